@@ -2,7 +2,9 @@
 
 from libcpp.string cimport string
 from libcpp.set cimport set as cpp_set
+from libcpp.vector cimport vector
 from libcpp cimport bool
+from libc.stdint cimport uint8_t, uint32_t, uint64_t, int32_t, int64_t
 from cython.operator cimport dereference as deref
 
 ############################################# BEGIN C++ DEFINITIONS #############################################
@@ -29,11 +31,22 @@ cdef extern from "<memory>" namespace "std":
         T& operator*() nogil
         T* get() nogil
 
+# std::mutex, to serialize calls on a context while the GIL is released
+cdef extern from "<mutex>" namespace "std" nogil:
+    cdef cppclass mutex:
+        mutex()
+        void lock()
+        void unlock()
+
 # Include ABE functionality from OpenABE
+# (every method is nogil: the bindings release the GIL around crypto calls)
 cdef extern from "<openabe/openabe.h>" namespace "oabe":
     cdef enum _OpenABE_ERROR:
         OpenABE_NOERROR = 0
     ctypedef _OpenABE_ERROR OpenABE_ERROR
+    cdef enum:
+        SESSION_CACHE_SIZE
+        DEFAULT_SESSION_MAX_RECORDS
     cdef enum _OpenABEFunctionInputType:
         FUNC_INVALID_INPUT = 0
         FUNC_POLICY_INPUT = 1
@@ -43,36 +56,47 @@ cdef extern from "<openabe/openabe.h>" namespace "oabe":
     void ShutdownOpenABE() except +RuntimeError
     cdef cppclass OpenABECryptoContext:
         OpenABECryptoContext(string scheme_id);
-        void generateParams() except +RuntimeError
-        void exportPublicParams(string& mpk)
-        void exportSecretParams(string& msk)
-        void importPublicParams(string& keyBlob)
-        void importSecretParams(string& keyBlob)
-        void importPublicParams(string& authID, string& keyBlob)
-        void importSecretParams(string& authID, string& keyBlob)
-        void importUserKey(string& keyID, string& keyBlob)
-        void exportUserKey(string& keyID, string& keyBlob)
-        void keygen(string& keyInput, string &keyID, string& authID, string &GID) except +RuntimeError
-        void encrypt(string encInput, string& plaintext, string& ciphertext) except +RuntimeError
-        bool decrypt(string& keyID, string& ciphertext, string& plaintext) except +RuntimeError
+        void generateParams() nogil except +RuntimeError
+        void exportPublicParams(string& mpk) nogil except +RuntimeError
+        void exportSecretParams(string& msk) nogil except +RuntimeError
+        void importPublicParams(string& keyBlob) nogil except +RuntimeError
+        void importSecretParams(string& keyBlob) nogil except +RuntimeError
+        void importPublicParams(string& authID, string& keyBlob) nogil except +RuntimeError
+        void importSecretParams(string& authID, string& keyBlob) nogil except +RuntimeError
+        void exportPublicParamsSnapshot(string& snapshot) nogil except +RuntimeError
+        void importPublicParamsSnapshot(const uint8_t *snapshot, size_t len) nogil except +RuntimeError
+        void saveSnapshot(const string& path) nogil except +RuntimeError
+        void loadSnapshot(const string& path) nogil except +RuntimeError
+        void importUserKey(string& keyID, string& keyBlob) nogil except +RuntimeError
+        void exportUserKey(string& keyID, string& keyBlob) nogil except +RuntimeError
+        void keygen(string& keyInput, string &keyID, string& authID, string &GID) nogil except +RuntimeError
+        void encrypt(string encInput, string& plaintext, string& ciphertext) nogil except +RuntimeError
+        void encryptBatch(string encInput, vector[string]& plaintexts, vector[string]& ciphertexts) nogil except +RuntimeError
+        bool decrypt(string& keyID, string& ciphertext, string& plaintext) nogil except +RuntimeError
+        size_t decryptBatch(string& keyID, vector[string]& ciphertexts, vector[string]& plaintexts, vector[bool]& decrypted) nogil except +RuntimeError
+        void sessionOpen(string encInput, string& header, uint64_t maxRecords, uint32_t maxSeconds) nogil except +RuntimeError
+        bool sessionEncrypt(string& plaintext, string& record, string& header) nogil except +RuntimeError
+        void sessionClose() nogil except +RuntimeError
+        bool sessionAccept(string& keyID, string& header) nogil except +RuntimeError
+        bool sessionDecrypt(string& record, string& plaintext) nogil except +RuntimeError
     cdef cppclass OpenPKEContext:
         OpenPKEContext(string ec_id)
-        void exportPublicKey(string key_id, string& keyBlob)
-        void exportPrivateKey(string key_id, string& keyBlob)
-        void importPublicKey(string key_id, string& keyBlob)
-        void importPrivateKey(string key_id, string& keyBlob)
-        void keygen(string key_id) except +RuntimeError
-        bool encrypt(string receiver_id, string& plaintext, string& ciphertext) except +RuntimeError
-        bool decrypt(string receiver_id, string& ciphertext, string& plaintext) except +RuntimeError
+        void exportPublicKey(string key_id, string& keyBlob) nogil except +RuntimeError
+        void exportPrivateKey(string key_id, string& keyBlob) nogil except +RuntimeError
+        void importPublicKey(string key_id, string& keyBlob) nogil except +RuntimeError
+        void importPrivateKey(string key_id, string& keyBlob) nogil except +RuntimeError
+        void keygen(string key_id) nogil except +RuntimeError
+        bool encrypt(string receiver_id, string& plaintext, string& ciphertext) nogil except +RuntimeError
+        bool decrypt(string receiver_id, string& ciphertext, string& plaintext) nogil except +RuntimeError
     cdef cppclass OpenPKSIGContext:
         OpenPKSIGContext(string ec_id)
-        void exportPublicKey(string key_id, string& keyBlob)
-        void exportPrivateKey(string key_id, string& keyBlob)
-        void importPublicKey(string key_id, string& keyBlob)
-        void importPrivateKey(string key_id, string& keyBlob)
-        void keygen(string key_id)
-        void sign(string key_id, string& message, string& signature)
-        bool verify(string key_id, string& message, string& signature)
+        void exportPublicKey(string key_id, string& keyBlob) nogil except +RuntimeError
+        void exportPrivateKey(string key_id, string& keyBlob) nogil except +RuntimeError
+        void importPublicKey(string key_id, string& keyBlob) nogil except +RuntimeError
+        void importPrivateKey(string key_id, string& keyBlob) nogil except +RuntimeError
+        void keygen(string key_id) nogil except +RuntimeError
+        void sign(string key_id, string& message, string& signature) nogil except +RuntimeError
+        bool verify(string key_id, string& message, string& signature) nogil except +RuntimeError
     const char* OpenABE_errorToString(OpenABE_ERROR)
 
 ############################################# END C++ DEFINITIONS #############################################
@@ -97,58 +121,295 @@ def to_bytes(obj):
     else:
         raise PyOpenABEError("invalid string type: 'str' or 'bytes' allowed. Got '%s'" % type(obj))
 
+# str (UTF-8 encoded), or any contiguous buffer (bytes, bytearray,
+# memoryview, ...) read in place: the only copy is into the C++ string
+cdef string as_string(obj) except *:
+    cdef const unsigned char[::1] view
+    if isinstance(obj, unicode):
+        obj = (<unicode>obj).encode('UTF-8')
+    try:
+        view = obj
+    except (TypeError, ValueError, BufferError):
+        raise PyOpenABEError("invalid input type: 'str' or a bytes-like object allowed. Got '%s'" % type(obj))
+    if view.shape[0] == 0:
+        return string()
+    return string(<const char*>&view[0], view.shape[0])
+
+# buffers of imported snapshots: their tables are used in place, so they
+# stay referenced (and an mmap stays open) for the life of the process
+_attached_snapshots = []
+
+# Columns: a pyarrow (Chunked)Array of binary or string values is read
+# straight from its buffers, anything else (NumPy object array, list, ...)
+# element by element. None (or an Arrow null) is a missing value.
+cdef bool is_arrow(obj):
+    return type(obj).__module__.split('.')[0] == 'pyarrow'
+
+cdef void read_arrow_chunk(arr, vector[string]& out, vector[bool]& valid) except *:
+    import pyarrow as pa
+    cdef bool large
+    if pa.types.is_binary(arr.type) or pa.types.is_string(arr.type):
+        large = False
+    elif pa.types.is_large_binary(arr.type) or pa.types.is_large_string(arr.type):
+        large = True
+    else:
+        raise PyOpenABEError("unsupported Arrow type '%s': binary or string expected" % arr.type)
+    cdef size_t n = len(arr)
+    if n == 0:
+        return
+    bufs = arr.buffers()
+    cdef const unsigned char[::1] bitmap
+    cdef const unsigned char[::1] offsets = bufs[1]
+    cdef const unsigned char[::1] data
+    cdef bool has_nulls = bufs[0] is not None and arr.null_count > 0
+    cdef bool has_data = bufs[2] is not None and bufs[2].size > 0
+    if has_nulls:
+        bitmap = bufs[0]
+    if has_data:
+        data = bufs[2]
+    cdef size_t base = arr.offset, i, j
+    cdef int64_t start, end
+    for i in range(n):
+        j = base + i
+        if has_nulls and not (bitmap[j >> 3] >> (j & 7)) & 1:
+            out.push_back(string())
+            valid.push_back(False)
+            continue
+        if large:
+            start = (<const int64_t*>&offsets[0])[j]
+            end = (<const int64_t*>&offsets[0])[j + 1]
+        else:
+            start = (<const int32_t*>&offsets[0])[j]
+            end = (<const int32_t*>&offsets[0])[j + 1]
+        if end > start:
+            out.push_back(string(<const char*>&data[start], end - start))
+        else:
+            out.push_back(string())
+        valid.push_back(True)
+
+cdef void read_column(values, vector[string]& out, vector[bool]& valid) except *:
+    if is_arrow(values):
+        for chunk in (values.chunks if hasattr(values, 'chunks') else [values]):
+            read_arrow_chunk(chunk, out, valid)
+        return
+    for value in values:
+        if value is None:
+            out.push_back(string())
+            valid.push_back(False)
+        else:
+            out.push_back(as_string(value))
+            valid.push_back(True)
+
+# the output column in the kind of the input: an Arrow binary array built
+# from buffers, a NumPy object array, or a list
+cdef make_column(like, vector[string]& values, vector[bool]& valid):
+    cdef size_t n = values.size(), i, total = 0, nulls = 0
+    cdef string data
+    cdef vector[uint8_t] bitmap
+    cdef vector[int32_t] offsets
+    cdef vector[int64_t] large_offsets
+    cdef bool large
+    if is_arrow(like):
+        import pyarrow as pa
+        for i in range(n):
+            if valid[i]:
+                total += values[i].size()
+        large = total > 0x7FFFFFFF
+        data.reserve(total)
+        bitmap.resize((n + 7) // 8)
+        with nogil:
+            for i in range(n + 1):
+                if large:
+                    large_offsets.push_back(data.size())
+                else:
+                    offsets.push_back(data.size())
+                if i == n:
+                    break
+                if valid[i]:
+                    bitmap[i >> 3] |= 1 << (i & 7)
+                    data.append(values[i])
+                else:
+                    nulls += 1
+        if large:
+            offsets_buf = pa.py_buffer((<char*>large_offsets.data())[:(n + 1) * 8])
+        else:
+            offsets_buf = pa.py_buffer((<char*>offsets.data())[:(n + 1) * 4])
+        return pa.Array.from_buffers(pa.large_binary() if large else pa.binary(), n,
+                                     [pa.py_buffer((<char*>bitmap.data())[:bitmap.size()]) if nulls else None,
+                                      offsets_buf, pa.py_buffer(data)],
+                                     null_count=nulls)
+    result = [values[i] if valid[i] else None for i in range(n)]
+    if type(like).__module__ == 'numpy':
+        import numpy
+        column = numpy.empty(n, dtype=object)
+        column[:] = result
+        return column
+    return result
+
 ########################################### PK ENC CONTEXT #############################################
 
 # main wrapper for encryption/signature contexts
+#
+# Crypto calls run without the GIL, so Python threads using different
+# contexts run in parallel; calls on one context are serialized by its lock.
 cdef class PyABEContext:
     cdef OpenABECryptoContext *thisptr
+    cdef mutex *lock
     def __cinit__(self, scheme):
         cdef string scheme_id = to_bytes(scheme)
         self.thisptr = new OpenABECryptoContext(scheme_id)
+        self.lock = new mutex()
 
     def __dealloc__(self):
         del self.thisptr
+        del self.lock
 
     def generateParams(self):
-        return self.thisptr.generateParams()
+        with nogil:
+            self.lock.lock()
+            try:
+                self.thisptr.generateParams()
+            finally:
+                self.lock.unlock()
 
     def exportPublicParams(self):
         cdef string mpk = string(b"")
-        self.thisptr.exportPublicParams(mpk)
+        with nogil:
+            self.lock.lock()
+            try:
+                self.thisptr.exportPublicParams(mpk)
+            finally:
+                self.lock.unlock()
         return mpk
 
     def exportSecretParams(self):
         cdef string msk = string(b"")
-        self.thisptr.exportSecretParams(msk)
+        with nogil:
+            self.lock.lock()
+            try:
+                self.thisptr.exportSecretParams(msk)
+            finally:
+                self.lock.unlock()
         return msk
 
-    def importPublicParams(self, keyBlob):
-        cdef string key = to_bytes(keyBlob)
-        return self.thisptr.importPublicParams(key)
-
-    def importPublicParams(self, authID, keyBlob):
-        cdef string auth_id = to_bytes(authID)
-        cdef string key = to_bytes(keyBlob)
-        return self.thisptr.importPublicParams(auth_id, key)
+    # importPublicParams(keyBlob) or importPublicParams(authID, keyBlob)
+    def importPublicParams(self, *args):
+        cdef string auth_id
+        cdef string key = as_string(args[-1])
+        cdef bool with_auth = len(args) > 1
+        if with_auth:
+            auth_id = to_bytes(args[0])
+        with nogil:
+            self.lock.lock()
+            try:
+                if with_auth:
+                    self.thisptr.importPublicParams(auth_id, key)
+                else:
+                    self.thisptr.importPublicParams(key)
+            finally:
+                self.lock.unlock()
+
+    # importSecretParams(keyBlob) or importSecretParams(authID, keyBlob)
+    def importSecretParams(self, *args):
+        cdef string auth_id
+        cdef string key = as_string(args[-1])
+        cdef bool with_auth = len(args) > 1
+        if with_auth:
+            auth_id = to_bytes(args[0])
+        with nogil:
+            self.lock.lock()
+            try:
+                if with_auth:
+                    self.thisptr.importSecretParams(auth_id, key)
+                else:
+                    self.thisptr.importSecretParams(key)
+            finally:
+                self.lock.unlock()
+
+    def exportPublicParamsSnapshot(self):
+        """The public params with their precomputed tables, for other
+        processes to pass to importPublicParamsSnapshot (write it to a
+        file or shared memory). Specific to the build of the library."""
+        cdef string snapshot = string(b"")
+        try:
+            with nogil:
+                self.lock.lock()
+                try:
+                    self.thisptr.exportPublicParamsSnapshot(snapshot)
+                finally:
+                    self.lock.unlock()
+        except RuntimeError as e:
+            raise PyOpenABEError(str(e))
+        return snapshot
+
+    def importPublicParamsSnapshot(self, snapshot):
+        """Import public params from a snapshot without recomputing their
+        tables. Any buffer works; an mmap (or multiprocessing shared
+        memory) is read in place and shared by every process that maps it,
+        and is kept open from then on."""
+        cdef const unsigned char[::1] view
+        try:
+            view = snapshot
+        except (TypeError, ValueError, BufferError):
+            raise PyOpenABEError("invalid snapshot type: a bytes-like object is required. Got '%s'" % type(snapshot))
+        if view.shape[0] == 0:
+            raise PyOpenABEError("empty snapshot")
+        try:
+            with nogil:
+                self.lock.lock()
+                try:
+                    self.thisptr.importPublicParamsSnapshot(&view[0], view.shape[0])
+                finally:
+                    self.lock.unlock()
+        except RuntimeError as e:
+            raise PyOpenABEError(str(e))
+        _attached_snapshots.append(view)
 
-    def importSecretParams(self, keyBlob):
-        cdef string key = to_bytes(keyBlob)
-        return self.thisptr.importSecretParams(key)
+    def saveSnapshot(self, path):
+        """Write the public params, user keys and their precomputed state to
+        a file (owner-only permissions) for loadSnapshot."""
+        cdef string path_str = to_bytes(path)
+        try:
+            with nogil:
+                self.lock.lock()
+                try:
+                    self.thisptr.saveSnapshot(path_str)
+                finally:
+                    self.lock.unlock()
+        except RuntimeError as e:
+            raise PyOpenABEError(str(e))
 
-    def importSecretParams(self, authID, keyBlob):
-        cdef string auth_id = to_bytes(authID)
-        cdef string key = to_bytes(keyBlob)
-        return self.thisptr.importSecretParams(auth_id, key)
+    def loadSnapshot(self, path):
+        cdef string path_str = to_bytes(path)
+        try:
+            with nogil:
+                self.lock.lock()
+                try:
+                    self.thisptr.loadSnapshot(path_str)
+                finally:
+                    self.lock.unlock()
+        except RuntimeError as e:
+            raise PyOpenABEError(str(e))
 
     def importUserKey(self, keyID, keyBlob):
         cdef string key_id = to_bytes(keyID)
-        cdef string key = to_bytes(keyBlob)
-        return self.thisptr.importUserKey(key_id, key)
+        cdef string key = as_string(keyBlob)
+        with nogil:
+            self.lock.lock()
+            try:
+                self.thisptr.importUserKey(key_id, key)
+            finally:
+                self.lock.unlock()
 
     def exportUserKey(self, keyID):
         cdef string key_id = to_bytes(keyID)
         cdef string key = string(b"")
-        self.thisptr.exportUserKey(key_id, key)
+        with nogil:
+            self.lock.lock()
+            try:
+                self.thisptr.exportUserKey(key_id, key)
+            finally:
+                self.lock.unlock()
         return key
 
     def keygen(self, keyInput, keyID, authID="", GID=""):
@@ -157,71 +418,256 @@ cdef class PyABEContext:
         cdef string auth_id = to_bytes(authID)
         cdef string gid_id = to_bytes(GID)
         try:
-            return self.thisptr.keygen(key_input, key_id, auth_id, gid_id)
+            with nogil:
+                self.lock.lock()
+                try:
+                    self.thisptr.keygen(key_input, key_id, auth_id, gid_id)
+                finally:
+                    self.lock.unlock()
         except RuntimeError as e:
             raise PyOpenABEError(str(e))
 
     def encrypt(self, encInput, plaintext):
         cdef string enc_input = to_bytes(encInput)
-        cdef string pt = to_bytes(plaintext) # expected to be bytes
+        cdef string pt = as_string(plaintext)
         cdef string ciphertext = string(b"")
         try:
-            self.thisptr.encrypt(enc_input, pt, ciphertext)
+            with nogil:
+                self.lock.lock()
+                try:
+                    self.thisptr.encrypt(enc_input, pt, ciphertext)
+                finally:
+                    self.lock.unlock()
             return ciphertext
         except RuntimeError as e:
             raise PyOpenABEError(str(e))
 
+    def encrypt_many(self, encInput, plaintexts):
+        """Encrypt every plaintext under encInput in one call (the library
+        spreads the batch over its thread pool). Returns the ciphertexts."""
+        cdef string enc_input = to_bytes(encInput)
+        cdef vector[string] pts
+        cdef vector[string] cts
+        for plaintext in plaintexts:
+            pts.push_back(as_string(plaintext))
+        try:
+            with nogil:
+                self.lock.lock()
+                try:
+                    self.thisptr.encryptBatch(enc_input, pts, cts)
+                finally:
+                    self.lock.unlock()
+        except RuntimeError as e:
+            raise PyOpenABEError(str(e))
+        return [cts[i] for i in range(cts.size())]
+
     def decrypt(self, keyID, ciphertext):
         cdef string key_id = to_bytes(keyID)
         cdef string pt = string(b"")
-        cdef string ct = to_bytes(ciphertext)
-        res = self.thisptr.decrypt(key_id, ct, pt)
+        cdef string ct = as_string(ciphertext)
+        cdef bool res = False
+        with nogil:
+            self.lock.lock()
+            try:
+                res = self.thisptr.decrypt(key_id, ct, pt)
+            finally:
+                self.lock.unlock()
         if res:
             return pt
         else:
             raise PyOpenABEError("Failed to decrypt!")
 
+    def decrypt_many(self, keyID, ciphertexts):
+        """Decrypt every ciphertext with keyID in one call. Returns a list
+        with the plaintext of each ciphertext, or None where it failed."""
+        cdef string key_id = to_bytes(keyID)
+        cdef vector[string] cts
+        cdef vector[string] pts
+        cdef vector[bool] decrypted
+        for ciphertext in ciphertexts:
+            cts.push_back(as_string(ciphertext))
+        try:
+            with nogil:
+                self.lock.lock()
+                try:
+                    self.thisptr.decryptBatch(key_id, cts, pts, decrypted)
+                finally:
+                    self.lock.unlock()
+        except RuntimeError as e:
+            raise PyOpenABEError(str(e))
+        return [pts[i] if decrypted[i] else None for i in range(pts.size())]
+
+    def encrypt_column(self, values, policies, max_records=DEFAULT_SESSION_MAX_RECORDS):
+        """Encrypt a column: values is a pyarrow binary (or string) array,
+        a NumPy object array or a sequence, and policies is one policy (or
+        attribute list) for every row or a column of them. The rows of each
+        distinct policy share one envelope session (see sessionOpen in the
+        C++ API), so a row costs one AES-GCM call instead of an ABE
+        encryption. Returns (ciphertexts, headers): the ciphertexts in the
+        kind of column given (None stays None) and the session headers that
+        decrypt_column needs. Values must not be empty."""
+        cdef vector[string] pts
+        cdef vector[string] cts
+        cdef vector[string] headers
+        cdef vector[bool] valid
+        cdef vector[size_t] rows
+        cdef string enc_input
+        cdef string header
+        cdef uint64_t max_recs = max_records
+        cdef size_t i, k
+        read_column(values, pts, valid)
+        # the rows of each distinct policy
+        groups = {}
+        if isinstance(policies, (unicode, bytes)):
+            groups[to_bytes(policies)] = [i for i in range(pts.size()) if valid[i]]
+        else:
+            pols = policies.to_pylist() if is_arrow(policies) else policies
+            if len(pols) != pts.size():
+                raise PyOpenABEError("got %d policies for %d values" % (len(pols), pts.size()))
+            for i, pol in enumerate(pols):
+                if valid[i]:
+                    if pol is None:
+                        raise PyOpenABEError("no policy for row %d" % i)
+                    groups.setdefault(to_bytes(pol), []).append(i)
+        cts.resize(pts.size())
+        try:
+            for policy, group in groups.items():
+                enc_input = policy
+                rows.clear()
+                for i in group:
+                    rows.push_back(i)
+                with nogil:
+                    self.lock.lock()
+                    try:
+                        self.thisptr.sessionOpen(enc_input, header, max_recs, 0)
+                        headers.push_back(header)
+                        for k in range(rows.size()):
+                            # true when the session key was replaced
+                            if self.thisptr.sessionEncrypt(pts[rows[k]], cts[rows[k]], header):
+                                headers.push_back(header)
+                    finally:
+                        self.thisptr.sessionClose()
+                        self.lock.unlock()
+        except RuntimeError as e:
+            raise PyOpenABEError(str(e))
+        return make_column(values, cts, valid), [headers[i] for i in range(headers.size())]
+
+    def decrypt_column(self, keyID, ciphertexts, headers):
+        """Decrypt a column from encrypt_column with keyID: each session
+        header is decrypted once (those keyID does not satisfy are skipped)
+        and then the rows of its session. Returns the plaintexts in the kind
+        of column given, with None where a row could not be decrypted."""
+        cdef string key_id = to_bytes(keyID)
+        cdef vector[string] cts
+        cdef vector[string] pts
+        cdef vector[string] hdrs
+        cdef vector[bool] valid
+        cdef vector[bool] decrypted
+        cdef size_t i, h, start = 0, stop
+        cdef bool accepted
+        read_column(ciphertexts, cts, valid)
+        for header in headers:
+            hdrs.push_back(as_string(header))
+        pts.resize(cts.size())
+        decrypted.resize(cts.size())
+        try:
+            with nogil:
+                self.lock.lock()
+                try:
+                    # the context keeps SESSION_CACHE_SIZE sessions, so the
+                    # headers are taken that many at a time
+                    while start < hdrs.size():
+                        stop = min(start + SESSION_CACHE_SIZE, hdrs.size())
+                        accepted = False
+                        for h in range(start, stop):
+                            if self.thisptr.sessionAccept(key_id, hdrs[h]):
+                                accepted = True
+                        if accepted:
+                            for i in range(cts.size()):
+                                if valid[i] and not decrypted[i]:
+                                    decrypted[i] = self.thisptr.sessionDecrypt(cts[i], pts[i])
+                        start = stop
+                finally:
+                    self.lock.unlock()
+        except RuntimeError as e:
+            raise PyOpenABEError(str(e))
+        return make_column(ciphertexts, pts, decrypted)
+
 # class for PKE encryption
 cdef class PyPKEContext:
     cdef OpenPKEContext *thisptr
+    cdef mutex *lock
     def __cinit__(self, curve_id="NIST_P256"):
         cdef string curve = to_bytes(curve_id)
         self.thisptr = new OpenPKEContext(curve)
+        self.lock = new mutex()
 
     def __dealloc__(self):
         del self.thisptr
+        del self.lock
 
     def exportPublicKey(self, keyID):
         cdef string key_id = to_bytes(keyID)
         cdef string key = string(b"")
-        self.thisptr.exportPublicKey(key_id, key)
+        with nogil:
+            self.lock.lock()
+            try:
+                self.thisptr.exportPublicKey(key_id, key)
+            finally:
+                self.lock.unlock()
         return key
 
     def exportPrivateKey(self, keyID):
         cdef string key_id = to_bytes(keyID)
         cdef string key = string(b"")
-        self.thisptr.exportPrivateKey(key_id, key)
+        with nogil:
+            self.lock.lock()
+            try:
+                self.thisptr.exportPrivateKey(key_id, key)
+            finally:
+                self.lock.unlock()
         return key
 
     def importPublicKey(self, keyID, keyBlob):
         cdef string key_id = to_bytes(keyID)
-        cdef string key = to_bytes(keyBlob)
-        return self.thisptr.importPublicKey(key_id, key)
+        cdef string key = as_string(keyBlob)
+        with nogil:
+            self.lock.lock()
+            try:
+                self.thisptr.importPublicKey(key_id, key)
+            finally:
+                self.lock.unlock()
 
     def importPrivateKey(self, keyID, keyBlob):
         cdef string key_id = to_bytes(keyID)
-        cdef string key = to_bytes(keyBlob)
-        return self.thisptr.importPrivateKey(key_id, key)
+        cdef string key = as_string(keyBlob)
+        with nogil:
+            self.lock.lock()
+            try:
+                self.thisptr.importPrivateKey(key_id, key)
+            finally:
+                self.lock.unlock()
 
     def keygen(self, keyID):
         cdef string key_id = to_bytes(keyID)
-        return self.thisptr.keygen(key_id)
+        with nogil:
+            self.lock.lock()
+            try:
+                self.thisptr.keygen(key_id)
+            finally:
+                self.lock.unlock()
 
     def encrypt(self, receiver_id, pt):
         cdef string rec_id = to_bytes(receiver_id)
-        cdef string pt_str = pt # expected to be bytes
+        cdef string pt_str = as_string(pt)
         cdef string ct = string(b"")
-        res = self.thisptr.encrypt(rec_id, pt_str, ct)
+        cdef bool res = False
+        with nogil:
+            self.lock.lock()
+            try:
+                res = self.thisptr.encrypt(rec_id, pt_str, ct)
+            finally:
+                self.lock.unlock()
         if res:
             return ct
         else:
@@ -229,9 +675,15 @@ cdef class PyPKEContext:
 
     def decrypt(self, receiver_id, ciphertext):
         cdef string rec_id = to_bytes(receiver_id)
-        cdef string ct = to_bytes(ciphertext)
+        cdef string ct = as_string(ciphertext)
         cdef string pt_str = string(b"")
-        res = self.thisptr.decrypt(rec_id, ct, pt_str)
+        cdef bool res = False
+        with nogil:
+            self.lock.lock()
+            try:
+                res = self.thisptr.decrypt(rec_id, ct, pt_str)
+            finally:
+                self.lock.unlock()
         if res:
             return pt_str
         else:
@@ -240,54 +692,94 @@ cdef class PyPKEContext:
 # class for PKSig
 cdef class PyPKSIGContext:
     cdef OpenPKSIGContext *thisptr
+    cdef mutex *lock
     def __cinit__(self, curve_id="NIST_P256"):
         cdef string curve = to_bytes(curve_id)
         self.thisptr = new OpenPKSIGContext(curve)
+        self.lock = new mutex()
 
     def __dealloc__(self):
         del self.thisptr
+        del self.lock
 
     def exportPublicKey(self, keyID):
         cdef string key_id = to_bytes(keyID)
         cdef string key = string(b"")
-        self.thisptr.exportPublicKey(key_id, key)
+        with nogil:
+            self.lock.lock()
+            try:
+                self.thisptr.exportPublicKey(key_id, key)
+            finally:
+                self.lock.unlock()
         return key
 
     def exportPrivateKey(self, keyID):
         cdef string key_id = to_bytes(keyID)
         cdef string key = string(b"")
-        self.thisptr.exportPrivateKey(key_id, key)
+        with nogil:
+            self.lock.lock()
+            try:
+                self.thisptr.exportPrivateKey(key_id, key)
+            finally:
+                self.lock.unlock()
         return key
 
     def importPublicKey(self, keyID, keyBlob):
         cdef string key_id = to_bytes(keyID)
-        cdef string key = to_bytes(keyBlob)
-        return self.thisptr.importPublicKey(key_id, key)
+        cdef string key = as_string(keyBlob)
+        with nogil:
+            self.lock.lock()
+            try:
+                self.thisptr.importPublicKey(key_id, key)
+            finally:
+                self.lock.unlock()
 
     def importPrivateKey(self, keyID, keyBlob):
         cdef string key_id = to_bytes(keyID)
-        cdef string key = to_bytes(keyBlob)
-        return self.thisptr.importPrivateKey(key_id, key)
+        cdef string key = as_string(keyBlob)
+        with nogil:
+            self.lock.lock()
+            try:
+                self.thisptr.importPrivateKey(key_id, key)
+            finally:
+                self.lock.unlock()
 
     def keygen(self, keyID):
         cdef string key_id = to_bytes(keyID)
-        return self.thisptr.keygen(key_id)
+        with nogil:
+            self.lock.lock()
+            try:
+                self.thisptr.keygen(key_id)
+            finally:
+                self.lock.unlock()
 
     def sign(self, keyID, message):
         cdef string key_id = to_bytes(keyID)
-        cdef string msg = to_bytes(message)
+        cdef string msg = as_string(message)
         cdef string sig = string(b"")
         try:
-            self.thisptr.sign(key_id, msg, sig)
+            with nogil:
+                self.lock.lock()
+                try:
+                    self.thisptr.sign(key_id, msg, sig)
+                finally:
+                    self.lock.unlock()
             return sig.decode('UTF-8')
         except RuntimeError as e:
             raise PyOpenABEError(str(e))
 
     def verify(self, keyID, message, signature):
         cdef string key_id = to_bytes(keyID)
-        cdef string msg = to_bytes(message)
-        cdef string sig = to_bytes(signature)
-        return self.thisptr.verify(key_id, msg, sig)
+        cdef string msg = as_string(message)
+        cdef string sig = as_string(signature)
+        cdef bool res = False
+        with nogil:
+            self.lock.lock()
+            try:
+                res = self.thisptr.verify(key_id, msg, sig)
+            finally:
+                self.lock.unlock()
+        return res
 
 ########################################### CREATE OpenABE CONTEXTS #############################################
 
@@ -40,6 +40,68 @@ assert pt1 == pt2, "Didn't recover the message!"
 
 print("CP-ABE Success!")
 
+print("Testing batch and threaded calls")
+
+pts = [pt1, bytearray(b"second"), memoryview(b"third")]
+cts = cpabe.encrypt_many("((one or two) and three)", pts)
+assert len(cts) == len(pts)
+cts.append(b"not a ciphertext")
+res = cpabe.decrypt_many("alice", cts)
+assert res[:3] == [bytes(p) for p in pts], "Didn't recover the batch!"
+assert res[3] is None
+
+import threading
+errors = []
+def worker(ctx):
+    try:
+        c = ctx.encrypt("((one or two) and three)", pt1)
+        assert ctx.decrypt("alice", c) == pt1
+    except Exception as e:
+        errors.append(e)
+threads = [threading.Thread(target=worker, args=(ctx,))
+           for ctx in [cpabe, cpabe2] * 4]
+for t in threads:
+    t.start()
+for t in threads:
+    t.join()
+assert not errors, errors
+print("Batch and threads Success!")
+
+print("Testing column encryption")
+
+values = [b"row%d" % i for i in range(100)]
+values[7] = None
+policies = ["((one or two) and three)" if i % 3 else "four" for i in range(100)]
+cts, headers = cpabe.encrypt_column(values, policies)
+assert len(cts) == len(values) and cts[7] is None
+assert len(headers) == 2
+res = cpabe.decrypt_column("alice", cts, headers)
+assert [r for i, r in enumerate(res) if i % 3] == [v for i, v in enumerate(values) if i % 3]
+assert all(r is None for i, r in enumerate(res) if i % 3 == 0)
+try:
+    import pyarrow as pa
+    column = pa.array(values, type=pa.binary())
+    cts, headers = cpabe.encrypt_column(column, "((one or two) and three)")
+    assert isinstance(cts, pa.Array) and cts.null_count == 1
+    assert cpabe.decrypt_column("alice", cts, headers).equals(column)
+except ImportError:
+    print("pyarrow not installed, skipping Arrow columns")
+print("Column encryption Success!")
+
+print("Testing public params snapshot")
+
+import mmap, tempfile
+snapshot = cpabe.exportPublicParamsSnapshot()
+with tempfile.TemporaryFile() as f:
+    f.write(snapshot)
+    f.flush()
+    mapped = mmap.mmap(f.fileno(), len(snapshot), access=mmap.ACCESS_READ)
+cpabe3 = openabe.CreateABEContext("CP-ABE")
+cpabe3.importPublicParamsSnapshot(mapped)
+ct = cpabe3.encrypt("((one or two) and three)", pt1)
+assert cpabe.decrypt("alice", ct) == pt1, "Didn't recover the message!"
+print("Snapshot Success!")
+
 
 pke = openabe.CreatePKEContext()
 
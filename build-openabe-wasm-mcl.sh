@@ -1,16 +1,56 @@
 #!/bin/bash
 # Build OpenABE library for WebAssembly using MCL (instead of RELIC)
 # This uses the wasi-sdk MCL build we created
+#
+# Usage: ./build-openabe-wasm-mcl.sh [--variant=generic|simd-threads] [--module]
+#
+# Variants (also settable with WASM_VARIANT):
+#   generic       wasm32-wasi, 32-bit MCL limbs; runs on every engine
+#   simd-threads  wasm32-wasi-threads with SIMD128, shared memory and
+#                 64-bit MCL limbs (wasm has native i64 multiply, so the
+#                 field code does a quarter of the limb products). Needs
+#                 a cross-origin isolated page for SharedArrayBuffer.
+#
+# --module also links wasm-bindings.cpp into openabe.wasm, or
+# openabe-<variant>.wasm for the non-generic variants; openabe-wrapper.js
+# picks the best one the engine supports.
 
 set -e
 
 # Configuration
 WASI_SDK_PATH="${WASI_SDK_PATH:-$HOME/wasi-sdk}"
 ZROOT="$(pwd)"
-WASM_BUILD_DIR="$ZROOT/build-wasm-mcl"
+WASM_VARIANT="${WASM_VARIANT:-generic}"
+LINK_MODULE=0
+for arg in "$@"; do
+    case "$arg" in
+        --variant=*) WASM_VARIANT="${arg#--variant=}" ;;
+        --module) LINK_MODULE=1 ;;
+    esac
+done
+
+case "$WASM_VARIANT" in
+    generic)
+        WASM_TARGET="wasm32-wasi"
+        VARIANT_FLAGS=""
+        VARIANT_SUFFIX=""
+        ;;
+    simd-threads)
+        WASM_TARGET="wasm32-wasi-threads"
+        VARIANT_FLAGS="-msimd128 -matomics -mbulk-memory -pthread -DMCL_SIZEOF_UNIT=8"
+        VARIANT_SUFFIX="-simd-threads"
+        ;;
+    *)
+        echo "Error: unknown WASM_VARIANT '$WASM_VARIANT' (expected generic or simd-threads)"
+        exit 1
+        ;;
+esac
+
+WASM_BUILD_DIR="$ZROOT/build-wasm-mcl$VARIANT_SUFFIX"
 WASM_OBJ_DIR="$WASM_BUILD_DIR/obj"
-WASM_PREFIX_MCL="$ZROOT/deps/root-wasm"  # MCL installation
-WASM_PREFIX_OTHER="$ZROOT/build-wasm/install"  # OpenSSL, GMP from RELIC build
+WASM_PREFIX_MCL="${WASM_PREFIX_MCL:-$ZROOT/deps/root-wasm$VARIANT_SUFFIX}"  # MCL installation
+WASM_PREFIX_OTHER="${WASM_PREFIX_OTHER:-$ZROOT/build-wasm/install}"  # OpenSSL, GMP from RELIC build
+MCL_SRC="${MCL_SRC:-$ZROOT/deps/mcl}"  # MCL checkout, built per variant if needed
 
 # Check if WASI SDK is installed
 if [ ! -f "$WASI_SDK_PATH/bin/clang" ]; then
@@ -19,22 +59,14 @@ if [ ! -f "$WASI_SDK_PATH/bin/clang" ]; then
     exit 1
 fi
 
-# Check if MCL is built
-if [ ! -f "$WASM_PREFIX_MCL/lib/libmcl.a" ]; then
-    echo "Error: MCL not found at $WASM_PREFIX_MCL"
-    echo "Please run: cd deps/mcl && make -f Makefile.wasm install"
-    exit 1
-fi
-
 # WASI-SDK tools
 export CC="$WASI_SDK_PATH/bin/clang"
 export CXX="$WASI_SDK_PATH/bin/clang++"
 export AR="$WASI_SDK_PATH/bin/llvm-ar"
 export RANLIB="$WASI_SDK_PATH/bin/llvm-ranlib"
 
-# WASM target and sysroot
+# WASM sysroot (the target comes from the variant)
 WASM_SYSROOT="$WASI_SDK_PATH/share/wasi-sysroot"
-WASM_TARGET="wasm32-wasi"
 
 # Compiler flags for building with MCL
 CFLAGS="--target=$WASM_TARGET --sysroot=$WASM_SYSROOT"
@@ -52,6 +84,7 @@ CFLAGS="$CFLAGS -I/Library/Developer/CommandLineTools/usr/include"  # FlexLexer.
 CFLAGS="$CFLAGS -fPIC"
 CFLAGS="$CFLAGS -mllvm -wasm-enable-sjlj"  # SJLJ exceptions
 CFLAGS="$CFLAGS -fexceptions"  # Enable C++ exceptions
+CFLAGS="$CFLAGS $VARIANT_FLAGS"  # Must match the flags MCL was built with
 
 CXXFLAGS="$CFLAGS -std=c++11"
 CXXFLAGS="$CXXFLAGS -Wall -Wsign-compare -fstrict-overflow"
@@ -71,10 +104,37 @@ error() { echo -e "${RED}[ERROR]${NC} $1"; exit 1; }
 # Create directories
 mkdir -p "$WASM_OBJ_DIR"
 
+# Build MCL for this variant from $MCL_SRC. Limb size and atomics are ABI:
+# the library and OpenABE must agree, so each variant has its own prefix.
+build_mcl() {
+    if [ ! -f "$MCL_SRC/src/fp.cpp" ]; then
+        return 1
+    fi
+
+    info "Building MCL ($WASM_VARIANT) from $MCL_SRC..."
+    mkdir -p "$WASM_PREFIX_MCL/lib" "$WASM_PREFIX_MCL/include"
+    $CXX --target=$WASM_TARGET --sysroot=$WASM_SYSROOT -O3 -DNDEBUG -std=c++11 \
+        -fexceptions $VARIANT_FLAGS \
+        -DMCL_USE_LLVM=0 -DMCL_DONT_USE_XBYAK -DMCL_DONT_USE_OPENSSL \
+        -DMCL_USE_VINT -DMCL_VINT_FIXED_BUFFER -DMCL_MAX_BIT_SIZE=384 \
+        -I"$MCL_SRC/include" -c "$MCL_SRC/src/fp.cpp" -o "$WASM_BUILD_DIR/mcl_fp.o"
+    $AR rcs "$WASM_PREFIX_MCL/lib/libmcl.a" "$WASM_BUILD_DIR/mcl_fp.o"
+    cp -r "$MCL_SRC/include/mcl" "$MCL_SRC/include/cybozu" "$WASM_PREFIX_MCL/include/"
+}
+
+# Check if MCL is built
+if [ ! -f "$WASM_PREFIX_MCL/lib/libmcl.a" ] && ! build_mcl; then
+    echo "Error: MCL not found at $WASM_PREFIX_MCL"
+    echo "Please run: cd deps/mcl && make -f Makefile.wasm install"
+    echo "or set MCL_SRC to an MCL checkout to build it for this variant"
+    exit 1
+fi
+
 # Source files (same as RELIC build)
 OABE_ZML_SRC=(
     "zml/zgroup.cpp"
     "zml/zpairing.cpp"
+    "zml/zfixedbase.cpp"
     "zml/zelliptic.cpp"
     "zml/zelement_ec.cpp"
     "zml/zelement_bp.cpp"
@@ -103,6 +163,8 @@ OABE_LOW_SRC=(
     "abe/zcontextcca.cpp"
     "abe/zcontextcpwaters.cpp"
     "abe/zcontextkpgpsw.cpp"
+    "abe/zcontextcpfame.cpp"
+    "abe/zcontextcpwatersfd.cpp"
 )
 
 OABE_TOOLS_SRC=(
@@ -112,6 +174,10 @@ OABE_TOOLS_SRC=(
 
 OABE_UTILS_SRC=(
     "utils/zkeymgr.cpp"
+    "utils/zkeystorelog.cpp"
+    "utils/zctblock.cpp"
+    "utils/zkeyring.cpp"
+    "utils/zperiodtree.cpp"
     "utils/zcryptoutils.cpp"
     "utils/zcontainer.cpp"
     "utils/zbenchmark.cpp"
@@ -122,6 +188,13 @@ OABE_UTILS_SRC=(
     "utils/zdriver.cpp"
     "utils/zfunctioninput.cpp"
     "utils/zcurveinfo.cpp"
+    "utils/ztrace.cpp"
+    "utils/zmetrics.cpp"
+    "utils/zcpu.cpp"
+    "utils/zthreadpool.cpp"
+    "utils/zarena.cpp"
+    "utils/zprecompute.cpp"
+    "utils/zbase64.cpp"
 )
 
 OABE_CORE_SRC=(
@@ -259,14 +332,39 @@ create_library() {
     info "Static library created: $WASM_BUILD_DIR/libopenabe.a"
 }
 
+# Link the JS bindings and the library into a loadable module
+create_wasm_module() {
+    local module="$WASM_BUILD_DIR/openabe$VARIANT_SUFFIX.wasm"
+    local link_flags="-Wl,--no-entry -Wl,--export-dynamic -Wl,--allow-undefined"
+
+    if [ "$WASM_VARIANT" = "simd-threads" ]; then
+        # the host creates the shared memory and hands it to every thread
+        link_flags="$link_flags -Wl,--import-memory -Wl,--shared-memory -Wl,--max-memory=4294967296"
+    fi
+
+    info "Linking $module..."
+    $CXX $CXXFLAGS -I"$ZROOT/wasm-bindings" \
+        "$ZROOT/wasm-bindings/wasm-bindings.cpp" \
+        -o "$module" \
+        $link_flags \
+        "$WASM_BUILD_DIR/libopenabe.a" \
+        -L"$WASM_PREFIX_MCL/lib" -L"$WASM_PREFIX_OTHER/lib" \
+        -lmcl -lcrypto
+
+    info "WebAssembly module created: $module"
+}
+
 # Main execution
 main() {
-    info "Building OpenABE for WebAssembly with MCL backend..."
+    info "Building OpenABE for WebAssembly with MCL backend ($WASM_VARIANT)..."
     info "MCL library: $WASM_PREFIX_MCL/lib/libmcl.a"
     info "MCL headers: $WASM_PREFIX_MCL/include/mcl/"
 
     compile_sources
     create_library
+    if [ "$LINK_MODULE" = "1" ]; then
+        create_wasm_module
+    fi
 
     info "OpenABE WebAssembly build complete (MCL backend)!"
     info "Output directory: $WASM_BUILD_DIR"
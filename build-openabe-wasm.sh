@@ -65,6 +65,7 @@ mkdir -p "$WASM_OBJ_DIR"
 OABE_ZML_SRC=(
     "zml/zgroup.cpp"
     "zml/zpairing.cpp"
+    "zml/zfixedbase.cpp"
     "zml/zelliptic.cpp"
     "zml/zelement_ec.cpp"
     "zml/zelement_bp.cpp"
@@ -86,6 +87,8 @@ OABE_LOW_SRC=(
     "abe/zcontextcca.cpp"
     "abe/zcontextcpwaters.cpp"
     "abe/zcontextkpgpsw.cpp"
+    "abe/zcontextcpfame.cpp"
+    "abe/zcontextcpwatersfd.cpp"
 )
 
 OABE_TOOLS_SRC=(
@@ -95,6 +98,10 @@ OABE_TOOLS_SRC=(
 
 OABE_UTILS_SRC=(
     "utils/zkeymgr.cpp"
+    "utils/zkeystorelog.cpp"
+    "utils/zctblock.cpp"
+    "utils/zkeyring.cpp"
+    "utils/zperiodtree.cpp"
     "utils/zcryptoutils.cpp"
     "utils/zcontainer.cpp"
     "utils/zbenchmark.cpp"
@@ -105,6 +112,13 @@ OABE_UTILS_SRC=(
     "utils/zdriver.cpp"
     "utils/zfunctioninput.cpp"
     "utils/zcurveinfo.cpp"
+    "utils/ztrace.cpp"
+    "utils/zmetrics.cpp"
+    "utils/zcpu.cpp"
+    "utils/zthreadpool.cpp"
+    "utils/zarena.cpp"
+    "utils/zprecompute.cpp"
+    "utils/zbase64.cpp"
 )
 
 OABE_CORE_SRC=(
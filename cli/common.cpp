@@ -31,6 +31,14 @@
 /// \author J. Ayo Akinyele
 ///
 
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "common.h"
 
 using namespace std;
@@ -56,6 +64,59 @@ void getFile(std::string &result, const std::string &filename) {
   fs.close();
 }
 
+// the files of a batch: every regular file in a directory (sorted by name),
+// or one file path per line of a manifest ('#' starts a comment)
+bool ListBatchInputs(const string &path, vector<string> &inputs)
+{
+    inputs.clear();
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return false;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        DIR *dir = opendir(path.c_str());
+        if (dir == nullptr) {
+            return false;
+        }
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            string file = path + "/" + entry->d_name;
+            if (stat(file.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+                inputs.push_back(file);
+            }
+        }
+        closedir(dir);
+        sort(inputs.begin(), inputs.end());
+        return true;
+    }
+
+    ifstream manifest(path);
+    if (!manifest.is_open()) {
+        return false;
+    }
+    string line;
+    while (getline(manifest, line)) {
+        if (!line.empty() && line[line.size()-1] == '\r') {
+            line.erase(line.size()-1);
+        }
+        if (!line.empty() && line[0] != '#') {
+            inputs.push_back(line);
+        }
+    }
+    return true;
+}
+
+// where a batch writes the output for input: next to it, or under outDir
+string BatchOutputPath(const string &input, const string &outDir)
+{
+    if (outDir.empty()) {
+        return input;
+    }
+    size_t pos = input.find_last_of('/');
+    string name = (pos == string::npos) ? input : input.substr(pos + 1);
+    return outDir + "/" + name;
+}
 
 OpenABE_SCHEME checkForScheme(string type, string &suffix)
 {
@@ -193,3 +254,187 @@ string ReadBinaryFile(const char* filename)
 
     return inputBlob;
 }
+
+/********************************************************************************
+ * Implementation of the InputFile class
+ ********************************************************************************/
+
+InputFile::InputFile() : fd_(-1), mapped_(false), map_(nullptr), mapLen_(0), pos_(0) {}
+
+InputFile::~InputFile()
+{
+    if (map_ != nullptr) {
+        munmap(map_, mapLen_);
+    }
+    if (fd_ > STDIN_FILENO) {
+        ::close(fd_);
+    }
+}
+
+void InputFile::open(const string &filename)
+{
+    if (filename == STDIO_FILENAME) {
+        fd_ = STDIN_FILENO;
+    } else if ((fd_ = ::open(filename.c_str(), O_RDONLY)) < 0) {
+        throw ios_base::failure("Could not open file " + filename);
+    }
+
+    struct stat st;
+    if (fstat(fd_, &st) == 0 && S_ISREG(st.st_mode)) {
+        mapped_ = true;
+        mapLen_ = (size_t)st.st_size;
+        if (mapLen_ == 0) {
+            return;
+        }
+        void *addr = mmap(nullptr, mapLen_, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (addr == MAP_FAILED) {
+            // fall back to reading it like a pipe
+            mapped_ = false;
+            mapLen_ = 0;
+            return;
+        }
+        map_ = (uint8_t *)addr;
+        madvise(map_, mapLen_, MADV_SEQUENTIAL);
+    }
+}
+
+size_t InputFile::read(const uint8_t **ptr, size_t maxLen)
+{
+    size_t n = 0;
+    if (mapped_) {
+        n = min(maxLen, mapLen_ - pos_);
+        *ptr = map_ + pos_;
+        pos_ += n;
+        return n;
+    }
+
+    // bytes left over from readLine() come first
+    if (pos_ < buf_.size()) {
+        n = min(maxLen, buf_.size() - pos_);
+        *ptr = &buf_[pos_];
+        pos_ += n;
+        return n;
+    }
+    buf_.resize(maxLen);
+    ssize_t rc;
+    do {
+        rc = ::read(fd_, &buf_[0], maxLen);
+    } while (rc < 0 && errno == EINTR);
+    if (rc < 0) {
+        throw ios_base::failure(string("Could not read input: ") + strerror(errno));
+    }
+    buf_.resize((size_t)rc);
+    pos_ = buf_.size();
+    *ptr = buf_.data();
+    return buf_.size();
+}
+
+bool InputFile::readLine(string &line)
+{
+    line.clear();
+    const uint8_t *ptr = nullptr;
+    size_t n;
+    while ((n = read(&ptr, BUFSIZ)) > 0) {
+        const uint8_t *nl = (const uint8_t *)memchr(ptr, '\n', n);
+        if (nl == nullptr) {
+            line.append((const char *)ptr, n);
+            continue;
+        }
+        line.append((const char *)ptr, nl - ptr);
+        // give back whatever follows the newline
+        pos_ -= n - (nl - ptr + 1);
+        return true;
+    }
+    return !line.empty();
+}
+
+void InputFile::readAll(string &result)
+{
+    result.clear();
+    if (mapped_) {
+        result.assign((const char *)map_ + pos_, mapLen_ - pos_);
+        pos_ = mapLen_;
+        return;
+    }
+    const uint8_t *ptr = nullptr;
+    size_t n;
+    while ((n = read(&ptr, IO_BLOCK_SIZE)) > 0) {
+        result.append((const char *)ptr, n);
+    }
+}
+
+/********************************************************************************
+ * Implementation of the OutputFile class
+ ********************************************************************************/
+
+OutputFile::OutputFile() : fd_(-1) {}
+
+OutputFile::~OutputFile()
+{
+    if (fd_ > STDOUT_FILENO) {
+        ::close(fd_);
+    }
+}
+
+void OutputFile::open(const string &filename)
+{
+    filename_ = filename;
+    if (filename == STDIO_FILENAME) {
+        fd_ = STDOUT_FILENO;
+    } else if ((fd_ = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+        throw ios_base::failure("Could not open file " + filename);
+    }
+}
+
+void OutputFile::write(const uint8_t *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t rc = ::write(fd_, buf, len);
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rc <= 0) {
+            throw ios_base::failure("Could not write to " + filename_ + ": " + strerror(errno));
+        }
+        buf += rc;
+        len -= (size_t)rc;
+    }
+}
+
+void OutputFile::close()
+{
+    if (fd_ > STDOUT_FILENO && ::close(fd_) != 0) {
+        fd_ = -1;
+        throw ios_base::failure("Could not write to " + filename_ + ": " + strerror(errno));
+    }
+    fd_ = -1;
+}
+
+void OutputFile::discard()
+{
+    if (fd_ > STDOUT_FILENO) {
+        ::close(fd_);
+        unlink(filename_.c_str());
+    }
+    fd_ = -1;
+}
+
+string ReadBlock(InputFile &input, const char* begin_header, const char* end_header)
+{
+    string line;
+    while (input.readLine(line)) {
+        if (line.compare(begin_header) == 0) {
+            return ReadBlockBody(input, end_header);
+        }
+    }
+    return "";
+}
+
+string ReadBlockBody(InputFile &input, const char* end_header)
+{
+    string block = "", line;
+    while (input.readLine(line) && line.compare(end_header) != 0) {
+        block += line;
+    }
+    return Base64Decode(block);
+}
@@ -41,6 +41,8 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <vector>
+#include <mutex>
 #include <openabe/openabe.h>
 
 #define DEFAULT_PARAMETER_STRING    DEFAULT_BP_PARAM // "BN_P256"
@@ -84,15 +86,71 @@
 /* encloses the ciphertext for symmetric key encryption portion */
 #define CT2_BEGIN_HEADER	"-----BEGIN CIPHERTEXT BLOCK-----"
 #define CT2_END_HEADER		"-----END CIPHERTEXT BLOCK-----"
+/* precedes the raw chunked AEAD payload, which runs to the end of the file */
+#define CT3_BEGIN_HEADER	"-----BEGIN CHUNKED CIPHERTEXT-----"
+
+#define STDIO_FILENAME      "-"
+#define IO_BLOCK_SIZE       (1 << 20)
+
+/* input file ("-" for stdin): regular files are memory-mapped, anything
+ * else (pipes, terminals) is read through a buffer */
+class InputFile {
+public:
+  InputFile();
+  ~InputFile();
+
+  void open(const std::string &filename);
+  bool isMapped() const { return mapped_; }
+  // the whole file, mapped files only
+  const uint8_t *data() const { return map_; }
+  size_t size() const { return mapLen_; }
+
+  // next span of at most maxLen bytes, valid until the next call (0 at EOF)
+  size_t read(const uint8_t **ptr, size_t maxLen);
+  // next line without its newline (false at EOF)
+  bool readLine(std::string &line);
+  void readAll(std::string &result);
+
+private:
+  int fd_;
+  bool mapped_;
+  uint8_t *map_;
+  size_t mapLen_, pos_;
+  std::vector<uint8_t> buf_;
+};
+
+/* output file ("-" for stdout), written as it is produced */
+class OutputFile {
+public:
+  OutputFile();
+  ~OutputFile();
+
+  void open(const std::string &filename);
+  void write(const uint8_t *buf, size_t len);
+  void write(const std::string &str) { write((const uint8_t *)str.data(), str.size()); }
+  void close();
+  bool isOpen() const { return fd_ >= 0; }
+  // closes and removes a partially written file (stdout cannot be undone)
+  void discard();
+
+private:
+  int fd_;
+  std::string filename_;
+};
 
 void getFile(std::string &result, const std::string &filename);
 std::string ReadFile(const char* filename);
 std::string ReadBlockFromFile(const char* begin_header, const char* end_header, const char* filename);
+std::string ReadBlock(InputFile &input, const char* begin_header, const char* end_header);
+std::string ReadBlockBody(InputFile &input, const char* end_header);
 std::string ReadBinaryFile(const char* filename);
 void WriteToFile(const char* filename, std::string outputStr);
 void WriteBinaryFile(const char* filename, std::string& outputStr);
 void WriteBinaryFile(const char* filename, uint8_t *buf, uint32_t len);
 
+bool ListBatchInputs(const std::string &path, std::vector<std::string> &inputs);
+std::string BatchOutputPath(const std::string &input, const std::string &outDir);
+
 OpenABE_SCHEME checkForScheme(std::string type, std::string &suffix);
 void addNameSeparator(std::string &prefix);
 void addFileExtension(std::string &filename, std::string ext);
@@ -0,0 +1,456 @@
+///
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+///
+/// This file is part of Zeutro's OpenABE.
+///
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+///
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+///
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+/// \file   daemon.cpp
+///
+/// \brief  OpenABE encryption/decryption daemon: keeps the parameters and
+///         keys loaded and serves requests over a Unix socket in batches
+///
+
+#include "common.h"
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <thread>
+
+using namespace std;
+using namespace oabe;
+
+#define USAGE \
+    "usage: [ -s scheme ] [ -p prefix ] [ -k key ] ... [ -S socket ] [ -w window ] [ -b batch ] -v\n\n" \
+    "\t-v : turn on verbosity\n" \
+    "\t-s : scheme types are 'CP' or 'KP'\n" \
+    "\t-k : secret key file to serve, named by its file name in requests (repeatable)\n" \
+    "\t-S : path of the Unix socket to listen on\n" \
+    "\t-w : microseconds to wait for more requests before running a batch (default: 1000)\n" \
+    "\t-b : most requests to run in one batch (default: 256)\n" \
+    "\t-p : prefix for generated authority public and secret parameter files (optional)\n\n" \
+
+/*
+ * Protocol (integers are 32-bit big-endian):
+ *   request:  [op (1)] [request id] [input length] [input] [data length] [data]
+ *   response: [request id] [status (1)] [output length] [output]
+ * DAEMON_OP_ENCRYPT encrypts the data under the input policy ('CP') or
+ * attribute list ('KP'); DAEMON_OP_DECRYPT decrypts the data with the key
+ * named by the input. Ciphertexts are those of the crypto box without
+ * base64 (OpenABECryptoContext(scheme, false)). The status is 0 or the
+ * OpenABE_ERROR of the failure. A client may send several requests before
+ * reading; responses come back as their batches finish, in any order.
+ */
+#define DAEMON_OP_ENCRYPT        1
+#define DAEMON_OP_DECRYPT        2
+#define MAX_REQUEST_FIELD_LEN    (1 << 26)
+#define DEFAULT_BATCH_WINDOW_US  1000
+#define DEFAULT_MAX_BATCH        256
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onStopSignal(int) {
+  stopRequested = 1;
+}
+
+static uint32_t getBE32(const uint8_t *buf) {
+  return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) |
+         ((uint32_t)buf[2] << 8) | (uint32_t)buf[3];
+}
+
+static void putBE32(uint8_t *buf, uint32_t x) {
+  buf[0] = (x >> 24) & 0xFF;
+  buf[1] = (x >> 16) & 0xFF;
+  buf[2] = (x >> 8) & 0xFF;
+  buf[3] = x & 0xFF;
+}
+
+/* a client connection, shared by its reader thread and the requests it
+ * queued; closed once both are done with it */
+class Connection {
+public:
+  explicit Connection(int fd) : fd_(fd) {}
+  ~Connection() { ::close(fd_); }
+
+  bool readFully(uint8_t *buf, size_t len) {
+    while (len > 0) {
+      ssize_t n = ::read(fd_, buf, len);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        return false;
+      }
+      buf += n;
+      len -= n;
+    }
+    return true;
+  }
+
+  bool readField(string &field) {
+    uint8_t len[4];
+    if (!readFully(len, sizeof(len))) {
+      return false;
+    }
+    uint32_t n = getBE32(len);
+    if (n > MAX_REQUEST_FIELD_LEN) {
+      return false;
+    }
+    field.resize(n);
+    return (n == 0) || readFully((uint8_t *)&field[0], n);
+  }
+
+  // a client that went away just loses its responses
+  void respond(uint32_t id, OpenABE_ERROR status, const string &output) {
+    uint8_t hdr[9];
+    putBE32(hdr, id);
+    hdr[4] = (uint8_t)status;
+    putBE32(hdr + 5, (uint32_t)output.size());
+    lock_guard<mutex> guard(writeLock_);
+    if (writeFully(hdr, sizeof(hdr))) {
+      writeFully((const uint8_t *)output.data(), output.size());
+    }
+  }
+
+  void shutdownRead() { ::shutdown(fd_, SHUT_RD); }
+
+private:
+  bool writeFully(const uint8_t *buf, size_t len) {
+    while (len > 0) {
+      ssize_t n = ::write(fd_, buf, len);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        return false;
+      }
+      buf += n;
+      len -= n;
+    }
+    return true;
+  }
+
+  int fd_;
+  mutex writeLock_;
+};
+
+struct Request {
+  shared_ptr<Connection> conn;
+  uint8_t op;
+  uint32_t id;
+  string input, data;
+};
+
+/* requests from every connection, taken out by the dispatcher in batches */
+class RequestQueue {
+public:
+  void push(Request &req) {
+    lock_guard<mutex> guard(lock_);
+    pending_.push_back(std::move(req));
+    if (pending_.size() == 1 || pending_.size() >= maxBatch_) {
+      ready_.notify_one();
+    }
+  }
+
+  void configure(chrono::microseconds window, size_t maxBatch) {
+    window_ = window;
+    maxBatch_ = maxBatch;
+  }
+
+  // waits for a request, then up to the batch window for others to join
+  // it (false if the daemon is stopping)
+  bool takeBatch(vector<Request> &batch) {
+    unique_lock<mutex> guard(lock_);
+    while (pending_.empty()) {
+      if (stopRequested) {
+        return false;
+      }
+      ready_.wait_for(guard, chrono::milliseconds(100));
+    }
+    const auto deadline = chrono::steady_clock::now() + window_;
+    ready_.wait_until(guard, deadline, [this]() {
+      return pending_.size() >= maxBatch_ || stopRequested;
+    });
+
+    const size_t count = min(pending_.size(), maxBatch_);
+    batch.clear();
+    for (size_t i = 0; i < count; i++) {
+      batch.push_back(std::move(pending_.front()));
+      pending_.pop_front();
+    }
+    return true;
+  }
+
+private:
+  mutex lock_;
+  condition_variable ready_;
+  deque<Request> pending_;
+  chrono::microseconds window_{DEFAULT_BATCH_WINDOW_US};
+  size_t maxBatch_ = DEFAULT_MAX_BATCH;
+};
+
+static void serveConnection(shared_ptr<Connection> conn, shared_ptr<RequestQueue> queue) {
+  uint8_t hdr[5];
+  while (conn->readFully(hdr, sizeof(hdr))) {
+    Request req;
+    req.conn = conn;
+    req.op = hdr[0];
+    req.id = getBE32(hdr + 1);
+    if (!conn->readField(req.input) || !conn->readField(req.data)) {
+      break;
+    }
+    if (req.op != DAEMON_OP_ENCRYPT && req.op != DAEMON_OP_DECRYPT) {
+      conn->respond(req.id, OpenABE_ERROR_INVALID_INPUT, "");
+      continue;
+    }
+    queue->push(req);
+  }
+  conn->shutdownRead();
+}
+
+// one call of the batch APIs per policy (encrypt) or key (decrypt)
+static void runBatch(OpenABECryptoContext &ctx, vector<Request> &batch, bool verbose) {
+  map<pair<uint8_t, string>, vector<Request *>> groups;
+  for (auto &req : batch) {
+    groups[make_pair(req.op, req.input)].push_back(&req);
+  }
+  if (verbose) {
+    cout << "batch of " << batch.size() << " requests in " << groups.size() << " groups" << endl;
+  }
+
+  for (auto &group : groups) {
+    const string &input = group.first.second;
+    vector<Request *> &reqs = group.second;
+    vector<string> inputs(reqs.size()), outputs;
+    for (size_t i = 0; i < reqs.size(); i++) {
+      inputs[i].swap(reqs[i]->data);
+    }
+
+    if (group.first.first == DAEMON_OP_ENCRYPT) {
+      try {
+        ctx.encryptBatch(input, inputs, outputs);
+      } catch (ZCryptoBoxException &) {
+        // the whole group shares the input that failed
+        for (auto req : reqs) {
+          req->conn->respond(req->id, OpenABE_ERROR_ENCRYPTION_ERROR, "");
+        }
+        continue;
+      }
+      for (size_t i = 0; i < reqs.size(); i++) {
+        reqs[i]->conn->respond(reqs[i]->id, OpenABE_NOERROR, outputs[i]);
+      }
+    } else {
+      vector<bool> decrypted;
+      ctx.decryptBatch(input, inputs, outputs, decrypted);
+      for (size_t i = 0; i < reqs.size(); i++) {
+        if (decrypted[i]) {
+          reqs[i]->conn->respond(reqs[i]->id, OpenABE_NOERROR, outputs[i]);
+          continue;
+        }
+        // the batch only says which failed; the header checks of
+        // tryDecrypt say why without another pairing in the usual cases
+        string plaintext;
+        OpenABE_ERROR result = ctx.tryDecrypt(input, inputs[i], plaintext);
+        reqs[i]->conn->respond(reqs[i]->id, result, plaintext);
+      }
+    }
+  }
+}
+
+static int openSocket(const string &path) {
+  struct sockaddr_un addr;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    cerr << "socket path is too long: " << path << endl;
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+  // a socket left behind by an earlier run is replaced, anything else is not
+  struct stat st;
+  if (stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+    unlink(path.c_str());
+  }
+
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    cerr << "unable to create the socket: " << strerror(errno) << endl;
+    return -1;
+  }
+  // the socket grants the use of the keys, so only the owner may connect
+  mode_t mask = umask(0077);
+  int err = ::bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+  umask(mask);
+  if (err < 0 || ::listen(fd, SOMAXCONN) < 0) {
+    cerr << "unable to listen on " << path << ": " << strerror(errno) << endl;
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static int loadDaemonContext(OpenABECryptoContext &ctx, string &prefix, string &suffix,
+                             vector<string> &keyFiles, bool verbose) {
+  string mpkFile = prefix + MPK_ID + suffix;
+  string mpkBlob = ReadFile(mpkFile.c_str());
+  if (mpkBlob.size() == 0) {
+    cerr << "master public parameters not encoded properly." << endl;
+    return -1;
+  }
+  try {
+    ctx.importPublicParams(mpkBlob);
+    for (auto &keyFile : keyFiles) {
+      string skBlob = ReadFile(keyFile.c_str());
+      if (skBlob.size() == 0) {
+        cerr << "secret key not encoded properly: " << keyFile << endl;
+        return -1;
+      }
+      ctx.importUserKey(keyFile, skBlob);
+      if (verbose) {
+        cout << "loaded user secret key: " << keyFile << endl;
+      }
+    }
+  } catch (ZCryptoBoxException &e) {
+    cerr << "unable to load the parameters or keys: " << e.what() << endl;
+    return -1;
+  }
+  return 0;
+}
+
+// serves until SIGINT or SIGTERM; the requests already queued are answered
+// first
+static int runDaemon(OpenABECryptoContext &ctx, string &socket_path, long window,
+                     size_t max_batch, bool verbose) {
+  // shared with the reader threads, which are not joined
+  shared_ptr<RequestQueue> queue = make_shared<RequestQueue>();
+  queue->configure(chrono::microseconds(window), max_batch);
+  int listenFd = openSocket(socket_path);
+  if (listenFd < 0) {
+    return -1;
+  }
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = onStopSignal;
+  sigaction(SIGINT, &sa, nullptr);
+  sigaction(SIGTERM, &sa, nullptr);
+  signal(SIGPIPE, SIG_IGN);
+
+  // the reader threads only move bytes; all the crypto runs on this
+  // thread and the library pool
+  thread acceptor([listenFd, queue]() {
+    while (!stopRequested) {
+      int fd = ::accept(listenFd, nullptr, nullptr);
+      if (fd < 0) {
+        if (errno == EINTR || errno == ECONNABORTED) {
+          continue;
+        }
+        break;
+      }
+      thread(serveConnection, make_shared<Connection>(fd), queue).detach();
+    }
+  });
+  if (verbose) {
+    cout << "listening on " << socket_path << endl;
+  }
+
+  vector<Request> batch;
+  while (queue->takeBatch(batch)) {
+    runBatch(ctx, batch, verbose);
+    batch.clear();
+  }
+
+  // wakes the acceptor up; connections still open are dropped at exit
+  ::shutdown(listenFd, SHUT_RDWR);
+  acceptor.join();
+  ::close(listenFd);
+  unlink(socket_path.c_str());
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  if(argc <= 1) {
+    cout << OpenABE_CLI_STRING << "encryption/decryption daemon, v" << (OpenABE_LIBRARY_VERSION / 100.) << endl;
+    fprintf(stderr, USAGE);
+    exit(-1);
+  }
+  int opt;
+  string scheme_name, prefix, suffix, socket_path;
+  vector<string> key_files;
+  long window = DEFAULT_BATCH_WINDOW_US;
+  size_t max_batch = DEFAULT_MAX_BATCH;
+  bool verbose = false;
+  while ((opt = getopt(argc,argv,"s:p:k:S:w:b:v")) != EOF)
+  {
+    switch(opt)
+    {
+      case 's': scheme_name = string(optarg); break;
+      case 'p': prefix = string(optarg); break;
+      case 'k': key_files.push_back(string(optarg)); break;
+      case 'S': socket_path = string(optarg); break;
+      case 'w': window = strtol(optarg, nullptr, 10); break;
+      case 'b': max_batch = strtoul(optarg, nullptr, 10); break;
+      case 'v': verbose = true; break;
+      case '?': fprintf(stderr, USAGE);
+      default: cout<<endl; exit(-1);
+    }
+  }
+
+  addNameSeparator(prefix);
+  OpenABE_SCHEME scheme_type = checkForScheme(scheme_name, suffix);
+  if (scheme_type != OpenABE_SCHEME_CP_WATERS && scheme_type != OpenABE_SCHEME_KP_GPSW) {
+    cerr << "selected an invalid scheme type. Try again with -s option ('CP' or 'KP').\n";
+    return -1;
+  }
+  if (socket_path == "") {
+    cerr << "please specify a socket path with -S option." << endl;
+    return -1;
+  }
+  if (window < 0 || max_batch == 0) {
+    cerr << "the batch window (-w) and size (-b) must be positive." << endl;
+    return -1;
+  }
+
+  InitializeOpenABE();
+  int err_code = 0;
+  {
+    OpenABECryptoContext ctx(scheme_name == CP_ABE ? "CP-ABE" : "KP-ABE", false);
+    err_code = loadDaemonContext(ctx, prefix, suffix, key_files, verbose);
+    if (err_code == 0) {
+      err_code = runDaemon(ctx, socket_path, window, max_batch, verbose);
+    }
+  }
+  ShutdownOpenABE();
+
+  return err_code;
+}
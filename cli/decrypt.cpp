@@ -37,14 +37,17 @@ using namespace std;
 using namespace oabe;
 
 #define USAGE \
-    "usage: [ -s scheme ] [ -p prefix ] [ -k key ] [ -i ciphertext ] [ -o output ] -v\n\n" \
+    "usage: [ -s scheme ] [ -p prefix ] [ -k key ] [ -i ciphertext ] [ -o output ] -v\n" \
+    "       [ -s scheme ] [ -p prefix ] [ -k key ] [ -B batch ] [ -j jobs ] [ -o output dir ] -v\n\n" \
     "\t-v : turn on verbosity\n" \
     "\t-s : scheme types are 'PK', 'CP' or 'KP'\n" \
     "\t-k : recipient key Id for 'PK' and secret key file for 'CP'/'KP'\n" \
     "\t-e : sender key Id for 'PK'\n" \
-    "\t-i : ciphertext file \n" \
-    "\t-o : output file for plaintext\n" \
-    "\t-p : prefix for generated authority public and secret parameter files (optional)\n\n" \
+    "\t-i : ciphertext file ('-' for stdin)\n" \
+    "\t-o : output file for plaintext ('-' for stdout)\n" \
+    "\t-p : prefix for generated authority public and secret parameter files (optional)\n" \
+    "\t-B : batch of ciphertext files, as a directory or a manifest of paths ('CP'/'KP' only)\n" \
+    "\t-j : number of batch jobs to run at once (default: one per core)\n\n" \
 
 bool getPublicKey(OpenABEByteString& publicKey, string& id, string& suffix) {
     const string pubKeyFile = id + ".pk" + suffix;
@@ -68,7 +71,7 @@ bool getPrivateKey(OpenABEByteString& privateKey, string& id, string& suffix) {
 
 
 int runPkDecrypt(string& suffix, string& sender_id, string& recipient_id,
-                  string& ciphertextFile, string& outputFile, bool verbose) {
+                  InputFile& input, OutputFile& output, bool verbose) {
     OpenABE_ERROR result = OpenABE_NOERROR;
     int err_code = 0;
     // load public key file for the recipient
@@ -84,7 +87,7 @@ int runPkDecrypt(string& suffix, string& sender_id, string& recipient_id,
         return -1;
     }
 
-    ctBlob = ReadBlockFromFile(CT2_BEGIN_HEADER, CT2_END_HEADER, ciphertextFile.c_str());
+    ctBlob = ReadBlock(input, CT2_BEGIN_HEADER, CT2_END_HEADER);
     if (ctBlob.size() == 0) {
         cerr << "ciphertext not encoded properly." << endl;
         return -1;
@@ -117,35 +120,75 @@ int runPkDecrypt(string& suffix, string& sender_id, string& recipient_id,
     unique_ptr<OpenABECiphertext> ciphertext(new OpenABECiphertext);
     ciphertext->loadFromBytes(ctBlob);
     if ((result = schemeContext->decrypt(sen_pkID, rec_skID, plaintext, ciphertext.get())) != OpenABE_NOERROR) {
-        cerr << "error while decrypting PK-encrypted object: " << ciphertextFile << endl;
+        cerr << "error while decrypting PK-encrypted object" << endl;
         return result;
     }
 
     err_code = 0;
     if(verbose) {
-        cout << "writing " << plaintext.size() << " bytes to " << outputFile << endl;
+        cout << "writing " << plaintext.size() << " bytes" << endl;
     }
-    WriteBinaryFile(outputFile.c_str(), (uint8_t *) plaintext.c_str(), plaintext.size());
+    output.write(plaintext);
+    output.close();
 
     return err_code;
 }
 
-int runAbeDecrypt(OpenABE_SCHEME scheme_type, string& prefix, string& suffix,
-    	       string& skFile, string& ciphertextFile, string& outputFile, bool verbose)
+// decrypts the chunked AEAD payload that follows the ABE ciphertext block,
+// writing out each chunk once it verifies
+int runAbeDecryptChunked(OpenABEContextSchemeCCA *schemeContext, string& mpkID, string& skID,
+                         OpenABECiphertext *ciphertext1, InputFile& input,
+                         OutputFile& output, bool verbose)
 {
   OpenABE_ERROR result = OpenABE_NOERROR;
-  std::unique_ptr<OpenABEContextSchemeCCA> schemeContext = nullptr;
-  std::unique_ptr<OpenABECiphertext> ciphertext1 = nullptr, ciphertext2 = nullptr;
+  std::unique_ptr<crypto::OpenABESymKeyChunkedAuthEnc> authEnc = nullptr;
+  OpenABEByteString buf;
 
-  int err_code = 0;
+  if ((result = schemeContext->decapsulate(mpkID, skID, ciphertext1, authEnc)) != OpenABE_NOERROR) {
+    if (verbose) {
+      cout << "decrypt failed with error code: " << result << endl;
+    }
+    return result;
+  }
+
+  size_t total = 0, n;
+  const uint8_t *ptr = nullptr;
+  bool ok = true;
+  authEnc->decryptInit();
+  while (ok && (n = input.read(&ptr, IO_BLOCK_SIZE)) > 0) {
+    ok = authEnc->decryptUpdate(ptr, n, &buf);
+    output.write(buf.data(), buf.size());
+    total += buf.size();
+    buf.clear();
+  }
+  if (!ok || !authEnc->decryptFinalize(&buf)) {
+    // a truncated or modified payload leaves nothing behind
+    cerr << "chunked ciphertext did not verify" << endl;
+    output.discard();
+    return OpenABE_ERROR_DECRYPTION_FAILED;
+  }
+  output.write(buf.data(), buf.size());
+  output.close();
+
+  if(verbose) {
+    cout << "wrote " << total + buf.size() << " bytes" << endl;
+  }
+  return 0;
+}
+
+// creates the scheme context and loads the master public parameters and the
+// user's secret key, once for a single file or a whole batch
+int loadAbeDecrypt(OpenABE_SCHEME scheme_type, string& prefix, string& suffix, string& skFile,
+                   std::unique_ptr<OpenABEContextSchemeCCA>& schemeContext, bool verbose)
+{
+  OpenABE_ERROR result = OpenABE_NOERROR;
   string mpkID = MPK_ID, skID = skFile;
   string mpkFile = MPK_ID + suffix;
   if(prefix != "") {
     mpkFile = prefix + mpkFile;
   }
   // read the file
-  OpenABEByteString mpkBlob, skBlob, ct1Blob, ct2Blob;
-  string plaintext;
+  OpenABEByteString mpkBlob, skBlob;
 
   // Initialize a OpenABEContext structure
   schemeContext = OpenABE_createContextABESchemeCCA(scheme_type);
@@ -172,7 +215,27 @@ int runAbeDecrypt(OpenABE_SCHEME scheme_type, string& prefix, string& suffix,
     return -1;
   }
 
-  ct1Blob = ReadBlockFromFile(CT1_BEGIN_HEADER, CT1_END_HEADER, ciphertextFile.c_str());
+  // now we can load the user's secret key
+  if ((result = schemeContext->loadUserSecretParams(skID, skBlob)) != OpenABE_NOERROR) {
+    cerr << "Unable to load user's decryption key" << endl;
+    return result;
+  }
+
+  if (verbose) {
+    cout << "loaded user secret key successfully" << endl;
+  }
+  return 0;
+}
+
+int runAbeDecryptFile(OpenABEContextSchemeCCA *schemeContext, string& mpkID, string& skID,
+                      InputFile& input, OutputFile& output, bool verbose)
+{
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  std::unique_ptr<OpenABECiphertext> ciphertext1 = nullptr, ciphertext2 = nullptr;
+  OpenABEByteString ct1Blob, ct2Blob;
+  string plaintext;
+
+  ct1Blob = ReadBlock(input, CT1_BEGIN_HEADER, CT1_END_HEADER);
   if (ct1Blob.size() == 0) {
     cerr << "ABE ciphertext not encoded properly." << endl;
     return -1;
@@ -182,24 +245,29 @@ int runAbeDecrypt(OpenABE_SCHEME scheme_type, string& prefix, string& suffix,
   ciphertext1.reset(new OpenABECiphertext);
   ciphertext1->loadFromBytes(ct1Blob);
 
-  ct2Blob = ReadBlockFromFile(CT2_BEGIN_HEADER, CT2_END_HEADER, ciphertextFile.c_str());
-  if (ct2Blob.size() == 0) {
-    cerr << "AEAD ciphertext not encoded properly." << endl;
+  // the AEAD part is either a base64 block or a chunked payload
+  string header;
+  while (input.readLine(header) && header.empty()) {}
+  bool chunked = (header == CT3_BEGIN_HEADER);
+  if (!chunked) {
+    if (header == CT2_BEGIN_HEADER) {
+      ct2Blob = ReadBlockBody(input, CT2_END_HEADER);
+    }
+    if (ct2Blob.size() == 0) {
+      cerr << "AEAD ciphertext not encoded properly." << endl;
+    }
   }
 
   if (verbose) {
     cout << "read " << ct1Blob.size() << " bytes" << endl;
-    cout << "read " << ct2Blob.size() << " bytes" << endl;
-  }
-
-  // now we can load the user's secret key
-  if ((result = schemeContext->loadUserSecretParams(skID, skBlob)) != OpenABE_NOERROR) {
-    cerr << "Unable to load user's decryption key" << endl;
-    return result;
+    if (!chunked) {
+      cout << "read " << ct2Blob.size() << " bytes" << endl;
+    }
   }
 
-  if (verbose) {
-    cout << "loaded user secret key successfully" << endl;
+  if (chunked) {
+    return runAbeDecryptChunked(schemeContext, mpkID, skID, ciphertext1.get(),
+                                input, output, verbose);
   }
 
   ciphertext2.reset(new OpenABECiphertext);
@@ -224,13 +292,85 @@ int runAbeDecrypt(OpenABE_SCHEME scheme_type, string& prefix, string& suffix,
     cout << "decrypt completed successfully!" << endl;
   }
 
-  err_code = 0;
   if(verbose) {
-    cout << "writing " << plaintext.size() << " bytes to " << outputFile << endl;
+    cout << "writing " << plaintext.size() << " bytes" << endl;
+  }
+  output.write(plaintext);
+  output.close();
+
+  return 0;
+}
+
+int runAbeDecrypt(OpenABE_SCHEME scheme_type, string& prefix, string& suffix,
+    	       string& skFile, InputFile& input, OutputFile& output, bool verbose)
+{
+  std::unique_ptr<OpenABEContextSchemeCCA> schemeContext = nullptr;
+  string mpkID = MPK_ID, skID = skFile;
+
+  int err_code = loadAbeDecrypt(scheme_type, prefix, suffix, skFile, schemeContext, verbose);
+  if (err_code != 0) {
+    return err_code;
   }
-  WriteBinaryFile(outputFile.c_str(), (uint8_t *)plaintext.c_str(), plaintext.size());
+  return runAbeDecryptFile(schemeContext.get(), mpkID, skID, input, output, verbose);
+}
+
+// decrypts every file of a manifest or directory on up to 'jobs' threads,
+// paying for library start-up, MPK and key decoding only once. Outputs drop
+// the scheme suffix (or gain ".dec" if the input did not have it)
+int runAbeBatchDecrypt(OpenABE_SCHEME scheme_type, string& prefix, string& suffix,
+                       string& skFile, string& batchPath, string& outDir, size_t jobs, bool verbose)
+{
+  std::unique_ptr<OpenABEContextSchemeCCA> schemeContext = nullptr;
+  string mpkID = MPK_ID, skID = skFile;
+  vector<string> inputs;
+  mutex errLock;
 
+  if (!ListBatchInputs(batchPath, inputs)) {
+    cerr << "unable to read the batch manifest or directory: " << batchPath << endl;
+    return -1;
+  }
+  int err_code = loadAbeDecrypt(scheme_type, prefix, suffix, skFile, schemeContext, verbose);
+  if (err_code != 0) {
     return err_code;
+  }
+
+  vector<char> done(inputs.size(), 0);
+  OpenABEThreadPool::getDefault()->parallelFor(inputs.size(), [&](size_t i) {
+    InputFile input;
+    OutputFile output;
+    string outFile = BatchOutputPath(inputs[i], outDir);
+    if (outFile.size() > suffix.size() &&
+        outFile.compare(outFile.size() - suffix.size(), suffix.size(), suffix) == 0) {
+      outFile.erase(outFile.size() - suffix.size());
+    } else {
+      outFile += ".dec";
+    }
+    try {
+      input.open(inputs[i]);
+      output.open(outFile);
+      done[i] = (runAbeDecryptFile(schemeContext.get(), mpkID, skID, input, output, false) == 0);
+    } catch(const std::ios_base::failure& e) {
+      lock_guard<mutex> guard(errLock);
+      cerr << e.what() << endl;
+    } catch(OpenABE_ERROR&) {
+      // malformed ciphertexts are reported like any other failure
+    }
+    if (output.isOpen()) {
+      output.discard();
+    }
+  }, jobs);
+
+  size_t failed = 0;
+  for (size_t i = 0; i < inputs.size(); i++) {
+    if (!done[i]) {
+      cerr << "failed to decrypt " << inputs[i] << endl;
+      failed++;
+    }
+  }
+  if (verbose) {
+    cout << "decrypted " << (inputs.size() - failed) << " of " << inputs.size() << " files" << endl;
+  }
+  return (failed == 0) ? 0 : -1;
 }
 
 int main(int argc, char **argv)
@@ -242,9 +382,12 @@ int main(int argc, char **argv)
   }
   int opt;
   string scheme_name, prefix, suffix;
-  string mpk_file, sender_id, recipient_id, key_file, ciphertext_file, out_file;
+  string mpk_file, sender_id, recipient_id, key_file, ciphertext_file, out_file, batch_path;
+  size_t jobs = 0;
+  InputFile input;
+  OutputFile output;
   bool verbose = false;
-  while ((opt = getopt(argc,argv,"e:k:p:s:i:o:r:v")) != EOF)
+  while ((opt = getopt(argc,argv,"e:k:p:s:i:o:r:B:j:v")) != EOF)
   {
     switch(opt)
     {
@@ -252,14 +395,21 @@ int main(int argc, char **argv)
       case 's': scheme_name = string(optarg); break;
       case 'p': prefix = string(optarg); break;
       case 'k': key_file = string(optarg); break;
-      case 'i': cout << "ciphertext: "<< optarg << endl; ciphertext_file = optarg; break;
+      case 'i': ciphertext_file = optarg; break;
       case 'r': recipient_id = string(optarg); break;
       case 'o': out_file = optarg; break;
+      case 'B': batch_path = optarg; break;
+      case 'j': jobs = strtoul(optarg, nullptr, 10); break;
       case 'v': verbose = true; break;
       case '?': fprintf(stderr, USAGE);
       default: cout<<endl; exit(-1);
     }
   }
+  // keep stdout clean for the plaintext
+  if (out_file == STDIO_FILENAME) {
+    cout.rdbuf(cerr.rdbuf());
+  }
+  cout << "ciphertext: " << ciphertext_file << endl;
 
     // check prefix ending
     addNameSeparator(prefix);
@@ -270,6 +420,19 @@ int main(int argc, char **argv)
     	return -1;
     }
 
+    if (batch_path != "") {
+      if (scheme_type == OpenABE_SCHEME_PK_OPDH) {
+        cerr << "the batch mode (-B option) is only available for 'CP' and 'KP'.\n";
+        return -1;
+      }
+      InitializeOpenABE();
+      cout << "user's SK file: " << key_file << endl;
+      int err_code = runAbeBatchDecrypt(scheme_type, prefix, suffix, key_file, batch_path,
+                                        out_file, jobs, verbose);
+      ShutdownOpenABE();
+      return err_code;
+    }
+
     if (ciphertext_file == "") {
         cerr << "please specify a ciphertext file with -i option." << endl;
     }
@@ -279,21 +442,38 @@ int main(int argc, char **argv)
     	return -1;
     }
 
+    try {
+      input.open(ciphertext_file);
+      output.open(out_file);
+    } catch(const std::ios_base::failure& e) {
+      cerr << e.what() << endl;
+      return -1;
+    }
+
     InitializeOpenABE();
 
   int err_code = 0;
-  if (scheme_type == OpenABE_SCHEME_PK_OPDH) {
-    if (sender_id == "" || recipient_id == "") {
-      cerr << "missing sender ID (-e option) and/or recipient ID (-r option)" << endl;
-      goto cleanup;
+  try {
+    if (scheme_type == OpenABE_SCHEME_PK_OPDH) {
+      if (sender_id == "" || recipient_id == "") {
+        cerr << "missing sender ID (-e option) and/or recipient ID (-r option)" << endl;
+        goto cleanup;
+      }
+      err_code = runPkDecrypt(suffix, sender_id, recipient_id, input, output, verbose);
+    } else {
+      cout << "user's SK file: " << key_file << endl;
+      err_code = runAbeDecrypt(scheme_type, prefix, suffix, key_file, input, output, verbose);
     }
-    err_code = runPkDecrypt(suffix, sender_id, recipient_id, ciphertext_file, out_file, verbose);
-  } else {
-    cout << "user's SK file: " << key_file << endl;
-    err_code = runAbeDecrypt(scheme_type, prefix, suffix, key_file, ciphertext_file, out_file, verbose);
+  } catch(const std::ios_base::failure& e) {
+    cerr << e.what() << endl;
+    err_code = -1;
   }
 
 cleanup:
+  // don't leave a partial plaintext behind on failure
+  if (output.isOpen()) {
+    output.discard();
+  }
   ShutdownOpenABE();
 
   return err_code;
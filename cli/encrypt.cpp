@@ -37,14 +37,18 @@ using namespace std;
 using namespace oabe;
 
 #define USAGE \
-    "usage: [ -s scheme ] [ -p prefix ] [ -e encryption input ] [ -i input ] [ -o output ] -v\n\n" \
+    "usage: [ -s scheme ] [ -p prefix ] [ -e encryption input ] [ -i input ] [ -o output ] -c -v\n" \
+    "       [ -s scheme ] [ -p prefix ] [ -e encryption input ] [ -B batch ] [ -j jobs ] [ -o output dir ] -c -v\n\n" \
     "\t-v : turn on verbosity\n" \
+    "\t-c : stream the input through the chunked AEAD mode ('CP'/'KP' only, for large files)\n" \
     "\t-s : scheme types are 'PK', 'CP' or 'KP'\n" \
     "\t-e : sender key Id for PK, policy string for 'CP' or attribute list for 'KP'\n" \
     "\t-r : recipient key Id for PK\n" \
-    "\t-i : input file\n" \
-    "\t-o : output file for ciphertext\n" \
-    "\t-p : prefix for generated authority public and secret parameter files (optional)\n\n" \
+    "\t-i : input file ('-' for stdin)\n" \
+    "\t-o : output file for ciphertext ('-' for stdout)\n" \
+    "\t-p : prefix for generated authority public and secret parameter files (optional)\n" \
+    "\t-B : batch of input files, as a directory or a manifest of paths ('CP'/'KP' only)\n" \
+    "\t-j : number of batch jobs to run at once (default: one per core)\n\n" \
 
 bool getPublicKey(OpenABEByteString& publicKey, string& id, string& suffix) {
     const string pubKeyFile = id + ".pk" + suffix;
@@ -57,7 +61,7 @@ bool getPublicKey(OpenABEByteString& publicKey, string& id, string& suffix) {
 }
 
 void runPkEncrypt(string& suffix, string& sender_id, string& recipient_id,
-                  string& inputStr, string& ciphertextFile, bool verbose) {
+                  string& inputStr, OutputFile& output, bool verbose) {
 
     OpenABE_ERROR result = OpenABE_NOERROR;
     // load public key file for the recipient
@@ -110,31 +114,33 @@ void runPkEncrypt(string& suffix, string& sender_id, string& recipient_id,
     if (verbose) {
         cout << "writing " << ctBlob.size() << " bytes" << endl;
     }
-    WriteToFile(ciphertextFile.c_str(), ctBlobStr);
+    output.write(ctBlobStr);
+    output.close();
 
     return;
 }
 
 
-void runAbeEncrypt(OpenABE_SCHEME scheme_type, string& prefix, string& suffix, string& func_input,
-    	       string& inputStr, string& ciphertextFile, bool verbose)
+// creates the scheme context and loads the master public parameters and
+// the functional input, once for a single file or a whole batch
+bool loadAbeEncrypt(OpenABE_SCHEME scheme_type, string& prefix, string& suffix, string& func_input,
+                    std::unique_ptr<OpenABEContextSchemeCCA>& schemeContext,
+                    std::unique_ptr<OpenABEFunctionInput>& funcInput)
 {
   OpenABE_ERROR result = OpenABE_NOERROR;
-  std::unique_ptr<OpenABEContextSchemeCCA> schemeContext = nullptr;
-  std::unique_ptr<OpenABEFunctionInput> funcInput = nullptr;
   string mpkID = MPK_ID;
   string mpkFile = MPK_ID + suffix;
   if(prefix != "") {
     mpkFile = prefix + mpkFile;
   }
 
-  OpenABEByteString ct1Blob, ct2Blob, mpkBlob;
+  OpenABEByteString mpkBlob;
 
   // Initialize a OpenABEContext structure
   schemeContext = OpenABE_createContextABESchemeCCA(scheme_type);
   if (schemeContext == nullptr) {
     cerr << "unable to create a new context" << endl;
-    return;
+    return false;
   }
 
   // next, get the functional input for encryption (based on scheme type)
@@ -145,26 +151,84 @@ void runAbeEncrypt(OpenABE_SCHEME scheme_type, string& prefix, string& suffix, s
   }
   if (funcInput == nullptr) {
     cerr << "invalid functional input" << endl;
-    return;
+    return false;
   }
 
   // for KP and CP, we only have to do this once
   mpkBlob = ReadFile(mpkFile.c_str());
   if (mpkBlob.size() == 0) {
     cerr << "master public parameters not encoded properly." << endl;
-    return;
+    return false;
   }
 
   if ((result = schemeContext->loadMasterPublicParams(mpkID, mpkBlob)) != OpenABE_NOERROR) {
     cerr << "unable to load the master public parameters" << endl;
-    return;
+    return false;
   }
+  return true;
+}
+
+// writes the ABE ciphertext block, then streams the input through the
+// chunked AEAD mode so only one chunk is held in memory at a time
+bool runAbeEncryptChunked(OpenABEContextSchemeCCA *schemeContext, string& mpkID,
+                          OpenABEFunctionInput *funcInput, InputFile& input,
+                          OutputFile& output, bool verbose)
+{
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  std::unique_ptr<crypto::OpenABESymKeyChunkedAuthEnc> authEnc = nullptr;
+  std::unique_ptr<OpenABECiphertext> ciphertext1(new OpenABECiphertext);
+  OpenABEByteString ct1Blob, buf;
+
+  if ((result = schemeContext->encapsulate(mpkID, funcInput, ciphertext1.get(), authEnc)) != OpenABE_NOERROR) {
+    cerr << "error occurred during encryption" << endl;
+    return false;
+  }
+
+  ciphertext1->exportToBytes(ct1Blob);
+  string ctBlobStr = CT1_BEGIN_HEADER;
+  ctBlobStr += NL + Base64Encode(ct1Blob.getInternalPtr(), ct1Blob.size()) + NL;
+  ctBlobStr += CT1_END_HEADER;
+  ctBlobStr += NL;
+  ctBlobStr += CT3_BEGIN_HEADER;
+  ctBlobStr += NL;
+  output.write(ctBlobStr);
+
+  size_t total = 0, n;
+  const uint8_t *ptr = nullptr;
+  result = authEnc->encryptInit(&buf);
+  while (result == OpenABE_NOERROR && (n = input.read(&ptr, IO_BLOCK_SIZE)) > 0) {
+    output.write(buf.data(), buf.size());
+    buf.clear();
+    result = authEnc->encryptUpdate(ptr, n, &buf);
+    total += n;
+  }
+  if (result == OpenABE_NOERROR) {
+    result = authEnc->encryptFinalize(&buf);
+  }
+  if (result != OpenABE_NOERROR) {
+    cerr << "error occurred during encryption" << endl;
+    output.discard();
+    return false;
+  }
+  output.write(buf.data(), buf.size());
+  output.close();
+
+  if(verbose) { cout << "encrypted " << total << " bytes" << endl; }
+  return true;
+}
+
+bool runAbeEncryptFile(OpenABEContextSchemeCCA *schemeContext, string& mpkID,
+                       OpenABEFunctionInput *funcInput, string& inputStr,
+                       OutputFile& output, bool verbose)
+{
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  OpenABEByteString ct1Blob, ct2Blob;
 
   std::unique_ptr<OpenABECiphertext> ciphertext1(new OpenABECiphertext);
   std::unique_ptr<OpenABECiphertext> ciphertext2(new OpenABECiphertext);
-  if ((result = schemeContext->encrypt(mpkID, funcInput.get(), inputStr, ciphertext1.get(), ciphertext2.get())) != OpenABE_NOERROR) {
+  if ((result = schemeContext->encrypt(mpkID, funcInput, inputStr, ciphertext1.get(), ciphertext2.get())) != OpenABE_NOERROR) {
     cerr << "error occurred during encryption" << endl;
-    return;
+    return false;
   }
 
   // write to disk
@@ -180,9 +244,87 @@ void runAbeEncrypt(OpenABE_SCHEME scheme_type, string& prefix, string& suffix, s
   ctBlobStr += NL;
 
   if(verbose) { cout << "writing " << ct2Blob.size() << " bytes" << endl; }
-  WriteToFile(ciphertextFile.c_str(), ctBlobStr);
+  output.write(ctBlobStr);
+  output.close();
+  return true;
+}
 
-  return;
+void runAbeEncrypt(OpenABE_SCHEME scheme_type, string& prefix, string& suffix, string& func_input,
+    	       string& inputStr, InputFile& input, bool chunked, OutputFile& output, bool verbose)
+{
+  std::unique_ptr<OpenABEContextSchemeCCA> schemeContext = nullptr;
+  std::unique_ptr<OpenABEFunctionInput> funcInput = nullptr;
+  string mpkID = MPK_ID;
+
+  if (!loadAbeEncrypt(scheme_type, prefix, suffix, func_input, schemeContext, funcInput)) {
+    return;
+  }
+
+  if (chunked) {
+    runAbeEncryptChunked(schemeContext.get(), mpkID, funcInput.get(), input, output, verbose);
+  } else {
+    runAbeEncryptFile(schemeContext.get(), mpkID, funcInput.get(), inputStr, output, verbose);
+  }
+}
+
+// encrypts every file of a manifest or directory on up to 'jobs' threads,
+// paying for library start-up and MPK decoding only once
+int runAbeBatchEncrypt(OpenABE_SCHEME scheme_type, string& prefix, string& suffix, string& func_input,
+                       string& batchPath, string& outDir, bool chunked, size_t jobs, bool verbose)
+{
+  std::unique_ptr<OpenABEContextSchemeCCA> schemeContext = nullptr;
+  std::unique_ptr<OpenABEFunctionInput> funcInput = nullptr;
+  string mpkID = MPK_ID;
+  vector<string> inputs;
+  mutex errLock;
+
+  if (!ListBatchInputs(batchPath, inputs)) {
+    cerr << "unable to read the batch manifest or directory: " << batchPath << endl;
+    return -1;
+  }
+  if (!loadAbeEncrypt(scheme_type, prefix, suffix, func_input, schemeContext, funcInput)) {
+    return -1;
+  }
+
+  vector<char> done(inputs.size(), 0);
+  OpenABEThreadPool::getDefault()->parallelFor(inputs.size(), [&](size_t i) {
+    InputFile input;
+    OutputFile output;
+    string inputStr;
+    try {
+      input.open(inputs[i]);
+      if (!chunked) {
+        input.readAll(inputStr);
+        if (inputStr.size() == 0 || inputStr.size() > MAX_FILE_SIZE) {
+          throw ios_base::failure("input file is either empty or too big: " + inputs[i]);
+        }
+      }
+      output.open(BatchOutputPath(inputs[i], outDir) + suffix);
+      if (chunked) {
+        done[i] = runAbeEncryptChunked(schemeContext.get(), mpkID, funcInput.get(), input, output, false);
+      } else {
+        done[i] = runAbeEncryptFile(schemeContext.get(), mpkID, funcInput.get(), inputStr, output, false);
+      }
+    } catch(const std::ios_base::failure& e) {
+      lock_guard<mutex> guard(errLock);
+      cerr << e.what() << endl;
+    }
+    if (output.isOpen()) {
+      output.discard();
+    }
+  }, jobs);
+
+  size_t failed = 0;
+  for (size_t i = 0; i < inputs.size(); i++) {
+    if (!done[i]) {
+      cerr << "failed to encrypt " << inputs[i] << endl;
+      failed++;
+    }
+  }
+  if (verbose) {
+    cout << "encrypted " << (inputs.size() - failed) << " of " << inputs.size() << " files" << endl;
+  }
+  return (failed == 0) ? 0 : -1;
 }
 
 int main(int argc, char **argv)
@@ -195,24 +337,35 @@ int main(int argc, char **argv)
   int opt;
   string func_input = "", input_file = "", prefix = "", suffix = "", scheme_type = "";
   string mpk_file, recipient_id = "", ciphertext_file;
-  string inputStr;
-
-  bool verbose = false;
-  while ((opt = getopt(argc,argv,"p:s:i:e:o:r:v")) != EOF)
+  string inputStr, batch_path;
+  InputFile input;
+  OutputFile output;
+  size_t jobs = 0;
+  int err_code = 0;
+
+  bool verbose = false, chunked = false;
+  while ((opt = getopt(argc,argv,"p:s:i:e:o:r:B:j:cv")) != EOF)
   {
     switch(opt)
     {
       case 'p': prefix = string(optarg); break;
       case 's': scheme_type = string(optarg); break;
-      case 'i': cout << "input file: " << optarg << endl; input_file = optarg; break;
+      case 'i': input_file = optarg; break;
       case 'e': func_input = string(optarg); break;
       case 'r': recipient_id = string(optarg); break;
       case 'o': ciphertext_file = optarg; break;
+      case 'c': chunked = true; break;
+      case 'B': batch_path = optarg; break;
+      case 'j': jobs = strtoul(optarg, nullptr, 10); break;
       case 'v': verbose = true; break;
       case '?': fprintf(stderr, USAGE);
       default: cout<<endl; exit(-1);
     }
   }
+  // keep stdout clean for the ciphertext
+  if (ciphertext_file == STDIO_FILENAME) {
+    cout.rdbuf(cerr.rdbuf());
+  }
   // check prefix ending
   addNameSeparator(prefix);
   // validate scheme type
@@ -221,44 +374,81 @@ int main(int argc, char **argv)
       cerr << "selected an invalid scheme type. Try again with -s option.\n";
       return -1;
   }
+  if (chunked && scheme == OpenABE_SCHEME_PK_OPDH) {
+      cerr << "the chunked mode (-c option) is only available for 'CP' and 'KP'.\n";
+      return -1;
+  }
 
-  try {
-    getFile(inputStr, input_file);
-    size_t inputLen = inputStr.size();
-    if (inputLen == 0 || inputLen > MAX_FILE_SIZE) {
-      cerr << "input file is either empty or too big! Can encrypt up to 4GB files." << endl;
+  if (batch_path != "") {
+    if (scheme == OpenABE_SCHEME_PK_OPDH) {
+      cerr << "the batch mode (-B option) is only available for 'CP' and 'KP'.\n";
       return -1;
     }
+    InitializeOpenABE();
+    cout << "encryption functional input: "<< func_input << endl;
+    err_code = runAbeBatchEncrypt(scheme, prefix, suffix, func_input, batch_path,
+                                  ciphertext_file, chunked, jobs, verbose);
+    ShutdownOpenABE();
+    return err_code;
+  }
+
+  cout << "input file: " << input_file << endl;
+  try {
+    input.open(input_file);
+    if (chunked) {
+      // streamed straight from the mapping (or the pipe)
+      if (input.isMapped() && input.size() == 0) {
+        cerr << "input file is empty!" << endl;
+        return -1;
+      }
+    } else {
+      input.readAll(inputStr);
+      size_t inputLen = inputStr.size();
+      if (inputLen == 0 || inputLen > MAX_FILE_SIZE) {
+        cerr << "input file is either empty or too big! Can encrypt up to 4GB files." << endl;
+        return -1;
+      }
+      if (verbose) {
+        cout << "read " << inputStr.size() << " bytes from " << input_file << endl;
+      }
+    }
+
+    // see if suffix has been added to the ciphertext filename
+    if (ciphertext_file != STDIO_FILENAME) {
+      addFileExtension(ciphertext_file, suffix);
+    }
+    output.open(ciphertext_file);
   } catch(const std::ios_base::failure& e) {
     cerr << e.what() << endl;
     return -1;
   }
 
-  if (verbose) {
-    cout << "read " << inputStr.size() << " bytes from " << input_file << endl;
-  }
-
-  // see if suffix has been added to the ciphertext filename
-  addFileExtension(ciphertext_file, suffix);
-
   InitializeOpenABE();
 
-  if (scheme == OpenABE_SCHEME_PK_OPDH) {
-    string sender_id = func_input;
-    if (sender_id == "" || recipient_id == "") {
-        cerr << "missing sender ID (-e option) and/or recipient ID (-r option)" << endl;
-        goto cleanup;
+  try {
+    if (scheme == OpenABE_SCHEME_PK_OPDH) {
+      string sender_id = func_input;
+      if (sender_id == "" || recipient_id == "") {
+          cerr << "missing sender ID (-e option) and/or recipient ID (-r option)" << endl;
+          goto cleanup;
+      }
+      cout << "sender ID: " << sender_id << endl;
+      cout << "recipient ID: " << recipient_id << endl;
+      runPkEncrypt(suffix, sender_id, recipient_id, inputStr, output, verbose);
+    } else {
+      cout << "encryption functional input: "<< func_input << endl;
+      runAbeEncrypt(scheme, prefix, suffix, func_input, inputStr, input, chunked, output, verbose);
     }
-    cout << "sender ID: " << sender_id << endl;
-    cout << "recipient ID: " << recipient_id << endl;
-    runPkEncrypt(suffix, sender_id, recipient_id, inputStr, ciphertext_file, verbose);
-  } else {
-    cout << "encryption functional input: "<< func_input << endl;
-    runAbeEncrypt(scheme, prefix, suffix, func_input, inputStr, ciphertext_file, verbose);
+  } catch(const std::ios_base::failure& e) {
+    cerr << e.what() << endl;
   }
 
 cleanup:
+  // don't leave a partial ciphertext behind on failure
+  if (output.isOpen()) {
+    output.discard();
+  }
   ShutdownOpenABE();
 
-  return 0;
+  return err_code;
 }
@@ -94,6 +94,8 @@ if [ -f "$TOOLCHAIN/bin/aarch64-linux-android-g++" ]; then
     OARCH="linux-aarch64" # For OpenSSL.
     RARM="ARM" # For Relic.
     RDWORD="64"
+    MARCH="aarch64" # For MCL.
+    ARCH_TUNE_FLAGS="-march=armv8-a+crypto"
 elif [ -f "$TOOLCHAIN/bin/arm-linux-androideabi-g++" ]; then
     printf "32-bit toolchain architecture\n"
     TOOLCHAIN_ARCH="arm-linux-androideabi"
@@ -101,6 +103,8 @@ elif [ -f "$TOOLCHAIN/bin/arm-linux-androideabi-g++" ]; then
     OARCH="android-armv7" # For OpenSSL.
     RARM="ARM" # For Relic.
     RDWORD="32"
+    MARCH="armv7l" # For MCL.
+    ARCH_TUNE_FLAGS="-march=armv7-a -mfpu=neon"
 else
     printf "Toolchain path provided doesn't contain a valid compiler, exiting\n"
 fi
@@ -235,7 +239,9 @@ buildOpenSSLForAndroid()
     fi
 
     cd $CWD/$OPENSSL
-    ./Configure android shared no-async --prefix=$SYSROOT --openssldir=$SYSROOT "-I$ANDROID_NDK_ROOT/platforms/android-14/arch-arm/usr/include/"
+    # The per-architecture target keeps OpenSSL's ARMv8 SHA-2/AES/PMULL (or
+    # NEON) assembly, which the generic android target leaves out.
+    ./Configure $OARCH shared no-async --prefix=$SYSROOT --openssldir=$SYSROOT "-I$ANDROID_NDK_ROOT/platforms/android-14/arch-arm/usr/include/"
     sed -i 's/LDFLAG= -pie/LDFLAG=/g' Makefile
     make CC="$CC" LD=$LD RANLIB=$RANLIB CROSS_SYSROOT=$SYSROOT
     make install_sw CC="$CC" LD=$LD RANLIB=$RANLIB CROSS_SYSROOT=$SYSROOT
@@ -243,6 +249,26 @@ buildOpenSSLForAndroid()
     cd $CWD
 }
 
+# Compile MCL from deps/mcl with its assembly field arithmetic for the
+# target (AArch64 or ARMv7) instead of the portable C++ fallback.
+buildMCLForAndroid()
+{
+    printf "Building MCL\n"
+    MCL_SRC=$ZROOT/deps/mcl
+    if [ ! -f $MCL_SRC/src/fp.cpp ]; then
+        printf "Could not find MCL sources in $MCL_SRC\n"
+        return 1
+    fi
+
+    make -C $MCL_SRC clean
+    make -C $MCL_SRC lib/libmcl.a ARCH=$MARCH MCL_USE_LLVM=1 MCL_USE_GMP=0 MCL_USE_OPENSSL=0 \
+        CXX="$CXX --sysroot=$SYSROOT" CC="$CC --sysroot=$SYSROOT" AR="$AR r" \
+        CFLAGS_USER="-DMCL_FP_BIT=384 -DMCL_FR_BIT=256 -O3 -I$SYSROOT/include $ARCH_TUNE_FLAGS"
+    cp $MCL_SRC/lib/libmcl.a $SYSROOT/lib/
+    cp -r $MCL_SRC/include/mcl $MCL_SRC/include/cybozu $SYSROOT/include/
+    cd $CWD
+}
+
 # Download and compile libgtest using the ndk-build tool. 
 buildGTestForAndroid()
 {
@@ -287,6 +313,7 @@ build_main()
     buildGMPForAndroid
     buildRelicForAndroid
     buildOpenSSLForAndroid
+    buildMCLForAndroid
     buildGTestForAndroid
 }
 
@@ -167,7 +167,7 @@ fi
 
 info "Running benchmarks for Native + MCL..."
 DYLD_LIBRARY_PATH=./cli "$RESULTS_DIR/benchmark_native_mcl" \
-    -s all -a -n $ITERATIONS \
+    -s all -a -n $ITERATIONS --json "$RESULTS_DIR/results-native-mcl.json" \
     > "$RESULTS_DIR/results-native-mcl.txt" 2>&1
 info "✓ Native + MCL complete"
 echo ""
@@ -258,6 +258,32 @@ else
     echo ""
 fi
 
+# ============================================================================
+# WASM + MCL through the JS bindings (if node available)
+# ============================================================================
+# Drives openabe-wrapper.js and openabe-worker-pool.js like a page would,
+# and compares with the native MCL run entry by entry
+if command -v node &> /dev/null; then
+    step "Benchmarking the JS bindings: WASM + MCL"
+    echo ""
+
+    if ./build-openabe-wasm-mcl.sh --module > "$RESULTS_DIR/build-wasm-mcl-module.log" 2>&1; then
+        info "Running wasm-bindings/run-openabe-benchmark.js..."
+        node wasm-bindings/run-openabe-benchmark.js --wasm-dir build-wasm-mcl \
+            -n $ITERATIONS --json "$RESULTS_DIR/results-wasm-js.json" \
+            --native "$RESULTS_DIR/results-native-mcl.json" \
+            > "$RESULTS_DIR/results-wasm-js.txt" 2>&1 || true
+        info "✓ JS bindings complete"
+    else
+        warn "Failed to build openabe.wasm, skipping the JS bindings"
+        warn "See log: $RESULTS_DIR/build-wasm-mcl-module.log"
+    fi
+    echo ""
+else
+    warn "Skipping the JS bindings (node not available)"
+    echo ""
+fi
+
 # ============================================================================
 # Generate Comparison Report
 # ============================================================================
@@ -339,6 +365,14 @@ if [ "$HAS_WASMTIME" = true ]; then
     echo "" >> "$RESULTS_DIR/COMPARISON_REPORT.md"
 fi
 
+if [ -f "$RESULTS_DIR/results-wasm-js.txt" ]; then
+    echo "### WASM + MCL (JS bindings)" >> "$RESULTS_DIR/COMPARISON_REPORT.md"
+    echo '```' >> "$RESULTS_DIR/COMPARISON_REPORT.md"
+    cat "$RESULTS_DIR/results-wasm-js.txt" >> "$RESULTS_DIR/COMPARISON_REPORT.md"
+    echo '```' >> "$RESULTS_DIR/COMPARISON_REPORT.md"
+    echo "" >> "$RESULTS_DIR/COMPARISON_REPORT.md"
+fi
+
 cat >> "$RESULTS_DIR/COMPARISON_REPORT.md" << 'REPORT_END'
 ## Analysis Notes
 
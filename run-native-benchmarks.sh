@@ -197,6 +197,7 @@ REPORT_START
 echo "- **Date**: $(date)" >> "$RESULTS_DIR/COMPARISON_REPORT.md"
 echo "- **Iterations**: $ITERATIONS per benchmark" >> "$RESULTS_DIR/COMPARISON_REPORT.md"
 echo "- **Platform**: $(uname -s) $(uname -m)" >> "$RESULTS_DIR/COMPARISON_REPORT.md"
+echo "- **Architecture profile**: ${ARCH_PROFILE:-default} (see Makefile.common)" >> "$RESULTS_DIR/COMPARISON_REPORT.md"
 echo "" >> "$RESULTS_DIR/COMPARISON_REPORT.md"
 
 cat >> "$RESULTS_DIR/COMPARISON_REPORT.md" << 'REPORT_MIDDLE'
@@ -35,7 +35,11 @@
 #include <stdlib.h>
 #include <iostream>
 #include <fstream>
+#include <list>
+#include <mutex>
+#include <set>
 #include <string>
+#include <unordered_map>
 
 using namespace std;
 
@@ -50,7 +54,7 @@ namespace oabe {
  * Constructor for the OpenABEContextABE base class.
  *
  */
-OpenABEContextABE::OpenABEContextABE() : OpenABEContext() {}
+OpenABEContextABE::OpenABEContextABE() : OpenABEContext(), numThreads_(1) {}
 
 /*!
  * Destructor for the OpenABEContextABE base class.
@@ -80,6 +84,708 @@ OpenABEContextABE::initializeCurve(const string groupParams) {
 }
 
 
+/*!
+ * Build (or rebuild) the fixed-base tables for the generators of the given
+ * master public key. Schemes call this lazily as well, so loading an MPK
+ * only moves the one-time cost out of the first encryption.
+ *
+ * @param   Parameters ID for the master public key.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR
+OpenABEContextABE::precomputeMasterPublicParams(const string &mpkID) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  try {
+    {
+      std::lock_guard<std::mutex> lock(this->precomputedLock_);
+      this->precomputed_.erase(mpkID);
+    }
+    this->getPrecomputedParams(mpkID);
+  } catch (OpenABE_ERROR &error) {
+    result = error;
+  }
+  return result;
+}
+
+/*!
+ * Package a loaded master public key with its fixed-base tables so other
+ * contexts can use it without decoding the blob again.
+ *
+ * @param   Parameters ID for the master public key.
+ * @return  The handle, or nullptr if the key is not loaded.
+ */
+
+OpenABEMPKHandle
+OpenABEContextABE::getMasterPublicParamsHandle(const string &mpkID) {
+  shared_ptr<OpenABEKey> MPK = this->getKeystore()->getPublicKey(mpkID);
+  if (MPK == nullptr) {
+    return nullptr;
+  }
+  try {
+    return make_shared<const OpenABEMasterPublicKeyHandle>(MPK, this->getPrecomputedParams(mpkID));
+  } catch (OpenABE_ERROR &) {
+    return nullptr;
+  }
+}
+
+/*!
+ * Attach a master public key handle from another context: the decoded key
+ * goes into this context's keystore and its tables are reused as they are.
+ * The handle must come from a context of the same scheme and curve.
+ *
+ * @param   Parameters ID for the master public key.
+ * @param   The handle to attach.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR
+OpenABEContextABE::attachMasterPublicParams(const string &mpkID, const OpenABEMPKHandle &handle) {
+  if (handle == nullptr || handle->getMasterPublicKey() == nullptr ||
+      handle->getPrecomputedParams() == nullptr) {
+    return OpenABE_ERROR_INVALID_INPUT;
+  }
+  shared_ptr<OpenABEKey> MPK = handle->getMasterPublicKey();
+  // initialize the pairing object if not already
+  if (this->getPairing() == nullptr) {
+    this->initializeCurve(OpenABE_convertCurveIDToString((OpenABECurveID)MPK->getCurveID()));
+  }
+  if (MPK->getCurveID() != this->getPairing()->getCurveID() ||
+      MPK->getAlgorithmID() != this->getAlgorithmID()) {
+    return OpenABE_ERROR_INVALID_KEY_HEADER;
+  }
+
+  this->getKeystore()->addKey(mpkID, MPK, KEY_TYPE_PUBLIC);
+  std::lock_guard<std::mutex> lock(this->precomputedLock_);
+  this->precomputed_[mpkID] = handle->getPrecomputedParams();
+  return OpenABE_NOERROR;
+}
+
+/*!
+ * Generic verification of a KEM ciphertext: re-run encryptKEM with the
+ * given RNG and compare the result against the ciphertext. Schemes
+ * override this to compare while recomputing and stop early.
+ *
+ * @param[in]   the RNG the ciphertext is expected to be derived from.
+ * @param[in]   parameters ID for the master public key.
+ * @param[in]   the function input of the ciphertext.
+ * @param[in]   the length of the encapsulated key.
+ * @param[out]  the encapsulated key if verification succeeds.
+ * @param[in]   the ciphertext to check.
+ * @param[out]  the number of ciphertext components that were checked.
+ * @return  OpenABE_NOERROR or OpenABE_ERROR_DECRYPTION_FAILED on mismatch.
+ */
+
+OpenABE_ERROR
+OpenABEContextABE::verifyKEM(OpenABERNG *rng, const string &mpkID,
+                             const OpenABEFunctionInput *encryptInput,
+                             uint32_t keyByteLen,
+                             const std::shared_ptr<OpenABESymKey> &key,
+                             OpenABECiphertext *ciphertext,
+                             uint32_t &numComponents) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  OpenABECiphertext expected;
+
+  ASSERT_NOTNULL(ciphertext);
+  result = this->encryptKEM(rng, mpkID, encryptInput, keyByteLen, key, &expected);
+  if (result != OpenABE_NOERROR) {
+    return result;
+  }
+  vector<string> keys = expected.getKeys();
+  for (auto &name : keys) {
+    // a policy registered only after the ciphertext was made is still
+    // carried as a string there: compare the policies instead
+    if (name == "policyHash" && !ciphertext->hasComponent(name)) {
+      unique_ptr<OpenABEPolicy> policy = getCiphertextPolicy(ciphertext);
+      if (policy == nullptr ||
+          policy->toCanonicalString() != encryptInput->toCanonicalString()) {
+        return OpenABE_ERROR_DECRYPTION_FAILED;
+      }
+      continue;
+    }
+    if (!ciphertext->matchComponent(name, expected.getComponent(name))) {
+      return OpenABE_ERROR_DECRYPTION_FAILED;
+    }
+  }
+  numComponents = keys.size();
+  return result;
+}
+
+/*!
+ * Return the fixed-base tables for the given master public key, building
+ * them if needed. Tables are rebuilt if the MPK in the keystore has been
+ * replaced since they were computed.
+ *
+ * @param   Parameters ID for the master public key.
+ * @return  The precomputed parameters (throws on error).
+ */
+
+shared_ptr<OpenABEPrecomputedParams>
+OpenABEContextABE::getPrecomputedParams(const string &mpkID) {
+  shared_ptr<OpenABEKey> MPK = this->getKeystore()->getPublicKey(mpkID);
+  if (MPK == nullptr) {
+    throw OpenABE_ERROR_INVALID_PARAMS;
+  }
+
+  std::lock_guard<std::mutex> lock(this->precomputedLock_);
+  auto it = this->precomputed_.find(mpkID);
+  if (it != this->precomputed_.end() &&
+      it->second->getMasterPublicKey() == MPK) {
+    return it->second;
+  }
+
+  shared_ptr<OpenABEPrecomputedParams> params(new OpenABEPrecomputedParams(MPK));
+  for (auto& label : this->fixedBaseG1_) {
+    G1 *g = MPK->getG1(label);
+    if (g == nullptr) {
+      throw OpenABE_ERROR_INVALID_PARAMS;
+    }
+    params->addG1(label, *g);
+  }
+  for (auto& label : this->fixedBaseG2_) {
+    G2 *g = MPK->getG2(label);
+    if (g == nullptr) {
+      throw OpenABE_ERROR_INVALID_PARAMS;
+    }
+    params->addG2(label, *g);
+  }
+  for (auto& label : this->fixedBaseGT_) {
+    GT *g = MPK->getGT(label);
+    if (g == nullptr) {
+      throw OpenABE_ERROR_INVALID_PARAMS;
+    }
+    params->addGT(label, *g);
+  }
+  this->precomputed_[mpkID] = params;
+  return params;
+}
+
+/********************************************************************************
+ * Implementation of the OpenABEPrecomputedParams class
+ ********************************************************************************/
+
+OpenABEPrecomputedParams::OpenABEPrecomputedParams(shared_ptr<OpenABEKey> mpk,
+                                                   size_t hashCacheSize,
+                                                   size_t tableCacheSize)
+  : mpk_(mpk), hashCacheSize_(hashCacheSize),
+    tableCacheSize_(tableCacheSize), tableCount_(0) {
+  this->owner_ = make_shared<OpenABEPrecomputeOwner>(
+      [this](const string &key, const OpenABEPrecomputeTicket *ticket) {
+        this->evictTable(key, ticket);
+      });
+  // only a key loaded from a snapshot has the snapshot's tables
+  if (mpk) {
+    this->attached_ = mpk->getAttachedTables();
+  }
+}
+
+OpenABEPrecomputedParams::~OpenABEPrecomputedParams() {
+  this->owner_->detach();
+}
+
+void OpenABEPrecomputedParams::addG1(const string &label, const G1 &base) {
+  this->g1_[label].reset(new G1FixedBase(base, this->attached_));
+}
+
+void OpenABEPrecomputedParams::addG2(const string &label, const G2 &base) {
+  this->g2_[label].reset(new G2FixedBase(base, this->attached_));
+}
+
+void OpenABEPrecomputedParams::addGT(const string &label, const GT &base) {
+  this->gt_[label].reset(new GTFixedBase(base, this->attached_));
+}
+
+G1FixedBase *OpenABEPrecomputedParams::getG1(const string &label) {
+  auto it = this->g1_.find(label);
+  return (it != this->g1_.end()) ? it->second.get() : nullptr;
+}
+
+G2FixedBase *OpenABEPrecomputedParams::getG2(const string &label) {
+  auto it = this->g2_.find(label);
+  return (it != this->g2_.end()) ? it->second.get() : nullptr;
+}
+
+GTFixedBase *OpenABEPrecomputedParams::getGT(const string &label) {
+  auto it = this->gt_.find(label);
+  return (it != this->gt_.end()) ? it->second.get() : nullptr;
+}
+
+void OpenABEPrecomputedParams::addToSnapshot(OpenABEFixedBaseSnapshot &snapshot) {
+  for (auto &it : this->g1_) {
+    snapshot.add(*it.second);
+  }
+  for (auto &it : this->g2_) {
+    snapshot.add(*it.second);
+  }
+  for (auto &it : this->gt_) {
+    snapshot.add(*it.second);
+  }
+  lock_guard<mutex> lock(this->hashLock_);
+  for (auto &it : this->hashList_) {
+    if (it.second.table) {
+      snapshot.add(it.second.table);
+    }
+  }
+}
+
+/*!
+ * Write the hash cache as (key length, key, point) records.
+ *
+ * @param[out]  the records.
+ */
+void OpenABEPrecomputedParams::exportHashCache(string &out) {
+  out.clear();
+#if defined(BP_WITH_MCL)
+  lock_guard<mutex> lock(this->hashLock_);
+  for (auto it = this->hashList_.rbegin(); it != this->hashList_.rend(); ++it) {
+    uint32_t keyLen = it->first.size();
+    out.append((const char *)&keyLen, sizeof(keyLen));
+    out += it->first;
+    out.append((const char *)&it->second.point.m_G1, sizeof(g1_ptr));
+  }
+#endif
+}
+
+/*!
+ * Fill the hash cache from exportHashCache records of the same MPK.
+ * The points are taken as they are, so the records must come from a
+ * trusted source (e.g. a snapshot that passed its digest check).
+ *
+ * @param[in]   the records.
+ */
+void OpenABEPrecomputedParams::importHashCache(const string &in) {
+#if defined(BP_WITH_MCL)
+  // the points join the group of the MPK generators
+  if (this->g1_.empty() || this->hashCacheSize_ == 0) {
+    return;
+  }
+  G1 point(this->g1_.begin()->second->getBase());
+  lock_guard<mutex> lock(this->hashLock_);
+  size_t index = 0;
+  while (index < in.size()) {
+    uint32_t keyLen;
+    if (in.size() - index < sizeof(keyLen)) {
+      throw OpenABE_ERROR_INVALID_LENGTH;
+    }
+    memcpy(&keyLen, in.data() + index, sizeof(keyLen));
+    index += sizeof(keyLen);
+    if (in.size() - index < (size_t)keyLen + sizeof(g1_ptr)) {
+      throw OpenABE_ERROR_INVALID_LENGTH;
+    }
+    string key = in.substr(index, keyLen);
+    memcpy(&point.m_G1, in.data() + index + keyLen, sizeof(g1_ptr));
+    index += keyLen + sizeof(g1_ptr);
+    this->insertHashLocked(key, point);
+  }
+#endif
+}
+
+/*!
+ * Find a cached hash entry and mark it most recently used. Must be called
+ * with the hash lock held.
+ *
+ * @param[in]   the cache key (hash prefix || label).
+ * @return  the entry, or the end of the list on a miss.
+ */
+OpenABEPrecomputedParams::HashCacheList::iterator
+OpenABEPrecomputedParams::lookupHashLocked(const string &key) {
+  auto it = this->hashIndex_.find(key);
+  if (it == this->hashIndex_.end()) {
+    return this->hashList_.end();
+  }
+  this->hashList_.splice(this->hashList_.begin(), this->hashList_, it->second);
+  return it->second;
+}
+
+/*!
+ * Add a freshly hashed point unless another thread got there first, and
+ * evict the least recently used entry (and its table) once the cache is
+ * full. Must be called with the hash lock held.
+ *
+ * @param[in]   the cache key (hash prefix || label).
+ * @param[in]   the hashed point.
+ * @return  the entry for the key.
+ */
+OpenABEPrecomputedParams::HashCacheList::iterator
+OpenABEPrecomputedParams::insertHashLocked(const string &key, const G1 &point) {
+  auto it = this->hashIndex_.find(key);
+  if (it != this->hashIndex_.end()) {
+    return it->second;
+  }
+  this->hashList_.emplace_front(key, HashCacheEntry(point));
+  this->hashIndex_[key] = this->hashList_.begin();
+  if (this->hashList_.size() > this->hashCacheSize_) {
+    if (this->hashList_.back().second.table) {
+      this->tableCount_--;
+    }
+    this->hashIndex_.erase(this->hashList_.back().first);
+    this->hashList_.pop_back();
+  }
+  return this->hashList_.begin();
+}
+
+/*!
+ * Release the table of the least recently used attribute that has one.
+ * Its hit count starts over, so it has to become hot again to get a new
+ * table. Must be called with the hash lock held.
+ */
+void OpenABEPrecomputedParams::dropTableLocked() {
+  for (auto it = this->hashList_.rbegin(); it != this->hashList_.rend(); ++it) {
+    if (it->second.table) {
+      it->second.table.reset();
+      it->second.ticket.reset();
+      it->second.hits = 0;
+      this->tableCount_--;
+      return;
+    }
+  }
+}
+
+/*!
+ * Called back by the precomputation store to evict an attribute table.
+ * Like dropTableLocked, the label has to become hot again to get another.
+ *
+ * @param[in]   the cache key (hash prefix || label).
+ * @param[in]   the ticket of the table to drop.
+ */
+void OpenABEPrecomputedParams::evictTable(const string &key,
+                                          const OpenABEPrecomputeTicket *ticket) {
+  lock_guard<mutex> lock(this->hashLock_);
+  auto it = this->hashIndex_.find(key);
+  if (it == this->hashIndex_.end() || it->second->second.ticket.get() != ticket) {
+    return;
+  }
+  HashCacheEntry &entry = it->second->second;
+  entry.table.reset();
+  entry.ticket.reset();
+  entry.hits = 0;
+  this->tableCount_--;
+}
+
+/*!
+ * Fill the cache with the labels of an upcoming encryption or key
+ * generation. The misses are hashed together, which is much faster than
+ * one at a time on a cold cache; at most hashCacheSize of them, since more
+ * would push each other out before they are used.
+ *
+ * @param[in]   the pairing used to compute cache misses.
+ * @param[in]   the hash key prefix 'k' from the MPK.
+ * @param[in]   the attribute labels (may repeat).
+ * @param[in]   the most threads to hash with (0 = the whole pool).
+ */
+void OpenABEPrecomputedParams::prefetchHashes(OpenABEPairing *pairing, OpenABEByteString &k,
+                                              const vector<string> &labels,
+                                              size_t maxConcurrency) {
+  if (pairing == nullptr) {
+    throw OpenABE_ERROR_INVALID_INPUT;
+  }
+  if (this->hashCacheSize_ == 0 || labels.size() < 2) {
+    return;
+  }
+  const string prefix = k.toString();
+  vector<string> misses;
+  {
+    lock_guard<mutex> lock(this->hashLock_);
+    set<string> seen;
+    for (const string &label : labels) {
+      if (misses.size() >= this->hashCacheSize_) {
+        break;
+      }
+      if (this->hashIndex_.count(prefix + label) == 0 && seen.insert(label).second) {
+        misses.push_back(label);
+      }
+    }
+  }
+  if (misses.size() < 2) {
+    // a single miss is left to the lookup itself
+    return;
+  }
+  OpenABE_countMetric(OpenABE_METRIC_HASH_CACHE_MISSES, misses.size());
+
+  vector<G1> points = pairing->hashToG1Batch(k, misses, maxConcurrency);
+  lock_guard<mutex> lock(this->hashLock_);
+  for (size_t i = 0; i < misses.size(); i++) {
+    this->insertHashLocked(prefix + misses[i], points[i]);
+  }
+}
+
+/*!
+ * Hash an attribute label to G1 under the hash key prefix of the MPK.
+ * Results are kept in a bounded LRU cache so that labels which repeat
+ * across encryptions and key generations are hashed only once.
+ *
+ * @param[in]   the pairing used to compute cache misses.
+ * @param[in]   the hash key prefix 'k' from the MPK.
+ * @param[in]   the attribute label.
+ * @return  the hashed G1 element.
+ */
+G1 OpenABEPrecomputedParams::hashToG1(OpenABEPairing *pairing,
+                                      OpenABEByteString &k, const string &label) {
+  if (pairing == nullptr) {
+    throw OpenABE_ERROR_INVALID_INPUT;
+  }
+  string key = k.toString() + label;
+  {
+    lock_guard<mutex> lock(this->hashLock_);
+    auto it = this->lookupHashLocked(key);
+    if (it != this->hashList_.end()) {
+      OpenABE_countMetric(OpenABE_METRIC_HASH_CACHE_HITS);
+      return it->second.point;
+    }
+  }
+  OpenABE_countMetric(OpenABE_METRIC_HASH_CACHE_MISSES);
+
+  // compute outside the lock; concurrent misses on the same label are benign
+  G1 point = pairing->hashToG1(k, label);
+  if (this->hashCacheSize_ == 0) {
+    return point;
+  }
+
+  lock_guard<mutex> lock(this->hashLock_);
+  this->insertHashLocked(key, point);
+  return point;
+}
+
+/*!
+ * Look up a label that is about to be exponentiated. Every call counts as
+ * a hit on the cached point; once a label has been exponentiated
+ * ATTRIBUTE_TABLE_MIN_HITS times it gets a fixed-base table, which turns
+ * the variable-base multiplication into table additions. Tables are
+ * large, so only the tableCacheSize most recently used hot labels keep one.
+ *
+ * @param[in]   the pairing used to compute cache misses.
+ * @param[in]   the hash key prefix 'k' from the MPK.
+ * @param[in]   the attribute label.
+ * @param[out]  the hashed point, set when no table is returned.
+ * @return  the table of the label, or nullptr.
+ */
+shared_ptr<const G1FixedBase>
+OpenABEPrecomputedParams::lookupForExp(OpenABEPairing *pairing, OpenABEByteString &k,
+                                       const string &label, unique_ptr<G1> &point) {
+  if (pairing == nullptr) {
+    throw OpenABE_ERROR_INVALID_INPUT;
+  }
+  string key = k.toString() + label;
+  shared_ptr<const G1FixedBase> table;
+  bool promote = false;
+  {
+    lock_guard<mutex> lock(this->hashLock_);
+    auto it = this->lookupHashLocked(key);
+    if (it != this->hashList_.end()) {
+      OpenABE_countMetric(OpenABE_METRIC_HASH_CACHE_HITS);
+      HashCacheEntry &entry = it->second;
+      table = entry.table;
+      if (table) {
+        entry.ticket->touch();
+      } else {
+        point.reset(new G1(entry.point));
+        entry.hits++;
+        if (!entry.building && this->tableCacheSize_ > 0 &&
+            entry.hits >= ATTRIBUTE_TABLE_MIN_HITS) {
+          // only one thread builds the table of a given label
+          entry.building = promote = true;
+        }
+      }
+    }
+  }
+  if (table) {
+    return table;
+  }
+
+  if (!point) {
+    OpenABE_countMetric(OpenABE_METRIC_HASH_CACHE_MISSES);
+    point.reset(new G1(pairing->hashToG1(k, label)));
+    if (this->hashCacheSize_ > 0) {
+      lock_guard<mutex> lock(this->hashLock_);
+      this->insertHashLocked(key, *point);
+    }
+  }
+  if (!promote) {
+    return nullptr;
+  }
+
+  // build outside the lock, then publish it if the entry is still cached
+  table = make_shared<const G1FixedBase>(*point, this->attached_);
+  OpenABEPrecomputeManager *store = OpenABEPrecomputeManager::getDefault();
+  {
+    lock_guard<mutex> lock(this->hashLock_);
+    auto it = this->lookupHashLocked(key);
+    if (it != this->hashList_.end()) {
+      it->second.building = false;
+      if (!it->second.table) {
+        if (this->tableCount_ >= this->tableCacheSize_) {
+          this->dropTableLocked();
+        }
+        it->second.table = table;
+        it->second.ticket = store->track(this->owner_, key, table->getMemoryUsage());
+        this->tableCount_++;
+      }
+    }
+  }
+  // the new table may push the store over its budget
+  store->enforceBudget();
+  return table;
+}
+
+/*!
+ * Compute H(k || label)^z, through a fixed-base table once the label is hot.
+ *
+ * @param[in]   the pairing used to compute cache misses.
+ * @param[in]   the hash key prefix 'k' from the MPK.
+ * @param[in]   the attribute label.
+ * @param[in]   the exponent.
+ * @return  the hashed G1 element raised to z.
+ */
+G1 OpenABEPrecomputedParams::hashToG1Exp(OpenABEPairing *pairing, OpenABEByteString &k,
+                                         const string &label, const ZP &z) {
+  unique_ptr<G1> point;
+  shared_ptr<const G1FixedBase> table = this->lookupForExp(pairing, k, label, point);
+  if (table) {
+    return table->exp(z);
+  }
+  point->expInPlace(z);
+  return *point;
+}
+
+/*!
+ * Compute base^e * H(k || label)^z. A hot label has two tables, and two
+ * table lookups beat any variable-base form. Otherwise the fixed-base
+ * table does not pay for itself against a double exponentiation that
+ * shares its doublings with the hashed point's, so both terms go through
+ * G1::doubleExp.
+ *
+ * @param[in]   the pairing used to compute cache misses.
+ * @param[in]   the hash key prefix 'k' from the MPK.
+ * @param[in]   the attribute label.
+ * @param[in]   the exponent of the hashed point.
+ * @param[in]   the fixed-base table of the other base.
+ * @param[in]   the exponent of the other base.
+ * @return  the resulting G1 element.
+ */
+G1 OpenABEPrecomputedParams::hashToG1Exp(OpenABEPairing *pairing, OpenABEByteString &k,
+                                         const string &label, const ZP &z,
+                                         const G1FixedBase &base, const ZP &e) {
+  unique_ptr<G1> point;
+  shared_ptr<const G1FixedBase> table = this->lookupForExp(pairing, k, label, point);
+  if (table) {
+    return base.exp(e) * table->exp(z);
+  }
+  return G1::doubleExp(base.getBase(), e, *point, z);
+}
+
+size_t OpenABEPrecomputedParams::getHashCacheCount() {
+  lock_guard<mutex> lock(this->hashLock_);
+  return this->hashList_.size();
+}
+
+size_t OpenABEPrecomputedParams::getAttributeTableCount() {
+  lock_guard<mutex> lock(this->hashLock_);
+  return this->tableCount_;
+}
+
+namespace {
+// Least-recently-used table of decoded user keys, keyed by the SHA-256 of
+// their serialized blobs. The keys are shared with the keystores that
+// imported them; whoever drops the last reference zeroizes the key.
+class OpenABEUserKeyCache {
+public:
+  OpenABEUserKeyCache() : maxKeys_(0), maxBytes_(0), bytes_(0) {}
+  ~OpenABEUserKeyCache() { this->resize(0, 0); }
+
+  bool enabled() {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    return (this->maxKeys_ > 0);
+  }
+
+  shared_ptr<OpenABEKey> find(const string &digest) {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    auto it = this->index_.find(digest);
+    if (it == this->index_.end()) {
+      return nullptr;
+    }
+    this->entries_.splice(this->entries_.begin(), this->entries_, it->second);
+    return it->second->key;
+  }
+
+  void insert(const string &digest, size_t blobSize, const shared_ptr<OpenABEKey> &key) {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    if (key == nullptr || blobSize > this->maxBytes_ ||
+        this->index_.count(digest) != 0) {
+      return;
+    }
+    this->entries_.push_front(Entry{digest, blobSize, key});
+    this->index_[digest] = this->entries_.begin();
+    this->bytes_ += blobSize;
+    this->evict(this->maxKeys_, this->maxBytes_);
+  }
+
+  void resize(size_t maxKeys, size_t maxBytes) {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    this->maxKeys_ = maxKeys;
+    this->maxBytes_ = maxBytes;
+    this->evict(maxKeys, maxBytes);
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    this->evict(0, 0);
+  }
+
+  size_t size() {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    return this->entries_.size();
+  }
+
+private:
+  struct Entry {
+    string digest;
+    size_t bytes;
+    shared_ptr<OpenABEKey> key;
+  };
+
+  // drop least recently used keys until both limits hold
+  void evict(size_t maxKeys, size_t maxBytes) {
+    while (!this->entries_.empty() &&
+           (this->entries_.size() > maxKeys || this->bytes_ > maxBytes)) {
+      Entry &victim = this->entries_.back();
+      if (victim.key.use_count() == 1) {
+        victim.key->zeroize();
+      }
+      this->bytes_ -= victim.bytes;
+      this->index_.erase(victim.digest);
+      this->entries_.pop_back();
+    }
+  }
+
+  typedef std::list<Entry> EntryList;
+  std::mutex lock_;
+  size_t maxKeys_, maxBytes_, bytes_;
+  EntryList entries_;
+  std::unordered_map<string, EntryList::iterator> index_;
+};
+
+OpenABEUserKeyCache& userKeyCache() {
+  static OpenABEUserKeyCache cache;
+  return cache;
+}
+}
+
+void enableUserKeyCache(size_t maxKeys, size_t maxBytes) {
+  userKeyCache().resize(maxKeys, maxBytes);
+}
+
+void disableUserKeyCache() {
+  userKeyCache().resize(0, 0);
+}
+
+void clearUserKeyCache() {
+  userKeyCache().clear();
+}
+
+size_t getUserKeyCacheCount() {
+  return userKeyCache().size();
+}
+
 /********************************************************************************
  * Implementation of the OpenABEContextSchemeCPA class
  ********************************************************************************/
@@ -93,7 +799,9 @@ OpenABEContextSchemeCPA::OpenABEContextSchemeCPA(unique_ptr<OpenABEContextABE> k
     throw OpenABE_ERROR_INVALID_INPUT;
   }
   if (kem_->getSchemeType() == OpenABE_SCHEME_KP_GPSW ||
-             kem_->getSchemeType() == OpenABE_SCHEME_CP_WATERS) {
+             kem_->getSchemeType() == OpenABE_SCHEME_CP_WATERS ||
+             kem_->getSchemeType() == OpenABE_SCHEME_CP_FAME ||
+             kem_->getSchemeType() == OpenABE_SCHEME_CP_WATERS_FD) {
     this->isMAABE = false;
   } else {
     /* unrecognized scheme type */
@@ -192,11 +900,14 @@ OpenABEContextSchemeCPA::exportKey(const string &keyID, OpenABEByteString &keyBl
  * @param[in]	serialized blob that represents the key parameters.
  * @param[in]	an optional password to derive a key for decrypting the serialized blob.
  * @param[in]   a key type for designating storage in keystore.
+ * @param[in]	defer decoding and validating the key's points to their first use (for authenticated blobs only).
+ * @param[in]	optional: the snapshot tables to give the key.
  * @return  An error code or OpenABE_NOERROR.
  */
 OpenABE_ERROR
 OpenABEContextSchemeCPA::loadKey(const string &ID, OpenABEByteString &keyBlob,
-                          zKeyType keyType) {
+                          zKeyType keyType, bool deferValidation,
+                          const OpenABEAttachedTables &attached) {
   OpenABEByteString outputKeyBytes;
   shared_ptr<OpenABEKey> KEY = this->m_KEM_->getKeystore()->parseKeyHeader(
       ID, keyBlob, outputKeyBytes);
@@ -218,7 +929,9 @@ OpenABEContextSchemeCPA::loadKey(const string &ID, OpenABEByteString &keyBlob,
   }
   // now, we can load the key
   KEY->setGroup(this->m_KEM_->getPairing()->getGroup());
+  KEY->setLazyDecoding(deferValidation);
   KEY->loadKeyFromBytes(outputKeyBytes);
+  KEY->setAttachedTables(attached);
   this->m_KEM_->getKeystore()->addKey(ID, KEY, keyType);
 
   return OpenABE_NOERROR;
@@ -230,12 +943,31 @@ OpenABEContextSchemeCPA::loadKey(const string &ID, OpenABEByteString &keyBlob,
  * @param[in]	identifier for the public key in the keystore.
  * @param[in]	serialized blob that represents the public parameters.
  * @param[in]	an optional password to derive a key for decrypting the serialized blob.
+ * @param[in]	defer decoding and validating the key's points to their first use (for authenticated blobs only).
+ * @param[in]	optional: the tables of the snapshot the blob came from.
  * @return  An error code or OpenABE_NOERROR.
  */
 OpenABE_ERROR
 OpenABEContextSchemeCPA::loadMasterPublicParams(const string &mpkID,
-                                         OpenABEByteString &mpkBlob) {
-  return this->loadKey(mpkID, mpkBlob, KEY_TYPE_PUBLIC);
+                                         OpenABEByteString &mpkBlob,
+                                         bool deferValidation,
+                                         const OpenABEAttachedTables &attached) {
+  OpenABE_ERROR result = this->loadKey(mpkID, mpkBlob, KEY_TYPE_PUBLIC, deferValidation, attached);
+  if (result != OpenABE_NOERROR) {
+    return result;
+  }
+  return this->m_KEM_->precomputeMasterPublicParams(mpkID);
+}
+
+OpenABEMPKHandle
+OpenABEContextSchemeCPA::getMasterPublicParamsHandle(const string &mpkID) {
+  return this->m_KEM_->getMasterPublicParamsHandle(mpkID);
+}
+
+OpenABE_ERROR
+OpenABEContextSchemeCPA::attachMasterPublicParams(const string &mpkID,
+                                           const OpenABEMPKHandle &handle) {
+  return this->m_KEM_->attachMasterPublicParams(mpkID, handle);
 }
 
 /*!
@@ -258,15 +990,126 @@ OpenABEContextSchemeCPA::loadMasterSecretParams(const string &mskID,
  * @param[in]	identifier for the secret key in the keystore.
  * @param[in]	serialized blob that represents the secret parameters.
  * @param[in]	an optional password to derive a key for decrypting the serialized blob.
+ * @param[in]	defer decoding and validating the key's points to their first use (for authenticated blobs only).
+ * @param[in]	optional: the tables of the snapshot the blob came from.
  * @return  An error code or OpenABE_NOERROR.
  */
 
 OpenABE_ERROR
 OpenABEContextSchemeCPA::loadUserSecretParams(const string &skID,
-                                       OpenABEByteString &skBlob) {
-  return this->loadKey(skID, skBlob, KEY_TYPE_SECRET);
+                                       OpenABEByteString &skBlob,
+                                       bool deferValidation,
+                                       const OpenABEAttachedTables &attached) {
+  // a key with snapshot tables is not shared through the cache
+  if (!userKeyCache().enabled() || attached) {
+    return this->loadKey(skID, skBlob, KEY_TYPE_SECRET, deferValidation, attached);
+  }
+
+  string digest;
+  sha256(digest, skBlob.toString());
+  shared_ptr<OpenABEKey> KEY = userKeyCache().find(digest);
+  OpenABE_countMetric(KEY ? OpenABE_METRIC_KEY_CACHE_HITS : OpenABE_METRIC_KEY_CACHE_MISSES);
+  if (KEY == nullptr) {
+    OpenABE_ERROR result = this->loadKey(skID, skBlob, KEY_TYPE_SECRET, deferValidation);
+    if (result == OpenABE_NOERROR) {
+      userKeyCache().insert(digest, skBlob.size(),
+                            this->m_KEM_->getKeystore()->getSecretKey(skID));
+    }
+    return result;
+  }
+
+  // the blob was decoded and validated before: only check that its header
+  // fits this context, as loadKey would
+  if (this->m_KEM_->getPairing() == nullptr) {
+    this->m_KEM_->initializeCurve(
+        OpenABE_convertCurveIDToString((OpenABECurveID)KEY->getCurveID()));
+  }
+  if (KEY->getCurveID() != this->m_KEM_->getPairing()->getCurveID() ||
+      KEY->getAlgorithmID() != this->m_KEM_->getAlgorithmID()) {
+    return OpenABE_ERROR_INVALID_KEY_HEADER;
+  }
+  return this->m_KEM_->getKeystore()->addKey(skID, KEY, KEY_TYPE_SECRET);
 }
 
+/*!
+ * Load and validate many user secret keys at once (see
+ * loadUserSecretParams). The headers are read first and every body is then
+ * decoded on the library thread pool; the keys are added to the keystore
+ * together, and only if all of them loaded.
+ *
+ * @param[in]	identifiers for the secret keys in the keystore.
+ * @param[in]	serialized blobs of the keys, in the same order.
+ * @param[in]	defer decoding and validating the keys' points to their first use (for authenticated blobs only).
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCPA::loadUserSecretParamsMany(const vector<string> &skIDs,
+                                           vector<OpenABEByteString> &skBlobs,
+                                           bool deferValidation) {
+  if (skIDs.size() != skBlobs.size()) {
+    return OpenABE_ERROR_INVALID_INPUT;
+  }
+  const size_t count = skIDs.size();
+  const bool useCache = userKeyCache().enabled();
+  OpenABEKeystore *keystore = this->m_KEM_->getKeystore();
+  vector<shared_ptr<OpenABEKey>> keys(count);
+  vector<OpenABEByteString> keyBytes(count);
+  vector<string> digests(count);
+  vector<bool> cached(count, false);
+
+  for (size_t i = 0; i < count; i++) {
+    if (useCache) {
+      sha256(digests[i], skBlobs[i].toString());
+      keys[i] = userKeyCache().find(digests[i]);
+      cached[i] = (keys[i] != nullptr);
+      OpenABE_countMetric(cached[i] ? OpenABE_METRIC_KEY_CACHE_HITS : OpenABE_METRIC_KEY_CACHE_MISSES);
+    }
+    if (!cached[i]) {
+      keys[i] = keystore->parseKeyHeader(skIDs[i], skBlobs[i], keyBytes[i]);
+      if (keys[i] == nullptr) {
+        return OpenABE_ERROR_INVALID_INPUT;
+      }
+    }
+    if (this->m_KEM_->getPairing() == nullptr) {
+      this->m_KEM_->initializeCurve(
+          OpenABE_convertCurveIDToString((OpenABECurveID)keys[i]->getCurveID()));
+    }
+    if (keys[i]->getCurveID() != this->m_KEM_->getPairing()->getCurveID() ||
+        keys[i]->getAlgorithmID() != this->m_KEM_->getAlgorithmID()) {
+      return OpenABE_ERROR_INVALID_KEY_HEADER;
+    }
+  }
+
+  vector<OpenABE_ERROR> status(count, OpenABE_NOERROR);
+  shared_ptr<ZGroup> group = this->m_KEM_->getPairing()->getGroup();
+  OpenABEThreadPool::getDefault()->parallelFor(count, [&](size_t i) {
+    if (cached[i]) {
+      return;
+    }
+    try {
+      keys[i]->setGroup(group);
+      keys[i]->setLazyDecoding(deferValidation);
+      keys[i]->loadKeyFromBytes(keyBytes[i]);
+    } catch (OpenABE_ERROR &error) {
+      status[i] = error;
+    }
+    keyBytes[i].zeroize();
+  });
+  for (size_t i = 0; i < count; i++) {
+    if (status[i] != OpenABE_NOERROR) {
+      return status[i];
+    }
+  }
+
+  if (useCache) {
+    for (size_t i = 0; i < count; i++) {
+      if (!cached[i]) {
+        userKeyCache().insert(digests[i], skBlobs[i].size(), keys[i]);
+      }
+    }
+  }
+  return keystore->addKeys(skIDs, keys, KEY_TYPE_SECRET);
+}
 
 /*!
  * Delete a key from the in-memory keystore given a key identifier.
@@ -355,6 +1198,92 @@ OpenABEContextSchemeCPA::encrypt(OpenABERNG *rng, const string &mpkID,
   return result;
 }
 
+/*!
+ * Estimate an encryption of plaintextLen bytes: the cost of the KEM and a
+ * skeleton of the ciphertext whose serialized size is that of encrypt().
+ *
+ * @param[in]   parameters ID for the master public key.
+ * @param[in]   the function input of the encryption.
+ * @param[in]   the length of the plaintext.
+ * @param[out]  the skeleton ciphertext (must be allocated).
+ * @param[out]  the operation counts.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR
+OpenABEContextSchemeCPA::estimate(const string &mpkID,
+                          const OpenABEFunctionInput *encryptInput,
+                          uint32_t plaintextLen, OpenABECiphertext *skeleton,
+                          OpenABEEncryptionCost &cost) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+
+  try {
+    ASSERT_NOTNULL(skeleton);
+    result = this->m_KEM_->estimateKEM(mpkID, encryptInput, DEFAULT_SYM_KEY_BYTES,
+                                       skeleton, cost);
+    ASSERT(result == OpenABE_NOERROR, result);
+    // the encrypted data is as long as the plaintext
+    OpenABEByteString y;
+    y.fillBuffer(0, plaintextLen);
+    skeleton->setComponent("_ED", &y);
+  } catch (OpenABE_ERROR &error) {
+    result = error;
+  }
+
+  return result;
+}
+
+/*!
+ * Check that a ciphertext is exactly the encryption of the given
+ * plaintext under the given RNG, without building a second ciphertext.
+ *
+ * @param[in]   the RNG the ciphertext is expected to be derived from.
+ * @param[in]   parameters ID for the master public key.
+ * @param[in]   the function input of the ciphertext.
+ * @param[in]   the expected plaintext.
+ * @param[in]   the ciphertext to check.
+ * @return  OpenABE_NOERROR or OpenABE_ERROR_DECRYPTION_FAILED on mismatch.
+ */
+
+OpenABE_ERROR
+OpenABEContextSchemeCPA::verify(OpenABERNG *rng, const string &mpkID,
+                          const OpenABEFunctionInput *encryptInput,
+                          OpenABEByteString *plaintext, OpenABECiphertext *ciphertext) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  shared_ptr<OpenABESymKey> K(new OpenABESymKey);
+  unique_ptr<OpenABERNG> PRNG = nullptr;
+  OpenABEByteString y;
+  uint32_t numComponents = 0;
+
+  try {
+    ASSERT_NOTNULL(plaintext);
+    ASSERT_NOTNULL(ciphertext);
+    result = this->m_KEM_->verifyKEM(rng, mpkID, encryptInput, DEFAULT_SYM_KEY_BYTES,
+                                     K, ciphertext, numComponents);
+    ASSERT(result == OpenABE_NOERROR, result);
+    // the KEM components plus the encrypted data, and nothing else
+    ASSERT(ciphertext->numComponents() == numComponents + 1,
+           OpenABE_ERROR_DECRYPTION_FAILED);
+
+    // recompute the encrypted data as in encrypt()
+    OpenABEByteString hashK = this->m_KEM_->getPairing()->hashFromBytes(
+        K->getKeyBytes(), OpenABE_CTR_DRBG_NONCELEN, SCHEME_HASH_FUNCTION);
+    PRNG.reset(new OpenABECTR_DRBG(K->getInternalPtr(), K->getLength()));
+    PRNG->setSeed(hashK);
+    PRNG->getRandomBytes(&y, plaintext->size());
+    y ^= *plaintext;
+    ASSERT(ciphertext->matchComponent("_ED", &y), OpenABE_ERROR_DECRYPTION_FAILED);
+
+    hashK.zeroize();
+  } catch (OpenABE_ERROR &error) {
+    result = error;
+  }
+
+  K->zeroize();
+  y.zeroize();
+  return result;
+}
+
  /*!
   * Decrypt a symmetric key using the key encapsulation mode
   * of the underlying scheme. Use the key with PRNG to decrypt
@@ -369,14 +1298,85 @@ OpenABEContextSchemeCPA::encrypt(OpenABERNG *rng, const string &mpkID,
 OpenABE_ERROR
 OpenABEContextSchemeCPA::decrypt(const string &mpkID, const string &keyID,
                           OpenABEByteString *plaintext, OpenABECiphertext *ciphertext) {
+  shared_ptr<OpenABESymKey> K(new OpenABESymKey);
+  OpenABE_ERROR result = this->m_KEM_->decryptKEM(mpkID, keyID, ciphertext,
+                                                  DEFAULT_SYM_KEY_BYTES, K);
+  if (result != OpenABE_NOERROR) {
+    return result;
+  }
+  return this->decryptData(K, plaintext, ciphertext);
+}
+
+/*!
+ * Server side of outsourced decryption: transform a ciphertext with a
+ * transformation key. 'transformed' holds the partially decrypted KEM
+ * and the encrypted data.
+ *
+ * @param[in]   master public key identifier in keystore.
+ * @param[in]   transformation key identifier in keystore.
+ * @param[in]   the ciphertext.
+ * @param[out]  the transformed ciphertext.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCPA::transform(const string &mpkID, const string &tkID,
+                          OpenABECiphertext *ciphertext, OpenABECiphertext *transformed) {
   OpenABE_ERROR result = OpenABE_NOERROR;
+
+  try {
+    ASSERT_NOTNULL(ciphertext);
+    ASSERT_NOTNULL(transformed);
+    OpenABEByteString *encMessage = ciphertext->getByteString("_ED");
+    if (encMessage == nullptr) {
+      throw OpenABE_ERROR_INVALID_INPUT;
+    }
+    result = this->m_KEM_->transformKEM(mpkID, tkID, ciphertext, transformed);
+    ASSERT(result == OpenABE_NOERROR, result);
+    transformed->setComponent("_ED", encMessage);
+  } catch (OpenABE_ERROR &error) {
+    result = error;
+  }
+
+  return result;
+}
+
+/*!
+ * Client side of outsourced decryption: decrypt a transformed ciphertext
+ * with the retrieval key.
+ *
+ * @param[in]   retrieval key identifier in keystore.
+ * @param[out]  the plaintext.
+ * @param[in]   the transformed ciphertext.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCPA::decryptTransformed(const string &rkID, OpenABEByteString *plaintext,
+                          OpenABECiphertext *transformed) {
   shared_ptr<OpenABESymKey> K(new OpenABESymKey);
+  OpenABE_ERROR result = this->m_KEM_->finishTransformedKEM(rkID, transformed,
+                                                            DEFAULT_SYM_KEY_BYTES, K);
+  if (result != OpenABE_NOERROR) {
+    return result;
+  }
+  return this->decryptData(K, plaintext, transformed);
+}
+
+/*!
+ * Decrypt the data of a ciphertext given its KEM key: PRNG(K) XOR _ED.
+ * Zeroizes the key.
+ *
+ * @param[in]   the KEM key.
+ * @param[out]  the plaintext.
+ * @param[in]   the ciphertext.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCPA::decryptData(const shared_ptr<OpenABESymKey> &K,
+                          OpenABEByteString *plaintext, OpenABECiphertext *ciphertext) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
   unique_ptr<OpenABERNG> PRNG = nullptr;
 
   try {
-    result = this->m_KEM_->decryptKEM(mpkID, keyID, ciphertext,
-                                      DEFAULT_SYM_KEY_BYTES, K);
-    ASSERT(result == OpenABE_NOERROR, result);
     // retrieve encrypted data
     OpenABEByteString *encMessage =
         ciphertext->getByteString("_ED"); // encryptedData
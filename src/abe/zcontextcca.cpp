@@ -90,8 +90,34 @@ OpenABEContextCCA::exportKey(const string &keyID, OpenABEByteString &keyBlob) {
  */
 OpenABE_ERROR
 OpenABEContextCCA::loadMasterPublicParams(const string &mpkID,
-                                      OpenABEByteString &mpkBlob) {
-  return this->abeSchemeContext->loadMasterPublicParams(mpkID, mpkBlob);
+                                      OpenABEByteString &mpkBlob,
+                                      bool deferValidation,
+                                      const OpenABEAttachedTables &attached) {
+  return this->abeSchemeContext->loadMasterPublicParams(mpkID, mpkBlob, deferValidation, attached);
+}
+
+/*!
+ * Return a shareable handle to a loaded master public key.
+ *
+ * @param[in]	identifier for the public key in the keystore.
+ * @return  The handle, or nullptr if the key is not loaded.
+ */
+OpenABEMPKHandle
+OpenABEContextCCA::getMasterPublicParamsHandle(const string &mpkID) {
+  return this->abeSchemeContext->getMasterPublicParamsHandle(mpkID);
+}
+
+/*!
+ * Use a master public key decoded by another context.
+ *
+ * @param[in]	identifier for the public key in the keystore.
+ * @param[in]	handle obtained from getMasterPublicParamsHandle.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextCCA::attachMasterPublicParams(const string &mpkID,
+                                   const OpenABEMPKHandle &handle) {
+  return this->abeSchemeContext->attachMasterPublicParams(mpkID, handle);
 }
 
 /*!
@@ -118,8 +144,17 @@ OpenABEContextCCA::loadMasterSecretParams(const string &mskID,
  */
 
 OpenABE_ERROR
-OpenABEContextCCA::loadUserSecretParams(const string &skID, OpenABEByteString &skBlob) {
-  return this->abeSchemeContext->loadUserSecretParams(skID, skBlob);
+OpenABEContextCCA::loadUserSecretParams(const string &skID, OpenABEByteString &skBlob,
+                                        bool deferValidation,
+                                        const OpenABEAttachedTables &attached) {
+  return this->abeSchemeContext->loadUserSecretParams(skID, skBlob, deferValidation, attached);
+}
+
+OpenABE_ERROR
+OpenABEContextCCA::loadUserSecretParamsMany(const vector<string> &skIDs,
+                                            vector<OpenABEByteString> &skBlobs,
+                                            bool deferValidation) {
+  return this->abeSchemeContext->loadUserSecretParamsMany(skIDs, skBlobs, deferValidation);
 }
 
 
@@ -140,6 +175,34 @@ OpenABEContextCCA::checkSecretKey(const string keyID)
     return this->abeSchemeContext->checkSecretKey(keyID);
 }
 
+OpenABE_ERROR
+OpenABEContextCCA::delegateKey(const string &mpkID, const string &keyID,
+                               OpenABEFunctionInput *keyInput,
+                               const string &newKeyID) {
+  return this->abeSchemeContext->delegateKey(mpkID, keyID, keyInput, newKeyID);
+}
+
+OpenABE_ERROR
+OpenABEContextCCA::extendDecryptionKey(const string &mpkID, const string &mskID,
+                                       const string &keyID,
+                                       OpenABEFunctionInput *keyInput,
+                                       const string &deltaID) {
+  return this->abeSchemeContext->extendKey(mpkID, mskID, keyID, keyInput, deltaID);
+}
+
+OpenABE_ERROR
+OpenABEContextCCA::applyKeyDelta(const string &keyID, const string &deltaID) {
+  return this->abeSchemeContext->applyKeyDelta(keyID, deltaID);
+}
+
+OpenABE_ERROR
+OpenABEContextCCA::generateKeyUpdate(const string &mpkID, const string &mskID,
+                                     const string &keyID,
+                                     OpenABEFunctionInput *keyInput,
+                                     const string &updateID) {
+  return this->abeSchemeContext->generateKeyUpdate(mpkID, mskID, keyID, keyInput, updateID);
+}
+
 OpenABE_ERROR
 OpenABEContextCCA::generateGlobalParams(const string groupParams,
                                     const string &gpkID) {
@@ -248,21 +311,23 @@ OpenABEContextGenericCCA::encryptKEM(OpenABERNG *rng, const string &mpkID,
     // CRITICAL FIX FOR BUG #15: Canonicalize policy tree structure
     // For CP-ABE policies, canonicalize the tree to ensure deterministic child ordering.
     // This ensures the LSSS traversal order is identical in both encryption and re-encryption.
-    unique_ptr<OpenABEFunctionInput> normalizedInput = nullptr;
+    const OpenABEFunctionInput *normalizedInput = encryptInput;
+    unique_ptr<OpenABEFunctionInput> canonicalCopy = nullptr;
     if (encryptInput->getFunctionType() == FUNC_POLICY_INPUT) {
-      // For CP-ABE policies, make a copy and canonicalize it
-      normalizedInput = copyFunctionInput(*encryptInput);
-      OpenABEPolicy *policy_ptr = dynamic_cast<OpenABEPolicy*>(normalizedInput.get());
+      const OpenABEPolicy *policy_ptr = dynamic_cast<const OpenABEPolicy*>(normalizedInput);
       if (policy_ptr == nullptr) {
         OpenABE_LOG_AND_THROW("Failed to cast to policy",
                           OpenABE_ERROR_INVALID_INPUT);
       }
-      // Explicitly canonicalize to ensure deterministic child ordering
-      policy_ptr->canonicalize();
-    } else {
-      // For KP-ABE attribute lists, use original (no tree structure issues)
-      normalizedInput = copyFunctionInput(*encryptInput);
+      // Policies from createPolicyTree are already canonical; only copy
+      // and canonicalize the ones built some other way
+      if (!policy_ptr->isCanonical()) {
+        canonicalCopy = copyFunctionInput(*policy_ptr);
+        static_cast<OpenABEPolicy*>(canonicalCopy.get())->canonicalize();
+        normalizedInput = canonicalCopy.get();
+      }
     }
+    // KP-ABE attribute lists are used as given (no tree structure issues)
 
     // set M = r || K
     OpenABEByteString M = r + K;
@@ -289,7 +354,7 @@ OpenABEContextGenericCCA::encryptKEM(OpenABERNG *rng, const string &mpkID,
     PRNG->setSeed(nonceU);
 
     // compute ciphertext, C using the normalized input
-    result = this->abeSchemeContext->encrypt(PRNG.get(), mpkID, normalizedInput.get(),
+    result = this->abeSchemeContext->encrypt(PRNG.get(), mpkID, normalizedInput,
                                              &M, ciphertext);
     if (result != OpenABE_NOERROR) {
       OpenABE_LOG_AND_THROW("ABE Encryption failed.", OpenABE_ERROR_ENCRYPTION_ERROR);
@@ -324,7 +389,6 @@ OpenABEContextGenericCCA::decryptKEM(const string &mpkID, const string &keyID,
   OpenABEByteString M;
   unique_ptr<OpenABERNG> PRNG = nullptr;
   unique_ptr<OpenABEFunctionInput> encryptInput = nullptr;
-  unique_ptr<OpenABECiphertext> ciphertext2(new OpenABECiphertext);
   OpenABEByteString u, nonceU, concat;
 
   try {
@@ -350,21 +414,23 @@ OpenABEContextGenericCCA::decryptKEM(const string &mpkID, const string &keyID,
     // CRITICAL FIX FOR BUG #15: Canonicalize policy tree structure (same as encryptKEM)
     // For CP-ABE policies, canonicalize the tree to ensure deterministic child ordering.
     // This ensures the LSSS traversal order is identical in both encryption and re-encryption.
-    unique_ptr<OpenABEFunctionInput> normalizedInput = nullptr;
+    const OpenABEFunctionInput *normalizedInput = encryptInput.get();
+    unique_ptr<OpenABEFunctionInput> canonicalCopy = nullptr;
     if (encryptInput->getFunctionType() == FUNC_POLICY_INPUT) {
-      // For CP-ABE policies, make a copy and canonicalize it
-      normalizedInput = copyFunctionInput(*encryptInput);
-      OpenABEPolicy *policy_ptr = dynamic_cast<OpenABEPolicy*>(normalizedInput.get());
+      const OpenABEPolicy *policy_ptr = dynamic_cast<const OpenABEPolicy*>(normalizedInput);
       if (policy_ptr == nullptr) {
         OpenABE_LOG_AND_THROW("Failed to cast to policy",
                           OpenABE_ERROR_INVALID_INPUT);
       }
-      // Explicitly canonicalize to ensure deterministic child ordering
-      policy_ptr->canonicalize();
-    } else {
-      // For KP-ABE attribute lists, use original (no tree structure issues)
-      normalizedInput = copyFunctionInput(*encryptInput);
+      // Policies from createPolicyTree are already canonical; only copy
+      // and canonicalize the ones built some other way
+      if (!policy_ptr->isCanonical()) {
+        canonicalCopy = copyFunctionInput(*policy_ptr);
+        static_cast<OpenABEPolicy*>(canonicalCopy.get())->canonicalize();
+        normalizedInput = canonicalCopy.get();
+      }
     }
+    // KP-ABE attribute lists are used as given (no tree structure issues)
 
     // r' || K' || A (use canonical form for policy to ensure consistent hashing)
     std::string canonical_policy = normalizedInput->toCanonicalString();
@@ -376,21 +442,21 @@ OpenABEContextGenericCCA::decryptKEM(const string &mpkID, const string &keyID,
     nonceU = this->abeSchemeContext->getPairing()->hashFromBytes(u, OpenABE_CTR_DRBG_NONCELEN,
                                                CCA_HASH_FUNCTION_TWO);
 
-    // Derive a deterministic UID from u (same as in encryptKEM)
-    // This ensures the re-encrypted ciphertext has the same UID
-    OpenABEByteString uid = u.getSubset(0, UID_LEN);
-    ciphertext2->setHeader(this->abeSchemeContext->getPairing()->getCurveID(), this->getSchemeType(), uid);
-
     // construct a new PRNG
     // set the key and seed (or plaintext)
     PRNG.reset(new OpenABECTR_DRBG(u));
     PRNG->setSeed(nonceU);
 
-    // compute ciphertext, C using the normalized input
-    result = this->abeSchemeContext->encrypt(
-        PRNG.get(), mpkID, normalizedInput.get(), &M, ciphertext2.get());
-    // verification check
-    if (*ciphertext == *ciphertext2) {
+    // verification check: the ciphertext must be the re-encryption of M
+    // under the normalized input. Components are recomputed and compared
+    // one at a time, so a forged ciphertext is rejected at the first
+    // mismatch.
+    OpenABETraceSpan verifySpan("cca.verify");
+    result = this->abeSchemeContext->verify(
+        PRNG.get(), mpkID, normalizedInput, &M, ciphertext);
+    verifySpan.setStatus(result);
+    verifySpan.end();
+    if (result == OpenABE_NOERROR) {
       key->setSymmetricKey(K);
     } else {
       OpenABE_LOG_AND_THROW("Failed ABE decryption verification check.",
@@ -404,148 +470,590 @@ OpenABEContextGenericCCA::decryptKEM(const string &mpkID, const string &keyID,
   return result;
 }
 
-/********************************************************************************
- * Implementation of the OpenABEContextSchemeCCA class
- ********************************************************************************/
-
 /*!
- * Constructor for the OpenABEContextSchemeCCA base class.
- * Note: we add to
+ * Estimate encryptKEM: the CPA encryption of r || K. Decryption re-encrypts
+ * to check the ciphertext, so it also costs the operations of encryption.
+ *
+ * @param   Parameters ID for the public master parameters.
+ * @param   Function input for the encryption.
+ * @param   Length of the symmetric key.
+ * @param   Skeleton ciphertext to fill.
+ * @param   Operation counts to be returned.
+ * @return  An error code or OpenABE_NOERROR.
  */
-OpenABEContextSchemeCCA::OpenABEContextSchemeCCA(unique_ptr<OpenABEContextCCA> kem_)
-    : ZObject() {
-  OpenABE_SCHEME scheme_type = OpenABE_SCHEME_NONE;
-  // upgrade the scheme type according to input KEM type
-  if (kem_->getSchemeType() == OpenABE_SCHEME_KP_GPSW) {
-    scheme_type = OpenABE_SCHEME_KP_GPSW_CCA;
-  } else if (kem_->getSchemeType() == OpenABE_SCHEME_CP_WATERS) {
-    scheme_type = OpenABE_SCHEME_CP_WATERS_CCA;
-  } else {
-    /* unrecognized scheme type */
-    throw OpenABE_ERROR_INVALID_INPUT;
+
+OpenABE_ERROR
+OpenABEContextGenericCCA::estimateKEM(const string &mpkID,
+                                  const OpenABEFunctionInput *encryptInput,
+                                  uint32_t keyByteLen, OpenABECiphertext *skeleton,
+                                  OpenABEEncryptionCost &cost) {
+  OpenABE_ERROR result = this->abeSchemeContext->estimate(mpkID, encryptInput,
+                                                          2 * keyByteLen, skeleton, cost);
+  if (result == OpenABE_NOERROR) {
+    cost.decryptExps += cost.encryptExps;
+    cost.decryptHashes += cost.encryptHashes;
   }
-  this->m_KEM_ = std::move(kem_);
-  this->m_KEM_->setSchemeType(scheme_type);
+  return result;
 }
 
 /*!
- * Destructor for the OpenABEContextABE base class.
+ * Split a decryption key for outsourced decryption (see the KEM).
  *
+ * @param   Identifier for the decryption key.
+ * @param   Identifier for the transformation key to be created.
+ * @param   Identifier for the retrieval key to be created.
+ * @return  An error code or OpenABE_NOERROR.
  */
-OpenABEContextSchemeCCA::~OpenABEContextSchemeCCA() {}
+
+OpenABE_ERROR
+OpenABEContextGenericCCA::generateTransformKey(const string &keyID, const string &tkID,
+                                           const string &rkID) {
+  return this->abeSchemeContext->generateTransformKey(keyID, tkID, rkID);
+}
 
 /*!
- * Generate parameters of the pairing curve based on a string identifier.
+ * Server side of outsourced decryption: transform the ABE ciphertext with
+ * a transformation key. The transformed ciphertext keeps the header of
+ * the original.
  *
- * @param[in]   specific string identifier to instantiate the pairing curve.
- * @param[in]   a string identifier for the master public parameters.
- * @param[in]   a string identifier for the master secret parameters.
+ * @param   Parameters ID for the public master parameters.
+ * @param   Identifier for the transformation key.
+ * @param   ABE ciphertext.
+ * @param   Transformed ciphertext to be returned.
  * @return  An error code or OpenABE_NOERROR.
  */
+
 OpenABE_ERROR
-OpenABEContextSchemeCCA::generateParams(const string groupParams,
-                                    const string &mpkID, const string &mskID) {
-  return this->m_KEM_->generateParams(groupParams, mpkID, mskID);
+OpenABEContextGenericCCA::transformKEM(const string &mpkID, const string &tkID,
+                                   OpenABECiphertext *ciphertext,
+                                   OpenABECiphertext *transformed) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+
+  try {
+    ASSERT_NOTNULL(ciphertext);
+    ASSERT_NOTNULL(transformed);
+    result = this->abeSchemeContext->transform(mpkID, tkID, ciphertext, transformed);
+    ASSERT(result == OpenABE_NOERROR, result);
+    transformed->setHeader((OpenABECurveID)ciphertext->getCurveID(),
+                           ciphertext->getSchemeType(), ciphertext->getUID());
+  } catch (OpenABE_ERROR &err) {
+    result = err;
+  }
+
+  return result;
 }
 
 /*!
- * Generate global parameters of the pairing curve based on a string identifier.
+ * Client side of outsourced decryption: recover M = r || K from a
+ * transformed ciphertext and check it against u = H_1(r || K || A).
+ * Redoing the re-encryption check of decryptKEM would cost the client a
+ * full encryption, so only the binding of M to the header uid and the
+ * policy is checked. As in Green, Hohenberger and Waters, the result is
+ * replayable-CCA: the AEAD over the payload, keyed with K and bound to
+ * the header, does the rest.
  *
- * @param[in]   specific string identifier to instantiate the pairing curve.
- * @param[in]   a string identifier for the global public parameters.
+ * @param   Identifier for the retrieval key.
+ * @param   Transformed ciphertext.
+ * @param   Symmetric key to be returned.
  * @return  An error code or OpenABE_NOERROR.
  */
+
 OpenABE_ERROR
-OpenABEContextSchemeCCA::generateGlobalParams(const string groupParams,
-                                          const string &gpkID) {
-  return this->m_KEM_->generateGlobalParams(groupParams, gpkID);
+OpenABEContextGenericCCA::finishTransformedKEM(const string &rkID,
+                                           OpenABECiphertext *transformed,
+                                           uint32_t keyByteLen,
+                                           const std::shared_ptr<OpenABESymKey> &key) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  OpenABEByteString M, u, concat;
+  unique_ptr<OpenABEFunctionInput> encryptInput = nullptr;
+
+  try {
+    ASSERT_NOTNULL(transformed);
+    ASSERT_NOTNULL(key);
+    result = this->abeSchemeContext->decryptTransformed(rkID, &M, transformed);
+    if (result != OpenABE_NOERROR || M.size() != 2 * keyByteLen) {
+      OpenABE_LOG_AND_THROW("ABE Decryption failed.", OpenABE_ERROR_DECRYPTION_FAILED);
+    }
+    OpenABEByteString r = M.getSubset(0, keyByteLen);
+    OpenABEByteString K = M.getSubset(keyByteLen, keyByteLen);
+
+    encryptInput = getFunctionInput(transformed);
+    if (encryptInput == nullptr) {
+      OpenABE_LOG_AND_THROW("Failed to get functional input.",
+                        OpenABE_ERROR_INVALID_INPUT);
+    }
+    // same canonical form of the policy as encryptKEM
+    const OpenABEFunctionInput *normalizedInput = encryptInput.get();
+    unique_ptr<OpenABEFunctionInput> canonicalCopy = nullptr;
+    const OpenABEPolicy *policy_ptr = dynamic_cast<const OpenABEPolicy*>(normalizedInput);
+    if (policy_ptr != nullptr && !policy_ptr->isCanonical()) {
+      canonicalCopy = copyFunctionInput(*policy_ptr);
+      static_cast<OpenABEPolicy*>(canonicalCopy.get())->canonicalize();
+      normalizedInput = canonicalCopy.get();
+    }
+
+    // u = H_1(r || K || A) must give the uid of the header
+    concat = r + K + normalizedInput->toCanonicalString();
+    u = this->abeSchemeContext->getPairing()->hashFromBytes(concat, keyByteLen,
+                                          CCA_HASH_FUNCTION_ONE);
+    if (!(u.getSubset(0, UID_LEN) == transformed->getUID())) {
+      OpenABE_LOG_AND_THROW("Failed ABE decryption verification check.",
+                        OpenABE_ERROR_DECRYPTION_FAILED);
+    }
+    key->setSymmetricKey(K);
+    r.zeroize();
+    K.zeroize();
+  } catch (OpenABE_ERROR &err) {
+    result = err;
+  }
+
+  M.zeroize();
+  return result;
+}
+
+/********************************************************************************
+ * Implementation of the OpenABEContextHashedCCA class
+ ********************************************************************************/
+
+static bool isHashedCCAScheme(OpenABE_SCHEME scheme_type) {
+  return (scheme_type == OpenABE_SCHEME_CP_WATERS_HCCA ||
+          scheme_type == OpenABE_SCHEME_KP_GPSW_HCCA ||
+          scheme_type == OpenABE_SCHEME_CP_FAME_HCCA ||
+          scheme_type == OpenABE_SCHEME_CP_WATERS_FD_HCCA);
 }
 
 /*!
- * Generate authority parameters of the pairing curve based on a string identifier.
- *
- * @param[in]   specific string identifier to instantiate the pairing curve.
- * @param[in]   a string identifier for the authority's master public parameters.
- * @param[in]   a string identifier for the authority's master secret parameters.
- * @return  An error code or OpenABE_NOERROR.
+ * d = H_3(CT): digest of the ABE ciphertext, header included. It is taken
+ * over the full (not the compact) encoding, so that the sender and a
+ * recipient that received the compact form agree on it.
  */
-OpenABE_ERROR
-OpenABEContextSchemeCCA::generateAuthorityParams(const string &gpkID,
-                                             const string &auth_mpkID,
-                                             const string &auth_mskID) {
-  return this->m_KEM_->generateAuthorityParams(gpkID, auth_mpkID, auth_mskID);
+static OpenABEByteString hashedCCADigest(OpenABEPairing *pairing,
+                                         OpenABECiphertext *ciphertext) {
+  OpenABEByteString ctBytes;
+  ciphertext->exportToBytes(ctBytes, false);
+  return pairing->hashFromBytes(ctBytes, SHA256_LEN, CCA_HASH_FUNCTION_THREE);
 }
 
 /*!
- * Export a key from the keystore given the key identifier.
+ * Constructor for the OpenABEContextHashedCCA class. The scheme type is
+ * upgraded to the hashed CCA variant of the CPA scheme.
  *
- * @param[in]   identifier for the key.
- * @param[out]  an allocated OpenABEByteString to store the exported key header/body.
- * @param[in]   a password to encrypt the exported key under (optional).
- * @return      An error code or OpenABE_NOERROR.
  */
+OpenABEContextHashedCCA::OpenABEContextHashedCCA(unique_ptr<OpenABEContextSchemeCPA> scheme)
+    : OpenABEContextCCA(std::move(scheme)) {
+  OpenABE_SCHEME scheme_type = OpenABE_SCHEME_NONE;
+  if (this->getSchemeType() == OpenABE_SCHEME_KP_GPSW) {
+    scheme_type = OpenABE_SCHEME_KP_GPSW_HCCA;
+  } else if (this->getSchemeType() == OpenABE_SCHEME_CP_WATERS) {
+    scheme_type = OpenABE_SCHEME_CP_WATERS_HCCA;
+  } else if (this->getSchemeType() == OpenABE_SCHEME_CP_FAME) {
+    scheme_type = OpenABE_SCHEME_CP_FAME_HCCA;
+  } else if (this->getSchemeType() == OpenABE_SCHEME_CP_WATERS_FD) {
+    scheme_type = OpenABE_SCHEME_CP_WATERS_FD_HCCA;
+  } else {
+    /* unrecognized scheme type */
+    throw OpenABE_ERROR_INVALID_INPUT;
+  }
+  this->setSchemeType(scheme_type);
+}
+
+OpenABEContextHashedCCA::~OpenABEContextHashedCCA() {}
+
 OpenABE_ERROR
-OpenABEContextSchemeCCA::exportKey(const string &keyID, OpenABEByteString &keyBlob) {
-  return this->m_KEM_->exportKey(keyID, keyBlob);
+OpenABEContextHashedCCA::generateParams(const string groupParams,
+                                    const string &mpkID, const string &mskID) {
+  return this->abeSchemeContext->generateParams(groupParams, mpkID, mskID);
+}
+
+OpenABE_ERROR
+OpenABEContextHashedCCA::generateDecryptionKey(
+    OpenABEFunctionInput *keyInput, const string &keyID, const string &mpkID,
+    const string &mskID, const string &gpkID, const string &GID) {
+  return this->abeSchemeContext->keygen(keyInput, keyID, mpkID, mskID, gpkID,
+                                        GID);
 }
 
 /*!
- * Load and validate the master public parameters.
+ * Encrypt a random K_0 with the CPA scheme and return K = H_4(K_0 || d),
+ * where d = H_3(CT) is the digest of the resulting ciphertext. Unlike the
+ * generic transform, the CPA encryption uses fresh randomness: nothing is
+ * re-encrypted on decryption.
  *
- * @param[in]	identifier for the public key in the keystore.
- * @param[in]	serialized blob that represents the public parameters.
- * @param[in]	an optional password to derive a key for decrypting the serialized blob.
+ * @param   Parameters ID for the public master parameters.
+ * @param   Function input for the encryption.
  * @return  An error code or OpenABE_NOERROR.
  */
+
 OpenABE_ERROR
-OpenABEContextSchemeCCA::loadMasterPublicParams(const string &mpkID,
-                                            OpenABEByteString &mpkBlob) {
-  return this->m_KEM_->loadMasterPublicParams(mpkID, mpkBlob);
+OpenABEContextHashedCCA::encryptKEM(OpenABERNG *rng, const string &mpkID,
+                                 const OpenABEFunctionInput *encryptInput,
+                                 uint32_t keyByteLen,
+                                 const std::shared_ptr<OpenABESymKey> &key,
+                                 OpenABECiphertext *ciphertext) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  OpenABERNG *myRNG = (rng != nullptr) ? rng : this->getRNG();
+  OpenABEByteString K0, K, d, concat;
+
+  try {
+    ASSERT_NOTNULL(encryptInput);
+    ASSERT_NOTNULL(key);
+    ASSERT_NOTNULL(ciphertext);
+    ASSERT_NOTNULL(myRNG);
+
+    // choose K_0 and encrypt it under the CPA scheme
+    myRNG->getRandomBytes(&K0, keyByteLen);
+    result = this->abeSchemeContext->encrypt(myRNG, mpkID, encryptInput,
+                                             &K0, ciphertext);
+    if (result != OpenABE_NOERROR) {
+      OpenABE_LOG_AND_THROW("ABE Encryption failed.", OpenABE_ERROR_ENCRYPTION_ERROR);
+    }
+
+    // K = H_4(K_0 || H_3(CT))
+    d = hashedCCADigest(this->abeSchemeContext->getPairing(), ciphertext);
+    concat = K0 + d;
+    K = this->abeSchemeContext->getPairing()->hashFromBytes(
+        concat, keyByteLen, CCA_HASH_FUNCTION_FOUR);
+    key->setSymmetricKey(K);
+  } catch (OpenABE_ERROR &err) {
+    result = err;
+  }
+
+  K0.zeroize();
+  K.zeroize();
+  concat.zeroize();
+  return result;
 }
 
 /*!
- * Load and validate the master secret parameters.
+ * Decrypt K_0 with the CPA scheme and return K = H_4(K_0 || H_3(CT)).
+ * There is no explicit validity check: any change to the ciphertext
+ * changes K, and the AEAD of the DEM (see OpenABEContextSchemeCCA) then
+ * rejects it. Callers using the KEM on its own must authenticate with K.
  *
- * @param[in]	identifier for the secret key in the keystore.
- * @param[in]	serialized blob that represents the secret parameters.
- * @param[in]	an optional password to derive a key for decrypting the serialized blob.
+ * @param   Parameters ID for the public master parameters.
+ * @param   Identifier for the decryption key to be used.
+ * @param   ABE ciphertext.
+ * @param   Symmetric key to be returned.
  * @return  An error code or OpenABE_NOERROR.
  */
+
 OpenABE_ERROR
-OpenABEContextSchemeCCA::loadMasterSecretParams(const string &mskID,
-                                            OpenABEByteString &mskBlob) {
-  return this->m_KEM_->loadMasterSecretParams(mskID, mskBlob);
+OpenABEContextHashedCCA::decryptKEM(const string &mpkID, const string &keyID,
+                                 OpenABECiphertext *ciphertext, uint32_t keyByteLen,
+                                 const std::shared_ptr<OpenABESymKey> &key) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  OpenABEByteString K0, K, d, concat;
+
+  try {
+    ASSERT_NOTNULL(ciphertext);
+    ASSERT_NOTNULL(key);
+    result = this->abeSchemeContext->decrypt(mpkID, keyID, &K0, ciphertext);
+    if (result != OpenABE_NOERROR || K0.size() != keyByteLen) {
+      OpenABE_LOG_AND_THROW("ABE Decryption failed.", OpenABE_ERROR_DECRYPTION_FAILED);
+    }
+
+    d = hashedCCADigest(this->abeSchemeContext->getPairing(), ciphertext);
+    concat = K0 + d;
+    K = this->abeSchemeContext->getPairing()->hashFromBytes(
+        concat, keyByteLen, CCA_HASH_FUNCTION_FOUR);
+    key->setSymmetricKey(K);
+  } catch (OpenABE_ERROR &err) {
+    result = err;
+  }
+
+  K0.zeroize();
+  K.zeroize();
+  concat.zeroize();
+  return result;
 }
 
 /*!
- * Load and validate the user's secret parameter.
+ * Estimate encryptKEM: the CPA encryption of K_0.
  *
- * @param[in]	identifier for the secret key in the keystore.
- * @param[in]	serialized blob that represents the secret parameters.
- * @param[in]	an optional password to derive a key for decrypting the serialized blob.
+ * @param   Parameters ID for the public master parameters.
+ * @param   Function input for the encryption.
+ * @param   Length of the symmetric key.
+ * @param   Skeleton ciphertext to fill.
+ * @param   Operation counts to be returned.
  * @return  An error code or OpenABE_NOERROR.
  */
 
 OpenABE_ERROR
-OpenABEContextSchemeCCA::loadUserSecretParams(const string &skID,
-                                          OpenABEByteString &skBlob) {
-  return this->m_KEM_->loadUserSecretParams(skID, skBlob);
+OpenABEContextHashedCCA::estimateKEM(const string &mpkID,
+                                 const OpenABEFunctionInput *encryptInput,
+                                 uint32_t keyByteLen, OpenABECiphertext *skeleton,
+                                 OpenABEEncryptionCost &cost) {
+  return this->abeSchemeContext->estimate(mpkID, encryptInput, keyByteLen,
+                                          skeleton, cost);
 }
 
+OpenABE_ERROR
+OpenABEContextHashedCCA::generateTransformKey(const string &keyID, const string &tkID,
+                                           const string &rkID) {
+  return this->abeSchemeContext->generateTransformKey(keyID, tkID, rkID);
+}
 
 /*!
- * Delete a key from the in-memory keystore given a key identifier.
+ * Server side of outsourced decryption. The transformed ciphertext no
+ * longer holds the original components, so the digest d = H_3(CT) goes
+ * along with it. A server that lies about d only makes the client derive
+ * a key the AEAD rejects.
  *
- * @param[in]   a string key identifier.
- * @return      An error code or OpenABE_NOERROR.
+ * @param   Parameters ID for the public master parameters.
+ * @param   Identifier for the transformation key.
+ * @param   ABE ciphertext.
+ * @param   Transformed ciphertext to be returned.
+ * @return  An error code or OpenABE_NOERROR.
  */
+
 OpenABE_ERROR
-OpenABEContextSchemeCCA::deleteKey(const string keyID) {
-  return this->m_KEM_->deleteKey(keyID);
-}
+OpenABEContextHashedCCA::transformKEM(const string &mpkID, const string &tkID,
+                                   OpenABECiphertext *ciphertext,
+                                   OpenABECiphertext *transformed) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  OpenABEByteString d;
 
-bool OpenABEContextSchemeCCA::checkSecretKey(const string keyID) {
-  return this->m_KEM_->checkSecretKey(keyID);
+  try {
+    ASSERT_NOTNULL(ciphertext);
+    ASSERT_NOTNULL(transformed);
+    result = this->abeSchemeContext->transform(mpkID, tkID, ciphertext, transformed);
+    ASSERT(result == OpenABE_NOERROR, result);
+    transformed->setHeader((OpenABECurveID)ciphertext->getCurveID(),
+                           ciphertext->getSchemeType(), ciphertext->getUID());
+    d = hashedCCADigest(this->abeSchemeContext->getPairing(), ciphertext);
+    transformed->setComponent("_H", &d);
+  } catch (OpenABE_ERROR &err) {
+    result = err;
+  }
+
+  return result;
+}
+
+/*!
+ * Client side of outsourced decryption: recover K_0 from a transformed
+ * ciphertext and return K = H_4(K_0 || d) with the digest it carries.
+ *
+ * @param   Identifier for the retrieval key.
+ * @param   Transformed ciphertext.
+ * @param   Symmetric key to be returned.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR
+OpenABEContextHashedCCA::finishTransformedKEM(const string &rkID,
+                                           OpenABECiphertext *transformed,
+                                           uint32_t keyByteLen,
+                                           const std::shared_ptr<OpenABESymKey> &key) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  OpenABEByteString K0, K, concat;
+
+  try {
+    ASSERT_NOTNULL(transformed);
+    ASSERT_NOTNULL(key);
+    OpenABEByteString *d = transformed->getByteString("_H");
+    ASSERT(d != nullptr && d->size() == SHA256_LEN, OpenABE_ERROR_INVALID_CIPHERTEXT_BODY);
+    result = this->abeSchemeContext->decryptTransformed(rkID, &K0, transformed);
+    if (result != OpenABE_NOERROR || K0.size() != keyByteLen) {
+      OpenABE_LOG_AND_THROW("ABE Decryption failed.", OpenABE_ERROR_DECRYPTION_FAILED);
+    }
+    concat = K0 + *d;
+    K = this->abeSchemeContext->getPairing()->hashFromBytes(
+        concat, keyByteLen, CCA_HASH_FUNCTION_FOUR);
+    key->setSymmetricKey(K);
+  } catch (OpenABE_ERROR &err) {
+    result = err;
+  }
+
+  K0.zeroize();
+  K.zeroize();
+  concat.zeroize();
+  return result;
+}
+
+/********************************************************************************
+ * Implementation of the OpenABEContextSchemeCCA class
+ ********************************************************************************/
+
+/*!
+ * Constructor for the OpenABEContextSchemeCCA base class.
+ * Note: we add to
+ */
+OpenABEContextSchemeCCA::OpenABEContextSchemeCCA(unique_ptr<OpenABEContextCCA> kem_)
+    : ZObject() {
+  OpenABE_SCHEME scheme_type = OpenABE_SCHEME_NONE;
+  // upgrade the scheme type according to input KEM type
+  if (kem_->getSchemeType() == OpenABE_SCHEME_KP_GPSW) {
+    scheme_type = OpenABE_SCHEME_KP_GPSW_CCA;
+  } else if (kem_->getSchemeType() == OpenABE_SCHEME_CP_WATERS) {
+    scheme_type = OpenABE_SCHEME_CP_WATERS_CCA;
+  } else if (kem_->getSchemeType() == OpenABE_SCHEME_CP_FAME) {
+    scheme_type = OpenABE_SCHEME_CP_FAME_CCA;
+  } else if (kem_->getSchemeType() == OpenABE_SCHEME_CP_WATERS_FD) {
+    scheme_type = OpenABE_SCHEME_CP_WATERS_FD_CCA;
+  } else if (isHashedCCAScheme(kem_->getSchemeType())) {
+    // an OpenABEContextHashedCCA KEM already carries its own scheme type
+    scheme_type = kem_->getSchemeType();
+  } else {
+    /* unrecognized scheme type */
+    throw OpenABE_ERROR_INVALID_INPUT;
+  }
+  this->m_KEM_ = std::move(kem_);
+  this->m_KEM_->setSchemeType(scheme_type);
+}
+
+/*!
+ * Destructor for the OpenABEContextABE base class.
+ *
+ */
+OpenABEContextSchemeCCA::~OpenABEContextSchemeCCA() {}
+
+/*!
+ * Generate parameters of the pairing curve based on a string identifier.
+ *
+ * @param[in]   specific string identifier to instantiate the pairing curve.
+ * @param[in]   a string identifier for the master public parameters.
+ * @param[in]   a string identifier for the master secret parameters.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCCA::generateParams(const string groupParams,
+                                    const string &mpkID, const string &mskID) {
+  return this->m_KEM_->generateParams(groupParams, mpkID, mskID);
+}
+
+/*!
+ * Generate global parameters of the pairing curve based on a string identifier.
+ *
+ * @param[in]   specific string identifier to instantiate the pairing curve.
+ * @param[in]   a string identifier for the global public parameters.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCCA::generateGlobalParams(const string groupParams,
+                                          const string &gpkID) {
+  return this->m_KEM_->generateGlobalParams(groupParams, gpkID);
+}
+
+/*!
+ * Generate authority parameters of the pairing curve based on a string identifier.
+ *
+ * @param[in]   specific string identifier to instantiate the pairing curve.
+ * @param[in]   a string identifier for the authority's master public parameters.
+ * @param[in]   a string identifier for the authority's master secret parameters.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCCA::generateAuthorityParams(const string &gpkID,
+                                             const string &auth_mpkID,
+                                             const string &auth_mskID) {
+  return this->m_KEM_->generateAuthorityParams(gpkID, auth_mpkID, auth_mskID);
+}
+
+/*!
+ * Export a key from the keystore given the key identifier.
+ *
+ * @param[in]   identifier for the key.
+ * @param[out]  an allocated OpenABEByteString to store the exported key header/body.
+ * @param[in]   a password to encrypt the exported key under (optional).
+ * @return      An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCCA::exportKey(const string &keyID, OpenABEByteString &keyBlob) {
+  return this->m_KEM_->exportKey(keyID, keyBlob);
+}
+
+/*!
+ * Load and validate the master public parameters.
+ *
+ * @param[in]	identifier for the public key in the keystore.
+ * @param[in]	serialized blob that represents the public parameters.
+ * @param[in]	an optional password to derive a key for decrypting the serialized blob.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCCA::loadMasterPublicParams(const string &mpkID,
+                                            OpenABEByteString &mpkBlob,
+                                            bool deferValidation,
+                                            const OpenABEAttachedTables &attached) {
+  return this->m_KEM_->loadMasterPublicParams(mpkID, mpkBlob, deferValidation, attached);
+}
+
+/*!
+ * Return a shareable handle to a loaded master public key.
+ *
+ * @param[in]	identifier for the public key in the keystore.
+ * @return  The handle, or nullptr if the key is not loaded.
+ */
+OpenABEMPKHandle
+OpenABEContextSchemeCCA::getMasterPublicParamsHandle(const string &mpkID) {
+  return this->m_KEM_->getMasterPublicParamsHandle(mpkID);
+}
+
+/*!
+ * Use a master public key decoded by another context.
+ *
+ * @param[in]	identifier for the public key in the keystore.
+ * @param[in]	handle obtained from getMasterPublicParamsHandle.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCCA::attachMasterPublicParams(const string &mpkID,
+                                   const OpenABEMPKHandle &handle) {
+  return this->m_KEM_->attachMasterPublicParams(mpkID, handle);
+}
+
+/*!
+ * Load and validate the master secret parameters.
+ *
+ * @param[in]	identifier for the secret key in the keystore.
+ * @param[in]	serialized blob that represents the secret parameters.
+ * @param[in]	an optional password to derive a key for decrypting the serialized blob.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCCA::loadMasterSecretParams(const string &mskID,
+                                            OpenABEByteString &mskBlob) {
+  return this->m_KEM_->loadMasterSecretParams(mskID, mskBlob);
+}
+
+/*!
+ * Load and validate the user's secret parameter.
+ *
+ * @param[in]	identifier for the secret key in the keystore.
+ * @param[in]	serialized blob that represents the secret parameters.
+ * @param[in]	an optional password to derive a key for decrypting the serialized blob.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR
+OpenABEContextSchemeCCA::loadUserSecretParams(const string &skID,
+                                          OpenABEByteString &skBlob,
+                                          bool deferValidation,
+                                          const OpenABEAttachedTables &attached) {
+  return this->m_KEM_->loadUserSecretParams(skID, skBlob, deferValidation, attached);
+}
+
+OpenABE_ERROR
+OpenABEContextSchemeCCA::loadUserSecretParamsMany(const vector<string> &skIDs,
+                                              vector<OpenABEByteString> &skBlobs,
+                                              bool deferValidation) {
+  return this->m_KEM_->loadUserSecretParamsMany(skIDs, skBlobs, deferValidation);
+}
+
+
+/*!
+ * Delete a key from the in-memory keystore given a key identifier.
+ *
+ * @param[in]   a string key identifier.
+ * @return      An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCCA::deleteKey(const string keyID) {
+  return this->m_KEM_->deleteKey(keyID);
+}
+
+bool OpenABEContextSchemeCCA::checkSecretKey(const string keyID) {
+  return this->m_KEM_->checkSecretKey(keyID);
 }
 
 /*!
@@ -579,48 +1087,164 @@ OpenABEContextSchemeCCA::keygen(OpenABEFunctionInput *keyInput, const string &ke
  * @return  An error code or OpenABE_NOERROR.
  */
 OpenABE_ERROR
-OpenABEContextSchemeCCA::encrypt(const string &mpkID,
+OpenABEContextSchemeCCA::encrypt(const string &mpkID,
+                             const OpenABEFunctionInput *encryptInput,
+                             const string &plaintext,
+                             OpenABECiphertext *ciphertext1,
+                             OpenABECiphertext *ciphertext2) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  unique_ptr<oabe::crypto::OpenABESymKeyAuthEnc> authEnc = nullptr;
+  OpenABEByteString iv, ct, tag;
+  OpenABETraceSpan span("abe.encrypt");
+  span.setItems(plaintext.size());
+
+  try {
+    ASSERT_NOTNULL(ciphertext2);
+    // make sure plaintext size > 0
+    ASSERT(plaintext.size() > 0, OpenABE_ERROR_NO_PLAINTEXT_SPECIFIED);
+
+    result = this->encapsulate(mpkID, encryptInput, ciphertext1, authEnc);
+    ASSERT(result == OpenABE_NOERROR, result);
+    // encrypt plaintext and store in iv/ct/tag
+    OpenABETraceSpan aeadSpan("aead.encrypt");
+    result = authEnc->encrypt(plaintext, &iv, &ct, &tag);
+    aeadSpan.end();
+    ASSERT(result == OpenABE_NOERROR, result);
+
+    // Store symmetric ciphertext
+    ciphertext2->setComponent("IV", &iv);
+    ciphertext2->setComponent("CT", &ct);
+    ciphertext2->setComponent("Tag", &tag);
+    ciphertext2->setHeader(OpenABE_NONE_ID, OpenABE_SCHEME_AES_GCM, ciphertext1->getUID());
+  } catch (OpenABE_ERROR &error) {
+    result = error;
+  }
+
+  span.setStatus(result);
+  return result;
+}
+
+/*!
+ * Generate and encrypt a symmetric key using the key encapsulation mode
+ * of the underlying KEM scheme, and return an AES-GCM cipher under that key
+ * with the header of the ABE ciphertext as additional auth data. With the
+ * cipher's output stored as IV/CT/Tag, this is exactly encrypt().
+ *
+ * @param[in]	master public key identifier in keystore for the recipient (assumes it's already in keystore).
+ * @param[in]   functional input of the underlying KEM context (either attribute list or policy).
+ * @param[out]	the ABE ciphertext (must be allocated).
+ * @param[out]	the AES-GCM cipher.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCCA::encapsulate(const string &mpkID,
+                             const OpenABEFunctionInput *encryptInput,
+                             OpenABECiphertext *ciphertext1,
+                             unique_ptr<oabe::crypto::OpenABESymKeyAuthEnc> &authEnc) {
+  OpenABEByteString ctHdr, symkeyBytes;
+  OpenABE_ERROR result = this->encapsulateKey(mpkID, encryptInput, ciphertext1, symkeyBytes);
+  if (result == OpenABE_NOERROR) {
+    // instantiate an auth enc scheme with the symmetric key
+    authEnc.reset(
+        new oabe::crypto::OpenABESymKeyAuthEnc(DEFAULT_AES_SEC_LEVEL, symkeyBytes));
+    // embed the header of the ciphertext as AAD
+    ciphertext1->getHeader(ctHdr);
+    authEnc->setAddAuthData(ctHdr);
+  }
+  symkeyBytes.zeroize();
+  return result;
+}
+
+/*!
+ * Same as above with the chunked AES-GCM cipher for large payloads.
+ *
+ * @param[in]	master public key identifier in keystore for the recipient (assumes it's already in keystore).
+ * @param[in]   functional input of the underlying KEM context (either attribute list or policy).
+ * @param[out]	the ABE ciphertext (must be allocated).
+ * @param[out]	the chunked AES-GCM cipher.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCCA::encapsulate(const string &mpkID,
+                             const OpenABEFunctionInput *encryptInput,
+                             OpenABECiphertext *ciphertext1,
+                             unique_ptr<oabe::crypto::OpenABESymKeyChunkedAuthEnc> &authEnc) {
+  OpenABEByteString ctHdr, symkeyBytes;
+  OpenABE_ERROR result = this->encapsulateKey(mpkID, encryptInput, ciphertext1, symkeyBytes);
+  if (result == OpenABE_NOERROR) {
+    authEnc.reset(
+        new oabe::crypto::OpenABESymKeyChunkedAuthEnc(DEFAULT_AES_SEC_LEVEL, symkeyBytes));
+    ciphertext1->getHeader(ctHdr);
+    authEnc->setAddAuthData(ctHdr);
+  }
+  symkeyBytes.zeroize();
+  return result;
+}
+
+/*!
+ * Estimate encrypt without encrypting: the ABE ciphertext as a skeleton
+ * whose serialized size is exact, and the operation counts of encrypting
+ * and decrypting (see OpenABEContextABE::estimateKEM).
+ *
+ * @param[in]	master public key identifier in keystore for the recipient (assumes it's already in keystore).
+ * @param[in]   functional input of the underlying KEM context (either attribute list or policy).
+ * @param[out]	the skeleton of the ABE ciphertext (must be allocated).
+ * @param[out]	the operation counts.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCCA::estimate(const string &mpkID,
+                             const OpenABEFunctionInput *encryptInput,
+                             OpenABECiphertext *ciphertext1,
+                             OpenABEEncryptionCost &cost) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+
+  try {
+    ASSERT_NOTNULL(ciphertext1);
+    result = this->m_KEM_->estimateKEM(mpkID, encryptInput, DEFAULT_SYM_KEY_BYTES,
+                                       ciphertext1, cost);
+    ASSERT(result == OpenABE_NOERROR, result);
+  } catch (OpenABE_ERROR &error) {
+    result = error;
+  }
+
+  return result;
+}
+
+/*!
+ * Generate and encrypt a symmetric key using the key encapsulation mode
+ * of the underlying KEM scheme.
+ *
+ * @param[in]	master public key identifier in keystore for the recipient (assumes it's already in keystore).
+ * @param[in]   functional input of the underlying KEM context (either attribute list or policy).
+ * @param[out]	the ABE ciphertext (must be allocated).
+ * @param[out]	the symmetric key bytes.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCCA::encapsulateKey(const string &mpkID,
                              const OpenABEFunctionInput *encryptInput,
-                             const string &plaintext,
                              OpenABECiphertext *ciphertext1,
-                             OpenABECiphertext *ciphertext2) {
+                             OpenABEByteString &symkeyBytes) {
   OpenABE_ERROR result = OpenABE_NOERROR;
-  unique_ptr<OpenABERNG> rng(new OpenABERNG);
+  unique_ptr<OpenABERNG> rng(new OpenABEThreadRNG);
   shared_ptr<OpenABESymKey> symkey(new OpenABESymKey);
-  OpenABEByteString ctHdr, symkeyBytes, iv, ct, tag;
+  OpenABETraceSpan span("abe.encapsulate");
 
   try {
     ASSERT_NOTNULL(ciphertext1);
-    ASSERT_NOTNULL(ciphertext2);
-    // make sure plaintext size > 0
-    ASSERT(plaintext.size() > 0, OpenABE_ERROR_NO_PLAINTEXT_SPECIFIED);
 
     result =
         this->m_KEM_->encryptKEM(rng.get(), mpkID, encryptInput,
                                  DEFAULT_SYM_KEY_BYTES, symkey, ciphertext1);
     ASSERT(result == OpenABE_NOERROR, result);
-    // instantiate an auth enc scheme with the symmetric key
     symkeyBytes = symkey->getKeyBytes();
-    unique_ptr<oabe::crypto::OpenABESymKeyAuthEnc> authEnc(
-        new oabe::crypto::OpenABESymKeyAuthEnc(DEFAULT_AES_SEC_LEVEL, symkeyBytes));
-    // obtain header from ciphertext
-    ciphertext1->getHeader(ctHdr);
-    // embed the header of the ciphertext as AAD
-    authEnc->setAddAuthData(ctHdr);
-    // encrypt plaintext and store in iv/ct/tag
-    authEnc->encrypt(plaintext, &iv, &ct, &tag);
-
-    // Store symmetric ciphertext
-    ciphertext2->setComponent("IV", &iv);
-    ciphertext2->setComponent("CT", &ct);
-    ciphertext2->setComponent("Tag", &tag);
-    ciphertext2->setHeader(OpenABE_NONE_ID, OpenABE_SCHEME_AES_GCM, ciphertext1->getUID());
   } catch (OpenABE_ERROR &error) {
     result = error;
   }
 
   symkey->zeroize();
-  symkeyBytes.zeroize();
+  span.setStatus(result);
   return result;
 }
 
@@ -640,10 +1264,9 @@ OpenABEContextSchemeCCA::decrypt(const string &mpkID, const string &keyID,
                              string &plaintext, OpenABECiphertext *ciphertext1,
                              OpenABECiphertext *ciphertext2) {
   OpenABE_ERROR result = OpenABE_NOERROR;
-  OpenABEByteString ctHdr, symkeyBytes;
   OpenABEByteString *iv, *ct, *tag;
-  shared_ptr<OpenABESymKey> symkey(new OpenABESymKey);
   unique_ptr<oabe::crypto::OpenABESymKeyAuthEnc> authEnc = nullptr;
+  OpenABETraceSpan span("abe.decrypt");
 
   try {
     ASSERT_NOTNULL(ciphertext1);
@@ -655,30 +1278,471 @@ OpenABEContextSchemeCCA::decrypt(const string &mpkID, const string &keyID,
     tag = ciphertext2->getByteString("Tag");
     ASSERT_NOTNULL(tag);
 
-    // get the header of the input ciphertext
-    ciphertext1->getHeader(ctHdr);
     // decrypt part 1 of the ciphertext (corresponds to ABE portion)
-    result = this->m_KEM_->decryptKEM(mpkID, keyID, ciphertext1,
-                                      DEFAULT_SYM_KEY_BYTES, symkey);
+    result = this->decapsulate(mpkID, keyID, ciphertext1, authEnc);
     // propagate errors from decryptKEM
     ASSERT(result == OpenABE_NOERROR, result);
+    // now attempt to decrypt
+    OpenABETraceSpan aeadSpan("aead.decrypt");
+    aeadSpan.setItems(ct->size());
+    if (!authEnc->decrypt(plaintext, iv, ct, tag)) {
+      aeadSpan.setStatus(OpenABE_ERROR_DECRYPTION_FAILED);
+      throw OpenABE_ERROR_DECRYPTION_FAILED;
+    }
+    aeadSpan.end();
+    span.setItems(plaintext.size());
+  } catch (OpenABE_ERROR &error) {
+    result = error;
+  }
+
+  span.setStatus(result);
+  return result;
+}
+
+/*!
+ * Decrypt the symmetric key of an ABE ciphertext and return the AES-GCM
+ * cipher for the other half of the ciphertext payload (see encapsulate).
+ *
+ * @param[in]   master public key identifier of the sender (assumes it's already in keystore).
+ * @param[in]   key identifier of recipient (assumes it's already in keystore).
+ * @param[in]   the ABE ciphertext.
+ * @param[out]  the AES-GCM cipher.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCCA::decapsulate(const string &mpkID, const string &keyID,
+                             OpenABECiphertext *ciphertext1,
+                             unique_ptr<oabe::crypto::OpenABESymKeyAuthEnc> &authEnc) {
+  OpenABEByteString ctHdr, symkeyBytes;
+  OpenABE_ERROR result = this->decapsulateKey(mpkID, keyID, ciphertext1, symkeyBytes);
+  if (result == OpenABE_NOERROR) {
     // apply AEAD to decrypt part 2 of the ciphertext (ciphertext header is
     // added as add auth data)
-    symkeyBytes = symkey->getKeyBytes();
     authEnc.reset(
         new oabe::crypto::OpenABESymKeyAuthEnc(DEFAULT_AES_SEC_LEVEL, symkeyBytes));
-    // embed the header of the ciphertext as AAD
+    ciphertext1->getHeader(ctHdr);
     authEnc->setAddAuthData(ctHdr);
-    // now attempt to decrypt
-    if (!authEnc->decrypt(plaintext, iv, ct, tag)) {
+  }
+  symkeyBytes.zeroize();
+  return result;
+}
+
+/*!
+ * Same as above with the chunked AES-GCM cipher for large payloads.
+ *
+ * @param[in]   master public key identifier of the sender (assumes it's already in keystore).
+ * @param[in]   key identifier of recipient (assumes it's already in keystore).
+ * @param[in]   the ABE ciphertext.
+ * @param[out]  the chunked AES-GCM cipher.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCCA::decapsulate(const string &mpkID, const string &keyID,
+                             OpenABECiphertext *ciphertext1,
+                             unique_ptr<oabe::crypto::OpenABESymKeyChunkedAuthEnc> &authEnc) {
+  OpenABEByteString ctHdr, symkeyBytes;
+  OpenABE_ERROR result = this->decapsulateKey(mpkID, keyID, ciphertext1, symkeyBytes);
+  if (result == OpenABE_NOERROR) {
+    authEnc.reset(
+        new oabe::crypto::OpenABESymKeyChunkedAuthEnc(DEFAULT_AES_SEC_LEVEL, symkeyBytes));
+    ciphertext1->getHeader(ctHdr);
+    authEnc->setAddAuthData(ctHdr);
+  }
+  symkeyBytes.zeroize();
+  return result;
+}
+
+/*!
+ * Decrypt the symmetric key of an ABE ciphertext using the key
+ * encapsulation mode of the underlying scheme.
+ *
+ * @param[in]   master public key identifier of the sender (assumes it's already in keystore).
+ * @param[in]   key identifier of recipient (assumes it's already in keystore).
+ * @param[in]   the ABE ciphertext.
+ * @param[out]  the symmetric key bytes.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCCA::decapsulateKey(const string &mpkID, const string &keyID,
+                             OpenABECiphertext *ciphertext1,
+                             OpenABEByteString &symkeyBytes) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  shared_ptr<OpenABESymKey> symkey(new OpenABESymKey);
+  OpenABETraceSpan span("abe.decapsulate");
+
+  try {
+    ASSERT_NOTNULL(ciphertext1);
+    // decrypt part 1 of the ciphertext (corresponds to ABE portion)
+    result = this->m_KEM_->decryptKEM(mpkID, keyID, ciphertext1,
+                                      DEFAULT_SYM_KEY_BYTES, symkey);
+    // propagate errors from decryptKEM
+    ASSERT(result == OpenABE_NOERROR, result);
+    symkeyBytes = symkey->getKeyBytes();
+  } catch (OpenABE_ERROR &error) {
+    result = error;
+  }
+
+  symkey->zeroize();
+  span.setStatus(result);
+  return result;
+}
+
+/*!
+ * Wrap the data key of a payload with the symmetric key of an ABE
+ * ciphertext. The wrap is authenticated with both headers, which binds
+ * it to this ABE ciphertext and to the payload ID in the header of
+ * wrapped (set by the caller).
+ *
+ * @param[in]   the ABE ciphertext.
+ * @param[in]   its symmetric key bytes.
+ * @param[in]   the data key bytes.
+ * @param[out]  the wrapped data key (WrapIV/WrapKey/WrapTag).
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCCA::wrapDataKey(OpenABECiphertext *ciphertext1,
+                             OpenABEByteString &symkeyBytes,
+                             OpenABEByteString &dataKey,
+                             OpenABECiphertext *wrapped) {
+  OpenABEByteString aad, hdr, iv, wk, tag;
+  ciphertext1->getHeader(aad);
+  wrapped->getHeader(hdr);
+  aad += hdr;
+
+  oabe::crypto::OpenABESymKeyAuthEnc wrap(DEFAULT_AES_SEC_LEVEL, symkeyBytes);
+  wrap.setAddAuthData(aad);
+  iv.resize(AES_BLOCK_SIZE);
+  wk.resize(dataKey.size());
+  tag.resize(AES_BLOCK_SIZE);
+  OpenABE_ERROR result = wrap.encrypt(dataKey.getInternalPtr(), dataKey.size(),
+                                      iv.getInternalPtr(), wk.getInternalPtr(),
+                                      tag.getInternalPtr());
+  if (result == OpenABE_NOERROR) {
+    wrapped->setComponent("WrapIV", &iv);
+    wrapped->setComponent("WrapKey", &wk);
+    wrapped->setComponent("WrapTag", &tag);
+  }
+  return result;
+}
+
+/*!
+ * Recover the data key wrapped by wrapDataKey.
+ *
+ * @param[in]   the ABE ciphertext.
+ * @param[in]   its symmetric key bytes.
+ * @param[in]   the wrapped data key.
+ * @param[out]  the data key bytes.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCCA::unwrapDataKey(OpenABECiphertext *ciphertext1,
+                             OpenABEByteString &symkeyBytes,
+                             OpenABECiphertext *wrapped,
+                             OpenABEByteString &dataKey) {
+  OpenABEByteString aad, hdr;
+  OpenABEByteString *iv = wrapped->getByteString("WrapIV");
+  OpenABEByteString *wk = wrapped->getByteString("WrapKey");
+  OpenABEByteString *tag = wrapped->getByteString("WrapTag");
+  if (iv == nullptr || wk == nullptr || wk->size() != DEFAULT_SYM_KEY_BYTES ||
+      tag == nullptr || tag->size() != AES_BLOCK_SIZE) {
+    return OpenABE_ERROR_INVALID_CIPHERTEXT_BODY;
+  }
+  ciphertext1->getHeader(aad);
+  wrapped->getHeader(hdr);
+  aad += hdr;
+
+  oabe::crypto::OpenABESymKeyAuthEnc wrap(DEFAULT_AES_SEC_LEVEL, symkeyBytes);
+  wrap.setAddAuthData(aad);
+  dataKey.resize(wk->size());
+  if (!wrap.decrypt(dataKey.getInternalPtr(), wk->getInternalPtr(), wk->size(),
+                    iv->getInternalPtr(), iv->size(), tag->getInternalPtr())) {
+    dataKey.zeroize();
+    return OpenABE_ERROR_DECRYPTION_FAILED;
+  }
+  return OpenABE_NOERROR;
+}
+
+/*!
+ * Encapsulate a symmetric key as in encapsulate, and wrap a fresh data
+ * key with it for the chunked AES-GCM cipher of the payload. The payload
+ * is authenticated with the header of wrapped only, which carries a
+ * random payload ID and stays the same across rewraps.
+ *
+ * @param[in]	master public key identifier in keystore for the recipient (assumes it's already in keystore).
+ * @param[in]   functional input of the underlying KEM context (either attribute list or policy).
+ * @param[out]	the ABE ciphertext (must be allocated).
+ * @param[out]	the wrapped data key (must be allocated).
+ * @param[out]	the chunked AES-GCM cipher for the payload.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCCA::encapsulateWrapped(const string &mpkID,
+                             const OpenABEFunctionInput *encryptInput,
+                             OpenABECiphertext *ciphertext1,
+                             OpenABECiphertext *wrapped,
+                             unique_ptr<oabe::crypto::OpenABESymKeyChunkedAuthEnc> &authEnc) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  OpenABEByteString symkeyBytes, dataKey, payloadHdr;
+  OpenABEThreadRNG rng;
+
+  try {
+    ASSERT_NOTNULL(wrapped);
+    result = this->encapsulateKey(mpkID, encryptInput, ciphertext1, symkeyBytes);
+    ASSERT(result == OpenABE_NOERROR, result);
+    rng.getRandomBytes(&dataKey, DEFAULT_SYM_KEY_BYTES);
+    wrapped->setHeader(OpenABE_NONE_ID, OpenABE_SCHEME_AES_GCM, &rng);
+    result = this->wrapDataKey(ciphertext1, symkeyBytes, dataKey, wrapped);
+    ASSERT(result == OpenABE_NOERROR, result);
+
+    authEnc.reset(
+        new oabe::crypto::OpenABESymKeyChunkedAuthEnc(DEFAULT_AES_SEC_LEVEL, dataKey));
+    wrapped->getHeader(payloadHdr);
+    authEnc->setAddAuthData(payloadHdr);
+  } catch (OpenABE_ERROR &error) {
+    result = error;
+  }
+
+  symkeyBytes.zeroize();
+  dataKey.zeroize();
+  return result;
+}
+
+/*!
+ * Decrypt the symmetric key of an ABE ciphertext, unwrap the data key
+ * with it and return the chunked AES-GCM cipher for the payload (see
+ * encapsulateWrapped).
+ *
+ * @param[in]   master public key identifier of the sender (assumes it's already in keystore).
+ * @param[in]   key identifier of recipient (assumes it's already in keystore).
+ * @param[in]   the ABE ciphertext.
+ * @param[in]   the wrapped data key.
+ * @param[out]  the chunked AES-GCM cipher for the payload.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCCA::decapsulateWrapped(const string &mpkID, const string &keyID,
+                             OpenABECiphertext *ciphertext1,
+                             OpenABECiphertext *wrapped,
+                             unique_ptr<oabe::crypto::OpenABESymKeyChunkedAuthEnc> &authEnc) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  OpenABEByteString symkeyBytes, dataKey, payloadHdr;
+
+  try {
+    ASSERT_NOTNULL(wrapped);
+    result = this->decapsulateKey(mpkID, keyID, ciphertext1, symkeyBytes);
+    ASSERT(result == OpenABE_NOERROR, result);
+    result = this->unwrapDataKey(ciphertext1, symkeyBytes, wrapped, dataKey);
+    ASSERT(result == OpenABE_NOERROR, result);
+
+    authEnc.reset(
+        new oabe::crypto::OpenABESymKeyChunkedAuthEnc(DEFAULT_AES_SEC_LEVEL, dataKey));
+    wrapped->getHeader(payloadHdr);
+    authEnc->setAddAuthData(payloadHdr);
+  } catch (OpenABE_ERROR &error) {
+    result = error;
+  }
+
+  symkeyBytes.zeroize();
+  dataKey.zeroize();
+  return result;
+}
+
+/*!
+ * Move the data key of a wrapped payload under a new function input: the
+ * data key is unwrapped with keyID, a new ABE ciphertext is encapsulated
+ * under newEncryptInput and the data key is wrapped again with its key.
+ * The payload and the header of wrapped (its AAD) are unchanged; only the
+ * wrap components of wrapped are replaced, and only on success.
+ *
+ * @param[in]   master public key identifier (assumes it's already in keystore).
+ * @param[in]   key identifier of a recipient of the current ciphertext.
+ * @param[in]   the new functional input (either attribute list or policy).
+ * @param[in]   the current ABE ciphertext.
+ * @param[in,out] the wrapped data key.
+ * @param[out]  the new ABE ciphertext (must be allocated).
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCCA::rewrap(const string &mpkID, const string &keyID,
+                             const OpenABEFunctionInput *newEncryptInput,
+                             OpenABECiphertext *ciphertext1,
+                             OpenABECiphertext *wrapped,
+                             OpenABECiphertext *newCiphertext1) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  OpenABEByteString symkeyBytes, newSymkeyBytes, dataKey;
+  OpenABETraceSpan span("abe.rewrap");
+
+  try {
+    ASSERT_NOTNULL(wrapped);
+    result = this->decapsulateKey(mpkID, keyID, ciphertext1, symkeyBytes);
+    ASSERT(result == OpenABE_NOERROR, result);
+    result = this->unwrapDataKey(ciphertext1, symkeyBytes, wrapped, dataKey);
+    ASSERT(result == OpenABE_NOERROR, result);
+    result = this->encapsulateKey(mpkID, newEncryptInput, newCiphertext1, newSymkeyBytes);
+    ASSERT(result == OpenABE_NOERROR, result);
+    result = this->wrapDataKey(newCiphertext1, newSymkeyBytes, dataKey, wrapped);
+    ASSERT(result == OpenABE_NOERROR, result);
+  } catch (OpenABE_ERROR &error) {
+    result = error;
+  }
+
+  symkeyBytes.zeroize();
+  newSymkeyBytes.zeroize();
+  dataKey.zeroize();
+  span.setStatus(result);
+  return result;
+}
+
+/*!
+ * Derive a decryption key for a narrower function input from an existing
+ * one, without the master secret parameters (see OpenABEContextABE).
+ *
+ * @param[in]   master public key identifier (assumes it's already in keystore).
+ * @param[in]   parent decryption key identifier (assumes it's already in keystore).
+ * @param[in]   functional input of the new key.
+ * @param[in]   identifier for the new decryption key.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCCA::delegateKey(const string &mpkID, const string &keyID,
+                                     OpenABEFunctionInput *keyInput,
+                                     const string &newKeyID) {
+  return this->m_KEM_->delegateKey(mpkID, keyID, keyInput, newKeyID);
+}
+
+/*!
+ * Add attributes to a decryption key without redoing it, and store the
+ * key delta for its holder (see OpenABEContextABE).
+ *
+ * @param[in]   master public key identifier (assumes it's already in keystore).
+ * @param[in]   master secret key identifier (assumes it's already in keystore).
+ * @param[in]   decryption key identifier (assumes it's already in keystore).
+ * @param[in]   functional input with the attributes to add.
+ * @param[in]   identifier for the key delta.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCCA::extendKey(const string &mpkID, const string &mskID,
+                                   const string &keyID,
+                                   OpenABEFunctionInput *keyInput,
+                                   const string &deltaID) {
+  return this->m_KEM_->extendDecryptionKey(mpkID, mskID, keyID, keyInput, deltaID);
+}
+
+/*!
+ * Apply a key delta from extendKey to a decryption key.
+ *
+ * @param[in]   decryption key identifier (assumes it's already in keystore).
+ * @param[in]   key delta identifier (assumes it's already in keystore).
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCCA::applyKeyDelta(const string &keyID, const string &deltaID) {
+  return this->m_KEM_->applyKeyDelta(keyID, deltaID);
+}
+
+/*!
+ * Make a key update (a key delta applied with applyKeyDelta) for a
+ * decryption key, leaving the key as it is.
+ *
+ * @param[in]   master public key identifier (assumes it's already in keystore).
+ * @param[in]   master secret key identifier (assumes it's already in keystore).
+ * @param[in]   decryption key identifier (assumes it's already in keystore).
+ * @param[in]   functional input with the attributes of the update.
+ * @param[in]   identifier for the key update.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCCA::generateKeyUpdate(const string &mpkID, const string &mskID,
+                                           const string &keyID,
+                                           OpenABEFunctionInput *keyInput,
+                                           const string &updateID) {
+  return this->m_KEM_->generateKeyUpdate(mpkID, mskID, keyID, keyInput, updateID);
+}
+
+/*!
+ * Split a decryption key for outsourced decryption: a server holding the
+ * transformation key turns ciphertexts into short ones (see transform())
+ * that the holder of the retrieval key decrypts with one exponentiation.
+ *
+ * @param[in]   decryption key identifier (assumes it's already in keystore).
+ * @param[in]   identifier for the transformation key.
+ * @param[in]   identifier for the retrieval key.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCCA::generateTransformKey(const string &keyID, const string &tkID,
+                                          const string &rkID) {
+  return this->m_KEM_->generateTransformKey(keyID, tkID, rkID);
+}
+
+/*!
+ * Transform part 1 of a ciphertext with a transformation key. Part 2 is
+ * left as it is.
+ *
+ * @param[in]   master public key identifier of the sender (assumes it's already in keystore).
+ * @param[in]   transformation key identifier (assumes it's already in keystore).
+ * @param[in]   the ABE ciphertext.
+ * @param[out]  the transformed ciphertext.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCCA::transform(const string &mpkID, const string &tkID,
+                               OpenABECiphertext *ciphertext1,
+                               OpenABECiphertext *transformed) {
+  OpenABETraceSpan span("abe.transform");
+  OpenABE_ERROR result = this->m_KEM_->transformKEM(mpkID, tkID, ciphertext1, transformed);
+  span.setStatus(result);
+  return result;
+}
+
+/*!
+ * Decrypt a transformed ciphertext with the retrieval key.
+ *
+ * @param[in]   retrieval key identifier (assumes it's already in keystore).
+ * @param[out]  string reference to store resulting plaintext if decrypt successful.
+ * @param[in]   the transformed ciphertext.
+ * @param[in]   part 2 of the original ciphertext.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCCA::decryptTransformed(const string &rkID, string &plaintext,
+                                        OpenABECiphertext *transformed,
+                                        OpenABECiphertext *ciphertext2) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  OpenABEByteString *iv, *ct, *tag;
+  OpenABEByteString ctHdr, symkeyBytes;
+  shared_ptr<OpenABESymKey> symkey(new OpenABESymKey);
+  OpenABETraceSpan span("abe.decryptTransformed");
+
+  try {
+    ASSERT_NOTNULL(transformed);
+    ASSERT_NOTNULL(ciphertext2);
+    iv = ciphertext2->getByteString("IV");
+    ASSERT_NOTNULL(iv);
+    ct = ciphertext2->getByteString("CT");
+    ASSERT_NOTNULL(ct);
+    tag = ciphertext2->getByteString("Tag");
+    ASSERT_NOTNULL(tag);
+
+    result = this->m_KEM_->finishTransformedKEM(rkID, transformed,
+                                                DEFAULT_SYM_KEY_BYTES, symkey);
+    ASSERT(result == OpenABE_NOERROR, result);
+    symkeyBytes = symkey->getKeyBytes();
+    oabe::crypto::OpenABESymKeyAuthEnc authEnc(DEFAULT_AES_SEC_LEVEL, symkeyBytes);
+    transformed->getHeader(ctHdr);
+    authEnc.setAddAuthData(ctHdr);
+    if (!authEnc.decrypt(plaintext, iv, ct, tag)) {
       throw OpenABE_ERROR_DECRYPTION_FAILED;
     }
+    span.setItems(plaintext.size());
   } catch (OpenABE_ERROR &error) {
     result = error;
   }
 
-  symkey->zeroize();
   symkeyBytes.zeroize();
+  symkey->zeroize();
+  span.setStatus(result);
   return result;
 }
 
@@ -698,6 +1762,13 @@ OpenABEContextSchemeCCAWithATZN::OpenABEContextSchemeCCAWithATZN(unique_ptr<Open
     scheme_type = OpenABE_SCHEME_KP_GPSW_CCA;
   } else if (kem_->getSchemeType() == OpenABE_SCHEME_CP_WATERS) {
     scheme_type = OpenABE_SCHEME_CP_WATERS_CCA;
+  } else if (kem_->getSchemeType() == OpenABE_SCHEME_CP_FAME) {
+    scheme_type = OpenABE_SCHEME_CP_FAME_CCA;
+  } else if (kem_->getSchemeType() == OpenABE_SCHEME_CP_WATERS_FD) {
+    scheme_type = OpenABE_SCHEME_CP_WATERS_FD_CCA;
+  } else if (isHashedCCAScheme(kem_->getSchemeType())) {
+    // an OpenABEContextHashedCCA KEM already carries its own scheme type
+    scheme_type = kem_->getSchemeType();
   } else {
     /* unrecognized scheme type */
     throw OpenABE_ERROR_INVALID_INPUT;
@@ -781,6 +1852,30 @@ OpenABEContextSchemeCCAWithATZN::loadMasterPublicParams(const string &mpkID,
   return this->m_KEM_->loadMasterPublicParams(mpkID, mpkBlob);
 }
 
+/*!
+ * Return a shareable handle to a loaded master public key.
+ *
+ * @param[in]	identifier for the public key in the keystore.
+ * @return  The handle, or nullptr if the key is not loaded.
+ */
+OpenABEMPKHandle
+OpenABEContextSchemeCCAWithATZN::getMasterPublicParamsHandle(const string &mpkID) {
+  return this->m_KEM_->getMasterPublicParamsHandle(mpkID);
+}
+
+/*!
+ * Use a master public key decoded by another context.
+ *
+ * @param[in]	identifier for the public key in the keystore.
+ * @param[in]	handle obtained from getMasterPublicParamsHandle.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemeCCAWithATZN::attachMasterPublicParams(const string &mpkID,
+                                   const OpenABEMPKHandle &handle) {
+  return this->m_KEM_->attachMasterPublicParams(mpkID, handle);
+}
+
 /*!
  * Load and validate the master secret parameters.
  *
@@ -861,7 +1956,7 @@ OpenABEContextSchemeCCAWithATZN::encrypt(const string &mpkID,
                              const OpenABEFunctionInput *encryptInput,
                              OpenABECiphertext *ciphertext) {
   OpenABE_ERROR result = OpenABE_NOERROR;
-  unique_ptr<OpenABERNG> rng(new OpenABERNG);
+  unique_ptr<OpenABERNG> rng(new OpenABEThreadRNG);
   shared_ptr<OpenABESymKey> symkey(new OpenABESymKey);
   unique_ptr<OpenABESymKeyHandle> keyHandle = nullptr;
   OpenABEByteString ctBlob, ctHash, symkeyBytes;
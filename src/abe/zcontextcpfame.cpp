@@ -0,0 +1,584 @@
+/// 
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+/// 
+/// This file is part of Zeutro's OpenABE.
+/// 
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+/// 
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+/// 
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+/// 
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+/// \file   zcontextcpfame.cpp
+///
+/// \brief  Implementation of the FAME CP-ABE scheme under SXDH (k = 1).
+///
+/// \source https://eprint.iacr.org/2017/807.pdf (Section 4)
+///
+
+#define __ZCONTEXTCPFAME_CPP__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+#include <openabe/openabe.h>
+#include <openabe/utils/zcryptoutils.h>
+
+using namespace std;
+
+/********************************************************************************
+ * Implementation of the OpenABEContextCPFAME class
+ ********************************************************************************/
+namespace oabe {
+
+// H(x l 1) of the paper: the hash of attribute x for l = 1, 2
+static string attributeHashLabel(const string &attr, uint32_t l) {
+  return "A|" + attr + "|" + to_string(l);
+}
+
+// H(0 j l 1) of the paper: the hash of column j of the share matrix
+static string columnHashLabel(uint32_t j, uint32_t l) {
+  return "C|" + to_string(j) + "|" + to_string(l);
+}
+
+/*!
+ * Constructor for the OpenABEContextCPFAME class.
+ *
+ */
+OpenABEContextCPFAME::OpenABEContextCPFAME(unique_ptr<OpenABERNG> rng)
+    : OpenABEContextABE() {
+  this->debug = false;
+  // KEM context will take ownership of the given RNG
+  this->m_RNG_ = std::move(rng);
+  this->algID = OpenABE_SCHEME_CP_FAME;
+  // generators that are raised to fresh exponents on every encryption
+  this->fixedBaseG2_ = {"h", "H1"};
+  this->fixedBaseGT_ = {"T1"};
+}
+
+/*!
+ * Destructor for the OpenABEContextCPFAME class.
+ *
+ */
+OpenABEContextCPFAME::~OpenABEContextCPFAME() {}
+
+/*!
+ * Generate the master public and secret parameters for the scheme:
+ * h and H1 = h^a in G2, T1 = e(g, h)^{d1 a + d2} and the hash key k are
+ * public; a, b, g, g^d1 and g^d2 are secret.
+ *
+ * @param[in] pairingParams     - Identifier for the pairing parameters.
+ * @param[in] mpkID             - Identifier to use for the new Master Public Key
+ * @param[in] mskID             - Identifier to use for the new Master Secret Key
+ * @return                      - An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR
+OpenABEContextCPFAME::generateParams(const string pairingParams,
+                                 const string &mpkID, const string &mskID) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  shared_ptr<OpenABEKey> MPK = nullptr, MSK = nullptr;
+  OpenABERNG *myRNG = this->getRNG();
+  OpenABEByteString k;
+
+  try {
+    // Instantiate a OpenABE pairing object with the given parameters
+    this->initializeCurve(pairingParams);
+
+    // Make sure these parameter IDs are valid and not already in use
+    if (this->getKeystore()->validateNewParamsID(mpkID) == false ||
+        this->getKeystore()->validateNewParamsID(mskID) == false) {
+      throw OpenABE_ERROR_INVALID_PARAMS_ID;
+    }
+
+    MPK.reset(new OpenABEKey(this->getPairing()->getCurveID(), this->algID, mpkID));
+    MSK.reset(new OpenABEKey(this->getPairing()->getCurveID(), this->algID, mskID));
+
+    // Select random generators g \in G1, h \in G2
+    G1 g = this->getPairing()->randomG1(myRNG);
+    G2 h = this->getPairing()->randomG2(myRNG);
+    // Select a, b \in ZP^* and d1, d2 \in ZP
+    ZP a = this->getPairing()->randomZP(myRNG);
+    ZP b = this->getPairing()->randomZP(myRNG);
+    ZP d1 = this->getPairing()->randomZP(myRNG);
+    ZP d2 = this->getPairing()->randomZP(myRNG);
+    // key prefix for hash function
+    myRNG->getRandomBytes(&k, HASH_LEN);
+
+    // H1 = h^a, T1 = e(g, h)^{d1 a + d2}
+    G2 H1 = h.exp(a);
+    GT T1 = this->getPairing()->pairing(g, h).exp(d1 * a + d2);
+    G1 gd1 = g.exp(d1);
+    G1 gd2 = g.exp(d2);
+
+    MPK->setComponent("h", &h);
+    MPK->setComponent("H1", &H1);
+    MPK->setComponent("T1", &T1);
+    MPK->setComponent("k", &k);
+
+    MSK->setComponent("a", &a);
+    MSK->setComponent("b", &b);
+    MSK->setComponent("g", &g);
+    MSK->setComponent("gd1", &gd1);
+    MSK->setComponent("gd2", &gd2);
+
+    // Add (MPK, MSK) to the keystore
+    this->getKeystore()->addKey(mpkID, MPK, KEY_TYPE_PUBLIC);
+    this->getKeystore()->addKey(mskID, MSK, KEY_TYPE_SECRET);
+
+  } catch (OpenABE_ERROR &err) {
+    result = err;
+  }
+
+  return result;
+}
+
+/*!
+ * Generate a decryption key for an attribute list. For random r and a
+ * random sigma per attribute (and one more, sigma'):
+ *   K01 = h^{br}, K02 = h^r
+ *   K1[y] = H(y 1)^{br/a} H(y 2)^{r/a} g^{sigma_y/a}, K2[y] = g^{-sigma_y}
+ *   KP1 = g^d1 H(0 1)^{br/a} H(0 2)^{r/a} g^{sigma'/a}, KP2 = g^d2 g^{-sigma'}
+ *
+ * @param[in] mpkID     - parameter ID of the Master Public Key
+ * @param[in] mskID     - parameter ID of the Master Secret Key
+ * @param[in] keyID     - parameter ID of the decryption key to be created
+ * @param[in] keyInput  - A OpenABEAttributeList structure for the key to be constructed
+ * @return              - An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR
+OpenABEContextCPFAME::generateDecryptionKey(
+    OpenABEFunctionInput *keyInput, const string &keyID, const string &mpkID,
+    const string &mskID, const string &gpkID = "", const string &GID = "") {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  shared_ptr<OpenABEKey> decKey = nullptr;
+  OpenABEAttributeList *attrList = nullptr;
+  OpenABERNG *myRNG = this->getRNG();
+  OpenABEByteString *k = nullptr;
+
+  try {
+    // Ensure that the given input is a OpenABEAttributeList
+    if ((attrList = dynamic_cast<OpenABEAttributeList *>(keyInput)) == nullptr) {
+      OpenABE_LOG_AND_THROW("Decryption key input must be an Attribute List",
+                        OpenABE_ERROR_INVALID_INPUT);
+    }
+
+    // Load the master secret and public key
+    shared_ptr<OpenABEKey> MPK = this->getKeystore()->getPublicKey(mpkID);
+    shared_ptr<OpenABEKey> MSK = this->getKeystore()->getSecretKey(mskID);
+    if (MPK == nullptr || MSK == nullptr) {
+      throw OpenABE_ERROR_INVALID_PARAMS;
+    }
+    k = MPK->getByteString("k");
+    G2 *h = MPK->getG2("h");
+    ZP *a = MSK->getZP("a"), *b = MSK->getZP("b");
+    G1 *g = MSK->getG1("g"), *gd1 = MSK->getG1("gd1"), *gd2 = MSK->getG1("gd2");
+    if (k == nullptr || h == nullptr || a == nullptr || b == nullptr ||
+        g == nullptr || gd1 == nullptr || gd2 == nullptr) {
+      throw OpenABE_ERROR_INVALID_PARAMS;
+    }
+    shared_ptr<OpenABEPrecomputedParams> PRE = this->getPrecomputedParams(mpkID);
+
+    decKey.reset(
+        new OpenABEKey(this->getPairing()->getCurveID(), this->algID, keyID));
+    decKey->setComponent("input", attrList);
+
+    ZP r = this->getPairing()->randomZP(myRNG);
+    ZP aInv = *a;
+    aInv.multInverse();
+    // exponents of H(. 1) and H(. 2): br/a and r/a
+    ZP br = *b * r;
+    ZP e1 = br * aInv, e2 = r * aInv;
+
+    G2 K01 = h->exp(br);
+    G2 K02 = h->exp(r);
+    decKey->setComponent("K01", &K01);
+    decKey->setComponent("K02", &K02);
+
+    // the three-base product shared by KP1 and every K1[y]
+    vector<G1> bases(3, *g);
+    vector<ZP> exps(3, e1);
+    exps[1] = e2;
+    auto keyTerm = [&](const string &label1, const string &label2, const ZP &sigma) {
+      bases[0] = PRE->hashToG1(this->getPairing(), *k, label1);
+      bases[1] = PRE->hashToG1(this->getPairing(), *k, label2);
+      exps[2] = sigma * aInv;
+      return G1::multiExp(bases, exps);
+    };
+
+    ZP sigma = this->getPairing()->randomZP(myRNG);
+    G1 KP1 = *gd1 * keyTerm(columnHashLabel(0, 1), columnHashLabel(0, 2), sigma);
+    G1 KP2 = *gd2 * g->exp(-sigma);
+    decKey->setComponent("KP1", &KP1);
+    decKey->setComponent("KP2", &KP2);
+
+    const vector<string> *attrStrings = attrList->getAttributeList();
+    for (auto it = attrStrings->begin(); it != attrStrings->end(); ++it) {
+      const string attr_deckey = OpenABEHashKey(*it);
+      ZP sigma_y = this->getPairing()->randomZP(myRNG);
+      G1 K1 = keyTerm(attributeHashLabel(*it, 1), attributeHashLabel(*it, 2), sigma_y);
+      G1 K2 = g->exp(-sigma_y);
+      decKey->setComponent(OpenABEMakeElementLabel("K1", attr_deckey), &K1);
+      decKey->setComponent(OpenABEMakeElementLabel("K2", attr_deckey), &K2);
+    }
+
+    // Add the decryption key to the keystore
+    this->getKeystore()->addKey(keyID, decKey, KEY_TYPE_SECRET);
+
+  } catch (OpenABE_ERROR &err) {
+    result = err;
+  }
+
+  return result;
+}
+
+/*!
+ * Generate and encrypt a symmetric key using the key encapsulation mode
+ * of the scheme. With M the share matrix of the policy and a random s:
+ *   C01 = H1^s, C02 = h^s
+ *   Cl[i] = (H(attr_i l) * prod_j H(0 j l)^{M_ij})^s  for l = 1, 2
+ * and the key is hashed from T1^s.
+ *
+ * @param   Parameters ID for the public master parameters.
+ * @param   Function input for the encryption.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR
+OpenABEContextCPFAME::encryptKEM(OpenABERNG *rng, const string &mpkID,
+                             const OpenABEFunctionInput *encryptInput,
+                             uint32_t keyByteLen,
+                             const std::shared_ptr<OpenABESymKey> &key,
+                             OpenABECiphertext *ciphertext) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  OpenABERNG *myRNG = this->getRNG();
+  OpenABEByteString *k = nullptr;
+
+  try {
+    ASSERT_NOTNULL(key);
+    ASSERT_NOTNULL(ciphertext);
+
+    if (rng != nullptr) {
+      // use the passed in RNG
+      myRNG = rng;
+    }
+    // Assert that the RNG has been set
+    ASSERT_NOTNULL(myRNG);
+
+    // Ensure that the given input is a OpenABEPolicy
+    const OpenABEPolicy *policy = dynamic_cast<const OpenABEPolicy *>(encryptInput);
+    if (policy == nullptr) {
+      OpenABE_LOG_AND_THROW("Encryption input must be a Policy",
+                        OpenABE_ERROR_INVALID_INPUT);
+    }
+
+    // Load the master public key
+    shared_ptr<OpenABEKey> MPK = this->getKeystore()->getPublicKey(mpkID);
+    if (MPK == nullptr) {
+      throw OpenABE_ERROR_INVALID_PARAMS;
+    }
+    k = MPK->getByteString("k");
+    ASSERT_NOTNULL(k);
+    shared_ptr<OpenABEPrecomputedParams> PRE = this->getPrecomputedParams(mpkID);
+    G2FixedBase *h = PRE->getG2("h"), *H1 = PRE->getG2("H1");
+    GTFixedBase *T1 = PRE->getGT("T1");
+    ASSERT_NOTNULL(h);
+    ASSERT_NOTNULL(H1);
+    ASSERT_NOTNULL(T1);
+
+    // s is the only randomness, so the CCA re-encryption check gets the
+    // same ciphertext whatever the number of threads
+    ZP s = this->getPairing()->randomZP(myRNG);
+    GT C = T1->exp(s);
+
+    shared_ptr<const OpenABELSSSCompiledPolicy> compiled =
+        OpenABELSSSCompiledPolicy::forPolicy(policy);
+    vector<OpenABELSSSMatrixRow> M;
+    uint32_t numColumns = 0;
+    OpenABELSSS lsss(this->getPairing(), myRNG);
+    lsss.shareMatrix(*compiled, M, numColumns);
+    const size_t numRows = compiled->numRows();
+
+    OpenABEByteString pol;
+    const bool hashed = policyComponentForCiphertext(policy, pol);
+    ciphertext->setComponent(hashed ? "policyHash" : "policy", &pol);
+    // the labels follow from the policy, so compact encoding can drop them
+    ciphertext->setSchema(hashed ? OpenABE_SCHEMA_CP_FAME_HASHED_CT
+                                 : OpenABE_SCHEMA_CP_FAME_CT);
+
+    G2 C01 = H1->exp(s);
+    G2 C02 = h->exp(s);
+    ciphertext->setComponent("C01", &C01);
+    ciphertext->setComponent("C02", &C02);
+
+    // H(0 j l) for every column of M
+    vector<G1> columns[2];
+    for (uint32_t l = 0; l < 2; l++) {
+      columns[l].reserve(numColumns);
+      for (uint32_t j = 0; j < numColumns; j++) {
+        columns[l].push_back(PRE->hashToG1(this->getPairing(), *k, columnHashLabel(j, l + 1)));
+      }
+    }
+
+    OpenABETraceSpan rowSpan("rows");
+    rowSpan.setItems(numRows);
+    vector<G1> Cx[2] = {vector<G1>(numRows, this->getPairing()->initG1()),
+                        vector<G1>(numRows, this->getPairing()->initG1())};
+    auto computeRow = [&](size_t i) {
+      const OpenABELSSSMatrixRow &row = M[i];
+      vector<G1> bases;
+      vector<ZP> exps;
+      bases.reserve(row.size() + 1);
+      exps.reserve(row.size() + 1);
+      for (uint32_t l = 0; l < 2; l++) {
+        bases.clear();
+        exps.clear();
+        bases.push_back(PRE->hashToG1(this->getPairing(), *k,
+                                      attributeHashLabel(compiled->rowAttribute(i), l + 1)));
+        exps.push_back(s);
+        for (auto &entry : row) {
+          bases.push_back(columns[l][entry.first]);
+          exps.push_back(s * entry.second);
+        }
+        Cx[l][i] = G1::multiExp(bases, exps);
+      }
+    };
+    if (this->getNumThreads() > 1) {
+      OpenABEThreadPool::getDefault()->parallelFor(numRows, computeRow,
+                                                   this->getNumThreads());
+    } else {
+      for (size_t i = 0; i < numRows; i++) {
+        computeRow(i);
+      }
+    }
+    rowSpan.end();
+
+    // policy, C01, C02, a (C1, C2) pair per row and the encrypted payload
+    ciphertext->reserveComponents(4 + 2 * numRows);
+    for (size_t i = 0; i < numRows; i++) {
+      const string &attr_key = compiled->rowKey(i);
+      ciphertext->setComponent(OpenABEMakeElementLabel("C1", attr_key), &Cx[0][i]);
+      ciphertext->setComponent(OpenABEMakeElementLabel("C2", attr_key), &Cx[1][i]);
+    }
+
+    // Hash C to obtain the symmetric key result.
+    OpenABETraceSpan kdfSpan("kdf");
+    key->hashToSymmetricKey(C, keyByteLen, HASH_FUNCTION_TYPE_SHA256);
+    kdfSpan.end();
+    ciphertext->setHeader(this->getPairing()->getCurveID(), this->algID, myRNG);
+
+  } catch (OpenABE_ERROR &err) {
+    result = err;
+  }
+
+  return result;
+}
+
+/*!
+ * Estimate encryptKEM under a policy: the operations it does, and a
+ * skeleton with the components it would set, holding a public generator
+ * and a hashed point in place of the group elements.
+ *
+ * @param   Parameters ID for the public master parameters.
+ * @param   Function input for the encryption.
+ * @param   Length of the symmetric key.
+ * @param   Skeleton ciphertext to fill.
+ * @param   Operation counts to be returned.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR
+OpenABEContextCPFAME::estimateKEM(const string &mpkID,
+                              const OpenABEFunctionInput *encryptInput,
+                              uint32_t keyByteLen, OpenABECiphertext *skeleton,
+                              OpenABEEncryptionCost &cost) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  OpenABEByteString *k = nullptr;
+
+  try {
+    ASSERT_NOTNULL(skeleton);
+    const OpenABEPolicy *policy = dynamic_cast<const OpenABEPolicy *>(encryptInput);
+    if (policy == nullptr) {
+      OpenABE_LOG_AND_THROW("Encryption input must be a Policy",
+                        OpenABE_ERROR_INVALID_INPUT);
+    }
+    shared_ptr<OpenABEKey> MPK = this->getKeystore()->getPublicKey(mpkID);
+    if (MPK == nullptr) {
+      throw OpenABE_ERROR_INVALID_PARAMS;
+    }
+    k = MPK->getByteString("k");
+    G2 *h = MPK->getG2("h");
+    ASSERT_NOTNULL(k);
+    ASSERT_NOTNULL(h);
+    // the MPK has no G1 element, the first column hash serves instead
+    shared_ptr<OpenABEPrecomputedParams> PRE = this->getPrecomputedParams(mpkID);
+    G1 point = PRE->hashToG1(this->getPairing(), *k, columnHashLabel(0, 1));
+
+    shared_ptr<const OpenABELSSSCompiledPolicy> compiled =
+        OpenABELSSSCompiledPolicy::forPolicy(policy);
+    vector<OpenABELSSSMatrixRow> M;
+    uint32_t numColumns = 0;
+    OpenABELSSS lsss(this->getPairing(), this->getRNG());
+    lsss.shareMatrix(*compiled, M, numColumns);
+    const size_t numRows = compiled->numRows();
+
+    OpenABEByteString pol;
+    const bool hashed = policyComponentForCiphertext(policy, pol);
+    skeleton->setComponent(hashed ? "policyHash" : "policy", &pol);
+    skeleton->setSchema(hashed ? OpenABE_SCHEMA_CP_FAME_HASHED_CT
+                               : OpenABE_SCHEMA_CP_FAME_CT);
+    skeleton->setComponent("C01", h);
+    skeleton->setComponent("C02", h);
+    skeleton->reserveComponents(4 + 2 * numRows);
+    for (size_t i = 0; i < numRows; i++) {
+      const string &attr_key = compiled->rowKey(i);
+      skeleton->setComponent(OpenABEMakeElementLabel("C1", attr_key), &point);
+      skeleton->setComponent(OpenABEMakeElementLabel("C2", attr_key), &point);
+    }
+    OpenABEByteString uid;
+    uid.fillBuffer(0, UID_LEN);
+    skeleton->setHeader(this->getPairing()->getCurveID(), this->algID, uid);
+
+    // encryption: C, C01 and C02, two hashes per column and a hash and a
+    // multi-exponentiation per row and l. Decryption: four pairings and
+    // four multi-exponentiations for any number of rows.
+    cost.rows = (uint32_t)numRows;
+    cost.minDecryptRows = compiled->minRows();
+    cost.encryptExps = 3 + 2 * cost.rows;
+    cost.encryptHashes = 2 * numColumns + 2 * cost.rows;
+    cost.decryptPairings = 4;
+    cost.decryptExps = 4;
+    cost.decryptHashes = 0;
+  } catch (OpenABE_ERROR &err) {
+    result = err;
+  }
+
+  return result;
+}
+
+/*!
+ * Decrypt a symmetric key using the key encapsulation mode of the scheme.
+ * With the coefficients c_i of the rows the key's attributes satisfy,
+ *   T1^s = e(KP1 prod K1[i]^{c_i}, C01) * e(KP2 prod K2[i]^{c_i}, C02)
+ *        * e(prod C1[i]^{-c_i}, K01) * e(prod C2[i]^{-c_i}, K02)
+ * which is one multi-pairing of four pairs for any policy.
+ *
+ * @param   Parameters ID for the public master parameters.
+ * @param   Identifier for the decryption key to be used.
+ * @param   ABE ciphertext.
+ * @param   Symmetric key to be returned.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR
+OpenABEContextCPFAME::decryptKEM(const string &mpkID, const string &keyID,
+                             OpenABECiphertext *ciphertext, uint32_t keyByteLen,
+                             const std::shared_ptr<OpenABESymKey> &key) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+
+  try {
+    ASSERT_NOTNULL(ciphertext);
+    ASSERT_NOTNULL(key);
+    shared_ptr<OpenABEKey> decKey = this->getKeystore()->getSecretKey(keyID);
+    ASSERT_NOTNULL(decKey);
+    OpenABEAttributeList *attrList =
+        dynamic_cast<OpenABEAttributeList *>(decKey->getComponent("input"));
+    ASSERT_NOTNULL(attrList);
+
+    unique_ptr<OpenABEPolicy> policy = getCiphertextPolicy(ciphertext);
+    ASSERT_NOTNULL(policy);
+
+    // throws if the attributes do not satisfy the policy
+    OpenABELSSS lsss(this->getPairing(), this->getRNG());
+    OpenABETraceSpan recoverSpan("lsss.recover");
+    if (!lsss.recoverCoefficients(keyID, policy.get(), attrList)) {
+      throw OpenABE_ERROR_POLICY_NOT_SATISFIED;
+    }
+    shared_ptr<const OpenABELSSSCompiledPolicy> compiled =
+        OpenABELSSSCompiledPolicy::forPolicy(policy.get());
+    const OpenABELSSSRowVector &lsssRows = lsss.getRecoveredRows();
+    recoverSpan.setItems(lsssRows.size());
+    recoverSpan.end();
+    if (lsssRows.empty()) {
+      throw OpenABE_ERROR_DECRYPTION_FAILED;
+    }
+
+    G2 *C01 = ciphertext->getG2("C01"), *C02 = ciphertext->getG2("C02");
+    G1 *KP1 = decKey->getG1("KP1"), *KP2 = decKey->getG1("KP2");
+    shared_ptr<const G2LineTable> K01 = decKey->getG2LineTable("K01");
+    shared_ptr<const G2LineTable> K02 = decKey->getG2LineTable("K02");
+    ASSERT_NOTNULL(C01);
+    ASSERT_NOTNULL(C02);
+    ASSERT_NOTNULL(KP1);
+    ASSERT_NOTNULL(KP2);
+    ASSERT_NOTNULL(K01);
+    ASSERT_NOTNULL(K02);
+
+    OpenABETraceSpan rowSpan("rows");
+    rowSpan.setItems(lsssRows.size());
+    vector<G1> c1s, c2s, k1s, k2s;
+    vector<ZP> coeffs, negCoeffs;
+    c1s.reserve(lsssRows.size());
+    c2s.reserve(lsssRows.size());
+    k1s.reserve(lsssRows.size());
+    k2s.reserve(lsssRows.size());
+    coeffs.reserve(lsssRows.size());
+    negCoeffs.reserve(lsssRows.size());
+    for (auto it = lsssRows.begin(); it != lsssRows.end(); ++it) {
+      const string &attr_key = compiled->rowKey(it->index);
+      const string &attr_deckey = compiled->rowAttributeKey(it->index);
+      G1 *C1 = ciphertext->getG1(OpenABEMakeElementLabel("C1", attr_key));
+      G1 *C2 = ciphertext->getG1(OpenABEMakeElementLabel("C2", attr_key));
+      G1 *K1 = decKey->getG1(OpenABEMakeElementLabel("K1", attr_deckey));
+      G1 *K2 = decKey->getG1(OpenABEMakeElementLabel("K2", attr_deckey));
+      ASSERT_NOTNULL(C1);
+      ASSERT_NOTNULL(C2);
+      ASSERT_NOTNULL(K1);
+      ASSERT_NOTNULL(K2);
+      c1s.push_back(*C1);
+      c2s.push_back(*C2);
+      k1s.push_back(*K1);
+      k2s.push_back(*K2);
+      coeffs.push_back(it->coefficient);
+      negCoeffs.push_back(-it->coefficient);
+    }
+    vector<G1> g1s = {*KP1 * G1::multiExp(k1s, coeffs), *KP2 * G1::multiExp(k2s, coeffs)};
+    vector<G2> g2s = {*C01, *C02};
+    vector<G1> fixedG1s = {G1::multiExp(c1s, negCoeffs), G1::multiExp(c2s, negCoeffs)};
+    const G2LineTable *fixedG2s[2] = {K01.get(), K02.get()};
+    rowSpan.end();
+
+    GT final = this->getPairing()->initGT();
+    OpenABETraceSpan pairingSpan("multi_pairing");
+    pairingSpan.setItems(4);
+    this->getPairing()->multi_pairing(final, g1s.data(), g2s.data(), g1s.size(),
+                                      fixedG1s.data(), fixedG2s, 2);
+    pairingSpan.end();
+    OpenABETraceSpan kdfSpan("kdf");
+    key->hashToSymmetricKey(final, keyByteLen, HASH_FUNCTION_TYPE_SHA256);
+    kdfSpan.end();
+  } catch (OpenABE_ERROR &err) {
+    result = err;
+  }
+
+  return result;
+}
+
+}
@@ -60,6 +60,10 @@ OpenABEContextCPWaters::OpenABEContextCPWaters(unique_ptr<OpenABERNG> rng)
   // KEM context will take ownership of the given RNG
   this->m_RNG_ = std::move(rng);
   this->algID = OpenABE_SCHEME_CP_WATERS;
+  // generators that are raised to fresh exponents on every encryption
+  this->fixedBaseG1_ = {"g1", "g1a"};
+  this->fixedBaseG2_ = {"g2"};
+  this->fixedBaseGT_ = {"A"};
 }
 
 /*!
@@ -68,6 +72,208 @@ OpenABEContextCPWaters::OpenABEContextCPWaters(unique_ptr<OpenABERNG> rng)
  */
 OpenABEContextCPWaters::~OpenABEContextCPWaters() {}
 
+/********************************************************************************
+ * Implementation of the OpenABECPWatersCouponPool class
+ ********************************************************************************/
+
+OpenABECPWatersCouponPool::OpenABECPWatersCouponPool(OpenABEPairing *pairing,
+                                                     shared_ptr<OpenABEPrecomputedParams> params,
+                                                     size_t capacity, size_t rows)
+    : pairing_(pairing), params_(params), capacity_(capacity), rows_(rows),
+      stopping_(false) {
+#if defined(__EMSCRIPTEN__)
+  this->refill();
+#else
+  this->worker_ = std::thread(&OpenABECPWatersCouponPool::workerLoop, this);
+#endif
+}
+
+OpenABECPWatersCouponPool::~OpenABECPWatersCouponPool() {
+  {
+    lock_guard<mutex> guard(this->lock_);
+    this->stopping_ = true;
+  }
+  this->wake_.notify_all();
+  if (this->worker_.joinable()) {
+    this->worker_.join();
+  }
+}
+
+/*!
+ * Generate one coupon: s, A^s and g1^s, then (ri, g2^ri) for each row.
+ *
+ * @param   RNG to draw the exponents from.
+ * @return  The new coupon.
+ */
+
+unique_ptr<OpenABECPWatersCoupon>
+OpenABECPWatersCouponPool::generate(OpenABERNG *rng) {
+  G1FixedBase *g1 = this->params_->getG1("g1");
+  G2FixedBase *g2 = this->params_->getG2("g2");
+  GTFixedBase *A = this->params_->getGT("A");
+  ASSERT_NOTNULL(g1);
+  ASSERT_NOTNULL(g2);
+  ASSERT_NOTNULL(A);
+
+  ZP s = this->pairing_->randomZP(rng);
+  unique_ptr<OpenABECPWatersCoupon> coupon(
+      new OpenABECPWatersCoupon(s, A->exp(s), g1->exp(s)));
+  coupon->r.reserve(this->rows_);
+  coupon->D.reserve(this->rows_);
+  for (size_t i = 0; i < this->rows_; i++) {
+    coupon->r.push_back(this->pairing_->randomZP(rng));
+    coupon->D.push_back(g2->exp(coupon->r.back()));
+  }
+  return coupon;
+}
+
+unique_ptr<OpenABECPWatersCoupon> OpenABECPWatersCouponPool::take() {
+  unique_ptr<OpenABECPWatersCoupon> coupon;
+  {
+    lock_guard<mutex> guard(this->lock_);
+    if (this->coupons_.empty()) {
+      return nullptr;
+    }
+    coupon = std::move(this->coupons_.front());
+    this->coupons_.pop_front();
+    if (this->coupons_.size() > this->capacity_ / 2) {
+      return coupon;
+    }
+  }
+  // down to the low-water mark
+  this->wake_.notify_one();
+  return coupon;
+}
+
+void OpenABECPWatersCouponPool::refill() {
+  OpenABEThreadRNG rng;
+  for (;;) {
+    {
+      lock_guard<mutex> guard(this->lock_);
+      if (this->stopping_ || this->coupons_.size() >= this->capacity_) {
+        return;
+      }
+    }
+    // generated without the lock so encryptions can keep taking coupons
+    unique_ptr<OpenABECPWatersCoupon> coupon = this->generate(&rng);
+    lock_guard<mutex> guard(this->lock_);
+    this->coupons_.push_back(std::move(coupon));
+  }
+}
+
+size_t OpenABECPWatersCouponPool::size() {
+  lock_guard<mutex> guard(this->lock_);
+  return this->coupons_.size();
+}
+
+void OpenABECPWatersCouponPool::workerLoop() {
+  // per-thread library initialization
+  OpenABEStateContext state;
+  for (;;) {
+    {
+      unique_lock<mutex> guard(this->lock_);
+      this->wake_.wait(guard, [this]() {
+        return this->stopping_ || this->coupons_.size() <= this->capacity_ / 2;
+      });
+      if (this->stopping_) {
+        return;
+      }
+    }
+    try {
+      this->refill();
+    } catch (...) {
+      // leave the pool as it is; encryption falls back to the full path
+      return;
+    }
+  }
+}
+
+/*!
+ * Start keeping a pool of encryption coupons for the given MPK. Each
+ * coupon saves encryptKEM the GT and G1 exponentiations for s and the G2
+ * exponentiation of the first 'rows' LSSS rows. Coupons are only used by
+ * encryptions whose RNG is not deterministic: under the CCA transform the
+ * randomness is derived from the message, so it cannot be generated ahead.
+ *
+ * @param   Parameters ID for the master public key.
+ * @param   Number of coupons to keep.
+ * @param   LSSS rows covered by each coupon (larger policies do the
+ *          remaining rows in full).
+ * @return  An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR
+OpenABEContextCPWaters::enableEncryptionCoupons(const string &mpkID,
+                                                size_t poolSize, size_t rows) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  try {
+    if (poolSize == 0) {
+      throw OpenABE_ERROR_INVALID_INPUT;
+    }
+    if (this->getKeystore()->getPublicKey(mpkID) == nullptr) {
+      throw OpenABE_ERROR_INVALID_PARAMS;
+    }
+    shared_ptr<OpenABECPWatersCouponPool> pool = make_shared<OpenABECPWatersCouponPool>(
+        this->getPairing(), this->getPrecomputedParams(mpkID), poolSize, rows);
+    lock_guard<mutex> lock(this->couponLock_);
+    this->coupons_[mpkID] = pool;
+  } catch (OpenABE_ERROR &error) {
+    result = error;
+  }
+  return result;
+}
+
+void OpenABEContextCPWaters::disableEncryptionCoupons(const string &mpkID) {
+  shared_ptr<OpenABECPWatersCouponPool> pool;
+  {
+    lock_guard<mutex> lock(this->couponLock_);
+    auto it = this->coupons_.find(mpkID);
+    if (it == this->coupons_.end()) {
+      return;
+    }
+    pool = it->second;
+    this->coupons_.erase(it);
+  }
+  // the worker is joined outside the lock (or later, by an encryption that
+  // still holds the pool)
+}
+
+size_t OpenABEContextCPWaters::getEncryptionCouponCount(const string &mpkID) {
+  shared_ptr<OpenABECPWatersCouponPool> pool;
+  {
+    lock_guard<mutex> lock(this->couponLock_);
+    auto it = this->coupons_.find(mpkID);
+    if (it == this->coupons_.end()) {
+      return 0;
+    }
+    pool = it->second;
+  }
+  return pool->size();
+}
+
+/*!
+ * Take a coupon for the given MPK, provided one is available and was made
+ * from the tables currently in use (the MPK may have been reloaded since).
+ */
+
+unique_ptr<OpenABECPWatersCoupon>
+OpenABEContextCPWaters::takeCoupon(const string &mpkID,
+                                   const shared_ptr<OpenABEPrecomputedParams> &params) {
+  shared_ptr<OpenABECPWatersCouponPool> pool;
+  {
+    lock_guard<mutex> lock(this->couponLock_);
+    if (this->coupons_.empty()) {
+      return nullptr;
+    }
+    auto it = this->coupons_.find(mpkID);
+    if (it == this->coupons_.end() || it->second->getPrecomputedParams() != params) {
+      return nullptr;
+    }
+    pool = it->second;
+  }
+  return pool->take();
+}
+
 /*!
  * Generate scheme public and private parameters for the Waters '11 CP-ABE
  * scheme. This function takes in a specific set of pairing parameters.
@@ -116,10 +322,12 @@ OpenABEContextCPWaters::generateParams(const string pairingParams,
     // Compute A = e(g1, g2)^\alpha
     GT A = this->getPairing()->pairing(g1, g2).exp(alpha);
 
-    // Add (g1, g2, g1a) to the public params
+    // Add (g1, g2, g1a, g2a) to the public params. g2a, like g^a in the
+    // symmetric scheme, is public; delegateKey needs it
     MPK->setComponent("g1", &g1);
     MPK->setComponent("g2", &g2);
     MPK->setComponent("g1a", &g1a);
+    MPK->setComponent("g2a", &g2a);
     MPK->setComponent("A", &A);
     MPK->setComponent("k", &k);
 
@@ -182,9 +390,13 @@ OpenABEContextCPWaters::generateDecryptionKey(
     // Add the attribute list to the key
     decKey->setComponent("input", attrList);
 
-    // Select a random element t \in ZP
-    ZP t = this->getPairing()->randomZP(myRNG);
+    // t is derived from alpha and a random nonce kept in the key, so
+    // that extendDecryptionKey can recompute it later
+    OpenABEByteString nonce;
+    myRNG->getRandomBytes(&nonce, OpenABE_CTR_DRBG_NONCELEN);
+    decKey->setComponent("nonce", &nonce);
     ZP alpha = *(MSK->getZP("alpha"));
+    ZP t = this->keyRandomness(alpha, nonce);
 
     // K = g2^\alpha * (g2^{a})^t
     G2 K = (MPK->getG2("g2")->exp(alpha)) * (MSK->getG2("g2a")->exp(t));
@@ -195,12 +407,14 @@ OpenABEContextCPWaters::generateDecryptionKey(
     decKey->setComponent("L", &L);
 
     // For each attribute in the attribute list
+    shared_ptr<OpenABEPrecomputedParams> PRE = this->getPrecomputedParams(mpkID);
     string attr, attr_deckey;
     const vector<string> *attrStrings = attrList->getAttributeList();
+    PRE->prefetchHashes(this->getPairing(), *k, *attrStrings, this->getNumThreads());
     for (auto it = attrStrings->begin(); it != attrStrings->end(); ++it) {
       // Compute KX_{attribute} = hash_to_G1(attribute)^t
       attr = *it;
-      G1 kx = this->getPairing()->hashToG1(*k, attr).exp(t);
+      G1 kx = PRE->hashToG1Exp(this->getPairing(), *k, attr, t);
       attr_deckey = OpenABEHashKey(attr);
       decKey->setComponent(OpenABEMakeElementLabel("KX", attr_deckey), &kx);
     }
@@ -215,6 +429,359 @@ OpenABEContextCPWaters::generateDecryptionKey(
   return result;
 }
 
+/*!
+ * t = PRF_alpha(nonce): the randomness of a decryption key, as a CTR-DRBG
+ * keyed with H(alpha || nonce).
+ */
+
+ZP
+OpenABEContextCPWaters::keyRandomness(ZP &alpha, OpenABEByteString &nonce) {
+  OpenABEByteString seed, prfKey;
+  alpha.serialize(seed);
+  seed += nonce;
+  prfKey = this->getPairing()->hashFromBytes(seed, DEFAULT_SYM_KEY_BYTES,
+                                             KEYGEN_HASH_FUNCTION);
+  OpenABECTR_DRBG prng(prfKey);
+  prng.setSeed(nonce);
+  ZP t = this->getPairing()->randomZP(&prng);
+  seed.zeroize();
+  prfKey.zeroize();
+  return t;
+}
+
+// the items of the compact form of 'input' that hold an attribute the
+// key doesn't have yet (so numeric attributes stay whole)
+static string addedKeyAttributes(OpenABEKey *decKey, OpenABEAttributeList *input) {
+  string added;
+  vector<string> items = split(input->toCompactString(), ATTR_SEP);
+  for (auto &item : items) {
+    if (item.empty()) {
+      continue;
+    }
+    unique_ptr<OpenABEAttributeList> one = createAttributeList(ATTR_SEP + item);
+    if (one == nullptr) {
+      throw OpenABE_ERROR_INVALID_INPUT;
+    }
+    const vector<string> *attrs = one->getAttributeList();
+    for (auto &attr : *attrs) {
+      if (!decKey->hasComponent(OpenABEMakeElementLabel("KX", OpenABEHashKey(attr)))) {
+        added += ATTR_SEP + item;
+        break;
+      }
+    }
+  }
+  return added;
+}
+
+/*!
+ * A copy of a decryption key with the attributes and KX components of a
+ * key delta added. Keys are shared (e.g. by the user key cache), so the
+ * key itself is left as it is.
+ */
+
+shared_ptr<OpenABEKey>
+OpenABEContextCPWaters::mergeKeyDelta(OpenABEKey *decKey, OpenABEKey *delta) {
+  OpenABEAttributeList *attrList =
+      dynamic_cast<OpenABEAttributeList *>(decKey->getComponent("input"));
+  OpenABEAttributeList *deltaList =
+      dynamic_cast<OpenABEAttributeList *>(delta->getComponent("input"));
+  ASSERT(attrList != nullptr && deltaList != nullptr, OpenABE_ERROR_INVALID_KEY_BODY);
+  // key updates may repeat attributes the key already holds
+  string deltaAttrs = addedKeyAttributes(decKey, deltaList);
+  unique_ptr<OpenABEAttributeList> merged = createAttributeList(
+      attrList->toCompactString() + (deltaAttrs.empty() ? "" : deltaAttrs.substr(1)));
+  ASSERT_NOTNULL(merged);
+
+  shared_ptr<OpenABEKey> newKey(new OpenABEKey(
+      (OpenABECurveID)decKey->getCurveID(), decKey->getAlgorithmID(),
+      decKey->getID(), &decKey->getUID()));
+  vector<string> labels = decKey->getKeys();
+  newKey->reserveComponents(labels.size() + deltaList->getAttributeList()->size());
+  for (auto &label : labels) {
+    if (label != "input") {
+      newKey->setComponent(label, decKey->getComponent(label));
+    }
+  }
+  newKey->setComponent("input", merged.get());
+  const vector<string> *attrStrings = deltaList->getAttributeList();
+  for (auto it = attrStrings->begin(); it != attrStrings->end(); ++it) {
+    const string label = OpenABEMakeElementLabel("KX", OpenABEHashKey(*it));
+    G1 *kx = delta->getG1(label);
+    ASSERT_NOTNULL(kx);
+    newKey->setComponent(label, kx);
+  }
+  return newKey;
+}
+
+/*!
+ * Add attributes to an existing decryption key, reusing its randomness
+ * t (recomputed from the MSK and the key's nonce): K and L stay as they
+ * are and only KX_x = H(x)^t is computed for each added attribute. The
+ * key in the keystore is replaced by the extended one, and a key delta
+ * holding the added attributes and their KX, for the key's holder to
+ * apply with applyKeyDelta, is stored under deltaID.
+ *
+ * @param[in] mpkID     - parameter ID of the Master Public Key
+ * @param[in] mskID     - parameter ID of the Master Secret Key
+ * @param[in] keyID     - parameter ID of the decryption key to be extended
+ * @param[in] keyInput  - the OpenABEAttributeList of the attributes to add
+ * @param[in] deltaID   - parameter ID of the key delta to be created
+ * @return              - An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR
+OpenABEContextCPWaters::extendDecryptionKey(const string &mpkID, const string &mskID,
+                                            const string &keyID,
+                                            OpenABEFunctionInput *keyInput,
+                                            const string &deltaID) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  OpenABEAttributeList *attrList = nullptr;
+
+  try {
+    if ((attrList = dynamic_cast<OpenABEAttributeList *>(keyInput)) == nullptr) {
+      OpenABE_LOG_AND_THROW("Decryption key input must be an Attribute List",
+                        OpenABE_ERROR_INVALID_INPUT);
+    }
+    shared_ptr<OpenABEKey> decKey = this->getKeystore()->getSecretKey(keyID);
+    if (decKey == nullptr) {
+      throw OpenABE_ERROR_INVALID_PARAMS;
+    }
+    string added = addedKeyAttributes(decKey.get(), attrList);
+    if (added.empty()) {
+      OpenABE_LOG_AND_THROW("Decryption key already holds the attributes",
+                        OpenABE_ERROR_INVALID_INPUT);
+    }
+    unique_ptr<OpenABEAttributeList> addedList = createAttributeList(added);
+    ASSERT_NOTNULL(addedList);
+
+    shared_ptr<OpenABEKey> delta =
+        this->makeKeyDelta(mpkID, mskID, decKey.get(), addedList.get(), deltaID);
+    this->getKeystore()->addKey(keyID, this->mergeKeyDelta(decKey.get(), delta.get()),
+                                KEY_TYPE_SECRET);
+    this->getKeystore()->addKey(deltaID, delta, KEY_TYPE_SECRET);
+  } catch (OpenABE_ERROR &err) {
+    result = err;
+  }
+
+  return result;
+}
+
+/*!
+ * A key update for a decryption key: a key delta with the attributes of
+ * keyInput, e.g. the time period nodes of OpenABEPeriodTree, stored under
+ * updateID for the key's holder to apply with applyKeyDelta. Unlike
+ * extendDecryptionKey the authority's copy of the key is left as it is,
+ * so issuing an update every period costs one exponentiation per
+ * attribute of the update and the long-lived key doesn't grow.
+ *
+ * @param[in] mpkID     - parameter ID of the Master Public Key
+ * @param[in] mskID     - parameter ID of the Master Secret Key
+ * @param[in] keyID     - parameter ID of the decryption key to update
+ * @param[in] keyInput  - the OpenABEAttributeList of the update
+ * @param[in] updateID  - parameter ID of the key update to be created
+ * @return              - An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR
+OpenABEContextCPWaters::generateKeyUpdate(const string &mpkID, const string &mskID,
+                                          const string &keyID,
+                                          OpenABEFunctionInput *keyInput,
+                                          const string &updateID) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  OpenABEAttributeList *attrList = nullptr;
+
+  try {
+    if ((attrList = dynamic_cast<OpenABEAttributeList *>(keyInput)) == nullptr) {
+      OpenABE_LOG_AND_THROW("Decryption key input must be an Attribute List",
+                        OpenABE_ERROR_INVALID_INPUT);
+    }
+    shared_ptr<OpenABEKey> decKey = this->getKeystore()->getSecretKey(keyID);
+    if (decKey == nullptr) {
+      throw OpenABE_ERROR_INVALID_PARAMS;
+    }
+    this->getKeystore()->addKey(updateID,
+        this->makeKeyDelta(mpkID, mskID, decKey.get(), attrList, updateID),
+        KEY_TYPE_SECRET);
+  } catch (OpenABE_ERROR &err) {
+    result = err;
+  }
+
+  return result;
+}
+
+/*!
+ * The key delta for the attributes of attrList: KX_{attribute} =
+ * hash_to_G1(attribute)^t for each, with t recomputed from the MSK and
+ * the nonce of decKey (checked against its L), and the nonce that ties
+ * the delta to the key.
+ */
+
+shared_ptr<OpenABEKey>
+OpenABEContextCPWaters::makeKeyDelta(const string &mpkID, const string &mskID,
+                                     OpenABEKey *decKey, OpenABEAttributeList *attrList,
+                                     const string &deltaID) {
+  shared_ptr<OpenABEKey> MPK = this->getKeystore()->getPublicKey(mpkID);
+  shared_ptr<OpenABEKey> MSK = this->getKeystore()->getSecretKey(mskID);
+  if (MPK == nullptr || MSK == nullptr) {
+    throw OpenABE_ERROR_INVALID_PARAMS;
+  }
+  OpenABEByteString *k = MPK->getByteString("k");
+  ZP *alpha = MSK->getZP("alpha");
+  ASSERT(k != nullptr && alpha != nullptr, OpenABE_ERROR_INVALID_PARAMS);
+  OpenABEByteString *nonce = decKey->getByteString("nonce");
+  G2 *L = decKey->getG2("L");
+  if (nonce == nullptr || L == nullptr) {
+    OpenABE_LOG("Decryption key can't be extended (no key nonce)");
+    throw OpenABE_ERROR_INVALID_KEY_BODY;
+  }
+
+  // recompute t and check that it is the randomness of this key
+  ZP t = this->keyRandomness(*alpha, *nonce);
+  if (!(MPK->getG2("g2")->exp(t) == *L)) {
+    OpenABE_LOG("Decryption key was not issued under these params");
+    throw OpenABE_ERROR_INVALID_KEY_BODY;
+  }
+
+  shared_ptr<OpenABEKey> delta(new OpenABEKey(
+      this->getPairing()->getCurveID(), this->algID, deltaID));
+  delta->setComponent("input", attrList);
+  delta->setComponent("nonce", nonce);
+  shared_ptr<OpenABEPrecomputedParams> PRE = this->getPrecomputedParams(mpkID);
+  const vector<string> *attrStrings = attrList->getAttributeList();
+  PRE->prefetchHashes(this->getPairing(), *k, *attrStrings, this->getNumThreads());
+  for (auto it = attrStrings->begin(); it != attrStrings->end(); ++it) {
+    G1 kx = PRE->hashToG1Exp(this->getPairing(), *k, *it, t);
+    delta->setComponent(OpenABEMakeElementLabel("KX", OpenABEHashKey(*it)), &kx);
+  }
+  return delta;
+}
+
+/*!
+ * Holder side of extendDecryptionKey: replace the decryption key with
+ * the key with the key delta applied. A delta only applies to the key
+ * whose nonce it carries.
+ *
+ * @param[in] keyID     - parameter ID of the decryption key
+ * @param[in] deltaID   - parameter ID of the key delta
+ * @return              - An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR
+OpenABEContextCPWaters::applyKeyDelta(const string &keyID, const string &deltaID) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+
+  try {
+    shared_ptr<OpenABEKey> decKey = this->getKeystore()->getSecretKey(keyID);
+    shared_ptr<OpenABEKey> delta = this->getKeystore()->getSecretKey(deltaID);
+    if (decKey == nullptr || delta == nullptr) {
+      throw OpenABE_ERROR_INVALID_PARAMS;
+    }
+    OpenABEByteString *nonce = decKey->getByteString("nonce");
+    OpenABEByteString *deltaNonce = delta->getByteString("nonce");
+    if (nonce == nullptr || deltaNonce == nullptr || !(*nonce == *deltaNonce) ||
+        delta->getAlgorithmID() != decKey->getAlgorithmID()) {
+      OpenABE_LOG_AND_THROW("Key delta is not for this decryption key",
+                        OpenABE_ERROR_INVALID_KEY_BODY);
+    }
+    // a delta applied before adds nothing
+    OpenABEAttributeList *deltaList =
+        dynamic_cast<OpenABEAttributeList *>(delta->getComponent("input"));
+    ASSERT_NOTNULL(deltaList);
+    if (addedKeyAttributes(decKey.get(), deltaList).empty()) {
+      return OpenABE_NOERROR;
+    }
+    this->getKeystore()->addKey(keyID, this->mergeKeyDelta(decKey.get(), delta.get()),
+                                KEY_TYPE_SECRET);
+  } catch (OpenABE_ERROR &err) {
+    result = err;
+  }
+
+  return result;
+}
+
+/*!
+ * Derive a key for a subset S' of the attributes of a decryption key
+ * without the master secret. With a random t', the parent's
+ * (K, L, KX_x) becomes K' = K * (g2^a)^{t'}, L' = L * g2^{t'} and
+ * KX'_x = KX_x * H(x)^{t'} for x in S', which is distributed exactly as
+ * a key from keygen for S' (with t + t'), so it can't be linked to the
+ * parent or combined with its siblings.
+ *
+ * @param[in] mpkID       - parameter ID of the Master Public Key
+ * @param[in] keyID       - parameter ID of the parent decryption key
+ * @param[in] keyInput    - the OpenABEAttributeList of the new key
+ * @param[in] newKeyID    - parameter ID of the decryption key to be created
+ * @return                - An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR
+OpenABEContextCPWaters::delegateKey(const string &mpkID, const string &keyID,
+                                    OpenABEFunctionInput *keyInput,
+                                    const string &newKeyID) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  shared_ptr<OpenABEKey> newKey = nullptr;
+  OpenABEAttributeList *attrList = nullptr;
+
+  try {
+    if ((attrList = dynamic_cast<OpenABEAttributeList *>(keyInput)) == nullptr) {
+      OpenABE_LOG_AND_THROW("Decryption key input must be an Attribute List",
+                        OpenABE_ERROR_INVALID_INPUT);
+    }
+
+    shared_ptr<OpenABEKey> MPK = this->getKeystore()->getPublicKey(mpkID);
+    shared_ptr<OpenABEKey> decKey = this->getKeystore()->getSecretKey(keyID);
+    if (MPK == nullptr || decKey == nullptr) {
+      throw OpenABE_ERROR_INVALID_PARAMS;
+    }
+    OpenABEByteString *k = MPK->getByteString("k");
+    G2 *g2 = MPK->getG2("g2");
+    G2 *g2a = MPK->getG2("g2a");
+    if (k == nullptr || g2 == nullptr || g2a == nullptr) {
+      OpenABE_LOG_AND_THROW("Master public params predate key delegation",
+                        OpenABE_ERROR_INVALID_PARAMS);
+    }
+    G2 *K = decKey->getG2("K");
+    G2 *L = decKey->getG2("L");
+    if (K == nullptr || L == nullptr) {
+      OpenABE_LOG_AND_THROW("Not a CP-Waters decryption key", OpenABE_ERROR_INVALID_KEY_BODY);
+    }
+
+    newKey.reset(
+        new OpenABEKey(this->getPairing()->getCurveID(), this->algID, newKeyID));
+    newKey->setComponent("input", attrList);
+
+    // Select a random element t' \in ZP
+    ZP tp = this->getPairing()->randomZP(this->getRNG());
+
+    // K' = K * (g2^{a})^{t'}, L' = L * g2^{t'}
+    G2 Kp = *K * g2a->exp(tp);
+    newKey->setComponent("K", &Kp);
+    G2 Lp = *L * g2->exp(tp);
+    newKey->setComponent("L", &Lp);
+
+    // KX'_{attribute} = KX_{attribute} * hash_to_G1(attribute)^{t'}, for
+    // attributes the parent key holds only
+    shared_ptr<OpenABEPrecomputedParams> PRE = this->getPrecomputedParams(mpkID);
+    const vector<string> *attrStrings = attrList->getAttributeList();
+    for (auto it = attrStrings->begin(); it != attrStrings->end(); ++it) {
+      const string label = OpenABEMakeElementLabel("KX", OpenABEHashKey(*it));
+      G1 *kx = decKey->getG1(label);
+      if (kx == nullptr) {
+        OpenABE_LOG_AND_THROW("Delegated attribute not in the parent key: " + *it,
+                          OpenABE_ERROR_INVALID_INPUT);
+      }
+      G1 kxp = *kx * PRE->hashToG1Exp(this->getPairing(), *k, *it, tp);
+      newKey->setComponent(label, &kxp);
+    }
+
+    this->getKeystore()->addKey(newKeyID, newKey, KEY_TYPE_SECRET);
+  } catch (OpenABE_ERROR &err) {
+    result = err;
+  }
+
+  return result;
+}
+
 /*!
  * Generate and encrypt a symmetric key using the key encapsulation mode
  * of the scheme. Return the key and ciphertext.
@@ -235,6 +802,9 @@ OpenABEContextCPWaters::encryptKEM(OpenABERNG *rng, const string &mpkID,
   OpenABEByteString *k = nullptr;
 
   try {
+    // per-row temporaries are released together when encryption returns
+    OpenABEArena arena;
+    OpenABEArenaScope arenaScope(arena);
     ASSERT_NOTNULL(key);
     ASSERT_NOTNULL(ciphertext);
 
@@ -264,46 +834,97 @@ OpenABEContextCPWaters::encryptKEM(OpenABERNG *rng, const string &mpkID,
     }
     // retrieve the hash function key prefix
     k = MPK->getByteString("k");
+    // fixed-base tables for g1, g1a, g2 and A
+    shared_ptr<OpenABEPrecomputedParams> PRE = this->getPrecomputedParams(mpkID);
+    G1FixedBase *g1 = PRE->getG1("g1"), *g1a = PRE->getG1("g1a");
+    G2FixedBase *g2 = PRE->getG2("g2");
+    GTFixedBase *A = PRE->getGT("A");
+    ASSERT_NOTNULL(g1);
+    ASSERT_NOTNULL(g1a);
+    ASSERT_NOTNULL(g2);
+    ASSERT_NOTNULL(A);
+
+    // With a coupon, s, C, Cprime and the first D[i] were computed offline.
+    // A deterministic RNG has to produce all of the randomness itself.
+    unique_ptr<OpenABECPWatersCoupon> coupon;
+    if (!myRNG->isDeterministic()) {
+      coupon = this->takeCoupon(mpkID, PRE);
+    }
+    const size_t couponRows = coupon ? coupon->r.size() : 0;
 
     // Select s and compute C = e(g1, g2)^\(alpha*s)
-    ZP s = this->getPairing()->randomZP(myRNG);
-    GT C = MPK->getGT("A")->exp(s);
+    ZP s = coupon ? coupon->s : this->getPairing()->randomZP(myRNG);
+    GT C = coupon ? coupon->C : A->exp(s);
 
     // Use the Linear Secret Sharing Scheme (LSSS) to compute an enumerated list
     // of all
-    // attributes and corresponding secret shares of s.
+    // attributes and corresponding secret shares of s. The policy's compiled
+    // layout gives the rows, so only the shares are computed here.
+    shared_ptr<const OpenABELSSSCompiledPolicy> compiled =
+        OpenABELSSSCompiledPolicy::forPolicy(policy);
+    vector<ZP> shares;
     OpenABELSSS lsss(this->getPairing(), myRNG);
-    lsss.shareSecret(policy, s);
+    OpenABETraceSpan shareSpan("lsss.share");
+    lsss.shareSecret(*compiled, s, shares);
+    const size_t numRows = compiled->numRows();
+    shareSpan.setItems(numRows);
+    shareSpan.end();
 
     // Allocate the ciphertext object and add the policy and key length
     OpenABEByteString pol;
-    pol = policy->toCanonicalString();
-    ciphertext->setComponent("policy", &pol);
+    const bool hashed = policyComponentForCiphertext(policy, pol);
+    ciphertext->setComponent(hashed ? "policyHash" : "policy", &pol);
+    // the labels follow from the policy, so compact encoding can drop them
+    ciphertext->setSchema(hashed ? OpenABE_SCHEMA_CP_WATERS_HASHED_CT
+                                 : OpenABE_SCHEMA_CP_WATERS_CT);
 
     // Compute Cprime = g1^s
-    G1 Cprime = MPK->getG1("g1")->exp(s);
+    G1 Cprime = coupon ? coupon->Cprime : g1->exp(s);
     ciphertext->setComponent("Cprime", &Cprime);
 
-    // For each element of the LSSS
-    ZP ri;
-    string attr_key;
-    OpenABELSSSRowMap lsssRows = lsss.getRows();
-    for (auto it = lsssRows.begin(); it != lsssRows.end(); ++it) {
-      // Pick a random value ri.
-      ri = this->getPairing()->randomZP(myRNG);
-      // Compute D[i] = g2^{ri}
-      G2 Di = (MPK->getG2("g2")->exp(ri));
-      attr_key = OpenABEHashKey(it->first);
-      ciphertext->setComponent(OpenABEMakeElementLabel("D", attr_key), &Di);
+    // Pick a random value ri for each element of the LSSS. These are drawn
+    // serially in row order so that the ciphertext does not depend on the
+    // number of threads (the CCA re-encryption check relies on this).
+    OpenABEArenaVector<ZP> r;
+    r.reserve(numRows);
+    for (size_t i = 0; i < numRows; i++) {
+      r.push_back(i < couponRows ? coupon->r[i] : this->getPairing()->randomZP(myRNG));
+    }
+
+    // Compute D[i] = g2^{ri} and C[i] = g1a^{share_i} * hash_to_G1(attribute)^{-ri}
+    PRE->prefetchHashes(this->getPairing(), *k, compiled->rowAttributes(),
+                        this->getNumThreads());
+    OpenABETraceSpan rowSpan("rows");
+    rowSpan.setItems(numRows);
+    OpenABEArenaVector<G2> D(numRows, this->getPairing()->initG2());
+    OpenABEArenaVector<G1> Cx(numRows, this->getPairing()->initG1());
+    auto computeRow = [&](size_t i) {
+      D[i] = (i < couponRows) ? coupon->D[i] : g2->exp(r[i]);
+      Cx[i] = PRE->hashToG1Exp(this->getPairing(), *k, compiled->rowAttribute(i),
+                               -r[i], *g1a, shares[i]);
+    };
+    if (this->getNumThreads() > 1) {
+      OpenABEThreadPool::getDefault()->parallelFor(numRows, computeRow,
+                                                   this->getNumThreads());
+    } else {
+      for (size_t i = 0; i < numRows; i++) {
+        computeRow(i);
+      }
+    }
+    rowSpan.end();
 
-      // Compute C[i] = g1a^{share_i} * hash_to_G1(attribute)^{-r}
-      G1 hG1 = this->getPairing()->hashToG1(*k, it->second.label());
-      G1 Ci = MPK->getG1("g1a")->exp(it->second.element()) * (hG1.exp(-ri));
-      ciphertext->setComponent(OpenABEMakeElementLabel("C", attr_key), &Ci);
+    // policy, Cprime, a (C, D) pair per row and the encrypted payload
+    ciphertext->reserveComponents(3 + 2 * numRows);
+    for (size_t i = 0; i < numRows; i++) {
+      const string &attr_key = compiled->rowKey(i);
+      ciphertext->setComponent(OpenABEMakeElementLabel("D", attr_key), &D[i]);
+      ciphertext->setComponent(OpenABEMakeElementLabel("C", attr_key), &Cx[i]);
     }
 
     // Hash C to obtain the symmetric key result.
+    OpenABETraceSpan kdfSpan("kdf");
     key->hashToSymmetricKey(C, keyByteLen, HASH_FUNCTION_TYPE_SHA256);
+    kdfSpan.end();
     ciphertext->setHeader(this->getPairing()->getCurveID(), this->algID, myRNG);
 
   } catch (OpenABE_ERROR &err) {
@@ -313,6 +934,192 @@ OpenABEContextCPWaters::encryptKEM(OpenABERNG *rng, const string &mpkID,
   return result;
 }
 
+/*!
+ * Verify that a ciphertext is the output of encryptKEM under the given RNG
+ * (used by the CCA transform). Each component is recomputed and compared
+ * in turn, and the GT exponentiation for the key is only done once every
+ * component has matched.
+ *
+ * @param   RNG the ciphertext is expected to be derived from.
+ * @param   Parameters ID for the public master parameters.
+ * @param   Function input for the encryption.
+ * @param   Symmetric key to be returned.
+ * @param   ABE ciphertext to check.
+ * @param   Number of ciphertext components that were checked.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR
+OpenABEContextCPWaters::verifyKEM(OpenABERNG *rng, const string &mpkID,
+                              const OpenABEFunctionInput *encryptInput,
+                              uint32_t keyByteLen,
+                              const std::shared_ptr<OpenABESymKey> &key,
+                              OpenABECiphertext *ciphertext,
+                              uint32_t &numComponents) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  OpenABEByteString *k = nullptr;
+
+  try {
+    OpenABEArena arena;
+    OpenABEArenaScope arenaScope(arena);
+    ASSERT_NOTNULL(rng);
+    ASSERT_NOTNULL(key);
+    ASSERT_NOTNULL(ciphertext);
+
+    const OpenABEPolicy *policy = dynamic_cast<const OpenABEPolicy *>(encryptInput);
+    if (policy == nullptr) {
+      OpenABE_LOG_AND_THROW("Encryption input must be a Policy",
+                        OpenABE_ERROR_INVALID_INPUT);
+    }
+
+    shared_ptr<OpenABEKey> MPK = this->getKeystore()->getPublicKey(mpkID);
+    if (MPK == nullptr) {
+      throw OpenABE_ERROR_INVALID_PARAMS;
+    }
+    k = MPK->getByteString("k");
+    shared_ptr<OpenABEPrecomputedParams> PRE = this->getPrecomputedParams(mpkID);
+    G1FixedBase *g1 = PRE->getG1("g1"), *g1a = PRE->getG1("g1a");
+    G2FixedBase *g2 = PRE->getG2("g2");
+    GTFixedBase *A = PRE->getGT("A");
+    ASSERT_NOTNULL(k);
+    ASSERT_NOTNULL(g1);
+    ASSERT_NOTNULL(g1a);
+    ASSERT_NOTNULL(g2);
+    ASSERT_NOTNULL(A);
+
+    // randomness is consumed in exactly the same order as encryptKEM
+    ZP s = this->getPairing()->randomZP(rng);
+    shared_ptr<const OpenABELSSSCompiledPolicy> compiled =
+        OpenABELSSSCompiledPolicy::forPolicy(policy);
+    vector<ZP> shares;
+    OpenABELSSS lsss(this->getPairing(), rng);
+    lsss.shareSecret(*compiled, s, shares);
+    const size_t numRows = compiled->numRows();
+
+    // the ciphertext decides the form: registering its policy after it was
+    // encrypted must not make it fail
+    OpenABEByteString pol;
+    const bool hashed = ciphertext->hasComponent("policyHash");
+    if (!hashed || !findPolicyDigest(policy, pol)) {
+      pol = policyStringForCiphertext(policy);
+    }
+    G1 Cprime = g1->exp(s);
+    if (!ciphertext->matchComponent(hashed ? "policyHash" : "policy", &pol) ||
+        !ciphertext->matchComponent("Cprime", &Cprime)) {
+      throw OpenABE_ERROR_DECRYPTION_FAILED;
+    }
+
+    OpenABEArenaVector<ZP> r;
+    r.reserve(numRows);
+    for (size_t i = 0; i < numRows; i++) {
+      r.push_back(this->getPairing()->randomZP(rng));
+    }
+
+    // a mismatching row throws, which stops the remaining rows early
+    auto verifyRow = [&](size_t i) {
+      G2 Di = g2->exp(r[i]);
+      if (!ciphertext->matchComponent(OpenABEMakeElementLabel("D", compiled->rowKey(i)), &Di)) {
+        throw OpenABE_ERROR_DECRYPTION_FAILED;
+      }
+      G1 Ci = PRE->hashToG1Exp(this->getPairing(), *k, compiled->rowAttribute(i),
+                               -r[i], *g1a, shares[i]);
+      if (!ciphertext->matchComponent(OpenABEMakeElementLabel("C", compiled->rowKey(i)), &Ci)) {
+        throw OpenABE_ERROR_DECRYPTION_FAILED;
+      }
+    };
+    if (this->getNumThreads() > 1) {
+      OpenABEThreadPool::getDefault()->parallelFor(numRows, verifyRow,
+                                                   this->getNumThreads());
+    } else {
+      for (size_t i = 0; i < numRows; i++) {
+        verifyRow(i);
+      }
+    }
+    // policy, Cprime and a (C, D) pair per row
+    numComponents = 2 + 2 * numRows;
+
+    GT C = A->exp(s);
+    key->hashToSymmetricKey(C, keyByteLen, HASH_FUNCTION_TYPE_SHA256);
+  } catch (OpenABE_ERROR &err) {
+    result = err;
+  }
+
+  return result;
+}
+
+/*!
+ * Estimate encryptKEM under a policy: the operations it does, and a
+ * skeleton with the components it would set, holding the public generators
+ * in place of the group elements.
+ *
+ * @param   Parameters ID for the public master parameters.
+ * @param   Function input for the encryption.
+ * @param   Length of the symmetric key.
+ * @param   Skeleton ciphertext to fill.
+ * @param   Operation counts to be returned.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR
+OpenABEContextCPWaters::estimateKEM(const string &mpkID,
+                                const OpenABEFunctionInput *encryptInput,
+                                uint32_t keyByteLen, OpenABECiphertext *skeleton,
+                                OpenABEEncryptionCost &cost) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+
+  try {
+    ASSERT_NOTNULL(skeleton);
+    const OpenABEPolicy *policy = dynamic_cast<const OpenABEPolicy *>(encryptInput);
+    if (policy == nullptr) {
+      OpenABE_LOG_AND_THROW("Encryption input must be a Policy",
+                        OpenABE_ERROR_INVALID_INPUT);
+    }
+    shared_ptr<OpenABEKey> MPK = this->getKeystore()->getPublicKey(mpkID);
+    if (MPK == nullptr) {
+      throw OpenABE_ERROR_INVALID_PARAMS;
+    }
+    G1 *g1 = MPK->getG1("g1");
+    G2 *g2 = MPK->getG2("g2");
+    ASSERT_NOTNULL(g1);
+    ASSERT_NOTNULL(g2);
+
+    shared_ptr<const OpenABELSSSCompiledPolicy> compiled =
+        OpenABELSSSCompiledPolicy::forPolicy(policy);
+    const size_t numRows = compiled->numRows();
+
+    OpenABEByteString pol;
+    const bool hashed = policyComponentForCiphertext(policy, pol);
+    skeleton->setComponent(hashed ? "policyHash" : "policy", &pol);
+    skeleton->setSchema(hashed ? OpenABE_SCHEMA_CP_WATERS_HASHED_CT
+                               : OpenABE_SCHEMA_CP_WATERS_CT);
+    skeleton->setComponent("Cprime", g1);
+    skeleton->reserveComponents(3 + 2 * numRows);
+    for (size_t i = 0; i < numRows; i++) {
+      const string &attr_key = compiled->rowKey(i);
+      skeleton->setComponent(OpenABEMakeElementLabel("D", attr_key), g2);
+      skeleton->setComponent(OpenABEMakeElementLabel("C", attr_key), g1);
+    }
+    OpenABEByteString uid;
+    uid.fillBuffer(0, UID_LEN);
+    skeleton->setHeader(this->getPairing()->getCurveID(), this->algID, uid);
+
+    // encryption: C and Cprime, then D[i] and the multi-exponentiation
+    // C[i] per row. Decryption: a pairing per used row plus e(Cprime, K)
+    // and e(prod1, L), with KX[i]^-coeff_i per row and prod1.
+    cost.rows = (uint32_t)numRows;
+    cost.minDecryptRows = compiled->minRows();
+    cost.encryptExps = 2 + 2 * cost.rows;
+    cost.encryptHashes = cost.rows;
+    cost.decryptPairings = cost.minDecryptRows + 2;
+    cost.decryptExps = cost.minDecryptRows + 1;
+    cost.decryptHashes = 0;
+  } catch (OpenABE_ERROR &err) {
+    result = err;
+  }
+
+  return result;
+}
+
 /*!
  * Decrypt a symmetric key using the key encapsulation mode
  * of the scheme. Return the key.
@@ -329,11 +1136,6 @@ OpenABEContextCPWaters::decryptKEM(const string &mpkID, const string &keyID,
                                OpenABECiphertext *ciphertext, uint32_t keyByteLen,
                                const std::shared_ptr<OpenABESymKey> &key) {
   OpenABE_ERROR result = OpenABE_NOERROR;
-  ZP coeff;
-  G1 prod1 = this->getPairing()->initG1();
-  G1 *Kx, *Cx;
-  G2 *Dx;
-  GT prodT = this->getPairing()->initGT();
 
   try {
     ASSERT_NOTNULL(ciphertext);
@@ -341,76 +1143,279 @@ OpenABEContextCPWaters::decryptKEM(const string &mpkID, const string &keyID,
     // Load the given decryption key
     shared_ptr<OpenABEKey> decKey = this->getKeystore()->getSecretKey(keyID);
     ASSERT_NOTNULL(decKey);
-    // Obtain the attribute list from the decryption key
-    OpenABEAttributeList *attrList =
-        (OpenABEAttributeList *)decKey->getComponent("input");
 
-    // Initialize an LSSS structure. Given an attribute list and policy
-    // it will identify the necessary solution and return the appropriate
-    // components of the access/policy and secret key along with coefficients.
-    // If the policy is not satisfied, it throws an error.
-    OpenABELSSS lsss(this->getPairing(), this->getRNG());
+    GT final = this->getPairing()->initGT();
+    this->pairingProduct(keyID, decKey.get(), ciphertext, final);
+    // Compute key = hash_to_bitstring( final );
+    OpenABETraceSpan kdfSpan("kdf");
+    key->hashToSymmetricKey(final, keyByteLen, HASH_FUNCTION_TYPE_SHA256);
+    kdfSpan.end();
+  } catch (OpenABE_ERROR &err) {
+    result = err;
+  }
 
-    OpenABEByteString *policy_str = ciphertext->getByteString("policy");
-    ASSERT_NOTNULL(policy_str);
+  return result;
+}
 
-    unique_ptr<OpenABEPolicy> policy = createPolicyTree(policy_str->toString());
-    lsss.recoverCoefficients(policy.get(), attrList);
-
-    // Compute prod1  = prod_{attr_i \in S} C[attr_i]^{coefficient[attr_i]}
-    //         prodT = prod_{attr_i \in S} e(KX[attr_i]^{coefficient[attr_i]},
-    //         D[attr_i])
-    vector<G1> g1s;
-    vector<G2> g2s;
-    string attr_key, attr_deckey;
-    OpenABELSSSRowMap lsssRows = lsss.getRows();
-    for (auto it = lsssRows.begin(); it != lsssRows.end(); ++it) {
-      coeff = it->second.element();
-      attr_key = OpenABEHashKey(it->first);
-      attr_deckey = OpenABEHashKey(it->second.label());
-
-      Kx = decKey->getG1(OpenABEMakeElementLabel("KX", attr_deckey));
-      ASSERT_NOTNULL(Kx);
-      Cx = ciphertext->getG1(OpenABEMakeElementLabel("C", attr_key));
-      ASSERT_NOTNULL(Cx);
-      Dx = ciphertext->getG2(OpenABEMakeElementLabel("D", attr_key));
-      ASSERT_NOTNULL(Dx);
-
-      // DEBUG: Check elements BEFORE exponentiation
-#if defined(BP_WITH_MCL)
-      fprintf(stderr, "[DECRYPT_DEBUG] attr_key='%s'\n", attr_key.c_str());
-      fprintf(stderr, "[DECRYPT_DEBUG] Kx before exp: isZero=%d\n",
-              mclBnG1_isZero(&Kx->m_G1));
-      fprintf(stderr, "[DECRYPT_DEBUG] Cx before exp: isZero=%d\n",
-              mclBnG1_isZero(&Cx->m_G1));
-      fprintf(stderr, "[DECRYPT_DEBUG] Dx: isZero=%d\n",
-              mclBnG2_isZero(&Dx->m_G2));
-#endif
+/*!
+ * Compute e(g1,g2)^{alpha s} (the value hashed into the KEM key) from a
+ * ciphertext and a decryption key. Given a transformation key, the result
+ * is the same value raised to 1/z. Throws an error if the key does not
+ * satisfy the policy.
+ *
+ * @param   Identifier for the decryption key to be used.
+ * @param   The decryption (or transformation) key.
+ * @param   ABE ciphertext.
+ * @param   GT element to store the result.
+ */
+
+void
+OpenABEContextCPWaters::pairingProduct(const string &keyID, OpenABEKey *decKey,
+                                      OpenABECiphertext *ciphertext, GT &final) {
+  ZP coeff;
+  G1 *Kx, *Cx;
+  G2 *Dx;
+
+  OpenABEArena arena;
+  OpenABEArenaScope arenaScope(arena);
+  // Obtain the attribute list from the decryption key
+  OpenABEAttributeList *attrList =
+      (OpenABEAttributeList *)decKey->getComponent("input");
+
+  // Initialize an LSSS structure. Given an attribute list and policy
+  // it will identify the necessary solution and return the appropriate
+  // components of the access/policy and secret key along with coefficients.
+  // If the policy is not satisfied, it throws an error before any group
+  // element of the ciphertext is decoded.
+  OpenABELSSS lsss(this->getPairing(), this->getRNG());
+  ASSERT_NOTNULL(attrList);
+
+  unique_ptr<OpenABEPolicy> policy = getCiphertextPolicy(ciphertext);
+  ASSERT_NOTNULL(policy);
+  OpenABETraceSpan recoverSpan("lsss.recover");
+  if (!lsss.recoverCoefficients(keyID, policy.get(), attrList)) {
+    throw OpenABE_ERROR_POLICY_NOT_SATISFIED;
+  }
+  // element labels of each row, computed once with the policy
+  shared_ptr<const OpenABELSSSCompiledPolicy> compiled =
+      OpenABELSSSCompiledPolicy::forPolicy(policy.get());
+  recoverSpan.setItems(lsss.getRecoveredRows().size());
+  recoverSpan.end();
+
+  G1 *Cprime = ciphertext->getG1("Cprime");
+  // K and L are the same for every decryption with this key, so their
+  // Miller-loop lines are precomputed once and kept with the key
+  shared_ptr<const G2LineTable> K = decKey->getG2LineTable("K");
+  shared_ptr<const G2LineTable> L = decKey->getG2LineTable("L");
+  ASSERT_NOTNULL(Cprime);
+  ASSERT_NOTNULL(K);
+  ASSERT_NOTNULL(L);
 
-      prod1 *= (Cx->exp(coeff));
-      G1 kx_exp = Kx->exp(coeff);
+  // final = e(Cprime, K) / (prodT * e(prod1, L)) where
+  //   prod1 = prod_{attr_i \in S} C[attr_i]^{coefficient[attr_i]}
+  //   prodT = prod_{attr_i \in S} e(KX[attr_i]^{coefficient[attr_i]}, D[attr_i])
+  // Negating the exponents moves the divisors into the product, so the
+  // whole expression is a single multi-pairing with one final exponentiation:
+  //   final = e(Cprime, K) * e(prod1^-1, L) * prod_i e(KX[i]^-coeff[i], D[i])
+  // The D[i] also have line tables if the ciphertext has been prepared
+  // with precomputeG2LineTables() (one ciphertext, many keys).
+  const OpenABELSSSRowVector &lsssRows = lsss.getRecoveredRows();
+  OpenABETraceSpan rowSpan("rows");
+  rowSpan.setItems(lsssRows.size());
+  OpenABEArenaVector<G1> g1s, cxs, fixedG1s;
+  OpenABEArenaVector<G2> g2s;
+  OpenABEArenaVector<shared_ptr<const G2LineTable>> dTables;
+  OpenABEArenaVector<const G2LineTable*> fixedG2s;
+  OpenABEArenaVector<ZP> coeffs;
+  g1s.reserve(lsssRows.size());
+  g2s.reserve(lsssRows.size());
+  dTables.reserve(lsssRows.size());
+  fixedG1s.reserve(lsssRows.size() + 2);
+  fixedG2s.reserve(lsssRows.size() + 2);
+  cxs.reserve(lsssRows.size());
+  coeffs.reserve(lsssRows.size());
+  fixedG1s.push_back(*Cprime);
+  fixedG2s.push_back(K.get());
+  for (auto it = lsssRows.begin(); it != lsssRows.end(); ++it) {
+    coeff = -it->coefficient;
+    const string &attr_key = compiled->rowKey(it->index);
+    const string &attr_deckey = compiled->rowAttributeKey(it->index);
+
+    Kx = decKey->getG1(OpenABEMakeElementLabel("KX", attr_deckey));
+    ASSERT_NOTNULL(Kx);
+    Cx = ciphertext->getG1(OpenABEMakeElementLabel("C", attr_key));
+    ASSERT_NOTNULL(Cx);
+    Dx = ciphertext->getG2(OpenABEMakeElementLabel("D", attr_key));
+    ASSERT_NOTNULL(Dx);
 
-      // DEBUG: Check result AFTER exponentiation
 #if defined(BP_WITH_MCL)
-      fprintf(stderr, "[DECRYPT_DEBUG] Kx after exp: isZero=%d\n",
-              mclBnG1_isZero(&kx_exp.m_G1));
+    OpenABE_TRACE_DEBUG("decryptKEM: attr_key='%s' Kx zero=%d Cx zero=%d Dx zero=%d",
+                        attr_key.c_str(), mclBnG1_isZero(&Kx->m_G1),
+                        mclBnG1_isZero(&Cx->m_G1), mclBnG2_isZero(&Dx->m_G2));
 #endif
 
-      g1s.push_back(kx_exp);
+    cxs.push_back(*Cx);
+    coeffs.push_back(coeff);
+    shared_ptr<const G2LineTable> Dt =
+        ciphertext->findG2LineTable(OpenABEMakeElementLabel("D", attr_key));
+    if (Dt != nullptr) {
+      fixedG1s.push_back(Kx->exp(coeff));
+      fixedG2s.push_back(Dt.get());
+      dTables.push_back(Dt);
+    } else {
+      g1s.push_back(Kx->exp(coeff));
       g2s.push_back(*Dx);
     }
+  }
+  fixedG1s.push_back(G1::multiExp(cxs.data(), coeffs.data(), cxs.size()));
+  fixedG2s.push_back(L.get());
+  rowSpan.end();
+
+  OpenABETraceSpan pairingSpan("multi_pairing");
+  pairingSpan.setItems(g1s.size() + fixedG2s.size());
+  this->getPairing()->multi_pairing(final, g1s.data(), g2s.data(), g1s.size(),
+                                    fixedG1s.data(), fixedG2s.data(), fixedG2s.size());
+  pairingSpan.end();
+}
+
+/*!
+ * Split a decryption key for outsourced decryption (Green, Hohenberger and
+ * Waters '11). For a random z, the transformation key holds every element
+ * of the decryption key raised to 1/z, and the retrieval key holds z. The
+ * transformation key is not secret from the server that transforms
+ * ciphertexts, but on its own it decrypts nothing.
+ *
+ * @param   Identifier for the decryption key.
+ * @param   Identifier for the transformation key to be created.
+ * @param   Identifier for the retrieval key to be created.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR
+OpenABEContextCPWaters::generateTransformKey(const string &keyID, const string &tkID,
+                                             const string &rkID) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
 
-    this->getPairing()->multi_pairing(prodT, g1s, g2s);
-    G1 *Cprime = ciphertext->getG1("Cprime");
+  try {
+    shared_ptr<OpenABEKey> decKey = this->getKeystore()->getSecretKey(keyID);
+    if (decKey == nullptr) {
+      throw OpenABE_ERROR_INVALID_PARAMS;
+    }
+    OpenABEAttributeList *attrList =
+        dynamic_cast<OpenABEAttributeList *>(decKey->getComponent("input"));
     G2 *K = decKey->getG2("K");
     G2 *L = decKey->getG2("L");
-    ASSERT_NOTNULL(Cprime);
-    ASSERT_NOTNULL(K);
-    ASSERT_NOTNULL(L);
-    // Now compute final = e(Cprime, K) / (prodT * e(prod1, L))
-    GT final = this->getPairing()->pairing(*Cprime, *K) /
-               (prodT * this->getPairing()->pairing(prod1, *L));
-    // Compute key = hash_to_bitstring( prodT );
+    if (attrList == nullptr || K == nullptr || L == nullptr) {
+      OpenABE_LOG_AND_THROW("Not a CP-Waters decryption key", OpenABE_ERROR_INVALID_KEY_BODY);
+    }
+
+    // Select a random element z \in ZP and compute 1/z
+    ZP z = this->getPairing()->randomZP(this->getRNG());
+    ZP zInv = z;
+    zInv.multInverse();
+
+    shared_ptr<OpenABEKey> TK(
+        new OpenABEKey(this->getPairing()->getCurveID(), this->algID, tkID));
+    TK->setComponent("input", attrList);
+    // K' = K^{1/z}, L' = L^{1/z}
+    G2 Kt = K->exp(zInv);
+    TK->setComponent("K", &Kt);
+    G2 Lt = L->exp(zInv);
+    TK->setComponent("L", &Lt);
+    // KX'_{attribute} = KX_{attribute}^{1/z}
+    const vector<string> *attrStrings = attrList->getAttributeList();
+    for (auto it = attrStrings->begin(); it != attrStrings->end(); ++it) {
+      const string label = OpenABEMakeElementLabel("KX", OpenABEHashKey(*it));
+      G1 *kx = decKey->getG1(label);
+      ASSERT_NOTNULL(kx);
+      G1 kxt = kx->exp(zInv);
+      TK->setComponent(label, &kxt);
+    }
+
+    shared_ptr<OpenABEKey> RK(
+        new OpenABEKey(this->getPairing()->getCurveID(), this->algID, rkID));
+    RK->setComponent("input", attrList);
+    RK->setComponent("z", &z);
+
+    this->getKeystore()->addKey(tkID, TK, KEY_TYPE_SECRET);
+    this->getKeystore()->addKey(rkID, RK, KEY_TYPE_SECRET);
+  } catch (OpenABE_ERROR &err) {
+    result = err;
+  }
+
+  return result;
+}
+
+/*!
+ * Server side of outsourced decryption: do all of the pairings of
+ * decryptKEM with a transformation key. 'transformed' receives the
+ * policy and T = e(g1,g2)^{alpha s / z}.
+ *
+ * @param   Parameters ID for the public master parameters.
+ * @param   Identifier for the transformation key.
+ * @param   ABE ciphertext.
+ * @param   Transformed ciphertext to be returned.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR
+OpenABEContextCPWaters::transformKEM(const string &mpkID, const string &tkID,
+                                     OpenABECiphertext *ciphertext,
+                                     OpenABECiphertext *transformed) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+
+  try {
+    ASSERT_NOTNULL(ciphertext);
+    ASSERT_NOTNULL(transformed);
+    shared_ptr<OpenABEKey> TK = this->getKeystore()->getSecretKey(tkID);
+    ASSERT_NOTNULL(TK);
+    const char *polLabel = ciphertext->hasComponent("policyHash") ? "policyHash" : "policy";
+    OpenABEByteString *policy_str = ciphertext->getByteString(polLabel);
+    ASSERT_NOTNULL(policy_str);
+
+    GT T = this->getPairing()->initGT();
+    this->pairingProduct(tkID, TK.get(), ciphertext, T);
+    transformed->setComponent(polLabel, policy_str);
+    transformed->setComponent("T", &T);
+  } catch (OpenABE_ERROR &err) {
+    result = err;
+  }
+
+  return result;
+}
+
+/*!
+ * Client side of outsourced decryption: recover the KEM key from a
+ * transformed ciphertext with one exponentiation, key = H(T^z).
+ *
+ * @param   Identifier for the retrieval key.
+ * @param   Transformed ciphertext.
+ * @param   Symmetric key to be returned.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR
+OpenABEContextCPWaters::finishTransformedKEM(const string &rkID,
+                                             OpenABECiphertext *transformed,
+                                             uint32_t keyByteLen,
+                                             const std::shared_ptr<OpenABESymKey> &key) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+
+  try {
+    ASSERT_NOTNULL(transformed);
+    ASSERT_NOTNULL(key);
+    shared_ptr<OpenABEKey> RK = this->getKeystore()->getSecretKey(rkID);
+    ASSERT_NOTNULL(RK);
+    ZP *z = RK->getZP("z");
+    GT *T = transformed->getGT("T");
+    if (z == nullptr || T == nullptr) {
+      throw OpenABE_ERROR_INVALID_INPUT;
+    }
+    // the identity is the one T whose T^z the server knows
+    if (T->isInfinity()) {
+      throw OpenABE_ERROR_DECRYPTION_FAILED;
+    }
+    GT final = T->exp(*z);
     key->hashToSymmetricKey(final, keyByteLen, HASH_FUNCTION_TYPE_SHA256);
   } catch (OpenABE_ERROR &err) {
     result = err;
@@ -0,0 +1,562 @@
+/// 
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+/// 
+/// This file is part of Zeutro's OpenABE.
+/// 
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+/// 
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+/// 
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+/// 
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+///
+/// \file   zcontextcpwatersfd.cpp
+///
+/// \brief  Implementation of the fast-decryption variant of the Waters '11
+///         CP-ABE scheme.
+///
+/// \source http://eprint.iacr.org/2008/290.pdf (Appendix A -- Large Universe
+///         Construction), with one randomizer r for every row instead of
+///         one per row. Hashing each attribute together with its use index
+///         keeps the hashes of a ciphertext distinct, which a shared r needs.
+///
+
+#define __ZCONTEXTCPWATERSFD_CPP__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+#include <openabe/openabe.h>
+#include <openabe/utils/zcryptoutils.h>
+
+using namespace std;
+
+/********************************************************************************
+ * Implementation of the OpenABEContextCPWatersFD class
+ ********************************************************************************/
+namespace oabe {
+
+// H(x | j): the hash of attribute x for its j-th row in a policy
+static string attributeUseLabel(const string &attr, uint32_t use) {
+  return attr + "|" + to_string(use);
+}
+
+/*!
+ * The use index of every row of a policy: 1 for the first row labeled
+ * with an attribute, 2 for the next one and so on. Throws if an attribute
+ * labels more rows than the keys hold a KX for.
+ */
+static void rowUses(const OpenABELSSSCompiledPolicy &compiled, vector<uint32_t> &uses) {
+  map<string, uint32_t> seen;
+  uses.resize(compiled.numRows());
+  for (size_t i = 0; i < compiled.numRows(); i++) {
+    uint32_t use = ++seen[compiled.rowAttribute(i)];
+    if (use > OpenABE_CP_FD_ATTRIBUTE_USES) {
+      OpenABE_LOG("Attribute '" + compiled.rowAttribute(i) + "' is used more than " +
+                  to_string(OpenABE_CP_FD_ATTRIBUTE_USES) + " times in the policy");
+      throw OpenABE_ERROR_POLICY_TOO_COMPLEX;
+    }
+    uses[i] = use;
+  }
+}
+
+/*!
+ * Constructor for the OpenABEContextCPWatersFD class.
+ *
+ */
+OpenABEContextCPWatersFD::OpenABEContextCPWatersFD(unique_ptr<OpenABERNG> rng)
+    : OpenABEContextABE() {
+  this->debug = false;
+  // KEM context will take ownership of the given RNG
+  this->m_RNG_ = std::move(rng);
+  this->algID = OpenABE_SCHEME_CP_WATERS_FD;
+  // generators that are raised to fresh exponents on every encryption
+  this->fixedBaseG1_ = {"g1", "g1a"};
+  this->fixedBaseG2_ = {"g2"};
+  this->fixedBaseGT_ = {"A"};
+}
+
+/*!
+ * Destructor for the OpenABEContextCPWatersFD class.
+ *
+ */
+OpenABEContextCPWatersFD::~OpenABEContextCPWatersFD() {}
+
+/*!
+ * Generate the master public and secret parameters for the scheme:
+ * g1, g2, g1^a, A = e(g1, g2)^alpha and the hash key k are public; alpha
+ * and g2^a are secret (nothing here delegates keys, so unlike CP-Waters
+ * g2^a is not published).
+ *
+ * @param[in] pairingParams     - Identifier for the pairing parameters.
+ * @param[in] mpkID             - Identifier to use for the new Master Public Key
+ * @param[in] mskID             - Identifier to use for the new Master Secret Key
+ * @return                      - An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR
+OpenABEContextCPWatersFD::generateParams(const string pairingParams,
+                                     const string &mpkID, const string &mskID) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  shared_ptr<OpenABEKey> MPK = nullptr, MSK = nullptr;
+  OpenABERNG *myRNG = this->getRNG();
+  OpenABEByteString k;
+
+  try {
+    // Instantiate a OpenABE pairing object with the given parameters
+    this->initializeCurve(pairingParams);
+
+    // Make sure these parameter IDs are valid and not already in use
+    if (this->getKeystore()->validateNewParamsID(mpkID) == false ||
+        this->getKeystore()->validateNewParamsID(mskID) == false) {
+      throw OpenABE_ERROR_INVALID_PARAMS_ID;
+    }
+
+    MPK.reset(new OpenABEKey(this->getPairing()->getCurveID(), this->algID, mpkID));
+    MSK.reset(new OpenABEKey(this->getPairing()->getCurveID(), this->algID, mskID));
+
+    // Select random generators g1 \in G1, g2 \in G2 and (a, \alpha) \in ZP
+    G1 g1 = this->getPairing()->randomG1(myRNG);
+    G2 g2 = this->getPairing()->randomG2(myRNG);
+    ZP alpha = this->getPairing()->randomZP(myRNG);
+    ZP a = this->getPairing()->randomZP(myRNG);
+    // key prefix for hash function
+    myRNG->getRandomBytes(&k, HASH_LEN);
+
+    G1 g1a = g1.exp(a);
+    G2 g2a = g2.exp(a);
+    GT A = this->getPairing()->pairing(g1, g2).exp(alpha);
+
+    MPK->setComponent("g1", &g1);
+    MPK->setComponent("g2", &g2);
+    MPK->setComponent("g1a", &g1a);
+    MPK->setComponent("A", &A);
+    MPK->setComponent("k", &k);
+
+    MSK->setComponent("alpha", &alpha);
+    MSK->setComponent("g2a", &g2a);
+
+    // Add (MPK, MSK) to the keystore
+    this->getKeystore()->addKey(mpkID, MPK, KEY_TYPE_PUBLIC);
+    this->getKeystore()->addKey(mskID, MSK, KEY_TYPE_SECRET);
+
+  } catch (OpenABE_ERROR &err) {
+    result = err;
+  }
+
+  return result;
+}
+
+/*!
+ * Generate a decryption key for an attribute list. For a random t:
+ *   K = g2^alpha (g2^a)^t, L = g2^t
+ *   KX[x, j] = H(x | j)^t  for each attribute x and j = 1 .. uses
+ * which is OpenABE_CP_FD_ATTRIBUTE_USES times the KX of a CP-Waters key.
+ *
+ * @param[in] mpkID     - parameter ID of the Master Public Key
+ * @param[in] mskID     - parameter ID of the Master Secret Key
+ * @param[in] keyID     - parameter ID of the decryption key to be created
+ * @param[in] keyInput  - A OpenABEAttributeList structure for the key to be constructed
+ * @return              - An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR
+OpenABEContextCPWatersFD::generateDecryptionKey(
+    OpenABEFunctionInput *keyInput, const string &keyID, const string &mpkID,
+    const string &mskID, const string &gpkID = "", const string &GID = "") {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  shared_ptr<OpenABEKey> decKey = nullptr;
+  OpenABEAttributeList *attrList = nullptr;
+  OpenABERNG *myRNG = this->getRNG();
+  OpenABEByteString *k = nullptr;
+
+  try {
+    // Ensure that the given input is a OpenABEAttributeList
+    if ((attrList = dynamic_cast<OpenABEAttributeList *>(keyInput)) == nullptr) {
+      OpenABE_LOG_AND_THROW("Decryption key input must be an Attribute List",
+                        OpenABE_ERROR_INVALID_INPUT);
+    }
+
+    // Load the master secret and public key
+    shared_ptr<OpenABEKey> MPK = this->getKeystore()->getPublicKey(mpkID);
+    shared_ptr<OpenABEKey> MSK = this->getKeystore()->getSecretKey(mskID);
+    if (MPK == nullptr || MSK == nullptr) {
+      throw OpenABE_ERROR_INVALID_PARAMS;
+    }
+    k = MPK->getByteString("k");
+    G2 *g2 = MPK->getG2("g2"), *g2a = MSK->getG2("g2a");
+    ZP *alpha = MSK->getZP("alpha");
+    if (k == nullptr || g2 == nullptr || g2a == nullptr || alpha == nullptr) {
+      throw OpenABE_ERROR_INVALID_PARAMS;
+    }
+    shared_ptr<OpenABEPrecomputedParams> PRE = this->getPrecomputedParams(mpkID);
+
+    decKey.reset(
+        new OpenABEKey(this->getPairing()->getCurveID(), this->algID, keyID));
+    decKey->setComponent("input", attrList);
+
+    ZP t = this->getPairing()->randomZP(myRNG);
+    G2 K = g2->exp(*alpha) * g2a->exp(t);
+    G2 L = g2->exp(t);
+    decKey->setComponent("K", &K);
+    decKey->setComponent("L", &L);
+
+    const vector<string> *attrStrings = attrList->getAttributeList();
+    vector<string> labels;
+    labels.reserve(attrStrings->size() * OpenABE_CP_FD_ATTRIBUTE_USES);
+    for (auto it = attrStrings->begin(); it != attrStrings->end(); ++it) {
+      for (uint32_t j = 1; j <= OpenABE_CP_FD_ATTRIBUTE_USES; j++) {
+        labels.push_back(attributeUseLabel(*it, j));
+      }
+    }
+    PRE->prefetchHashes(this->getPairing(), *k, labels, this->getNumThreads());
+    decKey->reserveComponents(3 + labels.size());
+    for (auto &label : labels) {
+      G1 kx = PRE->hashToG1Exp(this->getPairing(), *k, label, t);
+      decKey->setComponent(OpenABEMakeElementLabel("KX", OpenABEHashKey(label)), &kx);
+    }
+
+    // Add the decryption key to the keystore
+    this->getKeystore()->addKey(keyID, decKey, KEY_TYPE_SECRET);
+
+  } catch (OpenABE_ERROR &err) {
+    result = err;
+  }
+
+  return result;
+}
+
+/*!
+ * Generate and encrypt a symmetric key using the key encapsulation mode
+ * of the scheme. With shares lambda_i of a random s and one random r:
+ *   Cprime = g1^s, D = g2^r
+ *   C[i] = (g1^a)^{lambda_i} H(attr_i | j_i)^{-r}
+ * where j_i counts the rows labeled attr_i up to row i, and the key is
+ * hashed from A^s.
+ *
+ * @param   Parameters ID for the public master parameters.
+ * @param   Function input for the encryption.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR
+OpenABEContextCPWatersFD::encryptKEM(OpenABERNG *rng, const string &mpkID,
+                                 const OpenABEFunctionInput *encryptInput,
+                                 uint32_t keyByteLen,
+                                 const std::shared_ptr<OpenABESymKey> &key,
+                                 OpenABECiphertext *ciphertext) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  OpenABERNG *myRNG = this->getRNG();
+  OpenABEByteString *k = nullptr;
+
+  try {
+    // per-row temporaries are released together when encryption returns
+    OpenABEArena arena;
+    OpenABEArenaScope arenaScope(arena);
+    ASSERT_NOTNULL(key);
+    ASSERT_NOTNULL(ciphertext);
+
+    if (rng != nullptr) {
+      // use the passed in RNG
+      myRNG = rng;
+    }
+    // Assert that the RNG has been set
+    ASSERT_NOTNULL(myRNG);
+
+    // Ensure that the given input is a OpenABEPolicy
+    const OpenABEPolicy *policy = dynamic_cast<const OpenABEPolicy *>(encryptInput);
+    if (policy == nullptr) {
+      OpenABE_LOG_AND_THROW("Encryption input must be a Policy",
+                        OpenABE_ERROR_INVALID_INPUT);
+    }
+
+    // Load the master public key
+    shared_ptr<OpenABEKey> MPK = this->getKeystore()->getPublicKey(mpkID);
+    if (MPK == nullptr) {
+      throw OpenABE_ERROR_INVALID_PARAMS;
+    }
+    k = MPK->getByteString("k");
+    ASSERT_NOTNULL(k);
+    shared_ptr<OpenABEPrecomputedParams> PRE = this->getPrecomputedParams(mpkID);
+    G1FixedBase *g1 = PRE->getG1("g1"), *g1a = PRE->getG1("g1a");
+    G2FixedBase *g2 = PRE->getG2("g2");
+    GTFixedBase *A = PRE->getGT("A");
+    ASSERT_NOTNULL(g1);
+    ASSERT_NOTNULL(g1a);
+    ASSERT_NOTNULL(g2);
+    ASSERT_NOTNULL(A);
+
+    // a policy with too many rows for one attribute fails before any
+    // randomness is drawn
+    shared_ptr<const OpenABELSSSCompiledPolicy> compiled =
+        OpenABELSSSCompiledPolicy::forPolicy(policy);
+    vector<uint32_t> uses;
+    rowUses(*compiled, uses);
+    const size_t numRows = compiled->numRows();
+    vector<string> labels;
+    labels.reserve(numRows);
+    for (size_t i = 0; i < numRows; i++) {
+      labels.push_back(attributeUseLabel(compiled->rowAttribute(i), uses[i]));
+    }
+
+    // s, the shares and then r are drawn serially, so that the CCA
+    // re-encryption check gets the same ciphertext whatever the number
+    // of threads
+    ZP s = this->getPairing()->randomZP(myRNG);
+    GT C = A->exp(s);
+    vector<ZP> shares;
+    OpenABELSSS lsss(this->getPairing(), myRNG);
+    OpenABETraceSpan shareSpan("lsss.share");
+    lsss.shareSecret(*compiled, s, shares);
+    shareSpan.setItems(numRows);
+    shareSpan.end();
+    ZP r = this->getPairing()->randomZP(myRNG);
+    ZP negR = -r;
+
+    OpenABEByteString pol;
+    const bool hashed = policyComponentForCiphertext(policy, pol);
+    ciphertext->setComponent(hashed ? "policyHash" : "policy", &pol);
+    // the labels follow from the policy, so compact encoding can drop them
+    ciphertext->setSchema(hashed ? OpenABE_SCHEMA_CP_WATERS_FD_HASHED_CT
+                                 : OpenABE_SCHEMA_CP_WATERS_FD_CT);
+
+    G1 Cprime = g1->exp(s);
+    G2 D = g2->exp(r);
+    ciphertext->setComponent("Cprime", &Cprime);
+    ciphertext->setComponent("D", &D);
+
+    PRE->prefetchHashes(this->getPairing(), *k, labels, this->getNumThreads());
+    OpenABETraceSpan rowSpan("rows");
+    rowSpan.setItems(numRows);
+    OpenABEArenaVector<G1> Cx(numRows, this->getPairing()->initG1());
+    auto computeRow = [&](size_t i) {
+      Cx[i] = PRE->hashToG1Exp(this->getPairing(), *k, labels[i], negR, *g1a, shares[i]);
+    };
+    if (this->getNumThreads() > 1) {
+      OpenABEThreadPool::getDefault()->parallelFor(numRows, computeRow,
+                                                   this->getNumThreads());
+    } else {
+      for (size_t i = 0; i < numRows; i++) {
+        computeRow(i);
+      }
+    }
+    rowSpan.end();
+
+    // policy, Cprime, D, a C per row and the encrypted payload
+    ciphertext->reserveComponents(4 + numRows);
+    for (size_t i = 0; i < numRows; i++) {
+      ciphertext->setComponent(OpenABEMakeElementLabel("C", compiled->rowKey(i)), &Cx[i]);
+    }
+
+    // Hash C to obtain the symmetric key result.
+    OpenABETraceSpan kdfSpan("kdf");
+    key->hashToSymmetricKey(C, keyByteLen, HASH_FUNCTION_TYPE_SHA256);
+    kdfSpan.end();
+    ciphertext->setHeader(this->getPairing()->getCurveID(), this->algID, myRNG);
+
+  } catch (OpenABE_ERROR &err) {
+    result = err;
+  }
+
+  return result;
+}
+
+/*!
+ * Estimate encryptKEM under a policy: the operations it does, and a
+ * skeleton with the components it would set, holding a public generator
+ * in place of the group elements.
+ *
+ * @param   Parameters ID for the public master parameters.
+ * @param   Function input for the encryption.
+ * @param   Length of the symmetric key.
+ * @param   Skeleton ciphertext to fill.
+ * @param   Operation counts to be returned.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR
+OpenABEContextCPWatersFD::estimateKEM(const string &mpkID,
+                                  const OpenABEFunctionInput *encryptInput,
+                                  uint32_t keyByteLen, OpenABECiphertext *skeleton,
+                                  OpenABEEncryptionCost &cost) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+
+  try {
+    ASSERT_NOTNULL(skeleton);
+    const OpenABEPolicy *policy = dynamic_cast<const OpenABEPolicy *>(encryptInput);
+    if (policy == nullptr) {
+      OpenABE_LOG_AND_THROW("Encryption input must be a Policy",
+                        OpenABE_ERROR_INVALID_INPUT);
+    }
+    shared_ptr<OpenABEKey> MPK = this->getKeystore()->getPublicKey(mpkID);
+    if (MPK == nullptr) {
+      throw OpenABE_ERROR_INVALID_PARAMS;
+    }
+    G1 *g1 = MPK->getG1("g1");
+    G2 *g2 = MPK->getG2("g2");
+    ASSERT_NOTNULL(g1);
+    ASSERT_NOTNULL(g2);
+
+    // the same policies are refused as by encryptKEM
+    shared_ptr<const OpenABELSSSCompiledPolicy> compiled =
+        OpenABELSSSCompiledPolicy::forPolicy(policy);
+    vector<uint32_t> uses;
+    rowUses(*compiled, uses);
+    const size_t numRows = compiled->numRows();
+
+    OpenABEByteString pol;
+    const bool hashed = policyComponentForCiphertext(policy, pol);
+    skeleton->setComponent(hashed ? "policyHash" : "policy", &pol);
+    skeleton->setSchema(hashed ? OpenABE_SCHEMA_CP_WATERS_FD_HASHED_CT
+                               : OpenABE_SCHEMA_CP_WATERS_FD_CT);
+    skeleton->setComponent("Cprime", g1);
+    skeleton->setComponent("D", g2);
+    skeleton->reserveComponents(4 + numRows);
+    for (size_t i = 0; i < numRows; i++) {
+      skeleton->setComponent(OpenABEMakeElementLabel("C", compiled->rowKey(i)), g1);
+    }
+    OpenABEByteString uid;
+    uid.fillBuffer(0, UID_LEN);
+    skeleton->setHeader(this->getPairing()->getCurveID(), this->algID, uid);
+
+    // encryption: C, Cprime and D, then a hash and a multi-exponentiation
+    // per row. Decryption: three pairings and two multi-exponentiations for
+    // any number of rows.
+    cost.rows = (uint32_t)numRows;
+    cost.minDecryptRows = compiled->minRows();
+    cost.encryptExps = 3 + cost.rows;
+    cost.encryptHashes = cost.rows;
+    cost.decryptPairings = 3;
+    cost.decryptExps = 2;
+    cost.decryptHashes = 0;
+  } catch (OpenABE_ERROR &err) {
+    result = err;
+  }
+
+  return result;
+}
+
+/*!
+ * Decrypt a symmetric key using the key encapsulation mode of the scheme.
+ * With the coefficients w_i of the rows the key's attributes satisfy,
+ *   A^s = e(Cprime, K) * e(prod C[i]^{-w_i}, L) * e(prod KX[i, j_i]^{-w_i}, D)
+ * which is one multi-pairing of three pairs for any policy.
+ *
+ * @param   Parameters ID for the public master parameters.
+ * @param   Identifier for the decryption key to be used.
+ * @param   ABE ciphertext.
+ * @param   Symmetric key to be returned.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR
+OpenABEContextCPWatersFD::decryptKEM(const string &mpkID, const string &keyID,
+                                 OpenABECiphertext *ciphertext, uint32_t keyByteLen,
+                                 const std::shared_ptr<OpenABESymKey> &key) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+
+  try {
+    ASSERT_NOTNULL(ciphertext);
+    ASSERT_NOTNULL(key);
+    shared_ptr<OpenABEKey> decKey = this->getKeystore()->getSecretKey(keyID);
+    ASSERT_NOTNULL(decKey);
+    OpenABEAttributeList *attrList =
+        dynamic_cast<OpenABEAttributeList *>(decKey->getComponent("input"));
+    ASSERT_NOTNULL(attrList);
+
+    unique_ptr<OpenABEPolicy> policy = getCiphertextPolicy(ciphertext);
+    ASSERT_NOTNULL(policy);
+
+    // throws if the attributes do not satisfy the policy
+    OpenABELSSS lsss(this->getPairing(), this->getRNG());
+    OpenABETraceSpan recoverSpan("lsss.recover");
+    if (!lsss.recoverCoefficients(keyID, policy.get(), attrList)) {
+      throw OpenABE_ERROR_POLICY_NOT_SATISFIED;
+    }
+    shared_ptr<const OpenABELSSSCompiledPolicy> compiled =
+        OpenABELSSSCompiledPolicy::forPolicy(policy.get());
+    const OpenABELSSSRowVector &lsssRows = lsss.getRecoveredRows();
+    recoverSpan.setItems(lsssRows.size());
+    recoverSpan.end();
+    if (lsssRows.empty()) {
+      throw OpenABE_ERROR_DECRYPTION_FAILED;
+    }
+    vector<uint32_t> uses;
+    rowUses(*compiled, uses);
+
+    G1 *Cprime = ciphertext->getG1("Cprime");
+    G2 *D = ciphertext->getG2("D");
+    shared_ptr<const G2LineTable> K = decKey->getG2LineTable("K");
+    shared_ptr<const G2LineTable> L = decKey->getG2LineTable("L");
+    ASSERT_NOTNULL(Cprime);
+    ASSERT_NOTNULL(D);
+    ASSERT_NOTNULL(K);
+    ASSERT_NOTNULL(L);
+
+    OpenABETraceSpan rowSpan("rows");
+    rowSpan.setItems(lsssRows.size());
+    vector<G1> cxs, kxs;
+    vector<ZP> negCoeffs;
+    cxs.reserve(lsssRows.size());
+    kxs.reserve(lsssRows.size());
+    negCoeffs.reserve(lsssRows.size());
+    for (auto it = lsssRows.begin(); it != lsssRows.end(); ++it) {
+      const string &attr_key = compiled->rowKey(it->index);
+      const string label = attributeUseLabel(compiled->rowAttribute(it->index),
+                                             uses[it->index]);
+      G1 *Cx = ciphertext->getG1(OpenABEMakeElementLabel("C", attr_key));
+      G1 *Kx = decKey->getG1(OpenABEMakeElementLabel("KX", OpenABEHashKey(label)));
+      ASSERT_NOTNULL(Cx);
+      ASSERT_NOTNULL(Kx);
+      cxs.push_back(*Cx);
+      kxs.push_back(*Kx);
+      negCoeffs.push_back(-it->coefficient);
+    }
+    G1 prodKX = G1::multiExp(kxs, negCoeffs);
+    vector<G1> fixedG1s = {*Cprime, G1::multiExp(cxs, negCoeffs)};
+    const G2LineTable *fixedG2s[2] = {K.get(), L.get()};
+    rowSpan.end();
+
+    // D also has a line table if the ciphertext has been prepared with
+    // precomputeG2LineTables() (one ciphertext, many keys)
+    GT final = this->getPairing()->initGT();
+    OpenABETraceSpan pairingSpan("multi_pairing");
+    pairingSpan.setItems(3);
+    shared_ptr<const G2LineTable> Dt = ciphertext->findG2LineTable("D");
+    if (Dt != nullptr) {
+      fixedG1s.push_back(prodKX);
+      const G2LineTable *allG2s[3] = {K.get(), L.get(), Dt.get()};
+      this->getPairing()->multi_pairing(final, nullptr, nullptr, 0,
+                                        fixedG1s.data(), allG2s, 3);
+    } else {
+      this->getPairing()->multi_pairing(final, &prodKX, D, 1,
+                                        fixedG1s.data(), fixedG2s, 2);
+    }
+    pairingSpan.end();
+    OpenABETraceSpan kdfSpan("kdf");
+    key->hashToSymmetricKey(final, keyByteLen, HASH_FUNCTION_TYPE_SHA256);
+    kdfSpan.end();
+  } catch (OpenABE_ERROR &err) {
+    result = err;
+  }
+
+  return result;
+}
+
+}
@@ -39,6 +39,7 @@
 #include <stdlib.h>
 #include <iostream>
 #include <fstream>
+#include <set>
 #include <string>
 
 #include <openabe/openabe.h>
@@ -60,6 +61,10 @@ OpenABEContextKPGPSW::OpenABEContextKPGPSW(unique_ptr<OpenABERNG> rng) : OpenABE
   this->debug = false;
   this->m_RNG_ = std::move(rng);
   this->algID = OpenABE_SCHEME_KP_GPSW;
+  // generators that are raised to fresh exponents in keygen and encryption
+  this->fixedBaseG1_ = {"g1"};
+  this->fixedBaseG2_ = {"g2"};
+  this->fixedBaseGT_ = {"Y"};
 }
 
 /*!
@@ -167,6 +172,12 @@ OpenABEContextKPGPSW::generateDecryptionKey(
     }
     // retrieve the hash function key prefix
     k = MPK->getByteString("k");
+    // fixed-base tables for g1 and g2
+    shared_ptr<OpenABEPrecomputedParams> PRE = this->getPrecomputedParams(mpkID);
+    G1FixedBase *g1 = PRE->getG1("g1");
+    G2FixedBase *g2 = PRE->getG2("g2");
+    ASSERT_NOTNULL(g1);
+    ASSERT_NOTNULL(g2);
 
     // Create a new OpenABEKey object for the decryption key
     decKey.reset(
@@ -179,23 +190,48 @@ OpenABEContextKPGPSW::generateDecryptionKey(
     ZP y = *(MSK->getZP("y"));
 
     OpenABELSSS lsss(this->getPairing(), myRNG);
-    // Share the secret y over the policy tree
-    lsss.shareSecret(policy, y);
+    // Share the secret y over the policy tree; shares[i] belongs to row i
+    // of the compiled policy, which also carries the row's element labels
+    shared_ptr<const OpenABELSSSCompiledPolicy> compiled =
+        OpenABELSSSCompiledPolicy::forPolicy(policy);
+    vector<ZP> shares;
+    lsss.shareSecret(*compiled, y, shares);
+
+    // Pick a random value ri for each row of the policy. These are drawn
+    // serially in row order so that the key does not depend on the
+    // number of threads.
+    const size_t numRows = compiled->numRows();
+    OpenABEArenaVector<ZP> r;
+    r.reserve(numRows);
+    for (size_t i = 0; i < numRows; i++) {
+      r.push_back(this->getPairing()->randomZP(myRNG));
+    }
 
-    // For each element/share of the policy tree
-    string attr_deckey;
-    OpenABELSSSRowMap lsssRows = lsss.getRows();
-    for (auto it = lsssRows.begin(); it != lsssRows.end(); ++it) {
-      // Pick a random value ri in ZP
-      ZP ri = this->getPairing()->randomZP(myRNG);
-      // Di = g ^ \share(attr) * H(attr)^ri
-      G1 Di = MPK->getG1("g1")->exp(it->second.element()) *
-              this->getPairing()->hashToG1(*k, it->second.label()).exp(ri);
-      // di = g ^ ri
-      G2 di = MPK->getG2("g2")->exp(ri);
-      attr_deckey = OpenABEHashKey(it->first);
-      decKey->setComponent(OpenABEMakeElementLabel("D", attr_deckey), &Di);
-      decKey->setComponent(OpenABEMakeElementLabel("d", attr_deckey), &di);
+    // Compute D[i] = g1^{share_i} * H(attr)^{ri} and d[i] = g2^{ri}
+    PRE->prefetchHashes(this->getPairing(), *k, compiled->rowAttributes(),
+                        this->getNumThreads());
+    OpenABEArenaVector<G1> D(numRows, this->getPairing()->initG1());
+    OpenABEArenaVector<G2> d(numRows, this->getPairing()->initG2());
+    auto computeRow = [&](size_t i) {
+      D[i] = PRE->hashToG1Exp(this->getPairing(), *k, compiled->rowAttribute(i),
+                              r[i], *g1, shares[i]);
+      d[i] = g2->exp(r[i]);
+    };
+    if (this->getNumThreads() > 1) {
+      OpenABEThreadPool::getDefault()->parallelFor(numRows, computeRow,
+                                                   this->getNumThreads());
+    } else {
+      for (size_t i = 0; i < numRows; i++) {
+        computeRow(i);
+      }
+    }
+
+    // input plus a (D, d) pair per row
+    decKey->reserveComponents(1 + 2 * numRows);
+    for (size_t i = 0; i < numRows; i++) {
+      const string &attr_deckey = compiled->rowKey(i);
+      decKey->setComponent(OpenABEMakeElementLabel("D", attr_deckey), &D[i]);
+      decKey->setComponent(OpenABEMakeElementLabel("d", attr_deckey), &d[i]);
     }
 
     // Add the decryption key to the keystore
@@ -255,25 +291,39 @@ OpenABEContextKPGPSW::encryptKEM(OpenABERNG *rng, const string &mpkID,
     ZP t = this->getPairing()->randomZP(myRNG);
     // Compute Y^t => e(g1, g2)^(y*t). Note: this is hashed into a key later due
     // to KEM
-    GT Cpr1 = MPK->getGT("Y")->exp(t);
+    shared_ptr<OpenABEPrecomputedParams> PRE = this->getPrecomputedParams(mpkID);
+    GTFixedBase *Y = PRE->getGT("Y");
+    G2FixedBase *g2 = PRE->getG2("g2");
+    ASSERT_NOTNULL(Y);
+    ASSERT_NOTNULL(g2);
+    GT Cpr1 = Y->exp(t);
     // Compute g2 ^ t
-    G2 Cpr2 = MPK->getG2("g2")->exp(t);
+    G2 Cpr2 = g2->exp(t);
     ciphertext->setComponent("Cpr2", &Cpr2);
+    // the labels follow from the attribute list, so compact encoding can
+    // drop them
+    ciphertext->setSchema(OpenABE_SCHEMA_KP_GPSW_CT);
 
     string attr, attr_key;
     const vector<string> *attrStrings = attrList->getAttributeList();
+    PRE->prefetchHashes(this->getPairing(), *k, *attrStrings, this->getNumThreads());
+    OpenABETraceSpan rowSpan("rows");
+    rowSpan.setItems(attrStrings->size());
     for (auto it = attrStrings->begin(); it != attrStrings->end(); ++it) {
       // For each attribute in input, compute H(attribute) ^ t
       attr = *it;
-      G1 hG1 = this->getPairing()->hashToG1(*k, attr).exp(t);
+      G1 hG1 = PRE->hashToG1Exp(this->getPairing(), *k, attr, t);
       attr_key = OpenABEHashKey(attr);
       ciphertext->setComponent(OpenABEMakeElementLabel("C", attr_key), &hG1);
     }
+    rowSpan.end();
     // Set the attribute list in the policy
     ciphertext->setComponent("attributes", attrList);
 
     // Hash Cpr1 to obtain the encapsulation key.
+    OpenABETraceSpan kdfSpan("kdf");
     key->hashToSymmetricKey(Cpr1, keyByteLen, HASH_FUNCTION_TYPE_SHA256);
+    kdfSpan.end();
     // Set the ciphertext header
     ciphertext->setHeader(this->getPairing()->getCurveID(), this->algID, myRNG);
 
@@ -284,6 +334,150 @@ OpenABEContextKPGPSW::encryptKEM(OpenABERNG *rng, const string &mpkID,
   return result;
 }
 
+/*!
+ * Verify that a ciphertext is the output of encryptKEM under the given RNG
+ * (used by the CCA transform). Each component is recomputed and compared
+ * in turn, and the GT exponentiation for the key is only done once every
+ * component has matched.
+ *
+ * @param   RNG the ciphertext is expected to be derived from.
+ * @param   Parameters ID for the public master parameters.
+ * @param   Function input for the encryption: OpenABEAttributeList
+ * @param   Symmetric key to be returned.
+ * @param   ABE ciphertext to check.
+ * @param   Number of ciphertext components that were checked.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR
+OpenABEContextKPGPSW::verifyKEM(OpenABERNG *rng, const string &mpkID,
+                            const OpenABEFunctionInput *encryptInput,
+                            uint32_t keyByteLen,
+                            const std::shared_ptr<OpenABESymKey> &key,
+                            OpenABECiphertext *ciphertext,
+                            uint32_t &numComponents) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  shared_ptr<OpenABEKey> MPK = nullptr;
+  OpenABEByteString *k = nullptr;
+
+  try {
+    ASSERT_NOTNULL(rng);
+    ASSERT_NOTNULL(key);
+    ASSERT_NOTNULL(ciphertext);
+
+    const OpenABEAttributeList *attrList =
+        dynamic_cast<const OpenABEAttributeList *>(encryptInput);
+    if (attrList == nullptr) {
+      OpenABE_LOG_AND_THROW("Encryption input must be a Policy",
+                        OpenABE_ERROR_INVALID_INPUT);
+    }
+    if ((MPK = this->getKeystore()->getPublicKey(mpkID)) == nullptr) {
+      OpenABE_LOG_AND_THROW("Could not get master public params",
+                        OpenABE_ERROR_INVALID_PARAMS);
+    }
+    k = MPK->getByteString("k");
+    shared_ptr<OpenABEPrecomputedParams> PRE = this->getPrecomputedParams(mpkID);
+    GTFixedBase *Y = PRE->getGT("Y");
+    G2FixedBase *g2 = PRE->getG2("g2");
+    ASSERT_NOTNULL(k);
+    ASSERT_NOTNULL(Y);
+    ASSERT_NOTNULL(g2);
+
+    ZP t = this->getPairing()->randomZP(rng);
+    G2 Cpr2 = g2->exp(t);
+    if (!ciphertext->matchComponent("attributes", attrList) ||
+        !ciphertext->matchComponent("Cpr2", &Cpr2)) {
+      throw OpenABE_ERROR_DECRYPTION_FAILED;
+    }
+
+    set<string> labels;
+    const vector<string> *attrStrings = attrList->getAttributeList();
+    for (auto it = attrStrings->begin(); it != attrStrings->end(); ++it) {
+      G1 hG1 = PRE->hashToG1Exp(this->getPairing(), *k, *it, t);
+      string label = OpenABEMakeElementLabel("C", OpenABEHashKey(*it));
+      if (!ciphertext->matchComponent(label, &hG1)) {
+        throw OpenABE_ERROR_DECRYPTION_FAILED;
+      }
+      labels.insert(label);
+    }
+    // attributes, Cpr2 and one component per distinct attribute
+    numComponents = 2 + labels.size();
+
+    GT Cpr1 = Y->exp(t);
+    key->hashToSymmetricKey(Cpr1, keyByteLen, HASH_FUNCTION_TYPE_SHA256);
+  } catch (OpenABE_ERROR &err) {
+    result = err;
+  }
+
+  return result;
+}
+
+/*!
+ * Estimate encryptKEM under an attribute list: the operations it does, and
+ * a skeleton with the components it would set, holding the public
+ * generators in place of the group elements.
+ *
+ * @param   Parameters ID for the public master parameters.
+ * @param   Function input for the encryption.
+ * @param   Length of the symmetric key.
+ * @param   Skeleton ciphertext to fill.
+ * @param   Operation counts to be returned.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR
+OpenABEContextKPGPSW::estimateKEM(const string &mpkID,
+                              const OpenABEFunctionInput *encryptInput,
+                              uint32_t keyByteLen, OpenABECiphertext *skeleton,
+                              OpenABEEncryptionCost &cost) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  shared_ptr<OpenABEKey> MPK = nullptr;
+
+  try {
+    ASSERT_NOTNULL(skeleton);
+    const OpenABEAttributeList *attrList =
+        dynamic_cast<const OpenABEAttributeList *>(encryptInput);
+    if (attrList == nullptr) {
+      OpenABE_LOG_AND_THROW("Encryption input must be an Attribute List",
+                        OpenABE_ERROR_INVALID_INPUT);
+    }
+    if ((MPK = this->getKeystore()->getPublicKey(mpkID)) == nullptr) {
+      OpenABE_LOG_AND_THROW("Could not get master public params",
+                        OpenABE_ERROR_INVALID_PARAMS);
+    }
+    G1 *g1 = MPK->getG1("g1");
+    G2 *g2 = MPK->getG2("g2");
+    ASSERT_NOTNULL(g1);
+    ASSERT_NOTNULL(g2);
+
+    skeleton->setComponent("Cpr2", g2);
+    skeleton->setSchema(OpenABE_SCHEMA_KP_GPSW_CT);
+    const vector<string> *attrStrings = attrList->getAttributeList();
+    for (auto it = attrStrings->begin(); it != attrStrings->end(); ++it) {
+      skeleton->setComponent(OpenABEMakeElementLabel("C", OpenABEHashKey(*it)), g1);
+    }
+    skeleton->setComponent("attributes", attrList);
+    OpenABEByteString uid;
+    uid.fillBuffer(0, UID_LEN);
+    skeleton->setHeader(this->getPairing()->getCurveID(), this->algID, uid);
+
+    // encryption: Cpr1, Cpr2 and H(attribute)^t per attribute. Decryption:
+    // a pairing per used row plus e(prod1, Cpr2), with C_i^-coeff_i per row
+    // and prod1.
+    cost.rows = (uint32_t)attrStrings->size();
+    cost.minDecryptRows = cost.rows;
+    cost.encryptExps = 2 + cost.rows;
+    cost.encryptHashes = cost.rows;
+    cost.decryptPairings = cost.minDecryptRows + 1;
+    cost.decryptExps = cost.minDecryptRows + 1;
+    cost.decryptHashes = 0;
+  } catch (OpenABE_ERROR &err) {
+    result = err;
+  }
+
+  return result;
+}
+
 /*!
  * Decrypt a symmetric key using the key encapsulation mode
  * of the scheme. Return the key.
@@ -303,6 +497,9 @@ OpenABEContextKPGPSW::decryptKEM(const string &mpkID, const string &keyID,
   OpenABERNG *myRNG = this->getRNG();
 
   try {
+    // per-attribute temporaries are released together when decryption returns
+    OpenABEArena arena;
+    OpenABEArenaScope arenaScope(arena);
     ASSERT_NOTNULL(ciphertext);
     ASSERT_NOTNULL(key);
     // Load the given decryption key
@@ -322,42 +519,84 @@ OpenABEContextKPGPSW::decryptKEM(const string &mpkID, const string &keyID,
     // Initialize an LSSS structure. Given an attribute list and policy
     // it will identify the necessary solution and return the appropriate
     // components of the access/policy and secret key along with coefficients.
-    // If the policy is not satisfied, it throws an error.
+    // If the policy is not satisfied, it throws an error before any group
+    // element of the ciphertext is decoded.
     OpenABELSSS lsss(this->getPairing(), myRNG);
-    lsss.recoverCoefficients(policy.get(), attrList);
+    OpenABETraceSpan recoverSpan("lsss.recover");
+    ASSERT_NOTNULL(policy);
+    if (!lsss.recoverCoefficients(keyID, policy.get(), attrList)) {
+      throw OpenABE_ERROR_POLICY_NOT_SATISFIED;
+    }
+    // element labels of each row, computed once with the policy
+    shared_ptr<const OpenABELSSSCompiledPolicy> compiled =
+        OpenABELSSSCompiledPolicy::forPolicy(policy.get());
+    recoverSpan.setItems(lsss.getRecoveredRows().size());
+    recoverSpan.end();
 
     ZP coeff;
-    G1 prod1 = this->getPairing()->initG1();
     G1 *Ci, *Di;
-    G2 *di;
-    GT prodT = this->getPairing()->initGT();
-    vector<G1> g1s;
-    vector<G2> g2s;
+    shared_ptr<const G2LineTable> di;
+    G2 *Cpr2 = ciphertext->getG2("Cpr2");
+    ASSERT_NOTNULL(Cpr2);
+    // A = e(prod1, Cpr2) / prod_{i \in S} e(C_i^coeff_i, d_i), computed as a
+    // single multi-pairing by negating the coefficients of the divisors:
+    //   A = e(prod1, Cpr2) * prod_{i \in S} e(C_i^-coeff_i, d_i)
+    // The d_i are fixed per key, so their Miller-loop lines are precomputed
+    // once and kept with the key; Cpr2 has a table too if the ciphertext has
+    // been prepared with precomputeG2LineTables() (one ciphertext, many keys).
     // Get coefficients for satisfiable attributes
-    OpenABELSSSRowMap lsssRows = lsss.getRows();
-    string attr_key, attr_deckey;
+    const OpenABELSSSRowVector &lsssRows = lsss.getRecoveredRows();
+    OpenABETraceSpan rowSpan("rows");
+    rowSpan.setItems(lsssRows.size());
+    OpenABEArenaVector<G1> g1s, dis;
+    OpenABEArenaVector<shared_ptr<const G2LineTable>> dTables;
+    OpenABEArenaVector<const G2LineTable*> g2s;
+    OpenABEArenaVector<ZP> coeffs;
+    g1s.reserve(lsssRows.size() + 1);
+    dTables.reserve(lsssRows.size() + 1);
+    g2s.reserve(lsssRows.size() + 1);
+    dis.reserve(lsssRows.size());
+    coeffs.reserve(lsssRows.size());
     for (auto it = lsssRows.begin(); it != lsssRows.end(); ++it) {
-      coeff = it->second.element();
-      attr_key = OpenABEHashKey(it->second.label());
+      coeff = it->coefficient;
+      const string &attr_key = compiled->rowAttributeKey(it->index);
       Ci = ciphertext->getG1(OpenABEMakeElementLabel("C", attr_key));
-      attr_deckey = OpenABEHashKey(it->first);
+      const string &attr_deckey = compiled->rowKey(it->index);
 
-      di = decKey->getG2(OpenABEMakeElementLabel("d", attr_deckey));
+      di = decKey->getG2LineTable(OpenABEMakeElementLabel("d", attr_deckey));
       // prod1 => prod{i \in S} D_i ^ coeff_i
       Di = decKey->getG1(OpenABEMakeElementLabel("D", attr_deckey));
-      prod1 *= Di->exp(coeff);
-      // prodT => prod{i \in S} e(d_i, C_i)
-      g1s.push_back(Ci->exp(coeff));
-      g2s.push_back(*di);
+      ASSERT_NOTNULL(Ci);
+      ASSERT_NOTNULL(di);
+      ASSERT_NOTNULL(Di);
+      dis.push_back(*Di);
+      coeffs.push_back(coeff);
+      // e(C_i, d_i)^-coeff_i
+      g1s.push_back(Ci->exp(-coeff));
+      g2s.push_back(di.get());
+      dTables.push_back(di);
     }
-    // prodT => prod{i \in S} e(d_i, C_i)
-    this->getPairing()->multi_pairing(prodT, g1s, g2s);
-    G2 *Cpr2 = ciphertext->getG2("Cpr2");
-    ASSERT_NOTNULL(Cpr2);
-    GT A = this->getPairing()->pairing(prod1, *Cpr2) / prodT;
+    G1 prod1 = G1::multiExp(dis.data(), coeffs.data(), dis.size());
+    rowSpan.end();
+    GT A = this->getPairing()->initGT();
+    OpenABETraceSpan pairingSpan("multi_pairing");
+    pairingSpan.setItems(g1s.size() + 1);
+    shared_ptr<const G2LineTable> Cpr2t = ciphertext->findG2LineTable("Cpr2");
+    if (Cpr2t != nullptr) {
+      g1s.push_back(prod1);
+      g2s.push_back(Cpr2t.get());
+      this->getPairing()->multi_pairing(A, nullptr, nullptr, 0,
+                                        g1s.data(), g2s.data(), g1s.size());
+    } else {
+      this->getPairing()->multi_pairing(A, &prod1, Cpr2, 1,
+                                        g1s.data(), g2s.data(), g1s.size());
+    }
+    pairingSpan.end();
 
     // Compute key = hash_to_bitstring( A );
+    OpenABETraceSpan kdfSpan("kdf");
     key->hashToSymmetricKey(A, keyByteLen, HASH_FUNCTION_TYPE_SHA256);
+    kdfSpan.end();
 
   } catch (OpenABE_ERROR &err) {
     result = err;
@@ -170,6 +170,15 @@ string getSchemeString(OpenABE_SCHEME scheme_type)
 /// Benchmark routines for CP-ABE Waters '11 and KP-ABE GPSW ///
 ///////////////////////////////////////////////////////////////////////////////////
 
+// adds <op>_p50, <op>_p95 and <op>_p99 for the samples collected so far
+void recordPercentiles(map<string,string>& data, const string& op, const Benchmark& bench)
+{
+  BenchmarkSummary summary = bench.summarize();
+  data[op + "_p50"] = std::to_string(summary.p50);
+  data[op + "_p95"] = std::to_string(summary.p95);
+  data[op + "_p99"] = std::to_string(summary.p99);
+}
+
 void benchmarkABE_CPA_KEM(map<string,string>& data, OpenABE_SCHEME scheme_type, ofstream & outfile0,
 		                  ofstream & outfile1, ofstream & outfile2, int attributeCount,
 		                  int iterationCount, ListStr & encryptResults, ListStr & keygenResults,
@@ -245,6 +254,7 @@ void benchmarkABE_CPA_KEM(map<string,string>& data, OpenABE_SCHEME scheme_type,
   }
   cout << "Keygen avg: " << benchK.getAverage() << " ms" << endl;
   data["keygen"] = std::to_string(benchK.getAverage());
+  recordPercentiles(data, "keygen", benchK);
   s1 << attributeCount << " " << benchK.getAverage() << endl;
   outfile1 << s1.str();
   keygenResults[attributeCount] = benchK.getRawResultString();
@@ -262,6 +272,7 @@ void benchmarkABE_CPA_KEM(map<string,string>& data, OpenABE_SCHEME scheme_type,
   // get encryption measurements
   cout << "Encrypt avg: " << benchE.getAverage() << " ms" << endl;
   data["encrypt"] = std::to_string(benchE.getAverage());
+  recordPercentiles(data, "encrypt", benchE);
   s0 << attributeCount << " " << benchE.getAverage() << endl;
   outfile0 << s0.str();
   encryptResults[attributeCount] = benchE.getRawResultString();
@@ -278,6 +289,7 @@ void benchmarkABE_CPA_KEM(map<string,string>& data, OpenABE_SCHEME scheme_type,
   // get decryption measurements
   cout << "Decrypt avg: " << benchD.getAverage() << " ms" << endl;
   data["decrypt"] = std::to_string(benchD.getAverage());
+  recordPercentiles(data, "decrypt", benchD);
   s2 << attributeCount << " " << benchD.getAverage() << endl;
   outfile2 << s2.str();
   decryptResults[attributeCount] = benchD.getRawResultString();
@@ -375,6 +387,7 @@ void benchmarkABE_CCA_KEM(map<string,string>& data, OpenABE_SCHEME scheme_type,
   }
   if (verbose) cout << "Keygen avg: " << benchK.getAverage() << " ms" << endl;
   data["keygen"] = std::to_string(benchK.getAverage());
+  recordPercentiles(data, "keygen", benchK);
   s1 << attributeCount << " " << benchK.getAverage() << endl;
   outfile1 << s1.str();
   keygenResults[attributeCount] = benchK.getRawResultString();
@@ -392,6 +405,7 @@ void benchmarkABE_CCA_KEM(map<string,string>& data, OpenABE_SCHEME scheme_type,
   // get encryption measurements
   if (verbose) cout << "Encrypt avg: " << benchE.getAverage() << " ms" << endl;
   data["encrypt"] = std::to_string(benchE.getAverage());
+  recordPercentiles(data, "encrypt", benchE);
   s0 << attributeCount << " " << benchE.getAverage() << endl;
   outfile0 << s0.str();
   encryptResults[attributeCount] = benchE.getRawResultString();
@@ -408,6 +422,7 @@ void benchmarkABE_CCA_KEM(map<string,string>& data, OpenABE_SCHEME scheme_type,
   // get decryption measurements
   if (verbose) cout << "Decrypt avg: " << benchD.getAverage() << " ms" << endl;
   data["decrypt"] = std::to_string(benchD.getAverage());
+  recordPercentiles(data, "decrypt", benchD);
   s2 << attributeCount << " " << benchD.getAverage() << endl;
   outfile2 << s2.str();
   decryptResults[attributeCount] = benchD.getRawResultString();
@@ -528,7 +543,16 @@ int main(int argc, const char *argv[])
   cout << "attributes: " << attributeCount << endl;
   cout << "msmt type: " << fixOrRange << endl;
 
+  // cold start: library init plus the first pairing group on the default curve
+  Benchmark benchInit;
+  benchInit.start();
   InitializeOpenABE();
+  {
+    OpenABEPairing pairing(DEFAULT_BP_PARAM);
+  }
+  benchInit.stop();
+  data["cold_start"] = std::to_string(benchInit.computeTimeInMilliseconds());
+  cout << "cold start: " << data["cold_start"] << " ms" << endl;
 
   // get the scheme type
   OpenABE_SCHEME scheme_type;
@@ -0,0 +1,380 @@
+///
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+///
+/// This file is part of Zeutro's OpenABE.
+///
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+///
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+///
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+///
+/// \file   bench_policy.cpp
+///
+/// \brief  Scaling benchmark for CP-ABE and KP-ABE over policy shape,
+///         policy size and the number of satisfied leaves, for the CPA and
+///         CCA KEMs. Reports latency percentiles and ciphertext/key sizes.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <algorithm>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <openabe/openabe.h>
+#include <openabe/utils/zallochooks.h>
+#include <openabe/utils/zbenchmark.h>
+
+using namespace std;
+using namespace oabe;
+
+OpenABE_DEFINE_ALLOCATION_HOOKS
+
+#define DEFAULT_REPETITIONS   10
+#define DEFAULT_WARMUP        2
+// how far above the policy threshold numeric attributes are set
+#define RANGE_THRESHOLD       10
+#define RANGE_VALUE           1000
+
+/// Policy shapes
+///  and:   A0 and A1 and ... (every leaf needed)
+///  or:    A0 or A1 or ...   (any one leaf suffices)
+///  dnf:   (A0 and A1) or (A2 and A3) or ... (two leaves per clause)
+///  range: R0 > 10 and R1 > 10 and ... (numeric comparisons)
+static const char *SHAPES[] = { "and", "or", "dnf", "range" };
+
+struct ScalingResult {
+  string scheme, security, shape;
+  int leaves, satisfied;
+  BenchmarkSummary keygen, encrypt, decrypt;
+  size_t ciphertextBytes, keyBytes;
+};
+
+static string leafName(const string& shape, int i)
+{
+  return (shape == "range" ? "R" : "A") + std::to_string(i);
+}
+
+static string policyFor(const string& shape, int leaves)
+{
+  stringstream ss;
+  for (int i = 0; i < leaves; i++) {
+    if (shape == "dnf") {
+      if (i % 2 == 1) {
+        continue;
+      }
+      if (i > 0) {
+        ss << " or ";
+      }
+      if (i + 1 < leaves) {
+        ss << "(" << leafName(shape, i) << " and " << leafName(shape, i + 1) << ")";
+      } else {
+        ss << leafName(shape, i);
+      }
+      continue;
+    }
+    if (i > 0) {
+      ss << (shape == "or" ? " or " : " and ");
+    }
+    ss << leafName(shape, i);
+    if (shape == "range") {
+      ss << " > " << RANGE_THRESHOLD;
+    }
+  }
+  return ss.str();
+}
+
+// attributes holding the first 'satisfied' leaves of the policy
+static string attributesFor(const string& shape, int satisfied)
+{
+  stringstream ss;
+  for (int i = 0; i < satisfied; i++) {
+    if (i > 0) {
+      ss << "|";
+    }
+    ss << leafName(shape, i);
+    if (shape == "range") {
+      ss << " = " << RANGE_VALUE;
+    }
+  }
+  return ss.str();
+}
+
+// the satisfied-leaf counts worth measuring for a shape
+static vector<int> satisfiedCounts(const string& shape, int leaves,
+                                   const vector<double>& fractions)
+{
+  vector<int> counts;
+  if (shape == "and" || shape == "range") {
+    counts.push_back(leaves);
+    return counts;
+  }
+  for (double f : fractions) {
+    int s = (int) ceil(f * leaves);
+    if (shape == "dnf") {
+      // whole clauses only
+      s = min(leaves, max(2, s + (s % 2)));
+    }
+    s = max(1, min(leaves, s));
+    if (find(counts.begin(), counts.end(), s) == counts.end()) {
+      counts.push_back(s);
+    }
+  }
+  return counts;
+}
+
+static bool runCase(OpenABE_SCHEME schemeType, bool cca, const string& shape,
+                    int leaves, int satisfied, int warmup, int reps,
+                    ScalingResult& result)
+{
+  unique_ptr<OpenABERNG> rng(new OpenABERNG), rng2(new OpenABERNG);
+  unique_ptr<OpenABEContextABE> context;
+  if (cca) {
+    unique_ptr<OpenABEContextSchemeCPA> scheme = OpenABE_createContextABESchemeCPA(schemeType);
+    if (!scheme) {
+      return false;
+    }
+    context.reset(new OpenABEContextGenericCCA(std::move(scheme)));
+  } else {
+    context.reset(OpenABE_createContextABE(&rng, schemeType));
+  }
+  // the CCA context hides, rather than overrides, the key management calls
+  OpenABEContextCCA *ccaContext = cca ? static_cast<OpenABEContextCCA*>(context.get()) : nullptr;
+  if (context == nullptr ||
+      context->generateParams(DEFAULT_BP_PARAM, "MPK", "MSK") != OpenABE_NOERROR) {
+    return false;
+  }
+
+  unique_ptr<OpenABEFunctionInput> keyInput, encInput;
+  const string policy = policyFor(shape, leaves), attrs = attributesFor(shape, satisfied);
+  if (schemeType == OpenABE_SCHEME_CP_WATERS) {
+    keyInput = createAttributeList(attrs);
+    encInput = createPolicyTree(policy);
+  } else {
+    keyInput = createPolicyTree(policy);
+    encInput = createAttributeList(attrs);
+  }
+  if (!keyInput || !encInput) {
+    return false;
+  }
+
+  OpenABE_ERROR rc = OpenABE_NOERROR;
+  int keyCounter = 0;
+  result.keygen = runTimedBenchmark([&]() {
+    string id = "bench" + std::to_string(keyCounter++);
+    rc = context->generateDecryptionKey(keyInput.get(), id, "MPK", "MSK");
+    if (cca) {
+      ccaContext->deleteKey(id);
+    } else {
+      context->getKeystore()->deleteKey(id);
+    }
+  }, warmup, reps);
+  if (rc != OpenABE_NOERROR ||
+      context->generateDecryptionKey(keyInput.get(), "decKey", "MPK", "MSK") != OpenABE_NOERROR) {
+    return false;
+  }
+
+  shared_ptr<OpenABESymKey> symkey, newkey;
+  unique_ptr<OpenABECiphertext> ciphertext;
+  result.encrypt = runTimedBenchmark([&]() {
+    symkey.reset(new OpenABESymKey);
+    ciphertext.reset(new OpenABECiphertext);
+    rc = context->encryptKEM(cca ? rng2.get() : nullptr, "MPK", encInput.get(),
+                             DEFAULT_SYM_KEY_BYTES, symkey, ciphertext.get());
+  }, warmup, reps);
+  if (rc != OpenABE_NOERROR) {
+    return false;
+  }
+
+  result.decrypt = runTimedBenchmark([&]() {
+    newkey.reset(new OpenABESymKey);
+    rc = context->decryptKEM("MPK", "decKey", ciphertext.get(), DEFAULT_SYM_KEY_BYTES, newkey);
+  }, warmup, reps);
+  if (rc != OpenABE_NOERROR || newkey->toString() != symkey->toString()) {
+    return false;
+  }
+
+  OpenABEByteString ctBytes, keyBytes;
+  ciphertext->exportToBytes(ctBytes);
+  if (cca) {
+    ccaContext->exportKey("decKey", keyBytes);
+  } else {
+    context->getKeystore()->exportKeyToBytes("decKey", keyBytes);
+  }
+  result.ciphertextBytes = ctBytes.size();
+  result.keyBytes = keyBytes.size();
+  return true;
+}
+
+static vector<double> parseList(const string& s)
+{
+  vector<double> values;
+  stringstream ss(s);
+  string item;
+  while (getline(ss, item, ',')) {
+    if (!item.empty()) {
+      values.push_back(atof(item.c_str()));
+    }
+  }
+  return values;
+}
+
+static void usage(const char *prog)
+{
+  cout << "OpenABE policy scaling benchmark, v" << (OpenABE_LIBRARY_VERSION / 100.) << endl;
+  cout << "Usage " << prog << ": [ -s CP|KP|all ] [ -k cpa|cca|all ] [ -p shape,... ] [ -l leaves,... ]" << endl;
+  cout << "\t[ -f fraction,... ] [ -n repetitions ] [ -w warmup ] [ --allocs ] [ --csv file ]" << endl;
+  cout << "\tshape: and, or, dnf, range (default: all)" << endl;
+  cout << "\tleaves: policy sizes (default: 1,2,5,10,20,50,100,200,500)" << endl;
+  cout << "\tfraction: share of leaves the key/ciphertext attributes satisfy, for or/dnf (default: 1)" << endl;
+  cout << "\t--allocs: also report heap allocations and peak heap bytes per operation" << endl;
+  cout << "\tThreshold (k-of-n) gates are not swept: the policy grammar has no syntax for them." << endl;
+}
+
+int main(int argc, const char *argv[])
+{
+  string schemes = "all", securities = "all", csvFile;
+  vector<string> shapes(SHAPES, SHAPES + sizeof(SHAPES) / sizeof(SHAPES[0]));
+  vector<double> leafCounts = {1, 2, 5, 10, 20, 50, 100, 200, 500}, fractions = {1.0};
+  int reps = DEFAULT_REPETITIONS, warmup = DEFAULT_WARMUP;
+  bool allocs = false;
+
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "-s" && i + 1 < argc) {
+      schemes = argv[++i];
+    } else if (arg == "-k" && i + 1 < argc) {
+      securities = argv[++i];
+    } else if (arg == "-p" && i + 1 < argc) {
+      shapes.clear();
+      stringstream ss(argv[++i]);
+      string shape;
+      while (getline(ss, shape, ',')) {
+        shapes.push_back(shape);
+      }
+    } else if (arg == "-l" && i + 1 < argc) {
+      leafCounts = parseList(argv[++i]);
+    } else if (arg == "-f" && i + 1 < argc) {
+      fractions = parseList(argv[++i]);
+    } else if (arg == "-n" && i + 1 < argc) {
+      reps = atoi(argv[++i]);
+    } else if (arg == "-w" && i + 1 < argc) {
+      warmup = atoi(argv[++i]);
+    } else if (arg == "--allocs") {
+      allocs = true;
+    } else if (arg == "--csv" && i + 1 < argc) {
+      csvFile = argv[++i];
+    } else {
+      usage(argv[0]);
+      return -1;
+    }
+  }
+
+  vector<OpenABE_SCHEME> schemeTypes;
+  if (schemes == "CP" || schemes == "all") {
+    schemeTypes.push_back(OpenABE_SCHEME_CP_WATERS);
+  }
+  if (schemes == "KP" || schemes == "all") {
+    schemeTypes.push_back(OpenABE_SCHEME_KP_GPSW);
+  }
+  vector<bool> ccaModes;
+  if (securities == "cpa" || securities == "all") {
+    ccaModes.push_back(false);
+  }
+  if (securities == "cca" || securities == "all") {
+    ccaModes.push_back(true);
+  }
+
+  InitializeOpenABE();
+  OpenABE_setMetricsEnabled(allocs);
+
+  vector<ScalingResult> results;
+  cout << left << setw(8) << "scheme" << setw(5) << "kem" << setw(7) << "shape"
+       << right << setw(7) << "leaves" << setw(7) << "sat" << setw(12) << "keygen"
+       << setw(12) << "encrypt" << setw(12) << "decrypt" << setw(10) << "ct (B)"
+       << setw(10) << "key (B)";
+  if (allocs) {
+    cout << setw(10) << "enc allocs" << setw(10) << "dec allocs" << setw(12) << "dec peak (B)";
+  }
+  cout << "   (p50 ms)" << endl;
+  for (OpenABE_SCHEME schemeType : schemeTypes) {
+    for (bool cca : ccaModes) {
+      for (const string& shape : shapes) {
+        for (double l : leafCounts) {
+          int leaves = (int) l;
+          if (leaves < 1) {
+            continue;
+          }
+          for (int satisfied : satisfiedCounts(shape, leaves, fractions)) {
+            ScalingResult r;
+            r.scheme = (schemeType == OpenABE_SCHEME_CP_WATERS) ? "CP" : "KP";
+            r.security = cca ? "CCA" : "CPA";
+            r.shape = shape;
+            r.leaves = leaves;
+            r.satisfied = satisfied;
+            if (!runCase(schemeType, cca, shape, leaves, satisfied, warmup, reps, r)) {
+              cout << "FAILED: " << r.scheme << " " << r.security << " " << shape
+                   << " leaves=" << leaves << " satisfied=" << satisfied << endl;
+              continue;
+            }
+            results.push_back(r);
+            cout << left << setw(8) << r.scheme << setw(5) << r.security << setw(7) << shape
+                 << right << setw(7) << leaves << setw(7) << satisfied << fixed << setprecision(3)
+                 << setw(12) << r.keygen.p50 << setw(12) << r.encrypt.p50
+                 << setw(12) << r.decrypt.p50 << setw(10) << r.ciphertextBytes
+                 << setw(10) << r.keyBytes;
+            if (allocs) {
+              cout << setprecision(0) << setw(10) << r.encrypt.allocations
+                   << setw(10) << r.decrypt.allocations << setw(12) << r.decrypt.peakBytes;
+            }
+            cout << endl;
+          }
+        }
+      }
+    }
+  }
+
+  ShutdownOpenABE();
+
+  if (!csvFile.empty()) {
+    ofstream out(csvFile.c_str());
+    out << "scheme,security,shape,leaves,satisfied,keygen_p50,keygen_p95,encrypt_p50,"
+           "encrypt_p95,decrypt_p50,decrypt_p95,ciphertext_bytes,key_bytes,keygen_allocs,"
+           "encrypt_allocs,decrypt_allocs,keygen_peak_bytes,encrypt_peak_bytes,"
+           "decrypt_peak_bytes" << endl;
+    out << fixed << setprecision(4);
+    for (const ScalingResult& r : results) {
+      out << r.scheme << "," << r.security << "," << r.shape << "," << r.leaves << ","
+          << r.satisfied << "," << r.keygen.p50 << "," << r.keygen.p95 << ","
+          << r.encrypt.p50 << "," << r.encrypt.p95 << "," << r.decrypt.p50 << ","
+          << r.decrypt.p95 << "," << r.ciphertextBytes << "," << r.keyBytes << ","
+          << r.keygen.allocations << "," << r.encrypt.allocations << ","
+          << r.decrypt.allocations << "," << r.keygen.peakBytes << ","
+          << r.encrypt.peakBytes << "," << r.decrypt.peakBytes << endl;
+    }
+  }
+  return 0;
+}
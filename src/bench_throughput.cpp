@@ -0,0 +1,340 @@
+///
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+///
+/// This file is part of Zeutro's OpenABE.
+///
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+///
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+///
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+///
+/// \file   bench_throughput.cpp
+///
+/// \brief  Multithreaded load generator: N threads run keygen, encrypt or
+///         decrypt against one shared OpenABECryptoContext or against one
+///         context per thread, and the ops/sec scaling is reported.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <openabe/openabe.h>
+
+using namespace std;
+using namespace oabe;
+
+#define DEFAULT_DURATION_MS   2000
+#define DEFAULT_ATTRIBUTES    5
+
+static const char *OPERATIONS[] = { "keygen", "encrypt", "decrypt" };
+
+struct ThroughputResult {
+  string scheme, mode, operation;
+  size_t threads, ops;
+  double seconds, opsPerSec, speedup, efficiency, cpuUtilization;
+};
+
+static double processCpuSeconds()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+/// Material every context needs, generated once up front
+struct Workload {
+  string scheme, mpk, msk, keyInput, encInput, ciphertext, userKey;
+};
+
+static string attributeList(int n)
+{
+  stringstream ss;
+  for (int i = 0; i < n; i++) {
+    ss << (i > 0 ? "|" : "") << "Attr" << i;
+  }
+  return ss.str();
+}
+
+static string andPolicy(int n)
+{
+  stringstream ss;
+  for (int i = 0; i < n; i++) {
+    ss << (i > 0 ? " and " : "") << "Attr" << i;
+  }
+  return ss.str();
+}
+
+static void prepareWorkload(const string& scheme, int attributes, Workload& w)
+{
+  w.scheme = scheme;
+  if (scheme == "CP-ABE") {
+    w.keyInput = attributeList(attributes);
+    w.encInput = andPolicy(attributes);
+  } else {
+    w.keyInput = andPolicy(attributes);
+    w.encInput = attributeList(attributes);
+  }
+  OpenABECryptoContext context(scheme);
+  context.generateParams();
+  context.exportPublicParams(w.mpk);
+  context.exportSecretParams(w.msk);
+  context.keygen(w.keyInput, "user");
+  context.exportUserKey("user", w.userKey);
+  context.encrypt(w.encInput, "benchmark plaintext", w.ciphertext);
+}
+
+static unique_ptr<OpenABECryptoContext> loadContext(const Workload& w)
+{
+  unique_ptr<OpenABECryptoContext> context(new OpenABECryptoContext(w.scheme));
+  context->importPublicParams(w.mpk);
+  context->importSecretParams(w.msk);
+  context->importUserKey("user", w.userKey);
+  return context;
+}
+
+// one operation of the given kind; returns false on failure
+static bool runOperation(OpenABECryptoContext& context, const Workload& w,
+                         const string& operation, size_t thread, size_t iteration)
+{
+  if (operation == "keygen") {
+    // unique IDs: a shared keystore sees concurrent inserts and deletes
+    string keyID = "k" + std::to_string(thread) + "_" + std::to_string(iteration);
+    context.keygen(w.keyInput, keyID);
+    return context.deleteKey(keyID);
+  } else if (operation == "encrypt") {
+    string ct;
+    context.encrypt(w.encInput, "benchmark plaintext", ct);
+    return !ct.empty();
+  }
+  string pt;
+  return context.decrypt("user", w.ciphertext, pt);
+}
+
+static ThroughputResult runLoad(const Workload& w, const string& mode,
+                                const string& operation, size_t threads,
+                                int durationMs)
+{
+  vector<unique_ptr<OpenABECryptoContext>> contexts;
+  contexts.push_back(loadContext(w));
+  if (mode == "per-thread") {
+    for (size_t i = 1; i < threads; i++) {
+      contexts.push_back(loadContext(w));
+    }
+  }
+
+  atomic<bool> start(false), stop(false), failed(false);
+  atomic<size_t> ready(0);
+  vector<size_t> counts(threads, 0);
+  vector<thread> workers;
+  for (size_t t = 0; t < threads; t++) {
+    workers.emplace_back([&, t]() {
+      OpenABECryptoContext& context = *contexts[mode == "per-thread" ? t : 0];
+      ready++;
+      while (!start.load()) {
+        this_thread::yield();
+      }
+      size_t n = 0;
+      try {
+        while (!stop.load(memory_order_relaxed)) {
+          if (!runOperation(context, w, operation, t, n)) {
+            failed = true;
+            break;
+          }
+          n++;
+        }
+      } catch (OpenABE_ERROR& error) {
+        failed = true;
+      }
+      counts[t] = n;
+    });
+  }
+  while (ready.load() < threads) {
+    this_thread::yield();
+  }
+
+  double cpuStart = processCpuSeconds();
+  auto wallStart = chrono::steady_clock::now();
+  start = true;
+  this_thread::sleep_for(chrono::milliseconds(durationMs));
+  stop = true;
+  for (thread& worker : workers) {
+    worker.join();
+  }
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - wallStart).count();
+  double cpu = processCpuSeconds() - cpuStart;
+
+  ThroughputResult r;
+  r.scheme = w.scheme;
+  r.mode = mode;
+  r.operation = operation + (failed ? " (FAILED)" : "");
+  r.threads = threads;
+  r.ops = 0;
+  for (size_t n : counts) {
+    r.ops += n;
+  }
+  r.seconds = seconds;
+  r.opsPerSec = r.ops / seconds;
+  // time not spent on a CPU is time spent waiting, mostly on locks
+  r.cpuUtilization = cpu / (seconds * threads);
+  r.speedup = r.efficiency = 0;
+  return r;
+}
+
+static vector<size_t> parseCounts(const string& s)
+{
+  vector<size_t> values;
+  stringstream ss(s);
+  string item;
+  while (getline(ss, item, ',')) {
+    if (!item.empty()) {
+      values.push_back(strtoul(item.c_str(), NULL, 10));
+    }
+  }
+  return values;
+}
+
+static void usage(const char *prog)
+{
+  cout << "OpenABE throughput benchmark, v" << (OpenABE_LIBRARY_VERSION / 100.) << endl;
+  cout << "Usage " << prog << ": [ -s CP|KP|all ] [ -m shared|per-thread|all ] [ -o op,... ]" << endl;
+  cout << "\t[ -t threads,... ] [ -a attributes ] [ -d milliseconds ] [ --csv file ]" << endl;
+  cout << "\top: keygen, encrypt, decrypt (default: all)" << endl;
+  cout << "\tthreads: thread counts (default: 1, 2, 4, ... up to the hardware concurrency)" << endl;
+  cout << "\tattributes: attributes in the key and policy (default: " << DEFAULT_ATTRIBUTES << ")" << endl;
+  cout << "\tmilliseconds: measured run time per point (default: " << DEFAULT_DURATION_MS << ")" << endl;
+}
+
+int main(int argc, const char *argv[])
+{
+  string schemes = "all", modes = "all", csvFile;
+  vector<string> operations(OPERATIONS, OPERATIONS + sizeof(OPERATIONS) / sizeof(OPERATIONS[0]));
+  vector<size_t> threadCounts;
+  int attributes = DEFAULT_ATTRIBUTES, durationMs = DEFAULT_DURATION_MS;
+
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "-s" && i + 1 < argc) {
+      schemes = argv[++i];
+    } else if (arg == "-m" && i + 1 < argc) {
+      modes = argv[++i];
+    } else if (arg == "-o" && i + 1 < argc) {
+      operations.clear();
+      stringstream ss(argv[++i]);
+      string op;
+      while (getline(ss, op, ',')) {
+        operations.push_back(op);
+      }
+    } else if (arg == "-t" && i + 1 < argc) {
+      threadCounts = parseCounts(argv[++i]);
+    } else if (arg == "-a" && i + 1 < argc) {
+      attributes = atoi(argv[++i]);
+    } else if (arg == "-d" && i + 1 < argc) {
+      durationMs = atoi(argv[++i]);
+    } else if (arg == "--csv" && i + 1 < argc) {
+      csvFile = argv[++i];
+    } else {
+      usage(argv[0]);
+      return -1;
+    }
+  }
+  if (threadCounts.empty()) {
+    size_t hw = max(1u, thread::hardware_concurrency());
+    for (size_t n = 1; n < hw; n *= 2) {
+      threadCounts.push_back(n);
+    }
+    threadCounts.push_back(hw);
+  }
+  if (attributes < 1) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  vector<string> schemeIDs, modeNames;
+  if (schemes == "CP" || schemes == "all") {
+    schemeIDs.push_back("CP-ABE");
+  }
+  if (schemes == "KP" || schemes == "all") {
+    schemeIDs.push_back("KP-ABE");
+  }
+  if (modes == "shared" || modes == "all") {
+    modeNames.push_back("shared");
+  }
+  if (modes == "per-thread" || modes == "all") {
+    modeNames.push_back("per-thread");
+  }
+
+  InitializeOpenABE();
+
+  vector<ThroughputResult> results;
+  cout << left << setw(8) << "scheme" << setw(12) << "mode" << setw(18) << "operation"
+       << right << setw(8) << "threads" << setw(12) << "ops/sec" << setw(10) << "speedup"
+       << setw(12) << "efficiency" << setw(10) << "cpu" << endl;
+  for (const string& scheme : schemeIDs) {
+    Workload w;
+    prepareWorkload(scheme, attributes, w);
+    for (const string& mode : modeNames) {
+      for (const string& operation : operations) {
+        double baseline = 0;
+        for (size_t threads : threadCounts) {
+          if (threads == 0) {
+            continue;
+          }
+          ThroughputResult r = runLoad(w, mode, operation, threads, durationMs);
+          if (baseline == 0) {
+            baseline = r.opsPerSec / r.threads;
+          }
+          r.speedup = (baseline > 0) ? r.opsPerSec / baseline : 0;
+          r.efficiency = r.speedup / r.threads;
+          results.push_back(r);
+          cout << left << setw(8) << scheme << setw(12) << mode << setw(18) << r.operation
+               << right << setw(8) << threads << fixed << setprecision(1)
+               << setw(12) << r.opsPerSec << setprecision(2) << setw(10) << r.speedup
+               << setw(12) << r.efficiency << setw(10) << r.cpuUtilization << endl;
+        }
+      }
+    }
+  }
+
+  ShutdownOpenABE();
+
+  if (!csvFile.empty()) {
+    ofstream out(csvFile.c_str());
+    out << "scheme,mode,operation,threads,ops,seconds,ops_per_sec,speedup,efficiency,cpu_utilization" << endl;
+    out << fixed << setprecision(4);
+    for (const ThroughputResult& r : results) {
+      out << r.scheme << "," << r.mode << "," << r.operation << "," << r.threads << ","
+          << r.ops << "," << r.seconds << "," << r.opsPerSec << "," << r.speedup << ","
+          << r.efficiency << "," << r.cpuUtilization << endl;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,260 @@
+///
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+///
+/// This file is part of Zeutro's OpenABE.
+///
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+///
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+///
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+///
+/// \file   bench_zml.cpp
+///
+/// \brief  Microbenchmarks for the pairing primitives of the ZML layer
+///         (exponentiations, hashing, pairings, serialization), swept over
+///         every curve in the curve database the backend can instantiate.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <openabe/openabe.h>
+#include <openabe/utils/zbenchmark.h>
+
+using namespace std;
+using namespace oabe;
+
+#define DEFAULT_REPETITIONS   50
+#define DEFAULT_WARMUP        5
+
+struct PrimitiveResult {
+  string curve;
+  string name;
+  BenchmarkSummary summary;
+};
+
+static void record(vector<PrimitiveResult>& results, const string& curve,
+                   const string& name, const BenchmarkSummary& summary)
+{
+  PrimitiveResult r;
+  r.curve = curve;
+  r.name = name;
+  r.summary = summary;
+  results.push_back(r);
+  cout << left << setw(32) << name << right << fixed << setprecision(4)
+       << setw(12) << summary.p50 << setw(12) << summary.p95
+       << setw(12) << summary.p99 << setw(12) << summary.mean << endl;
+}
+
+static void benchmarkCurve(const string& params, const vector<size_t>& batches,
+                           int warmup, int reps, vector<PrimitiveResult>& results)
+{
+  OpenABERNG rng;
+  OpenABEPairing pairing(params);
+
+  cout << "=== " << params << " ===" << endl;
+  cout << left << setw(32) << "primitive (ms)" << right << setw(12) << "p50"
+       << setw(12) << "p95" << setw(12) << "p99" << setw(12) << "mean" << endl;
+
+  G1 g1 = pairing.randomG1(&rng);
+  G2 g2 = pairing.randomG2(&rng);
+  GT gt = pairing.pairing(g1, g2);
+  ZP z = pairing.randomZP(&rng);
+
+  record(results, params, "G1::exp", runTimedBenchmark([&]() { g1.exp(z); }, warmup, reps));
+  record(results, params, "G2::exp", runTimedBenchmark([&]() { g2.exp(z); }, warmup, reps));
+  record(results, params, "GT::exp", runTimedBenchmark([&]() { gt.exp(z); }, warmup, reps));
+  {
+    G1FixedBase fb1(g1);
+    G2FixedBase fb2(g2);
+    GTFixedBase fbt(gt);
+    record(results, params, "G1FixedBase::exp", runTimedBenchmark([&]() { fb1.exp(z); }, warmup, reps));
+    record(results, params, "G2FixedBase::exp", runTimedBenchmark([&]() { fb2.exp(z); }, warmup, reps));
+    record(results, params, "GTFixedBase::exp", runTimedBenchmark([&]() { fbt.exp(z); }, warmup, reps));
+  }
+
+  OpenABEByteString prefix;
+  prefix.appendArray((uint8_t*) "bench", 5);
+  int counter = 0;
+  record(results, params, "hashToG1", runTimedBenchmark([&]() {
+    pairing.hashToG1(prefix, "attribute" + std::to_string(counter++));
+  }, warmup, reps));
+  record(results, params, "pairing", runTimedBenchmark([&]() { pairing.pairing(g1, g2); }, warmup, reps));
+
+  for (size_t n : batches) {
+    vector<G1> bases1, p1;
+    vector<G2> bases2, p2;
+    vector<ZP> exps;
+    vector<unique_ptr<G2LineTable>> tables;
+    vector<const G2LineTable*> fixed;
+    for (size_t i = 0; i < n; i++) {
+      bases1.push_back(pairing.randomG1(&rng));
+      bases2.push_back(pairing.randomG2(&rng));
+      exps.push_back(pairing.randomZP(&rng));
+      tables.emplace_back(new G2LineTable(bases2.back()));
+      fixed.push_back(tables.back().get());
+    }
+    string suffix = " n=" + std::to_string(n);
+    GT out = pairing.initGT();
+    record(results, params, "G1::multiExp" + suffix, runTimedBenchmark([&]() {
+      G1::multiExp(bases1, exps);
+    }, warmup, reps));
+    record(results, params, "G2::multiExp" + suffix, runTimedBenchmark([&]() {
+      G2::multiExp(bases2, exps);
+    }, warmup, reps));
+    record(results, params, "multi_pairing" + suffix, runTimedBenchmark([&]() {
+      pairing.multi_pairing(out, bases1.data(), bases2.data(), n);
+    }, warmup, reps));
+    record(results, params, "multi_pairing (lines)" + suffix, runTimedBenchmark([&]() {
+      pairing.multi_pairing(out, nullptr, nullptr, 0, bases1.data(), fixed.data(), n);
+    }, warmup, reps));
+  }
+
+  OpenABEByteString s1, s2, st;
+  g1.serialize(s1);
+  g2.serialize(s2);
+  gt.serialize(st);
+  record(results, params, "G1::serialize", runTimedBenchmark([&]() {
+    OpenABEByteString b;
+    g1.serialize(b);
+  }, warmup, reps));
+  record(results, params, "G2::serialize", runTimedBenchmark([&]() {
+    OpenABEByteString b;
+    g2.serialize(b);
+  }, warmup, reps));
+  record(results, params, "GT::serialize", runTimedBenchmark([&]() {
+    OpenABEByteString b;
+    gt.serialize(b);
+  }, warmup, reps));
+  record(results, params, "G1::deserialize", runTimedBenchmark([&]() {
+    OpenABEByteString b = s1;
+    G1 e = pairing.initG1();
+    e.deserialize(b);
+  }, warmup, reps));
+  record(results, params, "G2::deserialize", runTimedBenchmark([&]() {
+    OpenABEByteString b = s2;
+    G2 e = pairing.initG2();
+    e.deserialize(b);
+  }, warmup, reps));
+  record(results, params, "GT::deserialize", runTimedBenchmark([&]() {
+    OpenABEByteString b = st;
+    GT e = pairing.initGT();
+    e.deserialize(b);
+  }, warmup, reps));
+  cout << endl;
+}
+
+static void usage(const char *prog)
+{
+  cout << "OpenABE primitive benchmark utility, v" << (OpenABE_LIBRARY_VERSION / 100.) << endl;
+  cout << "Usage " << prog << ": [ -c curve ]* [ -n repetitions ] [ -w warmup ] [ -b batch ]* [ --csv file ] [ --json file ]" << endl;
+  cout << "\tcurve: pairing parameters (e.g. BN_P254, BLS12_P381); default: every curve the backend supports" << endl;
+  cout << "\trepetitions: timed runs per primitive (default: " << DEFAULT_REPETITIONS << ")" << endl;
+  cout << "\twarmup: untimed runs per primitive (default: " << DEFAULT_WARMUP << ")" << endl;
+  cout << "\tbatch: sizes for multiExp and multi_pairing (default: 1 2 4 8 16 32)" << endl;
+}
+
+int main(int argc, const char *argv[])
+{
+  vector<string> curves;
+  vector<size_t> batches;
+  int reps = DEFAULT_REPETITIONS, warmup = DEFAULT_WARMUP;
+  string csvFile, jsonFile;
+
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "-c" && i + 1 < argc) {
+      curves.push_back(argv[++i]);
+    } else if (arg == "-n" && i + 1 < argc) {
+      reps = atoi(argv[++i]);
+    } else if (arg == "-w" && i + 1 < argc) {
+      warmup = atoi(argv[++i]);
+    } else if (arg == "-b" && i + 1 < argc) {
+      batches.push_back(strtoul(argv[++i], NULL, 10));
+    } else if (arg == "--csv" && i + 1 < argc) {
+      csvFile = argv[++i];
+    } else if (arg == "--json" && i + 1 < argc) {
+      jsonFile = argv[++i];
+    } else {
+      usage(argv[0]);
+      return -1;
+    }
+  }
+  if (batches.empty()) {
+    batches = {1, 2, 4, 8, 16, 32};
+  }
+
+  InitializeOpenABE();
+  // results are only comparable between machines that run the same kernels
+  cout << "CPU features: " << OpenABE_getCpuFeatureString() << endl;
+  cout << OpenABE_describeCodePaths() << endl;
+
+  if (curves.empty()) {
+    // sweep the curve database; curves the backend cannot instantiate are
+    // skipped below
+    const char **names = NULL;
+    int count = 0;
+    OpenABE_listAllCurves(&names, &count);
+    for (int i = 0; i < count; i++) {
+      OpenABECurveID id = OpenABE_getCurveIDByName(names[i]);
+      string params = OpenABE_convertCurveIDToString(id);
+      if (OpenABE_getCurveEmbeddingDegree(id) > 1 &&
+          getPairingCurveID(params) != OpenABE_NONE_ID) {
+        curves.push_back(params);
+      }
+    }
+  }
+
+  vector<PrimitiveResult> results;
+  for (const string& params : curves) {
+    try {
+      // one curve at a time: every group of the previous curve is gone by now
+      benchmarkCurve(params, batches, warmup, reps, results);
+    } catch (OpenABE_ERROR& error) {
+      cout << "Skipping " << params << ": " << OpenABE_errorToString(error) << endl;
+    }
+  }
+
+  ShutdownOpenABE();
+
+  if (!csvFile.empty()) {
+    ofstream out(csvFile.c_str());
+    out << BenchmarkSummary::csvHeader() << endl;
+    for (const PrimitiveResult& r : results) {
+      out << r.summary.toCsvRow(r.curve + "/" + r.name) << endl;
+    }
+  }
+  if (!jsonFile.empty()) {
+    ofstream out(jsonFile.c_str());
+    out << "[" << endl;
+    for (size_t i = 0; i < results.size(); i++) {
+      out << "  " << results[i].summary.toJson(results[i].curve + "/" + results[i].name)
+          << (i + 1 < results.size() ? "," : "") << endl;
+    }
+    out << "]" << endl;
+  }
+  return 0;
+}
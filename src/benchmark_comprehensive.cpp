@@ -12,14 +12,13 @@
 #include <iomanip>
 #include <vector>
 #include <string>
-#include <chrono>
-#include <cmath>
+#include <fstream>
 #include <map>
 #include <openabe/openabe.h>
+#include <openabe/utils/zbenchmark.h>
 
 using namespace std;
 using namespace oabe;
-using namespace chrono;
 
 struct BenchmarkResult {
     string operation;
@@ -28,47 +27,17 @@ struct BenchmarkResult {
     double stddev_ms;
     double min_ms;
     double max_ms;
+    BenchmarkSummary summary;
     int iterations;
     size_t data_size;
 };
 
-class Timer {
-public:
-    void start() { start_time = high_resolution_clock::now(); }
-
-    double stop_ms() {
-        auto end_time = high_resolution_clock::now();
-        auto duration = duration_cast<microseconds>(end_time - start_time);
-        return duration.count() / 1000.0;
-    }
-
-private:
-    high_resolution_clock::time_point start_time;
-};
-
 void calculate_stats(const vector<double>& times, BenchmarkResult& result) {
-    if (times.empty()) {
-        result.mean_ms = result.stddev_ms = result.min_ms = result.max_ms = 0.0;
-        return;
-    }
-
-    result.mean_ms = 0.0;
-    for (double t : times) result.mean_ms += t;
-    result.mean_ms /= times.size();
-
-    result.stddev_ms = 0.0;
-    for (double t : times) {
-        double diff = t - result.mean_ms;
-        result.stddev_ms += diff * diff;
-    }
-    result.stddev_ms = sqrt(result.stddev_ms / times.size());
-
-    result.min_ms = times[0];
-    result.max_ms = times[0];
-    for (double t : times) {
-        if (t < result.min_ms) result.min_ms = t;
-        if (t > result.max_ms) result.max_ms = t;
-    }
+    result.summary = BenchmarkSummary::fromSamples(times);
+    result.mean_ms = result.summary.mean;
+    result.stddev_ms = result.summary.stddev;
+    result.min_ms = result.summary.min;
+    result.max_ms = result.summary.max;
 }
 
 void print_result(const BenchmarkResult& r) {
@@ -77,6 +46,9 @@ void print_result(const BenchmarkResult& r) {
          << setw(12) << fixed << setprecision(2) << r.stddev_ms
          << setw(12) << fixed << setprecision(2) << r.min_ms
          << setw(12) << fixed << setprecision(2) << r.max_ms
+         << setw(12) << fixed << setprecision(2) << r.summary.p50
+         << setw(12) << fixed << setprecision(2) << r.summary.p95
+         << setw(12) << fixed << setprecision(2) << r.summary.p99
          << endl;
 }
 
@@ -106,13 +78,20 @@ void print_platform_info() {
 
     cout << "  Version:   " << fixed << setprecision(2)
          << (OpenABE_getLibraryVersion() / 100.0) << endl;
+    cout << "  CPU:       " << OpenABE_getCpuFeatureString() << endl;
+    cout << endl;
+    cout << "Code Paths:" << endl;
+    for (const auto& path : OpenABE_getActiveCodePaths()) {
+        cout << "  " << left << setw(16) << (path.first + ":") << right
+             << path.second << endl;
+    }
     cout << endl;
 }
 
 class CPABEBenchmark {
 public:
-    CPABEBenchmark(const string& curve_name, int iterations)
-        : curve_(curve_name), iterations_(iterations) {}
+    CPABEBenchmark(const string& curve_name, int iterations, int warmup)
+        : curve_(curve_name), iterations_(iterations), warmup_(warmup) {}
 
     vector<BenchmarkResult> run_all() {
         vector<BenchmarkResult> results;
@@ -134,17 +113,19 @@ public:
 private:
     string curve_;
     int iterations_;
+    int warmup_;
 
     BenchmarkResult benchmark_setup() {
         cout << "[1/6] Benchmarking setup..." << flush;
         vector<double> times;
-        Timer timer;
+        Benchmark timer;
 
-        for (int i = 0; i < iterations_; i++) {
+        for (int i = -warmup_; i < iterations_; i++) {
             OpenABECryptoContext cpabe("CP-ABE");
             timer.start();
             cpabe.generateParams();
-            times.push_back(timer.stop_ms());
+            timer.stop();
+            if (i >= 0) times.push_back(timer.computeTimeInMilliseconds());
         }
 
         BenchmarkResult result;
@@ -161,15 +142,16 @@ private:
     BenchmarkResult benchmark_keygen() {
         cout << "[2/6] Benchmarking key generation..." << flush;
         vector<double> times;
-        Timer timer;
+        Benchmark timer;
 
         OpenABECryptoContext cpabe("CP-ABE");
         cpabe.generateParams();
 
-        for (int i = 0; i < iterations_; i++) {
+        for (int i = -warmup_; i < iterations_; i++) {
             timer.start();
             cpabe.keygen("attr1|attr2|attr3", "bench_key_" + to_string(i));
-            times.push_back(timer.stop_ms());
+            timer.stop();
+            if (i >= 0) times.push_back(timer.computeTimeInMilliseconds());
         }
 
         BenchmarkResult result;
@@ -186,17 +168,18 @@ private:
     BenchmarkResult benchmark_encryption_simple() {
         cout << "[3/6] Benchmarking encryption (simple)..." << flush;
         vector<double> times;
-        Timer timer;
+        Benchmark timer;
 
         OpenABECryptoContext cpabe("CP-ABE");
         cpabe.generateParams();
         string plaintext = "This is a test message for benchmarking encryption performance in OpenABE CP-ABE";
         string ciphertext;
 
-        for (int i = 0; i < iterations_; i++) {
+        for (int i = -warmup_; i < iterations_; i++) {
             timer.start();
             cpabe.encrypt("attr1", plaintext, ciphertext);
-            times.push_back(timer.stop_ms());
+            timer.stop();
+            if (i >= 0) times.push_back(timer.computeTimeInMilliseconds());
         }
 
         BenchmarkResult result;
@@ -213,7 +196,7 @@ private:
     BenchmarkResult benchmark_encryption_complex() {
         cout << "[4/6] Benchmarking encryption (complex)..." << flush;
         vector<double> times;
-        Timer timer;
+        Benchmark timer;
 
         OpenABECryptoContext cpabe("CP-ABE");
         cpabe.generateParams();
@@ -221,10 +204,11 @@ private:
         string ciphertext;
         string policy = "((attr1 and attr2) or (attr3 and attr4))";
 
-        for (int i = 0; i < iterations_; i++) {
+        for (int i = -warmup_; i < iterations_; i++) {
             timer.start();
             cpabe.encrypt(policy, plaintext, ciphertext);
-            times.push_back(timer.stop_ms());
+            timer.stop();
+            if (i >= 0) times.push_back(timer.computeTimeInMilliseconds());
         }
 
         BenchmarkResult result;
@@ -241,7 +225,7 @@ private:
     BenchmarkResult benchmark_decryption_matching() {
         cout << "[5/6] Benchmarking decryption (matching)..." << flush;
         vector<double> times;
-        Timer timer;
+        Benchmark timer;
 
         OpenABECryptoContext cpabe("CP-ABE");
         cpabe.generateParams();
@@ -251,10 +235,11 @@ private:
         string ciphertext, recovered;
         cpabe.encrypt("attr1 and attr2", plaintext, ciphertext);
 
-        for (int i = 0; i < iterations_; i++) {
+        for (int i = -warmup_; i < iterations_; i++) {
             timer.start();
             bool success = cpabe.decrypt("bench_user", ciphertext, recovered);
-            times.push_back(timer.stop_ms());
+            timer.stop();
+            if (i >= 0) times.push_back(timer.computeTimeInMilliseconds());
 
             if (!success || recovered != plaintext) {
                 cerr << "ERROR: Decryption failed on iteration " << i << "!" << endl;
@@ -276,7 +261,7 @@ private:
     BenchmarkResult benchmark_decryption_nonmatching() {
         cout << "[6/6] Benchmarking decryption (non-matching)..." << flush;
         vector<double> times;
-        Timer timer;
+        Benchmark timer;
 
         OpenABECryptoContext cpabe("CP-ABE");
         cpabe.generateParams();
@@ -287,10 +272,11 @@ private:
         string ciphertext, recovered;
         cpabe.encrypt("attr1 and attr2", plaintext, ciphertext);
 
-        for (int i = 0; i < iterations_; i++) {
+        for (int i = -warmup_; i < iterations_; i++) {
             timer.start();
             bool success = cpabe.decrypt("bench_user_nomatch", ciphertext, recovered);
-            times.push_back(timer.stop_ms());
+            timer.stop();
+            if (i >= 0) times.push_back(timer.computeTimeInMilliseconds());
 
             if (success) {
                 cerr << "WARNING: Non-matching decryption unexpectedly succeeded!" << endl;
@@ -311,8 +297,8 @@ private:
 
 class PKEBenchmark {
 public:
-    PKEBenchmark(const string& ec_curve, int iterations)
-        : ec_curve_(ec_curve), iterations_(iterations) {}
+    PKEBenchmark(const string& ec_curve, int iterations, int warmup)
+        : ec_curve_(ec_curve), iterations_(iterations), warmup_(warmup) {}
 
     vector<BenchmarkResult> run_all() {
         vector<BenchmarkResult> results;
@@ -331,18 +317,20 @@ public:
 private:
     string ec_curve_;
     int iterations_;
+    int warmup_;
 
     BenchmarkResult benchmark_keygen() {
         cout << "[1/3] Benchmarking PKE key generation..." << flush;
         vector<double> times;
-        Timer timer;
+        Benchmark timer;
 
         OpenPKEContext pke(ec_curve_);
 
-        for (int i = 0; i < iterations_; i++) {
+        for (int i = -warmup_; i < iterations_; i++) {
             timer.start();
             pke.keygen("pke_user_" + to_string(i));
-            times.push_back(timer.stop_ms());
+            timer.stop();
+            if (i >= 0) times.push_back(timer.computeTimeInMilliseconds());
         }
 
         BenchmarkResult result;
@@ -359,7 +347,7 @@ private:
     BenchmarkResult benchmark_encryption() {
         cout << "[2/3] Benchmarking PKE encryption..." << flush;
         vector<double> times;
-        Timer timer;
+        Benchmark timer;
 
         OpenPKEContext pke(ec_curve_);
         pke.keygen("pke_test");
@@ -367,10 +355,11 @@ private:
         string plaintext = "This is a test message for benchmarking PKE encryption performance in OpenABE";
         string ciphertext;
 
-        for (int i = 0; i < iterations_; i++) {
+        for (int i = -warmup_; i < iterations_; i++) {
             timer.start();
             bool success = pke.encrypt("pke_test", plaintext, ciphertext);
-            times.push_back(timer.stop_ms());
+            timer.stop();
+            if (i >= 0) times.push_back(timer.computeTimeInMilliseconds());
 
             if (!success) {
                 cerr << "ERROR: PKE encryption failed on iteration " << i << "!" << endl;
@@ -392,7 +381,7 @@ private:
     BenchmarkResult benchmark_decryption() {
         cout << "[3/3] Benchmarking PKE decryption..." << flush;
         vector<double> times;
-        Timer timer;
+        Benchmark timer;
 
         OpenPKEContext pke(ec_curve_);
         pke.keygen("pke_test");
@@ -401,10 +390,11 @@ private:
         string ciphertext, recovered;
         pke.encrypt("pke_test", plaintext, ciphertext);
 
-        for (int i = 0; i < iterations_; i++) {
+        for (int i = -warmup_; i < iterations_; i++) {
             timer.start();
             bool success = pke.decrypt("pke_test", ciphertext, recovered);
-            times.push_back(timer.stop_ms());
+            timer.stop();
+            if (i >= 0) times.push_back(timer.computeTimeInMilliseconds());
 
             if (!success || recovered != plaintext) {
                 cerr << "ERROR: PKE decryption failed on iteration " << i << "!" << endl;
@@ -426,8 +416,8 @@ private:
 
 class PKSIGBenchmark {
 public:
-    PKSIGBenchmark(const string& ec_curve, int iterations)
-        : ec_curve_(ec_curve), iterations_(iterations) {}
+    PKSIGBenchmark(const string& ec_curve, int iterations, int warmup)
+        : ec_curve_(ec_curve), iterations_(iterations), warmup_(warmup) {}
 
     vector<BenchmarkResult> run_all() {
         vector<BenchmarkResult> results;
@@ -446,18 +436,20 @@ public:
 private:
     string ec_curve_;
     int iterations_;
+    int warmup_;
 
     BenchmarkResult benchmark_keygen() {
         cout << "[1/3] Benchmarking PKSIG key generation..." << flush;
         vector<double> times;
-        Timer timer;
+        Benchmark timer;
 
         OpenPKSIGContext pksig(ec_curve_);
 
-        for (int i = 0; i < iterations_; i++) {
+        for (int i = -warmup_; i < iterations_; i++) {
             timer.start();
             pksig.keygen("pksig_user_" + to_string(i));
-            times.push_back(timer.stop_ms());
+            timer.stop();
+            if (i >= 0) times.push_back(timer.computeTimeInMilliseconds());
         }
 
         BenchmarkResult result;
@@ -474,7 +466,7 @@ private:
     BenchmarkResult benchmark_sign() {
         cout << "[2/3] Benchmarking PKSIG signing..." << flush;
         vector<double> times;
-        Timer timer;
+        Benchmark timer;
 
         OpenPKSIGContext pksig(ec_curve_);
         pksig.keygen("pksig_test");
@@ -482,10 +474,11 @@ private:
         string message = "This is a test message for benchmarking digital signature performance in OpenABE";
         string signature;
 
-        for (int i = 0; i < iterations_; i++) {
+        for (int i = -warmup_; i < iterations_; i++) {
             timer.start();
             pksig.sign("pksig_test", message, signature);
-            times.push_back(timer.stop_ms());
+            timer.stop();
+            if (i >= 0) times.push_back(timer.computeTimeInMilliseconds());
         }
 
         BenchmarkResult result;
@@ -502,7 +495,7 @@ private:
     BenchmarkResult benchmark_verify() {
         cout << "[3/3] Benchmarking PKSIG verification..." << flush;
         vector<double> times;
-        Timer timer;
+        Benchmark timer;
 
         OpenPKSIGContext pksig(ec_curve_);
         pksig.keygen("pksig_test");
@@ -511,10 +504,11 @@ private:
         string signature;
         pksig.sign("pksig_test", message, signature);
 
-        for (int i = 0; i < iterations_; i++) {
+        for (int i = -warmup_; i < iterations_; i++) {
             timer.start();
             bool success = pksig.verify("pksig_test", message, signature);
-            times.push_back(timer.stop_ms());
+            timer.stop();
+            if (i >= 0) times.push_back(timer.computeTimeInMilliseconds());
 
             if (!success) {
                 cerr << "ERROR: PKSIG verification failed on iteration " << i << "!" << endl;
@@ -541,8 +535,11 @@ void print_results_table(const vector<BenchmarkResult>& results) {
          << right << setw(12) << "Mean (ms)"
          << setw(12) << "StdDev"
          << setw(12) << "Min"
-         << setw(12) << "Max" << endl;
-    cout << string(83, '-') << endl;
+         << setw(12) << "Max"
+         << setw(12) << "p50"
+         << setw(12) << "p95"
+         << setw(12) << "p99" << endl;
+    cout << string(119, '-') << endl;
 
     for (const auto& r : results) {
         print_result(r);
@@ -571,13 +568,19 @@ void print_usage(const char* prog_name) {
     cout << "  -n, --iterations N      Number of iterations (default: 100)" << endl;
     cout << "  -s, --scheme SCHEME     Scheme to benchmark: cpabe, pke, pksig, all" << endl;
     cout << "                          Default: all" << endl;
+    cout << "  -w, --warmup N          Untimed runs before each measurement (default: 3)" << endl;
     cout << "  -a, --all-curves        Benchmark all supported curves" << endl;
+    cout << "  --json FILE             Write per-operation statistics as JSON" << endl;
+    cout << "  --csv FILE              Write per-operation statistics as CSV" << endl;
+    cout << "  --baseline FILE         Compare p50s against a stored CSV; exit 2 on regression" << endl;
+    cout << "  --tolerance F           Allowed p50 slowdown vs the baseline (default: 0.10)" << endl;
     cout << "  -h, --help              Show this help message" << endl;
     cout << endl;
     cout << "Examples:" << endl;
     cout << "  " << prog_name << " -s cpabe -c BLS12_381 -n 50" << endl;
     cout << "  " << prog_name << " -s pke -e NIST_P384" << endl;
     cout << "  " << prog_name << " -s all --all-curves" << endl;
+    cout << "  " << prog_name << " -s cpabe --csv new.csv --baseline release.csv" << endl;
     cout << endl;
 }
 
@@ -587,6 +590,11 @@ int main(int argc, char* argv[]) {
     int iterations = 100;
     bool all_curves = false;
     string scheme = "all";  // Default: benchmark all schemes
+    int warmup = 3;
+    string json_file, csv_file, baseline_file;
+    double tolerance = 0.10;
+    // every result, keyed "<curve>/<operation>" for the machine-readable output
+    vector<BenchmarkResult> report;
 
     // Parse command line
     for (int i = 1; i < argc; i++) {
@@ -599,6 +607,16 @@ int main(int argc, char* argv[]) {
             iterations = atoi(argv[++i]);
         } else if ((arg == "-s" || arg == "--scheme") && i + 1 < argc) {
             scheme = argv[++i];
+        } else if ((arg == "-w" || arg == "--warmup") && i + 1 < argc) {
+            warmup = atoi(argv[++i]);
+        } else if (arg == "--json" && i + 1 < argc) {
+            json_file = argv[++i];
+        } else if (arg == "--csv" && i + 1 < argc) {
+            csv_file = argv[++i];
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            baseline_file = argv[++i];
+        } else if (arg == "--tolerance" && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
         } else if (arg == "-a" || arg == "--all-curves") {
             all_curves = true;
         } else if (arg == "-h" || arg == "--help") {
@@ -637,9 +655,10 @@ int main(int argc, char* argv[]) {
             cout << "========================================" << endl;
             cout << endl;
 
-            CPABEBenchmark benchmark(test_curve, iterations);
+            CPABEBenchmark benchmark(test_curve, iterations, warmup);
             auto results = benchmark.run_all();
             all_results[test_curve] = results;
+            report.insert(report.end(), results.begin(), results.end());
 
             print_results_table(results);
         }
@@ -698,8 +717,9 @@ int main(int argc, char* argv[]) {
             cout << "========================================" << endl;
             cout << endl;
 
-            PKEBenchmark pke_benchmark(test_ec_curve, iterations);
+            PKEBenchmark pke_benchmark(test_ec_curve, iterations, warmup);
             auto results = pke_benchmark.run_all();
+            report.insert(report.end(), results.begin(), results.end());
             print_results_table(results);
         }
     }
@@ -719,8 +739,9 @@ int main(int argc, char* argv[]) {
             cout << "========================================" << endl;
             cout << endl;
 
-            PKSIGBenchmark pksig_benchmark(test_ec_curve, iterations);
+            PKSIGBenchmark pksig_benchmark(test_ec_curve, iterations, warmup);
             auto results = pksig_benchmark.run_all();
+            report.insert(report.end(), results.begin(), results.end());
             print_results_table(results);
         }
     }
@@ -733,5 +754,46 @@ int main(int argc, char* argv[]) {
 
     ShutdownOpenABE();
 
-    return 0;
+    if (!json_file.empty()) {
+        ofstream out(json_file.c_str());
+        out << "[" << endl;
+        for (size_t i = 0; i < report.size(); i++) {
+            out << "  " << report[i].summary.toJson(report[i].curve + "/" + report[i].operation)
+                << (i + 1 < report.size() ? "," : "") << endl;
+        }
+        out << "]" << endl;
+    }
+    if (!csv_file.empty()) {
+        ofstream out(csv_file.c_str());
+        out << BenchmarkSummary::csvHeader() << endl;
+        for (const auto& r : report) {
+            out << r.summary.toCsvRow(r.curve + "/" + r.operation) << endl;
+        }
+    }
+
+    int rc = 0;
+    if (!baseline_file.empty()) {
+        BenchmarkBaseline baseline;
+        if (!loadBenchmarkBaseline(baseline_file, baseline)) {
+            cerr << "Could not read baseline: " << baseline_file << endl;
+            return 1;
+        }
+        for (const auto& r : report) {
+            string name = r.curve + "/" + r.operation;
+            auto it = baseline.find(name);
+            if (it == baseline.end()) {
+                continue;
+            }
+            if (isBenchmarkRegression(r.summary, it->second, tolerance)) {
+                cout << "REGRESSION: " << name << " p50 " << fixed << setprecision(2)
+                     << r.summary.p50 << " ms vs baseline " << it->second << " ms" << endl;
+                rc = 2;
+            }
+        }
+        if (rc == 0) {
+            cout << "No regressions against " << baseline_file << endl;
+        }
+    }
+
+    return rc;
 }
@@ -37,6 +37,7 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <chrono>
 
 #include <openabe/openabe.h>
 
@@ -65,11 +66,18 @@ void getFile(std::string &result, const std::string &filename) {
 
 int main(int argc, char **argv) {
   // check that we have appropriate # of args
-  if (argc < 2) {
-    cerr << "Usage " << argv[0] << ": [ input file ]" << endl;
+  // -t <ms> reports every input whose parse takes longer than ms
+  long slow_ms = -1;
+  int arg = 1;
+  if (argc > 2 && string(argv[1]) == "-t") {
+    slow_ms = strtol(argv[2], NULL, 10);
+    arg = 3;
+  }
+  if (argc <= arg) {
+    cerr << "Usage " << argv[0] << ": [ -t ms ] [ input file ]" << endl;
     return 1;
   }
-  const string input_file(argv[1]);
+  const string input_file(argv[arg]);
   int err_code = 1;
 
   try {
@@ -79,7 +87,13 @@ int main(int argc, char **argv) {
 
     for (auto p : attr_list_strings) {
       cout << "Input: " << p << endl;
+      auto start = chrono::steady_clock::now();
       std::unique_ptr<OpenABEAttributeList> attrList = createAttributeList(p);
+      long elapsed = chrono::duration_cast<chrono::milliseconds>(
+                         chrono::steady_clock::now() - start).count();
+      if (slow_ms >= 0 && elapsed > slow_ms) {
+        cerr << "slow input (" << elapsed << " ms): " << p << endl;
+      }
       if(attrList != nullptr) {
         cout << "AttrList Full: " << attrList->toString() << endl;
         cout << "AttrList Compact: " << attrList->toCompactString() << endl;
@@ -47,6 +47,15 @@
 ///
 namespace oabe {
 
+///
+/// @brief  One piece of the KDF OtherInfo, hashed in order without
+///         first concatenating the pieces
+///
+struct OpenABEKDFInput {
+  const uint8_t *data;
+  size_t len;
+};
+
 class OpenABEKDF : public ZObject {
 private:
 	uint8_t  hashPrefix;
@@ -60,6 +69,9 @@ public:
   ~OpenABEKDF();
 
   OpenABEByteString DeriveKey(OpenABEByteString &Z, uint32_t keyBitLen, OpenABEByteString &metadata);
+  OpenABE_ERROR DeriveKey(const uint8_t *Z, size_t zLen,
+                          const OpenABEKDFInput *metadata, size_t metadataCount,
+                          uint8_t *output, size_t outputLen);
 };
 
 ///
@@ -68,6 +80,40 @@ public:
 OpenABEByteString OpenABEPBKDF(OpenABEByteString &password, uint32_t keydataLenBytes,
                        OpenABEByteString &salt, int iterationCount = OpenABE_KDF_ITERATION_COUNT);
 
+///
+/// @class  OpenABEPasswordKeyCache
+///
+/// @brief  PBKDF2 keys derived from one passphrase, kept for the life of
+///         a session. Blobs sealed through the session share one salt, so
+///         unlocking them again costs a single derivation; other blobs
+///         are cached by (salt, iteration count). Keys are wiped on
+///         clear() and on destruction.
+///
+class OpenABEPasswordKeyCache {
+public:
+  OpenABEPasswordKeyCache(const std::string &password,
+                          int iterationCount = OpenABE_KDF_ITERATION_COUNT,
+                          size_t maxKeys = PASSWORD_KEY_CACHE_SIZE);
+  ~OpenABEPasswordKeyCache();
+
+  int getIterationCount() const { return iterationCount_; }
+  // salt and key for sealing a new blob
+  void getSealingKey(OpenABEByteString &salt, OpenABEByteString &key);
+  // key for opening a blob with the given salt and iteration count
+  void getKey(OpenABEByteString &salt, int iterationCount, OpenABEByteString &key);
+  size_t size();
+  void clear();
+
+private:
+  std::mutex lock_;
+  OpenABEByteString password_;
+  int iterationCount_;
+  size_t maxKeys_;
+  OpenABEByteString sealSalt_;
+  std::map<std::string, OpenABEByteString> keys_;
+  std::deque<std::string> order_;
+};
+
 }
 
 #endif // __ZKDF_H__
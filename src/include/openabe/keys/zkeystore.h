@@ -35,6 +35,8 @@
 #define __ZKEYSTORE_H__
 
 #include <map>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 namespace oabe {
@@ -49,6 +51,11 @@ typedef enum _zKeyType {
 /// \class  ZKeystore
 /// \brief  Keystore class for the OpenABE. Stores public and secret parameters
 ///         and keys, each indexed by a string identifier.
+///
+///         Lookups read an immutable snapshot of the key maps and take no
+///         lock, so one keystore (and the context that owns it) can serve
+///         many threads. Changes copy the map and publish the new snapshot;
+///         deleted keys are zeroized once no reader holds them any more.
 //
 class OpenABEKeystore : public ZObject {
 public:
@@ -58,6 +65,10 @@ public:
   OpenABE_ERROR addKey(const std::string name,
                        const std::shared_ptr<OpenABEKey>& component,
                        zKeyType keyType);
+  // addKey for many keys at once, publishing a single new snapshot
+  OpenABE_ERROR addKeys(const std::vector<std::string> &names,
+                        const std::vector<std::shared_ptr<OpenABEKey>> &components,
+                        zKeyType keyType);
   std::shared_ptr<OpenABEKey> getPublicKey(const std::string keyID);
   std::shared_ptr<OpenABEKey> getSecretKey(const std::string keyID);
   std::shared_ptr<OpenABEKey> getKey(const std::string keyID);
@@ -67,9 +78,7 @@ public:
 
   bool validateNewParamsID(const std::string &keyID);
   // search/extract key references
-#if 0
-  const std::vector<std::string> getSecretKeyIDs() const;
-#endif
+  std::vector<std::string> getSecretKeyIDs();
   // import/export routines
   std::shared_ptr<OpenABEKey> parseKeyHeader(const std::string keyID,
                                           OpenABEByteString &keyBlob,
@@ -80,8 +89,16 @@ public:
   OpenABE_ERROR exportKeyToBytes(const std::string keyID, OpenABEByteString &exportedKey);
 
 protected:
-  std::map<std::string, std::shared_ptr<OpenABEKey>> pubKeys;
-  std::map<std::string, std::shared_ptr<OpenABEKey>> secKeys;
+  typedef std::map<std::string, std::shared_ptr<OpenABEKey>> OpenABEKeyMap;
+  // current snapshots; only ever replaced (with std::atomic_store), never modified
+  std::shared_ptr<const OpenABEKeyMap> pubKeys;
+  std::shared_ptr<const OpenABEKeyMap> secKeys;
+  // serializes writers; readers never take it
+  std::mutex writeLock_;
+  // deleted keys still referenced elsewhere, zeroized when released
+  std::vector<std::shared_ptr<OpenABEKey>> retiredKeys_;
+
+  void sweepRetiredKeys();
 };
 
 typedef std::pair<std::string,int> KeyRef;
@@ -71,7 +71,8 @@ public:
   OpenABEByteString& getKeyBytes() { return (this->m_keyData); }
 
   bool hashToSymmetricKey(GT &input, uint32_t keyLen,
-                          OpenABEHashFunctionType hashType = OpenABE_DEFAULT_HASH_FUNCTION_TYPE);
+                          OpenABEHashFunctionType hashType = OpenABE_DEFAULT_HASH_FUNCTION_TYPE,
+                          OpenABEGTKDFVersion kdfVersion = OpenABE_GT_KDF_V1);
   bool generateSymmetricKey(uint32_t keyLen);
   void setSymmetricKey(OpenABEByteString &key);
 
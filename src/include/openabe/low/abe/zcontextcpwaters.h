@@ -34,12 +34,70 @@
 #ifndef __ZCONTEXTCPWATERS_H__
 #define __ZCONTEXTCPWATERS_H__
 
+namespace oabe {
+
+///
+/// @class  OpenABECPWatersCoupon
+///
+/// @brief  The message- and policy-independent part of a CP-Waters
+///         encryption under one MPK: s with A^s and g1^s, and (ri, g2^ri)
+///         for the first rows of the LSSS matrix.
+///
+
+struct OpenABECPWatersCoupon {
+  OpenABECPWatersCoupon(const ZP &s, const GT &C, const G1 &Cprime)
+    : s(s), C(C), Cprime(Cprime) {}
+
+  ZP s;
+  GT C;
+  G1 Cprime;
+  std::vector<ZP> r;
+  std::vector<G2> D;
+};
+
+///
+/// @class  OpenABECPWatersCouponPool
+///
+/// @brief  Coupons pre-generated for one MPK. A background thread tops the
+///         pool up whenever it falls to half of its capacity. The browser
+///         build has no thread: the pool is filled once when it is created
+///         and afterwards only by refill().
+///
+
+class OpenABECPWatersCouponPool {
+public:
+  OpenABECPWatersCouponPool(OpenABEPairing *pairing,
+                            std::shared_ptr<OpenABEPrecomputedParams> params,
+                            size_t capacity, size_t rows);
+  ~OpenABECPWatersCouponPool();
+
+  // the tables the coupons were generated from
+  std::shared_ptr<OpenABEPrecomputedParams> getPrecomputedParams() const { return this->params_; }
+  // a coupon, or nullptr if the pool is empty
+  std::unique_ptr<OpenABECPWatersCoupon> take();
+  // generate coupons on the calling thread until the pool is full
+  void refill();
+  size_t size();
+
+private:
+  std::unique_ptr<OpenABECPWatersCoupon> generate(OpenABERNG *rng);
+  void workerLoop();
+
+  OpenABEPairing *pairing_;
+  std::shared_ptr<OpenABEPrecomputedParams> params_;
+  size_t capacity_, rows_;
+  std::mutex lock_;
+  std::condition_variable wake_;
+  std::deque<std::unique_ptr<OpenABECPWatersCoupon>> coupons_;
+  bool stopping_;
+  std::thread worker_;
+};
+
 ///
 /// @class  OpenABEContextCPWaters
 ///
 /// @brief  Implementation of the Waters '09 CP-ABE encryption scheme.
 ///
-namespace oabe {
 
 class OpenABEContextCPWaters : public OpenABEContextABE {
 public:
@@ -61,6 +119,50 @@ public:
 
   OpenABE_ERROR decryptKEM(const std::string &mpkID, const std::string &keyID, OpenABECiphertext *ciphertext,
                        uint32_t keyByteLen, const std::shared_ptr<OpenABESymKey>& key);
+
+  OpenABE_ERROR verifyKEM(OpenABERNG *rng, const std::string &mpkID, const OpenABEFunctionInput *encryptInput,
+                       uint32_t keyByteLen, const std::shared_ptr<OpenABESymKey>& key,
+                       OpenABECiphertext *ciphertext, uint32_t &numComponents);
+
+  OpenABE_ERROR estimateKEM(const std::string &mpkID, const OpenABEFunctionInput *encryptInput,
+                       uint32_t keyByteLen, OpenABECiphertext *skeleton,
+                       OpenABEEncryptionCost &cost);
+
+  OpenABE_ERROR enableEncryptionCoupons(const std::string &mpkID,
+                                        size_t poolSize = OpenABE_COUPON_POOL_SIZE,
+                                        size_t rows = OpenABE_COUPON_ROWS);
+  void disableEncryptionCoupons(const std::string &mpkID);
+  size_t getEncryptionCouponCount(const std::string &mpkID);
+
+  OpenABE_ERROR delegateKey(const std::string &mpkID, const std::string &keyID,
+                            OpenABEFunctionInput *keyInput, const std::string &newKeyID);
+  OpenABE_ERROR extendDecryptionKey(const std::string &mpkID, const std::string &mskID,
+                                    const std::string &keyID, OpenABEFunctionInput *keyInput,
+                                    const std::string &deltaID);
+  OpenABE_ERROR applyKeyDelta(const std::string &keyID, const std::string &deltaID);
+  OpenABE_ERROR generateKeyUpdate(const std::string &mpkID, const std::string &mskID,
+                                  const std::string &keyID, OpenABEFunctionInput *keyInput,
+                                  const std::string &updateID);
+  OpenABE_ERROR generateTransformKey(const std::string &keyID, const std::string &tkID,
+                                     const std::string &rkID);
+  OpenABE_ERROR transformKEM(const std::string &mpkID, const std::string &tkID,
+                             OpenABECiphertext *ciphertext, OpenABECiphertext *transformed);
+  OpenABE_ERROR finishTransformedKEM(const std::string &rkID, OpenABECiphertext *transformed,
+                                     uint32_t keyByteLen, const std::shared_ptr<OpenABESymKey>& key);
+
+private:
+  ZP keyRandomness(ZP &alpha, OpenABEByteString &nonce);
+  std::shared_ptr<OpenABEKey> mergeKeyDelta(OpenABEKey *decKey, OpenABEKey *delta);
+  std::shared_ptr<OpenABEKey> makeKeyDelta(const std::string &mpkID, const std::string &mskID,
+                                           OpenABEKey *decKey, OpenABEAttributeList *attrList,
+                                           const std::string &deltaID);
+  void pairingProduct(const std::string &keyID, OpenABEKey *decKey,
+                      OpenABECiphertext *ciphertext, GT &final);
+  std::unique_ptr<OpenABECPWatersCoupon> takeCoupon(const std::string &mpkID,
+                                                    const std::shared_ptr<OpenABEPrecomputedParams> &params);
+
+  std::mutex couponLock_;
+  std::map<std::string, std::shared_ptr<OpenABECPWatersCouponPool>> coupons_;
 };
 
 }
@@ -0,0 +1,79 @@
+/// 
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+/// 
+/// This file is part of Zeutro's OpenABE.
+/// 
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+/// 
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+/// 
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+/// 
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+///
+/// \file   zcontextcpwatersfd.h
+///
+/// \brief  Class definition for the fast-decryption variant of the
+///         Waters '11 CP-ABE scheme.
+///
+/// \source http://eprint.iacr.org/2008/290.pdf (Appendix A), with one
+///         ciphertext randomizer shared by every row
+///
+
+#ifndef __ZCONTEXTCPWATERSFD_H__
+#define __ZCONTEXTCPWATERSFD_H__
+
+///
+/// @class  OpenABEContextCPWatersFD
+///
+/// @brief  Waters CP-ABE with a single D = g2^r for the whole ciphertext.
+///         Each attribute may label up to OpenABE_CP_FD_ATTRIBUTE_USES
+///         rows of a policy and the key holds a KX per attribute and use,
+///         so decryption is three pairings whatever the policy, with the
+///         per-row work in G1 multi-exponentiations.
+///
+namespace oabe {
+
+class OpenABEContextCPWatersFD : public OpenABEContextABE {
+public:
+  // Constructors/destructors
+  OpenABEContextCPWatersFD(std::unique_ptr<OpenABERNG> rng);
+  ~OpenABEContextCPWatersFD();
+  bool debug;
+
+  OpenABE_ERROR generateParams(const std::string groupParams,
+                           const std::string &mpkID,
+                           const std::string &mskID);
+
+  OpenABE_ERROR generateDecryptionKey(OpenABEFunctionInput *keyInput, const std::string &keyID,
+                                  const std::string &mpkID, const std::string &mskID,
+                                  const std::string &gpkID, const std::string &GID);
+
+  OpenABE_ERROR encryptKEM(OpenABERNG *rng, const std::string &mpkID, const OpenABEFunctionInput *encryptInput,
+                       uint32_t keyByteLen, const std::shared_ptr<OpenABESymKey>& key, OpenABECiphertext *ciphertext);
+
+  OpenABE_ERROR estimateKEM(const std::string &mpkID, const OpenABEFunctionInput *encryptInput,
+                       uint32_t keyByteLen, OpenABECiphertext *skeleton,
+                       OpenABEEncryptionCost &cost);
+
+  OpenABE_ERROR decryptKEM(const std::string &mpkID, const std::string &keyID, OpenABECiphertext *ciphertext,
+                       uint32_t keyByteLen, const std::shared_ptr<OpenABESymKey>& key);
+};
+
+}
+
+#endif /* ifdef  __ZCONTEXTCPWATERSFD_H__ */
@@ -66,8 +66,16 @@ public:
   OpenABE_ERROR encryptKEM(OpenABERNG *rng, const std::string &mpkID, const OpenABEFunctionInput *encryptInput,
                        uint32_t keyByteLen, const std::shared_ptr<OpenABESymKey>& key, OpenABECiphertext *ciphertext);
 
+  OpenABE_ERROR estimateKEM(const std::string &mpkID, const OpenABEFunctionInput *encryptInput,
+                       uint32_t keyByteLen, OpenABECiphertext *skeleton,
+                       OpenABEEncryptionCost &cost);
+
   OpenABE_ERROR decryptKEM(const std::string &mpkID, const std::string &keyID, OpenABECiphertext *ciphertext,
                        uint32_t keyByteLen, const std::shared_ptr<OpenABESymKey>& key);
+
+  OpenABE_ERROR verifyKEM(OpenABERNG *rng, const std::string &mpkID, const OpenABEFunctionInput *encryptInput,
+                       uint32_t keyByteLen, const std::shared_ptr<OpenABESymKey>& key,
+                       OpenABECiphertext *ciphertext, uint32_t &numComponents);
 };
 
 }
@@ -44,12 +44,20 @@
 namespace oabe {
 
 class OpenABEContextPKE : public OpenABEContext {
+protected:
+  // X25519 has no OpenABEEllipticCurve: getECCurve() stays NULL and the
+  // keys and ciphertexts hold raw byte strings
+  bool m_X25519_;
+
 public:
   // Constructors/destructors
   OpenABEContextPKE();
   ~OpenABEContextPKE();
 
   OpenABE_ERROR	initializeCurve(const std::string groupParams);
+  bool isCurveSet() { return this->m_X25519_ || this->getECCurve() != nullptr; }
+  bool isX25519() { return this->m_X25519_; }
+  OpenABECurveID getCurveID();
   OpenABE_ERROR generateParams(OpenABESecurityLevel securityLevel);
   virtual bool validatePublicKey(const std::shared_ptr<OpenABEKey>& key) = 0;
   virtual bool validatePrivateKey(const std::shared_ptr<OpenABEKey>& key) = 0;
@@ -68,6 +76,14 @@ public:
   virtual OpenABE_ERROR decryptKEM(const std::string &pkID, const std::string &skID,
                                OpenABECiphertext *ciphertext, uint32_t keyBitLen,
                                const std::shared_ptr<OpenABESymKey>& key) = 0;
+
+  // one ephemeral key for several recipients: keys[i] is the key a
+  // decryptKEM by pkIDs[i] recovers from the shared ciphertext. A null
+  // senderID stands for each recipient's own ID.
+  virtual OpenABE_ERROR encryptKEMMulti(OpenABERNG *rng, const std::vector<std::string> &pkIDs,
+                               OpenABEByteString *senderID, uint32_t keyBitLen,
+                               std::vector<std::shared_ptr<OpenABESymKey>> &keys,
+                               OpenABECiphertext *ciphertext) = 0;
 };
 
 ///
@@ -79,6 +95,13 @@ public:
 ///
 
 class OpenABEContextOPDH : public OpenABEContextPKE {
+private:
+  OpenABE_ERROR deriveKey(OpenABEByteString &Z, OpenABEByteString &senderID,
+                          OpenABEByteString &recipientID, uint32_t keyBitLen,
+                          const std::shared_ptr<OpenABESymKey>& key);
+  void generateEphemeralX25519(OpenABERNG *rng, OpenABEByteString &e,
+                               OpenABECiphertext *ciphertext);
+
 public:
   // Constructors/destructors
   OpenABEContextOPDH(std::unique_ptr<OpenABERNG> rng);
@@ -99,6 +122,11 @@ public:
   OpenABE_ERROR decryptKEM(const std::string &pkID, const std::string &keyID,
                        OpenABECiphertext *ciphertext, uint32_t keyBitLen,
                        const std::shared_ptr<OpenABESymKey>& key);
+
+  OpenABE_ERROR encryptKEMMulti(OpenABERNG *rng, const std::vector<std::string> &pkIDs,
+                       OpenABEByteString *senderID, uint32_t keyBitLen,
+                       std::vector<std::shared_ptr<OpenABESymKey>> &keys,
+                       OpenABECiphertext *ciphertext);
 };
 
 
@@ -126,6 +154,20 @@ public:
   OpenABE_ERROR keygen(const std::string &keyID, const std::string &pkID, const std::string &skID);
   OpenABE_ERROR encrypt(OpenABERNG *rng, const std::string &pkID, const std::string &senderpkID,
                     const std::string& plaintext, OpenABECiphertext *ciphertext);
+  // the two halves of encrypt, for callers that prepare the payload while
+  // the key is being derived: encapsulate fills the KEM part of the
+  // ciphertext, seal encrypts the payload (read in place) and wipes the key
+  OpenABE_ERROR encapsulate(OpenABERNG *rng, const std::string &pkID, const std::string &senderpkID,
+                        const std::shared_ptr<OpenABESymKey> &key, OpenABECiphertext *ciphertext);
+  OpenABE_ERROR seal(const std::shared_ptr<OpenABESymKey> &key, const uint8_t *plaintext,
+                 size_t plaintextLen, OpenABECiphertext *ciphertext);
+  // encrypt the payload once for several recipients: a random data key
+  // seals the payload and is wrapped under each recipient's KEM key (all
+  // derived from one ephemeral key). An empty senderpkID makes each
+  // recipient its own sender, as OpenPKEContext does. decrypt reads both forms.
+  OpenABE_ERROR encryptMulti(OpenABERNG *rng, const std::vector<std::string> &pkIDs,
+                    const std::string &senderpkID, const std::string &plaintext,
+                    OpenABECiphertext *ciphertext);
   OpenABE_ERROR decrypt(const std::string &pkID, const std::string &skID,
                     std::string &plaintext, OpenABECiphertext *ciphertext);
 };
@@ -35,10 +35,19 @@
 #define __ZCONTEXTPKSIG_H__
 
 #include <memory>
+#include <vector>
 #include <openabe/zml/zecdsa.h>
 
 namespace oabe {
 
+/// A message and signature to check against the public key 'keyID'. The
+/// byte strings are owned by the caller.
+struct OpenABESignedMessage {
+  std::string keyID;
+  OpenABEByteString *message;
+  OpenABEByteString *signature;
+};
+
 class OpenABEContextPKSIG : public OpenABEContext {
 protected:
   ecdsa_context_t ecdsa_ctx;
@@ -59,6 +68,59 @@ public:
   OpenABE_ERROR keygen(const std::string &pkID, const std::string &skID);
   OpenABE_ERROR sign(OpenABEPKey *privKey, OpenABEByteString *message, OpenABEByteString *signature);
   OpenABE_ERROR verify(OpenABEPKey *pubKey, OpenABEByteString *message, OpenABEByteString *signature);
+  // the same over caller buffers, which are read in place
+  OpenABE_ERROR sign(OpenABEPKey *privKey, const uint8_t *message, size_t messageLen,
+                     OpenABEByteString *signature);
+  OpenABE_ERROR verify(OpenABEPKey *pubKey, const uint8_t *message, size_t messageLen,
+                       const uint8_t *signature, size_t signatureLen);
+};
+
+
+///
+/// @class  OpenABEContextBLSSIG
+///
+/// @brief  BLS signatures over the pairing group, with short signatures:
+///         a signature is H(pk || m)^sk in G1 and the public key is g2^sk.
+///         Hashing the signer's public key in with the message (message
+///         augmentation) lets signatures by any keys on any messages be
+///         aggregated without proofs of possession. Aggregate and batch
+///         verification share one multi-pairing: one Miller loop per
+///         distinct key plus one, and a single final exponentiation.
+///
+
+class OpenABEContextBLSSIG : public OpenABEContext {
+protected:
+  bool validatePublicKey(const std::shared_ptr<OpenABEKey>& key);
+  bool validatePrivateKey(const std::shared_ptr<OpenABEKey>& key);
+  G1 hashMessage(OpenABEKey *pubKey, const uint8_t *message, size_t messageLen);
+  bool loadSignature(G1 &sig, const uint8_t *signature, size_t signatureLen);
+  // e(sig, g2)^-1 * prod_i e(hashes[i], pubKeys[i]) == 1
+  bool checkPairingProduct(const G1 &sig, std::vector<G1> &hashes,
+                           const std::vector<OpenABEKey*> &pubKeys);
+
+public:
+  OpenABEContextBLSSIG(std::unique_ptr<OpenABERNG> rng);
+  ~OpenABEContextBLSSIG();
+
+  OpenABE_ERROR initializeCurve(const std::string groupParams);
+  OpenABE_ERROR generateParams(const std::string groupParams);
+  OpenABE_ERROR keygen(const std::string &pkID, const std::string &skID);
+  OpenABE_ERROR exportKey(const std::string &keyID, OpenABEByteString &keyBlob);
+  OpenABE_ERROR loadPublicKey(const std::string &keyID, OpenABEByteString &keyBlob);
+  OpenABE_ERROR loadPrivateKey(const std::string &keyID, OpenABEByteString &keyBlob);
+
+  OpenABE_ERROR sign(const std::string &skID, const uint8_t *message, size_t messageLen,
+                     OpenABEByteString *signature);
+  OpenABE_ERROR verify(const std::string &pkID, const uint8_t *message, size_t messageLen,
+                       const uint8_t *signature, size_t signatureLen);
+  size_t verifyBatch(const std::vector<OpenABESignedMessage> &items,
+                     std::vector<OpenABE_ERROR> &results);
+  OpenABE_ERROR aggregate(const std::vector<OpenABEByteString*> &signatures,
+                          OpenABEByteString *aggregate);
+  // items[i].signature is unused: every message is checked against the
+  // one aggregate signature
+  OpenABE_ERROR verifyAggregate(const std::vector<OpenABESignedMessage> &items,
+                                OpenABEByteString *aggregate);
 };
 
 
@@ -70,10 +132,13 @@ public:
 
 class OpenABEContextSchemePKSIG : ZObject {
 private:
+  // exactly one of the two is set: ECDSA or BLS
   std::unique_ptr<OpenABEContextPKSIG>	m_PKSIG;
+  std::unique_ptr<OpenABEContextBLSSIG>	m_BLS;
 
 public:
   OpenABEContextSchemePKSIG(std::unique_ptr<OpenABEContextPKSIG> pksig);
+  OpenABEContextSchemePKSIG(std::unique_ptr<OpenABEContextBLSSIG> bls);
   ~OpenABEContextSchemePKSIG();
 
   OpenABE_ERROR exportKey(const std::string &keyID, OpenABEByteString &keyBlob);
@@ -85,6 +150,20 @@ public:
   OpenABE_ERROR keygen(const std::string &pkID, const std::string &skID);
   OpenABE_ERROR sign(const std::string &skID, OpenABEByteString *message, OpenABEByteString *signature);
   OpenABE_ERROR verify(const std::string &pkID, OpenABEByteString *message, OpenABEByteString *signature);
+  OpenABE_ERROR sign(const std::string &skID, const uint8_t *message, size_t messageLen,
+                     OpenABEByteString *signature);
+  OpenABE_ERROR verify(const std::string &pkID, const uint8_t *message, size_t messageLen,
+                       const uint8_t *signature, size_t signatureLen);
+  // verify many signatures at once: results[i] is the outcome for items[i].
+  // Returns the number of valid signatures.
+  size_t verifyBatch(const std::vector<OpenABESignedMessage> &items,
+                     std::vector<OpenABE_ERROR> &results);
+  // signature aggregation (BLS only; OpenABE_ERROR_NOT_IMPLEMENTED otherwise)
+  bool supportsAggregation() const { return this->m_BLS != nullptr; }
+  OpenABE_ERROR aggregate(const std::vector<OpenABEByteString*> &signatures,
+                          OpenABEByteString *aggregate);
+  OpenABE_ERROR verifyAggregate(const std::vector<OpenABESignedMessage> &items,
+                                OpenABEByteString *aggregate);
 };
 
 }
@@ -61,11 +61,13 @@
 #else
  #define DEBUG_ELEMENT_PRINTF(...)
  // For functions returning OpenABE_ERROR
+ // (release builds only return the error: failed decryptions are expected
+ // and must stay cheap)
  #define OpenABE_LOG_AND_THROW(str, err)                                            \
-  do { fprintf(stderr, "ERROR: %s (code: %d)\n", str, err); return (err); } while(0)
+  do { return (err); } while(0)
  // For void functions
  #define OpenABE_LOG_AND_THROW_VOID(str)                                            \
-  do { fprintf(stderr, "ERROR: %s\n", str); return; } while(0)
+  do { return; } while(0)
  #define OpenABE_LOG(str) /* do nothing */
 #endif
 
@@ -86,20 +88,33 @@ typedef enum _OpenABE_STATE {
 typedef enum _OpenABE_SCHEME {
   OpenABE_SCHEME_NONE = 0,
   OpenABE_SCHEME_PKSIG_ECDSA = 60,
+  OpenABE_SCHEME_PKSIG_BLS = 61,
   OpenABE_SCHEME_AES_GCM = 70,
   OpenABE_SCHEME_PK_OPDH = 100,
   OpenABE_SCHEME_CP_WATERS = 101,
   OpenABE_SCHEME_KP_GPSW = 102,
+  OpenABE_SCHEME_CP_FAME = 103,
+  OpenABE_SCHEME_CP_WATERS_FD = 104,
   OpenABE_SCHEME_CP_WATERS_CCA = 201,
-  OpenABE_SCHEME_KP_GPSW_CCA = 202
+  OpenABE_SCHEME_KP_GPSW_CCA = 202,
+  OpenABE_SCHEME_CP_FAME_CCA = 203,
+  OpenABE_SCHEME_CP_WATERS_FD_CCA = 204,
+  OpenABE_SCHEME_CP_WATERS_HCCA = 211,
+  OpenABE_SCHEME_KP_GPSW_HCCA = 212,
+  OpenABE_SCHEME_CP_FAME_HCCA = 213,
+  OpenABE_SCHEME_CP_WATERS_FD_HCCA = 214
 } OpenABE_SCHEME;
 
 //
 // hash function prefix definitions
 #define CCA_HASH_FUNCTION_ONE 0x1A
 #define CCA_HASH_FUNCTION_TWO 0x1F
+#define CCA_HASH_FUNCTION_THREE 0x1B
+#define CCA_HASH_FUNCTION_FOUR 0x1C
 #define SCHEME_HASH_FUNCTION 0x2A
 #define KDF_HASH_FUNCTION_PREFIX 0x2B
+#define KEYGEN_HASH_FUNCTION 0x2C
+#define POLICY_HASH_FUNCTION 0x2D
 
 #define OpenABE_MAX_KDF_BITLENGTH 0xFFFFFFFF
 //
@@ -113,7 +128,14 @@ typedef uint32_t OpenABESecurityLevel;
 //
 
 #include <openabe/zobject.h>
+#include <openabe/utils/ztrace.h>
+#include <openabe/utils/zmetrics.h>
+#include <openabe/utils/zcpu.h>
+#include <openabe/utils/zthreadpool.h>
 #include <openabe/utils/zconstants.h>
+#include <openabe/utils/zarena.h>
+#include <openabe/utils/zprecompute.h>
+#include <openabe/utils/zrwlock.h>
 #include <openabe/utils/zbytestring.h>
 #include <openabe/utils/zfunctioninput.h>
 #include <openabe/utils/zpolicy.h>
@@ -136,6 +158,7 @@ extern "C" {
 #include <openabe/zml/zelement_ec.h>
 #include <openabe/zml/zelliptic.h>
 #include <openabe/zml/zpairing.h>
+#include <openabe/zml/zfixedbase.h>
 #include <openabe/tools/zprng.h>
 #include <openabe/utils/zexception.h>
 #include <openabe/utils/zcryptoutils.h>
@@ -158,7 +181,13 @@ extern "C" {
 #include <openabe/zcontextcca.h>
 #include <openabe/low/abe/zcontextcpwaters.h>
 #include <openabe/low/abe/zcontextkpgpsw.h>
+#include <openabe/low/abe/zcontextcpfame.h>
+#include <openabe/low/abe/zcontextcpwatersfd.h>
 #include <openabe/utils/zdriver.h>
+#include <openabe/utils/zkeystorelog.h>
+#include <openabe/utils/zctblock.h>
+#include <openabe/utils/zkeyring.h>
+#include <openabe/utils/zperiodtree.h>
 #include <openabe/utils/zkeymgr.h>
 #include <openabe/utils/zx509.h>
 #include <openabe/zcrypto_box.h>
@@ -180,9 +209,16 @@ const std::string DEFAULT_EC_PARAM = "NIST_P256";
 ///
 
 #define OpenABE_EC_DSA "EC-DSA"
+#define OpenABE_BLS_SIG "BLS-SIG"
 #define OpenABE_PK_ENC "PK-ENC"
 #define OpenABE_CP_ABE "CP-ABE"
 #define OpenABE_KP_ABE "KP-ABE"
+#define OpenABE_CP_FAME "CP-FAME"
+#define OpenABE_CP_ABE_FD "CP-ABE-FD"
+#define OpenABE_CP_ABE_HCCA "CP-ABE-HCCA"
+#define OpenABE_KP_ABE_HCCA "KP-ABE-HCCA"
+#define OpenABE_CP_FAME_HCCA "CP-FAME-HCCA"
+#define OpenABE_CP_ABE_FD_HCCA "CP-ABE-FD-HCCA"
 #define OpenABE_MA_ABE "MA-ABE"
 
 ///
@@ -223,6 +259,7 @@ OpenABE_createContextABESchemeCCAWithATZN(OpenABE_SCHEME scheme_type);
 
 // PKSIG scheme context API
 std::unique_ptr<OpenABEContextSchemePKSIG> OpenABE_createContextPKSIGScheme();
+std::unique_ptr<OpenABEContextSchemePKSIG> OpenABE_createContextPKSIGScheme(OpenABE_SCHEME scheme_type);
 
 // curve to/from string conversion functions
 OpenABECurveID OpenABE_getCurveID(uint8_t id);
@@ -35,6 +35,7 @@
 #ifndef __ZLSSS_H__
 #define __ZLSSS_H__
 
+#include <memory>
 #include <stack>
 #include <vector>
 
@@ -78,6 +79,82 @@ typedef std::map<const std::string, OpenABELSSSElement> OpenABELSSSRowMap;
 /// \brief      Iterator for vector of results in an LSSS
 typedef OpenABELSSSRowMap::iterator OpenABELSSSRowMapIterator;
 
+/// \struct OpenABELSSSRow
+/// \brief  A row picked by coefficient recovery: its index in the compiled
+///         policy (see OpenABELSSSCompiledPolicy::rowLabel) and its
+///         coefficient.
+struct OpenABELSSSRow {
+  uint32_t index;
+  ZP coefficient;
+};
+
+/// \typedef    OpenABELSSSRowVector
+/// \brief      Recovered rows in row order
+typedef std::vector<OpenABELSSSRow> OpenABELSSSRowVector;
+
+/// \typedef    OpenABELSSSMatrixRow
+/// \brief      Non-zero (column, value) entries of a row of the share
+///             matrix, by increasing column
+typedef std::vector<std::pair<uint32_t, ZP>> OpenABELSSSMatrixRow;
+
+// result of one coefficient recovery, as kept by the decryption plan cache
+struct OpenABELSSSPlan;
+
+/// \class  OpenABELSSSCompiledPolicy
+/// \brief  Share-generation layout of a policy tree, computed once and
+///         reused by every encryption under that policy. Holds the order in
+///         which gates are visited, their thresholds and where each share
+///         lands, plus the rows in the order of OpenABELSSSRowMap. Immutable
+///         after construction, so it may be shared between threads.
+class OpenABELSSSCompiledPolicy {
+public:
+  OpenABELSSSCompiledPolicy(const OpenABEPolicy *policy);
+  // the layout attached to the policy, or one compiled for this caller
+  static std::shared_ptr<const OpenABELSSSCompiledPolicy> forPolicy(const OpenABEPolicy *policy);
+
+  size_t numRows() const { return this->m_RowLabels.size(); }
+  // unique label of a row (the key used in OpenABELSSSRowMap)
+  const std::string& rowLabel(size_t i) const { return this->m_RowLabels[i]; }
+  // attribute (prefix included) of a row
+  const std::string& rowAttribute(size_t i) const { return this->m_RowAttributes[i]; }
+  const std::vector<std::string>& rowAttributes() const { return this->m_RowAttributes; }
+  // OpenABEHashKey() of the row label and of the row attribute: the
+  // suffixes of the element labels that belong to a row
+  const std::string& rowKey(size_t i) const { return this->m_RowKeys[i]; }
+  const std::string& rowAttributeKey(size_t i) const { return this->m_RowAttributeKeys[i]; }
+  // index of the row with the given unique label, or numRows() if none
+  size_t findRow(const std::string &label) const;
+  // whether attrs satisfy the policy, and the fewest leaves that do so
+  // (the same answer as checkIfSatisfied, without touching the tree)
+  std::pair<bool,int> satisfiedBy(const OpenABEAttributeBitset &attrs) const;
+  // the fewest rows any satisfying attribute set combines
+  uint32_t minRows() const { return (uint32_t)this->satisfiedBy(this->m_LeafBits).second; }
+
+private:
+  friend class OpenABELSSS;
+  // One node of the tree in visiting order. A gate reads the share in
+  // 'slot' and writes the shares of its children to slots
+  // [firstChild, firstChild + numChildren); a leaf copies its slot to 'row'.
+  struct Step {
+    bool isLeaf;
+    uint32_t slot;
+    uint32_t threshold;
+    uint32_t firstChild;
+    uint32_t numChildren;
+    uint32_t row;
+  };
+  std::vector<Step> m_Steps;
+  uint32_t m_NumSlots;
+  uint32_t m_MaxThreshold;
+  std::vector<std::string> m_RowLabels, m_RowAttributes;
+  std::vector<std::string> m_RowKeys, m_RowAttributeKeys;
+  // interned ID of each row's attribute, and all of them as a set
+  std::vector<uint32_t> m_RowAttributeIds;
+  OpenABEAttributeBitset m_LeafBits;
+  uint32_t m_NumLeaves;
+  bool m_AllLeavesRequired;
+};
+
 /// \class	ZLSSS
 /// \brief	Secret sharing class.
 
@@ -86,8 +163,12 @@ protected:
   OpenABEPairing *m_Pairing;
   OpenABERNG *m_RNG;
   OpenABELSSSRowMap	m_ResultMap;
+  // the last recovery, possibly shared with the decryption plan cache. A
+  // cached plan's row map is only copied into m_ResultMap by getRows().
+  std::shared_ptr<const OpenABELSSSPlan> m_Plan;
+  bool m_ResultMapPending;
   bool debug;
-  ZP zero, iPlusOne, indexPlusOne;
+  ZP zero;
   std::map<std::string, int> m_AttrCount;
 
   // Protected methods
@@ -95,13 +176,16 @@ protected:
   bool performCoefficientRecovery(OpenABEPolicy *policy, OpenABEAttributeList *attrList);
 
   void addShareToResults(OpenABETreeNode *treeNode, ZP &elt);
-  bool clearExistingResults() { this->m_ResultMap.clear(); return true; }
+  bool clearExistingResults() {
+    this->m_ResultMap.clear();
+    this->m_Plan.reset();
+    this->m_ResultMapPending = false;
+    return true;
+  }
   inline std::string makeUniqueLabel(const OpenABETreeNode *treeNode);
   inline ZP evaluatePolynomial(std::vector<ZP> &coefficients, uint32_t x);
 
-  void iterativeShareSecret(OpenABETreeNode *treeNode, ZP &elt);
   bool iterativeCoefficientRecover(OpenABETreeNode *treeNode, ZP &inCoeff);
-  inline ZP calculateCoefficient(OpenABETreeNode *treeNode, uint32_t index, uint32_t threshold, uint32_t total);
 
 public:
   OpenABELSSS(OpenABEPairing *pairing, OpenABERNG *rng);
@@ -109,10 +193,26 @@ public:
     
   // Public secret sharing and recovery methods
   void shareSecret(const OpenABEFunctionInput *input, ZP &elt);
+  // share elt over a compiled policy; shares[i] belongs to compiled.rowLabel(i)
+  void shareSecret(const OpenABELSSSCompiledPolicy &compiled, ZP &elt,
+                   std::vector<ZP> &shares);
+  // the share-generating matrix M behind shareSecret(): share i is
+  // M_i . (elt, c_1, ..., c_m) where c_1 ... c_m are the random coefficients
+  // of the gates in visiting order, so column 0 belongs to the secret.
+  // The coefficients of recoverCoefficients() combine the rows into
+  // (1, 0, ..., 0).
+  void shareMatrix(const OpenABELSSSCompiledPolicy &compiled,
+                   std::vector<OpenABELSSSMatrixRow> &rows, uint32_t &numColumns);
   bool recoverCoefficients(OpenABEPolicy *policy, OpenABEAttributeList *attrList);
+  // as above, reusing a cached plan for this key, policy and attribute list
+  bool recoverCoefficients(const std::string &keyID, OpenABEPolicy *policy,
+                           OpenABEAttributeList *attrList);
 
   // Methods for obtaining the rows
-  OpenABELSSSRowMap&            getRows() { return m_ResultMap; }
+  OpenABELSSSRowMap&            getRows();
+  // rows and coefficients of the last recoverCoefficients() call, in row
+  // order of the policy's compiled layout; no copy is made
+  const OpenABELSSSRowVector&   getRecoveredRows() const;
 	
 #ifndef OpenABE_NO_TEST_ROUTINES
 	//
@@ -125,6 +225,9 @@ public:
 bool iterativeScanTree(OpenABETreeNode *treeNode, OpenABEAttributeList *attributeList);
 bool determineIfNodeShouldBeMarked(uint32_t threshold, OpenABETreeNode *node);
 std::pair<bool,int> checkIfSatisfied(OpenABEPolicy *policy, OpenABEAttributeList *attr_list, bool reset_flags=true);
+// drop the decryption plans kept by OpenABELSSS::recoverCoefficients(keyID, ...)
+void clearDecryptionPlanCache();
+size_t getDecryptionPlanCacheCount();
 
 }
 
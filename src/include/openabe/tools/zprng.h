@@ -52,6 +52,7 @@
 #define OpenABE_CTR_DRBG_MAX_INPUT_LENGTH   256     /* Maximum number of additional input bytes */
 #define OpenABE_CTR_DRBG_MAX_REQUEST        1024    /* Maximum number of requested bytes per call */
 #define OpenABE_CTR_DRBG_MAX_SEED_INPUT     384     /* Maximum size of (re)seed buffer */
+#define OpenABE_RNG_POOL_SIZE               4096    /* Bytes drawn at once by OpenABEBufferedRNG */
 
 #define OpenABE_ERR_CTR_DRBG_ENTROPY_SOURCE_FAILED  -0x0034  /* The entropy source failed. */
 #define OpenABE_ERR_CTR_DRBG_REQUEST_TOO_BIG        -0x0036  /* Too many random requested in single call. */
@@ -68,6 +69,9 @@ public:
 	~OpenABERNG();
 
 	virtual void setSeed(OpenABEByteString& nonce) { return; }
+	// true if the output is a function of the seed that must be reproducible,
+	// so callers may not substitute randomness generated elsewhere
+	virtual bool isDeterministic() const { return false; }
 	virtual int getRandomBytes(uint8_t *buf, size_t buf_len) {
 	    ASSERT_RNG(RAND_bytes(buf, buf_len)); return 1;
 	}
@@ -200,10 +204,50 @@ public:
   ~OpenABECTR_DRBG() { };
 
   void setSeed(OpenABEByteString& nonce);
+  bool isDeterministic() const { return true; }
   int getRandomBytes(uint8_t *buf, size_t buf_len);
   int getRandomBytes(OpenABEByteString *buf, size_t buf_len);
 };
 
+/// \class  OpenABEBufferedRNG
+/// \brief  Draws from another RNG in blocks of block_size bytes and hands out
+///         slices of them, so the many scalar-sized requests of an operation
+///         cost one call to the source. Bytes are zeroized as they are handed
+///         out. Not thread-safe, and not for a deterministic DRBG whose output
+///         has to be reproduced (the byte stream differs from unbuffered use).
+class OpenABEBufferedRNG : public OpenABERNG {
+private:
+  OpenABERNG *source_;
+  std::vector<uint8_t> pool_;
+  size_t pos_;
+
+public:
+  OpenABEBufferedRNG(OpenABERNG *source, size_t block_size = OpenABE_RNG_POOL_SIZE);
+  ~OpenABEBufferedRNG();
+
+  // drops whatever is left in the pool
+  void discard();
+  bool isDeterministic() const { return this->source_->isDeterministic(); }
+  int getRandomBytes(uint8_t *buf, size_t buf_len);
+  int getRandomBytes(OpenABEByteString *buf, size_t buf_len);
+};
+
+/// \class  OpenABEThreadRNG
+/// \brief  RNG backed by a CTR_DRBG owned by the calling thread, so that
+///         concurrent operations do not contend on a lock. Each thread's DRBG
+///         is seeded on first use from a process-wide root DRBG (seeded from
+///         the OpenSSL RNG), reseeds from it every
+///         OpenABE_CTR_DRBG_RESEED_INTERVAL requests, and starts over in a
+///         forked child. Small requests are served from a per-thread
+///         OpenABEBufferedRNG pool. The object holds no state of its own.
+class OpenABEThreadRNG : public OpenABERNG {
+public:
+  OpenABEThreadRNG() {};
+  ~OpenABEThreadRNG() {};
+
+  int getRandomBytes(uint8_t *buf, size_t buf_len);
+  int getRandomBytes(OpenABEByteString *buf, size_t buf_len);
+};
 
 }
 
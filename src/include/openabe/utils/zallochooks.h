@@ -0,0 +1,80 @@
+///
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+///
+/// This file is part of Zeutro's OpenABE.
+///
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+///
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+///
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+/// \file   zallochooks.h
+///
+/// \brief  Replacement operator new/delete that feed the allocation metrics.
+///
+/// \author J. Ayo Akinyele
+///
+
+#ifndef __ZALLOCHOOKS_H__
+#define __ZALLOCHOOKS_H__
+
+#include <cstdlib>
+#include <new>
+#include <openabe/utils/zmetrics.h>
+
+// room in front of each block for its size, keeping the block aligned
+#define OpenABE_ALLOCATION_HEADER   16
+
+///
+/// Expand once, at namespace scope in one source file of a program (a
+/// replaced operator new applies to the whole program, including the
+/// library). While metrics are enabled, every allocation is then counted
+/// into OpenABE_METRIC_ALLOCATIONS / ALLOCATED_BYTES and into the heap
+/// high-water mark of the API call running on the thread. When disabled,
+/// each allocation costs one relaxed atomic load on top of malloc.
+///
+#define OpenABE_DEFINE_ALLOCATION_HOOKS                                        \
+  void *operator new(size_t size) {                                            \
+    char *p = (char *)std::malloc(size + OpenABE_ALLOCATION_HEADER);           \
+    if (p == nullptr) {                                                        \
+      throw std::bad_alloc();                                                  \
+    }                                                                          \
+    *(size_t *)p = size;                                                       \
+    oabe::metrics::allocated(size);                                            \
+    return p + OpenABE_ALLOCATION_HEADER;                                      \
+  }                                                                            \
+  void operator delete(void *ptr) noexcept {                                   \
+    if (ptr != nullptr) {                                                      \
+      char *p = (char *)ptr - OpenABE_ALLOCATION_HEADER;                       \
+      oabe::metrics::freed(*(size_t *)p);                                      \
+      std::free(p);                                                            \
+    }                                                                          \
+  }                                                                            \
+  void *operator new(size_t size, const std::nothrow_t&) noexcept {            \
+    try {                                                                      \
+      return operator new(size);                                               \
+    } catch (...) {                                                            \
+      return nullptr;                                                          \
+    }                                                                          \
+  }                                                                            \
+  void operator delete(void *ptr, const std::nothrow_t&) noexcept {            \
+    operator delete(ptr);                                                      \
+  }
+
+#endif // __ZALLOCHOOKS_H__
@@ -0,0 +1,314 @@
+/// 
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+/// 
+/// This file is part of Zeutro's OpenABE.
+/// 
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+/// 
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+/// 
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+/// 
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+///
+/// \file   zarena.h
+///
+/// \brief  Operation-scoped arenas for short-lived temporaries and secrets.
+///
+/// \author J. Ayo Akinyele
+///
+
+#ifndef __ZARENA_H__
+#define __ZARENA_H__
+
+#include <cstddef>
+#include <deque>
+#include <new>
+#include <stack>
+#include <vector>
+
+namespace oabe {
+
+///
+/// @class  OpenABEArena
+///
+/// @brief  Monotonic buffer for the temporaries of a single operation
+///         (encrypt, decrypt, keygen). Allocations bump a pointer through a
+///         chain of blocks and are only returned all at once, when the arena
+///         is released or destroyed. An arena is not thread-safe and must
+///         outlive everything allocated from it.
+///
+
+class OpenABEArena {
+public:
+  OpenABEArena(size_t blockSize = OpenABE_ARENA_BLOCK_SIZE);
+  ~OpenABEArena();
+
+  void *allocate(size_t bytes, size_t alignment);
+  // free every block at once
+  void release();
+  // total bytes handed out since construction or the last release
+  size_t bytesAllocated() const { return this->bytesAllocated_; }
+
+  // the arena installed on the calling thread by OpenABEArenaScope (or NULL)
+  static OpenABEArena *current();
+
+private:
+  friend class OpenABEArenaScope;
+  struct Block;
+
+  OpenABEArena(const OpenABEArena &);
+  OpenABEArena &operator=(const OpenABEArena &);
+
+  Block *head_;
+  char *cursor_;
+  char *end_;
+  size_t blockSize_;
+  size_t bytesAllocated_;
+};
+
+///
+/// @class  OpenABEArenaScope
+///
+/// @brief  Makes an arena the current one for the calling thread until the
+///         scope ends. Scopes nest; the previous arena is restored on exit.
+///         Worker threads never see the caller's arena.
+///
+
+class OpenABEArenaScope {
+public:
+  OpenABEArenaScope(OpenABEArena &arena);
+  ~OpenABEArenaScope();
+
+private:
+  OpenABEArenaScope(const OpenABEArenaScope &);
+  OpenABEArenaScope &operator=(const OpenABEArenaScope &);
+
+  OpenABEArena *previous_;
+};
+
+///
+/// @class  OpenABEArenaAllocator
+///
+/// @brief  Standard allocator that draws from the arena current at the time
+///         it is constructed, or from the heap when there is none.
+///         Deallocation is a no-op for arena memory.
+///
+
+template <typename T>
+class OpenABEArenaAllocator {
+public:
+  typedef T value_type;
+
+  OpenABEArenaAllocator() : arena_(OpenABEArena::current()) {}
+  explicit OpenABEArenaAllocator(OpenABEArena *arena) : arena_(arena) {}
+  template <typename U>
+  OpenABEArenaAllocator(const OpenABEArenaAllocator<U> &other)
+      : arena_(other.arena()) {}
+
+  T *allocate(size_t n) {
+    if (n > (size_t)-1 / sizeof(T)) {
+      throw std::bad_alloc();
+    }
+    if (this->arena_ == NULL) {
+      return static_cast<T *>(::operator new(n * sizeof(T)));
+    }
+    return static_cast<T *>(this->arena_->allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T *p, size_t) {
+    if (this->arena_ == NULL) {
+      ::operator delete(p);
+    }
+  }
+
+  OpenABEArena *arena() const { return this->arena_; }
+
+private:
+  OpenABEArena *arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const OpenABEArenaAllocator<T> &x,
+                const OpenABEArenaAllocator<U> &y) {
+  return x.arena() == y.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const OpenABEArenaAllocator<T> &x,
+                const OpenABEArenaAllocator<U> &y) {
+  return x.arena() != y.arena();
+}
+
+///
+/// \typedef    OpenABEArenaVector
+/// \brief      Vector whose storage comes from the current arena
+///
+template <typename T>
+using OpenABEArenaVector = std::vector<T, OpenABEArenaAllocator<T>>;
+
+///
+/// \typedef    OpenABEArenaStack
+/// \brief      Stack whose storage comes from the current arena
+///
+template <typename T>
+using OpenABEArenaStack = std::stack<T, std::deque<T, OpenABEArenaAllocator<T>>>;
+
+void OpenABEZeroize(void *b, size_t b_len);
+
+///
+/// @class  OpenABESecureArena
+///
+/// @brief  Bump arena for secret temporaries (derived keys, KDF inputs).
+///         Its memory is mapped between two inaccessible guard pages,
+///         locked into RAM where the process is allowed to (mlock) and kept
+///         out of core dumps. Nothing is wiped per allocation: rewinding to
+///         a mark zeroizes everything allocated since in one pass. Like
+///         OpenABEArena it is not thread-safe; forThread() gives every thread
+///         its own, which keeps its first region mapped (and locked) between
+///         uses.
+///
+
+class OpenABESecureArena {
+public:
+  struct Mark {
+    void *region;
+    char *cursor;
+    size_t bytes;
+  };
+
+  OpenABESecureArena(size_t regionSize = OpenABE_SECURE_ARENA_SIZE);
+  ~OpenABESecureArena();
+
+  void *allocate(size_t bytes, size_t alignment);
+  Mark mark() const;
+  // zeroize and give back everything allocated since the mark
+  void rewind(const Mark &mark);
+  // zeroize and unmap every region
+  void release();
+  size_t bytesAllocated() const { return this->bytesAllocated_; }
+  // false if any region could not be locked (e.g. RLIMIT_MEMLOCK)
+  bool isLocked() const { return this->locked_; }
+
+  // the arena installed by OpenABESecureArenaScope on this thread (or NULL)
+  static OpenABESecureArena *current();
+  // this thread's own secure arena
+  static OpenABESecureArena &forThread();
+
+private:
+  friend class OpenABESecureArenaScope;
+  struct Region;
+
+  static Region *mapRegion(size_t bytes, bool &locked);
+  static void unmapRegion(Region *region);
+
+  OpenABESecureArena(const OpenABESecureArena &);
+  OpenABESecureArena &operator=(const OpenABESecureArena &);
+
+  Region *head_;
+  char *cursor_;
+  size_t regionSize_;
+  size_t bytesAllocated_;
+  bool locked_;
+};
+
+///
+/// @class  OpenABESecureArenaScope
+///
+/// @brief  Makes a secure arena the current one for the calling thread and,
+///         when the scope ends, zeroizes everything allocated from it within
+///         the scope and restores the previous arena. Scopes nest.
+///
+
+class OpenABESecureArenaScope {
+public:
+  OpenABESecureArenaScope(OpenABESecureArena &arena);
+  ~OpenABESecureArenaScope();
+
+private:
+  OpenABESecureArenaScope(const OpenABESecureArenaScope &);
+  OpenABESecureArenaScope &operator=(const OpenABESecureArenaScope &);
+
+  OpenABESecureArena &arena_;
+  OpenABESecureArena::Mark mark_;
+  OpenABESecureArena *previous_;
+};
+
+///
+/// @class  OpenABESecureAllocator
+///
+/// @brief  Standard allocator that draws from the secure arena current at
+///         the time it is constructed. Without one it uses the heap and
+///         zeroizes each block as it is freed.
+///
+
+template <typename T>
+class OpenABESecureAllocator {
+public:
+  typedef T value_type;
+
+  OpenABESecureAllocator() : arena_(OpenABESecureArena::current()) {}
+  explicit OpenABESecureAllocator(OpenABESecureArena *arena) : arena_(arena) {}
+  template <typename U>
+  OpenABESecureAllocator(const OpenABESecureAllocator<U> &other)
+      : arena_(other.arena()) {}
+
+  T *allocate(size_t n) {
+    if (n > (size_t)-1 / sizeof(T)) {
+      throw std::bad_alloc();
+    }
+    if (this->arena_ == NULL) {
+      return static_cast<T *>(::operator new(n * sizeof(T)));
+    }
+    return static_cast<T *>(this->arena_->allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T *p, size_t n) {
+    if (this->arena_ == NULL) {
+      OpenABEZeroize(p, n * sizeof(T));
+      ::operator delete(p);
+    }
+  }
+
+  OpenABESecureArena *arena() const { return this->arena_; }
+
+private:
+  OpenABESecureArena *arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const OpenABESecureAllocator<T> &x,
+                const OpenABESecureAllocator<U> &y) {
+  return x.arena() == y.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const OpenABESecureAllocator<T> &x,
+                const OpenABESecureAllocator<U> &y) {
+  return x.arena() != y.arena();
+}
+
+///
+/// \typedef    OpenABESecureVector
+/// \brief      Vector whose storage comes from the current secure arena
+///
+template <typename T>
+using OpenABESecureVector = std::vector<T, OpenABESecureAllocator<T>>;
+
+}
+
+#endif /* __ZARENA_H__ */
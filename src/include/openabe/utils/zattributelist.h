@@ -40,6 +40,32 @@
 #define ATTR_SEP     '|'
 namespace oabe {
 
+///
+/// @class  OpenABEAttributeBitset
+///
+/// @brief  Set of attributes, one bit per interned attribute ID
+///         (see OpenABEInternAttribute).
+///
+class OpenABEAttributeBitset {
+public:
+  void set(uint32_t id);
+  bool test(uint32_t id) const {
+    size_t w = id / 64;
+    return w < this->m_Words.size() && ((this->m_Words[w] >> (id % 64)) & 1);
+  }
+  bool isSubsetOf(const OpenABEAttributeBitset &other) const;
+  bool intersects(const OpenABEAttributeBitset &other) const;
+  void clear() { this->m_Words.clear(); }
+
+private:
+  std::vector<uint64_t> m_Words;
+};
+
+// dense process-wide ID of an attribute string (assigned on first use)
+uint32_t OpenABEInternAttribute(const std::string &attribute);
+// the ID of an already interned attribute; false if it has none yet
+bool OpenABEFindAttribute(const std::string &attribute, uint32_t &id);
+
 ///
 /// @class  OpenABEAttributeList
 ///
@@ -49,6 +75,7 @@ class OpenABEAttributeList : public OpenABEFunctionInput {
 protected:
   std::vector<std::string>     m_Attributes;
   std::vector<std::string>     m_OriginalAttributes;
+  OpenABEAttributeBitset       m_AttributeBits;
   void setAttributes(std::vector<std::string>& attr_list,
                      std::vector<std::string>& orig_attr_list,
                      std::set<std::string>& prefix_list);
@@ -69,6 +96,8 @@ public:
   friend std::ostream& operator<<(std::ostream&, const OpenABEAttributeList&);
   const std::vector<std::string>*	 getAttributeList() const { return &this->m_Attributes; }
   const std::vector<std::string>*  getOriginalAttributeList() const { return &this->m_OriginalAttributes; }
+  // m_Attributes as a bitset, kept in step with the list
+  const OpenABEAttributeBitset& getAttributeBitset() const { return this->m_AttributeBits; }
   OpenABEAttributeList*    clone() const { return new OpenABEAttributeList(*this); }
   std::string toString() const;
   std::string toCompactString() const;
@@ -35,31 +35,82 @@
 #define __ZBENCHMARK_H__
 
 #include <chrono>
+#include <cstdint>
+#include <functional>
 #include <string>
 #include <sstream>
 #include <map>
+#include <vector>
 
 #define MAX_LIST	10000000
 
+/// \struct  BenchmarkSummary
+/// \brief   Order statistics over a set of timing samples (in ms).
+///
+/// Outliers are samples beyond 1.5 interquartile ranges above the third
+/// quartile; trimmedMean is the mean with them left out. The allocation
+/// figures are per timed run, made on the calling thread, and only filled
+/// in by runTimedBenchmark while OpenABE metrics are enabled in a program
+/// with the allocation hooks (see zallochooks.h).
+struct BenchmarkSummary {
+	size_t count;
+	size_t outliers;
+	double mean, trimmedMean, stddev;
+	double min, max, p50, p95, p99;
+	double allocations, allocatedBytes;
+	uint64_t peakBytes;
+
+	BenchmarkSummary();
+	static BenchmarkSummary fromSamples(std::vector<double> samples);
+
+	std::string toJson(const std::string& name) const;
+	static std::string csvHeader();
+	std::string toCsvRow(const std::string& name) const;
+};
+
 class Benchmark  {
 public:
-	Benchmark() { initBench = true; sum = 0.0; iterationCount = 0; };
+	Benchmark() { initBench = true; sum = 0.0; iterationCount = 0; startC = endC = 0; };
 	~Benchmark() { };
 	void start();
 	void stop();
 	double computeTimeInMilliseconds();
 	int getTimeInMicroseconds();
+	// elapsed cycle counter ticks of the last start/stop (0 if unavailable)
+	uint64_t getCycles() const { return endC - startC; }
 	std::string getRawResultString();
 	double getAverage();
+	const std::vector<double>& getSamples() const { return samples; }
+	BenchmarkSummary summarize() const { return BenchmarkSummary::fromSamples(samples); }
+
+	static uint64_t readCycleCounter();
 
 private:
-	std::chrono::system_clock::time_point startT, endT;
+	std::chrono::steady_clock::time_point startT, endT;
+	uint64_t startC, endC;
 	double sum;
 	int iterationCount;
+	std::vector<double> samples;
 	std::stringstream ss;
 	bool initBench;
 };
 
+// runs fn warmup times untimed, then repetitions timed runs
+BenchmarkSummary runTimedBenchmark(const std::function<void()>& fn, int warmup,
+                                   int repetitions);
+
+/// \typedef  BenchmarkBaseline
+/// \brief    Stored p50 (in ms) per benchmark name.
+typedef std::map<std::string, double> BenchmarkBaseline;
+
+// reads "name,p50" lines (a leading header row is skipped); with a header
+// row, any other numeric column can be read instead
+bool loadBenchmarkBaseline(const std::string& path, BenchmarkBaseline& baseline,
+                           const std::string& column = "p50");
+// true when the p50 exceeds the stored one by more than the given fraction
+bool isBenchmarkRegression(const BenchmarkSummary& summary, double baselineP50,
+                           double tolerance);
+
 class ListStr  {
 public:
   ListStr(void);
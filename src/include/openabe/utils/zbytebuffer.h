@@ -0,0 +1,438 @@
+/// 
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+/// 
+/// This file is part of Zeutro's OpenABE.
+/// 
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+/// 
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+/// 
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+/// 
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+///
+/// \file   zbytebuffer.h
+///
+/// \brief  Vector-compatible byte storage behind OpenABEByteString, with
+///         inline space for small values and headroom for prepends.
+///
+/// \author J. Ayo Akinyele
+///
+
+#ifndef __ZBYTEBUFFER_H__
+#define __ZBYTEBUFFER_H__
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+
+#include "zconstants.h"
+
+namespace oabe {
+
+void OpenABEZeroize(void *b, size_t b_len);
+
+///
+/// @class  OpenABEByteBuffer
+///
+/// @brief  Contiguous byte storage with the std::vector<uint8_t> interface
+///         the byte string relies on. Up to OpenABE_BYTESTRING_INLINE bytes
+///         live inside the object, so hashes, IVs, tags and labels never
+///         touch the heap. Heap blocks keep OpenABE_BYTESTRING_HEADROOM
+///         spare bytes in front of the data, which makes prepending a type
+///         byte or length header O(1), and erasing from the front just
+///         advances the start.
+///
+///         Wipe semantics: bytes that leave the buffer (clear, erase,
+///         resize down, pop_back) are zeroized as they leave, the old copy
+///         is zeroized whenever the bytes move to another block, and the
+///         live bytes are zeroized on destruction. No stale copy of the
+///         contents is left behind in memory the buffer gave up.
+///
+
+class OpenABEByteBuffer {
+public:
+  typedef uint8_t         value_type;
+  typedef size_t          size_type;
+  typedef ptrdiff_t       difference_type;
+  typedef uint8_t&        reference;
+  typedef const uint8_t&  const_reference;
+  typedef uint8_t*        pointer;
+  typedef const uint8_t*  const_pointer;
+  typedef uint8_t*        iterator;
+  typedef const uint8_t*  const_iterator;
+  typedef std::reverse_iterator<iterator>       reverse_iterator;
+  typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+  OpenABEByteBuffer() : buf_(inline_), head_(0), size_(0),
+                        cap_(OpenABE_BYTESTRING_INLINE) {}
+  explicit OpenABEByteBuffer(size_type n, uint8_t value = 0)
+      : OpenABEByteBuffer() {
+    this->assign(n, value);
+  }
+  template <class InputIt,
+            class = typename std::enable_if<!std::is_integral<InputIt>::value>::type>
+  OpenABEByteBuffer(InputIt first, InputIt last) : OpenABEByteBuffer() {
+    this->assign(first, last);
+  }
+  OpenABEByteBuffer(std::initializer_list<uint8_t> init)
+      : OpenABEByteBuffer() {
+    this->assign(init.begin(), init.end());
+  }
+  OpenABEByteBuffer(const OpenABEByteBuffer &other) : OpenABEByteBuffer() {
+    this->assign(other.begin(), other.end());
+  }
+  OpenABEByteBuffer(OpenABEByteBuffer &&other) : OpenABEByteBuffer() {
+    this->take(other);
+  }
+  ~OpenABEByteBuffer() { this->release(); }
+
+  OpenABEByteBuffer &operator=(const OpenABEByteBuffer &other) {
+    if (this != &other) {
+      this->assign(other.begin(), other.end());
+    }
+    return *this;
+  }
+  OpenABEByteBuffer &operator=(OpenABEByteBuffer &&other) {
+    if (this != &other) {
+      this->release();
+      this->take(other);
+    }
+    return *this;
+  }
+  OpenABEByteBuffer &operator=(std::initializer_list<uint8_t> init) {
+    this->assign(init.begin(), init.end());
+    return *this;
+  }
+
+  // element access
+  pointer         data()       { return this->buf_ + this->head_; }
+  const_pointer   data() const { return this->buf_ + this->head_; }
+  reference       operator[](size_type i)       { return this->data()[i]; }
+  const_reference operator[](size_type i) const { return this->data()[i]; }
+  reference at(size_type i) {
+    if (i >= this->size_) {
+      throw std::out_of_range("OpenABEByteBuffer::at");
+    }
+    return this->data()[i];
+  }
+  const_reference at(size_type i) const {
+    if (i >= this->size_) {
+      throw std::out_of_range("OpenABEByteBuffer::at");
+    }
+    return this->data()[i];
+  }
+  reference       front()       { return this->data()[0]; }
+  const_reference front() const { return this->data()[0]; }
+  reference       back()       { return this->data()[this->size_ - 1]; }
+  const_reference back() const { return this->data()[this->size_ - 1]; }
+
+  // iterators
+  iterator       begin()        { return this->data(); }
+  const_iterator begin() const  { return this->data(); }
+  const_iterator cbegin() const { return this->data(); }
+  iterator       end()          { return this->data() + this->size_; }
+  const_iterator end() const    { return this->data() + this->size_; }
+  const_iterator cend() const   { return this->data() + this->size_; }
+  reverse_iterator       rbegin()       { return reverse_iterator(this->end()); }
+  const_reverse_iterator rbegin() const { return const_reverse_iterator(this->end()); }
+  reverse_iterator       rend()         { return reverse_iterator(this->begin()); }
+  const_reverse_iterator rend() const   { return const_reverse_iterator(this->begin()); }
+
+  // capacity
+  bool      empty() const    { return this->size_ == 0; }
+  size_type size() const     { return this->size_; }
+  size_type max_size() const { return SIZE_MAX / 2; }
+  // appendable without reallocating
+  size_type capacity() const { return this->cap_ - this->head_; }
+  // prependable without reallocating
+  size_type headroom() const { return this->head_; }
+  bool      isInline() const { return this->buf_ == this->inline_; }
+
+  void reserve(size_type n) {
+    if (n > this->capacity()) {
+      this->relocate(n, this->size_, 0, false);
+    }
+  }
+  void shrink_to_fit() {
+    if (!this->isInline() && this->size_ <= OpenABE_BYTESTRING_INLINE) {
+      this->relocate(this->size_, this->size_, 0, false);
+    }
+  }
+
+  // modifiers
+  void clear() {
+    this->wipe(this->data(), this->size_);
+    this->size_ = 0;
+    this->head_ = this->isInline() ? 0 : OpenABE_BYTESTRING_HEADROOM;
+  }
+  void push_back(uint8_t value) {
+    if (this->size_ == this->capacity()) {
+      this->grow(this->size_ + 1);
+    }
+    this->data()[this->size_++] = value;
+  }
+  void pop_back() {
+    this->size_--;
+    this->wipe(this->data() + this->size_, 1);
+  }
+  void resize(size_type n, uint8_t value = 0) {
+    if (n <= this->size_) {
+      this->wipe(this->data() + n, this->size_ - n);
+      this->size_ = n;
+      return;
+    }
+    if (n > this->capacity()) {
+      this->grow(n);
+    }
+    std::memset(this->data() + this->size_, value, n - this->size_);
+    this->size_ = n;
+  }
+
+  void assign(size_type n, uint8_t value) {
+    this->clear();
+    this->reserve(n);
+    std::memset(this->data(), value, n);
+    this->size_ = n;
+  }
+  template <class InputIt,
+            class = typename std::enable_if<!std::is_integral<InputIt>::value>::type>
+  void assign(InputIt first, InputIt last) {
+    this->clear();
+    this->insert(this->end(), first, last);
+  }
+
+  iterator insert(const_iterator pos, uint8_t value) {
+    uint8_t *gap = this->openGap(pos - this->begin(), 1);
+    *gap = value;
+    return gap;
+  }
+  iterator insert(const_iterator pos, size_type n, uint8_t value) {
+    uint8_t *gap = this->openGap(pos - this->begin(), n);
+    std::memset(gap, value, n);
+    return gap;
+  }
+  template <class InputIt,
+            class = typename std::enable_if<!std::is_integral<InputIt>::value>::type>
+  iterator insert(const_iterator pos, InputIt first, InputIt last) {
+    typedef typename std::iterator_traits<InputIt>::iterator_category category;
+    return this->insertRange(pos - this->begin(), first, last, category());
+  }
+  iterator insert(const_iterator pos, std::initializer_list<uint8_t> init) {
+    return this->insert(pos, init.begin(), init.end());
+  }
+
+  iterator erase(const_iterator pos) {
+    return this->erase(pos, pos + 1);
+  }
+  iterator erase(const_iterator first, const_iterator last) {
+    size_type off = first - this->begin();
+    size_type n = last - first;
+    if (n == 0) {
+      return this->begin() + off;
+    }
+    uint8_t *p = this->data();
+    if (off == 0) {
+      // dropping a prefix only moves the start
+      this->wipe(p, n);
+      this->head_ += n;
+    } else {
+      std::memmove(p + off, p + off + n, this->size_ - off - n);
+      this->wipe(p + this->size_ - n, n);
+    }
+    this->size_ -= n;
+    return this->begin() + off;
+  }
+
+  void swap(OpenABEByteBuffer &other) {
+    OpenABEByteBuffer tmp(std::move(other));
+    other = std::move(*this);
+    *this = std::move(tmp);
+  }
+
+  friend bool operator<(const OpenABEByteBuffer &lhs, const OpenABEByteBuffer &rhs) {
+    return std::lexicographical_compare(lhs.begin(), lhs.end(),
+                                        rhs.begin(), rhs.end());
+  }
+  friend bool operator!=(const OpenABEByteBuffer &lhs, const OpenABEByteBuffer &rhs) {
+    return !(lhs.size() == rhs.size() &&
+             std::equal(lhs.begin(), lhs.end(), rhs.begin()));
+  }
+
+private:
+  void wipe(uint8_t *p, size_type n) {
+    if (n > 0) {
+      OpenABEZeroize(p, n);
+    }
+  }
+
+  // give up the storage (wiped), leaving the buffer empty and inline
+  void release() {
+    this->wipe(this->data(), this->size_);
+    if (!this->isInline()) {
+      std::free(this->buf_);
+    }
+    this->buf_ = this->inline_;
+    this->head_ = 0;
+    this->size_ = 0;
+    this->cap_ = OpenABE_BYTESTRING_INLINE;
+  }
+
+  // move other's bytes into this (empty, inline) buffer
+  void take(OpenABEByteBuffer &other) {
+    if (other.isInline()) {
+      std::memcpy(this->inline_, other.data(), other.size_);
+      this->size_ = other.size_;
+      other.clear();
+    } else {
+      this->buf_ = other.buf_;
+      this->head_ = other.head_;
+      this->size_ = other.size_;
+      this->cap_ = other.cap_;
+      other.buf_ = other.inline_;
+      other.head_ = 0;
+      other.size_ = 0;
+      other.cap_ = OpenABE_BYTESTRING_INLINE;
+    }
+  }
+
+  // make room for at least n live bytes, doubling so appends are amortized O(1)
+  void grow(size_type n) {
+    this->relocate(std::max(n, 2 * this->capacity()), this->size_, 0, false);
+  }
+
+  // Move the live bytes into a block with room for `room` bytes after the
+  // start, leaving a gap of `gap` bytes at offset `off`. Small results stay
+  // in (or come back to) the inline storage. A prepend (`front`) reserves
+  // headroom in proportion to the size, so a run of prepends is amortized
+  // O(1) as well.
+  void relocate(size_type room, size_type off, size_type gap, bool front) {
+    uint8_t *src = this->data();
+    size_type len = this->size_;
+    if (room <= OpenABE_BYTESTRING_INLINE && !front) {
+      if (this->isInline()) {
+        // compact to the front of the inline storage
+        std::memmove(this->inline_, src, off);
+        std::memmove(this->inline_ + off + gap, src + off, len - off);
+        if (this->head_ > gap) {
+          this->wipe(this->inline_ + len + gap, this->head_ - gap);
+        }
+      } else {
+        std::memcpy(this->inline_, src, off);
+        std::memcpy(this->inline_ + off + gap, src + off, len - off);
+        this->wipe(src, len);
+        std::free(this->buf_);
+        this->buf_ = this->inline_;
+        this->cap_ = OpenABE_BYTESTRING_INLINE;
+      }
+      this->head_ = 0;
+      return;
+    }
+    size_type head = OpenABE_BYTESTRING_HEADROOM + (front ? len / 2 : 0);
+    uint8_t *block = static_cast<uint8_t *>(std::malloc(head + room));
+    if (block == NULL) {
+      throw std::bad_alloc();
+    }
+    std::memcpy(block + head, src, off);
+    std::memcpy(block + head + off + gap, src + off, len - off);
+    this->wipe(src, len);
+    if (!this->isInline()) {
+      std::free(this->buf_);
+    }
+    this->buf_ = block;
+    this->head_ = head;
+    this->cap_ = head + room;
+  }
+
+  // open an uninitialized gap of n bytes at offset off, return its start
+  uint8_t *openGap(size_type off, size_type n) {
+    if (n == 0) {
+      return this->data() + off;
+    }
+    size_type tail = this->capacity() - this->size_;
+    if (off == 0 && this->head_ >= n) {
+      this->head_ -= n;
+    } else if (tail >= n) {
+      uint8_t *p = this->data();
+      std::memmove(p + off + n, p + off, this->size_ - off);
+    } else if (this->head_ >= n) {
+      uint8_t *p = this->data();
+      std::memmove(p - n, p, off);
+      this->head_ -= n;
+    } else if (this->isInline() &&
+               this->size_ + n <= OpenABE_BYTESTRING_INLINE) {
+      this->relocate(this->size_ + n, off, n, false);
+    } else {
+      size_type need = this->size_ + n;
+      this->relocate(off == 0 ? need : std::max(need, 2 * this->capacity()),
+                     off, n, off == 0);
+    }
+    this->size_ += n;
+    return this->data() + off;
+  }
+
+  template <class ForwardIt>
+  iterator insertRange(size_type off, ForwardIt first, ForwardIt last,
+                       std::forward_iterator_tag) {
+    size_type n = static_cast<size_type>(std::distance(first, last));
+    if (n == 0) {
+      return this->begin() + off;
+    }
+    // the source may point into this buffer, which openGap can move
+    if (std::is_pointer<ForwardIt>::value) {
+      std::less<const uint8_t *> before;
+      const uint8_t *src = reinterpret_cast<const uint8_t *>(&*first);
+      if (!before(src, this->data()) && before(src, this->data() + this->size_)) {
+        OpenABEByteBuffer copy(first, last);
+        return this->insertRange(off, copy.begin(), copy.end(),
+                                 std::forward_iterator_tag());
+      }
+    }
+    uint8_t *gap = this->openGap(off, n);
+    std::copy(first, last, gap);
+    return gap;
+  }
+
+  template <class InputIt>
+  iterator insertRange(size_type off, InputIt first, InputIt last,
+                       std::input_iterator_tag) {
+    size_type start = off;
+    for (; first != last; ++first) {
+      uint8_t *gap = this->openGap(off++, 1);
+      *gap = *first;
+    }
+    return this->begin() + start;
+  }
+
+  uint8_t  *buf_;    // start of the block (inline_ or heap)
+  size_type head_;   // offset of the first live byte in buf_
+  size_type size_;   // live bytes
+  size_type cap_;    // size of the block
+  uint8_t   inline_[OpenABE_BYTESTRING_INLINE];
+};
+
+}
+
+#endif  // __ZBYTEBUFFER_H__
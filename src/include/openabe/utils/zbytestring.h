@@ -37,13 +37,13 @@
 #define __ZBYTESTRING_H__
 
 #include <cstring>
-#include <vector>
 #include <ostream>
 #include <sstream>
 #include <iostream>
 
 #include "zcryptoutils.h"
 #include "zconstants.h"
+#include "zbytebuffer.h"
 
 #define HEX_CHARS   "0123456789abcdefABCDEF"
 #define BYTESTRING	0x1D
@@ -51,7 +51,9 @@
 
 /// \class	OpenABEByteString
 /// \brief	Generic container for manipulating a vector of bytes.
-///         May be subclassed for specific schemes.
+///         May be subclassed for specific schemes. Storage is an
+///         OpenABEByteBuffer: small strings stay inline, prepends use
+///         headroom, and contents are wiped when released.
 typedef enum PACK_TYPE {
   PACK_NONE = 0x00,
   PACK_8    = 0xA1,
@@ -62,7 +64,9 @@ typedef enum PACK_TYPE {
 
 namespace oabe {
 
-class OpenABEByteString : public ZObject, public std::vector<uint8_t> {
+class OpenABEByteSink;
+
+class OpenABEByteString : public ZObject, public OpenABEByteBuffer {
 	
 public:
   OpenABEByteString& operator+=(const OpenABEByteString &concat) {
@@ -80,18 +84,19 @@ public:
     return *this;
   }
 
-  OpenABEByteString operator+(OpenABEByteString &concat) {
+  OpenABEByteString operator+(const OpenABEByteString &concat) const {
     OpenABEByteString result;
+    result.reserve(this->size() + concat.size());
     result.insert(result.end(), this->begin(), this->end());
     result.insert(result.end(), concat.begin(), concat.end());
     return result;
   }
 
-  OpenABEByteString operator+(std::string concat) {
+  OpenABEByteString operator+(const std::string &concat) const {
     OpenABEByteString result;
-    uint32_t size = concat.size();
+    result.reserve(this->size() + concat.size());
     result.insert(result.end(), this->begin(), this->end());
-    result.insert(result.end(), ((uint8_t*) concat.c_str())[0], ((uint8_t*)concat.c_str())[size]);
+    result.insert(result.end(), concat.begin(), concat.end());
     return result;
   }
 
@@ -115,16 +120,13 @@ public:
   }
 
   uint8_t *getInternalPtr() {
-    return &((*this)[0]);
+    return this->data();
   }
 
+  // wipe the contents and give back any heap block
   void zeroize() {
-    size_t b_len = this->size();
-    if (b_len > 0) {
-        void *b = &((*this)[0]);
-        OpenABEZeroize(b, b_len);
-    }
     this->clear();
+    this->shrink_to_fit();
   }
 
   void eraseAll() {
@@ -142,14 +144,11 @@ public:
   }
 
   void fillBuffer(uint8_t byte, uint32_t len) {
-    // clear buffer
-    this->clear();
-    for(size_t i = 0; i < len; i++) {
-      // fill with the given byte
-      this->push_back(byte);
-    }
+    // clear buffer and fill with the given byte
+    this->assign(len, byte);
   }
 
+  // O(1): uses the headroom in front of the data
   void insertFirstByte(uint8_t byte) {
     this->insert(this->begin(), byte);
   }
@@ -163,7 +162,7 @@ public:
     char hex[3];  // 2 hex digits + null terminator
     std::memset(hex, 0, 3);
 
-    for (std::vector<uint8_t>::const_iterator it = this->begin();
+    for (OpenABEByteString::const_iterator it = this->begin();
         it != this->end(); ++it) {
       sprintf(hex, "%02X", *it);
       ss << hex;
@@ -176,7 +175,7 @@ public:
     char hex[3];  // 2 hex digits + null terminator
     std::memset(hex, 0, 3);
 
-    for (std::vector<uint8_t>::const_iterator it = this->begin() ; it != this->end(); ++it) {
+    for (OpenABEByteString::const_iterator it = this->begin() ; it != this->end(); ++it) {
         sprintf(hex, "%02x", *it);
         ss << hex;
     }
@@ -214,7 +213,7 @@ public:
 
   const std::string toString() {
     std::stringstream ss;
-    for (std::vector<uint8_t>::iterator it = this->begin() ; it != this->end(); ++it) {
+    for (OpenABEByteString::iterator it = this->begin() ; it != this->end(); ++it) {
       const unsigned char str = *it;
       ss << str;
     }
@@ -234,8 +233,7 @@ public:
   }
 
   friend std::ostream& operator<<(std::ostream& s, const OpenABEByteString& z) {
-    OpenABEByteString z2(z);
-    for (std::vector<uint8_t>::iterator it = z2.begin() ; it != z2.end(); ++it) {
+    for (OpenABEByteString::const_iterator it = z.begin() ; it != z.end(); ++it) {
       s << *it;
     }
     return s;
@@ -247,6 +245,7 @@ public:
     result.insertFirstByte(BYTESTRING);
     result += *this;
   }
+  void serializeTo(OpenABEByteSink &sink) const;
 
   void deserialize(OpenABEByteString &input) {
     uint32_t len = 0;
@@ -378,6 +377,38 @@ public:
     return buf;
   }
 
+  // like smartUnpack, but returns the length and moves *index to the start
+  // of the value so that it can be read in place
+  size_t smartUnpackLength(size_t *index) const {
+    size_t buf_len = this->size(), hdr_len = 0;
+    if (*index + 1 > buf_len) {
+      THROW_ERROR(OpenABE_ERROR_INDEX_OUT_OF_BOUNDS);
+    }
+    PackType pack_type = (PackType) this->at(*index);
+    if (pack_type == PACK_32) {
+      hdr_len = 4;
+    } else if (pack_type == PACK_16) {
+      hdr_len = 2;
+    } else if (pack_type == PACK_8) {
+      hdr_len = 1;
+    } else {
+      THROW_ERROR(OpenABE_ERROR_INVALID_PACK_TYPE);
+    }
+    size_t index2 = *index + 1, len = 0;
+    if (index2 + hdr_len > buf_len) {
+      THROW_ERROR(OpenABE_ERROR_INDEX_OUT_OF_BOUNDS);
+    }
+    for (size_t i = 0; i < hdr_len; i++) {
+      len = (len << 8) | this->at(index2 + i);
+    }
+    index2 += hdr_len;
+    if (len > buf_len - index2) {
+      THROW_ERROR(OpenABE_ERROR_INDEX_OUT_OF_BOUNDS);
+    }
+    *index = index2;
+    return len;
+  }
+
   OpenABEByteString unpack8bits(size_t *index) {
     size_t index2 = *index;
     OpenABEByteString buf;
@@ -398,11 +429,8 @@ public:
     }
     index2 += 1;
 
-    for(size_t i = 0; i < len; i++) {
-      buf.push_back(this->at(index2));
-      index2++;
-    }
-    *index = index2;
+    buf.insert(buf.end(), this->begin() + index2, this->begin() + index2 + len);
+    *index = index2 + len;
     return buf;
   }
 
@@ -428,11 +456,8 @@ public:
       THROW_ERROR(OpenABE_ERROR_INDEX_OUT_OF_BOUNDS);
     }
     index2 += 2;
-    for(size_t i = 0; i < len; i++) {
-      buf.push_back(this->at(index2));
-      index2++;
-    }
-    *index = index2;
+    buf.insert(buf.end(), this->begin() + index2, this->begin() + index2 + len);
+    *index = index2 + len;
     return buf;
   }
 
@@ -460,11 +485,8 @@ public:
       THROW_ERROR(OpenABE_ERROR_INDEX_OUT_OF_BOUNDS);
     }
     index2 += 4;
-    for (size_t i = 0; i < len; i++) {
-      buf.push_back(this->at(index2));
-      index2++;
-    }
-    *index = index2;
+    buf.insert(buf.end(), this->begin() + index2, this->begin() + index2 + len);
+    *index = index2 + len;
     return buf;
   }
 
@@ -485,15 +507,84 @@ public:
       THROW_ERROR(OpenABE_ERROR_INDEX_OUT_OF_BOUNDS);
     }
     index2 += 4;
-    for (size_t i = 0; i < len; i++) {
-      buf.push_back(this->at(index2));
-      index2++;
-    }
-    *index = index2;
+    buf.insert(buf.end(), this->begin() + index2, this->begin() + index2 + len);
+    *index = index2 + len;
     return;
   }
 };
 
+///
+/// @class  OpenABEByteSink
+///
+/// @brief  Where serializers append their output (see ZObject::serializeTo).
+///         Length-prefixed values are written in place: mark the start with
+///         beginPacked(), append the value, then endPacked() inserts the
+///         smartPack (or 32-bit pack) header, so nested values don't have
+///         to be staged in temporary byte strings.
+///
+
+class OpenABEByteSink {
+public:
+  OpenABEByteSink(OpenABEByteString &out) : out_(out) {}
+
+  void   reserve(size_t len) { this->out_.reserve(this->out_.size() + len); }
+  size_t size() const { return this->out_.size(); }
+  void   push_back(uint8_t byte) { this->out_.push_back(byte); }
+  void   append(const uint8_t *buf, size_t len) {
+    this->out_.insert(this->out_.end(), buf, buf + len);
+  }
+  void   append(const OpenABEByteString &buf) {
+    this->out_.insert(this->out_.end(), buf.begin(), buf.end());
+  }
+  OpenABEByteString &bytes() { return this->out_; }
+
+  // same encoding as OpenABEByteString::smartPack of what was appended
+  // since the mark
+  size_t beginPacked() const { return this->out_.size(); }
+  void   endPacked(size_t mark) {
+    size_t len = this->out_.size() - mark;
+    uint8_t hdr[1 + sizeof(uint32_t)];
+    size_t hdrLen = 0;
+    if (len > UINT16_MAX) {
+      hdr[hdrLen++] = PACK_32;
+      hdr[hdrLen++] = (len >> 24) & 0xFF;
+      hdr[hdrLen++] = (len >> 16) & 0xFF;
+      hdr[hdrLen++] = (len >> 8) & 0xFF;
+    } else if (len > UINT8_MAX) {
+      hdr[hdrLen++] = PACK_16;
+      hdr[hdrLen++] = (len >> 8) & 0xFF;
+    } else if (len > 0) {
+      hdr[hdrLen++] = PACK_8;
+    } else {
+      THROW_ERROR(OpenABE_ERROR_INVALID_INPUT);
+    }
+    hdr[hdrLen++] = len & 0xFF;
+    this->out_.insert(this->out_.begin() + mark, hdr, hdr + hdrLen);
+  }
+
+  // same encoding as OpenABEByteString::pack; the length is patched in place
+  size_t beginPacked32() {
+    size_t mark = this->out_.size();
+    this->out_.insert(this->out_.end(), sizeof(uint32_t), 0);
+    return mark;
+  }
+  void   endPacked32(size_t mark) {
+    uint32_t len = this->out_.size() - mark - sizeof(uint32_t);
+    for (size_t i = 0; i < sizeof(uint32_t); i++) {
+      this->out_[mark + i] = (len >> (8 * (sizeof(uint32_t) - 1 - i))) & 0xFF;
+    }
+  }
+
+private:
+  OpenABEByteString &out_;
+};
+
+inline void OpenABEByteString::serializeTo(OpenABEByteSink &sink) const {
+  sink.push_back(BYTESTRING);
+  sink.bytes().pack32bits((uint32_t) this->size());
+  sink.append(*this);
+}
+
 }
 
 #endif	// __ZBYTESTRING_H__
@@ -77,6 +77,9 @@ public:
   // export and import methods for ciphertext components
   // this includes the OpenABE header and the contents of the ciphertext
   void exportToBytes(OpenABEByteString &output);
+  // the same in the given encoding (compact or not), whatever the
+  // ciphertext's own setting
+  void exportToBytes(OpenABEByteString &output, bool compact);
   void loadFromBytes(OpenABEByteString &input);
 
   void exportToBytesWithoutHeader(OpenABEByteString& output);
@@ -48,10 +48,43 @@
 #define UID_LEN                  16 // 128-bit UID length
 #define DEFAULT_SYM_KEY_BYTES    MIN_BYTE_LEN  // 256-bit keys
 #define DEFAULT_SYM_KEY_BITS     DEFAULT_SYM_KEY_BYTES*8
+#define DEFAULT_AEAD_CHUNK_SIZE  (1 << 16)  // Plaintext bytes per chunk of the chunked AES-GCM mode
+#define DEFAULT_SESSION_MAX_RECORDS (1 << 24)  // Records sealed under one envelope session key
+#define DEFAULT_SESSION_MAX_SECONDS 3600  // ...and the age of the key before it is replaced
+#define SESSION_CACHE_SIZE       64    // Envelope sessions a context can decrypt at once
 #define SHA256_LEN               32 // SHA-256
 #define OpenABE_KDF_ITERATION_COUNT  10000
+#define OpenABE_KDF_MIN_ITERATION_COUNT  1000
+#define OpenABE_KDF_MAX_ITERATION_COUNT  10000000  // Refuse password blobs asking for more
+#define PASSWORD_KEY_CACHE_SIZE  256   // Derived keys kept per passphrase session
+#define KEYSTORE_EVICTION_INTERVAL 60  // Seconds between expired-key sweeps
+#define KEY_RANK_CACHE_SIZE      1024  // Key search answers kept by the keystore manager
 #define MAX_BUFFER_SIZE          1024  // Increased for MCL BLS12-381 GT serialization (needs 576 bytes)
 #define MAX_INT_BITS             32  // For numerical attributes (in policy/attribute list)
+#define HASH_TO_G1_CACHE_SIZE    4096  // Attribute hashes cached per master public key
+#define ATTRIBUTE_TABLE_CACHE_SIZE 64  // Hashed attributes given a fixed-base table (~150 KB each)
+#define ATTRIBUTE_TABLE_MIN_HITS 32    // Exponentiations of a hashed attribute before it gets one
+#define HASH_TO_G1_BATCH_PARALLEL 16   // Batched hashes to G1 use the thread pool from this many
+#define MILLER_LOOP_PARALLEL_CHUNK 32  // Multi-pairings are split over the thread pool in chunks of this many pairs
+#define POLICY_CACHE_SIZE        512   // Parsed policies kept by createPolicyTree
+#define POLICY_MAX_INPUT_LENGTH  (1 << 18)  // Default limits on policy and attribute list
+#define POLICY_MAX_DEPTH         1024       // parsing (see OpenABEPolicyLimits)
+#define POLICY_MAX_LEAVES        4096
+#define POLICY_MAX_GATE_WIDTH    1024
+#define POLICY_MAX_ATTRIBUTES    4096
+#define TREE_STRING_RESERVE      256   // Initial buffer for writing a policy tree as a string
+#define DECRYPTION_PLAN_CACHE_SIZE 1024  // Solved (key, policy) pairs kept by the LSSS
+#define USER_KEY_CACHE_SIZE      256   // Decoded user keys kept once the key cache is enabled
+#define USER_KEY_CACHE_BYTES     (1 << 24)  // ...and the total size of their blobs
+#define OpenABE_ARENA_BLOCK_SIZE     4096  // First block of an operation arena (bytes)
+#define OpenABE_ARENA_MAX_BLOCK_SIZE (1 << 20)  // Arena blocks stop doubling here
+#define OpenABE_SECURE_ARENA_SIZE    16384  // Locked bytes a secure arena maps at a time
+#define PRECOMPUTE_ARENA_CHUNK_SIZE  (1 << 21)  // Table memory is mapped in huge-page sized chunks
+#define OpenABE_BYTESTRING_INLINE    64  // Byte strings up to this size don't allocate
+#define OpenABE_BYTESTRING_HEADROOM  16  // Free bytes kept in front of heap byte strings
+#define OpenABE_COUPON_POOL_SIZE     32  // Encryption coupons kept per MPK (offline/online mode)
+#define OpenABE_COUPON_ROWS          16  // LSSS rows covered by each coupon
+#define OpenABE_CP_FD_ATTRIBUTE_USES 4   // Rows one attribute may label in a CP-ABE-FD policy (keys grow with it)
 
 // Data structures     // OpenABE_ELEMENT_UINT = 0x2D,
 typedef enum _OpenABEElementType {
@@ -77,6 +110,9 @@ typedef enum _OpenABECurveID {
   OpenABE_NIST_P256_ID = 0x32,
   OpenABE_NIST_P384_ID = 0x5A,
   OpenABE_NIST_P521_ID = 0xB7,
+  // Curve25519 (X25519 key agreement, Ed25519 signatures)
+  OpenABE_X25519_ID = 0x19,
+  OpenABE_ED25519_ID = 0x1A,
   OpenABE_BN_P158_ID = 0x61,
   OpenABE_BN_P254_ID = 0x6F,
   OpenABE_BN_P256_ID = 0x73,
@@ -36,10 +36,38 @@
 #define __ZCONTAINER_H__
 
 #include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// containers with fewer group elements than this are decoded inline rather
+// than across the thread pool
+#define OpenABE_PARALLEL_DECODE_MIN  8
+
+// positional container format: the components a schema names are written in
+// the schema's order without their labels, followed by the rest as usual
+#define OpenABE_CONTAINER_POSITIONAL          0xE1
+#define OpenABE_CONTAINER_POSITIONAL_VERSION  0x01
+
+/// \enum   OpenABEContainerSchema
+/// \brief  The component layouts the positional format knows how to derive
+typedef enum _OpenABEContainerSchema {
+  OpenABE_SCHEMA_NONE = 0x00,
+  OpenABE_SCHEMA_CP_WATERS_CT = 0x01,   // policy, Cprime, C_x/D_x per LSSS row
+  OpenABE_SCHEMA_KP_GPSW_CT = 0x02,     // attributes, Cpr2, C_x per attribute
+  OpenABE_SCHEMA_CP_FAME_CT = 0x03,     // policy, C01, C02, C1_x/C2_x per LSSS row
+  OpenABE_SCHEMA_CP_WATERS_HASHED_CT = 0x04, // as CP_WATERS_CT, with policyHash
+  OpenABE_SCHEMA_CP_FAME_HASHED_CT = 0x05,   // as CP_FAME_CT, with policyHash
+  OpenABE_SCHEMA_CP_WATERS_FD_CT = 0x06,     // policy, Cprime, D, C_x per LSSS row
+  OpenABE_SCHEMA_CP_WATERS_FD_HASHED_CT = 0x07 // as CP_WATERS_FD_CT, with policyHash
+} OpenABEContainerSchema;
 
 namespace oabe {
 class ZP;
 class G;
+class OpenABELazyComponent;
 }
 
 /// \class	OpenABEContainer
@@ -49,12 +77,53 @@ namespace oabe {
 
 class OpenABEContainer : protected ZObject {
 protected:
+  // a stored component and its element type (OpenABE_ELEMENT_*, or
+  // OpenABE_NONE_TYPE for anything that isn't a ZP or pairing group element),
+  // so the typed getters are a tag check rather than a dynamic_cast
+  struct Component {
+    Component(const std::string &name, ZObject *object, uint8_t type, bool lazy)
+      : name(name), object(object), type(type), lazy(lazy) {}
+    std::string name;
+    ZObject *object;
+    uint8_t type;
+    bool lazy;     // object is an OpenABELazyComponent decoding to 'type'
+  };
+  typedef std::vector<Component> ComponentTable;
+
   std::shared_ptr<ZGroup> group;
-  std::map<std::string, ZObject*> val;
+  // components kept sorted by name in one contiguous table (the order the
+  // serialized form has always used); lookups are binary searches
+  ComponentTable val;
+  ComponentTable::iterator findComponent(const std::string &name);
+  ComponentTable::const_iterator findComponent(const std::string &name) const;
+  // take ownership of an already allocated component
+  void adoptComponent(const std::string &name, ZObject *component);
+  void adoptComponent(const std::string &name, ZObject *component,
+                      uint8_t type, bool lazy = false);
+  // decode group elements on first access when loading (see setLazyDecoding)
+  bool lazyDecode_;
+  // write GT elements in their compact form (see setCompactEncoding)
+  bool compactEncoding_;
+  // layout used by the positional format when compactEncoding_ is set
+  uint8_t schema_;
+  const ZObject *lookupComponent(const std::string &name) const;
+  bool deriveSchemaLabels(uint8_t schema, std::vector<std::string> &labels) const;
+  bool positionalLabels(std::vector<std::string> &labels) const;
+  void normalizePoints() const;
+  void serializeComponent(const Component &component, OpenABEByteSink &sink,
+                          bool compact) const;
+  void deserializeElements(std::vector<std::string> &keys,
+                           std::vector<OpenABEByteString> &values);
+  ZObject *resolveComponent(const Component &component) const;
+  // the named component if it holds an element of the given type
+  ZObject *getElement(const std::string &name, uint8_t type);
   void deserialize(OpenABEByteString &blob);
   void deserialize(std::string &blob);
   void deserializeElement(std::string key, OpenABEByteString& value);
   void serialize(OpenABEByteString &result) const;
+  void serializeTo(OpenABEByteSink &sink) const;
+  // the same in the given encoding, whatever setCompactEncoding says
+  void serializeTo(OpenABEByteSink &sink, bool compact) const;
   // void serializeAsTuple(std::vector<std::string>& keys, OpenABEByteString &result) const;
 
 public:
@@ -63,15 +132,28 @@ public:
   virtual ~OpenABEContainer();
 
   void        setGroup(std::shared_ptr<ZGroup> group) { this->group = group; }
+  // when set, G1/G2/GT elements loaded afterwards keep their serialized
+  // bytes and are only decoded (and validated) the first time they are used
+  void        setLazyDecoding(bool lazy) { this->lazyDecode_ = lazy; }
+  // when set, GT elements are written in the compact encoding (half the size
+  // under MCL) and a schema's components in the positional format. G1/G2
+  // elements are always written compressed. Loading reads every encoding,
+  // but releases without the compact forms can't read them.
+  void        setCompactEncoding(bool compact) { this->compactEncoding_ = compact; }
+  bool        getCompactEncoding() const { return this->compactEncoding_; }
+  // the layout the components follow; with compact encoding, the components
+  // it names are written without their labels (which it derives on load)
+  void        setSchema(uint8_t schema) { this->schema_ = schema; }
+  uint8_t     getSchema() const { return this->schema_; }
   void        setComponent(const std::string &name, const ZObject *component);
   void        setComponent(const std::string &name, ZObject component);
   ZObject*    getComponent(const std::string &name);
   OpenABE_ERROR   deleteComponent(const std::string name);
   // Some helper methods for getting components of specific types
-  ZP*	   getZP(const std::string &name) { return dynamic_cast<ZP*>(this->getComponent(name)); }
-  G1*    getG1(const std::string &name) { return dynamic_cast<G1*>(this->getComponent(name)); }
-  G2*    getG2(const std::string &name) { return dynamic_cast<G2*>(this->getComponent(name)); }
-  GT*    getGT(const std::string &name) { return dynamic_cast<GT*>(this->getComponent(name)); }
+  ZP*	   getZP(const std::string &name) { return static_cast<ZP*>(this->getElement(name, OpenABE_ELEMENT_ZP)); }
+  G1*    getG1(const std::string &name) { return static_cast<G1*>(this->getElement(name, OpenABE_ELEMENT_G1)); }
+  G2*    getG2(const std::string &name) { return static_cast<G2*>(this->getElement(name, OpenABE_ELEMENT_G2)); }
+  GT*    getGT(const std::string &name) { return static_cast<GT*>(this->getElement(name, OpenABE_ELEMENT_GT)); }
 
   ZP_t*  getZP_t(const std::string &name) { return dynamic_cast<ZP_t*>(this->getComponent(name)); }
   G_t*   getG_t(const std::string &name) { return dynamic_cast<G_t*>(this->getComponent(name)); }
@@ -79,10 +161,45 @@ public:
   OpenABEByteString* getByteString(const std::string &name) { return dynamic_cast<OpenABEByteString*>(this->getComponent(name)); }
   OpenABEUInteger* getInteger(const std::string &name) { return dynamic_cast<OpenABEUInteger*>(this->getComponent(name)); }
   uint32_t    numComponents();
+  // pre-size the component table when the number of components is known
+  void        reserveComponents(size_t count) { this->val.reserve(count); }
+  // true iff the named component is present and equal to 'expected'
+  bool        matchComponent(const std::string &name, const ZObject *expected) const;
+  // true iff the named component is present (and, unlike getComponent,
+  // quietly false otherwise)
+  bool        hasComponent(const std::string &name) const;
   OpenABE_ERROR   zeroize();
 
+  // Miller-loop lines for G2 components (see G2LineTable): get builds the
+  // table on first use, find only returns one that was already built and
+  // precompute builds them for every G2 component. The precomputation store
+  // may evict tables to stay within its budget; get then builds them again.
+  std::shared_ptr<const G2LineTable> getG2LineTable(const std::string &name);
+  std::shared_ptr<const G2LineTable> findG2LineTable(const std::string &name);
+  void        precomputeG2LineTables();
+  // add the line tables built so far to a snapshot
+  void        addToSnapshot(OpenABEFixedBaseSnapshot &snapshot);
+  // the snapshot tables the container was loaded with: line tables (and,
+  // for a master public key, its fixed-base tables) come from there while
+  // they match (see OpenABE_attachFixedBaseSnapshot)
+  void        setAttachedTables(const OpenABEAttachedTables &attached) { this->attached_ = attached; }
+  const OpenABEAttachedTables &getAttachedTables() const { return this->attached_; }
+
   std::vector<std::string> getKeys();
   friend bool operator==(const OpenABEContainer&, const OpenABEContainer&);
+
+private:
+  struct LineTableEntry {
+    std::shared_ptr<const G2LineTable> table;
+    std::shared_ptr<OpenABEPrecomputeTicket> ticket;
+  };
+  void evictG2LineTable(const std::string &name, const OpenABEPrecomputeTicket *ticket);
+
+  std::mutex lineTablesLock_;
+  std::map<std::string, LineTableEntry> lineTables_;
+  // created with the first line table
+  std::shared_ptr<OpenABEPrecomputeOwner> lineTablesOwner_;
+  OpenABEAttachedTables attached_;
 };
 
 inline std::string OpenABEMakeElementLabel(std::string base, std::string unique) { return base + "_" + unique; }
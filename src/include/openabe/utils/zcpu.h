@@ -0,0 +1,79 @@
+///
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+///
+/// This file is part of Zeutro's OpenABE.
+///
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+///
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+///
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+/// \file   zcpu.h
+///
+/// \brief  Runtime CPU feature detection and the code paths it selects.
+///
+/// \author J. Ayo Akinyele
+///
+
+#ifndef __ZCPU_H__
+#define __ZCPU_H__
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace oabe {
+
+///
+/// \class  OpenABECpuFeatures
+/// \brief  Instruction set extensions usable on this CPU (and enabled by the
+///         OS, for the AVX register state).
+///
+struct OpenABECpuFeatures {
+  // x86-64
+  bool bmi2, adx, avx2, avx512f, avx512ifma;
+  bool aesni, pclmul, vaes, vpclmulqdq, sha;
+  // AArch64
+  bool neon, armAes, armPmull, armSha2;
+};
+
+/*!
+ * Features of the running CPU, detected on the first call (the library
+ * makes that call from InitializeOpenABE).
+ */
+const OpenABECpuFeatures& OpenABE_getCpuFeatures();
+
+// space separated names of the detected features, e.g. "bmi2 adx avx2"
+std::string OpenABE_getCpuFeatureString();
+
+/*!
+ * (component, code path) for each backend kernel whose implementation
+ * depends on the CPU. MCL and OpenSSL pick these themselves at startup
+ * from the same CPUID bits; this reports the choice so that benchmark
+ * results from mixed hardware can be told apart. Masks set through
+ * OpenSSL's OPENSSL_ia32cap/OPENSSL_armcap are not reflected.
+ */
+std::vector<std::pair<std::string, std::string>> OpenABE_getActiveCodePaths();
+
+// one "component: path" line per entry of OpenABE_getActiveCodePaths()
+std::string OpenABE_describeCodePaths();
+
+}
+
+#endif // __ZCPU_H__
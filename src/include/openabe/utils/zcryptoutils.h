@@ -34,6 +34,8 @@
 #ifndef __ZCRYPTOUTILS_H__
 #define __ZCRYPTOUTILS_H__
 
+#include "zconstants.h"
+
 namespace oabe {
 
 /// @typedef    OpenABEHashFunctionType
@@ -56,12 +58,26 @@ typedef enum _OpenABEHashFunctionType {
 #define OpenABE_DEFAULT_HASH_FUNCTION_TYPE  HASH_FUNCTION_TYPE_SHA256
 #endif
 
+///
+/// @typedef    OpenABEGTKDFVersion
+///
+/// @brief      Versions of the GT-to-key derivation. v1 is the original
+///             construction and what every scheme uses, so existing
+///             ciphertexts keep decrypting; v2 hashes the native GT encoding
+///             with a block counter and is not interchangeable with v1.
+
+typedef enum _OpenABEGTKDFVersion {
+    OpenABE_GT_KDF_V1 = 1,
+    OpenABE_GT_KDF_V2 = 2
+} OpenABEGTKDFVersion;
+
 // forward declare GT (for now)
 class GT;
 // hashing GT elements into a bytestring
 bool  OpenABEUtilsHashToString(GT &input, uint32_t keyLen,
                            OpenABEByteString &result,
-                           OpenABEHashFunctionType hashType = OpenABE_DEFAULT_HASH_FUNCTION_TYPE);
+                           OpenABEHashFunctionType hashType = OpenABE_DEFAULT_HASH_FUNCTION_TYPE,
+                           OpenABEGTKDFVersion kdfVersion = OpenABE_GT_KDF_V1);
 std::string OpenABEHashKey(const std::string attr_key);
 // compute keyed hash
 void OpenABEComputeHash(OpenABEByteString& key, OpenABEByteString& input, OpenABEByteString& output);
@@ -69,10 +85,15 @@ void OpenABEComputeHash(OpenABEByteString& key, OpenABEByteString& input, OpenAB
 void generateHash(std::string& hash, const std::string& password);
 // check password against a given 'salted hash'
 bool checkPassword(const std::string& hash, const std::string& password);
-// encrypt a given blob and password
-OpenABE_ERROR encryptUnderPassword(const std::string password, OpenABEByteString &inputBlob, OpenABEByteString &encOutputBlob);
+// encrypt a given blob and password (the iteration count is stored in the blob)
+OpenABE_ERROR encryptUnderPassword(const std::string password, OpenABEByteString &inputBlob, OpenABEByteString &encOutputBlob,
+                                   int iterationCount = OpenABE_KDF_ITERATION_COUNT);
 // decrypt a given blob using password
 OpenABE_ERROR decryptUnderPassword(const std::string password, OpenABEByteString &inputCTBlob, OpenABEByteString &plainOutputBlob);
+// same as above, but reusing the keys already derived in a passphrase session
+class OpenABEPasswordKeyCache;
+OpenABE_ERROR encryptUnderPassword(OpenABEPasswordKeyCache &keys, OpenABEByteString &inputBlob, OpenABEByteString &encOutputBlob);
+OpenABE_ERROR decryptUnderPassword(OpenABEPasswordKeyCache &keys, OpenABEByteString &inputCTBlob, OpenABEByteString &plainOutputBlob);
 
 /*! \brief Calculates a SHA-256 hash
  *
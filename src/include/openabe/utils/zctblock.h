@@ -0,0 +1,134 @@
+///
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+///
+/// This file is part of Zeutro's OpenABE.
+///
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+///
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+///
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+///
+/// \file   zctblock.h
+///
+/// \brief  Columnar blocks of crypto box ciphertexts for bulk storage.
+///
+/// \author J. Ayo Akinyele
+///
+
+#ifndef __ZCTBLOCK_H__
+#define __ZCTBLOCK_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace oabe {
+
+///
+/// @class  OpenABECiphertextBlockWriter
+///
+/// @brief  Gathers binary crypto box ciphertexts of the same layout (same
+///         scheme, policy or attribute list, and encoding) into one block.
+///         The labels and everything the ciphertexts share, such as the
+///         header and the policy, are written once; each other component
+///         (a group element per LSSS row, the UID, the payload) becomes a
+///         column holding its value for every ciphertext. A reader gets
+///         back each ciphertext byte for byte.
+///
+class OpenABECiphertextBlockWriter {
+public:
+  OpenABECiphertextBlockWriter();
+
+  // add a ciphertext; fails if its layout differs from the first one's
+  OpenABE_ERROR add(const uint8_t *ciphertext, size_t len);
+  OpenABE_ERROR add(const std::string &ciphertext) {
+    return this->add((const uint8_t *)ciphertext.data(), ciphertext.size());
+  }
+  size_t count() const { return this->count_; }
+  // append the block (if any ciphertext was added) and start a new one
+  void finish(std::string &out);
+
+private:
+  std::string shape_;
+  std::vector<std::vector<std::string>> columns_;
+  size_t count_;
+};
+
+///
+/// @class  OpenABECiphertextBlockReader
+///
+/// @brief  Random access to the ciphertexts of one or more blocks written
+///         one after another. Blocks are read in place, from a read-only
+///         mapping of a file or from a caller's buffer: opening only
+///         checks the block and column headers, and get() assembles the
+///         one ciphertext asked for from its columns.
+///
+class OpenABECiphertextBlockReader {
+public:
+  OpenABECiphertextBlockReader();
+  ~OpenABECiphertextBlockReader();
+
+  OpenABE_ERROR open(const std::string &path);
+  // the buffer must outlive the reader (or the next attach/close)
+  OpenABE_ERROR attach(const uint8_t *data, size_t len);
+  void close();
+  // the number of ciphertexts over all blocks
+  size_t size() const { return this->count_; }
+  // the binary crypto box ciphertext i
+  OpenABE_ERROR get(size_t i, OpenABEByteString &ciphertext) const;
+
+private:
+  OpenABECiphertextBlockReader(const OpenABECiphertextBlockReader &);
+  OpenABECiphertextBlockReader &operator=(const OpenABECiphertextBlockReader &);
+
+  struct Column {
+    uint8_t kind;
+    uint32_t param;
+    const uint8_t *data;
+    uint64_t len;
+  };
+  // the labels and positional counts of one half of the ciphertext
+  struct Half {
+    bool positional;
+    uint8_t version, schema;
+    uint32_t numPositional;
+    std::vector<std::string> labels;
+  };
+  struct Block {
+    size_t first, count;
+    Half halves[2];
+    std::vector<Column> columns;
+  };
+
+  OpenABE_ERROR parseBlocks();
+  void field(const Block &block, size_t column, size_t i,
+             const uint8_t *&value, size_t &len) const;
+
+  std::vector<Block> blocks_;
+  size_t count_;
+  const uint8_t *data_;
+  size_t len_;
+  void *map_;
+  size_t mapLen_;
+};
+
+}
+
+#endif // __ZCTBLOCK_H__
@@ -58,6 +58,9 @@
 #define MONTH_BITS  4
 #define DAY_BITS    8
 #define YEAR_BITS   16
+// dates are encoded as days since the epoch; 16 bits last until June 2149,
+// so date comparisons never need markers for the bits above
+#define TIME_BITS   16
 
 static const uint32_t max_4bits = 0xf;
 static const uint32_t max_8bits = 0xff;
@@ -73,6 +76,24 @@ class OpenABEPolicy;
 class OpenABEAttributeList;
 class OpenABETreeNode;
 class OpenABEUInteger;
+
+/** Bounds on what parsing a policy or attribute list may cost, enforced as
+ * the input is read so adversarial inputs fail before the tree, its
+ * canonical form or its LSSS are built. Exceeding one throws
+ * OpenABE_ERROR_POLICY_TOO_COMPLEX (createPolicyTree and createAttributeList
+ * return nullptr). */
+struct OpenABEPolicyLimits {
+  size_t maxInputLength;  // bytes of input
+  size_t maxDepth;        // nested parentheses
+  size_t maxLeaves;       // leaves, i.e. LSSS rows, after comparisons expand
+  size_t maxGateWidth;    // inputs of one gate once and/or chains are merged
+  size_t maxAttributes;   // attribute list entries, after numbers expand
+};
+
+// the limits every Driver starts from; defaults are the POLICY_MAX_* values
+OpenABEPolicyLimits getPolicyLimits();
+void setPolicyLimits(const OpenABEPolicyLimits &limits);
+
 /** The Driver class brings together all components. It creates an instance of
  * the Parser and Scanner classes and connects them. Then the input stream is
  * fed into the scanner object and the parser gets it's token
@@ -109,6 +130,17 @@ public:
   bool parse_string(const std::string& prefix, const std::string& input,
                     const std::string& sname = "string stream");
 
+  /** Parse an input string with the hand-written recursive-descent parser.
+   * Accepts the same grammar and builds the same structures as parse_string,
+   * but reads the string in place: no prefix copy, string stream, flex
+   * buffer or bison stack, and no shared state, so any number may run at
+   * once (one Driver each).
+   * @param isPolicy	parse a policy (true) or an attribute list (false)
+   * @param input	input string
+   * @return		true if successfully parsed
+   */
+  bool parse_input(bool isPolicy, const std::string& input);
+
   /** Invoke the scanner and parser on a file. Use parse_stream with a
    * std::ifstream if detection of file reading errors is required.
    * @param filename	input file name
@@ -126,13 +158,14 @@ public:
 
   /** General error handling. This can be modified to output the error
    * e.g. to a dialog box. */
-  // void error(const std::string& m);
+  void error(const std::string& m);
 
   /** Pointer to the current lexer instance, this is used to connect the
    * parser to the scanner. It is used in the yylex macro. */
   class Scanner* lexer;
 
   /* helper functions */
+  const OpenABEPolicyLimits& getLimits() const { return this->limits; }
   std::unique_ptr<OpenABEPolicy> getPolicy() { return std::move(this->final_policy); }
   std::unique_ptr<OpenABEAttributeList> getAttributeList() { return std::move(this->final_attrlist); }
   void set_policy(OpenABETreeNode *subtree);
@@ -175,12 +208,30 @@ private:
   std::string original_input;
 
   bool debug, isPolicy;
+  OpenABEPolicyLimits limits;
+  size_t num_leaves;
   std::unique_ptr<OpenABEPolicy> final_policy;
   std::unique_ptr<OpenABEAttributeList> final_attrlist;
   // helper functions for non-numerical attributes
-  OpenABETreeNode* bit_marker_list(bool flex, bool gt, std::string attr, int bits, uint32_t value);
-  OpenABETreeNode* cmp_policy(OpenABEUInteger* number, bool gt, std::string attr);
+  // comparison over bits [0, bits) of value, with markers labeled for label_bits
+  OpenABETreeNode* bit_marker_list(bool flex, bool gt, std::string attr, int bits, uint32_t value,
+                                   int label_bits);
+  // domain_bits (0 = all) bounds the values the attribute can take, and
+  // markers for bits it can never set are left out
+  OpenABETreeNode* cmp_policy(OpenABEUInteger* number, bool gt, std::string attr, int domain_bits = 0);
+  OpenABETreeNode* eq_bits_policy(const std::string &c, OpenABEUInteger *number, int domain_bits);
+  // lo < attr < hi, sharing the markers of the bits lo and hi agree on
+  OpenABETreeNode* range_bits_policy(const std::string &c, OpenABEUInteger *lo, OpenABEUInteger *hi,
+                                     int domain_bits);
   OpenABETreeNode* flexint_leader(bool gt, std::string attr, uint32_t value);
+  // attribute list helpers that append to one list (shared by both parsers)
+  void finish_attrlist(std::vector<std::string>& attr_list);
+  void append_leaf_attr(std::vector<std::string>& attrs, const std::string& c);
+  void append_attr_num(std::vector<std::string>& attrs, const std::string& c, OpenABEUInteger *number);
+  void append_date_in_attrlist(std::vector<std::string>& attrs, const std::string& prefix,
+                               const std::string& month, OpenABEUInteger *m,
+                               OpenABEUInteger *d, OpenABEUInteger *y);
+  friend class DirectParser;
 };
 
 std::pair<std::string,std::string> check_attribute(const std::string& c);
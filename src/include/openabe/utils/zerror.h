@@ -101,6 +101,8 @@ typedef enum _OpenABE_ERROR {
   OpenABE_ERROR_KEYGEN_FAILED = 59,
   OpenABE_ERROR_NO_PLAINTEXT_SPECIFIED = 60,
   OpenABE_ERROR_INVALID_TAG_LENGTH = 61,
+  OpenABE_ERROR_POLICY_NOT_SATISFIED = 62,
+  OpenABE_ERROR_POLICY_TOO_COMPLEX = 63,
   OpenABE_ERROR_UNKNOWN = 99,
   OpenABE_INVALID_INPUT_TYPE = 100
 } OpenABE_ERROR;
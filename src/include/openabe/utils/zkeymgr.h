@@ -35,8 +35,12 @@
 #define __ZKEYMGR_H__
 
 #include <map>
+#include <deque>
+#include <set>
 #include <vector>
 #include <mutex>
+#include <thread>
+#include <condition_variable>
 
 namespace oabe {
 
@@ -52,11 +56,26 @@ struct _OpenABEMetadata {
     OpenABECurveID curveID;
     OpenABEByteString keyBlob;
     uint64_t keyExpirationDate;
+    /* attributes the key is indexed under (empty if unindexed) */
+    std::vector<std::string> indexTerms;
+    /* where keyBlob lives in the store when it isn't held in memory */
+    uint64_t blobOffset = 0;
+    uint32_t blobLen = 0;
+    /* decrypt cost estimate, set by addKeyMetadata: pairings spent per row
+     * the decrypt uses plus a fixed number, and the key's own row count */
+    uint32_t pairingsPerRow = 1, fixedPairings = 0, keyRows = 0;
 };
 
-#define MAX_KEYS_PER_USER  20
 typedef std::shared_ptr<_OpenABEMetadata> OpenABEMetadata;
 
+struct OpenABEEvictionStats {
+    uint64_t sweeps;          /* eviction passes run */
+    uint64_t keysEvicted;     /* expired keys removed */
+    uint64_t bytesZeroized;   /* key blob bytes wiped from memory */
+    uint64_t lastSweepTime;   /* time the last pass ran against */
+    size_t   lastSweepKeys;   /* keys removed by the last pass */
+};
+
 struct OpenABEKeyQuery {
     bool isEfficient, frequentlyAccessed;
     uint64_t currentTime;
@@ -82,28 +101,101 @@ public:
                                                 OpenABEByteString& keyBlob, uint64_t keyExpireDate,
                                                 bool canCacheKey = false);
 
+    // all of a user's keys as one key ring (see zkeyring.h), and back: the
+    // keys of a ring are decoded in parallel and stored under one lock.
+    // Returns the number of keys stored (see storeWithKeyIDCommand)
+    OpenABE_ERROR exportKeyRingCommand(const std::string& userId, OpenABEByteString& ring);
+    size_t importKeyRingCommand(const std::string& userId, const OpenABEByteString& ring,
+                               uint64_t keyExpireDate, bool canCacheKey = false);
+
     // tries to find a decryption key that can decrypt one ciphertext
     const std::string searchKeyCommand(OpenABEKeyQuery* query, OpenABEFunctionInput *func_input);
     // deletes keys that satisfy the query (excludes efficiency check though)
     std::vector<std::string> deleteKeyCommand(OpenABEKeyQuery* query);
 
-    // set the passphrase (used to encrypt DB on disk)
-    void setPassphrase(const std::string& programId, const std::string& userId, const std::string& passphrase);
+    // set the passphrase that seals the user's keys in the store; starts a new key session
+    void setPassphrase(const std::string& programId, const std::string& userId, const std::string& passphrase,
+                       int iterationCount = OpenABE_KDF_ITERATION_COUNT);
+    // end the user's passphrase session and wipe its derived keys
+    void clearPassphrase(const std::string& userId);
     // get active user map
     std::map<std::string,std::string> getActiveUsers();
-    int getUserKeyCount(const std::string& userId);
+    // number of keys currently held for the user
+    size_t getUserKeyCount(const std::string& userId);
+
+    // back the keys with an append-only log at 'path': the keys already in
+    // the log are indexed without loading their blobs, keys held in memory
+    // are written to it, and every later store or delete is appended. Blobs
+    // are sealed under their owner's passphrase, so a user needs one set
+    // (setPassphrase) before any of their keys can be written or read back
+    OpenABE_ERROR openStore(const std::string& path);
+    // rewrite the log without deleted or replaced keys
+    OpenABE_ERROR compactStore();
+    // load the blobs back into memory and stop using the log
+    void closeStore();
+
+    // remove every key that expired at or before currentTime (0 = now),
+    // wiping its blob; keys with an expiration date of 0 never expire
+    size_t evictExpiredKeys(uint64_t currentTime = 0);
+    // run evictExpiredKeys every intervalSeconds on a background thread
+    void startEvictionThread(unsigned int intervalSeconds = KEYSTORE_EVICTION_INTERVAL);
+    void stopEvictionThread();
+    OpenABEEvictionStats getEvictionStats();
 
 protected:
     std::vector<std::string> filterKeys(const std::string& userId, OpenABEFunctionInputType type);
+    // like filterKeys, but only keys that share an attribute with funcInput
+    std::vector<std::string> candidateKeys(const std::string& userId, OpenABEFunctionInput *funcInput);
+    bool storeWithKeyID(const std::string& userId, const std::string keyID,
+                        OpenABEByteString& keyBlob, uint64_t keyExpireDate,
+                        bool canCacheKey);
+    // the two halves of storeWithKeyID: decodeKey needs no lock
+    OpenABEMetadata decodeKey(const std::string& keyID, OpenABEByteString& keyBlob,
+                              std::shared_ptr<ZGroup>& group);
+    bool insertKey(const std::string& userId, const std::string& keyID,
+                   OpenABEMetadata& metadata, OpenABEByteString& keyBlob,
+                   uint64_t keyExpireDate, bool canCacheKey);
+    void addKeyMetadata(const std::string& keyID, OpenABEMetadata& metadata);
+    void removeKeyMetadata(const std::string& keyID);
+    // removeKeyMetadata plus a delete record when the key is in the store
+    void dropKey(const std::string& keyID);
+    OpenABE_ERROR appendToStore(const std::string& keyID, OpenABEMetadata& metadata,
+                                OpenABEByteString& keyBlob);
+    OpenABE_ERROR readFromStore(const std::string& keyID, OpenABEMetadata& metadata,
+                                OpenABEByteString& keyBlob);
     std::vector<std::string> getKeyIds(const std::string& userId, uint64_t currentTime = 0);
-    void rankKeyAlgorithm(std::vector<std::string>& keyIDs, OpenABEKeyQuery* query);
+    // order satisfying keys (with the rows each would use) cheapest decrypt first
+    void rankKeyAlgorithm(std::vector<KeyRef>& satKeys, OpenABEKeyQuery* query);
+    bool getRankedKey(const std::string& cacheKey, std::string& keyID);
+    void cacheRankedKey(const std::string& cacheKey, const std::string& keyID);
+    void clearRankedKeys();
     std::pair<bool,int> testAKey(OpenABEMetadata& key, OpenABEFunctionInput* funcInput);
-    std::mutex ks_lock_;
+    // shared by lookups and searches, exclusive for stores and deletes
+    OpenABERWLock ks_lock_;
     const std::string searchKey(OpenABEKeyQuery* query, OpenABEFunctionInput *funcInput);
     std::map<std::string, OpenABEMetadata> keyMetadata_;
-    std::map<std::string, unsigned int> keyCounter_;
+    // next counter for storeWithKeyPrefixCommand (never reused)
+    std::map<std::string, uint64_t> keyCounter_;
     std::map<std::string, std::string> keyPassphrase_, activeUsers_;
+    std::map<std::string, std::shared_ptr<OpenABEPasswordKeyCache>> passphraseKeys_;
     std::map<std::string, bool> keyLoaded_;
+    // indexes over keyMetadata_, maintained by add/removeKeyMetadata
+    std::map<std::string, std::set<std::string>> keysByAttribute_, keysByUser_;
+    std::set<std::string> unindexedKeys_;
+    std::set<std::pair<uint64_t, std::string>> keysByExpiration_;
+    std::map<std::string, std::string> keysByInput_;
+    OpenABEKeystoreLog store_;
+    OpenABEEvictionStats evictionStats_;
+    // searchKey answers to efficient queries, by user and input (searches
+    // only hold ks_lock_ shared, so this has a lock of its own)
+    std::mutex rankCacheLock_;
+    std::map<std::string, std::string> rankCache_;
+    std::deque<std::string> rankCacheOrder_;
+    // background sweeper
+    std::mutex sweeperLock_;
+    std::condition_variable sweeperWake_;
+    std::thread sweeper_;
+    bool sweeperStop_;
 };
 
 std::unique_ptr<OpenABEFunctionInput> getFunctionInput(OpenABEKey *key);
@@ -0,0 +1,67 @@
+///
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+///
+/// This file is part of Zeutro's OpenABE.
+///
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+///
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+///
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+///
+/// \file   zkeyring.h
+///
+/// \brief  Key rings: many exported user keys in one indexed binary blob.
+///
+/// \author J. Ayo Akinyele
+///
+
+#ifndef __ZKEYRING_H__
+#define __ZKEYRING_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace oabe {
+
+///
+/// @struct OpenABEKeyRingEntry
+///
+/// @brief  One key of a key ring: the ID it is stored under and its blob,
+///         as exported by OpenABEKey::exportKeyToBytes.
+///
+struct OpenABEKeyRingEntry {
+  std::string keyID;
+  OpenABEByteString keyBlob;
+};
+
+// write the keys as one key ring. They must all have the library version,
+// curve and scheme of the first key, which the ring holds once; the index
+// after it locates each key, so a reader can split the ring up front and
+// decode the keys independently
+OpenABE_ERROR OpenABE_writeKeyRing(const std::vector<OpenABEKeyRingEntry> &keys,
+                                   OpenABEByteString &ring);
+// the keys of a key ring, each blob as it was exported
+OpenABE_ERROR OpenABE_readKeyRing(const uint8_t *ring, size_t len,
+                                  std::vector<OpenABEKeyRingEntry> &keys);
+
+}
+
+#endif // __ZKEYRING_H__
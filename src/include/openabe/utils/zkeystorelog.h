@@ -0,0 +1,109 @@
+/// 
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+/// 
+/// This file is part of Zeutro's OpenABE.
+/// 
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+/// 
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+/// 
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+/// 
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+///
+/// \file   zkeystorelog.h
+///
+/// \brief  File-backed log of key blobs for the keystore manager.
+///
+/// \author J. Ayo Akinyele
+///
+
+#ifndef __ZKEYSTORELOG_H__
+#define __ZKEYSTORELOG_H__
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace oabe {
+
+///
+/// @brief  Everything the keystore manager needs to index a key without
+///         parsing it. The blob itself stays in the log until it is read.
+///
+struct OpenABEKeystoreRecord {
+  std::string keyID, userId;
+  // compact form of the key's attribute list or policy
+  std::string input;
+  OpenABEFunctionInputType inputType;
+  OpenABE_SCHEME schemeID;
+  OpenABECurveID curveID;
+  uint64_t keyExpirationDate;
+  bool isCached;
+  // where the blob lives in the log
+  uint64_t blobOffset;
+  uint32_t blobLen;
+};
+
+///
+/// @class  OpenABEKeystoreLog
+///
+/// @brief  Append-only log of stored and deleted keys. Opening the log
+///         replays the record headers through a read-only mapping, so key
+///         blobs are not touched until readBlob asks for one. Blobs are
+///         written as given: the keystore manager seals them under the
+///         owner's passphrase first. The checksum on each record header
+///         and blob only catches torn writes; a torn record at the tail
+///         (e.g. after a crash mid-append) is cut off on open.
+///         compact() rewrites the log with only the live keys.
+///
+class OpenABEKeystoreLog {
+public:
+  OpenABEKeystoreLog();
+  ~OpenABEKeystoreLog();
+
+  // open (creating if needed) and return the live keys in log order
+  OpenABE_ERROR open(const std::string& path, std::vector<OpenABEKeystoreRecord>& records);
+  void close();
+  bool isOpen() const { return fd_ >= 0; }
+  const std::string& getPath() const { return path_; }
+
+  // append a key; sets record.blobOffset and record.blobLen
+  OpenABE_ERROR appendKey(OpenABEKeystoreRecord& record, OpenABEByteString& keyBlob);
+  OpenABE_ERROR appendDelete(const std::string& keyID);
+  OpenABE_ERROR readBlob(uint64_t blobOffset, uint32_t blobLen, OpenABEByteString& keyBlob);
+  // rewrite the log with only these keys (their blob offsets are updated)
+  OpenABE_ERROR compact(std::vector<OpenABEKeystoreRecord>& records);
+  uint64_t size();
+
+private:
+  OpenABE_ERROR appendBytes(OpenABEByteString& bytes);
+  bool remap();
+  void unmap();
+
+  std::mutex lock_;
+  std::string path_;
+  int fd_;
+  uint8_t *map_;
+  size_t mapLen_;
+  uint64_t fileLen_;
+};
+
+}
+
+#endif // __ZKEYSTORELOG_H__
@@ -0,0 +1,230 @@
+///
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+///
+/// This file is part of Zeutro's OpenABE.
+///
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+///
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+///
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+/// \file   zmetrics.h
+///
+/// \brief  Opt-in operation counters and API latency histograms.
+///
+/// \author J. Ayo Akinyele
+///
+
+#ifndef __ZMETRICS_H__
+#define __ZMETRICS_H__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace oabe {
+
+///
+/// Operation counters. Multi-exponentiations count one exponentiation per
+/// base and multi-pairings one pairing per pair. The allocation counters
+/// stay at zero unless the program installs the hooks from zallochooks.h.
+/// Accelerated ops are the pairing products and multi-exponentiations that
+/// an OpenABEBatchAccelerator computed. Points decoded are the G1, G2 and
+/// GT elements of keys and ciphertexts decoded (and validated) on load or,
+/// when loaded lazily, on first use.
+///
+typedef enum _OpenABEMetric {
+  OpenABE_METRIC_PAIRINGS = 0,
+  OpenABE_METRIC_MULTI_PAIRINGS,
+  OpenABE_METRIC_G1_EXP,
+  OpenABE_METRIC_G2_EXP,
+  OpenABE_METRIC_GT_EXP,
+  OpenABE_METRIC_FIXED_BASE_EXP,
+  OpenABE_METRIC_HASH_TO_G1,
+  OpenABE_METRIC_HASH_CACHE_HITS,
+  OpenABE_METRIC_HASH_CACHE_MISSES,
+  OpenABE_METRIC_POLICY_CACHE_HITS,
+  OpenABE_METRIC_POLICY_CACHE_MISSES,
+  OpenABE_METRIC_PLAN_CACHE_HITS,
+  OpenABE_METRIC_PLAN_CACHE_MISSES,
+  OpenABE_METRIC_KEY_CACHE_HITS,
+  OpenABE_METRIC_KEY_CACHE_MISSES,
+  OpenABE_METRIC_BYTES_ENCRYPTED,
+  OpenABE_METRIC_BYTES_DECRYPTED,
+  OpenABE_METRIC_ALLOCATIONS,
+  OpenABE_METRIC_ALLOCATED_BYTES,
+  OpenABE_METRIC_ACCELERATED_OPS,
+  OpenABE_METRIC_POINTS_DECODED,
+  OpenABE_METRIC_COUNT
+} OpenABEMetric;
+
+///
+/// API calls with a latency histogram.
+///
+typedef enum _OpenABELatencyMetric {
+  OpenABE_LATENCY_ENCRYPT = 0,
+  OpenABE_LATENCY_DECRYPT,
+  OpenABE_LATENCY_KEYGEN,
+  OpenABE_LATENCY_IMPORT,
+  OpenABE_LATENCY_COUNT
+} OpenABELatencyMetric;
+
+// bucket 0 holds calls under 1us, bucket i those in [2^(i-1), 2^i) us
+#define OpenABE_LATENCY_BUCKETS   32
+
+struct OpenABELatencyHistogram {
+  uint64_t count;
+  uint64_t totalNanos;
+  uint64_t buckets[OpenABE_LATENCY_BUCKETS];
+  // heap high-water mark of each call above the bytes live at its start
+  // (with the allocation hooks); the maximum is not moved by a reset
+  uint64_t peakBytesTotal;
+  uint64_t peakBytesMax;
+
+  double meanMicros() const;
+  double meanPeakBytes() const;
+  // upper bound (in us) of the bucket holding the p-quantile, p in [0, 1]
+  double percentileMicros(double p) const;
+};
+
+///
+/// \class  OpenABEMetricsSnapshot
+/// \brief  Counter values and histograms at one point in time.
+///
+struct OpenABEMetricsSnapshot {
+  uint64_t counters[OpenABE_METRIC_COUNT];
+  OpenABELatencyHistogram latency[OpenABE_LATENCY_COUNT];
+
+  OpenABEMetricsSnapshot() { this->clear(); }
+  void clear();
+  uint64_t get(OpenABEMetric metric) const { return this->counters[metric]; }
+  const OpenABELatencyHistogram& get(OpenABELatencyMetric metric) const {
+    return this->latency[metric];
+  }
+  void add(const OpenABEMetricsSnapshot &other);
+  void subtract(const OpenABEMetricsSnapshot &other);
+  // one "name value" line per counter and per non-empty histogram
+  std::string toString() const;
+};
+
+const char *OpenABE_metricName(OpenABEMetric metric);
+const char *OpenABE_latencyMetricName(OpenABELatencyMetric metric);
+
+/*!
+ * Turn collection on or off (it is off by default). While off, each
+ * instrumented operation costs a single relaxed atomic load.
+ */
+void OpenABE_setMetricsEnabled(bool enabled);
+
+/*!
+ * Library-wide totals since startup (or since the last reset), summed over
+ * the per-thread counters of every thread, live or exited.
+ */
+void OpenABE_getMetrics(OpenABEMetricsSnapshot &snapshot);
+void OpenABE_resetMetrics();
+
+namespace metrics {
+extern std::atomic<bool> enabled;
+void count(OpenABEMetric metric, uint64_t n);
+bool enterScope();
+void leaveScope(OpenABELatencyMetric metric, uint64_t nanos, uint64_t peakBytes);
+void readThread(uint64_t counters[OpenABE_METRIC_COUNT]);
+
+// called by the allocation hooks
+void allocated(size_t bytes);
+void freed(size_t bytes);
+
+// Heap high-water mark of the calling thread between markPeak() and
+// peakSince(), in bytes above those live at markPeak(). Marks nest.
+struct PeakMark {
+  int64_t savedPeak, startLive;
+};
+PeakMark markPeak();
+uint64_t peakSince(const PeakMark &mark);
+}
+
+inline bool OpenABE_metricsEnabled() {
+  return metrics::enabled.load(std::memory_order_relaxed);
+}
+
+inline void OpenABE_countMetric(OpenABEMetric metric, uint64_t n = 1) {
+  if (OpenABE_metricsEnabled()) {
+    metrics::count(metric, n);
+  }
+}
+
+///
+/// \class  OpenABEMetricsCollector
+/// \brief  Totals for the API calls of one context (see OpenABEMetricsScope).
+///
+class OpenABEMetricsCollector {
+public:
+  void add(const uint64_t counters[OpenABE_METRIC_COUNT],
+           OpenABELatencyMetric metric, uint64_t nanos, uint64_t peakBytes);
+  void snapshot(OpenABEMetricsSnapshot &snapshot);
+  void reset();
+
+private:
+  std::mutex lock_;
+  OpenABEMetricsSnapshot totals_;
+};
+
+///
+/// \class  OpenABEMetricsScope
+/// \brief  Times one API call into the latency histogram of the calling
+///         thread. With a collector, the call's latency and the counters
+///         it moved on this thread are also added to the collector. Only
+///         the outermost scope on a thread records, so an API call made by
+///         another one is not counted twice.
+///
+class OpenABEMetricsScope {
+public:
+  OpenABEMetricsScope(OpenABELatencyMetric metric,
+                      OpenABEMetricsCollector *collector = nullptr)
+      : metric_(metric), collector_(collector),
+        active_(OpenABE_metricsEnabled() && metrics::enterScope()) {
+    if (this->active_) {
+      this->start();
+    }
+  }
+  ~OpenABEMetricsScope() {
+    if (this->active_) {
+      this->finish();
+    }
+  }
+  OpenABEMetricsScope(const OpenABEMetricsScope&) = delete;
+  OpenABEMetricsScope& operator=(const OpenABEMetricsScope&) = delete;
+
+private:
+  void start();
+  void finish();
+
+  OpenABELatencyMetric metric_;
+  OpenABEMetricsCollector *collector_;
+  bool active_;
+  metrics::PeakMark peak_;
+  std::chrono::steady_clock::time_point start_;
+  uint64_t before_[OpenABE_METRIC_COUNT];
+};
+
+}
+
+#endif // __ZMETRICS_H__
@@ -0,0 +1,107 @@
+///
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+///
+/// This file is part of Zeutro's OpenABE.
+///
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+///
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+///
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+///
+/// \file   zperiodtree.h
+///
+/// \brief  Time periods as a binary tree of attributes, for CP-ABE keys
+///         that are kept valid with small per-period key updates.
+///
+/// \author J. Ayo Akinyele
+///
+
+#ifndef __ZPERIODTREE_H__
+#define __ZPERIODTREE_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace oabe {
+
+///
+/// @class  OpenABEPeriodTree
+///
+/// @brief  Numbers the periods of periodDays days since the epoch (dates as
+///         the policy parser reads them) as the leaves of a binary tree of
+///         the given depth, and names each node of the tree by an attribute
+///         "prefix:<bits>", its path from the root with an 'x' for each
+///         level below it (the leaf of period 5 at depth 4 is
+///         "period:0101", its parent "period:010x", the root
+///         "period:xxxx").
+///
+///         A ciphertext for period t is encrypted under the clause
+///         policy(t): an OR of the depth + 1 nodes on the path to leaf t. A
+///         key is made valid for the periods [first, last] by giving it the
+///         attributes in attributes(first, last), the at most 2 * depth
+///         nodes whose subtrees cover exactly those leaves, so it satisfies
+///         the clause of every period in the interval and of no other.
+///         With CP-ABE, the long-lived key gets the user's attributes from
+///         keygen and each renewal is a key update
+///         (OpenABECryptoContext::generateKeyUpdate) holding only the
+///         cover nodes, bound to that key's randomness.
+///
+class OpenABEPeriodTree {
+public:
+  // depth is at most TIME_BITS (every date the parser takes fits in 16 bits)
+  OpenABEPeriodTree(const std::string &prefix = "period", uint32_t depth = TIME_BITS,
+                    uint32_t periodDays = 1);
+
+  const std::string &getPrefix() const { return this->prefix_; }
+  uint32_t getDepth() const { return this->depth_; }
+  uint32_t getPeriodDays() const { return this->periodDays_; }
+  // the number of periods the tree holds
+  uint32_t size() const { return (uint32_t)1 << this->depth_; }
+
+  // the period of a date ("April 18, 2018") or of a day count since the
+  // epoch; throws OpenABE_ERROR if it is past the last period
+  uint32_t periodOf(const std::string &date) const;
+  uint32_t periodOfDay(uint32_t days) const;
+  // the first second (since the epoch) after the period, e.g. for the
+  // expiration date of a key kept in OpenABEKeystoreManager
+  uint64_t periodEnd(uint32_t period) const;
+
+  // the nodes from the root down to the leaf of period
+  std::vector<std::string> pathNodes(uint32_t period) const;
+  // the fewest nodes whose leaves are exactly [first, last]
+  std::vector<std::string> coverNodes(uint32_t first, uint32_t last) const;
+
+  // "(n_0 or ... or n_depth)" over pathNodes, to AND into a policy
+  std::string policy(uint32_t period) const;
+  // "|c_1|...|c_k" over coverNodes, an attribute list for keygen or a
+  // key update
+  std::string attributes(uint32_t first, uint32_t last) const;
+
+private:
+  std::string nodeAttribute(uint32_t level, uint32_t index) const;
+
+  std::string prefix_;
+  uint32_t depth_, periodDays_;
+};
+
+}
+
+#endif // __ZPERIODTREE_H__
@@ -47,6 +47,7 @@ namespace oabe {
 
 // forward declare
 class OpenABEByteString;
+class OpenABELSSSCompiledPolicy;
 #define PREFIX_SEP  ':'
 
 typedef enum _zGateType {
@@ -114,9 +115,11 @@ public:
     }
   }
   const int getIndex() const   { return this->m_Index; }
+  void setIndex(int index)    { this->m_Index = index; }
   void setThresholdValue(uint32_t k) { if (this->m_Subnodes.size() > 0) { this->m_thresholdValue = k; } }
   uint32_t getThresholdValue();
   std::string toString();
+  void appendString(std::string& out);
 
   // Canonicalization support methods
   void reorderSubnodes(const std::vector<OpenABETreeNode*>& new_order);
@@ -132,10 +135,14 @@ public:
 class OpenABEPolicy : public OpenABEFunctionInput {
 protected:
   std::unique_ptr<OpenABETreeNode> m_rootNode;
-  bool m_hasDuplicates, m_enabledRevocation;
+  bool m_hasDuplicates, m_enabledRevocation, m_isCanonical;
   std::map<std::string, int> m_attrDuplicateCount;
   std::set<std::string> m_attrCompleteSet;
   std::string m_originalInputString;
+  // shared by every copy of a cached policy (see createPolicyTree)
+  std::shared_ptr<const OpenABELSSSCompiledPolicy> m_compiledLSSS;
+  // string form of a canonical tree, written once (see memoizeString)
+  std::string m_canonicalString;
 
 public:
   // Constructors/destructors
@@ -152,6 +159,9 @@ public:
   }
   OpenABEPolicy&    operator=(const OpenABEPolicy &rhs);
   std::string  toString() const {
+      if (!this->m_canonicalString.empty()) {
+          return this->m_canonicalString;
+      }
       return this->m_rootNode->toString();
   }
   void setCompactString(const std::string& input) {
@@ -178,6 +188,21 @@ public:
   // Canonicalization methods
   std::string toCanonicalString() const;
   void canonicalize();
+  bool isCanonical() const { return this->m_isCanonical; }
+  // remember the string form of a canonical tree that will not change again
+  void memoizeString() {
+      if (this->m_isCanonical && this->m_rootNode) {
+          this->m_canonicalString = this->m_rootNode->toString();
+      }
+  }
+
+  // precompiled secret-sharing layout, or nullptr if none was attached
+  std::shared_ptr<const OpenABELSSSCompiledPolicy> getCompiledLSSS() const {
+    return this->m_compiledLSSS;
+  }
+  void setCompiledLSSS(std::shared_ptr<const OpenABELSSSCompiledPolicy> compiled) {
+    this->m_compiledLSSS = compiled;
+  }
 
 #if 0
   void		ConstructTestPolicy();
@@ -194,6 +219,9 @@ private:
   void canonicalizeNode(OpenABETreeNode* node);
   void sortChildren(OpenABETreeNode* node);
   void flattenAssociative(OpenABETreeNode* node);
+  void collapseSingleInputGates(OpenABETreeNode* node);
+  void absorbRedundant(OpenABETreeNode* node);
+  void renumberLeaves();
 };
 
 // split a string based on a delimiter and return a vector
@@ -201,6 +229,25 @@ std::vector<std::string> split(const std::string &s, char delim);
 // print the string of the internal tree node gate
 const char* OpenABETreeNode_ToString(zGateType type);
 std::unique_ptr<OpenABEPolicy> createPolicyTree(std::string s);
+// drop the parsed policies that createPolicyTree keeps for reuse
+void clearPolicyCache();
+size_t getPolicyCacheCount();
+// the input strings of the cached policies, most recently used first
+std::vector<std::string> getCachedPolicyInputs();
+// the policy dictionary: ciphertexts encrypted under a registered policy
+// carry the digest of its canonical string ("policyHash") instead of the
+// policy itself, so whoever decrypts them must register the same policy
+bool registerPolicy(const std::string &s, OpenABEByteString *digest = nullptr);
+bool findPolicyDigest(const OpenABEPolicy *policy, OpenABEByteString &digest);
+// the policy a CP-ABE ciphertext carries: its digest ("policyHash", returns
+// true) when registered, otherwise the string below ("policy")
+bool policyComponentForCiphertext(const OpenABEPolicy *policy, OpenABEByteString &value);
+std::string policyStringForCiphertext(const OpenABEPolicy *policy);
+std::unique_ptr<OpenABEPolicy> createPolicyTreeFromDigest(const OpenABEByteString &digest);
+void clearPolicyDictionary();
+size_t getPolicyDictionaryCount();
+// the policy of a CP-ABE ciphertext, carried inline or by digest
+std::unique_ptr<OpenABEPolicy> getCiphertextPolicy(OpenABECiphertext *ciphertext);
 // reset all the flags in a policy tree
 bool resetFlags(OpenABETreeNode *root);
 // use to add an attribute at the OpenABEPolicy structure
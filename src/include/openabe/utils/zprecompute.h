@@ -0,0 +1,223 @@
+///
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+///
+/// This file is part of Zeutro's OpenABE.
+///
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+///
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+///
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+///
+/// \file   zprecompute.h
+///
+/// \brief  Process-wide store for precomputed tables, with a memory budget.
+///
+/// \author J. Ayo Akinyele
+///
+
+#ifndef __ZPRECOMPUTE_H__
+#define __ZPRECOMPUTE_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace oabe {
+
+class OpenABEPrecomputeTicket;
+
+///
+/// @struct OpenABEPrecomputeStats
+///
+/// @brief  A snapshot of the precomputation store's counters.
+///
+struct OpenABEPrecomputeStats {
+  size_t budget;          // bytes allowed for tables (0 = unlimited)
+  size_t bytesInUse;      // bytes held by live tables
+  size_t peakBytes;       // highest bytesInUse so far
+  size_t mappedBytes;     // arena memory backing them
+  size_t hugepageBytes;   // ...of which was advised to use huge pages
+  size_t tables;          // tables that can be evicted
+  size_t evictions;       // tables evicted to stay within the budget
+};
+
+///
+/// @class  OpenABEPrecomputeOwner
+///
+/// @brief  The side of a cache that the store calls back to evict one of
+///         its tables. The cache detaches it before going away; after
+///         detach() returns no callback runs or is still running. The drop
+///         function must only drop the entry if it still has this ticket,
+///         and must not call back into the store.
+///
+class OpenABEPrecomputeOwner {
+public:
+  typedef std::function<void(const std::string &, const OpenABEPrecomputeTicket *)> DropFn;
+
+  OpenABEPrecomputeOwner(DropFn drop) : drop_(drop) {}
+
+  void evict(const std::string &key, const OpenABEPrecomputeTicket *ticket);
+  void detach();
+
+private:
+  std::mutex lock_;
+  DropFn drop_;
+};
+
+///
+/// @class  OpenABEPrecomputeTicket
+///
+/// @brief  Registration of one evictable table. A cache keeps the ticket
+///         next to the table and touches it on every use; dropping the
+///         ticket unregisters the table.
+///
+class OpenABEPrecomputeTicket {
+public:
+  OpenABEPrecomputeTicket(std::shared_ptr<OpenABEPrecomputeOwner> owner,
+                          const std::string &key, size_t bytes, uint64_t now)
+    : owner_(owner), key_(key), bytes_(bytes), lastUse_(now) {}
+
+  // mark the table as just used (cheap enough for every lookup)
+  void touch();
+  size_t getBytes() const { return this->bytes_; }
+
+private:
+  friend class OpenABEPrecomputeManager;
+
+  std::shared_ptr<OpenABEPrecomputeOwner> owner_;
+  std::string key_;
+  size_t bytes_;
+  std::atomic<uint64_t> lastUse_;
+};
+
+///
+/// @class  OpenABEPrecomputeManager
+///
+/// @brief  One store for the fixed-base and Miller-loop line tables of
+///         every master public key, key and ciphertext in the process.
+///         Table memory comes from chunks of PRECOMPUTE_ARENA_CHUNK_SIZE
+///         bytes, aligned and advised for transparent huge pages so that
+///         table walks stay within few TLB entries. When a budget is set,
+///         the least recently used evictable tables (attribute tables of
+///         any MPK, line tables of any key or ciphertext) are dropped until
+///         the live tables fit again. MPK generator tables count toward the
+///         budget but are never evicted.
+///
+class OpenABEPrecomputeManager {
+public:
+  // the store shared by the library (never destroyed)
+  static OpenABEPrecomputeManager *getDefault();
+
+  // limit the bytes of live tables (0 = unlimited) and evict down to it
+  void setBudget(size_t bytes);
+  size_t getBudget();
+  void getStats(OpenABEPrecomputeStats &stats);
+
+  // table memory (see OpenABEPrecomputeAllocator)
+  void *allocate(size_t bytes);
+  void deallocate(void *p, size_t bytes);
+
+  // register an evictable table; keep the ticket as long as the table
+  std::shared_ptr<OpenABEPrecomputeTicket>
+  track(std::shared_ptr<OpenABEPrecomputeOwner> owner,
+        const std::string &key, size_t bytes);
+  // evict until within the budget; call without holding any cache lock
+  void enforceBudget();
+
+  uint64_t now() { return this->clock_.fetch_add(1, std::memory_order_relaxed); }
+
+private:
+  struct Chunk;
+
+  OpenABEPrecomputeManager();
+  OpenABEPrecomputeManager(const OpenABEPrecomputeManager &);
+  OpenABEPrecomputeManager &operator=(const OpenABEPrecomputeManager &);
+
+  Chunk *mapChunk(size_t bytes);
+  void unmapChunk(Chunk *chunk);
+  void pruneLocked();
+
+  std::mutex lock_;
+  std::atomic<uint64_t> clock_;
+  Chunk *current_;
+  size_t budget_;
+  size_t bytesInUse_;
+  size_t peakBytes_;
+  size_t mappedBytes_;
+  size_t hugepageBytes_;
+  size_t evictions_;
+  size_t pruneAt_;
+  std::vector<std::weak_ptr<OpenABEPrecomputeTicket>> tickets_;
+};
+
+///
+/// @class  OpenABEPrecomputeAllocator
+///
+/// @brief  Standard allocator that draws from the precomputation store.
+///
+template <typename T>
+class OpenABEPrecomputeAllocator {
+public:
+  typedef T value_type;
+
+  OpenABEPrecomputeAllocator() {}
+  template <typename U>
+  OpenABEPrecomputeAllocator(const OpenABEPrecomputeAllocator<U> &) {}
+
+  T *allocate(size_t n) {
+    if (n > (size_t)-1 / sizeof(T)) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T *>(OpenABEPrecomputeManager::getDefault()->allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T *p, size_t n) {
+    OpenABEPrecomputeManager::getDefault()->deallocate(p, n * sizeof(T));
+  }
+};
+
+template <typename T, typename U>
+bool operator==(const OpenABEPrecomputeAllocator<T> &,
+                const OpenABEPrecomputeAllocator<U> &) {
+  return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const OpenABEPrecomputeAllocator<T> &,
+                const OpenABEPrecomputeAllocator<U> &) {
+  return false;
+}
+
+///
+/// \typedef    OpenABEPrecomputeVector
+/// \brief      Vector whose storage comes from the precomputation store
+///
+template <typename T>
+using OpenABEPrecomputeVector = std::vector<T, OpenABEPrecomputeAllocator<T>>;
+
+}
+
+#endif /* __ZPRECOMPUTE_H__ */
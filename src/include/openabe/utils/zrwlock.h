@@ -0,0 +1,111 @@
+/// 
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+/// 
+/// This file is part of Zeutro's OpenABE.
+/// 
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+/// 
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+/// 
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+/// 
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+/// \file   zrwlock.h
+///
+/// \brief  Reader/writer lock for structures that are mostly read.
+///
+/// \author J. Ayo Akinyele
+///
+
+#ifndef __ZRWLOCK_H__
+#define __ZRWLOCK_H__
+
+#include <condition_variable>
+#include <mutex>
+
+namespace oabe {
+
+/// \class  OpenABERWLock
+/// \brief  Many readers or one writer. Waiting writers hold off new readers
+///         so a steady stream of lookups cannot starve an update. Follows
+///         the std::shared_mutex interface (which needs C++17), so it works
+///         with std::lock_guard and std::unique_lock for exclusive access.
+class OpenABERWLock {
+public:
+  OpenABERWLock() : readers_(0), waitingWriters_(0), writer_(false) {}
+  OpenABERWLock(const OpenABERWLock&) = delete;
+  OpenABERWLock& operator=(const OpenABERWLock&) = delete;
+
+  void lock() {
+    std::unique_lock<std::mutex> guard(this->lock_);
+    this->waitingWriters_++;
+    this->writerCv_.wait(guard, [this] { return !this->writer_ && this->readers_ == 0; });
+    this->waitingWriters_--;
+    this->writer_ = true;
+  }
+
+  void unlock() {
+    {
+      std::lock_guard<std::mutex> guard(this->lock_);
+      this->writer_ = false;
+    }
+    this->writerCv_.notify_one();
+    this->readerCv_.notify_all();
+  }
+
+  void lock_shared() {
+    std::unique_lock<std::mutex> guard(this->lock_);
+    this->readerCv_.wait(guard, [this] { return !this->writer_ && this->waitingWriters_ == 0; });
+    this->readers_++;
+  }
+
+  void unlock_shared() {
+    bool last;
+    {
+      std::lock_guard<std::mutex> guard(this->lock_);
+      last = (--this->readers_ == 0);
+    }
+    if (last) {
+      this->writerCv_.notify_one();
+    }
+  }
+
+private:
+  std::mutex lock_;
+  std::condition_variable readerCv_, writerCv_;
+  size_t readers_, waitingWriters_;
+  bool writer_;
+};
+
+/// \class  OpenABESharedLockGuard
+/// \brief  Holds an OpenABERWLock in shared (read) mode for its lifetime.
+class OpenABESharedLockGuard {
+public:
+  explicit OpenABESharedLockGuard(OpenABERWLock& rwlock) : rwlock_(rwlock) {
+    this->rwlock_.lock_shared();
+  }
+  ~OpenABESharedLockGuard() { this->rwlock_.unlock_shared(); }
+  OpenABESharedLockGuard(const OpenABESharedLockGuard&) = delete;
+  OpenABESharedLockGuard& operator=(const OpenABESharedLockGuard&) = delete;
+
+private:
+  OpenABERWLock& rwlock_;
+};
+
+}
+
+#endif // __ZRWLOCK_H__
@@ -0,0 +1,94 @@
+/// 
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+/// 
+/// This file is part of Zeutro's OpenABE.
+/// 
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+/// 
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+/// 
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+/// 
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+///
+/// \file   zthreadpool.h
+///
+/// \brief  Shared worker thread pool for parallel work inside the OpenABE.
+///
+/// \author J. Ayo Akinyele
+///
+
+#ifndef __ZTHREADPOOL_H__
+#define __ZTHREADPOOL_H__
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace oabe {
+
+///
+/// @class  OpenABEThreadPool
+///
+/// @brief  Fixed set of worker threads that run parallel loops. Each worker
+///         initializes the per-thread library state on startup, so callers
+///         never need to call OpenABEStateContext themselves. The calling
+///         thread always takes part in its own loop, so a loop submitted from
+///         inside a worker (or to a pool with no workers) still completes.
+///
+
+class OpenABEThreadPool {
+public:
+  OpenABEThreadPool(size_t numThreads);
+  ~OpenABEThreadPool();
+
+  // number of worker threads (excluding the caller)
+  size_t size() const { return this->workers_.size(); }
+
+  // run fn(0) ... fn(count-1) on at most maxConcurrency threads (0 = all
+  // workers plus the caller). The first exception thrown by fn is rethrown.
+  void parallelFor(size_t count, const std::function<void(size_t)> &fn,
+                   size_t maxConcurrency = 0);
+  // run task on a worker without waiting for it (on the caller if the pool
+  // has no workers). Exceptions thrown by task are dropped, so it should
+  // report its own errors. Queued tasks still run when the pool is
+  // destroyed.
+  void submit(std::function<void()> task);
+
+  // the pool shared by the library
+  static std::shared_ptr<OpenABEThreadPool> getDefault();
+  // resize the shared pool; loops already running finish on the old one
+  static void setDefaultSize(size_t numThreads);
+
+private:
+  struct Job;
+  void workerLoop();
+
+  std::mutex lock_;
+  std::condition_variable ready_;
+  std::deque<std::shared_ptr<Job>> jobs_;
+  std::vector<std::thread> workers_;
+  bool stopping_;
+};
+
+}
+
+#endif /* __ZTHREADPOOL_H__ */
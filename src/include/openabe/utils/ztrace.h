@@ -0,0 +1,170 @@
+/// 
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+/// 
+/// This file is part of Zeutro's OpenABE.
+/// 
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+/// 
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+/// 
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+/// 
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+/// \file   ztrace.h
+///
+/// \brief  Compile-time removable diagnostic tracing for the OpenABE.
+///
+/// \author J. Ayo Akinyele
+///
+
+#ifndef __ZTRACE_H__
+#define __ZTRACE_H__
+
+#include <stdint.h>
+
+//
+// Trace levels. A trace statement is compiled in only if its level is at
+// or below OpenABE_TRACE_LEVEL, which defaults to NONE (e.g., build with
+// -DOpenABE_TRACE_LEVEL=3 to enable everything). Disabled statements,
+// including their arguments, are never evaluated.
+//
+#define OpenABE_TRACE_LEVEL_NONE    0
+#define OpenABE_TRACE_LEVEL_ERROR   1
+#define OpenABE_TRACE_LEVEL_INFO    2
+#define OpenABE_TRACE_LEVEL_DEBUG   3
+
+#ifndef OpenABE_TRACE_LEVEL
+#define OpenABE_TRACE_LEVEL OpenABE_TRACE_LEVEL_NONE
+#endif
+
+#define OpenABE_TRACE_ENABLED(level) ((level) <= OpenABE_TRACE_LEVEL)
+
+#define OpenABE_TRACE(level, ...)                                              \
+  do {                                                                         \
+    if (OpenABE_TRACE_ENABLED(level)) {                                        \
+      OpenABE_traceEmit((level), __FILE__, __LINE__, __VA_ARGS__);             \
+    }                                                                          \
+  } while (0)
+
+#define OpenABE_TRACE_ERROR(...) OpenABE_TRACE(OpenABE_TRACE_LEVEL_ERROR, __VA_ARGS__)
+#define OpenABE_TRACE_INFO(...)  OpenABE_TRACE(OpenABE_TRACE_LEVEL_INFO, __VA_ARGS__)
+#define OpenABE_TRACE_DEBUG(...) OpenABE_TRACE(OpenABE_TRACE_LEVEL_DEBUG, __VA_ARGS__)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @typedef    OpenABE_TRACE_SINK
+///
+/// @brief      Callback that receives each formatted trace message
+
+typedef void (*OpenABE_TRACE_SINK)(int level, const char *file, int line,
+                                   const char *message);
+
+/*!
+ * Install a sink for trace messages. Passing NULL restores the default
+ * sink, which writes to stderr.
+ *
+ * @param[in]   the sink callback (or NULL)
+ */
+void OpenABE_setTraceSink(OpenABE_TRACE_SINK sink);
+
+/*!
+ * Format a trace message and hand it to the current sink. Callers should
+ * use the OpenABE_TRACE macros rather than calling this directly.
+ */
+void OpenABE_traceEmit(int level, const char *file, int line,
+                       const char *fmt, ...)
+#if defined(__GNUC__)
+  __attribute__((format(printf, 4, 5)))
+#endif
+  ;
+
+///
+/// Timed spans for the phases of an operation (policy parse, LSSS, row
+/// group operations, multi-pairing, KDF, AEAD, CCA verify). A span is
+/// reported to the sink when it ends, children before their parent. The
+/// fields map one-to-one onto an OpenTelemetry span: the 64-bit trace ID
+/// is the low half of the 128-bit OTel trace ID.
+///
+typedef struct _OpenABE_SPAN {
+  const char *name;
+  uint64_t traceId;         // shared by a root span and all its descendants
+  uint64_t spanId;
+  uint64_t parentSpanId;    // 0 for a root span
+  uint64_t startUnixNanos;  // wall clock, nanoseconds since the epoch
+  uint64_t durationNanos;   // monotonic clock
+  uint64_t items;           // rows, pairs or bytes handled; 0 if unset
+  int status;               // OpenABE_NOERROR (0), or the error of the phase
+} OpenABE_SPAN;
+
+/// @typedef    OpenABE_SPAN_SINK
+///
+/// @brief      Callback that receives each finished span, on the thread
+///             that ran it. The span is only valid during the call.
+
+typedef void (*OpenABE_SPAN_SINK)(const OpenABE_SPAN *span, void *context);
+
+/*!
+ * Install a sink for spans; NULL (the default) disables span tracing, in
+ * which case starting a span costs one atomic load.
+ *
+ * @param[in]   the sink callback (or NULL)
+ * @param[in]   opaque pointer handed back to the sink
+ */
+void OpenABE_setSpanSink(OpenABE_SPAN_SINK sink, void *context);
+
+#ifdef __cplusplus
+}
+
+namespace oabe {
+
+///
+/// \class  OpenABETraceSpan
+/// \brief  Scoped span: starts when constructed and ends (and is reported)
+///         at end() or destruction. Spans nest per thread. A span that is
+///         destroyed by an exception reports OpenABE_ERROR_UNKNOWN unless a
+///         status was set.
+///
+class OpenABETraceSpan {
+public:
+  explicit OpenABETraceSpan(const char *name);
+  ~OpenABETraceSpan() { this->end(); }
+  OpenABETraceSpan(const OpenABETraceSpan&) = delete;
+  OpenABETraceSpan& operator=(const OpenABETraceSpan&) = delete;
+
+  void setItems(uint64_t items) { this->span_.items = items; }
+  void setStatus(int status) { this->span_.status = status; this->statusSet_ = true; }
+  void end() {
+    if (this->active_) {
+      this->finish();
+    }
+  }
+
+private:
+  void finish();
+
+  OpenABE_SPAN span_;
+  OpenABETraceSpan *parent_;
+  uint64_t startMonotonicNanos_;
+  bool active_, statusSet_;
+};
+
+}
+#endif
+
+#endif // __ZTRACE_H__
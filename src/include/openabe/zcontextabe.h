@@ -34,12 +34,146 @@
 #ifndef __ZCONTEXTABE_H__
 #define __ZCONTEXTABE_H__
 
+#include <list>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+namespace oabe {
+
+///
+/// @class  OpenABEPrecomputedParams
+///
+/// @brief  Fixed-base tables for the generators of a master public key and
+///         a bounded LRU cache of hashed attribute points. Points that
+///         keep being exponentiated are promoted to fixed-base tables,
+///         which the precomputation store may evict to stay within its
+///         budget (see OpenABEPrecomputeManager).
+///
+
+class OpenABEPrecomputedParams {
+public:
+  OpenABEPrecomputedParams(std::shared_ptr<OpenABEKey> mpk,
+                           size_t hashCacheSize = HASH_TO_G1_CACHE_SIZE,
+                           size_t tableCacheSize = ATTRIBUTE_TABLE_CACHE_SIZE);
+  ~OpenABEPrecomputedParams();
+
+  // the master public key the tables were built from
+  std::shared_ptr<OpenABEKey> getMasterPublicKey() { return this->mpk_; }
+
+  void addG1(const std::string &label, const G1 &base);
+  void addG2(const std::string &label, const G2 &base);
+  void addGT(const std::string &label, const GT &base);
+  G1FixedBase *getG1(const std::string &label);
+  G2FixedBase *getG2(const std::string &label);
+  GTFixedBase *getGT(const std::string &label);
+  // add the generator and attribute tables to a snapshot (see
+  // OpenABEFixedBaseSnapshot)
+  void addToSnapshot(OpenABEFixedBaseSnapshot &snapshot);
+  // the hashed points in their native representation, least recently used
+  // first; importing them fills the cache without hashing again
+  void exportHashCache(std::string &out);
+  void importHashCache(const std::string &in);
+
+  // hash the labels that are not cached yet in one batch (see
+  // OpenABEPairing::hashToG1Batch), ahead of a loop over them
+  void prefetchHashes(OpenABEPairing *pairing, OpenABEByteString &k,
+                      const std::vector<std::string> &labels, size_t maxConcurrency = 0);
+  // H(k || label) in G1, served from the cache when possible
+  G1 hashToG1(OpenABEPairing *pairing, OpenABEByteString &k, const std::string &label);
+  // H(k || label)^z, through a fixed-base table once the label is hot
+  G1 hashToG1Exp(OpenABEPairing *pairing, OpenABEByteString &k,
+                 const std::string &label, const ZP &z);
+  // base^e * H(k || label)^z, the per-row term of CP-Waters and KP-GPSW
+  G1 hashToG1Exp(OpenABEPairing *pairing, OpenABEByteString &k,
+                 const std::string &label, const ZP &z,
+                 const G1FixedBase &base, const ZP &e);
+  size_t getHashCacheCount();
+  size_t getAttributeTableCount();
+
+private:
+  struct HashCacheEntry {
+    HashCacheEntry(const G1 &p) : point(p), hits(0), building(false) {}
+    G1 point;
+    size_t hits;
+    bool building;
+    std::shared_ptr<const G1FixedBase> table;
+    std::shared_ptr<OpenABEPrecomputeTicket> ticket;
+  };
+  // most recently used entries are kept at the front of the list
+  typedef std::list<std::pair<std::string, HashCacheEntry>> HashCacheList;
+
+  HashCacheList::iterator lookupHashLocked(const std::string &key);
+  HashCacheList::iterator insertHashLocked(const std::string &key, const G1 &point);
+  void dropTableLocked();
+  void evictTable(const std::string &key, const OpenABEPrecomputeTicket *ticket);
+  std::shared_ptr<const G1FixedBase> lookupForExp(OpenABEPairing *pairing,
+                                                  OpenABEByteString &k,
+                                                  const std::string &label,
+                                                  std::unique_ptr<G1> &point);
+
+  std::shared_ptr<OpenABEKey> mpk_;
+  // the snapshot tables of mpk_, if it was loaded from one
+  OpenABEAttachedTables attached_;
+  std::shared_ptr<OpenABEPrecomputeOwner> owner_;
+  std::mutex hashLock_;
+  size_t hashCacheSize_;
+  size_t tableCacheSize_;
+  size_t tableCount_;
+  HashCacheList hashList_;
+  std::unordered_map<std::string, HashCacheList::iterator> hashIndex_;
+  std::map<std::string, std::unique_ptr<G1FixedBase>> g1_;
+  std::map<std::string, std::unique_ptr<G2FixedBase>> g2_;
+  std::map<std::string, std::unique_ptr<GTFixedBase>> gt_;
+};
+
+///
+/// @class  OpenABEMasterPublicKeyHandle
+///
+/// @brief  A decoded master public key together with its precomputed
+///         tables. Never modified once built, so one handle can be
+///         attached to any number of contexts of the same scheme and used
+///         from many threads.
+///
+
+class OpenABEMasterPublicKeyHandle {
+public:
+  OpenABEMasterPublicKeyHandle(std::shared_ptr<OpenABEKey> mpk,
+                               std::shared_ptr<OpenABEPrecomputedParams> params)
+    : mpk_(mpk), params_(params) {}
+
+  std::shared_ptr<OpenABEKey> getMasterPublicKey() const { return this->mpk_; }
+  std::shared_ptr<OpenABEPrecomputedParams> getPrecomputedParams() const { return this->params_; }
+
+private:
+  std::shared_ptr<OpenABEKey> mpk_;
+  std::shared_ptr<OpenABEPrecomputedParams> params_;
+};
+
+typedef std::shared_ptr<const OpenABEMasterPublicKeyHandle> OpenABEMPKHandle;
+
+///
+/// @struct OpenABEEncryptionCost
+///
+/// @brief  Operation counts of an encryption under a function input and of
+///         the cheapest decryption of it. A multi-exponentiation counts as
+///         one exponentiation and hashes are hashes to G1.
+///
+struct OpenABEEncryptionCost {
+  uint32_t rows;             // LSSS rows (CP-ABE) or attributes (KP-ABE)
+  uint32_t minDecryptRows;   // rows the cheapest satisfying key combines
+  uint32_t encryptExps;
+  uint32_t encryptHashes;
+  uint32_t decryptPairings;  // pairs of the decryption multi-pairing
+  uint32_t decryptExps;
+  uint32_t decryptHashes;    // for the re-encryption check of the CCA transform
+};
+
 ///
 /// @class  OpenABEContextABE
 ///
 /// @brief  Abstract class for ABE-KEM scheme.
 ///
-namespace oabe {
 
 class OpenABEContextABE : public OpenABEContext {
 public:
@@ -62,6 +196,98 @@ public:
                                OpenABECiphertext *ciphertext) = 0;
   virtual OpenABE_ERROR decryptKEM(const std::string &mpkID, const std::string &keyID, OpenABECiphertext *ciphertext,
                                uint32_t keyByteLen, const std::shared_ptr<OpenABESymKey>& key) = 0;
+  // recompute the KEM with the given RNG and check it against 'ciphertext'
+  // component by component, stopping at the first mismatch
+  virtual OpenABE_ERROR verifyKEM(OpenABERNG *rng, const std::string &mpkID, const OpenABEFunctionInput *encryptInput,
+                               uint32_t keyByteLen, const std::shared_ptr<OpenABESymKey>& key,
+                               OpenABECiphertext *ciphertext, uint32_t &numComponents);
+  // cost estimate without encrypting: skeleton gets the components
+  // encryptKEM would set, with placeholder values of the same encoded size,
+  // so that serializing it gives the exact size of a ciphertext. For KP-ABE
+  // the rows of a decryption come from the key's policy, and the decryption
+  // cost is that of a key which uses each attribute once.
+  virtual OpenABE_ERROR estimateKEM(const std::string &mpkID, const OpenABEFunctionInput *encryptInput,
+                                    uint32_t keyByteLen, OpenABECiphertext *skeleton,
+                                    OpenABEEncryptionCost &cost) {
+    return OpenABE_ERROR_NOT_IMPLEMENTED;
+  }
+
+  // offline/online encryption: keep a pool of pre-generated, policy
+  // independent encryption work for the given MPK, used by encryptKEM
+  // whenever its RNG is not deterministic (so never under the CCA
+  // transform). Not every scheme supports it.
+  virtual OpenABE_ERROR enableEncryptionCoupons(const std::string &mpkID,
+                                                size_t poolSize = OpenABE_COUPON_POOL_SIZE,
+                                                size_t rows = OpenABE_COUPON_ROWS) {
+    return OpenABE_ERROR_NOT_IMPLEMENTED;
+  }
+  virtual void disableEncryptionCoupons(const std::string &mpkID) {}
+  virtual size_t getEncryptionCouponCount(const std::string &mpkID) { return 0; }
+
+  // outsourced decryption: split the decryption key keyID into a
+  // transformation key tkID, with which a server does the pairings of a
+  // decryption (transformKEM), and a retrieval key rkID that finishes it
+  // cheaply on the client (finishTransformedKEM). Not every scheme
+  // supports it.
+  virtual OpenABE_ERROR generateTransformKey(const std::string &keyID, const std::string &tkID,
+                                             const std::string &rkID) {
+    return OpenABE_ERROR_NOT_IMPLEMENTED;
+  }
+  virtual OpenABE_ERROR transformKEM(const std::string &mpkID, const std::string &tkID,
+                                     OpenABECiphertext *ciphertext, OpenABECiphertext *transformed) {
+    return OpenABE_ERROR_NOT_IMPLEMENTED;
+  }
+  virtual OpenABE_ERROR finishTransformedKEM(const std::string &rkID, OpenABECiphertext *transformed,
+                                             uint32_t keyByteLen, const std::shared_ptr<OpenABESymKey>& key) {
+    return OpenABE_ERROR_NOT_IMPLEMENTED;
+  }
+  // key delegation: derive from the decryption key keyID a key newKeyID
+  // for a narrower function input, without the master secret. Not every
+  // scheme supports it.
+  virtual OpenABE_ERROR delegateKey(const std::string &mpkID, const std::string &keyID,
+                                    OpenABEFunctionInput *keyInput, const std::string &newKeyID) {
+    return OpenABE_ERROR_NOT_IMPLEMENTED;
+  }
+  // key extension: add the attributes of keyInput to the decryption key
+  // keyID while keeping its randomness (needs the master secret), and
+  // store a key delta deltaID with only what was added, which the key's
+  // holder applies to its copy with applyKeyDelta
+  virtual OpenABE_ERROR extendDecryptionKey(const std::string &mpkID, const std::string &mskID,
+                                            const std::string &keyID, OpenABEFunctionInput *keyInput,
+                                            const std::string &deltaID) {
+    return OpenABE_ERROR_NOT_IMPLEMENTED;
+  }
+  virtual OpenABE_ERROR applyKeyDelta(const std::string &keyID, const std::string &deltaID) {
+    return OpenABE_ERROR_NOT_IMPLEMENTED;
+  }
+  // key update: a key delta updateID with the attributes of keyInput for
+  // the decryption key keyID (applied with applyKeyDelta), leaving keyID
+  // as it is; used for per-period renewals (see OpenABEPeriodTree)
+  virtual OpenABE_ERROR generateKeyUpdate(const std::string &mpkID, const std::string &mskID,
+                                          const std::string &keyID, OpenABEFunctionInput *keyInput,
+                                          const std::string &updateID) {
+    return OpenABE_ERROR_NOT_IMPLEMENTED;
+  }
+
+  // build (or rebuild) the fixed-base tables for the given MPK
+  OpenABE_ERROR precomputeMasterPublicParams(const std::string &mpkID);
+  // share a loaded MPK (and its tables) with other contexts
+  OpenABEMPKHandle getMasterPublicParamsHandle(const std::string &mpkID);
+  OpenABE_ERROR attachMasterPublicParams(const std::string &mpkID, const OpenABEMPKHandle &handle);
+
+  // number of threads used within a single operation (1 = serial)
+  virtual void setNumThreads(uint32_t numThreads) { this->numThreads_ = (numThreads == 0) ? 1 : numThreads; }
+  uint32_t getNumThreads() const { return this->numThreads_; }
+
+protected:
+  std::shared_ptr<OpenABEPrecomputedParams> getPrecomputedParams(const std::string &mpkID);
+  // MPK components that are used as fixed bases by the scheme
+  std::vector<std::string> fixedBaseG1_, fixedBaseG2_, fixedBaseGT_;
+  uint32_t numThreads_;
+
+private:
+  std::mutex precomputedLock_;
+  std::map<std::string, std::shared_ptr<OpenABEPrecomputedParams>> precomputed_;
 };
 
 
@@ -74,7 +300,11 @@ public:
 
 class OpenABEContextSchemeCPA : public ZObject {
 private:
-  OpenABE_ERROR    loadKey(const std::string &ID, OpenABEByteString &keyBlob, zKeyType keyType);
+  OpenABE_ERROR    loadKey(const std::string &ID, OpenABEByteString &keyBlob, zKeyType keyType,
+                           bool deferValidation = false,
+                           const OpenABEAttachedTables &attached = nullptr);
+  OpenABE_ERROR    decryptData(const std::shared_ptr<OpenABESymKey> &K, OpenABEByteString *plaintext,
+                               OpenABECiphertext *ciphertext);
   bool         isMAABE;
 
 protected:
@@ -86,13 +316,58 @@ public:
 
   void setSchemeType(OpenABE_SCHEME scheme_type) { this->m_KEM_->setSchemeType(scheme_type); }
   OpenABE_SCHEME getSchemeType() { return this->m_KEM_->getSchemeType(); }
+  void setNumThreads(uint32_t numThreads) { this->m_KEM_->setNumThreads(numThreads); }
+  OpenABE_ERROR enableEncryptionCoupons(const std::string &mpkID,
+                                        size_t poolSize = OpenABE_COUPON_POOL_SIZE,
+                                        size_t rows = OpenABE_COUPON_ROWS) {
+    return this->m_KEM_->enableEncryptionCoupons(mpkID, poolSize, rows);
+  }
+  void disableEncryptionCoupons(const std::string &mpkID) { this->m_KEM_->disableEncryptionCoupons(mpkID); }
+  size_t getEncryptionCouponCount(const std::string &mpkID) { return this->m_KEM_->getEncryptionCouponCount(mpkID); }
+  OpenABE_ERROR generateTransformKey(const std::string &keyID, const std::string &tkID,
+                                     const std::string &rkID) {
+    return this->m_KEM_->generateTransformKey(keyID, tkID, rkID);
+  }
+  OpenABE_ERROR delegateKey(const std::string &mpkID, const std::string &keyID,
+                            OpenABEFunctionInput *keyInput, const std::string &newKeyID) {
+    return this->m_KEM_->delegateKey(mpkID, keyID, keyInput, newKeyID);
+  }
+  OpenABE_ERROR extendKey(const std::string &mpkID, const std::string &mskID,
+                          const std::string &keyID, OpenABEFunctionInput *keyInput,
+                          const std::string &deltaID) {
+    return this->m_KEM_->extendDecryptionKey(mpkID, mskID, keyID, keyInput, deltaID);
+  }
+  OpenABE_ERROR applyKeyDelta(const std::string &keyID, const std::string &deltaID) {
+    return this->m_KEM_->applyKeyDelta(keyID, deltaID);
+  }
+  OpenABE_ERROR generateKeyUpdate(const std::string &mpkID, const std::string &mskID,
+                                  const std::string &keyID, OpenABEFunctionInput *keyInput,
+                                  const std::string &updateID) {
+    return this->m_KEM_->generateKeyUpdate(mpkID, mskID, keyID, keyInput, updateID);
+  }
 
   OpenABEPairing* getPairing() { return this->m_KEM_->getPairing(); }
   OpenABEByteString* getHashKey(const std::string &mpkID);
   OpenABE_ERROR exportKey(const std::string &keyID, OpenABEByteString &keyBlob);
-  OpenABE_ERROR loadMasterPublicParams(const std::string &mpkID, OpenABEByteString &mpkBlob);
+  // with deferValidation (for blobs whose integrity the caller has
+  // authenticated), the points of the key are decoded and validated on
+  // first use instead of while loading. A decryption then only decodes the
+  // user key components of the attributes it uses. With 'attached', the
+  // key takes its tables from the snapshot it came from (see
+  // OpenABE_attachFixedBaseSnapshot)
+  OpenABE_ERROR loadMasterPublicParams(const std::string &mpkID, OpenABEByteString &mpkBlob,
+                                       bool deferValidation = false,
+                                       const OpenABEAttachedTables &attached = nullptr);
+  OpenABEMPKHandle getMasterPublicParamsHandle(const std::string &mpkID);
+  OpenABE_ERROR attachMasterPublicParams(const std::string &mpkID, const OpenABEMPKHandle &handle);
   OpenABE_ERROR loadMasterSecretParams(const std::string &mskID, OpenABEByteString &mskBlob);
-  OpenABE_ERROR loadUserSecretParams(const std::string &skID, OpenABEByteString &skBlob);
+  OpenABE_ERROR loadUserSecretParams(const std::string &skID, OpenABEByteString &skBlob,
+                                     bool deferValidation = false,
+                                     const OpenABEAttachedTables &attached = nullptr);
+  // decodes the keys in parallel; either all of them are added or none is
+  OpenABE_ERROR loadUserSecretParamsMany(const std::vector<std::string> &skIDs,
+                                         std::vector<OpenABEByteString> &skBlobs,
+                                         bool deferValidation = false);
   OpenABE_ERROR deleteKey(const std::string keyID);
   bool checkSecretKey(const std::string keyID);
 
@@ -110,8 +385,26 @@ public:
                     OpenABEByteString *plaintext, OpenABECiphertext *ciphertext);
   OpenABE_ERROR decrypt(const std::string &mpkID, const std::string &keyID,
                     OpenABEByteString *plaintext, OpenABECiphertext *ciphertext);
+  OpenABE_ERROR verify(OpenABERNG *rng, const std::string &mpkID, const OpenABEFunctionInput *encryptInput,
+                    OpenABEByteString *plaintext, OpenABECiphertext *ciphertext);
+  // what encrypt would produce for plaintextLen bytes (see estimateKEM)
+  OpenABE_ERROR estimate(const std::string &mpkID, const OpenABEFunctionInput *encryptInput,
+                    uint32_t plaintextLen, OpenABECiphertext *skeleton, OpenABEEncryptionCost &cost);
+  // the two halves of decrypt for outsourced decryption
+  OpenABE_ERROR transform(const std::string &mpkID, const std::string &tkID,
+                    OpenABECiphertext *ciphertext, OpenABECiphertext *transformed);
+  OpenABE_ERROR decryptTransformed(const std::string &rkID, OpenABEByteString *plaintext,
+                    OpenABECiphertext *transformed);
 };
 
+// process-wide cache of decoded user keys for loadUserSecretParams, keyed by
+// the SHA-256 of the key blob (disabled until enabled, limits in keys/bytes)
+void enableUserKeyCache(size_t maxKeys = USER_KEY_CACHE_SIZE,
+                        size_t maxBytes = USER_KEY_CACHE_BYTES);
+void disableUserKeyCache();
+void clearUserKeyCache();
+size_t getUserKeyCacheCount();
+
 }
 
 #endif /* ifdef __ZCONTEXTABE_H__ */
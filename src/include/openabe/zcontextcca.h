@@ -51,6 +51,7 @@ public:
   ~OpenABEContextCCA();
   void        setSchemeType(OpenABE_SCHEME scheme_type) { this->abeSchemeContext->setSchemeType(scheme_type); }
   OpenABE_SCHEME  getSchemeType() { return this->abeSchemeContext->getSchemeType(); }
+  void        setNumThreads(uint32_t numThreads) { this->abeSchemeContext->setNumThreads(numThreads); }
 
 //  virtual OpenABE_ERROR   generateParams(OpenABESecurityLevel securityLevel,
 //                                     const std::string &mpkID, const std::string &mskID) = 0;
@@ -64,11 +65,29 @@ public:
   // export and import methods
   OpenABEByteString* getHashKey(const std::string &mpkID);
   OpenABE_ERROR   exportKey(const std::string &keyID, OpenABEByteString &keyBlob);
-  OpenABE_ERROR   loadMasterPublicParams(const std::string &mpkID, OpenABEByteString &mpkBlob);
+  OpenABE_ERROR   loadMasterPublicParams(const std::string &mpkID, OpenABEByteString &mpkBlob,
+                                         bool deferValidation = false,
+                                         const OpenABEAttachedTables &attached = nullptr);
+  OpenABEMPKHandle getMasterPublicParamsHandle(const std::string &mpkID);
+  OpenABE_ERROR   attachMasterPublicParams(const std::string &mpkID, const OpenABEMPKHandle &handle);
   OpenABE_ERROR   loadMasterSecretParams(const std::string &mskID, OpenABEByteString &mskBlob);
-  OpenABE_ERROR   loadUserSecretParams(const std::string &skID, OpenABEByteString &skBlob);
+  OpenABE_ERROR   loadUserSecretParams(const std::string &skID, OpenABEByteString &skBlob,
+                                       bool deferValidation = false,
+                                       const OpenABEAttachedTables &attached = nullptr);
+  OpenABE_ERROR   loadUserSecretParamsMany(const std::vector<std::string> &skIDs,
+                                           std::vector<OpenABEByteString> &skBlobs,
+                                           bool deferValidation = false);
   OpenABE_ERROR   deleteKey(const std::string keyID);
   bool        checkSecretKey(const std::string keyID);
+  OpenABE_ERROR   delegateKey(const std::string &mpkID, const std::string &keyID,
+                              OpenABEFunctionInput *keyInput, const std::string &newKeyID);
+  OpenABE_ERROR   extendDecryptionKey(const std::string &mpkID, const std::string &mskID,
+                                      const std::string &keyID, OpenABEFunctionInput *keyInput,
+                                      const std::string &deltaID);
+  OpenABE_ERROR   applyKeyDelta(const std::string &keyID, const std::string &deltaID);
+  OpenABE_ERROR   generateKeyUpdate(const std::string &mpkID, const std::string &mskID,
+                                    const std::string &keyID, OpenABEFunctionInput *keyInput,
+                                    const std::string &updateID);
 };
 
 ///
@@ -95,6 +114,48 @@ public:
                          uint32_t keyByteLen, const std::shared_ptr<OpenABESymKey>& key, OpenABECiphertext *ciphertext);
   OpenABE_ERROR   decryptKEM(const std::string &mpkID, const std::string &keyID,
                          OpenABECiphertext *ciphertext, uint32_t keyByteLen, const std::shared_ptr<OpenABESymKey>& key);
+  OpenABE_ERROR   estimateKEM(const std::string &mpkID, const OpenABEFunctionInput *encryptInput,
+                         uint32_t keyByteLen, OpenABECiphertext *skeleton, OpenABEEncryptionCost &cost);
+  OpenABE_ERROR   generateTransformKey(const std::string &keyID, const std::string &tkID,
+                         const std::string &rkID);
+  OpenABE_ERROR   transformKEM(const std::string &mpkID, const std::string &tkID,
+                         OpenABECiphertext *ciphertext, OpenABECiphertext *transformed);
+  OpenABE_ERROR   finishTransformedKEM(const std::string &rkID, OpenABECiphertext *transformed,
+                         uint32_t keyByteLen, const std::shared_ptr<OpenABESymKey>& key);
+};
+
+///
+/// @class  OpenABEContextHashedCCA
+///
+/// @brief  A hashed KEM-DEM transformation: the symmetric key is derived
+///         from the CPA-encrypted key and a digest of the whole ABE
+///         ciphertext, so a decryption costs one CPA decryption and the
+///         AEAD of the DEM rejects modified ciphertexts (no re-encryption).
+///
+
+class OpenABEContextHashedCCA : public OpenABEContextCCA {
+public:
+  // Constructors/destructors
+  OpenABEContextHashedCCA(std::unique_ptr<OpenABEContextSchemeCPA> scheme);
+  ~OpenABEContextHashedCCA();
+
+  OpenABE_ERROR   generateParams(const std::string groupParams,
+                             const std::string &mpkID, const std::string &mskID);
+  OpenABE_ERROR   generateDecryptionKey(OpenABEFunctionInput *keyInput, const std::string &keyID,
+                                    const std::string &mpkID, const std::string &mskID,
+                                    const std::string &gpkID="", const std::string &GID="");
+  OpenABE_ERROR   encryptKEM(OpenABERNG *rng, const std::string &mpkID, const OpenABEFunctionInput *encryptInput,
+                         uint32_t keyByteLen, const std::shared_ptr<OpenABESymKey>& key, OpenABECiphertext *ciphertext);
+  OpenABE_ERROR   decryptKEM(const std::string &mpkID, const std::string &keyID,
+                         OpenABECiphertext *ciphertext, uint32_t keyByteLen, const std::shared_ptr<OpenABESymKey>& key);
+  OpenABE_ERROR   estimateKEM(const std::string &mpkID, const OpenABEFunctionInput *encryptInput,
+                         uint32_t keyByteLen, OpenABECiphertext *skeleton, OpenABEEncryptionCost &cost);
+  OpenABE_ERROR   generateTransformKey(const std::string &keyID, const std::string &tkID,
+                         const std::string &rkID);
+  OpenABE_ERROR   transformKEM(const std::string &mpkID, const std::string &tkID,
+                         OpenABECiphertext *ciphertext, OpenABECiphertext *transformed);
+  OpenABE_ERROR   finishTransformedKEM(const std::string &rkID, OpenABECiphertext *transformed,
+                         uint32_t keyByteLen, const std::shared_ptr<OpenABESymKey>& key);
 };
 
 
@@ -108,17 +169,36 @@ class OpenABEContextSchemeCCA : public ZObject {
 protected:
   std::unique_ptr<OpenABEContextCCA>	m_KEM_;
 
+  OpenABE_ERROR   encapsulateKey(const std::string& mpkID, const OpenABEFunctionInput *encryptInput,
+                      OpenABECiphertext *ciphertext1, OpenABEByteString &symkeyBytes);
+  OpenABE_ERROR   decapsulateKey(const std::string &mpkID, const std::string &keyID,
+                      OpenABECiphertext *ciphertext1, OpenABEByteString &symkeyBytes);
+  OpenABE_ERROR   wrapDataKey(OpenABECiphertext *ciphertext1, OpenABEByteString &symkeyBytes,
+                      OpenABEByteString &dataKey, OpenABECiphertext *wrapped);
+  OpenABE_ERROR   unwrapDataKey(OpenABECiphertext *ciphertext1, OpenABEByteString &symkeyBytes,
+                      OpenABECiphertext *wrapped, OpenABEByteString &dataKey);
+
 public:
   OpenABEContextSchemeCCA(std::unique_ptr<OpenABEContextCCA> kem_);
   ~OpenABEContextSchemeCCA();
 
   OpenABEKeystore *getKeystore() const { return this->m_KEM_->getKeystore(); }
   OpenABE_SCHEME  getSchemeType() const { return this->m_KEM_->getSchemeType(); }
+  void        setNumThreads(uint32_t numThreads) { this->m_KEM_->setNumThreads(numThreads); }
 
   OpenABE_ERROR   exportKey(const std::string &keyID, OpenABEByteString &keyBlob);
-  OpenABE_ERROR   loadMasterPublicParams(const std::string &mpkID, OpenABEByteString &mpkBlob);
+  OpenABE_ERROR   loadMasterPublicParams(const std::string &mpkID, OpenABEByteString &mpkBlob,
+                                         bool deferValidation = false,
+                                         const OpenABEAttachedTables &attached = nullptr);
+  OpenABEMPKHandle getMasterPublicParamsHandle(const std::string &mpkID);
+  OpenABE_ERROR   attachMasterPublicParams(const std::string &mpkID, const OpenABEMPKHandle &handle);
   OpenABE_ERROR   loadMasterSecretParams(const std::string &mskID, OpenABEByteString &mskBlob);
-  OpenABE_ERROR   loadUserSecretParams(const std::string &skID, OpenABEByteString &skBlob);
+  OpenABE_ERROR   loadUserSecretParams(const std::string &skID, OpenABEByteString &skBlob,
+                                       bool deferValidation = false,
+                                       const OpenABEAttachedTables &attached = nullptr);
+  OpenABE_ERROR   loadUserSecretParamsMany(const std::vector<std::string> &skIDs,
+                                           std::vector<OpenABEByteString> &skBlobs,
+                                           bool deferValidation = false);
   OpenABE_ERROR   deleteKey(const std::string keyID);
   bool        checkSecretKey(const std::string keyID);
 
@@ -138,6 +218,58 @@ public:
                       const std::string& plaintext, OpenABECiphertext *ciphertext1, OpenABECiphertext *ciphertext2);
   OpenABE_ERROR   decrypt(const std::string &mpkID, const std::string &keyID, std::string& plaintext,
                       OpenABECiphertext *ciphertext1, OpenABECiphertext *ciphertext2);
+  // the ABE halves of encrypt/decrypt, for callers that lay out the AES-GCM
+  // part themselves: authEnc is keyed and bound to ciphertext1's header
+  OpenABE_ERROR   encapsulate(const std::string& mpkID, const OpenABEFunctionInput *encryptInput,
+                      OpenABECiphertext *ciphertext1,
+                      std::unique_ptr<oabe::crypto::OpenABESymKeyAuthEnc> &authEnc);
+  OpenABE_ERROR   decapsulate(const std::string &mpkID, const std::string &keyID,
+                      OpenABECiphertext *ciphertext1,
+                      std::unique_ptr<oabe::crypto::OpenABESymKeyAuthEnc> &authEnc);
+  // same, for the chunked AES-GCM mode of large payloads
+  OpenABE_ERROR   encapsulate(const std::string& mpkID, const OpenABEFunctionInput *encryptInput,
+                      OpenABECiphertext *ciphertext1,
+                      std::unique_ptr<oabe::crypto::OpenABESymKeyChunkedAuthEnc> &authEnc);
+  OpenABE_ERROR   decapsulate(const std::string &mpkID, const std::string &keyID,
+                      OpenABECiphertext *ciphertext1,
+                      std::unique_ptr<oabe::crypto::OpenABESymKeyChunkedAuthEnc> &authEnc);
+  // same, with the payload under a random data key that is wrapped with
+  // the ABE key into the small ciphertext wrapped (whose header is the
+  // payload's AAD), so that rewrap can move the data key under another
+  // function input into newCiphertext1 without touching the payload
+  OpenABE_ERROR   encapsulateWrapped(const std::string& mpkID, const OpenABEFunctionInput *encryptInput,
+                      OpenABECiphertext *ciphertext1, OpenABECiphertext *wrapped,
+                      std::unique_ptr<oabe::crypto::OpenABESymKeyChunkedAuthEnc> &authEnc);
+  OpenABE_ERROR   decapsulateWrapped(const std::string &mpkID, const std::string &keyID,
+                      OpenABECiphertext *ciphertext1, OpenABECiphertext *wrapped,
+                      std::unique_ptr<oabe::crypto::OpenABESymKeyChunkedAuthEnc> &authEnc);
+  OpenABE_ERROR   rewrap(const std::string &mpkID, const std::string &keyID,
+                      const OpenABEFunctionInput *newEncryptInput,
+                      OpenABECiphertext *ciphertext1, OpenABECiphertext *wrapped,
+                      OpenABECiphertext *newCiphertext1);
+  // the ABE ciphertext encrypt would produce, as a skeleton of the same
+  // serialized size, and the cost of encrypting and decrypting it (see
+  // OpenABEContextABE::estimateKEM)
+  OpenABE_ERROR   estimate(const std::string &mpkID, const OpenABEFunctionInput *encryptInput,
+                      OpenABECiphertext *ciphertext1, OpenABEEncryptionCost &cost);
+  // key delegation (schemes whose KEM supports it, see OpenABEContextABE)
+  OpenABE_ERROR   delegateKey(const std::string &mpkID, const std::string &keyID,
+                      OpenABEFunctionInput *keyInput, const std::string &newKeyID);
+  // key extension (schemes whose KEM supports it, see OpenABEContextABE)
+  OpenABE_ERROR   extendKey(const std::string &mpkID, const std::string &mskID,
+                      const std::string &keyID, OpenABEFunctionInput *keyInput,
+                      const std::string &deltaID);
+  OpenABE_ERROR   applyKeyDelta(const std::string &keyID, const std::string &deltaID);
+  OpenABE_ERROR   generateKeyUpdate(const std::string &mpkID, const std::string &mskID,
+                      const std::string &keyID, OpenABEFunctionInput *keyInput,
+                      const std::string &updateID);
+  // outsourced decryption (schemes whose KEM supports transform keys)
+  OpenABE_ERROR   generateTransformKey(const std::string &keyID, const std::string &tkID,
+                      const std::string &rkID);
+  OpenABE_ERROR   transform(const std::string &mpkID, const std::string &tkID,
+                      OpenABECiphertext *ciphertext1, OpenABECiphertext *transformed);
+  OpenABE_ERROR   decryptTransformed(const std::string &rkID, std::string &plaintext,
+                      OpenABECiphertext *transformed, OpenABECiphertext *ciphertext2);
 };
 
 ///
@@ -156,9 +288,12 @@ public:
 
   OpenABEKeystore *getKeystore() const { return this->m_KEM_->getKeystore(); }
   OpenABE_SCHEME  getSchemeType() const { return this->m_KEM_->getSchemeType(); }
+  void        setNumThreads(uint32_t numThreads) { this->m_KEM_->setNumThreads(numThreads); }
 
   OpenABE_ERROR   exportKey(const std::string &keyID, OpenABEByteString &keyBlob);
   OpenABE_ERROR   loadMasterPublicParams(const std::string &mpkID, OpenABEByteString &mpkBlob);
+  OpenABEMPKHandle getMasterPublicParamsHandle(const std::string &mpkID);
+  OpenABE_ERROR   attachMasterPublicParams(const std::string &mpkID, const OpenABEMPKHandle &handle);
   OpenABE_ERROR   loadMasterSecretParams(const std::string &mskID, OpenABEByteString &mskBlob);
   OpenABE_ERROR   loadUserSecretParams(const std::string &skID, OpenABEByteString &skBlob);
   OpenABE_ERROR   deleteKey(const std::string keyID);
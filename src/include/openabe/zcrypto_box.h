@@ -34,12 +34,52 @@
 #ifndef __ZCRYPTO_BOX__
 #define __ZCRYPTO_BOX__
 
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
 #include <openabe/utils/zexception.h>
 
 namespace oabe {
 
 typedef std::unique_ptr<crypto::OpenABESymKeyHandle> OpenABESymKeyHandlePtr;
+// called once with the exact size of the output; returns where to write it
+typedef std::function<uint8_t*(size_t)> OpenABEOutputSink;
+
+/// The outcome of an asynchronous call: OpenABE_NOERROR with the output
+/// (ciphertext, plaintext or signature; empty for keygen and verify), or
+/// the reason the call failed
+struct OpenABEAsyncResult {
+  OpenABE_ERROR error;
+  std::string output;
+};
+// called once, on the thread that ran the call
+typedef std::function<void(OpenABEAsyncResult &result)> OpenABECompletion;
+// hands a task to an application executor (event loop, thread pool, ...)
+typedef std::function<void(std::function<void()> task)> OpenABEExecutor;
+
+///
+/// @class  OpenABEAsyncRunner
+///
+/// @brief  Runs the asynchronous calls of a crypto box context, on the
+///         library thread pool or on the executor set by the application
+///         (set it before the first call). Every thread an executor runs
+///         tasks on must be set up for the library (see OpenABEStateContext).
+///
+class OpenABEAsyncRunner {
+public:
+  void setExecutor(const OpenABEExecutor &executor) { this->executor_ = executor; }
+  std::future<OpenABEAsyncResult> run(std::function<OpenABE_ERROR(std::string &)> op);
+  void run(std::function<OpenABE_ERROR(std::string &)> op, OpenABECompletion done);
+
+private:
+  OpenABEExecutor executor_;
+};
 
 class OpenABECryptoContextBase {
 public:
@@ -67,9 +107,29 @@ public:
   virtual bool deleteKey(const std::string &keyID) = 0;
 };
 
+/// What OpenABECryptoContext::inspect reads from an ABE ciphertext
+struct OpenABECiphertextInfo {
+  std::string scheme;    // e.g. "CP-ABE"
+  std::string curve;     // e.g. "BLS12_P381"
+  std::string uid;       // hex
+  std::string encInput;  // the policy (CP-ABE) or attribute list (KP-ABE)
+};
+
+/// What OpenABECryptoContext::estimate expects of an encryption, before
+/// encrypting: the operation counts and the exact output sizes
+struct OpenABEEncryptionEstimate {
+  OpenABEEncryptionCost cost;
+  size_t headerBytes;         // the serialized ABE ciphertext
+  size_t compactHeaderBytes;  // the same with compact encoding
+  size_t ciphertextBytes;     // encrypt() to a string (base64 if the context encodes)
+  size_t binaryBytes;         // encrypt() to a buffer
+  size_t chunkedBytes;        // encryptChunked() with the given chunk size
+};
+
 /*!
  * A crypto_box interface for attribute-based encryption.
- * Scheme-ID options: "CP-ABE", "KP-ABE", and "MA-ABE".
+ * Scheme-ID options: "CP-ABE" and "KP-ABE" (this build has no MA-ABE
+ * scheme; the multi-authority methods throw).
  * Note: This context is CCA-secure by default
  * Example usage:
  *   OpenABECryptoContext cpabe("CP-ABE");
@@ -83,13 +143,14 @@ public:
 class OpenABECryptoContext : public OpenABECryptoContextBase {
 public:
   OpenABECryptoContext(const std::string scheme_id, bool base64encode = true);
-  virtual ~OpenABECryptoContext() {};
+  virtual ~OpenABECryptoContext() { trustedKeyMAC_.zeroize(); };
   // generate system parameters for default curve selected.
   void generateParams();
   void enableKeyManager(const std::string userId);
   void enableVerbose();
 
-  // import/export various params and keys (for multi-authority)
+  // import/export various params and keys (for multi-authority; not
+  // implemented by any scheme of this build)
   void exportGlobalParams(std::string &globlmpk);
   void importGlobalParams(const std::string &keyBlob);
 
@@ -105,30 +166,292 @@ public:
 
   void importSecretParams(const std::string &authID,
                           const std::string &keyBlob);
+
+  // share decoded public params with other contexts of the same scheme
+  OpenABEMPKHandle getPublicParamsHandle();
+  void attachPublicParams(const OpenABEMPKHandle &handle);
+  // the same across processes: the snapshot holds the public params and
+  // their fixed-base tables, and can be written to a file or shared memory
+  // that other processes map and import without decoding the tables again.
+  // Only the keys imported from the snapshot use its tables. Every table is
+  // checked before use: by its tag when both sides have set the same
+  // setTrustedKeyMAC key, otherwise by recomputing it (which then only
+  // saves the memory). The imported memory is used in place, so it must
+  // stay mapped and unchanged while the context (or a handle taken from
+  // it) lives. Specific to the build.
+  void exportPublicParamsSnapshot(std::string &snapshot);
+  void importPublicParamsSnapshot(const uint8_t *snapshot, size_t len);
+  // a snapshot file of the whole serving state for a warm start: the
+  // public params and their tables, the user keys with their Miller-line
+  // tables, the attribute hash cache and the compiled policies. Holds the
+  // user keys, so it is written with owner-only permissions; the master
+  // secret is left out. loadSnapshot maps the file until the keys loaded
+  // from it are gone. The file is specific to the build.
+  void saveSnapshot(const std::string &path);
+  void loadSnapshot(const std::string &path);
+
   void importUserKey(const std::string &keyID, const std::string &keyBlob);
   void exportUserKey(const std::string &keyID, std::string &keyBlob);
   bool deleteKey(const std::string &keyID);
+  // many user keys in one binary key ring (never base64, see zkeyring.h):
+  // exportKeyRing writes the keys keyIDs, or without them every user key
+  // (with the key manager, the keys stored for the user). importKeyRing
+  // decodes the keys on the library thread pool and adds them together;
+  // either every key is imported or none is.
+  void exportKeyRing(const std::vector<std::string> &keyIDs, std::string &ring);
+  void exportKeyRing(std::string &ring);
+  void importKeyRing(const std::string &ring);
+  // for keys kept in the application's own keystore: the Trusted exports
+  // append an HMAC-SHA256 tag under macKey to the blob, and the Trusted
+  // imports check the tag over the whole blob and then leave each point
+  // to be decoded and validated on its first use (a decryption then only
+  // decodes the components of the attributes it uses). The plain imports
+  // and all ciphertexts are always validated in full. The key also tags the
+  // tables of the snapshots written afterwards and checks those imported.
+  void setTrustedKeyMAC(const std::string &macKey);
+  void exportPublicParamsTrusted(std::string &mpk);
+  void importPublicParamsTrusted(const std::string &keyBlob);
+  void exportUserKeyTrusted(const std::string &keyID, std::string &keyBlob);
+  void importUserKeyTrusted(const std::string &keyID, const std::string &keyBlob);
 
   void keygen(const std::string &keyInput, const std::string &keyID,
               const std::string &authID = "", const std::string &GID = "");
+  // generate keyIDs[i] for keyInputs[i], spread over the library thread
+  // pool. Either every key is added or, on failure, none are.
+  void keygenMany(const std::vector<std::string> &keyInputs,
+                  const std::vector<std::string> &keyIDs,
+                  const std::string &authID = "", const std::string &GID = "");
   void encrypt(const std::string encInput, const std::string &plaintext,
                std::string &ciphertext);
+  // encrypt many plaintexts under the same policy (or attribute list)
+  void encryptBatch(const std::string encInput,
+                    const std::vector<std::string> &plaintexts,
+                    std::vector<std::string> &ciphertexts);
   bool decrypt(const std::string &keyID, const std::string &ciphertext,
                std::string &plaintext);
   bool decrypt(const std::string &ciphertext, std::string &plaintext);
+  // binary-only variants (never base64, whatever the context was created
+  // with) that read the input in place and write straight into the buffer
+  // returned by the sink. The format is the one of the string API without
+  // base64, so the two interoperate.
+  void encrypt(const std::string encInput, const uint8_t *plaintext,
+               size_t plaintextLen, const OpenABEOutputSink &ciphertext);
+  bool decrypt(const std::string &keyID, const uint8_t *ciphertext,
+               size_t ciphertextLen, const OpenABEOutputSink &plaintext);
+  // the same as decrypt, returning why it failed instead of a bool. A key
+  // that does not fit the ciphertext is turned away (with
+  // OpenABE_ERROR_POLICY_NOT_SATISFIED) before any decryption work,
+  // without logging or exceptions.
+  OpenABE_ERROR tryDecrypt(const std::string &keyID, const std::string &ciphertext,
+                           std::string &plaintext);
+  OpenABE_ERROR tryDecrypt(const std::string &keyID, const uint8_t *ciphertext,
+                           size_t ciphertextLen, const OpenABEOutputSink &plaintext);
+  // for large payloads: the symmetric part is split into chunks (see
+  // OpenABESymKeyChunkedAuthEnc), encrypted on all cores and decryptable
+  // by range. Binary only, like the buffer variants above.
+  void encryptChunked(const std::string encInput, const uint8_t *plaintext,
+                      size_t plaintextLen, const OpenABEOutputSink &ciphertext,
+                      size_t chunkSize = DEFAULT_AEAD_CHUNK_SIZE);
+  bool decryptChunked(const std::string &keyID, const uint8_t *ciphertext,
+                      size_t ciphertextLen, const OpenABEOutputSink &plaintext);
+  // recover the payload cipher of a chunked ciphertext once (nullptr on
+  // failure), then decrypt ranges with cipher->decryptRange(out,
+  // ciphertext + payloadOffset, ciphertextLen - payloadOffset, offset, len)
+  std::unique_ptr<crypto::OpenABESymKeyChunkedAuthEnc>
+  openChunked(const std::string &keyID, const uint8_t *ciphertext,
+              size_t ciphertextLen, size_t &payloadOffset);
+  // chunked ciphertexts whose policy (or attribute list) can be changed
+  // without touching the payload: its data key is wrapped with the ABE
+  // key, and rewrap moves it under newEncInput. header then replaces the
+  // first payloadOffset bytes of the ciphertext, of which only that
+  // header part needs to be given. Binary only.
+  void encryptWrapped(const std::string encInput, const uint8_t *plaintext,
+                      size_t plaintextLen, const OpenABEOutputSink &ciphertext,
+                      size_t chunkSize = DEFAULT_AEAD_CHUNK_SIZE);
+  bool decryptWrapped(const std::string &keyID, const uint8_t *ciphertext,
+                      size_t ciphertextLen, const OpenABEOutputSink &plaintext);
+  bool rewrap(const std::string &keyID, const uint8_t *ciphertext,
+              size_t ciphertextLen, const std::string newEncInput,
+              std::string &header, size_t &payloadOffset);
+  // what encrypting plaintextLen bytes under encInput would cost and
+  // produce, from the compiled policy alone (no encryption): for admission
+  // control and to allocate output buffers up front
+  void estimate(const std::string encInput, OpenABEEncryptionEstimate &info,
+                size_t plaintextLen, size_t chunkSize = DEFAULT_AEAD_CHUNK_SIZE);
+  // streaming form of encryptChunked/decryptChunked with bounded memory:
+  // encryptInit emits the ABE ciphertext, then the payload is sealed chunk
+  // by chunk as it is fed. Output is appended to the string arguments
+  // (binary, the same format as encryptChunked). One encryption and one
+  // decryption stream at a time per context.
+  void encryptInit(const std::string encInput, std::string &ciphertext,
+                   size_t chunkSize = DEFAULT_AEAD_CHUNK_SIZE);
+  void encryptUpdate(const std::string &plaintextBlock, std::string &ciphertext);
+  void encryptFinalize(std::string &ciphertext);
+  // plaintext is only released once its chunk has verified
+  void decryptInit(const std::string &keyID);
+  bool decryptUpdate(const std::string &ciphertextBlock, std::string &plaintext);
+  bool decryptFinalize(std::string &plaintext);
+  // envelope mode for many small records under one policy (or attribute
+  // list): sessionOpen encapsulates one data key (the session header) and
+  // sessionEncrypt seals each record with it under a fresh nonce, so a
+  // record costs one AES-GCM call and carries only a 16-byte session ID.
+  // The data key is replaced after maxRecords records or maxSeconds
+  // seconds (0 for no limit); sessionEncrypt then sets header to the new
+  // session header and returns true, and the record must be delivered
+  // after it. Records of a session may be reordered or replayed.
+  void sessionOpen(const std::string encInput, std::string &header,
+                   uint64_t maxRecords = DEFAULT_SESSION_MAX_RECORDS,
+                   uint32_t maxSeconds = DEFAULT_SESSION_MAX_SECONDS);
+  bool sessionEncrypt(const std::string &plaintext, std::string &record,
+                      std::string &header);
+  void sessionClose();
+  // the receiving side: sessionAccept decrypts a session header once with
+  // keyID, then sessionDecrypt opens the records of any accepted session
+  // (the last SESSION_CACHE_SIZE are kept)
+  bool sessionAccept(const std::string &keyID, const std::string &header);
+  bool sessionDecrypt(const std::string &record, std::string &plaintext);
+  // read the header and the policy (or attribute list) of a ciphertext
+  // without decoding any group element; false if it is malformed
+  bool inspect(const std::string &ciphertext, OpenABECiphertextInfo &info);
+  // whether the key keyID satisfies the ciphertext, from the same parse
+  // (no pairing or point decoding)
+  bool canDecrypt(const std::string &keyID, const std::string &ciphertext);
+  // decrypt many ciphertexts with the same key: decrypted[i] tells whether
+  // plaintexts[i] holds the plaintext of ciphertexts[i]. Returns the number
+  // of ciphertexts that were decrypted.
+  size_t decryptBatch(const std::string &keyID,
+                      const std::vector<std::string> &ciphertexts,
+                      std::vector<std::string> &plaintexts,
+                      std::vector<bool> &decrypted);
+  // columnar storage for many ciphertexts under one policy (or attribute
+  // list): encryptBlock appends them to block as one block (binary, see
+  // OpenABECiphertextBlockWriter), and decryptBatch decrypts all of the
+  // ciphertexts of the blocks a reader holds
+  void encryptBlock(const std::string encInput,
+                    const std::vector<std::string> &plaintexts,
+                    std::string &block);
+  size_t decryptBatch(const std::string &keyID,
+                      const OpenABECiphertextBlockReader &blocks,
+                      std::vector<std::string> &plaintexts,
+                      std::vector<bool> &decrypted);
+  // key delegation (CP-ABE): derive from the key parentKeyID a key
+  // newKeyID for a subset of its attributes, with the public params only
+  // (no MSK). The new key is re-randomized, so it can't be linked to the
+  // parent or combined with other keys delegated from it. Throws if an
+  // attribute isn't in the parent key.
+  void delegateKey(const std::string &parentKeyID, const std::string &subsetAttributes,
+                   const std::string &newKeyID);
+  // key extension (CP-ABE, authority side): add newAttributes to the key
+  // keyID, keeping its K and L and computing only the components of the
+  // added attributes. keyDelta receives just those, for the key's holder
+  // to pass to applyKeyDelta. Keys issued before key extension existed
+  // can't be extended.
+  void extendKey(const std::string &keyID, const std::string &newAttributes,
+                 std::string &keyDelta);
+  void applyKeyDelta(const std::string &keyID, const std::string &keyDelta);
+  // key updates (CP-ABE, authority side): a key delta for the key keyID
+  // with updateAttributes, which may repeat attributes the key holds,
+  // without changing the authority's copy of the key. With
+  // OpenABEPeriodTree, keygen issues the long-lived key once and each
+  // renewal is generateKeyUpdate(keyID, tree.attributes(first, last)),
+  // at most 2 * depth components, applied with applyKeyDelta
+  void generateKeyUpdate(const std::string &keyID, const std::string &updateAttributes,
+                         std::string &keyUpdate);
+  // outsourced decryption (CP-ABE): split the key keyID into a
+  // transformation key tkID for a server, which does all of the pairings
+  // in transformCiphertext, and a retrieval key rkID that decrypts the
+  // (short) transformed ciphertext with one exponentiation. Both keys are
+  // exported and imported like user keys. The client checks the result
+  // against the ciphertext header and the AEAD tag instead of redoing the
+  // encryption, so a transformed ciphertext is only replayable-CCA secure.
+  void generateTransformKey(const std::string &keyID, const std::string &tkID,
+                            const std::string &rkID);
+  bool transformCiphertext(const std::string &tkID, const std::string &ciphertext,
+                           std::string &transformed);
+  bool decryptTransformed(const std::string &rkID, const std::string &transformed,
+                          std::string &plaintext);
+  // latencies of this context's API calls and the counters they moved (see
+  // zmetrics.h; collected only while OpenABE_setMetricsEnabled(true))
+  void getMetrics(OpenABEMetricsSnapshot &snapshot);
+  void resetMetrics();
+
+  // asynchronous keygen, encrypt and decrypt (see OpenABEAsyncRunner):
+  // each returns a future or calls done when finished. Calls may overlap
+  // like the batch methods do; the context must outlive them. The
+  // streaming and session calls have no asynchronous form.
+  void setExecutor(const OpenABEExecutor &executor) { async_.setExecutor(executor); }
+  std::future<OpenABEAsyncResult> keygenAsync(const std::string &keyInput,
+                                              const std::string &keyID);
+  void keygenAsync(const std::string &keyInput, const std::string &keyID,
+                   OpenABECompletion done);
+  std::future<OpenABEAsyncResult> encryptAsync(const std::string &encInput,
+                                               const std::string &plaintext);
+  void encryptAsync(const std::string &encInput, const std::string &plaintext,
+                    OpenABECompletion done);
+  std::future<OpenABEAsyncResult> decryptAsync(const std::string &keyID,
+                                               const std::string &ciphertext);
+  void decryptAsync(const std::string &keyID, const std::string &ciphertext,
+                    OpenABECompletion done);
 
 private:
+  std::function<OpenABE_ERROR(std::string &)> keygenOp(const std::string &keyInput,
+                                                       const std::string &keyID);
+  std::function<OpenABE_ERROR(std::string &)> encryptOp(const std::string &encInput,
+                                                        const std::string &plaintext);
+  std::unique_ptr<OpenABEFunctionInput> createEncInput(const std::string &encInput);
+  void writeSnapshot(std::string &snapshot, bool full);
+  void readSnapshot(const uint8_t *snapshot, size_t len,
+                    const std::shared_ptr<const void> &memory = nullptr);
+  void loadCiphertext(const std::string &ciphertext,
+                      std::unique_ptr<OpenABECiphertext> &ciphertext1,
+                      std::unique_ptr<OpenABECiphertext> &ciphertext2);
+  void loadCiphertextBytes(OpenABEByteString &ct,
+                           std::unique_ptr<OpenABECiphertext> &ciphertext1,
+                           std::unique_ptr<OpenABECiphertext> &ciphertext2);
+  void loadCiphertextHeader(const std::string &ciphertext,
+                            std::unique_ptr<OpenABECiphertext> &ciphertext1);
+  typedef std::function<void(size_t, std::unique_ptr<OpenABECiphertext> &,
+                             std::unique_ptr<OpenABECiphertext> &)> CiphertextLoader;
+  size_t decryptMany(const std::string &keyID, size_t count,
+                     const CiphertextLoader &load,
+                     std::vector<std::string> &plaintexts,
+                     std::vector<bool> &decrypted);
+  OpenABE_ERROR checkKey(const std::string &keyID, OpenABECiphertext *ciphertext1);
+  OpenABE_ERROR encryptWithInput(const OpenABEFunctionInput *funcInput,
+                                 const std::string &plaintext,
+                                 std::string &ciphertext);
+  void startSession(std::string &header);
+  void openTrustedBlob(const std::string &keyBlob, OpenABEByteString &key);
+
   std::string userId_;
   std::unique_ptr<OpenABEContextSchemeCCA> schemeContextCCA_;
   std::unique_ptr<OpenABEKeystoreManager> keyManager_;
+  OpenABEByteString trustedKeyMAC_;
+  std::unique_ptr<crypto::OpenABESymKeyChunkedAuthEnc> encStream_, decStream_;
+  OpenABEByteString decStreamHeader_;
+  std::string decStreamKeyID_;
+  std::unique_ptr<OpenABEFunctionInput> sessionInput_;
+  std::unique_ptr<crypto::OpenABESymKeyAuthEnc> session_;
+  std::string sessionID_;
+  uint64_t sessionRecords_, sessionMaxRecords_;
+  uint32_t sessionMaxSeconds_;
+  std::chrono::steady_clock::time_point sessionStart_;
+  std::map<std::string, std::unique_ptr<crypto::OpenABESymKeyAuthEnc>> acceptedSessions_;
+  std::deque<std::string> acceptedOrder_;
+  OpenABEMetricsCollector metrics_;
+  OpenABEAsyncRunner async_;
+  bool decStreamOpen_;
   OpenABE_SCHEME scheme_type_;
   OpenABEFunctionInputType keyInputType_, encInputType_;
   bool base64Encode_, debug_, useKeyManager_;
 };
 
+class OpenPKSIGContext;
+
 /*!
  * A crypto_box interface for public-key encryption
- * (i.e., One-pass DH in Sec 6.2.2.2 of NIST SP800-56A)
+ * (i.e., One-pass DH in Sec 6.2.2.2 of NIST SP800-56A) over a NIST curve,
+ * or over X25519 when ec_id is "X25519"
  * Example usage:
  *   OpenPKEContext pke;
  *   pke.keygen("user0");
@@ -153,15 +476,63 @@ public:
                std::string &ciphertext);
   bool decrypt(const std::string receiver_id, const std::string &ciphertext,
                std::string &plaintext);
+  // one ciphertext for all of receiver_ids: the payload is encrypted once
+  // and each receiver opens it with decrypt
+  bool encryptMulti(const std::vector<std::string> &receiver_ids,
+                    const std::string &plaintext, std::string &ciphertext);
+  // sign-then-encrypt: sender_key_id's signature (a key held by signer)
+  // over the receiver ID and the message is sealed together with the
+  // message. Signing runs alongside the key derivation, and both read the
+  // one copy of the message that gets encrypted.
+  void signcrypt(OpenPKSIGContext &signer, const std::string sender_key_id,
+                 const std::string receiver_id, const std::string &plaintext,
+                 std::string &ciphertext);
+  // decrypt and check that sender_key_id signed the message for receiver_id
+  bool unsigncrypt(OpenPKSIGContext &verifier, const std::string sender_key_id,
+                   const std::string receiver_id, const std::string &ciphertext,
+                   std::string &plaintext);
+  // signcrypt plaintexts[i] to receiver_ids[i], spread over the library
+  // thread pool
+  void signcryptBatch(OpenPKSIGContext &signer, const std::string sender_key_id,
+                      const std::vector<std::string> &receiver_ids,
+                      const std::vector<std::string> &plaintexts,
+                      std::vector<std::string> &ciphertexts);
+
+  // asynchronous forms (see OpenABECryptoContext::encryptAsync)
+  void setExecutor(const OpenABEExecutor &executor) { async_.setExecutor(executor); }
+  std::future<OpenABEAsyncResult> keygenAsync(const std::string &key_id);
+  void keygenAsync(const std::string &key_id, OpenABECompletion done);
+  std::future<OpenABEAsyncResult> encryptAsync(const std::string &receiver_id,
+                                               const std::string &plaintext);
+  void encryptAsync(const std::string &receiver_id, const std::string &plaintext,
+                    OpenABECompletion done);
+  std::future<OpenABEAsyncResult> decryptAsync(const std::string &receiver_id,
+                                               const std::string &ciphertext);
+  void decryptAsync(const std::string &receiver_id, const std::string &ciphertext,
+                    OpenABECompletion done);
 
 private:
+  OpenABE_ERROR signcryptWith(OpenPKSIGContext &signer, const std::string &sender_key_id,
+                              const std::string &receiver_id, const std::string &plaintext,
+                              std::string &ciphertext);
+
   std::unique_ptr<OpenABEContextSchemePKE> schemeContext_;
   std::string ec_id_;
+  OpenABEAsyncRunner async_;
   bool base64Encode_;
 };
 
+/// A message and signature to check with OpenPKSIGContext::verifyBatch
+struct OpenPKSIGMessage {
+  std::string key_id;
+  std::string message;
+  std::string signature;
+};
+
 /*!
- * A crypto_box interface for digital signatures (e.g., NIST EC-DSA)
+ * A crypto_box interface for digital signatures: NIST EC-DSA, Ed25519
+ * when ec_id is "ED25519", or BLS when ec_id names a pairing curve (e.g.,
+ * "BLS12_P381"), which adds signature aggregation.
  * Example usage:
  *   OpenPKSIGContext pksig;
  *   pksig.keygen("user1");
@@ -185,11 +556,61 @@ public:
             std::string &signature);
   bool verify(const std::string key_id, const std::string &message,
               const std::string &signature);
+  // binary-only variants (the signature is never base64) that read the
+  // message in place
+  void sign(const std::string key_id, const uint8_t *message, size_t messageLen,
+            std::string &signature);
+  bool verify(const std::string key_id, const uint8_t *message, size_t messageLen,
+              const uint8_t *signature, size_t signatureLen);
+  // verify many signatures (under any mix of keys): verified[i] tells
+  // whether items[i] holds a valid signature. Returns the number of valid
+  // signatures.
+  size_t verifyBatch(const std::vector<OpenPKSIGMessage> &items,
+                     std::vector<bool> &verified);
+  // sign a batch with one signature over the root of a Merkle tree of the
+  // messages: signatures[i] holds that root signature and the inclusion
+  // proof of messages[i] (log2 of the batch size hashes). The root is signed
+  // under the "OpenABE-MERKLE-ROOT-v1" label, and the other sign and verify
+  // methods refuse messages starting with it, so root signatures and plain
+  // signatures never stand in for each other
+  void signMerkleBatch(const std::string key_id, const std::vector<std::string> &messages,
+                       std::vector<std::string> &signatures);
+  // check a signature from signMerkleBatch. A root signature is verified
+  // once; the rest of its batch only rehashes the proof.
+  bool verifyMerkle(const std::string key_id, const std::string &message,
+                    const std::string &signature);
+  // BLS only: combine signatures (by any keys, on any messages) into one,
+  // and check it against every (key_ids[i], messages[i]) pair at once
+  void aggregate(const std::vector<std::string> &signatures, std::string &aggregate);
+  bool verifyAggregate(const std::vector<std::string> &key_ids,
+                       const std::vector<std::string> &messages,
+                       const std::string &aggregate);
+
+  // asynchronous forms (see OpenABECryptoContext::encryptAsync); a
+  // signature that does not verify is OpenABE_ERROR_VERIFICATION_FAILED
+  void setExecutor(const OpenABEExecutor &executor) { async_.setExecutor(executor); }
+  std::future<OpenABEAsyncResult> keygenAsync(const std::string &key_id);
+  void keygenAsync(const std::string &key_id, OpenABECompletion done);
+  std::future<OpenABEAsyncResult> signAsync(const std::string &key_id,
+                                            const std::string &message);
+  void signAsync(const std::string &key_id, const std::string &message,
+                 OpenABECompletion done);
+  std::future<OpenABEAsyncResult> verifyAsync(const std::string &key_id,
+                                              const std::string &message,
+                                              const std::string &signature);
+  void verifyAsync(const std::string &key_id, const std::string &message,
+                   const std::string &signature, OpenABECompletion done);
 
 private:
+  void clearMerkleRoots();
+
   std::unique_ptr<OpenABEContextSchemePKSIG> schemeContext_;
   std::string ec_id_;
+  OpenABEAsyncRunner async_;
   bool base64Encode_;
+  // Merkle roots whose signature has been verified (key ID, root, signature)
+  std::mutex merkleRootsLock_;
+  std::set<std::string> merkleRoots_;
 };
 
 
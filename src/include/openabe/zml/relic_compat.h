@@ -207,6 +207,7 @@
 #define ec_ep_cmp(a,b)              ep_cmp(a,b)
 #define ec_ep_norm(r,p)             ep_norm(r,p)
 #define ec_ep_mul_lwnaf(r,p,k)      ep_mul_lwnaf(r,p,k)
+#define ec_ep_mul_gen(r,k)          ep_mul_gen(r,k)
 #define ec_ep_size_bin(a,p)         ep_size_bin(a,p)
 #define ec_ep_read_bin(a,b,l)       ep_read_bin(a,b,l)
 #define ec_ep_write_bin(b,l,a,p)    ep_write_bin(b,l,a,p)
@@ -352,6 +352,8 @@ int ec_convert_to_point(ec_group_t group, ec_point_t p, uint8_t *xstr, int len);
 int  ec_point_is_on_curve(ec_group_t group, ec_point_t p);
 void ec_point_add(ec_group_t g, ec_point_t r, const ec_point_t x, const ec_point_t y);
 void ec_point_mul(ec_group_t g, ec_point_t r, const ec_point_t x, const bignum_t y);
+// r = generator^y, through the group's precomputed generator table
+void ec_point_mul_gen(ec_group_t g, ec_point_t r, const bignum_t y);
 
 size_t ec_point_elem_len(const ec_point_t g);
 void ec_point_elem_in(ec_point_t g, uint8_t *in, size_t len);
@@ -386,7 +388,9 @@ typedef GT_ELEM* gt_ptr;
 /* BEGIN MCL macro definitions */
 
 typedef void* bp_group_t;
-#define bp_group_free(g)   g = nullptr;
+// drops the group's reference on the process-wide MCL curve
+void bp_group_release(bp_group_t group);
+#define bp_group_free(g)   do { bp_group_release(g); g = nullptr; } while (0)
 
 typedef mclBnG1 g1_ptr;
 typedef mclBnG2 g2_ptr;
@@ -62,6 +62,7 @@ class OpenABEPairing;
 // forward declaration
 class OpenABEByteString;
 class OpenABERNG;
+class G2LineTable;
 
 #if !defined(BP_WITH_OPENSSL)
 bool checkRelicError();
@@ -96,6 +97,7 @@ void g2_convert_to_bytestring(bp_group_t group, oabe::OpenABEByteString & s, g2_
 
 void gt_convert_to_point(bp_group_t group, oabe::OpenABEByteString& s, gt_ptr *p);
 void gt_convert_to_bytestring(bp_group_t group, oabe::OpenABEByteString& s, const gt_ptr *p, int should_compress);
+void gt_convert_to_compact_bytestring(bp_group_t group, oabe::OpenABEByteString& s, const gt_ptr *p);
 const std::string gt_point_to_string(const bp_group_t group, gt_ptr p);
 
 /// \class	ZP
@@ -148,6 +150,7 @@ public:
   void setFrom(ZP&, uint32_t);
   bool ismember();
   void multInverse();
+  static void batchInverse(ZP *elts, size_t n);
 
   friend ZP power(const ZP&, unsigned int);
   friend ZP power(const ZP&, const ZP&);
@@ -169,10 +172,65 @@ public:
 
   ZP*    clone() const { return new ZP(*this); }
   void serialize(OpenABEByteString &result) const;
+  void serializeTo(OpenABEByteSink &sink) const;
   void deserialize(OpenABEByteString &input);
   bool isEqual(ZObject*) const;
 };
 
+/// \class  ZPScalar
+/// \brief  Value-only integer mod p for internal arithmetic.
+///
+/// A ZPScalar is the bare MCL Fr value: no order copy, no init flags and no
+/// virtual table, so arrays of them are flat and every operation is a single
+/// field call. It is meant for the inner loops of secret sharing and
+/// coefficient recovery; ZP stays the type at API boundaries.
+class ZPScalar {
+public:
+  bignum_t m_Fr;
+
+  ZPScalar() { mclBnFr_clear(&m_Fr); }
+  explicit ZPScalar(uint32_t x) { mclBnFr_setInt(&m_Fr, x); }
+  explicit ZPScalar(const ZP& z) : m_Fr(z.m_ZP) {}
+
+  // writes the value into z, which keeps its order
+  void toZP(ZP& z) const { z.m_ZP = m_Fr; }
+  bool isZero() const { return mclBnFr_isZero(&m_Fr) == 1; }
+
+  ZPScalar& operator+=(const ZPScalar& x) {
+    mclBnFr_add(&m_Fr, &m_Fr, &x.m_Fr);
+    return *this;
+  }
+  ZPScalar& operator-=(const ZPScalar& x) {
+    mclBnFr_sub(&m_Fr, &m_Fr, &x.m_Fr);
+    return *this;
+  }
+  ZPScalar& operator*=(const ZPScalar& x) {
+    mclBnFr_mul(&m_Fr, &m_Fr, &x.m_Fr);
+    return *this;
+  }
+  void multInverse() { mclBnFr_inv(&m_Fr, &m_Fr); }
+  static void batchInverse(ZPScalar *elts, size_t n);
+
+  friend ZPScalar operator-(const ZPScalar& x) {
+    ZPScalar r;
+    mclBnFr_neg(&r.m_Fr, &x.m_Fr);
+    return r;
+  }
+  friend ZPScalar operator-(const ZPScalar& x, const ZPScalar& y) {
+    ZPScalar r;
+    mclBnFr_sub(&r.m_Fr, &x.m_Fr, &y.m_Fr);
+    return r;
+  }
+  friend ZPScalar operator*(const ZPScalar& x, const ZPScalar& y) {
+    ZPScalar r;
+    mclBnFr_mul(&r.m_Fr, &x.m_Fr, &y.m_Fr);
+    return r;
+  }
+  friend bool operator==(const ZPScalar& x, const ZPScalar& y) {
+    return mclBnFr_isEqual(&x.m_Fr, &y.m_Fr) == 1;
+  }
+};
+
 /// \class  G1
 /// \brief  Class for G1 base field elements in ZML.
 class G1 : public ZObject {
@@ -183,23 +241,33 @@ public:
 
   G1(std::shared_ptr<BPGroup> bgroup);
   G1(const G1& w);
+  G1(G1&& w) noexcept;
   ~G1();
   G1& operator*=(const G1& x);
   G1& operator=(const G1& w);
+  G1& operator=(G1&& w) noexcept;
 
   void setRandom(OpenABERNG *rng);
   bool ismember(bignum_t);
   G1 exp(ZP);
+  G1& expInPlace(const ZP& z);
+  static G1 multiExp(std::vector<G1>& bases, std::vector<ZP>& exps);
+  static G1 multiExp(const G1 *bases, const ZP *exps, size_t n);
+  static G1 doubleExp(const G1& P, const ZP& a, const G1& Q, const ZP& b);
+  // affine coordinates for all of the points with a single inversion
+  static void normalizeAll(G1 *const *pts, size_t n);
   void multInverse();
   friend G1 operator-(const G1&);
   friend G1 operator/(const G1&,const G1&);
   friend G1 operator*(const G1&,const G1&);
+  friend G1 operator*(G1&&,const G1&);
   friend std::ostream& operator<<(std::ostream&, const G1&);
   friend bool operator==(const G1& x, const G1& y);
   friend bool operator!=(const G1& x,const G1& y);
 
   G1*    clone() const { return new G1(*this); }
   void serialize(OpenABEByteString &result) const;
+  void serializeTo(OpenABEByteSink &sink) const;
   void deserialize(OpenABEByteString &input);
   bool isEqual(ZObject*) const;
 };
@@ -214,27 +282,111 @@ public:
 
   G2(std::shared_ptr<BPGroup> bgroup);
   G2(const G2& w);
+  G2(G2&& w) noexcept;
   ~G2();
   G2& operator*=(const G2& x);
   G2& operator=(const G2& w);
+  G2& operator=(G2&& w) noexcept;
 
   void setRandom(OpenABERNG *rng);
+  // the fixed G2 base point (what setRandom takes multiples of)
+  void setGenerator();
   bool ismember(bignum_t);
   G2 exp(ZP);
+  G2& expInPlace(const ZP& z);
+  static G2 multiExp(std::vector<G2>& bases, std::vector<ZP>& exps);
+  static G2 multiExp(const G2 *bases, const ZP *exps, size_t n);
+  // affine coordinates for all of the points with a single inversion
+  static void normalizeAll(G2 *const *pts, size_t n);
 
   friend G2 operator-(const G2&);
   friend G2 operator/(const G2&,const G2&);
   friend G2 operator*(const G2&,const G2&);
+  friend G2 operator*(G2&&,const G2&);
   friend std::ostream& operator<<(std::ostream&, const G2&);
   friend bool operator==(const G2& x,const G2& y);
   friend bool operator!=(const G2& x,const G2& y);
 
   G2*    clone() const { return new G2(*this); }
   void serialize(OpenABEByteString &result) const;
+  void serializeTo(OpenABEByteSink &sink) const;
   void deserialize(OpenABEByteString &input);
   bool isEqual(ZObject*) const;
 };
 
+#if defined(BP_WITH_MCL)
+/// \class  G1Vector
+/// \brief  Contiguous G1 elements of one group.
+///
+/// The bare MCL points stored back to back with a single group pointer (no
+/// per-element vtable or shared_ptr), so the batch paths hand them to MCL
+/// without a copy: multi-exponentiation, the Miller loops of a
+/// multi-pairing, batch normalization and list serialization. Elements
+/// convert to and from G1 at the edges.
+class G1Vector {
+public:
+  explicit G1Vector(std::shared_ptr<BPGroup> bgroup, size_t n = 0);
+  G1Vector(std::shared_ptr<BPGroup> bgroup, const G1 *elts, size_t n);
+
+  size_t size() const { return this->elts_.size(); }
+  bool   empty() const { return this->elts_.empty(); }
+  // added elements are the identity
+  void   resize(size_t n);
+  void   reserve(size_t n) { this->elts_.reserve(n); }
+  void   clear() { this->elts_.clear(); }
+  void   push_back(const G1& e) { this->elts_.push_back(e.m_G1); }
+  G1     get(size_t i) const;
+  void   set(size_t i, const G1& e) { this->elts_[i] = e.m_G1; }
+  mclBnG1 *data() { return this->elts_.data(); }
+  const mclBnG1 *data() const { return this->elts_.data(); }
+  std::shared_ptr<BPGroup> getGroup() const { return this->bgroup_; }
+
+  // prod_i this[i]^exps[i] over size() exponents. MCL may normalize the
+  // elements while it works, which leaves their values unchanged.
+  G1 multiExp(const ZP *exps);
+  G1 multiExp(const ZPScalar *exps);
+  // brings every element to affine form with a single field inversion
+  void normalize();
+  // [count (4)] followed by the compressed encoding of each element
+  void serialize(OpenABEByteString &result) const;
+  void deserialize(OpenABEByteString &input);
+
+private:
+  std::shared_ptr<BPGroup> bgroup_;
+  std::vector<mclBnG1> elts_;
+};
+
+/// \class  G2Vector
+/// \brief  Contiguous G2 elements of one group (see G1Vector).
+class G2Vector {
+public:
+  explicit G2Vector(std::shared_ptr<BPGroup> bgroup, size_t n = 0);
+  G2Vector(std::shared_ptr<BPGroup> bgroup, const G2 *elts, size_t n);
+
+  size_t size() const { return this->elts_.size(); }
+  bool   empty() const { return this->elts_.empty(); }
+  void   resize(size_t n);
+  void   reserve(size_t n) { this->elts_.reserve(n); }
+  void   clear() { this->elts_.clear(); }
+  void   push_back(const G2& e) { this->elts_.push_back(e.m_G2); }
+  G2     get(size_t i) const;
+  void   set(size_t i, const G2& e) { this->elts_[i] = e.m_G2; }
+  mclBnG2 *data() { return this->elts_.data(); }
+  const mclBnG2 *data() const { return this->elts_.data(); }
+  std::shared_ptr<BPGroup> getGroup() const { return this->bgroup_; }
+
+  G2 multiExp(const ZP *exps);
+  G2 multiExp(const ZPScalar *exps);
+  void normalize();
+  void serialize(OpenABEByteString &result) const;
+  void deserialize(OpenABEByteString &input);
+
+private:
+  std::shared_ptr<BPGroup> bgroup_;
+  std::vector<mclBnG2> elts_;
+};
+#endif
+
 /// \class  GT
 /// \brief  Class for GT field elements in RELIC.
 class GT : public ZObject {
@@ -245,9 +397,11 @@ public:
 
   GT(std::shared_ptr<BPGroup> bgroup);
   GT(const GT& w);
+  GT(GT&& w) noexcept;
   ~GT();
   GT& operator*=(const GT& x);
   GT& operator=(const GT& x);
+  GT& operator=(GT&& w) noexcept;
 
   void enableCompression() { shouldCompress_ = true; };
   void disableCompression() { shouldCompress_ = false; };
@@ -256,16 +410,27 @@ public:
   bool isInfinity();
   bool ismember(bignum_t);
   GT exp(ZP);
+  GT& expInPlace(const ZP& z);
+  // unitary inverse: conjugation in Fp12, which is the inverse of every
+  // element of the cyclotomic subgroup (anything a pairing returns). The
+  // same operation backs operator- and the divisor in operator/.
+  GT conjugate() const;
 
   friend GT operator-(const GT&);
   friend GT operator/(const GT&,const GT&);
   friend GT operator*(const GT&,const GT&);
+  friend GT operator*(GT&&,const GT&);
   friend std::ostream& operator<<(std::ostream& s, const GT&);
   friend bool operator==(const GT& x, const GT& y);
   friend bool operator!=(const GT& x, const GT& y);
 
   GT* clone() const { return new GT(*this); }
   void serialize(OpenABEByteString &result) const;
+  void serializeTo(OpenABEByteSink &sink) const;
+  // smallest encoding the backend offers (torus compression under MCL);
+  // deserialize() reads it as well as the regular one
+  void serializeCompact(OpenABEByteString &result) const;
+  void serializeCompactTo(OpenABEByteSink &sink) const;
   void deserialize(OpenABEByteString &input);
   bool isEqual(ZObject*) const;
 
@@ -286,5 +451,16 @@ typedef OpenABEElementList::iterator OpenABEElementListIterator;
 // pairings definition
 void multi_bp_map_op(const bp_group_t group, oabe::GT& gt,
                      std::vector<oabe::G1>& g1, std::vector<oabe::G2>& g2);
+void multi_bp_map_op(const bp_group_t group, oabe::GT& gt,
+                     const oabe::G1 *g1, const oabe::G2 *g2, size_t n);
+// same, with m more pairs whose G2 side has precomputed lines
+void multi_bp_map_op(const bp_group_t group, oabe::GT& gt,
+                     const oabe::G1 *g1, const oabe::G2 *g2, size_t n,
+                     const oabe::G1 *fixedG1, const oabe::G2LineTable *const *fixedG2, size_t m);
+#if defined(BP_WITH_MCL)
+// over contiguous elements, without copying them
+void multi_bp_map_op(const bp_group_t group, oabe::GT& gt,
+                     const oabe::G1Vector& g1, const oabe::G2Vector& g2);
+#endif
 
 #endif	// __ZELEMENT_BP_H__
@@ -48,6 +48,8 @@ public:
   G_t  initG();
   // curve parameters
   G_t	getGenerator();
+  // generator^e, through the curve's precomputed generator table
+  G_t	expGenerator(ZP_t &e);
   void getGroupOrder(bignum_t o);
   ZP_t  getGroupOrder();
 
@@ -75,6 +77,13 @@ OpenABECurveID  OpenABE_convertIntToCurveID(uint8_t curveID);
 int OpenABE_convertStringToNID(std::string paramsID);
 int OpenABE_convertCurveIDToNID(OpenABECurveID id);
 
+// X25519 key agreement on raw 32-byte keys (see zelliptic.cpp)
+#define OpenABE_X25519_PARAMS     "X25519"
+#define OpenABE_X25519_KEY_BYTES  32
+bool OpenABE_X25519PublicKey(OpenABEByteString &privKey, OpenABEByteString &pubKey);
+bool OpenABE_X25519SharedSecret(OpenABEByteString &privKey, OpenABEByteString &peerKey,
+                                OpenABEByteString &Z);
+
 }
 
 #endif // __ZELLIPTIC_H__
@@ -0,0 +1,281 @@
+/// 
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+/// 
+/// This file is part of Zeutro's OpenABE.
+/// 
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+/// 
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+/// 
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+/// 
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+/// \file   zfixedbase.h
+///
+/// \brief  Class definitions for fixed-base exponentiation tables.
+///
+/// \author J. Ayo Akinyele
+///
+
+#ifndef __ZFIXEDBASE_H__
+#define __ZFIXEDBASE_H__
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// window size (in bits) of the fixed-base tables
+#define FIXED_BASE_WINDOW_BITS   4
+#define FIXED_BASE_WINDOW_SIZE   (1 << FIXED_BASE_WINDOW_BITS)
+// signed window size for GT (digits in [-16, 15], inverses are conjugates)
+#define FIXED_BASE_GT_WINDOW_BITS   5
+#define FIXED_BASE_GT_TABLE_SIZE    ((1 << (FIXED_BASE_GT_WINDOW_BITS - 1)) + 1)
+
+namespace oabe {
+
+/// \class  OpenABEFixedBaseAttachment
+/// \brief  The tables of one snapshot attached with
+///         OpenABE_attachFixedBaseSnapshot, by element. Only the tables
+///         built with the attachment (those of the keys loaded from the same
+///         snapshot) point into it, and they hold it, so the snapshot memory
+///         it keeps is released with the last of them.
+class OpenABEFixedBaseAttachment {
+public:
+  ~OpenABEFixedBaseAttachment() {}
+
+  // the table for a key built by zfixedbase.cpp (type and base), or nullptr
+  const void *find(const std::string &key) const {
+    auto it = this->tables_.find(key);
+    return (it != this->tables_.end()) ? it->second : nullptr;
+  }
+  size_t getCount() const { return this->tables_.size(); }
+
+private:
+  OpenABEFixedBaseAttachment() {}
+  OpenABEFixedBaseAttachment(const OpenABEFixedBaseAttachment&) = delete;
+  OpenABEFixedBaseAttachment& operator=(const OpenABEFixedBaseAttachment&) = delete;
+
+  std::map<std::string, const void*> tables_;
+  // an aligned copy of a snapshot that could not be used in place
+  std::unique_ptr<uint64_t[]> copy_;
+  // the memory of the snapshot, when the attachment owns it
+  std::shared_ptr<const void> memory_;
+
+  friend OpenABE_ERROR OpenABE_attachFixedBaseSnapshot(const uint8_t *, size_t,
+      std::shared_ptr<const OpenABEFixedBaseAttachment> &, const uint8_t **, size_t *,
+      const OpenABEByteString *, const std::shared_ptr<const void> &);
+};
+
+typedef std::shared_ptr<const OpenABEFixedBaseAttachment> OpenABEAttachedTables;
+
+/// \class  G1FixedBase
+/// \brief  Precomputed window table for exponentiations of a fixed G1 base.
+///         Stores d * 2^(w*j) * base for every window j and digit d, so
+///         that an exponentiation costs one table lookup and one point
+///         addition per window and no doublings.
+class G1FixedBase {
+public:
+  // with an attachment, uses its table for the base if it has one
+  G1FixedBase(const G1& base, const OpenABEAttachedTables &attached = nullptr);
+  ~G1FixedBase();
+
+  G1 exp(const ZP& z) const;
+  const G1& getBase() const { return base_; }
+  // bytes of table memory held (none for a table in an attached snapshot)
+  size_t getMemoryUsage() const;
+#if defined(BP_WITH_MCL)
+  const g1_ptr *getTable() const { return entries_; }
+  size_t getTableSize() const { return numWindows_ * FIXED_BASE_WINDOW_SIZE; }
+#endif
+
+private:
+  G1FixedBase(const G1FixedBase&) = delete;
+  G1FixedBase& operator=(const G1FixedBase&) = delete;
+
+  G1 base_;
+#if defined(BP_WITH_MCL)
+  size_t numWindows_;
+  OpenABEPrecomputeVector<g1_ptr> table_;
+  // table_, or the same table in an attached snapshot
+  const g1_ptr *entries_;
+  // the attachment entries_ points into
+  OpenABEAttachedTables attached_;
+#endif
+};
+
+/// \class  G2FixedBase
+/// \brief  Precomputed window table for exponentiations of a fixed G2 base.
+class G2FixedBase {
+public:
+  // with an attachment, uses its table for the base if it has one
+  G2FixedBase(const G2& base, const OpenABEAttachedTables &attached = nullptr);
+  ~G2FixedBase();
+
+  G2 exp(const ZP& z) const;
+  const G2& getBase() const { return base_; }
+  // bytes of table memory held (none for a table in an attached snapshot)
+  size_t getMemoryUsage() const;
+#if defined(BP_WITH_MCL)
+  const g2_ptr *getTable() const { return entries_; }
+  size_t getTableSize() const { return numWindows_ * FIXED_BASE_WINDOW_SIZE; }
+#endif
+
+private:
+  G2FixedBase(const G2FixedBase&) = delete;
+  G2FixedBase& operator=(const G2FixedBase&) = delete;
+
+  G2 base_;
+#if defined(BP_WITH_MCL)
+  size_t numWindows_;
+  OpenABEPrecomputeVector<g2_ptr> table_;
+  // table_, or the same table in an attached snapshot
+  const g2_ptr *entries_;
+  // the attachment entries_ points into
+  OpenABEAttachedTables attached_;
+#endif
+};
+
+/// \class  GTFixedBase
+/// \brief  Precomputed signed-window table for exponentiations of a fixed
+///         GT base. GT is the cyclotomic subgroup of Fp12, where inversion
+///         is a conjugation, so only the positive half of each window is
+///         stored and negative digits are applied by conjugating.
+class GTFixedBase {
+public:
+  // with an attachment, uses its table for the base if it has one
+  GTFixedBase(const GT& base, const OpenABEAttachedTables &attached = nullptr);
+  ~GTFixedBase();
+
+  GT exp(const ZP& z) const;
+  const GT& getBase() const { return base_; }
+  // bytes of table memory held (none for a table in an attached snapshot)
+  size_t getMemoryUsage() const;
+#if defined(BP_WITH_MCL)
+  const gt_ptr *getTable() const { return entries_; }
+  size_t getTableSize() const { return numWindows_ * FIXED_BASE_GT_TABLE_SIZE; }
+#endif
+
+private:
+  GTFixedBase(const GTFixedBase&) = delete;
+  GTFixedBase& operator=(const GTFixedBase&) = delete;
+
+  GT base_;
+#if defined(BP_WITH_MCL)
+  size_t numWindows_;
+  OpenABEPrecomputeVector<gt_ptr> table_;
+  // table_, or the same table in an attached snapshot
+  const gt_ptr *entries_;
+  // the attachment entries_ points into
+  OpenABEAttachedTables attached_;
+#endif
+};
+
+/// \class  G2LineTable
+/// \brief  Precomputed Miller-loop line coefficients for a fixed G2
+///         element. A pairing against the element then only evaluates the
+///         lines at the G1 point (see OpenABEPairing::multi_pairing).
+///         The table is as sensitive as the element and is zeroized with it
+///         (unless it lives in an attached snapshot, which is read-only).
+class G2LineTable {
+public:
+  G2LineTable(const G2& q, const OpenABEAttachedTables &attached = nullptr);
+  ~G2LineTable();
+
+  const G2& getElement() const { return q_; }
+  size_t getMemoryUsage() const;
+#if defined(BP_WITH_MCL)
+  const uint64_t *getLines() const { return entries_; }
+  size_t getLinesSize() const;
+#endif
+
+private:
+  G2LineTable(const G2LineTable&) = delete;
+  G2LineTable& operator=(const G2LineTable&) = delete;
+
+  G2 q_;
+#if defined(BP_WITH_MCL)
+  OpenABEPrecomputeVector<uint64_t> lines_;
+  // lines_, or the same lines in an attached snapshot
+  const uint64_t *entries_;
+  OpenABEAttachedTables attached_;
+#endif
+};
+
+/// \class  OpenABEFixedBaseSnapshot
+/// \brief  Writes fixed-base tables (and G2 line tables) in a flat layout
+///         that other processes can map (a file, shared memory) and use in
+///         place: a G1/G2/GTFixedBase or G2LineTable built for one of the
+///         snapshot's elements with the attachment of the snapshot (see
+///         OpenABE_attachFixedBaseSnapshot) points into it instead of
+///         holding its own table. An opaque payload (e.g. the serialized
+///         MPK the tables belong to) travels along, a SHA-256 digest covers
+///         the whole snapshot and, when written with a MAC key, an
+///         HMAC-SHA256 tag covers each table with its base. The layout is
+///         specific to the build (curve, limb size, window sizes) and other
+///         builds reject it.
+class OpenABEFixedBaseSnapshot {
+public:
+  OpenABEFixedBaseSnapshot() {}
+  ~OpenABEFixedBaseSnapshot() {}
+
+  void add(const G1FixedBase &table) { this->g1_.push_back(&table); }
+  void add(const G2FixedBase &table) { this->g2_.push_back(&table); }
+  void add(const GTFixedBase &table) { this->gt_.push_back(&table); }
+  void add(const G2LineTable &table) { this->lines_.push_back(&table); }
+  // evictable tables are held until the snapshot goes away
+  void add(const std::shared_ptr<const G1FixedBase> &table) {
+    this->add(*table);
+    this->held_.push_back(table);
+  }
+  void add(const std::shared_ptr<const G2LineTable> &table) {
+    this->add(*table);
+    this->held_.push_back(table);
+  }
+  void setPayload(const std::string &payload) { this->payload_ = payload; }
+  // the tables must stay alive until the snapshot is written; macKey tags
+  // each table (optional)
+  void serialize(std::string &out, const OpenABEByteString *macKey = nullptr) const;
+
+private:
+  std::vector<const G1FixedBase*> g1_;
+  std::vector<const G2FixedBase*> g2_;
+  std::vector<const GTFixedBase*> gt_;
+  std::vector<const G2LineTable*> lines_;
+  std::vector<std::shared_ptr<const void>> held_;
+  std::string payload_;
+};
+
+// Validate a snapshot and every one of its tables, and return them in
+// 'attached' for the tables of the keys loaded from the snapshot's own
+// payload; nothing else in the process uses them. Without a MAC key each
+// table is checked by recomputing it (which saves the memory, not the
+// time); with one, by its tag, and untagged snapshots are rejected. The
+// memory is read in place (when 8-byte aligned, otherwise copied once), so
+// it must stay mapped and unchanged while the attachment is alive, or be
+// handed over as 'memory'. On success, points 'payload' at the snapshot's
+// payload.
+OpenABE_ERROR OpenABE_attachFixedBaseSnapshot(const uint8_t *snapshot, size_t len,
+                                              OpenABEAttachedTables &attached,
+                                              const uint8_t **payload = nullptr,
+                                              size_t *payloadLen = nullptr,
+                                              const OpenABEByteString *macKey = nullptr,
+                                              const std::shared_ptr<const void> &memory = nullptr);
+
+}
+
+#endif	// __ZFIXEDBASE_H__
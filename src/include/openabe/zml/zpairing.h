@@ -57,8 +57,18 @@ public:
   OpenABEByteString hashFromBytes(OpenABEByteString &buf, uint32_t target_len, uint8_t hash_prefix);
 
   G1       hashToG1(OpenABEByteString&, std::string);
+  // hashToG1 of every message under the same prefix, in affine coordinates
+  std::vector<G1> hashToG1Batch(OpenABEByteString& keyPrefix,
+                                const std::vector<std::string>& msgs,
+                                size_t maxConcurrency = 0);
   GT       pairing(G1& g1, G2& g2);
   void     multi_pairing(GT& gt, std::vector<G1>& g1, std::vector<G2>& g2);
+  void     multi_pairing(GT& gt, const G1 *g1, const G2 *g2, size_t n);
+  void     multi_pairing(GT& gt, const G1 *g1, const G2 *g2, size_t n,
+                         const G1 *fixedG1, const G2LineTable *const *fixedG2, size_t m);
+#if defined(BP_WITH_MCL)
+  void     multi_pairing(GT& gt, const G1Vector& g1, const G2Vector& g2);
+#endif
 
   std::string  getPairingParams() const;
   OpenABECurveID   getCurveID() const;
@@ -72,6 +82,35 @@ protected:
   std::shared_ptr<BPGroup>  bpgroup;
 };
 
+#if defined(BP_WITH_MCL)
+///
+/// Offload of large pairing products and multi-exponentiations, e.g. to a
+/// GPU. Each hook returns 0 once it has written the result; any other
+/// value, a missing hook or a call below the thresholds runs on the CPU
+/// instead. The batch APIs call the hooks concurrently from the library
+/// pool, so a device backend should queue the calls into its own batches.
+///
+struct OpenABEBatchAccelerator {
+  const char *name;
+  size_t minPairs;   // smallest pairing product worth offloading
+  size_t minExps;    // smallest multi-exponentiation worth offloading
+  // out = prod_i MillerLoop(p[i], q[i]), without the final exponentiation
+  int (*millerLoopVec)(void *context, mclBnGT *out, const mclBnG1 *p,
+                       const mclBnG2 *q, size_t n);
+  // out = sum_i y[i] * x[i]; x is scratch and may be normalized in place
+  int (*g1MulVec)(void *context, mclBnG1 *out, mclBnG1 *x,
+                  const mclBnFr *y, size_t n);
+  int (*g2MulVec)(void *context, mclBnG2 *out, mclBnG2 *x,
+                  const mclBnFr *y, size_t n);
+  void *context;
+};
+
+// install an accelerator (nullptr removes it); it must stay valid for as
+// long as calls already running may still use it
+void OpenABE_setBatchAccelerator(const OpenABEBatchAccelerator *accel);
+const OpenABEBatchAccelerator *OpenABE_getBatchAccelerator();
+#endif
+
 // Global library initialization and shutdown functions
 OpenABE_ERROR zMathInitLibrary();
 OpenABE_ERROR zMathShutdownLibrary();
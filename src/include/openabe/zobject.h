@@ -49,6 +49,7 @@ namespace oabe {
 #ifndef __ZBYTESTRING_H__
 class OpenABEByteString;
 #endif
+class OpenABEByteSink;
 
 class ZObject {
 public:
@@ -65,6 +66,9 @@ public:
 #else
   virtual void serialize(OpenABEByteString &result) const { throw OpenABE_ERROR_NOT_IMPLEMENTED; }
 #endif
+  // append the serialized form to a sink; the default stages it through
+  // serialize(), element types write directly
+  virtual void serializeTo(OpenABEByteSink &sink) const;
   virtual bool isEqual(ZObject* z) const { return false; }
 
 protected:
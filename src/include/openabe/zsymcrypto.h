@@ -34,7 +34,9 @@
 #ifndef __ZSYMCRYPTO__
 #define __ZSYMCRYPTO__
 
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <openssl/aes.h>
 #include <openssl/rand.h>
@@ -55,7 +57,10 @@ namespace crypto {
 ///
 /// @class  OpenABESymKeyAuthEnc
 ///
-/// @brief  Class for performing authenticated symmetric encryption using AES in GCM mode
+/// @brief  Class for performing authenticated symmetric encryption using AES in GCM mode.
+///         The cipher contexts are keyed once and reused for every message,
+///         so an object is meant to be kept per key (and used by one thread
+///         at a time).
 ///
 
 class OpenABESymKeyAuthEnc : ZObject {
@@ -66,6 +71,10 @@ private:
   OpenABEByteString key;
   bool aad_set;
   uint32_t iv_len;
+  EVP_CIPHER_CTX *enc_ctx, *dec_ctx;
+  int enc_iv_len, dec_iv_len;
+
+  EVP_CIPHER_CTX* startMessage(int enc, const uint8_t *iv, int ivLen);
 
 public:
   OpenABESymKeyAuthEnc(int securitylevel, const std::string& zkey);
@@ -79,6 +88,73 @@ public:
                     OpenABEByteString* ciphertext, OpenABEByteString* tag);
   bool decrypt(std::string& plaintext, OpenABEByteString* iv,
                OpenABEByteString* ciphertext, OpenABEByteString* tag);
+  // allocation-free variants over caller buffers (ciphertext and plaintext
+  // are the same length, iv and tag are AES_BLOCK_SIZE bytes)
+  OpenABE_ERROR encrypt(const uint8_t *plaintext, size_t pt_len,
+                    uint8_t *iv, uint8_t *ciphertext, uint8_t *tag);
+  bool decrypt(uint8_t *plaintext, const uint8_t *ciphertext, size_t ct_len,
+               const uint8_t *iv, size_t iv_len, const uint8_t *tag);
+};
+
+///
+/// @class  OpenABESymKeyChunkedAuthEnc
+///
+/// @brief  Segmented AES-GCM for large payloads (the STREAM construction).
+///         The plaintext is split into fixed-size chunks, each sealed under
+///         its own nonce (random prefix || chunk index || last-chunk flag),
+///         so chunks are encrypted in parallel and can be decrypted on their
+///         own. Reordered, dropped or truncated chunks fail authentication.
+///         The same format can also be produced and consumed as a stream,
+///         one chunk at a time (init/update/finalize).
+///
+
+class OpenABESymKeyChunkedAuthEnc : ZObject {
+private:
+  EVP_CIPHER *cipher;
+  OpenABEByteString aad;
+  OpenABEByteString key;
+  // streaming state
+  EVP_CIPHER_CTX *stream_ctx;
+  OpenABEByteString stream_header, pending;
+  size_t stream_chunk_size, stream_index;
+  int stream_mode;
+
+  bool processChunks(int enc, size_t first, size_t last,
+                     const std::function<bool(EVP_CIPHER_CTX*, size_t)> &fn);
+  OpenABE_ERROR sealNextChunk(const uint8_t *plaintext, size_t n, bool last,
+                              OpenABEByteString *ciphertext);
+  void resetStream();
+
+public:
+  OpenABESymKeyChunkedAuthEnc(int securitylevel, OpenABEByteString& zkey);
+  ~OpenABESymKeyChunkedAuthEnc();
+
+  void setAddAuthData(OpenABEByteString &aad);
+  // size of the ciphertext of a pt_len-byte plaintext
+  static size_t getCiphertextSize(size_t pt_len,
+                                  size_t chunk_size = DEFAULT_AEAD_CHUNK_SIZE);
+  // size of the plaintext of a ciphertext, or 0 if it is malformed
+  static size_t getPlaintextSize(const uint8_t *ciphertext, size_t ct_len);
+
+  // ciphertext must hold getCiphertextSize(pt_len, chunk_size) bytes
+  OpenABE_ERROR encrypt(const uint8_t *plaintext, size_t pt_len, uint8_t *ciphertext,
+                        size_t chunk_size = DEFAULT_AEAD_CHUNK_SIZE);
+  // plaintext must hold getPlaintextSize(ciphertext, ct_len) bytes
+  bool decrypt(uint8_t *plaintext, const uint8_t *ciphertext, size_t ct_len);
+  // decrypt plaintext bytes [offset, offset + len), reading only the chunks
+  // that cover them
+  bool decryptRange(uint8_t *plaintext, const uint8_t *ciphertext, size_t ct_len,
+                    size_t offset, size_t len);
+
+  // streaming: output is appended, with at most one chunk held back
+  OpenABE_ERROR encryptInit(OpenABEByteString *ciphertext,
+                            size_t chunk_size = DEFAULT_AEAD_CHUNK_SIZE);
+  OpenABE_ERROR encryptUpdate(const uint8_t *plaintext, size_t pt_len,
+                              OpenABEByteString *ciphertext);
+  OpenABE_ERROR encryptFinalize(OpenABEByteString *ciphertext);
+  void decryptInit();
+  bool decryptUpdate(const uint8_t *ciphertext, size_t ct_len, OpenABEByteString *plaintext);
+  bool decryptFinalize(OpenABEByteString *plaintext);
 };
 
 class OpenABESymKeyHandle {
@@ -114,6 +190,9 @@ protected:
   std::string key_;
   bool b64_encode_;
   OpenABEByteString authData_;
+  // one keyed AES-GCM object for the handle's lifetime
+  std::unique_ptr<OpenABESymKeyAuthEnc> authEnc_;
+  std::mutex authEncLock_;
 };
 
 // Hash-based key derivation function
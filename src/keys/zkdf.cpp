@@ -81,45 +81,91 @@ OpenABEKDF::~OpenABEKDF() {}
 
 OpenABEByteString OpenABEKDF::DeriveKey(OpenABEByteString &Z, uint32_t keyBitLen,
                                 OpenABEByteString &metadata) {
-  // compute number of hash blocks needed (round up)
-  OpenABEByteString buffer;
-  uint32_t count = 1;
-
-  // ceiling of keydataLen / hashLen (bitwise)
-  size_t reps_len = (size_t)ceil(((double)keyBitLen) / this->hashLen);
-  if (reps_len > OpenABE_MAX_KDF_BITLENGTH) {
-    fprintf(stderr, "KDF: invalid key length (too long)\n");
+  OpenABEByteString keyMaterial;
+  OpenABEKDFInput info = { metadata.data(), metadata.size() };
+  keyMaterial.fillBuffer(0, keyBitLen / 8);
+  if (this->DeriveKey(Z.data(), Z.size(), &info, 1, keyMaterial.data(),
+                      keyMaterial.size()) != OpenABE_NOERROR) {
     return OpenABEByteString();
   }
+  return keyMaterial;
+}
+
+/*!
+ * Streaming form of the concatenated KDF. Each block is
+ * H(counter || hashPrefix || Z || metadata[0] || ... || metadata[n-1]),
+ * fed piecewise into one reused digest context and written straight
+ * into the caller's buffer, so no input or output copies are made.
+ *
+ * @param[in]   the shared secret and its length.
+ * @param[in]   the pieces of auxiliary information, in order.
+ * @param[in]   the number of pieces.
+ * @param[out]  buffer that receives the derived key.
+ * @param[in]   the number of bytes to derive.
+ * @return  An error code or OpenABE_NOERROR.
+ */
 
-  // buffer = counter || hashPrefix || Z || Metadata
-  buffer.setFirstBytes(count);
-  buffer.push_back(this->hashPrefix);
-  buffer.appendArray(Z.getInternalPtr(), Z.size());
-  buffer.appendArray(metadata.getInternalPtr(), metadata.size());
+OpenABE_ERROR OpenABEKDF::DeriveKey(const uint8_t *Z, size_t zLen,
+                                    const OpenABEKDFInput *metadata, size_t metadataCount,
+                                    uint8_t *output, size_t outputLen) {
+  if (Z == nullptr || output == nullptr || outputLen == 0 ||
+      (metadata == nullptr && metadataCount > 0)) {
+    return OpenABE_ERROR_INVALID_INPUT;
+  }
 
-  if (buffer.size() > this->maxInputLen) {
+  size_t inputLen = sizeof(uint32_t) + 1 + zLen;
+  for (size_t i = 0; i < metadataCount; i++) {
+    inputLen += metadata[i].len;
+  }
+  if (inputLen > this->maxInputLen) {
     fprintf(stderr, "KDF: invalid buffer size (too large)\n");
-    return OpenABEByteString();
+    return OpenABE_ERROR_INVALID_LENGTH;
   }
-
-  // set the hash_len
-  size_t hash_len = reps_len * this->hashLen;
-  std::vector<uint8_t> hash(hash_len + 1, 0);
-
-  uint8_t *hash_ptr = &hash[0];
-  for (size_t i = 0; i < reps_len; i++) {
-    // H(count++ || prefix || Z || Metadata)
-    sha256(hash_ptr, buffer.getInternalPtr(), buffer.size());
-    count++;
-    buffer.setFirstBytes(count);
-    hash_ptr += this->hashLen; // move ptr by hashLen bytes
+  // number of hash blocks needed (round up)
+  const size_t reps_len = (outputLen + SHA256_LEN - 1) / SHA256_LEN;
+  if (reps_len > OpenABE_MAX_KDF_BITLENGTH) {
+    fprintf(stderr, "KDF: invalid key length (too long)\n");
+    return OpenABE_ERROR_INVALID_LENGTH;
   }
 
-  uint32_t keydataBytes = keyBitLen / 8;
-  OpenABEByteString keyMaterial;
-  keyMaterial.appendArray(&hash[0], keydataBytes);
-  return keyMaterial;
+  EVP_MD_CTX *md_ctx = EVP_MD_CTX_new();
+  if (md_ctx == nullptr) {
+    return OpenABE_ERROR_OUT_OF_MEMORY;
+  }
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  uint8_t digest[SHA256_LEN];
+  size_t written = 0;
+  for (uint32_t count = 1; written < outputLen; count++) {
+    const uint8_t counter[sizeof(uint32_t)] = {
+        (uint8_t)(count >> 24), (uint8_t)(count >> 16),
+        (uint8_t)(count >> 8), (uint8_t)count };
+    bool ok = EVP_DigestInit_ex(md_ctx, EVP_sha256(), NULL) == 1 &&
+              EVP_DigestUpdate(md_ctx, counter, sizeof(counter)) == 1 &&
+              EVP_DigestUpdate(md_ctx, &this->hashPrefix, 1) == 1 &&
+              EVP_DigestUpdate(md_ctx, Z, zLen) == 1;
+    for (size_t i = 0; ok && i < metadataCount; i++) {
+      ok = EVP_DigestUpdate(md_ctx, metadata[i].data, metadata[i].len) == 1;
+    }
+    // whole blocks go straight to the output; only a final partial block
+    // goes through the stack buffer
+    const size_t n = min(outputLen - written, (size_t)SHA256_LEN);
+    uint8_t *dst = (n == SHA256_LEN) ? output + written : digest;
+    ok = ok && EVP_DigestFinal_ex(md_ctx, dst, NULL) == 1;
+    if (!ok) {
+      result = OpenABE_ERROR_UNKNOWN;
+      break;
+    }
+    if (dst == digest) {
+      memcpy(output + written, digest, n);
+    }
+    written += n;
+  }
+  OPENSSL_cleanse(digest, sizeof(digest));
+  EVP_MD_CTX_free(md_ctx);
+  if (result != OpenABE_NOERROR) {
+    OPENSSL_cleanse(output, outputLen);
+  }
+  return result;
 }
 
 
@@ -172,3 +218,114 @@ OpenABEByteString OpenABEPBKDF(OpenABEByteString &password, uint32_t keydataLenB
   return outputHash;
 }
 }
+
+/********************************************************************************
+ * Implementation of the OpenABEPasswordKeyCache class
+ ********************************************************************************/
+namespace oabe {
+
+static string passwordCacheKey(OpenABEByteString &salt, int iterationCount) {
+  string id((const char *)salt.data(), salt.size());
+  for (int i = 3; i >= 0; i--) {
+    id.push_back((char)((iterationCount >> (8 * i)) & 0xFF));
+  }
+  return id;
+}
+
+OpenABEPasswordKeyCache::OpenABEPasswordKeyCache(const string &password,
+                                                 int iterationCount, size_t maxKeys)
+    : iterationCount_(iterationCount), maxKeys_(maxKeys > 0 ? maxKeys : 1) {
+  password_ = password;
+}
+
+OpenABEPasswordKeyCache::~OpenABEPasswordKeyCache() {
+  this->clear();
+  password_.zeroize();
+}
+
+/*!
+ * Returns the salt and key for sealing a new blob. The salt is drawn
+ * once per session; the key is derived on first use.
+ *
+ * @param[out]  the session salt.
+ * @param[out]  the key derived from the passphrase and salt.
+ */
+
+void OpenABEPasswordKeyCache::getSealingKey(OpenABEByteString &salt, OpenABEByteString &key) {
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (sealSalt_.size() == 0) {
+      OpenABERNG rng;
+      rng.getRandomBytes(&sealSalt_, SALT_LEN);
+    }
+    salt = sealSalt_;
+  }
+  this->getKey(salt, iterationCount_, key);
+}
+
+/*!
+ * Returns the key for a (salt, iteration count) pair, deriving and
+ * caching it on a miss. The derivation runs without the lock held so
+ * concurrent misses on different blobs don't serialize.
+ *
+ * @param[in]   the salt from the blob.
+ * @param[in]   the iteration count from the blob.
+ * @param[out]  the derived key.
+ */
+
+void OpenABEPasswordKeyCache::getKey(OpenABEByteString &salt, int iterationCount,
+                                     OpenABEByteString &key) {
+  const string id = passwordCacheKey(salt, iterationCount);
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto it = keys_.find(id);
+    if (it != keys_.end()) {
+      key = it->second;
+      return;
+    }
+  }
+
+  key = OpenABEPBKDF(password_, DEFAULT_SYM_KEY_BYTES, salt, iterationCount);
+  if (key.size() == 0) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(lock_);
+  if (keys_.find(id) != keys_.end()) {
+    return;
+  }
+  keys_[id] = key;
+  // the session's own sealing key is never evicted
+  if (sealSalt_.size() > 0 && id == passwordCacheKey(sealSalt_, iterationCount_)) {
+    return;
+  }
+  order_.push_back(id);
+  // evict the oldest derivations
+  while (order_.size() > maxKeys_) {
+    auto oldest = keys_.find(order_.front());
+    oldest->second.zeroize();
+    keys_.erase(oldest);
+    order_.pop_front();
+  }
+}
+
+size_t OpenABEPasswordKeyCache::size() {
+  std::lock_guard<std::mutex> lock(lock_);
+  return keys_.size();
+}
+
+/*!
+ * Wipes every cached key and ends the current sealing salt.
+ */
+
+void OpenABEPasswordKeyCache::clear() {
+  std::lock_guard<std::mutex> lock(lock_);
+  for (auto &it : keys_) {
+    it.second.zeroize();
+  }
+  keys_.clear();
+  order_.clear();
+  sealSalt_.zeroize();
+}
+
+}
@@ -114,18 +114,17 @@ void OpenABEKey::getHeader(OpenABEByteString &header) {
 OpenABE_ERROR
 OpenABEKey::exportKeyToBytes(OpenABEByteString &output) {
   output.clear();
-  OpenABEByteString keyHeader, keyBytes;
+  OpenABEByteString keyHeader;
   // libVersion || curveID || AlgID || uid || id
   this->getHeader(keyHeader);
-  // serialize the key structure
-  this->serialize(keyBytes);
-  // first pack the key header
-  // then pack the key bytes
+  // first pack the key header, then serialize the key structure straight
+  // into the output (no intermediate copy of the secret key material)
   output.pack(keyHeader.getInternalPtr(), keyHeader.size());
-  output.pack(keyBytes.getInternalPtr(), keyBytes.size());
-  // clear the contents of the intermediate buffers
+  OpenABEByteSink sink(output);
+  size_t mark = sink.beginPacked32();
+  this->serializeTo(sink);
+  sink.endPacked32(mark);
   keyHeader.clear();
-  keyBytes.clear();
 
   return OpenABE_NOERROR;
 }
@@ -142,12 +141,21 @@ OpenABEKeyType OpenABE_KeyTypeFromAlgorithmID(uint8_t algorithmID) {
   if (algorithmID == OpenABE_SCHEME_PK_OPDH)
     return OpenABEKEY_PK_ENC;
   else if (algorithmID == OpenABE_SCHEME_CP_WATERS ||
-           algorithmID == OpenABE_SCHEME_CP_WATERS_CCA)
+           algorithmID == OpenABE_SCHEME_CP_WATERS_CCA ||
+           algorithmID == OpenABE_SCHEME_CP_FAME ||
+           algorithmID == OpenABE_SCHEME_CP_FAME_CCA ||
+           algorithmID == OpenABE_SCHEME_CP_WATERS_HCCA ||
+           algorithmID == OpenABE_SCHEME_CP_FAME_HCCA ||
+           algorithmID == OpenABE_SCHEME_CP_WATERS_FD ||
+           algorithmID == OpenABE_SCHEME_CP_WATERS_FD_CCA ||
+           algorithmID == OpenABE_SCHEME_CP_WATERS_FD_HCCA)
     return OpenABEKEY_CP_ENC;
   else if (algorithmID == OpenABE_SCHEME_KP_GPSW ||
-           algorithmID == OpenABE_SCHEME_KP_GPSW_CCA)
+           algorithmID == OpenABE_SCHEME_KP_GPSW_CCA ||
+           algorithmID == OpenABE_SCHEME_KP_GPSW_HCCA)
     return OpenABEKEY_KP_ENC;
-  else if (algorithmID == OpenABE_SCHEME_PKSIG_ECDSA)
+  else if (algorithmID == OpenABE_SCHEME_PKSIG_ECDSA ||
+           algorithmID == OpenABE_SCHEME_PKSIG_BLS)
     return OpenABEKEY_PK_SIG;
   else
     return OpenABEKEY_NONE;
@@ -54,10 +54,23 @@ namespace oabe {
  *
  */
 
-OpenABEKeystore::OpenABEKeystore(): ZObject()
+OpenABEKeystore::OpenABEKeystore(): ZObject(),
+    pubKeys(make_shared<const OpenABEKeyMap>()),
+    secKeys(make_shared<const OpenABEKeyMap>())
 {
 }
 
+// look up a key in a snapshot
+static shared_ptr<OpenABEKey>
+findKey(const shared_ptr<const map<string, shared_ptr<OpenABEKey>>>& keys,
+        const string& keyID) {
+    auto it = keys->find(keyID);
+    if (it != keys->end()) {
+        return it->second;
+    }
+    return nullptr;
+}
+
 /*!
  * Destructor for the OpenABECiphertext class.
  *
@@ -65,26 +78,21 @@ OpenABEKeystore::OpenABEKeystore(): ZObject()
 
 OpenABEKeystore::~OpenABEKeystore()
 {
-  std::map<std::string, shared_ptr<OpenABEKey>>::iterator iter;
-  for (iter = this->pubKeys.begin(); iter != this->pubKeys.end(); ++iter) {
-      // delete iter->second;
-      shared_ptr<OpenABEKey> key = iter->second;
-      if (key != nullptr) {
-          key->zeroize(); // securely zeroize the keys
-          key.reset(); // deletes the managed object
+  for (auto keys : { this->pubKeys, this->secKeys }) {
+      for (auto iter = keys->begin(); iter != keys->end(); ++iter) {
+          // securely zeroize the keys, unless they are shared with another
+          // context or the user key cache (the last owner does it then)
+          if (iter->second != nullptr && iter->second.use_count() == 1) {
+              iter->second->zeroize();
+          }
       }
   }
-  this->pubKeys.clear();
-
-  for (iter = this->secKeys.begin(); iter != this->secKeys.end(); ++iter) {
-      // delete iter->second;
-      shared_ptr<OpenABEKey> key = iter->second;
-      if (key != nullptr) {
-          key->zeroize(); // securely zeroize the keys
-          key.reset(); // deletes the managed object
+  for (auto& key : this->retiredKeys_) {
+      if (key.use_count() == 1) {
+          key->zeroize();
       }
   }
-  this->secKeys.clear();
+  this->retiredKeys_.clear();
 }
 
 /*!
@@ -97,14 +105,54 @@ OpenABEKeystore::~OpenABEKeystore()
 OpenABE_ERROR
 OpenABEKeystore::addKey(const string name, const shared_ptr<OpenABEKey>& component, zKeyType keyType)
 {
-    // Insert the key into the public or secret key maps
+    std::lock_guard<std::mutex> lock(this->writeLock_);
+    // Insert the key into a copy of the public or secret key map and
+    // publish it; readers of the old snapshot are unaffected
+    shared_ptr<const OpenABEKeyMap> *keys = nullptr;
     if (keyType == KEY_TYPE_PUBLIC) {
         // Public key/parameter
-        this->pubKeys[name] = component;
+        keys = &this->pubKeys;
     } else if (keyType == KEY_TYPE_SECRET){
         // Secret key/parameter
-        this->secKeys[name] = component;
+        keys = &this->secKeys;
+    } else {
+        return OpenABE_NOERROR;
+    }
+    shared_ptr<OpenABEKeyMap> next = make_shared<OpenABEKeyMap>(*atomic_load(keys));
+    (*next)[name] = component;
+    atomic_store(keys, shared_ptr<const OpenABEKeyMap>(next));
+    return OpenABE_NOERROR;
+}
+
+/*!
+ * Insert many keys into the keystore with one copy of the key map.
+ *
+ * @param Names of the keys
+ * @param Objects containing the keys, in the same order
+ */
+
+OpenABE_ERROR
+OpenABEKeystore::addKeys(const vector<string> &names,
+                         const vector<shared_ptr<OpenABEKey>> &components,
+                         zKeyType keyType)
+{
+    if (names.size() != components.size()) {
+        return OpenABE_ERROR_INVALID_INPUT;
     }
+    std::lock_guard<std::mutex> lock(this->writeLock_);
+    shared_ptr<const OpenABEKeyMap> *keys = nullptr;
+    if (keyType == KEY_TYPE_PUBLIC) {
+        keys = &this->pubKeys;
+    } else if (keyType == KEY_TYPE_SECRET){
+        keys = &this->secKeys;
+    } else {
+        return OpenABE_NOERROR;
+    }
+    shared_ptr<OpenABEKeyMap> next = make_shared<OpenABEKeyMap>(*atomic_load(keys));
+    for (size_t i = 0; i < names.size(); i++) {
+        (*next)[names[i]] = components[i];
+    }
+    atomic_store(keys, shared_ptr<const OpenABEKeyMap>(next));
     return OpenABE_NOERROR;
 }
 
@@ -121,12 +169,12 @@ OpenABEKeystore::getKey(const string keyID) {
     shared_ptr<OpenABEKey> result = nullptr;
 
     // Look in the public keys list
-    result = this->pubKeys[keyID];
+    result = findKey(atomic_load(&this->pubKeys), keyID);
     if (result != nullptr) {
         return result;
     }
     // Look in the secret keys list
-    result = this->secKeys[keyID];
+    result = findKey(atomic_load(&this->secKeys), keyID);
     if (result != nullptr) {
         return result;
     }
@@ -143,9 +191,7 @@ OpenABEKeystore::getKey(const string keyID) {
  */
 bool
 OpenABEKeystore::checkSecretKey(const string keyID) {
-    if(this->secKeys.count(keyID) != 0)
-        return true;
-    return false;
+    return (atomic_load(&this->secKeys)->count(keyID) != 0);
 }
 
 
@@ -158,15 +204,8 @@ OpenABEKeystore::checkSecretKey(const string keyID) {
 
 shared_ptr<OpenABEKey>
 OpenABEKeystore::getPublicKey(const string keyID) {
-    shared_ptr<OpenABEKey> result;
-
     // Look in the public keys list
-    result = this->pubKeys[keyID];
-    if (result != NULL) {
-        return result;
-    }
-    // Did not find the selected key
-    return nullptr;
+    return findKey(atomic_load(&this->pubKeys), keyID);
 }
 
 /*!
@@ -178,73 +217,78 @@ OpenABEKeystore::getPublicKey(const string keyID) {
 
 shared_ptr<OpenABEKey>
 OpenABEKeystore::getSecretKey(const string keyID) {
-    shared_ptr<OpenABEKey> result;
-
     // Look in the secret keys list
-    result = this->secKeys[keyID];
-    if (result != nullptr) {
-        return result;
-    }
-    // Did not find the selected key
-    return nullptr;
+    return findKey(atomic_load(&this->secKeys), keyID);
 }
 
-#if 0
 /*!
  * Retrieve references to secret key in the keystore.
  *
  * @return  A vector of key references
  */
 
-const vector<string>
-OpenABEKeystore::getSecretKeyIDs() const {
+vector<string>
+OpenABEKeystore::getSecretKeyIDs() {
     vector<string> keyRefs;
+    shared_ptr<const OpenABEKeyMap> keys = atomic_load(&this->secKeys);
 
-    std::map<std::string, shared_ptr<OpenABEKey>>::const_iterator iter;
-    for (iter = this->secKeys.begin(); iter != this->secKeys.end(); ++iter) {
+    for (auto iter = keys->begin(); iter != keys->end(); ++iter) {
         keyRefs.push_back(iter->first);
     }
     // list will be empty if no secret keys in the keystore
     return keyRefs;
 }
-#endif
 
 
 /*!
  * Delete a key from the keystore.
  *
  * @param[in] keyID     - Identifier of the key
- * @return              - An error code (OpenABE_ERROR_INVALID_KEY) or OpenABE_NOERROR
+ * @return              - OpenABE_NOERROR
  */
 
 OpenABE_ERROR
 OpenABEKeystore::deleteKey(const string keyID) {
-    // Find the key and destroy it
-    shared_ptr<OpenABEKey> key = this->getKey(keyID);
-    if (key != nullptr) {
-        key->zeroize();
-        bool foundInPubKey = false, foundInSecKey = false;
-        // Remove key/value from our internal store via the iterator
-        map<string, shared_ptr<OpenABEKey>>::iterator iter1 = this->pubKeys.find(keyID);
-        map<string, shared_ptr<OpenABEKey>>::iterator iter2 = this->secKeys.find(keyID);
-
-        if(iter1 != this->pubKeys.end()) {
-            this->pubKeys.erase(iter1);
-            foundInPubKey = true;
+    std::lock_guard<std::mutex> lock(this->writeLock_);
+    // Find the key and destroy it (deleting an unknown key is not an error)
+    for (auto keys : { &this->pubKeys, &this->secKeys }) {
+        shared_ptr<const OpenABEKeyMap> current = atomic_load(keys);
+        auto iter = current->find(keyID);
+        if (iter == current->end()) {
+            continue;
         }
-
-        if(iter2 != this->secKeys.end()) {
-            this->secKeys.erase(iter2);
-            foundInSecKey = true;
+        shared_ptr<OpenABEKey> key = iter->second;
+        // Remove key/value from a copy of the map and publish it
+        shared_ptr<OpenABEKeyMap> next = make_shared<OpenABEKeyMap>(*current);
+        next->erase(keyID);
+        atomic_store(keys, shared_ptr<const OpenABEKeyMap>(next));
+        if (key != nullptr) {
+            this->retiredKeys_.push_back(key);
         }
+    }
+    this->sweepRetiredKeys();
+    return OpenABE_NOERROR;
+}
 
-        // make sure key existed in one of two lists
-        // otherwise return an invalid key error
-        if(!foundInPubKey && !foundInSecKey) {
-            return OpenABE_ERROR_INVALID_KEY;
+/*!
+ * Zeroize the deleted keys nobody uses any more. A reader that looked a key
+ * up before it was removed may still be using it, so a deleted key waits
+ * in retiredKeys_ until that list holds the last reference (checked after
+ * every delete, and again when the keystore is destroyed).
+ * Must be called with writeLock_ held.
+ */
+
+void
+OpenABEKeystore::sweepRetiredKeys() {
+    auto it = this->retiredKeys_.begin();
+    while (it != this->retiredKeys_.end()) {
+        if (it->use_count() == 1) {
+            (*it)->zeroize();
+            it = this->retiredKeys_.erase(it);
+        } else {
+            ++it;
         }
     }
-    return OpenABE_NOERROR;
 }
 
 /*!
@@ -92,13 +92,12 @@ string OpenABESymKey::toString() { return this->m_keyData.toHex(); }
  */
 
 bool OpenABESymKey::hashToSymmetricKey(GT &input, uint32_t keyLen,
-                                   OpenABEHashFunctionType hashType) {
+                                   OpenABEHashFunctionType hashType,
+                                   OpenABEGTKDFVersion kdfVersion) {
   this->m_keyData.clear();
-  std::cerr << "[hashToSymmetricKey] Input GT: " << input << std::endl;
   // Hash the element into the key
-  bool result = OpenABEUtilsHashToString(input, keyLen, this->m_keyData, hashType);
-  std::cerr << "[hashToSymmetricKey] Output key (hex): " << this->m_keyData.toHex() << std::endl;
-  return result;
+  return OpenABEUtilsHashToString(input, keyLen, this->m_keyData, hashType,
+                                  kdfVersion);
 }
 
 bool OpenABESymKey::generateSymmetricKey(uint32_t keyLen) {
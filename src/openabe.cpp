@@ -35,7 +35,9 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <atomic>
 #include <iostream>
+#include <mutex>
 #include <string>
 #include <openabe/openabe.h>
 #include <openabe/openssl_init.h>
@@ -46,8 +48,10 @@ using namespace std;
  * Library global variables
  ********************************************************************************/
 
-// flag for the library initialization state
-OpenABE_STATE gLibraryState = OpenABE_STATE_UNINITIALIZED;
+// flag for the library initialization state; AssertLibInit reads it without
+// taking the lock, every transition happens under gLibraryLock
+std::atomic<OpenABE_STATE> gLibraryState(OpenABE_STATE_UNINITIALIZED);
+static std::mutex gLibraryLock;
 
 // flag for initializing openssl
 bool initializedOpenssl = false;
@@ -69,7 +73,9 @@ OpenABE_initialize(bool init_openssl) {
   OpenABE_ERROR result = OpenABE_ERROR_LIBRARY_NOT_INITIALIZED;
 
   // If the library is in a pre-initialized state, we can initialize it and go.
-  // Otherwise return an error.
+  // Otherwise return an error. Concurrent callers serialize here, so exactly
+  // one of them does the work.
+  std::lock_guard<std::mutex> guard(gLibraryLock);
   if (gLibraryState == OpenABE_STATE_UNINITIALIZED) {
 
     // Initialize the pairing library
@@ -83,12 +89,19 @@ OpenABE_initialize(bool init_openssl) {
     // Set the error file to stderr.
     // gErrorLog = new zErrorLog();
 
+    // Probe the CPU once, before any thread needs the result
+    OpenABE_getCpuFeatures();
+    OpenABE_TRACE_INFO("CPU features: %s", OpenABE_getCpuFeatureString().c_str());
+
     // Future library pre-processing, self-checks, etc. go here.
 
     // Set the library state to READY
     initializedOpenssl = init_openssl;
     gLibraryState = OpenABE_STATE_READY;
     result = OpenABE_NOERROR;
+  } else if (gLibraryState == OpenABE_STATE_READY) {
+    // already initialized (possibly by another thread)
+    result = OpenABE_NOERROR;
   }
 
   return result;
@@ -104,6 +117,7 @@ static OpenABE_ERROR
 OpenABE_shutdown() {
   OpenABE_ERROR result = OpenABE_NOERROR;
 
+  std::lock_guard<std::mutex> guard(gLibraryLock);
   // Shut down the pairing library
   result = zMathShutdownLibrary();
 
@@ -190,12 +204,24 @@ OpenABEContextABE *OpenABE_createContextABE(unique_ptr<OpenABERNG> *rng,
   switch (scheme_type) {
   case OpenABE_SCHEME_CP_WATERS:
   case OpenABE_SCHEME_CP_WATERS_CCA:  // CCA variant uses same base context
+  case OpenABE_SCHEME_CP_WATERS_HCCA:
     newContext = (OpenABEContextABE *)new OpenABEContextCPWaters(std::move(*rng));
     break;
   case OpenABE_SCHEME_KP_GPSW:
   case OpenABE_SCHEME_KP_GPSW_CCA:  // CCA variant uses same base context
+  case OpenABE_SCHEME_KP_GPSW_HCCA:
     newContext = (OpenABEContextABE *)new OpenABEContextKPGPSW(std::move(*rng));
     break;
+  case OpenABE_SCHEME_CP_FAME:
+  case OpenABE_SCHEME_CP_FAME_CCA:  // CCA variant uses same base context
+  case OpenABE_SCHEME_CP_FAME_HCCA:
+    newContext = (OpenABEContextABE *)new OpenABEContextCPFAME(std::move(*rng));
+    break;
+  case OpenABE_SCHEME_CP_WATERS_FD:
+  case OpenABE_SCHEME_CP_WATERS_FD_CCA:  // CCA variant uses same base context
+  case OpenABE_SCHEME_CP_WATERS_FD_HCCA:
+    newContext = (OpenABEContextABE *)new OpenABEContextCPWatersFD(std::move(*rng));
+    break;
   default:
     // gErrorLog.log("Could not instantiate unknown scheme type", __LINE__,
     // __FILE__);
@@ -214,7 +240,7 @@ OpenABEContextABE *OpenABE_createContextABE(unique_ptr<OpenABERNG> *rng,
 
 unique_ptr<OpenABEContextSchemeCPA>
 OpenABE_createContextABESchemeCPA(OpenABE_SCHEME scheme_type) {
-  unique_ptr<OpenABERNG> rng(new OpenABERNG);
+  unique_ptr<OpenABERNG> rng(new OpenABEThreadRNG);
   unique_ptr<OpenABEContextABE> kemContext(OpenABE_createContextABE(&rng, scheme_type));
   return unique_ptr<OpenABEContextSchemeCPA>(new OpenABEContextSchemeCPA(std::move(kemContext)));
 }
@@ -228,8 +254,17 @@ unique_ptr<OpenABEContextCCA> OpenABE_createABEContextForKEM(OpenABE_SCHEME sche
     // Return nullptr for error, not error code
     return nullptr;
   }
-  // create a CCA context (KEM version) based on the scheme context
-  kemContextCCA.reset(new OpenABEContextGenericCCA(std::move(schemeContext)));
+  // create a CCA context (KEM version) based on the scheme context: the
+  // hashed KEM-DEM transform for the *_HCCA scheme types, and the generic
+  // (re-encryption) transform otherwise
+  if (scheme_type == OpenABE_SCHEME_CP_WATERS_HCCA ||
+      scheme_type == OpenABE_SCHEME_KP_GPSW_HCCA ||
+      scheme_type == OpenABE_SCHEME_CP_FAME_HCCA ||
+      scheme_type == OpenABE_SCHEME_CP_WATERS_FD_HCCA) {
+    kemContextCCA.reset(new OpenABEContextHashedCCA(std::move(schemeContext)));
+  } else {
+    kemContextCCA.reset(new OpenABEContextGenericCCA(std::move(schemeContext)));
+  }
 
   return kemContextCCA;
 }
@@ -306,7 +341,7 @@ OpenABEContextPKE *OpenABE_createContextPKE(unique_ptr<OpenABERNG> *rng,
 unique_ptr<OpenABEContextSchemePKE>
 OpenABE_createContextPKESchemeCCA(OpenABE_SCHEME scheme_type) {
   // consruct an RNG object
-  unique_ptr<OpenABERNG> rng(new OpenABERNG);
+  unique_ptr<OpenABERNG> rng(new OpenABEThreadRNG);
   // create a KEM context for PKE given the RNG object
   unique_ptr<OpenABEContextPKE> pkeKEMContext(
       OpenABE_createContextPKE(&rng, scheme_type));
@@ -328,6 +363,29 @@ unique_ptr<OpenABEContextSchemePKSIG> OpenABE_createContextPKSIGScheme() {
       new OpenABEContextSchemePKSIG(std::move(pksig)));
 }
 
+/*!
+ * Create a PKSIG scheme context for a specific signature scheme.
+ *
+ * @param[in]   the scheme type (ECDSA or BLS)
+ * @return      A pointer to the PKSIG scheme context, or nullptr
+ */
+
+unique_ptr<OpenABEContextSchemePKSIG>
+OpenABE_createContextPKSIGScheme(OpenABE_SCHEME scheme_type) {
+  switch (scheme_type) {
+  case OpenABE_SCHEME_PKSIG_ECDSA:
+    return OpenABE_createContextPKSIGScheme();
+  case OpenABE_SCHEME_PKSIG_BLS: {
+    unique_ptr<OpenABERNG> rng(new OpenABEThreadRNG);
+    unique_ptr<OpenABEContextBLSSIG> bls(new OpenABEContextBLSSIG(std::move(rng)));
+    return unique_ptr<OpenABEContextSchemePKSIG>(
+        new OpenABEContextSchemePKSIG(std::move(bls)));
+  }
+  default:
+    return nullptr;
+  }
+}
+
 /*!
  * Return the OpenABE version.
  *
@@ -348,6 +406,8 @@ OpenABECurveID OpenABE_getCurveID(uint8_t id) {
   case OpenABE_NIST_P256_ID:
   case OpenABE_NIST_P384_ID:
   case OpenABE_NIST_P521_ID:
+  case OpenABE_X25519_ID:
+  case OpenABE_ED25519_ID:
   case OpenABE_BN_P158_ID:
   case OpenABE_BN_P254_ID:
   case OpenABE_BN_P256_ID:
@@ -409,12 +469,21 @@ OpenABE_SCHEME OpenABE_getSchemeID(uint8_t id) {
   switch (id) {
   case OpenABE_SCHEME_NONE:
   case OpenABE_SCHEME_PKSIG_ECDSA:
+  case OpenABE_SCHEME_PKSIG_BLS:
   case OpenABE_SCHEME_AES_GCM:
   case OpenABE_SCHEME_PK_OPDH:
   case OpenABE_SCHEME_CP_WATERS:
   case OpenABE_SCHEME_KP_GPSW:
   case OpenABE_SCHEME_CP_WATERS_CCA:
   case OpenABE_SCHEME_KP_GPSW_CCA:
+  case OpenABE_SCHEME_CP_FAME:
+  case OpenABE_SCHEME_CP_FAME_CCA:
+  case OpenABE_SCHEME_CP_WATERS_HCCA:
+  case OpenABE_SCHEME_KP_GPSW_HCCA:
+  case OpenABE_SCHEME_CP_FAME_HCCA:
+  case OpenABE_SCHEME_CP_WATERS_FD:
+  case OpenABE_SCHEME_CP_WATERS_FD_CCA:
+  case OpenABE_SCHEME_CP_WATERS_FD_HCCA:
     schemeID = (OpenABE_SCHEME)id;
     break;
   default:
@@ -433,6 +502,9 @@ const string OpenABE_convertSchemeIDToString(OpenABE_SCHEME id) {
   case OpenABE_SCHEME_PKSIG_ECDSA:
     scheme = OpenABE_EC_DSA;
     break;
+  case OpenABE_SCHEME_PKSIG_BLS:
+    scheme = OpenABE_BLS_SIG;
+    break;
   case OpenABE_SCHEME_PK_OPDH:
     scheme = OpenABE_PK_ENC;
     break;
@@ -444,6 +516,26 @@ const string OpenABE_convertSchemeIDToString(OpenABE_SCHEME id) {
   case OpenABE_SCHEME_KP_GPSW:
     scheme = OpenABE_KP_ABE;
     break;
+  case OpenABE_SCHEME_CP_FAME_CCA:
+  case OpenABE_SCHEME_CP_FAME:
+    scheme = OpenABE_CP_FAME;
+    break;
+  case OpenABE_SCHEME_CP_WATERS_HCCA:
+    scheme = OpenABE_CP_ABE_HCCA;
+    break;
+  case OpenABE_SCHEME_KP_GPSW_HCCA:
+    scheme = OpenABE_KP_ABE_HCCA;
+    break;
+  case OpenABE_SCHEME_CP_FAME_HCCA:
+    scheme = OpenABE_CP_FAME_HCCA;
+    break;
+  case OpenABE_SCHEME_CP_WATERS_FD_CCA:
+  case OpenABE_SCHEME_CP_WATERS_FD:
+    scheme = OpenABE_CP_ABE_FD;
+    break;
+  case OpenABE_SCHEME_CP_WATERS_FD_HCCA:
+    scheme = OpenABE_CP_ABE_FD_HCCA;
+    break;
   default:
     // Return error string for invalid scheme
     scheme = "Invalid Scheme";
@@ -455,12 +547,26 @@ const string OpenABE_convertSchemeIDToString(OpenABE_SCHEME id) {
 OpenABE_SCHEME OpenABE_convertStringToSchemeID(const string id) {
     if (id == OpenABE_EC_DSA) {
         return OpenABE_SCHEME_PKSIG_ECDSA;
+    } else if (id == OpenABE_BLS_SIG) {
+        return OpenABE_SCHEME_PKSIG_BLS;
     } else if (id == OpenABE_PK_ENC) {
         return OpenABE_SCHEME_PK_OPDH;
     } else if (id == OpenABE_CP_ABE) {
         return OpenABE_SCHEME_CP_WATERS;
     } else if (id == OpenABE_KP_ABE) {
         return OpenABE_SCHEME_KP_GPSW;
+    } else if (id == OpenABE_CP_FAME) {
+        return OpenABE_SCHEME_CP_FAME;
+    } else if (id == OpenABE_CP_ABE_HCCA) {
+        return OpenABE_SCHEME_CP_WATERS_HCCA;
+    } else if (id == OpenABE_KP_ABE_HCCA) {
+        return OpenABE_SCHEME_KP_GPSW_HCCA;
+    } else if (id == OpenABE_CP_FAME_HCCA) {
+        return OpenABE_SCHEME_CP_FAME_HCCA;
+    } else if (id == OpenABE_CP_ABE_FD) {
+        return OpenABE_SCHEME_CP_WATERS_FD;
+    } else if (id == OpenABE_CP_ABE_FD_HCCA) {
+        return OpenABE_SCHEME_CP_WATERS_FD_HCCA;
     } else {
         return OpenABE_SCHEME_NONE;
     }
@@ -477,6 +583,12 @@ string OpenABE_convertCurveIDToString(OpenABECurveID id) {
   case OpenABE_NIST_P521_ID:
     return "NIST_P521";
     break;
+  case OpenABE_X25519_ID:
+    return "X25519";
+    break;
+  case OpenABE_ED25519_ID:
+    return "ED25519";
+    break;
   case OpenABE_BN_P254_ID:
     return "BN_P254";
     break;
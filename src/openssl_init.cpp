@@ -58,7 +58,14 @@
 
 using namespace std;
 
-#ifndef __wasm__
+// OpenSSL 1.1.0 and later lock internally and seed their DRBG on first use;
+// the locking callbacks below are only installed for older releases, where
+// the library cannot be used from several threads without them.
+#if !defined(__wasm__) && OPENSSL_VERSION_NUMBER < 0x10100000L
+#define OABE_OPENSSL_LOCK_CALLBACKS
+#endif
+
+#ifdef OABE_OPENSSL_LOCK_CALLBACKS
 struct CRYPTO_dynlock_value {
     mutex the_mutex;
 };
@@ -93,14 +100,14 @@ static void dynlockDestroy(struct CRYPTO_dynlock_value* lock,
                            const char*, int) {
     delete lock;
 }
-#endif // __wasm__
+#endif // OABE_OPENSSL_LOCK_CALLBACKS
 
 void openSslInitialize() {
 #if defined(SSL_LIB_INIT) && !defined(__wasm__)
     SSL_library_init();
     SSL_load_error_strings();
 #endif
-#ifndef __wasm__
+#ifdef OABE_OPENSSL_LOCK_CALLBACKS
     // static locking
     mutexes.reset(new mutex[CRYPTO_num_locks()]);
     if (mutexes == nullptr) {
@@ -112,23 +119,29 @@ void openSslInitialize() {
     CRYPTO_set_dynlock_create_callback(dynlockCreate);
     CRYPTO_set_dynlock_lock_callback(dynlockLock);
     CRYPTO_set_dynlock_destroy_callback(dynlockDestroy);
-#endif // __wasm__
+#endif // OABE_OPENSSL_LOCK_CALLBACKS
 
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
     RAND_poll();
+#endif
 }
 
 void openSslCleanup() {
-#ifndef __wasm__
+#ifdef OABE_OPENSSL_LOCK_CALLBACKS
     // dynamic cleanup
     CRYPTO_set_dynlock_create_callback(nullptr);
     CRYPTO_set_dynlock_lock_callback(nullptr);
     CRYPTO_set_dynlock_destroy_callback(nullptr);
     // static cleanup
     CRYPTO_set_locking_callback(nullptr);
+#endif // OABE_OPENSSL_LOCK_CALLBACKS
+#ifndef __wasm__
     // library cleanup
     ERR_free_strings();
     EVP_cleanup();
     CRYPTO_cleanup_all_ex_data();
-    mutexes.reset();
 #endif // __wasm__
+#ifdef OABE_OPENSSL_LOCK_CALLBACKS
+    mutexes.reset();
+#endif
 }
@@ -0,0 +1,280 @@
+///
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+///
+/// This file is part of Zeutro's OpenABE.
+///
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+///
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+///
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+///
+/// \file   perf_check.cpp
+///
+/// \brief  Performance regression gate: runs a fixed, short set of ABE and
+///         pairing benchmarks and compares p50 latency and heap allocations
+///         per operation with the checked-in baseline of this platform.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <sys/utsname.h>
+#include <functional>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <openabe/openabe.h>
+#include <openabe/utils/zallochooks.h>
+#include <openabe/utils/zbenchmark.h>
+
+using namespace std;
+using namespace oabe;
+
+#define DEFAULT_REPETITIONS      30
+#define DEFAULT_WARMUP           5
+#define DEFAULT_TOLERANCE        0.25
+#define DEFAULT_ALLOC_TOLERANCE  0.10
+#define ATTRIBUTES               10
+#define BATCH                    8
+
+OpenABE_DEFINE_ALLOCATION_HOOKS
+
+struct CheckResult {
+  string name;
+  BenchmarkSummary summary;
+};
+
+static void measure(vector<CheckResult>& results, const string& name,
+                    const function<void()>& fn, int warmup, int reps)
+{
+  CheckResult r;
+  r.name = name;
+  r.summary = runTimedBenchmark(fn, warmup, reps);
+  results.push_back(r);
+  cout << "." << flush;
+}
+
+static void checkScheme(vector<CheckResult>& results, const string& scheme,
+                        int warmup, int reps)
+{
+  string attributes, policy;
+  for (int i = 0; i < ATTRIBUTES; i++) {
+    attributes += (i > 0 ? "|" : "") + string("Attr") + std::to_string(i);
+    policy += (i > 0 ? " and " : "") + string("Attr") + std::to_string(i);
+  }
+  const string& keyInput = (scheme == "CP-ABE") ? attributes : policy;
+  const string& encInput = (scheme == "CP-ABE") ? policy : attributes;
+
+  OpenABECryptoContext context(scheme);
+  context.generateParams();
+  context.keygen(keyInput, "user");
+  string ct, pt;
+  context.encrypt(encInput, "perf check plaintext", ct);
+
+  measure(results, scheme + "/keygen", [&]() {
+    context.keygen(keyInput, "tmp");
+    context.deleteKey("tmp");
+  }, warmup, reps);
+  measure(results, scheme + "/encrypt", [&]() {
+    string out;
+    context.encrypt(encInput, "perf check plaintext", out);
+  }, warmup, reps);
+  measure(results, scheme + "/decrypt", [&]() {
+    context.decrypt("user", ct, pt);
+  }, warmup, reps);
+}
+
+static void checkPairing(vector<CheckResult>& results, int warmup, int reps)
+{
+  OpenABERNG rng;
+  OpenABEPairing pairing(DEFAULT_BP_PARAM);
+  G1 g1 = pairing.randomG1(&rng);
+  G2 g2 = pairing.randomG2(&rng);
+  ZP z = pairing.randomZP(&rng);
+  vector<G1> bases1;
+  vector<G2> bases2;
+  vector<ZP> exps;
+  for (size_t i = 0; i < BATCH; i++) {
+    bases1.push_back(pairing.randomG1(&rng));
+    bases2.push_back(pairing.randomG2(&rng));
+    exps.push_back(pairing.randomZP(&rng));
+  }
+  GT out = pairing.initGT();
+  string batch = " n=" + std::to_string(BATCH);
+
+  measure(results, "zml/G1::exp", [&]() { g1.exp(z); }, warmup, reps);
+  measure(results, "zml/pairing", [&]() { pairing.pairing(g1, g2); }, warmup, reps);
+  measure(results, "zml/G1::multiExp" + batch, [&]() {
+    G1::multiExp(bases1, exps);
+  }, warmup, reps);
+  measure(results, "zml/multi_pairing" + batch, [&]() {
+    pairing.multi_pairing(out, bases1.data(), bases2.data(), BATCH);
+  }, warmup, reps);
+}
+
+static string platformName()
+{
+  struct utsname u;
+  if (uname(&u) != 0) {
+    return "unknown";
+  }
+  string name = string(u.sysname) + "-" + u.machine;
+  for (char& c : name) {
+    c = tolower(c);
+  }
+  return name;
+}
+
+static double change(double value, double baseline)
+{
+  return (baseline > 0) ? (value - baseline) / baseline : 0;
+}
+
+static void usage(const char *prog)
+{
+  cout << "OpenABE performance regression check, v" << (OpenABE_LIBRARY_VERSION / 100.) << endl;
+  cout << "Usage " << prog << ": [ -n repetitions ] [ -w warmup ] [ -b baseline-dir ] [ -p platform ]" << endl;
+  cout << "\t[ --tolerance fraction ] [ --alloc-tolerance fraction ] [ --report file ] [ --update ]" << endl;
+  cout << "\tbaseline: <baseline-dir>/<platform>.csv (default: perf-baselines/" << platformName() << ".csv)" << endl;
+  cout << "\ttolerance: allowed p50 slowdown (default: " << DEFAULT_TOLERANCE << ")" << endl;
+  cout << "\talloc-tolerance: allowed growth in allocations per operation (default: "
+       << DEFAULT_ALLOC_TOLERANCE << ")" << endl;
+  cout << "\t--update: write the measured results as the new baseline" << endl;
+  cout << "Exits with 2 when any operation regressed." << endl;
+}
+
+int main(int argc, const char *argv[])
+{
+  int reps = DEFAULT_REPETITIONS, warmup = DEFAULT_WARMUP;
+  double tolerance = DEFAULT_TOLERANCE, allocTolerance = DEFAULT_ALLOC_TOLERANCE;
+  string baselineDir = "perf-baselines", platform = platformName(), reportFile;
+  bool update = false;
+
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "-n" && i + 1 < argc) {
+      reps = atoi(argv[++i]);
+    } else if (arg == "-w" && i + 1 < argc) {
+      warmup = atoi(argv[++i]);
+    } else if (arg == "-b" && i + 1 < argc) {
+      baselineDir = argv[++i];
+    } else if (arg == "-p" && i + 1 < argc) {
+      platform = argv[++i];
+    } else if (arg == "--tolerance" && i + 1 < argc) {
+      tolerance = atof(argv[++i]);
+    } else if (arg == "--alloc-tolerance" && i + 1 < argc) {
+      allocTolerance = atof(argv[++i]);
+    } else if (arg == "--report" && i + 1 < argc) {
+      reportFile = argv[++i];
+    } else if (arg == "--update") {
+      update = true;
+    } else {
+      usage(argv[0]);
+      return -1;
+    }
+  }
+  if (reps < 1 || warmup < 0) {
+    usage(argv[0]);
+    return -1;
+  }
+  string baselineFile = baselineDir + "/" + platform + ".csv";
+
+  InitializeOpenABE();
+  // counts the allocations of each operation (see zallochooks.h)
+  OpenABE_setMetricsEnabled(true);
+  cout << "Running perf check on " << platform << " (" << OpenABE_getCpuFeatureString() << ")" << flush;
+  vector<CheckResult> results;
+  checkScheme(results, "CP-ABE", warmup, reps);
+  checkScheme(results, "KP-ABE", warmup, reps);
+  checkPairing(results, warmup, reps);
+  ShutdownOpenABE();
+  cout << endl;
+
+  if (update) {
+    ofstream out(baselineFile.c_str());
+    if (!out) {
+      cerr << "Could not write baseline: " << baselineFile << endl;
+      return 1;
+    }
+    out << "name,p50,allocs" << endl;
+    out << fixed << setprecision(4);
+    for (const CheckResult& r : results) {
+      out << r.name << "," << r.summary.p50 << "," << r.summary.allocations << endl;
+    }
+    cout << "Wrote baseline " << baselineFile << endl;
+    return 0;
+  }
+
+  BenchmarkBaseline latency, allocs;
+  bool haveBaseline = loadBenchmarkBaseline(baselineFile, latency) &&
+                      loadBenchmarkBaseline(baselineFile, allocs, "allocs");
+  if (!haveBaseline) {
+    cout << "No baseline for " << platform << " (" << baselineFile
+         << "); run with --update to record one" << endl;
+  }
+
+  int rc = 0;
+  ofstream report;
+  if (!reportFile.empty()) {
+    report.open(reportFile.c_str());
+    report << "name,baseline_p50,p50,p50_change,baseline_allocs,allocs,allocs_change,"
+              "peak_bytes,status" << endl;
+    report << fixed << setprecision(4);
+  }
+  cout << left << setw(28) << "operation" << right << setw(12) << "p50 (ms)" << setw(12)
+       << "baseline" << setw(10) << "change" << setw(10) << "allocs" << setw(10)
+       << "baseline" << setw(10) << "change" << "  status" << endl;
+  for (const CheckResult& r : results) {
+    auto lat = latency.find(r.name);
+    auto alloc = allocs.find(r.name);
+    string status = "new";
+    double baseP50 = 0, baseAllocs = 0;
+    if (lat != latency.end() && alloc != allocs.end()) {
+      baseP50 = lat->second;
+      baseAllocs = alloc->second;
+      // allocation counts are small integers, so allow at least one more
+      bool slower = isBenchmarkRegression(r.summary, baseP50, tolerance);
+      bool allocating = r.summary.allocations > baseAllocs * (1.0 + allocTolerance) &&
+                        r.summary.allocations >= baseAllocs + 1;
+      status = (slower || allocating) ? "REGRESSED" : "ok";
+      if (slower || allocating) {
+        rc = 2;
+      }
+    }
+    cout << left << setw(28) << r.name << right << fixed << setprecision(3)
+         << setw(12) << r.summary.p50 << setw(12) << baseP50 << setprecision(1)
+         << setw(9) << change(r.summary.p50, baseP50) * 100 << "%"
+         << setw(10) << r.summary.allocations << setw(10) << baseAllocs
+         << setw(9) << change(r.summary.allocations, baseAllocs) * 100 << "%" << "  " << status << endl;
+    if (report.is_open()) {
+      report << r.name << "," << baseP50 << "," << r.summary.p50 << ","
+             << change(r.summary.p50, baseP50) << "," << baseAllocs << ","
+             << r.summary.allocations << "," << change(r.summary.allocations, baseAllocs) << ","
+             << r.summary.peakBytes << "," << status << endl;
+    }
+  }
+  if (haveBaseline) {
+    cout << (rc == 0 ? "No regressions against " : "REGRESSION against ") << baselineFile << endl;
+  }
+  return rc;
+}
@@ -41,6 +41,9 @@
 
 using namespace std;
 
+// one wrapped data key in a multi-recipient ciphertext: IV || key || tag
+#define PKE_WRAPPED_KEY_LEN   (AES_BLOCK_SIZE + DEFAULT_SYM_KEY_BYTES + AES_BLOCK_SIZE)
+
 /********************************************************************************
  * Implementation of the OpenABEContextPKE class
  ********************************************************************************/
@@ -50,7 +53,9 @@ namespace oabe {
  * Constructor for the OpenABEContextPKE base class.
  *
  */
-OpenABEContextPKE::OpenABEContextPKE() : OpenABEContext() {}
+OpenABEContextPKE::OpenABEContextPKE() : OpenABEContext() {
+  this->m_X25519_ = false;
+}
 
 /*!
  * Destructor for the OpenABEContextPKE base class.
@@ -68,7 +73,12 @@ OpenABEContextPKE::~OpenABEContextPKE() {}
 OpenABE_ERROR
 OpenABEContextPKE::initializeCurve(const string groupParams) {
   OpenABE_ERROR result = OpenABE_NOERROR;
-  if (this->m_EllipticCurve_ != nullptr) {
+  if (this->isCurveSet()) {
+    return result;
+  }
+
+  if (groupParams == OpenABE_X25519_PARAMS) {
+    this->m_X25519_ = true;
     return result;
   }
 
@@ -81,6 +91,21 @@ OpenABEContextPKE::initializeCurve(const string groupParams) {
   return result;
 }
 
+/*!
+ * Return the identifier of the curve in use (OpenABE_NONE_ID if none is set).
+ *
+ * @return  The curve identifier.
+ */
+OpenABECurveID OpenABEContextPKE::getCurveID() {
+  if (this->m_X25519_) {
+    return OpenABE_X25519_ID;
+  }
+  if (this->getECCurve() == nullptr) {
+    return OpenABE_NONE_ID;
+  }
+  return this->getECCurve()->getCurveID();
+}
+
 /*!
  * Select the elliptic curve based on the given security level.
  *
@@ -157,23 +182,36 @@ OpenABEContextOPDH::generateDecryptionKey(const string &keyID, const string &pkI
   try {
     // Assert that the RNG has been set
     ASSERT_NOTNULL(myRNG);
+    ASSERT(this->isCurveSet(), OpenABE_ERROR_INVALID_GROUP_PARAMS);
     // generate a random UID for PK/SK
     myRNG->getRandomBytes(&uid, UID_LEN);
-    // select generator of the curve
-    G_t g = this->getECCurve()->getGenerator();
-    // generate static public and private keys
-    ZP_t a = this->getECCurve()->randomZP(myRNG);
-    // A = g ^ a
-    G_t A = g.exp(a);
 
     // initialize containers for the keys
-    PK.reset(new OpenABEKey(this->getECCurve()->getCurveID(), OpenABE_SCHEME_PK_OPDH,
+    PK.reset(new OpenABEKey(this->getCurveID(), OpenABE_SCHEME_PK_OPDH,
                         keyID, &uid));
-    SK.reset(new OpenABEKey(this->getECCurve()->getCurveID(), OpenABE_SCHEME_PK_OPDH,
+    SK.reset(new OpenABEKey(this->getCurveID(), OpenABE_SCHEME_PK_OPDH,
                         keyID, &uid));
 
-    PK->setComponent("A", &A);
-    SK->setComponent("a", &a);
+    if (this->isX25519()) {
+      // a <-$- {0,1}^256, A = X25519(a, 9)
+      OpenABEByteString a, A;
+      myRNG->getRandomBytes(&a, OpenABE_X25519_KEY_BYTES);
+      if (!OpenABE_X25519PublicKey(a, A)) {
+        a.zeroize();
+        throw OpenABE_ERROR_KEYGEN_FAILED;
+      }
+      PK->setComponent("A", &A);
+      SK->setComponent("a", &a);
+      a.zeroize();
+    } else {
+      // generate static public and private keys
+      ZP_t a = this->getECCurve()->randomZP(myRNG);
+      // A = g ^ a
+      G_t A = this->getECCurve()->expGenerator(a);
+
+      PK->setComponent("A", &A);
+      SK->setComponent("a", &a);
+    }
 
     // Add (MPK, MSK) to the keystore
     this->getKeystore()->addKey(pkID, PK, KEY_TYPE_PUBLIC);
@@ -186,6 +224,59 @@ OpenABEContextOPDH::generateDecryptionKey(const string &keyID, const string &pkI
   return result;
 }
 
+/*!
+ * Derive the KEM key from the shared x-coordinate Z using the
+ * metadata AlgID || ID_Sender || ID_Recipient. The pieces are hashed
+ * in place and the output lands directly in the key's buffer.
+ *
+ * @param[in]   the shared secret.
+ * @param[in]   UID of the sender.
+ * @param[in]   UID of the recipient.
+ * @param[in]   length of the symmetric key.
+ * @param[out]  symmetric key to be returned.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextOPDH::deriveKey(OpenABEByteString &Z, OpenABEByteString &senderID,
+                              OpenABEByteString &recipientID, uint32_t keyBitLen,
+                              const std::shared_ptr<OpenABESymKey> &key) {
+  const uint8_t algID = OpenABE_SCHEME_PK_OPDH;
+  const OpenABEKDFInput metadata[] = {
+    { &algID, 1 },
+    { senderID.data(), senderID.size() },
+    { recipientID.data(), recipientID.size() }
+  };
+  OpenABEByteString &keyBytes = key->getKeyBytes();
+  keyBytes.fillBuffer(0, keyBitLen / 8);
+
+  OpenABEKDF kdf;
+  OpenABE_ERROR result = kdf.DeriveKey(Z.data(), Z.size(), metadata, 3,
+                                       keyBytes.data(), keyBytes.size());
+  if (result != OpenABE_NOERROR) {
+    keyBytes.zeroize();
+  }
+  return result;
+}
+
+/*!
+ * Select an X25519 ephemeral private key e and store the ephemeral public
+ * key C = X25519(e, 9) in the ciphertext.
+ *
+ * @param[in]   random number generator.
+ * @param[out]  the ephemeral private key.
+ * @param[out]  PKE ciphertext to hold C.
+ */
+void OpenABEContextOPDH::generateEphemeralX25519(OpenABERNG *rng, OpenABEByteString &e,
+                                                 OpenABECiphertext *ciphertext) {
+  OpenABEByteString C;
+  rng->getRandomBytes(&e, OpenABE_X25519_KEY_BYTES);
+  if (!OpenABE_X25519PublicKey(e, C)) {
+    e.zeroize();
+    throw OpenABE_ERROR_ENCRYPTION_ERROR;
+  }
+  ciphertext->setComponent("C", &C);
+}
+
 /*!
  * Generate and encrypt a symmetric key using the key encapsulation mode
  * of the scheme. Return the key and ciphertext.
@@ -223,42 +314,144 @@ OpenABEContextOPDH::encryptKEM(OpenABERNG *rng, const string &pkID,
     if (PK == nullptr) {
       return OpenABE_ERROR_MISSING_RECEIVER_PUBLIC_KEY;
     }
-    // select generator of the curve
-    G_t g = this->getECCurve()->getGenerator();
-    // select ephemeral private keyL e <-$- ZP
-    ZP_t e = this->getECCurve()->randomZP(myRNG);
-    // compute ephemeral public key: C = g^e
-    G_t C = g.exp(e);
-    // store C in ciphertext
-    ciphertext->setComponent("C", &C);
-
-    // compute P = A ^ e => shared key: g^(a*e)
-    G_t *A = PK->getG_t("A");
-    ASSERT_NOTNULL(A);
-
-    G_t P = A->exp(e);
-    ZP_t x, y;
-    P.get(x, y);
-    OpenABEByteString Z = x.getByteString();
-
-    // compute the metadata
-    OpenABEByteString kdfMetadata;
+    OpenABEByteString Z;
+    if (this->isX25519()) {
+      // Z = X25519(e, A) for the ephemeral e of C = X25519(e, 9)
+      OpenABEByteString *A = PK->getByteString("A");
+      ASSERT_NOTNULL(A);
+      OpenABEByteString e;
+      this->generateEphemeralX25519(myRNG, e, ciphertext);
+      bool ok = OpenABE_X25519SharedSecret(e, *A, Z);
+      e.zeroize();
+      ASSERT(ok, OpenABE_ERROR_ENCRYPTION_ERROR);
+    } else {
+      // select ephemeral private keyL e <-$- ZP
+      ZP_t e = this->getECCurve()->randomZP(myRNG);
+      // compute ephemeral public key: C = g^e
+      G_t C = this->getECCurve()->expGenerator(e);
+      // store C in ciphertext
+      ciphertext->setComponent("C", &C);
+
+      // compute P = A ^ e => shared key: g^(a*e)
+      G_t *A = PK->getG_t("A");
+      ASSERT_NOTNULL(A);
+
+      G_t P = A->exp(e);
+      ZP_t x, y;
+      P.get(x, y);
+      Z = x.getByteString();
+    }
+
+    // derive the key directly into the key buffer
     // kdf_metadata required: AlgID || ID_Sender || ID_Recipient
-    kdfMetadata.insertFirstByte(OpenABE_SCHEME_PK_OPDH);
-    kdfMetadata = kdfMetadata + *senderID + PK->getUID();
-
-    unique_ptr<OpenABEKDF> kdf(new OpenABEKDF);
-    OpenABEByteString DerivedKeyMaterial =
-        kdf->DeriveKey(Z, keyBitLen, kdfMetadata);
-    // return the derived key material
-    key->setSymmetricKey(DerivedKeyMaterial);
+    result = this->deriveKey(Z, *senderID, PK->getUID(), keyBitLen, key);
+    Z.zeroize();
+    if (result != OpenABE_NOERROR) {
+      return result;
+    }
+    // set the ciphertext header (curve ID, scheme ID, etc)
+    ciphertext->setHeader(this->getCurveID(), OpenABE_SCHEME_PK_OPDH, myRNG);
+  } catch (OpenABE_ERROR &err) {
+    result = err;
+  }
+
+  return result;
+}
+
+/*!
+ * Generate one ephemeral key pair and derive a symmetric key for each of
+ * several recipients from it. The ciphertext carries the single ephemeral
+ * public key C = g^e; keys[i] comes out the same as a decryptKEM by the
+ * i-th recipient would derive. The per-recipient A_i^e and key derivations
+ * run on the library thread pool.
+ *
+ * @param[in]   random number generator to use during encryption (it is optional: could be set to NULL here).
+ * @param[in]	public key identifiers in keystore for the recipients (assumes they're already in keystore).
+ * @param[in]   UID of the sender (NULL: each recipient's own UID).
+ * @param[in]   length of the symmetric keys.
+ * @param[out]  symmetric keys to be returned, one per recipient.
+ * @param[out]	PKE ciphertext (must be allocated).
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextOPDH::encryptKEMMulti(OpenABERNG *rng, const vector<string> &pkIDs,
+                                OpenABEByteString *senderID, uint32_t keyBitLen,
+                                vector<shared_ptr<OpenABESymKey>> &keys,
+                                OpenABECiphertext *ciphertext) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  OpenABERNG *myRNG = this->getRNG();
+
+  try {
+    ASSERT_NOTNULL(ciphertext);
+    ASSERT(!pkIDs.empty(), OpenABE_ERROR_INVALID_INPUT);
+    if (rng != nullptr) {
+      myRNG = rng;
+    }
+    ASSERT_NOTNULL(myRNG);
+    // load every recipient's public key before doing any work
+    vector<shared_ptr<OpenABEKey>> PKs(pkIDs.size());
+    for (size_t i = 0; i < pkIDs.size(); i++) {
+      PKs[i] = this->getKeystore()->getPublicKey(pkIDs[i]);
+      if (PKs[i] == nullptr) {
+        return OpenABE_ERROR_MISSING_RECEIVER_PUBLIC_KEY;
+      }
+      if (this->isX25519()) {
+        ASSERT_NOTNULL(PKs[i]->getByteString("A"));
+      } else {
+        ASSERT_NOTNULL(PKs[i]->getG_t("A"));
+      }
+    }
+    // one ephemeral key e and C = g^e for all recipients
+    OpenABEByteString e25519;
+    ZP_t e;
+    if (this->isX25519()) {
+      this->generateEphemeralX25519(myRNG, e25519, ciphertext);
+    } else {
+      e = this->getECCurve()->randomZP(myRNG);
+      G_t C = this->getECCurve()->expGenerator(e);
+      ciphertext->setComponent("C", &C);
+    }
+
+    keys.resize(pkIDs.size());
+    vector<OpenABE_ERROR> status(pkIDs.size(), OpenABE_NOERROR);
+    OpenABEThreadPool::getDefault()->parallelFor(pkIDs.size(), [&](size_t i) {
+      try {
+        OpenABEByteString Z;
+        if (this->isX25519()) {
+          OpenABEByteString ei = e25519;
+          bool ok = OpenABE_X25519SharedSecret(ei, *PKs[i]->getByteString("A"), Z);
+          ei.zeroize();
+          ASSERT(ok, OpenABE_ERROR_ENCRYPTION_ERROR);
+        } else {
+          ZP_t ei = e;
+          G_t P = PKs[i]->getG_t("A")->exp(ei);
+          ZP_t x, y;
+          P.get(x, y);
+          Z = x.getByteString();
+        }
+        OpenABEByteString &recipientID = PKs[i]->getUID();
+        keys[i].reset(new OpenABESymKey);
+        // kdf_metadata required: AlgID || ID_Sender || ID_Recipient
+        status[i] = this->deriveKey(Z, (senderID != nullptr) ? *senderID : recipientID,
+                                    recipientID, keyBitLen, keys[i]);
+        Z.zeroize();
+      } catch (OpenABE_ERROR &error) {
+        status[i] = error;
+      }
+    });
+    e25519.zeroize();
+    for (size_t i = 0; i < status.size(); i++) {
+      if (status[i] != OpenABE_NOERROR) {
+        for (auto &key : keys) {
+          if (key != nullptr) {
+            key->zeroize();
+          }
+        }
+        return status[i];
+      }
+    }
     // set the ciphertext header (curve ID, scheme ID, etc)
-    ciphertext->setHeader(this->getECCurve()->getCurveID(), OpenABE_SCHEME_PK_OPDH,
-                          myRNG);
-    // clear memory
-    DerivedKeyMaterial.zeroize();
-    kdfMetadata.clear();
-    Z.clear();
+    ciphertext->setHeader(this->getCurveID(), OpenABE_SCHEME_PK_OPDH, myRNG);
   } catch (OpenABE_ERROR &err) {
     result = err;
   }
@@ -283,9 +476,6 @@ OpenABEContextOPDH::decryptKEM(const string &pkID, const string &skID,
   OpenABE_ERROR result = OpenABE_NOERROR;
   shared_ptr<OpenABEKey> SK = nullptr, PK = nullptr;
   OpenABEByteString senderID;
-  unique_ptr<OpenABEKDF> kdf = nullptr;
-  // compute the metadata
-  OpenABEByteString kdfMetadata;
   try {
     // check inputs
     ASSERT_NOTNULL(ciphertext);
@@ -306,30 +496,27 @@ OpenABEContextOPDH::decryptKEM(const string &pkID, const string &skID,
 
     // compute C ^ (recipient's private key)
     // to obtain the shared key
-    G_t *C = ciphertext->getG_t("C");
-    ASSERT_NOTNULL(C);
-    ZP_t *a = SK->getZP_t("a");
-    ASSERT_NOTNULL(a);
-    G_t P = C->exp(*a);
-    // extract x-coordinate from group element P
-    ZP_t x, y;
-    P.get(x, y);
-    OpenABEByteString Z = x.getByteString();
+    OpenABEByteString Z;
+    if (this->isX25519()) {
+      OpenABEByteString *C = ciphertext->getByteString("C");
+      ASSERT_NOTNULL(C);
+      OpenABEByteString *a = SK->getByteString("a");
+      ASSERT_NOTNULL(a);
+      ASSERT(OpenABE_X25519SharedSecret(*a, *C, Z), OpenABE_ERROR_DECRYPTION_FAILED);
+    } else {
+      G_t *C = ciphertext->getG_t("C");
+      ASSERT_NOTNULL(C);
+      ZP_t *a = SK->getZP_t("a");
+      ASSERT_NOTNULL(a);
+      G_t P = C->exp(*a);
+      // extract x-coordinate from group element P
+      ZP_t x, y;
+      P.get(x, y);
+      Z = x.getByteString();
+    }
 
     // kdf_metadata required: AlgID || ID_Sender || ID_Recipient
-    kdfMetadata.insertFirstByte(OpenABE_SCHEME_PK_OPDH);
-    kdfMetadata = kdfMetadata + senderID + SK->getUID();
-
-    kdf.reset(new OpenABEKDF);
-    OpenABEByteString DerivedKeyMaterial =
-        kdf->DeriveKey(Z, keyBitLen, kdfMetadata);
-
-    // return the derived key material
-    key->setSymmetricKey(DerivedKeyMaterial);
-
-    // clear memory
-    DerivedKeyMaterial.zeroize();
-    kdfMetadata.zeroize();
+    result = this->deriveKey(Z, senderID, SK->getUID(), keyBitLen, key);
     Z.zeroize();
 
   } catch (OpenABE_ERROR &err) {
@@ -348,6 +535,12 @@ OpenABEContextOPDH::decryptKEM(const string &pkID, const string &skID,
  */
 bool OpenABEContextOPDH::validatePublicKey(const std::shared_ptr<OpenABEKey> &key) {
   ASSERT_NOTNULL(key);
+  if (this->isX25519()) {
+    // every 32-byte string is an X25519 public key; the small-order ones
+    // are rejected when a shared secret is computed
+    OpenABEByteString *A = key->getByteString("A");
+    return (A != nullptr && A->size() == OpenABE_X25519_KEY_BYTES);
+  }
   G_t *A = key->getG_t("A");
   /* make sure element exists in OpenABEKey structure */
   ASSERT_NOTNULL(A);
@@ -400,6 +593,10 @@ bool OpenABEContextOPDH::validatePublicKey(const std::shared_ptr<OpenABEKey> &ke
  */
 bool OpenABEContextOPDH::validatePrivateKey(const std::shared_ptr<OpenABEKey> &key) {
   ASSERT_NOTNULL(key);
+  if (this->isX25519()) {
+    OpenABEByteString *a = key->getByteString("a");
+    return (a != nullptr && a->size() == OpenABE_X25519_KEY_BYTES);
+  }
   ZP_t *a = key->getZP_t("a");
   ASSERT_NOTNULL(a);
   /* retrieve the order of the EC points */
@@ -512,19 +709,21 @@ OpenABEContextSchemePKE::loadPublicKey(const string &keyID, OpenABEByteString &k
     }
 
     // Initialize the curve if ec parameters are not set
-    if (this->m_KEM_->getECCurve() == nullptr) {
+    if (!this->m_KEM_->isCurveSet()) {
       // Set parameters based on the PK's curve ID
       this->m_KEM_->initializeCurve(
           OpenABE_convertECCurveIDToString(PK->getCurveID()));
     }
 
-    if (PK->getCurveID() != this->m_KEM_->getECCurve()->getCurveID() ||
+    if (PK->getCurveID() != this->m_KEM_->getCurveID() ||
         PK->getAlgorithmID() != this->m_KEM_->getAlgorithmID()) {
       return OpenABE_ERROR_INVALID_KEY_HEADER;
     }
 
     // Now we can deserialize the body of the key
-    PK->setGroup(this->m_KEM_->getECCurve()->getGroup());
+    if (this->m_KEM_->getECCurve() != nullptr) {
+      PK->setGroup(this->m_KEM_->getECCurve()->getGroup());
+    }
     PK->loadKeyFromBytes(outputKeyBytes);
 
     // Perform validation on the public OpenABEKey structure
@@ -564,19 +763,21 @@ OpenABEContextSchemePKE::loadPrivateKey(const string &keyID, OpenABEByteString &
       return OpenABE_ERROR_INVALID_INPUT;
     }
     // Initialize the curve if ec parameters are not set
-    if (this->m_KEM_->getECCurve() == nullptr) {
+    if (!this->m_KEM_->isCurveSet()) {
       // Set parameters based on the PK's curve ID
       this->m_KEM_->initializeCurve(
           OpenABE_convertECCurveIDToString(SK->getCurveID()));
     }
 
-    if (SK->getCurveID() != this->m_KEM_->getECCurve()->getCurveID() ||
+    if (SK->getCurveID() != this->m_KEM_->getCurveID() ||
         SK->getAlgorithmID() != this->m_KEM_->getAlgorithmID()) {
       return OpenABE_ERROR_INVALID_KEY_HEADER;
     }
 
     // Now we can deserialize the body of the key
-    SK->setGroup(this->m_KEM_->getECCurve()->getGroup());
+    if (this->m_KEM_->getECCurve() != nullptr) {
+      SK->setGroup(this->m_KEM_->getECCurve()->getGroup());
+    }
     SK->loadKeyFromBytes(outputKeyBytes);
     // Perform validation on the private OpenABEKey
     if (this->m_KEM_->validatePrivateKey(SK)) {
@@ -620,15 +821,152 @@ OpenABEContextSchemePKE::encrypt(OpenABERNG *rng, const string &pkID,
                              const string &senderpkID, const string &plaintext,
                              OpenABECiphertext *ciphertext) {
   OpenABE_ERROR result = OpenABE_NOERROR;
-  shared_ptr<OpenABEKey> senderPK = nullptr;
-  OpenABEByteString senderID, keyBytes, ctHdr, iv, ct, tag;
   shared_ptr<OpenABESymKey> key(new OpenABESymKey);
-  unique_ptr<oabe::crypto::OpenABESymKeyAuthEnc> authEnc = nullptr;
 
+  // make sure plaintext size > 0
+  if (plaintext.size() == 0) {
+    return OpenABE_ERROR_NO_PLAINTEXT_SPECIFIED;
+  }
+  if ((result = this->encapsulate(rng, pkID, senderpkID, key, ciphertext)) != OpenABE_NOERROR) {
+    key->zeroize();
+    return result;
+  }
+  return this->seal(key, (const uint8_t *)plaintext.data(), plaintext.size(), ciphertext);
+}
+
+/*!
+ * Encrypt the plaintext once for several recipients. A random data key
+ * seals the payload with AES-GCM; it is wrapped (AES-GCM, with the
+ * ciphertext header as AAD) under every recipient's KEM key, which all
+ * come from one ephemeral key. The wrapped keys are stored in recipient
+ * order under "Wraps". decrypt handles the result.
+ *
+ * @param[in]   random number generator to use during encryption (it is optional: could be set to NULL here).
+ * @param[in]	public key identifiers in keystore for the recipients (assumes they're already in keystore).
+ * @param[in]   public key UID for sender (empty: each recipient's own).
+ * @param[in]   the plaintext.
+ * @param[out]	PKE ciphertext (must be allocated).
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemePKE::encryptMulti(OpenABERNG *rng, const vector<string> &pkIDs,
+                                  const string &senderpkID, const string &plaintext,
+                                  OpenABECiphertext *ciphertext) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  vector<shared_ptr<OpenABESymKey>> keks;
+  shared_ptr<OpenABESymKey> dataKey(new OpenABESymKey);
+  OpenABEByteString senderID, ctHdr, wraps;
+
+  if (plaintext.size() == 0) {
+    return OpenABE_ERROR_NO_PLAINTEXT_SPECIFIED;
+  }
   try {
     ASSERT_NOTNULL(ciphertext);
-    // make sure plaintext size > 0
-    ASSERT(plaintext.size() > 0, OpenABE_ERROR_NO_PLAINTEXT_SPECIFIED);
+    if (!senderpkID.empty()) {
+      shared_ptr<OpenABEKey> senderPK = this->m_KEM_->getKeystore()->getPublicKey(senderpkID);
+      if (senderPK == nullptr) {
+        return OpenABE_ERROR_MISSING_SENDER_PUBLIC_KEY;
+      }
+      senderID = senderPK->getUID();
+    }
+    result = this->m_KEM_->encryptKEMMulti(rng, pkIDs,
+                                           senderpkID.empty() ? nullptr : &senderID,
+                                           DEFAULT_SYM_KEY_BITS, keks, ciphertext);
+    ASSERT(result == OpenABE_NOERROR, result);
+
+    // wrap one data key under each recipient's key
+    dataKey->generateSymmetricKey(DEFAULT_SYM_KEY_BYTES);
+    OpenABEByteString &dataKeyBytes = dataKey->getKeyBytes();
+    ciphertext->getHeader(ctHdr);
+    wraps.fillBuffer(0, keks.size() * PKE_WRAPPED_KEY_LEN);
+    vector<OpenABE_ERROR> status(keks.size(), OpenABE_NOERROR);
+    OpenABEThreadPool::getDefault()->parallelFor(keks.size(), [&](size_t i) {
+      OpenABEByteString kekBytes = keks[i]->getKeyBytes();
+      oabe::crypto::OpenABESymKeyAuthEnc authEnc(DEFAULT_AES_SEC_LEVEL, kekBytes);
+      authEnc.setAddAuthData(ctHdr.getInternalPtr(), ctHdr.size());
+      uint8_t *slot = wraps.getInternalPtr() + i * PKE_WRAPPED_KEY_LEN;
+      status[i] = authEnc.encrypt(dataKeyBytes.data(), dataKeyBytes.size(), slot,
+                                  slot + AES_BLOCK_SIZE,
+                                  slot + AES_BLOCK_SIZE + DEFAULT_SYM_KEY_BYTES);
+      kekBytes.zeroize();
+      keks[i]->zeroize();
+    });
+    for (size_t i = 0; i < status.size(); i++) {
+      ASSERT(status[i] == OpenABE_NOERROR, status[i]);
+    }
+    ciphertext->setComponent("Wraps", &wraps);
+  } catch (OpenABE_ERROR &error) {
+    result = error;
+  }
+
+  for (auto &kek : keks) {
+    kek->zeroize();
+  }
+  if (result != OpenABE_NOERROR) {
+    dataKey->zeroize();
+    return result;
+  }
+  // the payload is encrypted once, under the data key
+  return this->seal(dataKey, (const uint8_t *)plaintext.data(), plaintext.size(), ciphertext);
+}
+
+/*!
+ * Find the data key of a multi-recipient ciphertext: the recipient's KEM
+ * key opens exactly one of the wrapped keys.
+ *
+ * @param[in]   the recipient's KEM key (replaced by the data key).
+ * @param[in]   the wrapped keys.
+ * @param[in]   the ciphertext header (the AAD of each wrap).
+ * @return  true if one of the wrapped keys opened.
+ */
+static bool unwrapDataKey(const shared_ptr<OpenABESymKey> &key, OpenABEByteString &wraps,
+                          OpenABEByteString &ctHdr) {
+  if (wraps.size() == 0 || wraps.size() % PKE_WRAPPED_KEY_LEN != 0) {
+    return false;
+  }
+  OpenABEByteString kekBytes = key->getKeyBytes(), dataKeyBytes;
+  oabe::crypto::OpenABESymKeyAuthEnc authEnc(DEFAULT_AES_SEC_LEVEL, kekBytes);
+  authEnc.setAddAuthData(ctHdr.getInternalPtr(), ctHdr.size());
+  dataKeyBytes.fillBuffer(0, DEFAULT_SYM_KEY_BYTES);
+  bool found = false;
+  for (size_t off = 0; off < wraps.size() && !found; off += PKE_WRAPPED_KEY_LEN) {
+    const uint8_t *slot = wraps.data() + off;
+    found = authEnc.decrypt(dataKeyBytes.getInternalPtr(), slot + AES_BLOCK_SIZE,
+                            DEFAULT_SYM_KEY_BYTES, slot, AES_BLOCK_SIZE,
+                            slot + AES_BLOCK_SIZE + DEFAULT_SYM_KEY_BYTES);
+  }
+  kekBytes.zeroize();
+  key->zeroize();
+  if (found) {
+    key->setSymmetricKey(dataKeyBytes);
+  }
+  dataKeyBytes.zeroize();
+  return found;
+}
+
+/*!
+ * Generate and encrypt a symmetric key using the key encapsulation mode
+ * of the underlying scheme (the first half of encrypt).
+ *
+ * @param[in]   random number generator to use during encryption (it is optional: could be set to NULL here).
+ * @param[in]	public key identifier in keystore for the recipient (assumes it's already in keystore).
+ * @param[in]   public key UID for sender.
+ * @param[out]  the derived symmetric key.
+ * @param[out]	PKE ciphertext (must be allocated).
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemePKE::encapsulate(OpenABERNG *rng, const string &pkID,
+                                 const string &senderpkID,
+                                 const shared_ptr<OpenABESymKey> &key,
+                                 OpenABECiphertext *ciphertext) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  shared_ptr<OpenABEKey> senderPK = nullptr;
+  OpenABEByteString senderID;
+
+  try {
+    ASSERT_NOTNULL(ciphertext);
+    ASSERT_NOTNULL(key);
 
     // Get PK of sender (assumes it has already been loaded)
     senderPK = this->m_KEM_->getKeystore()->getPublicKey(senderpkID);
@@ -639,8 +977,36 @@ OpenABEContextSchemePKE::encrypt(OpenABERNG *rng, const string &pkID,
     // Returns a ciphertext and a symmetric key
     result = this->m_KEM_->encryptKEM(rng, pkID, &senderID,
                                       DEFAULT_SYM_KEY_BITS, key, ciphertext);
-    // Propagate errors from encryptKEM
-    ASSERT(result == OpenABE_NOERROR, result);
+  } catch (OpenABE_ERROR &error) {
+    result = error;
+  }
+
+  return result;
+}
+
+/*!
+ * Encrypt the payload with AES-GCM under a key from encapsulate (the
+ * second half of encrypt). The ciphertext header is the AAD. The key is
+ * zeroized in all cases.
+ *
+ * @param[in]   the symmetric key.
+ * @param[in]   the plaintext and its length (at least one byte).
+ * @param[out]	PKE ciphertext filled by encapsulate.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextSchemePKE::seal(const shared_ptr<OpenABESymKey> &key,
+                          const uint8_t *plaintext, size_t plaintextLen,
+                          OpenABECiphertext *ciphertext) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  OpenABEByteString keyBytes, ctHdr, iv, ct, tag;
+  unique_ptr<oabe::crypto::OpenABESymKeyAuthEnc> authEnc = nullptr;
+
+  try {
+    ASSERT_NOTNULL(key);
+    ASSERT_NOTNULL(ciphertext);
+    // make sure plaintext size > 0
+    ASSERT(plaintext != nullptr && plaintextLen > 0, OpenABE_ERROR_NO_PLAINTEXT_SPECIFIED);
 
     // Instantiate an auth enc scheme with the symmetric key
     keyBytes = key->getKeyBytes();
@@ -651,7 +1017,12 @@ OpenABEContextSchemePKE::encrypt(OpenABERNG *rng, const string &pkID,
     // Embed the header of the ciphertext as AAD
     authEnc->setAddAuthData(ctHdr);
     // Encrypt
-    authEnc->encrypt(plaintext, &iv, &ct, &tag);
+    iv.resize(AES_BLOCK_SIZE);
+    ct.resize(plaintextLen);
+    tag.resize(AES_BLOCK_SIZE);
+    result = authEnc->encrypt(plaintext, plaintextLen, iv.getInternalPtr(),
+                              ct.getInternalPtr(), tag.getInternalPtr());
+    ASSERT(result == OpenABE_NOERROR, result);
     // Store symmetric ciphertext
     ciphertext->setComponent("IV", &iv);
     ciphertext->setComponent("CT", &ct);
@@ -660,7 +1031,9 @@ OpenABEContextSchemePKE::encrypt(OpenABERNG *rng, const string &pkID,
     result = error;
   }
 
-  key->zeroize();
+  if (key != nullptr) {
+    key->zeroize();
+  }
   keyBytes.zeroize();
   return result;
 }
@@ -693,6 +1066,13 @@ OpenABEContextSchemePKE::decrypt(const string &pkID, const string &skID,
                                       DEFAULT_SYM_KEY_BITS, key);
     // propagate errors from decryptKEM
     ASSERT(result == OpenABE_NOERROR, result);
+    // embed the header of the ciphertext
+    ciphertext->getHeader(ctHdr);
+    // a multi-recipient ciphertext: the KEM key wraps the data key
+    if (ciphertext->hasComponent("Wraps") &&
+        !unwrapDataKey(key, *ciphertext->getByteString("Wraps"), ctHdr)) {
+      return OpenABE_ERROR_DECRYPTION_FAILED;
+    }
 
     // construct the 'ct' structure from ciphertext then decrypt
     iv = ciphertext->getByteString("IV");
@@ -706,8 +1086,6 @@ OpenABEContextSchemePKE::decrypt(const string &pkID, const string &skID,
     keyBytes = key->getKeyBytes();
     authEnc.reset(
         new oabe::crypto::OpenABESymKeyAuthEnc(DEFAULT_AES_SEC_LEVEL, keyBytes));
-    // embed the header of the ciphertext
-    ciphertext->getHeader(ctHdr);
     // embed the header of the ciphertext as AAD
     authEnc->setAddAuthData(ctHdr);
 
@@ -36,6 +36,7 @@
 #include <stdlib.h>
 #include <iostream>
 #include <fstream>
+#include <map>
 #include <string>
 #include <openabe/openabe.h>
 
@@ -54,6 +55,8 @@ static uint8_t getCurveID(const std::string &groupParams) {
         return OpenABE_NIST_P384_ID;
     } else if (groupParams == "NIST_P521" || groupParams == "secp521r1") {
         return OpenABE_NIST_P521_ID;
+    } else if (groupParams == "ED25519" || groupParams == "Ed25519") {
+        return OpenABE_ED25519_ID;
     } else if (groupParams == "secp256k1") {
         // MCL secp256k1 - map to P256 ID for now
         // The actual backend selection is done by compile-time flags
@@ -170,6 +173,15 @@ OpenABEContextPKSIG::keygen(const std::string &pkID, const std::string &skID) {
 
 OpenABE_ERROR
 OpenABEContextPKSIG::sign(OpenABEPKey *privKey, OpenABEByteString *message, OpenABEByteString *signature) {
+    if (message == nullptr) {
+        return OpenABE_ERROR_INVALID_INPUT;
+    }
+    return this->sign(privKey, message->getInternalPtr(), message->size(), signature);
+}
+
+OpenABE_ERROR
+OpenABEContextPKSIG::sign(OpenABEPKey *privKey, const uint8_t *message, size_t messageLen,
+                          OpenABEByteString *signature) {
     OpenABE_ERROR result = OpenABE_NOERROR;
     uint8_t sig_buf[512];  // Should be large enough for any supported curve
     size_t sig_len = 0;
@@ -183,8 +195,7 @@ OpenABEContextPKSIG::sign(OpenABEPKey *privKey, OpenABEByteString *message, Open
         ASSERT_NOTNULL(keypair);
 
         // Sign the message using the ECDSA abstraction
-        sig_len = ecdsa_sign(keypair,
-                             message->getInternalPtr(), message->size(),
+        sig_len = ecdsa_sign(keypair, message, messageLen,
                              sig_buf, sizeof(sig_buf));
 
         if (sig_len == 0) {
@@ -204,6 +215,16 @@ OpenABEContextPKSIG::sign(OpenABEPKey *privKey, OpenABEByteString *message, Open
 
 OpenABE_ERROR
 OpenABEContextPKSIG::verify(OpenABEPKey *pubKey, OpenABEByteString *message, OpenABEByteString *signature) {
+    if (message == nullptr || signature == nullptr) {
+        return OpenABE_ERROR_INVALID_INPUT;
+    }
+    return this->verify(pubKey, message->getInternalPtr(), message->size(),
+                        signature->getInternalPtr(), signature->size());
+}
+
+OpenABE_ERROR
+OpenABEContextPKSIG::verify(OpenABEPKey *pubKey, const uint8_t *message, size_t messageLen,
+                            const uint8_t *signature, size_t signatureLen) {
     OpenABE_ERROR result = OpenABE_NOERROR;
 
     try {
@@ -215,9 +236,8 @@ OpenABEContextPKSIG::verify(OpenABEPKey *pubKey, OpenABEByteString *message, Ope
         ASSERT_NOTNULL(keypair);
 
         // Verify the signature using the ECDSA abstraction
-        int ret = ecdsa_verify(keypair,
-                               message->getInternalPtr(), message->size(),
-                               signature->getInternalPtr(), signature->size());
+        int ret = ecdsa_verify(keypair, message, messageLen,
+                               signature, signatureLen);
 
         if (ret != 1) {
             throw OpenABE_ERROR_VERIFICATION_FAILED;
@@ -256,6 +276,477 @@ OpenABEContextPKSIG::validatePrivateKey(const std::shared_ptr<OpenABEPKey>& key)
 }
 
 
+/********************************************************************************
+ * Implementation of the OpenABEContextBLSSIG class
+ ********************************************************************************/
+
+// domain tag hashed in front of the signer's public key and the message
+static const char BLS_SIG_DOMAIN[] = "OpenABE-BLS-SIG";
+
+OpenABEContextBLSSIG::OpenABEContextBLSSIG(unique_ptr<OpenABERNG> rng): OpenABEContext() {
+    this->m_RNG_ = std::move(rng);
+    this->algID = OpenABE_SCHEME_PKSIG_BLS;
+}
+
+OpenABEContextBLSSIG::~OpenABEContextBLSSIG() {
+}
+
+OpenABE_ERROR
+OpenABEContextBLSSIG::initializeCurve(const std::string groupParams) {
+    if (this->m_Pairing_ != nullptr) {
+        return OpenABE_NOERROR;
+    }
+    if (getPairingCurveID(groupParams) == OpenABE_NONE_ID) {
+        return OpenABE_ERROR_INVALID_GROUP_PARAMS;
+    }
+    this->m_Pairing_.reset(OpenABE_createNewPairing(groupParams));
+    if (this->m_Pairing_ == nullptr) {
+        return OpenABE_ERROR_INVALID_GROUP_PARAMS;
+    }
+    return OpenABE_NOERROR;
+}
+
+OpenABE_ERROR
+OpenABEContextBLSSIG::generateParams(const std::string groupParams) {
+    return this->initializeCurve(groupParams);
+}
+
+/*!
+ * Generate a key pair: sk <-$- ZP, pk = g2^sk. The private key keeps a
+ * copy of pk, which signing hashes in with the message.
+ *
+ * @param[in]   identifier of the public key in the keystore.
+ * @param[in]   identifier of the private key in the keystore.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextBLSSIG::keygen(const std::string &pkID, const std::string &skID) {
+    OpenABE_ERROR result = OpenABE_NOERROR;
+    OpenABEByteString uid;
+    OpenABERNG *myRNG = this->getRNG();
+
+    try {
+        ASSERT_NOTNULL(myRNG);
+        ASSERT_NOTNULL(this->getPairing());
+        myRNG->getRandomBytes(&uid, UID_LEN);
+        ZP sk = this->getPairing()->randomZP(myRNG);
+        G2 pk = this->getPairing()->initG2();
+        pk.setGenerator();
+        pk = pk.exp(sk);
+
+        const OpenABECurveID curveID = this->getPairing()->getCurveID();
+        shared_ptr<OpenABEKey> PK(new OpenABEKey(curveID, OpenABE_SCHEME_PKSIG_BLS, pkID, &uid));
+        shared_ptr<OpenABEKey> SK(new OpenABEKey(curveID, OpenABE_SCHEME_PKSIG_BLS, skID, &uid));
+        PK->setComponent("pk", &pk);
+        SK->setComponent("pk", &pk);
+        SK->setComponent("sk", &sk);
+
+        this->getKeystore()->addKey(pkID, PK, KEY_TYPE_PUBLIC);
+        this->getKeystore()->addKey(skID, SK, KEY_TYPE_SECRET);
+    } catch(OpenABE_ERROR& error) {
+        result = error;
+    }
+
+    return result;
+}
+
+OpenABE_ERROR
+OpenABEContextBLSSIG::exportKey(const string &keyID, OpenABEByteString &keyBlob) {
+    OpenABEByteString tmpKeyBlob;
+    if (OpenABE_exportKey(this->getKeystore(), keyID, &tmpKeyBlob) != OpenABE_NOERROR) {
+        return OpenABE_ERROR_INVALID_INPUT;
+    }
+    keyBlob.clear();
+    keyBlob += tmpKeyBlob;
+    tmpKeyBlob.zeroize();
+    return OpenABE_NOERROR;
+}
+
+OpenABE_ERROR
+OpenABEContextBLSSIG::loadPublicKey(const string &keyID, OpenABEByteString &keyBlob) {
+    OpenABE_ERROR result = OpenABE_NOERROR;
+
+    try {
+        OpenABEByteString keyBytes;
+        shared_ptr<OpenABEKey> PK = this->getKeystore()->constructKeyFromBytes(keyID, keyBlob, keyBytes);
+        if (PK == nullptr || PK->getAlgorithmID() != OpenABE_SCHEME_PKSIG_BLS) {
+            return OpenABE_ERROR_INVALID_KEY_HEADER;
+        }
+        // the key names its curve when none has been set up yet
+        result = this->initializeCurve(OpenABE_convertCurveIDToString((OpenABECurveID)PK->getCurveID()));
+        ASSERT(result == OpenABE_NOERROR, result);
+        if (PK->getCurveID() != this->getPairing()->getCurveID()) {
+            return OpenABE_ERROR_INVALID_KEY_HEADER;
+        }
+        PK->setGroup(this->getPairing()->getGroup());
+        PK->loadKeyFromBytes(keyBytes);
+        if (!this->validatePublicKey(PK)) {
+            return OpenABE_ERROR_INVALID_PARAMS;
+        }
+        this->getKeystore()->addKey(keyID, PK, KEY_TYPE_PUBLIC);
+    } catch(OpenABE_ERROR& error) {
+        result = error;
+    }
+
+    return result;
+}
+
+OpenABE_ERROR
+OpenABEContextBLSSIG::loadPrivateKey(const string &keyID, OpenABEByteString &keyBlob) {
+    OpenABE_ERROR result = OpenABE_NOERROR;
+
+    try {
+        OpenABEByteString keyBytes;
+        shared_ptr<OpenABEKey> SK = this->getKeystore()->constructKeyFromBytes(keyID, keyBlob, keyBytes);
+        if (SK == nullptr || SK->getAlgorithmID() != OpenABE_SCHEME_PKSIG_BLS) {
+            return OpenABE_ERROR_INVALID_KEY_HEADER;
+        }
+        result = this->initializeCurve(OpenABE_convertCurveIDToString((OpenABECurveID)SK->getCurveID()));
+        ASSERT(result == OpenABE_NOERROR, result);
+        if (SK->getCurveID() != this->getPairing()->getCurveID()) {
+            return OpenABE_ERROR_INVALID_KEY_HEADER;
+        }
+        SK->setGroup(this->getPairing()->getGroup());
+        SK->loadKeyFromBytes(keyBytes);
+        keyBytes.zeroize();
+        if (!this->validatePrivateKey(SK)) {
+            return OpenABE_ERROR_INVALID_PARAMS;
+        }
+        this->getKeystore()->addKey(keyID, SK, KEY_TYPE_SECRET);
+    } catch(OpenABE_ERROR& error) {
+        result = error;
+    }
+
+    return result;
+}
+
+// pk must be a non-identity element of the prime-order subgroup
+bool
+OpenABEContextBLSSIG::validatePublicKey(const shared_ptr<OpenABEKey>& key) {
+    ASSERT_NOTNULL(key);
+    G2 *pk = key->getG2("pk");
+    if (pk == nullptr) {
+        return false;
+    }
+    return (*pk != this->getPairing()->initG2() && pk->ismember(this->getPairing()->order));
+}
+
+// sk must match the public key stored with it
+bool
+OpenABEContextBLSSIG::validatePrivateKey(const shared_ptr<OpenABEKey>& key) {
+    ASSERT_NOTNULL(key);
+    ZP *sk = key->getZP("sk");
+    if (sk == nullptr || !this->validatePublicKey(key)) {
+        return false;
+    }
+    G2 pk = this->getPairing()->initG2();
+    pk.setGenerator();
+    return (pk.exp(*sk) == *key->getG2("pk"));
+}
+
+// H(domain || pk || m) in G1
+G1
+OpenABEContextBLSSIG::hashMessage(OpenABEKey *pubKey, const uint8_t *message, size_t messageLen) {
+    G2 *pk = pubKey->getG2("pk");
+    ASSERT_NOTNULL(pk);
+    OpenABEByteString prefix;
+    prefix.appendArray((uint8_t *)BLS_SIG_DOMAIN, sizeof(BLS_SIG_DOMAIN) - 1);
+    pk->serialize(prefix);
+    return this->getPairing()->hashToG1(prefix, string((const char *)message, messageLen));
+}
+
+// decode a signature, rejecting the identity and points outside the subgroup
+bool
+OpenABEContextBLSSIG::loadSignature(G1 &sig, const uint8_t *signature, size_t signatureLen) {
+    if (signature == nullptr || signatureLen < 2) {
+        return false;
+    }
+    OpenABEByteString bytes;
+    bytes.appendArray((uint8_t *)signature, signatureLen);
+    try {
+        sig.deserialize(bytes);
+    } catch(OpenABE_ERROR&) {
+        return false;
+    }
+    return (sig != this->getPairing()->initG1() && sig.ismember(this->getPairing()->order));
+}
+
+bool
+OpenABEContextBLSSIG::checkPairingProduct(const G1 &sig, vector<G1> &hashes,
+                                          const vector<OpenABEKey*> &pubKeys) {
+    G2 g2 = this->getPairing()->initG2();
+    g2.setGenerator();
+    vector<G1> g1s;
+    vector<G2> g2s;
+    g1s.reserve(hashes.size() + 1);
+    g2s.reserve(hashes.size() + 1);
+    g1s.push_back(sig);
+    g2s.push_back(-g2);
+    for (size_t i = 0; i < hashes.size(); i++) {
+        g1s.push_back(hashes[i]);
+        g2s.push_back(*pubKeys[i]->getG2("pk"));
+    }
+    GT result = this->getPairing()->initGT();
+    this->getPairing()->multi_pairing(result, g1s, g2s);
+    return result.isInfinity();
+}
+
+/*!
+ * Sign a message: sig = H(pk || m)^sk.
+ *
+ * @param[in]   identifier of the private key in the keystore.
+ * @param[in]   the message and its length.
+ * @param[out]  the serialized signature (a G1 element).
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextBLSSIG::sign(const string &skID, const uint8_t *message, size_t messageLen,
+                           OpenABEByteString *signature) {
+    OpenABE_ERROR result = OpenABE_NOERROR;
+
+    try {
+        ASSERT_NOTNULL(message);
+        ASSERT_NOTNULL(signature);
+        shared_ptr<OpenABEKey> SK = this->getKeystore()->getSecretKey(skID);
+        ASSERT_NOTNULL(SK);
+        ZP *sk = SK->getZP("sk");
+        ASSERT_NOTNULL(sk);
+
+        G1 sig = this->hashMessage(SK.get(), message, messageLen).exp(*sk);
+        signature->clear();
+        sig.serialize(*signature);
+    } catch(OpenABE_ERROR& error) {
+        result = error;
+    }
+
+    return result;
+}
+
+OpenABE_ERROR
+OpenABEContextBLSSIG::verify(const string &pkID, const uint8_t *message, size_t messageLen,
+                             const uint8_t *signature, size_t signatureLen) {
+    OpenABE_ERROR result = OpenABE_NOERROR;
+
+    try {
+        ASSERT_NOTNULL(message);
+        shared_ptr<OpenABEKey> PK = this->getKeystore()->getPublicKey(pkID);
+        ASSERT_NOTNULL(PK);
+
+        G1 sig = this->getPairing()->initG1();
+        if (!this->loadSignature(sig, signature, signatureLen)) {
+            return OpenABE_ERROR_VERIFICATION_FAILED;
+        }
+        vector<G1> hashes(1, this->hashMessage(PK.get(), message, messageLen));
+        if (!this->checkPairingProduct(sig, hashes, vector<OpenABEKey*>(1, PK.get()))) {
+            result = OpenABE_ERROR_VERIFICATION_FAILED;
+        }
+    } catch(OpenABE_ERROR& error) {
+        result = error;
+    }
+
+    return result;
+}
+
+/*!
+ * Combine signatures (by any keys, on any messages) into one: the product
+ * of the signatures in G1.
+ *
+ * @param[in]   the serialized signatures.
+ * @param[out]  the serialized aggregate signature.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR
+OpenABEContextBLSSIG::aggregate(const vector<OpenABEByteString*> &signatures,
+                                OpenABEByteString *aggregate) {
+    OpenABE_ERROR result = OpenABE_NOERROR;
+
+    try {
+        ASSERT_NOTNULL(aggregate);
+        ASSERT_NOTNULL(this->getPairing());
+        ASSERT(!signatures.empty(), OpenABE_ERROR_INVALID_INPUT);
+        G1 agg = this->getPairing()->initG1();
+        for (OpenABEByteString *signature : signatures) {
+            ASSERT_NOTNULL(signature);
+            G1 sig = this->getPairing()->initG1();
+            ASSERT(this->loadSignature(sig, signature->data(), signature->size()),
+                   OpenABE_ERROR_INVALID_INPUT);
+            agg *= sig;
+        }
+        aggregate->clear();
+        agg.serialize(*aggregate);
+    } catch(OpenABE_ERROR& error) {
+        result = error;
+    }
+
+    return result;
+}
+
+/*!
+ * Verify an aggregate signature over (key, message) pairs:
+ *   e(agg, g2) == prod_i e(H(pk_i || m_i), pk_i)
+ * Messages under the same key are hashed to G1 and multiplied first, so
+ * the product takes one Miller loop per distinct key (plus one for the
+ * aggregate) and a single final exponentiation.
+ *
+ * @param[in]   the (public key ID, message) pairs.
+ * @param[in]   the serialized aggregate signature.
+ * @return  OpenABE_NOERROR if the aggregate is valid.
+ */
+OpenABE_ERROR
+OpenABEContextBLSSIG::verifyAggregate(const vector<OpenABESignedMessage> &items,
+                                      OpenABEByteString *aggregate) {
+    OpenABE_ERROR result = OpenABE_NOERROR;
+
+    try {
+        ASSERT_NOTNULL(aggregate);
+        ASSERT_NOTNULL(this->getPairing());
+        ASSERT(!items.empty(), OpenABE_ERROR_INVALID_INPUT);
+        G1 agg = this->getPairing()->initG1();
+        if (!this->loadSignature(agg, aggregate->data(), aggregate->size())) {
+            return OpenABE_ERROR_VERIFICATION_FAILED;
+        }
+
+        // one slot per distinct key
+        map<string, size_t> slots;
+        vector<OpenABEKey*> pubKeys;
+        vector<shared_ptr<OpenABEKey>> owned;
+        vector<size_t> itemSlot(items.size());
+        for (size_t i = 0; i < items.size(); i++) {
+            ASSERT_NOTNULL(items[i].message);
+            auto it = slots.find(items[i].keyID);
+            if (it == slots.end()) {
+                shared_ptr<OpenABEKey> PK = this->getKeystore()->getPublicKey(items[i].keyID);
+                ASSERT(PK != nullptr, OpenABE_ERROR_INVALID_INPUT);
+                it = slots.emplace(items[i].keyID, pubKeys.size()).first;
+                pubKeys.push_back(PK.get());
+                owned.push_back(PK);
+            }
+            itemSlot[i] = it->second;
+        }
+
+        vector<G1> itemHashes(items.size(), this->getPairing()->initG1());
+        OpenABEThreadPool::getDefault()->parallelFor(items.size(), [&](size_t i) {
+            itemHashes[i] = this->hashMessage(pubKeys[itemSlot[i]], items[i].message->data(),
+                                              items[i].message->size());
+        });
+        vector<G1> hashes(pubKeys.size(), this->getPairing()->initG1());
+        for (size_t i = 0; i < items.size(); i++) {
+            hashes[itemSlot[i]] *= itemHashes[i];
+        }
+        if (!this->checkPairingProduct(agg, hashes, pubKeys)) {
+            result = OpenABE_ERROR_VERIFICATION_FAILED;
+        }
+    } catch(OpenABE_ERROR& error) {
+        result = error;
+    }
+
+    return result;
+}
+
+/*!
+ * Verify independent signatures together. With random r_i, the batch
+ * holds if
+ *   e(prod_i sig_i^r_i, g2) == prod_keys e(prod_(i under key) H_i^r_i, pk)
+ * (a forged signature passes with probability about 1/p). When the batch
+ * fails, each signature is checked on its own to say which are bad.
+ *
+ * @param[in]   the (public key ID, message, signature) items.
+ * @param[out]  one status per item (OpenABE_NOERROR when valid).
+ * @return  the number of valid signatures.
+ */
+size_t
+OpenABEContextBLSSIG::verifyBatch(const vector<OpenABESignedMessage> &items,
+                                  vector<OpenABE_ERROR> &results) {
+    const size_t count = items.size();
+    results.assign(count, OpenABE_NOERROR);
+    if (count == 0 || this->getPairing() == nullptr || this->getRNG() == nullptr) {
+        results.assign(count, OpenABE_ERROR_INVALID_INPUT);
+        return 0;
+    }
+
+    // resolve every key up front (the keystore is only read from here on)
+    map<string, size_t> slots;
+    vector<shared_ptr<OpenABEKey>> keys;
+    vector<size_t> itemSlot(count, 0);
+    for (size_t i = 0; i < count; i++) {
+        auto it = slots.find(items[i].keyID);
+        if (it == slots.end()) {
+            it = slots.emplace(items[i].keyID, keys.size()).first;
+            keys.push_back(this->getKeystore()->getPublicKey(items[i].keyID));
+        }
+        itemSlot[i] = it->second;
+    }
+
+    vector<G1> sigs(count, this->getPairing()->initG1());
+    vector<G1> itemHashes(count, this->getPairing()->initG1());
+    OpenABEThreadPool::getDefault()->parallelFor(count, [&](size_t i) {
+        OpenABEKey *PK = keys[itemSlot[i]].get();
+        if (PK == nullptr || items[i].message == nullptr || items[i].signature == nullptr) {
+            results[i] = OpenABE_ERROR_INVALID_INPUT;
+            return;
+        }
+        if (!this->loadSignature(sigs[i], items[i].signature->data(), items[i].signature->size())) {
+            results[i] = OpenABE_ERROR_VERIFICATION_FAILED;
+            return;
+        }
+        itemHashes[i] = this->hashMessage(PK, items[i].message->data(), items[i].message->size());
+    });
+
+    // the random weights come from the context RNG, on this thread
+    vector<size_t> pending;
+    vector<G1> pendingSigs;
+    vector<ZP> weights;
+    for (size_t i = 0; i < count; i++) {
+        if (results[i] == OpenABE_NOERROR) {
+            pending.push_back(i);
+            pendingSigs.push_back(sigs[i]);
+            weights.push_back(this->getPairing()->randomZP(this->getRNG()));
+        }
+    }
+
+    bool batchValid = false;
+    if (!pending.empty()) {
+        vector<G1> hashes(keys.size(), this->getPairing()->initG1());
+        vector<OpenABEKey*> pubKeys(keys.size(), nullptr);
+        for (size_t j = 0; j < pending.size(); j++) {
+            const size_t slot = itemSlot[pending[j]];
+            hashes[slot] *= itemHashes[pending[j]].exp(weights[j]);
+            pubKeys[slot] = keys[slot].get();
+        }
+        // keys whose items all failed to decode drop out of the product
+        vector<G1> usedHashes;
+        vector<OpenABEKey*> usedKeys;
+        for (size_t k = 0; k < keys.size(); k++) {
+            if (pubKeys[k] != nullptr) {
+                usedHashes.push_back(hashes[k]);
+                usedKeys.push_back(pubKeys[k]);
+            }
+        }
+        G1 combined = G1::multiExp(pendingSigs.data(), weights.data(), pendingSigs.size());
+        batchValid = this->checkPairingProduct(combined, usedHashes, usedKeys);
+    }
+
+    if (!batchValid) {
+        OpenABEThreadPool::getDefault()->parallelFor(pending.size(), [&](size_t j) {
+            const size_t i = pending[j];
+            vector<G1> hash(1, itemHashes[i]);
+            if (!this->checkPairingProduct(sigs[i], hash,
+                                           vector<OpenABEKey*>(1, keys[itemSlot[i]].get()))) {
+                results[i] = OpenABE_ERROR_VERIFICATION_FAILED;
+            }
+        });
+    }
+
+    size_t numValid = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (results[i] == OpenABE_NOERROR) {
+            numValid++;
+        }
+    }
+    return numValid;
+}
+
+
 /********************************************************************************
  * Implementation of the OpenABEContextSchemePKSIG class
  ********************************************************************************/
@@ -264,12 +755,19 @@ OpenABEContextSchemePKSIG::OpenABEContextSchemePKSIG(unique_ptr<OpenABEContextPK
     m_PKSIG = std::move(pksig);
 }
 
+OpenABEContextSchemePKSIG::OpenABEContextSchemePKSIG(unique_ptr<OpenABEContextBLSSIG> bls): ZObject() {
+    m_BLS = std::move(bls);
+}
+
 OpenABEContextSchemePKSIG::~OpenABEContextSchemePKSIG() {
 }
 
 OpenABE_ERROR
 OpenABEContextSchemePKSIG::exportKey(const string &keyID, OpenABEByteString &keyBlob) {
     OpenABE_ERROR result = OpenABE_NOERROR;
+    if (this->m_BLS) {
+        return this->m_BLS->exportKey(keyID, keyBlob);
+    }
 
     try {
         // attempt to export the given keyID to a temp keyBlob output buffer (without a header)
@@ -295,6 +793,9 @@ OpenABEContextSchemePKSIG::loadPrivateKey(const std::string &keyID, OpenABEByteS
     OpenABE_ERROR result = OpenABE_NOERROR;
     shared_ptr<OpenABEPKey> SK = nullptr;
     bool isPrivate = true;
+    if (this->m_BLS) {
+        return this->m_BLS->loadPrivateKey(keyID, keyBlob);
+    }
 
     try {
         if (keyBlob.size() < 2) {
@@ -328,6 +829,9 @@ OpenABEContextSchemePKSIG::loadPublicKey(const std::string &keyID, OpenABEByteSt
     OpenABE_ERROR result = OpenABE_NOERROR;
     shared_ptr<OpenABEPKey> PK = nullptr;
     bool isPrivate = false;
+    if (this->m_BLS) {
+        return this->m_BLS->loadPublicKey(keyID, keyBlob);
+    }
 
     try {
         if (keyBlob.size() < 2) {
@@ -358,23 +862,44 @@ OpenABEContextSchemePKSIG::loadPublicKey(const std::string &keyID, OpenABEByteSt
 
 OpenABE_ERROR
 OpenABEContextSchemePKSIG::deleteKey(const string &keyID) {
+    if (this->m_BLS) {
+        return this->m_BLS->getKeystore()->deleteKey(keyID);
+    }
     return this->m_PKSIG->getKeystore()->deleteKey(keyID);
 }
 
 OpenABE_ERROR
 OpenABEContextSchemePKSIG::generateParams(const std::string groupParams) {
+    if (this->m_BLS) {
+        return this->m_BLS->generateParams(groupParams);
+    }
     return this->m_PKSIG->generateParams(groupParams);
 }
 
 OpenABE_ERROR
 OpenABEContextSchemePKSIG::keygen(const std::string &pkID, const std::string &skID) {
+    if (this->m_BLS) {
+        return this->m_BLS->keygen(pkID, skID);
+    }
     return this->m_PKSIG->keygen(pkID, skID);
 }
 
 OpenABE_ERROR
 OpenABEContextSchemePKSIG::sign(const std::string &skID, OpenABEByteString *message, OpenABEByteString *signature) {
+    if (message == nullptr) {
+        return OpenABE_ERROR_INVALID_INPUT;
+    }
+    return this->sign(skID, message->getInternalPtr(), message->size(), signature);
+}
+
+OpenABE_ERROR
+OpenABEContextSchemePKSIG::sign(const std::string &skID, const uint8_t *message, size_t messageLen,
+                                OpenABEByteString *signature) {
     OpenABE_ERROR result = OpenABE_NOERROR;
     shared_ptr<OpenABEPKey> SK = nullptr;
+    if (this->m_BLS) {
+        return this->m_BLS->sign(skID, message, messageLen, signature);
+    }
 
     try {
         ASSERT_NOTNULL(message);
@@ -385,7 +910,7 @@ OpenABEContextSchemePKSIG::sign(const std::string &skID, OpenABEByteString *mess
         ASSERT_NOTNULL(SK);
 
         // sign the message with the key that was just loaded
-        result = this->m_PKSIG->sign(SK.get(), message, signature);
+        result = this->m_PKSIG->sign(SK.get(), message, messageLen, signature);
         ASSERT(result == OpenABE_NOERROR, result);
 
     } catch(OpenABE_ERROR& error) {
@@ -397,8 +922,21 @@ OpenABEContextSchemePKSIG::sign(const std::string &skID, OpenABEByteString *mess
 
 OpenABE_ERROR
 OpenABEContextSchemePKSIG::verify(const std::string &pkID, OpenABEByteString *message, OpenABEByteString *signature) {
+    if (message == nullptr || signature == nullptr) {
+        return OpenABE_ERROR_INVALID_INPUT;
+    }
+    return this->verify(pkID, message->getInternalPtr(), message->size(),
+                        signature->getInternalPtr(), signature->size());
+}
+
+OpenABE_ERROR
+OpenABEContextSchemePKSIG::verify(const std::string &pkID, const uint8_t *message, size_t messageLen,
+                                  const uint8_t *signature, size_t signatureLen) {
     OpenABE_ERROR result = OpenABE_NOERROR;
     shared_ptr<OpenABEPKey> PK = nullptr;
+    if (this->m_BLS) {
+        return this->m_BLS->verify(pkID, message, messageLen, signature, signatureLen);
+    }
 
     try {
         ASSERT_NOTNULL(message);
@@ -409,7 +947,7 @@ OpenABEContextSchemePKSIG::verify(const std::string &pkID, OpenABEByteString *me
         ASSERT_NOTNULL(PK);
 
         // verify the message and signature against a verification key
-        result = this->m_PKSIG->verify(PK.get(), message, signature);
+        result = this->m_PKSIG->verify(PK.get(), message, messageLen, signature, signatureLen);
 
     } catch(OpenABE_ERROR& error) {
         result = error;
@@ -418,4 +956,73 @@ OpenABEContextSchemePKSIG::verify(const std::string &pkID, OpenABEByteString *me
     return result;
 }
 
+/*!
+ * Verify a batch of signatures. Each distinct public key is looked up in
+ * the keystore once and then shared by all of its items, which are checked
+ * concurrently on the library thread pool.
+ *
+ * @param[in]   the (public key ID, message, signature) items.
+ * @param[out]  one status per item (OpenABE_NOERROR when valid).
+ * @return  the number of valid signatures.
+ */
+size_t
+OpenABEContextSchemePKSIG::verifyBatch(const vector<OpenABESignedMessage> &items,
+                                       vector<OpenABE_ERROR> &results) {
+    if (this->m_BLS) {
+        return this->m_BLS->verifyBatch(items, results);
+    }
+    const size_t count = items.size();
+    results.assign(count, OpenABE_NOERROR);
+    if (count == 0) {
+        return 0;
+    }
+
+    // resolve every key up front (the keystore is only read from here on)
+    map<string, shared_ptr<OpenABEPKey>> keys;
+    vector<OpenABEPKey*> itemKeys(count, nullptr);
+    for (size_t i = 0; i < count; i++) {
+        auto it = keys.find(items[i].keyID);
+        if (it == keys.end()) {
+            shared_ptr<OpenABEKey> key = this->m_PKSIG->getKeystore()->getPublicKey(items[i].keyID);
+            it = keys.emplace(items[i].keyID, static_pointer_cast<OpenABEPKey>(key)).first;
+        }
+        itemKeys[i] = it->second.get();
+    }
+
+    OpenABEThreadPool::getDefault()->parallelFor(count, [&](size_t i) {
+        if (itemKeys[i] == nullptr || items[i].message == nullptr ||
+            items[i].signature == nullptr) {
+            results[i] = OpenABE_ERROR_INVALID_INPUT;
+            return;
+        }
+        results[i] = this->m_PKSIG->verify(itemKeys[i], items[i].message, items[i].signature);
+    });
+
+    size_t numValid = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (results[i] == OpenABE_NOERROR) {
+            numValid++;
+        }
+    }
+    return numValid;
+}
+
+OpenABE_ERROR
+OpenABEContextSchemePKSIG::aggregate(const vector<OpenABEByteString*> &signatures,
+                                     OpenABEByteString *aggregate) {
+    if (!this->m_BLS) {
+        return OpenABE_ERROR_NOT_IMPLEMENTED;
+    }
+    return this->m_BLS->aggregate(signatures, aggregate);
+}
+
+OpenABE_ERROR
+OpenABEContextSchemePKSIG::verifyAggregate(const vector<OpenABESignedMessage> &items,
+                                           OpenABEByteString *aggregate) {
+    if (!this->m_BLS) {
+        return OpenABE_ERROR_NOT_IMPLEMENTED;
+    }
+    return this->m_BLS->verifyAggregate(items, aggregate);
+}
+
 }
@@ -167,6 +167,31 @@ TEST_F(PolicyParser, OrderOfParanthesis) {
     ASSERT_EQ(attr_set1, attr_set2);
 }
 
+TEST_F(PolicyParser, CachedPolicyTrees) {
+    TEST_DESCRIPTION("Testing that cached policy trees are independent canonical copies");
+    clearPolicyCache();
+    const string policy_str = "(one or two) and (three or three) and four";
+    unique_ptr<OpenABEPolicy> s1 = createPolicyTree(policy_str);
+    ASSERT_TRUE(s1 != nullptr);
+    ASSERT_EQ(getPolicyCacheCount(), 1u);
+    unique_ptr<OpenABEPolicy> s2 = createPolicyTree(policy_str);
+    ASSERT_TRUE(s2 != nullptr);
+    ASSERT_EQ(getPolicyCacheCount(), 1u);
+    // each caller owns its own tree
+    ASSERT_TRUE(s1->getRootNode() != s2->getRootNode());
+    ASSERT_TRUE(s2->isCanonical());
+    ASSERT_EQ(s1->toString(), s2->toString());
+    ASSERT_EQ(s1->toCanonicalString(), s2->toCanonicalString());
+    // duplicate attribute info survives the copy
+    ASSERT_EQ(s1->hasDuplicateNodes(), s2->hasDuplicateNodes());
+    ASSERT_EQ(s1->getAttrCompleteSet(), s2->getAttrCompleteSet());
+    // invalid policies are not cached
+    ASSERT_TRUE(createPolicyTree("one and") == nullptr);
+    ASSERT_EQ(getPolicyCacheCount(), 1u);
+    clearPolicyCache();
+    ASSERT_EQ(getPolicyCacheCount(), 0u);
+}
+
 TEST_F(PolicyParser, DateRangePolicy) {
     TEST_DESCRIPTION("Testing that we can handle range of dates policies");
     ASSERT_TRUE(createPolicyTree("Date = January 1-31, 2016") != nullptr);
@@ -264,6 +289,185 @@ TEST_F(PolicyParser, ExpIntNotAllowedInInputPolicy) {
     ASSERT_TRUE(createPolicyTree("Alice or foo_expint04_xxxxxxxxxxxxxxxxxxxxxxxxxxxxx0xx") == nullptr);
 }
 
+TEST_F(PolicyParser, DirectParserMatchesBisonParser) {
+    TEST_DESCRIPTION("Testing that the recursive-descent parser builds what the bison parser builds");
+    const vector<string> policies = {
+        "((one or two) and three)", "a or b and c", "a and b or c and d", "(a)",
+        "((one > 5 or two) and (three == 15))", "x >= 7 and y <= 8", "Month < 3#4",
+        "Date > January 1, 2015", "Date <= January 5, 2016", "Date = March 21-28, 2016",
+        "Level in (2-35)", "Level in {2-35}", "foo:alice or (bar:bob and alice)",
+        "one and", "(a", "a b", "Month < 16#4", "Month > -1#4", "Level in [2-35]",
+        "Alice or foo_expint04_xxxxxxxxxxxxxxxxxxxxxxxxxxxxx0xx", "a\nb"
+    };
+    for (auto& input : policies) {
+        Driver bison(false), direct(false);
+        bool ok1 = bison.parse_string(POLICY_PREFIX, input);
+        bool ok2 = direct.parse_input(true, input);
+        unique_ptr<OpenABEPolicy> p1 = bison.getPolicy(), p2 = direct.getPolicy();
+        ASSERT_EQ(ok1, ok2) << input;
+        ASSERT_EQ(p1 != nullptr, p2 != nullptr) << input;
+        if (p1 != nullptr) {
+            ASSERT_EQ(p1->toString(), p2->toString()) << input;
+            ASSERT_EQ(p1->getAttrCompleteSet(), p2->getAttrCompleteSet()) << input;
+            ASSERT_EQ(p1->hasDuplicateNodes(), p2->hasDuplicateNodes()) << input;
+        }
+    }
+
+    const vector<string> attrLists = {
+        "Alice|Bob", "|Alice||Bob|", "foo:alice|bar:Date = Jan 1, 2017|", "Alice|Level = 5|Alice",
+        "|Date = May 10, 2017|Alice|Date = July 1, 2015", "Alice|Day = 8#8",
+        "|", "Alice Bob", "|this or that|Value = 30#4", "Alice|Day >= 100|Bob", "Alice|Day = 1000#8|Bob"
+    };
+    for (auto& input : attrLists) {
+        Driver bison(false), direct(false);
+        bool ok1 = bison.parse_string(ATTRLIST_PREFIX, input);
+        bool ok2 = direct.parse_input(false, input);
+        unique_ptr<OpenABEAttributeList> a1 = bison.getAttributeList(), a2 = direct.getAttributeList();
+        ASSERT_EQ(ok1, ok2) << input;
+        ASSERT_EQ(a1 != nullptr, a2 != nullptr) << input;
+        if (a1 != nullptr) {
+            ASSERT_EQ(a1->toString(), a2->toString()) << input;
+            ASSERT_EQ(*a1->getOriginalAttributeList(), *a2->getOriginalAttributeList()) << input;
+            ASSERT_EQ(a1->getPrefixSet(), a2->getPrefixSet()) << input;
+        }
+    }
+}
+
+TEST_F(PolicyParser, CompactRangeEncoding) {
+    TEST_DESCRIPTION("Testing that ranges share the markers of common high bits and dates use 16 bits");
+    // 2 and 35 agree above bit 5: 26 shared markers plus two 6-bit comparisons
+    unique_ptr<OpenABEPolicy> range = createPolicyTree("Level in (2-35)");
+    ASSERT_TRUE(range != nullptr);
+    ASSERT_EQ(range->getAttrCompleteSet().size(), 38u);
+    unique_ptr<OpenABEPolicy> dates = createPolicyTree("Date = March 21-28, 2016");
+    ASSERT_TRUE(dates != nullptr);
+    ASSERT_TRUE(dates->getAttrCompleteSet().size() <= TIME_BITS + 6);
+    unique_ptr<OpenABEPolicy> after = createPolicyTree("Date > March 21, 2016");
+    ASSERT_TRUE(after != nullptr);
+    ASSERT_TRUE(after->getAttrCompleteSet().size() <= TIME_BITS);
+
+    for (int x = 1; x < 40; x++) {
+        unique_ptr<OpenABEAttributeList> attrs = createAttributeList("Level = " + to_string(x));
+        unique_ptr<OpenABEPolicy> incl = createPolicyTree("Level in {2-35}");
+        ASSERT_EQ(checkIfSatisfied(range.get(), attrs.get()).first, x > 2 && x < 35) << x;
+        ASSERT_EQ(checkIfSatisfied(incl.get(), attrs.get()).first, x >= 2 && x <= 35) << x;
+    }
+    for (int d = 1; d <= 31; d++) {
+        unique_ptr<OpenABEAttributeList> attrs =
+            createAttributeList("Date = March " + to_string(d) + ", 2016");
+        ASSERT_EQ(checkIfSatisfied(dates.get(), attrs.get()).first, d >= 21 && d <= 28) << d;
+        ASSERT_EQ(checkIfSatisfied(after.get(), attrs.get()).first, d > 21) << d;
+    }
+    unique_ptr<OpenABEAttributeList> later = createAttributeList("Date = January 1, 2030");
+    ASSERT_TRUE(checkIfSatisfied(after.get(), later.get()).first);
+    ASSERT_FALSE(checkIfSatisfied(dates.get(), later.get()).first);
+    // past the 16-bit day count
+    ASSERT_TRUE(createPolicyTree("Date > January 1, 2200") == nullptr);
+}
+
+TEST_F(PolicyParser, AbsorbRedundantInputs) {
+    TEST_DESCRIPTION("Testing that duplicate and absorbed policy inputs are dropped");
+    unique_ptr<OpenABEPolicy> absorbed = createPolicyTree("(Alice and Bob) or Alice");
+    ASSERT_TRUE(absorbed != nullptr);
+    ASSERT_EQ(absorbed->toString(), "Alice");
+    unique_ptr<OpenABEPolicy> twice = createPolicyTree("(Alice or Bob) and Alice and Alice");
+    ASSERT_TRUE(twice != nullptr);
+    ASSERT_EQ(twice->toString(), "Alice");
+    unique_ptr<OpenABEPolicy> range = createPolicyTree("Level > 5 or (Level > 5 and Bob)");
+    ASSERT_TRUE(range != nullptr);
+    ASSERT_EQ(range->toString(), createPolicyTree("Level > 5")->toString());
+    // inputs that only look alike stay
+    unique_ptr<OpenABEPolicy> kept = createPolicyTree("(Alice or Bob) and (Alice or (Bob and Carol))");
+    ASSERT_TRUE(kept != nullptr);
+    ASSERT_EQ(kept->getRootNode()->getNumSubnodes(), 2u);
+    // leaves dropped by absorption are no longer duplicates, and repeated
+    // leaves are numbered in printed order, as parsing the string would
+    ASSERT_FALSE(createPolicyTree("Alice or Alice")->hasDuplicateNodes());
+    unique_ptr<OpenABEPolicy> shared = createPolicyTree("(Alice and Carol) or (Alice and Bob)");
+    unique_ptr<OpenABEPolicy> reparsed = createPolicyTree(shared->toString());
+    ASSERT_TRUE(reparsed != nullptr);
+    map<string, int> count1, count2;
+    shared->getDuplicateInfo(count1);
+    reparsed->getDuplicateInfo(count2);
+    ASSERT_EQ(count1, count2);
+    OpenABETreeNode *first = shared->getRootNode()->getSubnode(0);
+    ASSERT_EQ(first->toString(), "(Alice and Bob)");
+    ASSERT_EQ(first->getSubnode(0)->getIndex(), 0);
+
+    const char *attrs[] = {"Alice", "Bob", "Carol", "Alice|Bob", "Bob|Carol", "Alice|Carol"};
+    for (const char *a : attrs) {
+        unique_ptr<OpenABEAttributeList> list = createAttributeList(a);
+        bool alice = string(a).find("Alice") != string::npos;
+        bool bob = string(a).find("Bob") != string::npos;
+        bool carol = string(a).find("Carol") != string::npos;
+        ASSERT_EQ(checkIfSatisfied(absorbed.get(), list.get()).first, alice) << a;
+        ASSERT_EQ(checkIfSatisfied(twice.get(), list.get()).first, alice) << a;
+        ASSERT_EQ(checkIfSatisfied(kept.get(), list.get()).first,
+                  alice || (bob && carol)) << a;
+    }
+}
+
+TEST_F(PolicyParser, StringOfLargePolicy) {
+    TEST_DESCRIPTION("Testing that wide and deep policies are written as strings in one pass");
+    string wide = "a0";
+    string deep = "a0";
+    for (int i = 1; i < 500; i++) {
+        wide += " or a" + to_string(i);
+        deep = "(" + deep + (i % 2 ? " and " : " or ") + "a" + to_string(i) + ")";
+    }
+    for (const string& input : {wide, deep}) {
+        unique_ptr<OpenABEPolicy> policy = createPolicyTree(input);
+        ASSERT_TRUE(policy != nullptr);
+        // the memoized string matches a fresh walk of the tree
+        string written = policy->getRootNode()->toString();
+        ASSERT_EQ(policy->toString(), written);
+        ASSERT_EQ(policy->toCanonicalString(), written);
+        unique_ptr<OpenABEPolicy> copy(policy->clone());
+        ASSERT_EQ(copy->toCanonicalString(), written);
+    }
+    unique_ptr<OpenABEPolicy> policy = createPolicyTree(wide);
+    ASSERT_EQ(policy->toString().compare(0, 14, "1 of (a0, a1, "), 0);
+}
+
+TEST_F(PolicyParser, ComplexityLimits) {
+    TEST_DESCRIPTION("Testing that policies and attribute lists beyond the parsing limits are rejected");
+    const OpenABEPolicyLimits defaults = getPolicyLimits();
+    OpenABEPolicyLimits limits = defaults;
+    limits.maxInputLength = 256;
+    limits.maxDepth = 8;
+    limits.maxLeaves = 16;
+    limits.maxGateWidth = 4;
+    limits.maxAttributes = 8;
+    setPolicyLimits(limits);
+
+    string deep = "a0", wide = "a0", attrs = "a0";
+    for (int i = 1; i < 10; i++) {
+        deep = "(" + deep + (i % 2 ? " and " : " or ") + "a" + to_string(i) + ")";
+        wide += " or a" + to_string(i);
+        attrs += "|a" + to_string(i);
+    }
+    // shallow and narrow, but with 20 leaves
+    string leaves = "((a0 or a1 or a2 or a3) and (b0 or b1 or b2 or b3) and "
+                    "(c0 or c1 or c2 or c3) and (d0 or d1 or d2 or d3)) or "
+                    "(e0 or e1 or e2 or e3)";
+    ASSERT_TRUE(createPolicyTree(deep) == nullptr);
+    ASSERT_TRUE(createPolicyTree(leaves) == nullptr);
+    ASSERT_TRUE(createPolicyTree(wide) == nullptr);
+    ASSERT_TRUE(createPolicyTree(string(300, 'a')) == nullptr);
+    ASSERT_TRUE(createAttributeList(attrs) == nullptr);
+    ASSERT_TRUE(createAttributeList(string(300, 'a')) == nullptr);
+
+    // inputs within the limits still parse
+    ASSERT_TRUE(createPolicyTree("(one or two) and three") != nullptr);
+    ASSERT_TRUE(createPolicyTree("a0 or a1 or a2 or a3") != nullptr);
+    ASSERT_TRUE(createAttributeList("|one|two|three|") != nullptr);
+
+    setPolicyLimits(defaults);
+    ASSERT_TRUE(createPolicyTree(deep) != nullptr);
+    ASSERT_TRUE(createPolicyTree(wide) != nullptr);
+    ASSERT_TRUE(createAttributeList(attrs) != nullptr);
+}
+
 class LinearSecretSharing : public ::testing::Test {
  protected:
   virtual void SetUp() {
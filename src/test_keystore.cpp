@@ -38,6 +38,7 @@
 #include <sstream>
 #include <string>
 #include <math.h>
+#include <unistd.h>
 #include <gtest/gtest.h>
 
 #include <openabe/openabe.h>
@@ -170,6 +171,321 @@ TEST_P(KeystoreManagerTest, testBaseCases) {
     cout << "success!" << endl;
 }
 
+
+
+TEST_P(KeystoreManagerTest, testIndexedSearchAndDelete) {
+    Config input = GetParam();
+    TEST_DESCRIPTION("Testing keystore manager search and expiry through its indexes for " + printScheme(input.scheme_type));
+    OpenABECiphertext ciphertext;
+    OpenABE_SCHEME scheme_type = input.scheme_type;
+    unique_ptr<OpenABEContextSchemeCPA> schemeContext = OpenABE_createContextABESchemeCPA(scheme_type);
+    vector<string> keyInput = input.keyInputs;
+    map<string,OpenABEByteString> keyBlobs;
+    OpenABEByteString tmp;
+
+    schemeContext->generateParams(DEFAULT_BP_PARAM, MPK, MSK);
+    for(size_t i = 0; i < keyInput.size(); i++) {
+        const string keyID = "key"+to_string(i+1);
+        unique_ptr<OpenABEFunctionInput> keyInput1 = getKeyInput(scheme_type, keyInput[i]);
+        schemeContext->keygen((OpenABEFunctionInput *)keyInput1.get(), keyID, MPK, MSK);
+        schemeContext->exportKey(keyID, tmp);
+        keyBlobs[ keyID ] = tmp;
+        schemeContext->deleteKey(keyID);
+    }
+
+    // the same keys for two users, one set expiring earlier than the other
+    unique_ptr<OpenABEKeystoreManager> km(new OpenABEKeystoreManager);
+    uint64_t expireDate = (uint64_t)time(NULL);
+    for(auto it = keyBlobs.begin(); it != keyBlobs.end(); it++) {
+        ASSERT_TRUE(km->storeWithKeyIDCommand("user", it->first, it->second, expireDate));
+        ASSERT_TRUE(km->storeWithKeyIDCommand("other", "other-" + it->first, it->second, expireDate + 1000));
+        // a key with the same input is only stored once per user
+        ASSERT_FALSE(km->storeWithKeyIDCommand("user", "dup-" + it->first, it->second, expireDate));
+    }
+
+    unique_ptr<OpenABEFunctionInput> encInput = getEncInput(input.scheme_type, input.funcInput);
+    schemeContext->encrypt(NULL, MPK, encInput.get(), &plaintext, &ciphertext);
+    unique_ptr<OpenABEFunctionInput> funcInput = getFunctionInput(&ciphertext);
+
+    OpenABEKeyQuery query;
+    query.isEfficient = true;
+    query.currentTime = 0;
+    query.userId = "user";
+    const string decKey = km->searchKeyCommand(&query, funcInput.get());
+    ASSERT_TRUE(decKey != "");
+    ASSERT_TRUE(km->getKeyCommand("user", decKey).second.size() > 0);
+
+    // nothing shares an attribute with this input
+    unique_ptr<OpenABEFunctionInput> unrelated = getEncInput(input.scheme_type, "Zed");
+    ASSERT_EQ(km->searchKeyCommand(&query, unrelated.get()), "");
+
+    // expire the first user's keys only
+    query.userId = "";
+    query.currentTime = expireDate;
+    vector<string> deleted = km->deleteKeyCommand(&query);
+    ASSERT_EQ(deleted.size(), keyBlobs.size());
+    query.currentTime = 0;
+    query.userId = "user";
+    ASSERT_EQ(km->searchKeyCommand(&query, funcInput.get()), "");
+    query.userId = "other";
+    ASSERT_EQ(km->searchKeyCommand(&query, funcInput.get()), "other-" + decKey);
+}
+
+TEST_P(KeystoreManagerTest, testKeyPrefixRotation) {
+    Config input = GetParam();
+    TEST_DESCRIPTION("Testing prefixed key IDs keep growing past many keys per user for " + printScheme(input.scheme_type));
+    OpenABE_SCHEME scheme_type = input.scheme_type;
+    unique_ptr<OpenABEContextSchemeCPA> schemeContext = OpenABE_createContextABESchemeCPA(scheme_type);
+    unique_ptr<OpenABEKeystoreManager> km(new OpenABEKeystoreManager);
+    OpenABEByteString tmp;
+    const size_t numKeys = 30;
+    uint64_t expireDate = (uint64_t)time(NULL);
+
+    schemeContext->generateParams(DEFAULT_BP_PARAM, MPK, MSK);
+    set<string> keyIDs;
+    for(size_t i = 0; i < numKeys; i++) {
+        const string tag = "Tag" + to_string(i);
+        unique_ptr<OpenABEFunctionInput> keyInput1 = getKeyInput(scheme_type,
+            (scheme_type == OpenABE_SCHEME_CP_WATERS) ? "Alice|" + tag : "(Alice and " + tag + ")");
+        schemeContext->keygen((OpenABEFunctionInput *)keyInput1.get(), "tmp", MPK, MSK);
+        schemeContext->exportKey("tmp", tmp);
+        schemeContext->deleteKey("tmp");
+        // the older half of the keys expires first
+        const string keyID = km->storeWithKeyPrefixCommand("svc", "rot-", tmp,
+                                                           expireDate + ((i < numKeys / 2) ? 0 : 1000));
+        ASSERT_EQ(keyID, "rot-" + to_string(i));
+        keyIDs.insert(keyID);
+    }
+    ASSERT_EQ(keyIDs.size(), numKeys);
+    ASSERT_EQ(km->getUserKeyCount("svc"), numKeys);
+
+    OpenABEKeyQuery query;
+    query.userId = "";
+    query.currentTime = expireDate;
+    ASSERT_EQ(km->deleteKeyCommand(&query).size(), numKeys / 2);
+    ASSERT_EQ(km->getUserKeyCount("svc"), numKeys - numKeys / 2);
+    ASSERT_EQ(km->getKeyCommand("svc", "rot-0").second.size(), 0U);
+    ASSERT_TRUE(km->getKeyCommand("svc", "rot-" + to_string(numKeys - 1)).second.size() > 0);
+
+    // IDs of pruned keys are not handed out again
+    unique_ptr<OpenABEFunctionInput> keyInput1 = getKeyInput(scheme_type,
+        (scheme_type == OpenABE_SCHEME_CP_WATERS) ? "Alice|Bob" : "(Alice and Bob)");
+    schemeContext->keygen((OpenABEFunctionInput *)keyInput1.get(), "tmp", MPK, MSK);
+    schemeContext->exportKey("tmp", tmp);
+    ASSERT_EQ(km->storeWithKeyPrefixCommand("svc", "rot-", tmp, expireDate + 1000),
+              "rot-" + to_string(numKeys));
+}
+
+TEST_P(KeystoreManagerTest, testExpiredKeyEviction) {
+    Config input = GetParam();
+    TEST_DESCRIPTION("Testing expired keys are evicted and counted for " + printScheme(input.scheme_type));
+    OpenABE_SCHEME scheme_type = input.scheme_type;
+    unique_ptr<OpenABEContextSchemeCPA> schemeContext = OpenABE_createContextABESchemeCPA(scheme_type);
+    vector<string> keyInput = input.keyInputs;
+    unique_ptr<OpenABEKeystoreManager> km(new OpenABEKeystoreManager);
+    OpenABEByteString tmp;
+    uint64_t now = (uint64_t)time(NULL);
+
+    // key1 never expires, the others expire one after another
+    schemeContext->generateParams(DEFAULT_BP_PARAM, MPK, MSK);
+    for(size_t i = 0; i < keyInput.size(); i++) {
+        const string keyID = "key"+to_string(i+1);
+        unique_ptr<OpenABEFunctionInput> keyInput1 = getKeyInput(scheme_type, keyInput[i]);
+        schemeContext->keygen((OpenABEFunctionInput *)keyInput1.get(), keyID, MPK, MSK);
+        schemeContext->exportKey(keyID, tmp);
+        schemeContext->deleteKey(keyID);
+        ASSERT_TRUE(km->storeWithKeyIDCommand("user", keyID, tmp, (i == 0) ? 0 : now + i));
+    }
+
+    ASSERT_EQ(km->evictExpiredKeys(now), 0U);
+    ASSERT_EQ(km->evictExpiredKeys(now + 1), 1U);
+    ASSERT_EQ(km->getKeyCommand("user", "key2").second.size(), 0U);
+    ASSERT_EQ(km->evictExpiredKeys(now + 1000), keyInput.size() - 2);
+    ASSERT_EQ(km->getUserKeyCount("user"), 1U);
+    ASSERT_TRUE(km->getKeyCommand("user", "key1").second.size() > 0);
+
+    OpenABEEvictionStats stats = km->getEvictionStats();
+    ASSERT_EQ(stats.sweeps, 3U);
+    ASSERT_EQ(stats.keysEvicted, keyInput.size() - 1);
+    ASSERT_TRUE(stats.bytesZeroized > 0);
+    ASSERT_EQ(stats.lastSweepTime, now + 1000);
+
+    // the background sweeper picks up keys that are already past due
+    ASSERT_TRUE(km->storeWithKeyIDCommand("user", "stale", tmp, now - 1));
+    km->startEvictionThread(1);
+    for (int i = 0; i < 50 && km->getUserKeyCount("user") > 1; i++) {
+        usleep(100000);
+    }
+    km->stopEvictionThread();
+    ASSERT_EQ(km->getUserKeyCount("user"), 1U);
+    ASSERT_EQ(km->getEvictionStats().keysEvicted, keyInput.size());
+}
+
+TEST_P(KeystoreManagerTest, testPersistentStore) {
+    Config input = GetParam();
+    TEST_DESCRIPTION("Testing keystore manager reloads keys from its log for " + printScheme(input.scheme_type));
+    OpenABECiphertext ciphertext;
+    OpenABE_SCHEME scheme_type = input.scheme_type;
+    unique_ptr<OpenABEContextSchemeCPA> schemeContext = OpenABE_createContextABESchemeCPA(scheme_type);
+    vector<string> keyInput = input.keyInputs;
+    map<string,OpenABEByteString> keyBlobs;
+    OpenABEByteString tmp;
+    const string path = "test_keystore_" + to_string((int)scheme_type) + ".log";
+    remove(path.c_str());
+
+    schemeContext->generateParams(DEFAULT_BP_PARAM, MPK, MSK);
+    for(size_t i = 0; i < keyInput.size(); i++) {
+        const string keyID = "key"+to_string(i+1);
+        unique_ptr<OpenABEFunctionInput> keyInput1 = getKeyInput(scheme_type, keyInput[i]);
+        schemeContext->keygen((OpenABEFunctionInput *)keyInput1.get(), keyID, MPK, MSK);
+        schemeContext->exportKey(keyID, tmp);
+        keyBlobs[ keyID ] = tmp;
+        schemeContext->deleteKey(keyID);
+    }
+
+    // the first key is stored before the log is opened, the rest after
+    uint64_t expireDate = (uint64_t)time(NULL);
+    {
+        unique_ptr<OpenABEKeystoreManager> km(new OpenABEKeystoreManager);
+        km->setPassphrase("program", "user", "passphrase", 2000);
+        auto it = keyBlobs.begin();
+        ASSERT_TRUE(km->storeWithKeyIDCommand("user", it->first, it->second, expireDate));
+        ASSERT_EQ(km->openStore(path), OpenABE_NOERROR);
+        for(++it; it != keyBlobs.end(); it++) {
+            ASSERT_TRUE(km->storeWithKeyIDCommand("user", it->first, it->second, expireDate));
+        }
+        ASSERT_TRUE(km->getKeyCommand("user", "key1").second == keyBlobs["key1"]);
+        // a user without a passphrase can't write to the store
+        ASSERT_FALSE(km->storeWithKeyIDCommand("other", "otherKey", keyBlobs["key1"], expireDate));
+    }
+
+    // the log holds only sealed blobs
+    {
+        ifstream file(path, ios::binary);
+        const string raw((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        ASSERT_TRUE(raw.size() > 0);
+        for(auto it = keyBlobs.begin(); it != keyBlobs.end(); it++) {
+            ASSERT_EQ(raw.find(it->second.toString()), string::npos);
+        }
+    }
+
+    // the blobs need the passphrase they were sealed under
+    {
+        unique_ptr<OpenABEKeystoreManager> km(new OpenABEKeystoreManager);
+        ASSERT_EQ(km->openStore(path), OpenABE_NOERROR);
+        ASSERT_EQ(km->getKeyCommand("user", "key1").second.size(), 0U);
+        km->setPassphrase("program", "user", "wrong", 2000);
+        ASSERT_EQ(km->getKeyCommand("user", "key1").second.size(), 0U);
+        km->setPassphrase("program", "user", "passphrase", 2000);
+        ASSERT_TRUE(km->getKeyCommand("user", "key1").second == keyBlobs["key1"]);
+
+        // nor are keys held in memory written out without one
+        km.reset(new OpenABEKeystoreManager);
+        ASSERT_TRUE(km->storeWithKeyIDCommand("user", "key1", keyBlobs["key1"], expireDate));
+        ASSERT_NE(km->openStore(path), OpenABE_NOERROR);
+    }
+
+    unique_ptr<OpenABEFunctionInput> encInput = getEncInput(input.scheme_type, input.funcInput);
+    schemeContext->encrypt(NULL, MPK, encInput.get(), &plaintext, &ciphertext);
+    unique_ptr<OpenABEFunctionInput> funcInput = getFunctionInput(&ciphertext);
+    OpenABEKeyQuery query;
+    query.isEfficient = true;
+    query.currentTime = 0;
+    query.userId = "user";
+
+    // a fresh manager finds every key without being handed the blobs
+    unique_ptr<OpenABEKeystoreManager> km(new OpenABEKeystoreManager);
+    km->setPassphrase("program", "user", "passphrase", 2000);
+    ASSERT_EQ(km->openStore(path), OpenABE_NOERROR);
+    for(auto it = keyBlobs.begin(); it != keyBlobs.end(); it++) {
+        ASSERT_TRUE(km->getKeyCommand("user", it->first).second == it->second);
+        ASSERT_EQ(km->getKeyCommand("other", it->first).second.size(), 0U);
+    }
+    const string decKey = km->searchKeyCommand(&query, funcInput.get());
+    ASSERT_TRUE(decKey != "");
+    skBlob = km->getKeyCommand("user", decKey).second;
+    ASSERT_TRUE(schemeContext->loadUserSecretParams(decKey, skBlob) == OpenABE_NOERROR);
+    ASSERT_TRUE(schemeContext->decrypt(MPK, decKey, &plaintext1, &ciphertext) == OpenABE_NOERROR);
+
+    // deletes survive a restart, and compaction leaves only live keys
+    query.userId = "";
+    query.currentTime = expireDate;
+    ASSERT_EQ(km->deleteKeyCommand(&query).size(), keyBlobs.size());
+    km.reset(new OpenABEKeystoreManager);
+    km->setPassphrase("program", "user", "passphrase", 2000);
+    ASSERT_EQ(km->openStore(path), OpenABE_NOERROR);
+    query.userId = "user";
+    query.currentTime = 0;
+    ASSERT_EQ(km->searchKeyCommand(&query, funcInput.get()), "");
+
+    for(auto it = keyBlobs.begin(); it != keyBlobs.end(); it++) {
+        ASSERT_TRUE(km->storeWithKeyIDCommand("user", it->first, it->second, expireDate));
+    }
+    ASSERT_EQ(km->compactStore(), OpenABE_NOERROR);
+    ASSERT_TRUE(km->getKeyCommand("user", decKey).second == skBlob);
+    km->closeStore();
+    ASSERT_TRUE(km->getKeyCommand("user", decKey).second == skBlob);
+    remove(path.c_str());
+}
+
+TEST_P(KeystoreManagerTest, testCheapestKeyRanking) {
+    Config input = GetParam();
+    TEST_DESCRIPTION("Testing searches pick the key with the cheapest decrypt for " + printScheme(input.scheme_type));
+    OpenABECiphertext ciphertext;
+    OpenABE_SCHEME scheme_type = input.scheme_type;
+    unique_ptr<OpenABEContextSchemeCPA> schemeContext = OpenABE_createContextABESchemeCPA(scheme_type);
+    unique_ptr<OpenABEKeystoreManager> km(new OpenABEKeystoreManager);
+    OpenABEByteString tmp;
+    bool isCP = (scheme_type == OpenABE_SCHEME_CP_WATERS);
+    // key1 needs three rows; key2 and key3 one each, key3 being the smaller key
+    vector<string> keyInput;
+    if (isCP) {
+        keyInput = { "Alice|Bob|Charlie", "David|Eve|Frank", "David|Eve" };
+    } else {
+        keyInput = { "(Alice and Bob and Charlie)", "(David or (Eve and Frank))", "(David or Eve)" };
+    }
+
+    schemeContext->generateParams(DEFAULT_BP_PARAM, MPK, MSK);
+    map<string,OpenABEByteString> keyBlobs;
+    for(size_t i = 0; i < keyInput.size(); i++) {
+        const string keyID = "key"+to_string(i+1);
+        unique_ptr<OpenABEFunctionInput> keyInput1 = getKeyInput(scheme_type, keyInput[i]);
+        schemeContext->keygen((OpenABEFunctionInput *)keyInput1.get(), keyID, MPK, MSK);
+        schemeContext->exportKey(keyID, tmp);
+        keyBlobs[ keyID ] = tmp;
+        schemeContext->deleteKey(keyID);
+    }
+
+    unique_ptr<OpenABEFunctionInput> encInput = getEncInput(scheme_type,
+        isCP ? "((Alice and Bob and Charlie) or David)" : "Alice|Bob|Charlie|David");
+    schemeContext->encrypt(NULL, MPK, encInput.get(), &plaintext, &ciphertext);
+    unique_ptr<OpenABEFunctionInput> funcInput = getFunctionInput(&ciphertext);
+    OpenABEKeyQuery query;
+    query.isEfficient = true;
+    query.currentTime = 0;
+    query.userId = "user";
+
+    ASSERT_TRUE(km->storeWithKeyIDCommand("user", "key1", keyBlobs["key1"], 0));
+    ASSERT_TRUE(km->storeWithKeyIDCommand("user", "key2", keyBlobs["key2"], 0));
+    ASSERT_EQ(km->searchKeyCommand(&query, funcInput.get()), "key2");
+    // answered from the cache the second time
+    ASSERT_EQ(km->searchKeyCommand(&query, funcInput.get()), "key2");
+
+    // a new key invalidates the cached answer
+    ASSERT_TRUE(km->storeWithKeyIDCommand("user", "key3", keyBlobs["key3"], 1));
+    const string decKey = km->searchKeyCommand(&query, funcInput.get());
+    ASSERT_EQ(decKey, "key3");
+    skBlob = km->getKeyCommand("user", decKey).second;
+    ASSERT_TRUE(schemeContext->loadUserSecretParams(decKey, skBlob) == OpenABE_NOERROR);
+    ASSERT_TRUE(schemeContext->decrypt(MPK, decKey, &plaintext1, &ciphertext) == OpenABE_NOERROR);
+    ASSERT_TRUE(plaintext == plaintext1);
+
+    // and so does removing it
+    ASSERT_EQ(km->evictExpiredKeys(1), 1U);
+    ASSERT_EQ(km->searchKeyCommand(&query, funcInput.get()), "key2");
+    query.userId = "other";
+    ASSERT_EQ(km->searchKeyCommand(&query, funcInput.get()), "");
+}
 }
 
 INSTANTIATE_TEST_CASE_P(ABETest5, KeystoreManagerTest,
@@ -38,17 +38,25 @@
 #include <unistd.h>
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
 #include <fstream>
 #include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
 #include <assert.h>
 #include <openabe/openabe.h>
 #include <openabe/zsymcrypto.h>
+#include <openabe/utils/zallochooks.h>
+#include <openabe/utils/zbenchmark.h>
 #include <gtest/gtest.h>
 
 using namespace std;
 using namespace oabe;
 using namespace oabe::crypto;
 
+OpenABE_DEFINE_ALLOCATION_HOOKS
+
 #define COLOR_STR_GREEN   "\033[32m"
 #define COLOR_STR_NORMAL  "\033[0m"
 #define COLOR_STR_RED     "\033[31m"
@@ -124,6 +132,27 @@ TEST(libopenabe, PolicyTreeAndAttributeListParser) {
   ASSERT_ANY_THROW(aList2->isEqual(nullptr));
 }
 
+TEST(libopenabe, ConcurrentInitialization) {
+  TEST_DESCRIPTION("Testing that initializing an initialized library from several threads is harmless");
+  vector<std::thread> threads;
+  std::atomic<int> failures(0);
+  for (int i = 0; i < 8; i++) {
+    threads.push_back(std::thread([&failures]() {
+      try {
+        InitializeOpenABE();
+        AssertLibInit();
+        OpenABEPairing pairing(DEFAULT_BP_PARAM);
+      } catch (...) {
+        failures++;
+      }
+    }));
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  ASSERT_EQ(failures.load(), 0);
+}
+
 TEST(libopenabe, BasicPairingTests) {
   TEST_DESCRIPTION("Testing that pairing arithmetic is correct");
 
@@ -375,6 +404,419 @@ TEST(libopenabe, LinearSecretSharing) {
 //	}
 }
 
+TEST(libopenabe, LinearSecretSharingMinimalRows) {
+  TEST_DESCRIPTION("Test that coefficient recovery selects the fewest rows");
+  OpenABEPairing pairing(DEFAULT_BP_PARAM);
+  OpenABERNG rng;
+  ZP s = pairing.randomZP(&rng);
+
+  // both branches of the top OR have two subnodes, but the left one needs
+  // three rows (Alice, Bob, Carl) and the right one only two (Dan, Eve)
+  std::unique_ptr<OpenABEPolicy> policy =
+      createPolicyTree("((Alice and ((Bob and Carl) or Xenia)) or (Dan and Eve))");
+  ASSERT_TRUE(policy != nullptr);
+  OpenABELSSS lsss(&pairing, &rng);
+  lsss.shareSecret(policy.get(), s);
+  OpenABELSSSRowMap shares = lsss.getRows();
+
+  std::unique_ptr<OpenABEAttributeList> attList =
+      createAttributeList("Alice|Bob|Carl|Dan|Eve");
+  ASSERT_TRUE(attList != nullptr);
+  OpenABELSSS recoveryLsss(&pairing, &rng);
+  ASSERT_TRUE(recoveryLsss.recoverCoefficients(policy.get(), attList.get()));
+  OpenABELSSSRowMap coefficients = recoveryLsss.getRows();
+  ASSERT_EQ(coefficients.size(), 2U);
+  for (auto it = coefficients.begin(); it != coefficients.end(); ++it) {
+    const string label = it->second.label();
+    ASSERT_TRUE(label.find("Dan") != string::npos || label.find("Eve") != string::npos);
+  }
+  ASSERT_TRUE(recoveryLsss.LSSStestSecretRecovery(coefficients, shares) == s);
+
+  // the keystore ranks keys by the same count
+  policy = createPolicyTree("((Alice and ((Bob and Carl) or Xenia)) or (Dan and Eve))");
+  pair<bool,int> res = checkIfSatisfied(policy.get(), attList.get());
+  ASSERT_TRUE(res.first);
+  ASSERT_EQ(res.second, 2);
+}
+
+TEST(libopenabe, BitsetPolicySatisfiability) {
+  TEST_DESCRIPTION("Test that the bitset satisfiability check agrees with the tree scan");
+  OpenABEAttributeBitset a, b;
+  a.set(OpenABEInternAttribute("Alice"));
+  b.set(OpenABEInternAttribute("Alice"));
+  b.set(OpenABEInternAttribute("Bob"));
+  ASSERT_EQ(OpenABEInternAttribute("Alice"), OpenABEInternAttribute("Alice"));
+  ASSERT_TRUE(a.isSubsetOf(b));
+  ASSERT_FALSE(b.isSubsetOf(a));
+  ASSERT_TRUE(a.intersects(b));
+  ASSERT_FALSE(OpenABEAttributeBitset().intersects(b));
+
+  vector<string> policies = {
+    "Alice",
+    "(Alice and Bob and Charlie)",
+    "((Alice or Bob) and (Charlie or Alice) and David)",
+    "((Alice and ((Bob and Carl) or Xenia)) or (Dan and Eve))",
+    "(Alice or (Bob and Charlie))"
+  };
+  vector<string> lists = {
+    "|Alice", "|Bob", "|Alice|Bob|Charlie", "|Alice|David",
+    "|Alice|Bob|Carl|Dan|Eve", "|Xenia|Alice", "|Eve|Frank"
+  };
+  for (auto& policy_str : policies) {
+    for (auto& list_str : lists) {
+      unique_ptr<OpenABEPolicy> policy = createPolicyTree(policy_str);
+      unique_ptr<OpenABEAttributeList> attrList = createAttributeList(list_str);
+      ASSERT_TRUE(policy != nullptr && attrList != nullptr);
+      // reset_flags=false keeps the marks and therefore scans the tree
+      pair<bool,int> scanned = checkIfSatisfied(policy.get(), attrList.get(), false);
+      pair<bool,int> fast = checkIfSatisfied(policy.get(), attrList.get());
+      ASSERT_EQ(fast.first, scanned.first) << policy_str << " / " << list_str;
+      if (fast.first) {
+        ASSERT_EQ(fast.second, scanned.second) << policy_str << " / " << list_str;
+      }
+    }
+  }
+}
+
+TEST(libopenabe, AttributeListMatchesInternedAttributes) {
+  TEST_DESCRIPTION("Test that attribute lookups in a large list go through the interned IDs");
+  string list_str;
+  for (int i = 0; i < 300; i++) {
+    list_str += "|group" + to_string(i);
+  }
+  unique_ptr<OpenABEAttributeList> attrList = createAttributeList(list_str);
+  ASSERT_TRUE(attrList != nullptr);
+  ASSERT_EQ(attrList->getAttributeList()->size(), 300u);
+  for (int i = 0; i < 300; i++) {
+    ASSERT_TRUE(attrList->matchAttribute("group" + to_string(i))) << i;
+  }
+  ASSERT_FALSE(attrList->matchAttribute("group300"));
+  // probing for an unknown attribute does not intern it
+  uint32_t id;
+  ASSERT_FALSE(attrList->matchAttribute("never-interned-attribute"));
+  ASSERT_FALSE(OpenABEFindAttribute("never-interned-attribute", id));
+  ASSERT_TRUE(OpenABEFindAttribute("group7", id));
+  ASSERT_EQ(id, OpenABEInternAttribute("group7"));
+
+  unique_ptr<OpenABEAttributeList> copy(attrList->clone());
+  ASSERT_TRUE(copy->addAttribute("extra"));
+  ASSERT_TRUE(copy->matchAttribute("extra"));
+  ASSERT_FALSE(attrList->matchAttribute("extra"));
+  ASSERT_TRUE(copy->matchAttribute("group299"));
+}
+
+TEST(libopenabe, DecryptionPlanCache) {
+  TEST_DESCRIPTION("Test that cached decryption plans match a fresh coefficient recovery");
+  OpenABEPairing pairing(DEFAULT_BP_PARAM);
+  OpenABERNG rng;
+  clearDecryptionPlanCache();
+
+  std::unique_ptr<OpenABEPolicy> policy =
+      createPolicyTree("((Alice or Bob) and (Charlie or Alice) and David)");
+  ASSERT_TRUE(policy != nullptr);
+  OpenABEAttributeList attList, otherList;
+  attList.addAttribute(string("Alice"));
+  attList.addAttribute(string("David"));
+  otherList.addAttribute(string("Bob"));
+  otherList.addAttribute(string("Charlie"));
+  otherList.addAttribute(string("David"));
+
+  OpenABELSSS fresh(&pairing, &rng), first(&pairing, &rng), second(&pairing, &rng);
+  ASSERT_TRUE(fresh.recoverCoefficients(policy.get(), &attList));
+  ASSERT_TRUE(first.recoverCoefficients("key0", policy.get(), &attList));
+  ASSERT_EQ(getDecryptionPlanCacheCount(), 1U);
+  ASSERT_TRUE(second.recoverCoefficients("key0", policy.get(), &attList));
+  ASSERT_EQ(getDecryptionPlanCacheCount(), 1U);
+
+  OpenABELSSSRowMap expected = fresh.getRows();
+  for (OpenABELSSS *lsss : {&first, &second}) {
+    OpenABELSSSRowMap rows = lsss->getRows();
+    ASSERT_EQ(rows.size(), expected.size());
+    for (auto it = expected.begin(); it != expected.end(); ++it) {
+      ASSERT_TRUE(rows.count(it->first) == 1);
+      ASSERT_EQ(rows.at(it->first).label(), it->second.label());
+      ASSERT_EQ(rows.at(it->first).element(), it->second.element());
+    }
+  }
+
+  // the row vector holds the same rows by compiled row index, and a cached
+  // plan hands out the vector it keeps rather than a copy
+  shared_ptr<const OpenABELSSSCompiledPolicy> compiled = policy->getCompiledLSSS();
+  ASSERT_TRUE(compiled != nullptr);
+  for (OpenABELSSS *lsss : {&fresh, &first, &second}) {
+    const OpenABELSSSRowVector &recovered = lsss->getRecoveredRows();
+    ASSERT_EQ(recovered.size(), expected.size());
+    auto it = expected.begin();
+    for (size_t i = 0; i < recovered.size(); i++, ++it) {
+      ASSERT_EQ(compiled->rowLabel(recovered[i].index), it->first);
+      ASSERT_EQ(recovered[i].coefficient, it->second.element());
+    }
+  }
+  ASSERT_EQ(&first.getRecoveredRows(), &second.getRecoveredRows());
+
+  // the same key ID with different attributes gets its own plan
+  OpenABELSSS other(&pairing, &rng);
+  ASSERT_TRUE(other.recoverCoefficients("key0", policy.get(), &otherList));
+  ASSERT_EQ(getDecryptionPlanCacheCount(), 2U);
+  OpenABELSSSRowMap otherRows = other.getRows();
+  for (auto it = otherRows.begin(); it != otherRows.end(); ++it) {
+    ASSERT_NE(it->second.label(), "Alice");
+  }
+  clearDecryptionPlanCache();
+  ASSERT_EQ(getDecryptionPlanCacheCount(), 0U);
+}
+
+TEST(libopenabe, LinearSecretSharingCompiled) {
+  TEST_DESCRIPTION("Test that a compiled policy shares exactly like the policy tree");
+  OpenABEPairing pairing(DEFAULT_BP_PARAM);
+  OpenABERNG rng;
+  OpenABEByteString seed, nonce;
+  rng.getRandomBytes(&seed, 32);
+  rng.getRandomBytes(&nonce, OpenABE_CTR_DRBG_NONCELEN);
+
+  string str = "((Alice or Bob) and (Charlie or Alice) and David)";
+  std::unique_ptr<OpenABEPolicy> policy = createPolicyTree(str);
+  ASSERT_TRUE(policy != nullptr);
+  shared_ptr<const OpenABELSSSCompiledPolicy> compiled = policy->getCompiledLSSS();
+  ASSERT_TRUE(compiled != nullptr);
+  // copies of a cached policy share its compiled layout
+  std::unique_ptr<OpenABEPolicy> again = createPolicyTree(str);
+  ASSERT_EQ(again->getCompiledLSSS(), compiled);
+
+  // a policy without a precompiled layout is compiled on the fly
+  OpenABEPolicy uncompiled(*policy);
+  uncompiled.setCompiledLSSS(nullptr);
+  ZP s = pairing.randomZP(&rng);
+
+  OpenABECTR_DRBG rng1(seed), rng2(seed);
+  rng1.setSeed(nonce);
+  rng2.setSeed(nonce);
+  OpenABELSSS lsss1(&pairing, &rng1), lsss2(&pairing, &rng2);
+  lsss1.shareSecret(&uncompiled, s);
+  vector<ZP> shares;
+  lsss2.shareSecret(*compiled, s, shares);
+
+  OpenABELSSSRowMap rows = lsss1.getRows();
+  ASSERT_EQ(rows.size(), compiled->numRows());
+  ASSERT_EQ(shares.size(), compiled->numRows());
+  size_t i = 0;
+  for (auto it = rows.begin(); it != rows.end(); ++it, ++i) {
+    ASSERT_EQ(it->first, compiled->rowLabel(i));
+    ASSERT_EQ(it->second.label(), compiled->rowAttribute(i));
+    ASSERT_EQ(it->second.element(), shares[i]);
+    // element label suffixes are precomputed with the layout
+    ASSERT_EQ(compiled->rowKey(i), OpenABEHashKey(compiled->rowLabel(i)));
+    ASSERT_EQ(compiled->rowAttributeKey(i), OpenABEHashKey(compiled->rowAttribute(i)));
+    ASSERT_EQ(compiled->findRow(it->first), i);
+  }
+  ASSERT_EQ(compiled->findRow("Eve"), compiled->numRows());
+
+  OpenABELSSS recoveryLsss(&pairing, &rng);
+  OpenABEAttributeList attList;
+  attList.addAttribute(string("Alice"));
+  attList.addAttribute(string("David"));
+  ASSERT_TRUE(recoveryLsss.recoverCoefficients(policy.get(), &attList));
+  ZP recovered = recoveryLsss.LSSStestSecretRecovery(recoveryLsss.getRows(), rows);
+  ASSERT_TRUE(recovered == s);
+
+  // the share matrix applied to (s, r_1, ..., r_n) gives shares that the
+  // same coefficients recombine into s
+  vector<OpenABELSSSMatrixRow> matrix;
+  uint32_t numColumns = 0;
+  lsss1.shareMatrix(*compiled, matrix, numColumns);
+  ASSERT_EQ(matrix.size(), compiled->numRows());
+  vector<ZP> v(numColumns);
+  v[0] = s;
+  for (uint32_t j = 1; j < numColumns; j++) {
+    v[j] = pairing.randomZP(&rng);
+  }
+  OpenABELSSSRowMap coefficients = recoveryLsss.getRows();
+  ZP combined;
+  pairing.initZP(combined, 0);
+  for (size_t r = 0; r < matrix.size(); r++) {
+    auto coeffIt = coefficients.find(compiled->rowLabel(r));
+    if (coeffIt == coefficients.end()) {
+      continue;
+    }
+    ZP share;
+    pairing.initZP(share, 0);
+    for (auto &entry : matrix[r]) {
+      ASSERT_TRUE(entry.first < numColumns);
+      share += entry.second * v[entry.first];
+    }
+    combined += coeffIt->second.element() * share;
+  }
+  ASSERT_TRUE(combined == s);
+}
+
+static string gTraceMessage;
+static int gTraceLevel = 0;
+
+static void captureTrace(int level, const char *file, int line, const char *message) {
+  gTraceLevel = level;
+  gTraceMessage = message;
+}
+
+TEST(libopenabe, TraceSink) {
+  TEST_DESCRIPTION("Testing that trace messages are routed to the installed sink");
+  OpenABE_setTraceSink(captureTrace);
+  OpenABE_traceEmit(OpenABE_TRACE_LEVEL_INFO, __FILE__, __LINE__, "pairs=%d", 3);
+  ASSERT_EQ(gTraceLevel, OpenABE_TRACE_LEVEL_INFO);
+  ASSERT_EQ(gTraceMessage, "pairs=3");
+
+  // disabled levels never reach the sink
+  gTraceMessage = "";
+#if !OpenABE_TRACE_ENABLED(OpenABE_TRACE_LEVEL_DEBUG)
+  OpenABE_TRACE_DEBUG("should be compiled out");
+  ASSERT_EQ(gTraceMessage, "");
+#endif
+  OpenABE_setTraceSink(NULL);
+}
+
+TEST(libopenabe, ThreadPool) {
+  TEST_DESCRIPTION("Testing that the library thread pool runs every iteration once");
+  OpenABEThreadPool pool(3);
+  ASSERT_EQ(pool.size(), 3u);
+  vector<int> hits(200, 0);
+  pool.parallelFor(hits.size(), [&](size_t i) {
+    hits[i]++;
+    // nested loops run on the calling worker when the pool is busy
+    pool.parallelFor(4, [](size_t) {});
+  });
+  for (size_t i = 0; i < hits.size(); i++) {
+    ASSERT_EQ(hits[i], 1);
+  }
+  // exceptions are passed back to the caller
+  ASSERT_THROW(pool.parallelFor(50, [](size_t i) {
+    if (i == 17) throw OpenABE_ERROR_INVALID_INPUT;
+  }), OpenABE_ERROR);
+  // a pool without workers runs everything on the caller
+  OpenABEThreadPool serial(0);
+  size_t count = 0;
+  serial.parallelFor(10, [&](size_t) { count++; });
+  ASSERT_EQ(count, 10u);
+}
+
+struct rwlock_test_data {
+  OpenABERWLock *rwlock;
+  int *counter;
+  bool sawShared;
+};
+
+void *rwlock_reader(void *data) {
+  rwlock_test_data *d = (rwlock_test_data *) data;
+  OpenABESharedLockGuard lock(*d->rwlock);
+  d->sawShared = true;
+  return NULL;
+}
+
+void *rwlock_writer(void *data) {
+  rwlock_test_data *d = (rwlock_test_data *) data;
+  for (int i = 0; i < 1000; i++) {
+    std::lock_guard<OpenABERWLock> lock(*d->rwlock);
+    (*d->counter)++;
+  }
+  return NULL;
+}
+
+TEST(libopenabe, ReaderWriterLock) {
+  TEST_DESCRIPTION("Test that the reader/writer lock admits concurrent readers and one writer");
+  OpenABERWLock rwlock;
+  int counter = 0;
+
+  // a second reader gets in while the first still holds the lock
+  rwlock_test_data reader = { &rwlock, &counter, false };
+  pthread_t thread;
+  rwlock.lock_shared();
+  ASSERT_EQ(pthread_create(&thread, NULL, rwlock_reader, (void *) &reader), 0);
+  ASSERT_EQ(pthread_join(thread, NULL), 0);
+  rwlock.unlock_shared();
+  ASSERT_TRUE(reader.sawShared);
+
+  const int count = 4;
+  pthread_t writers[count];
+  rwlock_test_data data[count];
+  for (int i = 0; i < count; i++) {
+    data[i] = { &rwlock, &counter, false };
+    ASSERT_EQ(pthread_create(&writers[i], NULL, rwlock_writer, (void *) &data[i]), 0);
+  }
+  for (int i = 0; i < count; i++) {
+    ASSERT_EQ(pthread_join(writers[i], NULL), 0);
+  }
+  OpenABESharedLockGuard lock(rwlock);
+  ASSERT_EQ(counter, count * 1000);
+}
+
+TEST(libopenabe, OperationArena) {
+  TEST_DESCRIPTION("Testing that arena containers draw from the current arena");
+  // without a scope the allocator falls back to the heap
+  OpenABEArenaVector<int> heap(4, 1);
+  ASSERT_TRUE(heap.get_allocator().arena() == NULL);
+
+  OpenABEArena arena(64);
+  {
+    OpenABEArenaScope scope(arena);
+    ASSERT_EQ(OpenABEArena::current(), &arena);
+    OpenABEArenaVector<string> labels;
+    OpenABEArenaStack<uint64_t> stack;
+    for (uint64_t i = 0; i < 1000; i++) {
+      labels.push_back(to_string(i));
+      stack.push(i);
+    }
+    ASSERT_EQ(labels[999], "999");
+    ASSERT_EQ(stack.top(), 999u);
+    void *p = arena.allocate(10, 32);
+    ASSERT_EQ((uintptr_t)p % 32, 0u);
+    {
+      // scopes nest and restore the outer arena
+      OpenABEArena inner;
+      OpenABEArenaScope innerScope(inner);
+      ASSERT_EQ(OpenABEArena::current(), &inner);
+    }
+    ASSERT_EQ(OpenABEArena::current(), &arena);
+    ASSERT_GT(arena.bytesAllocated(), 1000 * sizeof(uint64_t));
+  }
+  ASSERT_TRUE(OpenABEArena::current() == NULL);
+  arena.release();
+  ASSERT_EQ(arena.bytesAllocated(), 0u);
+}
+
+TEST(libopenabe, SecureArena) {
+  TEST_DESCRIPTION("Testing that the secure arena wipes what a scope allocated");
+  OpenABESecureVector<uint8_t> heap(32, 0xAA);
+  ASSERT_TRUE(heap.get_allocator().arena() == NULL);
+
+  OpenABESecureArena arena(64);
+  uint8_t *first;
+  {
+    OpenABESecureArenaScope scope(arena);
+    ASSERT_EQ(OpenABESecureArena::current(), &arena);
+    first = static_cast<uint8_t *>(arena.allocate(48, 16));
+    ASSERT_EQ((uintptr_t)first % 16, 0u);
+    memset(first, 0x5A, 48);
+    {
+      // nested scopes only wipe their own allocations
+      OpenABESecureArenaScope inner(arena);
+      OpenABESecureVector<uint8_t> secret(100000, 0xC3);
+      ASSERT_EQ(secret.get_allocator().arena(), &arena);
+      ASSERT_EQ(secret[99999], 0xC3);
+    }
+    ASSERT_EQ(OpenABESecureArena::current(), &arena);
+    ASSERT_EQ(arena.bytesAllocated(), 48u);
+    ASSERT_EQ(first[47], 0x5A);
+  }
+  ASSERT_TRUE(OpenABESecureArena::current() == NULL);
+  ASSERT_EQ(arena.bytesAllocated(), 0u);
+  // the first region stays mapped for reuse and comes back zeroized
+  uint8_t *again = static_cast<uint8_t *>(arena.allocate(48, 16));
+  ASSERT_EQ(again, first);
+  for (size_t i = 0; i < 48; i++) {
+    ASSERT_EQ(again[i], 0u);
+  }
+  arena.release();
+  ASSERT_EQ(arena.bytesAllocated(), 0u);
+}
+
 TEST(libopenabe, Base64Tests) {
   TEST_DESCRIPTION("Testing that Base64 encode/decode works correctly");
   const string to_encode("Hello, world!");
@@ -398,6 +840,30 @@ TEST(libopenabe, Base64Tests) {
   EXPECT_THROW(Base64Decode(invalid_b64), OpenABE_ERROR); // OpenABE_ERROR_INVALID_INPUT
 }
 
+TEST(libopenabe, Base64BlockTests) {
+  TEST_DESCRIPTION("Testing Base64 encode/decode across the vector block boundaries");
+  OpenABERNG rng;
+  OpenABEByteString value;
+  rng.getRandomBytes(&value, 4096);
+  const string alphabet("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/");
+
+  for (size_t len = 0; len <= 200; len++) {
+    string encoded = Base64Encode(value.getInternalPtr(), len);
+    ASSERT_EQ(encoded.size(), (len + 2) / 3 * 4);
+    ASSERT_TRUE(encoded.find_first_not_of(alphabet + "=") == string::npos);
+    ASSERT_TRUE(Base64Decode(encoded) == string((const char *)value.getInternalPtr(), len));
+  }
+  string encoded = Base64Encode(value.getInternalPtr(), value.size());
+  ASSERT_TRUE(Base64Decode(encoded) == value.toString());
+
+  // a bad character anywhere rejects the whole input
+  for (size_t pos : { (size_t)0, (size_t)31, (size_t)100, encoded.size() - 5 }) {
+    string corrupt = encoded;
+    corrupt[pos] = '~';
+    ASSERT_TRUE(Base64Decode(corrupt).empty());
+  }
+}
+
 TEST(libopenabe, SerializationTests) {
   TEST_DESCRIPTION("Testing that pairing group elements serialization works correctly");
   // Create a pairing object
@@ -457,6 +923,56 @@ TEST(libopenabe, SerializationTests) {
   }
 }
 
+TEST(libopenabe, SerializationCompactGT) {
+  TEST_DESCRIPTION("Testing that the compact GT encoding round-trips and is no larger than the regular one");
+  OpenABEPairing pairing(DEFAULT_BP_PARAM);
+  OpenABERNG rng;
+  GT gt1 = pairing.initGT();
+
+  for (int i = 0; i < 5; i++) {
+    G1 g1 = pairing.randomG1(&rng);
+    G2 g2 = pairing.randomG2(&rng);
+    GT gt0 = pairing.pairing(g1, g2);
+    OpenABEByteString full, compact;
+    gt0.serialize(full);
+    gt0.serializeCompact(compact);
+    ASSERT_TRUE(compact.size() <= full.size());
+    gt1.deserialize(compact);
+    ASSERT_TRUE(gt0 == gt1);
+    gt1.deserialize(full);
+    ASSERT_TRUE(gt0 == gt1);
+  }
+
+  // the identity has its own encoding
+  GT one = pairing.initGT(), gt2 = pairing.initGT();
+  one.setIdentity();
+  OpenABEByteString compact;
+  one.serializeCompact(compact);
+  gt2.deserialize(compact);
+  ASSERT_TRUE(one == gt2);
+
+  // containers written compactly load into the same components
+  OpenABECiphertext ciphertext(pairing.getGroup()), ciphertext2(pairing.getGroup());
+  ciphertext.setHeader(OpenABE_NONE_ID, OpenABE_SCHEME_NONE, &rng);
+  G1 g1 = pairing.randomG1(&rng);
+  G2 g2 = pairing.randomG2(&rng);
+  GT gt3 = pairing.pairing(g1, g2);
+  ciphertext.setComponent("GT", &gt3);
+  ciphertext.setComponent("G1", &g1);
+  OpenABEByteString ctBlob, ctCompact;
+  ciphertext.exportToBytes(ctBlob);
+  ciphertext.setCompactEncoding(true);
+  ciphertext.exportToBytes(ctCompact);
+  ASSERT_TRUE(ctCompact.size() <= ctBlob.size());
+  ciphertext2.loadFromBytes(ctCompact);
+  ASSERT_TRUE(ciphertext == ciphertext2);
+  // an explicit encoding leaves the ciphertext's own setting alone
+  OpenABEByteString ctFull;
+  ciphertext.exportToBytes(ctFull, false);
+  ASSERT_TRUE(ctFull == ctBlob);
+  ASSERT_TRUE(ciphertext.getCompactEncoding());
+}
+
 TEST(libopenabe, SerializationIntTests) {
   TEST_DESCRIPTION("Testing that integer elements serialization works correctly");
 
@@ -490,6 +1006,93 @@ TEST(libopenabe, OpenABEByteStringZeroize) {
   ASSERT_TRUE(buf.size() == empty.size());
 }
 
+TEST(libopenabe, OpenABEByteSink) {
+  TEST_DESCRIPTION("Testing that values packed in place by OpenABEByteSink match smartPack and pack");
+  OpenABEPairing pairing(DEFAULT_BP_PARAM);
+  OpenABERNG rng;
+  size_t sizes[] = { 1, UINT8_MAX, UINT8_MAX + 1, UINT16_MAX, UINT16_MAX + 1 };
+
+  for (size_t len : sizes) {
+    OpenABEByteString value, packed, sunk;
+    rng.getRandomBytes(&value, len);
+    packed.smartPack(value);
+    packed.pack(value);
+    OpenABEByteSink sink(sunk);
+    size_t mark = sink.beginPacked();
+    sink.append(value);
+    sink.endPacked(mark);
+    mark = sink.beginPacked32();
+    sink.append(value);
+    sink.endPacked32(mark);
+    ASSERT_TRUE(packed == sunk);
+  }
+  OpenABEByteString out;
+  OpenABEByteSink sink(out);
+  ASSERT_ANY_THROW(sink.endPacked(sink.beginPacked()));
+
+  // elements written to a sink match their serialize() output
+  G1 g1 = pairing.randomG1(&rng);
+  G2 g2 = pairing.randomG2(&rng);
+  GT gt = pairing.pairing(g1, g2);
+  ZP z = pairing.randomZP(&rng);
+  const ZObject *elements[] = { &g1, &g2, &gt, &z };
+  for (const ZObject *element : elements) {
+    OpenABEByteString bytes, sunk;
+    element->serialize(bytes);
+    OpenABEByteSink elementSink(sunk);
+    element->serializeTo(elementSink);
+    ASSERT_TRUE(bytes == sunk);
+  }
+}
+
+TEST(libopenabe, OpenABEByteStringStorage) {
+  TEST_DESCRIPTION("Testing inline storage, prepend headroom and wiping of OpenABEByteString");
+  OpenABERNG rng;
+  OpenABEByteString small;
+  rng.getRandomBytes(&small, SHA256_LEN);
+  ASSERT_TRUE(small.isInline());
+
+  // growing past the inline size moves to the heap and keeps the bytes
+  OpenABEByteString big = small;
+  std::vector<uint8_t> expected(small.begin(), small.end());
+  for (size_t i = 0; i < 1000; i++) {
+    big.push_back(i & 0xFF);
+    expected.push_back(i & 0xFF);
+  }
+  ASSERT_FALSE(big.isInline());
+  ASSERT_TRUE(big.headroom() == OpenABE_BYTESTRING_HEADROOM);
+
+  // prepends use the headroom
+  const uint8_t *start = big.data();
+  big.insertFirstByte(0xAA);
+  expected.insert(expected.begin(), 0xAA);
+  ASSERT_TRUE(big.data() == start - 1);
+  for (size_t i = 0; i < 10000; i++) {
+    big.insertFirstByte(i & 0xFF);
+    expected.insert(expected.begin(), i & 0xFF);
+  }
+  ASSERT_TRUE(big.size() == expected.size());
+  ASSERT_TRUE(std::equal(expected.begin(), expected.end(), big.begin()));
+
+  // erased bytes are wiped in place
+  size_t len = big.size();
+  uint8_t *tail = big.data() + len - 100;
+  big.erase(big.end() - 100, big.end());
+  for (size_t i = 0; i < 100; i++) {
+    ASSERT_TRUE(tail[i] == 0);
+  }
+  ASSERT_TRUE(big.size() == len - 100);
+
+  // zeroize drops the heap block
+  big.zeroize();
+  ASSERT_TRUE(big.empty() && big.isInline());
+
+  // copies and moves of inline strings
+  OpenABEByteString copy(small), moved(std::move(copy));
+  ASSERT_TRUE(moved == small);
+  ASSERT_TRUE(copy.empty());
+}
+
 TEST(libopenabe, OpenABECiphertextTests) {
   TEST_DESCRIPTION("Test that ciphertext can support all container object types");
 
@@ -580,6 +1183,37 @@ TEST(libopenabe, OpenABECiphertextTests) {
 
   ASSERT_TRUE(*ciphertext == *ciphertext2);
 
+  // lazily decoded elements match eagerly decoded ones
+  OpenABECiphertext lazyCiphertext(pairing.getGroup());
+  lazyCiphertext.setLazyDecoding(true);
+  lazyCiphertext.loadFromBytes(ctBlob);
+  ASSERT_TRUE(lazyCiphertext.matchComponent("G2", &g2));
+  ASSERT_TRUE(*ciphertext2 == lazyCiphertext);
+  ASSERT_TRUE(lazyCiphertext == *ciphertext2);
+  ASSERT_TRUE(g0 == *lazyCiphertext.getG1("G1"));
+  ASSERT_TRUE(gt == *lazyCiphertext.getGT("GT"));
+  // the typed getters only return components of their own type
+  ASSERT_TRUE(lazyCiphertext.getG2("G1") == nullptr);
+  ASSERT_TRUE(lazyCiphertext.getGT("G2") == nullptr);
+  ASSERT_TRUE(ciphertext2->getG1("GT") == nullptr);
+  ASSERT_TRUE(ciphertext2->getZP("int") == nullptr);
+  ASSERT_TRUE(ciphertext2->getG1("str") == nullptr);
+  OpenABEByteString lazyBlob;
+  lazyCiphertext.exportToBytes(lazyBlob);
+  ASSERT_TRUE(lazyBlob == ctBlob);
+
+  // differing values, names or component counts all compare unequal
+  OpenABECiphertext ciphertext3(pairing.getGroup());
+  ciphertext3.loadFromBytes(ctBlob);
+  G1 other = pairing.randomG1(&rng);
+  ciphertext3.setComponent("G1", &other);
+  ASSERT_FALSE(*ciphertext == ciphertext3);
+  ciphertext3.setComponent("G1", &g0);
+  ASSERT_TRUE(*ciphertext == ciphertext3);
+  ciphertext3.setComponent("extra", &g0);
+  ASSERT_FALSE(*ciphertext == ciphertext3);
+  ASSERT_FALSE(ciphertext3 == *ciphertext);
+
   OpenABEByteString uid, emptyUid;
   rng.getRandomBytes(&uid, UID_LEN);
 
@@ -606,6 +1240,42 @@ TEST(libopenabe, OpenABECiphertextTests) {
   SAFE_DELETE(attrlist);
 }
 
+TEST(libopenabe, OpenABECiphertextParallelDecode) {
+  TEST_DESCRIPTION("Test that ciphertexts with many group elements decode in parallel and in order");
+
+  OpenABEPairing pairing(DEFAULT_BP_PARAM);
+  OpenABERNG rng;
+  OpenABECiphertext ciphertext(pairing.getGroup());
+  ciphertext.setHeader(OpenABE_NONE_ID, OpenABE_SCHEME_NONE, &rng);
+
+  const size_t count = OpenABE_PARALLEL_DECODE_MIN * 2;
+  vector<G1> g1s;
+  vector<G2> g2s;
+  for (size_t i = 0; i < count; i++) {
+    g1s.push_back(pairing.randomG1(&rng));
+    g2s.push_back(pairing.randomG2(&rng));
+  }
+  for (size_t i = 0; i < count; i++) {
+    ciphertext.setComponent("C" + to_string(i), &g1s[i]);
+    ciphertext.setComponent("D" + to_string(i), &g2s[i]);
+  }
+  ZP z = pairing.randomZP(&rng);
+  ciphertext.setComponent("z", &z);
+
+  OpenABEByteString ctBlob, ctBlob2;
+  ciphertext.exportToBytes(ctBlob);
+  OpenABECiphertext ciphertext2(pairing.getGroup());
+  ciphertext2.loadFromBytes(ctBlob);
+  for (size_t i = 0; i < count; i++) {
+    ASSERT_TRUE(g1s[i] == *ciphertext2.getG1("C" + to_string(i)));
+    ASSERT_TRUE(g2s[i] == *ciphertext2.getG2("D" + to_string(i)));
+  }
+  ASSERT_TRUE(z == *ciphertext2.getZP("z"));
+  ASSERT_TRUE(ciphertext == ciphertext2);
+  ciphertext2.exportToBytes(ctBlob2);
+  ASSERT_TRUE(ctBlob == ctBlob2);
+}
+
 TEST(libopenabe, CPATestsForCpAbeKEMContext) {
   TEST_DESCRIPTION("Testing that CPA secure CP-ABE KEM encryption and decryption context is correct");
   OpenABEContextABE *context = NULL;
@@ -675,6 +1345,61 @@ TEST(libopenabe, CPATestsForCpAbeKEMContext) {
 }
 
 
+TEST(libopenabe, PositionalCiphertextEncoding) {
+  TEST_DESCRIPTION("Testing that compactly encoded CP/KP-ABE ciphertexts drop their labels and still decrypt");
+  unique_ptr<OpenABERNG> rng(new OpenABERNG);
+  OpenABE_SCHEME schemes[] = { OpenABE_SCHEME_CP_WATERS, OpenABE_SCHEME_KP_GPSW };
+
+  for (OpenABE_SCHEME scheme : schemes) {
+    unique_ptr<OpenABEContextABE> context(OpenABE_createContextABE(&rng, scheme));
+    ASSERT_TRUE(context != nullptr);
+    ASSERT_TRUE(context->generateParams(DEFAULT_BP_PARAM, "testMPK", "testMSK") == OpenABE_NOERROR);
+
+    vector<string> attributes;
+    string policyStr;
+    for (int i = 0; i < 20; i++) {
+      attributes.push_back("department" + to_string(i));
+      policyStr += (i == 0 ? "" : " or ") + attributes.back();
+    }
+    unique_ptr<OpenABEPolicy> policy = createPolicyTree(policyStr);
+    OpenABEAttributeList attrList(attributes.size(), attributes);
+    OpenABEAttributeList userAttrs(1, vector<string>(1, attributes[7]));
+    unique_ptr<OpenABEPolicy> userPolicy = createPolicyTree(attributes[7]);
+    OpenABEFunctionInput *encInput = (scheme == OpenABE_SCHEME_CP_WATERS) ?
+        (OpenABEFunctionInput *)policy.get() : (OpenABEFunctionInput *)&attrList;
+    OpenABEFunctionInput *keyInput = (scheme == OpenABE_SCHEME_CP_WATERS) ?
+        (OpenABEFunctionInput *)&userAttrs : (OpenABEFunctionInput *)userPolicy.get();
+
+    shared_ptr<OpenABESymKey> symkey(new OpenABESymKey), newkey(new OpenABESymKey);
+    OpenABECiphertext ciphertext;
+    ASSERT_TRUE(context->encryptKEM(NULL, "testMPK", encInput, DEFAULT_SYM_KEY_BYTES, symkey, &ciphertext) == OpenABE_NOERROR);
+    ASSERT_TRUE(context->generateDecryptionKey(keyInput, "decKey", "testMPK", "testMSK") == OpenABE_NOERROR);
+
+    OpenABEByteString labeled, positional, again;
+    ciphertext.exportToBytes(labeled);
+    ciphertext.setCompactEncoding(true);
+    ciphertext.exportToBytes(positional);
+    ASSERT_TRUE(positional.size() < labeled.size());
+
+    OpenABECiphertext ciphertext2;
+    ciphertext2.loadFromBytes(positional);
+    ASSERT_TRUE(ciphertext == ciphertext2);
+    ciphertext2.exportToBytes(again);
+    ASSERT_TRUE(again == positional);
+    ASSERT_TRUE(context->decryptKEM("testMPK", "decKey", &ciphertext2, DEFAULT_SYM_KEY_BYTES, newkey) == OpenABE_NOERROR);
+    ASSERT_TRUE(symkey->toString() == newkey->toString());
+
+    // components the schema doesn't name keep their labels
+    OpenABEByteString extra;
+    extra = "extra";
+    ciphertext.setComponent("_ED", &extra);
+    ciphertext.exportToBytes(positional);
+    OpenABECiphertext ciphertext3;
+    ciphertext3.loadFromBytes(positional);
+    ASSERT_TRUE(ciphertext == ciphertext3);
+  }
+}
+
 TEST(libopenabe, CPATestsForCpAbeSchemeContext) {
   TEST_DESCRIPTION("Testing that CPA secure CP-ABE scheme context is correct");
   unique_ptr<OpenABEContextSchemeCPA> schemeContext = nullptr;
@@ -730,6 +1455,65 @@ TEST(libopenabe, CPATestsForCpAbeSchemeContext) {
   SAFE_DELETE(attrlist);
 }
 
+TEST(libopenabe, EncryptionCouponsForCpAbe) {
+  TEST_DESCRIPTION("Testing CPA secure CP-ABE encryption with pre-generated coupons");
+  unique_ptr<OpenABEContextSchemeCPA> schemeContext =
+      OpenABE_createContextABESchemeCPA(OpenABE_SCHEME_CP_WATERS);
+  ASSERT_TRUE(schemeContext->generateParams(DEFAULT_BP_PARAM, "testMPK", "testMSK") == OpenABE_NOERROR);
+  ASSERT_TRUE(schemeContext->enableEncryptionCoupons("unknownMPK") == OpenABE_ERROR_INVALID_PARAMS);
+
+  // 4 coupons covering 2 rows each, filled in the background
+  ASSERT_TRUE(schemeContext->enableEncryptionCoupons("testMPK", 4, 2) == OpenABE_NOERROR);
+  auto waitForCoupons = [&]() {
+    for (int i = 0; i < 1000 && schemeContext->getEncryptionCouponCount("testMPK") < 4; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return schemeContext->getEncryptionCouponCount("testMPK");
+  };
+  ASSERT_EQ(waitForCoupons(), 4u);
+
+  vector<string> attributes = { "Alice", "Charlie" };
+  OpenABEAttributeList attrlist(2, attributes);
+  ASSERT_TRUE(schemeContext->keygen(&attrlist, "decKey", "testMPK", "testMSK") == OpenABE_NOERROR);
+
+  // fewer and more rows than a coupon covers
+  const char *policies[] = { "Alice", "((Alice or Bob) and (Charlie or David))" };
+  size_t expected = 4;
+  for (const char *p : policies) {
+    OpenABEByteString plaintext, plaintext2;
+    plaintext = "offline/online encryption";
+    unique_ptr<OpenABEPolicy> policy = createPolicyTree(p);
+    OpenABECiphertext ciphertext;
+    ASSERT_TRUE(schemeContext->encrypt(NULL, "testMPK", policy.get(), &plaintext, &ciphertext) == OpenABE_NOERROR);
+    // the pool is only topped up once it's down to half
+    if (--expected > 2) {
+      ASSERT_EQ(schemeContext->getEncryptionCouponCount("testMPK"), expected);
+    }
+    ASSERT_TRUE(schemeContext->decrypt("testMPK", "decKey", &plaintext2, &ciphertext) == OpenABE_NOERROR);
+    ASSERT_TRUE(plaintext == plaintext2);
+  }
+
+  // a deterministic RNG never takes a coupon, so its output is reproducible
+  ASSERT_EQ(waitForCoupons(), 4u);
+  OpenABEByteString seed, nonce, plaintext, ct1, ct2;
+  seed.fillBuffer(0x11, 32);
+  nonce.fillBuffer(0x22, OpenABE_CTR_DRBG_NONCELEN);
+  plaintext = "deterministic";
+  unique_ptr<OpenABEPolicy> policy = createPolicyTree("Alice and Charlie");
+  for (OpenABEByteString *out : { &ct1, &ct2 }) {
+    OpenABECTR_DRBG rng(seed);
+    rng.setSeed(nonce);
+    OpenABECiphertext ciphertext;
+    ASSERT_TRUE(schemeContext->encrypt(&rng, "testMPK", policy.get(), &plaintext, &ciphertext) == OpenABE_NOERROR);
+    ciphertext.exportToBytes(*out);
+  }
+  ASSERT_TRUE(ct1 == ct2);
+  ASSERT_EQ(schemeContext->getEncryptionCouponCount("testMPK"), 4u);
+
+  schemeContext->disableEncryptionCoupons("testMPK");
+  ASSERT_EQ(schemeContext->getEncryptionCouponCount("testMPK"), 0u);
+}
+
 TEST(libopenabe, CPATestsForKpAbeSchemeContext) {
   TEST_DESCRIPTION("Testing that CPA secure KP-ABE scheme context is correct");
   unique_ptr<OpenABEContextSchemeCPA> schemeContext = nullptr;
@@ -843,6 +1627,41 @@ TEST(libopenabe, CCATestsForCpAbeKEMContext) {
   SAFE_DELETE(contextCCAKEM);
 }
 
+TEST(libopenabe, PreparedCiphertextFanOut) {
+  TEST_DESCRIPTION("Testing that a ciphertext prepared with G2 line tables decrypts for many keys");
+  for (auto scheme : { OpenABE_SCHEME_CP_WATERS, OpenABE_SCHEME_KP_GPSW }) {
+    unique_ptr<OpenABEContextSchemeCCA> ccaSchemeContext = OpenABE_createContextABESchemeCCA(scheme);
+    ASSERT_TRUE(ccaSchemeContext->generateParams(DEFAULT_BP_PARAM, "testMPK", "testMSK") == OpenABE_NOERROR);
+
+    string plaintext1 = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ", plaintext2;
+    OpenABECiphertext ciphertext1, ciphertext2;
+    unique_ptr<OpenABEFunctionInput> encInput, keyInput[3];
+    const char *keys[3] = { "|Alice|Charlie", "|Bob|David", "|Alice|Bob|Charlie" };
+    if (scheme == OpenABE_SCHEME_CP_WATERS) {
+      encInput = createPolicyTree("((Alice or Bob) and (Charlie or David))");
+      for (size_t i = 0; i < 3; i++) {
+        keyInput[i] = createAttributeList(keys[i]);
+      }
+    } else {
+      encInput = createAttributeList("|Alice|Bob|Charlie|David");
+      keyInput[0] = createPolicyTree("(Alice and Charlie)");
+      keyInput[1] = createPolicyTree("(Bob and David)");
+      keyInput[2] = createPolicyTree("((Alice or Bob) and Charlie)");
+    }
+    ASSERT_TRUE(ccaSchemeContext->encrypt("testMPK", encInput.get(), plaintext1,
+                                          &ciphertext1, &ciphertext2) == OpenABE_NOERROR);
+    ciphertext1.precomputeG2LineTables();
+
+    for (size_t i = 0; i < 3; i++) {
+      string keyID = "decKey" + to_string(i);
+      ASSERT_TRUE(ccaSchemeContext->keygen(keyInput[i].get(), keyID, "testMPK", "testMSK") == OpenABE_NOERROR);
+      plaintext2.clear();
+      ASSERT_TRUE(ccaSchemeContext->decrypt("testMPK", keyID, plaintext2, &ciphertext1, &ciphertext2) == OpenABE_NOERROR);
+      ASSERT_EQ(plaintext1, plaintext2);
+    }
+  }
+}
+
 TEST(libopenabe, CCATestsForCpAbeSchemeContext) {
   TEST_DESCRIPTION("Testing that CCA secure CP-ABE Scheme context (wrapper around CCA KEM) is correct");
   OpenABECiphertext *ciphertext1 = nullptr, *ciphertext2 = nullptr;
@@ -883,6 +1702,83 @@ TEST(libopenabe, CCATestsForCpAbeSchemeContext) {
   SAFE_DELETE(attrlist);
 }
 
+TEST(libopenabe, CCATestsForCpAbeSchemeContextRejectsTampering) {
+  TEST_DESCRIPTION("Testing that the CCA verification check rejects modified ciphertexts");
+  unique_ptr<OpenABEContextSchemeCCA> ccaSchemeContext = OpenABE_createContextABESchemeCCA(OpenABE_SCHEME_CP_WATERS);
+  ASSERT_TRUE(ccaSchemeContext->generateParams(DEFAULT_BP_PARAM, "testMPK", "testMSK") == OpenABE_NOERROR);
+  std::unique_ptr<OpenABEPolicy> policy = createPolicyTree("(Alice or Bob)");
+  vector<string> attributes = {"Alice"};
+  unique_ptr<OpenABEAttributeList> attrlist(new OpenABEAttributeList(attributes.size(), attributes));
+  ASSERT_TRUE(ccaSchemeContext->keygen(attrlist.get(), "decKey", "testMPK", "testMSK") == OpenABE_NOERROR);
+
+  string plaintext1 = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ", plaintext2;
+  OpenABEByteString ct1Bytes;
+  OpenABECiphertext ciphertext1, ciphertext2;
+  ASSERT_TRUE(ccaSchemeContext->encrypt("testMPK", policy.get(), plaintext1, &ciphertext1, &ciphertext2) == OpenABE_NOERROR);
+  ciphertext1.exportToBytes(ct1Bytes);
+
+  // an extra component is not part of the encryption
+  OpenABECiphertext extra;
+  extra.loadFromBytes(ct1Bytes);
+  OpenABEByteString junk;
+  junk.appendArray((uint8_t *)"junk", 4);
+  extra.setComponent("junk", &junk);
+  ASSERT_FALSE(ccaSchemeContext->decrypt("testMPK", "decKey", plaintext2, &extra, &ciphertext2) == OpenABE_NOERROR);
+
+  // an unused row that has been replaced
+  OpenABECiphertext modified;
+  modified.loadFromBytes(ct1Bytes);
+  OpenABERNG rng;
+  OpenABEPairing pairing(DEFAULT_BP_PARAM);
+  G2 forged = pairing.randomG2(&rng);
+  string bobRow;
+  for (auto &name : modified.getKeys()) {
+    if (name.compare(0, 2, "D_") == 0 && name.find("Bob") != string::npos) {
+      bobRow = name;
+    }
+  }
+  ASSERT_FALSE(bobRow.empty());
+  modified.setComponent(bobRow, &forged);
+  ASSERT_FALSE(ccaSchemeContext->decrypt("testMPK", "decKey", plaintext2, &modified, &ciphertext2) == OpenABE_NOERROR);
+
+  // the untouched ciphertext still decrypts
+  ASSERT_TRUE(ccaSchemeContext->decrypt("testMPK", "decKey", plaintext2, &ciphertext1, &ciphertext2) == OpenABE_NOERROR);
+  ASSERT_EQ(plaintext1, plaintext2);
+}
+
+TEST(libopenabe, CCATestsForCpAbeSchemeContextWithThreads) {
+  TEST_DESCRIPTION("Testing that multi-threaded CP-ABE encryption is independent of the thread count");
+  unique_ptr<OpenABEContextSchemeCCA> ccaSchemeContext = OpenABE_createContextABESchemeCCA(OpenABE_SCHEME_CP_WATERS);
+  ASSERT_TRUE(ccaSchemeContext->generateParams(DEFAULT_BP_PARAM, "testMPK", "testMSK") == OpenABE_NOERROR);
+
+  // a policy with enough rows to be shared among the workers
+  string policyStr = "(attr0";
+  vector<string> attributes;
+  attributes.push_back("attr0");
+  for (size_t i = 1; i < 24; i++) {
+    policyStr += (i % 2 ? " and attr" : " or attr") + to_string(i);
+    attributes.push_back("attr" + to_string(i));
+  }
+  policyStr += ")";
+  std::unique_ptr<OpenABEPolicy> policy = createPolicyTree(policyStr);
+  ASSERT_TRUE(policy != nullptr);
+  unique_ptr<OpenABEAttributeList> attrlist(new OpenABEAttributeList(attributes.size(), attributes));
+  ASSERT_TRUE(ccaSchemeContext->keygen(attrlist.get(), "decKey", "testMPK", "testMSK") == OpenABE_NOERROR);
+
+  string plaintext1 = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ", plaintext2;
+  OpenABECiphertext ciphertext1, ciphertext2;
+  ccaSchemeContext->setNumThreads(4);
+  ASSERT_TRUE(ccaSchemeContext->encrypt("testMPK", policy.get(), plaintext1, &ciphertext1, &ciphertext2) == OpenABE_NOERROR);
+  ASSERT_TRUE(ccaSchemeContext->decrypt("testMPK", "decKey", plaintext2, &ciphertext1, &ciphertext2) == OpenABE_NOERROR);
+  ASSERT_EQ(plaintext1, plaintext2);
+
+  // the re-encryption check must also pass when decrypting serially
+  plaintext2.clear();
+  ccaSchemeContext->setNumThreads(1);
+  ASSERT_TRUE(ccaSchemeContext->decrypt("testMPK", "decKey", plaintext2, &ciphertext1, &ciphertext2) == OpenABE_NOERROR);
+  ASSERT_EQ(plaintext1, plaintext2);
+}
+
 TEST(libopenabe, CCATestsForKpAbeSchemeContextWithATZN) {
   TEST_DESCRIPTION("Testing that CCA secure KP-ABE Scheme context with amortization (wrapper around CCA KEM) is correct");
   OpenABECiphertext *ciphertext = nullptr;
@@ -1136,6 +2032,110 @@ TEST(libopenabe, CSPRNG) {
 
 }
 
+TEST(libopenabe, StreamingKDF) {
+  TEST_DESCRIPTION("Testing that the streaming KDF matches the concatenated form");
+  OpenABERNG rng;
+  OpenABEByteString Z, meta1, meta2, metadata;
+  rng.getRandomBytes(&Z, 32);
+  rng.getRandomBytes(&meta1, 7);
+  rng.getRandomBytes(&meta2, 20);
+  metadata = meta1 + meta2;
+
+  OpenABEKDF kdf;
+  OpenABEByteString expected = kdf.DeriveKey(Z, 256, metadata);
+  ASSERT_EQ(expected.size(), (size_t)SHA256_LEN);
+
+  // metadata in pieces hashes the same as the concatenation
+  const OpenABEKDFInput pieces[] = {
+    { meta1.data(), meta1.size() }, { meta2.data(), meta2.size() }
+  };
+  uint8_t out[3 * SHA256_LEN + 5];
+  ASSERT_EQ(kdf.DeriveKey(Z.data(), Z.size(), pieces, 2, out, SHA256_LEN), OpenABE_NOERROR);
+  ASSERT_TRUE(memcmp(out, expected.data(), SHA256_LEN) == 0);
+
+  // longer outputs are the counter blocks back to back
+  ASSERT_EQ(kdf.DeriveKey(Z.data(), Z.size(), pieces, 2, out, sizeof(out)), OpenABE_NOERROR);
+  ASSERT_TRUE(memcmp(out, expected.data(), SHA256_LEN) == 0);
+  OpenABEByteString block2;
+  block2.setFirstBytes(2);
+  block2.push_back(KDF_HASH_FUNCTION_PREFIX);
+  block2 += Z;
+  block2 += metadata;
+  uint8_t digest[SHA256_LEN];
+  sha256(digest, block2.data(), block2.size());
+  ASSERT_TRUE(memcmp(out + SHA256_LEN, digest, SHA256_LEN) == 0);
+
+  ASSERT_EQ(kdf.DeriveKey(Z.data(), Z.size(), pieces, 2, nullptr, 16),
+            OpenABE_ERROR_INVALID_INPUT);
+}
+
+TEST(libopenabe, PasswordProtectedBlobs) {
+  TEST_DESCRIPTION("Testing password blobs with a stored cost and a session key cache");
+  OpenABEByteString blob, ct, pt;
+  blob = "a serialized key blob";
+
+  // the iteration count travels with the blob
+  ASSERT_EQ(encryptUnderPassword("secret", blob, ct, 2000), OpenABE_NOERROR);
+  ASSERT_EQ(decryptUnderPassword("secret", ct, pt), OpenABE_NOERROR);
+  ASSERT_TRUE(pt == blob);
+  ASSERT_NE(decryptUnderPassword("wrong", ct, pt), OpenABE_NOERROR);
+  ASSERT_NE(encryptUnderPassword("secret", blob, ct, 1), OpenABE_NOERROR);
+
+  // blobs without a header still open at the default count
+  OpenABERNG rng;
+  OpenABEByteString salt, key, iv, sym, tag, legacy;
+  rng.getRandomBytes(&salt, SALT_LEN);
+  OpenABEByteString pword;
+  pword = "secret";
+  key = OpenABEPBKDF(pword, DEFAULT_SYM_KEY_BYTES, salt);
+  oabe::crypto::OpenABESymKeyAuthEnc authEnc(DEFAULT_AES_SEC_LEVEL, key);
+  ASSERT_EQ(authEnc.encrypt(blob.toString(), &iv, &sym, &tag), OpenABE_NOERROR);
+  legacy = salt;
+  legacy.smartPack(iv);
+  legacy.smartPack(sym);
+  legacy.smartPack(tag);
+  pt.clear();
+  ASSERT_EQ(decryptUnderPassword("secret", legacy, pt), OpenABE_NOERROR);
+  ASSERT_TRUE(pt == blob);
+
+  // a session derives once for everything it seals
+  OpenABEPasswordKeyCache keys("secret", 2000);
+  vector<OpenABEByteString> sealed(8);
+  for (size_t i = 0; i < sealed.size(); i++) {
+    ASSERT_EQ(encryptUnderPassword(keys, blob, sealed[i]), OpenABE_NOERROR);
+  }
+  ASSERT_EQ(keys.size(), 1U);
+  for (size_t i = 0; i < sealed.size(); i++) {
+    pt.clear();
+    ASSERT_EQ(decryptUnderPassword(keys, sealed[i], pt), OpenABE_NOERROR);
+    ASSERT_TRUE(pt == blob);
+  }
+  ASSERT_EQ(keys.size(), 1U);
+  ASSERT_EQ(decryptUnderPassword("secret", sealed[0], pt), OpenABE_NOERROR);
+  ASSERT_EQ(decryptUnderPassword(keys, ct, pt), OpenABE_NOERROR);
+  ASSERT_EQ(decryptUnderPassword(keys, legacy, pt), OpenABE_NOERROR);
+  ASSERT_EQ(keys.size(), 3U);
+  keys.clear();
+  ASSERT_EQ(keys.size(), 0U);
+  ASSERT_EQ(decryptUnderPassword(keys, sealed[0], pt), OpenABE_NOERROR);
+
+  // a well-formed blob whose header asks for a single iteration is refused
+  OpenABEByteString weak, weakKey;
+  iv.clear(); sym.clear(); tag.clear();
+  weak.appendArray((uint8_t *)"OAPW", 4);
+  weak.pack32bits(1);
+  weak += salt;
+  weakKey = OpenABEPBKDF(pword, DEFAULT_SYM_KEY_BYTES, salt, 1);
+  oabe::crypto::OpenABESymKeyAuthEnc weakEnc(DEFAULT_AES_SEC_LEVEL, weakKey);
+  weakEnc.setAddAuthData(weak);
+  ASSERT_EQ(weakEnc.encrypt(blob.toString(), &iv, &sym, &tag), OpenABE_NOERROR);
+  weak.smartPack(iv);
+  weak.smartPack(sym);
+  weak.smartPack(tag);
+  ASSERT_NE(decryptUnderPassword("secret", weak, pt), OpenABE_NOERROR);
+  ASSERT_NE(decryptUnderPassword(keys, weak, pt), OpenABE_NOERROR);
+}
+
 static size_t offset;
 static int self_test_entropy_callback(void *data, uint8_t *buf, size_t len) {
     const uint8_t *p = (uint8_t *)data;
@@ -1636,6 +2636,76 @@ TEST(libopenabe, CTR_DRBG) {
   ASSERT_TRUE(CTR_DRBG_NIST_Test(15, entropyA_source_nopr, nonceA_pers_nopr, resultA_nopr));
 }
 
+TEST(libopenabe, ThreadRNG) {
+  TEST_DESCRIPTION("Testing that the per-thread CTR_DRBGs produce independent streams");
+  OpenABEThreadRNG rng;
+  const size_t numThreads = 8;
+  vector<string> firstBlocks(numThreads);
+  vector<std::thread> threads;
+
+  // one RNG object shared by all threads, past the reseed interval
+  for (size_t t = 0; t < numThreads; t++) {
+    threads.emplace_back([&, t]() {
+      uint8_t buf[32];
+      for (int i = 0; i < OpenABE_CTR_DRBG_RESEED_INTERVAL + 10; i++) {
+        rng.getRandomBytes(buf, sizeof(buf));
+        if (i == 0) {
+          firstBlocks[t].assign((char *)buf, sizeof(buf));
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  sort(firstBlocks.begin(), firstBlocks.end());
+  ASSERT_TRUE(unique(firstBlocks.begin(), firstBlocks.end()) == firstBlocks.end());
+
+  // requests larger than a single DRBG call
+  OpenABEByteString buf1, buf2;
+  ASSERT_EQ(rng.getRandomBytes(&buf1, 4 * OpenABE_CTR_DRBG_MAX_REQUEST + 7), 1);
+  ASSERT_EQ(rng.getRandomBytes(&buf2, 4 * OpenABE_CTR_DRBG_MAX_REQUEST + 7), 1);
+  ASSERT_EQ(buf1.size(), (size_t)(4 * OpenABE_CTR_DRBG_MAX_REQUEST + 7));
+  ASSERT_FALSE(buf1 == buf2);
+}
+
+TEST(libopenabe, BufferedRNG) {
+  TEST_DESCRIPTION("Testing that the buffered RNG hands out slices of whole source blocks");
+  OpenABEByteString seed, nonce, expected, got, part;
+  seed.fillBuffer(0x5a, OpenABE_CTR_DRBG_ENTROPYLEN);
+  nonce.fillBuffer(0xa5, 16);
+  OpenABECTR_DRBG source(seed), reference(seed);
+  source.setSeed(nonce);
+  reference.setSeed(nonce);
+
+  const size_t blockSize = 64;
+  OpenABEBufferedRNG rng(&source, blockSize);
+  // scalar-sized requests drain one block of the source
+  size_t sizes[] = { 10, 22, 32 };
+  for (size_t n : sizes) {
+    ASSERT_EQ(rng.getRandomBytes(&part, n), 1);
+    ASSERT_EQ(part.size(), n);
+    got += part;
+  }
+  reference.getRandomBytes(&expected, blockSize);
+  ASSERT_TRUE(got == expected);
+
+  // a request spanning a refill continues into the next block
+  ASSERT_EQ(rng.getRandomBytes(&part, 16), 1);
+  ASSERT_EQ(rng.getRandomBytes(&got, 56), 1);
+  reference.getRandomBytes(&expected, blockSize);
+  ASSERT_TRUE(memcmp(part.getInternalPtr(), expected.getInternalPtr(), 16) == 0);
+  ASSERT_TRUE(memcmp(got.getInternalPtr(), expected.getInternalPtr() + 16, 48) == 0);
+  reference.getRandomBytes(&expected, blockSize);
+  ASSERT_TRUE(memcmp(got.getInternalPtr() + 48, expected.getInternalPtr(), 8) == 0);
+
+  // requests of a block or more go straight to the source once the pool is empty
+  rng.discard();
+  ASSERT_EQ(rng.getRandomBytes(&got, 2 * blockSize), 1);
+  reference.getRandomBytes(&expected, 2 * blockSize);
+  ASSERT_TRUE(got == expected);
+}
+
 TEST(libopenabe, SymKeyOperations) {
   TEST_DESCRIPTION("Testing OpenABE keystore handling of symmetric keys is correct");
   shared_ptr<OpenABESymKey> symkey1(new OpenABESymKey);
@@ -1686,6 +2756,55 @@ TEST(libopenabe, SymKeyOperations) {
   SAFE_DELETE(ks);
 }
 
+struct keystore_test_data {
+  OpenABEKeystore *ks;
+  bool allFound;
+};
+
+void *keystore_reader(void *data) {
+  keystore_test_data *d = (keystore_test_data *) data;
+  for (int i = 0; i < 2000; i++) {
+    if (d->ks->getSecretKey("stableKey") == nullptr) {
+      d->allFound = false;
+    }
+    d->ks->getKey("key" + to_string(i % 50));
+  }
+  return NULL;
+}
+
+TEST(libopenabe, KeystoreConcurrentLookups) {
+  TEST_DESCRIPTION("Testing that keystore lookups are safe while keys are added and deleted");
+  OpenABEKeystore ks;
+  shared_ptr<OpenABESymKey> stable(new OpenABESymKey);
+  stable->generateSymmetricKey(DEFAULT_SYM_KEY_BYTES);
+  ASSERT_TRUE(ks.addKey("stableKey", stable, KEY_TYPE_SECRET) == OpenABE_NOERROR);
+
+  const int count = 4;
+  pthread_t readers[count];
+  keystore_test_data data[count];
+  for (int i = 0; i < count; i++) {
+    data[i] = { &ks, true };
+    ASSERT_EQ(pthread_create(&readers[i], NULL, keystore_reader, (void *) &data[i]), 0);
+  }
+  // churn other keys while the readers run
+  for (int round = 0; round < 20; round++) {
+    for (int i = 0; i < 50; i++) {
+      shared_ptr<OpenABESymKey> key(new OpenABESymKey);
+      key->generateSymmetricKey(DEFAULT_SYM_KEY_BYTES);
+      ks.addKey("key" + to_string(i), key, KEY_TYPE_SECRET);
+    }
+    for (int i = 0; i < 50; i++) {
+      ASSERT_TRUE(ks.deleteKey("key" + to_string(i)) == OpenABE_NOERROR);
+    }
+  }
+  for (int i = 0; i < count; i++) {
+    ASSERT_EQ(pthread_join(readers[i], NULL), 0);
+    ASSERT_TRUE(data[i].allFound);
+  }
+  ASSERT_TRUE(ks.deleteKey("missingKey") == OpenABE_NOERROR);
+  ASSERT_TRUE(ks.getSecretKey("key0") == nullptr);
+}
+
 TEST(libopenabe, SymKeyAuthEnc) {
   TEST_DESCRIPTION("Testing that AES GCM implementation is correct");
   shared_ptr<OpenABESymKey> symkey(new OpenABESymKey);
@@ -1718,6 +2837,164 @@ TEST(libopenabe, SymKeyAuthEnc) {
   ASSERT_TRUE(authEnc->decrypt(plaintext2, &iv, &ct, &tag));
 }
 
+TEST(libopenabe, SymKeyAuthEncReuse) {
+  TEST_DESCRIPTION("Testing that one AES GCM object encrypts and decrypts many messages");
+  shared_ptr<OpenABESymKey> symkey(new OpenABESymKey);
+  OpenABEByteString sym_key_bytes;
+  symkey->generateSymmetricKey(DEFAULT_SYM_KEY_BYTES);
+  symkey->exportKeyToBytes(sym_key_bytes);
+  OpenABESymKeyAuthEnc authEnc(DEFAULT_AES_SEC_LEVEL, sym_key_bytes);
+  OpenABESymKeyAuthEnc other(DEFAULT_AES_SEC_LEVEL, sym_key_bytes);
+  authEnc.setAddAuthData(NULL, 0);
+  other.setAddAuthData(NULL, 0);
+
+  for (size_t len : { 1, 15, 16, 100, 1000 }) {
+    string plaintext1(len, 'a' + (len % 26)), plaintext2;
+    OpenABEByteString iv, ct, tag;
+    ASSERT_EQ(authEnc.encrypt(plaintext1, &iv, &ct, &tag), OpenABE_NOERROR);
+    ASSERT_EQ(ct.size(), len);
+    ASSERT_TRUE(authEnc.decrypt(plaintext2, &iv, &ct, &tag));
+    ASSERT_EQ(plaintext1, plaintext2);
+
+    // the buffer API produces the same format, without allocating
+    vector<uint8_t> ct2(len), pt2(len);
+    uint8_t iv2[AES_BLOCK_SIZE], tag2[AES_BLOCK_SIZE];
+    ASSERT_EQ(authEnc.encrypt((const uint8_t *)plaintext1.data(), len, iv2, ct2.data(), tag2),
+              OpenABE_NOERROR);
+    ASSERT_TRUE(other.decrypt(pt2.data(), ct2.data(), len, iv2, AES_BLOCK_SIZE, tag2));
+    ASSERT_EQ(string(pt2.begin(), pt2.end()), plaintext1);
+
+    // a bad tag fails and leaves no plaintext behind, the next message works
+    tag2[0] ^= 1;
+    ASSERT_FALSE(other.decrypt(pt2.data(), ct2.data(), len, iv2, AES_BLOCK_SIZE, tag2));
+    ASSERT_EQ(pt2, vector<uint8_t>(len, 0));
+    plaintext2.clear();
+    ASSERT_TRUE(other.decrypt(plaintext2, &iv, &ct, &tag));
+    ASSERT_EQ(plaintext1, plaintext2);
+  }
+}
+
+TEST(libopenabe, SymKeyChunkedAuthEnc) {
+  TEST_DESCRIPTION("Testing that chunked AES GCM decrypts by range and detects reordering and truncation");
+  shared_ptr<OpenABESymKey> symkey(new OpenABESymKey);
+  OpenABEByteString sym_key_bytes, aad;
+  symkey->generateSymmetricKey(DEFAULT_SYM_KEY_BYTES);
+  symkey->exportKeyToBytes(sym_key_bytes);
+  aad = "header";
+  OpenABESymKeyChunkedAuthEnc authEnc(DEFAULT_AES_SEC_LEVEL, sym_key_bytes);
+  authEnc.setAddAuthData(aad);
+
+  const size_t chunk = 1024;
+  for (size_t len : { 1, 1023, 1024, 1025, 10000 }) {
+    vector<uint8_t> pt(len), pt2(len);
+    for (size_t i = 0; i < len; i++) {
+      pt[i] = (uint8_t)(i * 31 + 7);
+    }
+    vector<uint8_t> ct(OpenABESymKeyChunkedAuthEnc::getCiphertextSize(len, chunk));
+    ASSERT_EQ(authEnc.encrypt(pt.data(), len, ct.data(), chunk), OpenABE_NOERROR);
+    ASSERT_EQ(OpenABESymKeyChunkedAuthEnc::getPlaintextSize(ct.data(), ct.size()), len);
+    ASSERT_TRUE(authEnc.decrypt(pt2.data(), ct.data(), ct.size()));
+    ASSERT_EQ(pt, pt2);
+
+    // ranges within a chunk and across chunk boundaries
+    for (size_t off : { (size_t)0, len / 3, len - 1 }) {
+      size_t n = min(len - off, chunk + 10);
+      vector<uint8_t> part(n);
+      ASSERT_TRUE(authEnc.decryptRange(part.data(), ct.data(), ct.size(), off, n));
+      ASSERT_TRUE(equal(part.begin(), part.end(), pt.begin() + off));
+    }
+    ASSERT_FALSE(authEnc.decryptRange(pt2.data(), ct.data(), ct.size(), len, 1));
+  }
+
+  vector<uint8_t> pt(10 * chunk, 'x'), pt2(pt.size());
+  vector<uint8_t> ct(OpenABESymKeyChunkedAuthEnc::getCiphertextSize(pt.size(), chunk));
+  ASSERT_EQ(authEnc.encrypt(pt.data(), pt.size(), ct.data(), chunk), OpenABE_NOERROR);
+  const size_t hdr = ct.size() - pt.size() - 10 * AES_BLOCK_SIZE, unit = chunk + AES_BLOCK_SIZE;
+
+  // dropping the tail at a chunk boundary is caught when the new last chunk is read
+  size_t truncated = hdr + 4 * unit;
+  ASSERT_FALSE(authEnc.decrypt(pt2.data(), ct.data(), truncated));
+  ASSERT_FALSE(authEnc.decryptRange(pt2.data(), ct.data(), truncated, 3 * chunk, 10));
+  ASSERT_TRUE(authEnc.decryptRange(pt2.data(), ct.data(), truncated, 0, 10));
+
+  // swapping two chunks breaks both, other chunks still decrypt
+  vector<uint8_t> swapped(ct);
+  swap_ranges(swapped.begin() + hdr, swapped.begin() + hdr + unit, swapped.begin() + hdr + unit);
+  ASSERT_FALSE(authEnc.decryptRange(pt2.data(), swapped.data(), swapped.size(), 0, 10));
+  ASSERT_FALSE(authEnc.decryptRange(pt2.data(), swapped.data(), swapped.size(), chunk, 10));
+  ASSERT_TRUE(authEnc.decryptRange(pt2.data(), swapped.data(), swapped.size(), 2 * chunk, 10));
+
+  // a tampered header or different AAD fails everywhere
+  OpenABESymKeyChunkedAuthEnc other(DEFAULT_AES_SEC_LEVEL, sym_key_bytes);
+  ASSERT_FALSE(other.decrypt(pt2.data(), ct.data(), ct.size()));
+  ASSERT_EQ(pt2, vector<uint8_t>(pt2.size(), 0));
+  ct[hdr - 1] ^= 0x01;
+  ASSERT_FALSE(authEnc.decryptRange(pt2.data(), ct.data(), ct.size(), 5 * chunk, 10));
+}
+
+TEST(libopenabe, SymKeyChunkedAuthEncStream) {
+  TEST_DESCRIPTION("Testing that streaming chunked AES GCM matches the one-shot format");
+  shared_ptr<OpenABESymKey> symkey(new OpenABESymKey);
+  OpenABEByteString sym_key_bytes, aad;
+  symkey->generateSymmetricKey(DEFAULT_SYM_KEY_BYTES);
+  symkey->exportKeyToBytes(sym_key_bytes);
+  aad = "header";
+  OpenABESymKeyChunkedAuthEnc authEnc(DEFAULT_AES_SEC_LEVEL, sym_key_bytes);
+  authEnc.setAddAuthData(aad);
+
+  const size_t chunk = 1000;
+  for (size_t len : { 1, 999, 1000, 1001, 5000, 12345 }) {
+    vector<uint8_t> pt(len);
+    for (size_t i = 0; i < len; i++) {
+      pt[i] = (uint8_t)(i * 13 + 1);
+    }
+    // feed pieces of varying sizes
+    OpenABEByteString ct;
+    ASSERT_EQ(authEnc.encryptInit(&ct, chunk), OpenABE_NOERROR);
+    for (size_t pos = 0, step = 1; pos < len; pos += step, step = step * 3 + 7) {
+      ASSERT_EQ(authEnc.encryptUpdate(pt.data() + pos, min(step, len - pos), &ct), OpenABE_NOERROR);
+      // never more than one chunk held back
+      ASSERT_GE(ct.size() + chunk + AES_BLOCK_SIZE,
+                OpenABESymKeyChunkedAuthEnc::getCiphertextSize(min(pos + step, len), chunk));
+    }
+    ASSERT_EQ(authEnc.encryptFinalize(&ct), OpenABE_NOERROR);
+    ASSERT_EQ(ct.size(), OpenABESymKeyChunkedAuthEnc::getCiphertextSize(len, chunk));
+    vector<uint8_t> pt2(len);
+    ASSERT_TRUE(authEnc.decrypt(pt2.data(), ct.getInternalPtr(), ct.size()));
+    ASSERT_EQ(pt, pt2);
+
+    // and the other way around, a few bytes at a time
+    OpenABEByteString pt3;
+    authEnc.decryptInit();
+    for (size_t pos = 0; pos < ct.size(); pos += 777) {
+      ASSERT_TRUE(authEnc.decryptUpdate(ct.getInternalPtr() + pos, min((size_t)777, ct.size() - pos), &pt3));
+    }
+    ASSERT_TRUE(authEnc.decryptFinalize(&pt3));
+    ASSERT_EQ(vector<uint8_t>(pt3.begin(), pt3.end()), pt);
+
+    // a truncated stream is rejected at the end
+    pt3.clear();
+    authEnc.decryptInit();
+    ASSERT_TRUE(authEnc.decryptUpdate(ct.getInternalPtr(), ct.size() - 1, &pt3));
+    ASSERT_FALSE(authEnc.decryptFinalize(&pt3));
+  }
+
+  // a tampered chunk stops the stream before its plaintext is released
+  vector<uint8_t> pt(5 * chunk, 'y');
+  OpenABEByteString ct, pt2;
+  ASSERT_EQ(authEnc.encryptInit(&ct, chunk), OpenABE_NOERROR);
+  ASSERT_EQ(authEnc.encryptUpdate(pt.data(), pt.size(), &ct), OpenABE_NOERROR);
+  ASSERT_EQ(authEnc.encryptFinalize(&ct), OpenABE_NOERROR);
+  ct[ct.size() / 2] ^= 0x01;
+  authEnc.decryptInit();
+  ASSERT_FALSE(authEnc.decryptUpdate(ct.getInternalPtr(), ct.size(), &pt2));
+  ASSERT_EQ(pt2.size(), 2 * chunk);
+  ASSERT_FALSE(authEnc.decryptFinalize(&pt2));
+  // finalizing an empty stream is an error
+  ASSERT_EQ(authEnc.encryptInit(&ct, chunk), OpenABE_NOERROR);
+  ASSERT_NE(authEnc.encryptFinalize(&ct), OpenABE_NOERROR);
+}
+
 TEST(libopenabe, SymKeyAuthEnc_Stream) {
   TEST_DESCRIPTION("Testing that SK streaming encryption is correct");
   shared_ptr<OpenABESymKey> symkey(new OpenABESymKey);
@@ -2138,26 +3415,1124 @@ TEST(libopenabe, CryptoBoxCPABEContext) {
   ASSERT_FALSE(cpabe2.decrypt("key2", ct2, pt3));
 }
 
-TEST(libopenabe, CryptoBoxCPABEContextMinusBase64Encoding) {
-  TEST_DESCRIPTION("Testing that crypto box for CP-ABE context works (without base64 encoding)");
-  string mpk, msk;
+TEST(libopenabe, CryptoBoxCPFAMEContext) {
+  TEST_DESCRIPTION("Testing that crypto box for the CP-FAME context works");
+  string mpk, msk, key1;
   string ct1, ct2;
 
-  OpenABECryptoContext cpabe("CP-ABE", false);
+  OpenABECryptoContext fame("CP-FAME");
+  fame.generateParams();
+  fame.exportPublicParams(mpk);
+  fame.exportSecretParams(msk);
+
+  fame.keygen("|one|two|three", "key1");
+  fame.keygen("|one|two", "key2");
+  fame.exportUserKey("key1", key1);
+
+  string pt1 = "hello world!", pt2, pt3;
+  fame.encrypt("((one or two) and three)", pt1, ct1);
+  ASSERT_TRUE(fame.decrypt("key1", ct1, pt2));
+  ASSERT_EQ(pt1, pt2);
+  ASSERT_FALSE(fame.decrypt("key2", ct1, pt3));
 
+  // repeated attributes in the policy land on distinct rows
+  pt2.clear();
+  fame.encrypt("((one and two) or (one and three))", pt1, ct2);
+  ASSERT_TRUE(fame.decrypt("key2", ct2, pt2));
+  ASSERT_EQ(pt1, pt2);
+
+  // a context that only holds the MPK encrypts for an imported key
+  OpenABECryptoContext fame2("CP-FAME");
+  fame2.importPublicParams(mpk);
+  fame2.importUserKey("key1", key1);
+  pt2.clear();
+  fame2.encrypt("(one and three)", pt1, ct2);
+  ASSERT_TRUE(fame2.decrypt("key1", ct2, pt2));
+  ASSERT_EQ(pt1, pt2);
+  ASSERT_TRUE(fame.decrypt("key1", ct2, pt2));
+
+  // ciphertexts grow by two G1 elements per row instead of a G1 and a G2
+  OpenABECryptoContext cpabe("CP-ABE");
   cpabe.generateParams();
-  cpabe.exportPublicParams(mpk);
-  cpabe.exportSecretParams(msk);
+  string policy = "(a and b and c and d and e and f and g and h)", ct3, ct4;
+  fame.encrypt(policy, pt1, ct3);
+  cpabe.encrypt(policy, pt1, ct4);
+  cout << "CP-FAME: " << ct3.size() << " CP-ABE: " << ct4.size() << endl;
+  ASSERT_LT(ct3.size(), ct4.size());
+}
+
+TEST(libopenabe, CryptoBoxCPABEFDContext) {
+  TEST_DESCRIPTION("Testing that crypto box for the fast-decryption CP-ABE context works");
+  for (const char *scheme : {"CP-ABE-FD", "CP-ABE-FD-HCCA"}) {
+    string mpk, key1, ct1, ct2, ct3;
+    OpenABECryptoContext fd(scheme);
+    fd.generateParams();
+    fd.exportPublicParams(mpk);
+    fd.keygen("|one|two|three", "key1");
+    fd.keygen("|one|two", "key2");
+    fd.exportUserKey("key1", key1);
+
+    string pt1 = "hello world!", pt2, pt3;
+    fd.encrypt("((one or two) and three)", pt1, ct1);
+    ASSERT_TRUE(fd.decrypt("key1", ct1, pt2));
+    ASSERT_EQ(pt1, pt2);
+    ASSERT_FALSE(fd.decrypt("key2", ct1, pt3));
+
+    // repeated attributes hash to a different point on each row
+    pt2.clear();
+    fd.encrypt("((one and two) or (one and three))", pt1, ct2);
+    ASSERT_TRUE(fd.decrypt("key2", ct2, pt2));
+    ASSERT_EQ(pt1, pt2);
+    pt2.clear();
+    fd.encrypt("(((one and three) or (two and three)) or (one and two))", pt1, ct3);
+    ASSERT_TRUE(fd.decrypt("key2", ct3, pt2));
+    ASSERT_EQ(pt1, pt2);
+
+    // keys only cover OpenABE_CP_FD_ATTRIBUTE_USES rows per attribute
+    string policy = "one";
+    for (size_t i = 1; i <= OpenABE_CP_FD_ATTRIBUTE_USES; i++) {
+      policy = "(" + policy + " or one)";
+    }
+    ASSERT_ANY_THROW(fd.encrypt(policy, pt1, ct3));
+
+    // a context that only holds the MPK encrypts for an imported key
+    OpenABECryptoContext fd2(scheme);
+    fd2.importPublicParams(mpk);
+    fd2.importUserKey("key1", key1);
+    pt2.clear();
+    fd2.encrypt("(one and three)", pt1, ct2);
+    ASSERT_TRUE(fd2.decrypt("key1", ct2, pt2));
+    ASSERT_EQ(pt1, pt2);
+    ASSERT_TRUE(fd.decrypt("key1", ct2, pt2));
+  }
+
+  // a single G2 element for the ciphertext instead of one per row
+  string pt = "hello world!", ct1, ct2;
+  OpenABECryptoContext fd("CP-ABE-FD"), cpabe("CP-ABE");
+  fd.generateParams();
+  cpabe.generateParams();
+  string policy = "(a and b and c and d and e and f and g and h)";
+  fd.encrypt(policy, pt, ct1);
+  cpabe.encrypt(policy, pt, ct2);
+  cout << "CP-ABE-FD: " << ct1.size() << " CP-ABE: " << ct2.size() << endl;
+  ASSERT_LT(ct1.size(), ct2.size());
+}
 
+TEST(libopenabe, CryptoBoxCPABEContextBatch) {
+  TEST_DESCRIPTION("Testing that batch encryption in the CP-ABE crypto box works");
+  OpenABECryptoContext cpabe("CP-ABE");
+  cpabe.generateParams();
   cpabe.keygen("|one|two|three", "key1");
   cpabe.keygen("|one|two", "key2");
 
-  string pt1 = "hello world!", pt2;
-  cpabe.encrypt("((one or two) and three)", pt1, ct1);
+  vector<string> pts, cts;
+  for (size_t i = 0; i < 16; i++) {
+    pts.push_back("record number " + to_string(i));
+  }
+  cpabe.encryptBatch("((one or two) and three)", pts, cts);
+  ASSERT_EQ(cts.size(), pts.size());
+  for (size_t i = 0; i < pts.size(); i++) {
+    string pt;
+    ASSERT_TRUE(cpabe.decrypt("key1", cts[i], pt));
+    ASSERT_EQ(pt, pts[i]);
+    ASSERT_FALSE(cpabe.decrypt("key2", cts[i], pt));
+  }
 
-  cout << "Ciphertext: " << ct1.size() << endl;
+  // an empty batch is a no-op, bad inputs throw
+  vector<string> none;
+  cpabe.encryptBatch("(one and two)", none, cts);
+  ASSERT_TRUE(cts.empty());
+  ASSERT_ANY_THROW(cpabe.encryptBatch("(one or ", pts, cts));
+  pts.push_back("");
+  ASSERT_ANY_THROW(cpabe.encryptBatch("(one and two)", pts, cts));
+}
 
-  ASSERT_TRUE(cpabe.decrypt("key1", ct1, pt2));
+TEST(libopenabe, CryptoBoxDecryptBatch) {
+  TEST_DESCRIPTION("Testing that batch decryption reports a status per ciphertext");
+  for (auto scheme : { "CP-ABE", "KP-ABE" }) {
+    bool cp = (string(scheme) == "CP-ABE");
+    OpenABECryptoContext abe(scheme);
+    abe.generateParams();
+    abe.keygen(cp ? "|one|two" : "(one and two)", "key1");
+
+    // two groups the key satisfies, one it doesn't, and a malformed entry
+    const char *good1 = cp ? "(one and two)" : "|one|two";
+    const char *good2 = cp ? "(one or three)" : "|one|two|three";
+    const char *bad = cp ? "(three and four)" : "|three|four";
+    vector<string> pts, cts;
+    for (size_t i = 0; i < 12; i++) {
+      string ct, pt = "record number " + to_string(i);
+      abe.encrypt((i % 3 == 0) ? good1 : ((i % 3 == 1) ? good2 : bad), pt, ct);
+      pts.push_back(pt);
+      cts.push_back(ct);
+    }
+    cts.push_back("not a ciphertext");
+
+    vector<string> out;
+    vector<bool> ok;
+    ASSERT_EQ(abe.decryptBatch("key1", cts, out, ok), 8U);
+    ASSERT_EQ(out.size(), cts.size());
+    ASSERT_EQ(ok.size(), cts.size());
+    for (size_t i = 0; i < pts.size(); i++) {
+      ASSERT_EQ(ok[i], (i % 3 != 2));
+      ASSERT_EQ(out[i], ok[i] ? pts[i] : "");
+    }
+    ASSERT_FALSE(ok.back());
+
+    // an unknown key fails every item, an empty batch is a no-op
+    ASSERT_EQ(abe.decryptBatch("key2", cts, out, ok), 0U);
+    vector<string> none;
+    ASSERT_EQ(abe.decryptBatch("key1", none, out, ok), 0U);
+    ASSERT_TRUE(out.empty());
+  }
+}
+
+TEST(libopenabe, CryptoBoxKeygenMany) {
+  TEST_DESCRIPTION("Testing that batch key generation matches keygen and is all-or-nothing");
+  OpenABECryptoContext kpabe("KP-ABE");
+  kpabe.generateParams();
+  vector<string> policies, ids;
+  for (size_t i = 0; i < 12; i++) {
+    policies.push_back((i % 2) ? "((dept:eng or dept:ops) and region:us)"
+                               : "(dept:eng and clearance:" + to_string(i) + ")");
+    ids.push_back("user" + to_string(i));
+  }
+  kpabe.keygenMany(policies, ids);
+
+  string ct1, ct2, pt;
+  kpabe.encrypt("|dept:eng|region:us", "message one", ct1);
+  kpabe.encrypt("|dept:eng|clearance:4", "message two", ct2);
+  for (size_t i = 0; i < ids.size(); i++) {
+    ASSERT_EQ(kpabe.decrypt(ids[i], ct1, pt), (i % 2) == 1);
+    ASSERT_EQ(kpabe.decrypt(ids[i], ct2, pt), i == 4);
+  }
+  ASSERT_EQ(pt, "message two");
+
+  // mismatched lengths and a malformed policy throw without adding keys
+  vector<string> more = { "(dept:eng and region:eu)", "(dept:eng or " };
+  vector<string> moreIds = { "user12", "user13" };
+  ASSERT_ANY_THROW(kpabe.keygenMany(more, ids));
+  ASSERT_ANY_THROW(kpabe.keygenMany(more, moreIds));
+  ASSERT_FALSE(kpabe.deleteKey("user12"));
+  ASSERT_FALSE(kpabe.deleteKey("user13"));
+}
+
+TEST(libopenabe, CryptoBoxSpanEncDec) {
+  TEST_DESCRIPTION("Testing that the buffer-based encrypt/decrypt interoperates with the string API");
+  OpenABECryptoContext cpabe("CP-ABE", false);
+  cpabe.generateParams();
+  cpabe.keygen("|one|two", "key1");
+
+  // sizes that exercise each smartPack size class of the CT component
+  for (size_t len : { 1, 200, 1000, 70000 }) {
+    string pt1(len, 'x'), pt2, ct1;
+    vector<uint8_t> ct2, pt3;
+    auto ctSink = [&](size_t n) { ct2.resize(n); return ct2.data(); };
+    auto ptSink = [&](size_t n) { pt3.resize(n); return pt3.data(); };
+
+    // span encrypt -> string decrypt
+    cpabe.encrypt("(one and two)", (const uint8_t *)pt1.data(), pt1.size(), ctSink);
+    ASSERT_TRUE(cpabe.decrypt("key1", string(ct2.begin(), ct2.end()), pt2));
+    ASSERT_EQ(pt1, pt2);
+
+    // string encrypt -> span decrypt
+    cpabe.encrypt("(one or three)", pt1, ct1);
+    ASSERT_TRUE(cpabe.decrypt("key1", (const uint8_t *)ct1.data(), ct1.size(), ptSink));
+    ASSERT_EQ(pt1, string(pt3.begin(), pt3.end()));
+
+    // tampering is detected and the output zeroized
+    ct1[ct1.size() - 1] ^= 0x01;
+    ASSERT_FALSE(cpabe.decrypt("key1", (const uint8_t *)ct1.data(), ct1.size(), ptSink));
+    ASSERT_EQ(string(pt3.size(), '\0'), string(pt3.begin(), pt3.end()));
+  }
+
+  // truncated input, an unsatisfied policy and an empty plaintext
+  vector<uint8_t> ct, pt;
+  auto ctSink = [&](size_t n) { ct.resize(n); return ct.data(); };
+  auto ptSink = [&](size_t n) { pt.resize(n); return pt.data(); };
+  string msg = "hello world!";
+  cpabe.encrypt("(one and two)", (const uint8_t *)msg.data(), msg.size(), ctSink);
+  ASSERT_FALSE(cpabe.decrypt("key1", ct.data(), ct.size() - 1, ptSink));
+  ASSERT_FALSE(cpabe.decrypt("key1", ct.data(), 3, ptSink));
+  cpabe.encrypt("(three and four)", (const uint8_t *)msg.data(), msg.size(), ctSink);
+  ASSERT_FALSE(cpabe.decrypt("key1", ct.data(), ct.size(), ptSink));
+  ASSERT_ANY_THROW(cpabe.encrypt("(one and two)", (const uint8_t *)msg.data(), 0, ctSink));
+}
+
+TEST(libopenabe, CryptoBoxChunkedEncDec) {
+  TEST_DESCRIPTION("Testing chunked encryption of large payloads with random-access decryption");
+  OpenABECryptoContext kpabe("KP-ABE");
+  kpabe.generateParams();
+  kpabe.keygen("((one or two) and three)", "key1");
+
+  vector<uint8_t> pt(300000), ct, pt2;
+  for (size_t i = 0; i < pt.size(); i++) {
+    pt[i] = (uint8_t)(i % 251);
+  }
+  auto ctSink = [&](size_t n) { ct.resize(n); return ct.data(); };
+  auto ptSink = [&](size_t n) { pt2.resize(n); return pt2.data(); };
+  kpabe.encryptChunked("|one|three", pt.data(), pt.size(), ctSink, 4096);
+  ASSERT_TRUE(kpabe.decryptChunked("key1", ct.data(), ct.size(), ptSink));
+  ASSERT_EQ(pt, pt2);
+
+  // only the chunks covering a range are decrypted
+  size_t offset = 0;
+  unique_ptr<OpenABESymKeyChunkedAuthEnc> payload =
+      kpabe.openChunked("key1", ct.data(), ct.size(), offset);
+  ASSERT_TRUE(payload != nullptr);
+  vector<uint8_t> part(5000);
+  ASSERT_TRUE(payload->decryptRange(part.data(), ct.data() + offset, ct.size() - offset,
+                                    123456, part.size()));
+  ASSERT_TRUE(equal(part.begin(), part.end(), pt.begin() + 123456));
+
+  // wrong key or attributes, and a tampered payload
+  ASSERT_TRUE(kpabe.openChunked("key2", ct.data(), ct.size(), offset) == nullptr);
+  kpabe.keygen("(one and two)", "key2");
+  ASSERT_FALSE(kpabe.decryptChunked("key2", ct.data(), ct.size(), ptSink));
+  ct[ct.size() - 1] ^= 0x01;
+  ASSERT_FALSE(kpabe.decryptChunked("key1", ct.data(), ct.size(), ptSink));
+  ASSERT_ANY_THROW(kpabe.encryptChunked("|one", pt.data(), 0, ctSink));
+}
+
+TEST(libopenabe, CryptoBoxRewrap) {
+  TEST_DESCRIPTION("Testing that rewrap changes the policy of a ciphertext and keeps its payload");
+  OpenABECryptoContext cpabe("CP-ABE");
+  cpabe.generateParams();
+  cpabe.keygen("|one|two", "key1");
+  cpabe.keygen("|three", "key2");
+
+  vector<uint8_t> pt(100000), ct, pt2;
+  for (size_t i = 0; i < pt.size(); i++) {
+    pt[i] = (uint8_t)(i % 251);
+  }
+  auto ctSink = [&](size_t n) { ct.resize(n); return ct.data(); };
+  auto ptSink = [&](size_t n) { pt2.resize(n); return pt2.data(); };
+  cpabe.encryptWrapped("one and two", pt.data(), pt.size(), ctSink, 4096);
+  ASSERT_TRUE(cpabe.decryptWrapped("key1", ct.data(), ct.size(), ptSink));
+  ASSERT_EQ(pt, pt2);
+  ASSERT_FALSE(cpabe.decryptWrapped("key2", ct.data(), ct.size(), ptSink));
+
+  // only the header is given and replaced; the payload is kept byte for byte
+  string header;
+  size_t offset = 0;
+  ASSERT_FALSE(cpabe.rewrap("key2", ct.data(), ct.size(), "three", header, offset));
+  ASSERT_TRUE(cpabe.rewrap("key1", ct.data(), ct.size() / 2, "three", header, offset));
+  vector<uint8_t> ct2(header.begin(), header.end());
+  ct2.insert(ct2.end(), ct.begin() + offset, ct.end());
+  ASSERT_TRUE(cpabe.decryptWrapped("key2", ct2.data(), ct2.size(), ptSink));
+  ASSERT_EQ(pt, pt2);
+  ASSERT_FALSE(cpabe.decryptWrapped("key1", ct2.data(), ct2.size(), ptSink));
+
+  // a tampered wrapped key
+  vector<uint8_t> bad(header.begin(), header.end());
+  bad[bad.size() - 1] ^= 0x01;
+  bad.insert(bad.end(), ct.begin() + offset, ct.end());
+  ASSERT_FALSE(cpabe.decryptWrapped("key2", bad.data(), bad.size(), ptSink));
+}
+
+TEST(libopenabe, CryptoBoxEstimate) {
+  TEST_DESCRIPTION("Testing that the encryption estimate matches the actual ciphertexts");
+  OpenABECryptoContext cpabe("CP-ABE");
+  cpabe.generateParams();
+  string pt(1000, 'x'), ct;
+  vector<uint8_t> out;
+  auto sink = [&](size_t n) { out.resize(n); return out.data(); };
+
+  OpenABEEncryptionEstimate est;
+  cpabe.estimate("(one and two) or three", est, pt.size(), 256);
+  ASSERT_EQ(3U, est.cost.rows);
+  ASSERT_EQ(1U, est.cost.minDecryptRows);
+  ASSERT_LE(est.compactHeaderBytes, est.headerBytes);
+  cpabe.encrypt("(one and two) or three", pt, ct);
+  ASSERT_EQ(est.ciphertextBytes, ct.size());
+  cpabe.encrypt("(one and two) or three", (const uint8_t *)pt.data(), pt.size(), sink);
+  ASSERT_EQ(est.binaryBytes, out.size());
+  cpabe.encryptChunked("(one and two) or three", (const uint8_t *)pt.data(), pt.size(), sink, 256);
+  ASSERT_EQ(est.chunkedBytes, out.size());
+
+  // more rows cost more
+  OpenABEEncryptionEstimate est2;
+  cpabe.estimate("one and two and three and four", est2, pt.size());
+  ASSERT_EQ(4U, est2.cost.minDecryptRows);
+  ASSERT_GT(est2.cost.encryptExps, est.cost.encryptExps);
+  ASSERT_GT(est2.cost.decryptPairings, est.cost.decryptPairings);
+
+  OpenABECryptoContext kpabe("KP-ABE", false);
+  kpabe.generateParams();
+  kpabe.estimate("|one|two|three", est, pt.size());
+  ASSERT_EQ(3U, est.cost.rows);
+  kpabe.encrypt("|one|two|three", pt, ct);
+  ASSERT_EQ(est.ciphertextBytes, ct.size());
+  ASSERT_EQ(est.binaryBytes, ct.size());
+
+  ASSERT_THROW(cpabe.estimate("one and", est, pt.size()), ZCryptoBoxException);
+}
+
+TEST(libopenabe, CryptoBoxStreamEncDec) {
+  TEST_DESCRIPTION("Testing streaming ABE encryption and decryption in the crypto box");
+  OpenABECryptoContext cpabe("CP-ABE");
+  cpabe.generateParams();
+  cpabe.keygen("|one|two", "key1");
+  cpabe.keygen("|three", "key2");
+
+  string pt1, ct, pt2;
+  for (size_t i = 0; i < 20000; i++) {
+    pt1 += (char)('a' + (i % 26));
+  }
+  // encrypt in uneven pieces
+  cpabe.encryptInit("(one and two)", ct, 1024);
+  for (size_t pos = 0, step = 1; pos < pt1.size(); pos += step, step = step * 2 + 3) {
+    cpabe.encryptUpdate(pt1.substr(pos, step), ct);
+  }
+  cpabe.encryptFinalize(ct);
+
+  // the result is a chunked ciphertext
+  vector<uint8_t> out;
+  ASSERT_TRUE(cpabe.decryptChunked("key1", (const uint8_t *)ct.data(), ct.size(),
+                                   [&](size_t n) { out.resize(n); return out.data(); }));
+  ASSERT_EQ(pt1, string(out.begin(), out.end()));
+
+  // decrypt in pieces, including ones that split the ABE ciphertext
+  cpabe.decryptInit("key1");
+  for (size_t pos = 0; pos < ct.size(); pos += 333) {
+    ASSERT_TRUE(cpabe.decryptUpdate(ct.substr(pos, 333), pt2));
+  }
+  ASSERT_TRUE(cpabe.decryptFinalize(pt2));
+  ASSERT_EQ(pt1, pt2);
+
+  // wrong key, truncation and tampering
+  pt2.clear();
+  cpabe.decryptInit("key2");
+  ASSERT_FALSE(cpabe.decryptUpdate(ct, pt2));
+  ASSERT_TRUE(pt2.empty());
+  cpabe.decryptInit("key1");
+  ASSERT_TRUE(cpabe.decryptUpdate(ct.substr(0, ct.size() - 1), pt2));
+  ASSERT_FALSE(cpabe.decryptFinalize(pt2));
+  string bad = ct;
+  bad[bad.size() - 2000] ^= 0x01;
+  pt2.clear();
+  cpabe.decryptInit("key1");
+  ASSERT_FALSE(cpabe.decryptUpdate(bad, pt2));
+  ASSERT_FALSE(cpabe.decryptFinalize(pt2));
+
+  // updates without an init and empty streams are errors
+  ASSERT_ANY_THROW(cpabe.encryptUpdate(pt1, ct));
+  ct.clear();
+  cpabe.encryptInit("(one and two)", ct);
+  ASSERT_ANY_THROW(cpabe.encryptFinalize(ct));
+}
+
+TEST(libopenabe, CryptoBoxEnvelopeSession) {
+  TEST_DESCRIPTION("Testing that envelope sessions seal many records under one ABE header");
+  OpenABECryptoContext cpabe("CP-ABE"), receiver("CP-ABE"), other("CP-ABE");
+  string mpk, key1, key2;
+  cpabe.generateParams();
+  cpabe.exportPublicParams(mpk);
+  cpabe.keygen("|one|two", "key1");
+  cpabe.keygen("|three", "key2");
+  cpabe.exportUserKey("key1", key1);
+  cpabe.exportUserKey("key2", key2);
+  receiver.importPublicParams(mpk);
+  receiver.importUserKey("key1", key1);
+  other.importPublicParams(mpk);
+  other.importUserKey("key2", key2);
+
+  // records before a session is open are errors
+  string header, record, pt;
+  ASSERT_ANY_THROW(cpabe.sessionEncrypt("record", record, header));
+
+  // the data key is replaced every three records
+  cpabe.sessionOpen("(one and two)", header, 3, 0);
+  ASSERT_TRUE(receiver.sessionAccept("key1", header));
+  ASSERT_FALSE(other.sessionAccept("key2", header));
+  vector<string> headers(1, header), records;
+  for (int i = 0; i < 7; i++) {
+    string newHeader;
+    bool rotated = cpabe.sessionEncrypt("record " + to_string(i), record, newHeader);
+    ASSERT_EQ(rotated, i > 0 && i % 3 == 0);
+    if (rotated) {
+      ASSERT_NE(newHeader, headers.back());
+      ASSERT_TRUE(receiver.sessionAccept("key1", newHeader));
+      headers.push_back(newHeader);
+    }
+    records.push_back(record);
+  }
+  ASSERT_EQ(headers.size(), 3u);
+  // the same header twice is accepted (once decrypted)
+  ASSERT_TRUE(receiver.sessionAccept("key1", headers[0]));
+  for (int i = 0; i < 7; i++) {
+    ASSERT_TRUE(receiver.sessionDecrypt(records[i], pt));
+    ASSERT_EQ(pt, "record " + to_string(i));
+    ASSERT_FALSE(other.sessionDecrypt(records[i], pt));
+  }
+
+  // tampered records and unknown sessions do not decrypt
+  string bin = Base64Decode(records[0]);
+  bin[bin.size() - 1] ^= 0x01;
+  string bad = Base64Encode((const uint8_t *)bin.data(), bin.size());
+  ASSERT_FALSE(receiver.sessionDecrypt(bad, pt));
+  OpenABECryptoContext fresh("CP-ABE");
+  fresh.importPublicParams(mpk);
+  ASSERT_FALSE(fresh.sessionDecrypt(records[0], pt));
+
+  cpabe.sessionClose();
+  ASSERT_ANY_THROW(cpabe.sessionEncrypt("record", record, header));
+}
+
+TEST(libopenabe, CryptoBoxSharedPublicParams) {
+  TEST_DESCRIPTION("Testing that decoded public params can be shared between contexts");
+  OpenABECryptoContext cpabe("CP-ABE");
+  cpabe.generateParams();
+  cpabe.keygen("|one|two|three", "key1");
+
+  // a context that never saw the serialized MPK can still encrypt
+  OpenABEMPKHandle handle = cpabe.getPublicParamsHandle();
+  ASSERT_TRUE(handle != nullptr);
+  OpenABECryptoContext cpabe2("CP-ABE"), cpabe3("CP-ABE");
+  cpabe2.attachPublicParams(handle);
+  cpabe3.attachPublicParams(handle);
+
+  string pt1 = "hello world!", pt2, ct1, ct2;
+  cpabe2.encrypt("((one or two) and three)", pt1, ct1);
+  cpabe3.encrypt("(one and two)", pt1, ct2);
+  ASSERT_TRUE(cpabe.decrypt("key1", ct1, pt2));
+  ASSERT_EQ(pt1, pt2);
+  pt2.clear();
+  ASSERT_TRUE(cpabe.decrypt("key1", ct2, pt2));
+  ASSERT_EQ(pt1, pt2);
+
+  // the handle only fits contexts of the same scheme
+  OpenABECryptoContext kpabe("KP-ABE");
+  ASSERT_ANY_THROW(kpabe.attachPublicParams(handle));
+  ASSERT_ANY_THROW(kpabe.attachPublicParams(nullptr));
+  ASSERT_ANY_THROW(kpabe.getPublicParamsHandle());
+}
+
+// bytes of fixed-base table memory the MPK of a context holds for "g1"
+// (none when the table is in a snapshot)
+static size_t publicParamsTableMemory(OpenABECryptoContext &context) {
+  return context.getPublicParamsHandle()->getPrecomputedParams()->getG1("g1")->getMemoryUsage();
+}
+
+// recompute the digest of a snapshot (SHA-256 at offset 72, over the whole
+// snapshot with it zeroed), as anyone who crafts one can
+static void resealPublicParamsSnapshot(string &snapshot) {
+  const size_t offset = 72;
+  memset(&snapshot[offset], 0, SHA256_LEN);
+  uint8_t digest[SHA256_LEN];
+  sha256(digest, (uint8_t *)&snapshot[0], snapshot.size());
+  memcpy(&snapshot[offset], digest, SHA256_LEN);
+}
+
+TEST(libopenabe, CryptoBoxPublicParamsSnapshot) {
+  TEST_DESCRIPTION("Testing that a public params snapshot is imported with its tables in place");
+  OpenABECryptoContext cpabe("CP-ABE");
+  cpabe.generateParams();
+  cpabe.keygen("|one|two|three", "key1");
+
+  string snapshot;
+  cpabe.exportPublicParamsSnapshot(snapshot);
+
+  // the snapshot is read in place, so it must outlive the contexts
+  static string mapped;
+  mapped = snapshot;
+  OpenABECryptoContext worker("CP-ABE");
+  worker.importPublicParamsSnapshot((const uint8_t *)mapped.data(), mapped.size());
+  ASSERT_EQ(publicParamsTableMemory(worker), 0U);
+
+  string pt1 = "hello world!", pt2, ct;
+  worker.encrypt("((one or two) and three)", pt1, ct);
+  ASSERT_TRUE(cpabe.decrypt("key1", ct, pt2));
+  ASSERT_EQ(pt1, pt2);
+
+  // the tables stay with the snapshot's own MPK: the same MPK imported the
+  // usual way builds its own
+  string mpk;
+  cpabe.exportPublicParams(mpk);
+  OpenABECryptoContext plain("CP-ABE");
+  plain.importPublicParams(mpk);
+  ASSERT_GT(publicParamsTableMemory(plain), 0U);
+
+  // unaligned input is copied
+  static string unaligned;
+  unaligned = "x" + snapshot;
+  OpenABECryptoContext worker2("CP-ABE");
+  worker2.importPublicParamsSnapshot((const uint8_t *)unaligned.data() + 1, snapshot.size());
+  ASSERT_EQ(publicParamsTableMemory(worker2), 0U);
+  pt2.clear();
+  worker2.encrypt("((one or two) and three)", pt1, ct);
+  ASSERT_TRUE(cpabe.decrypt("key1", ct, pt2));
+  ASSERT_EQ(pt1, pt2);
+
+  // truncated or tampered snapshots are rejected
+  OpenABECryptoContext worker3("CP-ABE");
+  ASSERT_ANY_THROW(worker3.importPublicParamsSnapshot((const uint8_t *)snapshot.data(), 16));
+  string bad = snapshot;
+  bad[0] ^= 1;
+  ASSERT_ANY_THROW(worker3.importPublicParamsSnapshot((const uint8_t *)bad.data(), bad.size()));
+  ASSERT_ANY_THROW(worker3.importPublicParamsSnapshot((const uint8_t *)snapshot.data(),
+                                                      snapshot.size() / 2));
+  // so is a table entry changed under a recomputed digest
+  string forged = snapshot;
+  forged[forged.size() - 8] ^= 1;
+  resealPublicParamsSnapshot(forged);
+  ASSERT_ANY_THROW(worker3.importPublicParamsSnapshot((const uint8_t *)forged.data(), forged.size()));
+
+  // with a MAC key on both sides, the tables are checked by their tags
+  const string macKey = "0123456789abcdef0123456789abcdef";
+  cpabe.setTrustedKeyMAC(macKey);
+  static string tagged;
+  cpabe.exportPublicParamsSnapshot(tagged);
+  OpenABECryptoContext worker4("CP-ABE");
+  worker4.setTrustedKeyMAC(macKey);
+  worker4.importPublicParamsSnapshot((const uint8_t *)tagged.data(), tagged.size());
+  ASSERT_EQ(publicParamsTableMemory(worker4), 0U);
+  // and untagged snapshots, or ones tagged under another key, are rejected
+  OpenABECryptoContext worker5("CP-ABE");
+  worker5.setTrustedKeyMAC(macKey);
+  ASSERT_ANY_THROW(worker5.importPublicParamsSnapshot((const uint8_t *)snapshot.data(), snapshot.size()));
+  worker5.setTrustedKeyMAC("fedcba9876543210fedcba9876543210");
+  ASSERT_ANY_THROW(worker5.importPublicParamsSnapshot((const uint8_t *)tagged.data(), tagged.size()));
+}
+
+TEST(libopenabe, CryptoBoxSnapshotFile) {
+  TEST_DESCRIPTION("Testing that a snapshot file restores keys, caches and policies");
+  OpenABECryptoContext cpabe("CP-ABE");
+  cpabe.generateParams();
+  cpabe.keygen("|one|two|three", "key1");
+  string pt1 = "hello world!", pt2, ct;
+  cpabe.encrypt("((one or two) and three)", pt1, ct);
+
+  const char *path = "context_snapshot.bin";
+  cpabe.saveSnapshot(path);
+  clearPolicyCache();
+
+  OpenABECryptoContext worker("CP-ABE");
+  worker.loadSnapshot(path);
+  // MPK tables came from the file
+  ASSERT_EQ(publicParamsTableMemory(worker), 0U);
+  ASSERT_GE(getPolicyCacheCount(), 1U);
+  ASSERT_TRUE(worker.decrypt("key1", ct, pt2));
+  ASSERT_EQ(pt1, pt2);
+  worker.encrypt("((one or two) and three)", pt1, ct);
+  pt2.clear();
+  ASSERT_TRUE(cpabe.decrypt("key1", ct, pt2));
+  ASSERT_EQ(pt1, pt2);
+  // the master secret stays out of the snapshot
+  ASSERT_ANY_THROW(worker.keygen("|one|", "key2"));
+
+  // a corrupted file fails its digest check
+  string bytes;
+  {
+    ifstream in(path, ios::binary);
+    bytes.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+  }
+  bytes[bytes.size() / 2] ^= 1;
+  {
+    ofstream out(path, ios::binary | ios::trunc);
+    out << bytes;
+  }
+  OpenABECryptoContext worker2("CP-ABE");
+  ASSERT_ANY_THROW(worker2.loadSnapshot(path));
+  remove(path);
+  ASSERT_ANY_THROW(worker2.loadSnapshot(path));
+}
+
+TEST(libopenabe, CryptoBoxTransformKey) {
+  TEST_DESCRIPTION("Testing outsourced decryption with transformation and retrieval keys");
+  OpenABECryptoContext cpabe("CP-ABE");
+  cpabe.generateParams();
+  cpabe.keygen("|one|two|three", "key1");
+  cpabe.generateTransformKey("key1", "tk1", "rk1");
+
+  // the server only gets the public params and the transformation key
+  string mpk, tk;
+  cpabe.exportPublicParams(mpk);
+  cpabe.exportUserKey("tk1", tk);
+  OpenABECryptoContext server("CP-ABE");
+  server.importPublicParams(mpk);
+  server.importUserKey("tk1", tk);
+
+  string pt1 = "hello world!", pt2, ct, tct;
+  cpabe.encrypt("((one or two) and three)", pt1, ct);
+  ASSERT_TRUE(server.transformCiphertext("tk1", ct, tct));
+  ASSERT_FALSE(server.decrypt("tk1", ct, pt2));
+  ASSERT_TRUE(cpabe.decryptTransformed("rk1", tct, pt2));
+  ASSERT_EQ(pt1, pt2);
+
+  // the transformation key is bound to the attributes of key1
+  cpabe.encrypt("one and four", pt1, ct);
+  ASSERT_FALSE(server.transformCiphertext("tk1", ct, tct));
+
+  // a transformed ciphertext is rejected under another retrieval key, or
+  // when its payload is changed
+  cpabe.keygen("|one|two|three", "key2");
+  cpabe.generateTransformKey("key2", "tk2", "rk2");
+  cpabe.encrypt("one and two", pt1, ct);
+  ASSERT_TRUE(server.transformCiphertext("tk1", ct, tct));
+  ASSERT_FALSE(cpabe.decryptTransformed("rk2", tct, pt2));
+  string bin = Base64Decode(tct);
+  bin[bin.size() - 1] ^= 1;
+  ASSERT_FALSE(cpabe.decryptTransformed("rk1", Base64Encode((const uint8_t *)bin.data(), bin.size()), pt2));
+
+  OpenABECryptoContext kpabe("KP-ABE");
+  kpabe.generateParams();
+  kpabe.keygen("one and two", "key1");
+  ASSERT_ANY_THROW(kpabe.generateTransformKey("key1", "tk1", "rk1"));
+}
+
+TEST(libopenabe, CryptoBoxDelegateKey) {
+  TEST_DESCRIPTION("Testing CP-ABE key delegation to a subset of attributes without the MSK");
+  OpenABECryptoContext authority("CP-ABE");
+  authority.generateParams();
+  authority.keygen("|one|two|three", "key1");
+
+  // the edge service only gets the public params and the parent key
+  string mpk, sk1, sk2;
+  authority.exportPublicParams(mpk);
+  authority.exportUserKey("key1", sk1);
+  OpenABECryptoContext edge("CP-ABE");
+  edge.importPublicParams(mpk);
+  edge.importUserKey("key1", sk1);
+  edge.delegateKey("key1", "|one|three", "key2");
+  edge.exportUserKey("key2", sk2);
+  ASSERT_NE(sk1, sk2);
+
+  string pt1 = "hello world!", pt2, ct;
+  authority.encrypt("one and three", pt1, ct);
+  ASSERT_TRUE(edge.decrypt("key2", ct, pt2));
+  ASSERT_EQ(pt1, pt2);
+  authority.encrypt("two and three", pt1, ct);
+  ASSERT_TRUE(edge.decrypt("key1", ct, pt2));
+  ASSERT_FALSE(edge.decrypt("key2", ct, pt2));
+
+  // a delegated key is never wider than its parent
+  ASSERT_ANY_THROW(edge.delegateKey("key1", "|one|four", "key3"));
+  ASSERT_ANY_THROW(edge.delegateKey("key2", "|one|two", "key3"));
+  edge.delegateKey("key2", "|three", "key3");
+  authority.encrypt("three", pt1, ct);
+  ASSERT_TRUE(edge.decrypt("key3", ct, pt2));
+
+  OpenABECryptoContext kpabe("KP-ABE");
+  kpabe.generateParams();
+  kpabe.keygen("one and two", "key1");
+  ASSERT_ANY_THROW(kpabe.delegateKey("key1", "|one", "key2"));
+}
+
+TEST(libopenabe, CryptoBoxExtendKey) {
+  TEST_DESCRIPTION("Testing that CP-ABE keys can be extended with a small key delta");
+  OpenABECryptoContext authority("CP-ABE");
+  authority.generateParams();
+  authority.keygen("|one|two", "key1");
+  authority.keygen("|one|two", "key2");
+
+  string mpk, sk, delta, pt1 = "hello world!", pt2, ct;
+  authority.exportPublicParams(mpk);
+  authority.exportUserKey("key1", sk);
+  OpenABECryptoContext user("CP-ABE");
+  user.importPublicParams(mpk);
+  user.importUserKey("key1", sk);
+
+  authority.encrypt("one and three", pt1, ct);
+  ASSERT_FALSE(user.decrypt("key1", ct, pt2));
+  authority.extendKey("key1", "|three", delta);
+  ASSERT_LT(delta.size(), sk.size());
+  user.applyKeyDelta("key1", delta);
+  ASSERT_TRUE(user.decrypt("key1", ct, pt2));
+  ASSERT_EQ(pt1, pt2);
+  ASSERT_TRUE(authority.decrypt("key1", ct, pt2));
+
+  // numeric attributes are added whole
+  authority.extendKey("key1", "|three|Date = May 5, 2026", delta);
+  user.applyKeyDelta("key1", delta);
+  authority.encrypt("two and Date = May 1-10, 2026", pt1, ct);
+  ASSERT_TRUE(user.decrypt("key1", ct, pt2));
+  ASSERT_EQ(pt1, pt2);
+
+  // applying a delta again changes nothing, and it only fits its own key
+  user.applyKeyDelta("key1", delta);
+  ASSERT_TRUE(user.decrypt("key1", ct, pt2));
+  authority.exportUserKey("key2", sk);
+  user.importUserKey("key2", sk);
+  ASSERT_ANY_THROW(user.applyKeyDelta("key2", delta));
+  ASSERT_FALSE(user.decrypt("key2", ct, pt2));
+
+  // nothing to add, and keys that don't come from keygen can't be extended
+  ASSERT_ANY_THROW(authority.extendKey("key1", "|one|three", delta));
+  authority.delegateKey("key1", "|one", "key3");
+  ASSERT_ANY_THROW(authority.extendKey("key3", "|two", delta));
+}
+
+TEST(libopenabe, PeriodTreeCover) {
+  TEST_DESCRIPTION("Testing that period tree covers match exactly the periods of an interval");
+  OpenABEPeriodTree tree("period", 4);
+  ASSERT_EQ(tree.size(), 16U);
+  vector<string> path = tree.pathNodes(5);
+  ASSERT_EQ(path.size(), 5U);
+  ASSERT_EQ(path[0], "period:xxxx");
+  ASSERT_EQ(path[3], "period:010x");
+  ASSERT_EQ(path[4], "period:0101");
+  ASSERT_EQ(tree.coverNodes(0, 15), vector<string>{"period:xxxx"});
+  ASSERT_EQ(tree.attributes(3, 8), "|period:0011|period:01xx|period:1000");
+
+  // a cover meets the path of every period inside it, and of no other
+  for (uint32_t first = 0; first < tree.size(); first++) {
+    for (uint32_t last = first; last < tree.size(); last++) {
+      vector<string> cover = tree.coverNodes(first, last);
+      ASSERT_LE(cover.size(), 2 * (size_t)tree.getDepth());
+      set<string> nodes(cover.begin(), cover.end());
+      for (uint32_t period = 0; period < tree.size(); period++) {
+        size_t hits = 0;
+        for (auto &node : tree.pathNodes(period)) {
+          hits += nodes.count(node);
+        }
+        ASSERT_EQ(hits, (period >= first && period <= last) ? 1U : 0U);
+      }
+    }
+  }
+  ASSERT_ANY_THROW(tree.coverNodes(9, 3));
+  ASSERT_ANY_THROW(tree.pathNodes(16));
+
+  // weeks since the epoch, from dates as the parser reads them
+  OpenABEPeriodTree weeks("week", TIME_BITS, 7);
+  ASSERT_EQ(weeks.periodOf("March 3, 2020") + 1, weeks.periodOf("March 10, 2020"));
+  ASSERT_EQ(weeks.periodOfDay(13), 1U);
+  ASSERT_EQ(weeks.periodEnd(0), 7 * 86400U);
+  ASSERT_ANY_THROW(weeks.periodOf("Smarch 3, 2020"));
+  ASSERT_ANY_THROW(weeks.periodOf("April 31, 2020"));
+  ASSERT_ANY_THROW(OpenABEPeriodTree("week", 0));
+}
+
+TEST(libopenabe, CryptoBoxKeyUpdate) {
+  TEST_DESCRIPTION("Testing that period key updates combine with a long-lived CP-ABE key");
+  OpenABEPeriodTree tree("period", 8);
+  OpenABECryptoContext authority("CP-ABE");
+  authority.generateParams();
+  authority.keygen("|doctor|cardiology", "alice");
+  authority.keygen("|doctor", "bob");
+
+  string mpk, sk, update, pt1 = "hello world!", pt2, ct;
+  authority.exportPublicParams(mpk);
+  authority.exportUserKey("alice", sk);
+  OpenABECryptoContext user("CP-ABE");
+  user.importPublicParams(mpk);
+  user.importUserKey("alice", sk);
+  const string policy = "(doctor and cardiology) and ";
+
+  authority.encrypt(policy + tree.policy(20), pt1, ct);
+  ASSERT_FALSE(user.decrypt("alice", ct, pt2));
+
+  // valid for periods 16-31: one cover node
+  authority.generateKeyUpdate("alice", tree.attributes(16, 31), update);
+  ASSERT_LT(update.size(), sk.size());
+  user.applyKeyDelta("alice", update);
+  ASSERT_TRUE(user.decrypt("alice", ct, pt2));
+  ASSERT_EQ(pt1, pt2);
+  // the authority's copy of the key is unchanged
+  ASSERT_FALSE(authority.decrypt("alice", ct, pt2));
+
+  authority.encrypt(policy + tree.policy(32), pt1, ct);
+  ASSERT_FALSE(user.decrypt("alice", ct, pt2));
+  // the next renewal may repeat nodes of the last one
+  authority.generateKeyUpdate("alice", tree.attributes(16, 40), update);
+  user.applyKeyDelta("alice", update);
+  ASSERT_TRUE(user.decrypt("alice", ct, pt2));
+  ASSERT_EQ(pt1, pt2);
+
+  // an update only fits its own key, and needs the user's attributes
+  authority.generateKeyUpdate("bob", tree.attributes(0, 255), update);
+  ASSERT_ANY_THROW(user.applyKeyDelta("alice", update));
+  authority.exportUserKey("bob", sk);
+  user.importUserKey("bob", sk);
+  user.applyKeyDelta("bob", update);
+  ASSERT_FALSE(user.decrypt("bob", ct, pt2));
+  authority.encrypt("doctor and " + tree.policy(100), pt1, ct);
+  ASSERT_TRUE(user.decrypt("bob", ct, pt2));
+  ASSERT_FALSE(user.decrypt("alice", ct, pt2));
+
+  OpenABECryptoContext kpabe("KP-ABE");
+  kpabe.generateParams();
+  kpabe.keygen("one and two", "key1");
+  ASSERT_ANY_THROW(kpabe.generateKeyUpdate("key1", tree.attributes(0, 7), update));
+}
+
+TEST(libopenabe, CryptoBoxPolicyDictionary) {
+  TEST_DESCRIPTION("Testing that ciphertexts under a registered policy carry only its digest");
+  clearPolicyDictionary();
+  const string policy = "((alpha_department and beta_project) or (gamma_team and delta_region))";
+  string pt1 = "hello world!", pt2, ct1, ct2;
+  for (const char *scheme : {"CP-ABE", "CP-FAME"}) {
+    OpenABECryptoContext cpabe(scheme);
+    cpabe.generateParams();
+    cpabe.keygen("|alpha_department|beta_project", "key0");
+    cpabe.encrypt(policy, pt1, ct1);
+    clearPolicyDictionary();
+    ASSERT_TRUE(registerPolicy(policy));
+    ASSERT_EQ(getPolicyDictionaryCount(), 1U);
+    cpabe.encrypt(policy, pt1, ct2);
+    ASSERT_LT(ct2.size(), ct1.size());
+    // both forms decrypt while the policy stays registered
+    ASSERT_TRUE(cpabe.decrypt("key0", ct1, pt2));
+    ASSERT_EQ(pt1, pt2);
+    pt2.clear();
+    ASSERT_TRUE(cpabe.decrypt("key0", ct2, pt2));
+    ASSERT_EQ(pt1, pt2);
+    // the digest does not resolve without the dictionary entry
+    clearPolicyDictionary();
+    ASSERT_FALSE(cpabe.decrypt("key0", ct2, pt2));
+  }
+  ASSERT_FALSE(registerPolicy("((alpha and"));
+  ASSERT_EQ(getPolicyDictionaryCount(), 0U);
+}
+
+TEST(libopenabe, CryptoBoxCiphertextBlocks) {
+  TEST_DESCRIPTION("Testing that columnar blocks keep every ciphertext and decrypt from a file");
+  OpenABECryptoContext cpabe("CP-ABE", false);
+  cpabe.generateParams();
+  cpabe.keygen("|one|two|three", "key0");
+  const string policy = "((one or two) and three)";
+
+  // the writer gives back each ciphertext byte for byte
+  vector<string> pts, cts;
+  OpenABECiphertextBlockWriter writer;
+  for (size_t i = 0; i < 8; i++) {
+    string ct, pt = "record " + string(i + 1, 'x');
+    cpabe.encrypt(policy, pt, ct);
+    ASSERT_EQ(writer.add(ct), OpenABE_NOERROR);
+    pts.push_back(pt);
+    cts.push_back(ct);
+  }
+  string other;
+  cpabe.encrypt("(one and two)", pts[0], other);
+  ASSERT_EQ(writer.add(other), OpenABE_ERROR_INVALID_INPUT);
+  ASSERT_EQ(writer.count(), 8U);
+  string block;
+  writer.finish(block);
+  size_t total = 0;
+  for (auto &ct : cts) {
+    total += ct.size();
+  }
+  ASSERT_LT(block.size(), total);
+
+  OpenABECiphertextBlockReader reader;
+  ASSERT_EQ(reader.attach((const uint8_t *)block.data(), block.size()), OpenABE_NOERROR);
+  ASSERT_EQ(reader.size(), cts.size());
+  for (size_t i = 0; i < cts.size(); i++) {
+    OpenABEByteString ct;
+    ASSERT_EQ(reader.get(i, ct), OpenABE_NOERROR);
+    ASSERT_EQ(ct.toString(), cts[i]);
+  }
+  OpenABEByteString ct;
+  ASSERT_EQ(reader.get(cts.size(), ct), OpenABE_ERROR_INDEX_OUT_OF_BOUNDS);
+
+  // a second block under another policy, appended to the same file
+  vector<string> pts2 = {"first", "second", "third"};
+  cpabe.encryptBlock("(one and two)", pts2, block);
+  const char *path = "ciphertext_blocks.bin";
+  {
+    ofstream out(path, ios::binary | ios::trunc);
+    out << block;
+  }
+  ASSERT_EQ(reader.open(path), OpenABE_NOERROR);
+  ASSERT_EQ(reader.size(), pts.size() + pts2.size());
+  pts.insert(pts.end(), pts2.begin(), pts2.end());
+  vector<string> out;
+  vector<bool> ok;
+  ASSERT_EQ(cpabe.decryptBatch("key0", reader, out, ok), pts.size());
+  ASSERT_TRUE(out == pts);
+  reader.close();
+  remove(path);
+
+  // a truncated block is turned away when it is opened
+  ASSERT_NE(reader.attach((const uint8_t *)block.data(), block.size() - 1), OpenABE_NOERROR);
+  ASSERT_EQ(reader.size(), 0U);
+}
+
+TEST(libopenabe, CryptoBoxKeyRing) {
+  TEST_DESCRIPTION("Testing that a key ring imports every key of a user at once");
+  OpenABECryptoContext cpabe("CP-ABE");
+  cpabe.generateParams();
+  string mpk;
+  cpabe.exportPublicParams(mpk);
+  vector<string> inputs = {"|one|two", "|two|three", "|one|three", "|four"};
+  vector<string> keyIDs = {"key0", "key1", "key2", "key3"};
+  cpabe.keygenMany(inputs, keyIDs);
+
+  string ring, one;
+  cpabe.exportKeyRing(ring);
+
+  OpenABECryptoContext worker("CP-ABE");
+  worker.importPublicParams(mpk);
+  worker.importKeyRing(ring);
+  vector<string> policies = {"(one and two)", "(two and three)", "(one and three)", "four"};
+  for (size_t i = 0; i < keyIDs.size(); i++) {
+    string ct, pt;
+    cpabe.encrypt(policies[i], "message " + keyIDs[i], ct);
+    ASSERT_TRUE(worker.decrypt(keyIDs[i], ct, pt));
+    ASSERT_EQ(pt, "message " + keyIDs[i]);
+    string exported;
+    worker.exportUserKey(keyIDs[i], exported);
+    cpabe.exportUserKey(keyIDs[i], one);
+    ASSERT_EQ(exported, one);
+  }
+
+  // a chosen subset, and nothing is imported from a truncated ring
+  cpabe.exportKeyRing({"key1", "key3"}, ring);
+  OpenABECryptoContext partial("CP-ABE");
+  partial.importPublicParams(mpk);
+  ASSERT_THROW(partial.importKeyRing(ring.substr(0, ring.size() - 1)), ZCryptoBoxException);
+  ASSERT_THROW(partial.exportUserKey("key1", one), ZCryptoBoxException);
+  partial.importKeyRing(ring);
+  partial.exportUserKey("key3", one);
+  ASSERT_THROW(partial.exportUserKey("key0", one), ZCryptoBoxException);
+}
+
+TEST(libopenabe, CryptoBoxUserKeyCache) {
+  TEST_DESCRIPTION("Testing that repeated imports of a user key are served from the key cache");
+  string mpk, sk, ct, pt1 = "hello world!", pt2;
+  OpenABECryptoContext cpabe("CP-ABE");
+  cpabe.generateParams();
+  cpabe.exportPublicParams(mpk);
+  cpabe.keygen("|one|two|three", "key1");
+  cpabe.exportUserKey("key1", sk);
+  cpabe.encrypt("((one or two) and three)", pt1, ct);
+
+  enableUserKeyCache(2, USER_KEY_CACHE_BYTES);
+  clearUserKeyCache();
+  for (size_t i = 0; i < 3; i++) {
+    OpenABECryptoContext worker("CP-ABE");
+    worker.importPublicParams(mpk);
+    worker.importUserKey("key" + to_string(i), sk);
+    ASSERT_EQ(getUserKeyCacheCount(), 1U);
+    pt2.clear();
+    ASSERT_TRUE(worker.decrypt("key" + to_string(i), ct, pt2));
+    ASSERT_EQ(pt1, pt2);
+  }
+
+  // a cached key is still checked against the importing context
+  OpenABECryptoContext kpabe("KP-ABE");
+  ASSERT_ANY_THROW(kpabe.importUserKey("key1", sk));
+
+  // the limits evict least recently used keys
+  cpabe.keygen("|four", "key2");
+  cpabe.keygen("|five", "key3");
+  string sk2, sk3;
+  cpabe.exportUserKey("key2", sk2);
+  cpabe.exportUserKey("key3", sk3);
+  OpenABECryptoContext worker("CP-ABE");
+  worker.importPublicParams(mpk);
+  worker.importUserKey("key2", sk2);
+  worker.importUserKey("key3", sk3);
+  ASSERT_EQ(getUserKeyCacheCount(), 2U);
+  enableUserKeyCache(USER_KEY_CACHE_SIZE, 1);
+  ASSERT_EQ(getUserKeyCacheCount(), 0U);
+
+  // keys evicted from the cache stay usable by the contexts that hold them
+  worker.importUserKey("key1", sk);
+  pt2.clear();
+  ASSERT_TRUE(worker.decrypt("key1", ct, pt2));
+  ASSERT_EQ(pt1, pt2);
+
+  disableUserKeyCache();
+  ASSERT_EQ(getUserKeyCacheCount(), 0U);
+}
+
+TEST(libopenabe, CryptoBoxTrustedKeyImport) {
+  TEST_DESCRIPTION("Testing that MAC-checked key imports decrypt like full imports");
+  const string macKey(32, 'k');
+  string mpk, sk, ct, pt1 = "hello world!", pt2;
+  OpenABECryptoContext cpabe("CP-ABE");
+  cpabe.generateParams();
+  cpabe.keygen("|one|two|three", "key1");
+  cpabe.encrypt("((one or two) and three)", pt1, ct);
+  // no MAC key set yet
+  ASSERT_THROW(cpabe.exportUserKeyTrusted("key1", sk), ZCryptoBoxException);
+  ASSERT_THROW(cpabe.setTrustedKeyMAC("short"), ZCryptoBoxException);
+  cpabe.setTrustedKeyMAC(macKey);
+  cpabe.exportPublicParamsTrusted(mpk);
+  cpabe.exportUserKeyTrusted("key1", sk);
+
+  OpenABECryptoContext worker("CP-ABE");
+  worker.setTrustedKeyMAC(macKey);
+  worker.importPublicParamsTrusted(mpk);
+  worker.importUserKeyTrusted("key1", sk);
+  ASSERT_TRUE(worker.decrypt("key1", ct, pt2));
+  ASSERT_EQ(pt1, pt2);
+
+  // a blob changed anywhere, or checked under another key, is refused
+  string bad = Base64Decode(sk);
+  bad[bad.size() / 2] ^= 0x01;
+  ASSERT_THROW(worker.importUserKeyTrusted("key2", Base64Encode((const uint8_t *)bad.data(), bad.size())),
+               ZCryptoBoxException);
+  OpenABECryptoContext other("CP-ABE");
+  other.setTrustedKeyMAC(string(32, 'o'));
+  ASSERT_THROW(other.importPublicParamsTrusted(mpk), ZCryptoBoxException);
+}
+
+TEST(libopenabe, CryptoBoxLazyUserKey) {
+  TEST_DESCRIPTION("Testing that a trusted user key import only decodes the components a decryption uses");
+  const string macKey(32, 'k');
+  string mpk, sk, skTrusted, ct, pt1 = "hello world!", pt2, attrs;
+  OpenABECryptoContext cpabe("CP-ABE");
+  cpabe.generateParams();
+  for (size_t i = 0; i < 40; i++) {
+    attrs += "|attr" + to_string(i);
+  }
+  cpabe.keygen(attrs, "key1");
+  cpabe.encrypt("attr3 and attr7", pt1, ct);
+  cpabe.setTrustedKeyMAC(macKey);
+  cpabe.exportPublicParams(mpk);
+  cpabe.exportUserKey("key1", sk);
+  cpabe.exportUserKeyTrusted("key1", skTrusted);
+
+  OpenABECryptoContext worker("CP-ABE");
+  worker.importPublicParams(mpk);
+  worker.setTrustedKeyMAC(macKey);
+  OpenABEMetricsSnapshot before, after;
+  OpenABE_setMetricsEnabled(true);
+  // a plain import validates every point of the key while loading
+  OpenABE_getMetrics(before);
+  worker.importUserKey("key2", sk);
+  OpenABE_getMetrics(after);
+  ASSERT_GT(after.get(OpenABE_METRIC_POINTS_DECODED) - before.get(OpenABE_METRIC_POINTS_DECODED), 40U);
+
+  OpenABE_getMetrics(before);
+  worker.importUserKeyTrusted("key1", skTrusted);
+  OpenABE_getMetrics(after);
+  ASSERT_EQ(after.get(OpenABE_METRIC_POINTS_DECODED), before.get(OpenABE_METRIC_POINTS_DECODED));
+
+  ASSERT_TRUE(worker.decrypt("key1", ct, pt2));
+  ASSERT_EQ(pt1, pt2);
+  // K, L and the KX of the two attributes, plus the ciphertext's points
+  OpenABE_getMetrics(before);
+  OpenABE_setMetricsEnabled(false);
+  ASSERT_LT(before.get(OpenABE_METRIC_POINTS_DECODED) - after.get(OpenABE_METRIC_POINTS_DECODED), 20U);
+
+  // the decoded components are kept: a second decryption decodes none of the key's
+  ASSERT_TRUE(worker.decrypt("key1", ct, pt2));
+  ASSERT_EQ(pt1, pt2);
+}
+
+TEST(libopenabe, CryptoBoxCPABEContextMinusBase64Encoding) {
+  TEST_DESCRIPTION("Testing that crypto box for CP-ABE context works (without base64 encoding)");
+  string mpk, msk;
+  string ct1, ct2;
+
+  OpenABECryptoContext cpabe("CP-ABE", false);
+
+  cpabe.generateParams();
+  cpabe.exportPublicParams(mpk);
+  cpabe.exportSecretParams(msk);
+
+  cpabe.keygen("|one|two|three", "key1");
+  cpabe.keygen("|one|two", "key2");
+
+  string pt1 = "hello world!", pt2;
+  cpabe.encrypt("((one or two) and three)", pt1, ct1);
+
+  cout << "Ciphertext: " << ct1.size() << endl;
+
+  ASSERT_TRUE(cpabe.decrypt("key1", ct1, pt2));
 
   string pt3;
   ASSERT_FALSE(cpabe.decrypt("key2", ct1, pt3));
@@ -2238,6 +4613,184 @@ TEST(libopenabe, CryptoBoxKPABEContext) {
   ASSERT_FALSE(kpabe.decrypt("key2", ct1, pt3));
 }
 
+TEST(libopenabe, CryptoBoxHashedCCA) {
+  TEST_DESCRIPTION("Testing the hashed KEM-DEM CCA transform for CP-ABE and KP-ABE");
+  string pt1 = "hello world!", pt2, ct, tct;
+
+  OpenABECryptoContext cpabe("CP-ABE-HCCA");
+  cpabe.generateParams();
+  cpabe.keygen("|one|two|three", "key1");
+  cpabe.encrypt("((one or two) and three)", pt1, ct);
+  ASSERT_TRUE(cpabe.decrypt("key1", ct, pt2));
+  ASSERT_EQ(pt1, pt2);
+
+  // any change to the ABE ciphertext changes the derived key
+  string bin = Base64Decode(ct);
+  for (size_t i = 1; i < 8; i++) {
+    string bad = bin;
+    bad[i * bad.size() / 8] ^= 1;
+    ASSERT_FALSE(cpabe.decrypt("key1", Base64Encode((const uint8_t *)bad.data(), bad.size()), pt2));
+  }
+
+  // params (and so keys and ciphertexts) don't carry over to the generic transform
+  string mpk;
+  cpabe.exportPublicParams(mpk);
+  OpenABECryptoContext generic("CP-ABE");
+  ASSERT_ANY_THROW(generic.importPublicParams(mpk));
+
+  // outsourced decryption carries the digest of the original ciphertext
+  cpabe.generateTransformKey("key1", "tk1", "rk1");
+  cpabe.encrypt("one and three", pt1, ct);
+  ASSERT_TRUE(cpabe.transformCiphertext("tk1", ct, tct));
+  ASSERT_TRUE(cpabe.decryptTransformed("rk1", tct, pt2));
+  ASSERT_EQ(pt1, pt2);
+
+  OpenABECryptoContext kpabe("KP-ABE-HCCA");
+  kpabe.generateParams();
+  kpabe.keygen("((one or two) and three)", "key1");
+  kpabe.encrypt("two|three", pt1, ct);
+  ASSERT_TRUE(kpabe.decrypt("key1", ct, pt2));
+  ASSERT_EQ(pt1, pt2);
+  kpabe.encrypt("one|two", pt1, ct);
+  ASSERT_FALSE(kpabe.decrypt("key1", ct, pt2));
+}
+
+TEST(libopenabe, CryptoBoxInspectAndCanDecrypt) {
+  TEST_DESCRIPTION("Testing that ciphertext headers are read without decrypting");
+  OpenABECryptoContext cpabe("CP-ABE"), kpabe("KP-ABE");
+  cpabe.generateParams();
+  kpabe.generateParams();
+  cpabe.keygen("|one|two", "key1");
+  cpabe.keygen("|three", "key2");
+  kpabe.keygen("((one or two) and three)", "key1");
+
+  string pt = "hello world!", ct1, ct2, pt2;
+  cpabe.encrypt("((one or two) and (two or three))", pt, ct1);
+  kpabe.encrypt("two|three", pt, ct2);
+
+  OpenABECiphertextInfo info;
+  ASSERT_TRUE(cpabe.inspect(ct1, info));
+  ASSERT_EQ(info.scheme, "CP-ABE");
+  ASSERT_EQ(info.curve, DEFAULT_BP_PARAM);
+  ASSERT_EQ(info.uid.size(), 2u * UID_LEN);
+  ASSERT_NE(info.encInput.find("three"), string::npos);
+  ASSERT_TRUE(kpabe.inspect(ct2, info));
+  ASSERT_EQ(info.scheme, "KP-ABE");
+  ASSERT_NE(info.encInput.find("three"), string::npos);
+  ASSERT_FALSE(cpabe.inspect("bm90IGEgY2lwaGVydGV4dA==", info));
+
+  // the answers match decryption
+  ASSERT_TRUE(cpabe.canDecrypt("key1", ct1));
+  ASSERT_TRUE(cpabe.decrypt("key1", ct1, pt2));
+  ASSERT_FALSE(cpabe.canDecrypt("key2", ct1));
+  ASSERT_FALSE(cpabe.decrypt("key2", ct1, pt2));
+  ASSERT_FALSE(cpabe.canDecrypt("noSuchKey", ct1));
+  ASSERT_TRUE(kpabe.canDecrypt("key1", ct2));
+  kpabe.encrypt("one|two", pt, ct2);
+  ASSERT_FALSE(kpabe.canDecrypt("key1", ct2));
+  ASSERT_FALSE(kpabe.decrypt("key1", ct2, pt2));
+
+  // ciphertexts of another scheme never match
+  ASSERT_FALSE(kpabe.canDecrypt("key1", ct1));
+}
+
+TEST(libopenabe, CryptoBoxTryDecrypt) {
+  TEST_DESCRIPTION("Testing that tryDecrypt reports failures by error code");
+  OpenABECryptoContext cpabe("CP-ABE"), binary("CP-ABE", false);
+  string mpk;
+  cpabe.generateParams();
+  cpabe.exportPublicParams(mpk);
+  binary.importPublicParams(Base64Decode(mpk));
+  cpabe.keygen("|one|two", "key1");
+  cpabe.keygen("|three", "key2");
+
+  string pt = "hello world!", ct, pt2;
+  cpabe.encrypt("(one and two)", pt, ct);
+  ASSERT_EQ(cpabe.tryDecrypt("key1", ct, pt2), OpenABE_NOERROR);
+  ASSERT_EQ(pt, pt2);
+  ASSERT_EQ(cpabe.tryDecrypt("key2", ct, pt2), OpenABE_ERROR_POLICY_NOT_SATISFIED);
+  ASSERT_EQ(cpabe.tryDecrypt("noSuchKey", ct, pt2), OpenABE_ERROR_INVALID_KEY);
+  ASSERT_NE(cpabe.tryDecrypt("key1", "bm90IGEgY2lwaGVydGV4dA==", pt2), OpenABE_NOERROR);
+
+  // tampering is caught by decryption itself
+  string bin = Base64Decode(ct);
+  bin[bin.size() - 1] ^= 0x01;
+  string bad = Base64Encode((const uint8_t *)bin.data(), bin.size());
+  OpenABE_ERROR result = cpabe.tryDecrypt("key1", bad, pt2);
+  ASSERT_NE(result, OpenABE_NOERROR);
+  ASSERT_NE(result, OpenABE_ERROR_POLICY_NOT_SATISFIED);
+
+  // the buffer variant
+  string bct;
+  binary.encrypt("(one and two)", pt, bct);
+  vector<uint8_t> out;
+  auto sink = [&](size_t n) { out.resize(n); return out.data(); };
+  ASSERT_EQ(cpabe.tryDecrypt("key1", (const uint8_t *)bct.data(), bct.size(), sink),
+            OpenABE_NOERROR);
+  ASSERT_EQ(pt, string(out.begin(), out.end()));
+  ASSERT_EQ(cpabe.tryDecrypt("key2", (const uint8_t *)bct.data(), bct.size(), sink),
+            OpenABE_ERROR_POLICY_NOT_SATISFIED);
+  ASSERT_NE(cpabe.tryDecrypt("key1", (const uint8_t *)bct.data(), 10, sink), OpenABE_NOERROR);
+}
+
+TEST(libopenabe, CryptoBoxAsync) {
+  TEST_DESCRIPTION("Testing the asynchronous crypto box calls");
+  OpenABECryptoContext cpabe("CP-ABE");
+  cpabe.generateParams();
+  ASSERT_EQ(cpabe.keygenAsync("|one|two", "key1").get().error, OpenABE_NOERROR);
+  ASSERT_EQ(cpabe.keygenAsync("|three", "key2").get().error, OpenABE_NOERROR);
+
+  const string pt = "hello world!";
+  vector<future<OpenABEAsyncResult>> pending;
+  for (int i = 0; i < 4; i++) {
+    pending.push_back(cpabe.encryptAsync("(one and two)", pt));
+  }
+  ASSERT_EQ(cpabe.encryptAsync("", pt).get().error, OpenABE_ERROR_INVALID_INPUT);
+  vector<string> cts;
+  for (auto &f : pending) {
+    OpenABEAsyncResult r = f.get();
+    ASSERT_EQ(r.error, OpenABE_NOERROR);
+    cts.push_back(r.output);
+  }
+  for (auto &ct : cts) {
+    OpenABEAsyncResult r = cpabe.decryptAsync("key1", ct).get();
+    ASSERT_EQ(r.error, OpenABE_NOERROR);
+    ASSERT_EQ(pt, r.output);
+  }
+  OpenABEAsyncResult denied = cpabe.decryptAsync("key2", cts[0]).get();
+  ASSERT_EQ(denied.error, OpenABE_ERROR_POLICY_NOT_SATISFIED);
+  ASSERT_TRUE(denied.output.empty());
+
+  // completion callbacks
+  promise<OpenABEAsyncResult> done;
+  cpabe.decryptAsync("key1", cts[1], [&](OpenABEAsyncResult &r) { done.set_value(r); });
+  OpenABEAsyncResult r = done.get_future().get();
+  ASSERT_EQ(r.error, OpenABE_NOERROR);
+  ASSERT_EQ(pt, r.output);
+
+  // an application executor (here one that runs each task at once)
+  int tasks = 0;
+  OpenPKEContext pke;
+  OpenPKSIGContext pksig;
+  auto inline_executor = [&](function<void()> task) { tasks++; task(); };
+  pke.setExecutor(inline_executor);
+  pksig.setExecutor(inline_executor);
+  ASSERT_EQ(pke.keygenAsync("user1").get().error, OpenABE_NOERROR);
+  OpenABEAsyncResult pct = pke.encryptAsync("user1", pt).get();
+  ASSERT_EQ(pct.error, OpenABE_NOERROR);
+  ASSERT_EQ(pke.decryptAsync("user1", pct.output).get().output, pt);
+  ASSERT_EQ(pke.decryptAsync("user1", "bm90IGEgY2lwaGVydGV4dA==").get().error,
+            OpenABE_ERROR_DECRYPTION_FAILED);
+
+  ASSERT_EQ(pksig.keygenAsync("signer").get().error, OpenABE_NOERROR);
+  OpenABEAsyncResult sig = pksig.signAsync("signer", pt).get();
+  ASSERT_EQ(sig.error, OpenABE_NOERROR);
+  ASSERT_EQ(pksig.verifyAsync("signer", pt, sig.output).get().error, OpenABE_NOERROR);
+  ASSERT_EQ(pksig.verifyAsync("signer", pt + "!", sig.output).get().error,
+            OpenABE_ERROR_VERIFICATION_FAILED);
+  ASSERT_EQ(tasks, 8);
+}
+
 TEST(libopenabe, CryptoBoxKPABEContextMinusBase64Encoding) {
   TEST_DESCRIPTION("Testing that crypto box for KP-ABE context works (without base64 encoding)");
   string pt1, pt2, pt3, ct1, ct2;
@@ -2287,6 +4840,71 @@ TEST(libopenabe, CryptoBoxPKEContext) {
   ASSERT_TRUE(pke.decrypt("user2", ct, pt2));
 }
 
+TEST(libopenabe, CryptoBoxPKEContextMultiRecipient) {
+  TEST_DESCRIPTION("Testing that one PKE ciphertext can be opened by each of several receivers");
+  OpenPKEContext pke("NIST_P256", false);
+  vector<string> receivers;
+  for (int i = 0; i < 5; i++) {
+    receivers.push_back("user" + to_string(i));
+    pke.keygen(receivers.back());
+  }
+  pke.keygen("outsider");
+
+  const string pt(10000, 'x');
+  string ct, pt2;
+  ASSERT_TRUE(pke.encryptMulti(receivers, pt, ct));
+  // the payload is in the ciphertext only once
+  ASSERT_LT(ct.size(), 2 * pt.size());
+  for (const string &receiver : receivers) {
+    pt2.clear();
+    ASSERT_TRUE(pke.decrypt(receiver, ct, pt2));
+    ASSERT_EQ(pt, pt2);
+  }
+  ASSERT_FALSE(pke.decrypt("outsider", ct, pt2));
+
+  // single-recipient ciphertexts are unaffected
+  ASSERT_TRUE(pke.encrypt("user0", pt, ct));
+  ASSERT_TRUE(pke.decrypt("user0", ct, pt2));
+  ASSERT_EQ(pt, pt2);
+
+  ASSERT_THROW(pke.encryptMulti(vector<string>(), pt, ct), ZCryptoBoxException);
+  ASSERT_THROW(pke.encryptMulti({"user0", "nobody"}, pt, ct), ZCryptoBoxException);
+  ASSERT_THROW(pke.encryptMulti(receivers, "", ct), ZCryptoBoxException);
+}
+
+TEST(libopenabe, CryptoBoxPKEContextX25519) {
+  TEST_DESCRIPTION("Testing that crypto box for PKE context works over X25519");
+  string user1PK, user1SK, ct, pt2;
+  const string pt = "hello world!";
+  OpenPKEContext pke("X25519"), pke2("X25519"), nist;
+
+  pke.keygen("user1");
+  pke.keygen("user2");
+  pke.exportPublicKey("user1", user1PK);
+  pke.exportPrivateKey("user1", user1SK);
+  ASSERT_TRUE(pke.encrypt("user1", pt, ct));
+  ASSERT_TRUE(pke.decrypt("user1", ct, pt2));
+  ASSERT_EQ(pt, pt2);
+  ASSERT_FALSE(pke.decrypt("user2", ct, pt2));
+
+  // exported keys work in another context
+  pke2.importPublicKey("user1", user1PK);
+  ASSERT_TRUE(pke2.encrypt("user1", pt, ct));
+  pke2.importPrivateKey("user1", user1SK);
+  pt2.clear();
+  ASSERT_TRUE(pke2.decrypt("user1", ct, pt2));
+  ASSERT_EQ(pt, pt2);
+
+  pt2.clear();
+  ASSERT_TRUE(pke.encryptMulti({"user1", "user2"}, pt, ct));
+  ASSERT_TRUE(pke.decrypt("user2", ct, pt2));
+  ASSERT_EQ(pt, pt2);
+
+  // an X25519 key is not a NIST P-256 key
+  nist.keygen("user0");
+  ASSERT_THROW(nist.importPublicKey("user1", user1PK), ZCryptoBoxException);
+}
+
 TEST(libopenabe, CryptoBoxPKEContextMinusBase64Encoding) {
   TEST_DESCRIPTION("Testing that crypto box for PKE context works (without base64 encoding)");
   string pk, sk;
@@ -2353,6 +4971,234 @@ TEST(libopenabe, CryptoBoxPKSIGContextMinusBase64Encoding) {
   ASSERT_FALSE(pksig.verify("user1", msg2, sig));
 }
 
+TEST(libopenabe, CryptoBoxPKSIGVerifyBatch) {
+  TEST_DESCRIPTION("Testing that batch verification reports a status per signature");
+  OpenPKSIGContext pksig;
+  pksig.keygen("user1");
+  pksig.keygen("user2");
+
+  vector<OpenPKSIGMessage> items;
+  for (size_t i = 0; i < 16; i++) {
+    OpenPKSIGMessage item;
+    item.key_id = (i % 2) ? "user2" : "user1";
+    item.message = "audit record " + to_string(i);
+    pksig.sign(item.key_id, item.message, item.signature);
+    items.push_back(item);
+  }
+  // a tampered message, a signature under the wrong key and an unknown key
+  items[3].message += "!";
+  items[4].key_id = "user2";
+  items[5].key_id = "user3";
+
+  vector<bool> verified;
+  ASSERT_EQ(pksig.verifyBatch(items, verified), 13U);
+  ASSERT_EQ(verified.size(), items.size());
+  for (size_t i = 0; i < items.size(); i++) {
+    ASSERT_EQ(verified[i], i < 3 || i > 5);
+    ASSERT_EQ(verified[i], pksig.verify(items[i].key_id, items[i].message, items[i].signature));
+  }
+
+  vector<OpenPKSIGMessage> none;
+  ASSERT_EQ(pksig.verifyBatch(none, verified), 0U);
+  ASSERT_TRUE(verified.empty());
+}
+
+TEST(libopenabe, CryptoBoxPKSIGEd25519) {
+  TEST_DESCRIPTION("Testing Ed25519 signatures and their batch verification");
+  OpenPKSIGContext ed("ED25519"), ed2("ED25519");
+  ed.keygen("user1");
+  ed.keygen("user2");
+
+  string sig, pk, sk;
+  const string msg = "log record";
+  ed.sign("user1", msg, sig);
+  ASSERT_TRUE(ed.verify("user1", msg, sig));
+  ASSERT_FALSE(ed.verify("user1", msg + "!", sig));
+  ASSERT_FALSE(ed.verify("user2", msg, sig));
+
+  // exported keys work in another context
+  ed.exportPublicKey("user1", pk);
+  ed.exportPrivateKey("user1", sk);
+  ed2.importPublicKey("user1", pk);
+  ASSERT_TRUE(ed2.verify("user1", msg, sig));
+  ed2.importPrivateKey("user1", sk);
+  ed2.sign("user1", msg, sig);
+  ASSERT_TRUE(ed.verify("user1", msg, sig));
+
+  vector<OpenPKSIGMessage> items;
+  for (size_t i = 0; i < 16; i++) {
+    OpenPKSIGMessage item;
+    item.key_id = (i % 2) ? "user2" : "user1";
+    item.message = "audit record " + to_string(i);
+    ed.sign(item.key_id, item.message, item.signature);
+    items.push_back(item);
+  }
+  vector<bool> verified;
+  ASSERT_EQ(ed.verifyBatch(items, verified), 16U);
+  items[3].message += "!";
+  items[4].key_id = "user2";
+  ASSERT_EQ(ed.verifyBatch(items, verified), 14U);
+  for (size_t i = 0; i < items.size(); i++) {
+    ASSERT_EQ(verified[i], i < 3 || i > 4);
+  }
+}
+
+TEST(libopenabe, CryptoBoxPKSIGBLS) {
+  TEST_DESCRIPTION("Testing BLS signatures, their aggregation and batch verification");
+  OpenPKSIGContext bls("BLS12_P381"), bls2("BLS12_P381");
+  bls.keygen("user1");
+  bls.keygen("user2");
+
+  string sig, pk;
+  const string msg = "log record";
+  bls.sign("user1", msg, sig);
+  ASSERT_TRUE(bls.verify("user1", msg, sig));
+  ASSERT_FALSE(bls.verify("user1", msg + "!", sig));
+  ASSERT_FALSE(bls.verify("user2", msg, sig));
+
+  // an exported public key verifies in another context
+  bls.exportPublicKey("user1", pk);
+  bls2.importPublicKey("user1", pk);
+  ASSERT_TRUE(bls2.verify("user1", msg, sig));
+
+  // keys may repeat and sign the same message: the public key is hashed in
+  vector<string> keys = {"user1", "user2", "user1", "user2"};
+  vector<string> msgs = {"a", "a", "b", "c"}, sigs(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    bls.sign(keys[i], msgs[i], sigs[i]);
+  }
+  string agg;
+  bls.aggregate(sigs, agg);
+  ASSERT_TRUE(bls.verifyAggregate(keys, msgs, agg));
+  vector<string> swapped = {"a", "a", "c", "b"};
+  ASSERT_FALSE(bls.verifyAggregate(keys, swapped, agg));
+  ASSERT_FALSE(bls.verifyAggregate({"user1", "user2", "user1"}, {"a", "a", "b"}, agg));
+  ASSERT_THROW(bls.aggregate({sigs[0], "bm90IGEgc2lnbmF0dXJl"}, agg), ZCryptoBoxException);
+
+  vector<OpenPKSIGMessage> items;
+  for (size_t i = 0; i < 16; i++) {
+    OpenPKSIGMessage item;
+    item.key_id = (i % 2) ? "user2" : "user1";
+    item.message = "audit record " + to_string(i);
+    bls.sign(item.key_id, item.message, item.signature);
+    items.push_back(item);
+  }
+  vector<bool> verified;
+  ASSERT_EQ(bls.verifyBatch(items, verified), 16U);
+  items[3].message += "!";
+  items[4].key_id = "user2";
+  items[5].key_id = "user3";
+  ASSERT_EQ(bls.verifyBatch(items, verified), 13U);
+  for (size_t i = 0; i < items.size(); i++) {
+    ASSERT_EQ(verified[i], i < 3 || i > 5);
+  }
+
+  // ECDSA has no aggregation
+  OpenPKSIGContext ecdsa;
+  ecdsa.keygen("user1");
+  ecdsa.sign("user1", msg, sig);
+  ASSERT_THROW(ecdsa.aggregate({sig}, agg), ZCryptoBoxException);
+}
+
+TEST(libopenabe, CryptoBoxPKSIGMerkleBatch) {
+  TEST_DESCRIPTION("Testing that every message of a Merkle-signed batch verifies on its own");
+  OpenPKSIGContext pksig;
+  pksig.keygen("user1");
+  pksig.keygen("user2");
+
+  // batch sizes that exercise unpaired nodes at several levels
+  for (size_t count : {1, 2, 7, 33}) {
+    vector<string> records, sigs;
+    for (size_t i = 0; i < count; i++) {
+      records.push_back("log record " + to_string(i));
+    }
+    pksig.signMerkleBatch("user1", records, sigs);
+    ASSERT_EQ(sigs.size(), count);
+    for (size_t i = 0; i < count; i++) {
+      ASSERT_TRUE(pksig.verifyMerkle("user1", records[i], sigs[i]));
+      ASSERT_FALSE(pksig.verifyMerkle("user1", records[i] + "!", sigs[i]));
+      ASSERT_FALSE(pksig.verifyMerkle("user2", records[i], sigs[i]));
+      if (count > 1) {
+        // a proof only fits the message it was made for
+        ASSERT_FALSE(pksig.verifyMerkle("user1", records[(i + 1) % count], sigs[i]));
+      }
+    }
+  }
+
+  OpenPKSIGContext raw("NIST_P256", false);
+  raw.keygen("user1");
+  vector<string> records = {"a", "b", "c"}, sigs;
+  raw.signMerkleBatch("user1", records, sigs);
+  ASSERT_TRUE(raw.verifyMerkle("user1", "c", sigs[2]));
+  // a truncated proof or a changed batch size fails
+  ASSERT_FALSE(raw.verifyMerkle("user1", "c", sigs[2].substr(0, sigs[2].size() - 1)));
+  string resized = sigs[2];
+  resized[8] = 4;
+  ASSERT_FALSE(raw.verifyMerkle("user1", "c", resized));
+
+  // a plain signature on a root message does not pass as a batch of one
+  uint8_t leaf[SHA256_LEN];
+  string leafInput = string(1, '\0') + "c";
+  sha256(leaf, (uint8_t *)&leafInput[0], leafInput.size());
+  string rootMsg = string("\x02\0\0\0\x01", 5) + string((const char *)leaf, SHA256_LEN);
+  string plainSig, forged = string("\x4d\0\0\0\0\0\0\0\x01", 9);
+  raw.sign("user1", rootMsg, plainSig);
+  forged.push_back((char)(plainSig.size() >> 8));
+  forged.push_back((char)(plainSig.size() & 0xFF));
+  ASSERT_FALSE(raw.verifyMerkle("user1", "c", forged + plainSig));
+  // nor with the root label, which plain signing refuses
+  rootMsg.replace(0, 1, "OpenABE-MERKLE-ROOT-v1");
+  ASSERT_THROW(raw.sign("user1", rootMsg, plainSig), ZCryptoBoxException);
+  // and a root signature is no plain signature on its root message
+  vector<string> one = {"c"};
+  raw.signMerkleBatch("user1", one, sigs);
+  const string rootSig = sigs[0].substr(11, sigs[0].size() - 11);
+  ASSERT_TRUE(raw.verifyMerkle("user1", "c", sigs[0]));
+  ASSERT_FALSE(raw.verify("user1", rootMsg, rootSig));
+
+  ASSERT_THROW(pksig.signMerkleBatch("user1", vector<string>(), sigs), ZCryptoBoxException);
+}
+
+TEST(libopenabe, CryptoBoxPKESigncrypt) {
+  TEST_DESCRIPTION("Testing that signcrypt binds the sender and receiver to the message");
+  OpenPKEContext pke;
+  OpenPKSIGContext pksig;
+  string pt1 = "hello world!", pt2, ct;
+
+  pke.keygen("user1");
+  pke.keygen("user2");
+  pksig.keygen("sender");
+  pksig.keygen("other");
+
+  pke.signcrypt(pksig, "sender", "user1", pt1, ct);
+  ASSERT_TRUE(pke.unsigncrypt(pksig, "sender", "user1", ct, pt2));
+  ASSERT_EQ(pt1, pt2);
+
+  // wrong sender, wrong receiver and a tampered ciphertext
+  ASSERT_FALSE(pke.unsigncrypt(pksig, "other", "user1", ct, pt2));
+  ASSERT_TRUE(pt2.empty());
+  ASSERT_FALSE(pke.unsigncrypt(pksig, "sender", "user2", ct, pt2));
+  string bad = ct;
+  bad[bad.size() / 2] = (bad[bad.size() / 2] == 'A') ? 'B' : 'A';
+  ASSERT_FALSE(pke.unsigncrypt(pksig, "sender", "user1", bad, pt2));
+
+  vector<string> receivers, plaintexts, ciphertexts;
+  for (size_t i = 0; i < 8; i++) {
+    receivers.push_back((i % 2) ? "user2" : "user1");
+    plaintexts.push_back("message " + to_string(i));
+  }
+  pke.signcryptBatch(pksig, "sender", receivers, plaintexts, ciphertexts);
+  ASSERT_EQ(ciphertexts.size(), plaintexts.size());
+  for (size_t i = 0; i < ciphertexts.size(); i++) {
+    ASSERT_TRUE(pke.unsigncrypt(pksig, "sender", receivers[i], ciphertexts[i], pt2));
+    ASSERT_EQ(pt2, plaintexts[i]);
+  }
+
+  receivers.pop_back();
+  ASSERT_THROW(pke.signcryptBatch(pksig, "sender", receivers, plaintexts, ciphertexts),
+               ZCryptoBoxException);
+}
+
 struct thread_data {
   int id, time;
   OpenABERNG *shared_rng;
@@ -2396,6 +5242,194 @@ TEST(libopenabe, OpenABEThreadContext) {
   return;
 }
 
+TEST(libopenabe, BenchmarkSummaryStatistics) {
+  TEST_DESCRIPTION("Testing benchmark percentiles, outliers and baseline comparison");
+  vector<double> samples;
+  for (int i = 100; i >= 1; i--) {
+    samples.push_back(i);
+  }
+  samples.push_back(1000);
+  BenchmarkSummary summary = BenchmarkSummary::fromSamples(samples);
+  ASSERT_EQ(summary.count, 101U);
+  ASSERT_EQ(summary.min, 1.0);
+  ASSERT_EQ(summary.max, 1000.0);
+  ASSERT_EQ(summary.p50, 51.0);
+  ASSERT_EQ(summary.p95, 96.0);
+  ASSERT_EQ(summary.p99, 100.0);
+  ASSERT_EQ(summary.outliers, 1U);
+  ASSERT_EQ(summary.trimmedMean, 50.5);
+
+  ASSERT_FALSE(isBenchmarkRegression(summary, 50.0, 0.10));
+  ASSERT_TRUE(isBenchmarkRegression(summary, 40.0, 0.10));
+  ASSERT_EQ(BenchmarkSummary::fromSamples(vector<double>()).count, 0U);
+
+  int runs = 0;
+  BenchmarkSummary timed = runTimedBenchmark([&runs]() { runs++; }, 3, 10);
+  ASSERT_EQ(runs, 13);
+  ASSERT_EQ(timed.count, 10U);
+
+  const char *path = "benchmark_baseline.csv";
+  {
+    ofstream out(path);
+    out << "name,p50,allocs" << endl << "CP-ABE/encrypt,12.5,800" << endl;
+  }
+  BenchmarkBaseline p50s, allocs;
+  ASSERT_TRUE(loadBenchmarkBaseline(path, p50s));
+  ASSERT_TRUE(loadBenchmarkBaseline(path, allocs, "allocs"));
+  ASSERT_EQ(p50s["CP-ABE/encrypt"], 12.5);
+  ASSERT_EQ(allocs["CP-ABE/encrypt"], 800.0);
+  remove(path);
+}
+
+TEST(libopenabe, CpuFeatureQuery) {
+  TEST_DESCRIPTION("Testing that CPU feature detection is consistent with the reported code paths");
+  const OpenABECpuFeatures &f = OpenABE_getCpuFeatures();
+  ASSERT_EQ(&f, &OpenABE_getCpuFeatures());
+  // the AVX-512 extensions are only reported with AVX-512F itself
+  ASSERT_TRUE(!f.avx512ifma || f.avx512f);
+
+  vector<pair<string, string>> paths = OpenABE_getActiveCodePaths();
+  map<string, string> active(paths.begin(), paths.end());
+  ASSERT_EQ(active.size(), 4U);
+  ASSERT_EQ(active["openssl.sha256"] == "sha-ni", f.sha);
+  ASSERT_EQ(active["mcl.g1_mulvec"] == "avx512ifma", f.avx512ifma);
+  string features = OpenABE_getCpuFeatureString();
+  ASSERT_EQ(features.find("avx2") != string::npos, f.avx2);
+  ASSERT_NE(OpenABE_describeCodePaths().find("mcl.field: "), string::npos);
+}
+
+TEST(libopenabe, MetricsCountersAndContextSnapshot) {
+  TEST_DESCRIPTION("Testing the global metric registry and per-context snapshots");
+  OpenABECryptoContext cpabe("CP-ABE");
+  cpabe.generateParams();
+  string ct, pt1 = "hello world!", pt2;
+
+  // nothing is recorded while collection is off
+  OpenABE_resetMetrics();
+  cpabe.keygen("attr1|attr2", "key0");
+  OpenABEMetricsSnapshot global, context;
+  OpenABE_getMetrics(global);
+  ASSERT_EQ(global.get(OpenABE_LATENCY_KEYGEN).count, 0U);
+  ASSERT_EQ(global.get(OpenABE_METRIC_G1_EXP), 0U);
+
+  OpenABE_setMetricsEnabled(true);
+  cpabe.encrypt("attr1 and attr2", pt1, ct);
+  ASSERT_TRUE(cpabe.decrypt("key0", ct, pt2));
+  ASSERT_EQ(pt1, pt2);
+  cpabe.getMetrics(context);
+  OpenABE_getMetrics(global);
+  OpenABE_setMetricsEnabled(false);
+
+  ASSERT_EQ(context.get(OpenABE_LATENCY_ENCRYPT).count, 1U);
+  ASSERT_EQ(context.get(OpenABE_LATENCY_DECRYPT).count, 1U);
+  ASSERT_EQ(context.get(OpenABE_LATENCY_KEYGEN).count, 0U);
+  ASSERT_EQ(context.get(OpenABE_METRIC_BYTES_ENCRYPTED), pt1.size());
+  ASSERT_EQ(context.get(OpenABE_METRIC_BYTES_DECRYPTED), pt1.size());
+  ASSERT_GT(context.get(OpenABE_METRIC_PAIRINGS), 0U);
+  ASSERT_GT(context.get(OpenABE_LATENCY_DECRYPT).percentileMicros(0.5), 0.0);
+  // the global registry saw at least what this context did
+  for (int i = 0; i < OpenABE_METRIC_COUNT; i++) {
+    ASSERT_GE(global.counters[i], context.counters[i]);
+  }
+
+  OpenABE_resetMetrics();
+  cpabe.resetMetrics();
+  OpenABE_getMetrics(global);
+  cpabe.getMetrics(context);
+  ASSERT_EQ(global.get(OpenABE_LATENCY_ENCRYPT).count, 0U);
+  ASSERT_EQ(context.get(OpenABE_METRIC_PAIRINGS), 0U);
+}
+
+TEST(libopenabe, AllocationCountsAndPeakBytes) {
+  TEST_DESCRIPTION("Testing allocation counters and heap high-water marks per operation");
+  OpenABE_setMetricsEnabled(true);
+  BenchmarkSummary summary = runTimedBenchmark([]() {
+    unique_ptr<char[]> a(new char[1000]);
+    unique_ptr<char[]> b(new char[3000]);
+  }, 1, 5);
+  ASSERT_EQ(summary.allocations, 2.0);
+  ASSERT_EQ(summary.allocatedBytes, 4000.0);
+  ASSERT_EQ(summary.peakBytes, 4000U);
+
+  OpenABECryptoContext cpabe("CP-ABE");
+  cpabe.generateParams();
+  string ct, pt;
+  cpabe.keygen("attr1|attr2", "key0");
+  cpabe.encrypt("attr1 and attr2", "hello world!", ct);
+  ASSERT_TRUE(cpabe.decrypt("key0", ct, pt));
+  OpenABEMetricsSnapshot context;
+  cpabe.getMetrics(context);
+  OpenABE_setMetricsEnabled(false);
+
+  ASSERT_GT(context.get(OpenABE_METRIC_ALLOCATIONS), 0U);
+  ASSERT_GE(context.get(OpenABE_METRIC_ALLOCATED_BYTES), context.get(OpenABE_METRIC_ALLOCATIONS));
+  const OpenABELatencyHistogram &encrypt = context.get(OpenABE_LATENCY_ENCRYPT);
+  ASSERT_GT(encrypt.peakBytesMax, 0U);
+  ASSERT_LE(encrypt.peakBytesMax, context.get(OpenABE_METRIC_ALLOCATED_BYTES));
+}
+
+static void collectSpan(const OpenABE_SPAN *span, void *context) {
+  static_cast<vector<OpenABE_SPAN>*>(context)->push_back(*span);
+}
+
+TEST(libopenabe, TraceSpansForEncryptAndDecrypt) {
+  TEST_DESCRIPTION("Testing that encrypt/decrypt phases are reported as nested spans");
+  OpenABECryptoContext cpabe("CP-ABE");
+  cpabe.generateParams();
+  cpabe.keygen("|attr1|attr2", "key0");
+  string ct, pt1 = "hello world!", pt2;
+
+  vector<OpenABE_SPAN> spans;
+  OpenABE_setSpanSink(collectSpan, &spans);
+  cpabe.encrypt("attr1 and attr2", pt1, ct);
+  ASSERT_TRUE(cpabe.decrypt("key0", ct, pt2));
+  OpenABE_setSpanSink(NULL, NULL);
+  ASSERT_EQ(pt1, pt2);
+
+  map<string, const OpenABE_SPAN*> byName;
+  map<uint64_t, const OpenABE_SPAN*> byID;
+  for (const OpenABE_SPAN &span : spans) {
+    byName[span.name] = &span;
+    byID[span.spanId] = &span;
+  }
+  for (const char *name : {"oabe.encrypt", "abe.encrypt", "abe.encapsulate", "lsss.share",
+                           "rows", "kdf", "aead.encrypt", "oabe.decrypt", "abe.decrypt",
+                           "abe.decapsulate", "lsss.recover", "multi_pairing", "cca.verify",
+                           "aead.decrypt"}) {
+    ASSERT_TRUE(byName.count(name) == 1) << name;
+    ASSERT_EQ(byName[name]->status, OpenABE_NOERROR) << name;
+  }
+  // roots are the API calls; everything else has a parent in the same trace
+  // that started no later and ended no earlier
+  for (const OpenABE_SPAN &span : spans) {
+    if (span.parentSpanId == 0) {
+      ASSERT_EQ(span.traceId, span.spanId);
+      ASSERT_EQ(string(span.name).compare(0, 5, "oabe."), 0) << span.name;
+      continue;
+    }
+    ASSERT_TRUE(byID.count(span.parentSpanId) == 1) << span.name;
+    const OpenABE_SPAN *parent = byID[span.parentSpanId];
+    ASSERT_EQ(span.traceId, parent->traceId);
+    ASSERT_LE(parent->startUnixNanos, span.startUnixNanos + 1000);
+    ASSERT_GE(parent->durationNanos, span.durationNanos);
+  }
+  ASSERT_EQ(byID[byName["cca.verify"]->parentSpanId]->name, string("abe.decapsulate"));
+  ASSERT_EQ(byName["aead.decrypt"]->items, pt1.size());
+
+  // a failed decryption is reported on its spans
+  spans.clear();
+  OpenABE_setSpanSink(collectSpan, &spans);
+  ASSERT_FALSE(cpabe.decrypt("key0", ct.substr(0, ct.size() - 8) + "AAAAAAAA", pt2));
+  OpenABE_setSpanSink(NULL, NULL);
+  ASSERT_FALSE(spans.empty());
+  ASSERT_EQ(string(spans.back().name), "oabe.decrypt");
+  bool failed = false;
+  for (const OpenABE_SPAN &span : spans) {
+    failed |= (span.status != OpenABE_NOERROR);
+  }
+  ASSERT_TRUE(failed);
+}
+
 }
 
 int main(int argc, char **argv)
@@ -151,6 +151,75 @@ TEST_F(ZeutroMathLib, MultInverseZP) {
   ASSERT_EQ(one, a * c);
 }
 
+TEST_F(ZeutroMathLib, BatchInverseZP) {
+  TEST_DESCRIPTION("Testing that batch inversion of ZP elements matches individual inverses");
+  vector<ZP> elts, inverses;
+  for (int i = 0; i < 9; i++) {
+    elts.push_back(pgroup_->randomZP(rng_.get()));
+  }
+  inverses = elts;
+  ZP::batchInverse(inverses.data(), inverses.size());
+  for (size_t i = 0; i < elts.size(); i++) {
+    ZP c = elts[i];
+    c.multInverse();
+    ASSERT_EQ(c, inverses[i]);
+  }
+
+  ZP single = elts[0];
+  ZP::batchInverse(&single, 1);
+  ASSERT_EQ(single, inverses[0]);
+
+  pgroup_->initZP(elts[4], 0);
+  ASSERT_ANY_THROW(ZP::batchInverse(elts.data(), elts.size()));
+}
+
+TEST_F(ZeutroMathLib, ScalarMatchesZP) {
+  TEST_DESCRIPTION("Testing that value-only scalar arithmetic agrees with ZP");
+  ZP x = pgroup_->randomZP(rng_.get());
+  ZP y = pgroup_->randomZP(rng_.get());
+  ZPScalar sx(x), sy(y);
+
+  ZP out = x;
+  (sx * sy).toZP(out);
+  ASSERT_EQ(out, x * y);
+  (sx - sy).toZP(out);
+  ASSERT_EQ(out, x - y);
+  ZPScalar sum = sx;
+  sum += sy;
+  sum.toZP(out);
+  ASSERT_EQ(out, x + y);
+  (-sx).toZP(out);
+  ASSERT_EQ(out, -x);
+
+  vector<ZPScalar> scalars;
+  vector<ZP> elts;
+  for (int i = 0; i < 9; i++) {
+    elts.push_back(pgroup_->randomZP(rng_.get()));
+    scalars.push_back(ZPScalar(elts.back()));
+  }
+  ZP::batchInverse(elts.data(), elts.size());
+  ZPScalar::batchInverse(scalars.data(), scalars.size());
+  for (size_t i = 0; i < elts.size(); i++) {
+    scalars[i].toZP(out);
+    ASSERT_EQ(out, elts[i]);
+  }
+
+  scalars[4] = ZPScalar(0);
+  ASSERT_ANY_THROW(ZPScalar::batchInverse(scalars.data(), scalars.size()));
+}
+
+TEST_F(ZeutroMathLib, CurveSwitchRefusedWhileGroupsLive) {
+  TEST_DESCRIPTION("Testing that another curve cannot be initialized under live groups");
+  string other = (DEFAULT_BP_PARAM == "BN_P254") ? "BLS12_P381" : "BN_P254";
+  ASSERT_ANY_THROW(OpenABEPairing p(other));
+
+  // the same curve can always be shared, and the fixture is still usable
+  OpenABEPairing same(DEFAULT_BP_PARAM);
+  ZP x = pgroup_->randomZP(rng_.get());
+  ZP y = same.randomZP(rng_.get());
+  ASSERT_EQ((x * y) / y, x);
+}
+
 TEST_F(ZeutroMathLib, MultiplyAndDivideZP) {
   TEST_DESCRIPTION("Testing that multiplication and division for ZP elements works correctly");
   ZP x = pgroup_->randomZP(rng_.get());
@@ -301,6 +370,36 @@ TEST_F(ZeutroMathLib, ExpG1Tests) {
   ASSERT_EQ(a.exp(z), g);
 }
 
+TEST_F(ZeutroMathLib, InPlaceAndMoveG1Tests) {
+  TEST_DESCRIPTION("Testing that in-place and move operations on G1 match the copying ones");
+  G1 g = pgroup_->randomG1(rng_.get());
+  G1 h = pgroup_->randomG1(rng_.get());
+  ZP r = pgroup_->randomZP(rng_.get());
+  G1 expected = g.exp(r) * h;
+
+  G1 a = g;
+  a.expInPlace(r);
+  ASSERT_EQ(a, g.exp(r));
+  a *= h;
+  ASSERT_EQ(a, expected);
+  // a temporary lhs is reused by operator*
+  ASSERT_EQ(g.exp(r) * h, expected);
+
+  G1 moved(std::move(a));
+  ASSERT_EQ(moved, expected);
+  // a moved-from element can be assigned again
+  a = h;
+  ASSERT_EQ(a, h);
+  a = std::move(moved);
+  ASSERT_EQ(a, expected);
+
+  ZP s = r;
+  s += r;
+  ASSERT_EQ(s, r + r);
+  s *= r;
+  ASSERT_EQ(s, (r + r) * r);
+}
+
 TEST_F(ZeutroMathLib, SerializeG1) {
   TEST_DESCRIPTION("Testing that G1 serialize/deserialize works correctly");
   G1 g = pgroup_->randomG1(rng_.get());
@@ -336,6 +435,48 @@ TEST_F(ZeutroMathLib, HashToG1) {
 
 
 ////// G2 unit tests //////
+TEST_F(ZeutroMathLib, MultiExpG1) {
+  TEST_DESCRIPTION("Testing that G1 multi-exponentiation matches the naive product");
+  vector<G1> bases;
+  vector<ZP> exps;
+  G1 prod = pgroup_->initG1();
+  for (size_t i = 0; i < NUM_PAIRING_TESTS; i++) {
+    bases.push_back(pgroup_->randomG1(rng_.get()));
+    exps.push_back(pgroup_->randomZP(rng_.get()));
+    prod *= bases.back().exp(exps.back());
+  }
+  ASSERT_EQ(G1::multiExp(bases, exps), prod);
+
+  exps.pop_back();
+  EXPECT_THROW(G1::multiExp(bases, exps), OpenABE_ERROR);
+}
+
+TEST_F(ZeutroMathLib, DoubleExpG1) {
+  TEST_DESCRIPTION("Testing that G1 double exponentiation matches two exponentiations");
+  for (size_t i = 0; i < NUM_PAIRING_TESTS; i++) {
+    G1 P = pgroup_->randomG1(rng_.get()), Q = pgroup_->randomG1(rng_.get());
+    ZP a = pgroup_->randomZP(rng_.get()), b = pgroup_->randomZP(rng_.get());
+    ASSERT_EQ(G1::doubleExp(P, a, Q, b), P.exp(a) * Q.exp(b));
+    ASSERT_EQ(G1::doubleExp(P, a, Q, -b), P.exp(a) / Q.exp(b));
+  }
+}
+
+TEST_F(ZeutroMathLib, FixedBaseG1) {
+  TEST_DESCRIPTION("Testing that fixed-base exponentiation in G1 matches G1::exp");
+  G1 g = pgroup_->randomG1(rng_.get());
+  G1FixedBase fb(g);
+  ZP zero, one;
+  pgroup_->initZP(zero, 0);
+  pgroup_->initZP(one, 1);
+  ASSERT_EQ(fb.exp(one), g);
+  ASSERT_EQ(fb.exp(zero), g.exp(zero));
+  ASSERT_EQ(fb.exp(-one), -g);
+  for (size_t i = 0; i < NUM_PAIRING_TESTS; i++) {
+    ZP r = pgroup_->randomZP(rng_.get());
+    ASSERT_EQ(fb.exp(r), g.exp(r));
+  }
+}
+
 TEST_F(ZeutroMathLib, RandomG2) {
   TEST_DESCRIPTION("Testing that random G2 works correctly");
   G2 a = pgroup_->randomG2(rng_.get());
@@ -401,6 +542,33 @@ TEST_F(ZeutroMathLib, MembershipTestG2) {
   ASSERT_TRUE(g.ismember(pgroup_->order));
 }
 
+TEST_F(ZeutroMathLib, MultiExpG2) {
+  TEST_DESCRIPTION("Testing that G2 multi-exponentiation matches the naive product");
+  vector<G2> bases;
+  vector<ZP> exps;
+  G2 prod = pgroup_->initG2();
+  for (size_t i = 0; i < NUM_PAIRING_TESTS; i++) {
+    bases.push_back(pgroup_->randomG2(rng_.get()));
+    exps.push_back(pgroup_->randomZP(rng_.get()));
+    prod *= bases.back().exp(exps.back());
+  }
+  ASSERT_EQ(G2::multiExp(bases, exps), prod);
+}
+
+TEST_F(ZeutroMathLib, FixedBaseG2) {
+  TEST_DESCRIPTION("Testing that fixed-base exponentiation in G2 matches G2::exp");
+  G2 g = pgroup_->randomG2(rng_.get());
+  G2FixedBase fb(g);
+  ZP one;
+  pgroup_->initZP(one, 1);
+  ASSERT_EQ(fb.exp(one), g);
+  ASSERT_EQ(fb.exp(-one), -g);
+  for (size_t i = 0; i < NUM_PAIRING_TESTS; i++) {
+    ZP r = pgroup_->randomZP(rng_.get());
+    ASSERT_EQ(fb.exp(r), g.exp(r));
+  }
+}
+
 ////// GT unit tests //////
 TEST_F(ZeutroMathLib, MulGTTests) {
   TEST_DESCRIPTION("Testing that multiplication with GT works correctly");
@@ -445,6 +613,106 @@ TEST_F(ZeutroMathLib, ExpGTTests) {
   ZP z = r;
   z.multInverse();
   ASSERT_EQ(a.exp(z), gt);
+
+  GT b = gt;
+  b.expInPlace(r);
+  ASSERT_EQ(b, a);
+  b *= gt;
+  ASSERT_EQ(b, a * gt);
+}
+
+TEST_F(ZeutroMathLib, FixedBaseGT) {
+  TEST_DESCRIPTION("Testing that fixed-base exponentiation in GT matches GT::exp");
+  G1 g1 = pgroup_->randomG1(rng_.get());
+  G2 g2 = pgroup_->randomG2(rng_.get());
+  GT gt = pgroup_->pairing(g1,g2);
+  GTFixedBase fb(gt);
+  ZP zero, one, sixteen;
+  pgroup_->initZP(zero, 0);
+  pgroup_->initZP(one, 1);
+  pgroup_->initZP(sixteen, 16);
+  ASSERT_EQ(fb.exp(one), gt);
+  ASSERT_EQ(fb.exp(zero), gt.exp(zero));
+  // exercises the negative digits of the signed recoding
+  ASSERT_EQ(fb.exp(sixteen), gt.exp(sixteen));
+  ASSERT_EQ(fb.exp(-one), gt.exp(-one));
+  for (size_t i = 0; i < NUM_PAIRING_TESTS; i++) {
+    ZP r = pgroup_->randomZP(rng_.get());
+    ASSERT_EQ(fb.exp(r), gt.exp(r));
+  }
+}
+
+TEST_F(ZeutroMathLib, HashToG1Cache) {
+  TEST_DESCRIPTION("Testing that cached hashToG1 matches the pairing and stays bounded");
+  OpenABEPrecomputedParams pre(nullptr, 4);
+  OpenABEByteString k, k2;
+  k.appendArray((uint8_t *)"prefix-one", 10);
+  k2.appendArray((uint8_t *)"prefix-two", 10);
+  for (size_t i = 0; i < NUM_PAIRING_TESTS; i++) {
+    string label = "attr" + to_string(i % 6);
+    ASSERT_EQ(pre.hashToG1(pgroup_.get(), k, label), pgroup_->hashToG1(k, label));
+    // a hit must return the same point
+    ASSERT_EQ(pre.hashToG1(pgroup_.get(), k, label), pgroup_->hashToG1(k, label));
+    ASSERT_LE(pre.getHashCacheCount(), 4u);
+  }
+  // entries are keyed by the hash prefix as well as the label
+  ASSERT_FALSE(pre.hashToG1(pgroup_.get(), k, "attr0") ==
+               pre.hashToG1(pgroup_.get(), k2, "attr0"));
+}
+
+TEST_F(ZeutroMathLib, HashToG1Batch) {
+  TEST_DESCRIPTION("Testing that batched hashToG1 matches hashing one label at a time");
+  OpenABEByteString k;
+  k.appendArray((uint8_t *)"prefix-one", 10);
+  vector<string> labels;
+  for (size_t i = 0; i < 2 * HASH_TO_G1_BATCH_PARALLEL; i++) {
+    labels.push_back("attr" + to_string(i % (HASH_TO_G1_BATCH_PARALLEL + 3)));
+  }
+  for (size_t threads : {1U, 0U}) {
+    vector<G1> points = pgroup_->hashToG1Batch(k, labels, threads);
+    ASSERT_EQ(points.size(), labels.size());
+    for (size_t i = 0; i < labels.size(); i++) {
+      ASSERT_EQ(points[i], pgroup_->hashToG1(k, labels[i]));
+    }
+  }
+  ASSERT_TRUE(pgroup_->hashToG1Batch(k, vector<string>()).empty());
+
+  // prefetching fills the cache with the distinct labels, up to its size
+  OpenABEPrecomputedParams pre(nullptr, 8);
+  pre.prefetchHashes(pgroup_.get(), k, labels);
+  ASSERT_EQ(pre.getHashCacheCount(), 8U);
+  OpenABEPrecomputedParams all(nullptr);
+  all.prefetchHashes(pgroup_.get(), k, labels);
+  ASSERT_EQ(all.getHashCacheCount(), HASH_TO_G1_BATCH_PARALLEL + 3U);
+  for (const string &label : labels) {
+    ASSERT_EQ(all.hashToG1(pgroup_.get(), k, label), pgroup_->hashToG1(k, label));
+  }
+  ASSERT_EQ(all.getHashCacheCount(), HASH_TO_G1_BATCH_PARALLEL + 3U);
+}
+
+TEST_F(ZeutroMathLib, HashToG1ExpTables) {
+  TEST_DESCRIPTION("Testing that hot hashed attributes get bounded fixed-base tables");
+  OpenABEPrecomputedParams pre(nullptr, 8, 2);
+  OpenABEByteString k;
+  k.appendArray((uint8_t *)"prefix-one", 10);
+  G1 g = pgroup_->randomG1(rng_.get());
+  G1FixedBase fb(g);
+  for (size_t round = 0; round < ATTRIBUTE_TABLE_MIN_HITS + 2; round++) {
+    for (size_t j = 0; j < 3; j++) {
+      string label = "attr" + to_string(j);
+      ZP r = pgroup_->randomZP(rng_.get());
+      G1 expected = pgroup_->hashToG1(k, label);
+      expected.expInPlace(r);
+      // the table path and the variable-base path must agree
+      ASSERT_EQ(pre.hashToG1Exp(pgroup_.get(), k, label, r), expected);
+      ASSERT_EQ(pre.hashToG1Exp(pgroup_.get(), k, label, -r), -expected);
+      ZP e = pgroup_->randomZP(rng_.get());
+      ASSERT_EQ(pre.hashToG1Exp(pgroup_.get(), k, label, r, fb, e), g.exp(e) * expected);
+    }
+    ASSERT_LE(pre.getAttributeTableCount(), 2u);
+  }
+  ASSERT_EQ(pre.getAttributeTableCount(), 2u);
+  ASSERT_EQ(pre.hashToG1(pgroup_.get(), k, "attr0"), pgroup_->hashToG1(k, "attr0"));
 }
 
 TEST_F(ZeutroMathLib, SerializeGT) {
@@ -470,6 +738,410 @@ TEST_F(ZeutroMathLib, MembershipTestGT) {
   ASSERT_TRUE(gt.ismember(pgroup_->order));
 }
 
+TEST_F(ZeutroMathLib, CyclotomicGT) {
+  TEST_DESCRIPTION("Testing that the unitary inverse inverts pairing outputs");
+  G1 g1 = pgroup_->randomG1(rng_.get());
+  G2 g2 = pgroup_->randomG2(rng_.get());
+  GT x = pgroup_->pairing(g1, g2);
+  G1 h1 = pgroup_->randomG1(rng_.get());
+  GT y = pgroup_->pairing(h1, g2);
+  GT one = pgroup_->initGT();
+  one.setIdentity();
+  ASSERT_EQ(x * x.conjugate(), one);
+  ASSERT_EQ(x / y, x * y.conjugate());
+  ASSERT_EQ(x / y, x * -y);
+
+  // exponentiation (cyclotomic squarings) agrees with the pairing's
+  // bilinearity and with the inverse of a negated exponent
+  ZP a = pgroup_->randomZP(rng_.get());
+  G1 g1a = g1.exp(a);
+  ASSERT_EQ(x.exp(a), pgroup_->pairing(g1a, g2));
+  ASSERT_EQ(x.exp(-a), x.exp(a).conjugate());
+}
+
+TEST_F(ZeutroMathLib, GTKeyDerivation) {
+  TEST_DESCRIPTION("Testing that the streamed GT KDF matches the original construction");
+  G1 g1 = pgroup_->randomG1(rng_.get());
+  G2 g2 = pgroup_->randomG2(rng_.get());
+  GT gt = pgroup_->pairing(g1, g2);
+
+  OpenABEByteString serialized;
+  gt.serialize(serialized);
+  for (uint32_t keyLen : {16u, 32u, 64u, 96u}) {
+    // v1 as originally specified: a running transcript of
+    // offset || serialize(GT) || |serialize(GT)|, hashed after each block
+    stringstream transcript;
+    OpenABEByteString expected;
+    for (uint32_t numBytes = 0; numBytes < keyLen; numBytes += SHA256_LEN) {
+      transcript << numBytes << serialized << serialized.size();
+      string hash;
+      sha256(hash, (uint8_t *)transcript.str().c_str(), transcript.str().size());
+      expected.appendArray((uint8_t *)hash.c_str(), SHA256_LEN);
+    }
+
+    OpenABEByteString v1, v2, v2again;
+    ASSERT_TRUE(OpenABEUtilsHashToString(gt, keyLen, v1));
+    ASSERT_EQ(v1, expected);
+    ASSERT_TRUE(OpenABEUtilsHashToString(gt, keyLen, v2,
+                  HASH_FUNCTION_TYPE_SHA256, OpenABE_GT_KDF_V2));
+    ASSERT_TRUE(OpenABEUtilsHashToString(gt, keyLen, v2again,
+                  HASH_FUNCTION_TYPE_SHA256, OpenABE_GT_KDF_V2));
+    ASSERT_EQ(v2, v2again);
+    ASSERT_NE(v1, v2);
+  }
+
+  OpenABESymKey key;
+  ASSERT_TRUE(key.hashToSymmetricKey(gt, 32));
+  OpenABEByteString v1;
+  OpenABEUtilsHashToString(gt, 32, v1);
+  ASSERT_EQ(key.getKeyBytes(), v1);
+}
+
+TEST_F(ZeutroMathLib, MultiPairingGT) {
+  TEST_DESCRIPTION("Testing that multi-pairing matches the product of pairings");
+  vector<G1> g1;
+  vector<G2> g2;
+  GT prod = pgroup_->initGT();
+  prod.setIdentity();
+  for (size_t i = 0; i < NUM_PAIRING_TESTS; i++) {
+    g1.push_back(pgroup_->randomG1(rng_.get()));
+    g2.push_back(pgroup_->randomG2(rng_.get()));
+    prod = prod * pgroup_->pairing(g1.back(), g2.back());
+  }
+
+  GT gt = pgroup_->initGT();
+  pgroup_->multi_pairing(gt, g1, g2);
+  ASSERT_EQ(gt, prod);
+
+  // an empty product is the identity
+  vector<G1> e1;
+  vector<G2> e2;
+  GT one = pgroup_->initGT();
+  one.setIdentity();
+  pgroup_->multi_pairing(gt, e1, e2);
+  ASSERT_EQ(gt, one);
+}
+
+TEST_F(ZeutroMathLib, MultiPairingLineTables) {
+  TEST_DESCRIPTION("Testing that pairings against precomputed G2 lines match plain pairings");
+  vector<G1> g1, fixedG1;
+  vector<G2> g2;
+  vector<unique_ptr<G2LineTable>> tables;
+  vector<const G2LineTable*> fixedG2;
+  GT prod = pgroup_->initGT();
+  prod.setIdentity();
+  for (size_t i = 0; i < NUM_PAIRING_TESTS; i++) {
+    g1.push_back(pgroup_->randomG1(rng_.get()));
+    g2.push_back(pgroup_->randomG2(rng_.get()));
+    prod = prod * pgroup_->pairing(g1.back(), g2.back());
+
+    G1 p = pgroup_->randomG1(rng_.get());
+    G2 q = pgroup_->randomG2(rng_.get());
+    prod = prod * pgroup_->pairing(p, q);
+    fixedG1.push_back(p);
+    tables.emplace_back(new G2LineTable(q));
+    fixedG2.push_back(tables.back().get());
+  }
+
+  GT gt = pgroup_->initGT();
+  pgroup_->multi_pairing(gt, g1.data(), g2.data(), g1.size(),
+                         fixedG1.data(), fixedG2.data(), fixedG2.size());
+  ASSERT_EQ(gt, prod);
+
+  // only fixed pairs
+  G2 q0 = tables[0]->getElement();
+  GT fixedOnly = pgroup_->pairing(fixedG1[0], q0);
+  pgroup_->multi_pairing(gt, nullptr, nullptr, 0, fixedG1.data(), fixedG2.data(), 1);
+  ASSERT_EQ(gt, fixedOnly);
+}
+
+TEST_F(ZeutroMathLib, MultiPairingChunked) {
+  TEST_DESCRIPTION("Testing that multi-pairings split over the thread pool match the product of pairings");
+  size_t workers = OpenABEThreadPool::getDefault()->size();
+  OpenABEThreadPool::setDefaultSize(3);
+  const size_t n = 4 * MILLER_LOOP_PARALLEL_CHUNK + 5;
+  vector<G1> g1, fixedG1;
+  vector<G2> g2;
+  vector<unique_ptr<G2LineTable>> tables;
+  vector<const G2LineTable*> fixedG2;
+  GT prod = pgroup_->initGT(), fixedProd = pgroup_->initGT();
+  prod.setIdentity();
+  fixedProd.setIdentity();
+  for (size_t i = 0; i < n; i++) {
+    g1.push_back(pgroup_->randomG1(rng_.get()));
+    g2.push_back(pgroup_->randomG2(rng_.get()));
+    prod = prod * pgroup_->pairing(g1.back(), g2.back());
+
+    G1 p = pgroup_->randomG1(rng_.get());
+    G2 q = pgroup_->randomG2(rng_.get());
+    fixedProd = fixedProd * pgroup_->pairing(p, q);
+    fixedG1.push_back(p);
+    tables.emplace_back(new G2LineTable(q));
+    fixedG2.push_back(tables.back().get());
+  }
+
+  GT gt = pgroup_->initGT();
+  pgroup_->multi_pairing(gt, g1, g2);
+  ASSERT_EQ(gt, prod);
+  pgroup_->multi_pairing(gt, nullptr, nullptr, 0, fixedG1.data(), fixedG2.data(), n);
+  ASSERT_EQ(gt, fixedProd);
+  pgroup_->multi_pairing(gt, g1.data(), g2.data(), n, fixedG1.data(), fixedG2.data(), n);
+  ASSERT_EQ(gt, prod * fixedProd);
+  OpenABEThreadPool::setDefaultSize(workers);
+}
+
+#if defined(BP_WITH_MCL)
+// stands in for a device backend: counts the calls it takes and computes
+// them with MCL, or declines all of them
+static int testMillerLoopVec(void *context, mclBnGT *out, const mclBnG1 *p,
+                             const mclBnG2 *q, size_t n) {
+  int *calls = (int *)context;
+  if (calls == nullptr) {
+    return -1;
+  }
+  (*calls)++;
+  mclBn_millerLoopVec(out, p, q, (mclSize)n);
+  return 0;
+}
+
+static int testG1MulVec(void *context, mclBnG1 *out, mclBnG1 *x, const mclBnFr *y, size_t n) {
+  int *calls = (int *)context;
+  if (calls == nullptr) {
+    return -1;
+  }
+  (*calls)++;
+  mclBnG1_mulVec(out, x, y, (mclSize)n);
+  return 0;
+}
+
+TEST_F(ZeutroMathLib, BatchAccelerator) {
+  TEST_DESCRIPTION("Testing that an installed batch accelerator takes large batches only");
+  vector<G1> g1, bases;
+  vector<G2> g2;
+  vector<ZP> exps;
+  for (size_t i = 0; i < NUM_PAIRING_TESTS; i++) {
+    g1.push_back(pgroup_->randomG1(rng_.get()));
+    g2.push_back(pgroup_->randomG2(rng_.get()));
+    bases.push_back(pgroup_->randomG1(rng_.get()));
+    exps.push_back(pgroup_->randomZP(rng_.get()));
+  }
+  GT expected = pgroup_->initGT(), gt = pgroup_->initGT();
+  pgroup_->multi_pairing(expected, g1, g2);
+  G1 expectedExp = G1::multiExp(bases, exps);
+
+  int calls = 0;
+  OpenABEBatchAccelerator accel = { "test", 2, 2, testMillerLoopVec, testG1MulVec,
+                                    nullptr, &calls };
+  OpenABE_setBatchAccelerator(&accel);
+  ASSERT_EQ(OpenABE_getBatchAccelerator(), &accel);
+  pgroup_->multi_pairing(gt, g1, g2);
+  ASSERT_EQ(gt, expected);
+  ASSERT_EQ(G1::multiExp(bases, exps), expectedExp);
+  ASSERT_EQ(calls, 2);
+
+  // below the thresholds the CPU keeps the work
+  GT single = pgroup_->initGT();
+  pgroup_->multi_pairing(single, g1.data(), g2.data(), 1);
+  ASSERT_EQ(single, pgroup_->pairing(g1[0], g2[0]));
+  ASSERT_EQ(calls, 2);
+
+  // a backend that declines falls back to the CPU
+  accel.context = nullptr;
+  pgroup_->multi_pairing(gt, g1, g2);
+  ASSERT_EQ(gt, expected);
+  ASSERT_EQ(G1::multiExp(bases, exps), expectedExp);
+
+  OpenABE_setBatchAccelerator(nullptr);
+  ASSERT_TRUE(OpenABE_getBatchAccelerator() == nullptr);
+}
+
+TEST_F(ZeutroMathLib, ContiguousElementVectors) {
+  TEST_DESCRIPTION("Testing that G1Vector/G2Vector match the per-element operations");
+  vector<G1> g1;
+  vector<G2> g2;
+  vector<ZP> exps;
+  for (size_t i = 0; i < NUM_PAIRING_TESTS; i++) {
+    // products, so that the points are not all in affine form
+    g1.push_back(pgroup_->randomG1(rng_.get()) * pgroup_->randomG1(rng_.get()));
+    g2.push_back(pgroup_->randomG2(rng_.get()) * pgroup_->randomG2(rng_.get()));
+    exps.push_back(pgroup_->randomZP(rng_.get()));
+  }
+  g1.push_back(pgroup_->initG1());
+  g2.push_back(pgroup_->initG2());
+  exps.push_back(pgroup_->randomZP(rng_.get()));
+
+  G1Vector v1(g1[0].bgroup, g1.data(), g1.size());
+  G2Vector v2(g2[0].bgroup, g2.data(), g2.size());
+  ASSERT_EQ(v1.size(), g1.size());
+  ASSERT_EQ(v1.multiExp(exps.data()), G1::multiExp(g1, exps));
+  ASSERT_EQ(v2.multiExp(exps.data()), G2::multiExp(g2, exps));
+
+  GT expected = pgroup_->initGT(), gt = pgroup_->initGT();
+  pgroup_->multi_pairing(expected, g1, g2);
+  pgroup_->multi_pairing(gt, v1, v2);
+  ASSERT_EQ(gt, expected);
+
+  v1.normalize();
+  v2.normalize();
+  for (size_t i = 0; i < g1.size(); i++) {
+    ASSERT_EQ(v1.get(i), g1[i]);
+    ASSERT_EQ(v2.get(i), g2[i]);
+  }
+  for (size_t i = 0; i + 1 < g1.size(); i++) {
+    ASSERT_EQ(mclBnFp_isOne(&v1.data()[i].z), 1);
+  }
+
+  OpenABEByteString bytes;
+  G1Vector r1(g1[0].bgroup);
+  G2Vector r2(g2[0].bgroup);
+  v1.serialize(bytes);
+  r1.deserialize(bytes);
+  ASSERT_EQ(r1.size(), g1.size());
+  v2.serialize(bytes);
+  r2.deserialize(bytes);
+  for (size_t i = 0; i < g1.size(); i++) {
+    ASSERT_EQ(r1.get(i), g1[i]);
+    ASSERT_EQ(r2.get(i), g2[i]);
+  }
+  bytes.pop_back();
+  EXPECT_THROW(r2.deserialize(bytes), OpenABE_ERROR);
+}
+
+TEST_F(ZeutroMathLib, NormalizeAllPoints) {
+  TEST_DESCRIPTION("Testing that batch normalization keeps the points and their encodings");
+  vector<G1> g1;
+  vector<G2> g2;
+  vector<OpenABEByteString> b1, b2;
+  for (size_t i = 0; i < NUM_PAIRING_TESTS; i++) {
+    g1.push_back(pgroup_->randomG1(rng_.get()) * pgroup_->randomG1(rng_.get()));
+    g2.push_back(pgroup_->randomG2(rng_.get()) * pgroup_->randomG2(rng_.get()));
+  }
+  // the identity and an already affine point are left as they are
+  g1.push_back(pgroup_->initG1());
+  g2.push_back(pgroup_->initG2());
+  g1.push_back(pgroup_->randomG1(rng_.get()));
+  g2.push_back(pgroup_->randomG2(rng_.get()));
+  vector<G1> c1(g1);
+  vector<G2> c2(g2);
+  vector<G1 *> p1;
+  vector<G2 *> p2;
+  for (size_t i = 0; i < g1.size(); i++) {
+    OpenABEByteString bytes;
+    g1[i].serialize(bytes);
+    b1.push_back(bytes);
+    g2[i].serialize(bytes);
+    b2.push_back(bytes);
+    p1.push_back(&c1[i]);
+    p2.push_back(&c2[i]);
+  }
+
+  G1::normalizeAll(p1.data(), p1.size());
+  G2::normalizeAll(p2.data(), p2.size());
+  for (size_t i = 0; i < g1.size(); i++) {
+    OpenABEByteString bytes;
+    ASSERT_EQ(c1[i], g1[i]);
+    ASSERT_EQ(c2[i], g2[i]);
+    c1[i].serialize(bytes);
+    ASSERT_EQ(bytes, b1[i]);
+    c2[i].serialize(bytes);
+    ASSERT_EQ(bytes, b2[i]);
+  }
+}
+
+TEST_F(ZeutroMathLib, NativeSerializationFormat) {
+  TEST_DESCRIPTION("Testing that ZP/G1/G2 encode as the MCL serialization behind the usual headers");
+  ZP z = pgroup_->randomZP(rng_.get());
+  G1 g = pgroup_->randomG1(rng_.get()) * pgroup_->randomG1(rng_.get());
+  G2 h = pgroup_->randomG2(rng_.get()) * pgroup_->randomG2(rng_.get());
+  uint8_t buf[MAX_BUFFER_SIZE];
+  OpenABEByteString bytes, raw, expected;
+
+  size_t len = mclBnFr_serialize(buf, sizeof(buf), &z.m_ZP);
+  expected.push_back(OpenABE_ELEMENT_ZP);
+  expected.pack16bits((uint16_t)len);
+  expected.appendArray(buf, len);
+  z.serialize(bytes);
+  ASSERT_EQ(bytes, expected);
+
+  len = mclBnG1_serialize(buf, sizeof(buf), &g.m_G1);
+  raw.appendArray(buf, len);
+  expected.clear();
+  expected.push_back(OpenABE_ELEMENT_G1);
+  expected.smartPack(raw);
+  g.serialize(bytes);
+  ASSERT_EQ(bytes, expected);
+  size_t index = 1;
+  ASSERT_EQ(bytes.smartUnpackLength(&index), len);
+  ASSERT_EQ(index, bytes.size() - len);
+  G1 g2 = pgroup_->initG1();
+  g2.deserialize(bytes);
+  ASSERT_EQ(g2, g);
+
+  len = mclBnG2_serialize(buf, sizeof(buf), &h.m_G2);
+  raw.clear();
+  raw.appendArray(buf, len);
+  expected.clear();
+  expected.push_back(OpenABE_ELEMENT_G2);
+  expected.smartPack(raw);
+  h.serialize(bytes);
+  ASSERT_EQ(bytes, expected);
+  G2 h2 = pgroup_->initG2();
+  h2.deserialize(bytes);
+  ASSERT_EQ(h2, h);
+
+  bytes.pop_back();
+  index = 1;
+  EXPECT_THROW(bytes.smartUnpackLength(&index), OpenABE_ERROR);
+}
+
+TEST_F(ZeutroMathLib, PrecomputeBudget) {
+  TEST_DESCRIPTION("Testing that the precomputation store evicts its least recently used tables to fit the budget");
+  OpenABEPrecomputeManager *store = OpenABEPrecomputeManager::getDefault();
+  OpenABEPrecomputeStats before, stats;
+  store->getStats(before);
+  {
+    OpenABEContainer a, b;
+    for (size_t i = 0; i < 2; i++) {
+      G2 q = pgroup_->randomG2(rng_.get());
+      a.setComponent("q" + to_string(i), &q);
+      q = pgroup_->randomG2(rng_.get());
+      b.setComponent("q" + to_string(i), &q);
+    }
+    size_t lineBytes = a.getG2LineTable("q0")->getMemoryUsage();
+    ASSERT_GT(lineBytes, 0U);
+    store->getStats(stats);
+    ASSERT_EQ(stats.bytesInUse, before.bytesInUse + lineBytes);
+    ASSERT_EQ(stats.tables, before.tables + 1);
+    ASSERT_GE(stats.mappedBytes, stats.bytesInUse);
+    ASSERT_LE(stats.hugepageBytes, stats.mappedBytes);
+
+    // room for two line tables: the third evicts the oldest, of either key
+    store->setBudget(before.bytesInUse + 2 * lineBytes);
+    a.getG2LineTable("q1");
+    b.getG2LineTable("q0");
+    store->getStats(stats);
+    ASSERT_LE(stats.bytesInUse, stats.budget);
+    ASSERT_EQ(stats.evictions, before.evictions + 1);
+    ASSERT_TRUE(a.findG2LineTable("q0") == nullptr);
+    ASSERT_TRUE(b.findG2LineTable("q0") != nullptr);
+
+    // a lookup refreshes a table, so a.q1 now outlives b.q0
+    ASSERT_TRUE(a.findG2LineTable("q1") != nullptr);
+    b.getG2LineTable("q1");
+    ASSERT_TRUE(b.findG2LineTable("q0") == nullptr);
+    ASSERT_TRUE(a.findG2LineTable("q1") != nullptr);
+
+    // evicted tables are built again on demand
+    shared_ptr<const G2LineTable> table = a.getG2LineTable("q0");
+    ASSERT_TRUE(table->getElement() == *a.getG2("q0"));
+    store->setBudget(0);
+  }
+  store->getStats(stats);
+  ASSERT_EQ(stats.bytesInUse, before.bytesInUse);
+  ASSERT_EQ(stats.tables, before.tables);
+}
+#endif
+
 }
 
 int main(int argc, char **argv)
@@ -143,6 +143,8 @@ Test_BP_EC_Group()
         ZP_t a = egroup.randomZP(&rng);
         G_t A = h.exp(a);
         cout << "A : " << A << endl;
+        G_t A2 = egroup.expGenerator(a);
+        cout << "(A == h^a via table): " << ((A == A2) ? "true" : "false") << endl;
         result.clear();
         A.serialize(result);
         cout << "A bytes: " << result.toLowerHex() << endl;
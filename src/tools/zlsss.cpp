@@ -40,7 +40,10 @@
 #include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <list>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <openabe/openabe.h>
 
 using namespace std;
@@ -56,6 +59,193 @@ OpenABELSSSElement::OpenABELSSSElement(std::string label, ZP &element)
   this->m_Prefix = pr.first;
 }
 
+/********************************************************************************
+ * Implementation of the OpenABELSSSCompiledPolicy class
+ ********************************************************************************/
+
+/*!
+ * Compile the share-generation layout of a policy. The tree is walked with
+ * the same stack discipline as secret sharing: a gate's children are pushed
+ * in order and therefore visited last to first.
+ *
+ * @param[in] policy        - the (canonical) policy tree
+ * @throw                   - an exception if the tree is empty or malformed
+ */
+
+OpenABELSSSCompiledPolicy::OpenABELSSSCompiledPolicy(const OpenABEPolicy *policy)
+    : m_NumSlots(0), m_MaxThreshold(0), m_NumLeaves(0), m_AllLeavesRequired(true)
+{
+  if (policy == nullptr || policy->getRootNode() == nullptr) {
+    throw OpenABE_ERROR_INVALID_POLICY;
+  }
+  std::map<std::string, int> attrCount;
+  if (policy->hasDuplicateNodes()) {
+    policy->getDuplicateInfo(attrCount);
+  }
+
+  // unique label -> attribute for every leaf, and the unique label of each
+  // leaf step (a repeated label maps to the same row, last write wins)
+  std::map<std::string, std::string> rows;
+  std::vector<std::string> leafLabels;
+  std::vector<std::pair<OpenABETreeNode*, uint32_t>> nodes;
+  nodes.push_back(std::make_pair(policy->getRootNode(), 0));
+  this->m_NumSlots = 1;
+
+  while (!nodes.empty()) {
+    OpenABETreeNode *node = nodes.back().first;
+    Step step = { false, nodes.back().second, 0, 0, 0, 0 };
+    nodes.pop_back();
+
+    if (node->getNodeType() == GATE_TYPE_LEAF) {
+      std::string attribute = node->getCompleteLabel();
+      std::string label = attribute;
+      if (attrCount.count(attribute) != 0) {
+        label += "%" + to_string(node->getIndex());
+      }
+      rows[label] = attribute;
+      step.isLeaf = true;
+      step.row = leafLabels.size();
+      leafLabels.push_back(label);
+      this->m_NumLeaves++;
+    } else {
+      step.threshold = node->getThresholdValue();
+      step.numChildren = node->getNumSubnodes();
+      if (step.threshold == 0 || step.numChildren == 0) {
+        throw OpenABE_ERROR_INVALID_POLICY;
+      }
+      if (step.threshold != step.numChildren) {
+        this->m_AllLeavesRequired = false;
+      }
+      step.firstChild = this->m_NumSlots;
+      this->m_NumSlots += step.numChildren;
+      this->m_MaxThreshold = std::max(this->m_MaxThreshold, step.threshold);
+      for (uint32_t i = 0; i < step.numChildren; i++) {
+        nodes.push_back(std::make_pair(node->getSubnode(i), step.firstChild + i));
+      }
+    }
+    this->m_Steps.push_back(step);
+  }
+
+  // number the rows in map order and point each leaf at its row
+  std::map<std::string, uint32_t> rowIndex;
+  for (auto it = rows.begin(); it != rows.end(); ++it) {
+    rowIndex[it->first] = this->m_RowLabels.size();
+    this->m_RowLabels.push_back(it->first);
+    this->m_RowAttributes.push_back(it->second);
+    this->m_RowKeys.push_back(OpenABEHashKey(it->first));
+    this->m_RowAttributeKeys.push_back(OpenABEHashKey(it->second));
+    this->m_RowAttributeIds.push_back(OpenABEInternAttribute(it->second));
+    this->m_LeafBits.set(this->m_RowAttributeIds.back());
+  }
+  for (Step &step : this->m_Steps) {
+    if (step.isLeaf) {
+      step.row = rowIndex[leafLabels[step.row]];
+    }
+  }
+}
+
+/*!
+ * Find a row by its unique label. Rows are kept in label order, so this
+ * is a binary search.
+ *
+ * @param[in] label     - the unique label of the row
+ * @return              - the row index, or numRows() if there is none
+ */
+
+size_t
+OpenABELSSSCompiledPolicy::findRow(const string &label) const
+{
+  auto it = std::lower_bound(this->m_RowLabels.begin(), this->m_RowLabels.end(), label);
+  if (it == this->m_RowLabels.end() || *it != label) {
+    return this->m_RowLabels.size();
+  }
+  return it - this->m_RowLabels.begin();
+}
+
+/*!
+ * Evaluate the policy against a set of attributes. Two word-wise checks
+ * settle the common cases (no attribute in common, or a pure AND policy)
+ * outright; otherwise the gates are evaluated children-first over the
+ * compiled steps. Each node's cost is the fewest leaves that satisfy it:
+ * 1 for a held leaf, and the sum of the 'threshold' cheapest satisfied
+ * subnodes for a gate.
+ *
+ * @param[in] attrs     - the attribute list as a bitset
+ * @return              - (satisfied, minimum number of leaves)
+ */
+
+pair<bool,int>
+OpenABELSSSCompiledPolicy::satisfiedBy(const OpenABEAttributeBitset &attrs) const
+{
+  if (!this->m_LeafBits.intersects(attrs)) {
+    return make_pair(false, 0);
+  }
+  if (this->m_AllLeavesRequired) {
+    if (this->m_LeafBits.isSubsetOf(attrs)) {
+      return make_pair(true, (int)this->m_NumLeaves);
+    }
+    return make_pair(false, 0);
+  }
+
+  // cost of the node in each slot, -1 if it cannot be satisfied
+  OpenABEArenaVector<int> costs(this->m_NumSlots, -1);
+  OpenABEArenaVector<int> satisfied;
+  for (auto it = this->m_Steps.rbegin(); it != this->m_Steps.rend(); ++it) {
+    const Step &step = *it;
+    if (step.isLeaf) {
+      costs[step.slot] = attrs.test(this->m_RowAttributeIds[step.row]) ? 1 : -1;
+      continue;
+    }
+    satisfied.clear();
+    for (uint32_t i = 0; i < step.numChildren; i++) {
+      if (costs[step.firstChild + i] >= 0) {
+        satisfied.push_back(costs[step.firstChild + i]);
+      }
+    }
+    if (satisfied.size() < step.threshold) {
+      costs[step.slot] = -1;
+      continue;
+    }
+    std::nth_element(satisfied.begin(), satisfied.begin() + (step.threshold - 1),
+                     satisfied.end());
+    int sum = 0;
+    for (uint32_t i = 0; i < step.threshold; i++) {
+      sum += satisfied[i];
+    }
+    costs[step.slot] = sum;
+  }
+
+  if (costs[0] < 0) {
+    return make_pair(false, 0);
+  }
+  return make_pair(true, costs[0]);
+}
+
+/*!
+ * Policies from createPolicyTree carry their compiled layout; anything else
+ * is compiled for this call only.
+ *
+ * @param[in] policy        - the policy tree
+ * @return                  - the compiled layout
+ */
+
+shared_ptr<const OpenABELSSSCompiledPolicy>
+OpenABELSSSCompiledPolicy::forPolicy(const OpenABEPolicy *policy)
+{
+  if (policy == nullptr) {
+    throw OpenABE_ERROR_INVALID_POLICY;
+  }
+  shared_ptr<const OpenABELSSSCompiledPolicy> compiled = policy->getCompiledLSSS();
+  if (compiled == nullptr) {
+    compiled = make_shared<const OpenABELSSSCompiledPolicy>(policy);
+  }
+  return compiled;
+}
+
+/********************************************************************************
+ * Implementation of the OpenABELSSS class
+ ********************************************************************************/
+
 /*!
  * Constructor for the OpenABELSSS class.
  *
@@ -67,9 +257,7 @@ OpenABELSSS::OpenABELSSS(OpenABEPairing *pairing, OpenABERNG *rng) : ZObject(),
   this->m_Pairing->addRef();
   this->m_RNG = rng;
   this->m_Pairing->initZP(zero, 0);
-  // Initialize member variables used in calculateCoefficient
-  this->m_Pairing->initZP(iPlusOne, 0);
-  this->m_Pairing->initZP(indexPlusOne, 0);
+  this->m_ResultMapPending = false;
 }
 
 
@@ -122,6 +310,76 @@ OpenABELSSS::shareSecret(const OpenABEFunctionInput *input, ZP &elt)
 //  }
 }
 
+struct OpenABELSSSPlan {
+  // by unique label, as returned by getRows()
+  OpenABELSSSRowMap rows;
+  // the same rows by compiled row index, as returned by getRecoveredRows()
+  OpenABELSSSRowVector coefficients;
+};
+
+namespace {
+// Least-recently-used table of solved (policy, attribute list) pairs: the
+// rows selected for decryption together with their Lagrange coefficients.
+class OpenABEDecryptionPlanCache {
+public:
+  OpenABEDecryptionPlanCache(size_t capacity) : capacity_(capacity) {}
+
+  std::shared_ptr<const OpenABELSSSPlan> find(const std::string &k) {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    auto it = this->index_.find(k);
+    if (it == this->index_.end()) {
+      return nullptr;
+    }
+    this->entries_.splice(this->entries_.begin(), this->entries_, it->second);
+    return it->second->second;
+  }
+
+  void insert(const std::string &k, std::shared_ptr<const OpenABELSSSPlan> plan) {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    if (this->capacity_ == 0 || this->index_.count(k) != 0) {
+      return;
+    }
+    this->entries_.emplace_front(k, plan);
+    this->index_[k] = this->entries_.begin();
+    if (this->entries_.size() > this->capacity_) {
+      this->index_.erase(this->entries_.back().first);
+      this->entries_.pop_back();
+    }
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    this->index_.clear();
+    this->entries_.clear();
+  }
+
+  size_t size() {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    return this->entries_.size();
+  }
+
+private:
+  typedef std::list<std::pair<std::string, std::shared_ptr<const OpenABELSSSPlan>>> EntryList;
+  std::mutex lock_;
+  size_t capacity_;
+  EntryList entries_;
+  std::unordered_map<std::string, EntryList::iterator> index_;
+};
+
+OpenABEDecryptionPlanCache& decryptionPlanCache() {
+  static OpenABEDecryptionPlanCache cache(DECRYPTION_PLAN_CACHE_SIZE);
+  return cache;
+}
+}
+
+void clearDecryptionPlanCache() {
+  decryptionPlanCache().clear();
+}
+
+size_t getDecryptionPlanCacheCount() {
+  return decryptionPlanCache().size();
+}
+
 /*!
  * Given an access structure (policy) and an input (attribute list)
  * generates the coefficients necessary to recover the secret.
@@ -151,10 +409,92 @@ OpenABELSSS::recoverCoefficients(OpenABEPolicy *policy, OpenABEAttributeList *at
   return false;
   }
 
+  // Index the rows by their place in the compiled layout. Both are in
+  // label order, so the vector comes out sorted by row.
+  shared_ptr<const OpenABELSSSCompiledPolicy> compiled =
+      OpenABELSSSCompiledPolicy::forPolicy(policy);
+  shared_ptr<OpenABELSSSPlan> plan = make_shared<OpenABELSSSPlan>();
+  plan->coefficients.reserve(this->m_ResultMap.size());
+  for (auto it = this->m_ResultMap.begin(); it != this->m_ResultMap.end(); ++it) {
+    size_t row = compiled->findRow(it->first);
+    if (row == compiled->numRows()) {
+      this->clearExistingResults();
+      return false;
+    }
+    OpenABELSSSRow recovered = { (uint32_t)row, it->second.element() };
+    plan->coefficients.push_back(recovered);
+  }
+  this->m_Plan = plan;
+
   // Success, return true
   return true;
 }
 
+OpenABELSSSRowMap&
+OpenABELSSS::getRows()
+{
+  if (this->m_ResultMapPending) {
+    this->m_ResultMap = this->m_Plan->rows;
+    this->m_ResultMapPending = false;
+  }
+  return this->m_ResultMap;
+}
+
+const OpenABELSSSRowVector&
+OpenABELSSS::getRecoveredRows() const
+{
+  static const OpenABELSSSRowVector none;
+  if (this->m_Plan == nullptr) {
+    return none;
+  }
+  return this->m_Plan->coefficients;
+}
+
+/*!
+ * Same as recoverCoefficients(policy, attrList), but reuses the rows and
+ * coefficients from an earlier call for the same key, policy and attribute
+ * list. The plan is keyed on the canonical policy and attribute strings as
+ * well as the key ID, so a key ID that is reused for a different key can
+ * never pick up another key's plan.
+ *
+ * @param[in] keyID     - identifier of the decryption key
+ * @param[in] policy    - OpenABEPolicy object describing the access structure
+ * @param[in] attrList  - OpenABEAttributeList object describing the attribute list
+ * @throw               - an exception if there is a problem with recovery
+ */
+
+bool
+OpenABELSSS::recoverCoefficients(const std::string &keyID, OpenABEPolicy *policy,
+                                 OpenABEAttributeList *attrList)
+{
+  ASSERT_NOTNULL(policy);
+  ASSERT_NOTNULL(attrList);
+
+  string planKey = keyID;
+  planKey.push_back('\0');
+  planKey += policy->toCanonicalString();
+  planKey.push_back('\0');
+  planKey += attrList->toCanonicalString();
+
+  shared_ptr<const OpenABELSSSPlan> plan = decryptionPlanCache().find(planKey);
+  OpenABE_countMetric(plan ? OpenABE_METRIC_PLAN_CACHE_HITS : OpenABE_METRIC_PLAN_CACHE_MISSES);
+  if (plan != nullptr) {
+    this->clearExistingResults();
+    this->m_Plan = plan;
+    this->m_ResultMapPending = true;
+    return true;
+  }
+
+  if (this->recoverCoefficients(policy, attrList) == false) {
+    return false;
+  }
+  shared_ptr<OpenABELSSSPlan> cached = make_shared<OpenABELSSSPlan>(*this->m_Plan);
+  cached->rows = this->m_ResultMap;
+  this->m_Plan = cached;
+  decryptionPlanCache().insert(planKey, cached);
+  return true;
+}
+
 /*!
  * Utility routine. Given an access structure (policy) and an element,
  * perform secret sharing on the given element.
@@ -167,16 +507,109 @@ OpenABELSSS::recoverCoefficients(OpenABEPolicy *policy, OpenABEAttributeList *at
 void
 OpenABELSSS::performSecretSharing(const OpenABEPolicy *policy, ZP &elt)
 {
-  OpenABETreeNode *node = NULL;
+  shared_ptr<const OpenABELSSSCompiledPolicy> compiled =
+      OpenABELSSSCompiledPolicy::forPolicy(policy);
+
+  vector<ZP> shares;
+  this->shareSecret(*compiled, elt, shares);
+  // rows are already in map order, so each insert lands at the end
+  for (size_t i = 0; i < compiled->numRows(); i++) {
+    OpenABELSSSElement lsssElement(compiled->rowAttribute(i), shares[i]);
+    this->m_ResultMap.insert(this->m_ResultMap.end(),
+                             make_pair(compiled->rowLabel(i), lsssElement));
+  }
+}
 
-  if(policy->hasDuplicateNodes()) {
-    policy->getDuplicateInfo(this->m_AttrCount);
+/*!
+ * Share a secret over a compiled policy. Every gate gets a random polynomial
+ * whose constant term is the gate's own share, and its children receive the
+ * polynomial evaluated at 1, 2, ..., n. The gates are visited (and the RNG
+ * consumed) in the same order as the tree walk always has, so the shares do
+ * not depend on whether a policy was compiled ahead of time.
+ *
+ * @param[in] compiled      - compiled policy
+ * @param[in] elt           - ZP to be shared
+ * @param[out] shares       - one share per row, in row order
+ */
+
+void
+OpenABELSSS::shareSecret(const OpenABELSSSCompiledPolicy &compiled, ZP &elt,
+                         vector<ZP> &shares)
+{
+  // the arithmetic runs on value-only scalars; only the inputs and the
+  // shares handed back are ZPs
+  OpenABEArenaVector<ZPScalar> slots(compiled.m_NumSlots);
+  OpenABEArenaVector<ZPScalar> coefficients(compiled.m_MaxThreshold);
+  ZPScalar share;
+  shares.assign(compiled.numRows(), this->zero);
+  slots[0] = ZPScalar(elt);
+
+  for (const OpenABELSSSCompiledPolicy::Step &step : compiled.m_Steps) {
+    if (step.isLeaf) {
+      slots[step.slot].toZP(shares[step.row]);
+      continue;
+    }
+    // coefficient 0 is drawn and then replaced by the gate's share, exactly
+    // as the tree walk did, which keeps the RNG stream unchanged
+    for (uint32_t i = 0; i < step.threshold; i++) {
+      coefficients[i] = ZPScalar(this->m_Pairing->randomZP(this->m_RNG));
+    }
+    coefficients[0] = slots[step.slot];
+    // Horner evaluation at x = 1 ... numChildren
+    for (uint32_t j = 0; j < step.numChildren; j++) {
+      ZPScalar x(j + 1);
+      share = coefficients[step.threshold - 1];
+      for (uint32_t k = step.threshold - 1; k-- > 0;) {
+        share *= x;
+        share += coefficients[k];
+      }
+      slots[step.firstChild + j] = share;
+    }
   }
+}
 
-  node = policy->getRootNode();
-  assert(node != NULL);
+/*!
+ * The matrix form of shareSecret(): the same walk, with every slot holding
+ * the row vector its share is the product of. A gate's child at x gets the
+ * gate's vector plus x^k in the column of the gate's k-th coefficient.
+ *
+ * @param[in] compiled      - compiled policy
+ * @param[out] rows         - the non-zero entries of each row, in row order
+ * @param[out] numColumns   - 1 + the number of random coefficients
+ */
 
-  iterativeShareSecret(node, elt);
+void
+OpenABELSSS::shareMatrix(const OpenABELSSSCompiledPolicy &compiled,
+                         vector<OpenABELSSSMatrixRow> &rows, uint32_t &numColumns)
+{
+  vector<OpenABELSSSMatrixRow> slots(compiled.m_NumSlots);
+  ZP one;
+  this->m_Pairing->initZP(one, 1);
+  rows.assign(compiled.numRows(), OpenABELSSSMatrixRow());
+  slots[0].push_back(make_pair(0, one));
+  numColumns = 1;
+
+  for (const OpenABELSSSCompiledPolicy::Step &step : compiled.m_Steps) {
+    if (step.isLeaf) {
+      rows[step.row] = slots[step.slot];
+      continue;
+    }
+    // columns are handed out in visiting order, so they only grow along
+    // a path and every row stays sorted
+    const uint32_t firstColumn = numColumns;
+    numColumns += step.threshold - 1;
+    for (uint32_t j = 0; j < step.numChildren; j++) {
+      OpenABELSSSMatrixRow &child = slots[step.firstChild + j];
+      child = slots[step.slot];
+      ZP x, xk;
+      this->m_Pairing->initZP(x, j + 1);
+      xk = one;
+      for (uint32_t k = 1; k < step.threshold; k++) {
+        xk *= x;
+        child.push_back(make_pair(firstColumn + k - 1, xk));
+      }
+    }
+  }
 }
 
 /*!
@@ -219,82 +652,18 @@ OpenABELSSS::performCoefficientRecovery(OpenABEPolicy *policy, OpenABEAttributeL
   return iterativeCoefficientRecover(node, one);
 }
 
-/*!
- * Utility routine (iterative version). Given an access structure (policy) and an element,
- * perform secret sharing on the given element.
- *
- * @param[in] treeNode      - OpenABETreeNode for the subtree
- * @param[in] elt           - ZP to be shared
- * @return                  - bool indicating success/failure
- * @throw                   - an exception if there is a problem sharing the element
- */
-
-void
-OpenABELSSS::iterativeShareSecret(OpenABETreeNode *treeNode, ZP &elt)
-{
-    std::stack<OpenABETreeNode*> nodes;
-    std::stack<ZP> eltList;
-    OpenABETreeNode *visitedNode = NULL;
-    ZP theSecret, coefficient;
-    this->m_Pairing->initZP(theSecret, 0);
-    this->m_Pairing->initZP(coefficient, 0);
-    // push the root to the stack
-    nodes.push(treeNode);
-    eltList.push(elt);
-  OpenABEElementList coefficients;
-
-  do {
-    uint32_t threshold = 0, totalSubnodes = 0;
-    coefficients.clear();
-
-    visitedNode  = nodes.top();
-    theSecret    = eltList.top();
-    nodes.pop();
-    eltList.pop();
-    ASSERT_NOTNULL_VOID(visitedNode);
-
-    // Base case:
-    // If the node is a leaf node, simply add the given element to the results
-    // and return.
-    if (visitedNode->getNodeType() == GATE_TYPE_LEAF) {
-      this->addShareToResults(visitedNode, theSecret);
-    }
-    else {
-      // First convert this node into a pair of values "threshold" and
-      // "totalSubnodes" such that any "threshold"--out-of-"totalSubnodes"
-      // shares permit secret recovery.
-      totalSubnodes = visitedNode->getNumSubnodes();
-      assert((threshold = visitedNode->getThresholdValue()) != 0);
-
-      // Generate a polynomial consisting of "threshold" coefficients
-      for (uint32_t i = 0; i < threshold; i++) {
-        // Each coefficient is a random element of same field
-        // as the element
-        ZP coefficient = this->m_Pairing->randomZP(this->m_RNG);
-        coefficients.push_back(coefficient);
-      }
-      // set position 0 as the passed in secret
-      coefficients[0] = theSecret;
-
-      // Now evaluate the polynomial at points (1, 2, ..., totalSubnodes) to
-      // obtain the shares
-      for (uint32_t i = 0; i < totalSubnodes; i++) {
-        // Evaluate the polynomial at point (i+1) and recurse on the resulting value
-        ZP share = this->evaluatePolynomial(coefficients, (i+1));
-        nodes.push(visitedNode->getSubnode(i));
-        eltList.push(share);
-      }
-    }
-  } while(!nodes.empty());
-
-  coefficients.clear();
-}
-
 /*!
  * Utility routine (iterative version). Given an access structure (policy) where each node has been
  * 'marked' if it's necessary to recover the secret, move through and calculate
  * the coefficients for each leaf node.
  *
+ * The Lagrange coefficient of marked subnode j of a gate is
+ *   prod_{i marked, i != j} (0 - x_i) / (x_j - x_i),  with x_i = i + 1.
+ * The first pass gathers the numerator and denominator of every coefficient
+ * in the marked tree, all denominators are then inverted together with one
+ * batch inversion, and the second pass multiplies the coefficients down
+ * from the root to the leaves.
+ *
  * @param[in] treeNode      - OpenABETreeNode for the subtree
  * @param[in] inCoeff       - ZP to be shared
  * @return                  - bool indicating success/failure
@@ -304,145 +673,68 @@ OpenABELSSS::iterativeShareSecret(OpenABETreeNode *treeNode, ZP &elt)
 bool
 OpenABELSSS::iterativeCoefficientRecover(OpenABETreeNode *treeNode, ZP &inCoeff)
 {
-  std::stack<OpenABETreeNode*> nodes;
-  std::stack<ZP> coeffs;
-  OpenABETreeNode *visitedNode = NULL;
-  ZP tmpInCoeff, coefficient;
-  this->m_Pairing->initZP(tmpInCoeff, 0);
-  this->m_Pairing->initZP(coefficient, 0);
-  // push the root to the stack
-  nodes.push(treeNode);
-  coeffs.push(inCoeff);
-  bool result = false;
-
-  do {
-    uint32_t threshold = 0;
-
-    visitedNode = nodes.top();
-    tmpInCoeff  = coeffs.top();
-    nodes.pop();
-    coeffs.pop();
+  ASSERT_NOTNULL(treeNode);
+  // one entry per marked node, parents before their subnodes
+  OpenABEArenaVector<OpenABETreeNode*> nodes;
+  OpenABEArenaVector<size_t> parents;
+  OpenABEArenaVector<ZPScalar> numerators, denominators;
+  OpenABEArenaVector<ZPScalar> xs;
+  OpenABEArenaVector<uint32_t> marked;
+  const ZPScalar one(1);
+
+  nodes.push_back(treeNode);
+  parents.push_back(0);
+  numerators.push_back(ZPScalar(inCoeff));
+  denominators.push_back(one);
+
+  for (size_t t = 0; t < nodes.size(); t++) {
+    OpenABETreeNode *visitedNode = nodes[t];
     ASSERT_NOTNULL(visitedNode);
-
-    // Base case:
-    // If the node is a leaf node, simply add the input coefficient  to the results
-    // and return.
     if (visitedNode->getNodeType() == GATE_TYPE_LEAF) {
-      this->addShareToResults(visitedNode, tmpInCoeff);
-      result = true;
+      continue;
     }
-    	else {
-      // First get the number of subnodes for this tree node.
-      uint32_t numSubnodes = visitedNode->getNumSubnodes();
-
-      // Process the node according to its type
-      switch (visitedNode->getNodeType()) {
-        case GATE_TYPE_AND:
-          threshold = numSubnodes;    // AND gate: all subnodes satisfied
-          break;
-        case GATE_TYPE_OR:
-          threshold = 1;              // OR gate: any one subnodes satisfied
-          break;
-#if 0
-        case GATE_TYPE_THRESHOLD:
-          threshold = visitedNode->getThresholdValue();
-          break;
-        default:
-          // Unrecognized node type
-          fprintf(stderr, "ERROR: Unrecognized node type\n");
-          return false;
-#endif
+
+    marked.clear();
+    xs.clear();
+    for (uint32_t i = 0; i < visitedNode->getNumSubnodes(); i++) {
+      if (visitedNode->getSubnode(i)->getMark()) {
+        marked.push_back(i);
+        xs.push_back(ZPScalar(i + 1));
       }
+    }
 
-      // Now for each subnode in our list, calculate the coefficient and recurse
-      for (uint32_t i = 0; i < numSubnodes; i++) {
-        if(visitedNode->getSubnode(i)->getMark() == true) {
-          // compute coefficient for this node
-          coefficient = tmpInCoeff * calculateCoefficient(visitedNode, i, threshold, numSubnodes);
-          nodes.push(visitedNode->getSubnode(i));
-          coeffs.push(coefficient);
-          result = true;
+    for (size_t j = 0; j < marked.size(); j++) {
+      ZPScalar num = one, den = one;
+      for (size_t i = 0; i < marked.size(); i++) {
+        if (i != j) {
+          num *= -xs[i];
+          den *= (xs[j] - xs[i]);
         }
       }
-    	}
-  } while(!nodes.empty());
-
-  return result;
-}
-
-
-/*!
- * Utility routine. Calculates a Lagrange interpolation coefficient for 
- * share "index" out of "total" shares for a "threshold" secret sharing.
- *
- * @param[in] index            - Index of the coefficient
- * @param[in] threshold        - Threshold value
- * @param[in] total            - Total number of elements
- * @return                     - An element containing the coefficient
- * @throw                      - an exception if there is a problem sharing the element
- */
-
-ZP
-OpenABELSSS::calculateCoefficient(OpenABETreeNode *treeNode, uint32_t index, uint32_t threshold, uint32_t total)
-{
-  ZP result;
-  this->m_Pairing->initZP(result, 1);
-  this->m_Pairing->initZP(this->indexPlusOne, index + 1);
-
-  // Use local ZP variables for coefficient calculation
-  ZP local_iPlusOne, local_indexPlusOne;
-  this->m_Pairing->initZP(local_indexPlusOne, index + 1);
-
-  fprintf(stderr, "[LSSS_COEFF] calculateCoefficient: index=%u, threshold=%u, total=%u\n",
-          index, threshold, total);
-  fprintf(stderr, "[LSSS_COEFF] Initial result = 1, indexPlusOne = %u\n", index + 1);
-
-  // Product for all marked subnodes (excluding index) of ( (0 - (X(i))) / (X(subnode_index) - (X(i))) )
-  // Note that X(i) = i+1.
-  for (uint32_t i = 0; i < threshold; i++) {
-    /* Check if this subnode is being used for the recovery.	*/
-    this->m_Pairing->initZP(local_iPlusOne, i + 1);
-    bool is_marked = treeNode->getSubnode(i)->getMark();
-
-    fprintf(stderr, "[LSSS_COEFF] i=%u: marked=%d\n", i, is_marked);
-
-    if (is_marked) {
-      if (i != index) {
-        ZP numerator = this->zero - local_iPlusOne;
-        ZP denominator = local_indexPlusOne - local_iPlusOne;
-
-        fprintf(stderr, "[LSSS_COEFF] i=%u (i!=index): Computing (0 - %u) / (%u - %u)\n",
-                i, i+1, index+1, i+1);
-
-        // Check if numerator or denominator is zero by serializing
-        OpenABEByteString num_bytes = numerator.getByteString();
-        OpenABEByteString den_bytes = denominator.getByteString();
-        bool num_zero = (num_bytes.size() == 0 || (num_bytes.size() == 1 && num_bytes.at(0) == 0));
-        bool den_zero = (den_bytes.size() == 0 || (den_bytes.size() == 1 && den_bytes.at(0) == 0));
-
-        fprintf(stderr, "[LSSS_COEFF] i=%u: numerator zero=%d, denominator zero=%d\n",
-                i, num_zero, den_zero);
-
-        ZP term = numerator / denominator;
-
-        OpenABEByteString term_bytes = term.getByteString();
-        bool term_zero = (term_bytes.size() == 0 || (term_bytes.size() == 1 && term_bytes.at(0) == 0));
-        fprintf(stderr, "[LSSS_COEFF] i=%u: term zero=%d\n", i, term_zero);
+      nodes.push_back(visitedNode->getSubnode(marked[j]));
+      parents.push_back(t);
+      numerators.push_back(num);
+      denominators.push_back(den);
+    }
+  }
 
-        // BUG FIX: Removed extra "result *" that was squaring the coefficient each iteration
-        result *= term;
+  ZPScalar::batchInverse(denominators.data(), denominators.size());
 
-        OpenABEByteString result_bytes = result.getByteString();
-        bool result_zero = (result_bytes.size() == 0 || (result_bytes.size() == 1 && result_bytes.at(0) == 0));
-        fprintf(stderr, "[LSSS_COEFF] i=%u: After multiply, result zero=%d\n", i, result_zero);
-      }
+  bool result = false;
+  ZP coefficient = inCoeff;
+  // numerators[t] becomes the coefficient of node t
+  for (size_t t = 0; t < nodes.size(); t++) {
+    numerators[t] *= denominators[t];
+    if (t != 0) {
+      numerators[t] *= numerators[parents[t]];
+    }
+    if (nodes[t]->getNodeType() == GATE_TYPE_LEAF) {
+      numerators[t].toZP(coefficient);
+      this->addShareToResults(nodes[t], coefficient);
+      result = true;
     }
   }
 
-  OpenABEByteString final_bytes = result.getByteString();
-  bool final_zero = (final_bytes.size() == 0 || (final_bytes.size() == 1 && final_bytes.at(0) == 0));
-  fprintf(stderr, "[LSSS_COEFF] Final coefficient zero=%d\n", final_zero);
-
   return result;
 }
 
@@ -532,7 +824,7 @@ OpenABELSSS::makeUniqueLabel(const OpenABETreeNode *treeNode)
 bool iterativeScanTree(OpenABETreeNode *treeNode, OpenABEAttributeList *attributeList)
 {
   uint32_t threshold;
-  std::stack<OpenABETreeNode*> nodes;
+  OpenABEArenaStack<OpenABETreeNode*> nodes;
   OpenABETreeNode *topNode = NULL;
   bool isInternalNode, allSubnodesVisited;
 
@@ -605,78 +897,59 @@ bool iterativeScanTree(OpenABETreeNode *treeNode, OpenABEAttributeList *attribut
   return treeNode->getMark();
 }
 
-// comparator for pair of integers
+// orders (subnode index, leaf cost) pairs by increasing cost
 struct less_than {
     bool operator()(const std::pair<int,int> &left, const std::pair<int,int> &right) {
         return (left.second < right.second);
     }
 };
 
+/*!
+ * Decide whether an internal node is satisfied once all of its subnodes
+ * have been scanned. On entry every subnode's mark says whether it can be
+ * satisfied and its satisfied count is the number of leaf rows that costs.
+ * Of the satisfied subnodes the 'threshold' cheapest are kept (ties go to
+ * the lower index) and the rest are unmarked, so the node's own count is
+ * the smallest number of rows that satisfies its subtree. For AND gates
+ * every subnode is kept; for OR gates this picks the cheapest branch.
+ *
+ * @param[in] threshold     - number of subnodes needed to satisfy the node
+ * @param[in] node          - the internal node to mark
+ * @return                  - true if the node is satisfied
+ */
+
 bool determineIfNodeShouldBeMarked(uint32_t threshold, OpenABETreeNode *node)
 {
+  if (node->getNodeType() != GATE_TYPE_AND &&
+      node->getNodeType() != GATE_TYPE_OR) {
+    return false;
+  }
+
   vector<pair<int, int>> list;
-  uint32_t enough_nodes = threshold, cnt = 0;
-  bool result;
-  if (node->getNodeType() == GATE_TYPE_AND) {
-    // mark this node as being satisfied (at first)
-    result = true;
-    int sum = 0;
-    for(uint32_t i = 0; i < node->getNumSubnodes(); i++) {
-      if(!node->getSubnode(i)->getMark()) {
-          // mark this node as not being satisfied
-          // (found at least one unmatched subnode)
-          result = false;
-      }
-      sum += node->getSubnode(i)->getNumSatisfied();
+  for (uint32_t i = 0; i < node->getNumSubnodes(); i++) {
+    // only satisfied subnodes are candidates
+    if (node->getSubnode(i)->getMark()) {
+      list.push_back(std::make_pair(i, node->getSubnode(i)->getNumSatisfied()));
     }
+  }
 
-    if (result) {
-      node->setMark(result, sum);
-    } else {
-      node->setMark(false, 0);
-    }
-  } else if(node->getNodeType() == GATE_TYPE_OR) {
-    result = false;
-    // build up list
-    for (uint32_t i = 0; i < node->getNumSubnodes(); i++) {
-      cnt = node->getSubnode(i)->getNumSubnodes();
-      if(cnt == 0) {
-        cnt++;
-      }
-      // only sorting nodes that are marked 'true'
-      if (node->getSubnode(i)->getMark()) {
-        list.push_back(std::make_pair(i, cnt));
-      }
-    }
-    // sort the list (usually size 2)
-    std::sort(list.begin(), list.end(), less_than());
-    uint32_t i;
-    // iterate through list in increasing order of subnodes to
-    // determine satisfiability of subtree
-    for (size_t k = 0; k < list.size(); k++) {
-      i = list[k].first;
-      // cout << "index: " << i << ", subnodes: " << list[k].second <<
-      //        ", satisfied: " << (node->getSubnode(i)->getMark() ? "true": "false") << endl;
-      if (node->getSubnode(i)->getMark() && enough_nodes > 0) {
-        enough_nodes--;
-        result = true;
-      } else if(node->getSubnode(i)->getMark() && enough_nodes == 0) {
-        // mark remaining nodes as false
-        node->getSubnode(i)->setMark(false, 0);
-      }
-    }
+  if (threshold == 0 || list.size() < threshold) {
+    node->setMark(false, 0);
+    return false;
+  }
 
-    if (result) {
-      node->setMark(result, list[0].second);
+  std::stable_sort(list.begin(), list.end(), less_than());
+  int sum = 0;
+  for (size_t k = 0; k < list.size(); k++) {
+    if (k < threshold) {
+      sum += list[k].second;
     } else {
-      node->setMark(false, 0);
+      // not needed for the recovery
+      node->getSubnode(list[k].first)->setMark(false, 0);
     }
   }
-  else {
-      result = false;
-  }
-
-  return result;
+  node->setMark(true, sum);
+  return true;
 }
 
 pair<bool, int> checkIfSatisfied(OpenABEPolicy *policy, OpenABEAttributeList *attr_list, bool reset_flags) {
@@ -684,6 +957,16 @@ pair<bool, int> checkIfSatisfied(OpenABEPolicy *policy, OpenABEAttributeList *at
         fprintf(stderr, "%s:%s:%d: null pointer\n", __FILE__, __FUNCTION__, __LINE__);
         return make_pair(false, 0);
     }
+    if (reset_flags) {
+        // the tree is left as it was, so evaluate the compiled form instead
+        try {
+            shared_ptr<const OpenABELSSSCompiledPolicy> compiled =
+                OpenABELSSSCompiledPolicy::forPolicy(policy);
+            return compiled->satisfiedBy(attr_list->getAttributeBitset());
+        } catch (OpenABE_ERROR &) {
+            // malformed trees fall through to the tree scan
+        }
+    }
     // check whether list satisfies the policy
     bool isSatisfied = iterativeScanTree(policy->getRootNode(), attr_list);
     int numNodesSatisfied = policy->getRootNode()->getNumSatisfied();
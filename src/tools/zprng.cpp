@@ -36,6 +36,11 @@
 #include <stdlib.h>
 #include <iostream>
 #include <string>
+#include <atomic>
+#include <unistd.h>
+#ifndef __wasm__
+#include <pthread.h>
+#endif
 #include <openabe/openabe.h>
 #include <openssl/evp.h>
 
@@ -56,40 +61,49 @@ OpenABERNG::~OpenABERNG() {
  * Implementation of the OpenABEPRNG class
  ********************************************************************************/
 
-static void AesEvpBlockEncrypt(const EVP_CIPHER *cipher, const uint8_t* key,
-                        const uint8_t* pl_ptr, uint8_t *ct_ptr, size_t pl_len) {
-    ASSERT_NOTNULL_VOID(cipher);
-    EVP_CIPHER_CTX *ctx = nullptr;
-    ctx = EVP_CIPHER_CTX_new();
-    EVP_CIPHER_CTX_set_padding(ctx, false);
-    // note that cipher AND key must be in sync (key len should be appropriate input size of
-    // cipher (e.g., 128-bits by default)
-    EVP_EncryptInit_ex (ctx, cipher, NULL, (uint8_t*)key, NULL);
-
-    int olen = 512, tmp_len = 0, out_len = 0;
-    uint8_t out[olen];
-    memset(out, 0, olen);
-    EVP_EncryptUpdate(ctx, out, &tmp_len, (uint8_t*) pl_ptr, (int)pl_len);
-
-    EVP_EncryptFinal_ex(ctx, out + tmp_len, &out_len);
-    // Total encrypted bytes is tmp_len + out_len
-    // For ECB with no padding and block-aligned data, out_len will be 0
-    memcpy(ct_ptr, out, tmp_len + out_len);
-    // cleanup memory
-    EVP_CIPHER_CTX_free(ctx);
-}
-
-static void AES_ECB(const uint8_t *key, const uint8_t *plaintext, uint8_t *ciphertext, size_t len) {
-    // make sure key and plaintext are of sufficient length
-    const EVP_CIPHER *cipher = EVP_aes_256_ecb();
-    AesEvpBlockEncrypt(cipher, key, plaintext, ciphertext, len);
-}
-
-//static void AES_CTR(const uint8_t *key, const uint8_t *plaintext, size_t len) {
-//    // 1. need an IV too here
-//    // 2. make sure key and plaintext are of sufficient length
-//    AesEvpBlockEncrypt(EVP_aes_256_ctr(), key, plaintext, len);
-//}
+// AES-256-ECB with the key schedule done once, for the block-by-block
+// chains of the derivation function
+static EVP_CIPHER_CTX *AesEcbInit(const uint8_t *key) {
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    if (ctx != nullptr) {
+        EVP_EncryptInit_ex(ctx, EVP_aes_256_ecb(), NULL, key, NULL);
+        EVP_CIPHER_CTX_set_padding(ctx, 0);
+    }
+    return ctx;
+}
+
+static void AesEcbBlock(EVP_CIPHER_CTX *ctx, const uint8_t *in, uint8_t *out) {
+    int out_len = 0;
+    EVP_EncryptUpdate(ctx, out, &out_len, in, OpenABE_CTR_DRBG_BLOCKSIZE);
+}
+
+// V = V + n (big-endian, modulo 2^128)
+static void CounterAdd(uint8_t counter[AES_BLOCK_SIZE], size_t n) {
+    for (int i = AES_BLOCK_SIZE; i > 0 && n > 0; i--) {
+        n += counter[i - 1];
+        counter[i - 1] = (uint8_t)n;
+        n >>= 8;
+    }
+}
+
+// E(K, V+1) || E(K, V+2) || ... for num_blocks blocks, exactly as the DRBG
+// would produce them one block at a time, but through a single AES-CTR call
+// so that OpenSSL can pipeline the blocks (AES-NI/VAES). V is left at the
+// last block used.
+static void CtrDrbgKeystream(OpenABECtrDrbg& ctx, uint8_t *out, size_t num_blocks) {
+    size_t len = num_blocks * OpenABE_CTR_DRBG_BLOCKSIZE;
+    CounterAdd(ctx->counter, 1);
+    memset(out, 0, len);
+
+    EVP_CIPHER_CTX *cctx = EVP_CIPHER_CTX_new();
+    ASSERT_NOTNULL_VOID(cctx);
+    int out_len = 0;
+    EVP_EncryptInit_ex(cctx, EVP_aes_256_ctr(), NULL, ctx->key, ctx->counter);
+    EVP_EncryptUpdate(cctx, out, &out_len, out, (int)len);
+    EVP_CIPHER_CTX_free(cctx);
+
+    CounterAdd(ctx->counter, num_blocks - 1);
+}
 
 static void initCtrDrbgContext(OpenABECtrDrbg& ctx, uint8_t *key, size_t key_len) {
     memcpy(ctx->key, key, key_len);
@@ -174,6 +188,10 @@ static int block_cipher_df(uint8_t *output, const uint8_t *data, size_t data_len
         key[i] = i;
     }
 
+    EVP_CIPHER_CTX *aes = AesEcbInit(key);
+    if (aes == nullptr)
+        return OpenABE_ERR_CTR_DRBG_ENTROPY_SOURCE_FAILED;
+
     // Reduce data to OpenABE_CTR_DRBG_SEEDLEN bytes of data
     for (j = 0; j < OpenABE_CTR_DRBG_SEEDLEN; j += OpenABE_CTR_DRBG_BLOCKSIZE) {
         p = buf;
@@ -187,7 +205,7 @@ static int block_cipher_df(uint8_t *output, const uint8_t *data, size_t data_len
             use_len -= (use_len >= OpenABE_CTR_DRBG_BLOCKSIZE) ?
                        OpenABE_CTR_DRBG_BLOCKSIZE : use_len;
             // Block encrypt
-            AES_ECB(key, chain, chain, OpenABE_CTR_DRBG_BLOCKSIZE);
+            AesEcbBlock(aes, chain, chain);
         }
 
         memcpy(tmp + j, chain, OpenABE_CTR_DRBG_BLOCKSIZE);
@@ -199,34 +217,25 @@ static int block_cipher_df(uint8_t *output, const uint8_t *data, size_t data_len
     memcpy(key, tmp, OpenABE_CTR_DRBG_KEYSIZE_BYTES);
     iv = tmp + OpenABE_CTR_DRBG_KEYSIZE_BYTES;
     p = output;
+    EVP_EncryptInit_ex(aes, NULL, NULL, key, NULL);
 
     for (j = 0; j < OpenABE_CTR_DRBG_SEEDLEN; j += OpenABE_CTR_DRBG_BLOCKSIZE) {
         // Block encrypt
-        AES_ECB(key, iv, iv, OpenABE_CTR_DRBG_BLOCKSIZE);
+        AesEcbBlock(aes, iv, iv);
         memcpy(p, iv, OpenABE_CTR_DRBG_BLOCKSIZE);
         p += OpenABE_CTR_DRBG_BLOCKSIZE;
     }
 
+    EVP_CIPHER_CTX_free(aes);
+    OpenABEZeroize(key, OpenABE_CTR_DRBG_KEYSIZE_BYTES);
+    OpenABEZeroize(tmp, OpenABE_CTR_DRBG_SEEDLEN);
     return 0;
 }
 
-static int update_internal(OpenABECtrDrbg& ctx, const uint8_t data[OpenABE_CTR_DRBG_SEEDLEN]) {
-    unsigned char tmp[OpenABE_CTR_DRBG_SEEDLEN];
-    unsigned char *p = tmp;
-    size_t i, j;
-
-    memset( tmp, 0, OpenABE_CTR_DRBG_SEEDLEN );
-
-    for (j = 0; j < OpenABE_CTR_DRBG_SEEDLEN; j += OpenABE_CTR_DRBG_BLOCKSIZE) {
-        // Increase counter
-        for (i = OpenABE_CTR_DRBG_BLOCKSIZE; i > 0; i--)
-            if (++ctx->counter[i - 1] != 0)
-                break;
-
-        // Encrypt counter block
-        AES_ECB(ctx->key, ctx->counter, p, OpenABE_CTR_DRBG_BLOCKSIZE);
-        p += OpenABE_CTR_DRBG_BLOCKSIZE;
-    }
+// tmp holds the OpenABE_CTR_DRBG_SEEDLEN bytes of keystream that follow V
+static int update_with_keystream(OpenABECtrDrbg& ctx, uint8_t *tmp,
+                                 const uint8_t data[OpenABE_CTR_DRBG_SEEDLEN]) {
+    size_t i;
 
     for (i = 0; i < OpenABE_CTR_DRBG_SEEDLEN; i++) {
         tmp[i] ^= data[i];
@@ -235,10 +244,17 @@ static int update_internal(OpenABECtrDrbg& ctx, const uint8_t data[OpenABE_CTR_D
      // Update key and counter
     memcpy(ctx->key, tmp, OpenABE_CTR_DRBG_KEYSIZE_BYTES);
     memcpy(ctx->counter, tmp + OpenABE_CTR_DRBG_KEYSIZE_BYTES, OpenABE_CTR_DRBG_BLOCKSIZE );
+    OpenABEZeroize(tmp, OpenABE_CTR_DRBG_SEEDLEN);
 
     return 0;
 }
 
+static int update_internal(OpenABECtrDrbg& ctx, const uint8_t data[OpenABE_CTR_DRBG_SEEDLEN]) {
+    uint8_t tmp[OpenABE_CTR_DRBG_SEEDLEN];
+    CtrDrbgKeystream(ctx, tmp, OpenABE_CTR_DRBG_SEEDLEN / OpenABE_CTR_DRBG_BLOCKSIZE);
+    return update_with_keystream(ctx, tmp, data);
+}
+
 void ctr_drbg_update(OpenABECtrDrbg& ctx, const uint8_t *additional, size_t add_len) {
     uint8_t add_input[OpenABE_CTR_DRBG_SEEDLEN];
 
@@ -299,10 +315,9 @@ int ctr_drbg_generate_random_with_add(OpenABECtrDrbg& ctx, uint8_t *output, size
                      const uint8_t *additional, size_t add_len) {
     int ret = 0;
     uint8_t add_input[OpenABE_CTR_DRBG_SEEDLEN];
-    uint8_t *p = output;
-    uint8_t tmp[OpenABE_CTR_DRBG_BLOCKSIZE];
-    int i;
-    size_t use_len;
+    // output blocks followed by the blocks of the closing state update
+    uint8_t stream[OpenABE_CTR_DRBG_MAX_REQUEST + OpenABE_CTR_DRBG_BLOCKSIZE + OpenABE_CTR_DRBG_SEEDLEN];
+    size_t out_blocks;
 
     if (output_len > OpenABE_CTR_DRBG_MAX_REQUEST) {
         return OpenABE_ERR_CTR_DRBG_REQUEST_TOO_BIG;
@@ -326,23 +341,14 @@ int ctr_drbg_generate_random_with_add(OpenABECtrDrbg& ctx, uint8_t *output, size
         update_internal(ctx, add_input);
     }
 
-    while (output_len > 0) {
-        // Increase counter
-        for (i = OpenABE_CTR_DRBG_BLOCKSIZE; i > 0; i--) {
-            if(++ctx->counter[i - 1] != 0)
-                break;
-        }
-        // Block_encrypt
-        AES_ECB(ctx->key, ctx->counter, tmp, OpenABE_CTR_DRBG_BLOCKSIZE);
-        use_len = (output_len > OpenABE_CTR_DRBG_BLOCKSIZE) ? OpenABE_CTR_DRBG_BLOCKSIZE :
-                                                       output_len;
-        // Copy random block to destination
-        memcpy(p, tmp, use_len);
-        p += use_len;
-        output_len -= use_len;
-    }
+    // The output and the update of K and V use the same key and consecutive
+    // counters, so all of their blocks come from one keystream call
+    out_blocks = (output_len + OpenABE_CTR_DRBG_BLOCKSIZE - 1) / OpenABE_CTR_DRBG_BLOCKSIZE;
+    CtrDrbgKeystream(ctx, stream, out_blocks + OpenABE_CTR_DRBG_SEEDLEN / OpenABE_CTR_DRBG_BLOCKSIZE);
+    memcpy(output, stream, output_len);
+    OpenABEZeroize(stream, out_blocks * OpenABE_CTR_DRBG_BLOCKSIZE);
     // Update internal K and V
-    update_internal(ctx, add_input);
+    update_with_keystream(ctx, stream + out_blocks * OpenABE_CTR_DRBG_BLOCKSIZE, add_input);
     ctx->reseed_counter++;
 
     return 0;
@@ -393,6 +399,7 @@ int OpenABECtrDrbgContext::getRandomBytes(uint8_t *output, size_t output_len) {
 
 int OpenABECtrDrbgContext::getRandomBytes(OpenABEByteString *output, size_t output_len) {
     output->clear();
+    output->resize(output_len);
 #ifndef __wasm__
     std::lock_guard<std::mutex> write_lock(lock_);
 #endif
@@ -440,18 +447,197 @@ int OpenABECTR_DRBG::getRandomBytes(uint8_t *buf, size_t buf_len) {
 
 int OpenABECTR_DRBG::getRandomBytes(OpenABEByteString *buf, size_t buf_len) {
     ASSERT(isInit_, OpenABE_ERROR_CTR_DRB_NOT_INITIALIZED);
-    uint8_t out[buf_len];
+    // generated in place (same byte stream as the pointer overload)
     buf->clear();
-    int ret = ctrDrbgContext_->getRandomBytes(out, buf_len);
+    buf->resize(buf_len);
+    int ret = ctrDrbgContext_->getRandomBytes(buf->getInternalPtr(), buf_len);
     if (ret < 0) {
         // an error occurred
+        buf->zeroize();
         return 0;
     }
-    buf->appendArray(out, buf_len);
-    memset(out, 0, buf_len);
     return 1; // means we're good
 }
 
+/********************************************************************************
+ * Implementation of the OpenABEBufferedRNG class
+ ********************************************************************************/
+
+OpenABEBufferedRNG::OpenABEBufferedRNG(OpenABERNG *source, size_t block_size)
+    : source_(source), pool_(block_size), pos_(block_size) {
+    ABORT_ASSERT(source != nullptr && block_size > 0, OpenABE_ERROR_INVALID_INPUT);
+}
+
+OpenABEBufferedRNG::~OpenABEBufferedRNG() {
+    this->discard();
+}
+
+void OpenABEBufferedRNG::discard() {
+    OpenABEZeroize(pool_.data() + pos_, pool_.size() - pos_);
+    pos_ = pool_.size();
+}
+
+int OpenABEBufferedRNG::getRandomBytes(uint8_t *buf, size_t buf_len) {
+    while (buf_len > 0) {
+        if (pos_ == pool_.size()) {
+            // requests as big as a block skip the pool
+            if (buf_len >= pool_.size()) {
+                return source_->getRandomBytes(buf, buf_len);
+            }
+            if (source_->getRandomBytes(pool_.data(), pool_.size()) < 1) {
+                return 0;
+            }
+            pos_ = 0;
+        }
+        size_t n = min(buf_len, pool_.size() - pos_);
+        memcpy(buf, pool_.data() + pos_, n);
+        OpenABEZeroize(pool_.data() + pos_, n);
+        pos_ += n;
+        buf += n;
+        buf_len -= n;
+    }
+    return 1;
+}
+
+int OpenABEBufferedRNG::getRandomBytes(OpenABEByteString *buf, size_t buf_len) {
+    buf->clear();
+    buf->resize(buf_len);
+    return this->getRandomBytes(buf->getInternalPtr(), buf_len);
+}
+
+/********************************************************************************
+ * Implementation of the OpenABEThreadRNG class
+ ********************************************************************************/
+
+namespace {
+
+struct ThreadCtrDrbg {
+    OpenABECtrDrbg ctx;
+    unsigned int generation;
+    ~ThreadCtrDrbg() {
+        if (ctx) {
+            clearCtrDrbgContext(ctx);
+        }
+    }
+};
 
+// bumped in a forked child so that no DRBG state is shared with the parent
+std::atomic<unsigned int> forkGeneration(1);
+std::atomic<uint64_t> threadDrbgCount(0);
+thread_local ThreadCtrDrbg threadDrbg;
+
+OpenABECtrDrbg rootDrbg;
+unsigned int rootGeneration = 0;
+#ifndef __wasm__
+std::mutex rootLock;
+
+// the root lock is held across fork() so the child never inherits it locked
+void forkPrepareHandler() {
+    rootLock.lock();
+}
+
+void forkParentHandler() {
+    rootLock.unlock();
+}
+
+void forkChildHandler() {
+    forkGeneration++;
+    rootLock.unlock();
+}
+#endif
+
+int systemEntropyCallback(void *, uint8_t *buf, size_t len) {
+    return (RAND_bytes(buf, (int)len) == 1) ? 0 : OpenABE_ERR_CTR_DRBG_ENTROPY_SOURCE_FAILED;
+}
+
+// entropy for the thread DRBGs: the only place a lock is taken, once per
+// thread seed or reseed
+int rootEntropyCallback(void *, uint8_t *buf, size_t len) {
+#ifndef __wasm__
+    std::lock_guard<std::mutex> guard(rootLock);
+    static int registered = pthread_atfork(forkPrepareHandler, forkParentHandler,
+                                           forkChildHandler);
+    (void)registered;
+#endif
+    unsigned int generation = forkGeneration;
+    if (!rootDrbg || rootGeneration != generation) {
+        uint32_t pid = (uint32_t)getpid();
+        rootDrbg.reset(new OpenABECtrDrbg_);
+        int ret = ctr_drbg_seed_entropy_len(rootDrbg, systemEntropyCallback, nullptr,
+                                            (const uint8_t *)&pid, sizeof(pid),
+                                            OpenABE_CTR_DRBG_ENTROPYLEN);
+        if (ret != 0) {
+            rootDrbg.reset();
+            return ret;
+        }
+        rootGeneration = generation;
+    }
+    return ctr_drbg_generate_random_with_add(rootDrbg, buf, len, NULL, 0);
+}
+
+int threadGenerate(uint8_t *buf, size_t buf_len) {
+    ThreadCtrDrbg &drbg = threadDrbg;
+    unsigned int generation = forkGeneration;
+    if (!drbg.ctx || drbg.generation != generation) {
+        // the personalization string keeps every thread's instance distinct
+        uint64_t person[2] = { threadDrbgCount++, (uint64_t)getpid() };
+        if (drbg.ctx) {
+            clearCtrDrbgContext(drbg.ctx);
+        }
+        drbg.ctx.reset(new OpenABECtrDrbg_);
+        if (ctr_drbg_seed_entropy_len(drbg.ctx, rootEntropyCallback, nullptr,
+                                      (const uint8_t *)person, sizeof(person),
+                                      OpenABE_CTR_DRBG_ENTROPYLEN) != 0) {
+            drbg.ctx.reset();
+            return 0;
+        }
+        drbg.generation = generation;
+    }
+
+    while (buf_len > 0) {
+        size_t n = min(buf_len, (size_t)OpenABE_CTR_DRBG_MAX_REQUEST);
+        if (ctr_drbg_generate_random_with_add(drbg.ctx, buf, n, NULL, 0) != 0) {
+            return 0;
+        }
+        buf += n;
+        buf_len -= n;
+    }
+    return 1;
+}
+
+// the calling thread's DRBG as an OpenABERNG, feeding its pool
+class ThreadDrbgSource : public OpenABERNG {
+public:
+    int getRandomBytes(uint8_t *buf, size_t buf_len) {
+        ASSERT_RNG(threadGenerate(buf, buf_len));
+        return 1;
+    }
+};
+
+ThreadDrbgSource threadDrbgSource;
+thread_local OpenABEBufferedRNG threadPool(&threadDrbgSource);
+thread_local unsigned int threadPoolGeneration = 0;
+
+OpenABEBufferedRNG& currentThreadPool() {
+    unsigned int generation = forkGeneration;
+    if (threadPoolGeneration != generation) {
+        // never hand out bytes drawn before a fork
+        threadPool.discard();
+        threadPoolGeneration = generation;
+    }
+    return threadPool;
+}
+
+}
+
+int OpenABEThreadRNG::getRandomBytes(uint8_t *buf, size_t buf_len) {
+    ASSERT_RNG(currentThreadPool().getRandomBytes(buf, buf_len));
+    return 1;
+}
+
+int OpenABEThreadRNG::getRandomBytes(OpenABEByteString *buf, size_t buf_len) {
+    ASSERT_RNG(currentThreadPool().getRandomBytes(buf, buf_len));
+    return 1;
+}
 
 }
@@ -0,0 +1,309 @@
+/// 
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+/// 
+/// This file is part of Zeutro's OpenABE.
+/// 
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+/// 
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+/// 
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+/// 
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+///
+/// \file   zarena.cpp
+///
+/// \brief  Implementation of the operation-scoped arenas.
+///
+/// \author J. Ayo Akinyele
+///
+
+#include <algorithm>
+#include <cstdint>
+#if !defined(_WIN32) && !defined(__wasm__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define OpenABE_SECURE_ARENA_MMAP
+#endif
+#include <openabe/openabe.h>
+
+using namespace std;
+
+namespace oabe {
+
+/********************************************************************************
+ * Implementation of the OpenABEArena class
+ ********************************************************************************/
+
+// Block header; the usable bytes follow it in the same allocation
+struct OpenABEArena::Block {
+  Block *next;
+  size_t size;
+};
+
+static thread_local OpenABEArena *currentArena = NULL;
+
+OpenABEArena::OpenABEArena(size_t blockSize)
+    : head_(NULL), cursor_(NULL), end_(NULL),
+      blockSize_(std::max(blockSize, (size_t)64)), bytesAllocated_(0) {}
+
+OpenABEArena::~OpenABEArena() { this->release(); }
+
+/*!
+ * Allocate bytes from the arena. The memory stays valid until the arena is
+ * released or destroyed.
+ *
+ * @param[in]   number of bytes.
+ * @param[in]   required alignment (a power of two).
+ * @return      pointer to the allocated bytes.
+ */
+void *OpenABEArena::allocate(size_t bytes, size_t alignment) {
+  uintptr_t p = ((uintptr_t)this->cursor_ + alignment - 1) & ~(uintptr_t)(alignment - 1);
+  if (this->cursor_ == NULL || p + bytes > (uintptr_t)this->end_ ||
+      p < (uintptr_t)this->cursor_) {
+    // start a new block that is at least as large as the request; each new
+    // block doubles (up to a cap) so long operations make few trips to the heap
+    const size_t header = (sizeof(Block) + alignof(max_align_t) - 1) &
+                          ~(alignof(max_align_t) - 1);
+    size_t size = this->blockSize_;
+    if (bytes + alignment > size) {
+      size = bytes + alignment;
+    }
+    Block *block = static_cast<Block *>(::operator new(header + size));
+    block->next = this->head_;
+    block->size = size;
+    this->head_ = block;
+    this->cursor_ = reinterpret_cast<char *>(block) + header;
+    this->end_ = this->cursor_ + size;
+    if (this->blockSize_ < OpenABE_ARENA_MAX_BLOCK_SIZE) {
+      this->blockSize_ *= 2;
+    }
+    p = ((uintptr_t)this->cursor_ + alignment - 1) & ~(uintptr_t)(alignment - 1);
+  }
+  this->cursor_ = reinterpret_cast<char *>(p + bytes);
+  this->bytesAllocated_ += bytes;
+  return reinterpret_cast<void *>(p);
+}
+
+/*!
+ * Return every block to the heap. Anything allocated from the arena must no
+ * longer be in use.
+ */
+void OpenABEArena::release() {
+  while (this->head_ != NULL) {
+    Block *next = this->head_->next;
+    ::operator delete(this->head_);
+    this->head_ = next;
+  }
+  this->cursor_ = this->end_ = NULL;
+  this->bytesAllocated_ = 0;
+}
+
+OpenABEArena *OpenABEArena::current() { return currentArena; }
+
+/********************************************************************************
+ * Implementation of the OpenABEArenaScope class
+ ********************************************************************************/
+
+OpenABEArenaScope::OpenABEArenaScope(OpenABEArena &arena)
+    : previous_(currentArena) {
+  currentArena = &arena;
+}
+
+OpenABEArenaScope::~OpenABEArenaScope() { currentArena = this->previous_; }
+
+/********************************************************************************
+ * Implementation of the OpenABESecureArena class
+ ********************************************************************************/
+
+// Region header, at the start of the usable (unguarded) bytes of a mapping
+struct OpenABESecureArena::Region {
+  Region *next;
+  char *base;     // start of the mapping, including the leading guard page
+  size_t mapLen;
+  char *start;    // first allocatable byte
+  char *end;
+  char *top;      // the cursor when a newer region was started
+};
+
+static thread_local OpenABESecureArena *currentSecureArena = NULL;
+
+static size_t secureArenaPageSize() {
+#if defined(OpenABE_SECURE_ARENA_MMAP)
+  static const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  return page;
+#else
+  return 64;
+#endif
+}
+
+OpenABESecureArena::OpenABESecureArena(size_t regionSize)
+    : head_(NULL), cursor_(NULL),
+      regionSize_(std::max(regionSize, (size_t)64)), bytesAllocated_(0),
+      locked_(true) {}
+
+OpenABESecureArena::~OpenABESecureArena() { this->release(); }
+
+// Map a region with room for at least 'bytes', guard pages on either side.
+// Sets 'locked' to false if the usable pages could not be locked.
+OpenABESecureArena::Region *OpenABESecureArena::mapRegion(size_t bytes, bool &locked) {
+  const size_t page = secureArenaPageSize();
+  const size_t header = (sizeof(Region) + alignof(max_align_t) - 1) &
+                        ~(alignof(max_align_t) - 1);
+  size_t usable = (header + bytes + page - 1) & ~(page - 1);
+#if defined(OpenABE_SECURE_ARENA_MMAP)
+  size_t mapLen = usable + 2 * page;
+  void *map = mmap(NULL, mapLen, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (map == MAP_FAILED) {
+    throw std::bad_alloc();
+  }
+  char *base = static_cast<char *>(map);
+  if (mprotect(base + page, usable, PROT_READ | PROT_WRITE) != 0) {
+    munmap(map, mapLen);
+    throw std::bad_alloc();
+  }
+  if (mlock(base + page, usable) != 0) {
+    locked = false;
+  }
+#if defined(MADV_DONTDUMP)
+  madvise(base + page, usable, MADV_DONTDUMP);
+#endif
+  Region *region = reinterpret_cast<Region *>(base + page);
+#else
+  size_t mapLen = usable;
+  char *base = static_cast<char *>(::operator new(mapLen));
+  locked = false;
+  Region *region = reinterpret_cast<Region *>(base);
+#endif
+  region->next = NULL;
+  region->base = base;
+  region->mapLen = mapLen;
+  region->start = reinterpret_cast<char *>(region) + header;
+  region->end = reinterpret_cast<char *>(region) + usable;
+  region->top = region->start;
+  return region;
+}
+
+void OpenABESecureArena::unmapRegion(Region *region) {
+#if defined(OpenABE_SECURE_ARENA_MMAP)
+  const size_t page = secureArenaPageSize();
+  munlock(region->base + page, region->mapLen - 2 * page);
+  munmap(region->base, region->mapLen);
+#else
+  ::operator delete(region->base);
+#endif
+}
+
+/*!
+ * Allocate bytes from locked memory. They stay valid until the arena is
+ * rewound past them or released.
+ *
+ * @param[in]   number of bytes.
+ * @param[in]   required alignment (a power of two).
+ * @return      pointer to the allocated bytes.
+ */
+void *OpenABESecureArena::allocate(size_t bytes, size_t alignment) {
+  uintptr_t p = ((uintptr_t)this->cursor_ + alignment - 1) & ~(uintptr_t)(alignment - 1);
+  if (this->head_ == NULL || p + bytes > (uintptr_t)this->head_->end ||
+      p < (uintptr_t)this->cursor_) {
+    Region *region = mapRegion(std::max(bytes + alignment, this->regionSize_),
+                               this->locked_);
+    if (this->head_ != NULL) {
+      this->head_->top = this->cursor_;
+    }
+    region->next = this->head_;
+    this->head_ = region;
+    this->cursor_ = region->start;
+    p = ((uintptr_t)this->cursor_ + alignment - 1) & ~(uintptr_t)(alignment - 1);
+  }
+  this->cursor_ = reinterpret_cast<char *>(p + bytes);
+  this->bytesAllocated_ += bytes;
+  return reinterpret_cast<void *>(p);
+}
+
+OpenABESecureArena::Mark OpenABESecureArena::mark() const {
+  Mark m;
+  m.region = this->head_;
+  m.cursor = this->cursor_;
+  m.bytes = this->bytesAllocated_;
+  return m;
+}
+
+/*!
+ * Zeroize everything allocated since the mark and make it available again.
+ * Regions started since are unmapped, except that the first region is kept
+ * (wiped) so the next use needs no new mapping or page faults.
+ *
+ * @param[in]   a mark taken from this arena.
+ */
+void OpenABESecureArena::rewind(const Mark &mark) {
+  while (this->head_ != NULL && this->head_ != mark.region) {
+    OpenABEZeroize(this->head_->start, this->cursor_ - this->head_->start);
+    if (mark.region == NULL && this->head_->next == NULL) {
+      this->cursor_ = this->head_->start;
+      this->bytesAllocated_ = mark.bytes;
+      return;
+    }
+    Region *next = this->head_->next;
+    unmapRegion(this->head_);
+    this->head_ = next;
+    this->cursor_ = next != NULL ? next->top : NULL;
+  }
+  if (this->head_ != NULL && this->cursor_ > mark.cursor) {
+    OpenABEZeroize(mark.cursor, this->cursor_ - mark.cursor);
+    this->cursor_ = mark.cursor;
+  }
+  this->bytesAllocated_ = mark.bytes;
+}
+
+/*!
+ * Zeroize and unmap every region. Anything allocated from the arena must no
+ * longer be in use.
+ */
+void OpenABESecureArena::release() {
+  Mark empty = { NULL, NULL, 0 };
+  this->rewind(empty);
+  if (this->head_ != NULL) {
+    unmapRegion(this->head_);
+    this->head_ = NULL;
+    this->cursor_ = NULL;
+  }
+  this->locked_ = true;
+}
+
+OpenABESecureArena *OpenABESecureArena::current() { return currentSecureArena; }
+
+OpenABESecureArena &OpenABESecureArena::forThread() {
+  static thread_local OpenABESecureArena arena;
+  return arena;
+}
+
+/********************************************************************************
+ * Implementation of the OpenABESecureArenaScope class
+ ********************************************************************************/
+
+OpenABESecureArenaScope::OpenABESecureArenaScope(OpenABESecureArena &arena)
+    : arena_(arena), mark_(arena.mark()), previous_(currentSecureArena) {
+  currentSecureArena = &arena;
+}
+
+OpenABESecureArenaScope::~OpenABESecureArenaScope() {
+  this->arena_.rewind(this->mark_);
+  currentSecureArena = this->previous_;
+}
+
+}
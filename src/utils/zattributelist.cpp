@@ -38,16 +38,104 @@
 #include <stdlib.h>
 #include <iostream>
 #include <fstream>
+#include <mutex>
 #include <string>
 #include <regex>
+#include <unordered_map>
 #include <openabe/openabe.h>
 
 using namespace std;
 
+namespace oabe {
+
+/********************************************************************************
+ * Implementation of the OpenABEAttributeBitset class
+ ********************************************************************************/
+
+namespace {
+struct OpenABEAttributeInterner {
+  std::mutex lock;
+  std::unordered_map<std::string, uint32_t> ids;
+};
+
+OpenABEAttributeInterner& attributeInterner() {
+  static OpenABEAttributeInterner interner;
+  return interner;
+}
+}
+
+/*!
+ * Map an attribute string to a small dense integer. IDs are handed out in
+ * first-use order and never reused, so bitsets built at different times
+ * can be compared.
+ *
+ * @param[in] attribute  - the complete attribute label
+ * @return               - the attribute's ID
+ */
+
+uint32_t OpenABEInternAttribute(const std::string &attribute) {
+  OpenABEAttributeInterner &interner = attributeInterner();
+  std::lock_guard<std::mutex> guard(interner.lock);
+  auto it = interner.ids.find(attribute);
+  if (it != interner.ids.end()) {
+    return it->second;
+  }
+  uint32_t id = interner.ids.size();
+  interner.ids.emplace(attribute, id);
+  return id;
+}
+
+/*!
+ * Look up the ID of an attribute string without assigning one, so probing
+ * a list for attributes it cannot hold leaves the intern table unchanged.
+ *
+ * @param[in] attribute  - the complete attribute label
+ * @param[out] id        - the attribute's ID, if it has one
+ * @return               - true if the attribute has been interned
+ */
+
+bool OpenABEFindAttribute(const std::string &attribute, uint32_t &id) {
+  OpenABEAttributeInterner &interner = attributeInterner();
+  std::lock_guard<std::mutex> guard(interner.lock);
+  auto it = interner.ids.find(attribute);
+  if (it == interner.ids.end()) {
+    return false;
+  }
+  id = it->second;
+  return true;
+}
+
+void OpenABEAttributeBitset::set(uint32_t id) {
+  size_t w = id / 64;
+  if (w >= this->m_Words.size()) {
+    this->m_Words.resize(w + 1, 0);
+  }
+  this->m_Words[w] |= (uint64_t(1) << (id % 64));
+}
+
+bool OpenABEAttributeBitset::isSubsetOf(const OpenABEAttributeBitset &other) const {
+  for (size_t w = 0; w < this->m_Words.size(); w++) {
+    uint64_t theirs = (w < other.m_Words.size()) ? other.m_Words[w] : 0;
+    if ((this->m_Words[w] & ~theirs) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool OpenABEAttributeBitset::intersects(const OpenABEAttributeBitset &other) const {
+  size_t n = std::min(this->m_Words.size(), other.m_Words.size());
+  for (size_t w = 0; w < n; w++) {
+    if ((this->m_Words[w] & other.m_Words[w]) != 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
 /********************************************************************************
  * Implementation of the OpenABEAttributeList class
  ********************************************************************************/
-namespace oabe {
 
 /*!
  * Constructor for the ZAttributeList class.
@@ -83,6 +171,7 @@ OpenABEAttributeList::OpenABEAttributeList(const OpenABEAttributeList &copy) {
   this->m_Type = copy.getFunctionType();
   this->m_Attributes = copy.m_Attributes;
   this->m_OriginalAttributes = copy.m_OriginalAttributes;
+  this->m_AttributeBits = copy.m_AttributeBits;
   this->m_prefixSet = copy.m_prefixSet;
 }
 
@@ -117,13 +206,15 @@ void OpenABEAttributeList::syncOrigAttributes(const string &prefix,
 }
 
 /*!
- * Search for a string in the string list.
+ * Search for a string in the string list. Every attribute of the list is
+ * interned when it is added, so this is one hash lookup and a bit test
+ * rather than a scan of the list.
  *
  */
 
 bool OpenABEAttributeList::matchAttribute(const string &attribute) {
-  return (std::find(m_Attributes.begin(), m_Attributes.end(), attribute) !=
-          m_Attributes.end());
+  uint32_t id;
+  return OpenABEFindAttribute(attribute, id) && this->m_AttributeBits.test(id);
 }
 
 bool OpenABEAttributeList::addAttribute(string attribute) {
@@ -142,6 +233,7 @@ bool OpenABEAttributeList::addAttribute(string attribute) {
   // do a quick find for the '=' symbol: if not, then proceed as usual
   if (attribute.find(EQUALS) == string::npos) {
     this->m_Attributes.push_back(attribute);
+    this->m_AttributeBits.set(OpenABEInternAttribute(attribute));
   } else {
     // otherwise, parse as a numerical attribute (using regex)
     // NOTE: we already handled prefixes in first part so would be redundant here
@@ -149,8 +241,10 @@ bool OpenABEAttributeList::addAttribute(string attribute) {
     const vector<string> *m_attrs = attr_list->getAttributeList();
     const vector<string> *orig_attrs = attr_list->getOriginalAttributeList();
     if (m_attrs && orig_attrs) {
-      for (auto& a : *m_attrs)
+      for (auto& a : *m_attrs) {
         this->m_Attributes.push_back(a);
+        this->m_AttributeBits.set(OpenABEInternAttribute(a));
+      }
       for (auto& b : *orig_attrs)
         this->m_OriginalAttributes.push_back(b);
     }
@@ -165,6 +259,10 @@ void OpenABEAttributeList::setAttributes(vector<string> &attr_list,
   this->m_Attributes = attr_list;
   this->m_OriginalAttributes = orig_attr_list;
   this->m_prefixSet = prefix_list;
+  this->m_AttributeBits.clear();
+  for (auto &a : this->m_Attributes) {
+    this->m_AttributeBits.set(OpenABEInternAttribute(a));
+  }
 }
 
 ostream &operator<<(ostream &os, const OpenABEAttributeList &attributeList) {
@@ -273,7 +371,7 @@ std::unique_ptr<OpenABEAttributeList> createAttributeList(const std::string &s)
   }
   /* construct attribute list */
   try {
-    driver.parse_string(ATTRLIST_PREFIX, s);
+    driver.parse_input(false, s);
     return driver.getAttributeList();
   } catch (OpenABE_ERROR &error) {
     cerr << "caught exception: " << OpenABE_errorToString(error) << endl;
@@ -0,0 +1,367 @@
+/// 
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+/// 
+/// This file is part of Zeutro's OpenABE.
+/// 
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+/// 
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+/// 
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+/// 
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+///
+/// \file   zbase64.cpp
+///
+/// \brief  Base64 codec for key, ciphertext and signature blobs. Long
+///         inputs go through AVX2 (x86, picked at run time) or NEON
+///         (AArch64) kernels; the ends and everything else use the
+///         table-driven scalar code.
+///
+/// \author J. Ayo Akinyele
+///
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <openabe/openabe.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__)) && !defined(__wasm__)
+#define OpenABE_BASE64_AVX2
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define OpenABE_BASE64_NEON
+#include <arm_neon.h>
+#endif
+
+using namespace std;
+
+namespace oabe {
+
+static const char base64_chars[] =
+             "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+             "abcdefghijklmnopqrstuvwxyz"
+             "0123456789+/";
+
+#define B64_INVALID 0xFF
+
+// value of each base64 character, B64_INVALID for everything else
+static const uint8_t base64_values[256] = {
+#define X B64_INVALID
+  X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+  X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+  X, X, X, X, X, X, X, X, X, X, X, 62, X, X, X, 63,
+  52, 53, 54, 55, 56, 57, 58, 59, 60, 61, X, X, X, X, X, X,
+  X, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+  15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, X, X, X, X, X,
+  X, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+  41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, X, X, X, X, X,
+  X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+  X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+  X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+  X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+  X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+  X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+  X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+  X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X
+#undef X
+};
+
+bool is_base64(unsigned char c) {
+  return base64_values[c] != B64_INVALID;
+}
+
+/********************************************************************************
+ * Vector kernels. Each one handles as many whole blocks as it can and
+ * returns the number of input bytes it consumed; the caller finishes the
+ * rest with the scalar code. Decoders stop at the first block holding
+ * anything but the 64 base64 characters.
+ ********************************************************************************/
+
+#if defined(OpenABE_BASE64_AVX2)
+
+static bool haveAVX2() {
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  return avx2;
+}
+
+// 24 bytes -> 32 characters per step (W. Mula's pshufb encoder)
+__attribute__((target("avx2")))
+static size_t encodeAVX2(const uint8_t *in, size_t len, char *out) {
+  const __m256i shuffle = _mm256_setr_epi8(
+      1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+      1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+  const __m256i offsets = _mm256_setr_epi8(
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+      '/' - 63, 'A', 0, 0,
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+      '/' - 63, 'A', 0, 0);
+  size_t done = 0;
+  // each 16-byte load only uses 12 bytes, so keep 4 spare bytes readable
+  while (len - done >= 28) {
+    __m128i lo = _mm_loadu_si128((const __m128i *)(in + done));
+    __m128i hi = _mm_loadu_si128((const __m128i *)(in + done + 12));
+    __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    v = _mm256_shuffle_epi8(v, shuffle);
+    // split every 3 bytes into four 6-bit indices
+    __m256i t0 = _mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00));
+    __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    __m256i t2 = _mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0));
+    __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    __m256i idx = _mm256_or_si256(t1, t3);
+    // map each index range to its ASCII offset
+    __m256i range = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+    __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx);
+    range = _mm256_or_si256(range, _mm256_and_si256(upper, _mm256_set1_epi8(13)));
+    __m256i chars = _mm256_add_epi8(_mm256_shuffle_epi8(offsets, range), idx);
+    _mm256_storeu_si256((__m256i *)(out + done / 3 * 4), chars);
+    done += 24;
+  }
+  return done;
+}
+
+// 32 characters -> 24 bytes per step; writes 8 bytes past each block
+__attribute__((target("avx2")))
+static size_t decodeAVX2(const uint8_t *in, size_t len, uint8_t *out) {
+  const __m256i lut_lo = _mm256_setr_epi8(
+      0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+      0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+      0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+      0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+  const __m256i lut_hi = _mm256_setr_epi8(
+      0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+      0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m256i lut_roll = _mm256_setr_epi8(
+      0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i mask_2F = _mm256_set1_epi8(0x2f);
+  const __m256i pack = _mm256_setr_epi8(
+      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1);
+  size_t done = 0;
+  while (len - done >= 32) {
+    __m256i str = _mm256_loadu_si256((const __m256i *)(in + done));
+    // classify by nibbles: any bit shared by lo and hi flags a bad character
+    __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask_2F);
+    __m256i lo_nibbles = _mm256_and_si256(str, mask_2F);
+    __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+    __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+    if (!_mm256_testz_si256(lo, hi)) {
+      break;
+    }
+    __m256i eq_2F = _mm256_cmpeq_epi8(str, mask_2F);
+    __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2F, hi_nibbles));
+    str = _mm256_add_epi8(str, roll);
+    // merge the 6-bit values into 24-bit groups, then drop the gaps
+    __m256i merged = _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+    merged = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+    merged = _mm256_shuffle_epi8(merged, pack);
+    merged = _mm256_permutevar8x32_epi32(merged, lanes);
+    _mm256_storeu_si256((__m256i *)(out + done / 4 * 3), merged);
+    done += 32;
+  }
+  return done;
+}
+
+#elif defined(OpenABE_BASE64_NEON)
+
+// 48 bytes -> 64 characters per step
+static size_t encodeNEON(const uint8_t *in, size_t len, char *out) {
+  uint8x16x4_t table;
+  table.val[0] = vld1q_u8((const uint8_t *)base64_chars);
+  table.val[1] = vld1q_u8((const uint8_t *)base64_chars + 16);
+  table.val[2] = vld1q_u8((const uint8_t *)base64_chars + 32);
+  table.val[3] = vld1q_u8((const uint8_t *)base64_chars + 48);
+  const uint8x16_t mask = vdupq_n_u8(0x3f);
+  size_t done = 0;
+  while (len - done >= 48) {
+    uint8x16x3_t src = vld3q_u8(in + done);
+    uint8x16x4_t idx;
+    idx.val[0] = vshrq_n_u8(src.val[0], 2);
+    idx.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(src.val[0], 4),
+                                   vshrq_n_u8(src.val[1], 4)), mask);
+    idx.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(src.val[1], 2),
+                                   vshrq_n_u8(src.val[2], 6)), mask);
+    idx.val[3] = vandq_u8(src.val[2], mask);
+    uint8x16x4_t chars;
+    chars.val[0] = vqtbl4q_u8(table, idx.val[0]);
+    chars.val[1] = vqtbl4q_u8(table, idx.val[1]);
+    chars.val[2] = vqtbl4q_u8(table, idx.val[2]);
+    chars.val[3] = vqtbl4q_u8(table, idx.val[3]);
+    vst4q_u8((uint8_t *)out + done / 3 * 4, chars);
+    done += 48;
+  }
+  return done;
+}
+
+// 64 characters -> 48 bytes per step
+static size_t decodeNEON(const uint8_t *in, size_t len, uint8_t *out) {
+  // values of characters 0..63 and 64..127; anything else is invalid
+  uint8x16x4_t lower, upper;
+  for (int i = 0; i < 4; i++) {
+    lower.val[i] = vld1q_u8(base64_values + 16 * i);
+    upper.val[i] = vld1q_u8(base64_values + 64 + 16 * i);
+  }
+  const uint8x16_t offset = vdupq_n_u8(64);
+  size_t done = 0;
+  while (len - done >= 64) {
+    uint8x16x4_t str = vld4q_u8(in + done);
+    uint8x16x4_t val;
+    uint8x16_t bad = vdupq_n_u8(0);
+    for (int i = 0; i < 4; i++) {
+      // out-of-range table indices give 0, so exactly one lookup applies
+      val.val[i] = vorrq_u8(vqtbl4q_u8(lower, str.val[i]),
+                            vqtbl4q_u8(upper, vsubq_u8(str.val[i], offset)));
+      bad = vorrq_u8(bad, vorrq_u8(val.val[i], vcgeq_u8(str.val[i], vdupq_n_u8(128))));
+    }
+    // every valid value is below 64
+    if (vmaxvq_u8(bad) >= 64) {
+      break;
+    }
+    uint8x16x3_t bytes;
+    bytes.val[0] = vorrq_u8(vshlq_n_u8(val.val[0], 2), vshrq_n_u8(val.val[1], 4));
+    bytes.val[1] = vorrq_u8(vshlq_n_u8(val.val[1], 4), vshrq_n_u8(val.val[2], 2));
+    bytes.val[2] = vorrq_u8(vshlq_n_u8(val.val[2], 6), val.val[3]);
+    vst3q_u8(out + done / 4 * 3, bytes);
+    done += 64;
+  }
+  return done;
+}
+
+#endif
+
+static size_t encodeBlocks(const uint8_t *in, size_t len, char *out) {
+#if defined(OpenABE_BASE64_AVX2)
+  if (haveAVX2()) {
+    return encodeAVX2(in, len, out);
+  }
+#elif defined(OpenABE_BASE64_NEON)
+  return encodeNEON(in, len, out);
+#endif
+  return 0;
+}
+
+static size_t decodeBlocks(const uint8_t *in, size_t len, uint8_t *out) {
+#if defined(OpenABE_BASE64_AVX2)
+  if (haveAVX2()) {
+    return decodeAVX2(in, len, out);
+  }
+#elif defined(OpenABE_BASE64_NEON)
+  return decodeNEON(in, len, out);
+#endif
+  return 0;
+}
+
+/********************************************************************************
+ * Base64Encode / Base64Decode
+ ********************************************************************************/
+
+string Base64Encode(unsigned char const* bytes_to_encode, unsigned int in_len) {
+  string ret;
+  if (in_len == 0) {
+    return ret;
+  }
+  ret.resize(((size_t)in_len + 2) / 3 * 4);
+  char *out = &ret[0];
+  const uint8_t *in = bytes_to_encode;
+
+  size_t i = encodeBlocks(in, in_len, out);
+  char *p = out + i / 3 * 4;
+  for (; i + 3 <= in_len; i += 3) {
+    uint32_t v = (in[i] << 16) | (in[i+1] << 8) | in[i+2];
+    *p++ = base64_chars[(v >> 18) & 0x3f];
+    *p++ = base64_chars[(v >> 12) & 0x3f];
+    *p++ = base64_chars[(v >> 6) & 0x3f];
+    *p++ = base64_chars[v & 0x3f];
+  }
+  if (i < in_len) {
+    uint32_t v = in[i] << 16;
+    if (i + 1 < in_len) {
+      v |= in[i+1] << 8;
+    }
+    *p++ = base64_chars[(v >> 18) & 0x3f];
+    *p++ = base64_chars[(v >> 12) & 0x3f];
+    *p++ = (i + 1 < in_len) ? base64_chars[(v >> 6) & 0x3f] : '=';
+    *p++ = '=';
+  }
+  return ret;
+}
+
+string Base64Decode(string const& encoded_string) {
+  const uint8_t *in = (const uint8_t *)encoded_string.data();
+  size_t in_len = encoded_string.size();
+  std::string ret;
+  // the vector kernels write a few bytes past each block
+  ret.resize(in_len / 4 * 3 + 16);
+  uint8_t *out = (uint8_t *)&ret[0];
+
+  size_t in_ = decodeBlocks(in, in_len, out);
+  size_t out_len = in_ / 4 * 3;
+  // decode up to the first '=' or non-base64 character
+  uint8_t char_array_4[4];
+  int i = 0;
+  for (; in_ < in_len; in_++) {
+    uint8_t v = base64_values[in[in_]];
+    if (v == B64_INVALID) {
+      break;
+    }
+    char_array_4[i++] = v;
+    if (i == 4) {
+      out[out_len++] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
+      out[out_len++] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
+      out[out_len++] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
+      i = 0;
+    }
+  }
+
+  // The only case where we have a valid input and the following
+  // if happens is terminating '=' characters
+  if (in_ < in_len) {
+    // Look for terminating '='s, maximum 2
+    if (in_len - in_ > 2) {
+        fprintf(stderr, "Invalid Base64 input: too many terminating characters\n");
+        return "";
+    }
+    size_t tmp = in_;
+    for (; tmp < in_len; tmp++) {
+        if (in[tmp] != '=') {
+            break;
+        }
+    }
+    if (tmp != in_len) {
+        fprintf(stderr, "Invalid Base64 input: invalid terminating characters\n");
+        return "";
+    }
+  }
+
+  if (i >= 2) {
+    out[out_len++] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
+  }
+  if (i == 3) {
+    out[out_len++] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
+  }
+  ret.resize(out_len);
+  return ret;
+}
+
+}
@@ -31,23 +31,44 @@
 /// \author J. Ayo Akinyele
 ///
 
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
 #include <cstring>
 #include <chrono>
+#include <fstream>
+#include <iomanip>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 #include <openabe/utils/zbenchmark.h>
+#include <openabe/utils/zmetrics.h>
 
 using namespace std;
+using namespace oabe;
 
 int sec_in_microsecond = 1000000;
 int ms_in_microsecond = 1000;
 
+uint64_t Benchmark::readCycleCounter()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
 void Benchmark::start()
 {
-  startT = chrono::system_clock::now();
+  startC = readCycleCounter();
+  startT = chrono::steady_clock::now();
 }
 
 void Benchmark::stop()
 {
-  endT = chrono::system_clock::now();
+  endT = chrono::steady_clock::now();
+  endC = readCycleCounter();
 }
 
 int Benchmark::getTimeInMicroseconds()
@@ -61,9 +82,10 @@ int Benchmark::getTimeInMicroseconds()
 double Benchmark::computeTimeInMilliseconds()
 {
   if (initBench) {
-    double microsec_result = (double) this->getTimeInMicroseconds();
-    double rawResult = microsec_result / ms_in_microsecond;
+    // sub-microsecond resolution; getTimeInMicroseconds truncates
+    double rawResult = chrono::duration<double, milli>(endT - startT).count();
     ss << rawResult << ", ";
+    samples.push_back(rawResult);
     sum += rawResult;
     iterationCount++;
     return rawResult;
@@ -81,6 +103,169 @@ double Benchmark::getAverage()
   return sum / iterationCount;
 }
 
+BenchmarkSummary::BenchmarkSummary()
+  : count(0), outliers(0), mean(0.0), trimmedMean(0.0), stddev(0.0),
+    min(0.0), max(0.0), p50(0.0), p95(0.0), p99(0.0), allocations(0.0),
+    allocatedBytes(0.0), peakBytes(0) {}
+
+// nearest-rank percentile of sorted samples
+static double percentile(const vector<double>& sorted, double p)
+{
+  size_t rank = (size_t) ceil(p / 100.0 * sorted.size());
+  return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+BenchmarkSummary BenchmarkSummary::fromSamples(vector<double> samples)
+{
+  BenchmarkSummary summary;
+  if (samples.empty()) {
+    return summary;
+  }
+  sort(samples.begin(), samples.end());
+  summary.count = samples.size();
+  summary.min = samples.front();
+  summary.max = samples.back();
+  summary.p50 = percentile(samples, 50);
+  summary.p95 = percentile(samples, 95);
+  summary.p99 = percentile(samples, 99);
+
+  double total = 0.0;
+  for (double t : samples) {
+    total += t;
+  }
+  summary.mean = total / samples.size();
+  double variance = 0.0;
+  for (double t : samples) {
+    variance += (t - summary.mean) * (t - summary.mean);
+  }
+  summary.stddev = sqrt(variance / samples.size());
+
+  double q1 = percentile(samples, 25), q3 = percentile(samples, 75);
+  double fence = q3 + 1.5 * (q3 - q1);
+  double kept = 0.0;
+  for (double t : samples) {
+    if (t > fence) {
+      summary.outliers++;
+    } else {
+      kept += t;
+    }
+  }
+  summary.trimmedMean = kept / (samples.size() - summary.outliers);
+  return summary;
+}
+
+string BenchmarkSummary::toJson(const string& name) const
+{
+  stringstream out;
+  out << fixed << setprecision(4);
+  out << "{\"name\": \"" << name << "\", \"count\": " << count
+      << ", \"mean\": " << mean << ", \"trimmed_mean\": " << trimmedMean
+      << ", \"stddev\": " << stddev << ", \"min\": " << min
+      << ", \"max\": " << max << ", \"p50\": " << p50
+      << ", \"p95\": " << p95 << ", \"p99\": " << p99
+      << ", \"outliers\": " << outliers << ", \"allocs\": " << allocations
+      << ", \"alloc_bytes\": " << allocatedBytes << ", \"peak_bytes\": " << peakBytes
+      << "}";
+  return out.str();
+}
+
+string BenchmarkSummary::csvHeader()
+{
+  return "name,count,mean,trimmed_mean,stddev,min,max,p50,p95,p99,outliers,"
+         "allocs,alloc_bytes,peak_bytes";
+}
+
+string BenchmarkSummary::toCsvRow(const string& name) const
+{
+  stringstream out;
+  out << fixed << setprecision(4);
+  out << name << "," << count << "," << mean << "," << trimmedMean << ","
+      << stddev << "," << min << "," << max << "," << p50 << "," << p95
+      << "," << p99 << "," << outliers << "," << allocations << ","
+      << allocatedBytes << "," << peakBytes;
+  return out.str();
+}
+
+BenchmarkSummary runTimedBenchmark(const function<void()>& fn, int warmup,
+                                   int repetitions)
+{
+  Benchmark bench;
+  for (int i = 0; i < warmup; i++) {
+    fn();
+  }
+  bool tracking = oabe::OpenABE_metricsEnabled();
+  uint64_t allocations = 0, allocatedBytes = 0, peakBytes = 0;
+  uint64_t before[OpenABE_METRIC_COUNT], after[OpenABE_METRIC_COUNT];
+  for (int i = 0; i < repetitions; i++) {
+    oabe::metrics::PeakMark mark = { 0, 0 };
+    if (tracking) {
+      oabe::metrics::readThread(before);
+      mark = oabe::metrics::markPeak();
+    }
+    bench.start();
+    fn();
+    bench.stop();
+    if (tracking) {
+      peakBytes = max(peakBytes, oabe::metrics::peakSince(mark));
+      oabe::metrics::readThread(after);
+      allocations += after[OpenABE_METRIC_ALLOCATIONS] - before[OpenABE_METRIC_ALLOCATIONS];
+      allocatedBytes += after[OpenABE_METRIC_ALLOCATED_BYTES] -
+                        before[OpenABE_METRIC_ALLOCATED_BYTES];
+    }
+    bench.computeTimeInMilliseconds();
+  }
+  BenchmarkSummary summary = bench.summarize();
+  if (tracking && repetitions > 0) {
+    summary.allocations = (double) allocations / repetitions;
+    summary.allocatedBytes = (double) allocatedBytes / repetitions;
+    summary.peakBytes = peakBytes;
+  }
+  return summary;
+}
+
+bool loadBenchmarkBaseline(const string& path, BenchmarkBaseline& baseline,
+                           const string& columnName)
+{
+  ifstream in(path.c_str());
+  if (!in) {
+    return false;
+  }
+  // "name,p50" by default; a header row naming the column (such as the
+  // one from BenchmarkSummary::csvHeader) selects it instead
+  size_t column = (columnName == "p50") ? 1 : string::npos;
+  string line;
+  while (getline(in, line)) {
+    vector<string> fields;
+    stringstream row(line);
+    string field;
+    while (getline(row, field, ',')) {
+      fields.push_back(field);
+    }
+    if (fields.size() < 2) {
+      continue;
+    }
+    if (fields[0] == "name") {
+      column = find(fields.begin(), fields.end(), columnName) - fields.begin();
+      continue;
+    }
+    if (column >= fields.size()) {
+      continue;
+    }
+    char *end = nullptr;
+    double value = strtod(fields[column].c_str(), &end);
+    if (end != fields[column].c_str()) {
+      baseline[fields[0]] = value;
+    }
+  }
+  return true;
+}
+
+bool isBenchmarkRegression(const BenchmarkSummary& summary, double baselineP50,
+                           double tolerance)
+{
+  return summary.count > 0 && summary.p50 > baselineP50 * (1.0 + tolerance);
+}
+
 ListStr::ListStr(void)
 {
   // increases as elements are appended
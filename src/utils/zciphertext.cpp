@@ -93,16 +93,27 @@ OpenABECiphertext::~OpenABECiphertext() {}
  *
  */
 void OpenABECiphertext::exportToBytes(OpenABEByteString &output) {
-  OpenABEByteString ciphertextHeader, ciphertextBytes;
+  this->exportToBytes(output, this->getCompactEncoding());
+}
+
+/*!
+ * Export routine in the given encoding, which the ciphertext does not keep:
+ * exporting the full form of a compact ciphertext changes nothing that
+ * another thread reading it could see.
+ *
+ */
+void OpenABECiphertext::exportToBytes(OpenABEByteString &output, bool compact) {
+  OpenABEByteString ciphertextHeader;
   // libVersion || curveID || AlgID || uid || id
   this->getHeader(ciphertextHeader);
-  // serialize the ciphertext elements
-  this->serialize(ciphertextBytes);
-  // first pack the key header
-  // then pack the key bytes
+  // first pack the header, then serialize the ciphertext elements straight
+  // into the output and pack them in place
   output.clear();
   output.smartPack(ciphertextHeader);
-  output.smartPack(ciphertextBytes);
+  OpenABEByteSink sink(output);
+  size_t mark = sink.beginPacked();
+  this->serializeTo(sink, compact);
+  sink.endPacked(mark);
   return;
 }
 
@@ -141,12 +152,12 @@ void OpenABECiphertext::loadFromBytes(OpenABEByteString &input) {
     this->algorithmID = OpenABE_getSchemeID(ciphertextHeader.at(2));
     this->uid = ciphertextHeader.getSubset(3, UID_LEN);
 
-    fprintf(stderr, "DEBUG loadFromBytes: curveID=%d, algorithmID=%d, group=%p\n",
-            this->curveID, this->algorithmID, (void*)this->group.get());
+    OpenABE_TRACE_DEBUG("loadFromBytes: curveID=%d, algorithmID=%d, group=%p",
+                        this->curveID, this->algorithmID, (void*)this->group.get());
 
     if (this->group == nullptr && this->curveID != OpenABE_NONE_ID) {
       OpenABE_setGroupObject(this->group, this->curveID);
-      fprintf(stderr, "DEBUG loadFromBytes: After setGroupObject, group=%p\n", (void*)this->group.get());
+      OpenABE_TRACE_DEBUG("loadFromBytes: after setGroupObject, group=%p", (void*)this->group.get());
     }
 
     this->deserialize(ciphertextBytes);
@@ -162,13 +173,12 @@ void OpenABECiphertext::loadFromBytes(OpenABEByteString &input) {
  *
  */
 void OpenABECiphertext::exportToBytesWithoutHeader(OpenABEByteString &output) {
-  OpenABEByteString ciphertextBytes;
-  // serialize the ciphertext elements
-  this->serialize(ciphertextBytes);
-  // first pack the key header
-  // then pack the key bytes
+  // serialize the ciphertext elements straight into the output
   output.clear();
-  output.smartPack(ciphertextBytes);
+  OpenABEByteSink sink(output);
+  size_t mark = sink.beginPacked();
+  this->serializeTo(sink);
+  sink.endPacked(mark);
   return;
 }
 
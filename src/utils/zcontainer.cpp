@@ -34,6 +34,8 @@
 #define __OpenABECONTAINER_CPP__
 
 #include <algorithm>
+#include <atomic>
+#include <mutex>
 #include <stdio.h>
 #include <stdlib.h>
 #include <iostream>
@@ -43,21 +45,110 @@
 
 using namespace std;
 
+namespace oabe {
+
+/*!
+ * Decode a serialized G1, G2 or GT element, including point decompression
+ * and subgroup validation. Only reads the group, so several threads may
+ * decode into the same group at once.
+ */
+static ZObject *decodeGroupElement(std::shared_ptr<BPGroup> group, uint8_t type,
+                                   OpenABEByteString &bytes) {
+  OpenABE_countMetric(OpenABE_METRIC_POINTS_DECODED);
+  if (type == OpenABE_ELEMENT_G1) {
+    unique_ptr<G1> g(new G1(group));
+    g->deserialize(bytes);
+    return g.release();
+  } else if (type == OpenABE_ELEMENT_G2) {
+    unique_ptr<G2> g(new G2(group));
+    g->deserialize(bytes);
+    return g.release();
+  }
+  unique_ptr<GT> g(new GT(group));
+  g->deserialize(bytes);
+  return g.release();
+}
+
+/********************************************************************************
+ * Implementation of the OpenABELazyComponent class
+ ********************************************************************************/
+
+///
+/// @class  OpenABELazyComponent
+///
+/// @brief  A G1, G2 or GT element read from a serialized container. The
+///         bytes are kept as-is and decoded (including point decompression
+///         and validation) only when the element is first used; the
+///         decoded element is kept from then on.
+///
+
+class OpenABELazyComponent : public ZObject {
+public:
+  // takes over the bytes, which the caller no longer needs
+  OpenABELazyComponent(std::shared_ptr<BPGroup> group, uint8_t type,
+                       OpenABEByteString &bytes)
+    : ZObject(), group_(group), type_(type), decoded_(nullptr) {
+    this->bytes_.swap(bytes);
+  }
+  ~OpenABELazyComponent() { delete decoded_.load(); }
+
+  // decode on first use; safe to call from several threads
+  ZObject *get() const {
+    call_once(this->once_, [this]() {
+      // decoding only reads the bytes
+      OpenABEByteString &bytes = const_cast<OpenABEByteString &>(this->bytes_);
+      this->decoded_.store(decodeGroupElement(this->group_, this->type_, bytes));
+    });
+    return this->decoded_.load();
+  }
+
+  ZObject *clone() const { return this->get()->clone(); }
+  // the original encoding is written back without decoding
+  void serialize(OpenABEByteString &result) const { result = this->bytes_; }
+  void serializeTo(OpenABEByteSink &sink) const { sink.append(this->bytes_); }
+
+  bool isEqual(ZObject *z) const {
+    ZObject *decoded = this->decoded_.load();
+    if (decoded != nullptr) {
+      OpenABELazyComponent *lazy = dynamic_cast<OpenABELazyComponent *>(z);
+      return decoded->isEqual(lazy != nullptr ? lazy->get() : z);
+    }
+    if (z == nullptr) {
+      return false;
+    }
+    // compare encodings instead of decoding this element; elements are
+    // always serialized canonically so equal points have equal bytes
+    OpenABEByteString other;
+    z->serialize(other);
+    return other == this->bytes_;
+  }
+
+private:
+  std::shared_ptr<BPGroup> group_;
+  uint8_t type_;
+  OpenABEByteString bytes_;
+  mutable std::once_flag once_;
+  mutable std::atomic<ZObject *> decoded_;
+};
+
 /********************************************************************************
  * Implementation of the OpenABEContainer class
  ********************************************************************************/
-namespace oabe {
 
 /*!
  * Constructor for the OpenABEContainer class.
  *
  */
 
-OpenABEContainer::OpenABEContainer() : ZObject() { 
+OpenABEContainer::OpenABEContainer()
+  : ZObject(), lazyDecode_(false), compactEncoding_(false),
+    schema_(OpenABE_SCHEMA_NONE) {
   this->group = nullptr; 
 }
 
-OpenABEContainer::OpenABEContainer(std::shared_ptr<ZGroup> group) : ZObject() {
+OpenABEContainer::OpenABEContainer(std::shared_ptr<ZGroup> group)
+  : ZObject(), lazyDecode_(false), compactEncoding_(false),
+    schema_(OpenABE_SCHEMA_NONE) {
   this->group = group;
 }
 
@@ -67,13 +158,89 @@ OpenABEContainer::OpenABEContainer(std::shared_ptr<ZGroup> group) : ZObject() {
  */
 
 OpenABEContainer::~OpenABEContainer() {
-  std::map<std::string, ZObject *>::iterator iter;
-  for (iter = this->val.begin(); iter != this->val.end(); iter++) {
-    delete iter->second;
+  if (this->lineTablesOwner_) {
+    this->lineTablesOwner_->detach();
+  }
+  for (auto &component : this->val) {
+    delete component.object;
   }
   this->val.clear();
 }
 
+template <typename C>
+static bool componentNameLess(const C &c, const string &name) {
+  return c.name < name;
+}
+
+OpenABEContainer::ComponentTable::iterator
+OpenABEContainer::findComponent(const string &name) {
+  auto it = lower_bound(this->val.begin(), this->val.end(), name,
+                        componentNameLess<Component>);
+  return (it != this->val.end() && it->name == name) ? it : this->val.end();
+}
+
+OpenABEContainer::ComponentTable::const_iterator
+OpenABEContainer::findComponent(const string &name) const {
+  auto it = lower_bound(this->val.begin(), this->val.end(), name,
+                        componentNameLess<Component>);
+  return (it != this->val.end() && it->name == name) ? it : this->val.end();
+}
+
+// the element type tag of a component added through setComponent
+static uint8_t componentType(const ZObject *component) {
+  if (dynamic_cast<const G1 *>(component) != nullptr) {
+    return OpenABE_ELEMENT_G1;
+  } else if (dynamic_cast<const G2 *>(component) != nullptr) {
+    return OpenABE_ELEMENT_G2;
+  } else if (dynamic_cast<const GT *>(component) != nullptr) {
+    return OpenABE_ELEMENT_GT;
+  } else if (dynamic_cast<const ZP *>(component) != nullptr) {
+    return OpenABE_ELEMENT_ZP;
+  }
+  return OpenABE_NONE_TYPE;
+}
+
+/*!
+ * Store a component by name, taking ownership of it. Any existing
+ * component with the same name is released.
+ *
+ * @param Name of the ciphertext component
+ * @param Heap allocated component
+ */
+
+void OpenABEContainer::adoptComponent(const string &name, ZObject *component) {
+  this->adoptComponent(name, component, componentType(component));
+}
+
+/*!
+ * Store a component whose element type is already known (from its
+ * serialized form), taking ownership of it.
+ *
+ * @param Name of the ciphertext component
+ * @param Heap allocated component
+ * @param Element type of the component (or of what a lazy one decodes to)
+ * @param Whether the component is an OpenABELazyComponent
+ */
+
+void OpenABEContainer::adoptComponent(const string &name, ZObject *component,
+                                      uint8_t type, bool lazy) {
+  // components are usually added in order, so check the end of the table first
+  if (this->val.empty() || this->val.back().name < name) {
+    this->val.emplace_back(name, component, type, lazy);
+    return;
+  }
+  auto it = lower_bound(this->val.begin(), this->val.end(), name,
+                        componentNameLess<Component>);
+  if (it != this->val.end() && it->name == name) {
+    delete it->object;
+    it->object = component;
+    it->type = type;
+    it->lazy = lazy;
+  } else {
+    this->val.emplace(it, name, component, type, lazy);
+  }
+}
+
 /*!
  * Set component by name.
  *
@@ -82,9 +249,7 @@ OpenABEContainer::~OpenABEContainer() {
  */
 
 void OpenABEContainer::setComponent(const string &name, const ZObject *component) {
-  ZObject *copy = component->clone();
-
-  this->val[name] = copy;
+  this->adoptComponent(name, component->clone());
 }
 
 /*!
@@ -95,20 +260,55 @@ void OpenABEContainer::setComponent(const string &name, const ZObject *component
  */
 
 ZObject *OpenABEContainer::getComponent(const string &name) {
-  ZObject *result = this->val[name];
+  auto it = this->findComponent(name);
+  if (it == this->val.end() || it->object == nullptr) {
+    cerr << "OpenABEContainer::getComponent: missing '" << name << "'" << endl;
+    return nullptr;
+  }
 
-  if (result == nullptr) {
+  return this->resolveComponent(*it);
+}
+
+/*!
+ * Obtain a ZP, G1, G2 or GT component: the type tag recorded when the
+ * component was stored replaces a dynamic_cast on every access.
+ *
+ * @param Name of the component
+ * @param Expected element type (OpenABE_ELEMENT_*)
+ * @return The component, or nullptr if it is missing or of another type
+ */
+
+ZObject *OpenABEContainer::getElement(const string &name, uint8_t type) {
+  auto it = this->findComponent(name);
+  if (it == this->val.end() || it->object == nullptr) {
     cerr << "OpenABEContainer::getComponent: missing '" << name << "'" << endl;
     return nullptr;
   }
+  if (it->type != type) {
+    return nullptr;
+  }
+  return this->resolveComponent(*it);
+}
 
-  return result;
+/*!
+ * Return the decoded form of a stored component.
+ *
+ * @param The stored component
+ * @return The component, decoded if it was loaded lazily
+ */
+
+ZObject *OpenABEContainer::resolveComponent(const Component &component) const {
+  if (component.lazy) {
+    return static_cast<OpenABELazyComponent *>(component.object)->get();
+  }
+  return component.object;
 }
 
 OpenABE_ERROR
 OpenABEContainer::deleteComponent(const string name) {
-  map<string, ZObject *>::iterator iter1 = this->val.find(name);
+  auto iter1 = this->findComponent(name);
   if (iter1 != this->val.end()) {
+    delete iter1->object;
     this->val.erase(iter1);
     return OpenABE_NOERROR;
   }
@@ -123,24 +323,258 @@ OpenABEContainer::deleteComponent(const string name) {
 
 uint32_t OpenABEContainer::numComponents() { return this->val.size(); }
 
+/*!
+ * Compare a single component against an expected value without
+ * inserting a placeholder when the component is missing.
+ *
+ * @param[in]   the name of the component.
+ * @param[in]   the expected value.
+ * @return  true if the component exists and is equal to the expected value.
+ */
+
+bool OpenABEContainer::matchComponent(const string &name, const ZObject *expected) const {
+  auto it = this->findComponent(name);
+  if (it == this->val.end() || it->object == nullptr || expected == nullptr) {
+    return false;
+  }
+  return it->object->isEqual(const_cast<ZObject *>(expected));
+}
+
+/*!
+ * Check whether a component is present without reporting it as missing.
+ *
+ * @param[in]   the name of the component.
+ * @return  true if the component exists.
+ */
+
+bool OpenABEContainer::hasComponent(const string &name) const {
+  auto it = this->findComponent(name);
+  return (it != this->val.end() && it->object != nullptr);
+}
+
 OpenABE_ERROR OpenABEContainer::zeroize() {
   return OpenABE_ERROR_NOT_IMPLEMENTED;
 }
 
 /*!
- * Serialize the entire object.
+ * Return a stored component (decoded if it was loaded lazily), or nullptr.
+ */
+
+const ZObject *OpenABEContainer::lookupComponent(const string &name) const {
+  auto it = this->findComponent(name);
+  return it != this->val.end() ? this->resolveComponent(*it) : nullptr;
+}
+
+/*!
+ * The labels a schema derives from the components already present: for
+ * ciphertexts, everything but the policy (or attribute list) they are
+ * derived from. These must match the labels the scheme's encrypt uses.
+ *
+ * @param[in]   the schema
+ * @param[out]  the derived labels, in positional order
+ * @return      false if the schema is unknown or its inputs are missing
+ */
+
+bool OpenABEContainer::deriveSchemaLabels(uint8_t schema, vector<string> &labels) const {
+  labels.clear();
+  if (schema == OpenABE_SCHEMA_CP_WATERS_CT || schema == OpenABE_SCHEMA_CP_FAME_CT ||
+      schema == OpenABE_SCHEMA_CP_WATERS_HASHED_CT ||
+      schema == OpenABE_SCHEMA_CP_FAME_HASHED_CT ||
+      schema == OpenABE_SCHEMA_CP_WATERS_FD_CT ||
+      schema == OpenABE_SCHEMA_CP_WATERS_FD_HASHED_CT) {
+    const bool hashed = (schema == OpenABE_SCHEMA_CP_WATERS_HASHED_CT ||
+                         schema == OpenABE_SCHEMA_CP_FAME_HASHED_CT ||
+                         schema == OpenABE_SCHEMA_CP_WATERS_FD_HASHED_CT);
+    const OpenABEByteString *pol = dynamic_cast<const OpenABEByteString *>(
+        this->lookupComponent(hashed ? "policyHash" : "policy"));
+    if (pol == nullptr) {
+      return false;
+    }
+    // a digest only resolves through the policy dictionary
+    unique_ptr<OpenABEPolicy> policy = hashed ?
+        oabe::createPolicyTreeFromDigest(*pol) :
+        oabe::createPolicyTree(const_cast<OpenABEByteString *>(pol)->toString());
+    if (policy == nullptr) {
+      return false;
+    }
+    shared_ptr<const OpenABELSSSCompiledPolicy> compiled =
+        OpenABELSSSCompiledPolicy::forPolicy(policy.get());
+    if (schema == OpenABE_SCHEMA_CP_FAME_CT || schema == OpenABE_SCHEMA_CP_FAME_HASHED_CT) {
+      labels.push_back("C01");
+      labels.push_back("C02");
+      for (size_t i = 0; i < compiled->numRows(); i++) {
+        const string &attr_key = compiled->rowKey(i);
+        labels.push_back(OpenABEMakeElementLabel("C1", attr_key));
+        labels.push_back(OpenABEMakeElementLabel("C2", attr_key));
+      }
+      return true;
+    }
+    if (schema == OpenABE_SCHEMA_CP_WATERS_FD_CT ||
+        schema == OpenABE_SCHEMA_CP_WATERS_FD_HASHED_CT) {
+      labels.push_back("Cprime");
+      labels.push_back("D");
+      for (size_t i = 0; i < compiled->numRows(); i++) {
+        labels.push_back(OpenABEMakeElementLabel("C", compiled->rowKey(i)));
+      }
+      return true;
+    }
+    labels.push_back("Cprime");
+    for (size_t i = 0; i < compiled->numRows(); i++) {
+      const string &attr_key = compiled->rowKey(i);
+      labels.push_back(OpenABEMakeElementLabel("C", attr_key));
+      labels.push_back(OpenABEMakeElementLabel("D", attr_key));
+    }
+    return true;
+  } else if (schema == OpenABE_SCHEMA_KP_GPSW_CT) {
+    const OpenABEAttributeList *attrList =
+        dynamic_cast<const OpenABEAttributeList *>(this->lookupComponent("attributes"));
+    if (attrList == nullptr) {
+      return false;
+    }
+    labels.push_back("Cpr2");
+    const vector<string> *attrStrings = attrList->getAttributeList();
+    for (auto it = attrStrings->begin(); it != attrStrings->end(); ++it) {
+      labels.push_back(OpenABEMakeElementLabel("C", OpenABEHashKey(*it)));
+    }
+    return true;
+  }
+  return false;
+}
+
+// the component a schema's other labels are derived from
+static const char *schemaSeedLabel(uint8_t schema) {
+  if (schema == OpenABE_SCHEMA_CP_WATERS_CT || schema == OpenABE_SCHEMA_CP_FAME_CT ||
+      schema == OpenABE_SCHEMA_CP_WATERS_FD_CT) {
+    return "policy";
+  } else if (schema == OpenABE_SCHEMA_CP_WATERS_HASHED_CT ||
+             schema == OpenABE_SCHEMA_CP_FAME_HASHED_CT ||
+             schema == OpenABE_SCHEMA_CP_WATERS_FD_HASHED_CT) {
+    return "policyHash";
+  } else if (schema == OpenABE_SCHEMA_KP_GPSW_CT) {
+    return "attributes";
+  }
+  return nullptr;
+}
+
+/*!
+ * The labels to write positionally: the schema's seed component followed by
+ * the labels derived from it. Fails (and the container is written with
+ * labels) unless every derived label is present and distinct.
+ */
+
+bool OpenABEContainer::positionalLabels(vector<string> &labels) const {
+  const char *seed = schemaSeedLabel(this->schema_);
+  vector<string> derived;
+  if (seed == nullptr || this->lookupComponent(seed) == nullptr ||
+      !this->deriveSchemaLabels(this->schema_, derived)) {
+    return false;
+  }
+  labels.assign(1, seed);
+  labels.insert(labels.end(), derived.begin(), derived.end());
+  vector<string> sorted(labels);
+  sort(sorted.begin(), sorted.end());
+  if (adjacent_find(sorted.begin(), sorted.end()) != sorted.end()) {
+    return false;
+  }
+  for (auto &label : derived) {
+    if (this->findComponent(label) == this->val.end()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void OpenABEContainer::serializeComponent(const Component &component,
+                                          OpenABEByteSink &sink, bool compact) const {
+  size_t mark = sink.beginPacked();
+  if (compact && component.type == OpenABE_ELEMENT_GT) {
+    static_cast<const GT *>(this->resolveComponent(component))->serializeCompactTo(sink);
+  } else if (component.lazy && component.type == OpenABE_ELEMENT_GT) {
+    // a lazy GT element may still hold the compact encoding it was read in
+    this->resolveComponent(component)->serializeTo(sink);
+  } else {
+    component.object->serializeTo(sink);
+  }
+  sink.endPacked(mark);
+}
+
+/*!
+ * Points from exp and *= are left in Jacobian coordinates, and each one
+ * would be inverted on its own when it is written. The G1 and the G2
+ * components are normalized here first, with one inversion per group.
+ * Lazy components are still encoded (or were decoded affine) and are
+ * skipped.
+ */
+void OpenABEContainer::normalizePoints() const {
+  vector<G1 *> g1;
+  vector<G2 *> g2;
+  for (auto &component : this->val) {
+    if (component.lazy || component.object == nullptr) {
+      continue;
+    }
+    if (component.type == OpenABE_ELEMENT_G1) {
+      g1.push_back(static_cast<G1 *>(component.object));
+    } else if (component.type == OpenABE_ELEMENT_G2) {
+      g2.push_back(static_cast<G2 *>(component.object));
+    }
+  }
+  if (g1.size() > 1) {
+    G1::normalizeAll(g1.data(), g1.size());
+  }
+  if (g2.size() > 1) {
+    G2::normalizeAll(g2.data(), g2.size());
+  }
+}
+
+/*!
+ * Serialize the entire object. With compact encoding and a schema, the
+ * schema's components come first, without labels:
+ * POSITIONAL || version || schema || smartPack(smartPack(value)...), then
+ * the remaining components as (label, value) pairs.
  *
  * @return Byte vector containing the result
  */
 void OpenABEContainer::serialize(OpenABEByteString &result) const {
-  OpenABEByteString res, key, bytes;
-  std::map<std::string, ZObject *>::const_iterator it;
-  std::stringstream ss;
-  for (it = this->val.begin(); it != this->val.end(); ++it) {
-    it->second->serialize(bytes);
-    key = it->first;
-    result.smartPack(key);
-    result.smartPack(bytes);
+  OpenABEByteSink sink(result);
+  this->serializeTo(sink);
+}
+
+/*!
+ * Append the serialized form (see serialize) to a sink, writing each
+ * element and its length header in place.
+ */
+void OpenABEContainer::serializeTo(OpenABEByteSink &sink) const {
+  this->serializeTo(sink, this->compactEncoding_);
+}
+
+/*!
+ * Append the serialized form in the given encoding: compact (positional
+ * components and compact GT elements) or full. The container's own
+ * setting is left alone, so concurrent readers still see the same
+ * encoding.
+ */
+void OpenABEContainer::serializeTo(OpenABEByteSink &sink, bool compact) const {
+  this->normalizePoints();
+  vector<string> positional;
+  if (compact && this->positionalLabels(positional)) {
+    sink.push_back(OpenABE_CONTAINER_POSITIONAL);
+    sink.push_back(OpenABE_CONTAINER_POSITIONAL_VERSION);
+    sink.push_back(this->schema_);
+    size_t body = sink.beginPacked();
+    for (auto &label : positional) {
+      this->serializeComponent(*this->findComponent(label), sink, compact);
+    }
+    sink.endPacked(body);
+    sort(positional.begin(), positional.end());
+  }
+  for (auto it = this->val.begin(); it != this->val.end(); ++it) {
+    if (binary_search(positional.begin(), positional.end(), it->name)) {
+      continue;
+    }
+    size_t mark = sink.beginPacked();
+    sink.append((const uint8_t *)it->name.data(), it->name.size());
+    sink.endPacked(mark);
+    this->serializeComponent(*it, sink, compact);
   }
 }
 
@@ -154,7 +588,7 @@ void OpenABEContainer::deserializeElement(std::string key, OpenABEByteString &va
   if (type == OpenABE_ELEMENT_INT) {
     unique_ptr<OpenABEUInteger> i(new OpenABEUInteger(0));
     i->deserialize(value);
-    this->setComponent(key, i.get());
+    this->adoptComponent(key, i.release());
   } else if (type >= OpenABE_ELEMENT_ZP && type <= OpenABE_ELEMENT_GT) {
     if (this->group == nullptr) {
       fprintf(stderr, "%s:%s:%d: group is null\n", __FILE__, __FUNCTION__, __LINE__);
@@ -165,28 +599,20 @@ void OpenABEContainer::deserializeElement(std::string key, OpenABEByteString &va
       fprintf(stderr, "%s:%s:%d: cast to BPGroup failed\n", __FILE__, __FUNCTION__, __LINE__);
       return;
     }
-    if (type == OpenABE_ELEMENT_ZP) {
+    if (this->lazyDecode_ && type != OpenABE_ELEMENT_ZP) {
+      this->adoptComponent(key, new OpenABELazyComponent(bp, type, value), type, true);
+    } else if (type == OpenABE_ELEMENT_ZP) {
       unique_ptr<ZP> s(new ZP);
       s->setOrder(bp->order);
       s->deserialize(value);
-      this->setComponent(key, s.get());
-    } else if (type == OpenABE_ELEMENT_G1) {
-      unique_ptr<G1> g(new G1(bp));
-      g->deserialize(value);
-      this->setComponent(key, g.get());
-    } else if (type == OpenABE_ELEMENT_G2) {
-      unique_ptr<G2> g(new G2(bp));
-      g->deserialize(value);
-      this->setComponent(key, g.get());
+      this->adoptComponent(key, s.release(), type);
     } else {
-      unique_ptr<GT> g(new GT(bp));
-      g->deserialize(value);
-      this->setComponent(key, g.get());
+      this->adoptComponent(key, decodeGroupElement(bp, type, value), type);
     }
   } else if (type == OpenABE_ELEMENT_BYTESTRING) {
     unique_ptr<OpenABEByteString> b(new OpenABEByteString);
     b->deserialize(value);
-    this->setComponent(key, b.get());
+    this->adoptComponent(key, b.release());
   } else if (type == OpenABE_ELEMENT_POLICY) {
     const string b = value.toString();
     unique_ptr<OpenABEPolicy> p = oabe::createPolicyTree(b);
@@ -194,7 +620,7 @@ void OpenABEContainer::deserializeElement(std::string key, OpenABEByteString &va
       fprintf(stderr, "deserializeElement: invalid policy tree\n");
       return;
     }
-    this->setComponent(key, p.get());
+    this->adoptComponent(key, p.release());
   } else if (type == OpenABE_ELEMENT_ATTRIBUTES) {
     const string b = value.toString();
     unique_ptr<OpenABEAttributeList> a = oabe::createAttributeList(b);
@@ -202,7 +628,7 @@ void OpenABEContainer::deserializeElement(std::string key, OpenABEByteString &va
       fprintf(stderr, "deserializeElement: invalid attribute list\n");
       return;
     }
-    this->setComponent(key, a.get());
+    this->adoptComponent(key, a.release());
   } else if (type == OpenABE_ELEMENT_ZP_t || type == OpenABE_ELEMENT_G_t) {
     if (this->group == nullptr) {
       fprintf(stderr, "%s:%s:%d: group is null\n", __FILE__, __FUNCTION__, __LINE__);
@@ -218,11 +644,11 @@ void OpenABEContainer::deserializeElement(std::string key, OpenABEByteString &va
       unique_ptr<ZP_t> s(new ZP_t);
       s->setOrder(ec->order);
       s->deserialize(value);
-      this->setComponent(key, s.get());
+      this->adoptComponent(key, s.release());
     } else {
       unique_ptr<G_t> g(new G_t(ec));
       g->deserialize(value);
-      this->setComponent(key, g.get());
+      this->adoptComponent(key, g.release());
     }
   } else { 
     cout << "Invalid Input type: " << type << endl;
@@ -237,64 +663,216 @@ void OpenABEContainer::deserialize(OpenABEByteString &blob) {
   result = blob;
   size_t index = 0;
 
-  do {
-    key = result.smartUnpack(&index);
-    value = result.smartUnpack(&index);
-    this->deserializeElement(key.toString(), value);
-  } while (index < result.size());
+  vector<string> keys;
+  vector<OpenABEByteString> values;
+  if (result.size() > 0 && result.at(0) == OpenABE_CONTAINER_POSITIONAL) {
+    if (result.size() < 3 || result.at(1) != OpenABE_CONTAINER_POSITIONAL_VERSION) {
+      fprintf(stderr, "deserialize: unsupported positional container version\n");
+      throw OpenABE_ERROR_SERIALIZATION_FAILED;
+    }
+    uint8_t schema = result.at(2);
+    const char *seed = schemaSeedLabel(schema);
+    index = 3;
+    OpenABEByteString body = result.smartUnpack(&index);
+    size_t bodyIndex = 0;
+    while (bodyIndex < body.size()) {
+      values.push_back(body.smartUnpack(&bodyIndex));
+    }
+    if (seed == nullptr || values.empty()) {
+      throw OpenABE_ERROR_SERIALIZATION_FAILED;
+    }
+    // the seed component first, then the labels derived from it
+    this->deserializeElement(seed, values[0]);
+    values.erase(values.begin());
+    if (!this->deriveSchemaLabels(schema, keys) || keys.size() != values.size()) {
+      throw OpenABE_ERROR_SERIALIZATION_FAILED;
+    }
+    this->schema_ = schema;
+    this->compactEncoding_ = true;
+    while (index < result.size()) {
+      key = result.smartUnpack(&index);
+      value = result.smartUnpack(&index);
+      keys.push_back(key.toString());
+      values.push_back(value);
+    }
+  } else {
+    do {
+      key = result.smartUnpack(&index);
+      value = result.smartUnpack(&index);
+      keys.push_back(key.toString());
+      values.push_back(value);
+    } while (index < result.size());
+  }
+  this->deserializeElements(keys, values);
+
+  std::lock_guard<std::mutex> lock(this->lineTablesLock_);
+  this->lineTables_.clear();
   return;
 }
 
+void OpenABEContainer::deserializeElements(vector<string> &keys,
+                                           vector<OpenABEByteString> &values) {
+  // Point decompression and subgroup checks dominate loading keys and
+  // ciphertexts, and each element is independent: when there are enough of
+  // them, decode all the G1/G2/GT elements across the thread pool first and
+  // adopt them in their serialized order afterwards.
+  vector<size_t> points;
+  std::shared_ptr<BPGroup> bp = dynamic_pointer_cast<BPGroup>(this->group);
+  if (!this->lazyDecode_ && bp != nullptr) {
+    for (size_t i = 0; i < values.size(); i++) {
+      if (values[i].size() > 0 && values[i].at(0) >= OpenABE_ELEMENT_G1 &&
+          values[i].at(0) <= OpenABE_ELEMENT_GT) {
+        points.push_back(i);
+      }
+    }
+  }
+  vector<unique_ptr<ZObject>> decoded(values.size());
+  if (points.size() >= OpenABE_PARALLEL_DECODE_MIN) {
+    OpenABEThreadPool::getDefault()->parallelFor(points.size(), [&](size_t j) {
+      size_t i = points[j];
+      decoded[i].reset(decodeGroupElement(bp, values[i].at(0), values[i]));
+    });
+  }
+
+  for (size_t i = 0; i < values.size(); i++) {
+    if (decoded[i] != nullptr) {
+      this->adoptComponent(keys[i], decoded[i].release(), values[i].at(0));
+    } else {
+      this->deserializeElement(keys[i], values[i]);
+    }
+  }
+}
+
 void OpenABEContainer::deserialize(string &blob) {
   OpenABEByteString result;
   result = blob;
   return this->deserialize(result);
 }
 
+/*!
+ * Return the precomputed Miller-loop lines for a G2 component, building
+ * them on the first call. Tables stay with the container, so every later
+ * pairing against that component is cheaper; a table is rebuilt if the
+ * component has been replaced since.
+ *
+ * @param[in]   the name of the G2 component.
+ * @return      the line table, or nullptr if there is no such component.
+ */
+shared_ptr<const G2LineTable> OpenABEContainer::getG2LineTable(const string &name) {
+  G2 *q = this->getG2(name);
+  if (q == nullptr) {
+    return nullptr;
+  }
+
+  OpenABEPrecomputeManager *store = OpenABEPrecomputeManager::getDefault();
+  shared_ptr<const G2LineTable> table;
+  {
+    std::lock_guard<std::mutex> lock(this->lineTablesLock_);
+    auto it = this->lineTables_.find(name);
+    if (it != this->lineTables_.end() && it->second.table->getElement() == *q) {
+      it->second.ticket->touch();
+      return it->second.table;
+    }
+    if (!this->lineTablesOwner_) {
+      this->lineTablesOwner_ = make_shared<OpenABEPrecomputeOwner>(
+          [this](const string &key, const OpenABEPrecomputeTicket *ticket) {
+            this->evictG2LineTable(key, ticket);
+          });
+    }
+    table = make_shared<const G2LineTable>(*q, this->attached_);
+    LineTableEntry &entry = this->lineTables_[name];
+    entry.table = table;
+    entry.ticket = store->track(this->lineTablesOwner_, name, table->getMemoryUsage());
+  }
+  // the new table may push the store over its budget
+  store->enforceBudget();
+  return table;
+}
+
+/*!
+ * Called back by the precomputation store to evict a line table.
+ *
+ * @param[in]   the name of the G2 component.
+ * @param[in]   the ticket of the table to drop.
+ */
+void OpenABEContainer::evictG2LineTable(const string &name,
+                                        const OpenABEPrecomputeTicket *ticket) {
+  std::lock_guard<std::mutex> lock(this->lineTablesLock_);
+  auto it = this->lineTables_.find(name);
+  if (it != this->lineTables_.end() && it->second.ticket.get() == ticket) {
+    this->lineTables_.erase(it);
+  }
+}
+
+/*!
+ * Return the line table of a G2 component only if it has already been
+ * built (by getG2LineTable or precomputeG2LineTables).
+ *
+ * @param[in]   the name of the G2 component.
+ * @return      the line table, or nullptr.
+ */
+shared_ptr<const G2LineTable> OpenABEContainer::findG2LineTable(const string &name) {
+  {
+    std::lock_guard<std::mutex> lock(this->lineTablesLock_);
+    if (this->lineTables_.count(name) == 0) {
+      return nullptr;
+    }
+  }
+  return this->getG2LineTable(name);
+}
+
+/*!
+ * Build the line tables of every G2 component, e.g. to prepare a
+ * ciphertext that is about to be decrypted with many different keys.
+ */
+void OpenABEContainer::precomputeG2LineTables() {
+  for (const string &name : this->getKeys()) {
+    this->getG2LineTable(name);
+  }
+}
+
+void OpenABEContainer::addToSnapshot(OpenABEFixedBaseSnapshot &snapshot) {
+  std::lock_guard<std::mutex> lock(this->lineTablesLock_);
+  for (auto &it : this->lineTables_) {
+    snapshot.add(it.second.table);
+  }
+}
+
 std::vector<std::string> OpenABEContainer::getKeys() {
   std::vector<std::string> keyList;
-  std::map<std::string, ZObject *>::iterator iter;
-  for (iter = this->val.begin(); iter != this->val.end(); iter++) {
-    keyList.push_back(iter->first);
+  keyList.reserve(this->val.size());
+  for (auto &component : this->val) {
+    keyList.push_back(component.name);
   }
 
   return keyList;
 }
 
 bool operator==(const OpenABEContainer &c1, const OpenABEContainer &c2) {
-  // check that the 'keys' of the containers are equal
-  std::vector<std::string> keyList1 = const_cast<OpenABEContainer &>(c1).getKeys();
-  std::vector<std::string> keyList2 = const_cast<OpenABEContainer &>(c2).getKeys();
-
-  // First check: containers must have the same number of keys
-  if (keyList1.size() != keyList2.size()) {
-    return false;
-  }
-
-  std::vector<std::string> keyList3(keyList1.size() + keyList2.size());
-  std::vector<std::string>::iterator iter =
-      std::set_difference(keyList1.begin(), keyList1.end(), keyList2.begin(),
-                          keyList2.end(), keyList3.begin());
-  // Fix: Calculate the number of different keys using distance, not iter->size()
-  size_t keydiff = std::distance(keyList3.begin(), iter);
-  if (keydiff > 0) {
+  // containers must have the same number of components
+  if (c1.val.size() != c2.val.size()) {
     return false;
   }
 
-  // check that 'values' of container are equal
-  for (std::vector<std::string>::iterator it = keyList1.begin();
-       it != keyList1.end(); ++it) {
-    ZObject *lhs = const_cast<OpenABEContainer &>(c1).getComponent(*it);
-    ZObject *rhs = const_cast<OpenABEContainer &>(c2).getComponent(*it);
-    if (lhs->isEqual(rhs)) {
+  // both tables are ordered by name, so walk them side by side and stop at
+  // the first differing name or value. Group elements are compared in
+  // their native representation by their isEqual() methods.
+  auto it1 = c1.val.begin();
+  auto it2 = c2.val.begin();
+  for (; it1 != c1.val.end(); ++it1, ++it2) {
+    if (it1->name != it2->name) {
+      return false;
+    }
+    if (it1->object == nullptr || it2->object == nullptr) {
+      if (it1->object != it2->object) {
+        return false;
+      }
       continue;
-    } else {
-      keydiff++;
+    }
+    if (!it1->object->isEqual(c2.resolveComponent(*it2))) {
+      return false;
     }
   }
-
-  if (keydiff > 0)
-    return false;
   return true;
 }
 }
@@ -0,0 +1,169 @@
+///
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+///
+/// This file is part of Zeutro's OpenABE.
+///
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+///
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+///
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+/// \file   zcpu.cpp
+///
+/// \brief  CPUID/HWCAP probing for the CPU feature query API.
+///
+/// \author J. Ayo Akinyele
+///
+
+#include <stdint.h>
+#include <string.h>
+#include <sstream>
+#include <openabe/utils/zcpu.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#elif defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+using namespace std;
+
+namespace oabe {
+
+#if defined(__x86_64__) || defined(__i386__)
+static uint64_t readXcr0() {
+  uint32_t eax, edx;
+  __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return ((uint64_t)edx << 32) | eax;
+}
+
+static void detectX86(OpenABECpuFeatures &f) {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    return;
+  }
+  f.pclmul = (ecx & (1u << 1)) != 0;
+  f.aesni = (ecx & (1u << 25)) != 0;
+  // AVX and AVX-512 also need the OS to save the wider registers
+  bool osxsave = (ecx & (1u << 27)) != 0;
+  uint64_t xcr0 = osxsave ? readXcr0() : 0;
+  bool avxState = (xcr0 & 0x6) == 0x6;
+  bool avx512State = avxState && (xcr0 & 0xe0) == 0xe0;
+
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+    return;
+  }
+  f.avx2 = avxState && (ebx & (1u << 5)) != 0;
+  f.bmi2 = (ebx & (1u << 8)) != 0;
+  f.avx512f = avx512State && (ebx & (1u << 16)) != 0;
+  f.adx = (ebx & (1u << 19)) != 0;
+  f.avx512ifma = f.avx512f && (ebx & (1u << 21)) != 0;
+  f.sha = (ebx & (1u << 29)) != 0;
+  f.vaes = avxState && (ecx & (1u << 9)) != 0;
+  f.vpclmulqdq = avxState && (ecx & (1u << 10)) != 0;
+}
+#endif
+
+static OpenABECpuFeatures detect() {
+  OpenABECpuFeatures f;
+  memset(&f, 0, sizeof(f));
+#if defined(__x86_64__) || defined(__i386__)
+  detectX86(f);
+#elif defined(__aarch64__) && defined(__linux__)
+  unsigned long hwcap = getauxval(AT_HWCAP);
+  f.neon = (hwcap & HWCAP_ASIMD) != 0;
+  f.armAes = (hwcap & HWCAP_AES) != 0;
+  f.armPmull = (hwcap & HWCAP_PMULL) != 0;
+  f.armSha2 = (hwcap & HWCAP_SHA2) != 0;
+#elif defined(__aarch64__) && defined(__APPLE__)
+  // every Apple AArch64 core has the crypto extensions
+  f.neon = f.armAes = f.armPmull = f.armSha2 = true;
+#endif
+  return f;
+}
+
+const OpenABECpuFeatures& OpenABE_getCpuFeatures() {
+  static const OpenABECpuFeatures features = detect();
+  return features;
+}
+
+string OpenABE_getCpuFeatureString() {
+  const OpenABECpuFeatures &f = OpenABE_getCpuFeatures();
+  const pair<bool, const char*> names[] = {
+    {f.bmi2, "bmi2"}, {f.adx, "adx"}, {f.avx2, "avx2"}, {f.avx512f, "avx512f"},
+    {f.avx512ifma, "avx512ifma"}, {f.aesni, "aesni"}, {f.pclmul, "pclmul"},
+    {f.vaes, "vaes"}, {f.vpclmulqdq, "vpclmulqdq"}, {f.sha, "sha"},
+    {f.neon, "neon"}, {f.armAes, "aes"}, {f.armPmull, "pmull"}, {f.armSha2, "sha2"}
+  };
+  string s;
+  for (const pair<bool, const char*> &name : names) {
+    if (name.first) {
+      s += (s.empty() ? "" : " ") + string(name.second);
+    }
+  }
+  return s;
+}
+
+vector<pair<string, string>> OpenABE_getActiveCodePaths() {
+  const OpenABECpuFeatures &f = OpenABE_getCpuFeatures();
+  vector<pair<string, string>> paths;
+#if defined(__x86_64__)
+  // MCL's JIT (its default on x86-64) emits mulx/adcx/adox when available
+  paths.push_back(make_pair("mcl.field", (f.bmi2 && f.adx) ? "jit-mulx-adx" : "jit"));
+  paths.push_back(make_pair("mcl.g1_mulvec", f.avx512ifma ? "avx512ifma" : "generic"));
+#elif defined(__aarch64__)
+  paths.push_back(make_pair("mcl.field", "aarch64-asm"));
+  paths.push_back(make_pair("mcl.g1_mulvec", "generic"));
+#else
+  paths.push_back(make_pair("mcl.field", "generic"));
+  paths.push_back(make_pair("mcl.g1_mulvec", "generic"));
+#endif
+
+  string sha = "generic", aes = "generic";
+  if (f.sha) {
+    sha = "sha-ni";
+  } else if (f.avx2) {
+    sha = "avx2";
+  } else if (f.armSha2) {
+    sha = "armv8-sha2";
+  } else if (f.neon) {
+    sha = "neon";
+  }
+  if (f.vaes && f.vpclmulqdq && f.avx512f) {
+    aes = "vaes-avx512";
+  } else if (f.aesni && f.pclmul) {
+    aes = "aesni-pclmul";
+  } else if (f.armAes && f.armPmull) {
+    aes = "armv8-aes-pmull";
+  }
+  paths.push_back(make_pair("openssl.sha256", sha));
+  paths.push_back(make_pair("openssl.aes_gcm", aes));
+  return paths;
+}
+
+string OpenABE_describeCodePaths() {
+  stringstream ss;
+  for (const pair<string, string> &path : OpenABE_getActiveCodePaths()) {
+    ss << path.first << ": " << path.second << endl;
+  }
+  return ss.str();
+}
+
+}
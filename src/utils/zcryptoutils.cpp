@@ -39,6 +39,7 @@
 #include <fstream>
 #include <string>
 #include <memory>
+#include <functional>
 #include <openabe/openabe.h>
 #include <openabe/zsymcrypto.h>
 
@@ -49,27 +50,160 @@ using namespace std;
  ********************************************************************************/
 namespace oabe {
 
+#if defined(BP_WITH_MCL)
+// Native MCL encoding of a GT element, written into a caller buffer so the
+// KDF can feed it to the hash context without staging it in a byte string.
+static size_t OpenABEGTNativeBytes(GT &input, uint8_t *buf, size_t len) {
+  size_t n = mclBnGT_serialize(buf, len, &input.m_GT);
+  if (n == 0) {
+    THROW_ERROR(OpenABE_ERROR_SERIALIZATION_FAILED);
+  }
+  return n;
+}
+
+static void OpenABEDigestUpdate(EVP_MD_CTX *ctx, const void *buf, size_t len) {
+  if (!EVP_DigestUpdate(ctx, buf, len)) {
+    THROW_ERROR(OpenABE_ERROR_INVALID_INPUT);
+  }
+}
+
+static void OpenABEDigestUpdate(EVP_MD_CTX *ctx, uint32_t value) {
+  string s = to_string(value);
+  OpenABEDigestUpdate(ctx, s.c_str(), s.size());
+}
+
+// The v1 KDF appends decimal(offset) || serialize(GT) ||
+// decimal(|serialize(GT)|) to a running transcript for each 32-byte block
+// and hashes the whole transcript so far. The transcript is absorbed
+// incrementally here, from the native encoding plus the element header
+// (type byte and smartPack length), without materializing serialize(GT).
+static void OpenABEHashGTv1(EVP_MD_CTX *ctx, GT &input, uint32_t keyLen,
+                            OpenABEByteString &result) {
+  OpenABESecureVector<uint8_t> buf(MAX_BUFFER_SIZE);
+  size_t len = OpenABEGTNativeBytes(input, buf.data(), buf.size());
+  uint8_t hdr[2 + sizeof(uint32_t)];
+  size_t hdrLen = 0;
+  hdr[hdrLen++] = OpenABE_ELEMENT_GT;
+  if (len > UINT16_MAX) {
+    hdr[hdrLen++] = PACK_32;
+    hdr[hdrLen++] = (len >> 24) & 0xFF;
+    hdr[hdrLen++] = (len >> 16) & 0xFF;
+    hdr[hdrLen++] = (len >> 8) & 0xFF;
+  } else if (len > UINT8_MAX) {
+    hdr[hdrLen++] = PACK_16;
+    hdr[hdrLen++] = (len >> 8) & 0xFF;
+  } else {
+    hdr[hdrLen++] = PACK_8;
+  }
+  hdr[hdrLen++] = len & 0xFF;
+
+  EVP_MD_CTX *block = EVP_MD_CTX_new();
+  if (block == NULL) {
+    THROW_ERROR(OpenABE_ERROR_OUT_OF_MEMORY);
+  }
+  try {
+    if (!EVP_DigestInit_ex(ctx, EVP_sha256(), NULL)) {
+      THROW_ERROR(OpenABE_ERROR_INVALID_INPUT);
+    }
+    OpenABESecureVector<uint8_t> digest(SHA256_LEN);
+    for (uint32_t numBytes = 0; numBytes < keyLen; numBytes += SHA256_LEN) {
+      OpenABEDigestUpdate(ctx, numBytes);
+      OpenABEDigestUpdate(ctx, hdr, hdrLen);
+      OpenABEDigestUpdate(ctx, buf.data(), len);
+      OpenABEDigestUpdate(ctx, (uint32_t)(hdrLen + len));
+      if (!EVP_MD_CTX_copy_ex(block, ctx)) {
+        THROW_ERROR(OpenABE_ERROR_INVALID_INPUT);
+      }
+      EVP_DigestFinal_ex(block, digest.data(), NULL);
+      result.appendArray(digest.data(), SHA256_LEN);
+    }
+  } catch (...) {
+    EVP_MD_CTX_free(block);
+    throw;
+  }
+  EVP_MD_CTX_free(block);
+}
+
+// The v2 KDF absorbs the native encoding once and derives each block as
+//   SHA-256(GT || be32(block index))
+// by copying the absorbed context, so long keys cost one pass over GT.
+static void OpenABEHashGTv2(EVP_MD_CTX *ctx, GT &input, uint32_t keyLen,
+                            OpenABEByteString &result) {
+  OpenABESecureVector<uint8_t> buf(MAX_BUFFER_SIZE);
+  size_t len = OpenABEGTNativeBytes(input, buf.data(), buf.size());
+  EVP_MD_CTX *block = EVP_MD_CTX_new();
+  if (block == NULL) {
+    THROW_ERROR(OpenABE_ERROR_OUT_OF_MEMORY);
+  }
+  try {
+    if (!EVP_DigestInit_ex(ctx, EVP_sha256(), NULL)) {
+      THROW_ERROR(OpenABE_ERROR_INVALID_INPUT);
+    }
+    OpenABEDigestUpdate(ctx, buf.data(), len);
+    OpenABESecureVector<uint8_t> digest(SHA256_LEN);
+    uint32_t i = 0;
+    for (uint32_t numBytes = 0; numBytes < keyLen; numBytes += SHA256_LEN, i++) {
+      uint8_t counter[4] = { (uint8_t)(i >> 24), (uint8_t)(i >> 16),
+                             (uint8_t)(i >> 8), (uint8_t)i };
+      if (!EVP_MD_CTX_copy_ex(block, ctx)) {
+        THROW_ERROR(OpenABE_ERROR_INVALID_INPUT);
+      }
+      OpenABEDigestUpdate(block, counter, sizeof(counter));
+      EVP_DigestFinal_ex(block, digest.data(), NULL);
+      result.appendArray(digest.data(), SHA256_LEN);
+    }
+  } catch (...) {
+    EVP_MD_CTX_free(block);
+    throw;
+  }
+  EVP_MD_CTX_free(block);
+}
+#endif
+
 /*!
- * Utility for hashing a group element into a string.
+ * Utility for hashing a group element into a string. The v1 KDF is the
+ * original construction (kept for existing ciphertexts); v2 hashes the
+ * native GT encoding with a big-endian block counter. Only SHA-256 is
+ * implemented, so hashType is currently ignored.
  *
  */
 
 bool OpenABEUtilsHashToString(GT &input, uint32_t keyLen, OpenABEByteString &result,
-                          OpenABEHashFunctionType hashType) {
+                          OpenABEHashFunctionType hashType, OpenABEGTKDFVersion kdfVersion) {
+  result.clear();
+#if defined(BP_WITH_MCL)
+  // the GT encoding and digests are staged in locked memory, wiped in one
+  // pass when the scope ends
+  OpenABESecureArenaScope secretScope(OpenABESecureArena::forThread());
+  EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+  if (ctx == NULL) {
+    return false;
+  }
+  bool ok = true;
+  try {
+    if (kdfVersion == OpenABE_GT_KDF_V2) {
+      OpenABEHashGTv2(ctx, input, keyLen, result);
+    } else {
+      OpenABEHashGTv1(ctx, input, keyLen, result);
+    }
+  } catch (OpenABE_ERROR &error) {
+    result.clear();
+    ok = false;
+  }
+  EVP_MD_CTX_free(ctx);
+  return ok;
+#else
+  if (kdfVersion != OpenABE_GT_KDF_V1) {
+    return false;
+  }
   stringstream concatResult;
   OpenABEByteString serializedResult;
   uint32_t numBytes = 0;
 
-  result.clear();
   input.disableCompression();
   input.serialize(serializedResult);
   input.enableCompression();
 
-  // DEBUG: Log GT serialization details
-  std::cerr << "[GT HASH DEBUG] GT serialization size: " << serializedResult.size() << " bytes" << std::endl;
-  std::cerr << "[GT HASH DEBUG] GT serialized hex (first 128 chars): " << serializedResult.toHex().substr(0, 128) << std::endl;
-  std::cerr << "[GT HASH DEBUG] Requesting keyLen: " << keyLen << " bytes" << std::endl;
-
   for (uint32_t i = 0; numBytes < keyLen; i++, numBytes += SHA256_LEN) {
     concatResult.clear();
     concatResult << numBytes << serializedResult << serializedResult.size();
@@ -77,18 +211,9 @@ bool OpenABEUtilsHashToString(GT &input, uint32_t keyLen, OpenABEByteString &res
     sha256(hash, (uint8_t *)(concatResult.str().c_str()),
            concatResult.str().size());
     result.appendArray((uint8_t *)hash.c_str(), SHA256_LEN);
-
-    // DEBUG: Log first hash iteration
-    if (i == 0) {
-      OpenABEByteString tmpHash;
-      tmpHash.appendArray((uint8_t *)hash.c_str(), SHA256_LEN);
-      std::cerr << "[GT HASH DEBUG] First SHA256 hash output: " << tmpHash.toHex() << std::endl;
-    }
   }
-
-  std::cerr << "[GT HASH DEBUG] Final derived key (hex): " << result.toHex() << std::endl;
-
   return true;
+#endif
 }
 
 string OpenABEHashKey(const string attr_key) {
@@ -220,38 +345,149 @@ bool checkPassword(const std::string &hash, const std::string &password) {
   return answer;
 }
 
+/*
+ * Password blobs start with a header that records the PBKDF2 cost:
+ *   magic (4) || iteration count (4, big-endian) || salt || iv || ct || tag
+ * The header is bound to the ciphertext as AAD. Blobs from older
+ * releases are just salt || iv || ct || tag at the default count.
+ */
+static const uint8_t passwordBlobMagic[] = { 'O', 'A', 'P', 'W' };
+#define PASSWORD_BLOB_HEADER_LEN  (sizeof(passwordBlobMagic) + sizeof(uint32_t) + SALT_LEN)
+
+static OpenABE_ERROR sealUnderPasswordKey(OpenABEByteString &salt, int iterationCount,
+                                          OpenABEByteString &key,
+                                          OpenABEByteString &inputBlob,
+                                          OpenABEByteString &encOutputBlob) {
+  OpenABEByteString header, output, iv, ct, tag;
+  header.appendArray((uint8_t *)passwordBlobMagic, sizeof(passwordBlobMagic));
+  header.pack32bits((uint32_t)iterationCount);
+  header += salt;
+
+  oabe::crypto::OpenABESymKeyAuthEnc authEnc(DEFAULT_AES_SEC_LEVEL, key);
+  authEnc.setAddAuthData(header);
+  OpenABE_ERROR result = authEnc.encrypt(inputBlob.toString(), &iv, &ct, &tag);
+  if (result != OpenABE_NOERROR) {
+    return result;
+  }
+  output.smartPack(iv);
+  output.smartPack(ct);
+  output.smartPack(tag);
+  // concatenate bytes into caller's encOutputBlob object
+  encOutputBlob += header;
+  encOutputBlob += output;
+  return OpenABE_NOERROR;
+}
+
+static bool openUnderPasswordKey(OpenABEByteString &key, OpenABEByteString *header,
+                                 OpenABEByteString &ctBlob,
+                                 OpenABEByteString &plainOutputBlob) {
+  OpenABEByteString iv, ct, tag;
+  string ptBlob;
+  // now parse sym ciphertext
+  size_t index = 0;
+  iv = ctBlob.smartUnpack(&index);
+  ct = ctBlob.smartUnpack(&index);
+  tag = ctBlob.smartUnpack(&index);
+
+  oabe::crypto::OpenABESymKeyAuthEnc authEnc(DEFAULT_AES_SEC_LEVEL, key);
+  if (header != nullptr) {
+    authEnc.setAddAuthData(*header);
+  }
+  if (!authEnc.decrypt(ptBlob, &iv, &ct, &tag)) {
+    return false;
+  }
+  plainOutputBlob = ptBlob;
+  return true;
+}
+
+/*!
+ * Opens a password blob in either format. deriveKey supplies the key for
+ * a (salt, iteration count) pair. A versioned header whose blob fails to
+ * open is retried as a legacy blob, whose random salt may happen to start
+ * with the magic bytes.
+ */
+static OpenABE_ERROR decryptPasswordBlob(
+    OpenABEByteString &inputCTBlob, OpenABEByteString &plainOutputBlob,
+    const std::function<void(OpenABEByteString &, int, OpenABEByteString &)> &deriveKey) {
+  OpenABE_ERROR result = OpenABE_ERROR_DECRYPTION_FAILED;
+  OpenABEByteString salt, key, ctBlob;
+
+  try {
+    if (inputCTBlob.size() > PASSWORD_BLOB_HEADER_LEN &&
+        memcmp(inputCTBlob.data(), passwordBlobMagic, sizeof(passwordBlobMagic)) == 0) {
+      const uint8_t *count = inputCTBlob.data() + sizeof(passwordBlobMagic);
+      const uint32_t iterationCount = ((uint32_t)count[0] << 24) | ((uint32_t)count[1] << 16) |
+                                      ((uint32_t)count[2] << 8) | (uint32_t)count[3];
+      const size_t index = sizeof(passwordBlobMagic) + sizeof(uint32_t);
+      // the same bounds encryptUnderPassword enforces: a forged header must not
+      // talk the caller into a cheap derivation
+      if (iterationCount >= OpenABE_KDF_MIN_ITERATION_COUNT &&
+          iterationCount <= OpenABE_KDF_MAX_ITERATION_COUNT) {
+        OpenABEByteString header = inputCTBlob.getSubset(0, PASSWORD_BLOB_HEADER_LEN);
+        salt = inputCTBlob.getSubset(index, SALT_LEN);
+        ctBlob = inputCTBlob.getSubset(PASSWORD_BLOB_HEADER_LEN,
+                                       inputCTBlob.size() - PASSWORD_BLOB_HEADER_LEN);
+        deriveKey(salt, (int)iterationCount, key);
+        if (key.size() > 0 && openUnderPasswordKey(key, &header, ctBlob, plainOutputBlob)) {
+          result = OpenABE_NOERROR;
+        }
+        key.zeroize();
+      }
+    }
+  } catch (OpenABE_ERROR &error) {
+    result = error;
+  }
+  if (result == OpenABE_NOERROR) {
+    return result;
+  }
+
+  result = OpenABE_NOERROR;
+  try {
+    // validate the input lengths
+    ASSERT(inputCTBlob.size() > SALT_LEN, OpenABE_ERROR_INVALID_INPUT);
+    // first recover the salt
+    salt = inputCTBlob.getSubset(0, SALT_LEN);
+    // then recover the ciphertext
+    ctBlob = inputCTBlob.getSubset(SALT_LEN, inputCTBlob.size() - SALT_LEN);
+    // derive the key (with default number of iterations)
+    deriveKey(salt, OpenABE_KDF_ITERATION_COUNT, key);
+    if (key.size() == 0 || !openUnderPasswordKey(key, nullptr, ctBlob, plainOutputBlob)) {
+      result = OpenABE_ERROR_DECRYPTION_FAILED;
+    }
+  } catch (OpenABE_ERROR &error) {
+    result = error;
+  }
+
+  key.zeroize();
+  salt.zeroize();
+  return result;
+}
+
 OpenABE_ERROR encryptUnderPassword(const std::string password,
                                OpenABEByteString &inputBlob,
-                               OpenABEByteString &encOutputBlob) {
+                               OpenABEByteString &encOutputBlob,
+                               int iterationCount) {
   OpenABE_ERROR result = OpenABE_NOERROR;
-  OpenABEByteString pword, salt, key, output, iv, ct, tag;
-  string inBlob, key_str;
-  unique_ptr<oabe::crypto::OpenABESymKeyAuthEnc> authEnc = nullptr;
+  OpenABEByteString pword, salt, key;
   OpenABERNG rng;
 
   try {
-    inBlob = inputBlob.toString();
+    ASSERT(iterationCount >= OpenABE_KDF_MIN_ITERATION_COUNT &&
+           iterationCount <= OpenABE_KDF_MAX_ITERATION_COUNT,
+           OpenABE_ERROR_INVALID_INPUT);
     // convert the 'password' into a key + generate a salt.
     pword = password;
     // generate salt
     rng.getRandomBytes(&salt, SALT_LEN);
     // derive the key using PBKDF2 under generated salt
-    key = OpenABEPBKDF(pword, DEFAULT_SYM_KEY_BYTES, salt);
+    key = OpenABEPBKDF(pword, DEFAULT_SYM_KEY_BYTES, salt, iterationCount);
     // use derived key to encrypt input blob
-    authEnc.reset(
-        new oabe::crypto::OpenABESymKeyAuthEnc(DEFAULT_AES_SEC_LEVEL, key));
-    // encrypt the input blob
-    authEnc->encrypt(inBlob, &iv, &ct, &tag);
-    output.smartPack(iv);
-    output.smartPack(ct);
-    output.smartPack(tag);
-    // concatenate bytes into caller's encOutputBlob object
-    encOutputBlob += salt;
-    encOutputBlob += output;
+    result = sealUnderPasswordKey(salt, iterationCount, key, inputBlob, encOutputBlob);
   } catch (OpenABE_ERROR &error) {
     result = error;
   }
 
+  pword.zeroize();
   key.zeroize();
   salt.zeroize();
   return result;
@@ -260,36 +496,29 @@ OpenABE_ERROR encryptUnderPassword(const std::string password,
 OpenABE_ERROR decryptUnderPassword(const string password,
                                OpenABEByteString &inputCTBlob,
                                OpenABEByteString &plainOutputBlob) {
+  OpenABEByteString pwd;
+  // convert the 'password' into a key
+  pwd = password;
+  OpenABE_ERROR result = decryptPasswordBlob(inputCTBlob, plainOutputBlob,
+      [&](OpenABEByteString &salt, int iterationCount, OpenABEByteString &key) {
+        key = OpenABEPBKDF(pwd, DEFAULT_SYM_KEY_BYTES, salt, iterationCount);
+      });
+  pwd.zeroize();
+  return result;
+}
+
+OpenABE_ERROR encryptUnderPassword(OpenABEPasswordKeyCache &keys,
+                               OpenABEByteString &inputBlob,
+                               OpenABEByteString &encOutputBlob) {
   OpenABE_ERROR result = OpenABE_NOERROR;
-  OpenABEByteString pwd, ctBlob, salt, key;
-  OpenABEByteString iv, ct, tag;
-  unique_ptr<oabe::crypto::OpenABESymKeyAuthEnc> authEnc = nullptr;
-  string ptBlob;
+  OpenABEByteString salt, key;
 
   try {
-    // validate the input lengths
-    ASSERT(inputCTBlob.size() > SALT_LEN, OpenABE_ERROR_INVALID_INPUT);
-    // first recover the salt
-    salt = inputCTBlob.getSubset(0, SALT_LEN);
-    // then recover the ciphertext
-    ctBlob = inputCTBlob.getSubset(SALT_LEN, inputCTBlob.size() - SALT_LEN);
-    // now parse sym ciphertext
-    size_t index = 0;
-    iv = ctBlob.smartUnpack(&index);
-    ct = ctBlob.smartUnpack(&index);
-    tag = ctBlob.smartUnpack(&index);
-    // convert the 'password' into a key + generate a salt.
-    pwd = password;
-    // derive the key (with default number of iterations)
-    key = OpenABEPBKDF(pwd, DEFAULT_SYM_KEY_BYTES, salt);
-    // use key to decrypt CT
-    authEnc.reset(
-        new oabe::crypto::OpenABESymKeyAuthEnc(DEFAULT_AES_SEC_LEVEL, key));
-    if (!authEnc->decrypt(ptBlob, &iv, &ct, &tag)) {
-      ptBlob.clear();
-      return OpenABE_ERROR_DECRYPTION_FAILED;
-    }
-    plainOutputBlob = ptBlob;
+    // every blob sealed in the session shares the session salt and key
+    keys.getSealingKey(salt, key);
+    ASSERT(key.size() > 0, OpenABE_ERROR_INVALID_INPUT);
+    result = sealUnderPasswordKey(salt, keys.getIterationCount(), key,
+                                  inputBlob, encOutputBlob);
   } catch (OpenABE_ERROR &error) {
     result = error;
   }
@@ -299,6 +528,15 @@ OpenABE_ERROR decryptUnderPassword(const string password,
   return result;
 }
 
+OpenABE_ERROR decryptUnderPassword(OpenABEPasswordKeyCache &keys,
+                               OpenABEByteString &inputCTBlob,
+                               OpenABEByteString &plainOutputBlob) {
+  return decryptPasswordBlob(inputCTBlob, plainOutputBlob,
+      [&](OpenABEByteString &salt, int iterationCount, OpenABEByteString &key) {
+        keys.getKey(salt, iterationCount, key);
+      });
+}
+
 void sha256(uint8_t *digest, uint8_t *val, size_t val_len) {
   std::string d;
   const std::string value = std::string((const char *)val, val_len);
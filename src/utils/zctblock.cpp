@@ -0,0 +1,587 @@
+///
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+///
+/// This file is part of Zeutro's OpenABE.
+///
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+///
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+///
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+///
+/// \file   zctblock.cpp
+///
+/// \brief  Implementation of the columnar ciphertext blocks.
+///
+/// \author J. Ayo Akinyele
+///
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#endif
+#include <openabe/openabe.h>
+
+using namespace std;
+
+namespace oabe {
+
+/*
+ * Block layout (all integers big-endian):
+ *   block:   magic (8) || block length (8) || count (4) ||
+ *            shape length (4) || shape || column count (4) ||
+ *            column header || ... || column data || ...
+ *   column header:  kind (1) || parameter (4) || data length (8)
+ *   shape:   half || half  (the ABE ciphertext, then the payload)
+ *   half:    positional (1) [|| version (1) || schema (1) || count (4)] ||
+ *            label count (4) || (label length (2) || label) ...
+ * A crypto box ciphertext is pack32(ct1) || pack32(ct2), each half being
+ * smartPack(header) || smartPack(body) as in OpenABECiphertext. The
+ * columns of a half are the first 3 bytes of its header, the rest of it
+ * (the UID), the positional values and the values of the labels, in order.
+ * A column holds one value for all ciphertexts (CONSTANT), repeats an
+ * earlier column (COPY, parameter = its index), holds values of one width
+ * (FIXED, parameter = the width) or holds count + 1 offsets (8 bytes each,
+ * from the end of the table) followed by the values (VARIABLE).
+ */
+static const uint8_t ciphertextBlockMagic[] = { 'O', 'A', 'B', 'E', 'C', 'B', '0', '1' };
+#define CT_BLOCK_CONSTANT   0x00
+#define CT_BLOCK_COPY       0x01
+#define CT_BLOCK_FIXED      0x02
+#define CT_BLOCK_VARIABLE   0x03
+#define CT_BLOCK_HEADER_PREFIX_LEN  3
+
+namespace {
+// bounds-checked reads from a buffer the block does not own
+class BlockBytes {
+public:
+  BlockBytes(const uint8_t *buf, size_t len) : buf_(buf), left_(len) {}
+
+  size_t left() const { return left_; }
+  uint8_t peek() const {
+    if (left_ == 0) {
+      throw OpenABE_ERROR_INVALID_CIPHERTEXT_BODY;
+    }
+    return buf_[0];
+  }
+
+  const uint8_t *take(size_t n) {
+    if (n > left_) {
+      throw OpenABE_ERROR_INVALID_CIPHERTEXT_BODY;
+    }
+    const uint8_t *p = buf_;
+    buf_ += n;
+    left_ -= n;
+    return p;
+  }
+
+  uint64_t read(size_t width) {
+    const uint8_t *p = take(width);
+    uint64_t x = 0;
+    for (size_t i = 0; i < width; i++) {
+      x = (x << 8) | p[i];
+    }
+    return x;
+  }
+
+  const uint8_t *smartUnpack(size_t &n) {
+    uint8_t type = *take(1);
+    if (type == PACK_32) {
+      n = read(4);
+    } else if (type == PACK_16) {
+      n = read(2);
+    } else if (type == PACK_8) {
+      n = read(1);
+    } else {
+      throw OpenABE_ERROR_INVALID_PACK_TYPE;
+    }
+    return take(n);
+  }
+
+private:
+  const uint8_t *buf_;
+  size_t left_;
+};
+
+void put(string &out, uint64_t x, size_t width) {
+  for (size_t i = width; i > 0; i--) {
+    out.push_back((char)((x >> (8 * (i - 1))) & 0xFF));
+  }
+}
+
+// the framing of OpenABEByteString::smartPack
+void putPacked(string &out, const uint8_t *value, size_t len) {
+  if (len == 0) {
+    throw OpenABE_ERROR_INVALID_CIPHERTEXT_BODY;
+  }
+  if (len > UINT16_MAX) {
+    out.push_back((char)PACK_32);
+    put(out, len, 4);
+  } else if (len > UINT8_MAX) {
+    out.push_back((char)PACK_16);
+    put(out, len, 2);
+  } else {
+    out.push_back((char)PACK_8);
+    put(out, len, 1);
+  }
+  out.append((const char *)value, len);
+}
+
+// the shape and the fields of one half of a ciphertext
+void splitHalf(const uint8_t *ct, size_t ctLen, string &shape,
+               vector<string> &fields) {
+  BlockBytes in(ct, ctLen);
+  size_t hdrLen = 0, bodyLen = 0;
+  const uint8_t *hdr = in.smartUnpack(hdrLen);
+  if (hdrLen <= CT_BLOCK_HEADER_PREFIX_LEN) {
+    throw OpenABE_ERROR_INVALID_CIPHERTEXT_HEADER;
+  }
+  fields.push_back(string((const char *)hdr, CT_BLOCK_HEADER_PREFIX_LEN));
+  fields.push_back(string((const char *)hdr + CT_BLOCK_HEADER_PREFIX_LEN,
+                          hdrLen - CT_BLOCK_HEADER_PREFIX_LEN));
+  const uint8_t *bodyBytes = in.smartUnpack(bodyLen);
+  BlockBytes body(bodyBytes, bodyLen);
+  if (in.left() != 0) {
+    throw OpenABE_ERROR_INVALID_CIPHERTEXT_BODY;
+  }
+
+  if (body.peek() == OpenABE_CONTAINER_POSITIONAL) {
+    shape.push_back(1);
+    const uint8_t *p = body.take(3) + 1;
+    shape.push_back((char)p[0]);
+    shape.push_back((char)p[1]);
+    size_t posLen = 0;
+    const uint8_t *posBytes = body.smartUnpack(posLen);
+    BlockBytes pos(posBytes, posLen);
+    uint32_t numPositional = 0;
+    while (pos.left() > 0) {
+      size_t len = 0;
+      const uint8_t *value = pos.smartUnpack(len);
+      fields.push_back(string((const char *)value, len));
+      numPositional++;
+    }
+    put(shape, numPositional, 4);
+  } else {
+    shape.push_back(0);
+  }
+
+  string labels;
+  uint32_t numLabels = 0;
+  while (body.left() > 0) {
+    size_t nameLen = 0, valueLen = 0;
+    const uint8_t *name = body.smartUnpack(nameLen);
+    const uint8_t *value = body.smartUnpack(valueLen);
+    if (nameLen > UINT16_MAX) {
+      throw OpenABE_ERROR_INVALID_CIPHERTEXT_BODY;
+    }
+    put(labels, nameLen, 2);
+    labels.append((const char *)name, nameLen);
+    fields.push_back(string((const char *)value, valueLen));
+    numLabels++;
+  }
+  put(shape, numLabels, 4);
+  shape += labels;
+}
+}
+
+/********************************************************************************
+ * Implementation of the OpenABECiphertextBlockWriter class
+ ********************************************************************************/
+
+OpenABECiphertextBlockWriter::OpenABECiphertextBlockWriter() : count_(0) {}
+
+/*!
+ * Add a binary crypto box ciphertext to the block.
+ *
+ * @param[in]   the ciphertext and its length.
+ * @return  OpenABE_NOERROR, OpenABE_ERROR_INVALID_INPUT if its layout
+ *          differs from the ciphertexts already added, or the reason it
+ *          could not be parsed.
+ */
+
+OpenABE_ERROR OpenABECiphertextBlockWriter::add(const uint8_t *ciphertext, size_t len) {
+  string shape;
+  vector<string> fields;
+  try {
+    if (ciphertext == nullptr) {
+      return OpenABE_ERROR_INVALID_INPUT;
+    }
+    BlockBytes in(ciphertext, len);
+    for (int h = 0; h < 2; h++) {
+      size_t ctLen = in.read(4);
+      splitHalf(in.take(ctLen), ctLen, shape, fields);
+    }
+    if (in.left() != 0) {
+      return OpenABE_ERROR_INVALID_CIPHERTEXT_BODY;
+    }
+  } catch (OpenABE_ERROR &error) {
+    return error;
+  }
+
+  if (this->count_ == 0) {
+    this->shape_ = shape;
+    this->columns_.assign(fields.size(), vector<string>());
+  } else if (shape != this->shape_ || fields.size() != this->columns_.size()) {
+    return OpenABE_ERROR_INVALID_INPUT;
+  }
+  for (size_t j = 0; j < fields.size(); j++) {
+    this->columns_[j].push_back(std::move(fields[j]));
+  }
+  this->count_++;
+  return OpenABE_NOERROR;
+}
+
+/*!
+ * Write the block of the ciphertexts added so far to the end of out, and
+ * start an empty block.
+ *
+ * @param[out]  the output the block is appended to.
+ */
+
+void OpenABECiphertextBlockWriter::finish(string &out) {
+  if (this->count_ == 0) {
+    return;
+  }
+  const size_t numColumns = this->columns_.size();
+  string headers, data;
+  for (size_t j = 0; j < numColumns; j++) {
+    const vector<string> &values = this->columns_[j];
+    uint8_t kind = CT_BLOCK_CONSTANT;
+    uint32_t param = 0;
+    string columnData;
+
+    bool constant = true, fixed = true;
+    for (size_t i = 1; i < values.size(); i++) {
+      constant = constant && (values[i] == values[0]);
+      fixed = fixed && (values[i].size() == values[0].size());
+    }
+    // a column can only repeat an earlier one with the same first value
+    // (the UID of the payload header is the one of the ABE header)
+    size_t copyOf = j;
+    if (!constant) {
+      for (size_t k = 0; k < j && copyOf == j; k++) {
+        if (this->columns_[k][0] == values[0] && this->columns_[k] == values) {
+          copyOf = k;
+        }
+      }
+    }
+
+    if (constant) {
+      columnData = values[0];
+    } else if (copyOf != j) {
+      kind = CT_BLOCK_COPY;
+      param = (uint32_t)copyOf;
+    } else if (fixed && !values[0].empty()) {
+      kind = CT_BLOCK_FIXED;
+      param = (uint32_t)values[0].size();
+      for (auto &value : values) {
+        columnData += value;
+      }
+    } else {
+      kind = CT_BLOCK_VARIABLE;
+      uint64_t offset = 0;
+      for (auto &value : values) {
+        put(columnData, offset, 8);
+        offset += value.size();
+      }
+      put(columnData, offset, 8);
+      for (auto &value : values) {
+        columnData += value;
+      }
+    }
+    headers.push_back((char)kind);
+    put(headers, param, 4);
+    put(headers, columnData.size(), 8);
+    data += columnData;
+  }
+
+  string block((const char *)ciphertextBlockMagic, sizeof(ciphertextBlockMagic));
+  const uint64_t blockLen = sizeof(ciphertextBlockMagic) + 8 + 4 + 4 +
+                            this->shape_.size() + 4 + headers.size() + data.size();
+  put(block, blockLen, 8);
+  put(block, this->count_, 4);
+  put(block, this->shape_.size(), 4);
+  block += this->shape_;
+  put(block, numColumns, 4);
+  block += headers;
+  block += data;
+  out += block;
+
+  this->shape_.clear();
+  this->columns_.clear();
+  this->count_ = 0;
+}
+
+/********************************************************************************
+ * Implementation of the OpenABECiphertextBlockReader class
+ ********************************************************************************/
+
+OpenABECiphertextBlockReader::OpenABECiphertextBlockReader()
+    : count_(0), data_(NULL), len_(0), map_(NULL), mapLen_(0) {}
+
+OpenABECiphertextBlockReader::~OpenABECiphertextBlockReader() { this->close(); }
+
+/*!
+ * Map the file at 'path' read-only and index the blocks in it.
+ *
+ * @param[in]   path of a file of one or more blocks.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR OpenABECiphertextBlockReader::open(const string &path) {
+#if defined(_WIN32)
+  return OpenABE_ERROR_NOT_IMPLEMENTED;
+#else
+  this->close();
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return OpenABE_ERROR_INVALID_INPUT;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    ::close(fd);
+    return OpenABE_ERROR_INVALID_LENGTH;
+  }
+  size_t len = (size_t)st.st_size;
+  void *p = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    return OpenABE_ERROR_OUT_OF_MEMORY;
+  }
+  this->map_ = p;
+  this->mapLen_ = len;
+  this->data_ = (const uint8_t *)p;
+  this->len_ = len;
+  OpenABE_ERROR result = this->parseBlocks();
+  if (result != OpenABE_NOERROR) {
+    this->close();
+  }
+  return result;
+#endif
+}
+
+/*!
+ * Index the blocks of a buffer, which is read in place.
+ *
+ * @param[in]   the blocks and their total length.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR OpenABECiphertextBlockReader::attach(const uint8_t *data, size_t len) {
+  this->close();
+  if (data == NULL || len == 0) {
+    return OpenABE_ERROR_INVALID_INPUT;
+  }
+  this->data_ = data;
+  this->len_ = len;
+  OpenABE_ERROR result = this->parseBlocks();
+  if (result != OpenABE_NOERROR) {
+    this->close();
+  }
+  return result;
+}
+
+void OpenABECiphertextBlockReader::close() {
+#if !defined(_WIN32)
+  if (this->map_ != NULL) {
+    munmap(this->map_, this->mapLen_);
+  }
+#endif
+  this->map_ = NULL;
+  this->mapLen_ = 0;
+  this->data_ = NULL;
+  this->len_ = 0;
+  this->blocks_.clear();
+  this->count_ = 0;
+}
+
+// checks every block and column header; the values are only read by get()
+OpenABE_ERROR OpenABECiphertextBlockReader::parseBlocks() {
+  try {
+    BlockBytes file(this->data_, this->len_);
+    while (file.left() > 0) {
+      const uint8_t *start = file.take(sizeof(ciphertextBlockMagic));
+      if (memcmp(start, ciphertextBlockMagic, sizeof(ciphertextBlockMagic)) != 0) {
+        return OpenABE_ERROR_SERIALIZATION_FAILED;
+      }
+      uint64_t blockLen = file.read(8);
+      if (blockLen < sizeof(ciphertextBlockMagic) + 8 ||
+          blockLen - sizeof(ciphertextBlockMagic) - 8 > file.left()) {
+        return OpenABE_ERROR_INVALID_LENGTH;
+      }
+      BlockBytes in(file.take(blockLen - sizeof(ciphertextBlockMagic) - 8),
+                    blockLen - sizeof(ciphertextBlockMagic) - 8);
+
+      Block block;
+      block.first = this->count_;
+      block.count = in.read(4);
+      if (block.count == 0) {
+        return OpenABE_ERROR_INVALID_LENGTH;
+      }
+      size_t shapeLen = in.read(4);
+      BlockBytes shape(in.take(shapeLen), shapeLen);
+      size_t expectedColumns = 0;
+      for (int h = 0; h < 2; h++) {
+        Half &half = block.halves[h];
+        half.positional = (*shape.take(1) != 0);
+        half.version = half.schema = 0;
+        half.numPositional = 0;
+        if (half.positional) {
+          half.version = *shape.take(1);
+          half.schema = *shape.take(1);
+          half.numPositional = shape.read(4);
+        }
+        uint32_t numLabels = shape.read(4);
+        for (uint32_t k = 0; k < numLabels; k++) {
+          size_t nameLen = shape.read(2);
+          half.labels.push_back(string((const char *)shape.take(nameLen), nameLen));
+        }
+        expectedColumns += 2 + (size_t)half.numPositional + half.labels.size();
+      }
+      if (shape.left() != 0 || in.read(4) != expectedColumns) {
+        return OpenABE_ERROR_SERIALIZATION_FAILED;
+      }
+
+      for (size_t j = 0; j < expectedColumns; j++) {
+        Column column;
+        column.kind = *in.take(1);
+        column.param = in.read(4);
+        column.len = in.read(8);
+        column.data = NULL;
+        block.columns.push_back(column);
+      }
+      for (size_t j = 0; j < expectedColumns; j++) {
+        Column &column = block.columns[j];
+        column.data = in.take(column.len);
+        bool valid = false;
+        if (column.kind == CT_BLOCK_CONSTANT) {
+          valid = (column.len > 0);
+        } else if (column.kind == CT_BLOCK_COPY) {
+          valid = (column.param < j && column.len == 0 &&
+                   block.columns[column.param].kind != CT_BLOCK_COPY);
+        } else if (column.kind == CT_BLOCK_FIXED) {
+          valid = (column.param > 0 && column.len / column.param == block.count &&
+                   column.len % column.param == 0);
+        } else if (column.kind == CT_BLOCK_VARIABLE) {
+          valid = (column.len / 8 > block.count);
+        }
+        if (!valid) {
+          return OpenABE_ERROR_SERIALIZATION_FAILED;
+        }
+      }
+      if (in.left() != 0) {
+        return OpenABE_ERROR_INVALID_LENGTH;
+      }
+      this->count_ += block.count;
+      this->blocks_.push_back(std::move(block));
+    }
+  } catch (OpenABE_ERROR &error) {
+    return error;
+  }
+  return OpenABE_NOERROR;
+}
+
+// value i (within its block) of a column
+void OpenABECiphertextBlockReader::field(const Block &block, size_t column, size_t i,
+                                         const uint8_t *&value, size_t &len) const {
+  const Column &c = block.columns[column];
+  if (c.kind == CT_BLOCK_CONSTANT) {
+    value = c.data;
+    len = c.len;
+  } else if (c.kind == CT_BLOCK_COPY) {
+    this->field(block, c.param, i, value, len);
+  } else if (c.kind == CT_BLOCK_FIXED) {
+    value = c.data + i * c.param;
+    len = c.param;
+  } else {
+    const uint64_t tableLen = 8 * ((uint64_t)block.count + 1);
+    BlockBytes offsets(c.data + 8 * i, 16);
+    uint64_t begin = offsets.read(8), end = offsets.read(8);
+    if (begin > end || end > c.len - tableLen) {
+      throw OpenABE_ERROR_INVALID_CIPHERTEXT_BODY;
+    }
+    value = c.data + tableLen + begin;
+    len = end - begin;
+  }
+}
+
+/*!
+ * Assemble ciphertext i from its columns, in the binary form the crypto
+ * box encrypts to.
+ *
+ * @param[in]   the index of the ciphertext over all blocks.
+ * @param[out]  the ciphertext.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR OpenABECiphertextBlockReader::get(size_t i, OpenABEByteString &ciphertext) const {
+  if (i >= this->count_) {
+    return OpenABE_ERROR_INDEX_OUT_OF_BOUNDS;
+  }
+  auto it = upper_bound(this->blocks_.begin(), this->blocks_.end(), i,
+                        [](size_t x, const Block &b) { return x < b.first; });
+  const Block &block = *(it - 1);
+  const size_t row = i - block.first;
+
+  try {
+    string out;
+    size_t column = 0;
+    for (int h = 0; h < 2; h++) {
+      const Half &half = block.halves[h];
+      const uint8_t *value = NULL;
+      size_t len = 0;
+      string hdr, body, ct;
+      for (int k = 0; k < 2; k++) {
+        this->field(block, column++, row, value, len);
+        hdr.append((const char *)value, len);
+      }
+      if (half.positional) {
+        string pos;
+        for (uint32_t k = 0; k < half.numPositional; k++) {
+          this->field(block, column++, row, value, len);
+          putPacked(pos, (const uint8_t *)value, len);
+        }
+        body.push_back((char)OpenABE_CONTAINER_POSITIONAL);
+        body.push_back((char)half.version);
+        body.push_back((char)half.schema);
+        putPacked(body, (const uint8_t *)pos.data(), pos.size());
+      }
+      for (auto &label : half.labels) {
+        this->field(block, column++, row, value, len);
+        putPacked(body, (const uint8_t *)label.data(), label.size());
+        putPacked(body, value, len);
+      }
+      putPacked(ct, (const uint8_t *)hdr.data(), hdr.size());
+      putPacked(ct, (const uint8_t *)body.data(), body.size());
+      put(out, ct.size(), 4);
+      out += ct;
+    }
+    ciphertext.clear();
+    ciphertext.appendArray((uint8_t *)out.data(), out.size());
+  } catch (OpenABE_ERROR &error) {
+    return error;
+  }
+  return OpenABE_NOERROR;
+}
+
+}
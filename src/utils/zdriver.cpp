@@ -38,6 +38,9 @@
 #include <bitset>
 #include <math.h>
 #include <time.h>
+#include <climits>
+#include <cstring>
+#include <cctype>
 
 #include <openabe/utils/zdriver.h>
 #include <openabe/utils/zscanner.h>
@@ -54,15 +57,43 @@
 #include <openabe/utils/zattributelist.h>
 #endif
 
+#include <mutex>
+
 const size_t DAY_IN_SECS = 60*60*24;
 
 using namespace std;
 
 namespace oabe {
 
+////////////////////// Parsing limits //////////////////////
+
+static std::mutex policyLimitsLock;
+static OpenABEPolicyLimits policyLimits = {
+  POLICY_MAX_INPUT_LENGTH, POLICY_MAX_DEPTH, POLICY_MAX_LEAVES,
+  POLICY_MAX_GATE_WIDTH, POLICY_MAX_ATTRIBUTES
+};
+
+OpenABEPolicyLimits getPolicyLimits() {
+  std::lock_guard<std::mutex> lock(policyLimitsLock);
+  return policyLimits;
+}
+
+void setPolicyLimits(const OpenABEPolicyLimits &limits) {
+  std::lock_guard<std::mutex> lock(policyLimitsLock);
+  policyLimits = limits;
+}
+
+static void checkPolicyLimit(size_t value, size_t limit, const char *what) {
+  if (value > limit) {
+    std::cerr << "Driver::error " << what << " exceeds the limit of " << limit << std::endl;
+    throw OpenABE_ERROR_POLICY_TOO_COMPLEX;
+  }
+}
+
 ////////////////////// Driver for OpenABEPolicy //////////////////////
 
-Driver::Driver(bool _debug) : trace_scanning(false), trace_parsing(false) {
+Driver::Driver(bool _debug) : trace_scanning(false), trace_parsing(false),
+                              limits(getPolicyLimits()), num_leaves(0) {
   final_policy = nullptr;
   debug = _debug;
 }
@@ -83,6 +114,7 @@ bool Driver::parse_stream(std::istream &in, const std::string &sname) {
 
 bool Driver::parse_string(const std::string &prefix, const std::string &input,
                           const std::string &sname) {
+  checkPolicyLimit(input.size(), this->limits.maxInputLength, "input length");
   std::istringstream iss(prefix + input);
   this->original_input = input;
   if (prefix == POLICY_PREFIX) {
@@ -95,6 +127,364 @@ bool Driver::parse_string(const std::string &prefix, const std::string &input,
   return parse_stream(iss, sname);
 }
 
+////////////////////// Recursive-descent parser //////////////////////
+
+/* Same tokens as zscanner.ll and same grammar as zparser.yy, read straight
+ * out of the input string. Each production calls the Driver handler its
+ * bison action calls, in the same order, so both parsers build identical
+ * policies and attribute lists. */
+class DirectParser {
+public:
+  DirectParser(Driver &driver, const std::string &input)
+      : driver_(driver), begin_(input.data()), end_(input.data() + input.size()),
+        pos_(begin_) {
+    next();
+  }
+
+  bool parsePolicy() {
+    unique_ptr<OpenABETreeNode> root;
+    if (!policy(root)) {
+      return false;
+    }
+    if (tok_ != TOK_END) {
+      return syntaxError();
+    }
+    driver_.set_policy(root.release());
+    return true;
+  }
+
+  bool parseAttributeList() {
+    // LEAF items separated by one or more '|', with optional leading and
+    // trailing '|'
+    vector<string> attrs;
+    bool haveItem = false, needSep = false;
+    while (tok_ != TOK_END) {
+      if (isChar('|')) {
+        next();
+        needSep = false;
+        continue;
+      }
+      if (needSep || tok_ != TOK_LEAF) {
+        return syntaxError();
+      }
+      if (!attribute(attrs)) {
+        return false;
+      }
+      checkPolicyLimit(attrs.size(), driver_.limits.maxAttributes, "number of attributes");
+      haveItem = needSep = true;
+    }
+    if (!haveItem) {
+      return syntaxError();
+    }
+    driver_.finish_attrlist(attrs);
+    return true;
+  }
+
+private:
+  enum Token {
+    TOK_END, TOK_EOL, TOK_LEAF, TOK_UINT, TOK_OR, TOK_AND, TOK_IN,
+    TOK_EQ, TOK_LEQ, TOK_GEQ, TOK_CHAR, TOK_ERROR
+  };
+
+  static bool isLeafStart(char c) {
+    return isalpha((unsigned char)c) || (c != '\0' && strchr("/\\.[]$~", c) != nullptr);
+  }
+
+  static bool isLeafChar(char c) {
+    return isalnum((unsigned char)c) || (c != '\0' && strchr("_/\\,.*-:!~[]&$#@%^{}", c) != nullptr);
+  }
+
+  bool isWord(const char *w) const { return this->text_ == w; }
+
+  void next() {
+    while (pos_ < end_ && (*pos_ == ' ' || *pos_ == '\t' || *pos_ == '\r')) {
+      pos_++;
+    }
+    tokStart_ = pos_;
+    if (pos_ == end_) {
+      tok_ = TOK_END;
+      return;
+    }
+    char c = *pos_;
+    if (c == '\n') {
+      pos_++;
+      tok_ = TOK_EOL;
+    } else if (isdigit((unsigned char)c)) {
+      uint64_t n = 0;
+      while (pos_ < end_ && isdigit((unsigned char)*pos_)) {
+        if (n < UINT_MAX) {
+          n = n * 10 + (*pos_ - '0');
+        }
+        pos_++;
+      }
+      tok_ = TOK_UINT;
+      if (n >= UINT_MAX) { /* 32-bit unsigned integers */
+        std::cerr << column() << ": unsigned integer is out of range" << std::endl;
+        tok_ = TOK_ERROR;
+      } else if (n == 0) {
+        std::cerr << column() << ": cannot build meaningful comparison trees with 0" << std::endl;
+        tok_ = TOK_ERROR;
+      }
+      uval_ = (uint32_t)n;
+    } else if (isLeafStart(c)) {
+      const char *s = pos_;
+      while (pos_ < end_ && isLeafChar(*pos_)) {
+        pos_++;
+      }
+      text_.assign(s, pos_ - s);
+      if (isWord("[0]:") || isWord("[1]:")) {
+        // start markers of the bison grammar; never valid mid-input
+        tok_ = TOK_ERROR;
+      } else if (isWord("or") || isWord("OR")) {
+        tok_ = TOK_OR;
+      } else if (isWord("and") || isWord("AND")) {
+        tok_ = TOK_AND;
+      } else if (isWord("in") || isWord("IN")) {
+        tok_ = TOK_IN;
+      } else if (text_.find(EXPINT_KEYWORD) != std::string::npos) {
+        std::cerr << column() << ": '" << EXPINT_KEYWORD << "' is reserved and cannot be user-specified." << std::endl;
+        tok_ = TOK_ERROR;
+      } else {
+        tok_ = TOK_LEAF;
+      }
+    } else if ((c == '<' || c == '>' || c == '=') && pos_ + 1 < end_ && pos_[1] == '=') {
+      tok_ = (c == '<') ? TOK_LEQ : ((c == '>') ? TOK_GEQ : TOK_EQ);
+      pos_ += 2;
+    } else {
+      char_ = c;
+      pos_++;
+      tok_ = TOK_CHAR;
+    }
+  }
+
+  size_t column() const { return (tokStart_ - begin_) + 1; }
+
+  bool isChar(char c) const { return tok_ == TOK_CHAR && char_ == c; }
+
+  bool syntaxError() {
+    driver_.error("column " + to_string(column()) + ": syntax error");
+    return false;
+  }
+
+  bool expectChar(char c) {
+    if (!isChar(c)) {
+      return syntaxError();
+    }
+    next();
+    return true;
+  }
+
+  // number: UINT | UINT '#' UINT
+  bool number(unique_ptr<OpenABEUInteger> &num) {
+    if (tok_ != TOK_UINT) {
+      return syntaxError();
+    }
+    uint32_t value = uval_;
+    next();
+    if (!isChar('#')) {
+      num.reset(create_flexint(value));
+      return true;
+    }
+    next();
+    if (tok_ != TOK_UINT) {
+      return syntaxError();
+    }
+    uint32_t bits = uval_;
+    next();
+    if (!checkValidBit(value, bits)) {
+      // YYERROR in the bison action: fails without reporting
+      return false;
+    }
+    num.reset(create_expint(value, bits));
+    return true;
+  }
+
+  // {Month} {Day}, {Year} after the comparison, with 'text_' the month
+  bool date(unique_ptr<OpenABEUInteger> &month, unique_ptr<OpenABEUInteger> &d,
+            unique_ptr<OpenABEUInteger> &y) {
+    month.reset(get_month(text_));
+    next();
+    return number(d) && expectChar(',') && number(y);
+  }
+
+  // policy: policy OR policy, with AND binding tighter (both left-assoc)
+  bool policy(unique_ptr<OpenABETreeNode> &node) {
+    // bounds the recursion through '(' below
+    checkPolicyLimit(++depth_, driver_.limits.maxDepth, "nesting depth");
+    if (!conjunction(node)) {
+      return false;
+    }
+    while (tok_ == TOK_OR) {
+      next();
+      unique_ptr<OpenABETreeNode> right;
+      if (!conjunction(right)) {
+        return false;
+      }
+      node.reset(driver_.kof2_tree(1, node.release(), right.release()));
+    }
+    depth_--;
+    return true;
+  }
+
+  bool conjunction(unique_ptr<OpenABETreeNode> &node) {
+    if (!limitedTerm(node)) {
+      return false;
+    }
+    while (tok_ == TOK_AND) {
+      next();
+      unique_ptr<OpenABETreeNode> right;
+      if (!limitedTerm(right)) {
+        return false;
+      }
+      node.reset(driver_.kof2_tree(2, node.release(), right.release()));
+    }
+    return true;
+  }
+
+  bool term(unique_ptr<OpenABETreeNode> &node) {
+    if (isChar('(')) {
+      next();
+      return policy(node) && expectChar(')');
+    }
+    if (tok_ != TOK_LEAF) {
+      return syntaxError();
+    }
+    const string leaf = text_;
+    next();
+    unique_ptr<OpenABEUInteger> n1, n2, n3;
+    if (isChar('<') || isChar('>') || tok_ == TOK_LEQ || tok_ == TOK_GEQ) {
+      bool lt = isChar('<') || tok_ == TOK_LEQ;
+      bool strict = (tok_ == TOK_CHAR);
+      next();
+      if (tok_ == TOK_LEAF) {
+        if (!date(n1, n2, n3)) {
+          return false;
+        }
+        if (lt) {
+          node.reset(strict ? driver_.lt_date_in_policy(leaf, n1.get(), n2.get(), n3.get())
+                            : driver_.le_date_in_policy(leaf, n1.get(), n2.get(), n3.get()));
+        } else {
+          node.reset(strict ? driver_.gt_date_in_policy(leaf, n1.get(), n2.get(), n3.get())
+                            : driver_.ge_date_in_policy(leaf, n1.get(), n2.get(), n3.get()));
+        }
+        return true;
+      }
+      if (!number(n1)) {
+        return false;
+      }
+      if (lt) {
+        node.reset(strict ? driver_.lt_policy(leaf, n1.get()) : driver_.le_policy(leaf, n1.get()));
+      } else {
+        node.reset(strict ? driver_.gt_policy(leaf, n1.get()) : driver_.ge_policy(leaf, n1.get()));
+      }
+      return true;
+    }
+    if (tok_ == TOK_EQ) {
+      next();
+      if (!number(n1)) {
+        return false;
+      }
+      node.reset(driver_.eq_policy(leaf, n1.get()));
+      return true;
+    }
+    if (tok_ == TOK_IN) {
+      // LEAF in (min-max) or LEAF in {min-max}
+      next();
+      bool inclusive = isChar('{');
+      if (!inclusive && !isChar('(')) {
+        return syntaxError();
+      }
+      next();
+      if (!number(n1) || !expectChar('-') || !number(n2) ||
+          !expectChar(inclusive ? '}' : ')')) {
+        return false;
+      }
+      node.reset(inclusive ? driver_.range_incl_policy(leaf, n1.get(), n2.get())
+                           : driver_.range_policy(leaf, n1.get(), n2.get()));
+      return true;
+    }
+    if (isChar('=')) {
+      // LEAF = {Month} {Day}, {Year} or LEAF = {Month} {Day}-{Day}, {Year}
+      next();
+      if (tok_ != TOK_LEAF) {
+        return syntaxError();
+      }
+      n1.reset(get_month(text_));
+      next();
+      if (!number(n2)) {
+        return false;
+      }
+      if (isChar('-')) {
+        unique_ptr<OpenABEUInteger> n4;
+        next();
+        if (!number(n3) || !expectChar(',') || !number(n4)) {
+          return false;
+        }
+        node.reset(driver_.range_date_in_policy(leaf, n1.get(), n2.get(), n3.get(), n4.get()));
+        return true;
+      }
+      if (!expectChar(',') || !number(n3)) {
+        return false;
+      }
+      node.reset(driver_.set_date_in_policy(leaf, n1.get(), n2.get(), n3.get()));
+      return true;
+    }
+    node.reset(driver_.leaf_node(leaf));
+    return true;
+  }
+
+  // term with the leaf budget checked once its subtree is owned (one
+  // comparison expands to at most a few dozen leaves)
+  bool limitedTerm(unique_ptr<OpenABETreeNode> &node) {
+    if (!term(node)) {
+      return false;
+    }
+    checkPolicyLimit(driver_.num_leaves, driver_.limits.maxLeaves, "number of leaves");
+    return true;
+  }
+
+  // attrlist item: LEAF | LEAF = number | LEAF = {Month} {Day}, {Year}
+  bool attribute(vector<string> &attrs) {
+    const string leaf = text_;
+    next();
+    if (!isChar('=')) {
+      driver_.append_leaf_attr(attrs, leaf);
+      return true;
+    }
+    next();
+    unique_ptr<OpenABEUInteger> n1, n2, n3;
+    if (tok_ == TOK_LEAF) {
+      const string month = text_;
+      if (!date(n1, n2, n3)) {
+        return false;
+      }
+      driver_.append_date_in_attrlist(attrs, leaf, month, n1.get(), n2.get(), n3.get());
+      return true;
+    }
+    if (!number(n1)) {
+      return false;
+    }
+    driver_.append_attr_num(attrs, leaf, n1.get());
+    return true;
+  }
+
+  Driver &driver_;
+  size_t depth_ = 0;
+  const char *begin_, *end_, *pos_, *tokStart_;
+  Token tok_;
+  string text_;
+  uint32_t uval_;
+  char char_;
+};
+
+bool Driver::parse_input(bool isPolicy, const std::string &input) {
+  checkPolicyLimit(input.size(), this->limits.maxInputLength, "input length");
+  this->original_input = input;
+  this->isPolicy = isPolicy;
+  DirectParser parser(*this, input);
+  return isPolicy ? parser.parsePolicy() : parser.parseAttributeList();
+}
+
 void Driver::error(const class location &l, const std::string &m) {
   std::cerr << "Driver::error " << l << ": " << m << std::endl;
   // clear state
@@ -106,7 +496,24 @@ void Driver::error(const class location &l, const std::string &m) {
   }
 }
 
+void Driver::error(const std::string &m) {
+  std::cerr << "Driver::error " << m << std::endl;
+  // clear state
+  this->original_input = "";
+  if (this->isPolicy) {
+    this->final_policy.reset();
+  } else {
+    this->final_attrlist.reset();
+  }
+}
+
 void Driver::set_policy(OpenABETreeNode *subtree) {
+  // the bison parser only reaches here with the whole tree, so its leaf
+  // budget is checked at the end (the input length bounds the work so far)
+  if (this->num_leaves > this->limits.maxLeaves) {
+    delete subtree;
+    checkPolicyLimit(this->num_leaves, this->limits.maxLeaves, "number of leaves");
+  }
   if (this->final_policy == nullptr) {
     this->final_policy = std::unique_ptr<OpenABEPolicy>(new OpenABEPolicy);
     this->final_policy->setRootNode(subtree);
@@ -142,46 +549,63 @@ void Driver::set_attrlist(std::vector<std::string> *attr_list) {
       cout << "PREFIX: " << i << endl;
     }
   }
-  this->final_attrlist.reset(new OpenABEAttributeList);
-  this->final_attrlist->setAttributes(*attr_list, orig_attributes, attr_prefix);
-  if (attr_list != nullptr)
-    delete attr_list;
+  unique_ptr<vector<string>> owned(attr_list);
+  checkPolicyLimit(attr_list->size(), this->limits.maxAttributes, "number of attributes");
+  finish_attrlist(*attr_list);
   return;
 }
 
+void Driver::finish_attrlist(std::vector<std::string> &attr_list) {
+  this->final_attrlist.reset(new OpenABEAttributeList);
+  this->final_attrlist->setAttributes(attr_list, orig_attributes, attr_prefix);
+}
+
 // handler for LEAF '=' number
 vector<string> *Driver::attr_num(const std::string &c, OpenABEUInteger *number) {
   vector<string> *attrs = new vector<string>();
+  append_attr_num(*attrs, c, number);
+  return attrs;
+}
+
+void Driver::append_attr_num(std::vector<std::string> &attrs, const std::string &c,
+                             OpenABEUInteger *number) {
   if (this->attr_count[c] >= 1) {
       if (this->debug)
           cerr << "'" << c << "' already specified as an attribute. Excluding from attribute list." << endl;
-      return attrs;
+      return;
   }
-  assign_stmt(*attrs, c, *number);
+  assign_stmt(attrs, c, *number);
 
   stringstream ss;
   ss << c << ASSIGN_EQ << *number;
   orig_attributes.push_back(ss.str());
-  return attrs;
 }
 
 vector<string> *Driver::set_date_in_attrlist(const std::string &prefix,
                                              const std::string &month,
                                              OpenABEUInteger *m, OpenABEUInteger *d,
                                              OpenABEUInteger *y) {
+  vector<string> *attrs = new vector<string>();
+  append_date_in_attrlist(*attrs, prefix, month, m, d, y);
+  return attrs;
+}
+
+void Driver::append_date_in_attrlist(std::vector<std::string> &attrs,
+                                     const std::string &prefix,
+                                     const std::string &month,
+                                     OpenABEUInteger *m, OpenABEUInteger *d,
+                                     OpenABEUInteger *y) {
   uint32_t s_days = validate_date(prefix, m, d, y);
   stringstream ss;
   ss << prefix << ASSIGN_EQ << month << " " << *d << ", " << *y;
 
   OpenABEUInteger ui(s_days, 32);
-  vector<string> *attrs = new vector<string>();
   if (this->date_prefix.count(prefix) == 0) {
       const string attr = prefix + COLON + TIME_KEYWORD;
-      assign_stmt(*attrs, attr, ui);
+      assign_stmt(attrs, attr, ui);
       orig_attributes.push_back(ss.str());
       this->date_prefix.insert(prefix);
   }
-  return attrs;
 }
 
 bool Driver::parse_attribute(const std::string &c) {
@@ -215,6 +639,15 @@ vector<string> *Driver::leaf_attr(const std::string &c) {
   return nullptr;
 }
 
+void Driver::append_leaf_attr(std::vector<std::string> &attrs, const std::string &c) {
+  if (this->debug) {
+    cout << "Parse as leaf attribute: " << c << endl;
+  }
+  if (parse_attribute(c)) {
+    attrs.push_back(c);
+  }
+}
+
 std::vector<std::string> *Driver::concat_attr(std::vector<std::string> *attr1,
                                               std::vector<std::string> *attr2) {
   if (attr1 == nullptr) {
@@ -233,6 +666,7 @@ OpenABETreeNode *Driver::leaf_node(const std::string &c) {
   if (this->debug) {
     cout << "Constructing leaf node: " << c << endl;
   }
+  this->num_leaves++;
   pair<string, string> attr = check_attribute(c);
   const string prefix = attr.first;
   const string attribute = attr.second;
@@ -365,23 +799,28 @@ bool checkValidBit(uint32_t value, uint32_t bits) {
 }
 
 OpenABETreeNode *Driver::bit_marker_list(bool flex, bool gt, std::string attr,
-                                     int bits, uint32_t value) {
+                                     int bits, uint32_t value, int label_bits) {
   OpenABETreeNode *p = NULL;
   int i;
 
+  // trailing bits equal to the comparison direction never decide it
   i = 0;
-  while (gt ? (((uint32_t)1) << i & value) : !(((uint32_t)1) << i & value))
+  while (i < bits && (gt ? (((uint32_t)1) << i & value) : !(((uint32_t)1) << i & value)))
     i++;
+  if (i == bits) {
+    // nothing in range is greater (or smaller) than value
+    throw OpenABE_ERROR_INVALID_RANGE_NUMBERS;
+  }
 
-  p = this->leaf_node(bit_marker(flex, attr, i, gt, bits));
+  p = this->leaf_node(bit_marker(flex, attr, i, gt, label_bits));
   for (i = i + 1; i < bits; i++) {
     if (gt) {
       p = this->kof2_tree(((uint32_t)1 << i & value) ? 2 : 1,
-                          this->leaf_node(bit_marker(flex, attr, i, gt, bits)),
+                          this->leaf_node(bit_marker(flex, attr, i, gt, label_bits)),
                           p);
     } else {
       p = this->kof2_tree(((uint32_t)1 << i & value) ? 1 : 2,
-                          this->leaf_node(bit_marker(flex, attr, i, gt, bits)),
+                          this->leaf_node(bit_marker(flex, attr, i, gt, label_bits)),
                           p);
     }
   }
@@ -414,8 +853,17 @@ OpenABETreeNode *Driver::flexint_leader(bool gt, std::string attr, uint32_t valu
   return this->kofn_tree((gt ? 1 : i), attributes);
 }
 
+// bits a comparison against value needs: all label_bits, or domain_bits
+// when the attribute can't exceed that and value fits in it
+static int compare_bits(int label_bits, int domain_bits, uint32_t value) {
+  if (domain_bits > 0 && domain_bits < label_bits && (value >> domain_bits) == 0) {
+    return domain_bits;
+  }
+  return label_bits;
+}
+
 OpenABETreeNode *Driver::cmp_policy(OpenABEUInteger *number, bool gt,
-                                std::string attr) {
+                                std::string attr, int domain_bits) {
   OpenABETreeNode *p = NULL;
 
   /* create the subtree */
@@ -424,16 +872,17 @@ OpenABETreeNode *Driver::cmp_policy(OpenABEUInteger *number, bool gt,
   uint32_t value = number->getVal();
   //                                        (value >= ((uint64_t)1 << 32) ? 64
   //                                          :
-  p = this->bit_marker_list(
-      flex, gt, attr,
+  int label_bits =
       bits ? bits : (value >= ((uint32_t)1 << 16)
                          ? 32
                          : value >= ((uint32_t)1 << 8)
                                ? 16
                                : value >= ((uint32_t)1 << 4)
                                      ? 8
-                                     : value >= ((uint32_t)1 << 2) ? 4 : 2),
-      value);
+                                     : value >= ((uint32_t)1 << 2) ? 4 : 2);
+  p = this->bit_marker_list(flex, gt, attr,
+                            compare_bits(label_bits, domain_bits, value),
+                            value, label_bits);
   return p;
 }
 
@@ -459,6 +908,11 @@ std::string bit_marker(bool flex, std::string base, int bit, int val,
 }
 
 OpenABETreeNode *Driver::eq_policy(const std::string &c, OpenABEUInteger *number) {
+  return this->eq_bits_policy(c, number, 0);
+}
+
+OpenABETreeNode *Driver::eq_bits_policy(const std::string &c, OpenABEUInteger *number,
+                                        int domain_bits) {
   OpenABETreeNode *p = NULL;
   int bits = number->getBits();
   bool flex = bits ? false : true;
@@ -467,7 +921,7 @@ OpenABETreeNode *Driver::eq_policy(const std::string &c, OpenABEUInteger *number
   std::bitset<32> num(number->getVal());
   // std::cout << "flex: " << flex << ", bit_count: " << bit_count << std::endl;
   // std::cout << "Bits: " << num << std::endl;
-  int last = flex ? num.size() : bit_count;
+  int last = compare_bits(flex ? num.size() : bit_count, domain_bits, number->getVal());
   // std::cout << "Bit rep: " << num[last];
   p = this->leaf_node(bit_marker(flex, c, last - 1, num[last - 1], bit_count));
 
@@ -498,6 +952,33 @@ OpenABETreeNode *Driver::ge_policy(const std::string &attr, OpenABEUInteger *num
   return this->cmp_policy(number, true, attr);
 }
 
+OpenABETreeNode *Driver::range_bits_policy(const std::string &c, OpenABEUInteger *lo,
+                                           OpenABEUInteger *hi, int domain_bits) {
+  int bits = lo->getBits();
+  uint32_t a = lo->getVal(), b = hi->getVal();
+  int width = compare_bits(bits, domain_bits, b);
+  if (bits == 0 || a >= b || (width < 32 && (b >> width) != 0)) {
+    // nothing to share: (LEAF > lo AND LEAF < hi)
+    OpenABETreeNode *l = this->cmp_policy(lo, true, c, domain_bits);
+    return this->kof2_tree(2, l, this->cmp_policy(hi, false, c, domain_bits));
+  }
+  // every value strictly between a and b carries the bits above the highest
+  // one where a and b differ, so those get a single marker each and only
+  // the bits below are compared against a and b
+  int k = 31;
+  while (!(((a ^ b) >> k) & 1)) {
+    k--;
+  }
+  uint32_t low = (k == 31) ? max_32bits : (((uint32_t)1 << (k + 1)) - 1);
+  OpenABETreeNode *p =
+      this->kof2_tree(2, this->bit_marker_list(false, true, c, k + 1, a & low, bits),
+                      this->bit_marker_list(false, false, c, k + 1, b & low, bits));
+  for (int i = k + 1; i < width; i++) {
+    p = this->kof2_tree(2, p, this->leaf_node(bit_marker(false, c, i, (a >> i) & 1, bits)));
+  }
+  return p;
+}
+
 OpenABETreeNode *Driver::range_policy(const std::string &c, OpenABEUInteger *min_num,
                                   OpenABEUInteger *max_num) {
   if (min_num->getVal() > max_num->getVal()) {
@@ -508,14 +989,7 @@ OpenABETreeNode *Driver::range_policy(const std::string &c, OpenABEUInteger *min
     return nullptr;
   }
   // translate to (LEAF > min_num AND LEAF < max_num)
-  OpenABETreeNode *rootNode = new OpenABETreeNode();
-  OpenABETreeNode *l = this->gt_policy(c, min_num);
-  OpenABETreeNode *r = this->lt_policy(c, max_num);
-  rootNode->setNodeType(GATE_TYPE_AND);
-  rootNode->addSubnode(l);
-  rootNode->addSubnode(r);
-  rootNode->setThresholdValue(2);
-  return rootNode;
+  return this->range_bits_policy(c, min_num, max_num, 0);
 }
 
 OpenABETreeNode *Driver::range_incl_policy(const std::string &c,
@@ -528,15 +1002,10 @@ OpenABETreeNode *Driver::range_incl_policy(const std::string &c,
     fprintf(stderr, "%s:%s:%d: '%s'\n", __FILE__, __FUNCTION__, __LINE__, OpenABE_errorToString(OpenABE_ERROR_INVALID_MISMATCH_BITS));
     return nullptr;
   }
-  // translate to (LEAF >= min_num AND LEAF <= max_num)
-  OpenABETreeNode *rootNode = new OpenABETreeNode();
-  OpenABETreeNode *l = this->ge_policy(c, min_num);
-  OpenABETreeNode *r = this->le_policy(c, max_num);
-  rootNode->setNodeType(GATE_TYPE_AND);
-  rootNode->addSubnode(l);
-  rootNode->addSubnode(r);
-  rootNode->setThresholdValue(2);
-  return rootNode;
+  // translate to (LEAF > min_num - 1 AND LEAF < max_num + 1)
+  *min_num -= 1;
+  *max_num += 1;
+  return this->range_bits_policy(c, min_num, max_num, 0);
 }
 
 static bool is_valid_date(int month, int day, int year) {
@@ -605,20 +1074,20 @@ uint32_t validate_date(const std::string &prefix, OpenABEUInteger *m,
   //    cout << "Year: " << y->getVal() << endl;
   if (prefix == MONTH_KEYWORD || prefix == DAY_KEYWORD ||
       prefix == YEAR_KEYWORD) {
-        return OpenABE_ERROR_INVALID_PREFIX_SPECIFIED;
+        throw OpenABE_ERROR_INVALID_PREFIX_SPECIFIED;
   }
 
   if (!(m->isFlexInt() && d->isFlexInt() && y->isFlexInt())) {
-    return OpenABE_ERROR_INVALID_ATTRIBUTE_STRUCTURE;
+    throw OpenABE_ERROR_INVALID_ATTRIBUTE_STRUCTURE;
   }
 
   if (!is_valid_date(m->getVal(), d->getVal(), y->getVal())) {
-    return OpenABE_ERROR_INVALID_DATE_SPECIFIED;
+    throw OpenABE_ERROR_INVALID_DATE_SPECIFIED;
   }
 
   // reject if before epoch
   if (y->getVal() < EPOCH_YEAR) {
-    return OpenABE_ERROR_INVALID_DATE_BEFORE_EPOCH;
+    throw OpenABE_ERROR_INVALID_DATE_BEFORE_EPOCH;
   }
 
   struct tm t = {0};
@@ -628,6 +1097,9 @@ uint32_t validate_date(const std::string &prefix, OpenABEUInteger *m,
   time_t s = mktime(&t);
 
   uint32_t in_days = (uint32_t)(s / DAY_IN_SECS);
+  if ((in_days >> TIME_BITS) != 0) {
+    throw OpenABE_ERROR_INVALID_DATE_SPECIFIED;
+  }
   return in_days;
 }
 
@@ -675,7 +1147,7 @@ OpenABETreeNode *Driver::set_date_in_policy(const std::string &prefix,
     attr += prefix;
 
   OpenABEUInteger ui(s, 32);
-  OpenABETreeNode *rootNode = this->eq_policy(attr, &ui);
+  OpenABETreeNode *rootNode = this->eq_bits_policy(attr, &ui, TIME_BITS);
   return rootNode;
 }
 
@@ -691,7 +1163,7 @@ OpenABETreeNode *Driver::gt_date_in_policy(const std::string &prefix,
     attr += prefix;
 
   OpenABEUInteger ui(s, 32);
-  OpenABETreeNode *rootNode = this->gt_policy(attr, &ui);
+  OpenABETreeNode *rootNode = this->cmp_policy(&ui, true, attr, TIME_BITS);
   return rootNode;
 }
 
@@ -706,8 +1178,8 @@ OpenABETreeNode *Driver::ge_date_in_policy(const std::string &prefix,
   else
     attr += prefix;
 
-  OpenABEUInteger ui(s, 32);
-  OpenABETreeNode *rootNode = this->ge_policy(attr, &ui);
+  OpenABEUInteger ui(s - 1, 32);
+  OpenABETreeNode *rootNode = this->cmp_policy(&ui, true, attr, TIME_BITS);
   return rootNode;
 }
 
@@ -723,7 +1195,7 @@ OpenABETreeNode *Driver::lt_date_in_policy(const std::string &prefix,
     attr += prefix;
 
   OpenABEUInteger ui(s, 32);
-  OpenABETreeNode *rootNode = this->lt_policy(attr, &ui);
+  OpenABETreeNode *rootNode = this->cmp_policy(&ui, false, attr, TIME_BITS);
   return rootNode;
 }
 
@@ -738,8 +1210,8 @@ OpenABETreeNode *Driver::le_date_in_policy(const std::string &prefix,
   else
     attr += prefix;
 
-  OpenABEUInteger ui(s, 32);
-  OpenABETreeNode *rootNode = this->le_policy(attr, &ui);
+  OpenABEUInteger ui(s + 1, 32);
+  OpenABETreeNode *rootNode = this->cmp_policy(&ui, false, attr, TIME_BITS);
   return rootNode;
 }
 
@@ -769,16 +1241,9 @@ OpenABETreeNode *Driver::range_date_in_policy(const std::string &prefix,
   else
     attr += prefix;
 
-  OpenABEUInteger ui_min((uint32_t)s1_days, 32), ui_max((uint32_t)s2_days, 32);
-  OpenABETreeNode *l = this->ge_policy(attr, &ui_min);
-  OpenABETreeNode *r = this->le_policy(attr, &ui_max);
-  OpenABETreeNode *rootNode = new OpenABETreeNode();
-  rootNode->setNodeType(GATE_TYPE_AND);
-  rootNode->addSubnode(l);
-  rootNode->addSubnode(r);
-  rootNode->setThresholdValue(2);
-
-  return rootNode;
+  // (date >= first AND date <= last)
+  OpenABEUInteger ui_min((uint32_t)s1_days - 1, 32), ui_max((uint32_t)s2_days + 1, 32);
+  return this->range_bits_policy(attr, &ui_min, &ui_max, TIME_BITS);
 }
 
 std::ostream &Driver::print(std::ostream &stream) {
@@ -230,6 +230,10 @@ const char *OpenABE_errorToString(OpenABE_ERROR error) {
         break;
       case OpenABE_ERROR_NO_PLAINTEXT_SPECIFIED:
         return "Did not specify plaintext to encrypt or sign";
+      case OpenABE_ERROR_POLICY_NOT_SATISFIED:
+        return "The attributes do not satisfy the policy";
+      case OpenABE_ERROR_POLICY_TOO_COMPLEX:
+        return "The policy or attribute list exceeds the parsing limits";
       case OpenABE_ERROR_UNKNOWN:
         return "Unknown error";
         break;
@@ -76,29 +76,57 @@ unique_ptr<OpenABEFunctionInput> copyFunctionInput(const OpenABEFunctionInput &i
   return funcInput;
 }
 
+/*!
+ * The policy of a CP-ABE ciphertext: parsed from its "policy" string, or
+ * copied from the policy dictionary when it only carries the digest.
+ *
+ * @param[in]   the ciphertext
+ * @return      the policy, or nullptr if it has none or the digest is not
+ *              registered
+ */
+
+unique_ptr<OpenABEPolicy> getCiphertextPolicy(OpenABECiphertext *ciphertext) {
+  if (ciphertext->hasComponent("policyHash")) {
+    OpenABEByteString *digest = ciphertext->getByteString("policyHash");
+    unique_ptr<OpenABEPolicy> policy =
+        (digest != NULL) ? createPolicyTreeFromDigest(*digest) : nullptr;
+    if (policy == nullptr) {
+      fprintf(stderr, "%s:%s:%d: policy digest is not registered\n", __FILE__, __FUNCTION__, __LINE__);
+    }
+    return policy;
+  }
+  OpenABEByteString *policy_str = ciphertext->getByteString("policy");
+  if (policy_str == NULL) {
+    fprintf(stderr, "%s:%s:%d: policy_str is null\n", __FILE__, __FUNCTION__, __LINE__);
+    return nullptr;
+  }
+  return createPolicyTree(policy_str->toString());
+}
+
 unique_ptr<OpenABEFunctionInput> getFunctionInput(OpenABECiphertext *ciphertext) {
   if (ciphertext == NULL) {
     fprintf(stderr, "%s:%s:%d: ciphertext is null\n", __FILE__, __FUNCTION__, __LINE__);
     return nullptr;
   }
   OpenABE_SCHEME scheme_type = ciphertext->getSchemeType();
-  OpenABEByteString *policy_str = NULL;
   OpenABEAttributeList *attrList = NULL;
 
   // check the scheme type
   switch (scheme_type) {
   case OpenABE_SCHEME_CP_WATERS:
   case OpenABE_SCHEME_CP_WATERS_CCA:
-    policy_str = ciphertext->getByteString("policy");
-    if (policy_str == NULL) {
-      fprintf(stderr, "%s:%s:%d: policy_str is null\n", __FILE__, __FUNCTION__, __LINE__);
-      return nullptr;
-    }
-    return unique_ptr<OpenABEFunctionInput>(
-               createPolicyTree(policy_str->toString()));
+  case OpenABE_SCHEME_CP_WATERS_HCCA:
+  case OpenABE_SCHEME_CP_FAME:
+  case OpenABE_SCHEME_CP_FAME_CCA:
+  case OpenABE_SCHEME_CP_FAME_HCCA:
+  case OpenABE_SCHEME_CP_WATERS_FD:
+  case OpenABE_SCHEME_CP_WATERS_FD_CCA:
+  case OpenABE_SCHEME_CP_WATERS_FD_HCCA:
+    return unique_ptr<OpenABEFunctionInput>(getCiphertextPolicy(ciphertext));
     break;
   case OpenABE_SCHEME_KP_GPSW:
   case OpenABE_SCHEME_KP_GPSW_CCA:
+  case OpenABE_SCHEME_KP_GPSW_HCCA:
     attrList = (OpenABEAttributeList *)ciphertext->getComponent("attributes");
     if (attrList == NULL) {
       fprintf(stderr, "%s:%s:%d: attrList is null\n", __FILE__, __FUNCTION__, __LINE__);
@@ -37,6 +37,8 @@
 #include <algorithm>
 #include <fstream>
 #include <string>
+#include <cstring>
+#include <ctime>
 #include <assert.h>
 #include <openabe/openabe.h>
 
@@ -48,22 +50,124 @@ namespace oabe {
  * Implementation of the OpenABEKeystoreManager class
  ********************************************************************************/
 
-OpenABEKeystoreManager::OpenABEKeystoreManager(): OpenABEKeystore() {
+// attributes a policy or attribute list mentions; a key can only satisfy
+// (or be satisfied by) a functional input it shares one of these with
+static vector<string> getIndexTerms(OpenABEFunctionInput *input) {
+    vector<string> terms;
+    if (input->getFunctionType() == FUNC_ATTRLIST_INPUT) {
+        terms = *((OpenABEAttributeList *)input)->getAttributeList();
+    } else if (input->getFunctionType() == FUNC_POLICY_INPUT) {
+        try {
+            shared_ptr<const OpenABELSSSCompiledPolicy> compiled =
+                OpenABELSSSCompiledPolicy::forPolicy((OpenABEPolicy *)input);
+            for (size_t i = 0; i < compiled->numRows(); i++) {
+                terms.push_back(compiled->rowAttribute(i));
+            }
+        } catch (OpenABE_ERROR &) {
+            terms.clear();
+        }
+    }
+    return terms;
+}
+
+// identifies a key's owner, input type and input for duplicate detection
+static string getInputIndexKey(const string& userId, OpenABEFunctionInput *input) {
+    string k = userId;
+    k.push_back('\0');
+    k += to_string((int)input->getFunctionType());
+    k.push_back('\0');
+    k += input->toCompactString();
+    return k;
+}
+
+// pairings a decrypt with this key spends per row it uses, and the ones it
+// always spends: CP-Waters pairs K_x/D_x per row plus C'/K and prod C_x/L,
+// KP-GPSW pairs C_i/d_i per row plus prod D_i/C', CP-FAME always pairs four
+// and CP-Waters FD always pairs three
+static void setDecryptCost(OpenABEMetadata& metadata) {
+    metadata->pairingsPerRow = 1;
+    switch (metadata->schemeID) {
+        case OpenABE_SCHEME_CP_WATERS:
+        case OpenABE_SCHEME_CP_WATERS_CCA:
+        case OpenABE_SCHEME_CP_WATERS_HCCA:
+            metadata->fixedPairings = 2;
+            break;
+        case OpenABE_SCHEME_CP_FAME:
+        case OpenABE_SCHEME_CP_FAME_CCA:
+        case OpenABE_SCHEME_CP_FAME_HCCA:
+            metadata->pairingsPerRow = 0;
+            metadata->fixedPairings = 4;
+            break;
+        case OpenABE_SCHEME_CP_WATERS_FD:
+        case OpenABE_SCHEME_CP_WATERS_FD_CCA:
+        case OpenABE_SCHEME_CP_WATERS_FD_HCCA:
+            metadata->pairingsPerRow = 0;
+            metadata->fixedPairings = 3;
+            break;
+        default:
+            metadata->fixedPairings = 1;
+            break;
+    }
+    metadata->keyRows = 0;
+    if (metadata->inputType == FUNC_POLICY_INPUT) {
+        OpenABEPolicy *policy = (OpenABEPolicy *)metadata->input.get();
+        if (policy->getCompiledLSSS() != nullptr) {
+            metadata->keyRows = policy->getCompiledLSSS()->numRows();
+        }
+    } else if (metadata->inputType == FUNC_ATTRLIST_INPUT) {
+        OpenABEAttributeList *attrs = (OpenABEAttributeList *)metadata->input.get();
+        metadata->keyRows = attrs->getAttributeList()->size();
+    }
+}
+
+static uint64_t getDecryptCost(const OpenABEMetadata& metadata, int rowsUsed) {
+    return metadata->fixedPairings + (uint64_t)metadata->pairingsPerRow * (rowsUsed > 0 ? rowsUsed : 0);
+}
+
+OpenABEKeystoreManager::OpenABEKeystoreManager(): OpenABEKeystore(), sweeperStop_(false) {
+    memset(&evictionStats_, 0, sizeof(evictionStats_));
 }
 
 OpenABEKeystoreManager::~OpenABEKeystoreManager() {
+    stopEvictionThread();
     // clear out metadata structure
     keyPassphrase_.clear();
+    for (auto& it : passphraseKeys_) {
+        it.second->clear();
+    }
+    passphraseKeys_.clear();
 }
 
 void
-OpenABEKeystoreManager::setPassphrase(const std::string& programId, const std::string& userId, const std::string& passphrase) {
+OpenABEKeystoreManager::setPassphrase(const std::string& programId, const std::string& userId,
+                                      const std::string& passphrase, int iterationCount) {
+    std::shared_ptr<OpenABEPasswordKeyCache> keys(new OpenABEPasswordKeyCache(passphrase, iterationCount));
+    std::lock_guard<OpenABERWLock> lock(ks_lock_);
+    // a changed passphrase invalidates everything derived from the old one
+    auto it = passphraseKeys_.find(userId);
+    if (it != passphraseKeys_.end()) {
+        it->second->clear();
+    }
     keyPassphrase_[userId] = passphrase;
     activeUsers_[userId] = programId;
+    passphraseKeys_[userId] = keys;
+}
+
+void
+OpenABEKeystoreManager::clearPassphrase(const std::string& userId) {
+    std::lock_guard<OpenABERWLock> lock(ks_lock_);
+    auto it = passphraseKeys_.find(userId);
+    if (it != passphraseKeys_.end()) {
+        it->second->clear();
+        passphraseKeys_.erase(it);
+    }
+    keyPassphrase_.erase(userId);
+    activeUsers_.erase(userId);
 }
 
 map<string,string>
 OpenABEKeystoreManager::getActiveUsers() {
+    OpenABESharedLockGuard lock(ks_lock_);
     return activeUsers_;
 }
 
@@ -71,65 +175,206 @@ bool
 OpenABEKeystoreManager::storeWithKeyIDCommand(const string& userId, const std::string keyID,
                                           OpenABEByteString& keyBlob, uint64_t keyExpireDate,
                                           bool canCacheKey) {
-    OpenABEMetadata metadata(new _OpenABEMetadata);
-    OpenABEByteString origBlob = keyBlob, outputKeyBytes;
-    // parse the header first
-    shared_ptr<OpenABEKey> key = nullptr;
+    std::lock_guard<OpenABERWLock> lock(ks_lock_);
+    return storeWithKeyID(userId, keyID, keyBlob, keyExpireDate, canCacheKey);
+}
+
+bool
+OpenABEKeystoreManager::storeWithKeyID(const string& userId, const std::string keyID,
+                                   OpenABEByteString& keyBlob, uint64_t keyExpireDate,
+                                   bool canCacheKey) {
+    OpenABEByteString origBlob = keyBlob;
+    std::shared_ptr<ZGroup> group;
     assert(userId != "");
 
-    if (keyMetadata_.count(keyID) != 0) {
-    	keyMetadata_.erase(keyID);
+    dropKey(keyID);
+
+    OpenABEMetadata metadata = decodeKey(keyID, keyBlob, group);
+    if (metadata == nullptr) {
+        return false;
     }
+    return insertKey(userId, keyID, metadata, origBlob, keyExpireDate, canCacheKey);
+}
 
-    key = this->parseKeyHeader(keyID, keyBlob, outputKeyBytes);
+/*!
+ * Parse a key blob and decode the key for its metadata. Needs no lock.
+ *
+ * @param[in]   the key ID and the key blob.
+ * @param[in,out]  the group of the key's curve (created if null).
+ * @return  the metadata with the curve, scheme and input of the key set,
+ *          or nullptr if the curve or the scheme is unknown. Throws if
+ *          the blob is malformed.
+ */
+OpenABEMetadata
+OpenABEKeystoreManager::decodeKey(const string& keyID, OpenABEByteString& keyBlob,
+                                  std::shared_ptr<ZGroup>& group) {
+    OpenABEByteString outputKeyBytes;
+    // parse the header first
+    shared_ptr<OpenABEKey> key = this->parseKeyHeader(keyID, keyBlob, outputKeyBytes);
     if(key == nullptr) {
         THROW_ERROR(OpenABE_ERROR_INVALID_INPUT);
     }
 
-    bool foundAnExistingKey = false;
-    string funcInputStr, funcInputStrNew;
     OpenABECurveID curveID = OpenABE_getCurveID(key->getCurveID());
     OpenABE_SCHEME schemeID = OpenABE_getSchemeID(key->getAlgorithmID());
+    if(curveID == OpenABE_NONE_ID || schemeID == OpenABE_SCHEME_NONE) {
+        return nullptr;
+    }
     // create the group object based on curve ID.
+    if (group == nullptr) {
+        OpenABE_setGroupObject(group, curveID);
+    }
+    // parse the body of the key, validating every point: the blob is
+    // unauthenticated, and decryptions load it from the store unchecked
+    key->setGroup(group);
+    key->loadKeyFromBytes(outputKeyBytes);
+    outputKeyBytes.zeroize();
+
+    OpenABEMetadata metadata(new _OpenABEMetadata);
+    metadata->curveID = curveID;
+    metadata->schemeID = schemeID;
+    metadata->input = getFunctionInput(key.get());
+    metadata->inputType = metadata->input->getFunctionType();
+    return metadata;
+}
+
+/*!
+ * Add a decoded key (see decodeKey) for the user, unless the user already
+ * has a key for the same input. Called with ks_lock_ held exclusively.
+ */
+bool
+OpenABEKeystoreManager::insertKey(const string& userId, const string& keyID,
+                                  OpenABEMetadata& metadata, OpenABEByteString& keyBlob,
+                                  uint64_t keyExpireDate, bool canCacheKey) {
+    // search existing metadata for the same user, func input & type
+    if (keysByInput_.count(getInputIndexKey(userId, metadata->input.get())) != 0) {
+        // no need to add key
+        return false;
+    }
+
+    // add info to metadata here
+    metadata->userId  = userId;
+    metadata->keyExpirationDate = keyExpireDate;
+    metadata->isCached = canCacheKey;
+    if (store_.isOpen()) {
+        // the blob goes to the log; only its position stays in memory
+        if (appendToStore(keyID, metadata, keyBlob) != OpenABE_NOERROR) {
+            return false;
+        }
+    } else {
+        metadata->keyBlob = keyBlob;
+    }
+    addKeyMetadata(keyID, metadata);
+    return true;
+}
+
+/*!
+ * Store the keys of a key ring (see OpenABE_writeKeyRing) for a user. The
+ * keys are decoded on the library thread pool without the keystore lock,
+ * which is then taken once to store all of them. A key replaces the one
+ * stored under its ID, and is skipped if the user has a key for the same
+ * input, as with storeWithKeyIDCommand.
+ *
+ * @return  the number of keys stored. Throws if the ring or one of its
+ *          keys is malformed, before any key is stored.
+ */
+size_t
+OpenABEKeystoreManager::importKeyRingCommand(const string& userId, const OpenABEByteString& ring,
+                                            uint64_t keyExpireDate, bool canCacheKey) {
+    vector<OpenABEKeyRingEntry> keys;
+    OpenABE_ERROR result = OpenABE_readKeyRing(ring.data(), ring.size(), keys);
+    if (result != OpenABE_NOERROR) {
+        THROW_ERROR(result);
+    }
+    assert(userId != "");
+
+    // the ring has one curve: its group is made once, before the threads
+    // start, from the first key
+    const size_t count = keys.size();
+    vector<OpenABEByteString> blobs(count);
+    vector<OpenABEMetadata> metadata(count);
+    vector<OpenABE_ERROR> status(count, OpenABE_NOERROR);
     std::shared_ptr<ZGroup> group;
-    OpenABE_setGroupObject(group, curveID);
-
-    if(curveID != OpenABE_NONE_ID && schemeID != OpenABE_SCHEME_NONE) {
-        // parse the body of the key
-        key->setGroup(group);
-        key->loadKeyFromBytes(outputKeyBytes);
-        // check if input
-        unique_ptr<OpenABEFunctionInput> keyInput = getFunctionInput(key.get());
-        funcInputStrNew = keyInput->toCompactString();
-        // search existing metadata (if available)
-        for (auto it = keyMetadata_.begin(); it != keyMetadata_.end(); it++) {
-            funcInputStr = it->second->input->toCompactString();
-            if (funcInputStr.compare(funcInputStrNew) == 0 // same func input & type
-                    && keyInput->getFunctionType() == it->second->input->getFunctionType()
-                    && userId.compare(it->second->userId) == 0) {
-                foundAnExistingKey = true;
-                break;
+    auto decodeAt = [&](size_t i) {
+        try {
+            blobs[i] = keys[i].keyBlob;
+            metadata[i] = decodeKey(keys[i].keyID, keys[i].keyBlob, group);
+        } catch (OpenABE_ERROR &error) {
+            status[i] = error;
+        }
+    };
+    if (count > 0) {
+        decodeAt(0);
+    }
+    // (a curve or scheme this build doesn't know is the same for every key)
+    if (count > 1 && metadata[0] != nullptr) {
+        OpenABEThreadPool::getDefault()->parallelFor(count - 1, [&](size_t i) {
+            decodeAt(i + 1);
+        });
+    }
+    for (size_t i = 0; i < count; i++) {
+        keys[i].keyBlob.zeroize();
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (status[i] != OpenABE_NOERROR) {
+            for (auto& blob : blobs) {
+                blob.zeroize();
             }
+            THROW_ERROR(status[i]);
         }
+    }
 
-        if (foundAnExistingKey) {
-            // no need to add key
-            return false;
+    size_t stored = 0;
+    std::lock_guard<OpenABERWLock> lock(ks_lock_);
+    for (size_t i = 0; i < count; i++) {
+        dropKey(keys[i].keyID);
+        if (metadata[i] != nullptr &&
+            insertKey(userId, keys[i].keyID, metadata[i], blobs[i], keyExpireDate, canCacheKey)) {
+            stored++;
         }
+        blobs[i].zeroize();
+    }
+    return stored;
+}
 
-        // add info to metadata here
-        metadata->userId  = userId;
-        metadata->keyBlob = origBlob;
-        metadata->keyExpirationDate = keyExpireDate;
-        metadata->curveID = curveID;
-        metadata->schemeID = schemeID;
-        metadata->inputType = keyInput->getFunctionType();
-        metadata->input = std::move(keyInput);
-        metadata->isCached = canCacheKey;
-        keyMetadata_[keyID] = metadata;
-        return true;
+/*!
+ * Write the keys held for a user as one key ring (see OpenABE_writeKeyRing).
+ */
+OpenABE_ERROR
+OpenABEKeystoreManager::exportKeyRingCommand(const string& userId, OpenABEByteString& ring) {
+    vector<OpenABEKeyRingEntry> keys;
+    OpenABE_ERROR result = OpenABE_NOERROR;
+    {
+        OpenABESharedLockGuard lock(ks_lock_);
+        auto user = keysByUser_.find(userId);
+        if (user != keysByUser_.end()) {
+            for (auto& keyID : user->second) {
+                auto it = keyMetadata_.find(keyID);
+                if (it == keyMetadata_.end()) {
+                    continue;
+                }
+                auto& keyMd = it->second;
+                OpenABEKeyRingEntry entry;
+                entry.keyID = keyID;
+                if (keyMd->blobLen > 0) {
+                    result = readFromStore(keyID, keyMd, entry.keyBlob);
+                    if (result != OpenABE_NOERROR) {
+                        break;
+                    }
+                } else {
+                    entry.keyBlob = keyMd->keyBlob;
+                }
+                keys.push_back(std::move(entry));
+            }
+        }
+    }
+    if (result == OpenABE_NOERROR) {
+        result = OpenABE_writeKeyRing(keys, ring);
+    }
+    for (auto& key : keys) {
+        key.keyBlob.zeroize();
     }
-    return false;
+    return result;
 }
 
 const string
@@ -137,16 +382,17 @@ OpenABEKeystoreManager::storeWithKeyPrefixCommand(const string& userId, const st
                                               OpenABEByteString& keyBlob, uint64_t keyExpireDate,
                                               bool canCacheKey) {
     // choose new key ID based on some user-defined prefix
-    std::lock_guard<std::mutex> lock(ks_lock_);
-
-    if(keyCounter_.count(userId) == 0)
-        keyCounter_[userId] = 0;
-    const string keyID = keyPrefix + to_string(keyCounter_[userId]);
-    if (storeWithKeyIDCommand(userId, keyID, keyBlob, keyExpireDate, canCacheKey)) {
-        // increment the key counter
-        // currentKeyCounter++;
-    	int key_count = ((keyCounter_[userId] + 1) % MAX_KEYS_PER_USER);
-        keyCounter_[userId] = key_count;
+    std::lock_guard<OpenABERWLock> lock(ks_lock_);
+
+    uint64_t& counter = keyCounter_[userId];
+    string keyID = keyPrefix + to_string(counter);
+    // skip IDs that are already taken (e.g. keys loaded from the store)
+    while (keyMetadata_.count(keyID) != 0) {
+        keyID = keyPrefix + to_string(++counter);
+    }
+    if (storeWithKeyID(userId, keyID, keyBlob, keyExpireDate, canCacheKey)) {
+        // IDs only ever move forward, so an old key is never overwritten
+        counter++;
         // return new key ID reference
         return keyID;
     }
@@ -154,91 +400,438 @@ OpenABEKeystoreManager::storeWithKeyPrefixCommand(const string& userId, const st
     return "";
 }
 
-int OpenABEKeystoreManager::getUserKeyCount(const std::string& userId) {
-    return keyCounter_[userId];
+size_t OpenABEKeystoreManager::getUserKeyCount(const std::string& userId) {
+    OpenABESharedLockGuard lock(ks_lock_);
+    auto it = keysByUser_.find(userId);
+    return (it != keysByUser_.end()) ? it->second.size() : 0;
 }
 
 pair<string,OpenABEByteString>
 OpenABEKeystoreManager::getKeyCommand(const string& userId, const string& keyID) {
     OpenABEByteString keyBlob;
     string funcInput = "";
-    std::lock_guard<std::mutex> lock(ks_lock_);
+    OpenABESharedLockGuard lock(ks_lock_);
 
-    if(keyMetadata_.count(keyID) != 0) {
-        auto& keyMd = keyMetadata_[keyID];
+    auto it = keyMetadata_.find(keyID);
+    if(it != keyMetadata_.end()) {
+        auto& keyMd = it->second;
         if (keyMd->userId.compare(userId) == 0) {
-            keyBlob = keyMd->keyBlob;
+            if (keyMd->blobLen > 0) {
+                // lazily read from the store
+                if (readFromStore(keyID, keyMd, keyBlob) != OpenABE_NOERROR) {
+                    return make_pair(funcInput, OpenABEByteString());
+                }
+            } else {
+                keyBlob = keyMd->keyBlob;
+            }
             funcInput = keyMd->input->toCompactString();
         }
     }
     return make_pair(funcInput, keyBlob);
 }
 
+static OpenABEKeystoreRecord getStoreRecord(const string& keyID, OpenABEMetadata& metadata) {
+    OpenABEKeystoreRecord record;
+    record.keyID = keyID;
+    record.userId = metadata->userId;
+    record.input = metadata->input->toCompactString();
+    record.inputType = metadata->inputType;
+    record.schemeID = metadata->schemeID;
+    record.curveID = metadata->curveID;
+    record.keyExpirationDate = metadata->keyExpirationDate;
+    record.isCached = metadata->isCached;
+    record.blobOffset = metadata->blobOffset;
+    record.blobLen = metadata->blobLen;
+    return record;
+}
+
+// what a stored blob is bound to, so the log's blobs can't be swapped between records
+static void getStoreBinding(OpenABEByteString& binding, const string& keyID, const string& userId) {
+    binding.pack32bits((uint32_t)keyID.size());
+    binding += keyID;
+    binding.pack32bits((uint32_t)userId.size());
+    binding += userId;
+}
+
+/*!
+ * Seal a key blob under its owner's passphrase session and append it to
+ * the log. A user without a passphrase has nothing to seal under, so their
+ * keys are refused rather than written in the clear. Called with ks_lock_
+ * held exclusively.
+ */
+OpenABE_ERROR
+OpenABEKeystoreManager::appendToStore(const string& keyID, OpenABEMetadata& metadata,
+                                      OpenABEByteString& keyBlob) {
+    auto session = passphraseKeys_.find(metadata->userId);
+    if (session == passphraseKeys_.end()) {
+        fprintf(stderr, "%s:%s:%d: refusing to store key '%s': no passphrase set for user '%s'\n",
+                __FILE__, __FUNCTION__, __LINE__, keyID.c_str(), metadata->userId.c_str());
+        return OpenABE_ERROR_INVALID_CONTEXT;
+    }
+    OpenABEKeystoreRecord record = getStoreRecord(keyID, metadata);
+    OpenABEByteString plain, sealed;
+    getStoreBinding(plain, keyID, metadata->userId);
+    plain += keyBlob;
+    OpenABE_ERROR result = encryptUnderPassword(*session->second, plain, sealed);
+    plain.zeroize();
+    if (result == OpenABE_NOERROR) {
+        result = store_.appendKey(record, sealed);
+    }
+    if (result == OpenABE_NOERROR) {
+        metadata->blobOffset = record.blobOffset;
+        metadata->blobLen = record.blobLen;
+        metadata->keyBlob.zeroize();
+    }
+    return result;
+}
+
+/*!
+ * Read a key blob back from the log and open it under its owner's
+ * passphrase session. Called with ks_lock_ held.
+ */
+OpenABE_ERROR
+OpenABEKeystoreManager::readFromStore(const string& keyID, OpenABEMetadata& metadata,
+                                      OpenABEByteString& keyBlob) {
+    auto session = passphraseKeys_.find(metadata->userId);
+    if (session == passphraseKeys_.end()) {
+        return OpenABE_ERROR_INVALID_CONTEXT;
+    }
+    OpenABEByteString sealed, plain, binding;
+    OpenABE_ERROR result = store_.readBlob(metadata->blobOffset, metadata->blobLen, sealed);
+    if (result != OpenABE_NOERROR) {
+        return result;
+    }
+    result = decryptUnderPassword(*session->second, sealed, plain);
+    if (result == OpenABE_NOERROR) {
+        getStoreBinding(binding, keyID, metadata->userId);
+        if (plain.size() > binding.size() && plain.getSubset(0, binding.size()) == binding) {
+            keyBlob = plain.getSubset(binding.size(), plain.size() - binding.size());
+        } else {
+            result = OpenABE_ERROR_DECRYPTION_FAILED;
+        }
+    }
+    plain.zeroize();
+    return result;
+}
+
+void
+OpenABEKeystoreManager::dropKey(const string& keyID) {
+    auto md = keyMetadata_.find(keyID);
+    if (md == keyMetadata_.end()) {
+        return;
+    }
+    if (md->second->blobLen > 0 && store_.isOpen()) {
+        store_.appendDelete(keyID);
+    }
+    removeKeyMetadata(keyID);
+}
+
+OpenABE_ERROR
+OpenABEKeystoreManager::openStore(const string& path) {
+    std::lock_guard<OpenABERWLock> lock(ks_lock_);
+    // check up front that the keys held in memory can be sealed (see appendToStore)
+    for (auto& it : keyMetadata_) {
+        if (passphraseKeys_.count(it.second->userId) == 0) {
+            fprintf(stderr, "%s:%s:%d: refusing to open the store: no passphrase set for user '%s'\n",
+                    __FILE__, __FUNCTION__, __LINE__, it.second->userId.c_str());
+            return OpenABE_ERROR_INVALID_CONTEXT;
+        }
+    }
+    vector<OpenABEKeystoreRecord> records;
+    OpenABE_ERROR result = store_.open(path, records);
+    if (result != OpenABE_NOERROR) {
+        return result;
+    }
+
+    for (auto& record : records) {
+        if (keyMetadata_.count(record.keyID) != 0) {
+            // stored in this session, so newer than the log's copy
+            continue;
+        }
+        // the compact input string is enough to index the key; the key
+        // body is only parsed by whoever fetches the blob
+        unique_ptr<OpenABEFunctionInput> keyInput = nullptr;
+        try {
+            if (record.inputType == FUNC_POLICY_INPUT) {
+                keyInput = createPolicyTree(record.input);
+            } else if (record.inputType == FUNC_ATTRLIST_INPUT) {
+                keyInput = createAttributeList(record.input);
+            }
+        } catch (OpenABE_ERROR &) {
+            keyInput = nullptr;
+        }
+        if (keyInput == nullptr) {
+            fprintf(stderr, "%s:%s:%d: skipping key '%s' with an invalid input\n",
+                    __FILE__, __FUNCTION__, __LINE__, record.keyID.c_str());
+            continue;
+        }
+        OpenABEMetadata metadata(new _OpenABEMetadata);
+        metadata->userId = record.userId;
+        metadata->keyExpirationDate = record.keyExpirationDate;
+        metadata->curveID = record.curveID;
+        metadata->schemeID = record.schemeID;
+        metadata->inputType = record.inputType;
+        metadata->input = std::move(keyInput);
+        metadata->isCached = record.isCached;
+        metadata->blobOffset = record.blobOffset;
+        metadata->blobLen = record.blobLen;
+        addKeyMetadata(record.keyID, metadata);
+    }
+
+    // keys held only in memory so far are written to the log
+    for (auto& it : keyMetadata_) {
+        if (it.second->blobLen == 0 &&
+            (result = appendToStore(it.first, it.second, it.second->keyBlob)) != OpenABE_NOERROR) {
+            return result;
+        }
+    }
+    return OpenABE_NOERROR;
+}
+
+OpenABE_ERROR
+OpenABEKeystoreManager::compactStore() {
+    std::lock_guard<OpenABERWLock> lock(ks_lock_);
+    if (!store_.isOpen()) {
+        return OpenABE_ERROR_INVALID_CONTEXT;
+    }
+    vector<OpenABEKeystoreRecord> records;
+    vector<OpenABEMetadata*> owners;
+    records.reserve(keyMetadata_.size());
+    for (auto& it : keyMetadata_) {
+        if (it.second->blobLen > 0) {
+            records.push_back(getStoreRecord(it.first, it.second));
+            owners.push_back(&it.second);
+        }
+    }
+    OpenABE_ERROR result = store_.compact(records);
+    if (result == OpenABE_NOERROR) {
+        for (size_t i = 0; i < records.size(); i++) {
+            (*owners[i])->blobOffset = records[i].blobOffset;
+        }
+    }
+    return result;
+}
+
+void
+OpenABEKeystoreManager::closeStore() {
+    std::lock_guard<OpenABERWLock> lock(ks_lock_);
+    if (!store_.isOpen()) {
+        return;
+    }
+    vector<string> unreadable;
+    for (auto& it : keyMetadata_) {
+        OpenABEMetadata& metadata = it.second;
+        if (metadata->blobLen == 0) {
+            continue;
+        }
+        if (readFromStore(it.first, metadata, metadata->keyBlob) != OpenABE_NOERROR) {
+            unreadable.push_back(it.first);
+        }
+        metadata->blobOffset = 0;
+        metadata->blobLen = 0;
+    }
+    // a blob we can no longer read is a key we no longer have
+    for (auto& keyID : unreadable) {
+        fprintf(stderr, "%s:%s:%d: dropping unreadable key '%s'\n",
+                __FILE__, __FUNCTION__, __LINE__, keyID.c_str());
+        removeKeyMetadata(keyID);
+    }
+    store_.close();
+}
+
+void
+OpenABEKeystoreManager::addKeyMetadata(const string& keyID, OpenABEMetadata& metadata) {
+    if (metadata->inputType == FUNC_POLICY_INPUT) {
+        // compile the key's policy now so that concurrent searches only
+        // ever read it (see testAKey)
+        OpenABEPolicy *policy = (OpenABEPolicy *)metadata->input.get();
+        if (policy->getCompiledLSSS() == nullptr) {
+            try {
+                policy->setCompiledLSSS(
+                    make_shared<const OpenABELSSSCompiledPolicy>(policy));
+            } catch (OpenABE_ERROR &) {
+            }
+        }
+    }
+    setDecryptCost(metadata);
+    metadata->indexTerms = getIndexTerms(metadata->input.get());
+    clearRankedKeys();
+    keyMetadata_[keyID] = metadata;
+    keysByUser_[metadata->userId].insert(keyID);
+    keysByExpiration_.insert(make_pair(metadata->keyExpirationDate, keyID));
+    keysByInput_[getInputIndexKey(metadata->userId, metadata->input.get())] = keyID;
+    if (metadata->indexTerms.empty()) {
+        unindexedKeys_.insert(keyID);
+    }
+    for (auto& term : metadata->indexTerms) {
+        keysByAttribute_[term].insert(keyID);
+    }
+}
+
+void
+OpenABEKeystoreManager::removeKeyMetadata(const string& keyID) {
+    auto md = keyMetadata_.find(keyID);
+    if (md == keyMetadata_.end()) {
+        return;
+    }
+    OpenABEMetadata& metadata = md->second;
+    clearRankedKeys();
+    auto user = keysByUser_.find(metadata->userId);
+    if (user != keysByUser_.end()) {
+        user->second.erase(keyID);
+        if (user->second.empty()) {
+            keysByUser_.erase(user);
+        }
+    }
+    keysByExpiration_.erase(make_pair(metadata->keyExpirationDate, keyID));
+    auto input = keysByInput_.find(getInputIndexKey(metadata->userId, metadata->input.get()));
+    if (input != keysByInput_.end() && input->second == keyID) {
+        keysByInput_.erase(input);
+    }
+    unindexedKeys_.erase(keyID);
+    for (auto& term : metadata->indexTerms) {
+        auto attr = keysByAttribute_.find(term);
+        if (attr != keysByAttribute_.end()) {
+            attr->second.erase(keyID);
+            if (attr->second.empty()) {
+                keysByAttribute_.erase(attr);
+            }
+        }
+    }
+    keyMetadata_.erase(md);
+}
+
+// the key input type that can be tested against a functional input of 'type'
+static OpenABEFunctionInputType getTargetInputType(OpenABEFunctionInputType type) {
+    /* filter keys based on opposite of 'type' */
+    if(type == FUNC_POLICY_INPUT)
+        return FUNC_ATTRLIST_INPUT;
+    else if(type == FUNC_ATTRLIST_INPUT)
+        return FUNC_POLICY_INPUT;
+    return FUNC_INVALID_INPUT;
+}
+
 vector<string>
 OpenABEKeystoreManager::filterKeys(const string& userId, OpenABEFunctionInputType type) {
     vector<string> keyList;
-    OpenABEFunctionInputType target_type;
-    OpenABEMetadata tmp;
     if (userId == "") {
         /* return an empty key list */
         return keyList;
     }
 
-    /* filter keys based on opposite of 'type' */
-    if(type == FUNC_POLICY_INPUT)
-        target_type = FUNC_ATTRLIST_INPUT;
-    else if(type == FUNC_ATTRLIST_INPUT)
-        target_type = FUNC_POLICY_INPUT;
-    else
-        target_type = FUNC_INVALID_INPUT;
-
-    map<string,OpenABEMetadata>::iterator it;
-    for(it = keyMetadata_.begin(); it != keyMetadata_.end(); it++) {
-        if (it->second->inputType == target_type) {
-            if (userId.compare(it->second->userId) == 0) {
-                // if user Id set and matches the Id on the key metadata
-                // cout << "Filter keys for: " << currentUserId_ << endl;
-                keyList.push_back(it->first);
-             }
+    OpenABEFunctionInputType target_type = getTargetInputType(type);
+    auto user = keysByUser_.find(userId);
+    if (user == keysByUser_.end()) {
+        return keyList;
+    }
+    for (auto& keyID : user->second) {
+        if (keyMetadata_.at(keyID)->inputType == target_type) {
+            keyList.push_back(keyID);
         }
     }
-
     return keyList;
 }
 
 vector<string>
-OpenABEKeystoreManager::getKeyIds(const std::string& userId, uint64_t currentTime) {
+OpenABEKeystoreManager::candidateKeys(const string& userId, OpenABEFunctionInput *funcInput) {
     vector<string> keyList;
-    OpenABEMetadata tmp;
-
-    map<string,OpenABEMetadata>::iterator it;
-    for(it = keyMetadata_.begin(); it != keyMetadata_.end(); it++) {
-        if(userId.compare(it->second->userId) == 0) {
-            if (currentTime == 0)
-               keyList.push_back(it->first);
-            else if (currentTime >= it->second->keyExpirationDate)
-               keyList.push_back(it->first);
-        } else {
-            // try to find expired keys (regardless of userId matching)
-            if (currentTime > 0 && currentTime >= it->second->keyExpirationDate) {
-                keyList.push_back(it->first);
-            }
+    if (userId == "" || keysByUser_.count(userId) == 0) {
+        return keyList;
+    }
+
+    OpenABEFunctionInputType target_type = getTargetInputType(funcInput->getFunctionType());
+    vector<string> terms = getIndexTerms(funcInput);
+    if (terms.empty()) {
+        // nothing to look up with, test every key of the user
+        return filterKeys(userId, funcInput->getFunctionType());
+    }
+
+    // keys sharing at least one attribute, plus keys we could not index
+    // (kept in key ID order, as filterKeys returns them)
+    set<string> candidates = unindexedKeys_;
+    for (auto& term : terms) {
+        auto attr = keysByAttribute_.find(term);
+        if (attr != keysByAttribute_.end()) {
+            candidates.insert(attr->second.begin(), attr->second.end());
+        }
+    }
+    for (auto& keyID : candidates) {
+        const OpenABEMetadata& metadata = keyMetadata_.at(keyID);
+        if (metadata->inputType == target_type && userId.compare(metadata->userId) == 0) {
+            keyList.push_back(keyID);
         }
     }
     return keyList;
 }
 
+vector<string>
+OpenABEKeystoreManager::getKeyIds(const std::string& userId, uint64_t currentTime) {
+    set<string> keyList;
+    if (currentTime == 0) {
+        auto user = keysByUser_.find(userId);
+        if (user != keysByUser_.end()) {
+            keyList = user->second;
+        }
+    } else {
+        // expired keys (regardless of userId matching); 0 means no expiry
+        for (auto it = keysByExpiration_.lower_bound(make_pair((uint64_t)1, string()));
+             it != keysByExpiration_.end() && it->first <= currentTime; ++it) {
+            keyList.insert(it->second);
+        }
+    }
+    return vector<string>(keyList.begin(), keyList.end());
+}
+
 void
-OpenABEKeystoreManager::rankKeyAlgorithm(vector<string>& keyIDs, OpenABEKeyQuery* query) {
-    /* do nothing for now */
-    return;
+OpenABEKeystoreManager::rankKeyAlgorithm(vector<KeyRef>& satKeys, OpenABEKeyQuery* query) {
+    // cheapest decrypt first; between equals, the smaller key (less to
+    // load and parse), then key ID so the choice doesn't depend on order
+    std::sort(satKeys.begin(), satKeys.end(),
+              [this](const KeyRef& left, const KeyRef& right) {
+        const OpenABEMetadata& l = keyMetadata_.at(left.first);
+        const OpenABEMetadata& r = keyMetadata_.at(right.first);
+        uint64_t lCost = getDecryptCost(l, left.second), rCost = getDecryptCost(r, right.second);
+        if (lCost != rCost) {
+            return lCost < rCost;
+        }
+        if (l->keyRows != r->keyRows) {
+            return l->keyRows < r->keyRows;
+        }
+        return left.first < right.first;
+    });
 }
 
-struct key_ref_compare {
-    bool operator()(const std::pair<string,int> &left, const std::pair<string,int> &right) {
-        return (left.second < right.second);
+bool
+OpenABEKeystoreManager::getRankedKey(const string& cacheKey, string& keyID) {
+    std::lock_guard<std::mutex> lock(rankCacheLock_);
+    auto it = rankCache_.find(cacheKey);
+    if (it == rankCache_.end()) {
+        return false;
     }
-};
+    keyID = it->second;
+    return true;
+}
+
+void
+OpenABEKeystoreManager::cacheRankedKey(const string& cacheKey, const string& keyID) {
+    std::lock_guard<std::mutex> lock(rankCacheLock_);
+    if (rankCache_.count(cacheKey) != 0) {
+        return;
+    }
+    if (rankCacheOrder_.size() >= KEY_RANK_CACHE_SIZE) {
+        rankCache_.erase(rankCacheOrder_.front());
+        rankCacheOrder_.pop_front();
+    }
+    rankCache_[cacheKey] = keyID;
+    rankCacheOrder_.push_back(cacheKey);
+}
+
+void
+OpenABEKeystoreManager::clearRankedKeys() {
+    std::lock_guard<std::mutex> lock(rankCacheLock_);
+    rankCache_.clear();
+    rankCacheOrder_.clear();
+}
 
 pair<bool,int>
 OpenABEKeystoreManager::testAKey(OpenABEMetadata& key, OpenABEFunctionInput* funcInput) {
@@ -257,6 +850,12 @@ OpenABEKeystoreManager::testAKey(OpenABEMetadata& key, OpenABEFunctionInput* fun
             funcInput->getFunctionType() == FUNC_ATTRLIST_INPUT) {
         policy = (OpenABEPolicy *) key->input.get();
         attr_list = (OpenABEAttributeList *) funcInput;
+        if (policy->getCompiledLSSS() == nullptr) {
+            // without a compiled form the check marks the tree, and other
+            // searches may be reading this key concurrently
+            OpenABEPolicy copy(*policy);
+            return checkIfSatisfied(&copy, attr_list);
+        }
     }
     else {
         /* throw an error - invalid input on either key or ciphertext (most likely ciphertext) */
@@ -268,8 +867,9 @@ OpenABEKeystoreManager::testAKey(OpenABEMetadata& key, OpenABEFunctionInput* fun
 
 const std::string
 OpenABEKeystoreManager::searchKeyCommand(OpenABEKeyQuery* query, OpenABEFunctionInput *func_input) {
-    // call search key on the functional input
-    std::lock_guard<std::mutex> lock(ks_lock_);
+    // call search key on the functional input (searches only read the
+    // metadata, so any number of them run side by side)
+    OpenABESharedLockGuard lock(ks_lock_);
     return searchKey(query, func_input);
 }
 
@@ -281,7 +881,7 @@ OpenABEKeystoreManager::deleteKeyCommand(OpenABEKeyQuery* query) {
         return keyList;
     }
 
-    std::lock_guard<std::mutex> lock(ks_lock_);
+    std::lock_guard<OpenABERWLock> lock(ks_lock_);
     keyList = getKeyIds(query->userId, query->currentTime);
 
     if (query->currentTime > 0) {
@@ -297,10 +897,79 @@ OpenABEKeystoreManager::deleteKeyCommand(OpenABEKeyQuery* query) {
     for (size_t i = 0; i < keyList.size(); i++) {
         //cout << "Delete key with Id: " << keyList[i] << " for " << query->userId << endl;
         this->deleteKey(keyList[i]);
+        this->dropKey(keyList[i]);
     }
     return keyList;
 }
 
+size_t
+OpenABEKeystoreManager::evictExpiredKeys(uint64_t currentTime) {
+    if (currentTime == 0) {
+        currentTime = (uint64_t)time(NULL);
+    }
+    std::lock_guard<OpenABERWLock> lock(ks_lock_);
+    size_t evicted = 0;
+    // the expiration index is ordered, so this only visits expired keys
+    auto it = keysByExpiration_.lower_bound(make_pair((uint64_t)1, string()));
+    while (it != keysByExpiration_.end() && it->first <= currentTime) {
+        const string keyID = it->second;
+        ++it;
+        auto md = keyMetadata_.find(keyID);
+        if (md != keyMetadata_.end()) {
+            evictionStats_.bytesZeroized += md->second->keyBlob.size();
+            md->second->keyBlob.zeroize();
+        }
+        this->deleteKey(keyID);
+        this->dropKey(keyID);
+        evicted++;
+    }
+    evictionStats_.sweeps++;
+    evictionStats_.keysEvicted += evicted;
+    evictionStats_.lastSweepTime = currentTime;
+    evictionStats_.lastSweepKeys = evicted;
+    return evicted;
+}
+
+void
+OpenABEKeystoreManager::startEvictionThread(unsigned int intervalSeconds) {
+    stopEvictionThread();
+    if (intervalSeconds == 0) {
+        intervalSeconds = 1;
+    }
+    sweeperStop_ = false;
+    sweeper_ = std::thread([this, intervalSeconds]() {
+        std::unique_lock<std::mutex> lock(sweeperLock_);
+        while (!sweeperStop_) {
+            if (sweeperWake_.wait_for(lock, std::chrono::seconds(intervalSeconds),
+                                      [this]() { return sweeperStop_; })) {
+                break;
+            }
+            // searches and stores go on while the pass waits for the lock
+            lock.unlock();
+            evictExpiredKeys();
+            lock.lock();
+        }
+    });
+}
+
+void
+OpenABEKeystoreManager::stopEvictionThread() {
+    {
+        std::lock_guard<std::mutex> lock(sweeperLock_);
+        sweeperStop_ = true;
+    }
+    sweeperWake_.notify_all();
+    if (sweeper_.joinable()) {
+        sweeper_.join();
+    }
+}
+
+OpenABEEvictionStats
+OpenABEKeystoreManager::getEvictionStats() {
+    OpenABESharedLockGuard lock(ks_lock_);
+    return evictionStats_;
+}
+
 const string
 OpenABEKeystoreManager::searchKey(OpenABEKeyQuery* query, OpenABEFunctionInput *funcInput) {
     if (query == NULL || funcInput == NULL) {
@@ -308,14 +977,30 @@ OpenABEKeystoreManager::searchKey(OpenABEKeyQuery* query, OpenABEFunctionInput *
         return "";
     }
     vector<KeyRef> satKeys;
+    string cacheKey, keyID;
+    if (query->isEfficient) {
+        // the cheapest key for this input doesn't change until a key is
+        // added or removed, and those clear the cache
+        cacheKey = getInputIndexKey(query->userId, funcInput);
+        if (getRankedKey(cacheKey, keyID)) {
+            return keyID;
+        }
+    }
+    if (funcInput->getFunctionType() == FUNC_POLICY_INPUT &&
+        ((OpenABEPolicy *)funcInput)->getCompiledLSSS() == nullptr) {
+        // compile the ciphertext policy once rather than once per key
+        try {
+            OpenABEPolicy *policy = (OpenABEPolicy *)funcInput;
+            policy->setCompiledLSSS(make_shared<const OpenABELSSSCompiledPolicy>(policy));
+        } catch (OpenABE_ERROR &) {
+        }
+    }
     // initial set of keys that are available that could satisfy the input ciphertext
-    vector<string> keyRefs = filterKeys(query->userId, funcInput->getFunctionType());
-    // rank/sort keys based on the contents of the query
-    rankKeyAlgorithm(keyRefs, query);
+    vector<string> keyRefs = candidateKeys(query->userId, funcInput);
     // test and evaluat each key
     for(size_t i = 0; i < keyRefs.size(); i++) {
         assert(keyMetadata_.count(keyRefs[i]) != 0);
-        pair<bool,int> result = testAKey(keyMetadata_[keyRefs[i]], funcInput);
+        pair<bool,int> result = testAKey(keyMetadata_.at(keyRefs[i]), funcInput);
         bool is_satisfied = result.first;
         if (is_satisfied) {
             /* returns the key identifier that satisfies the query */
@@ -332,11 +1017,14 @@ OpenABEKeystoreManager::searchKey(OpenABEKeyQuery* query, OpenABEFunctionInput *
 
     // check whether query dictates first satisfied vs. all satisfied
     if(satKeys.size() > 0) {
-        std::sort(satKeys.begin(), satKeys.end(), key_ref_compare());
-        return satKeys[0].first;
+        rankKeyAlgorithm(satKeys, query);
+        keyID = satKeys[0].first;
     }
-    /* error since no key was found -- indicates that a key request needs to be formed */
-    return "";
+    if (query->isEfficient) {
+        cacheRankedKey(cacheKey, keyID);
+    }
+    /* empty if no key was found -- indicates that a key request needs to be formed */
+    return keyID;
 }
 
 /********************************************************************************
@@ -349,10 +1037,18 @@ OpenABEFunctionInputType getFunctionInputType(OpenABEKey *key) {
     switch(scheme_type) {
         case OpenABE_SCHEME_CP_WATERS:
         case OpenABE_SCHEME_CP_WATERS_CCA:
+        case OpenABE_SCHEME_CP_WATERS_HCCA:
+        case OpenABE_SCHEME_CP_FAME:
+        case OpenABE_SCHEME_CP_FAME_CCA:
+        case OpenABE_SCHEME_CP_FAME_HCCA:
+        case OpenABE_SCHEME_CP_WATERS_FD:
+        case OpenABE_SCHEME_CP_WATERS_FD_CCA:
+        case OpenABE_SCHEME_CP_WATERS_FD_HCCA:
             return FUNC_ATTRLIST_INPUT;
             break;
         case OpenABE_SCHEME_KP_GPSW:
         case OpenABE_SCHEME_KP_GPSW_CCA:
+        case OpenABE_SCHEME_KP_GPSW_HCCA:
             return FUNC_POLICY_INPUT;
             break;
         default:
@@ -374,6 +1070,13 @@ unique_ptr<OpenABEFunctionInput> getFunctionInput(OpenABEKey *key) {
     switch(scheme_type) {
         case OpenABE_SCHEME_CP_WATERS:
         case OpenABE_SCHEME_CP_WATERS_CCA:
+        case OpenABE_SCHEME_CP_WATERS_HCCA:
+        case OpenABE_SCHEME_CP_FAME:
+        case OpenABE_SCHEME_CP_FAME_CCA:
+        case OpenABE_SCHEME_CP_FAME_HCCA:
+        case OpenABE_SCHEME_CP_WATERS_FD:
+        case OpenABE_SCHEME_CP_WATERS_FD_CCA:
+        case OpenABE_SCHEME_CP_WATERS_FD_HCCA:
             // attributes are on the key for CP-ABE
             attrList = (OpenABEAttributeList*)key->getComponent("input");
             if (attrList == NULL) {
@@ -384,6 +1087,7 @@ unique_ptr<OpenABEFunctionInput> getFunctionInput(OpenABEKey *key) {
             break;
         case OpenABE_SCHEME_KP_GPSW:
         case OpenABE_SCHEME_KP_GPSW_CCA:
+        case OpenABE_SCHEME_KP_GPSW_HCCA:
             // policy on the key for KP-ABE
             policy_str = key->getByteString("input");
             if (policy_str == NULL) {
@@ -0,0 +1,217 @@
+///
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+///
+/// This file is part of Zeutro's OpenABE.
+///
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+///
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+///
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+///
+/// \file   zkeyring.cpp
+///
+/// \brief  Implementation of the key ring format.
+///
+/// \author J. Ayo Akinyele
+///
+
+#include <cstring>
+#include <openabe/openabe.h>
+
+using namespace std;
+
+namespace oabe {
+
+/*
+ * Key ring layout (all integers big-endian):
+ *   magic (8) || library version (1) || curve (1) || scheme (1) ||
+ *   count (4) || entry || ... || data
+ *   entry:  key ID length (2) || key ID || header length (2) ||
+ *           body length (4) || data offset (8)
+ * A key blob is pack(header) || pack(body), the header being library
+ * version || curve || scheme || UID || ID. The ring keeps the first three
+ * bytes once; data holds the rest of each header followed by the body,
+ * at the entry's offset from the start of data.
+ */
+static const uint8_t keyRingMagic[] = { 'O', 'A', 'B', 'E', 'K', 'R', '0', '1' };
+#define KEY_RING_HEADER_PREFIX_LEN  3
+
+namespace {
+// bounds-checked reads from a buffer the ring does not own
+class RingBytes {
+public:
+  RingBytes(const uint8_t *buf, size_t len) : buf_(buf), left_(len) {}
+
+  size_t left() const { return left_; }
+  const uint8_t *take(size_t n) {
+    if (n > left_) {
+      throw OpenABE_ERROR_INVALID_LENGTH;
+    }
+    const uint8_t *p = buf_;
+    buf_ += n;
+    left_ -= n;
+    return p;
+  }
+
+  uint64_t read(size_t width) {
+    const uint8_t *p = take(width);
+    uint64_t x = 0;
+    for (size_t i = 0; i < width; i++) {
+      x = (x << 8) | p[i];
+    }
+    return x;
+  }
+
+private:
+  const uint8_t *buf_;
+  size_t left_;
+};
+
+void put(OpenABEByteSink &out, uint64_t x, size_t width) {
+  for (size_t i = width; i > 0; i--) {
+    out.push_back((uint8_t)((x >> (8 * (i - 1))) & 0xFF));
+  }
+}
+}
+
+/*!
+ * Write exported key blobs as one key ring.
+ *
+ * @param[in]   the keys and the IDs to import them under.
+ * @param[out]  the key ring (replaces its contents).
+ * @return  OpenABE_NOERROR, OpenABE_ERROR_INVALID_KEY_HEADER if a key is
+ *          not of the version, curve and scheme of the first one, or
+ *          OpenABE_ERROR_INVALID_INPUT for a malformed blob.
+ */
+
+OpenABE_ERROR OpenABE_writeKeyRing(const vector<OpenABEKeyRingEntry> &keys,
+                                   OpenABEByteString &ring) {
+  const size_t count = keys.size();
+  vector<const uint8_t *> header(count), body(count);
+  vector<size_t> headerLen(count), bodyLen(count);
+  try {
+    for (size_t i = 0; i < count; i++) {
+      RingBytes in(keys[i].keyBlob.data(), keys[i].keyBlob.size());
+      headerLen[i] = in.read(4);
+      header[i] = in.take(headerLen[i]);
+      bodyLen[i] = in.read(4);
+      body[i] = in.take(bodyLen[i]);
+      if (in.left() != 0 || headerLen[i] < KEY_RING_HEADER_PREFIX_LEN ||
+          headerLen[i] - KEY_RING_HEADER_PREFIX_LEN > UINT16_MAX ||
+          keys[i].keyID.size() > UINT16_MAX) {
+        return OpenABE_ERROR_INVALID_INPUT;
+      }
+      if (memcmp(header[i], header[0], KEY_RING_HEADER_PREFIX_LEN) != 0) {
+        return OpenABE_ERROR_INVALID_KEY_HEADER;
+      }
+    }
+  } catch (OpenABE_ERROR &) {
+    return OpenABE_ERROR_INVALID_INPUT;
+  }
+
+  ring.clear();
+  OpenABEByteSink out(ring);
+  out.append(keyRingMagic, sizeof(keyRingMagic));
+  if (count > 0) {
+    out.append(header[0], KEY_RING_HEADER_PREFIX_LEN);
+  } else {
+    put(out, 0, KEY_RING_HEADER_PREFIX_LEN);
+  }
+  put(out, count, 4);
+  uint64_t offset = 0;
+  for (size_t i = 0; i < count; i++) {
+    put(out, keys[i].keyID.size(), 2);
+    out.append((const uint8_t *)keys[i].keyID.data(), keys[i].keyID.size());
+    put(out, headerLen[i] - KEY_RING_HEADER_PREFIX_LEN, 2);
+    put(out, bodyLen[i], 4);
+    put(out, offset, 8);
+    offset += headerLen[i] - KEY_RING_HEADER_PREFIX_LEN + bodyLen[i];
+  }
+  for (size_t i = 0; i < count; i++) {
+    out.append(header[i] + KEY_RING_HEADER_PREFIX_LEN,
+               headerLen[i] - KEY_RING_HEADER_PREFIX_LEN);
+    out.append(body[i], bodyLen[i]);
+  }
+  return OpenABE_NOERROR;
+}
+
+/*!
+ * Read the keys of a key ring.
+ *
+ * @param[in]   the key ring and its length.
+ * @param[out]  the keys, with their blobs as they were exported.
+ * @return  OpenABE_NOERROR, or OpenABE_ERROR_INVALID_INPUT if the ring is
+ *          malformed.
+ */
+
+OpenABE_ERROR OpenABE_readKeyRing(const uint8_t *ring, size_t len,
+                                  vector<OpenABEKeyRingEntry> &keys) {
+  keys.clear();
+  if (ring == nullptr) {
+    return OpenABE_ERROR_INVALID_INPUT;
+  }
+  try {
+    RingBytes in(ring, len);
+    if (memcmp(in.take(sizeof(keyRingMagic)), keyRingMagic, sizeof(keyRingMagic)) != 0) {
+      return OpenABE_ERROR_INVALID_INPUT;
+    }
+    const uint8_t *prefix = in.take(KEY_RING_HEADER_PREFIX_LEN);
+    size_t count = in.read(4);
+    // every entry takes at least 16 bytes of the index
+    if (count > in.left() / 16) {
+      return OpenABE_ERROR_INVALID_INPUT;
+    }
+    vector<size_t> headerLen(count), bodyLen(count);
+    vector<uint64_t> offset(count);
+    keys.resize(count);
+    for (size_t i = 0; i < count; i++) {
+      size_t idLen = in.read(2);
+      keys[i].keyID.assign((const char *)in.take(idLen), idLen);
+      headerLen[i] = in.read(2);
+      bodyLen[i] = in.read(4);
+      offset[i] = in.read(8);
+    }
+
+    const uint8_t *data = in.take(in.left());
+    size_t dataLen = len - (data - ring);
+    for (size_t i = 0; i < count; i++) {
+      if (offset[i] > dataLen || headerLen[i] + bodyLen[i] > dataLen - offset[i]) {
+        throw OpenABE_ERROR_INVALID_LENGTH;
+      }
+      OpenABEByteString &blob = keys[i].keyBlob;
+      OpenABEByteSink out(blob);
+      out.reserve(8 + KEY_RING_HEADER_PREFIX_LEN + headerLen[i] + bodyLen[i]);
+      put(out, KEY_RING_HEADER_PREFIX_LEN + headerLen[i], 4);
+      out.append(prefix, KEY_RING_HEADER_PREFIX_LEN);
+      out.append(data + offset[i], headerLen[i]);
+      put(out, bodyLen[i], 4);
+      out.append(data + offset[i] + headerLen[i], bodyLen[i]);
+    }
+  } catch (OpenABE_ERROR &) {
+    for (auto &key : keys) {
+      key.keyBlob.zeroize();
+    }
+    keys.clear();
+    return OpenABE_ERROR_INVALID_INPUT;
+  }
+  return OpenABE_NOERROR;
+}
+
+}
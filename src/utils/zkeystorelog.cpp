@@ -0,0 +1,496 @@
+/// 
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+/// 
+/// This file is part of Zeutro's OpenABE.
+/// 
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+/// 
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+/// 
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+/// 
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+///
+/// \file   zkeystorelog.cpp
+///
+/// \brief  Implementation of the file-backed keystore log.
+///
+/// \author J. Ayo Akinyele
+///
+
+#include <cstring>
+#include <map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#endif
+#include <openabe/openabe.h>
+
+using namespace std;
+
+namespace oabe {
+
+/*
+ * Log layout (all integers big-endian):
+ *   file:    magic (8) || record || record || ...
+ *   record:  header length (4) || header || header checksum (4)
+ *            [|| blob || blob checksum (4)]   (key records only)
+ *   header:  type (1) || ...
+ *     key:     expiration (8) || cached (1) || input type (4) || scheme (4) ||
+ *              curve (4) || key ID length (2) || user ID length (2) ||
+ *              input length (4) || blob length (4) || key ID || user ID || input
+ *     delete:  key ID length (2) || key ID
+ * A checksum is the first 4 bytes of the SHA-256 of what it covers.
+ */
+static const uint8_t keystoreLogMagic[] = { 'O', 'A', 'B', 'E', 'K', 'S', '0', '1' };
+#define KEYSTORE_RECORD_KEY     0x01
+#define KEYSTORE_RECORD_DELETE  0x02
+#define KEYSTORE_CHECKSUM_LEN   4
+#define KEYSTORE_MAX_HEADER_LEN (1 << 24)
+
+static uint32_t keystoreChecksum(const uint8_t *data, size_t len) {
+  uint8_t digest[SHA256_LEN];
+  sha256(digest, (uint8_t *)data, len);
+  return ((uint32_t)digest[0] << 24) | ((uint32_t)digest[1] << 16) |
+         ((uint32_t)digest[2] << 8) | (uint32_t)digest[3];
+}
+
+// bounds-checked big-endian reader over the mapping
+struct KeystoreReader {
+  const uint8_t *ptr;
+  size_t len, pos;
+
+  bool need(size_t n) const { return n <= len - pos; }
+  uint64_t get(size_t n) {
+    uint64_t x = 0;
+    for (size_t i = 0; i < n; i++) {
+      x = (x << 8) | ptr[pos++];
+    }
+    return x;
+  }
+  string getString(size_t n) {
+    string s((const char *)ptr + pos, n);
+    pos += n;
+    return s;
+  }
+};
+
+static void packInt(OpenABEByteString& out, uint64_t x, size_t n) {
+  for (size_t i = n; i > 0; i--) {
+    out.push_back((uint8_t)(x >> (8 * (i - 1))));
+  }
+}
+
+static void packKeyHeader(OpenABEByteString& header, const OpenABEKeystoreRecord& record,
+                          uint32_t blobLen) {
+  header.push_back(KEYSTORE_RECORD_KEY);
+  packInt(header, record.keyExpirationDate, 8);
+  header.push_back(record.isCached ? 1 : 0);
+  packInt(header, (uint32_t)record.inputType, 4);
+  packInt(header, (uint32_t)record.schemeID, 4);
+  packInt(header, (uint32_t)record.curveID, 4);
+  packInt(header, record.keyID.size(), 2);
+  packInt(header, record.userId.size(), 2);
+  packInt(header, record.input.size(), 4);
+  packInt(header, blobLen, 4);
+  header += record.keyID;
+  header += record.userId;
+  header += record.input;
+}
+
+// frame a header as a record and start it in 'out'
+static void packRecord(OpenABEByteString& out, OpenABEByteString& header) {
+  packInt(out, header.size(), 4);
+  out += header;
+  packInt(out, keystoreChecksum(header.data(), header.size()), KEYSTORE_CHECKSUM_LEN);
+}
+
+/********************************************************************************
+ * Implementation of the OpenABEKeystoreLog class
+ ********************************************************************************/
+
+OpenABEKeystoreLog::OpenABEKeystoreLog()
+    : fd_(-1), map_(NULL), mapLen_(0), fileLen_(0) {}
+
+OpenABEKeystoreLog::~OpenABEKeystoreLog() { this->close(); }
+
+/*!
+ * Opens the log at 'path', creating it if it doesn't exist, and replays
+ * it. Only record headers are read; blobs are verified when read.
+ *
+ * @param[in]   path of the log file.
+ * @param[out]  the keys still live at the end of the log, in log order.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR OpenABEKeystoreLog::open(const string& path,
+                                       vector<OpenABEKeystoreRecord>& records) {
+#if defined(_WIN32)
+  return OpenABE_ERROR_NOT_IMPLEMENTED;
+#else
+  std::lock_guard<std::mutex> lock(lock_);
+  records.clear();
+  if (fd_ >= 0) {
+    return OpenABE_ERROR_IN_USE_ALREADY;
+  }
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0600);
+  if (fd < 0) {
+    return OpenABE_ERROR_INVALID_INPUT;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    ::close(fd);
+    return OpenABE_ERROR_INVALID_INPUT;
+  }
+  fd_ = fd;
+  path_ = path;
+  fileLen_ = (uint64_t)st.st_size;
+
+  if (fileLen_ == 0) {
+    OpenABEByteString magic;
+    magic.appendArray((uint8_t *)keystoreLogMagic, sizeof(keystoreLogMagic));
+    OpenABE_ERROR result = this->appendBytes(magic);
+    if (result != OpenABE_NOERROR) {
+      this->unmap();
+      ::close(fd_);
+      fd_ = -1;
+      return result;
+    }
+    return OpenABE_NOERROR;
+  }
+  if (!this->remap() || mapLen_ < sizeof(keystoreLogMagic) ||
+      memcmp(map_, keystoreLogMagic, sizeof(keystoreLogMagic)) != 0) {
+    this->unmap();
+    ::close(fd_);
+    fd_ = -1;
+    return OpenABE_ERROR_INVALID_INPUT;
+  }
+
+  // replay: later records for a key ID replace or delete earlier ones
+  map<string, size_t> live;
+  KeystoreReader in = { map_, mapLen_, sizeof(keystoreLogMagic) };
+  size_t good = in.pos;
+  while (in.need(4)) {
+    const size_t headerLen = in.get(4);
+    if (headerLen == 0 || headerLen > KEYSTORE_MAX_HEADER_LEN ||
+        !in.need(headerLen + KEYSTORE_CHECKSUM_LEN)) {
+      break;
+    }
+    const uint8_t *header = in.ptr + in.pos;
+    KeystoreReader h = { header, headerLen, 0 };
+    in.pos += headerLen;
+    if (in.get(KEYSTORE_CHECKSUM_LEN) != keystoreChecksum(header, headerLen)) {
+      break;
+    }
+
+    const uint8_t type = (uint8_t)h.get(1);
+    string keyID;
+    if (type == KEYSTORE_RECORD_KEY && h.need(8 + 1 + 12 + 4 + 8)) {
+      OpenABEKeystoreRecord record;
+      record.keyExpirationDate = h.get(8);
+      record.isCached = (h.get(1) != 0);
+      record.inputType = (OpenABEFunctionInputType)h.get(4);
+      record.schemeID = (OpenABE_SCHEME)h.get(4);
+      record.curveID = (OpenABECurveID)h.get(4);
+      const size_t idLen = h.get(2), userLen = h.get(2);
+      const size_t inputLen = h.get(4);
+      record.blobLen = (uint32_t)h.get(4);
+      if (!h.need(idLen + userLen + inputLen) ||
+          !in.need((size_t)record.blobLen + KEYSTORE_CHECKSUM_LEN)) {
+        break;
+      }
+      record.keyID = h.getString(idLen);
+      record.userId = h.getString(userLen);
+      record.input = h.getString(inputLen);
+      record.blobOffset = in.pos;
+      // skip the blob without reading it
+      in.pos += record.blobLen + KEYSTORE_CHECKSUM_LEN;
+
+      auto it = live.find(record.keyID);
+      if (it != live.end()) {
+        records[it->second].keyID.clear();
+      }
+      live[record.keyID] = records.size();
+      records.push_back(record);
+    } else if (type == KEYSTORE_RECORD_DELETE && h.need(2)) {
+      const size_t idLen = h.get(2);
+      if (!h.need(idLen)) {
+        break;
+      }
+      keyID = h.getString(idLen);
+      auto it = live.find(keyID);
+      if (it != live.end()) {
+        records[it->second].keyID.clear();
+        live.erase(it);
+      }
+    } else {
+      break;
+    }
+    good = in.pos;
+  }
+
+  // drop superseded entries, then any torn tail so appends start clean
+  size_t n = 0;
+  for (size_t i = 0; i < records.size(); i++) {
+    if (!records[i].keyID.empty()) {
+      if (n != i) {
+        records[n] = records[i];
+      }
+      n++;
+    }
+  }
+  records.resize(n);
+  if (good < fileLen_) {
+    fprintf(stderr, "OpenABEKeystoreLog: dropping %lu bytes of incomplete records\n",
+            (unsigned long)(fileLen_ - good));
+    this->unmap();
+    if (ftruncate(fd_, (off_t)good) != 0) {
+      ::close(fd_);
+      fd_ = -1;
+      records.clear();
+      return OpenABE_ERROR_INVALID_INPUT;
+    }
+    fileLen_ = good;
+    this->remap();
+  }
+  return OpenABE_NOERROR;
+#endif
+}
+
+void OpenABEKeystoreLog::close() {
+  std::lock_guard<std::mutex> lock(lock_);
+  this->unmap();
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+  fileLen_ = 0;
+}
+
+uint64_t OpenABEKeystoreLog::size() {
+  std::lock_guard<std::mutex> lock(lock_);
+  return fileLen_;
+}
+
+/*!
+ * Appends a stored key. The caller's record gets the blob's position
+ * in the log so it can be read back later.
+ *
+ * @param[in/out]   the key's index entry.
+ * @param[in]       the key blob.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR OpenABEKeystoreLog::appendKey(OpenABEKeystoreRecord& record,
+                                            OpenABEByteString& keyBlob) {
+  if (record.keyID.empty() || record.keyID.size() > 0xFFFF ||
+      record.userId.size() > 0xFFFF || keyBlob.size() == 0) {
+    return OpenABE_ERROR_INVALID_INPUT;
+  }
+  OpenABEByteString header, bytes;
+  packKeyHeader(header, record, (uint32_t)keyBlob.size());
+  if (header.size() > KEYSTORE_MAX_HEADER_LEN) {
+    return OpenABE_ERROR_INVALID_LENGTH;
+  }
+  bytes.reserve(4 + header.size() + keyBlob.size() + 2 * KEYSTORE_CHECKSUM_LEN);
+  packRecord(bytes, header);
+  const size_t blobPos = bytes.size();
+  bytes += keyBlob;
+  packInt(bytes, keystoreChecksum(keyBlob.data(), keyBlob.size()), KEYSTORE_CHECKSUM_LEN);
+
+  std::lock_guard<std::mutex> lock(lock_);
+  const uint64_t start = fileLen_;
+  OpenABE_ERROR result = this->appendBytes(bytes);
+  if (result == OpenABE_NOERROR) {
+    record.blobOffset = start + blobPos;
+    record.blobLen = (uint32_t)keyBlob.size();
+  }
+  return result;
+}
+
+OpenABE_ERROR OpenABEKeystoreLog::appendDelete(const string& keyID) {
+  if (keyID.empty() || keyID.size() > 0xFFFF) {
+    return OpenABE_ERROR_INVALID_INPUT;
+  }
+  OpenABEByteString header, bytes;
+  header.push_back(KEYSTORE_RECORD_DELETE);
+  packInt(header, keyID.size(), 2);
+  header += keyID;
+  packRecord(bytes, header);
+
+  std::lock_guard<std::mutex> lock(lock_);
+  return this->appendBytes(bytes);
+}
+
+/*!
+ * Copies a key blob out of the log, checking its checksum. The mapping
+ * is extended first if the blob was appended after it was made.
+ *
+ * @param[in]   offset of the blob in the log.
+ * @param[in]   length of the blob.
+ * @param[out]  the key blob.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR OpenABEKeystoreLog::readBlob(uint64_t blobOffset, uint32_t blobLen,
+                                           OpenABEByteString& keyBlob) {
+  std::lock_guard<std::mutex> lock(lock_);
+  const uint64_t end = blobOffset + blobLen + KEYSTORE_CHECKSUM_LEN;
+  if (fd_ < 0 || end > fileLen_) {
+    return OpenABE_ERROR_INVALID_INPUT;
+  }
+  if (end > mapLen_ && !this->remap()) {
+    return OpenABE_ERROR_OUT_OF_MEMORY;
+  }
+  const uint8_t *blob = map_ + blobOffset;
+  KeystoreReader sum = { blob + blobLen, KEYSTORE_CHECKSUM_LEN, 0 };
+  if (sum.get(KEYSTORE_CHECKSUM_LEN) != keystoreChecksum(blob, blobLen)) {
+    return OpenABE_ERROR_INVALID_KEY_BODY;
+  }
+  keyBlob.clear();
+  keyBlob.appendArray((uint8_t *)blob, blobLen);
+  return OpenABE_NOERROR;
+}
+
+/*!
+ * Rewrites the log with only the given keys, then swaps it in place of
+ * the old one. On success the records point into the new log.
+ *
+ * @param[in/out]   the live keys.
+ * @return  An error code or OpenABE_NOERROR.
+ */
+
+OpenABE_ERROR OpenABEKeystoreLog::compact(vector<OpenABEKeystoreRecord>& records) {
+#if defined(_WIN32)
+  return OpenABE_ERROR_NOT_IMPLEMENTED;
+#else
+  std::lock_guard<std::mutex> lock(lock_);
+  if (fd_ < 0) {
+    return OpenABE_ERROR_INVALID_CONTEXT;
+  }
+  if (mapLen_ < fileLen_ && !this->remap()) {
+    return OpenABE_ERROR_OUT_OF_MEMORY;
+  }
+  const string tmpPath = path_ + ".tmp";
+  int fd = ::open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) {
+    return OpenABE_ERROR_INVALID_INPUT;
+  }
+
+  bool ok = true;
+  vector<uint64_t> offsets(records.size());
+  OpenABEByteString bytes;
+  bytes.appendArray((uint8_t *)keystoreLogMagic, sizeof(keystoreLogMagic));
+  uint64_t written = 0;
+  for (size_t i = 0; ok && i <= records.size(); i++) {
+    if (i < records.size()) {
+      OpenABEKeystoreRecord& record = records[i];
+      if (record.blobOffset + record.blobLen + KEYSTORE_CHECKSUM_LEN > mapLen_) {
+        ok = false;
+        break;
+      }
+      OpenABEByteString header;
+      packKeyHeader(header, record, record.blobLen);
+      packRecord(bytes, header);
+      offsets[i] = written + bytes.size();
+      // the blob and its checksum move over unchanged
+      bytes.appendArray(map_ + record.blobOffset, record.blobLen + KEYSTORE_CHECKSUM_LEN);
+    }
+    // write out in batches rather than one record at a time
+    if (bytes.size() >= (1 << 20) || i == records.size()) {
+      ok = (::write(fd, bytes.data(), bytes.size()) == (ssize_t)bytes.size());
+      written += bytes.size();
+      bytes.clear();
+    }
+  }
+  ok = ok && (fsync(fd) == 0) && (rename(tmpPath.c_str(), path_.c_str()) == 0);
+  if (!ok) {
+    ::close(fd);
+    unlink(tmpPath.c_str());
+    return OpenABE_ERROR_INVALID_INPUT;
+  }
+
+  this->unmap();
+  ::close(fd_);
+  fd_ = fd;
+  fileLen_ = written;
+  for (size_t i = 0; i < records.size(); i++) {
+    records[i].blobOffset = offsets[i];
+  }
+  this->remap();
+  return OpenABE_NOERROR;
+#endif
+}
+
+// caller holds lock_
+OpenABE_ERROR OpenABEKeystoreLog::appendBytes(OpenABEByteString& bytes) {
+#if defined(_WIN32)
+  return OpenABE_ERROR_NOT_IMPLEMENTED;
+#else
+  if (fd_ < 0) {
+    return OpenABE_ERROR_INVALID_CONTEXT;
+  }
+  size_t done = 0;
+  while (done < bytes.size()) {
+    ssize_t n = pwrite(fd_, bytes.data() + done, bytes.size() - done,
+                       (off_t)(fileLen_ + done));
+    if (n <= 0) {
+      // leave the partial record for the next open to cut off
+      return OpenABE_ERROR_INVALID_INPUT;
+    }
+    done += (size_t)n;
+  }
+  if (fdatasync(fd_) != 0) {
+    return OpenABE_ERROR_INVALID_INPUT;
+  }
+  fileLen_ += bytes.size();
+  return OpenABE_NOERROR;
+#endif
+}
+
+// caller holds lock_; maps the whole file as it is now
+bool OpenABEKeystoreLog::remap() {
+#if defined(_WIN32)
+  return false;
+#else
+  this->unmap();
+  if (fileLen_ == 0) {
+    return true;
+  }
+  void *p = mmap(NULL, (size_t)fileLen_, PROT_READ, MAP_SHARED, fd_, 0);
+  if (p == MAP_FAILED) {
+    return false;
+  }
+  map_ = (uint8_t *)p;
+  mapLen_ = (size_t)fileLen_;
+  return true;
+#endif
+}
+
+void OpenABEKeystoreLog::unmap() {
+#if !defined(_WIN32)
+  if (map_ != NULL) {
+    munmap(map_, mapLen_);
+  }
+#endif
+  map_ = NULL;
+  mapLen_ = 0;
+}
+
+}
@@ -0,0 +1,386 @@
+///
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+///
+/// This file is part of Zeutro's OpenABE.
+///
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+///
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+///
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+/// \file   zmetrics.cpp
+///
+/// \brief  Per-thread metric counters and the global registry over them.
+///
+/// \author J. Ayo Akinyele
+///
+
+#include <algorithm>
+#include <set>
+#include <sstream>
+#include <openabe/utils/zmetrics.h>
+
+using namespace std;
+
+namespace oabe {
+
+static const char *metricNames[OpenABE_METRIC_COUNT] = {
+  "pairings", "multi_pairings", "g1_exp", "g2_exp", "gt_exp", "fixed_base_exp",
+  "hash_to_g1", "hash_cache_hits", "hash_cache_misses", "policy_cache_hits",
+  "policy_cache_misses", "plan_cache_hits", "plan_cache_misses",
+  "key_cache_hits", "key_cache_misses", "bytes_encrypted", "bytes_decrypted",
+  "allocations", "allocated_bytes", "accelerated_ops", "points_decoded"
+};
+
+static const char *latencyNames[OpenABE_LATENCY_COUNT] = {
+  "encrypt", "decrypt", "keygen", "import"
+};
+
+const char *OpenABE_metricName(OpenABEMetric metric) {
+  return (metric >= 0 && metric < OpenABE_METRIC_COUNT) ? metricNames[metric] : "unknown";
+}
+
+const char *OpenABE_latencyMetricName(OpenABELatencyMetric metric) {
+  return (metric >= 0 && metric < OpenABE_LATENCY_COUNT) ? latencyNames[metric] : "unknown";
+}
+
+static size_t latencyBucket(uint64_t nanos) {
+  uint64_t micros = nanos / 1000;
+  size_t bucket = 0;
+  while (micros > 0 && bucket < OpenABE_LATENCY_BUCKETS - 1) {
+    micros >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+double OpenABELatencyHistogram::meanMicros() const {
+  return (this->count > 0) ? (this->totalNanos / 1000.0) / this->count : 0;
+}
+
+double OpenABELatencyHistogram::meanPeakBytes() const {
+  return (this->count > 0) ? (double) this->peakBytesTotal / this->count : 0;
+}
+
+double OpenABELatencyHistogram::percentileMicros(double p) const {
+  if (this->count == 0) {
+    return 0;
+  }
+  p = (p < 0) ? 0 : ((p > 1) ? 1 : p);
+  uint64_t rank = (uint64_t) (p * (this->count - 1)) + 1, seen = 0;
+  for (size_t i = 0; i < OpenABE_LATENCY_BUCKETS; i++) {
+    seen += this->buckets[i];
+    if (seen >= rank) {
+      return (double) (1ULL << i);
+    }
+  }
+  return (double) (1ULL << (OpenABE_LATENCY_BUCKETS - 1));
+}
+
+void OpenABEMetricsSnapshot::clear() {
+  for (size_t i = 0; i < OpenABE_METRIC_COUNT; i++) {
+    this->counters[i] = 0;
+  }
+  for (size_t i = 0; i < OpenABE_LATENCY_COUNT; i++) {
+    this->latency[i].count = this->latency[i].totalNanos = 0;
+    this->latency[i].peakBytesTotal = this->latency[i].peakBytesMax = 0;
+    for (size_t b = 0; b < OpenABE_LATENCY_BUCKETS; b++) {
+      this->latency[i].buckets[b] = 0;
+    }
+  }
+}
+
+void OpenABEMetricsSnapshot::add(const OpenABEMetricsSnapshot &other) {
+  for (size_t i = 0; i < OpenABE_METRIC_COUNT; i++) {
+    this->counters[i] += other.counters[i];
+  }
+  for (size_t i = 0; i < OpenABE_LATENCY_COUNT; i++) {
+    this->latency[i].count += other.latency[i].count;
+    this->latency[i].totalNanos += other.latency[i].totalNanos;
+    this->latency[i].peakBytesTotal += other.latency[i].peakBytesTotal;
+    this->latency[i].peakBytesMax = max(this->latency[i].peakBytesMax,
+                                        other.latency[i].peakBytesMax);
+    for (size_t b = 0; b < OpenABE_LATENCY_BUCKETS; b++) {
+      this->latency[i].buckets[b] += other.latency[i].buckets[b];
+    }
+  }
+}
+
+void OpenABEMetricsSnapshot::subtract(const OpenABEMetricsSnapshot &other) {
+  for (size_t i = 0; i < OpenABE_METRIC_COUNT; i++) {
+    this->counters[i] -= other.counters[i];
+  }
+  for (size_t i = 0; i < OpenABE_LATENCY_COUNT; i++) {
+    this->latency[i].count -= other.latency[i].count;
+    this->latency[i].totalNanos -= other.latency[i].totalNanos;
+    this->latency[i].peakBytesTotal -= other.latency[i].peakBytesTotal;
+    for (size_t b = 0; b < OpenABE_LATENCY_BUCKETS; b++) {
+      this->latency[i].buckets[b] -= other.latency[i].buckets[b];
+    }
+  }
+}
+
+string OpenABEMetricsSnapshot::toString() const {
+  stringstream ss;
+  for (size_t i = 0; i < OpenABE_METRIC_COUNT; i++) {
+    ss << metricNames[i] << " " << this->counters[i] << endl;
+  }
+  for (size_t i = 0; i < OpenABE_LATENCY_COUNT; i++) {
+    const OpenABELatencyHistogram &h = this->latency[i];
+    if (h.count == 0) {
+      continue;
+    }
+    ss << latencyNames[i] << " count=" << h.count << " mean_us=" << h.meanMicros()
+       << " p50_us<=" << h.percentileMicros(0.5) << " p99_us<=" << h.percentileMicros(0.99);
+    if (h.peakBytesMax > 0) {
+      ss << " peak_bytes_mean=" << h.meanPeakBytes() << " peak_bytes_max=" << h.peakBytesMax;
+    }
+    ss << endl;
+  }
+  return ss.str();
+}
+
+namespace metrics {
+
+atomic<bool> enabled(false);
+
+// Each thread only ever writes its own block, so an update is a relaxed
+// load and store (no locked instruction); the atomics only make the reads
+// of other threads well defined.
+struct ThreadMetrics {
+  atomic<uint64_t> counters[OpenABE_METRIC_COUNT];
+  atomic<uint64_t> latencyCount[OpenABE_LATENCY_COUNT];
+  atomic<uint64_t> latencyNanos[OpenABE_LATENCY_COUNT];
+  atomic<uint64_t> latencyBuckets[OpenABE_LATENCY_COUNT][OpenABE_LATENCY_BUCKETS];
+  atomic<uint64_t> latencyPeakTotal[OpenABE_LATENCY_COUNT];
+  atomic<uint64_t> latencyPeakMax[OpenABE_LATENCY_COUNT];
+
+  ThreadMetrics();
+  ~ThreadMetrics();
+  void addTo(OpenABEMetricsSnapshot &snapshot) const;
+};
+
+struct MetricsRegistry {
+  mutex lock;
+  set<const ThreadMetrics*> threads;
+  // totals of exited threads, and the totals at the last reset
+  OpenABEMetricsSnapshot retired, baseline;
+};
+
+// never destroyed: threads may exit after static destructors have run
+static MetricsRegistry& registry() {
+  static MetricsRegistry *r = new MetricsRegistry;
+  return *r;
+}
+
+static inline void bump(atomic<uint64_t> &counter, uint64_t n) {
+  counter.store(counter.load(memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+// Plain flags, so the allocation hooks can test them without constructing
+// threadMetrics: set while a hook itself allocates (registering the thread)
+// and once threadMetrics is gone at thread exit.
+static thread_local bool inHook = false, threadExited = false;
+static thread_local int64_t liveBytes = 0, peakLive = 0;
+
+ThreadMetrics::ThreadMetrics() {
+  for (size_t i = 0; i < OpenABE_METRIC_COUNT; i++) {
+    this->counters[i].store(0, memory_order_relaxed);
+  }
+  for (size_t i = 0; i < OpenABE_LATENCY_COUNT; i++) {
+    this->latencyCount[i].store(0, memory_order_relaxed);
+    this->latencyNanos[i].store(0, memory_order_relaxed);
+    this->latencyPeakTotal[i].store(0, memory_order_relaxed);
+    this->latencyPeakMax[i].store(0, memory_order_relaxed);
+    for (size_t b = 0; b < OpenABE_LATENCY_BUCKETS; b++) {
+      this->latencyBuckets[i][b].store(0, memory_order_relaxed);
+    }
+  }
+  MetricsRegistry &r = registry();
+  lock_guard<mutex> guard(r.lock);
+  r.threads.insert(this);
+}
+
+ThreadMetrics::~ThreadMetrics() {
+  threadExited = true;
+  MetricsRegistry &r = registry();
+  lock_guard<mutex> guard(r.lock);
+  this->addTo(r.retired);
+  r.threads.erase(this);
+}
+
+void ThreadMetrics::addTo(OpenABEMetricsSnapshot &snapshot) const {
+  for (size_t i = 0; i < OpenABE_METRIC_COUNT; i++) {
+    snapshot.counters[i] += this->counters[i].load(memory_order_relaxed);
+  }
+  for (size_t i = 0; i < OpenABE_LATENCY_COUNT; i++) {
+    snapshot.latency[i].count += this->latencyCount[i].load(memory_order_relaxed);
+    snapshot.latency[i].totalNanos += this->latencyNanos[i].load(memory_order_relaxed);
+    snapshot.latency[i].peakBytesTotal += this->latencyPeakTotal[i].load(memory_order_relaxed);
+    snapshot.latency[i].peakBytesMax = max(snapshot.latency[i].peakBytesMax,
+                                           this->latencyPeakMax[i].load(memory_order_relaxed));
+    for (size_t b = 0; b < OpenABE_LATENCY_BUCKETS; b++) {
+      snapshot.latency[i].buckets[b] += this->latencyBuckets[i][b].load(memory_order_relaxed);
+    }
+  }
+}
+
+static thread_local ThreadMetrics threadMetrics;
+static thread_local bool inScope = false;
+
+void count(OpenABEMetric metric, uint64_t n) {
+  bump(threadMetrics.counters[metric], n);
+}
+
+bool enterScope() {
+  if (inScope) {
+    return false;
+  }
+  inScope = true;
+  return true;
+}
+
+void leaveScope(OpenABELatencyMetric metric, uint64_t nanos, uint64_t peakBytes) {
+  bump(threadMetrics.latencyCount[metric], 1);
+  bump(threadMetrics.latencyNanos[metric], nanos);
+  bump(threadMetrics.latencyBuckets[metric][latencyBucket(nanos)], 1);
+  bump(threadMetrics.latencyPeakTotal[metric], peakBytes);
+  if (peakBytes > threadMetrics.latencyPeakMax[metric].load(memory_order_relaxed)) {
+    threadMetrics.latencyPeakMax[metric].store(peakBytes, memory_order_relaxed);
+  }
+  inScope = false;
+}
+
+void allocated(size_t bytes) {
+  if (inHook || threadExited || !OpenABE_metricsEnabled()) {
+    return;
+  }
+  inHook = true;
+  bump(threadMetrics.counters[OpenABE_METRIC_ALLOCATIONS], 1);
+  bump(threadMetrics.counters[OpenABE_METRIC_ALLOCATED_BYTES], bytes);
+  inHook = false;
+  liveBytes += bytes;
+  if (liveBytes > peakLive) {
+    peakLive = liveBytes;
+  }
+}
+
+void freed(size_t bytes) {
+  // a block may be freed by another thread than the one that allocated it,
+  // so a thread's live bytes can go negative; only differences matter
+  if (OpenABE_metricsEnabled()) {
+    liveBytes -= bytes;
+  }
+}
+
+PeakMark markPeak() {
+  PeakMark mark = { peakLive, liveBytes };
+  peakLive = liveBytes;
+  return mark;
+}
+
+uint64_t peakSince(const PeakMark &mark) {
+  int64_t peak = peakLive - mark.startLive;
+  peakLive = max(peakLive, mark.savedPeak);
+  return (peak > 0) ? (uint64_t) peak : 0;
+}
+
+void readThread(uint64_t counters[OpenABE_METRIC_COUNT]) {
+  for (size_t i = 0; i < OpenABE_METRIC_COUNT; i++) {
+    counters[i] = threadMetrics.counters[i].load(memory_order_relaxed);
+  }
+}
+
+static void total(MetricsRegistry &r, OpenABEMetricsSnapshot &snapshot) {
+  snapshot = r.retired;
+  for (const ThreadMetrics *t : r.threads) {
+    t->addTo(snapshot);
+  }
+}
+
+}
+
+void OpenABE_setMetricsEnabled(bool enabled) {
+  metrics::enabled.store(enabled);
+}
+
+void OpenABE_getMetrics(OpenABEMetricsSnapshot &snapshot) {
+  metrics::MetricsRegistry &r = metrics::registry();
+  lock_guard<mutex> guard(r.lock);
+  metrics::total(r, snapshot);
+  snapshot.subtract(r.baseline);
+}
+
+void OpenABE_resetMetrics() {
+  // counters are only ever written by their own thread, so a reset moves
+  // the baseline instead of clearing them
+  metrics::MetricsRegistry &r = metrics::registry();
+  lock_guard<mutex> guard(r.lock);
+  metrics::total(r, r.baseline);
+}
+
+void OpenABEMetricsCollector::add(const uint64_t counters[OpenABE_METRIC_COUNT],
+                                  OpenABELatencyMetric metric, uint64_t nanos,
+                                  uint64_t peakBytes) {
+  lock_guard<mutex> guard(this->lock_);
+  for (size_t i = 0; i < OpenABE_METRIC_COUNT; i++) {
+    this->totals_.counters[i] += counters[i];
+  }
+  OpenABELatencyHistogram &h = this->totals_.latency[metric];
+  h.count++;
+  h.totalNanos += nanos;
+  h.buckets[latencyBucket(nanos)]++;
+  h.peakBytesTotal += peakBytes;
+  h.peakBytesMax = max(h.peakBytesMax, peakBytes);
+}
+
+void OpenABEMetricsCollector::snapshot(OpenABEMetricsSnapshot &snapshot) {
+  lock_guard<mutex> guard(this->lock_);
+  snapshot = this->totals_;
+}
+
+void OpenABEMetricsCollector::reset() {
+  lock_guard<mutex> guard(this->lock_);
+  this->totals_.clear();
+}
+
+void OpenABEMetricsScope::start() {
+  if (this->collector_ != nullptr) {
+    metrics::readThread(this->before_);
+  }
+  this->peak_ = metrics::markPeak();
+  this->start_ = chrono::steady_clock::now();
+}
+
+void OpenABEMetricsScope::finish() {
+  uint64_t nanos = (uint64_t) chrono::duration_cast<chrono::nanoseconds>(
+      chrono::steady_clock::now() - this->start_).count();
+  uint64_t peakBytes = metrics::peakSince(this->peak_);
+  metrics::leaveScope(this->metric_, nanos, peakBytes);
+  if (this->collector_ != nullptr) {
+    uint64_t after[OpenABE_METRIC_COUNT];
+    metrics::readThread(after);
+    for (size_t i = 0; i < OpenABE_METRIC_COUNT; i++) {
+      after[i] -= this->before_[i];
+    }
+    this->collector_->add(after, this->metric_, nanos, peakBytes);
+  }
+}
+
+}
@@ -0,0 +1,143 @@
+///
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+///
+/// This file is part of Zeutro's OpenABE.
+///
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+///
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+///
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+///
+/// \file   zperiodtree.cpp
+///
+/// \brief  Implementation of the binary tree of time period attributes.
+///
+/// \author J. Ayo Akinyele
+///
+
+#include <memory>
+#include <sstream>
+#include <openabe/openabe.h>
+
+using namespace std;
+
+namespace oabe {
+
+OpenABEPeriodTree::OpenABEPeriodTree(const string &prefix, uint32_t depth,
+                                     uint32_t periodDays)
+    : prefix_(prefix), depth_(depth), periodDays_(periodDays) {
+  if (prefix.empty() || prefix.find(COLON) != string::npos ||
+      depth == 0 || depth > TIME_BITS || periodDays == 0) {
+    throw OpenABE_ERROR_INVALID_INPUT;
+  }
+}
+
+uint32_t OpenABEPeriodTree::periodOf(const string &date) const {
+  // {Month} {Day}, {Year}, checked like a date in a policy
+  istringstream in(date);
+  string month;
+  uint32_t day = 0, year = 0;
+  char comma = 0;
+  if (!(in >> month >> day >> comma >> year) || comma != ',' || !(in >> ws).eof()) {
+    throw OpenABE_ERROR_INVALID_DATE_SPECIFIED;
+  }
+  unique_ptr<OpenABEUInteger> m(get_month(month)), d(create_flexint(day)),
+      y(create_flexint(year));
+  return this->periodOfDay(validate_date(this->prefix_, m.get(), d.get(), y.get()));
+}
+
+uint32_t OpenABEPeriodTree::periodOfDay(uint32_t days) const {
+  uint32_t period = days / this->periodDays_;
+  if (period >= this->size()) {
+    throw OpenABE_ERROR_INVALID_DATE_SPECIFIED;
+  }
+  return period;
+}
+
+uint64_t OpenABEPeriodTree::periodEnd(uint32_t period) const {
+  return ((uint64_t)period + 1) * this->periodDays_ * 60 * 60 * 24;
+}
+
+string OpenABEPeriodTree::nodeAttribute(uint32_t level, uint32_t index) const {
+  string node = this->prefix_ + COLON;
+  for (uint32_t bit = level; bit > 0; bit--) {
+    node += ((index >> (bit - 1)) & 1) ? '1' : '0';
+  }
+  node.append(this->depth_ - level, 'x');
+  return node;
+}
+
+vector<string> OpenABEPeriodTree::pathNodes(uint32_t period) const {
+  if (period >= this->size()) {
+    throw OpenABE_ERROR_INVALID_INPUT;
+  }
+  vector<string> nodes;
+  nodes.reserve(this->depth_ + 1);
+  for (uint32_t level = 0; level <= this->depth_; level++) {
+    nodes.push_back(this->nodeAttribute(level, period >> (this->depth_ - level)));
+  }
+  return nodes;
+}
+
+vector<string> OpenABEPeriodTree::coverNodes(uint32_t first, uint32_t last) const {
+  if (first > last || last >= this->size()) {
+    throw OpenABE_ERROR_INVALID_RANGE_NUMBERS;
+  }
+  // walk down from the root: a node inside [first, last] is taken whole,
+  // one that only overlaps it is split into its children
+  vector<string> nodes;
+  vector<pair<uint32_t, uint32_t>> pending(1, make_pair(0, 0));
+  while (!pending.empty()) {
+    uint32_t level = pending.back().first, index = pending.back().second;
+    pending.pop_back();
+    uint32_t shift = this->depth_ - level;
+    uint64_t lo = (uint64_t)index << shift, hi = (((uint64_t)index + 1) << shift) - 1;
+    if (hi < first || lo > last) {
+      continue;
+    }
+    if (lo >= first && hi <= last) {
+      nodes.push_back(this->nodeAttribute(level, index));
+      continue;
+    }
+    // right child first, so nodes come out in period order
+    pending.push_back(make_pair(level + 1, 2 * index + 1));
+    pending.push_back(make_pair(level + 1, 2 * index));
+  }
+  return nodes;
+}
+
+string OpenABEPeriodTree::policy(uint32_t period) const {
+  vector<string> nodes = this->pathNodes(period);
+  string clause = "(";
+  for (size_t i = 0; i < nodes.size(); i++) {
+    clause += (i == 0 ? "" : " or ") + nodes[i];
+  }
+  return clause + ")";
+}
+
+string OpenABEPeriodTree::attributes(uint32_t first, uint32_t last) const {
+  string attrs;
+  for (auto &node : this->coverNodes(first, last)) {
+    attrs += ATTR_SEP + node;
+  }
+  return attrs;
+}
+
+}
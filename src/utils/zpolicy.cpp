@@ -37,7 +37,10 @@
 #include <stdlib.h>
 #include <iostream>
 #include <fstream>
+#include <list>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <openabe/openabe.h>
 
 using namespace std;
@@ -53,7 +56,8 @@ namespace oabe {
  */
 
 OpenABEPolicy::OpenABEPolicy() : OpenABEFunctionInput(),
-        m_rootNode(nullptr), m_hasDuplicates(false), m_enabledRevocation(false) {
+        m_rootNode(nullptr), m_hasDuplicates(false), m_enabledRevocation(false),
+        m_isCanonical(false) {
 	this->m_Type = FUNC_POLICY_INPUT;
 }
 
@@ -73,11 +77,14 @@ OpenABEPolicy::OpenABEPolicy(const OpenABEPolicy &copy): OpenABEFunctionInput()
   }
   this->m_hasDuplicates       = copy.m_hasDuplicates;
   this->m_enabledRevocation   = copy.m_enabledRevocation;
+  this->m_isCanonical         = copy.m_isCanonical;
+  this->m_compiledLSSS        = copy.m_compiledLSSS;
   this->m_attrDuplicateCount  = copy.m_attrDuplicateCount;
   this->m_attrCompleteSet     = copy.m_attrCompleteSet;
   this->m_prefixSet           = copy.m_prefixSet;
   this->m_Type                = copy.m_Type;
   this->m_originalInputString = copy.m_originalInputString;
+  this->m_canonicalString     = copy.m_canonicalString;
 }
 
 /*!
@@ -111,48 +118,205 @@ OpenABEPolicy::ConstructTestPolicy() {
 void
 OpenABEPolicy::setRootNode(OpenABETreeNode* subtree) {
   this->m_rootNode = std::unique_ptr<OpenABETreeNode>(subtree);
+  this->m_isCanonical = false;
+  this->m_compiledLSSS.reset();
+  this->m_canonicalString.clear();
 }
 
 void
 OpenABEPolicy::serialize(OpenABEByteString &result) const {  }
 
-std::unique_ptr<OpenABEPolicy> createPolicyTree(std::string s) {
+// Parsed and canonicalized policies keyed by their input string. Entries are
+// never handed out directly: callers get a copy, since the LSSS marks the
+// tree while it scans it.
+namespace {
+class OpenABEPolicyCache {
+public:
+  OpenABEPolicyCache(size_t capacity) : capacity_(capacity) {}
+
+  std::shared_ptr<const OpenABEPolicy> find(const std::string &s) {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    auto it = this->index_.find(s);
+    if (it == this->index_.end()) {
+      return nullptr;
+    }
+    // move the entry to the front (most recently used)
+    this->entries_.splice(this->entries_.begin(), this->entries_, it->second);
+    return it->second->second;
+  }
+
+  void insert(const std::string &s, std::shared_ptr<const OpenABEPolicy> policy) {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    if (this->capacity_ == 0 || this->index_.count(s) != 0) {
+      return;
+    }
+    this->entries_.emplace_front(s, policy);
+    this->index_[s] = this->entries_.begin();
+    if (this->entries_.size() > this->capacity_) {
+      this->index_.erase(this->entries_.back().first);
+      this->entries_.pop_back();
+    }
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    this->index_.clear();
+    this->entries_.clear();
+  }
+
+  size_t size() {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    return this->entries_.size();
+  }
+
+  std::vector<std::string> inputs() {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    std::vector<std::string> result;
+    for (auto &entry : this->entries_) {
+      result.push_back(entry.first);
+    }
+    return result;
+  }
+
+private:
+  typedef std::list<std::pair<std::string, std::shared_ptr<const OpenABEPolicy>>> EntryList;
+  std::mutex lock_;
+  size_t capacity_;
+  EntryList entries_;
+  std::unordered_map<std::string, EntryList::iterator> index_;
+};
+
+OpenABEPolicyCache& policyCache() {
+  static OpenABEPolicyCache cache(POLICY_CACHE_SIZE);
+  return cache;
+}
+
+// Registered policies keyed by the digest of their canonical string, and the
+// digests keyed by that string. Unlike the cache, entries stay until cleared:
+// a ciphertext that refers to a policy by digest cannot be decrypted without
+// it.
+class OpenABEPolicyDictionary {
+public:
+  void insert(const std::string &canonical, const std::string &digest,
+              std::shared_ptr<const OpenABEPolicy> policy) {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    this->byDigest_[digest] = policy;
+    this->byString_[canonical] = digest;
+  }
+
+  bool findDigest(const std::string &canonical, std::string &digest) {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    auto it = this->byString_.find(canonical);
+    if (it == this->byString_.end()) {
+      return false;
+    }
+    digest = it->second;
+    return true;
+  }
+
+  std::shared_ptr<const OpenABEPolicy> find(const std::string &digest) {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    auto it = this->byDigest_.find(digest);
+    return (it != this->byDigest_.end()) ? it->second : nullptr;
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    this->byDigest_.clear();
+    this->byString_.clear();
+  }
+
+  size_t size() {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    return this->byDigest_.size();
+  }
+
+private:
+  std::mutex lock_;
+  std::unordered_map<std::string, std::shared_ptr<const OpenABEPolicy>> byDigest_;
+  std::unordered_map<std::string, std::string> byString_;
+};
+
+OpenABEPolicyDictionary& policyDictionary() {
+  static OpenABEPolicyDictionary dictionary;
+  return dictionary;
+}
+
+std::string policyDigest(const std::string &canonical) {
+  std::string input(1, (char)POLICY_HASH_FUNCTION);
+  input += canonical;
+  std::string digest;
+  sha256(digest, input);
+  return digest;
+}
+}
+
+// gates only reach their full width once canonicalize() merges and/or
+// chains, so the width limit is checked on the canonical tree, before the
+// LSSS is compiled from it
+static void checkGateWidths(OpenABETreeNode *root, size_t limit) {
+  std::vector<OpenABETreeNode *> pending(1, root);
+  while (!pending.empty()) {
+    OpenABETreeNode *node = pending.back();
+    pending.pop_back();
+    if (node == nullptr || node->getNodeType() == GATE_TYPE_LEAF) {
+      continue;
+    }
+    if (node->getNumSubnodes() > limit) {
+      cerr << "Driver::error gate width exceeds the limit of " << limit << endl;
+      throw OpenABE_ERROR_POLICY_TOO_COMPLEX;
+    }
+    for (uint32_t i = 0; i < node->getNumSubnodes(); i++) {
+      pending.push_back(node->getSubnode(i));
+    }
+  }
+}
+
+static std::unique_ptr<OpenABEPolicy> parsePolicyTree(const std::string &s) {
   oabe::Driver driver(false);
+  driver.parse_input(true, s);
+  std::unique_ptr<OpenABEPolicy> policy = driver.getPolicy();
+  // CRITICAL FIX FOR BUG #15: Always canonicalize policy trees to ensure
+  // deterministic structure for CCA re-encryption verification.
+  // This ensures that createPolicyTree() is idempotent - calling it multiple
+  // times with the same string always produces identical tree structures.
+  if (policy) {
+    OpenABE_TRACE_DEBUG("createPolicyTree: before canonicalize: %s",
+                        policy->toString().c_str());
+    policy->canonicalize();
+    OpenABE_TRACE_DEBUG("createPolicyTree: after canonicalize: %s",
+                        policy->toString().c_str());
+    checkGateWidths(policy->getRootNode(), driver.getLimits().maxGateWidth);
+  }
+  return policy;
+}
+
+std::unique_ptr<OpenABEPolicy> createPolicyTree(std::string s) {
   if(s.size() == 0) {
       return nullptr;
   }
+  std::shared_ptr<const OpenABEPolicy> cached = policyCache().find(s);
+  OpenABE_countMetric(cached ? OpenABE_METRIC_POLICY_CACHE_HITS : OpenABE_METRIC_POLICY_CACHE_MISSES);
+  if (cached != nullptr) {
+    return std::unique_ptr<OpenABEPolicy>(new OpenABEPolicy(*cached));
+  }
   /* construct policy now */
+  OpenABETraceSpan span("policy.parse");
+  span.setItems(s.size());
   try {
-    driver.parse_string(POLICY_PREFIX, s);
-    std::unique_ptr<OpenABEPolicy> policy = driver.getPolicy();
-    // CRITICAL FIX FOR BUG #15: Always canonicalize policy trees to ensure
-    // deterministic structure for CCA re-encryption verification.
-    // This ensures that createPolicyTree() is idempotent - calling it multiple
-    // times with the same string always produces identical tree structures.
+    std::unique_ptr<OpenABEPolicy> policy = parsePolicyTree(s);
     if (policy) {
-      fprintf(stderr, "[ZPOLICY] Before canonicalize: %s\n", policy->toString().c_str());
-      // Print child node order
-      OpenABETreeNode* root = policy->getRootNode();
-      if (root && root->getNumSubnodes() > 0) {
-        fprintf(stderr, "[ZPOLICY] Root node type: %s, children count: %u\n",
-                OpenABETreeNode_ToString((zGateType)root->getNodeType()),
-                root->getNumSubnodes());
-        for (uint32_t i = 0; i < root->getNumSubnodes(); i++) {
-          OpenABETreeNode* child = root->getSubnode(i);
-          fprintf(stderr, "[ZPOLICY]   Child[%u]: %s\n", i, child->getLabel().c_str());
-        }
-      }
-      policy->canonicalize();
-      fprintf(stderr, "[ZPOLICY] After canonicalize: %s\n", policy->toString().c_str());
-      // Print child node order after canonicalization
-      if (root && root->getNumSubnodes() > 0) {
-        fprintf(stderr, "[ZPOLICY] After canonicalization - children count: %u\n",
-                root->getNumSubnodes());
-        for (uint32_t i = 0; i < root->getNumSubnodes(); i++) {
-          OpenABETreeNode* child = root->getSubnode(i);
-          fprintf(stderr, "[ZPOLICY]   Child[%u]: %s\n", i, child->getLabel().c_str());
-        }
+      // compile the secret-sharing layout once; every copy handed out from
+      // the cache shares it. Trees that cannot be shared still parse, and
+      // fail later in the LSSS as before.
+      try {
+        policy->setCompiledLSSS(
+            std::make_shared<const OpenABELSSSCompiledPolicy>(policy.get()));
+      } catch (OpenABE_ERROR &) {
       }
+      // write the canonical string now so that every copy starts with it
+      policy->memoizeString();
+      policyCache().insert(s, std::make_shared<const OpenABEPolicy>(*policy));
     }
     return policy;
   } catch(OpenABE_ERROR & error) {
@@ -161,6 +325,94 @@ std::unique_ptr<OpenABEPolicy> createPolicyTree(std::string s) {
   }
 }
 
+void clearPolicyCache() {
+  policyCache().clear();
+}
+
+size_t getPolicyCacheCount() {
+  return policyCache().size();
+}
+
+std::vector<std::string> getCachedPolicyInputs() {
+  return policyCache().inputs();
+}
+
+bool registerPolicy(const std::string &s, OpenABEByteString *digest) {
+  std::unique_ptr<OpenABEPolicy> policy = createPolicyTree(s);
+  if (policy == nullptr) {
+    return false;
+  }
+  const std::string canonical = policy->toCanonicalString();
+  const std::string hash = policyDigest(canonical);
+  policyDictionary().insert(canonical, hash,
+                            std::make_shared<const OpenABEPolicy>(*policy));
+  if (digest != nullptr) {
+    digest->clear();
+    *digest += hash;
+  }
+  return true;
+}
+
+bool findPolicyDigest(const OpenABEPolicy *policy, OpenABEByteString &digest) {
+  // trees that were never canonicalized may label their rows differently
+  // from the registered tree, so only canonical ones are looked up
+  if (policy == nullptr || !policy->isCanonical()) {
+    return false;
+  }
+  std::string hash;
+  if (!policyDictionary().findDigest(policy->toCanonicalString(), hash)) {
+    return false;
+  }
+  digest.clear();
+  digest += hash;
+  return true;
+}
+
+/*!
+ * The policy component of a CP-ABE ciphertext: the digest of a policy
+ * registered in the policy dictionary (stored as "policyHash"), otherwise
+ * the string below (stored as "policy"). Returns true for a digest.
+ */
+bool policyComponentForCiphertext(const OpenABEPolicy *policy, OpenABEByteString &value) {
+  if (findPolicyDigest(policy, value)) {
+    return true;
+  }
+  value = policyStringForCiphertext(policy);
+  return false;
+}
+
+/*!
+ * The policy string stored in a CP-ABE ciphertext. Decryption parses it
+ * again, so it must give back the same tree and row labels: the original
+ * input does (as for KP-GPSW keys), while canonical strings of gates with
+ * more than two inputs ("k of (...)") cannot be parsed. Trees built without
+ * an input string fall back to the canonical form.
+ */
+std::string policyStringForCiphertext(const OpenABEPolicy *policy) {
+  std::string input = policy->toCompactString();
+  if (input.empty()) {
+    return policy->toCanonicalString();
+  }
+  return input;
+}
+
+std::unique_ptr<OpenABEPolicy> createPolicyTreeFromDigest(const OpenABEByteString &digest) {
+  std::shared_ptr<const OpenABEPolicy> entry =
+      policyDictionary().find(const_cast<OpenABEByteString &>(digest).toString());
+  if (entry == nullptr) {
+    return nullptr;
+  }
+  return std::unique_ptr<OpenABEPolicy>(new OpenABEPolicy(*entry));
+}
+
+void clearPolicyDictionary() {
+  policyDictionary().clear();
+}
+
+size_t getPolicyDictionaryCount() {
+  return policyDictionary().size();
+}
+
 unique_ptr<OpenABEPolicy>
 addToRootOfInput(zGateType type, const string attribute, OpenABEPolicy* policy) {
   if (policy == NULL) {
@@ -191,6 +443,9 @@ OpenABEPolicy::operator=(OpenABEPolicy const &rhs) {
     this->m_rootNode.reset();
     // set this rootNode to the rhs and perform copy via OpenABETreeNode class
     this->m_rootNode = std::unique_ptr<OpenABETreeNode>(new OpenABETreeNode(rhs.getRootNode()));
+    this->m_isCanonical = rhs.m_isCanonical;
+    this->m_compiledLSSS = rhs.m_compiledLSSS;
+    this->m_canonicalString = rhs.m_canonicalString;
   }
 
   return *this;
@@ -311,6 +566,13 @@ OpenABETreeNode::OpenABETreeNode(OpenABETreeNode *copy) {
   if(this->m_nodeType == GATE_TYPE_LEAF) {
     this->m_Prefix          = copy->m_Prefix;
     this->m_Label           = copy->m_Label;
+    // the index tells duplicate leaves apart in the LSSS labels
+    this->m_Index           = copy->m_Index;
+    this->m_thresholdValue  = 0;
+    this->m_numSubnodes     = 0;
+    this->m_Mark            = false;
+    this->m_Satisfied       = 0;
+    this->m_Visited         = false;
     return;
   }
 
@@ -344,62 +606,77 @@ OpenABETreeNode::OpenABETreeNode(OpenABETreeNode *copy) {
  */
 string
 OpenABETreeNode::toString() {
-  string op = "";
-  string tree = "";
-  stringstream tmp;
-  /* Initialize threshold to 0 to avoid false positive gcc
-  variable uninitialized warning */
-  int threshold = 0;
-  bool recurse = false;
-  if(this->m_nodeType == GATE_TYPE_LEAF) {
-    if(this->m_Prefix != "") {
-      const string thePrefix = this->m_Prefix + COLON;
-      return thePrefix + this->m_Label;
-    }
-    return this->m_Label;
-  }
+  string tree;
+  tree.reserve(TREE_STRING_RESERVE);
+  this->appendString(tree);
+  return tree;
+}
 
-  switch(this->m_nodeType) {
-    case GATE_TYPE_AND:
-        op = " and ";
-        threshold = this->m_Subnodes.size();
-        recurse = true;
-        break;
-    case GATE_TYPE_OR:
-        op = " or ";
-        threshold = 1;
-        recurse = true;
-        break;
-    case GATE_TYPE_THRESHOLD:
-        tmp << this->m_thresholdValue << " of ";
-        op = tmp.str();
-        break;
-    default:
+/*!
+ * Append the string form of this subtree to 'out' in a single pass over the
+ * tree. The walk keeps its own stack, so deep or wide policies neither
+ * recurse nor build intermediate strings for each subtree.
+ *
+ */
+void
+OpenABETreeNode::appendString(string& out) {
+  // (gate, index of the next subnode to write)
+  std::vector<std::pair<OpenABETreeNode*, uint32_t>> stack;
+  OpenABETreeNode *node = this;
+
+  while (true) {
+    if (node != nullptr) {
+      if (node->m_nodeType == GATE_TYPE_LEAF) {
+        if (node->m_Prefix != "") {
+          out += node->m_Prefix;
+          out += COLON;
+        }
+        out += node->m_Label;
+      } else if (node->m_nodeType != GATE_TYPE_AND &&
+                 node->m_nodeType != GATE_TYPE_OR &&
+                 node->m_nodeType != GATE_TYPE_THRESHOLD) {
         fprintf(stderr, "ERROR: Illegal gate type\n");
-        return "";
-  }
-
-  if(this->m_Subnodes.size() == 2) {
-    tree += "(";
-    if(recurse) {
-      tree += this->m_Subnodes[0]->toString() + op + this->m_Subnodes[1]->toString();
+      } else if (node->m_Subnodes.size() == 2 &&
+                 node->m_nodeType == GATE_TYPE_THRESHOLD) {
+        // two-input threshold gates print no inputs (as they always have)
+        out += "()";
+      } else {
+        if (node->m_Subnodes.size() != 2 &&
+            node->m_nodeType != GATE_TYPE_THRESHOLD) {
+          uint32_t threshold = (node->m_nodeType == GATE_TYPE_AND) ?
+                               node->m_Subnodes.size() : 1;
+          out += to_string(threshold) + " of ";
+        }
+        out += "(";
+        stack.push_back(std::make_pair(node, 0));
+      }
     }
-    tree += ")";
-  }
-  else {
-    if(this->m_nodeType == GATE_TYPE_AND || this->m_nodeType == GATE_TYPE_OR) {
-      tmp << threshold << " of ";
-      tree = tmp.str();
+
+    // write the separator before the next subnode of the innermost open
+    // gate, or close the gate once all of its subnodes are written
+    node = nullptr;
+    while (!stack.empty()) {
+      OpenABETreeNode *gate = stack.back().first;
+      uint32_t next = stack.back().second;
+      if (next < gate->m_Subnodes.size()) {
+        if (next > 0) {
+          if (gate->m_Subnodes.size() != 2) {
+            out += ", ";
+          } else {
+            out += (gate->m_nodeType == GATE_TYPE_AND) ? " and " : " or ";
+          }
+        }
+        stack.back().second++;
+        node = gate->m_Subnodes[next];
+        break;
+      }
+      out += ")";
+      stack.pop_back();
     }
-    tree += "(";
-    for (uint32_t i = 0; i < this->m_Subnodes.size(); i++) {
-      tree += this->m_Subnodes[i]->toString() + ", ";
+    if (node == nullptr) {
+      return;
     }
-    tree.erase(tree.size()-2, tree.size());
-    tree += ")";
   }
-
-  return tree;
 }
 
 /*
@@ -520,6 +797,35 @@ std::vector<std::string> split(const std::string &s, char delim) {
  * Canonicalization implementation
  ********************************************************************************/
 
+/*!
+ * Helper: Check whether a node is an AND/OR gate with exactly one input.
+ * Such a gate is equivalent to its input.
+ */
+static bool
+isSingleInputGate(OpenABETreeNode* node) {
+  return node != nullptr && node->getNumSubnodes() == 1 &&
+         (node->getNodeType() == GATE_TYPE_AND ||
+          node->getNodeType() == GATE_TYPE_OR);
+}
+
+/*!
+ * Helper: Check whether a subtree contains a threshold gate. toString() does
+ * not print the threshold value, so such subtrees cannot be compared by
+ * their string form.
+ */
+static bool
+hasThresholdGate(OpenABETreeNode* node) {
+  if (node->getNodeType() == GATE_TYPE_THRESHOLD) {
+    return true;
+  }
+  for (uint32_t i = 0; i < node->getNumSubnodes(); i++) {
+    if (hasThresholdGate(node->getSubnode(i))) {
+      return true;
+    }
+  }
+  return false;
+}
+
 /*!
  * Generate a canonical string representation of the policy.
  * The canonical form ensures that logically equivalent policies
@@ -530,6 +836,9 @@ OpenABEPolicy::toCanonicalString() const {
   if (!this->m_rootNode) {
     return "";
   }
+  if (this->m_isCanonical) {
+    return this->toString();
+  }
 
   // Create a deep copy of the policy tree
   OpenABEPolicy canonical_copy(*this);
@@ -551,7 +860,23 @@ OpenABEPolicy::canonicalize() {
     return;
   }
 
+  if (this->m_isCanonical) {
+    return;
+  }
+  this->m_canonicalString.clear();
   canonicalizeNode(this->m_rootNode.get());
+  // absorption can leave the root as a single-input gate
+  OpenABETreeNode* root = this->m_rootNode.get();
+  while (isSingleInputGate(root)) {
+    OpenABETreeNode* child = root->getSubnode(0);
+    root->replaceSubnodes(std::vector<OpenABETreeNode*>());
+    this->m_rootNode.reset(child);
+    root = child;
+  }
+  renumberLeaves();
+  this->m_isCanonical = true;
+  // the tree may have been reordered
+  this->m_compiledLSSS.reset();
 }
 
 /*!
@@ -573,13 +898,171 @@ OpenABEPolicy::canonicalizeNode(OpenABETreeNode* node) {
     canonicalizeNode(node->getSubnode(i));
   }
 
-  // Then flatten associative operators if possible
+  // Then flatten associative operators if possible, including those
+  // exposed by inputs that simplified down to a single-input gate
+  collapseSingleInputGates(node);
   flattenAssociative(node);
 
+  // Drop duplicate and absorbed inputs before the tree is shared
+  absorbRedundant(node);
+
   // Finally, sort children for commutative operators
   sortChildren(node);
 }
 
+/*!
+ * Helper: Number repeated leaves in the order in which toString() prints
+ * them, and rebuild the duplicate info from the final tree. This makes the
+ * LSSS row labels a function of the canonical tree alone: they match what
+ * parsing the canonical string yields, and leaves dropped by absorbRedundant
+ * no longer count as duplicates.
+ */
+void
+OpenABEPolicy::renumberLeaves() {
+  std::map<std::string, int> counts;
+  std::stack<OpenABETreeNode*> stack;
+  stack.push(this->m_rootNode.get());
+
+  while (!stack.empty()) {
+    OpenABETreeNode* node = stack.top();
+    stack.pop();
+    if (node->getNodeType() == GATE_TYPE_LEAF) {
+      int& count = counts[node->getCompleteLabel()];
+      node->setIndex(count++);
+      continue;
+    }
+    // push in reverse so the leftmost subnode is visited first
+    for (uint32_t i = node->getNumSubnodes(); i > 0; i--) {
+      stack.push(node->getSubnode(i - 1));
+    }
+  }
+
+  this->m_attrDuplicateCount.clear();
+  this->m_attrCompleteSet.clear();
+  for (auto& it : counts) {
+    if (it.second > 1) {
+      this->m_attrDuplicateCount[it.first] = it.second;
+    }
+    this->m_attrCompleteSet.insert(it.first);
+  }
+  this->m_hasDuplicates = !this->m_attrDuplicateCount.empty();
+}
+
+/*!
+ * Helper: Replace every single-input AND/OR child with its input.
+ * For example: (a or (and b)) -> (a or b)
+ */
+void
+OpenABEPolicy::collapseSingleInputGates(OpenABETreeNode* node) {
+  std::vector<OpenABETreeNode*> new_children;
+  bool changed = false;
+
+  for (uint32_t i = 0; i < node->getNumSubnodes(); i++) {
+    OpenABETreeNode* child = node->getSubnode(i);
+    while (isSingleInputGate(child)) {
+      OpenABETreeNode* input = child->getSubnode(0);
+      child->replaceSubnodes(std::vector<OpenABETreeNode*>());
+      delete child;
+      child = input;
+      changed = true;
+    }
+    new_children.push_back(child);
+  }
+
+  if (changed) {
+    node->replaceSubnodes(new_children);
+  }
+}
+
+/*!
+ * Helper: Remove inputs of an AND/OR gate that do not change its value.
+ * Idempotence:  (a or a) -> a, (a and a) -> a
+ * Absorption:   (a or (a and b)) -> a, (a and (a or b)) -> a
+ * An input of the dual gate type is absorbed when the terms of another
+ * input are a subset of its own terms. Surviving leaves keep their index,
+ * so their LSSS row labels are unchanged.
+ */
+void
+OpenABEPolicy::absorbRedundant(OpenABETreeNode* node) {
+  zGateType nodeType = static_cast<zGateType>(node->getNodeType());
+  if (nodeType != GATE_TYPE_AND && nodeType != GATE_TYPE_OR) {
+    return;
+  }
+  if (node->getNumSubnodes() <= 1) {
+    return;
+  }
+  const uint32_t dualType = (nodeType == GATE_TYPE_AND) ?
+                            GATE_TYPE_OR : GATE_TYPE_AND;
+
+  // Idempotence: keep the first of each set of identical inputs
+  std::vector<OpenABETreeNode*> unique_children;
+  std::vector<std::set<std::string>> terms;
+  std::set<std::string> seen;
+  bool changed = false;
+
+  for (uint32_t i = 0; i < node->getNumSubnodes(); i++) {
+    OpenABETreeNode* child = node->getSubnode(i);
+    std::set<std::string> child_terms;
+    if (!hasThresholdGate(child)) {
+      if (!seen.insert(child->toString()).second) {
+        delete child;
+        changed = true;
+        continue;
+      }
+      if (child->getNodeType() == dualType) {
+        for (uint32_t j = 0; j < child->getNumSubnodes(); j++) {
+          child_terms.insert(child->getSubnode(j)->toString());
+        }
+      } else {
+        child_terms.insert(child->toString());
+      }
+    }
+    unique_children.push_back(child);
+    terms.push_back(child_terms);
+  }
+
+  // Absorption: an input implied by (OR) or implying (AND) a sibling goes
+  std::vector<OpenABETreeNode*> new_children;
+  for (size_t i = 0; i < unique_children.size(); i++) {
+    bool absorbed = false;
+    for (size_t j = 0; j < unique_children.size() && !terms[i].empty(); j++) {
+      if (j == i || terms[j].empty() || terms[j].size() >= terms[i].size()) {
+        continue;
+      }
+      if (std::includes(terms[i].begin(), terms[i].end(),
+                        terms[j].begin(), terms[j].end())) {
+        absorbed = true;
+        break;
+      }
+    }
+    // a term of the same gate type as this node whose inputs are all
+    // siblings also implies (OR) or is implied by (AND) this node, e.g.
+    // ((a or b) or ((a or b) and c)) flattens to (a or b or ((a or b) and c))
+    OpenABETreeNode* child = unique_children[i];
+    for (uint32_t j = 0; !absorbed && !terms[i].empty() &&
+         child->getNodeType() == dualType && j < child->getNumSubnodes(); j++) {
+      OpenABETreeNode* term = child->getSubnode(j);
+      if (term->getNodeType() != nodeType) {
+        continue;
+      }
+      absorbed = true;
+      for (uint32_t k = 0; absorbed && k < term->getNumSubnodes(); k++) {
+        absorbed = seen.count(term->getSubnode(k)->toString()) > 0;
+      }
+    }
+    if (absorbed) {
+      delete unique_children[i];
+      changed = true;
+    } else {
+      new_children.push_back(unique_children[i]);
+    }
+  }
+
+  if (changed) {
+    node->replaceSubnodes(new_children);
+  }
+}
+
 /*!
  * Helper: Sort children of commutative gates (AND, OR) lexicographically.
  */
@@ -0,0 +1,334 @@
+///
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+///
+/// This file is part of Zeutro's OpenABE.
+///
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+///
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+///
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+///
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+///
+/// \file   zprecompute.cpp
+///
+/// \brief  Implementation of the process-wide precomputation store.
+///
+/// \author J. Ayo Akinyele
+///
+
+#include <algorithm>
+#include <cstdint>
+#if !defined(_WIN32) && !defined(__wasm__)
+#include <sys/mman.h>
+#define OpenABE_PRECOMPUTE_MMAP
+#endif
+#include <openabe/openabe.h>
+
+using namespace std;
+
+namespace oabe {
+
+// tables are cut from chunks aligned to their size, so a table's chunk
+// header is found by masking its address
+static_assert((PRECOMPUTE_ARENA_CHUNK_SIZE & (PRECOMPUTE_ARENA_CHUNK_SIZE - 1)) == 0,
+              "the chunk size must be a power of two");
+
+// tables start on their own cache line
+static const size_t PRECOMPUTE_ALIGNMENT = 64;
+
+static inline size_t precomputeRound(size_t bytes, size_t align) {
+  return (bytes + align - 1) & ~(align - 1);
+}
+
+/********************************************************************************
+ * Implementation of the OpenABEPrecomputeOwner and Ticket classes
+ ********************************************************************************/
+
+/*!
+ * Drop the table registered under the ticket, unless the owner is gone.
+ *
+ * @param[in]   the key of the table in its cache.
+ * @param[in]   the ticket of the table.
+ */
+void OpenABEPrecomputeOwner::evict(const string &key, const OpenABEPrecomputeTicket *ticket) {
+  lock_guard<mutex> lock(this->lock_);
+  if (this->drop_) {
+    this->drop_(key, ticket);
+  }
+}
+
+void OpenABEPrecomputeOwner::detach() {
+  lock_guard<mutex> lock(this->lock_);
+  this->drop_ = nullptr;
+}
+
+void OpenABEPrecomputeTicket::touch() {
+  this->lastUse_.store(OpenABEPrecomputeManager::getDefault()->now(),
+                       memory_order_relaxed);
+}
+
+/********************************************************************************
+ * Implementation of the OpenABEPrecomputeManager class
+ ********************************************************************************/
+
+// Chunk header; the tables follow it in the same mapping
+struct OpenABEPrecomputeManager::Chunk {
+  size_t mapLen;
+  size_t live;    // tables not yet returned
+  char *start;
+  char *cursor;
+  char *end;
+  bool advised;
+};
+
+OpenABEPrecomputeManager::OpenABEPrecomputeManager()
+    : clock_(0), current_(NULL), budget_(0), bytesInUse_(0), peakBytes_(0),
+      mappedBytes_(0), hugepageBytes_(0), evictions_(0), pruneAt_(64) {}
+
+OpenABEPrecomputeManager *OpenABEPrecomputeManager::getDefault() {
+  // never destroyed: tables held by static objects may outlive any order
+  static OpenABEPrecomputeManager *manager = new OpenABEPrecomputeManager();
+  return manager;
+}
+
+void OpenABEPrecomputeManager::setBudget(size_t bytes) {
+  {
+    lock_guard<mutex> lock(this->lock_);
+    this->budget_ = bytes;
+  }
+  this->enforceBudget();
+}
+
+size_t OpenABEPrecomputeManager::getBudget() {
+  lock_guard<mutex> lock(this->lock_);
+  return this->budget_;
+}
+
+void OpenABEPrecomputeManager::getStats(OpenABEPrecomputeStats &stats) {
+  lock_guard<mutex> lock(this->lock_);
+  stats.budget = this->budget_;
+  stats.bytesInUse = this->bytesInUse_;
+  stats.peakBytes = this->peakBytes_;
+  stats.mappedBytes = this->mappedBytes_;
+  stats.hugepageBytes = this->hugepageBytes_;
+  stats.tables = 0;
+  for (auto &ticket : this->tickets_) {
+    if (!ticket.expired()) {
+      stats.tables++;
+    }
+  }
+  stats.evictions = this->evictions_;
+}
+
+/*!
+ * Map a chunk with room for at least 'bytes' after its header, aligned to
+ * (and a multiple of) the chunk size. Must be called with the lock held.
+ *
+ * @param[in]   number of bytes.
+ * @return      the chunk.
+ */
+OpenABEPrecomputeManager::Chunk *OpenABEPrecomputeManager::mapChunk(size_t bytes) {
+  const size_t align = PRECOMPUTE_ARENA_CHUNK_SIZE;
+  const size_t header = precomputeRound(sizeof(Chunk), PRECOMPUTE_ALIGNMENT);
+  bool advised = false;
+#if defined(OpenABE_PRECOMPUTE_MMAP)
+  size_t mapLen = precomputeRound(header + bytes, align);
+  // map one chunk more than needed and trim it to an aligned range
+  void *map = mmap(NULL, mapLen + align, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (map == MAP_FAILED) {
+    throw std::bad_alloc();
+  }
+  uintptr_t start = precomputeRound((uintptr_t)map, align);
+  size_t lead = start - (uintptr_t)map;
+  if (lead > 0) {
+    munmap(map, lead);
+  }
+  if (align - lead > 0) {
+    munmap(reinterpret_cast<char *>(start) + mapLen, align - lead);
+  }
+  char *base = reinterpret_cast<char *>(start);
+#if defined(MADV_HUGEPAGE)
+  advised = (madvise(base, mapLen, MADV_HUGEPAGE) == 0);
+#endif
+#else
+  size_t mapLen = header + bytes;
+  char *base = static_cast<char *>(::operator new(mapLen));
+#endif
+  Chunk *chunk = reinterpret_cast<Chunk *>(base);
+  chunk->mapLen = mapLen;
+  chunk->live = 0;
+  chunk->start = chunk->cursor = base + header;
+  chunk->end = base + mapLen;
+  chunk->advised = advised;
+  this->mappedBytes_ += mapLen;
+  if (advised) {
+    this->hugepageBytes_ += mapLen;
+  }
+  return chunk;
+}
+
+void OpenABEPrecomputeManager::unmapChunk(Chunk *chunk) {
+  this->mappedBytes_ -= chunk->mapLen;
+  if (chunk->advised) {
+    this->hugepageBytes_ -= chunk->mapLen;
+  }
+#if defined(OpenABE_PRECOMPUTE_MMAP)
+  munmap(chunk, chunk->mapLen);
+#else
+  ::operator delete(chunk);
+#endif
+}
+
+/*!
+ * Allocate table memory. Tables are bumped out of the current chunk; one
+ * larger than a quarter of a chunk gets a mapping of its own. A chunk is
+ * returned to the system when its last table is freed.
+ *
+ * @param[in]   number of bytes.
+ * @return      pointer to the allocated bytes (cache-line aligned when mapped).
+ */
+void *OpenABEPrecomputeManager::allocate(size_t bytes) {
+  size_t need = precomputeRound(std::max(bytes, (size_t)1), PRECOMPUTE_ALIGNMENT);
+  if (need < bytes) {
+    throw std::bad_alloc();
+  }
+  lock_guard<mutex> lock(this->lock_);
+  Chunk *chunk;
+#if defined(OpenABE_PRECOMPUTE_MMAP)
+  if (need > PRECOMPUTE_ARENA_CHUNK_SIZE / 4) {
+    chunk = this->mapChunk(need);
+  } else {
+    if (this->current_ == NULL ||
+        (size_t)(this->current_->end - this->current_->cursor) < need) {
+      Chunk *full = this->current_;
+      this->current_ = this->mapChunk(need);
+      if (full != NULL && full->live == 0) {
+        this->unmapChunk(full);
+      }
+    }
+    chunk = this->current_;
+  }
+#else
+  // without mmap every table is a chunk of its own
+  chunk = this->mapChunk(need);
+#endif
+  char *p = chunk->cursor;
+  chunk->cursor += need;
+  chunk->live++;
+  this->bytesInUse_ += bytes;
+  this->peakBytes_ = std::max(this->peakBytes_, this->bytesInUse_);
+  return p;
+}
+
+void OpenABEPrecomputeManager::deallocate(void *p, size_t bytes) {
+  if (p == NULL) {
+    return;
+  }
+  lock_guard<mutex> lock(this->lock_);
+#if defined(OpenABE_PRECOMPUTE_MMAP)
+  Chunk *chunk = reinterpret_cast<Chunk *>((uintptr_t)p &
+                                           ~(uintptr_t)(PRECOMPUTE_ARENA_CHUNK_SIZE - 1));
+#else
+  Chunk *chunk = reinterpret_cast<Chunk *>(static_cast<char *>(p) -
+                 precomputeRound(sizeof(Chunk), PRECOMPUTE_ALIGNMENT));
+#endif
+  this->bytesInUse_ -= bytes;
+  if (--chunk->live == 0) {
+    if (chunk == this->current_) {
+      // empty again: reuse it from the start
+      chunk->cursor = chunk->start;
+    } else {
+      this->unmapChunk(chunk);
+    }
+  }
+}
+
+/*!
+ * Forget tickets whose tables are gone, once the list has doubled since
+ * the last pass. Must be called with the lock held.
+ */
+void OpenABEPrecomputeManager::pruneLocked() {
+  if (this->tickets_.size() < this->pruneAt_) {
+    return;
+  }
+  this->tickets_.erase(remove_if(this->tickets_.begin(), this->tickets_.end(),
+                                 [](const weak_ptr<OpenABEPrecomputeTicket> &t) {
+                                   return t.expired();
+                                 }),
+                       this->tickets_.end());
+  this->pruneAt_ = std::max((size_t)64, 2 * this->tickets_.size());
+}
+
+/*!
+ * Register an evictable table.
+ *
+ * @param[in]   the cache the table lives in.
+ * @param[in]   the key of the table in that cache.
+ * @param[in]   the bytes the table holds.
+ * @return      the ticket, to be kept (and touched) with the table.
+ */
+shared_ptr<OpenABEPrecomputeTicket>
+OpenABEPrecomputeManager::track(shared_ptr<OpenABEPrecomputeOwner> owner,
+                                const string &key, size_t bytes) {
+  shared_ptr<OpenABEPrecomputeTicket> ticket =
+      make_shared<OpenABEPrecomputeTicket>(owner, key, bytes, this->now());
+  lock_guard<mutex> lock(this->lock_);
+  this->pruneLocked();
+  this->tickets_.push_back(ticket);
+  return ticket;
+}
+
+/*!
+ * Evict the least recently used tables until the live tables fit in the
+ * budget (or nothing evictable is left). The owners are called without
+ * the store's lock, since dropping a table frees its memory through it.
+ */
+void OpenABEPrecomputeManager::enforceBudget() {
+  vector<shared_ptr<OpenABEPrecomputeTicket>> victims;
+  {
+    lock_guard<mutex> lock(this->lock_);
+    if (this->budget_ == 0 || this->bytesInUse_ <= this->budget_) {
+      return;
+    }
+    vector<pair<uint64_t, shared_ptr<OpenABEPrecomputeTicket>>> live;
+    for (auto &weak : this->tickets_) {
+      shared_ptr<OpenABEPrecomputeTicket> ticket = weak.lock();
+      if (ticket && ticket->bytes_ > 0) {
+        live.emplace_back(ticket->lastUse_.load(memory_order_relaxed), ticket);
+      }
+    }
+    sort(live.begin(), live.end(),
+         [](const pair<uint64_t, shared_ptr<OpenABEPrecomputeTicket>> &a,
+            const pair<uint64_t, shared_ptr<OpenABEPrecomputeTicket>> &b) {
+           return a.first < b.first;
+         });
+    size_t excess = this->bytesInUse_ - this->budget_, freed = 0;
+    for (size_t i = 0; i < live.size() && freed < excess; i++) {
+      freed += live[i].second->bytes_;
+      victims.push_back(live[i].second);
+    }
+    this->evictions_ += victims.size();
+  }
+  for (auto &ticket : victims) {
+    ticket->owner_->evict(ticket->key_, ticket.get());
+  }
+}
+
+}
@@ -0,0 +1,244 @@
+/// 
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+/// 
+/// This file is part of Zeutro's OpenABE.
+/// 
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+/// 
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+/// 
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+/// 
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+///
+/// \file   zthreadpool.cpp
+///
+/// \brief  Implementation of the shared worker thread pool.
+///
+/// \author J. Ayo Akinyele
+///
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <openabe/openabe.h>
+
+using namespace std;
+
+namespace oabe {
+
+/********************************************************************************
+ * Implementation of the OpenABEThreadPool class
+ ********************************************************************************/
+
+// A parallel loop. Workers (and the caller) claim indices from 'next' until
+// the loop is exhausted, so faster threads naturally take more of the work.
+struct OpenABEThreadPool::Job {
+  const function<void(size_t)> *fn;
+  size_t count;
+  atomic<size_t> next;
+  // threads that may still join the loop (one slot per helper)
+  atomic<size_t> slots;
+  // helpers currently running iterations of the loop
+  size_t active;
+  mutex lock;
+  condition_variable done;
+  exception_ptr error;
+  atomic<bool> failed;
+  // the body of a submitted task, which outlives its caller
+  function<void(size_t)> owned;
+
+  Job(const function<void(size_t)> *f, size_t n, size_t helpers)
+    : fn(f), count(n), next(0), slots(helpers), active(0), failed(false) {}
+
+  void run() {
+    size_t i;
+    while (!failed && (i = next.fetch_add(1)) < count) {
+      try {
+        (*fn)(i);
+      } catch (...) {
+        lock_guard<mutex> guard(lock);
+        if (!failed) {
+          error = current_exception();
+          failed = true;
+        }
+      }
+    }
+  }
+};
+
+OpenABEThreadPool::OpenABEThreadPool(size_t numThreads) : stopping_(false) {
+#if defined(__EMSCRIPTEN__) || (defined(__wasm__) && !defined(__wasm_atomics__))
+  // no threads in the single-threaded wasm builds; all loops run on the
+  // caller (the wasm32-wasi-threads build keeps its workers)
+  numThreads = 0;
+#endif
+  for (size_t i = 0; i < numThreads; i++) {
+    this->workers_.emplace_back(&OpenABEThreadPool::workerLoop, this);
+  }
+}
+
+OpenABEThreadPool::~OpenABEThreadPool() {
+  {
+    lock_guard<mutex> guard(this->lock_);
+    this->stopping_ = true;
+  }
+  this->ready_.notify_all();
+  for (auto &w : this->workers_) {
+    w.join();
+  }
+}
+
+void OpenABEThreadPool::workerLoop() {
+  // per-thread library initialization
+  OpenABEStateContext state;
+  for (;;) {
+    shared_ptr<Job> job;
+    {
+      unique_lock<mutex> guard(this->lock_);
+      this->ready_.wait(guard, [this]() {
+        return this->stopping_ || !this->jobs_.empty();
+      });
+      if (this->stopping_ && this->jobs_.empty()) {
+        return;
+      }
+      job = this->jobs_.front();
+      // take a helper slot; the job leaves the queue once all are taken
+      if (--job->slots == 0) {
+        this->jobs_.pop_front();
+      }
+    }
+    {
+      lock_guard<mutex> guard(job->lock);
+      job->active++;
+    }
+    job->run();
+    {
+      lock_guard<mutex> guard(job->lock);
+      job->active--;
+    }
+    job->done.notify_all();
+  }
+}
+
+/*!
+ * Run a loop over [0, count) on the pool. The caller runs iterations as well
+ * and returns once every iteration has finished.
+ *
+ * @param[in]   the number of iterations.
+ * @param[in]   the loop body, called with the iteration index.
+ * @param[in]   the maximum number of threads (including the caller) to use.
+ */
+void OpenABEThreadPool::parallelFor(size_t count,
+                                    const function<void(size_t)> &fn,
+                                    size_t maxConcurrency) {
+  if (count == 0) {
+    return;
+  }
+  size_t helpers = this->workers_.size();
+  if (maxConcurrency > 0) {
+    helpers = min(helpers, maxConcurrency - 1);
+  }
+  helpers = min(helpers, count - 1);
+
+  shared_ptr<Job> job = make_shared<Job>(&fn, count, helpers);
+  if (helpers > 0) {
+    {
+      lock_guard<mutex> guard(this->lock_);
+      this->jobs_.push_back(job);
+    }
+    if (helpers == 1) {
+      this->ready_.notify_one();
+    } else {
+      this->ready_.notify_all();
+    }
+  }
+
+  job->run();
+
+  if (helpers > 0) {
+    // withdraw the helper slots nobody picked up yet
+    {
+      lock_guard<mutex> guard(this->lock_);
+      auto it = find(this->jobs_.begin(), this->jobs_.end(), job);
+      if (it != this->jobs_.end()) {
+        this->jobs_.erase(it);
+      }
+    }
+    unique_lock<mutex> guard(job->lock);
+    job->done.wait(guard, [&job]() { return job->active == 0; });
+  }
+
+  if (job->error) {
+    rethrow_exception(job->error);
+  }
+}
+
+/*!
+ * Queue a task for one of the workers and return at once.
+ *
+ * @param[in]   the task.
+ */
+void OpenABEThreadPool::submit(function<void()> task) {
+  if (this->workers_.empty()) {
+    try {
+      task();
+    } catch (...) {
+    }
+    return;
+  }
+  shared_ptr<Job> job = make_shared<Job>(nullptr, 1, 1);
+  job->owned = [task](size_t) { task(); };
+  job->fn = &job->owned;
+  {
+    lock_guard<mutex> guard(this->lock_);
+    this->jobs_.push_back(job);
+  }
+  this->ready_.notify_one();
+}
+
+static mutex defaultPoolLock;
+static shared_ptr<OpenABEThreadPool> defaultPool;
+static size_t defaultPoolSize = 0;
+static bool defaultPoolSizeSet = false;
+
+shared_ptr<OpenABEThreadPool> OpenABEThreadPool::getDefault() {
+  lock_guard<mutex> guard(defaultPoolLock);
+  if (!defaultPool) {
+    if (!defaultPoolSizeSet) {
+      // one worker per core besides the calling thread
+      size_t cores = thread::hardware_concurrency();
+      defaultPoolSize = (cores > 1) ? cores - 1 : 0;
+    }
+    defaultPool = make_shared<OpenABEThreadPool>(defaultPoolSize);
+  }
+  return defaultPool;
+}
+
+void OpenABEThreadPool::setDefaultSize(size_t numThreads) {
+  shared_ptr<OpenABEThreadPool> old;
+  {
+    lock_guard<mutex> guard(defaultPoolLock);
+    defaultPoolSize = numThreads;
+    defaultPoolSizeSet = true;
+    old = defaultPool;
+    defaultPool.reset();
+  }
+  // the old pool is joined when its last user lets go of it
+}
+
+}
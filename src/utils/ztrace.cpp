@@ -0,0 +1,148 @@
+/// 
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+/// 
+/// This file is part of Zeutro's OpenABE.
+/// 
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+/// 
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+/// 
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+/// 
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+/// \file   ztrace.cpp
+///
+/// \brief  Implementation of the diagnostic trace sink.
+///
+/// \author J. Ayo Akinyele
+///
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <random>
+#include <openabe/utils/zerror.h>
+#include <openabe/utils/ztrace.h>
+
+static const char *trace_level_name(int level) {
+  switch (level) {
+    case OpenABE_TRACE_LEVEL_ERROR:
+      return "ERROR";
+    case OpenABE_TRACE_LEVEL_INFO:
+      return "INFO";
+    case OpenABE_TRACE_LEVEL_DEBUG:
+      return "DEBUG";
+    default:
+      return "TRACE";
+  }
+}
+
+static void trace_default_sink(int level, const char *file, int line,
+                               const char *message) {
+  fprintf(stderr, "[%s] %s:%d: %s\n", trace_level_name(level), file, line,
+          message);
+}
+
+static std::atomic<OpenABE_TRACE_SINK> trace_sink(trace_default_sink);
+
+void OpenABE_setTraceSink(OpenABE_TRACE_SINK sink) {
+  trace_sink.store(sink != NULL ? sink : trace_default_sink);
+}
+
+void OpenABE_traceEmit(int level, const char *file, int line,
+                       const char *fmt, ...) {
+  char buf[1024];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+  trace_sink.load()(level, file, line, buf);
+}
+
+static std::atomic<OpenABE_SPAN_SINK> span_sink(nullptr);
+static std::atomic<void*> span_sink_context(nullptr);
+static uint64_t random_seed() {
+  std::random_device rd;
+  return ((uint64_t) rd() << 32) | rd();
+}
+
+// span IDs: a counter scrambled by splitmix64 from a random starting point
+static std::atomic<uint64_t> span_counter(random_seed());
+static thread_local oabe::OpenABETraceSpan *current_span = nullptr;
+
+static uint64_t next_span_id() {
+  uint64_t z = (span_counter += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  z ^= (z >> 31);
+  return (z != 0) ? z : 1;
+}
+
+static uint64_t monotonic_nanos() {
+  return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void OpenABE_setSpanSink(OpenABE_SPAN_SINK sink, void *context) {
+  span_sink_context.store(context);
+  span_sink.store(sink);
+}
+
+namespace oabe {
+
+OpenABETraceSpan::OpenABETraceSpan(const char *name)
+    : parent_(nullptr), startMonotonicNanos_(0), active_(false), statusSet_(false) {
+  memset(&this->span_, 0, sizeof(this->span_));
+  if (span_sink.load(std::memory_order_relaxed) == nullptr) {
+    return;
+  }
+  this->active_ = true;
+  this->parent_ = current_span;
+  this->span_.name = name;
+  this->span_.spanId = next_span_id();
+  if (this->parent_ != nullptr) {
+    this->span_.traceId = this->parent_->span_.traceId;
+    this->span_.parentSpanId = this->parent_->span_.spanId;
+  } else {
+    this->span_.traceId = this->span_.spanId;
+  }
+  this->span_.startUnixNanos = (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  this->startMonotonicNanos_ = monotonic_nanos();
+  current_span = this;
+}
+
+void OpenABETraceSpan::finish() {
+  this->active_ = false;
+  this->span_.durationNanos = monotonic_nanos() - this->startMonotonicNanos_;
+  if (!this->statusSet_ && std::uncaught_exception()) {
+    this->span_.status = OpenABE_ERROR_UNKNOWN;
+  }
+  // spans end in LIFO order, except a span ended early with end()
+  if (current_span == this) {
+    current_span = this->parent_;
+  }
+  OpenABE_SPAN_SINK sink = span_sink.load();
+  if (sink != nullptr) {
+    sink(&this->span_, span_sink_context.load());
+  }
+}
+
+}
@@ -34,10 +34,20 @@
 #include <sstream>
 #include <stdexcept>
 #include <cassert>
+#include <cstring>
 #include <openabe/openabe.h>
 
 #include <openssl/pem.h>
 #include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/crypto.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#endif
 
 using namespace std;
 
@@ -46,12 +56,66 @@ namespace oabe {
 static const char MASTER_PUBLIC_PARAMS[] = "mpk";
 static const char MASTER_SECRET_PARAMS[] = "msk";
 
+// bounds the ABE ciphertext buffered by the streaming decryptor
+static const size_t MAX_STREAM_ABE_CIPHERTEXT_LEN = (1 << 24);
+
+// Merkle batch signatures (OpenPKSIGContext::signMerkleBatch)
+static const uint8_t MERKLE_SIG_FORMAT = 0x4D;
+static const size_t MERKLE_HASH_LEN = 32;
+// verified roots remembered before the cache is reset
+static const size_t MERKLE_ROOT_CACHE_SIZE = 1024;
+// context label in front of every signed Merkle root; sign and verify
+// refuse messages that start with it, so no plain signature is a root
+// signature and no root signature is a plain one
+static const char MERKLE_ROOT_LABEL[] = "OpenABE-MERKLE-ROOT-v1";
+
+static bool merkleRootLabeled(const uint8_t *message, size_t messageLen) {
+  const size_t labelLen = sizeof(MERKLE_ROOT_LABEL) - 1;
+  return messageLen >= labelLen && memcmp(message, MERKLE_ROOT_LABEL, labelLen) == 0;
+}
+
 static const char PUBLIC_ID[] = "public_";
 static const char PRIVATE_ID[] = "private_";
+// keystore ID of a key delta while it's exported or applied
+static const char DELTA_ID[] = "delta_";
 
 #define OpenABE_PK_PREFIX(a) PUBLIC_ID + a
 #define OpenABE_SK_PREFIX(a) PRIVATE_ID + a
 
+/////////////////// OpenABEAsyncRunner ////////////////////////
+
+std::future<OpenABEAsyncResult>
+OpenABEAsyncRunner::run(std::function<OpenABE_ERROR(std::string &)> op) {
+  shared_ptr<promise<OpenABEAsyncResult>> result = make_shared<promise<OpenABEAsyncResult>>();
+  future<OpenABEAsyncResult> pending = result->get_future();
+  run(op, [result](OpenABEAsyncResult &r) { result->set_value(r); });
+  return pending;
+}
+
+void OpenABEAsyncRunner::run(std::function<OpenABE_ERROR(std::string &)> op,
+                             OpenABECompletion done) {
+  function<void()> task = [op, done]() {
+    OpenABEAsyncResult result;
+    try {
+      result.error = op(result.output);
+    } catch (OpenABE_ERROR &error) {
+      result.error = error;
+    } catch (std::exception &) {
+      result.error = OpenABE_ERROR_UNKNOWN;
+    }
+    if (result.error != OpenABE_NOERROR) {
+      result.output.clear();
+    }
+    done(result);
+  };
+
+  if (executor_) {
+    executor_(task);
+  } else {
+    OpenABEThreadPool::getDefault()->submit(task);
+  }
+}
+
 OpenABECryptoContext::OpenABECryptoContext(const std::string scheme_id, bool base64encode) {
   scheme_type_ = OpenABE_convertStringToSchemeID(scheme_id);
   if (scheme_type_ == OpenABE_SCHEME_NONE) {
@@ -63,11 +127,13 @@ OpenABECryptoContext::OpenABECryptoContext(const std::string scheme_id, bool bas
     throw ZCryptoBoxException("Unable to create ABE scheme context");
   }
 
-  if (scheme_type_ == OpenABE_SCHEME_CP_WATERS) {
+  if (scheme_type_ == OpenABE_SCHEME_CP_WATERS || scheme_type_ == OpenABE_SCHEME_CP_FAME ||
+      scheme_type_ == OpenABE_SCHEME_CP_WATERS_HCCA || scheme_type_ == OpenABE_SCHEME_CP_FAME_HCCA ||
+      scheme_type_ == OpenABE_SCHEME_CP_WATERS_FD || scheme_type_ == OpenABE_SCHEME_CP_WATERS_FD_HCCA) {
     keyInputType_ = FUNC_ATTRLIST_INPUT;
     encInputType_ = FUNC_POLICY_INPUT;
   } else {
-    // OpenABE_SCHEME_KP_GPSW
+    // OpenABE_SCHEME_KP_GPSW (or its hashed CCA variant)
     keyInputType_ = FUNC_POLICY_INPUT;
     encInputType_ = FUNC_ATTRLIST_INPUT;
   }
@@ -76,6 +142,9 @@ OpenABECryptoContext::OpenABECryptoContext(const std::string scheme_id, bool bas
   keyManager_.reset(new OpenABEKeystoreManager);
   useKeyManager_ = false;
   debug_ = false;
+  decStreamOpen_ = false;
+  sessionRecords_ = sessionMaxRecords_ = 0;
+  sessionMaxSeconds_ = 0;
 }
 
 void OpenABECryptoContext::generateParams() {
@@ -94,6 +163,7 @@ void OpenABECryptoContext::enableVerbose() {
 
 void OpenABECryptoContext::keygen(const std::string &keyInput, const std::string &keyID,
                                   const std::string &authID, const std::string &GID) {
+  OpenABEMetricsScope scope(OpenABE_LATENCY_KEYGEN, &metrics_);
   unique_ptr<OpenABEFunctionInput> keyFuncInput = nullptr;
   if (keyInputType_ == FUNC_POLICY_INPUT) {
     keyFuncInput = createPolicyTree(keyInput);
@@ -113,6 +183,65 @@ void OpenABECryptoContext::keygen(const std::string &keyInput, const std::string
   }
 }
 
+void OpenABECryptoContext::keygenMany(const std::vector<std::string> &keyInputs,
+                                      const std::vector<std::string> &keyIDs,
+                                      const std::string &authID, const std::string &GID) {
+  if (keyInputs.size() != keyIDs.size()) {
+    throw ZCryptoBoxException("keygenMany: number of key inputs and key IDs differ");
+  }
+  const size_t count = keyInputs.size();
+
+  // parse every input up front so that a bad one fails before any key is made
+  vector<unique_ptr<OpenABEFunctionInput>> keyFuncInputs(count);
+  for (size_t i = 0; i < count; i++) {
+    if (keyInputType_ == FUNC_POLICY_INPUT) {
+      keyFuncInputs[i] = createPolicyTree(keyInputs[i]);
+    } else {
+      keyFuncInputs[i] = createAttributeList(keyInputs[i]);
+    }
+    if (keyFuncInputs[i] == nullptr) {
+      throw ZCryptoBoxException("Invalid functional input for ABE key: " + keyInputs[i]);
+    }
+  }
+
+  // each key draws its own randomness and is added to the keystore under
+  // its write lock, so the keys are generated concurrently. The attribute
+  // hashes and fixed-base tables of the MPK are shared by all of them.
+  const string mpkID = MASTER_PUBLIC_PARAMS, mskID = MASTER_SECRET_PARAMS, gpkID = "";
+  vector<OpenABE_ERROR> status(count, OpenABE_NOERROR);
+  OpenABEThreadPool::getDefault()->parallelFor(count, [&](size_t i) {
+    OpenABEMetricsScope scope(OpenABE_LATENCY_KEYGEN, &metrics_);
+    try {
+      status[i] = schemeContextCCA_->keygen(keyFuncInputs[i].get(), keyIDs[i],
+                                            mpkID, mskID, gpkID, GID);
+    } catch (OpenABE_ERROR &error) {
+      status[i] = error;
+    }
+  });
+
+  for (size_t i = 0; i < count; i++) {
+    if (status[i] != OpenABE_NOERROR) {
+      for (size_t j = 0; j < count; j++) {
+        if (status[j] == OpenABE_NOERROR) {
+          deleteKey(keyIDs[j]);
+        }
+      }
+      if (debug_)
+        cerr << "OpenABECryptoContext::keygenMany: key " << keyIDs[i] << ": "
+             << OpenABE_errorToString(status[i]) << endl;
+      throw ZCryptoBoxException(OpenABE_errorToString(status[i]));
+    }
+  }
+}
+
+void OpenABECryptoContext::exportGlobalParams(string &globlmpk) {
+  throw ZCryptoBoxException(OpenABE_errorToString(OpenABE_ERROR_NOT_IMPLEMENTED));
+}
+
+void OpenABECryptoContext::importGlobalParams(const string &keyBlob) {
+  throw ZCryptoBoxException(OpenABE_errorToString(OpenABE_ERROR_NOT_IMPLEMENTED));
+}
+
 void OpenABECryptoContext::exportPublicParams(string &mpk) {
   return exportUserKey(MASTER_PUBLIC_PARAMS, mpk);
 }
@@ -140,6 +269,7 @@ void OpenABECryptoContext::importPublicParams(const std::string &keyBlob) {
 
 void OpenABECryptoContext::importPublicParams(const std::string &authID,
                                     const std::string &keyBlob) {
+  OpenABEMetricsScope scope(OpenABE_LATENCY_IMPORT, &metrics_);
   OpenABE_ERROR result = OpenABE_NOERROR;
   OpenABEByteString key;
   if (base64Encode_)
@@ -154,12 +284,213 @@ void OpenABECryptoContext::importPublicParams(const std::string &authID,
   }
 }
 
+OpenABEMPKHandle OpenABECryptoContext::getPublicParamsHandle() {
+  OpenABEMPKHandle handle =
+      schemeContextCCA_->getMasterPublicParamsHandle(MASTER_PUBLIC_PARAMS);
+  if (handle == nullptr) {
+    throw ZCryptoBoxException(OpenABE_errorToString(OpenABE_ERROR_INVALID_PARAMS));
+  }
+  return handle;
+}
+
+void OpenABECryptoContext::attachPublicParams(const OpenABEMPKHandle &handle) {
+  OpenABE_ERROR result =
+      schemeContextCCA_->attachMasterPublicParams(MASTER_PUBLIC_PARAMS, handle);
+  if (result != OpenABE_NOERROR) {
+    throw ZCryptoBoxException(OpenABE_errorToString(result));
+  }
+}
+
+// payload records of a context snapshot (after the tables)
+#define SNAPSHOT_MPK        'M'
+#define SNAPSHOT_USER_KEY   'K'
+#define SNAPSHOT_HASH_CACHE 'H'
+#define SNAPSHOT_POLICY     'P'
+
+void OpenABECryptoContext::exportPublicParamsSnapshot(string &snapshot) {
+  this->writeSnapshot(snapshot, false);
+}
+
+void OpenABECryptoContext::importPublicParamsSnapshot(const uint8_t *snapshot, size_t len) {
+  this->readSnapshot(snapshot, len);
+}
+
+void OpenABECryptoContext::saveSnapshot(const std::string &path) {
+#if defined(_WIN32)
+  throw ZCryptoBoxException(OpenABE_errorToString(OpenABE_ERROR_NOT_IMPLEMENTED));
+#else
+  string snapshot;
+  this->writeSnapshot(snapshot, true);
+  // written aside and renamed, so readers never map a partial snapshot
+  const string tmpPath = path + ".tmp";
+  int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) {
+    throw ZCryptoBoxException(OpenABE_errorToString(OpenABE_ERROR_INVALID_INPUT));
+  }
+  bool ok = (::write(fd, snapshot.data(), snapshot.size()) == (ssize_t)snapshot.size());
+  ok = ok && (fsync(fd) == 0);
+  ::close(fd);
+  ok = ok && (rename(tmpPath.c_str(), path.c_str()) == 0);
+  OpenABEZeroize(&snapshot[0], snapshot.size());
+  if (!ok) {
+    unlink(tmpPath.c_str());
+    throw ZCryptoBoxException(OpenABE_errorToString(OpenABE_ERROR_INVALID_INPUT));
+  }
+#endif
+}
+
+void OpenABECryptoContext::loadSnapshot(const std::string &path) {
+#if defined(_WIN32)
+  throw ZCryptoBoxException(OpenABE_errorToString(OpenABE_ERROR_NOT_IMPLEMENTED));
+#else
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw ZCryptoBoxException(OpenABE_errorToString(OpenABE_ERROR_INVALID_INPUT));
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    ::close(fd);
+    throw ZCryptoBoxException(OpenABE_errorToString(OpenABE_ERROR_INVALID_LENGTH));
+  }
+  size_t len = (size_t)st.st_size;
+  void *map = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    throw ZCryptoBoxException(OpenABE_errorToString(OpenABE_ERROR_OUT_OF_MEMORY));
+  }
+  // the tables of the loaded keys are used in place, so the mapping goes
+  // with the last of them (or right away if the snapshot is rejected)
+  shared_ptr<const void> mapping(map, [len](const void *p) {
+    munmap(const_cast<void *>(p), len);
+  });
+  this->readSnapshot((const uint8_t *)map, len, mapping);
+#endif
+}
+
+/*!
+ * Serialize the MPK tables (and, for a full snapshot, the line tables of
+ * the user keys) followed by the payload records: the MPK, then for a full
+ * snapshot the user keys, the hash cache and the cached policy inputs.
+ */
+void OpenABECryptoContext::writeSnapshot(string &snapshot, bool full) {
+  OpenABEMPKHandle handle = this->getPublicParamsHandle();
+  OpenABEByteString payload, blob;
+  OpenABE_ERROR result = this->schemeContextCCA_->exportKey(MASTER_PUBLIC_PARAMS, blob);
+  if (result != OpenABE_NOERROR) {
+    throw ZCryptoBoxException(OpenABE_errorToString(result));
+  }
+  payload.pack8bits(SNAPSHOT_MPK);
+  payload.pack(blob);
+
+  OpenABEFixedBaseSnapshot tables;
+  handle->getPrecomputedParams()->addToSnapshot(tables);
+  // the keys hold their line tables until the snapshot is written
+  vector<shared_ptr<OpenABEKey>> keys;
+  if (full) {
+    OpenABEKeystore *keystore = this->schemeContextCCA_->getKeystore();
+    for (auto &keyID : keystore->getSecretKeyIDs()) {
+      shared_ptr<OpenABEKey> key = keystore->getSecretKey(keyID);
+      if (keyID == MASTER_SECRET_PARAMS || key == nullptr) {
+        continue;
+      }
+      OpenABEByteString id, keyBlob;
+      if (this->schemeContextCCA_->exportKey(keyID, keyBlob) != OpenABE_NOERROR) {
+        continue;
+      }
+      id += keyID;
+      payload.pack8bits(SNAPSHOT_USER_KEY);
+      payload.pack(id);
+      payload.pack(keyBlob);
+      keyBlob.zeroize();
+      key->precomputeG2LineTables();
+      key->addToSnapshot(tables);
+      keys.push_back(key);
+    }
+
+    string cache;
+    handle->getPrecomputedParams()->exportHashCache(cache);
+    if (!cache.empty()) {
+      blob = cache;
+      payload.pack8bits(SNAPSHOT_HASH_CACHE);
+      payload.pack(blob);
+    }
+    // least recently used first, so that loading keeps the order
+    vector<string> policies = getCachedPolicyInputs();
+    for (auto it = policies.rbegin(); it != policies.rend(); ++it) {
+      blob = *it;
+      payload.pack8bits(SNAPSHOT_POLICY);
+      payload.pack(blob);
+    }
+  }
+
+  tables.setPayload(payload.toString());
+  payload.zeroize();
+  try {
+    // a context sharing the MAC key checks the tables by their tags
+    tables.serialize(snapshot, trustedKeyMAC_.size() > 0 ? &trustedKeyMAC_ : nullptr);
+  } catch (OpenABE_ERROR &error) {
+    throw ZCryptoBoxException(OpenABE_errorToString(error));
+  }
+}
+
+void OpenABECryptoContext::readSnapshot(const uint8_t *snapshot, size_t len,
+                                        const shared_ptr<const void> &memory) {
+  OpenABEMetricsScope scope(OpenABE_LATENCY_IMPORT, &metrics_);
+  const uint8_t *data = nullptr;
+  size_t dataLen = 0;
+  OpenABEAttachedTables attached;
+  OpenABE_ERROR result = OpenABE_attachFixedBaseSnapshot(
+      snapshot, len, attached, &data, &dataLen,
+      trustedKeyMAC_.size() > 0 ? &trustedKeyMAC_ : nullptr, memory);
+  if (result != OpenABE_NOERROR) {
+    throw ZCryptoBoxException(OpenABE_errorToString(result));
+  }
+
+  // only the keys of the payload get the snapshot's tables, found by their
+  // elements while the keys load instead of being rebuilt
+  OpenABEByteString payload;
+  payload.appendArray(const_cast<uint8_t *>(data), dataLen);
+  size_t index = 0;
+  bool mpk = false;
+  try {
+    while (result == OpenABE_NOERROR && index < payload.size()) {
+      uint8_t type = payload.at(index++);
+      OpenABEByteString blob = payload.unpack(&index);
+      if (type == SNAPSHOT_MPK) {
+        result = schemeContextCCA_->loadMasterPublicParams(MASTER_PUBLIC_PARAMS, blob, false, attached);
+        mpk = (result == OpenABE_NOERROR);
+      } else if (type == SNAPSHOT_USER_KEY) {
+        OpenABEByteString keyBlob = payload.unpack(&index);
+        result = schemeContextCCA_->loadUserSecretParams(blob.toString(), keyBlob, false, attached);
+        keyBlob.zeroize();
+      } else if (type == SNAPSHOT_HASH_CACHE && mpk) {
+        this->getPublicParamsHandle()->getPrecomputedParams()->importHashCache(blob.toString());
+      } else if (type == SNAPSHOT_POLICY) {
+        // parsed and compiled into the policy cache
+        createPolicyTree(blob.toString());
+      } else {
+        result = OpenABE_ERROR_INVALID_INPUT;
+      }
+    }
+  } catch (OpenABE_ERROR &error) {
+    result = error;
+  }
+  payload.zeroize();
+  if (result == OpenABE_NOERROR && !mpk) {
+    result = OpenABE_ERROR_INVALID_PARAMS;
+  }
+  if (result != OpenABE_NOERROR) {
+    throw ZCryptoBoxException(OpenABE_errorToString(result));
+  }
+}
+
 void OpenABECryptoContext::importSecretParams(const std::string &keyBlob) {
   this->importSecretParams(MASTER_SECRET_PARAMS, keyBlob);
 }
 
 void OpenABECryptoContext::importSecretParams(const std::string &authID,
                                     const std::string &keyBlob) {
+  OpenABEMetricsScope scope(OpenABE_LATENCY_IMPORT, &metrics_);
   OpenABE_ERROR result = OpenABE_NOERROR;
   OpenABEByteString key;
   if (base64Encode_)
@@ -177,6 +508,7 @@ void OpenABECryptoContext::importSecretParams(const std::string &authID,
 }
 
 void OpenABECryptoContext::importUserKey(const std::string& keyID, const std::string& keyBlob) {
+  OpenABEMetricsScope scope(OpenABE_LATENCY_IMPORT, &metrics_);
   OpenABE_ERROR result = OpenABE_NOERROR;
   OpenABEByteString key;
   if (base64Encode_)
@@ -194,94 +526,855 @@ void OpenABECryptoContext::importUserKey(const std::string& keyID, const std::st
   }
 }
 
+void OpenABECryptoContext::exportKeyRing(const std::vector<std::string> &keyIDs,
+                                         std::string &ring) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  vector<OpenABEKeyRingEntry> keys(keyIDs.size());
+  for (size_t i = 0; i < keyIDs.size() && result == OpenABE_NOERROR; i++) {
+    keys[i].keyID = keyIDs[i];
+    result = this->schemeContextCCA_->exportKey(keyIDs[i], keys[i].keyBlob);
+  }
+  OpenABEByteString bytes;
+  if (result == OpenABE_NOERROR) {
+    result = OpenABE_writeKeyRing(keys, bytes);
+  }
+  for (auto &key : keys) {
+    key.keyBlob.zeroize();
+  }
+  if (result != OpenABE_NOERROR) {
+    throw ZCryptoBoxException(OpenABE_errorToString(result));
+  }
+  ring = bytes.toString();
+  bytes.zeroize();
+}
+
+void OpenABECryptoContext::exportKeyRing(std::string &ring) {
+  if (useKeyManager_) {
+    OpenABEByteString bytes;
+    OpenABE_ERROR result = keyManager_->exportKeyRingCommand(userId_, bytes);
+    if (result != OpenABE_NOERROR) {
+      throw ZCryptoBoxException(OpenABE_errorToString(result));
+    }
+    ring = bytes.toString();
+    bytes.zeroize();
+    return;
+  }
+  vector<string> keyIDs;
+  for (auto &keyID : this->schemeContextCCA_->getKeystore()->getSecretKeyIDs()) {
+    if (keyID != MASTER_SECRET_PARAMS) {
+      keyIDs.push_back(keyID);
+    }
+  }
+  exportKeyRing(keyIDs, ring);
+}
+
+void OpenABECryptoContext::importKeyRing(const std::string &ring) {
+  OpenABEMetricsScope scope(OpenABE_LATENCY_IMPORT, &metrics_);
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  if (useKeyManager_) {
+    OpenABEByteString bytes;
+    bytes += ring;
+    try {
+      keyManager_->importKeyRingCommand(userId_, bytes, 0);
+    } catch (OpenABE_ERROR &error) {
+      result = error;
+    }
+    bytes.zeroize();
+  } else {
+    vector<OpenABEKeyRingEntry> keys;
+    result = OpenABE_readKeyRing((const uint8_t *)ring.data(), ring.size(), keys);
+    if (result == OpenABE_NOERROR) {
+      vector<string> keyIDs(keys.size());
+      vector<OpenABEByteString> blobs(keys.size());
+      for (size_t i = 0; i < keys.size(); i++) {
+        keyIDs[i] = keys[i].keyID;
+        blobs[i].swap(keys[i].keyBlob);
+      }
+      try {
+        result = schemeContextCCA_->loadUserSecretParamsMany(keyIDs, blobs);
+      } catch (OpenABE_ERROR &error) {
+        result = error;
+      }
+      for (auto &blob : blobs) {
+        blob.zeroize();
+      }
+    }
+  }
+  if (result != OpenABE_NOERROR) {
+    throw ZCryptoBoxException(OpenABE_errorToString(result));
+  }
+}
+
+// HMAC-SHA256 tag closing a blob of the Trusted export/import methods
+#define TRUSTED_KEY_TAG_LEN     SHA256_LEN
+#define TRUSTED_KEY_MIN_MAC_LEN 16
+
+static void trustedKeyTag(const OpenABEByteString &macKey, const uint8_t *blob,
+                          size_t blobLen, uint8_t tag[TRUSTED_KEY_TAG_LEN]) {
+  unsigned int tagLen = TRUSTED_KEY_TAG_LEN;
+  if (HMAC(EVP_sha256(), macKey.data(), (int)macKey.size(), blob, blobLen,
+           tag, &tagLen) == nullptr || tagLen != TRUSTED_KEY_TAG_LEN) {
+    throw ZCryptoBoxException(OpenABE_errorToString(OpenABE_ERROR_UNKNOWN));
+  }
+}
+
+void OpenABECryptoContext::setTrustedKeyMAC(const std::string &macKey) {
+  if (macKey.size() < TRUSTED_KEY_MIN_MAC_LEN) {
+    throw ZCryptoBoxException(OpenABE_errorToString(OpenABE_ERROR_INVALID_LENGTH));
+  }
+  trustedKeyMAC_.zeroize();
+  trustedKeyMAC_ = macKey;
+}
+
+void OpenABECryptoContext::exportPublicParamsTrusted(string &mpk) {
+  exportUserKeyTrusted(MASTER_PUBLIC_PARAMS, mpk);
+}
+
+void OpenABECryptoContext::importPublicParamsTrusted(const string &keyBlob) {
+  OpenABEMetricsScope scope(OpenABE_LATENCY_IMPORT, &metrics_);
+  OpenABEByteString key;
+  openTrustedBlob(keyBlob, key);
+  OpenABE_ERROR result =
+      schemeContextCCA_->loadMasterPublicParams(MASTER_PUBLIC_PARAMS, key, true);
+  if (result != OpenABE_NOERROR) {
+    throw ZCryptoBoxException(OpenABE_errorToString(result));
+  }
+}
+
+void OpenABECryptoContext::exportUserKeyTrusted(const string &keyID, string &keyBlob) {
+  if (trustedKeyMAC_.size() == 0) {
+    throw ZCryptoBoxException(OpenABE_errorToString(OpenABE_ERROR_INVALID_INPUT));
+  }
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  OpenABEByteString key;
+  if ((result = this->schemeContextCCA_->exportKey(keyID, key)) != OpenABE_NOERROR) {
+    throw ZCryptoBoxException(OpenABE_errorToString(result));
+  }
+
+  uint8_t tag[TRUSTED_KEY_TAG_LEN];
+  trustedKeyTag(trustedKeyMAC_, key.data(), key.size(), tag);
+  key.appendArray(tag, sizeof(tag));
+  if (base64Encode_)
+    keyBlob = Base64Encode(key.data(), key.size());
+  else
+    keyBlob = key.toString();
+  key.zeroize();
+}
+
+void OpenABECryptoContext::importUserKeyTrusted(const string &keyID, const string &keyBlob) {
+  OpenABEMetricsScope scope(OpenABE_LATENCY_IMPORT, &metrics_);
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  OpenABEByteString key;
+  openTrustedBlob(keyBlob, key);
+  if (!useKeyManager_)
+    result = schemeContextCCA_->loadUserSecretParams(keyID, key, true);
+  else
+    keyManager_->storeWithKeyIDCommand(userId_, keyID, key, 0);
+  key.zeroize();
+
+  if (result != OpenABE_NOERROR) {
+    throw ZCryptoBoxException(OpenABE_errorToString(result));
+  }
+}
+
+/*!
+ * Check the tag of a blob from a Trusted export and return the key blob
+ * it closes. Throws if no MAC key is set or the tag does not match.
+ */
+void OpenABECryptoContext::openTrustedBlob(const string &keyBlob, OpenABEByteString &key) {
+  if (trustedKeyMAC_.size() == 0) {
+    throw ZCryptoBoxException(OpenABE_errorToString(OpenABE_ERROR_INVALID_INPUT));
+  }
+  if (base64Encode_)
+    key += Base64Decode(keyBlob);
+  else
+    key += keyBlob;
+  if (key.size() <= TRUSTED_KEY_TAG_LEN) {
+    throw ZCryptoBoxException(OpenABE_errorToString(OpenABE_ERROR_INVALID_LENGTH));
+  }
+
+  const size_t keyLen = key.size() - TRUSTED_KEY_TAG_LEN;
+  uint8_t tag[TRUSTED_KEY_TAG_LEN];
+  trustedKeyTag(trustedKeyMAC_, key.data(), keyLen, tag);
+  if (CRYPTO_memcmp(tag, key.data() + keyLen, TRUSTED_KEY_TAG_LEN) != 0) {
+    key.zeroize();
+    throw ZCryptoBoxException(OpenABE_errorToString(OpenABE_ERROR_VERIFICATION_FAILED));
+  }
+  key.resize(keyLen);
+}
+
 bool OpenABECryptoContext::deleteKey(const std::string &keyID) {
   return (this->schemeContextCCA_->deleteKey(keyID) == OpenABE_NOERROR);
 }
 
+unique_ptr<OpenABEFunctionInput>
+OpenABECryptoContext::createEncInput(const std::string &encInput) {
+  unique_ptr<OpenABEFunctionInput> funcInput = nullptr;
+  if (encInputType_ == FUNC_POLICY_INPUT) {
+    funcInput = createPolicyTree(encInput);
+  } else {
+    funcInput = createAttributeList(encInput);
+  }
+
+  if (!funcInput) {
+    throw ZCryptoBoxException(OpenABE_errorToString(OpenABE_ERROR_INVALID_INPUT));
+  }
+  return funcInput;
+}
+
+OpenABE_ERROR
+OpenABECryptoContext::encryptWithInput(const OpenABEFunctionInput *funcInput,
+                                       const std::string &plaintext,
+                                       std::string &ciphertext) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  OpenABEByteString ct1, ct2, combined;
+  unique_ptr<OpenABECiphertext> ciphertext1(new OpenABECiphertext);
+  unique_ptr<OpenABECiphertext> ciphertext2(new OpenABECiphertext);
+
+  string mpkID = MASTER_PUBLIC_PARAMS;
+  // now we can encrypt
+  if ((result = schemeContextCCA_->encrypt(
+           mpkID, funcInput, plaintext, ciphertext1.get(),
+           ciphertext2.get())) != OpenABE_NOERROR) {
+    return result;
+  }
+
+  OpenABE_countMetric(OpenABE_METRIC_BYTES_ENCRYPTED, plaintext.size());
+
+  // serialize the results
+  ciphertext1->exportToBytes(ct1);
+  ciphertext2->exportToBytes(ct2);
+
+  // write back to user
+  combined.pack(ct1);
+  combined.pack(ct2);
+  if (base64Encode_) {
+    const string ct = combined.toString();
+    ciphertext = Base64Encode((const uint8_t *)ct.data(), ct.size());
+  } else {
+    ciphertext = combined.toString();
+  }
+  return result;
+}
+
 void OpenABECryptoContext::encrypt(const std::string encInput,
                          const std::string &plaintext,
                          std::string &ciphertext) {
+  OpenABEMetricsScope scope(OpenABE_LATENCY_ENCRYPT, &metrics_);
+  OpenABETraceSpan span("oabe.encrypt");
   OpenABE_ERROR result = OpenABE_NOERROR;
-  unique_ptr<OpenABECiphertext> ciphertext1 = nullptr, ciphertext2 = nullptr;
-  unique_ptr<OpenABEFunctionInput> funcInput = nullptr;
 
   try {
-    OpenABEByteString ct1, ct2, combined;
-
-    if (encInputType_ == FUNC_POLICY_INPUT) {
-      funcInput = createPolicyTree(encInput);
-    } else {
-      funcInput = createAttributeList(encInput);
+    unique_ptr<OpenABEFunctionInput> funcInput = createEncInput(encInput);
+    if ((result = encryptWithInput(funcInput.get(), plaintext, ciphertext)) != OpenABE_NOERROR) {
+      throw ZCryptoBoxException(OpenABE_errorToString(result));
     }
+  } catch (OpenABE_ERROR &error) {
+    if (debug_)
+      cerr << "OpenABECryptoContext::encrypt: " << OpenABE_errorToString(error) << endl;
+    throw ZCryptoBoxException(OpenABE_errorToString(error));
+  }
+}
 
-    if (!funcInput) {
-      throw ZCryptoBoxException(OpenABE_errorToString(OpenABE_ERROR_INVALID_INPUT));
-    }
+void OpenABECryptoContext::encryptBatch(const std::string encInput,
+                              const std::vector<std::string> &plaintexts,
+                              std::vector<std::string> &ciphertexts) {
+  ciphertexts.clear();
+  ciphertexts.resize(plaintexts.size());
+  if (plaintexts.empty()) {
+    return;
+  }
 
-    ciphertext1.reset(new OpenABECiphertext);
-    ciphertext2.reset(new OpenABECiphertext);
+  try {
+    // parse the policy (or attribute list) once for the whole batch. The
+    // attribute hashes are shared through the MPK's hashToG1 cache.
+    unique_ptr<OpenABEFunctionInput> funcInput = createEncInput(encInput);
+
+    // each encryption draws its own randomness, so the batch is spread
+    // over the library thread pool
+    OpenABEThreadPool::getDefault()->parallelFor(plaintexts.size(), [&](size_t i) {
+      OpenABEMetricsScope scope(OpenABE_LATENCY_ENCRYPT, &metrics_);
+      OpenABETraceSpan span("oabe.encrypt");
+      OpenABE_ERROR err = encryptWithInput(funcInput.get(), plaintexts[i], ciphertexts[i]);
+      if (err != OpenABE_NOERROR) {
+        throw err;
+      }
+    });
+  } catch (OpenABE_ERROR &error) {
+    ciphertexts.clear();
+    if (debug_)
+      cerr << "OpenABECryptoContext::encryptBatch: " << OpenABE_errorToString(error) << endl;
+    throw ZCryptoBoxException(OpenABE_errorToString(error));
+  }
+}
 
-    string mpkID = MASTER_PUBLIC_PARAMS;
-    // now we can encrypt
-    if ((result = schemeContextCCA_->encrypt(
-             mpkID, funcInput.get(), plaintext, ciphertext1.get(),
-             ciphertext2.get())) != OpenABE_NOERROR) {
+/*!
+ * Encrypt many plaintexts under the same policy (or attribute list), as
+ * encryptBatch does, and append them to block as one columnar block (see
+ * OpenABECiphertextBlockWriter) instead of returning each ciphertext.
+ *
+ * @param[in]   the policy (CP-ABE) or attribute list (KP-ABE).
+ * @param[in]   the plaintexts.
+ * @param[out]  the output the block is appended to.
+ */
+void OpenABECryptoContext::encryptBlock(const std::string encInput,
+                              const std::vector<std::string> &plaintexts,
+                              std::string &block) {
+  vector<string> ciphertexts;
+  encryptBatch(encInput, plaintexts, ciphertexts);
+
+  OpenABECiphertextBlockWriter writer;
+  for (auto &ciphertext : ciphertexts) {
+    OpenABE_ERROR result = base64Encode_ ? writer.add(Base64Decode(ciphertext))
+                                         : writer.add(ciphertext);
+    if (result != OpenABE_NOERROR) {
       throw ZCryptoBoxException(OpenABE_errorToString(result));
     }
+  }
+  writer.finish(block);
+}
 
-    // serialize the results
-    ciphertext1->exportToBytes(ct1);
-    ciphertext2->exportToBytes(ct2);
+void OpenABECryptoContext::loadCiphertext(const std::string &ciphertext,
+                                 unique_ptr<OpenABECiphertext> &ciphertext1,
+                                 unique_ptr<OpenABECiphertext> &ciphertext2) {
+  OpenABEByteString ct;
+  if (base64Encode_) {
+    // base64 decode ...
+    string ct_bin = Base64Decode(ciphertext);
+    ct += ct_bin;
+  } else {
+    ct += ciphertext;
+  }
+  loadCiphertextBytes(ct, ciphertext1, ciphertext2);
+}
 
-    // write back to user
-    combined.pack(ct1);
-    combined.pack(ct2);
-    if (base64Encode_) {
-      const string ct = combined.toString();
-      ciphertext = Base64Encode((const uint8_t *)ct.data(), ct.size());
+// the binary form, whatever the context was created with
+void OpenABECryptoContext::loadCiphertextBytes(OpenABEByteString &ct,
+                                 unique_ptr<OpenABECiphertext> &ciphertext1,
+                                 unique_ptr<OpenABECiphertext> &ciphertext2) {
+  OpenABEByteString ct1, ct2;
+  size_t index = 0;
+  ct.unpack(&index, ct1);
+  ct.unpack(&index, ct2);
+
+  ciphertext1.reset(new OpenABECiphertext);
+  ciphertext2.reset(new OpenABECiphertext);
+
+  // only the rows needed to decrypt are decoded; the rest are checked
+  // against the re-encryption by their encoded bytes
+  ciphertext1->setLazyDecoding(true);
+  ciphertext1->loadFromBytes(ct1);
+  ciphertext2->loadFromBytes(ct2);
+}
+
+// the ABE half only: the payload is skipped and no group element decoded
+void OpenABECryptoContext::loadCiphertextHeader(const std::string &ciphertext,
+                                 unique_ptr<OpenABECiphertext> &ciphertext1) {
+  OpenABEByteString ct, ct1;
+  if (base64Encode_) {
+    ct += Base64Decode(ciphertext);
+  } else {
+    ct += ciphertext;
+  }
+  size_t index = 0;
+  ct.unpack(&index, ct1);
+
+  ciphertext1.reset(new OpenABECiphertext);
+  ciphertext1->setLazyDecoding(true);
+  ciphertext1->loadFromBytes(ct1);
+}
+
+bool OpenABECryptoContext::inspect(const std::string &ciphertext,
+                                   OpenABECiphertextInfo &info) {
+  unique_ptr<OpenABECiphertext> ciphertext1 = nullptr;
+
+  try {
+    loadCiphertextHeader(ciphertext, ciphertext1);
+    unique_ptr<OpenABEFunctionInput> funcInput = getFunctionInput(ciphertext1.get());
+    ASSERT(funcInput != nullptr, OpenABE_ERROR_INVALID_CIPHERTEXT_BODY);
+
+    info.scheme = OpenABE_convertSchemeIDToString(ciphertext1->getSchemeType());
+    info.curve = OpenABE_convertCurveIDToString((OpenABECurveID)ciphertext1->getCurveID());
+    info.uid = ciphertext1->getUID().toLowerHex();
+    if (funcInput->getFunctionType() == FUNC_POLICY_INPUT) {
+      info.encInput = ((OpenABEPolicy *)funcInput.get())->toString();
     } else {
-      ciphertext = combined.toString();
+      info.encInput = ((OpenABEAttributeList *)funcInput.get())->toString();
     }
+    return true;
   } catch (OpenABE_ERROR &error) {
     if (debug_)
-      cerr << "OpenABECryptoContext::encrypt: " << OpenABE_errorToString(error) << endl;
-    throw ZCryptoBoxException(OpenABE_errorToString(error));
+      cerr << "OpenABECryptoContext::inspect: " << OpenABE_errorToString(error) << endl;
+  }
+  return false;
+}
+
+bool OpenABECryptoContext::canDecrypt(const std::string &keyID,
+                                      const std::string &ciphertext) {
+  unique_ptr<OpenABECiphertext> ciphertext1 = nullptr;
+  OpenABE_ERROR result = OpenABE_NOERROR;
+
+  try {
+    loadCiphertextHeader(ciphertext, ciphertext1);
+    result = checkKey(keyID, ciphertext1.get());
+  } catch (OpenABE_ERROR &error) {
+    result = error;
+  }
+  if (result != OpenABE_NOERROR && debug_)
+    cerr << "OpenABECryptoContext::canDecrypt: " << OpenABE_errorToString(result) << endl;
+  return (result == OpenABE_NOERROR);
+}
+
+/*!
+ * Check that a loaded key fits a ciphertext before any decryption work:
+ * same scheme, and attributes that satisfy the policy. Reports by error
+ * code only (no logging, no exceptions).
+ *
+ * @param[in]   key identifier of the recipient.
+ * @param[in]   the ABE half of the ciphertext (lazily decoded).
+ * @return      OpenABE_NOERROR, or why the key cannot decrypt.
+ */
+OpenABE_ERROR OpenABECryptoContext::checkKey(const std::string &keyID,
+                                             OpenABECiphertext *ciphertext1) {
+  shared_ptr<OpenABEKey> key = schemeContextCCA_->getKeystore()->getSecretKey(keyID);
+  if (key == nullptr) {
+    return OpenABE_ERROR_INVALID_KEY;
+  }
+  if (ciphertext1->getSchemeType() != schemeContextCCA_->getSchemeType()) {
+    return OpenABE_ERROR_INVALID_CIPHERTEXT_HEADER;
+  }
+  unique_ptr<OpenABEFunctionInput> funcInput = getFunctionInput(ciphertext1);
+  if (funcInput == nullptr) {
+    return OpenABE_ERROR_INVALID_CIPHERTEXT_BODY;
+  }
+
+  OpenABEPolicy *policy = nullptr;
+  OpenABEAttributeList *attrList = nullptr;
+  unique_ptr<OpenABEPolicy> keyPolicy = nullptr;
+  if (keyInputType_ == FUNC_ATTRLIST_INPUT) {
+    policy = dynamic_cast<OpenABEPolicy *>(funcInput.get());
+    attrList = dynamic_cast<OpenABEAttributeList *>(key->getComponent("input"));
+  } else {
+    OpenABEByteString *policy_str = key->getByteString("input");
+    if (policy_str != nullptr) {
+      keyPolicy = createPolicyTree(policy_str->toString());
+    }
+    policy = keyPolicy.get();
+    attrList = dynamic_cast<OpenABEAttributeList *>(funcInput.get());
   }
+  if (policy == nullptr || attrList == nullptr) {
+    return OpenABE_ERROR_INVALID_KEY_BODY;
+  }
+  if (!checkIfSatisfied(policy, attrList).first) {
+    return OpenABE_ERROR_POLICY_NOT_SATISFIED;
+  }
+  return OpenABE_NOERROR;
 }
 
 bool OpenABECryptoContext::decrypt(const std::string &keyID,
                          const std::string &ciphertext,
                          std::string &plaintext) {
+  OpenABE_ERROR result = tryDecrypt(keyID, ciphertext, plaintext);
+  if (result != OpenABE_NOERROR && debug_)
+    cerr << "OpenABECryptoContext::decrypt: " << OpenABE_errorToString(result) << endl;
+  return (result == OpenABE_NOERROR);
+}
+
+/*!
+ * Decrypt with an error code instead of a bool. A key that does not fit
+ * the ciphertext is turned away by checkKey before any group element is
+ * decoded, without logging or unwinding.
+ *
+ * @param[in]   key identifier of the recipient.
+ * @param[in]   the ciphertext.
+ * @param[out]  the plaintext.
+ * @return      OpenABE_NOERROR or the reason decryption failed.
+ */
+OpenABE_ERROR OpenABECryptoContext::tryDecrypt(const std::string &keyID,
+                         const std::string &ciphertext,
+                         std::string &plaintext) {
+  OpenABEMetricsScope scope(OpenABE_LATENCY_DECRYPT, &metrics_);
+  OpenABETraceSpan span("oabe.decrypt");
   OpenABE_ERROR result = OpenABE_NOERROR;
   unique_ptr<OpenABECiphertext> ciphertext1 = nullptr, ciphertext2 = nullptr;
 
   try {
-    string pt;
-    OpenABEByteString ct, ct1, ct2;
-    if (base64Encode_) {
-      // base64 decode ...
-      string ct_bin = Base64Decode(ciphertext);
-      ct += ct_bin;
-    } else {
-      ct += ciphertext;
+    loadCiphertext(ciphertext, ciphertext1, ciphertext2);
+    result = checkKey(keyID, ciphertext1.get());
+    if (result == OpenABE_NOERROR) {
+      string mpkID = MASTER_PUBLIC_PARAMS;
+      // can now decrypt
+      result = schemeContextCCA_->decrypt(mpkID, keyID, plaintext,
+                                          ciphertext1.get(), ciphertext2.get());
     }
-    size_t index = 0;
-    ct.unpack(&index, ct1);
-    ct.unpack(&index, ct2);
+    if (result == OpenABE_NOERROR) {
+      OpenABE_countMetric(OpenABE_METRIC_BYTES_DECRYPTED, plaintext.size());
+    }
+  } catch (OpenABE_ERROR &error) {
+    result = error;
+  }
+  span.setStatus(result);
+  return result;
+}
 
-    ciphertext1.reset(new OpenABECiphertext);
-    ciphertext2.reset(new OpenABECiphertext);
+size_t OpenABECryptoContext::decryptBatch(const std::string &keyID,
+                                  const std::vector<std::string> &ciphertexts,
+                                  std::vector<std::string> &plaintexts,
+                                  std::vector<bool> &decrypted) {
+  return decryptMany(keyID, ciphertexts.size(),
+      [&](size_t i, unique_ptr<OpenABECiphertext> &ciphertext1,
+          unique_ptr<OpenABECiphertext> &ciphertext2) {
+        loadCiphertext(ciphertexts[i], ciphertext1, ciphertext2);
+      }, plaintexts, decrypted);
+}
 
+/*!
+ * Decrypt every ciphertext of a block reader, as decryptBatch does for a
+ * vector. Each ciphertext is assembled from the mapped columns on the
+ * thread that decrypts it.
+ *
+ * @param[in]   key identifier of the recipient.
+ * @param[in]   the blocks.
+ * @param[out]  the plaintexts, and whether each ciphertext was decrypted.
+ * @return      the number of ciphertexts that were decrypted.
+ */
+size_t OpenABECryptoContext::decryptBatch(const std::string &keyID,
+                                  const OpenABECiphertextBlockReader &blocks,
+                                  std::vector<std::string> &plaintexts,
+                                  std::vector<bool> &decrypted) {
+  return decryptMany(keyID, blocks.size(),
+      [&](size_t i, unique_ptr<OpenABECiphertext> &ciphertext1,
+          unique_ptr<OpenABECiphertext> &ciphertext2) {
+        OpenABEByteString ct;
+        OpenABE_ERROR result = blocks.get(i, ct);
+        if (result != OpenABE_NOERROR) {
+          throw result;
+        }
+        loadCiphertextBytes(ct, ciphertext1, ciphertext2);
+      }, plaintexts, decrypted);
+}
+
+size_t OpenABECryptoContext::decryptMany(const std::string &keyID, size_t count,
+                                  const CiphertextLoader &load,
+                                  std::vector<std::string> &plaintexts,
+                                  std::vector<bool> &decrypted) {
+  plaintexts.clear();
+  plaintexts.resize(count);
+  decrypted.assign(count, false);
+  if (count == 0) {
+    return 0;
+  }
+
+  // one status per item (std::vector<bool> can't be written concurrently)
+  vector<OpenABE_ERROR> status(count, OpenABE_NOERROR);
+  vector<unique_ptr<OpenABECiphertext>> ciphertext1(count), ciphertext2(count);
+  const string mpkID = MASTER_PUBLIC_PARAMS;
+  OpenABEThreadPool *pool = OpenABEThreadPool::getDefault().get();
+
+  pool->parallelFor(count, [&](size_t i) {
+    try {
+      load(i, ciphertext1[i], ciphertext2[i]);
+    } catch (OpenABE_ERROR &error) {
+      status[i] = error;
+    }
+  });
+
+  // group the ciphertexts by policy (attribute list for KP-ABE): the first
+  // of each group solves the LSSS and fills the decryption plan cache, the
+  // others reuse that plan as well as the key's precomputed line tables
+  const char *inputLabel = (encInputType_ == FUNC_POLICY_INPUT) ? "policy" : "attributes";
+  map<string, vector<size_t>> groups;
+  for (size_t i = 0; i < count; i++) {
+    if (status[i] != OpenABE_NOERROR) {
+      continue;
+    }
+    OpenABEByteString encInput;
+    // ciphertexts under a registered policy group by its digest
+    ZObject *input = ciphertext1[i]->hasComponent("policyHash") ?
+        ciphertext1[i]->getComponent("policyHash") :
+        ciphertext1[i]->getComponent(inputLabel);
+    if (input == nullptr) {
+      status[i] = OpenABE_ERROR_INVALID_CIPHERTEXT_BODY;
+      continue;
+    }
+    input->serialize(encInput);
+    groups[encInput.toString()].push_back(i);
+  }
+
+  vector<size_t> leaders, followers;
+  for (auto& group : groups) {
+    leaders.push_back(group.second.front());
+    followers.insert(followers.end(), group.second.begin() + 1, group.second.end());
+  }
+  auto decryptOne = [&](size_t i) {
+    OpenABEMetricsScope scope(OpenABE_LATENCY_DECRYPT, &metrics_);
+    OpenABETraceSpan span("oabe.decrypt");
+    try {
+      status[i] = schemeContextCCA_->decrypt(mpkID, keyID, plaintexts[i],
+                                             ciphertext1[i].get(), ciphertext2[i].get());
+      if (status[i] == OpenABE_NOERROR) {
+        OpenABE_countMetric(OpenABE_METRIC_BYTES_DECRYPTED, plaintexts[i].size());
+      }
+    } catch (OpenABE_ERROR &error) {
+      status[i] = error;
+    }
+    ciphertext1[i].reset();
+    ciphertext2[i].reset();
+  };
+  pool->parallelFor(leaders.size(), [&](size_t j) { decryptOne(leaders[j]); });
+  pool->parallelFor(followers.size(), [&](size_t j) { decryptOne(followers[j]); });
+
+  size_t numDecrypted = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (status[i] == OpenABE_NOERROR) {
+      decrypted[i] = true;
+      numDecrypted++;
+    } else {
+      plaintexts[i].clear();
+      if (debug_)
+        cerr << "OpenABECryptoContext::decryptBatch: item " << i << ": "
+             << OpenABE_errorToString(status[i]) << endl;
+    }
+  }
+  return numDecrypted;
+}
+
+void OpenABECryptoContext::delegateKey(const std::string &parentKeyID,
+                                       const std::string &subsetAttributes,
+                                       const std::string &newKeyID) {
+  OpenABEMetricsScope scope(OpenABE_LATENCY_KEYGEN, &metrics_);
+  if (keyInputType_ != FUNC_ATTRLIST_INPUT) {
+    throw ZCryptoBoxException("Key delegation needs attribute-based keys (CP-ABE)");
+  }
+  unique_ptr<OpenABEFunctionInput> keyFuncInput = createAttributeList(subsetAttributes);
+  if (keyFuncInput == nullptr) {
+    throw ZCryptoBoxException("Invalid functional input for ABE key");
+  }
+  OpenABE_ERROR result = schemeContextCCA_->delegateKey(MASTER_PUBLIC_PARAMS, parentKeyID,
+                                                        keyFuncInput.get(), newKeyID);
+  if (result != OpenABE_NOERROR) {
+    throw ZCryptoBoxException(OpenABE_errorToString(result));
+  }
+}
+
+void OpenABECryptoContext::extendKey(const std::string &keyID,
+                                     const std::string &newAttributes,
+                                     std::string &keyDelta) {
+  OpenABEMetricsScope scope(OpenABE_LATENCY_KEYGEN, &metrics_);
+  if (keyInputType_ != FUNC_ATTRLIST_INPUT) {
+    throw ZCryptoBoxException("Key extension needs attribute-based keys (CP-ABE)");
+  }
+  unique_ptr<OpenABEFunctionInput> keyFuncInput = createAttributeList(newAttributes);
+  if (keyFuncInput == nullptr) {
+    throw ZCryptoBoxException("Invalid functional input for ABE key");
+  }
+  const string deltaID = DELTA_ID + keyID;
+  OpenABE_ERROR result = schemeContextCCA_->extendKey(MASTER_PUBLIC_PARAMS, MASTER_SECRET_PARAMS,
+                                                      keyID, keyFuncInput.get(), deltaID);
+  if (result != OpenABE_NOERROR) {
+    throw ZCryptoBoxException(OpenABE_errorToString(result));
+  }
+  OpenABEByteString delta;
+  result = schemeContextCCA_->exportKey(deltaID, delta);
+  schemeContextCCA_->deleteKey(deltaID);
+  if (result != OpenABE_NOERROR) {
+    throw ZCryptoBoxException(OpenABE_errorToString(result));
+  }
+  keyDelta = delta.toString();
+  if (base64Encode_)
+    keyDelta = Base64Encode((const uint8_t *)keyDelta.c_str(), keyDelta.size());
+}
+
+void OpenABECryptoContext::generateKeyUpdate(const std::string &keyID,
+                                             const std::string &updateAttributes,
+                                             std::string &keyUpdate) {
+  OpenABEMetricsScope scope(OpenABE_LATENCY_KEYGEN, &metrics_);
+  if (keyInputType_ != FUNC_ATTRLIST_INPUT) {
+    throw ZCryptoBoxException("Key updates need attribute-based keys (CP-ABE)");
+  }
+  unique_ptr<OpenABEFunctionInput> keyFuncInput = createAttributeList(updateAttributes);
+  if (keyFuncInput == nullptr) {
+    throw ZCryptoBoxException("Invalid functional input for ABE key");
+  }
+  const string updateID = DELTA_ID + keyID;
+  OpenABE_ERROR result = schemeContextCCA_->generateKeyUpdate(MASTER_PUBLIC_PARAMS,
+                                                              MASTER_SECRET_PARAMS, keyID,
+                                                              keyFuncInput.get(), updateID);
+  if (result != OpenABE_NOERROR) {
+    throw ZCryptoBoxException(OpenABE_errorToString(result));
+  }
+  OpenABEByteString update;
+  result = schemeContextCCA_->exportKey(updateID, update);
+  schemeContextCCA_->deleteKey(updateID);
+  if (result != OpenABE_NOERROR) {
+    throw ZCryptoBoxException(OpenABE_errorToString(result));
+  }
+  keyUpdate = update.toString();
+  if (base64Encode_)
+    keyUpdate = Base64Encode((const uint8_t *)keyUpdate.c_str(), keyUpdate.size());
+}
+
+void OpenABECryptoContext::applyKeyDelta(const std::string &keyID,
+                                         const std::string &keyDelta) {
+  OpenABEMetricsScope scope(OpenABE_LATENCY_IMPORT, &metrics_);
+  OpenABEByteString delta;
+  if (base64Encode_)
+    delta += Base64Decode(keyDelta);
+  else
+    delta += keyDelta;
+
+  const string deltaID = DELTA_ID + keyID;
+  OpenABE_ERROR result = schemeContextCCA_->loadUserSecretParams(deltaID, delta);
+  if (result == OpenABE_NOERROR) {
+    result = schemeContextCCA_->applyKeyDelta(keyID, deltaID);
+    schemeContextCCA_->deleteKey(deltaID);
+  }
+  if (result != OpenABE_NOERROR) {
+    throw ZCryptoBoxException(OpenABE_errorToString(result));
+  }
+}
+
+void OpenABECryptoContext::generateTransformKey(const std::string &keyID,
+                                                const std::string &tkID,
+                                                const std::string &rkID) {
+  OpenABE_ERROR result = schemeContextCCA_->generateTransformKey(keyID, tkID, rkID);
+  if (result != OpenABE_NOERROR) {
+    throw ZCryptoBoxException(OpenABE_errorToString(result));
+  }
+}
+
+bool OpenABECryptoContext::transformCiphertext(const std::string &tkID,
+                                               const std::string &ciphertext,
+                                               std::string &transformed) {
+  OpenABETraceSpan span("oabe.transform");
+  OpenABEByteString ct, ct1, ct2, tct1, combined;
+
+  try {
+    if (base64Encode_) {
+      ct += Base64Decode(ciphertext);
+    } else {
+      ct += ciphertext;
+    }
+    size_t index = 0;
+    ct.unpack(&index, ct1);
+    ct.unpack(&index, ct2);
+
+    unique_ptr<OpenABECiphertext> ciphertext1(new OpenABECiphertext);
+    unique_ptr<OpenABECiphertext> transformed1(new OpenABECiphertext);
+    ciphertext1->setLazyDecoding(true);
+    ciphertext1->loadFromBytes(ct1);
+
+    string mpkID = MASTER_PUBLIC_PARAMS;
+    OpenABE_ERROR result = schemeContextCCA_->transform(mpkID, tkID, ciphertext1.get(),
+                                                        transformed1.get());
+    if (result != OpenABE_NOERROR) {
+      if (debug_)
+        cerr << "OpenABECryptoContext::transformCiphertext: " << OpenABE_errorToString(result) << endl;
+      return false;
+    }
+
+    // the same framing as a ciphertext, with the payload passed through
+    transformed1->exportToBytes(tct1);
+    combined.pack(tct1);
+    combined.pack(ct2);
+    if (base64Encode_) {
+      const string tct = combined.toString();
+      transformed = Base64Encode((const uint8_t *)tct.data(), tct.size());
+    } else {
+      transformed = combined.toString();
+    }
+    return true;
+  } catch (OpenABE_ERROR &error) {
+    if (debug_)
+      cerr << "OpenABECryptoContext::transformCiphertext: " << OpenABE_errorToString(error) << endl;
+  }
+  return false;
+}
+
+bool OpenABECryptoContext::decryptTransformed(const std::string &rkID,
+                                              const std::string &transformed,
+                                              std::string &plaintext) {
+  OpenABEMetricsScope scope(OpenABE_LATENCY_DECRYPT, &metrics_);
+  OpenABETraceSpan span("oabe.decryptTransformed");
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  unique_ptr<OpenABECiphertext> transformed1 = nullptr, ciphertext2 = nullptr;
+
+  try {
+    loadCiphertext(transformed, transformed1, ciphertext2);
+    if ((result = schemeContextCCA_->decryptTransformed(
+             rkID, plaintext, transformed1.get(), ciphertext2.get())) !=
+        OpenABE_NOERROR) {
+      return false;
+    }
+    OpenABE_countMetric(OpenABE_METRIC_BYTES_DECRYPTED, plaintext.size());
+    return true;
+  } catch (OpenABE_ERROR &error) {
+    if (debug_)
+      cerr << "OpenABECryptoContext::decryptTransformed: " << OpenABE_errorToString(error) << endl;
+  }
+  return false;
+}
+
+bool OpenABECryptoContext::decrypt(const std::string &ciphertext,
+                                   std::string &plaintext) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  OpenABEKeyQuery query;
+  unique_ptr<OpenABECiphertext> ciphertext1 = nullptr, ciphertext2 = nullptr;
+  if (!useKeyManager_) {
+    throw ZCryptoBoxException("Key Manager not enabled!");
+  }
+  OpenABEMetricsScope scope(OpenABE_LATENCY_DECRYPT, &metrics_);
+  OpenABETraceSpan span("oabe.decrypt");
+
+  try {
+    string pt;
+    OpenABEByteString ct, ct1, ct2;
+    if (base64Encode_) {
+      // base64 decode ...
+      string ct_bin = Base64Decode(ciphertext);
+      ct += ct_bin;
+    } else {
+      ct += ciphertext;
+    }
+    size_t index = 0;
+    ct.unpack(&index, ct1);
+    ct.unpack(&index, ct2);
+
+    ciphertext1.reset(new OpenABECiphertext);
+    ciphertext2.reset(new OpenABECiphertext);
+
+    // only the rows needed to decrypt are decoded; the rest are checked
+    // against the re-encryption by their encoded bytes
+    ciphertext1->setLazyDecoding(true);
     ciphertext1->loadFromBytes(ct1);
     ciphertext2->loadFromBytes(ct2);
 
     string mpkID = MASTER_PUBLIC_PARAMS;
+
+    query.userId = userId_;
+    query.isEfficient = true;
+
+    unique_ptr<OpenABEFunctionInput> funcInput = getFunctionInput(ciphertext1.get());
+    const string decKeyId = keyManager_->searchKeyCommand(&query, funcInput.get());
+    if (decKeyId == "") {
+        throw ZCryptoBoxException("Key Manager could not find an appropriate key to decrypt!");
+    }
+
+    // load key in the scheme context. The key manager validated every point
+    // of the blob when it was stored, so only the ones used are decoded
+    pair<string,OpenABEByteString> sk = keyManager_->getKeyCommand(userId_, decKeyId);
+    if (debug_) { cout << "Found Key: '" << decKeyId << "' => '" << sk.first << "'" << endl; }
+    if ((result = schemeContextCCA_->loadUserSecretParams(decKeyId, sk.second, true)) != OpenABE_NOERROR) {
+        return false;
+    }
+
     // can now decrypt
     if ((result = schemeContextCCA_->decrypt(
-             mpkID, keyID, plaintext, ciphertext1.get(), ciphertext2.get())) !=
+             mpkID, decKeyId, plaintext, ciphertext1.get(), ciphertext2.get())) !=
         OpenABE_NOERROR) {
-      return result;
+      return false;
     }
+    OpenABE_countMetric(OpenABE_METRIC_BYTES_DECRYPTED, plaintext.size());
     return true;
   } catch (OpenABE_ERROR &error) {
     if (debug_)
@@ -290,65 +1383,1054 @@ bool OpenABECryptoContext::decrypt(const std::string &keyID,
   return false;
 }
 
-bool OpenABECryptoContext::decrypt(const std::string &ciphertext,
-                                   std::string &plaintext) {
-  OpenABE_ERROR result = OpenABE_NOERROR;
-  OpenABEKeyQuery query;
-  unique_ptr<OpenABECiphertext> ciphertext1 = nullptr, ciphertext2 = nullptr;
-  if (!useKeyManager_) {
-    throw ZCryptoBoxException("Key Manager not enabled!");
+namespace {
+
+// Writer/reader for the framing the string API builds with OpenABEByteString
+// (pack, smartPack and the BYTESTRING serialization), over raw buffers.
+const size_t BYTESTRING_HDR_LEN = 1 + sizeof(uint32_t);
+
+size_t smartPackLen(size_t n) {
+  if (n > UINT16_MAX) {
+    return 1 + sizeof(uint32_t) + n;
+  } else if (n > UINT8_MAX) {
+    return 1 + sizeof(uint16_t) + n;
+  }
+  return 2 + n;
+}
+
+uint8_t *write32(uint8_t *out, uint32_t n) {
+  out[0] = (n >> 24) & 0xFF;
+  out[1] = (n >> 16) & 0xFF;
+  out[2] = (n >> 8) & 0xFF;
+  out[3] = n & 0xFF;
+  return out + sizeof(uint32_t);
+}
+
+uint8_t *writeSmartPackHdr(uint8_t *out, size_t n) {
+  if (n > UINT16_MAX) {
+    *out++ = PACK_32;
+    return write32(out, (uint32_t)n);
+  } else if (n > UINT8_MAX) {
+    *out++ = PACK_16;
+    *out++ = (n >> 8) & 0xFF;
+    *out++ = n & 0xFF;
+    return out;
+  }
+  *out++ = PACK_8;
+  *out++ = (uint8_t)n;
+  return out;
+}
+
+uint8_t *writeBytes(uint8_t *out, OpenABEByteString &buf) {
+  memcpy(out, buf.getInternalPtr(), buf.size());
+  return out + buf.size();
+}
+
+// size of smartPack(name) || smartPack(serialized byte string of n bytes)
+size_t componentLen(const char *name, size_t n) {
+  return smartPackLen(strlen(name)) + smartPackLen(BYTESTRING_HDR_LEN + n);
+}
+
+// writes the framing of a byte string component and returns where its
+// n bytes of data go
+uint8_t *writeComponentHdr(uint8_t *out, const char *name, size_t n) {
+  size_t nameLen = strlen(name);
+  out = writeSmartPackHdr(out, nameLen);
+  memcpy(out, name, nameLen);
+  out = writeSmartPackHdr(out + nameLen, BYTESTRING_HDR_LEN + n);
+  *out++ = BYTESTRING;
+  return write32(out, (uint32_t)n);
+}
+
+class ByteReader {
+public:
+  ByteReader(const uint8_t *buf, size_t len) : buf_(buf), left_(len) {}
+
+  size_t left() const { return left_; }
+
+  const uint8_t *take(size_t n) {
+    if (n > left_) {
+      throw OpenABE_ERROR_INVALID_CIPHERTEXT_BODY;
+    }
+    const uint8_t *p = buf_;
+    buf_ += n;
+    left_ -= n;
+    return p;
+  }
+
+  uint32_t read32() {
+    const uint8_t *p = take(sizeof(uint32_t));
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+  }
+
+  const uint8_t *smartUnpack(size_t &n) {
+    uint8_t type = *take(1);
+    if (type == PACK_32) {
+      n = read32();
+    } else if (type == PACK_16) {
+      const uint8_t *p = take(sizeof(uint16_t));
+      n = ((size_t)p[0] << 8) | p[1];
+    } else if (type == PACK_8) {
+      n = *take(1);
+    } else {
+      throw OpenABE_ERROR_INVALID_PACK_TYPE;
+    }
+    return take(n);
+  }
+
+private:
+  const uint8_t *buf_;
+  size_t left_;
+};
+
+}
+
+/*!
+ * Encrypt a plaintext buffer under a policy (or attribute list). The
+ * ciphertext is always binary and is written in a single pass into the
+ * buffer the sink returns for its exact size.
+ *
+ * @param[in]   the policy (CP-ABE) or attribute list (KP-ABE).
+ * @param[in]   the plaintext and its length.
+ * @param[in]   the output sink for the ciphertext.
+ */
+void OpenABECryptoContext::encrypt(const std::string encInput,
+                         const uint8_t *plaintext, size_t plaintextLen,
+                         const OpenABEOutputSink &ciphertext) {
+  OpenABEMetricsScope scope(OpenABE_LATENCY_ENCRYPT, &metrics_);
+  OpenABETraceSpan span("oabe.encrypt");
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  unique_ptr<oabe::crypto::OpenABESymKeyAuthEnc> authEnc = nullptr;
+  OpenABECiphertext ciphertext1, ciphertext2;
+  OpenABEByteString ct1, hdr2;
+
+  try {
+    ASSERT(plaintext != nullptr && plaintextLen > 0,
+           OpenABE_ERROR_NO_PLAINTEXT_SPECIFIED);
+    // the symmetric cipher takes an int length
+    ASSERT(plaintextLen <= INT32_MAX, OpenABE_ERROR_INVALID_LENGTH);
+    unique_ptr<OpenABEFunctionInput> funcInput = createEncInput(encInput);
+
+    string mpkID = MASTER_PUBLIC_PARAMS;
+    result = schemeContextCCA_->encapsulate(mpkID, funcInput.get(),
+                                            &ciphertext1, authEnc);
+    ASSERT(result == OpenABE_NOERROR, result);
+    ciphertext1.exportToBytes(ct1);
+    // only the header of the second half is needed, the rest is laid out below
+    ciphertext2.setHeader(OpenABE_NONE_ID, OpenABE_SCHEME_AES_GCM, ciphertext1.getUID());
+    ciphertext2.getHeader(hdr2);
+
+    // components are serialized in name order: CT, IV, Tag
+    size_t body2Len = componentLen("CT", plaintextLen) +
+                      componentLen("IV", AES_BLOCK_SIZE) +
+                      componentLen("Tag", AES_BLOCK_SIZE);
+    size_t ct2Len = smartPackLen(hdr2.size()) + smartPackLen(body2Len);
+    size_t totalLen = 2 * sizeof(uint32_t) + ct1.size() + ct2Len;
+
+    uint8_t *out = ciphertext(totalLen);
+    ASSERT(out != nullptr, OpenABE_ERROR_INVALID_INPUT);
+    out = write32(out, (uint32_t)ct1.size());
+    out = writeBytes(out, ct1);
+    out = write32(out, (uint32_t)ct2Len);
+    out = writeSmartPackHdr(out, hdr2.size());
+    out = writeBytes(out, hdr2);
+    out = writeSmartPackHdr(out, body2Len);
+    uint8_t *ct = writeComponentHdr(out, "CT", plaintextLen);
+    uint8_t *iv = writeComponentHdr(ct + plaintextLen, "IV", AES_BLOCK_SIZE);
+    uint8_t *tag = writeComponentHdr(iv + AES_BLOCK_SIZE, "Tag", AES_BLOCK_SIZE);
+    result = authEnc->encrypt(plaintext, plaintextLen, iv, ct, tag);
+    ASSERT(result == OpenABE_NOERROR, result);
+    OpenABE_countMetric(OpenABE_METRIC_BYTES_ENCRYPTED, plaintextLen);
+  } catch (OpenABE_ERROR &error) {
+    if (debug_)
+      cerr << "OpenABECryptoContext::encrypt: " << OpenABE_errorToString(error) << endl;
+    throw ZCryptoBoxException(OpenABE_errorToString(error));
+  }
+}
+
+/*!
+ * Decrypt a binary ciphertext buffer. Only the ABE half is copied (to be
+ * decoded); the symmetric half is decrypted in place straight into the
+ * buffer the sink returns for the exact plaintext size. That buffer is
+ * zeroized if the ciphertext does not verify.
+ *
+ * @param[in]   key identifier of the recipient.
+ * @param[in]   the ciphertext and its length.
+ * @param[in]   the output sink for the plaintext.
+ * @return      true if decryption succeeded.
+ */
+bool OpenABECryptoContext::decrypt(const std::string &keyID,
+                         const uint8_t *ciphertext, size_t ciphertextLen,
+                         const OpenABEOutputSink &plaintext) {
+  OpenABE_ERROR result = tryDecrypt(keyID, ciphertext, ciphertextLen, plaintext);
+  if (result != OpenABE_NOERROR && debug_)
+    cerr << "OpenABECryptoContext::decrypt: " << OpenABE_errorToString(result) << endl;
+  return (result == OpenABE_NOERROR);
+}
+
+OpenABE_ERROR OpenABECryptoContext::tryDecrypt(const std::string &keyID,
+                         const uint8_t *ciphertext, size_t ciphertextLen,
+                         const OpenABEOutputSink &plaintext) {
+  OpenABEMetricsScope scope(OpenABE_LATENCY_DECRYPT, &metrics_);
+  OpenABETraceSpan span("oabe.decrypt");
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  unique_ptr<oabe::crypto::OpenABESymKeyAuthEnc> authEnc = nullptr;
+  unique_ptr<OpenABECiphertext> ciphertext1(new OpenABECiphertext);
+  const uint8_t *ct = nullptr, *iv = nullptr, *tag = nullptr;
+  size_t ctLen = 0, ivLen = 0, tagLen = 0;
+
+  try {
+    if (ciphertext == nullptr) {
+      return OpenABE_ERROR_INVALID_INPUT;
+    }
+    ByteReader reader(ciphertext, ciphertextLen);
+    size_t ct1Len = reader.read32();
+    OpenABEByteString ct1;
+    ct1.appendArray((uint8_t *)reader.take(ct1Len), ct1Len);
+    size_t ct2Len = reader.read32();
+    ByteReader ct2(reader.take(ct2Len), ct2Len);
+
+    // the header of the second half is not authenticated (nor checked by
+    // the string API), so only its size is validated
+    size_t hdr2Len = 0, body2Len = 0;
+    ct2.smartUnpack(hdr2Len);
+    if (hdr2Len != 3 + UID_LEN) {
+      throw OpenABE_ERROR_INVALID_CIPHERTEXT_HEADER;
+    }
+    ByteReader body2(ct2.smartUnpack(body2Len), body2Len);
+    while (body2.left() > 0) {
+      size_t nameLen = 0, valueLen = 0;
+      const uint8_t *name = body2.smartUnpack(nameLen);
+      ByteReader value(body2.smartUnpack(valueLen), valueLen);
+      if (*value.take(1) != BYTESTRING) {
+        throw OpenABE_ERROR_INVALID_CIPHERTEXT_BODY;
+      }
+      size_t len = value.read32();
+      const uint8_t *data = value.take(len);
+      if (value.left() != 0) {
+        throw OpenABE_ERROR_INVALID_CIPHERTEXT_BODY;
+      }
+
+      string key((const char *)name, nameLen);
+      if (key == "CT") {
+        ct = data;
+        ctLen = len;
+      } else if (key == "IV") {
+        iv = data;
+        ivLen = len;
+      } else if (key == "Tag") {
+        tag = data;
+        tagLen = len;
+      }
+    }
+    if (ct == nullptr || ctLen == 0 || iv == nullptr || ivLen == 0 ||
+        tag == nullptr || tagLen != AES_BLOCK_SIZE) {
+      return OpenABE_ERROR_INVALID_CIPHERTEXT_BODY;
+    }
+
+    ciphertext1->setLazyDecoding(true);
+    ciphertext1->loadFromBytes(ct1);
+    if ((result = checkKey(keyID, ciphertext1.get())) != OpenABE_NOERROR) {
+      return result;
+    }
+
+    string mpkID = MASTER_PUBLIC_PARAMS;
+    result = schemeContextCCA_->decapsulate(mpkID, keyID, ciphertext1.get(), authEnc);
+    if (result != OpenABE_NOERROR) {
+      return result;
+    }
+
+    uint8_t *out = plaintext(ctLen);
+    if (out == nullptr) {
+      return OpenABE_ERROR_INVALID_INPUT;
+    }
+    if (!authEnc->decrypt(out, ct, ctLen, iv, ivLen, tag)) {
+      return OpenABE_ERROR_DECRYPTION_FAILED;
+    }
+    OpenABE_countMetric(OpenABE_METRIC_BYTES_DECRYPTED, ctLen);
+  } catch (OpenABE_ERROR &error) {
+    result = error;
+  }
+  return result;
+}
+
+/*!
+ * Encrypt a large plaintext buffer under a policy (or attribute list). The
+ * ciphertext is the ABE ciphertext (with a 32-bit length) followed by the
+ * payload in the chunked AES-GCM format, written into the buffer the sink
+ * returns for its exact size.
+ *
+ * @param[in]   the policy (CP-ABE) or attribute list (KP-ABE).
+ * @param[in]   the plaintext and its length.
+ * @param[in]   the output sink for the ciphertext.
+ * @param[in]   plaintext bytes per chunk.
+ */
+void OpenABECryptoContext::encryptChunked(const std::string encInput,
+                         const uint8_t *plaintext, size_t plaintextLen,
+                         const OpenABEOutputSink &ciphertext, size_t chunkSize) {
+  OpenABEMetricsScope scope(OpenABE_LATENCY_ENCRYPT, &metrics_);
+  OpenABETraceSpan span("oabe.encrypt");
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  unique_ptr<oabe::crypto::OpenABESymKeyChunkedAuthEnc> authEnc = nullptr;
+  OpenABECiphertext ciphertext1;
+  OpenABEByteString ct1;
+
+  try {
+    ASSERT(plaintext != nullptr && plaintextLen > 0,
+           OpenABE_ERROR_NO_PLAINTEXT_SPECIFIED);
+    size_t payloadLen =
+        oabe::crypto::OpenABESymKeyChunkedAuthEnc::getCiphertextSize(plaintextLen, chunkSize);
+    ASSERT(payloadLen > 0, OpenABE_ERROR_INVALID_LENGTH);
+    unique_ptr<OpenABEFunctionInput> funcInput = createEncInput(encInput);
+
+    string mpkID = MASTER_PUBLIC_PARAMS;
+    result = schemeContextCCA_->encapsulate(mpkID, funcInput.get(),
+                                            &ciphertext1, authEnc);
+    ASSERT(result == OpenABE_NOERROR, result);
+    ciphertext1.exportToBytes(ct1);
+
+    uint8_t *out = ciphertext(sizeof(uint32_t) + ct1.size() + payloadLen);
+    ASSERT(out != nullptr, OpenABE_ERROR_INVALID_INPUT);
+    out = write32(out, (uint32_t)ct1.size());
+    out = writeBytes(out, ct1);
+    result = authEnc->encrypt(plaintext, plaintextLen, out, chunkSize);
+    ASSERT(result == OpenABE_NOERROR, result);
+    OpenABE_countMetric(OpenABE_METRIC_BYTES_ENCRYPTED, plaintextLen);
+  } catch (OpenABE_ERROR &error) {
+    if (debug_)
+      cerr << "OpenABECryptoContext::encryptChunked: " << OpenABE_errorToString(error) << endl;
+    throw ZCryptoBoxException(OpenABE_errorToString(error));
+  }
+}
+
+/*!
+ * Decrypt the ABE half of a chunked ciphertext and return the payload
+ * cipher, so that any number of ranges can be decrypted afterwards.
+ *
+ * @param[in]   key identifier of the recipient.
+ * @param[in]   the ciphertext and its length.
+ * @param[out]  where the chunked payload starts in the ciphertext.
+ * @return      the payload cipher, or nullptr on failure.
+ */
+unique_ptr<oabe::crypto::OpenABESymKeyChunkedAuthEnc>
+OpenABECryptoContext::openChunked(const std::string &keyID,
+                         const uint8_t *ciphertext, size_t ciphertextLen,
+                         size_t &payloadOffset) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  unique_ptr<oabe::crypto::OpenABESymKeyChunkedAuthEnc> authEnc = nullptr;
+  unique_ptr<OpenABECiphertext> ciphertext1(new OpenABECiphertext);
+
+  try {
+    ASSERT(ciphertext != nullptr, OpenABE_ERROR_INVALID_INPUT);
+    ByteReader reader(ciphertext, ciphertextLen);
+    size_t ct1Len = reader.read32();
+    OpenABEByteString ct1;
+    ct1.appendArray((uint8_t *)reader.take(ct1Len), ct1Len);
+    payloadOffset = ciphertextLen - reader.left();
+
+    ciphertext1->setLazyDecoding(true);
+    ciphertext1->loadFromBytes(ct1);
+
+    string mpkID = MASTER_PUBLIC_PARAMS;
+    result = schemeContextCCA_->decapsulate(mpkID, keyID, ciphertext1.get(), authEnc);
+    ASSERT(result == OpenABE_NOERROR, result);
+    return authEnc;
+  } catch (OpenABE_ERROR &error) {
+    if (debug_)
+      cerr << "OpenABECryptoContext::openChunked: " << OpenABE_errorToString(error) << endl;
+  }
+  return nullptr;
+}
+
+/*!
+ * Decrypt a whole chunked ciphertext into the buffer the sink returns for
+ * the exact plaintext size (zeroized if a chunk does not verify).
+ *
+ * @param[in]   key identifier of the recipient.
+ * @param[in]   the ciphertext and its length.
+ * @param[in]   the output sink for the plaintext.
+ * @return      true if decryption succeeded.
+ */
+bool OpenABECryptoContext::decryptChunked(const std::string &keyID,
+                         const uint8_t *ciphertext, size_t ciphertextLen,
+                         const OpenABEOutputSink &plaintext) {
+  OpenABEMetricsScope scope(OpenABE_LATENCY_DECRYPT, &metrics_);
+  OpenABETraceSpan span("oabe.decrypt");
+  size_t payloadOffset = 0;
+  unique_ptr<oabe::crypto::OpenABESymKeyChunkedAuthEnc> authEnc =
+      openChunked(keyID, ciphertext, ciphertextLen, payloadOffset);
+  if (!authEnc) {
+    return false;
+  }
+  const uint8_t *payload = ciphertext + payloadOffset;
+  size_t payloadLen = ciphertextLen - payloadOffset;
+  size_t plaintextLen =
+      oabe::crypto::OpenABESymKeyChunkedAuthEnc::getPlaintextSize(payload, payloadLen);
+  if (plaintextLen == 0) {
+    return false;
+  }
+  uint8_t *out = plaintext(plaintextLen);
+  if (out == nullptr || !authEnc->decrypt(out, payload, payloadLen)) {
+    return false;
+  }
+  OpenABE_countMetric(OpenABE_METRIC_BYTES_DECRYPTED, plaintextLen);
+  return true;
+}
+
+// reads the ABE ciphertext and the wrapped data key at the start of a
+// wrapped ciphertext (see encryptWrapped); the payload starts at
+// payloadOffset
+static void loadWrappedHeader(const uint8_t *ciphertext, size_t ciphertextLen,
+                              OpenABECiphertext &ciphertext1, OpenABECiphertext &wrapped,
+                              size_t &payloadOffset) {
+  ASSERT(ciphertext != nullptr, OpenABE_ERROR_INVALID_INPUT);
+  ByteReader reader(ciphertext, ciphertextLen);
+  OpenABEByteString ct1, wk;
+  size_t ct1Len = reader.read32();
+  ct1.appendArray((uint8_t *)reader.take(ct1Len), ct1Len);
+  size_t wkLen = reader.read32();
+  wk.appendArray((uint8_t *)reader.take(wkLen), wkLen);
+  payloadOffset = ciphertextLen - reader.left();
+
+  ciphertext1.setLazyDecoding(true);
+  ciphertext1.loadFromBytes(ct1);
+  wrapped.loadFromBytes(wk);
+}
+
+/*!
+ * Encrypt a large plaintext buffer as in encryptChunked, with the payload
+ * under a data key that is wrapped with the ABE key. The ciphertext is the
+ * ABE ciphertext and the wrapped data key (each with a 32-bit length)
+ * followed by the chunked payload, written into the buffer the sink
+ * returns for its exact size. Its policy (or attribute list) can later be
+ * changed with rewrap.
+ *
+ * @param[in]   the policy (CP-ABE) or attribute list (KP-ABE).
+ * @param[in]   the plaintext and its length.
+ * @param[in]   the output sink for the ciphertext.
+ * @param[in]   plaintext bytes per chunk.
+ */
+void OpenABECryptoContext::encryptWrapped(const std::string encInput,
+                         const uint8_t *plaintext, size_t plaintextLen,
+                         const OpenABEOutputSink &ciphertext, size_t chunkSize) {
+  OpenABEMetricsScope scope(OpenABE_LATENCY_ENCRYPT, &metrics_);
+  OpenABETraceSpan span("oabe.encrypt");
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  unique_ptr<oabe::crypto::OpenABESymKeyChunkedAuthEnc> authEnc = nullptr;
+  OpenABECiphertext ciphertext1, wrapped;
+  OpenABEByteString ct1, wk;
+
+  try {
+    ASSERT(plaintext != nullptr && plaintextLen > 0,
+           OpenABE_ERROR_NO_PLAINTEXT_SPECIFIED);
+    size_t payloadLen =
+        oabe::crypto::OpenABESymKeyChunkedAuthEnc::getCiphertextSize(plaintextLen, chunkSize);
+    ASSERT(payloadLen > 0, OpenABE_ERROR_INVALID_LENGTH);
+    unique_ptr<OpenABEFunctionInput> funcInput = createEncInput(encInput);
+
+    string mpkID = MASTER_PUBLIC_PARAMS;
+    result = schemeContextCCA_->encapsulateWrapped(mpkID, funcInput.get(),
+                                                   &ciphertext1, &wrapped, authEnc);
+    ASSERT(result == OpenABE_NOERROR, result);
+    ciphertext1.exportToBytes(ct1);
+    wrapped.exportToBytes(wk);
+
+    uint8_t *out = ciphertext(2 * sizeof(uint32_t) + ct1.size() + wk.size() + payloadLen);
+    ASSERT(out != nullptr, OpenABE_ERROR_INVALID_INPUT);
+    out = write32(out, (uint32_t)ct1.size());
+    out = writeBytes(out, ct1);
+    out = write32(out, (uint32_t)wk.size());
+    out = writeBytes(out, wk);
+    result = authEnc->encrypt(plaintext, plaintextLen, out, chunkSize);
+    ASSERT(result == OpenABE_NOERROR, result);
+    OpenABE_countMetric(OpenABE_METRIC_BYTES_ENCRYPTED, plaintextLen);
+  } catch (OpenABE_ERROR &error) {
+    if (debug_)
+      cerr << "OpenABECryptoContext::encryptWrapped: " << OpenABE_errorToString(error) << endl;
+    throw ZCryptoBoxException(OpenABE_errorToString(error));
+  }
+}
+
+/*!
+ * Decrypt a whole wrapped ciphertext into the buffer the sink returns for
+ * the exact plaintext size (zeroized if a chunk does not verify).
+ *
+ * @param[in]   key identifier of the recipient.
+ * @param[in]   the ciphertext and its length.
+ * @param[in]   the output sink for the plaintext.
+ * @return      true if decryption succeeded.
+ */
+bool OpenABECryptoContext::decryptWrapped(const std::string &keyID,
+                         const uint8_t *ciphertext, size_t ciphertextLen,
+                         const OpenABEOutputSink &plaintext) {
+  OpenABEMetricsScope scope(OpenABE_LATENCY_DECRYPT, &metrics_);
+  OpenABETraceSpan span("oabe.decrypt");
+  unique_ptr<oabe::crypto::OpenABESymKeyChunkedAuthEnc> authEnc = nullptr;
+  OpenABECiphertext ciphertext1, wrapped;
+  size_t payloadOffset = 0;
+
+  try {
+    loadWrappedHeader(ciphertext, ciphertextLen, ciphertext1, wrapped, payloadOffset);
+    string mpkID = MASTER_PUBLIC_PARAMS;
+    OpenABE_ERROR result = schemeContextCCA_->decapsulateWrapped(mpkID, keyID,
+                                                  &ciphertext1, &wrapped, authEnc);
+    ASSERT(result == OpenABE_NOERROR, result);
+
+    const uint8_t *payload = ciphertext + payloadOffset;
+    size_t payloadLen = ciphertextLen - payloadOffset;
+    size_t plaintextLen =
+        oabe::crypto::OpenABESymKeyChunkedAuthEnc::getPlaintextSize(payload, payloadLen);
+    ASSERT(plaintextLen > 0, OpenABE_ERROR_INVALID_CIPHERTEXT_BODY);
+    uint8_t *out = plaintext(plaintextLen);
+    ASSERT(out != nullptr, OpenABE_ERROR_INVALID_INPUT);
+    if (!authEnc->decrypt(out, payload, payloadLen)) {
+      throw OpenABE_ERROR_DECRYPTION_FAILED;
+    }
+    OpenABE_countMetric(OpenABE_METRIC_BYTES_DECRYPTED, plaintextLen);
+    return true;
+  } catch (OpenABE_ERROR &error) {
+    if (debug_)
+      cerr << "OpenABECryptoContext::decryptWrapped: " << OpenABE_errorToString(error) << endl;
+  }
+  return false;
+}
+
+/*!
+ * Change the policy (or attribute list) of a wrapped ciphertext without
+ * decrypting its payload: the data key is unwrapped with keyID and
+ * wrapped again under a new ABE ciphertext for newEncInput. Only the
+ * header of the ciphertext is read, so the buffer may stop anywhere after
+ * it.
+ *
+ * @param[in]   key identifier of a recipient of the ciphertext.
+ * @param[in]   the start of the ciphertext and its length.
+ * @param[in]   the new policy (CP-ABE) or attribute list (KP-ABE).
+ * @param[out]  the bytes that replace the first payloadOffset bytes of
+ *              the ciphertext (the payload after them is kept as is).
+ * @param[out]  where the payload starts in the given ciphertext.
+ * @return      true if the ciphertext was rewrapped.
+ */
+bool OpenABECryptoContext::rewrap(const std::string &keyID,
+                         const uint8_t *ciphertext, size_t ciphertextLen,
+                         const std::string newEncInput, std::string &header,
+                         size_t &payloadOffset) {
+  OpenABETraceSpan span("oabe.rewrap");
+  OpenABECiphertext ciphertext1, wrapped, newCiphertext1;
+  OpenABEByteString ct1, wk;
+
+  try {
+    loadWrappedHeader(ciphertext, ciphertextLen, ciphertext1, wrapped, payloadOffset);
+    unique_ptr<OpenABEFunctionInput> funcInput = createEncInput(newEncInput);
+    string mpkID = MASTER_PUBLIC_PARAMS;
+    OpenABE_ERROR result = schemeContextCCA_->rewrap(mpkID, keyID, funcInput.get(),
+                                                     &ciphertext1, &wrapped, &newCiphertext1);
+    ASSERT(result == OpenABE_NOERROR, result);
+    newCiphertext1.exportToBytes(ct1);
+    wrapped.exportToBytes(wk);
+
+    header.resize(2 * sizeof(uint32_t) + ct1.size() + wk.size());
+    uint8_t *out = (uint8_t *)&header[0];
+    out = write32(out, (uint32_t)ct1.size());
+    out = writeBytes(out, ct1);
+    out = write32(out, (uint32_t)wk.size());
+    writeBytes(out, wk);
+    return true;
+  } catch (OpenABE_ERROR &error) {
+    if (debug_)
+      cerr << "OpenABECryptoContext::rewrap: " << OpenABE_errorToString(error) << endl;
+  }
+  return false;
+}
+
+/*!
+ * Estimate an encryption from the compiled policy (or attribute list): the
+ * scheme lays out a skeleton of the ABE ciphertext with placeholder
+ * elements of the right encoded size, so the serialized sizes are exact.
+ *
+ * @param[in]   the policy (CP-ABE) or attribute list (KP-ABE).
+ * @param[out]  the operation counts and output sizes.
+ * @param[in]   the length of the plaintext.
+ * @param[in]   the chunk size of encryptChunked.
+ */
+void OpenABECryptoContext::estimate(const std::string encInput,
+                         OpenABEEncryptionEstimate &info, size_t plaintextLen,
+                         size_t chunkSize) {
+  OpenABECiphertext ciphertext1;
+  OpenABEByteString ct1;
+
+  try {
+    ASSERT(plaintextLen > 0, OpenABE_ERROR_NO_PLAINTEXT_SPECIFIED);
+    ASSERT(plaintextLen <= INT32_MAX, OpenABE_ERROR_INVALID_LENGTH);
+    unique_ptr<OpenABEFunctionInput> funcInput = createEncInput(encInput);
+
+    string mpkID = MASTER_PUBLIC_PARAMS;
+    OpenABE_ERROR result = schemeContextCCA_->estimate(mpkID, funcInput.get(),
+                                                       &ciphertext1, info.cost);
+    ASSERT(result == OpenABE_NOERROR, result);
+    ciphertext1.exportToBytes(ct1);
+    info.headerBytes = ct1.size();
+    ciphertext1.setCompactEncoding(true);
+    ciphertext1.exportToBytes(ct1);
+    info.compactHeaderBytes = ct1.size();
+
+    // the second half as laid out by the buffer encrypt
+    size_t body2Len = componentLen("CT", plaintextLen) +
+                      componentLen("IV", AES_BLOCK_SIZE) +
+                      componentLen("Tag", AES_BLOCK_SIZE);
+    size_t ct2Len = smartPackLen(3 + UID_LEN) + smartPackLen(body2Len);
+    info.binaryBytes = 2 * sizeof(uint32_t) + info.headerBytes + ct2Len;
+    info.ciphertextBytes = base64Encode_ ? (info.binaryBytes + 2) / 3 * 4
+                                         : info.binaryBytes;
+    size_t payloadLen =
+        oabe::crypto::OpenABESymKeyChunkedAuthEnc::getCiphertextSize(plaintextLen, chunkSize);
+    ASSERT(payloadLen > 0, OpenABE_ERROR_INVALID_LENGTH);
+    info.chunkedBytes = sizeof(uint32_t) + info.headerBytes + payloadLen;
+  } catch (OpenABE_ERROR &error) {
+    if (debug_)
+      cerr << "OpenABECryptoContext::estimate: " << OpenABE_errorToString(error) << endl;
+    throw ZCryptoBoxException(OpenABE_errorToString(error));
+  }
+}
+
+/*!
+ * Start a streaming encryption under a policy (or attribute list).
+ *
+ * @param[in]   the policy (CP-ABE) or attribute list (KP-ABE).
+ * @param[out]  the ABE ciphertext and payload header are appended.
+ * @param[in]   plaintext bytes per chunk (also the memory held back).
+ */
+void OpenABECryptoContext::encryptInit(const std::string encInput,
+                         std::string &ciphertext, size_t chunkSize) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  OpenABECiphertext ciphertext1;
+  OpenABEByteString ct1, out;
+
+  try {
+    encStream_.reset();
+    unique_ptr<OpenABEFunctionInput> funcInput = createEncInput(encInput);
+
+    string mpkID = MASTER_PUBLIC_PARAMS;
+    result = schemeContextCCA_->encapsulate(mpkID, funcInput.get(),
+                                            &ciphertext1, encStream_);
+    ASSERT(result == OpenABE_NOERROR, result);
+    ciphertext1.exportToBytes(ct1);
+    out.pack(ct1);
+    result = encStream_->encryptInit(&out, chunkSize);
+    ASSERT(result == OpenABE_NOERROR, result);
+    ciphertext.append((const char *)out.getInternalPtr(), out.size());
+  } catch (OpenABE_ERROR &error) {
+    encStream_.reset();
+    if (debug_)
+      cerr << "OpenABECryptoContext::encryptInit: " << OpenABE_errorToString(error) << endl;
+    throw ZCryptoBoxException(OpenABE_errorToString(error));
+  }
+}
+
+void OpenABECryptoContext::encryptUpdate(const std::string &plaintextBlock,
+                         std::string &ciphertext) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  OpenABEByteString out;
+
+  try {
+    ASSERT(encStream_ != nullptr, OpenABE_ERROR_INVALID_INPUT);
+    result = encStream_->encryptUpdate((const uint8_t *)plaintextBlock.data(),
+                                       plaintextBlock.size(), &out);
+    ASSERT(result == OpenABE_NOERROR, result);
+    if (out.size() > 0) {
+      ciphertext.append((const char *)out.getInternalPtr(), out.size());
+    }
+  } catch (OpenABE_ERROR &error) {
+    encStream_.reset();
+    if (debug_)
+      cerr << "OpenABECryptoContext::encryptUpdate: " << OpenABE_errorToString(error) << endl;
+    throw ZCryptoBoxException(OpenABE_errorToString(error));
+  }
+}
+
+void OpenABECryptoContext::encryptFinalize(std::string &ciphertext) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  OpenABEByteString out;
+
+  try {
+    ASSERT(encStream_ != nullptr, OpenABE_ERROR_INVALID_INPUT);
+    result = encStream_->encryptFinalize(&out);
+    encStream_.reset();
+    ASSERT(result == OpenABE_NOERROR, result);
+    ciphertext.append((const char *)out.getInternalPtr(), out.size());
+  } catch (OpenABE_ERROR &error) {
+    encStream_.reset();
+    if (debug_)
+      cerr << "OpenABECryptoContext::encryptFinalize: " << OpenABE_errorToString(error) << endl;
+    throw ZCryptoBoxException(OpenABE_errorToString(error));
+  }
+}
+
+/*!
+ * Start a streaming decryption. The ABE ciphertext is decrypted as soon as
+ * it has been fed in full, the payload chunk by chunk after that.
+ *
+ * @param[in]   key identifier of the recipient.
+ */
+void OpenABECryptoContext::decryptInit(const std::string &keyID) {
+  decStream_.reset();
+  decStreamHeader_.zeroize();
+  decStreamKeyID_ = keyID;
+  decStreamOpen_ = true;
+}
+
+bool OpenABECryptoContext::decryptUpdate(const std::string &ciphertextBlock,
+                         std::string &plaintext) {
+  OpenABE_ERROR result = OpenABE_NOERROR;
+  OpenABEByteString out;
+
+  try {
+    ASSERT(decStreamOpen_, OpenABE_ERROR_INVALID_INPUT);
+    const uint8_t *in = (const uint8_t *)ciphertextBlock.data();
+    size_t inLen = ciphertextBlock.size();
+
+    if (decStream_ == nullptr) {
+      // the ABE ciphertext comes first, with its length in front
+      decStreamHeader_.insert(decStreamHeader_.end(), in, in + inLen);
+      if (decStreamHeader_.size() < sizeof(uint32_t)) {
+        return true;
+      }
+      ByteReader reader(decStreamHeader_.getInternalPtr(), decStreamHeader_.size());
+      size_t ct1Len = reader.read32();
+      ASSERT(ct1Len <= MAX_STREAM_ABE_CIPHERTEXT_LEN, OpenABE_ERROR_INVALID_CIPHERTEXT_HEADER);
+      if (reader.left() < ct1Len) {
+        return true;
+      }
+
+      OpenABEByteString ct1;
+      ct1.appendArray((uint8_t *)reader.take(ct1Len), ct1Len);
+      unique_ptr<OpenABECiphertext> ciphertext1(new OpenABECiphertext);
+      ciphertext1->setLazyDecoding(true);
+      ciphertext1->loadFromBytes(ct1);
+
+      string mpkID = MASTER_PUBLIC_PARAMS;
+      result = schemeContextCCA_->decapsulate(mpkID, decStreamKeyID_,
+                                              ciphertext1.get(), decStream_);
+      ASSERT(result == OpenABE_NOERROR, result);
+      decStream_->decryptInit();
+      // the rest of the buffer is payload
+      inLen = reader.left();
+      in = reader.take(inLen);
+    }
+
+    ASSERT(decStream_->decryptUpdate(in, inLen, &out), OpenABE_ERROR_DECRYPTION_FAILED);
+    decStreamHeader_.clear();
+    if (out.size() > 0) {
+      plaintext.append((const char *)out.getInternalPtr(), out.size());
+      out.zeroize();
+    }
+    return true;
+  } catch (OpenABE_ERROR &error) {
+    out.zeroize();
+    decStream_.reset();
+    decStreamHeader_.clear();
+    decStreamOpen_ = false;
+    if (debug_)
+      cerr << "OpenABECryptoContext::decryptUpdate: " << OpenABE_errorToString(error) << endl;
+  }
+  return false;
+}
+
+bool OpenABECryptoContext::decryptFinalize(std::string &plaintext) {
+  OpenABEByteString out;
+  bool ok = (decStreamOpen_ && decStream_ != nullptr && decStream_->decryptFinalize(&out));
+  if (ok) {
+    plaintext.append((const char *)out.getInternalPtr(), out.size());
+    out.zeroize();
+  } else if (debug_) {
+    cerr << "OpenABECryptoContext::decryptFinalize: "
+         << OpenABE_errorToString(OpenABE_ERROR_DECRYPTION_FAILED) << endl;
+  }
+  decStream_.reset();
+  decStreamHeader_.clear();
+  decStreamOpen_ = false;
+  return ok;
+}
+
+// a record is the session ID, the nonce and the tag, then the ciphertext
+static const size_t SESSION_RECORD_OVERHEAD = UID_LEN + 2 * AES_BLOCK_SIZE;
+
+static string sessionIDOf(OpenABEByteString &header) {
+  uint8_t digest[SHA256_LEN];
+  sha256(digest, header.getInternalPtr(), header.size());
+  return string((const char *)digest, UID_LEN);
+}
+
+/*!
+ * Open an envelope session under a policy (or attribute list).
+ *
+ * @param[in]   the policy (CP-ABE) or attribute list (KP-ABE).
+ * @param[out]  the session header, to be sent ahead of the records.
+ * @param[in]   records sealed before the data key is replaced (0 for no limit).
+ * @param[in]   seconds before the data key is replaced (0 for no limit).
+ */
+void OpenABECryptoContext::sessionOpen(const std::string encInput,
+                         std::string &header, uint64_t maxRecords,
+                         uint32_t maxSeconds) {
+  OpenABEMetricsScope scope(OpenABE_LATENCY_ENCRYPT, &metrics_);
+  try {
+    sessionClose();
+    sessionInput_ = createEncInput(encInput);
+    sessionMaxRecords_ = maxRecords;
+    sessionMaxSeconds_ = maxSeconds;
+    startSession(header);
+  } catch (OpenABE_ERROR &error) {
+    sessionClose();
+    if (debug_)
+      cerr << "OpenABECryptoContext::sessionOpen: " << OpenABE_errorToString(error) << endl;
+    throw ZCryptoBoxException(OpenABE_errorToString(error));
+  }
+}
+
+void OpenABECryptoContext::startSession(std::string &header) {
+  OpenABETraceSpan span("oabe.sessionOpen");
+  OpenABECiphertext ciphertext1;
+  OpenABEByteString ct1;
+  session_.reset();
+
+  string mpkID = MASTER_PUBLIC_PARAMS;
+  OpenABE_ERROR result = schemeContextCCA_->encapsulate(mpkID, sessionInput_.get(),
+                                                        &ciphertext1, session_);
+  ASSERT(result == OpenABE_NOERROR, result);
+  ciphertext1.exportToBytes(ct1);
+  sessionID_ = sessionIDOf(ct1);
+  sessionRecords_ = 0;
+  sessionStart_ = std::chrono::steady_clock::now();
+
+  if (base64Encode_) {
+    header = Base64Encode(ct1.getInternalPtr(), ct1.size());
+  } else {
+    header = ct1.toString();
+  }
+}
+
+/*!
+ * Seal a record under the open session, replacing the data key first if
+ * the session has reached its limits.
+ *
+ * @param[in]   the plaintext.
+ * @param[out]  the record.
+ * @param[out]  the new session header, if one was started.
+ * @return      true if a new session header was written to header.
+ */
+bool OpenABECryptoContext::sessionEncrypt(const std::string &plaintext,
+                         std::string &record, std::string &header) {
+  OpenABEMetricsScope scope(OpenABE_LATENCY_ENCRYPT, &metrics_);
+  bool rotated = false;
+
+  try {
+    ASSERT(session_ != nullptr, OpenABE_ERROR_INVALID_INPUT);
+    ASSERT(plaintext.size() > 0, OpenABE_ERROR_NO_PLAINTEXT_SPECIFIED);
+    bool expired = (sessionMaxRecords_ > 0 && sessionRecords_ >= sessionMaxRecords_);
+    if (!expired && sessionMaxSeconds_ > 0) {
+      expired = (std::chrono::steady_clock::now() - sessionStart_ >=
+                 std::chrono::seconds(sessionMaxSeconds_));
+    }
+    if (expired) {
+      startSession(header);
+      rotated = true;
+    }
+
+    string out(SESSION_RECORD_OVERHEAD + plaintext.size(), '\0');
+    uint8_t *p = (uint8_t *)&out[0];
+    memcpy(p, sessionID_.data(), UID_LEN);
+    OpenABE_ERROR result = session_->encrypt((const uint8_t *)plaintext.data(), plaintext.size(),
+                                             p + UID_LEN, p + SESSION_RECORD_OVERHEAD,
+                                             p + UID_LEN + AES_BLOCK_SIZE);
+    ASSERT(result == OpenABE_NOERROR, result);
+    sessionRecords_++;
+    OpenABE_countMetric(OpenABE_METRIC_BYTES_ENCRYPTED, plaintext.size());
+
+    if (base64Encode_) {
+      record = Base64Encode((const uint8_t *)out.data(), out.size());
+    } else {
+      record.swap(out);
+    }
+  } catch (OpenABE_ERROR &error) {
+    if (debug_)
+      cerr << "OpenABECryptoContext::sessionEncrypt: " << OpenABE_errorToString(error) << endl;
+    throw ZCryptoBoxException(OpenABE_errorToString(error));
+  }
+  return rotated;
+}
+
+void OpenABECryptoContext::sessionClose() {
+  session_.reset();
+  sessionInput_.reset();
+  sessionID_.clear();
+  sessionRecords_ = 0;
+}
+
+/*!
+ * Decrypt a session header and keep its data key for sessionDecrypt.
+ *
+ * @param[in]   key identifier of the recipient.
+ * @param[in]   the session header.
+ * @return      true if the session can now be decrypted.
+ */
+bool OpenABECryptoContext::sessionAccept(const std::string &keyID,
+                         const std::string &header) {
+  OpenABEMetricsScope scope(OpenABE_LATENCY_DECRYPT, &metrics_);
+  OpenABETraceSpan span("oabe.sessionAccept");
+  unique_ptr<oabe::crypto::OpenABESymKeyAuthEnc> authEnc = nullptr;
+  unique_ptr<OpenABECiphertext> ciphertext1(new OpenABECiphertext);
+  OpenABEByteString ct1;
+
+  try {
+    if (base64Encode_) {
+      ct1 += Base64Decode(header);
+    } else {
+      ct1 += header;
+    }
+    const string id = sessionIDOf(ct1);
+    if (acceptedSessions_.count(id) > 0) {
+      return true;
+    }
+
+    ciphertext1->setLazyDecoding(true);
+    ciphertext1->loadFromBytes(ct1);
+    string mpkID = MASTER_PUBLIC_PARAMS;
+    OpenABE_ERROR result = schemeContextCCA_->decapsulate(mpkID, keyID,
+                                                          ciphertext1.get(), authEnc);
+    ASSERT(result == OpenABE_NOERROR, result);
+
+    if (acceptedOrder_.size() >= SESSION_CACHE_SIZE) {
+      acceptedSessions_.erase(acceptedOrder_.front());
+      acceptedOrder_.pop_front();
+    }
+    acceptedSessions_[id] = std::move(authEnc);
+    acceptedOrder_.push_back(id);
+    return true;
+  } catch (OpenABE_ERROR &error) {
+    if (debug_)
+      cerr << "OpenABECryptoContext::sessionAccept: " << OpenABE_errorToString(error) << endl;
+  }
+  return false;
+}
+
+bool OpenABECryptoContext::sessionDecrypt(const std::string &record,
+                         std::string &plaintext) {
+  OpenABEMetricsScope scope(OpenABE_LATENCY_DECRYPT, &metrics_);
+  string bin;
+  if (base64Encode_) {
+    bin = Base64Decode(record);
+  }
+  const string &in = base64Encode_ ? bin : record;
+  if (in.size() <= SESSION_RECORD_OVERHEAD) {
+    return false;
+  }
+
+  auto it = acceptedSessions_.find(in.substr(0, UID_LEN));
+  if (it == acceptedSessions_.end()) {
+    if (debug_)
+      cerr << "OpenABECryptoContext::sessionDecrypt: unknown session" << endl;
+    return false;
+  }
+  const uint8_t *p = (const uint8_t *)in.data();
+  size_t ctLen = in.size() - SESSION_RECORD_OVERHEAD;
+  string out(ctLen, '\0');
+  if (!it->second->decrypt((uint8_t *)&out[0], p + SESSION_RECORD_OVERHEAD, ctLen,
+                           p + UID_LEN, AES_BLOCK_SIZE, p + UID_LEN + AES_BLOCK_SIZE)) {
+    return false;
+  }
+  plaintext.swap(out);
+  OpenABE_countMetric(OpenABE_METRIC_BYTES_DECRYPTED, ctLen);
+  return true;
+}
+
+void OpenABECryptoContext::getMetrics(OpenABEMetricsSnapshot &snapshot) {
+  metrics_.snapshot(snapshot);
+}
+
+void OpenABECryptoContext::resetMetrics() {
+  metrics_.reset();
+}
+
+/*!
+ * The key and encryption inputs are parsed on the calling thread; an input
+ * that does not parse is reported as OpenABE_ERROR_INVALID_INPUT through
+ * the result like any other failure.
+ */
+function<OpenABE_ERROR(std::string &)>
+OpenABECryptoContext::keygenOp(const std::string &keyInput, const std::string &keyID) {
+  shared_ptr<OpenABEFunctionInput> keyFuncInput;
+  if (keyInputType_ == FUNC_POLICY_INPUT) {
+    keyFuncInput = createPolicyTree(keyInput);
+  } else {
+    keyFuncInput = createAttributeList(keyInput);
   }
 
-  try {
-    string pt;
-    OpenABEByteString ct, ct1, ct2;
-    if (base64Encode_) {
-      // base64 decode ...
-      string ct_bin = Base64Decode(ciphertext);
-      ct += ct_bin;
-    } else {
-      ct += ciphertext;
+  return [this, keyFuncInput, keyID](string &) {
+    if (keyFuncInput == nullptr) {
+      return OpenABE_ERROR_INVALID_INPUT;
     }
-    size_t index = 0;
-    ct.unpack(&index, ct1);
-    ct.unpack(&index, ct2);
+    OpenABEMetricsScope scope(OpenABE_LATENCY_KEYGEN, &metrics_);
+    string mpkID = MASTER_PUBLIC_PARAMS, mskID = MASTER_SECRET_PARAMS, gpkID = "";
+    return schemeContextCCA_->keygen(keyFuncInput.get(), keyID, mpkID, mskID,
+                                     gpkID, "");
+  };
+}
 
-    ciphertext1.reset(new OpenABECiphertext);
-    ciphertext2.reset(new OpenABECiphertext);
+function<OpenABE_ERROR(std::string &)>
+OpenABECryptoContext::encryptOp(const std::string &encInput, const std::string &plaintext) {
+  shared_ptr<OpenABEFunctionInput> funcInput;
+  if (encInputType_ == FUNC_POLICY_INPUT) {
+    funcInput = createPolicyTree(encInput);
+  } else {
+    funcInput = createAttributeList(encInput);
+  }
 
-    ciphertext1->loadFromBytes(ct1);
-    ciphertext2->loadFromBytes(ct2);
+  return [this, funcInput, plaintext](string &ciphertext) {
+    if (funcInput == nullptr) {
+      return OpenABE_ERROR_INVALID_INPUT;
+    }
+    OpenABEMetricsScope scope(OpenABE_LATENCY_ENCRYPT, &metrics_);
+    OpenABETraceSpan span("oabe.encrypt");
+    OpenABE_ERROR result = encryptWithInput(funcInput.get(), plaintext, ciphertext);
+    span.setStatus(result);
+    return result;
+  };
+}
 
-    string mpkID = MASTER_PUBLIC_PARAMS;
+std::future<OpenABEAsyncResult>
+OpenABECryptoContext::keygenAsync(const std::string &keyInput, const std::string &keyID) {
+  return async_.run(keygenOp(keyInput, keyID));
+}
 
-    query.userId = userId_;
-    query.isEfficient = true;
+void OpenABECryptoContext::keygenAsync(const std::string &keyInput, const std::string &keyID,
+                                       OpenABECompletion done) {
+  async_.run(keygenOp(keyInput, keyID), done);
+}
 
-    unique_ptr<OpenABEFunctionInput> funcInput = getFunctionInput(ciphertext1.get());
-    const string decKeyId = keyManager_->searchKeyCommand(&query, funcInput.get());
-    if (decKeyId == "") {
-        throw ZCryptoBoxException("Key Manager could not find an appropriate key to decrypt!");
-    }
+std::future<OpenABEAsyncResult>
+OpenABECryptoContext::encryptAsync(const std::string &encInput, const std::string &plaintext) {
+  return async_.run(encryptOp(encInput, plaintext));
+}
 
-    // load key in the scheme context
-    pair<string,OpenABEByteString> sk = keyManager_->getKeyCommand(userId_, decKeyId);
-    if (debug_) { cout << "Found Key: '" << decKeyId << "' => '" << sk.first << "'" << endl; }
-    if ((result = schemeContextCCA_->loadUserSecretParams(decKeyId, sk.second)) != OpenABE_NOERROR) {
-        return result;
-    }
+void OpenABECryptoContext::encryptAsync(const std::string &encInput,
+                                        const std::string &plaintext,
+                                        OpenABECompletion done) {
+  async_.run(encryptOp(encInput, plaintext), done);
+}
 
-    // can now decrypt
-    if ((result = schemeContextCCA_->decrypt(
-             mpkID, decKeyId, plaintext, ciphertext1.get(), ciphertext2.get())) !=
-        OpenABE_NOERROR) {
-      return result;
-    }
-    return true;
-  } catch (OpenABE_ERROR &error) {
-    if (debug_)
-      cerr << "OpenABECryptoContext::decrypt: " << OpenABE_errorToString(error) << endl;
-  }
-  return false;
+std::future<OpenABEAsyncResult>
+OpenABECryptoContext::decryptAsync(const std::string &keyID, const std::string &ciphertext) {
+  return async_.run([this, keyID, ciphertext](string &plaintext) {
+    return tryDecrypt(keyID, ciphertext, plaintext);
+  });
+}
+
+void OpenABECryptoContext::decryptAsync(const std::string &keyID,
+                                        const std::string &ciphertext,
+                                        OpenABECompletion done) {
+  async_.run([this, keyID, ciphertext](string &plaintext) {
+    return tryDecrypt(keyID, ciphertext, plaintext);
+  }, done);
 }
 
 /////////////////// OpenABECryptoContext ////////////////////////
@@ -457,6 +2539,31 @@ bool OpenPKEContext::encrypt(const string receiver_id, const string &plaintext,
   return true;
 }
 
+bool OpenPKEContext::encryptMulti(const vector<string> &receiver_ids,
+                                  const string &plaintext, string &ciphertext) {
+  OpenABE_ERROR result;
+  OpenABECiphertext ct;
+  OpenABEByteString ct_buf;
+  vector<string> pk_ids;
+  pk_ids.reserve(receiver_ids.size());
+  for (const string &receiver_id : receiver_ids) {
+    pk_ids.push_back(OpenABE_PK_PREFIX(receiver_id));
+  }
+
+  // each receiver is its own sender, as in encrypt
+  if ((result = schemeContext_->encryptMulti(nullptr, pk_ids, "", plaintext,
+                                             &ct)) != OpenABE_NOERROR) {
+    throw ZCryptoBoxException("encryptMulti: " + string(OpenABE_errorToString(result)));
+  }
+  ct.exportToBytes(ct_buf);
+  if (base64Encode_)
+    ciphertext = Base64Encode(ct_buf.data(), ct_buf.size());
+  else
+    ciphertext = ct_buf.toString();
+
+  return true;
+}
+
 bool OpenPKEContext::decrypt(const string receiver_id, const string &ciphertext,
                          string &plaintext) {
   OpenABE_ERROR result;
@@ -477,8 +2584,216 @@ bool OpenPKEContext::decrypt(const string receiver_id, const string &ciphertext,
   return true;
 }
 
+/*!
+ * Sign-then-encrypt one message. The sealed payload is
+ *   [receiver ID length (2)] [receiver ID] [message] [signature] [signature length (2)]
+ * where the signature covers everything before it. Binding the receiver ID
+ * keeps a receiver from passing the signed message on as if it had been
+ * sent to someone else.
+ */
+OpenABE_ERROR OpenPKEContext::signcryptWith(OpenPKSIGContext &signer,
+                                            const string &sender_key_id,
+                                            const string &receiver_id,
+                                            const string &plaintext,
+                                            string &ciphertext) {
+  if (plaintext.empty()) {
+    return OpenABE_ERROR_NO_PLAINTEXT_SPECIFIED;
+  }
+  if (receiver_id.size() > 0xFFFF) {
+    return OpenABE_ERROR_INVALID_INPUT;
+  }
+
+  // the only copy of the message: signed and then encrypted in place
+  OpenABEByteString payload;
+  payload.reserve(2 + receiver_id.size() + plaintext.size() + MAX_BUFFER_SIZE);
+  payload.push_back((uint8_t)(receiver_id.size() >> 8));
+  payload.push_back((uint8_t)(receiver_id.size() & 0xFF));
+  payload.appendArray((uint8_t *)receiver_id.data(), receiver_id.size());
+  payload.appendArray((uint8_t *)plaintext.data(), plaintext.size());
+  const size_t signedLen = payload.size();
+
+  // signing and the key derivation don't depend on each other
+  shared_ptr<OpenABESymKey> key(new OpenABESymKey);
+  OpenABECiphertext ct;
+  string sig;
+  OpenABE_ERROR sigResult = OpenABE_NOERROR, kemResult = OpenABE_NOERROR;
+  const string pk_id = OpenABE_PK_PREFIX(receiver_id);
+  OpenABEThreadPool::getDefault()->parallelFor(2, [&](size_t i) {
+    if (i == 0) {
+      try {
+        signer.sign(sender_key_id, payload.data(), signedLen, sig);
+      } catch (ZCryptoBoxException &) {
+        sigResult = OpenABE_ERROR_SIGNATURE_FAILED;
+      }
+    } else {
+      kemResult = schemeContext_->encapsulate(nullptr, pk_id, pk_id, key, &ct);
+    }
+  });
+  if (sigResult != OpenABE_NOERROR || kemResult != OpenABE_NOERROR) {
+    key->zeroize();
+    return (kemResult != OpenABE_NOERROR) ? kemResult : sigResult;
+  }
+  if (sig.size() > 0xFFFF) {
+    key->zeroize();
+    return OpenABE_ERROR_SIGNATURE_FAILED;
+  }
+
+  payload.appendArray((uint8_t *)sig.data(), sig.size());
+  payload.push_back((uint8_t)(sig.size() >> 8));
+  payload.push_back((uint8_t)(sig.size() & 0xFF));
+  OpenABE_ERROR result = schemeContext_->seal(key, payload.data(), payload.size(), &ct);
+  if (result != OpenABE_NOERROR) {
+    return result;
+  }
+
+  OpenABEByteString ct_buf;
+  ct.exportToBytes(ct_buf);
+  if (base64Encode_)
+    ciphertext = Base64Encode(ct_buf.data(), ct_buf.size());
+  else
+    ciphertext = ct_buf.toString();
+  return OpenABE_NOERROR;
+}
+
+void OpenPKEContext::signcrypt(OpenPKSIGContext &signer, const string sender_key_id,
+                               const string receiver_id, const string &plaintext,
+                               string &ciphertext) {
+  OpenABE_ERROR result = signcryptWith(signer, sender_key_id, receiver_id,
+                                       plaintext, ciphertext);
+  if (result != OpenABE_NOERROR) {
+    throw ZCryptoBoxException("signcrypt: " + string(OpenABE_errorToString(result)));
+  }
+}
+
+bool OpenPKEContext::unsigncrypt(OpenPKSIGContext &verifier, const string sender_key_id,
+                                 const string receiver_id, const string &ciphertext,
+                                 string &plaintext) {
+  string payload;
+  plaintext.clear();
+  try {
+    if (!decrypt(receiver_id, ciphertext, payload)) {
+      return false;
+    }
+  } catch (OpenABE_ERROR &) {
+    return false;
+  }
+
+  const uint8_t *p = (const uint8_t *)payload.data();
+  const size_t len = payload.size();
+  if (len < 4) {
+    return false;
+  }
+  const size_t recvLen = ((size_t)p[0] << 8) | p[1];
+  const size_t sigLen = ((size_t)p[len-2] << 8) | p[len-1];
+  if (2 + recvLen + sigLen + 2 >= len ||
+      payload.compare(2, recvLen, receiver_id) != 0 ||
+      recvLen != receiver_id.size()) {
+    return false;
+  }
+  const size_t signedLen = len - sigLen - 2;
+  if (!verifier.verify(sender_key_id, p, signedLen, p + signedLen, sigLen)) {
+    return false;
+  }
+  plaintext = payload.substr(2 + recvLen, signedLen - 2 - recvLen);
+  return true;
+}
+
+void OpenPKEContext::signcryptBatch(OpenPKSIGContext &signer, const string sender_key_id,
+                                    const vector<string> &receiver_ids,
+                                    const vector<string> &plaintexts,
+                                    vector<string> &ciphertexts) {
+  if (receiver_ids.size() != plaintexts.size()) {
+    throw ZCryptoBoxException("signcryptBatch: number of receivers and plaintexts differ");
+  }
+  const size_t count = plaintexts.size();
+  ciphertexts.clear();
+  ciphertexts.resize(count);
+
+  vector<OpenABE_ERROR> status(count, OpenABE_NOERROR);
+  OpenABEThreadPool::getDefault()->parallelFor(count, [&](size_t i) {
+    try {
+      status[i] = signcryptWith(signer, sender_key_id, receiver_ids[i],
+                                plaintexts[i], ciphertexts[i]);
+    } catch (OpenABE_ERROR &error) {
+      status[i] = error;
+    }
+  });
+  for (size_t i = 0; i < count; i++) {
+    if (status[i] != OpenABE_NOERROR) {
+      ciphertexts.clear();
+      throw ZCryptoBoxException("signcryptBatch: " + string(OpenABE_errorToString(status[i])));
+    }
+  }
+}
+
+// the public-key contexts report failures by exception or by a false
+// return; their asynchronous calls map both onto the given error code
+static function<OpenABE_ERROR(std::string &)>
+asyncOp(function<bool(std::string &)> call, OpenABE_ERROR failure) {
+  return [call, failure](string &output) {
+    try {
+      return call(output) ? OpenABE_NOERROR : failure;
+    } catch (ZCryptoBoxException &) {
+      return failure;
+    }
+  };
+}
+
+static function<OpenABE_ERROR(std::string &)> pkeKeygenOp(OpenPKEContext *ctx,
+                                                          const string &key_id) {
+  return asyncOp([ctx, key_id](string &) {
+    ctx->keygen(key_id);
+    return true;
+  }, OpenABE_ERROR_KEYGEN_FAILED);
+}
+
+static function<OpenABE_ERROR(std::string &)>
+pkeEncryptOp(OpenPKEContext *ctx, const string &receiver_id, const string &plaintext) {
+  return asyncOp([ctx, receiver_id, plaintext](string &ciphertext) {
+    return ctx->encrypt(receiver_id, plaintext, ciphertext);
+  }, OpenABE_ERROR_ENCRYPTION_ERROR);
+}
+
+static function<OpenABE_ERROR(std::string &)>
+pkeDecryptOp(OpenPKEContext *ctx, const string &receiver_id, const string &ciphertext) {
+  return asyncOp([ctx, receiver_id, ciphertext](string &plaintext) {
+    return ctx->decrypt(receiver_id, ciphertext, plaintext);
+  }, OpenABE_ERROR_DECRYPTION_FAILED);
+}
+
+std::future<OpenABEAsyncResult> OpenPKEContext::keygenAsync(const std::string &key_id) {
+  return async_.run(pkeKeygenOp(this, key_id));
+}
+
+void OpenPKEContext::keygenAsync(const std::string &key_id, OpenABECompletion done) {
+  async_.run(pkeKeygenOp(this, key_id), done);
+}
+
+std::future<OpenABEAsyncResult>
+OpenPKEContext::encryptAsync(const std::string &receiver_id, const std::string &plaintext) {
+  return async_.run(pkeEncryptOp(this, receiver_id, plaintext));
+}
+
+void OpenPKEContext::encryptAsync(const std::string &receiver_id,
+                                  const std::string &plaintext, OpenABECompletion done) {
+  async_.run(pkeEncryptOp(this, receiver_id, plaintext), done);
+}
+
+std::future<OpenABEAsyncResult>
+OpenPKEContext::decryptAsync(const std::string &receiver_id, const std::string &ciphertext) {
+  return async_.run(pkeDecryptOp(this, receiver_id, ciphertext));
+}
+
+void OpenPKEContext::decryptAsync(const std::string &receiver_id,
+                                  const std::string &ciphertext, OpenABECompletion done) {
+  async_.run(pkeDecryptOp(this, receiver_id, ciphertext), done);
+}
+
 OpenPKSIGContext::OpenPKSIGContext(const string ec_id, bool base64encode) {
-  schemeContext_ = OpenABE_createContextPKSIGScheme();
+  // a pairing curve selects BLS signatures
+  schemeContext_ = OpenABE_createContextPKSIGScheme(
+      (getPairingCurveID(ec_id) != OpenABE_NONE_ID) ? OpenABE_SCHEME_PKSIG_BLS
+                                                    : OpenABE_SCHEME_PKSIG_ECDSA);
   if (!schemeContext_) {
     throw runtime_error("Unable to create PKSIG scheme context");
   }
@@ -497,6 +2812,7 @@ void OpenPKSIGContext::keygen(const string key_id) {
   if ((result = schemeContext_->keygen(pk_id, sk_id)) != OpenABE_NOERROR) {
     throw ZCryptoBoxException(OpenABE_errorToString(result));
   }
+  clearMerkleRoots();
 }
 
 void OpenPKSIGContext::exportPublicKey(const std::string key_id,
@@ -543,6 +2859,7 @@ void OpenPKSIGContext::importPublicKey(const string key_id, const string &keyBlo
   if ((result = schemeContext_->loadPublicKey(pk_id, key_buf)) != OpenABE_NOERROR) {
     throw ZCryptoBoxException("importPublicKey: " + string(OpenABE_errorToString(result)));
   }
+  clearMerkleRoots();
 }
 
 void OpenPKSIGContext::importPrivateKey(const string key_id,
@@ -564,36 +2881,382 @@ void OpenPKSIGContext::importPrivateKey(const string key_id,
 void OpenPKSIGContext::sign(const std::string key_id, const std::string &message,
                         std::string &signature) {
   OpenABE_ERROR result;
-  OpenABEByteString msg, sig;
+  OpenABEByteString sig;
   const string sk_id = OpenABE_SK_PREFIX(key_id);
-  msg = message;
-  if ((result = schemeContext_->sign(sk_id, &msg, &sig)) != OpenABE_NOERROR) {
+  if (merkleRootLabeled((const uint8_t *)message.data(), message.size())) {
+    throw ZCryptoBoxException("sign: message starts with the reserved Merkle root label");
+  }
+  if ((result = schemeContext_->sign(sk_id, (const uint8_t *)message.data(),
+                                     message.size(), &sig)) != OpenABE_NOERROR) {
     throw ZCryptoBoxException("sign: " + string(OpenABE_errorToString(result)));
   }
 
-  if (base64Encode_) {
-    const string str = sig.toString();
-    signature = Base64Encode((const uint8_t *)str.c_str(), str.size());
-  } else
+  if (base64Encode_)
+    signature = Base64Encode(sig.data(), sig.size());
+  else
     signature = sig.toString();
 }
 
+void OpenPKSIGContext::sign(const std::string key_id, const uint8_t *message,
+                            size_t messageLen, std::string &signature) {
+  OpenABE_ERROR result;
+  OpenABEByteString sig;
+  const string sk_id = OpenABE_SK_PREFIX(key_id);
+  if (merkleRootLabeled(message, messageLen)) {
+    throw ZCryptoBoxException("sign: message starts with the reserved Merkle root label");
+  }
+  if ((result = schemeContext_->sign(sk_id, message, messageLen, &sig)) != OpenABE_NOERROR) {
+    throw ZCryptoBoxException("sign: " + string(OpenABE_errorToString(result)));
+  }
+  signature = sig.toString();
+}
+
+bool OpenPKSIGContext::verify(const std::string key_id, const uint8_t *message,
+                              size_t messageLen, const uint8_t *signature,
+                              size_t signatureLen) {
+  const string pk_id = OpenABE_PK_PREFIX(key_id);
+  if (merkleRootLabeled(message, messageLen)) {
+    return false;
+  }
+  return (schemeContext_->verify(pk_id, message, messageLen, signature,
+                                 signatureLen) == OpenABE_NOERROR);
+}
+
 bool OpenPKSIGContext::verify(const std::string key_id, const std::string &message,
                           const std::string &signature) {
   OpenABE_ERROR result;
-  OpenABEByteString msg, sig;
+  OpenABEByteString sig;
   if (base64Encode_)
     sig += Base64Decode(signature);
   else
     sig += signature;
 
   const string pk_id = OpenABE_PK_PREFIX(key_id);
-  msg = message;
-  if ((result = schemeContext_->verify(pk_id, &msg, &sig)) != OpenABE_NOERROR) {
+  if (merkleRootLabeled((const uint8_t *)message.data(), message.size())) {
+    return false;
+  }
+  if ((result = schemeContext_->verify(pk_id, (const uint8_t *)message.data(), message.size(),
+                                       sig.data(), sig.size())) != OpenABE_NOERROR) {
     cerr << "Failed to verify: " << string(OpenABE_errorToString(result)) << endl;
     return false;
   }
   return true;
 }
 
+size_t OpenPKSIGContext::verifyBatch(const std::vector<OpenPKSIGMessage> &items,
+                                     std::vector<bool> &verified) {
+  const size_t count = items.size();
+  verified.assign(count, false);
+  if (count == 0) {
+    return 0;
+  }
+
+  // decoding is cheap next to verification, so it stays on this thread
+  vector<OpenABEByteString> msgs(count), sigs(count);
+  vector<OpenABESignedMessage> batch(count);
+  for (size_t i = 0; i < count; i++) {
+    msgs[i] = items[i].message;
+    if (base64Encode_)
+      sigs[i] += Base64Decode(items[i].signature);
+    else
+      sigs[i] += items[i].signature;
+    batch[i].keyID = OpenABE_PK_PREFIX(items[i].key_id);
+    batch[i].message = &msgs[i];
+    batch[i].signature = &sigs[i];
+  }
+
+  vector<OpenABE_ERROR> results;
+  schemeContext_->verifyBatch(batch, results);
+  size_t numValid = 0;
+  for (size_t i = 0; i < count; i++) {
+    verified[i] = (results[i] == OpenABE_NOERROR) &&
+                  !merkleRootLabeled(msgs[i].data(), msgs[i].size());
+    numValid += verified[i] ? 1 : 0;
+  }
+  return numValid;
+}
+
+// Merkle tree hashing with the RFC 6962 domain separation: leaves are
+// H(0x00 || message) and interior nodes H(0x01 || left || right). An odd
+// node at the end of a level moves up unpaired.
+static void merkleLeafHash(uint8_t *hash, const string &message) {
+  const uint8_t prefix = 0x00;
+  unsigned int len = 0;
+  EVP_MD_CTX *ctx = EVP_MD_CTX_create();
+  if (ctx == nullptr || EVP_DigestInit_ex(ctx, EVP_sha256(), NULL) != 1 ||
+      EVP_DigestUpdate(ctx, &prefix, 1) != 1 ||
+      EVP_DigestUpdate(ctx, message.data(), message.size()) != 1 ||
+      EVP_DigestFinal_ex(ctx, hash, &len) != 1) {
+    EVP_MD_CTX_destroy(ctx);
+    throw ZCryptoBoxException("Merkle leaf hashing failed");
+  }
+  EVP_MD_CTX_destroy(ctx);
+}
+
+static void merkleNodeHash(uint8_t *hash, const uint8_t *left, const uint8_t *right) {
+  uint8_t node[1 + 2 * MERKLE_HASH_LEN];
+  node[0] = 0x01;
+  memcpy(node + 1, left, MERKLE_HASH_LEN);
+  memcpy(node + 1 + MERKLE_HASH_LEN, right, MERKLE_HASH_LEN);
+  sha256(hash, node, sizeof(node));
+}
+
+// what the root signature covers: label || batch size (4) || root
+static string merkleRootMessage(uint32_t count, const uint8_t *root) {
+  string msg(MERKLE_ROOT_LABEL);
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    msg.push_back((char)((count >> shift) & 0xFF));
+  }
+  msg.append((const char *)root, MERKLE_HASH_LEN);
+  return msg;
+}
+
+static void putUInt(string &out, uint32_t value, int bytes) {
+  for (int shift = 8 * (bytes - 1); shift >= 0; shift -= 8) {
+    out.push_back((char)((value >> shift) & 0xFF));
+  }
+}
+
+static uint32_t getUInt(const uint8_t *p, int bytes) {
+  uint32_t value = 0;
+  for (int i = 0; i < bytes; i++) {
+    value = (value << 8) | p[i];
+  }
+  return value;
+}
+
+/*!
+ * Sign a batch of messages with one signature. Each output signature is
+ *   [format (1)] [index (4)] [batch size (4)] [root signature length (2)]
+ *   [root signature] [sibling hashes on the path to the root]
+ * and is checked on its own with verifyMerkle.
+ */
+void OpenPKSIGContext::signMerkleBatch(const string key_id, const vector<string> &messages,
+                                       vector<string> &signatures) {
+  signatures.clear();
+  if (messages.empty() || messages.size() > UINT32_MAX) {
+    throw ZCryptoBoxException("signMerkleBatch: invalid batch size");
+  }
+  const uint32_t count = (uint32_t)messages.size();
+
+  // levels[0] holds the leaf hashes, the last level the root
+  vector<string> levels(1, string(count * MERKLE_HASH_LEN, '\0'));
+  OpenABEThreadPool::getDefault()->parallelFor(count, [&](size_t i) {
+    merkleLeafHash((uint8_t *)&levels[0][i * MERKLE_HASH_LEN], messages[i]);
+  });
+  for (size_t n = count; n > 1; n = (n + 1) / 2) {
+    const string &below = levels.back();
+    string level(((n + 1) / 2) * MERKLE_HASH_LEN, '\0');
+    for (size_t j = 0; j + 1 < n; j += 2) {
+      merkleNodeHash((uint8_t *)&level[(j / 2) * MERKLE_HASH_LEN],
+                     (const uint8_t *)&below[j * MERKLE_HASH_LEN],
+                     (const uint8_t *)&below[(j + 1) * MERKLE_HASH_LEN]);
+    }
+    if (n % 2) {
+      level.replace((n / 2) * MERKLE_HASH_LEN, MERKLE_HASH_LEN, below,
+                    (n - 1) * MERKLE_HASH_LEN, MERKLE_HASH_LEN);
+    }
+    levels.push_back(level);
+  }
+
+  // signed under the label, which the plain sign refuses
+  const string root = merkleRootMessage(count, (const uint8_t *)levels.back().data());
+  OpenABEByteString rootSigBytes;
+  OpenABE_ERROR result = schemeContext_->sign(OpenABE_SK_PREFIX(key_id),
+                                              (const uint8_t *)root.data(), root.size(),
+                                              &rootSigBytes);
+  if (result != OpenABE_NOERROR) {
+    throw ZCryptoBoxException("signMerkleBatch: " + string(OpenABE_errorToString(result)));
+  }
+  const string rootSig = rootSigBytes.toString();
+  if (rootSig.size() > 0xFFFF) {
+    throw ZCryptoBoxException("signMerkleBatch: signature too long");
+  }
+
+  signatures.resize(count);
+  for (uint32_t i = 0; i < count; i++) {
+    string sig(1, (char)MERKLE_SIG_FORMAT);
+    putUInt(sig, i, 4);
+    putUInt(sig, count, 4);
+    putUInt(sig, (uint32_t)rootSig.size(), 2);
+    sig += rootSig;
+    size_t index = i, n = count;
+    for (size_t level = 0; n > 1; level++, index >>= 1, n = (n + 1) / 2) {
+      if ((index ^ 1) < n) {
+        sig.append(levels[level], (index ^ 1) * MERKLE_HASH_LEN, MERKLE_HASH_LEN);
+      }
+    }
+    if (base64Encode_)
+      signatures[i] = Base64Encode((const uint8_t *)sig.data(), sig.size());
+    else
+      signatures[i] = sig;
+  }
+}
+
+bool OpenPKSIGContext::verifyMerkle(const string key_id, const string &message,
+                                    const string &signature) {
+  const string sig = base64Encode_ ? Base64Decode(signature) : signature;
+  const uint8_t *p = (const uint8_t *)sig.data();
+  const size_t len = sig.size();
+  if (len < 11 || p[0] != MERKLE_SIG_FORMAT) {
+    return false;
+  }
+  const size_t index = getUInt(p + 1, 4), count = getUInt(p + 5, 4);
+  const size_t rootSigLen = getUInt(p + 9, 2);
+  if (index >= count || 11 + rootSigLen > len) {
+    return false;
+  }
+
+  // walk from the leaf to the root, using a sibling wherever the level has one
+  uint8_t hash[MERKLE_HASH_LEN];
+  merkleLeafHash(hash, message);
+  size_t offset = 11 + rootSigLen;
+  for (size_t i = index, n = count; n > 1; i >>= 1, n = (n + 1) / 2) {
+    if ((i ^ 1) >= n) {
+      continue;
+    }
+    if (offset + MERKLE_HASH_LEN > len) {
+      return false;
+    }
+    if (i & 1) {
+      merkleNodeHash(hash, p + offset, hash);
+    } else {
+      merkleNodeHash(hash, hash, p + offset);
+    }
+    offset += MERKLE_HASH_LEN;
+  }
+  if (offset != len) {
+    return false;
+  }
+
+  const string root = merkleRootMessage((uint32_t)count, hash);
+  string entry = key_id;
+  entry.push_back('\0');
+  entry += root;
+  entry.append(sig, 11, rootSigLen);
+  {
+    lock_guard<mutex> lock(merkleRootsLock_);
+    if (merkleRoots_.count(entry)) {
+      return true;
+    }
+  }
+  if (schemeContext_->verify(OpenABE_PK_PREFIX(key_id), (const uint8_t *)root.data(),
+                             root.size(), p + 11, rootSigLen) != OpenABE_NOERROR) {
+    return false;
+  }
+  lock_guard<mutex> lock(merkleRootsLock_);
+  if (merkleRoots_.size() >= MERKLE_ROOT_CACHE_SIZE) {
+    merkleRoots_.clear();
+  }
+  merkleRoots_.insert(entry);
+  return true;
+}
+
+void OpenPKSIGContext::aggregate(const vector<string> &signatures, string &aggregate) {
+  OpenABE_ERROR result;
+  vector<OpenABEByteString> sigs(signatures.size());
+  vector<OpenABEByteString *> sigPtrs(signatures.size());
+  for (size_t i = 0; i < signatures.size(); i++) {
+    if (base64Encode_)
+      sigs[i] += Base64Decode(signatures[i]);
+    else
+      sigs[i] += signatures[i];
+    sigPtrs[i] = &sigs[i];
+  }
+
+  OpenABEByteString agg;
+  if ((result = schemeContext_->aggregate(sigPtrs, &agg)) != OpenABE_NOERROR) {
+    throw ZCryptoBoxException("aggregate: " + string(OpenABE_errorToString(result)));
+  }
+  if (base64Encode_)
+    aggregate = Base64Encode(agg.data(), agg.size());
+  else
+    aggregate = agg.toString();
+}
+
+bool OpenPKSIGContext::verifyAggregate(const vector<string> &key_ids,
+                                       const vector<string> &messages,
+                                       const string &aggregate) {
+  if (key_ids.size() != messages.size() || key_ids.empty()) {
+    return false;
+  }
+  OpenABEByteString agg;
+  if (base64Encode_)
+    agg += Base64Decode(aggregate);
+  else
+    agg += aggregate;
+
+  vector<OpenABEByteString> msgs(messages.size());
+  vector<OpenABESignedMessage> items(messages.size());
+  for (size_t i = 0; i < messages.size(); i++) {
+    if (merkleRootLabeled((const uint8_t *)messages[i].data(), messages[i].size())) {
+      return false;
+    }
+    msgs[i] = messages[i];
+    items[i].keyID = OpenABE_PK_PREFIX(key_ids[i]);
+    items[i].message = &msgs[i];
+    items[i].signature = nullptr;
+  }
+  return (schemeContext_->verifyAggregate(items, &agg) == OpenABE_NOERROR);
+}
+
+// a key ID can be bound to a different public key; forget what was verified
+void OpenPKSIGContext::clearMerkleRoots() {
+  lock_guard<mutex> lock(merkleRootsLock_);
+  merkleRoots_.clear();
+}
+
+static function<OpenABE_ERROR(std::string &)> pksigKeygenOp(OpenPKSIGContext *ctx,
+                                                            const string &key_id) {
+  return asyncOp([ctx, key_id](string &) {
+    ctx->keygen(key_id);
+    return true;
+  }, OpenABE_ERROR_KEYGEN_FAILED);
+}
+
+static function<OpenABE_ERROR(std::string &)>
+pksigSignOp(OpenPKSIGContext *ctx, const string &key_id, const string &message) {
+  return asyncOp([ctx, key_id, message](string &signature) {
+    ctx->sign(key_id, message, signature);
+    return true;
+  }, OpenABE_ERROR_SIGNATURE_FAILED);
+}
+
+static function<OpenABE_ERROR(std::string &)>
+pksigVerifyOp(OpenPKSIGContext *ctx, const string &key_id, const string &message,
+              const string &signature) {
+  return asyncOp([ctx, key_id, message, signature](string &) {
+    return ctx->verify(key_id, message, signature);
+  }, OpenABE_ERROR_VERIFICATION_FAILED);
+}
+
+std::future<OpenABEAsyncResult> OpenPKSIGContext::keygenAsync(const std::string &key_id) {
+  return async_.run(pksigKeygenOp(this, key_id));
+}
+
+void OpenPKSIGContext::keygenAsync(const std::string &key_id, OpenABECompletion done) {
+  async_.run(pksigKeygenOp(this, key_id), done);
+}
+
+std::future<OpenABEAsyncResult>
+OpenPKSIGContext::signAsync(const std::string &key_id, const std::string &message) {
+  return async_.run(pksigSignOp(this, key_id, message));
+}
+
+void OpenPKSIGContext::signAsync(const std::string &key_id, const std::string &message,
+                                 OpenABECompletion done) {
+  async_.run(pksigSignOp(this, key_id, message), done);
+}
+
+std::future<OpenABEAsyncResult>
+OpenPKSIGContext::verifyAsync(const std::string &key_id, const std::string &message,
+                              const std::string &signature) {
+  return async_.run(pksigVerifyOp(this, key_id, message, signature));
+}
+
+void OpenPKSIGContext::verifyAsync(const std::string &key_id, const std::string &message,
+                                   const std::string &signature, OpenABECompletion done) {
+  async_.run(pksigVerifyOp(this, key_id, message, signature), done);
+}
+
 }
@@ -1,7 +1,8 @@
 ///
 /// \file   zecdsa_openssl.cpp
 ///
-/// \brief  OpenSSL-based ECDSA implementation for NIST curves.
+/// \brief  OpenSSL-based ECDSA implementation for NIST curves, plus
+///         Ed25519 (RFC 8032) behind the same interface.
 ///
 /// \author OpenABE Contributors
 ///
@@ -9,6 +10,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <mutex>
+#include <new>
 #include <openssl/ec.h>
 #include <openssl/evp.h>
 #include <openssl/bn.h>
@@ -24,14 +27,23 @@
  * Internal Structures
  ********************************************************************************/
 
+// group is NULL for Ed25519, which is not a short-Weierstrass curve
 struct ecdsa_context_internal {
     EC_GROUP *group;
     uint8_t curve_id;
 };
 
+// The sign/verify templates are digest contexts initialized once with the
+// key; each operation copies one instead of repeating the key, digest and
+// provider setup of EVP_DigestSignInit/EVP_DigestVerifyInit. Ed25519 keys
+// have none: the scheme hashes internally and only signs in one shot.
 struct ecdsa_keypair_internal {
     EVP_PKEY *pkey;
     bool has_private;
+    bool ed25519;
+    EVP_MD_CTX *sign_tmpl;
+    EVP_MD_CTX *verify_tmpl;
+    std::mutex tmpl_lock;
 };
 
 /********************************************************************************
@@ -46,11 +58,111 @@ static int curve_id_to_nid(uint8_t id) {
             return NID_secp384r1;
         case OpenABE_NIST_P521_ID:
             return NID_secp521r1;
+        case OpenABE_ED25519_ID:
+            return NID_ED25519;
         default:
             return 0;
     }
 }
 
+// Wrap pkey (taking ownership) in a keypair and build its templates. A
+// template that fails to initialize is left NULL and the operations fall
+// back to a full init.
+static struct ecdsa_keypair_internal *keypair_new(EVP_PKEY *pkey, bool has_private) {
+    struct ecdsa_keypair_internal *kp = new (std::nothrow) ecdsa_keypair_internal;
+    if (!kp) {
+        EVP_PKEY_free(pkey);
+        return nullptr;
+    }
+
+    kp->pkey = pkey;
+    kp->has_private = has_private;
+    kp->ed25519 = (EVP_PKEY_id(pkey) == EVP_PKEY_ED25519);
+    kp->sign_tmpl = nullptr;
+    kp->verify_tmpl = nullptr;
+    if (kp->ed25519) {
+        return kp;
+    }
+    kp->verify_tmpl = EVP_MD_CTX_new();
+    if (kp->verify_tmpl &&
+        EVP_DigestVerifyInit(kp->verify_tmpl, nullptr, EVP_sha256(), nullptr, pkey) != 1) {
+        EVP_MD_CTX_free(kp->verify_tmpl);
+        kp->verify_tmpl = nullptr;
+    }
+    if (has_private) {
+        kp->sign_tmpl = EVP_MD_CTX_new();
+        if (kp->sign_tmpl &&
+            EVP_DigestSignInit(kp->sign_tmpl, nullptr, EVP_sha256(), nullptr, pkey) != 1) {
+            EVP_MD_CTX_free(kp->sign_tmpl);
+            kp->sign_tmpl = nullptr;
+        }
+    }
+    ERR_clear_error();
+    return kp;
+}
+
+// A digest context ready for EVP_DigestSignUpdate (sign) or
+// EVP_DigestVerifyUpdate, copied from the keypair's template when possible
+static EVP_MD_CTX *keypair_md_ctx(struct ecdsa_keypair_internal *kp, bool sign) {
+    EVP_MD_CTX *md_ctx = EVP_MD_CTX_new();
+    if (!md_ctx) {
+        return nullptr;
+    }
+
+    EVP_MD_CTX *tmpl = sign ? kp->sign_tmpl : kp->verify_tmpl;
+    if (tmpl) {
+        std::lock_guard<std::mutex> lock(kp->tmpl_lock);
+        if (EVP_MD_CTX_copy_ex(md_ctx, tmpl) == 1) {
+            return md_ctx;
+        }
+        EVP_MD_CTX_reset(md_ctx);
+        ERR_clear_error();
+    }
+
+    int ret = sign ? EVP_DigestSignInit(md_ctx, nullptr, EVP_sha256(), nullptr, kp->pkey)
+                   : EVP_DigestVerifyInit(md_ctx, nullptr, EVP_sha256(), nullptr, kp->pkey);
+    if (ret != 1) {
+        EVP_MD_CTX_free(md_ctx);
+        return nullptr;
+    }
+    return md_ctx;
+}
+
+#define ED25519_SIGNATURE_BYTES 64
+
+// Ed25519 signs the whole message in one EVP_DigestSign call with no
+// digest (PureEdDSA), so there is no template to copy
+static size_t ed25519_sign(struct ecdsa_keypair_internal *kp, const uint8_t *msg,
+                           size_t msg_len, uint8_t *sig, size_t sig_len) {
+    EVP_MD_CTX *md_ctx = EVP_MD_CTX_new();
+    if (!md_ctx) {
+        return 0;
+    }
+    size_t sig_size = sig_len;
+    if (EVP_DigestSignInit(md_ctx, nullptr, nullptr, nullptr, kp->pkey) != 1 ||
+        EVP_DigestSign(md_ctx, sig, &sig_size, msg, msg_len) != 1) {
+        sig_size = 0;
+    }
+    EVP_MD_CTX_free(md_ctx);
+    return sig_size;
+}
+
+static int ed25519_verify(struct ecdsa_keypair_internal *kp, const uint8_t *msg,
+                          size_t msg_len, const uint8_t *sig, size_t sig_len) {
+    if (sig_len != ED25519_SIGNATURE_BYTES) {
+        return 0;
+    }
+    EVP_MD_CTX *md_ctx = EVP_MD_CTX_new();
+    if (!md_ctx) {
+        return 0;
+    }
+    int result = (EVP_DigestVerifyInit(md_ctx, nullptr, nullptr, nullptr, kp->pkey) == 1 &&
+                  EVP_DigestVerify(md_ctx, sig, sig_len, msg, msg_len) == 1) ? 1 : 0;
+    EVP_MD_CTX_free(md_ctx);
+    ERR_clear_error();
+    return result;
+}
+
 /********************************************************************************
  * Context Management
  ********************************************************************************/
@@ -69,6 +181,13 @@ int ecdsa_context_init(ecdsa_context_t *ctx, uint8_t curve_id) {
         return -1;
     }
 
+    internal->curve_id = curve_id;
+    if (nid == NID_ED25519) {
+        internal->group = nullptr;
+        *ctx = (ecdsa_context_t)internal;
+        return 0;
+    }
+
     internal->group = EC_GROUP_new_by_curve_name(nid);
     if (!internal->group) {
         free(internal);
@@ -76,7 +195,6 @@ int ecdsa_context_init(ecdsa_context_t *ctx, uint8_t curve_id) {
     }
 
     EC_GROUP_set_asn1_flag(internal->group, OPENSSL_EC_NAMED_CURVE);
-    internal->curve_id = curve_id;
 
     *ctx = (ecdsa_context_t)internal;
     return 0;
@@ -103,6 +221,22 @@ int ecdsa_keygen(ecdsa_context_t ctx, ecdsa_keypair_t *keypair) {
     EC_KEY *ec_key = nullptr;
     EVP_PKEY *pkey = nullptr;
 
+    if (ctx_internal->curve_id == OpenABE_ED25519_ID) {
+        EVP_PKEY_CTX *pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_ED25519, nullptr);
+        int ok = (pctx && EVP_PKEY_keygen_init(pctx) == 1 &&
+                  EVP_PKEY_keygen(pctx, &pkey) == 1);
+        EVP_PKEY_CTX_free(pctx);
+        if (!ok) {
+            return -1;
+        }
+        struct ecdsa_keypair_internal *kp = keypair_new(pkey, true);
+        if (!kp) {
+            return -1;
+        }
+        *keypair = (ecdsa_keypair_t)kp;
+        return 0;
+    }
+
     // Create EC_KEY
     ec_key = EC_KEY_new();
     if (!ec_key) {
@@ -135,16 +269,11 @@ int ecdsa_keygen(ecdsa_context_t ctx, ecdsa_keypair_t *keypair) {
     }
 
     // Create keypair structure
-    struct ecdsa_keypair_internal *kp =
-        (struct ecdsa_keypair_internal *)malloc(sizeof(struct ecdsa_keypair_internal));
+    struct ecdsa_keypair_internal *kp = keypair_new(pkey, true);
     if (!kp) {
-        EVP_PKEY_free(pkey);
         return -1;
     }
 
-    kp->pkey = pkey;
-    kp->has_private = true;
-
     *keypair = (ecdsa_keypair_t)kp;
     return 0;
 }
@@ -153,10 +282,12 @@ void ecdsa_keypair_free(ecdsa_keypair_t keypair) {
     if (!keypair) return;
 
     struct ecdsa_keypair_internal *kp = (struct ecdsa_keypair_internal *)keypair;
+    EVP_MD_CTX_free(kp->sign_tmpl);
+    EVP_MD_CTX_free(kp->verify_tmpl);
     if (kp->pkey) {
         EVP_PKEY_free(kp->pkey);
     }
-    free(kp);
+    delete kp;
 }
 
 size_t ecdsa_export_public_key(ecdsa_keypair_t keypair, uint8_t *buf, size_t buf_len) {
@@ -164,6 +295,15 @@ size_t ecdsa_export_public_key(ecdsa_keypair_t keypair, uint8_t *buf, size_t buf
 
     struct ecdsa_keypair_internal *kp = (struct ecdsa_keypair_internal *)keypair;
 
+    // Ed25519 keys are the raw 32 bytes of RFC 8032
+    if (kp->ed25519) {
+        size_t raw_len = buf_len;
+        if (EVP_PKEY_get_raw_public_key(kp->pkey, buf, &raw_len) != 1) {
+            return 0;
+        }
+        return raw_len;
+    }
+
     // Use EVP_PKEY serialization
     unsigned char *p = buf;
     int len = i2d_PUBKEY(kp->pkey, &p);
@@ -184,6 +324,14 @@ size_t ecdsa_export_private_key(ecdsa_keypair_t keypair, uint8_t *buf, size_t bu
         return 0;
     }
 
+    if (kp->ed25519) {
+        size_t raw_len = buf_len;
+        if (EVP_PKEY_get_raw_private_key(kp->pkey, buf, &raw_len) != 1) {
+            return 0;
+        }
+        return raw_len;
+    }
+
     // Use EVP_PKEY serialization
     unsigned char *p = buf;
     int len = i2d_PrivateKey(kp->pkey, &p);
@@ -199,24 +347,25 @@ int ecdsa_import_public_key(ecdsa_context_t ctx, ecdsa_keypair_t *keypair,
                              const uint8_t *buf, size_t buf_len) {
     if (!ctx || !keypair || !buf) return -1;
 
+    struct ecdsa_context_internal *ctx_internal = (struct ecdsa_context_internal *)ctx;
     const unsigned char *p = buf;
-    EVP_PKEY *pkey = d2i_PUBKEY(nullptr, &p, buf_len);
+    EVP_PKEY *pkey = nullptr;
+    if (ctx_internal->curve_id == OpenABE_ED25519_ID) {
+        pkey = EVP_PKEY_new_raw_public_key(EVP_PKEY_ED25519, nullptr, buf, buf_len);
+    } else {
+        pkey = d2i_PUBKEY(nullptr, &p, buf_len);
+    }
 
     if (!pkey) {
         return -1;
     }
 
     // Create keypair structure
-    struct ecdsa_keypair_internal *kp =
-        (struct ecdsa_keypair_internal *)malloc(sizeof(struct ecdsa_keypair_internal));
+    struct ecdsa_keypair_internal *kp = keypair_new(pkey, false);
     if (!kp) {
-        EVP_PKEY_free(pkey);
         return -1;
     }
 
-    kp->pkey = pkey;
-    kp->has_private = false;
-
     *keypair = (ecdsa_keypair_t)kp;
     return 0;
 }
@@ -225,24 +374,25 @@ int ecdsa_import_private_key(ecdsa_context_t ctx, ecdsa_keypair_t *keypair,
                               const uint8_t *buf, size_t buf_len) {
     if (!ctx || !keypair || !buf) return -1;
 
+    struct ecdsa_context_internal *ctx_internal = (struct ecdsa_context_internal *)ctx;
     const unsigned char *p = buf;
-    EVP_PKEY *pkey = d2i_PrivateKey(EVP_PKEY_EC, nullptr, &p, buf_len);
+    EVP_PKEY *pkey = nullptr;
+    if (ctx_internal->curve_id == OpenABE_ED25519_ID) {
+        pkey = EVP_PKEY_new_raw_private_key(EVP_PKEY_ED25519, nullptr, buf, buf_len);
+    } else {
+        pkey = d2i_PrivateKey(EVP_PKEY_EC, nullptr, &p, buf_len);
+    }
 
     if (!pkey) {
         return -1;
     }
 
     // Create keypair structure
-    struct ecdsa_keypair_internal *kp =
-        (struct ecdsa_keypair_internal *)malloc(sizeof(struct ecdsa_keypair_internal));
+    struct ecdsa_keypair_internal *kp = keypair_new(pkey, true);
     if (!kp) {
-        EVP_PKEY_free(pkey);
         return -1;
     }
 
-    kp->pkey = pkey;
-    kp->has_private = true;
-
     *keypair = (ecdsa_keypair_t)kp;
     return 0;
 }
@@ -263,36 +413,30 @@ size_t ecdsa_sign(ecdsa_keypair_t keypair, const uint8_t *msg, size_t msg_len,
         return 0;
     }
 
-    EVP_MD_CTX *md_ctx = EVP_MD_CTX_new();
-    if (!md_ctx) {
+    // Check if buffer is large enough for the largest signature
+    if ((size_t)EVP_PKEY_size(kp->pkey) > sig_len) {
         return 0;
     }
 
-    size_t sig_size = 0;
-
-    // Initialize signing
-    if (EVP_DigestSignInit(md_ctx, nullptr, EVP_sha256(), nullptr, kp->pkey) != 1) {
-        goto cleanup;
+    if (kp->ed25519) {
+        return ed25519_sign(kp, msg, msg_len, sig, sig_len);
     }
 
-    // Update with message
-    if (EVP_DigestSignUpdate(md_ctx, msg, msg_len) != 1) {
-        goto cleanup;
+    // Initialized for signing with this key
+    EVP_MD_CTX *md_ctx = keypair_md_ctx(kp, true);
+    if (!md_ctx) {
+        return 0;
     }
 
-    // First call to get the signature size
-    if (EVP_DigestSignFinal(md_ctx, NULL, &sig_size) != 1) {
-        sig_size = 0;
-        goto cleanup;
-    }
+    size_t sig_size = sig_len;
 
-    // Check if buffer is large enough
-    if (sig_size > sig_len) {
+    // Update with message
+    if (EVP_DigestSignUpdate(md_ctx, msg, msg_len) != 1) {
         sig_size = 0;
         goto cleanup;
     }
 
-    // Second call to get the actual signature
+    // Produce the signature (sig_size becomes its actual length)
     if (EVP_DigestSignFinal(md_ctx, sig, &sig_size) != 1) {
         sig_size = 0;
         goto cleanup;
@@ -309,18 +453,18 @@ int ecdsa_verify(ecdsa_keypair_t keypair, const uint8_t *msg, size_t msg_len,
 
     struct ecdsa_keypair_internal *kp = (struct ecdsa_keypair_internal *)keypair;
 
-    EVP_MD_CTX *md_ctx = EVP_MD_CTX_new();
+    if (kp->ed25519) {
+        return ed25519_verify(kp, msg, msg_len, sig, sig_len);
+    }
+
+    // Initialized for verification with this key
+    EVP_MD_CTX *md_ctx = keypair_md_ctx(kp, false);
     if (!md_ctx) {
         return 0;
     }
 
     int result = 0;
 
-    // Initialize verification
-    if (EVP_DigestVerifyInit(md_ctx, nullptr, EVP_sha256(), nullptr, kp->pkey) != 1) {
-        goto cleanup;
-    }
-
     // Update with message
     if (EVP_DigestVerifyUpdate(md_ctx, msg, msg_len) != 1) {
         goto cleanup;
@@ -343,6 +487,11 @@ size_t ecdsa_get_max_signature_size(ecdsa_context_t ctx) {
 
     struct ecdsa_context_internal *internal = (struct ecdsa_context_internal *)ctx;
 
+    // Ed25519 signatures are always R || S
+    if (internal->group == nullptr) {
+        return ED25519_SIGNATURE_BYTES;
+    }
+
     // ECDSA signature is approximately 2 * (field_size + 8) bytes in DER encoding
     // For P-256: ~72 bytes, P-384: ~104 bytes, P-521: ~139 bytes
     int field_bits = EC_GROUP_get_degree(internal->group);
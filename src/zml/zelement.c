@@ -345,6 +345,11 @@ int ec_group_init(ec_group_t *group, uint8_t id) {
   default:
       return -1;
   }
+#if defined(EC_WITH_OPENSSL) && OPENSSL_VERSION_NUMBER < 0x30000000L
+  // fixed-base table for the generator, used by ec_point_mul_gen (OpenSSL 3
+  // deprecates this; its curves precompute the generator internally)
+  EC_GROUP_precompute_mult(*group, NULL);
+#endif
   return 0;
 }
 
@@ -422,6 +427,16 @@ void ec_point_mul(ec_group_t g, ec_point_t r, const ec_point_t x,
 #endif
 }
 
+void ec_point_mul_gen(ec_group_t g, ec_point_t r, const bignum_t y) {
+#if defined(EC_WITH_OPENSSL)
+  // the generator form uses the group's precomputed table (and the built-in
+  // one of the optimized P-256 code) instead of a variable-base ladder
+  EC_POINT_mul(g, r, y, NULL, NULL, NULL);
+#else
+  ec_ep_mul_gen(r, y);
+#endif
+}
+
 int ec_point_cmp(ec_group_t group, const ec_point_t a, const ec_point_t b) {
 #if defined(EC_WITH_OPENSSL)
   return EC_POINT_cmp(group, a, b, NULL);
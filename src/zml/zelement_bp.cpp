@@ -33,10 +33,12 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <atomic>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <utility>
 #include <openabe/openabe.h>
 #include <openssl/rand.h>
 
@@ -91,14 +93,15 @@ const string g1_point_to_string(bp_group_t group, const g1_ptr p) {
 void g1_convert_to_bytestring(bp_group_t group, oabe::OpenABEByteString &s,
                               const g1_ptr p) {
 #if defined(BP_WITH_MCL)
-  uint8_t buf[MAX_BUFFER_SIZE];
-  memset(buf, 0, MAX_BUFFER_SIZE);
-  size_t len = mclBnG1_serialize(buf, MAX_BUFFER_SIZE, &p);
+  // serialize straight into the output (room for an uncompressed point)
+  size_t max = 2 * mclBn_getFpByteSize() + 1, off = s.size();
+  s.resize(off + max);
+  size_t len = mclBnG1_serialize(s.getInternalPtr() + off, max, &p);
+  s.resize(off + len);
   if (len == 0) {
     fprintf(stderr, "g1_convert_to_bytestring: mclBnG1_serialize failed\n");
     return;
   }
-  s.appendArray(buf, len);
 #elif defined(BP_WITH_OPENSSL)
   uint8_t buf[MAX_BUFFER_SIZE];
   memset(buf, 0, MAX_BUFFER_SIZE);
@@ -106,9 +109,10 @@ void g1_convert_to_bytestring(bp_group_t group, oabe::OpenABEByteString &s,
                                  MAX_BUFFER_SIZE, NULL);
   s.appendArray(buf, len);
 #else
-  size_t len = g1_elem_len(p);
-  s.fillBuffer(0, len);
-  g1_elem_out(p, s.getInternalPtr(), len);
+  // append, so callers can serialize straight into a larger buffer
+  size_t len = g1_elem_len(p), off = s.size();
+  s.resize(off + len);
+  g1_elem_out(p, s.getInternalPtr() + off, len);
 #endif
 }
 
@@ -122,15 +126,14 @@ void g1_convert_to_point(bp_group_t group, oabe::OpenABEByteString &s, g1_ptr p,
   uint8_t *xstr = s.getInternalPtr();
   size_t xstr_len = s.size();
 #if defined(BP_WITH_MCL)
-  fprintf(stderr, "[g1_convert_to_point] BEFORE deserialize: p_is_zero=%d\n", mclBnG1_isZero(&p));
   size_t read = mclBnG1_deserialize(&p, xstr, xstr_len);
   if (read == 0) {
     fprintf(stderr, "%s:%s:%d: '%s'\n", __FILE__, __FUNCTION__, __LINE__,
             OpenABE_errorToString(oabe::OpenABE_ERROR_SERIALIZATION_FAILED));
     return;
   }
-  fprintf(stderr, "[g1_convert_to_point] AFTER deserialize: read=%zu, p_is_zero=%d, p_is_valid=%d\n",
-          read, mclBnG1_isZero(&p), mclBnG1_isValid(&p));
+  OpenABE_TRACE_DEBUG("g1_convert_to_point: read=%zu, is_zero=%d, is_valid=%d",
+                      read, mclBnG1_isZero(&p), mclBnG1_isValid(&p));
 #elif defined(BP_WITH_OPENSSL)
   G1_ELEM_oct2point(group, p, xstr, xstr_len, NULL);
 #else
@@ -207,14 +210,14 @@ const string g2_point_to_string(bp_group_t group, const g2_ptr p) {
 void g2_convert_to_bytestring(bp_group_t group, oabe::OpenABEByteString &s,
                               g2_ptr p) {
 #if defined(BP_WITH_MCL)
-  uint8_t buf[MAX_BUFFER_SIZE];
-  memset(buf, 0, MAX_BUFFER_SIZE);
-  size_t len = mclBnG2_serialize(buf, MAX_BUFFER_SIZE, &p);
+  size_t max = 4 * mclBn_getFpByteSize() + 1, off = s.size();
+  s.resize(off + max);
+  size_t len = mclBnG2_serialize(s.getInternalPtr() + off, max, &p);
+  s.resize(off + len);
   if (len == 0) {
     fprintf(stderr, "g2_convert_to_bytestring: mclBnG2_serialize failed\n");
     return;
   }
-  s.appendArray(buf, len);
 #elif defined(BP_WITH_OPENSSL)
   uint8_t buf[MAX_BUFFER_SIZE];
   memset(buf, 0, MAX_BUFFER_SIZE); // ideal => POINT_CONVERSION_COMPRESSED
@@ -222,9 +225,9 @@ void g2_convert_to_bytestring(bp_group_t group, oabe::OpenABEByteString &s,
                                  MAX_BUFFER_SIZE, NULL);
   s.appendArray(buf, len);
 #else
-  size_t len = g2_elem_len(p);
-  s.fillBuffer(0, len);
-  g2_elem_out(p, s.getInternalPtr(), len);
+  size_t len = g2_elem_len(p), off = s.size();
+  s.resize(off + len);
+  g2_elem_out(p, s.getInternalPtr() + off, len);
 
 //  size_t len = g2_size_bin(p, COMPRESS);
 //  // cout << "G1::serialize => " << len << endl;
@@ -276,20 +279,16 @@ void gt_convert_to_bytestring(bp_group_t group, oabe::OpenABEByteString &s, cons
 #if defined(BP_WITH_MCL)
   // FIX Bug #8: gt_ptr is mclBnGT struct, must pass by pointer!
 
-  // DEBUG: Check if GT element is valid before serialization
-  int is_one = mclBnGT_isOne(p);
-  int is_zero = mclBnGT_isZero(p);
-  fprintf(stderr, "[gt_convert_to_bytestring] GT is_one=%d, is_zero=%d\n", is_one, is_zero);
-
   uint8_t buf[MAX_BUFFER_SIZE];
   memset(buf, 0, MAX_BUFFER_SIZE);
   size_t len = mclBnGT_serialize(buf, MAX_BUFFER_SIZE, p);  // p is now already a pointer
   if (len == 0) {
     fprintf(stderr, "gt_convert_to_bytestring: mclBnGT_serialize failed\n");
-    fprintf(stderr, "  GT element state: is_one=%d, is_zero=%d\n", is_one, is_zero);
+    OpenABE_TRACE_ERROR("gt_convert_to_bytestring: is_one=%d, is_zero=%d",
+                        mclBnGT_isOne(p), mclBnGT_isZero(p));
     return;
   }
-  fprintf(stderr, "[gt_convert_to_bytestring] Serialized %zu bytes\n", len);
+  OpenABE_TRACE_DEBUG("gt_convert_to_bytestring: serialized %zu bytes", len);
   s.appendArray(buf, len);
 #elif defined(BP_WITH_OPENSSL)
   uint8_t buf[MAX_BUFFER_SIZE];
@@ -298,9 +297,9 @@ void gt_convert_to_bytestring(bp_group_t group, oabe::OpenABEByteString &s, cons
   s.appendArray(buf, len);
 #else
   // FIX Bug #18: For RELIC with BLS12-381, GT functions accept pointers
-  size_t len = gt_elem_len(p, should_compress);
-  s.fillBuffer(0, len);
-  gt_elem_out(p, s.getInternalPtr(), len, should_compress);
+  size_t len = gt_elem_len(p, should_compress), off = s.size();
+  s.resize(off + len);
+  gt_elem_out(p, s.getInternalPtr() + off, len, should_compress);
 //  size_t len = gt_size_bin(p, should_compress);
 //  // cout << "G1::serialize => " << len << endl;
 //  s.fillBuffer(0, len);
@@ -308,10 +307,178 @@ void gt_convert_to_bytestring(bp_group_t group, oabe::OpenABEByteString &s, cons
 #endif
 }
 
+#if defined(BP_WITH_MCL)
+// Compact GT encoding. GT is the cyclotomic subgroup of Fp12 = Fp6[w]/(w^2 - v),
+// Fp6 = Fp2[v]/(v^3 - xi), so every element g = a + b*w has norm
+// a^2 - v*b^2 = 1 and is determined by c = (1 + a) / b in Fp6 (torus
+// compression): g = (c + w) / (c - w). That halves the 12 Fp coefficients to
+// 6. The identity (b = 0) is sent as a single tag byte. Both curves the MCL
+// build uses (BLS12-381 and BN254) have xi = 1 + i.
+#define GT_COMPACT_IDENTITY   0x00
+#define GT_COMPACT_TORUS      0x01
+
+typedef struct { mclBnFp2 c[3]; } gt_fp6;
+
+static void fp2_mul_xi(mclBnFp2 *z, const mclBnFp2 *x) {
+  mclBnFp2 t;
+  mclBnFp_sub(&t.d[0], &x->d[0], &x->d[1]);
+  mclBnFp_add(&t.d[1], &x->d[0], &x->d[1]);
+  *z = t;
+}
+
+static void fp6_mul(gt_fp6 *z, const gt_fp6 *x, const gt_fp6 *y) {
+  mclBnFp2 t0, t1, t2, u;
+  // c0 = x0*y0 + xi*(x1*y2 + x2*y1)
+  mclBnFp2_mul(&t0, &x->c[1], &y->c[2]);
+  mclBnFp2_mul(&u, &x->c[2], &y->c[1]);
+  mclBnFp2_add(&t0, &t0, &u);
+  fp2_mul_xi(&t0, &t0);
+  mclBnFp2_mul(&u, &x->c[0], &y->c[0]);
+  mclBnFp2_add(&t0, &t0, &u);
+  // c1 = x0*y1 + x1*y0 + xi*x2*y2
+  mclBnFp2_mul(&t1, &x->c[2], &y->c[2]);
+  fp2_mul_xi(&t1, &t1);
+  mclBnFp2_mul(&u, &x->c[0], &y->c[1]);
+  mclBnFp2_add(&t1, &t1, &u);
+  mclBnFp2_mul(&u, &x->c[1], &y->c[0]);
+  mclBnFp2_add(&t1, &t1, &u);
+  // c2 = x0*y2 + x1*y1 + x2*y0
+  mclBnFp2_mul(&t2, &x->c[0], &y->c[2]);
+  mclBnFp2_mul(&u, &x->c[1], &y->c[1]);
+  mclBnFp2_add(&t2, &t2, &u);
+  mclBnFp2_mul(&u, &x->c[2], &y->c[0]);
+  mclBnFp2_add(&t2, &t2, &u);
+  z->c[0] = t0;
+  z->c[1] = t1;
+  z->c[2] = t2;
+}
+
+static void fp6_inv(gt_fp6 *z, const gt_fp6 *x) {
+  mclBnFp2 t0, t1, t2, d, u;
+  // t0 = x0^2 - xi*x1*x2, t1 = xi*x2^2 - x0*x1, t2 = x1^2 - x0*x2
+  mclBnFp2_mul(&u, &x->c[1], &x->c[2]);
+  fp2_mul_xi(&u, &u);
+  mclBnFp2_sqr(&t0, &x->c[0]);
+  mclBnFp2_sub(&t0, &t0, &u);
+  mclBnFp2_sqr(&t1, &x->c[2]);
+  fp2_mul_xi(&t1, &t1);
+  mclBnFp2_mul(&u, &x->c[0], &x->c[1]);
+  mclBnFp2_sub(&t1, &t1, &u);
+  mclBnFp2_sqr(&t2, &x->c[1]);
+  mclBnFp2_mul(&u, &x->c[0], &x->c[2]);
+  mclBnFp2_sub(&t2, &t2, &u);
+  // d = x0*t0 + xi*(x2*t1 + x1*t2)
+  mclBnFp2_mul(&d, &x->c[2], &t1);
+  mclBnFp2_mul(&u, &x->c[1], &t2);
+  mclBnFp2_add(&d, &d, &u);
+  fp2_mul_xi(&d, &d);
+  mclBnFp2_mul(&u, &x->c[0], &t0);
+  mclBnFp2_add(&d, &d, &u);
+  mclBnFp2_inv(&d, &d);
+  mclBnFp2_mul(&z->c[0], &t0, &d);
+  mclBnFp2_mul(&z->c[1], &t1, &d);
+  mclBnFp2_mul(&z->c[2], &t2, &d);
+}
+
+// MCL lays an Fp12 out as the Fp6 coefficients a then b, each as 3 Fp2
+static gt_fp6 *gt_half(const gt_ptr *p, int i) {
+  return reinterpret_cast<gt_fp6 *>(const_cast<gt_ptr *>(p)) + i;
+}
+
+static mclBnFp fp_one() {
+  mclBnFp one;
+  mclBnFp_setInt(&one, 1);
+  return one;
+}
+
+static bool gt_compact_in(gt_ptr *p, const uint8_t *in, size_t len) {
+  if (len == 1 && in[0] == GT_COMPACT_IDENTITY) {
+    mclBnGT_setInt(p, 1);
+    return true;
+  }
+  const size_t fp2Len = 2 * mclBn_getFpByteSize();
+  if (len != 1 + 3 * fp2Len || in[0] != GT_COMPACT_TORUS) {
+    return false;
+  }
+  gt_fp6 c, s, num, den;
+  mclBnFp one = fp_one();
+  for (int i = 0; i < 3; i++) {
+    if (mclBnFp2_deserialize(&c.c[i], in + 1 + i * fp2Len, fp2Len) != fp2Len) {
+      return false;
+    }
+  }
+  // a = (c^2 + v) / (c^2 - v), b = 2c / (c^2 - v); c^2 - v is never zero
+  // because v is not a square in Fp6
+  fp6_mul(&s, &c, &c);
+  num = s;
+  den = s;
+  mclBnFp_add(&num.c[1].d[0], &num.c[1].d[0], &one);
+  mclBnFp_sub(&den.c[1].d[0], &den.c[1].d[0], &one);
+  fp6_inv(&den, &den);
+  fp6_mul(gt_half(p, 0), &num, &den);
+  for (int i = 0; i < 3; i++) {
+    mclBnFp2_add(&c.c[i], &c.c[i], &c.c[i]);
+  }
+  fp6_mul(gt_half(p, 1), &c, &den);
+  return true;
+}
+#endif
+
+/*!
+ * Encode a GT element in the smallest form the backend offers: torus
+ * compression under MCL (see above), the compressed Fp12 form otherwise.
+ * gt_convert_to_point reads either this or the regular encoding.
+ */
+void gt_convert_to_compact_bytestring(bp_group_t group, oabe::OpenABEByteString &s,
+                                      const gt_ptr *p) {
+#if defined(BP_WITH_MCL)
+  gt_fp6 *a = gt_half(p, 0), *b = gt_half(p, 1);
+  if (mclBnFp2_isZero(&b->c[0]) && mclBnFp2_isZero(&b->c[1]) &&
+      mclBnFp2_isZero(&b->c[2])) {
+    // a^2 = 1 and -1 has even order, so a unitary g with b = 0 is the identity
+    if (!mclBnGT_isOne(p)) {
+      fprintf(stderr, "gt_convert_to_compact_bytestring: element not in GT\n");
+      return;
+    }
+    s.push_back(GT_COMPACT_IDENTITY);
+    return;
+  }
+  // c = (1 + a) / b
+  gt_fp6 c = *a, binv;
+  mclBnFp one = fp_one();
+  mclBnFp_add(&c.c[0].d[0], &c.c[0].d[0], &one);
+  fp6_inv(&binv, b);
+  fp6_mul(&c, &c, &binv);
+
+  uint8_t buf[MAX_BUFFER_SIZE];
+  size_t len = 0;
+  buf[len++] = GT_COMPACT_TORUS;
+  for (int i = 0; i < 3; i++) {
+    size_t n = mclBnFp2_serialize(buf + len, MAX_BUFFER_SIZE - len, &c.c[i]);
+    if (n == 0) {
+      fprintf(stderr, "gt_convert_to_compact_bytestring: mclBnFp2_serialize failed\n");
+      return;
+    }
+    len += n;
+  }
+  s.appendArray(buf, len);
+#else
+  gt_convert_to_bytestring(group, s, p, COMPRESS);
+#endif
+}
+
 void gt_convert_to_point(bp_group_t group, oabe::OpenABEByteString &s, gt_ptr *p, uint8_t curve_id) {
   uint8_t *xstr = s.getInternalPtr();
   size_t xstr_len = s.size();
 #if defined(BP_WITH_MCL)
+  // the full encoding is 12 field elements; anything shorter is compact
+  if (xstr_len < 12 * (size_t)mclBn_getFpByteSize()) {
+    if (!gt_compact_in(p, xstr, xstr_len)) {
+      fprintf(stderr, "%s:%s:%d: '%s'\n", __FILE__, __FUNCTION__, __LINE__,
+              OpenABE_errorToString(oabe::OpenABE_ERROR_SERIALIZATION_FAILED));
+    }
+    return;
+  }
   // FIX Bug #8: gt_ptr is mclBnGT struct, must pass by pointer!
   size_t read = mclBnGT_deserialize(p, xstr, xstr_len);  // p is now already a pointer
   if (read == 0) {
@@ -339,68 +506,112 @@ void gt_convert_to_point(bp_group_t group, oabe::OpenABEByteString &s, gt_ptr *p
 }
 
 
+#if defined(BP_WITH_MCL)
+static std::atomic<const oabe::OpenABEBatchAccelerator *> batchAccelerator(nullptr);
+
+namespace oabe {
+
+void OpenABE_setBatchAccelerator(const OpenABEBatchAccelerator *accel) {
+  batchAccelerator.store(accel, std::memory_order_release);
+}
+
+const OpenABEBatchAccelerator *OpenABE_getBatchAccelerator() {
+  return batchAccelerator.load(std::memory_order_acquire);
+}
+
+}
+
+// out = the product of loop(part, begin, end) over a split of [0, n) into
+// chunks of at least MILLER_LOOP_PARALLEL_CHUNK pairs, run on the library
+// thread pool. The partial products are multiplied here, so the caller
+// still does a single final exponentiation.
+template <typename Loop>
+static void millerLoopChunked(mclBnGT *out, size_t n, const Loop &loop) {
+  std::shared_ptr<oabe::OpenABEThreadPool> pool = oabe::OpenABEThreadPool::getDefault();
+  size_t chunks = std::min(n / MILLER_LOOP_PARALLEL_CHUNK, pool->size() + 1);
+  if (chunks < 2) {
+    loop(out, 0, n);
+    return;
+  }
+  std::vector<mclBnGT> partial(chunks);
+  pool->parallelFor(chunks, [&](size_t c) {
+    loop(&partial[c], c * n / chunks, (c + 1) * n / chunks);
+  });
+  *out = partial[0];
+  for (size_t c = 1; c < chunks; c++) {
+    mclBnGT_mul(out, out, &partial[c]);
+  }
+}
+
+// the MCL vector operations, handed to the accelerator when it takes them
+static void accelMillerLoopVec(mclBnGT *out, const mclBnG1 *p, const mclBnG2 *q, size_t n) {
+  const oabe::OpenABEBatchAccelerator *accel = batchAccelerator.load(std::memory_order_acquire);
+  if (accel != nullptr && accel->millerLoopVec != nullptr && n >= accel->minPairs &&
+      accel->millerLoopVec(accel->context, out, p, q, n) == 0) {
+    oabe::OpenABE_countMetric(oabe::OpenABE_METRIC_ACCELERATED_OPS);
+    return;
+  }
+  millerLoopChunked(out, n, [&](mclBnGT *part, size_t begin, size_t end) {
+    mclBn_millerLoopVec(part, p + begin, q + begin, (mclSize)(end - begin));
+  });
+}
+
+static void accelG1MulVec(mclBnG1 *out, mclBnG1 *x, const mclBnFr *y, size_t n) {
+  const oabe::OpenABEBatchAccelerator *accel = batchAccelerator.load(std::memory_order_acquire);
+  if (accel != nullptr && accel->g1MulVec != nullptr && n >= accel->minExps &&
+      accel->g1MulVec(accel->context, out, x, y, n) == 0) {
+    oabe::OpenABE_countMetric(oabe::OpenABE_METRIC_ACCELERATED_OPS);
+    return;
+  }
+  mclBnG1_mulVec(out, x, y, (mclSize)n);
+}
+
+static void accelG2MulVec(mclBnG2 *out, mclBnG2 *x, const mclBnFr *y, size_t n) {
+  const oabe::OpenABEBatchAccelerator *accel = batchAccelerator.load(std::memory_order_acquire);
+  if (accel != nullptr && accel->g2MulVec != nullptr && n >= accel->minExps &&
+      accel->g2MulVec(accel->context, out, x, y, n) == 0) {
+    oabe::OpenABE_countMetric(oabe::OpenABE_METRIC_ACCELERATED_OPS);
+    return;
+  }
+  mclBnG2_mulVec(out, x, y, (mclSize)n);
+}
+#endif
+
 void multi_bp_map_op(const bp_group_t group, oabe::GT &gt,
                      std::vector<oabe::G1> &g1, std::vector<oabe::G2> &g2) {
   if (g1.size() != g2.size()) {
     throw oabe::OpenABE_ERROR_INVALID_LENGTH;
   }
-  const size_t n = g1.size();
+  multi_bp_map_op(group, gt, g1.data(), g2.data(), g1.size());
+}
+
+void multi_bp_map_op(const bp_group_t group, oabe::GT &gt,
+                     const oabe::G1 *g1, const oabe::G2 *g2, size_t n) {
 #if defined(BP_WITH_OPENSSL) || defined(BP_WITH_MCL)
+  // the point arrays come from the caller's arena (if any) rather than the
+  // stack, so large policies cannot overflow it
   #if defined(BP_WITH_OPENSSL)
-  const G1_ELEM *ps[n];
-  const G2_ELEM *qs[n];
+  oabe::OpenABEArenaVector<const G1_ELEM *> ps(n);
+  oabe::OpenABEArenaVector<const G2_ELEM *> qs(n);
   #else /* BP_WITH_MCL */
-  g1_ptr ps[n];
-  g2_ptr qs[n];
+  oabe::OpenABEArenaVector<g1_ptr> ps(n);
+  oabe::OpenABEArenaVector<g2_ptr> qs(n);
   #endif
   for (size_t i = 0; i < n; i++) {
-    ps[i] = g1.at(i).m_G1;
-    qs[i] = g2.at(i).m_G2;
+    ps[i] = g1[i].m_G1;
+    qs[i] = g2[i].m_G2;
   }
   #if defined(BP_WITH_OPENSSL)
-  GT_ELEMs_pairing(group, gt.m_GT, n, ps, qs, NULL);
+  GT_ELEMs_pairing(group, gt.m_GT, n, ps.data(), qs.data(), NULL);
   #else /* BP_WITH_MCL */
-  // For MCL, compute multi-pairing
-  fprintf(stderr, "[MULTI_PAIRING_MCL] Computing %zu pairings\n", n);
-  mclBnGT temp;
-  memset(&temp, 0, sizeof(temp));
+  // For MCL, accumulate the Miller loops of all pairs and share a single
+  // final exponentiation: prod_i e(P_i, Q_i) = FE(prod_i ML(P_i, Q_i))
+  OpenABE_TRACE_DEBUG("multi_bp_map_op: %zu pairs", n);
   if (n == 0) {
     mclBnGT_setInt(&gt.m_GT, 1);  // Set to multiplicative identity (1), NOT zero!
   } else {
-    for (size_t i = 0; i < n; i++) {
-      // DEBUG: Check if G1 and G2 inputs are valid
-      int g1_valid = mclBnG1_isValid(&ps[i]);
-      int g2_valid = mclBnG2_isValid(&qs[i]);
-      int g1_zero = mclBnG1_isZero(&ps[i]);
-      int g2_zero = mclBnG2_isZero(&qs[i]);
-      fprintf(stderr, "[MULTI_PAIRING_MCL] Pair %zu: G1 valid=%d zero=%d, G2 valid=%d zero=%d\n",
-              i, g1_valid, g1_zero, g2_valid, g2_zero);
-
-      mclBn_pairing(&temp, &ps[i], &qs[i]);
-
-      // DEBUG: Check if pairing result is identity
-      int temp_is_one = mclBnGT_isOne(&temp);
-      int temp_is_zero = mclBnGT_isZero(&temp);
-      fprintf(stderr, "[MULTI_PAIRING_MCL] Pair %zu: pairing result is_one=%d is_zero=%d\n",
-              i, temp_is_one, temp_is_zero);
-
-      if (i == 0) {
-        // MCL doesn't have mclBnGT_copy, use memcpy or direct assignment
-        memcpy(&gt.m_GT, &temp, sizeof(mclBnGT));
-        fprintf(stderr, "[MULTI_PAIRING_MCL] Pair %zu: copied to result\n", i);
-      } else {
-        mclBnGT_mul(&gt.m_GT, &gt.m_GT, &temp);
-        int result_is_one = mclBnGT_isOne(&gt.m_GT);
-        fprintf(stderr, "[MULTI_PAIRING_MCL] Pair %zu: multiplied, result is_one=%d\n",
-                i, result_is_one);
-      }
-    }
-
-    // DEBUG: Final result check
-    int final_is_one = mclBnGT_isOne(&gt.m_GT);
-    int final_is_zero = mclBnGT_isZero(&gt.m_GT);
-    fprintf(stderr, "[MULTI_PAIRING_MCL] Final result: is_one=%d is_zero=%d\n",
-            final_is_one, final_is_zero);
+    accelMillerLoopVec(&gt.m_GT, ps.data(), qs.data(), n);
+    mclBn_finalExp(&gt.m_GT, &gt.m_GT);
   }
   #endif
 #else
@@ -408,20 +619,18 @@ void multi_bp_map_op(const bp_group_t group, oabe::GT &gt,
   g2_t g_2[n];
   for (size_t i = 0; i < n; i++) {
     g1_inits(g_1[i]);
-    g1_copy_const(g_1[i], g1.at(i).m_G1);
+    g1_copy_const(g_1[i], g1[i].m_G1);
     ep2_inits(g_2[i]);
-    g2_copy_const(g_2[i], g2.at(i).m_G2);
+    g2_copy_const(g_2[i], g2[i].m_G2);
 
-    // DEBUG: Check if inputs are infinity/zero
-    fprintf(stderr, "[MULTI_PAIRING] Pair %zu: G1 is_infty=%d, G2 is_infty=%d\n",
-            i, g1_is_infty(g_1[i]), g2_is_infty(g_2[i]));
+    OpenABE_TRACE_DEBUG("multi_bp_map_op: pair %zu: G1 is_infty=%d, G2 is_infty=%d",
+                        i, g1_is_infty(g_1[i]), g2_is_infty(g_2[i]));
 
     // SKIP normalization - g1_norm/g2_norm are BROKEN in WASM and zero out coordinates!
     // The pairing operation will handle normalization internally if needed
-    fprintf(stderr, "[MULTI_PAIRING] Pair %zu: Coordinates preserved (no norm call)\n", i);
   }
 
-  fprintf(stderr, "[MULTI_PAIRING] Computing %zu pairings individually\n", n);
+  OpenABE_TRACE_DEBUG("multi_bp_map_op: computing %zu pairings individually", n);
 
   // WORKAROUND: pp_map_sim_oatep_k12 appears to be broken in RELIC 0.7.0 with BN254
   // Use individual pairings and multiply results instead
@@ -435,15 +644,11 @@ void multi_bp_map_op(const bp_group_t group, oabe::GT &gt,
     } else {
       fp12_mul(gt.m_GT, gt.m_GT, temp);
     }
-    fprintf(stderr, "[MULTI_PAIRING] Pair %zu: computed and multiplied\n", i);
   }
 
   fp12_free(temp);
-  fprintf(stderr, "[MULTI_PAIRING] Finished individual pairing computation\n");
-
-  // DEBUG: Check result GT element
-  fprintf(stderr, "[MULTI_PAIRING] Result GT first coefficient fp12[0][0][0]=%d\n",
-          fp_is_zero(gt.m_GT[0][0][0]));
+  OpenABE_TRACE_DEBUG("multi_bp_map_op: result fp12[0][0][0] is_zero=%d",
+                      fp_is_zero(gt.m_GT[0][0][0]));
 
   for (size_t i = 0; i < n; i++) {
     g1_free(g_1[i]);
@@ -453,6 +658,69 @@ void multi_bp_map_op(const bp_group_t group, oabe::GT &gt,
 }
 
 
+void multi_bp_map_op(const bp_group_t group, oabe::GT &gt,
+                     const oabe::G1 *g1, const oabe::G2 *g2, size_t n,
+                     const oabe::G1 *fixedG1, const oabe::G2LineTable *const *fixedG2, size_t m) {
+#if defined(BP_WITH_MCL)
+  oabe::OpenABEArenaVector<g1_ptr> ps(n);
+  oabe::OpenABEArenaVector<g2_ptr> qs(n);
+  for (size_t i = 0; i < n; i++) {
+    ps[i] = g1[i].m_G1;
+    qs[i] = g2[i].m_G2;
+  }
+  OpenABE_TRACE_DEBUG("multi_bp_map_op: %zu pairs, %zu with precomputed lines", n, m);
+  if (n == 0) {
+    mclBnGT_setInt(&gt.m_GT, 1);
+  } else {
+    accelMillerLoopVec(&gt.m_GT, ps.data(), qs.data(), n);
+  }
+  // the fixed pairs join the same product ahead of the final exponentiation
+  if (m > 0) {
+    mclBnGT f;
+    millerLoopChunked(&f, m, [&](mclBnGT *part, size_t begin, size_t end) {
+      mclBnGT g;
+      mclBnGT_setInt(part, 1);
+      for (size_t i = begin; i < end; i++) {
+        mclBn_precomputedMillerLoop(&g, &fixedG1[i].m_G1, fixedG2[i]->getLines());
+        mclBnGT_mul(part, part, &g);
+      }
+    });
+    mclBnGT_mul(&gt.m_GT, &gt.m_GT, &f);
+  }
+  mclBn_finalExp(&gt.m_GT, &gt.m_GT);
+#else
+  // no line precomputation in this backend: pair the fixed elements directly
+  oabe::OpenABEArenaVector<oabe::G1> ps;
+  oabe::OpenABEArenaVector<oabe::G2> qs;
+  ps.reserve(n + m);
+  qs.reserve(n + m);
+  for (size_t i = 0; i < n; i++) {
+    ps.push_back(g1[i]);
+    qs.push_back(g2[i]);
+  }
+  for (size_t i = 0; i < m; i++) {
+    ps.push_back(fixedG1[i]);
+    qs.push_back(fixedG2[i]->getElement());
+  }
+  multi_bp_map_op(group, gt, ps.data(), qs.data(), ps.size());
+#endif
+}
+
+#if defined(BP_WITH_MCL)
+void multi_bp_map_op(const bp_group_t group, oabe::GT &gt,
+                     const oabe::G1Vector &g1, const oabe::G2Vector &g2) {
+  if (g1.size() != g2.size()) {
+    throw oabe::OpenABE_ERROR_INVALID_LENGTH;
+  }
+  if (g1.empty()) {
+    mclBnGT_setInt(&gt.m_GT, 1);
+    return;
+  }
+  accelMillerLoopVec(&gt.m_GT, g1.data(), g2.data(), g1.size());
+  mclBn_finalExp(&gt.m_GT, &gt.m_GT);
+}
+#endif
+
 /********************************************************************************
  * RNG trampoline from RELIC
  ********************************************************************************/
@@ -483,18 +751,21 @@ bool checkRelicError() {
  ********************************************************************************/
 
 BPGroup::BPGroup(OpenABECurveID id) : ZGroup(id) {
-  bp_group_init(&group, id);
+  // fails when the curve is unsupported or another curve is still in use
+  if (bp_group_init(&group, id) != 0) {
+    throw OpenABE_ERROR_INVALID_CURVE_ID;
+  }
   group_param = OpenABE_convertCurveIDToString(id);
   zml_bignum_init(&order);
   bp_get_order(group, order);
 }
 
 BPGroup::~BPGroup() {
-#ifndef __wasm__
   bp_group_free(group);
+#ifndef __wasm__
   zml_bignum_free(order);
 #else
-  // WASM FIX: Skip RELIC group/bignum cleanup in WASM builds
+  // WASM FIX: Skip bignum cleanup in WASM builds
   // The entire WASM module instance is destroyed after execution,
   // so explicit cleanup is unnecessary and causes traps
 #endif
@@ -574,15 +845,22 @@ ZP::~ZP() {
 #endif
 }
 
+// In-place variants of operator+ and operator*: no temporaries are created
 ZP &ZP::operator+=(const ZP &x) {
-  ZP r(*this);
-  *this = r + x;
+  ASSERT(this->isOrderSet || x.isOrderSet, OpenABE_ERROR_INVALID_INPUT);
+  if (!this->isOrderSet) {
+    this->setOrder(x.order);
+  }
+  zml_bignum_add(this->m_ZP, this->m_ZP, x.m_ZP, this->order);
   return *this;
 }
 
 ZP &ZP::operator*=(const ZP &x) {
-  ZP r(*this);
-  *this = r * x;
+  ASSERT(this->isOrderSet || x.isOrderSet, OpenABE_ERROR_INVALID_INPUT);
+  if (!this->isOrderSet) {
+    this->setOrder(x.order);
+  }
+  zml_bignum_mul(this->m_ZP, this->m_ZP, x.m_ZP, this->order);
   return *this;
 }
 
@@ -616,31 +894,14 @@ ZP operator-(const ZP &x, const ZP &y) {
   else
     zr.setOrder(y.order);
 
-#if defined(BP_WITH_MCL)
-  // DEBUG: Check input values before subtraction
-  fprintf(stderr, "[ZP_SUB_DEBUG] Before subtraction:\n");
-  fprintf(stderr, "[ZP_SUB_DEBUG]   x.isOrderSet=%d, y.isOrderSet=%d, zr.isOrderSet=%d\n",
-          x.isOrderSet, y.isOrderSet, zr.isOrderSet);
-  fprintf(stderr, "[ZP_SUB_DEBUG]   x.isZero=%d, y.isZero=%d\n",
-          mclBnFr_isZero(&x.m_ZP), mclBnFr_isZero(&y.m_ZP));
-
-  // Get string representation
-  char x_str[256], y_str[256];
-  mclBnFr_getStr(x_str, sizeof(x_str), &x.m_ZP, 10);
-  mclBnFr_getStr(y_str, sizeof(y_str), &y.m_ZP, 10);
-  fprintf(stderr, "[ZP_SUB_DEBUG]   x value: %s\n", x_str);
-  fprintf(stderr, "[ZP_SUB_DEBUG]   y value: %s\n", y_str);
-#endif
-
   zml_bignum_sub_order(zr.m_ZP, x.m_ZP, y.m_ZP, zr.order);
 
-#if defined(BP_WITH_MCL)
-  // DEBUG: Check result after subtraction
-  fprintf(stderr, "[ZP_SUB_DEBUG] After subtraction:\n");
-  fprintf(stderr, "[ZP_SUB_DEBUG]   result.isZero=%d\n", mclBnFr_isZero(&zr.m_ZP));
-  char r_str[256];
+#if defined(BP_WITH_MCL) && OpenABE_TRACE_ENABLED(OpenABE_TRACE_LEVEL_DEBUG)
+  char x_str[256], y_str[256], r_str[256];
+  mclBnFr_getStr(x_str, sizeof(x_str), &x.m_ZP, 10);
+  mclBnFr_getStr(y_str, sizeof(y_str), &y.m_ZP, 10);
   mclBnFr_getStr(r_str, sizeof(r_str), &zr.m_ZP, 10);
-  fprintf(stderr, "[ZP_SUB_DEBUG]   result value: %s\n", r_str);
+  OpenABE_TRACE_DEBUG("ZP sub: %s - %s = %s", x_str, y_str, r_str);
 #endif
 
   return zr;
@@ -672,6 +933,66 @@ void ZP::multInverse() {
   }
 }
 
+/*!
+ * Invert n elements in place with a single modular inversion (Montgomery's
+ * trick): invert the running product once, then peel each inverse off it
+ * with two multiplications.
+ *
+ * @param[in,out] elts  - the elements to invert
+ * @param[in] n         - number of elements
+ * @throw               - OpenABE_ERROR_DIVIDE_BY_ZERO if any element is zero
+ */
+void ZP::batchInverse(ZP *elts, size_t n) {
+  if (n == 0) {
+    return;
+  }
+  // prefix[i] = elts[0] * ... * elts[i]
+  OpenABEArenaVector<ZP> prefix;
+  prefix.reserve(n);
+  prefix.push_back(elts[0]);
+  for (size_t i = 1; i < n; i++) {
+    prefix.push_back(prefix[i-1] * elts[i]);
+  }
+  ZP inv = prefix[n-1];
+  ASSERT(!zml_bignum_is_zero(inv.m_ZP), OpenABE_ERROR_DIVIDE_BY_ZERO);
+  inv.multInverse();
+  // inv = 1 / (elts[0] * ... * elts[i]) at the top of each iteration
+  for (size_t i = n - 1; i > 0; i--) {
+    ZP eltInv = inv * prefix[i-1];
+    inv *= elts[i];
+    elts[i] = eltInv;
+  }
+  elts[0] = inv;
+}
+
+/*!
+ * Same as ZP::batchInverse, on value-only scalars.
+ *
+ * @param[in,out] elts  - the elements to invert
+ * @param[in] n         - number of elements
+ * @throw               - OpenABE_ERROR_DIVIDE_BY_ZERO if any element is zero
+ */
+void ZPScalar::batchInverse(ZPScalar *elts, size_t n) {
+  if (n == 0) {
+    return;
+  }
+  OpenABEArenaVector<ZPScalar> prefix;
+  prefix.reserve(n);
+  prefix.push_back(elts[0]);
+  for (size_t i = 1; i < n; i++) {
+    prefix.push_back(prefix[i-1] * elts[i]);
+  }
+  ZPScalar inv = prefix[n-1];
+  ASSERT(!inv.isZero(), OpenABE_ERROR_DIVIDE_BY_ZERO);
+  inv.multInverse();
+  for (size_t i = n - 1; i > 0; i--) {
+    ZPScalar eltInv = inv * prefix[i-1];
+    inv *= elts[i];
+    elts[i] = eltInv;
+  }
+  elts[0] = inv;
+}
+
 ZP operator/(const ZP &x, const ZP &y) {
   ZP c;
   if (zml_bignum_is_zero(y.m_ZP)) {
@@ -686,23 +1007,15 @@ ZP operator/(const ZP &x, const ZP &y) {
   else
     r.setOrder(y.order);
 
-  // DEBUG: Check values before division
-  #if defined(BP_WITH_MCL)
-  char x_val[256], y_val[256];
-  mclBnFr_getStr(x_val, sizeof(x_val), &x.m_ZP, 10);
-  mclBnFr_getStr(y_val, sizeof(y_val), &y.m_ZP, 10);
-  fprintf(stderr, "[ZP_DIV_DEBUG] Before div: x=%s, y=%s\n", x_val, y_val);
-  fprintf(stderr, "[ZP_DIV_DEBUG] r.m_ZP is_zero BEFORE=%d\n", mclBnFr_isZero(&r.m_ZP));
-  #endif
-
   zml_bignum_div(r.m_ZP, x.m_ZP, y.m_ZP, r.order);
 
-  // DEBUG: Check result after division
-  #if defined(BP_WITH_MCL)
-  char r_val[256];
+#if defined(BP_WITH_MCL) && OpenABE_TRACE_ENABLED(OpenABE_TRACE_LEVEL_DEBUG)
+  char x_val[256], y_val[256], r_val[256];
+  mclBnFr_getStr(x_val, sizeof(x_val), &x.m_ZP, 10);
+  mclBnFr_getStr(y_val, sizeof(y_val), &y.m_ZP, 10);
   mclBnFr_getStr(r_val, sizeof(r_val), &r.m_ZP, 10);
-  fprintf(stderr, "[ZP_DIV_DEBUG] After div: r=%s, is_zero=%d\n", r_val, mclBnFr_isZero(&r.m_ZP));
-  #endif
+  OpenABE_TRACE_DEBUG("ZP div: %s / %s = %s", x_val, y_val, r_val);
+#endif
 
   return r;
 }
@@ -761,21 +1074,6 @@ void ZP::setRandom(OpenABERNG *rng, bignum_t o) {
   if (!isInit) { fprintf(stderr, "%s:%s:%d: '%s'\
 ", __FILE__, __FUNCTION__, __LINE__, OpenABE_errorToString(OpenABE_ERROR_ELEMENT_NOT_INITIALIZED)); return; }
 
-  // COMPILE-TIME DIAGNOSTIC: Print which backend is being used
-  static bool diag_printed = false;
-  if (!diag_printed) {
-#if defined(BP_WITH_MCL)
-    fprintf(stderr, "[COMPILE-TIME] BP_WITH_MCL is DEFINED\n");
-#elif defined(BP_WITH_OPENSSL)
-    fprintf(stderr, "[COMPILE-TIME] BP_WITH_OPENSSL is DEFINED\n");
-#elif defined(__wasm__)
-    fprintf(stderr, "[COMPILE-TIME] __wasm__ is DEFINED\n");
-#else
-    fprintf(stderr, "[COMPILE-TIME] Using RELIC (default)\n");
-#endif
-    diag_printed = true;
-  }
-
   // 1. get some number of bytes
   if (!this->isOrderSet) {
     this->isOrderSet = true;
@@ -787,24 +1085,7 @@ void ZP::setRandom(OpenABERNG *rng, bignum_t o) {
   memset(buf, 0, length);
 #if defined(BP_WITH_OPENSSL) || defined(__wasm__)
   rng->getRandomBytes(buf, length);
-
-  // DEBUG: Print first few bytes
-  static int call_count = 0;
-  if (call_count < 10) {
-    fprintf(stderr, "[ZP::setRandom #%d] Got %d bytes: %02x%02x%02x%02x...\n",
-            call_count, length, buf[0], buf[1], buf[2], buf[3]);
-  }
-
   zml_bignum_fromBin(this->m_ZP, buf, length);
-
-  // DEBUG: Print resulting ZP value
-  if (call_count < 10) {
-    int len = 0;
-    char *str = zml_bignum_toDec(this->m_ZP, &len);
-    fprintf(stderr, "[ZP::setRandom #%d] ZP value (before mod): %s\n", call_count, str);
-    zml_bignum_safe_free(str);
-    call_count++;
-  }
 #elif defined(BP_WITH_MCL)
   // FIX Bug #15: For CCA security, we MUST use the provided PRNG, not MCL's system CSPRNG.
   // Generate random bytes from the provided PRNG and convert to Fr element.
@@ -821,18 +1102,6 @@ void ZP::setRandom(OpenABERNG *rng, bignum_t o) {
   zml_bignum_rand(this->m_ZP, this->order);
   zml_bignum_mod(this->m_ZP, this->order);
 #endif
-
-#if defined(BP_WITH_OPENSSL) || defined(BP_WITH_MCL) || defined(__wasm__)
-  // DEBUG: Print final ZP value after mod
-  static int final_count = 0;
-  if (final_count < 10) {
-    int len = 0;
-    char *str = zml_bignum_toDec(this->m_ZP, &len);
-    fprintf(stderr, "[ZP::setRandom #%d] ZP value (after mod): %s\n", final_count, str);
-    zml_bignum_safe_free(str);
-    final_count++;
-  }
-#endif
 }
 
 void ZP::setFrom(ZP &z, uint32_t index) {
@@ -901,8 +1170,15 @@ void ZP::serialize(OpenABEByteString &result) const {
   if (!isInit) { fprintf(stderr, "%s:%s:%d: '%s'\
 ", __FILE__, __FUNCTION__, __LINE__, OpenABE_errorToString(OpenABE_ERROR_ELEMENT_NOT_INITIALIZED)); return; }
   result.clear();
-  result.insertFirstByte(OpenABE_ELEMENT_ZP);
-  this->getLengthAndByteString(result);
+  OpenABEByteSink sink(result);
+  this->serializeTo(sink);
+}
+
+void ZP::serializeTo(OpenABEByteSink &sink) const {
+  if (!isInit) { fprintf(stderr, "%s:%s:%d: '%s'\
+", __FILE__, __FUNCTION__, __LINE__, OpenABE_errorToString(OpenABE_ERROR_ELEMENT_NOT_INITIALIZED)); return; }
+  sink.push_back(OpenABE_ELEMENT_ZP);
+  this->getLengthAndByteString(sink.bytes());
 }
 
 void ZP::deserialize(OpenABEByteString &input) {
@@ -955,6 +1231,16 @@ string ZP::getBytesAsString() {
 
 
 void ZP::getLengthAndByteString(OpenABEByteString &z) const {
+#if defined(BP_WITH_MCL)
+  // serialize straight into the output after the 16-bit length
+  size_t max = mclBn_getFrByteSize(), off = z.size();
+  z.resize(off + 2 + max);
+  uint8_t *out = z.getInternalPtr() + off;
+  size_t length = mclBnFr_serialize(out + 2, max, &this->m_ZP);
+  z.resize(off + 2 + length);
+  out[0] = (length >> 8) & 0xFF;
+  out[1] = length & 0xFF;
+#else
   size_t length = zml_bignum_countbytes(this->m_ZP);
 
   uint8_t data[length];
@@ -963,6 +1249,7 @@ void ZP::getLengthAndByteString(OpenABEByteString &z) const {
 
   z.pack16bits((uint16_t)length);
   z.appendArray(data, length);
+#endif
 }
 
 
@@ -992,6 +1279,47 @@ G1::G1(const G1 &w) {
   this->isInit = true;
 }
 
+/*!
+ * Move constructor. Takes over the group reference of w (no reference
+ * count traffic) and, where the point lives on the heap, the point itself.
+ *
+ * @param[in]   - G1 element to move from.
+ */
+G1::G1(G1 &&w) noexcept : bgroup(std::move(w.bgroup)) {
+  if (this->bgroup == nullptr) {
+    this->isInit = false;
+    return;
+  }
+#if defined(BP_WITH_OPENSSL)
+  this->m_G1 = w.m_G1;
+  w.m_G1 = nullptr;
+#else
+  g1_init(GET_BP_GROUP(this->bgroup), &this->m_G1);
+  g1_copy_const(this->m_G1, w.m_G1);
+#endif
+  this->isInit = true;
+}
+
+G1 &G1::operator=(G1 &&w) noexcept {
+  if (this == &w) {
+    return *this;
+  }
+  if (!this->isInit) {
+    ro_error();
+    return *this;
+  }
+  // swapping keeps w usable without touching the reference count
+  if (w.bgroup != nullptr) {
+    this->bgroup.swap(w.bgroup);
+  }
+#if defined(BP_WITH_OPENSSL)
+  std::swap(this->m_G1, w.m_G1);
+#else
+  g1_copy_const(this->m_G1, w.m_G1);
+#endif
+  return *this;
+}
+
 G1 &G1::operator=(const G1 &w) {
   if (this->isInit) {
     if (w.bgroup != nullptr) {
@@ -1011,7 +1339,7 @@ G1 &G1::operator=(const G1 &w) {
 }
 
 G1::~G1() {
-  if (this->isInit) {
+  if (this->isInit && !(is_elem_null(this->m_G1))) {
 #ifndef __wasm__
     g1_element_free(this->m_G1);
 #else
@@ -1031,18 +1359,28 @@ G1::~G1() {
  */
 G1 operator*(const G1 &x, const G1 &y) {
   G1 z = x;
-#if defined(BP_WITH_MCL)
-  // FIX Bug #9: Pass pointers for MCL
-  g1_add_op(GET_GROUP(z.bgroup), &z.m_G1, &z.m_G1, &const_cast<G1&>(y).m_G1);
-#else
-  g1_add_op(GET_GROUP(z.bgroup), z.m_G1, z.m_G1, y.m_G1);
-#endif
+  z *= y;
   return z;
 }
 
+// reuses the storage of a temporary lhs, e.g. g.exp(a) * h
+G1 operator*(G1 &&x, const G1 &y) {
+  x *= y;
+  return std::move(x);
+}
+
+/*!
+ * In-place field addition (rep. as multiplication) on elements of G1.
+ *
+ * @param[in]   - G1 element on rhs
+ */
 G1 &G1::operator*=(const G1 &x) {
-  G1 r(*this);
-  *this = r * x;
+#if defined(BP_WITH_MCL)
+  // FIX Bug #9: Pass pointers for MCL
+  g1_add_op(GET_GROUP(this->bgroup), &this->m_G1, &this->m_G1, &x.m_G1);
+#else
+  g1_add_op(GET_GROUP(this->bgroup), this->m_G1, this->m_G1, x.m_G1);
+#endif
   return *this;
 }
 
@@ -1093,6 +1431,7 @@ G1 operator-(const G1 &x) {
  * @param[in]   - ZP to multiply with this element.
  */
 G1 G1::exp(ZP z) {
+  OpenABE_countMetric(OpenABE_METRIC_G1_EXP);
   G1 g1(this->bgroup);
 #if defined(BP_WITH_MCL)
   // FIX Bug #9: Pass pointers for MCL - CRITICAL for G1::exp
@@ -1103,6 +1442,92 @@ G1 G1::exp(ZP z) {
   return g1;
 }
 
+/*!
+ * In-place exponentiation: this = this^z, without a temporary element.
+ *
+ * @param[in]   - ZP to multiply with this element.
+ * @return      - this element.
+ */
+G1 &G1::expInPlace(const ZP &z) {
+#if defined(BP_WITH_MCL)
+  OpenABE_countMetric(OpenABE_METRIC_G1_EXP);
+  g1_mul_op(GET_BP_GROUP(this->bgroup), &this->m_G1, &this->m_G1, &z.m_ZP);
+#else
+  *this = this->exp(z);
+#endif
+  return *this;
+}
+
+/*!
+ * Multi-exponentiation: compute prod_i bases[i]^exps[i] in one pass
+ * (Straus/Pippenger for MCL) instead of n separate exponentiations.
+ *
+ * @param[in]   - G1 bases.
+ * @param[in]   - ZP exponents (same length as bases).
+ * @return      - the resulting G1 element.
+ */
+G1 G1::multiExp(vector<G1> &bases, vector<ZP> &exps) {
+  if (bases.size() != exps.size()) {
+    throw OpenABE_ERROR_INVALID_LENGTH;
+  }
+  return G1::multiExp(bases.data(), exps.data(), bases.size());
+}
+
+/*!
+ * Multi-exponentiation over arrays of n bases and exponents.
+ *
+ * @param[in]   - G1 bases.
+ * @param[in]   - ZP exponents.
+ * @param[in]   - number of bases (at least one).
+ * @return      - the resulting G1 element.
+ */
+G1 G1::multiExp(const G1 *bases, const ZP *exps, size_t n) {
+  if (n == 0) {
+    throw OpenABE_ERROR_INVALID_LENGTH;
+  }
+  G1 result(bases[0].bgroup);
+#if defined(BP_WITH_MCL)
+  OpenABE_countMetric(OpenABE_METRIC_G1_EXP, n);
+  OpenABEArenaVector<mclBnG1> xs(n);
+  OpenABEArenaVector<mclBnFr> ys(n);
+  for (size_t i = 0; i < n; i++) {
+    xs[i] = bases[i].m_G1;
+    ys[i] = exps[i].m_ZP;
+  }
+  accelG1MulVec(&result.m_G1, xs.data(), ys.data(), n);
+#else
+  // exp() is not const, so work on copies of the bases
+  result = G1(bases[0]).exp(exps[0]);
+  for (size_t i = 1; i < n; i++) {
+    result *= G1(bases[i]).exp(exps[i]);
+  }
+#endif
+  return result;
+}
+
+/*!
+ * Double exponentiation: compute P^a * Q^b with the doublings of both
+ * terms shared (a two-term mulVec for MCL).
+ *
+ * @param[in]   - first base.
+ * @param[in]   - first exponent.
+ * @param[in]   - second base.
+ * @param[in]   - second exponent.
+ * @return      - the resulting G1 element.
+ */
+G1 G1::doubleExp(const G1 &P, const ZP &a, const G1 &Q, const ZP &b) {
+  G1 result(P.bgroup);
+#if defined(BP_WITH_MCL)
+  mclBnG1 xs[2] = {P.m_G1, Q.m_G1};
+  mclBnFr ys[2] = {a.m_ZP, b.m_ZP};
+  mclBnG1_mulVec(&result.m_G1, xs, ys, 2);
+#else
+  result = G1(P).exp(a);
+  result *= G1(Q).exp(b);
+#endif
+  return result;
+}
+
 /*!
  * Check whether G1 element is a member of a subgroup of the elliptic curve.
  *
@@ -1207,13 +1632,19 @@ bool operator!=(const G1 &x, const G1 &y) {
 }
 
 void G1::serialize(OpenABEByteString &result) const {
-  OpenABEByteString tmp;
-
   if (this->isInit) {
-    g1_convert_to_bytestring(GET_BP_GROUP(this->bgroup), tmp, this->m_G1);
     result.clear();
-    result.insertFirstByte(OpenABE_ELEMENT_G1);
-    result.smartPack(tmp);
+    OpenABEByteSink sink(result);
+    this->serializeTo(sink);
+  }
+}
+
+void G1::serializeTo(OpenABEByteSink &sink) const {
+  if (this->isInit) {
+    sink.push_back(OpenABE_ELEMENT_G1);
+    size_t mark = sink.beginPacked();
+    g1_convert_to_bytestring(GET_BP_GROUP(this->bgroup), sink.bytes(), this->m_G1);
+    sink.endPacked(mark);
   }
 }
 
@@ -1226,6 +1657,13 @@ void G1::deserialize(OpenABEByteString &input) {
     uint8_t element_type = input.at(index);
     if (element_type == OpenABE_ELEMENT_G1) {
       index++;
+#if defined(BP_WITH_MCL)
+      // read the point in place rather than from an unpacked copy
+      size_t len = input.smartUnpackLength(&index);
+      if (mclBnG1_deserialize(&this->m_G1, input.getInternalPtr() + index, len) == len) {
+        return;
+      }
+#else
       g1_bytes = input.smartUnpack(&index);
       // read the binary buffer into a G1 element, then check for error
       // condition
@@ -1234,6 +1672,7 @@ void G1::deserialize(OpenABEByteString &input) {
       }
       g1_convert_to_point(GET_BP_GROUP(this->bgroup), g1_bytes, this->m_G1, this->bgroup->getCurveID());
       return;
+#endif
     }
   }
   fprintf(stderr, "%s:%s:%d: '%s'\
@@ -1276,6 +1715,43 @@ G2::G2(const G2& w)
     this->isInit = true;
 }
 
+G2::G2(G2&& w) noexcept : bgroup(std::move(w.bgroup))
+{
+    if (this->bgroup == nullptr) {
+        this->isInit = false;
+        return;
+    }
+#if defined(BP_WITH_OPENSSL)
+    this->m_G2 = w.m_G2;
+    w.m_G2 = nullptr;
+#else
+    g2_init(GET_BP_GROUP(this->bgroup), &this->m_G2);
+    g2_copy_const(this->m_G2, w.m_G2);
+#endif
+    this->isInit = true;
+}
+
+G2&
+G2::operator=(G2&& w) noexcept
+{
+    if (this == &w) {
+        return *this;
+    }
+    if (!this->isInit) {
+        ro_error();
+        return *this;
+    }
+    if (w.bgroup != nullptr) {
+        this->bgroup.swap(w.bgroup);
+    }
+#if defined(BP_WITH_OPENSSL)
+    std::swap(this->m_G2, w.m_G2);
+#else
+    g2_copy_const(this->m_G2, w.m_G2);
+#endif
+    return *this;
+}
+
 G2&
 G2::operator=(const G2& w)
 {
@@ -1298,7 +1774,7 @@ G2::operator=(const G2& w)
 
 G2::~G2()
 {
-    if (this->isInit) {
+    if (this->isInit && !(is_elem_null(this->m_G2))) {
 #ifndef __wasm__
         g2_element_free(this->m_G2);
 #else
@@ -1314,20 +1790,25 @@ G2::~G2()
 G2 operator*(const G2& x,const G2& y)
 {
 	G2 z = x;
-#if defined(BP_WITH_OPENSSL)
-    G2_ELEM_add(GET_BP_GROUP(z.bgroup), z.m_G2, z.m_G2, y.m_G2, NULL);
-#else
-	g2_add(z.m_G2, z.m_G2, const_cast<G2&>(y).m_G2);
-	g2_norm(z.m_G2, z.m_G2);
-#endif
+	z *= y;
 	return z;
 }
 
+G2 operator*(G2&& x,const G2& y)
+{
+	x *= y;
+	return std::move(x);
+}
+
 G2&
 G2::operator*=(const G2& x)
 {
-	G2 r(*this);
-	*this = r * x;
+#if defined(BP_WITH_OPENSSL)
+    G2_ELEM_add(GET_BP_GROUP(this->bgroup), this->m_G2, this->m_G2, x.m_G2, NULL);
+#else
+	g2_add(this->m_G2, this->m_G2, const_cast<G2&>(x).m_G2);
+	g2_norm(this->m_G2, this->m_G2);
+#endif
 	return *this;
 }
 
@@ -1359,6 +1840,7 @@ G2 operator-(const G2& x)
 
 G2 G2::exp(ZP z)
 {
+	OpenABE_countMetric(OpenABE_METRIC_G2_EXP);
 	G2 g2(this->bgroup);
 #if defined(BP_WITH_MCL)
 	// FIX Bug #9: Pass pointers for MCL - CRITICAL for G2::exp
@@ -1369,6 +1851,65 @@ G2 G2::exp(ZP z)
     return g2;
 }
 
+G2& G2::expInPlace(const ZP& z)
+{
+#if defined(BP_WITH_MCL)
+	OpenABE_countMetric(OpenABE_METRIC_G2_EXP);
+	g2_mul_op(GET_BP_GROUP(this->bgroup), &this->m_G2, &this->m_G2, &z.m_ZP);
+#else
+	*this = this->exp(z);
+#endif
+	return *this;
+}
+
+/*!
+ * Multi-exponentiation: compute prod_i bases[i]^exps[i] in one pass.
+ *
+ * @param[in]   - G2 bases.
+ * @param[in]   - ZP exponents (same length as bases).
+ * @return      - the resulting G2 element.
+ */
+G2 G2::multiExp(vector<G2> &bases, vector<ZP> &exps)
+{
+  if (bases.size() != exps.size()) {
+    throw OpenABE_ERROR_INVALID_LENGTH;
+  }
+  return G2::multiExp(bases.data(), exps.data(), bases.size());
+}
+
+/*!
+ * Multi-exponentiation over arrays of n bases and exponents.
+ *
+ * @param[in]   - G2 bases.
+ * @param[in]   - ZP exponents.
+ * @param[in]   - number of bases (at least one).
+ * @return      - the resulting G2 element.
+ */
+G2 G2::multiExp(const G2 *bases, const ZP *exps, size_t n)
+{
+  if (n == 0) {
+    throw OpenABE_ERROR_INVALID_LENGTH;
+  }
+  G2 result(bases[0].bgroup);
+#if defined(BP_WITH_MCL)
+  OpenABE_countMetric(OpenABE_METRIC_G2_EXP, n);
+  OpenABEArenaVector<mclBnG2> xs(n);
+  OpenABEArenaVector<mclBnFr> ys(n);
+  for (size_t i = 0; i < n; i++) {
+    xs[i] = bases[i].m_G2;
+    ys[i] = exps[i].m_ZP;
+  }
+  accelG2MulVec(&result.m_G2, xs.data(), ys.data(), n);
+#else
+  // exp() is not const, so work on copies of the bases
+  result = G2(bases[0]).exp(exps[0]);
+  for (size_t i = 1; i < n; i++) {
+    result *= G2(bases[i]).exp(exps[i]);
+  }
+#endif
+  return result;
+}
+
 bool G2::ismember(bignum_t order)
 {
 	bool result;
@@ -1431,6 +1972,22 @@ void G2::setRandom(OpenABERNG *rng)
 	}
 }
 
+void G2::setGenerator()
+{
+	if(this->isInit) {
+#if defined(BP_WITH_OPENSSL)
+        int rc = BP_GROUP_get_generator_G2(GET_BP_GROUP(this->bgroup), this->m_G2);
+        ASSERT(rc == 1, OpenABE_ERROR_INVALID_INPUT);
+#elif defined(BP_WITH_MCL)
+		// the same base point that setRandom and g2_rand multiply
+		int ret = mclBnG2_hashAndMapTo(&this->m_G2, "OpenABE-G2-base", 15);
+		ASSERT(ret == 0, OpenABE_ERROR_INVALID_INPUT);
+#else
+		g2_get_gen(this->m_G2);
+#endif
+	}
+}
+
 ostream& operator<<(ostream& os, const G2& g2)
 {
 #if defined(BP_WITH_OPENSSL) || defined(BP_WITH_MCL)
@@ -1464,13 +2021,21 @@ bool operator!=(const G2& x,const G2& y)
 void
 G2::serialize(OpenABEByteString &result) const
 {
-    OpenABEByteString tmp;
-
     if(this->isInit) {
-        g2_convert_to_bytestring(GET_BP_GROUP(this->bgroup), tmp, const_cast<G2*>(this)->m_G2);
         result.clear();
-        result.insertFirstByte(OpenABE_ELEMENT_G2);
-        result.smartPack(tmp);
+        OpenABEByteSink sink(result);
+        this->serializeTo(sink);
+    }
+}
+
+void
+G2::serializeTo(OpenABEByteSink &sink) const
+{
+    if(this->isInit) {
+        sink.push_back(OpenABE_ELEMENT_G2);
+        size_t mark = sink.beginPacked();
+        g2_convert_to_bytestring(GET_BP_GROUP(this->bgroup), sink.bytes(), const_cast<G2*>(this)->m_G2);
+        sink.endPacked(mark);
     }
 }
 
@@ -1485,12 +2050,19 @@ G2::deserialize(OpenABEByteString &input)
         uint8_t element_type = input.at(index);
         if(element_type == OpenABE_ELEMENT_G2) {
             index++;
+#if defined(BP_WITH_MCL)
+            size_t len = input.smartUnpackLength(&index);
+            if (mclBnG2_deserialize(&this->m_G2, input.getInternalPtr() + index, len) == len) {
+                return;
+            }
+#else
             g2_bytes = input.smartUnpack(&index);
             if (is_elem_null(this->m_G2)) {
                 g2_init(GET_BP_GROUP(this->bgroup), &this->m_G2);
             }
             g2_convert_to_point(GET_BP_GROUP(this->bgroup), g2_bytes, this->m_G2, this->bgroup->getCurveID());
             return;
+#endif
         }
     }
     fprintf(stderr, "%s:%s:%d: '%s'\
@@ -1507,6 +2079,251 @@ G2::isEqual(ZObject *z) const
 	return false;
 }
 
+#if defined(BP_WITH_MCL)
+/********************************************************************************
+ * Implementation of the G1Vector and G2Vector classes
+ ********************************************************************************/
+
+// the field and point operations the vector code shares, by coordinate field
+static inline void mcl_setOne(mclBnFp *x) { mclBnFp_setInt(x, 1); }
+static inline void mcl_setOne(mclBnFp2 *x) { mclBnFp_setInt(&x->d[0], 1); mclBnFp_clear(&x->d[1]); }
+static inline bool mcl_isZero(const mclBnFp *x) { return mclBnFp_isZero(x) == 1; }
+static inline bool mcl_isZero(const mclBnFp2 *x) { return mclBnFp2_isZero(x) == 1; }
+static inline bool mcl_isEqual(const mclBnFp *x, const mclBnFp *y) { return mclBnFp_isEqual(x, y) == 1; }
+static inline bool mcl_isEqual(const mclBnFp2 *x, const mclBnFp2 *y) { return mclBnFp2_isEqual(x, y) == 1; }
+static inline void mcl_mul(mclBnFp *z, const mclBnFp *x, const mclBnFp *y) { mclBnFp_mul(z, x, y); }
+static inline void mcl_mul(mclBnFp2 *z, const mclBnFp2 *x, const mclBnFp2 *y) { mclBnFp2_mul(z, x, y); }
+static inline void mcl_sqr(mclBnFp *y, const mclBnFp *x) { mclBnFp_sqr(y, x); }
+static inline void mcl_sqr(mclBnFp2 *y, const mclBnFp2 *x) { mclBnFp2_sqr(y, x); }
+static inline void mcl_inv(mclBnFp *y, const mclBnFp *x) { mclBnFp_inv(y, x); }
+static inline void mcl_inv(mclBnFp2 *y, const mclBnFp2 *x) { mclBnFp2_inv(y, x); }
+static inline size_t mcl_serialize(uint8_t *buf, size_t n, const mclBnG1 *x) { return mclBnG1_serialize(buf, n, x); }
+static inline size_t mcl_serialize(uint8_t *buf, size_t n, const mclBnG2 *x) { return mclBnG2_serialize(buf, n, x); }
+static inline size_t mcl_deserialize(mclBnG1 *x, const uint8_t *buf, size_t n) { return mclBnG1_deserialize(x, buf, n); }
+static inline size_t mcl_deserialize(mclBnG2 *x, const uint8_t *buf, size_t n) { return mclBnG2_deserialize(x, buf, n); }
+static inline size_t mcl_pointSize(const mclBnG1 *) { return (size_t)mclBn_getG1ByteSize(); }
+static inline size_t mcl_pointSize(const mclBnG2 *) { return 2 * (size_t)mclBn_getG1ByteSize(); }
+
+/*!
+ * MCL keeps points in Jacobian coordinates (X, Y, Z) for (X/Z^2, Y/Z^3).
+ * All the Z are inverted at once with Montgomery's trick, so n points cost
+ * one inversion and about 3n multiplications; the identity (Z = 0) is left
+ * as it is.
+ */
+template <class P, class F, class At>
+static void batchNormalizeAt(size_t n, At at) {
+  std::vector<F> prefix(n);
+  F acc, zinv, t;
+  mcl_setOne(&acc);
+  for (size_t i = 0; i < n; i++) {
+    prefix[i] = acc;
+    if (!mcl_isZero(&at(i).z)) {
+      mcl_mul(&acc, &acc, &at(i).z);
+    }
+  }
+  mcl_inv(&acc, &acc);
+  for (size_t i = n; i-- > 0; ) {
+    P &pt = at(i);
+    if (mcl_isZero(&pt.z)) {
+      continue;
+    }
+    // acc = 1 / (z_0 ... z_i), prefix[i] = z_0 ... z_(i-1)
+    mcl_mul(&zinv, &acc, &prefix[i]);
+    mcl_mul(&acc, &acc, &pt.z);
+    mcl_sqr(&t, &zinv);
+    mcl_mul(&pt.x, &pt.x, &t);
+    mcl_mul(&t, &t, &zinv);
+    mcl_mul(&pt.y, &pt.y, &t);
+    mcl_setOne(&pt.z);
+  }
+}
+
+template <class P, class F>
+static void batchNormalize(P *pts, size_t n) {
+  batchNormalizeAt<P, F>(n, [pts](size_t i) -> P& { return pts[i]; });
+}
+
+// the points of 'pts' not already affine (Z = 1), normalized together
+template <class E, class P, class F>
+static void batchNormalizeElements(E *const *pts, size_t n, P E::*point) {
+  std::vector<P *> pending;
+  F one;
+  mcl_setOne(&one);
+  for (size_t i = 0; i < n; i++) {
+    P *pt = &(pts[i]->*point);
+    if (!mcl_isZero(&pt->z) && !mcl_isEqual(&pt->z, &one)) {
+      pending.push_back(pt);
+    }
+  }
+  if (pending.size() == 1) {
+    // no inversion to share: a single point costs the same either way
+    return;
+  }
+  batchNormalizeAt<P, F>(pending.size(), [&pending](size_t i) -> P& { return *pending[i]; });
+}
+
+template <class P>
+static void serializePoints(OpenABEByteString &result, const std::vector<P> &pts) {
+  const size_t len = mcl_pointSize((const P *)nullptr);
+  result.clear();
+  result.pack32bits((uint32_t)pts.size());
+  result.resize(sizeof(uint32_t) + pts.size() * len);
+  uint8_t *out = result.getInternalPtr() + sizeof(uint32_t);
+  for (size_t i = 0; i < pts.size(); i++, out += len) {
+    if (mcl_serialize(out, len, &pts[i]) != len) {
+      throw OpenABE_ERROR_SERIALIZATION_FAILED;
+    }
+  }
+}
+
+template <class P>
+static void deserializePoints(OpenABEByteString &input, std::vector<P> &pts) {
+  const size_t len = mcl_pointSize((const P *)nullptr);
+  if (input.size() < sizeof(uint32_t)) {
+    throw OpenABE_ERROR_SERIALIZATION_FAILED;
+  }
+  const uint8_t *in = input.getInternalPtr();
+  size_t count = ((size_t)in[0] << 24) | ((size_t)in[1] << 16) | ((size_t)in[2] << 8) | in[3];
+  if ((input.size() - sizeof(uint32_t)) / len != count ||
+      (input.size() - sizeof(uint32_t)) % len != 0) {
+    throw OpenABE_ERROR_SERIALIZATION_FAILED;
+  }
+  pts.resize(count);
+  in += sizeof(uint32_t);
+  for (size_t i = 0; i < count; i++, in += len) {
+    if (mcl_deserialize(&pts[i], in, len) != len) {
+      throw OpenABE_ERROR_SERIALIZATION_FAILED;
+    }
+  }
+}
+
+static_assert(sizeof(ZPScalar) == sizeof(mclBnFr), "ZPScalar must be a bare mclBnFr");
+
+G1Vector::G1Vector(std::shared_ptr<BPGroup> bgroup, size_t n) : bgroup_(bgroup) {
+  this->resize(n);
+}
+
+G1Vector::G1Vector(std::shared_ptr<BPGroup> bgroup, const G1 *elts, size_t n)
+    : bgroup_(bgroup), elts_(n) {
+  for (size_t i = 0; i < n; i++) {
+    this->elts_[i] = elts[i].m_G1;
+  }
+}
+
+void G1Vector::resize(size_t n) {
+  mclBnG1 zero;
+  mclBnG1_clear(&zero);
+  this->elts_.resize(n, zero);
+}
+
+G1 G1Vector::get(size_t i) const {
+  G1 e(this->bgroup_);
+  e.m_G1 = this->elts_[i];
+  return e;
+}
+
+G1 G1Vector::multiExp(const ZP *exps) {
+  OpenABEArenaVector<mclBnFr> ys(this->size());
+  for (size_t i = 0; i < this->size(); i++) {
+    ys[i] = exps[i].m_ZP;
+  }
+  return this->multiExp((const ZPScalar *)ys.data());
+}
+
+G1 G1Vector::multiExp(const ZPScalar *exps) {
+  if (this->empty()) {
+    throw OpenABE_ERROR_INVALID_LENGTH;
+  }
+  OpenABE_countMetric(OpenABE_METRIC_G1_EXP, this->size());
+  G1 result(this->bgroup_);
+  accelG1MulVec(&result.m_G1, this->elts_.data(), (const mclBnFr *)exps, this->size());
+  return result;
+}
+
+void G1Vector::normalize() {
+  batchNormalize<mclBnG1, mclBnFp>(this->elts_.data(), this->elts_.size());
+}
+
+void G1Vector::serialize(OpenABEByteString &result) const {
+  serializePoints(result, this->elts_);
+}
+
+void G1Vector::deserialize(OpenABEByteString &input) {
+  deserializePoints(input, this->elts_);
+}
+
+G2Vector::G2Vector(std::shared_ptr<BPGroup> bgroup, size_t n) : bgroup_(bgroup) {
+  this->resize(n);
+}
+
+G2Vector::G2Vector(std::shared_ptr<BPGroup> bgroup, const G2 *elts, size_t n)
+    : bgroup_(bgroup), elts_(n) {
+  for (size_t i = 0; i < n; i++) {
+    this->elts_[i] = elts[i].m_G2;
+  }
+}
+
+void G2Vector::resize(size_t n) {
+  mclBnG2 zero;
+  mclBnG2_clear(&zero);
+  this->elts_.resize(n, zero);
+}
+
+G2 G2Vector::get(size_t i) const {
+  G2 e(this->bgroup_);
+  e.m_G2 = this->elts_[i];
+  return e;
+}
+
+G2 G2Vector::multiExp(const ZP *exps) {
+  OpenABEArenaVector<mclBnFr> ys(this->size());
+  for (size_t i = 0; i < this->size(); i++) {
+    ys[i] = exps[i].m_ZP;
+  }
+  return this->multiExp((const ZPScalar *)ys.data());
+}
+
+G2 G2Vector::multiExp(const ZPScalar *exps) {
+  if (this->empty()) {
+    throw OpenABE_ERROR_INVALID_LENGTH;
+  }
+  OpenABE_countMetric(OpenABE_METRIC_G2_EXP, this->size());
+  G2 result(this->bgroup_);
+  accelG2MulVec(&result.m_G2, this->elts_.data(), (const mclBnFr *)exps, this->size());
+  return result;
+}
+
+void G2Vector::normalize() {
+  batchNormalize<mclBnG2, mclBnFp2>(this->elts_.data(), this->elts_.size());
+}
+
+void G2Vector::serialize(OpenABEByteString &result) const {
+  serializePoints(result, this->elts_);
+}
+
+void G2Vector::deserialize(OpenABEByteString &input) {
+  deserializePoints(input, this->elts_);
+}
+
+/*!
+ * Bring the points to affine coordinates with one field inversion for all
+ * of them, so that serializing them does not invert each Z on its own.
+ * Points that are already affine are left alone.
+ *
+ * @param[in]   the points and their number.
+ */
+void G1::normalizeAll(G1 *const *pts, size_t n) {
+  batchNormalizeElements<G1, mclBnG1, mclBnFp>(pts, n, &G1::m_G1);
+}
+
+void G2::normalizeAll(G2 *const *pts, size_t n) {
+  batchNormalizeElements<G2, mclBnG2, mclBnFp2>(pts, n, &G2::m_G2);
+}
+#else
+void G1::normalizeAll(G1 *const *, size_t) {}
+void G2::normalizeAll(G2 *const *, size_t) {}
+#endif
+
 /********************************************************************************
  * Implementation of the GT class
  ********************************************************************************/
@@ -1538,6 +2355,45 @@ GT::GT(const GT& w)
     this->shouldCompress_ = w.shouldCompress_;
 }
 
+GT::GT(GT&& w) noexcept : bgroup(std::move(w.bgroup))
+{
+    this->shouldCompress_ = w.shouldCompress_;
+    if (this->bgroup == nullptr) {
+        this->isInit = false;
+        return;
+    }
+#if defined(BP_WITH_OPENSSL)
+    this->m_GT = w.m_GT;
+    w.m_GT = nullptr;
+#else
+    gt_init(GET_BP_GROUP(this->bgroup), &this->m_GT);
+    gt_copy_const(this->m_GT, w.m_GT);
+#endif
+    this->isInit = true;
+}
+
+GT&
+GT::operator=(GT&& w) noexcept
+{
+    if (this == &w) {
+        return *this;
+    }
+    if (!this->isInit) {
+        ro_error();
+        return *this;
+    }
+    if (w.bgroup != nullptr) {
+        this->bgroup.swap(w.bgroup);
+    }
+#if defined(BP_WITH_OPENSSL)
+    std::swap(this->m_GT, w.m_GT);
+#else
+    gt_copy_const(this->m_GT, w.m_GT);
+#endif
+    this->shouldCompress_ = w.shouldCompress_;
+    return *this;
+}
+
 GT&
 GT::operator=(const GT& w)
 {
@@ -1560,7 +2416,7 @@ GT::operator=(const GT& w)
 
 GT::~GT()
 {
-    if (this->isInit) {
+    if (this->isInit && !(is_elem_null(this->m_GT))) {
         gt_element_free(this->m_GT);
         this->isInit = false;
     }
@@ -1570,20 +2426,25 @@ GT::~GT()
 GT operator*(const GT& x,const GT& y)
 {
 	GT z = x;
-#if defined(BP_WITH_MCL)
-	// FIX Bug #9: Pass pointers for MCL
-	gt_mul_op(GET_BP_GROUP(z.bgroup), &z.m_GT, &z.m_GT, &const_cast<GT&>(y).m_GT);
-#else
-	gt_mul_op(GET_BP_GROUP(z.bgroup), z.m_GT, z.m_GT, const_cast<GT&>(y).m_GT);
-#endif
+	z *= y;
 	return z;
 }
 
+GT operator*(GT&& x,const GT& y)
+{
+	x *= y;
+	return std::move(x);
+}
+
 GT&
 GT::operator*=(const GT& x)
 {
-	GT r(*this);
-	*this = r * x;
+#if defined(BP_WITH_MCL)
+	// FIX Bug #9: Pass pointers for MCL
+	gt_mul_op(GET_BP_GROUP(this->bgroup), &this->m_GT, &this->m_GT, &x.m_GT);
+#else
+	gt_mul_op(GET_BP_GROUP(this->bgroup), this->m_GT, this->m_GT, const_cast<GT&>(x).m_GT);
+#endif
 	return *this;
 }
 
@@ -1602,6 +2463,7 @@ GT operator/(const GT& x,const GT& y)
 
 GT GT::exp(ZP z)
 {
+	OpenABE_countMetric(OpenABE_METRIC_GT_EXP);
 	GT gt(*this);
 #if defined(BP_WITH_MCL)
 	// FIX Bug #9: Pass pointers for MCL
@@ -1612,9 +2474,20 @@ GT GT::exp(ZP z)
 	return gt;
 }
 
-GT operator-(const GT& g)
+GT& GT::expInPlace(const ZP& z)
 {
-	GT gt(g);
+	OpenABE_countMetric(OpenABE_METRIC_GT_EXP);
+#if defined(BP_WITH_MCL)
+	gt_exp_op(GET_BP_GROUP(this->bgroup), &this->m_GT, &this->m_GT, &z.m_ZP);
+#else
+	gt_exp_op(GET_BP_GROUP(this->bgroup), this->m_GT, this->m_GT, const_cast<ZP&>(z).m_ZP);
+#endif
+	return *this;
+}
+
+GT GT::conjugate() const
+{
+	GT gt(*this);
 #if defined(BP_WITH_OPENSSL)
 	GT_ELEM_inv(GET_BP_GROUP(gt.bgroup), gt.m_GT, gt.m_GT, NULL);
 #else
@@ -1623,6 +2496,11 @@ GT operator-(const GT& g)
 	return gt;
 }
 
+GT operator-(const GT& g)
+{
+	return g.conjugate();
+}
+
 void GT::setIdentity()
 {
 #if defined(BP_WITH_OPENSSL)
@@ -1698,16 +2576,45 @@ bool operator!=(const GT& x, const GT& y)
 void
 GT::serialize(OpenABEByteString &result) const
 {
-    OpenABEByteString tmp;
+    if(this->isInit) {
+        result.clear();
+        OpenABEByteSink sink(result);
+        this->serializeTo(sink);
+    }
+}
+
+void
+GT::serializeTo(OpenABEByteSink &sink) const
+{
     int compress = shouldCompress_ ? COMPRESS : NO_COMPRESS;
 
     if(this->isInit) {
+        sink.push_back(OpenABE_ELEMENT_GT);
+        size_t mark = sink.beginPacked();
         // FIX Bug #8: Pass pointer to m_GT for MCL
-        gt_convert_to_bytestring(GET_BP_GROUP(this->bgroup), tmp, &const_cast<GT&>(*this).m_GT, compress);
-        // pack the resulting ciphertext in result
+        gt_convert_to_bytestring(GET_BP_GROUP(this->bgroup), sink.bytes(), &const_cast<GT&>(*this).m_GT, compress);
+        sink.endPacked(mark);
+    }
+}
+
+void
+GT::serializeCompact(OpenABEByteString &result) const
+{
+    if(this->isInit) {
         result.clear();
-        result.insertFirstByte(OpenABE_ELEMENT_GT);
-        result.smartPack(tmp);
+        OpenABEByteSink sink(result);
+        this->serializeCompactTo(sink);
+    }
+}
+
+void
+GT::serializeCompactTo(OpenABEByteSink &sink) const
+{
+    if(this->isInit) {
+        sink.push_back(OpenABE_ELEMENT_GT);
+        size_t mark = sink.beginPacked();
+        gt_convert_to_compact_bytestring(GET_BP_GROUP(this->bgroup), sink.bytes(), &this->m_GT);
+        sink.endPacked(mark);
     }
 }
 
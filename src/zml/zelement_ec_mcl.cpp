@@ -197,6 +197,11 @@ void ec_point_mul(ec_group_t g, ec_point_t r, const ec_point_t x, const bignum_t
             scalar);
 }
 
+void ec_point_mul_gen(ec_group_t g, ec_point_t r, const bignum_t y) {
+    if (!mcl_ec_initialized) return;
+    ec_point_mul(g, r, &generator, y);
+}
+
 /********************************************************************************
  * Serialization Operations
  ********************************************************************************/
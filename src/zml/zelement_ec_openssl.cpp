@@ -56,6 +56,11 @@ int ec_group_init(ec_group_t *group, uint8_t id) {
 
     // Set group to use named curve for more efficient serialization
     EC_GROUP_set_asn1_flag(ec_group, OPENSSL_EC_NAMED_CURVE);
+#if OPENSSL_VERSION_NUMBER < 0x30000000L
+    // Fixed-base table for the generator, used by ec_point_mul_gen
+    // (OpenSSL 3 deprecates this; its curves precompute it internally)
+    EC_GROUP_precompute_mult(ec_group, NULL);
+#endif
 
     *group = ec_group;
     return 0;
@@ -246,6 +251,27 @@ void ec_point_mul(ec_group_t g, ec_point_t r, const ec_point_t x, const bignum_t
     BN_CTX_free(ctx);
 }
 
+void ec_point_mul_gen(ec_group_t g, ec_point_t r, const bignum_t y) {
+    if (!g || !r || !y) return;
+
+    EC_GROUP *ec_group = static_cast<EC_GROUP*>(g);
+    EC_POINT *result = static_cast<EC_POINT*>(r);
+    const BIGNUM *scalar = static_cast<const BIGNUM*>(y);
+
+    BN_CTX *ctx = BN_CTX_new();
+    if (!ctx) {
+        fprintf(stderr, "ec_point_mul_gen: Failed to create BN_CTX\n");
+        return;
+    }
+
+    // generator form: uses the precomputed generator table of the group
+    if (!EC_POINT_mul(ec_group, result, scalar, NULL, NULL, ctx)) {
+        fprintf(stderr, "ec_point_mul_gen: Failed to multiply generator\n");
+    }
+
+    BN_CTX_free(ctx);
+}
+
 /********************************************************************************
  * Serialization Operations
  ********************************************************************************/
@@ -83,6 +83,10 @@ void ec_point_mul(ec_group_t g, ec_point_t r, const ec_point_t x, const bignum_t
     fprintf(stderr, "ERROR: ec_point_mul called with incompatible configuration\n");
 }
 
+void ec_point_mul_gen(ec_group_t g, ec_point_t r, const bignum_t y) {
+    fprintf(stderr, "ERROR: ec_point_mul_gen called with incompatible configuration\n");
+}
+
 size_t ec_point_elem_len(const ec_point_t g) {
     fprintf(stderr, "ERROR: ec_point_elem_len called with incompatible configuration\n");
     return 0;
@@ -11,6 +11,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <pthread.h>
 #include <openabe/zml/zelement.h>
 #include <openabe/utils/zconstants.h>
 
@@ -20,21 +21,33 @@
  * MCL Library Initialization
  ********************************************************************************/
 
+// MCL keeps its curve parameters in process-wide state, so only one curve can
+// be active at a time. Every live BPGroup holds a reference on that curve;
+// switching curves is only allowed once no group of the old curve is left,
+// because reinitializing MCL underneath live elements silently corrupts them.
 static int mcl_initialized = 0;
 static int mcl_current_curve = -1;
+static int mcl_live_groups = 0;
+static pthread_mutex_t mcl_curve_lock = PTHREAD_MUTEX_INITIALIZER;
 
-// Initialize MCL with specific curve (called from bp_group_init)
-int mcl_init_curve(int curve_id) {
+static const char *mcl_curve_name(int curve_id) {
+  return curve_id == MCL_BLS12_381 ? "BLS12-381" :
+         curve_id == MCL_BLS12_377 ? "BLS12-377" :
+         curve_id == MCL_BN254 ? "BN254" : "Unknown";
+}
+
+// Initialize MCL with specific curve; the caller holds mcl_curve_lock
+static int mcl_init_curve_locked(int curve_id) {
   if (mcl_initialized && mcl_current_curve == curve_id) {
     // Already initialized with this curve
     return 0;
   }
 
-  if (mcl_initialized && mcl_current_curve != curve_id) {
-    // Need to switch curves - MCL requires re-initialization
-    fprintf(stderr, "MCL: Switching from curve %d to curve %d\n",
-            mcl_current_curve, curve_id);
-    mcl_initialized = 0;
+  if (mcl_initialized && mcl_live_groups > 0) {
+    fprintf(stderr, "MCL: cannot switch from curve %s to %s while %d group(s) "
+            "are in use\n", mcl_curve_name(mcl_current_curve),
+            mcl_curve_name(curve_id), mcl_live_groups);
+    return -1;
   }
 
   int ret = mclBn_init(curve_id, MCLBN_COMPILED_TIME_VAR);
@@ -45,25 +58,34 @@ int mcl_init_curve(int curve_id) {
 
   mcl_initialized = 1;
   mcl_current_curve = curve_id;
-  fprintf(stderr, "MCL: Initialized curve %d (%s)\n", curve_id,
-          curve_id == MCL_BLS12_381 ? "BLS12-381" :
-          curve_id == MCL_BLS12_377 ? "BLS12-377" :
-          curve_id == MCL_BN254 ? "BN254" : "Unknown");
   return 0;
 }
 
+int mcl_init_curve(int curve_id) {
+  pthread_mutex_lock(&mcl_curve_lock);
+  int ret = mcl_init_curve_locked(curve_id);
+  pthread_mutex_unlock(&mcl_curve_lock);
+  return ret;
+}
+
 void zml_init() {
   // Default initialization with BLS12-381 (for backwards compatibility)
   // Note: bp_group_init will call mcl_init_curve with the actual curve needed
+  pthread_mutex_lock(&mcl_curve_lock);
   if (!mcl_initialized) {
-    mcl_init_curve(MCL_BLS12_381);
+    mcl_init_curve_locked(MCL_BLS12_381);
   }
+  pthread_mutex_unlock(&mcl_curve_lock);
 }
 
 void zml_clean() {
-  // MCL doesn't require explicit cleanup
-  mcl_initialized = 0;
-  mcl_current_curve = -1;
+  // MCL doesn't require explicit cleanup; keep the curve while groups are live
+  pthread_mutex_lock(&mcl_curve_lock);
+  if (mcl_live_groups == 0) {
+    mcl_initialized = 0;
+    mcl_current_curve = -1;
+  }
+  pthread_mutex_unlock(&mcl_curve_lock);
 }
 
 /********************************************************************************
@@ -206,10 +228,15 @@ int bp_group_init(bp_group_t *group, uint8_t id) {
       return -1;
   }
 
-  // Initialize MCL with the requested curve
-  if (mcl_init_curve(mcl_curve_id) != 0) {
+  // Initialize MCL with the requested curve and take a reference on it
+  pthread_mutex_lock(&mcl_curve_lock);
+  if (mcl_init_curve_locked(mcl_curve_id) != 0) {
+    pthread_mutex_unlock(&mcl_curve_lock);
+    *group = NULL;
     return -1;
   }
+  mcl_live_groups++;
+  pthread_mutex_unlock(&mcl_curve_lock);
 
   // Set group to a non-null value (MCL uses global state)
   *group = (void*)0x1;
@@ -217,6 +244,17 @@ int bp_group_init(bp_group_t *group, uint8_t id) {
   return 0;
 }
 
+void bp_group_release(bp_group_t group) {
+  if (group == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&mcl_curve_lock);
+  if (mcl_live_groups > 0) {
+    mcl_live_groups--;
+  }
+  pthread_mutex_unlock(&mcl_curve_lock);
+}
+
 void bp_get_order(bp_group_t group, bignum_t order) {
   // Get the order of the curve (same as Fr field order)
   char order_str[256];
@@ -373,15 +411,19 @@ void gt_mul_op(const bp_group_t group, gt_ptr *z, const gt_ptr *x, const gt_ptr
 }
 
 // FIX Bug #9: gt_ptr is mclBnGT struct, must pass by pointer for output!
+// GT elements are pairing outputs and lie in the cyclotomic subgroup, where
+// mclBnGT_inv is the unitary inverse (Fp12 conjugation) rather than a full
+// Fp12 inversion (mclBnGT_invGeneric).
 void gt_div_op(const bp_group_t group, gt_ptr *z, const gt_ptr *x, const gt_ptr *y) {
   mclBnGT inv;
-  memset(&inv, 0, sizeof(inv));
   mclBnGT_inv(&inv, y);
   mclBnGT_mul(z, x, &inv);
   (void)group;
 }
 
 // FIX Bug #9: gt_ptr is mclBnGT struct, must pass by pointer for output!
+// mclBnGT_pow is the GT-specific exponentiation (GLV decomposition with
+// cyclotomic squarings); mclBnGT_powGeneric is the plain Fp12 ladder.
 void gt_exp_op(const bp_group_t group, gt_ptr *y, const gt_ptr *x, const bignum_t *r) {
   mclBnGT_pow(y, x, r);
   (void)group;
@@ -38,6 +38,7 @@
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <openssl/evp.h>
 #include <openabe/openabe.h>
 
 using namespace std;
@@ -75,6 +76,8 @@ OpenABECurveID OpenABE_convertIntToCurveID(uint8_t curveID) {
     id = OpenABE_NIST_P384_ID;
   } else if (curveID == OpenABE_NIST_P521_ID) {
     id = OpenABE_NIST_P521_ID;
+  } else if (curveID == OpenABE_X25519_ID) {
+    id = OpenABE_X25519_ID;
   } else {
     // Return sentinel value for invalid curve ID
     return OpenABE_NONE_ID;
@@ -224,6 +227,20 @@ G_t OpenABEEllipticCurve::getGenerator() {
   return result;
 }
 
+/*!
+ * Raise the generator of the selected elliptic curve to e. Unlike
+ * getGenerator().exp(e), this goes through the fixed-base table of the
+ * group rather than a variable-base multiplication.
+ *
+ * @param[in] the exponent.
+ * @return group element in G
+ */
+G_t OpenABEEllipticCurve::expGenerator(ZP_t &e) {
+  G_t result(this->ecgroup);
+  ec_point_mul_gen(GET_GROUP(this->ecgroup), result.m_G, e.m_ZP);
+  return result;
+}
+
 /*!
  * Return the order of the selected elliptic curve.
  *
@@ -283,9 +300,81 @@ string OpenABE_convertECCurveIDToString(uint8_t curveID) {
     return "NIST_P384";
   } else if (curveID == OpenABE_NIST_P521_ID) {
     return "NIST_P521";
+  } else if (curveID == OpenABE_X25519_ID) {
+    return OpenABE_X25519_PARAMS;
   } else {
     return "";
   }
 }
 
+/********************************************************************************
+ * X25519 (RFC 7748) key agreement
+ ********************************************************************************/
+
+// X25519 is a Montgomery-form curve with its own constant-time ladder in
+// OpenSSL, so its keys and shares are the raw little-endian strings of the
+// RFC rather than G_t/ZP_t elements.
+
+/*!
+ * Compute the X25519 public key for a private key. Any 32 bytes are a
+ * valid private key (the scalar is clamped by the ladder).
+ *
+ * @param[in]   the 32-byte private key.
+ * @param[out]  the 32-byte public key.
+ * @return  true on success.
+ */
+bool OpenABE_X25519PublicKey(OpenABEByteString &privKey, OpenABEByteString &pubKey) {
+  if (privKey.size() != OpenABE_X25519_KEY_BYTES) {
+    return false;
+  }
+  EVP_PKEY *pkey = EVP_PKEY_new_raw_private_key(EVP_PKEY_X25519, nullptr,
+                                                privKey.data(), privKey.size());
+  if (pkey == nullptr) {
+    return false;
+  }
+  size_t len = OpenABE_X25519_KEY_BYTES;
+  pubKey.fillBuffer(0, len);
+  bool ok = (EVP_PKEY_get_raw_public_key(pkey, pubKey.data(), &len) == 1 &&
+             len == OpenABE_X25519_KEY_BYTES);
+  EVP_PKEY_free(pkey);
+  return ok;
+}
+
+/*!
+ * Compute the X25519 shared secret Z of a private key and a peer's public
+ * key. Fails for a peer key of small order (an all-zero Z, RFC 7748
+ * section 6.1).
+ *
+ * @param[in]   the 32-byte private key.
+ * @param[in]   the peer's 32-byte public key.
+ * @param[out]  the 32-byte shared secret.
+ * @return  true on success.
+ */
+bool OpenABE_X25519SharedSecret(OpenABEByteString &privKey, OpenABEByteString &peerKey,
+                                OpenABEByteString &Z) {
+  if (privKey.size() != OpenABE_X25519_KEY_BYTES ||
+      peerKey.size() != OpenABE_X25519_KEY_BYTES) {
+    return false;
+  }
+  EVP_PKEY *priv = EVP_PKEY_new_raw_private_key(EVP_PKEY_X25519, nullptr,
+                                                privKey.data(), privKey.size());
+  EVP_PKEY *peer = EVP_PKEY_new_raw_public_key(EVP_PKEY_X25519, nullptr,
+                                               peerKey.data(), peerKey.size());
+  EVP_PKEY_CTX *ctx = (priv != nullptr) ? EVP_PKEY_CTX_new(priv, nullptr) : nullptr;
+  size_t len = OpenABE_X25519_KEY_BYTES;
+  Z.fillBuffer(0, len);
+  bool ok = (peer != nullptr && ctx != nullptr &&
+             EVP_PKEY_derive_init(ctx) == 1 &&
+             EVP_PKEY_derive_set_peer(ctx, peer) == 1 &&
+             EVP_PKEY_derive(ctx, Z.data(), &len) == 1 &&
+             len == OpenABE_X25519_KEY_BYTES);
+  if (!ok) {
+    Z.zeroize();
+  }
+  EVP_PKEY_CTX_free(ctx);
+  EVP_PKEY_free(peer);
+  EVP_PKEY_free(priv);
+  return ok;
+}
+
 }
@@ -0,0 +1,801 @@
+/// 
+/// Copyright (c) 2018 Zeutro, LLC. All rights reserved.
+/// 
+/// This file is part of Zeutro's OpenABE.
+/// 
+/// OpenABE is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Affero General Public License as published by
+/// the Free Software Foundation, either version 3 of the License, or
+/// (at your option) any later version.
+/// 
+/// OpenABE is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU Affero General Public License for more details.
+/// 
+/// You should have received a copy of the GNU Affero General Public
+/// License along with OpenABE. If not, see <http://www.gnu.org/licenses/>.
+/// 
+/// You can be released from the requirements of the GNU Affero General
+/// Public License and obtain additional features by purchasing a
+/// commercial license. Buying such a license is mandatory if you
+/// engage in commercial activities involving OpenABE that do not
+/// comply with the open source requirements of the GNU Affero General
+/// Public License. For more information on commerical licenses,
+/// visit <http://www.zeutro.com>.
+///
+/// \file   zfixedbase.cpp
+///
+/// \brief  Implementation of fixed-base exponentiation tables.
+///
+/// \author J. Ayo Akinyele
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <memory>
+#include <stddef.h>
+#include <string>
+#include <openabe/openabe.h>
+#include <openssl/evp.h>
+#include <openssl/crypto.h>
+
+using namespace std;
+
+#if defined(BP_WITH_MCL)
+
+static inline void mcl_add(mclBnG1 *z, const mclBnG1 *x, const mclBnG1 *y) { mclBnG1_add(z, x, y); }
+static inline void mcl_add(mclBnG2 *z, const mclBnG2 *x, const mclBnG2 *y) { mclBnG2_add(z, x, y); }
+static inline void mcl_clear(mclBnG1 *x) { mclBnG1_clear(x); }
+static inline void mcl_clear(mclBnG2 *x) { mclBnG2_clear(x); }
+static inline void mcl_normalize(mclBnG1 *x) { mclBnG1_normalize(x, x); }
+static inline void mcl_normalize(mclBnG2 *x) { mclBnG2_normalize(x, x); }
+
+/*!
+ * Fill a window table for the given base. Entry (j, d) holds
+ * d * 2^(w*j) * base; entry (j, 0) is the point at infinity.
+ */
+template <typename P, typename A>
+static void fixed_base_build(vector<P, A> &table, size_t numWindows, const P &base) {
+  table.resize(numWindows * FIXED_BASE_WINDOW_SIZE);
+  P step = base;
+  for (size_t j = 0; j < numWindows; j++) {
+    P *row = &table[j * FIXED_BASE_WINDOW_SIZE];
+    mcl_clear(&row[0]);
+    row[1] = step;
+    for (size_t d = 2; d < FIXED_BASE_WINDOW_SIZE; d++) {
+      mcl_add(&row[d], &row[d-1], &step);
+    }
+    // step = 2^w * step
+    mcl_add(&step, &row[FIXED_BASE_WINDOW_SIZE-1], &step);
+    // affine entries let the exponentiation use mixed additions
+    for (size_t d = 1; d < FIXED_BASE_WINDOW_SIZE; d++) {
+      mcl_normalize(&row[d]);
+    }
+  }
+}
+
+/*!
+ * Select row[digit] by scanning the whole row, so that the memory access
+ * pattern does not depend on the (secret) exponent.
+ */
+template <typename P>
+static void fixed_base_select_n(P &out, const P *row, size_t n, uint8_t digit) {
+  const size_t words = sizeof(P) / sizeof(uint64_t);
+  uint64_t *dst = reinterpret_cast<uint64_t *>(&out);
+  memset(dst, 0, sizeof(P));
+  for (uint32_t d = 0; d < n; d++) {
+    // all ones iff d == digit
+    uint64_t mask = (uint64_t)0 - (uint64_t)(((d ^ digit) - 1) >> 31);
+    const uint64_t *src = reinterpret_cast<const uint64_t *>(&row[d]);
+    for (size_t i = 0; i < words; i++) {
+      dst[i] |= (src[i] & mask);
+    }
+  }
+}
+
+template <typename P>
+static void fixed_base_exp(P &result, const P *table, size_t numWindows,
+                           const mclBnFr *z) {
+  uint8_t buf[MAX_BUFFER_SIZE];
+  size_t len = mclBnFr_getLittleEndian(buf, sizeof(buf), z);
+  if (len == 0 || len * 8 > numWindows * FIXED_BASE_WINDOW_BITS) {
+    throw oabe::OpenABE_ERROR_INVALID_INPUT;
+  }
+  memset(buf + len, 0, sizeof(buf) - len);
+
+  P term;
+  mcl_clear(&result);
+  for (size_t j = 0; j < numWindows; j++) {
+    uint8_t digit = (buf[(j * FIXED_BASE_WINDOW_BITS) / 8] >>
+                     ((j * FIXED_BASE_WINDOW_BITS) % 8)) & (FIXED_BASE_WINDOW_SIZE - 1);
+    fixed_base_select_n(term, &table[j * FIXED_BASE_WINDOW_SIZE],
+                        FIXED_BASE_WINDOW_SIZE, digit);
+    mcl_add(&result, &result, &term);
+  }
+  memset(buf, 0, sizeof(buf));
+}
+
+static size_t fixed_base_windows() {
+  size_t bits = mclBn_getFrByteSize() * 8;
+  return (bits + FIXED_BASE_WINDOW_BITS - 1) / FIXED_BASE_WINDOW_BITS;
+}
+
+/*!
+ * Number of signed GT windows; one extra bit absorbs the final carry.
+ */
+static size_t fixed_base_gt_windows() {
+  size_t bits = mclBn_getFrByteSize() * 8 + 1;
+  return (bits + FIXED_BASE_GT_WINDOW_BITS - 1) / FIXED_BASE_GT_WINDOW_BITS;
+}
+
+/*!
+ * Fill the GT table. Entry (j, d) holds base^(d * 32^j) for d in [0, 16].
+ */
+static void fixed_base_gt_build(oabe::OpenABEPrecomputeVector<mclBnGT> &table,
+                                size_t numWindows, const mclBnGT &base) {
+  table.resize(numWindows * FIXED_BASE_GT_TABLE_SIZE);
+  mclBnGT step = base;
+  for (size_t j = 0; j < numWindows; j++) {
+    mclBnGT *row = &table[j * FIXED_BASE_GT_TABLE_SIZE];
+    mclBnGT_setInt(&row[0], 1);
+    row[1] = step;
+    for (size_t d = 2; d < FIXED_BASE_GT_TABLE_SIZE; d++) {
+      mclBnGT_mul(&row[d], &row[d-1], &step);
+    }
+    // step = step^32 = (step^16)^2
+    mclBnGT_sqr(&step, &row[FIXED_BASE_GT_TABLE_SIZE-1]);
+  }
+}
+
+static void fixed_base_gt_exp(mclBnGT &result, const mclBnGT *table,
+                              size_t numWindows, const mclBnFr *z) {
+  uint8_t buf[MAX_BUFFER_SIZE];
+  size_t len = mclBnFr_getLittleEndian(buf, sizeof(buf), z);
+  if (len == 0 || len * 8 >= numWindows * FIXED_BASE_GT_WINDOW_BITS) {
+    throw oabe::OpenABE_ERROR_INVALID_INPUT;
+  }
+  memset(buf + len, 0, sizeof(buf) - len);
+
+  const size_t words = sizeof(mclBnGT) / sizeof(uint64_t);
+  mclBnGT term, conj;
+  uint32_t carry = 0;
+  mclBnGT_setInt(&result, 1);
+  for (size_t j = 0; j < numWindows; j++) {
+    size_t bit = j * FIXED_BASE_GT_WINDOW_BITS;
+    uint32_t v = (((uint32_t)buf[bit / 8] | ((uint32_t)buf[bit / 8 + 1] << 8)) >> (bit % 8)) & 0x1F;
+    v += carry;
+    // recode v in [0, 32] into a signed digit in [-16, 15]
+    carry = (v + 16) >> FIXED_BASE_GT_WINDOW_BITS;
+    int32_t digit = (int32_t)v - (int32_t)(carry << FIXED_BASE_GT_WINDOW_BITS);
+    uint32_t neg = (uint32_t)(digit >> 31);
+    uint8_t index = (uint8_t)((digit ^ (int32_t)neg) - (int32_t)neg);
+
+    fixed_base_select_n(term, &table[j * FIXED_BASE_GT_TABLE_SIZE],
+                        FIXED_BASE_GT_TABLE_SIZE, index);
+    // conditionally replace term by its inverse (conjugate)
+    mclBnGT_inv(&conj, &term);
+    uint64_t mask = (uint64_t)0 - (uint64_t)(neg & 1);
+    uint64_t *t = reinterpret_cast<uint64_t *>(&term);
+    const uint64_t *c = reinterpret_cast<const uint64_t *>(&conj);
+    for (size_t i = 0; i < words; i++) {
+      t[i] = (t[i] & ~mask) | (c[i] & mask);
+    }
+    mclBnGT_mul(&result, &result, &term);
+  }
+  memset(buf, 0, sizeof(buf));
+}
+
+
+/********************************************************************************
+ * Fixed-base snapshots
+ ********************************************************************************/
+
+#define FIXED_BASE_SNAPSHOT_G1      1
+#define FIXED_BASE_SNAPSHOT_G2      2
+#define FIXED_BASE_SNAPSHOT_GT      3
+#define FIXED_BASE_SNAPSHOT_LINES   4
+// tables start on a cache line
+#define FIXED_BASE_SNAPSHOT_ALIGN   64
+
+static const char FIXED_BASE_SNAPSHOT_MAGIC[8] = { 'O', 'A', 'B', 'E', 'F', 'B', 'S', '2' };
+
+// everything a table's layout depends on; a snapshot is only used by a
+// build that agrees on all of it
+struct FixedBaseSnapshotHeader {
+  char magic[8];
+  uint32_t byteOrder;
+  uint32_t unitSize;
+  uint32_t fpSize;
+  uint32_t frSize;
+  uint32_t g1Size;
+  uint32_t g2Size;
+  uint32_t gtSize;
+  uint32_t windowBits;
+  uint32_t gtWindowBits;
+  uint32_t count;
+  uint64_t fieldOrder;
+  uint64_t payloadOffset;
+  uint64_t payloadLen;
+  // of the whole snapshot, with this field zeroed
+  uint8_t digest[SHA256_LEN];
+};
+
+struct FixedBaseSnapshotEntry {
+  uint32_t type;
+  uint32_t baseLen;
+  uint64_t baseOffset;
+  uint64_t tableOffset;
+  uint64_t tableSize;
+  // HMAC-SHA256 of the type, sizes, base and table (zero without a MAC key)
+  uint8_t tag[SHA256_LEN];
+};
+
+static void fixed_base_snapshot_header(FixedBaseSnapshotHeader &hdr) {
+  char order[MAX_BUFFER_SIZE];
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, FIXED_BASE_SNAPSHOT_MAGIC, sizeof(hdr.magic));
+  hdr.byteOrder = 0x01020304;
+  hdr.unitSize = mclBn_getOpUnitSize();
+  hdr.fpSize = mclBn_getFpByteSize();
+  hdr.frSize = mclBn_getFrByteSize();
+  hdr.g1Size = sizeof(mclBnG1);
+  hdr.g2Size = sizeof(mclBnG2);
+  hdr.gtSize = sizeof(mclBnGT);
+  hdr.windowBits = FIXED_BASE_WINDOW_BITS;
+  hdr.gtWindowBits = FIXED_BASE_GT_WINDOW_BITS;
+  // FNV-1a of the field order tells the curves apart
+  size_t len = mclBn_getFieldOrder(order, sizeof(order));
+  hdr.fieldOrder = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < len; i++) {
+    hdr.fieldOrder = (hdr.fieldOrder ^ (uint8_t)order[i]) * 0x100000001b3ULL;
+  }
+}
+
+static inline size_t mcl_serialize(uint8_t *buf, size_t n, const mclBnG1 *x) { return mclBnG1_serialize(buf, n, x); }
+static inline size_t mcl_serialize(uint8_t *buf, size_t n, const mclBnG2 *x) { return mclBnG2_serialize(buf, n, x); }
+static inline size_t mcl_serialize(uint8_t *buf, size_t n, const mclBnGT *x) { return mclBnGT_serialize(buf, n, x); }
+static inline size_t mcl_deserialize(mclBnG1 *x, const uint8_t *buf, size_t n) { return mclBnG1_deserialize(x, buf, n); }
+static inline size_t mcl_deserialize(mclBnG2 *x, const uint8_t *buf, size_t n) { return mclBnG2_deserialize(x, buf, n); }
+static inline size_t mcl_deserialize(mclBnGT *x, const uint8_t *buf, size_t n) { return mclBnGT_deserialize(x, buf, n); }
+static inline bool mcl_equal(const mclBnG1 *x, const mclBnG1 *y) { return mclBnG1_isEqual(x, y) == 1; }
+static inline bool mcl_equal(const mclBnG2 *x, const mclBnG2 *y) { return mclBnG2_isEqual(x, y) == 1; }
+static inline bool mcl_equal(const mclBnGT *x, const mclBnGT *y) { return mclBnGT_isEqual(x, y) == 1; }
+
+template <typename P>
+static bool fixed_base_snapshot_key(string &key, uint32_t type, const P &base) {
+  uint8_t buf[MAX_BUFFER_SIZE];
+  size_t len = mcl_serialize(buf, sizeof(buf), &base);
+  if (len == 0) {
+    return false;
+  }
+  key.assign(1, (char)type);
+  key.append((const char *)buf, len);
+  return true;
+}
+
+/*!
+ * The table of the attachment for this base, or nullptr.
+ */
+template <typename P>
+static const void *fixed_base_attached(const oabe::OpenABEAttachedTables &attached,
+                                       uint32_t type, const P &base) {
+  string key;
+  if (!attached || !fixed_base_snapshot_key(key, type, base)) {
+    return nullptr;
+  }
+  return attached->find(key);
+}
+
+static size_t fixed_base_snapshot_size(uint32_t type) {
+  switch (type) {
+    case FIXED_BASE_SNAPSHOT_GT:
+      return fixed_base_gt_windows() * FIXED_BASE_GT_TABLE_SIZE;
+    case FIXED_BASE_SNAPSHOT_LINES:
+      return mclBn_getUint64NumToPrecompute();
+    default:
+      return fixed_base_windows() * FIXED_BASE_WINDOW_SIZE;
+  }
+}
+
+/*!
+ * HMAC-SHA256 under the MAC key of the SHA-256 of an entry's type and
+ * sizes, its base and its table.
+ */
+static void fixed_base_snapshot_tag(uint8_t *tag, const FixedBaseSnapshotEntry &entry,
+                                    const uint8_t *base, const uint8_t *table,
+                                    size_t tableBytes, const oabe::OpenABEByteString &macKey) {
+  uint8_t digest[SHA256_LEN];
+  unsigned int tagLen = SHA256_LEN;
+  EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+  if (ctx == nullptr ||
+      EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr) != 1 ||
+      EVP_DigestUpdate(ctx, &entry.type, sizeof(entry.type)) != 1 ||
+      EVP_DigestUpdate(ctx, &entry.baseLen, sizeof(entry.baseLen)) != 1 ||
+      EVP_DigestUpdate(ctx, &entry.tableSize, sizeof(entry.tableSize)) != 1 ||
+      EVP_DigestUpdate(ctx, base, entry.baseLen) != 1 ||
+      EVP_DigestUpdate(ctx, table, tableBytes) != 1 ||
+      EVP_DigestFinal_ex(ctx, digest, nullptr) != 1) {
+    EVP_MD_CTX_free(ctx);
+    throw oabe::OpenABE_ERROR_UNKNOWN;
+  }
+  EVP_MD_CTX_free(ctx);
+  if (HMAC(EVP_sha256(), macKey.data(), (int)macKey.size(), digest, sizeof(digest),
+           tag, &tagLen) == nullptr || tagLen != SHA256_LEN) {
+    throw oabe::OpenABE_ERROR_UNKNOWN;
+  }
+}
+
+template <typename P, typename E>
+static void fixed_base_snapshot_add(vector<FixedBaseSnapshotEntry> &entries,
+                                    string &data, uint32_t type, const P &base,
+                                    const E *table, size_t tableSize, size_t dataOffset,
+                                    const oabe::OpenABEByteString *macKey) {
+  uint8_t buf[MAX_BUFFER_SIZE];
+  FixedBaseSnapshotEntry entry;
+  size_t len = mcl_serialize(buf, sizeof(buf), &base);
+  if (len == 0) {
+    throw oabe::OpenABE_ERROR_SERIALIZATION_FAILED;
+  }
+  memset(&entry, 0, sizeof(entry));
+  entry.type = type;
+  entry.baseLen = len;
+  entry.baseOffset = dataOffset + data.size();
+  data.append((const char *)buf, len);
+  data.append((FIXED_BASE_SNAPSHOT_ALIGN - (dataOffset + data.size()) % FIXED_BASE_SNAPSHOT_ALIGN) %
+              FIXED_BASE_SNAPSHOT_ALIGN, '\0');
+  entry.tableOffset = dataOffset + data.size();
+  entry.tableSize = tableSize;
+  data.append((const char *)table, tableSize * sizeof(E));
+  if (macKey != nullptr) {
+    fixed_base_snapshot_tag(entry.tag, entry, buf, (const uint8_t *)table,
+                            tableSize * sizeof(E), *macKey);
+  }
+  entries.push_back(entry);
+}
+
+/*!
+ * Check an entry against the snapshot bounds, decode its base and, with a
+ * MAC key, check its tag. Without one the caller recomputes the table.
+ */
+template <typename P, typename E>
+static bool fixed_base_snapshot_check(const FixedBaseSnapshotEntry &entry,
+                                      const uint8_t *snapshot, size_t len,
+                                      const oabe::OpenABEByteString *macKey, P &base) {
+  if (entry.baseLen == 0 || entry.baseLen > MAX_BUFFER_SIZE ||
+      entry.baseOffset > len || entry.baseLen > len - entry.baseOffset ||
+      entry.tableSize != fixed_base_snapshot_size(entry.type) ||
+      entry.tableOffset % sizeof(uint64_t) != 0 || entry.tableOffset > len ||
+      entry.tableSize * sizeof(E) > len - entry.tableOffset) {
+    return false;
+  }
+  if (mcl_deserialize(&base, snapshot + entry.baseOffset, entry.baseLen) != entry.baseLen) {
+    return false;
+  }
+  if (macKey == nullptr) {
+    return true;
+  }
+  uint8_t tag[SHA256_LEN];
+  fixed_base_snapshot_tag(tag, entry, snapshot + entry.baseOffset, snapshot + entry.tableOffset,
+                          entry.tableSize * sizeof(E), *macKey);
+  return CRYPTO_memcmp(tag, entry.tag, sizeof(tag)) == 0;
+}
+
+/*!
+ * True iff the table is the one built for the base, entry for entry.
+ */
+template <typename P>
+static bool fixed_base_snapshot_recompute(const P &base, const uint8_t *table) {
+  oabe::OpenABEPrecomputeVector<P> expected;
+  fixed_base_build(expected, fixed_base_windows(), base);
+  return memcmp(table, expected.data(), expected.size() * sizeof(P)) == 0;
+}
+
+static bool fixed_base_snapshot_recompute(const mclBnGT &base, const uint8_t *table) {
+  oabe::OpenABEPrecomputeVector<mclBnGT> expected;
+  fixed_base_gt_build(expected, fixed_base_gt_windows(), base);
+  return memcmp(table, expected.data(), expected.size() * sizeof(mclBnGT)) == 0;
+}
+
+static bool fixed_base_snapshot_recompute_lines(const mclBnG2 &base, const uint8_t *table) {
+  oabe::OpenABEPrecomputeVector<uint64_t> expected(mclBn_getUint64NumToPrecompute());
+  mclBn_precomputeG2(expected.data(), &base);
+  bool equal = memcmp(table, expected.data(), expected.size() * sizeof(uint64_t)) == 0;
+  // the lines of a user key are as sensitive as the key
+  oabe::OpenABEZeroize(expected.data(), expected.size() * sizeof(uint64_t));
+  return equal;
+}
+
+static void fixed_base_snapshot_digest(uint8_t *digest, const uint8_t *snapshot, size_t len) {
+  FixedBaseSnapshotHeader hdr;
+  memcpy(&hdr, snapshot, sizeof(hdr));
+  memset(hdr.digest, 0, sizeof(hdr.digest));
+  EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+  if (ctx == nullptr ||
+      EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr) != 1 ||
+      EVP_DigestUpdate(ctx, &hdr, sizeof(hdr)) != 1 ||
+      EVP_DigestUpdate(ctx, snapshot + sizeof(hdr), len - sizeof(hdr)) != 1 ||
+      EVP_DigestFinal_ex(ctx, digest, nullptr) != 1) {
+    EVP_MD_CTX_free(ctx);
+    throw oabe::OpenABE_ERROR_UNKNOWN;
+  }
+  EVP_MD_CTX_free(ctx);
+}
+
+#endif
+
+namespace oabe {
+
+/********************************************************************************
+ * Implementation of the G1FixedBase class
+ ********************************************************************************/
+
+/*!
+ * Build the window table for a G1 base element.
+ *
+ * @param[in]   - the fixed base.
+ * @param[in]   - optional: the attachment to take the table from.
+ */
+G1FixedBase::G1FixedBase(const G1& base, const OpenABEAttachedTables &attached) : base_(base) {
+#if defined(BP_WITH_MCL)
+  numWindows_ = fixed_base_windows();
+  entries_ = static_cast<const g1_ptr *>(fixed_base_attached(attached, FIXED_BASE_SNAPSHOT_G1, base_.m_G1));
+  if (entries_ == nullptr) {
+    fixed_base_build(table_, numWindows_, base_.m_G1);
+    entries_ = table_.data();
+  } else {
+    attached_ = attached;
+  }
+#endif
+}
+
+G1FixedBase::~G1FixedBase() {}
+
+/*!
+ * Compute base^z using the precomputed table.
+ *
+ * @param[in]   - the exponent.
+ * @return      - a new G1 element.
+ */
+G1 G1FixedBase::exp(const ZP& z) const {
+#if defined(BP_WITH_MCL)
+  OpenABE_countMetric(OpenABE_METRIC_FIXED_BASE_EXP);
+  G1 result(base_.bgroup);
+  fixed_base_exp(result.m_G1, entries_, numWindows_, &z.m_ZP);
+  return result;
+#else
+  G1 b = base_;
+  return b.exp(z);
+#endif
+}
+
+size_t G1FixedBase::getMemoryUsage() const {
+#if defined(BP_WITH_MCL)
+  return this->table_.size() * sizeof(g1_ptr);
+#else
+  return 0;
+#endif
+}
+
+/********************************************************************************
+ * Implementation of the G2FixedBase class
+ ********************************************************************************/
+
+/*!
+ * Build the window table for a G2 base element.
+ *
+ * @param[in]   - the fixed base.
+ * @param[in]   - optional: the attachment to take the table from.
+ */
+G2FixedBase::G2FixedBase(const G2& base, const OpenABEAttachedTables &attached) : base_(base) {
+#if defined(BP_WITH_MCL)
+  numWindows_ = fixed_base_windows();
+  entries_ = static_cast<const g2_ptr *>(fixed_base_attached(attached, FIXED_BASE_SNAPSHOT_G2, base_.m_G2));
+  if (entries_ == nullptr) {
+    fixed_base_build(table_, numWindows_, base_.m_G2);
+    entries_ = table_.data();
+  } else {
+    attached_ = attached;
+  }
+#endif
+}
+
+G2FixedBase::~G2FixedBase() {}
+
+/*!
+ * Compute base^z using the precomputed table.
+ *
+ * @param[in]   - the exponent.
+ * @return      - a new G2 element.
+ */
+G2 G2FixedBase::exp(const ZP& z) const {
+#if defined(BP_WITH_MCL)
+  OpenABE_countMetric(OpenABE_METRIC_FIXED_BASE_EXP);
+  G2 result(base_.bgroup);
+  fixed_base_exp(result.m_G2, entries_, numWindows_, &z.m_ZP);
+  return result;
+#else
+  G2 b = base_;
+  return b.exp(z);
+#endif
+}
+
+size_t G2FixedBase::getMemoryUsage() const {
+#if defined(BP_WITH_MCL)
+  return this->table_.size() * sizeof(g2_ptr);
+#else
+  return 0;
+#endif
+}
+
+/********************************************************************************
+ * Implementation of the GTFixedBase class
+ ********************************************************************************/
+
+/*!
+ * Build the signed window table for a GT base element.
+ *
+ * @param[in]   - the fixed base (must be an element of GT).
+ * @param[in]   - optional: the attachment to take the table from.
+ */
+GTFixedBase::GTFixedBase(const GT& base, const OpenABEAttachedTables &attached) : base_(base) {
+#if defined(BP_WITH_MCL)
+  numWindows_ = fixed_base_gt_windows();
+  entries_ = static_cast<const gt_ptr *>(fixed_base_attached(attached, FIXED_BASE_SNAPSHOT_GT, base_.m_GT));
+  if (entries_ == nullptr) {
+    fixed_base_gt_build(table_, numWindows_, base_.m_GT);
+    entries_ = table_.data();
+  } else {
+    attached_ = attached;
+  }
+#endif
+}
+
+GTFixedBase::~GTFixedBase() {}
+
+/*!
+ * Compute base^z using the precomputed table.
+ *
+ * @param[in]   - the exponent.
+ * @return      - a new GT element.
+ */
+GT GTFixedBase::exp(const ZP& z) const {
+#if defined(BP_WITH_MCL)
+  OpenABE_countMetric(OpenABE_METRIC_FIXED_BASE_EXP);
+  GT result(base_);
+  fixed_base_gt_exp(result.m_GT, entries_, numWindows_, &z.m_ZP);
+  return result;
+#else
+  GT b = base_;
+  return b.exp(z);
+#endif
+}
+
+size_t GTFixedBase::getMemoryUsage() const {
+#if defined(BP_WITH_MCL)
+  return this->table_.size() * sizeof(gt_ptr);
+#else
+  return 0;
+#endif
+}
+
+/********************************************************************************
+ * Implementation of the G2LineTable class
+ ********************************************************************************/
+
+/*!
+ * Precompute the Miller-loop lines of a fixed G2 element.
+ *
+ * @param[in]   - the fixed element (must be an element of G2).
+ * @param[in]   - optional: the attachment to take the lines from.
+ */
+G2LineTable::G2LineTable(const G2& q, const OpenABEAttachedTables &attached) : q_(q) {
+#if defined(BP_WITH_MCL)
+  entries_ = static_cast<const uint64_t *>(fixed_base_attached(attached, FIXED_BASE_SNAPSHOT_LINES, q_.m_G2));
+  if (entries_ == nullptr) {
+    lines_.resize(mclBn_getUint64NumToPrecompute());
+    mclBn_precomputeG2(lines_.data(), &q_.m_G2);
+    entries_ = lines_.data();
+  } else {
+    attached_ = attached;
+  }
+#endif
+}
+
+G2LineTable::~G2LineTable() {
+#if defined(BP_WITH_MCL)
+  OpenABEZeroize(lines_.data(), lines_.size() * sizeof(uint64_t));
+  mclBnG2_clear(&q_.m_G2);
+#endif
+}
+
+size_t G2LineTable::getMemoryUsage() const {
+#if defined(BP_WITH_MCL)
+  return this->lines_.size() * sizeof(uint64_t);
+#else
+  return 0;
+#endif
+}
+
+#if defined(BP_WITH_MCL)
+size_t G2LineTable::getLinesSize() const {
+  return mclBn_getUint64NumToPrecompute();
+}
+#endif
+
+/********************************************************************************
+ * Implementation of the OpenABEFixedBaseSnapshot class
+ ********************************************************************************/
+
+/*!
+ * Write the header, the entry directory, the payload and then each base
+ * with its table (aligned), all offsets relative to the start.
+ *
+ * @param[out]  the snapshot.
+ * @param[in]   optional: the key to tag each table with.
+ */
+void OpenABEFixedBaseSnapshot::serialize(string &out, const OpenABEByteString *macKey) const {
+#if defined(BP_WITH_MCL)
+  FixedBaseSnapshotHeader hdr;
+  vector<FixedBaseSnapshotEntry> entries;
+  string data;
+  size_t count = this->g1_.size() + this->g2_.size() + this->gt_.size() + this->lines_.size();
+  size_t dataOffset = sizeof(hdr) + count * sizeof(FixedBaseSnapshotEntry);
+
+  fixed_base_snapshot_header(hdr);
+  hdr.count = count;
+  hdr.payloadOffset = dataOffset;
+  hdr.payloadLen = this->payload_.size();
+  data = this->payload_;
+  for (auto t : this->g1_) {
+    fixed_base_snapshot_add(entries, data, FIXED_BASE_SNAPSHOT_G1, t->getBase().m_G1,
+                            t->getTable(), t->getTableSize(), dataOffset, macKey);
+  }
+  for (auto t : this->g2_) {
+    fixed_base_snapshot_add(entries, data, FIXED_BASE_SNAPSHOT_G2, t->getBase().m_G2,
+                            t->getTable(), t->getTableSize(), dataOffset, macKey);
+  }
+  for (auto t : this->gt_) {
+    fixed_base_snapshot_add(entries, data, FIXED_BASE_SNAPSHOT_GT, t->getBase().m_GT,
+                            t->getTable(), t->getTableSize(), dataOffset, macKey);
+  }
+  for (auto t : this->lines_) {
+    fixed_base_snapshot_add(entries, data, FIXED_BASE_SNAPSHOT_LINES, t->getElement().m_G2,
+                            t->getLines(), t->getLinesSize(), dataOffset, macKey);
+  }
+
+  out.clear();
+  out.reserve(dataOffset + data.size());
+  out.append((const char *)&hdr, sizeof(hdr));
+  if (!entries.empty()) {
+    out.append((const char *)entries.data(), entries.size() * sizeof(FixedBaseSnapshotEntry));
+  }
+  out += data;
+  fixed_base_snapshot_digest(hdr.digest, (const uint8_t *)out.data(), out.size());
+  memcpy(&out[offsetof(FixedBaseSnapshotHeader, digest)], hdr.digest, sizeof(hdr.digest));
+#else
+  throw OpenABE_ERROR_NOT_IMPLEMENTED;
+#endif
+}
+
+/*!
+ * Validate a snapshot and each of its tables, and collect them in an
+ * attachment for the keys loaded from its payload. Nothing is attached
+ * unless every entry checks out.
+ *
+ * @param[in]   the snapshot (see OpenABEFixedBaseSnapshot).
+ * @param[in]   its length.
+ * @param[out]  the tables of the snapshot.
+ * @param[out]  optional: where the payload starts.
+ * @param[out]  optional: the payload length.
+ * @param[in]   optional: the key the tables were tagged with.
+ * @param[in]   optional: the owner of the snapshot memory, held by the attachment.
+ * @return      An error code or OpenABE_NOERROR.
+ */
+OpenABE_ERROR OpenABE_attachFixedBaseSnapshot(const uint8_t *snapshot, size_t len,
+                                              OpenABEAttachedTables &attached,
+                                              const uint8_t **payload, size_t *payloadLen,
+                                              const OpenABEByteString *macKey,
+                                              const shared_ptr<const void> &memory) {
+#if defined(BP_WITH_MCL)
+  FixedBaseSnapshotHeader hdr, expected;
+  if (snapshot == nullptr || len < sizeof(hdr)) {
+    return OpenABE_ERROR_INVALID_LENGTH;
+  }
+  memcpy(&hdr, snapshot, sizeof(hdr));
+  fixed_base_snapshot_header(expected);
+  if (memcmp(hdr.magic, expected.magic, sizeof(hdr.magic)) != 0) {
+    return OpenABE_ERROR_INVALID_INPUT;
+  }
+  if (hdr.byteOrder != expected.byteOrder || hdr.unitSize != expected.unitSize ||
+      hdr.fpSize != expected.fpSize || hdr.frSize != expected.frSize ||
+      hdr.g1Size != expected.g1Size || hdr.g2Size != expected.g2Size ||
+      hdr.gtSize != expected.gtSize || hdr.windowBits != expected.windowBits ||
+      hdr.gtWindowBits != expected.gtWindowBits ||
+      hdr.fieldOrder != expected.fieldOrder) {
+    return OpenABE_ERROR_INVALID_LIBVERSION;
+  }
+  if (hdr.count > (len - sizeof(hdr)) / sizeof(FixedBaseSnapshotEntry) ||
+      hdr.payloadOffset > len || hdr.payloadLen > len - hdr.payloadOffset) {
+    return OpenABE_ERROR_INVALID_LENGTH;
+  }
+  if (macKey != nullptr && macKey->size() == 0) {
+    macKey = nullptr;
+  }
+
+  shared_ptr<OpenABEFixedBaseAttachment> result(new OpenABEFixedBaseAttachment());
+  // tables are read in place, which needs the alignment of their limbs
+  if ((uintptr_t)snapshot % sizeof(uint64_t) != 0) {
+    result->copy_.reset(new uint64_t[(len + sizeof(uint64_t) - 1) / sizeof(uint64_t)]);
+    memcpy(result->copy_.get(), snapshot, len);
+    snapshot = reinterpret_cast<const uint8_t *>(result->copy_.get());
+  }
+
+  uint8_t digest[SHA256_LEN];
+  fixed_base_snapshot_digest(digest, snapshot, len);
+  if (memcmp(digest, hdr.digest, sizeof(digest)) != 0) {
+    return OpenABE_ERROR_INVALID_INPUT;
+  }
+
+  vector<FixedBaseSnapshotEntry> entries(hdr.count);
+  if (hdr.count > 0) {
+    memcpy(entries.data(), snapshot + sizeof(hdr), hdr.count * sizeof(FixedBaseSnapshotEntry));
+  }
+  for (auto &entry : entries) {
+    const uint8_t *table = snapshot + entry.tableOffset;
+    bool valid = false;
+    switch (entry.type) {
+      case FIXED_BASE_SNAPSHOT_G1: {
+        mclBnG1 base;
+        valid = fixed_base_snapshot_check<mclBnG1, mclBnG1>(entry, snapshot, len, macKey, base) &&
+                (macKey != nullptr || fixed_base_snapshot_recompute(base, table));
+        break;
+      }
+      case FIXED_BASE_SNAPSHOT_G2: {
+        mclBnG2 base;
+        valid = fixed_base_snapshot_check<mclBnG2, mclBnG2>(entry, snapshot, len, macKey, base) &&
+                (macKey != nullptr || fixed_base_snapshot_recompute(base, table));
+        break;
+      }
+      case FIXED_BASE_SNAPSHOT_GT: {
+        mclBnGT base;
+        valid = fixed_base_snapshot_check<mclBnGT, mclBnGT>(entry, snapshot, len, macKey, base) &&
+                (macKey != nullptr || fixed_base_snapshot_recompute(base, table));
+        break;
+      }
+      case FIXED_BASE_SNAPSHOT_LINES: {
+        mclBnG2 base;
+        valid = fixed_base_snapshot_check<mclBnG2, uint64_t>(entry, snapshot, len, macKey, base) &&
+                (macKey != nullptr || fixed_base_snapshot_recompute_lines(base, table));
+        mclBnG2_clear(&base);
+        break;
+      }
+    }
+    if (!valid) {
+      return OpenABE_ERROR_INVALID_INPUT;
+    }
+  }
+
+  for (auto &entry : entries) {
+    string key(1, (char)entry.type);
+    key.append((const char *)snapshot + entry.baseOffset, entry.baseLen);
+    // a base that appears twice keeps its first table
+    result->tables_.insert(make_pair(key, snapshot + entry.tableOffset));
+  }
+  result->memory_ = memory;
+  attached = result;
+  if (payload != nullptr) {
+    *payload = snapshot + hdr.payloadOffset;
+  }
+  if (payloadLen != nullptr) {
+    *payloadLen = hdr.payloadLen;
+  }
+  return OpenABE_NOERROR;
+#else
+  return OpenABE_ERROR_NOT_IMPLEMENTED;
+#endif
+}
+
+}
@@ -39,6 +39,7 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <openssl/evp.h>
 #include <openabe/openabe.h>
 
 extern "C" {
@@ -121,8 +122,8 @@ OpenABEPairing::OpenABEPairing(const string &pairingParams) : ZObject()
   // Look up the pairing parameters and set them
   this->pairingParams = pairingParams;  // Store the pairing parameters string
   this->curveID = getPairingCurveID(pairingParams);
-  fprintf(stderr, "DEBUG OpenABEPairing constructor: pairingParams='%s', curveID=%d\n",
-          pairingParams.c_str(), this->curveID);
+  OpenABE_TRACE_DEBUG("OpenABEPairing: pairingParams='%s', curveID=%d",
+                      pairingParams.c_str(), this->curveID);
 
   this->bpgroup  = make_shared<BPGroup>(this->curveID);
   zml_bignum_init(&this->order);
@@ -263,6 +264,7 @@ OpenABEPairing::hashToG1(OpenABEByteString& keyPrefix, string msg)
   tmp += msg;
   // hash the message to G1
   // (note that g1_map first hashes to ZP, then to G1)
+  OpenABE_countMetric(OpenABE_METRIC_HASH_TO_G1);
   G1 g1(this->bpgroup);
   std::string digest, str = tmp.toString();
   oabe::sha256(digest, str);
@@ -277,9 +279,79 @@ OpenABEPairing::hashToG1(OpenABEByteString& keyPrefix, string msg)
   return g1;
 }
 
+/*!
+ * Hash many messages to G1 under the same key prefix; entry i equals
+ * hashToG1(keyPrefix, msgs[i]). The prefix goes through SHA-256 once and
+ * each message continues from a copy of that state. Large batches are
+ * mapped to the curve on the thread pool, and the points are then brought
+ * to affine coordinates together, with a single field inversion, so that
+ * later additions and tables built from them take the cheaper mixed form.
+ *
+ * @param[in]   the hash key prefix.
+ * @param[in]   the messages.
+ * @param[in]   the most threads to use (0 = the whole pool).
+ * @return  the hashed G1 elements, in the order of the messages.
+ */
+vector<G1>
+OpenABEPairing::hashToG1Batch(OpenABEByteString& keyPrefix, const vector<string>& msgs,
+                              size_t maxConcurrency)
+{
+  vector<G1> points(msgs.size(), G1(this->bpgroup));
+  if (msgs.empty()) {
+    return points;
+  }
+  EVP_MD_CTX *prefix = EVP_MD_CTX_new();
+  if (prefix == nullptr || EVP_DigestInit_ex(prefix, EVP_sha256(), nullptr) != 1 ||
+      EVP_DigestUpdate(prefix, keyPrefix.getInternalPtr(), keyPrefix.size()) != 1) {
+    EVP_MD_CTX_free(prefix);
+    throw OpenABE_ERROR_UNKNOWN;
+  }
+
+  vector<OpenABE_ERROR> status(msgs.size(), OpenABE_NOERROR);
+  auto hashOne = [&](size_t i) {
+    OpenABE_countMetric(OpenABE_METRIC_HASH_TO_G1);
+    uint8_t digest[SHA256_LEN];
+    unsigned int len = 0;
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    if (ctx == nullptr || EVP_MD_CTX_copy_ex(ctx, prefix) != 1 ||
+        EVP_DigestUpdate(ctx, msgs[i].data(), msgs[i].size()) != 1 ||
+        EVP_DigestFinal_ex(ctx, digest, &len) != 1) {
+      status[i] = OpenABE_ERROR_UNKNOWN;
+    } else {
+#if defined(BP_WITH_MCL)
+      g1_map_op(GET_BP_GROUP(this->bpgroup), &points[i].m_G1, digest, len);
+#else
+      g1_map_op(GET_BP_GROUP(this->bpgroup), points[i].m_G1, digest, len);
+#endif
+    }
+    EVP_MD_CTX_free(ctx);
+  };
+  if (maxConcurrency != 1 && msgs.size() >= HASH_TO_G1_BATCH_PARALLEL) {
+    OpenABEThreadPool::getDefault()->parallelFor(msgs.size(), hashOne, maxConcurrency);
+  } else {
+    for (size_t i = 0; i < msgs.size(); i++) {
+      hashOne(i);
+    }
+  }
+  EVP_MD_CTX_free(prefix);
+  for (OpenABE_ERROR err : status) {
+    if (err != OpenABE_NOERROR) {
+      throw err;
+    }
+  }
+
+  vector<G1*> ptrs(points.size());
+  for (size_t i = 0; i < points.size(); i++) {
+    ptrs[i] = &points[i];
+  }
+  G1::normalizeAll(ptrs.data(), ptrs.size());
+  return points;
+}
+
 GT
 OpenABEPairing::pairing(G1& g1, G2& g2)
 {
+  OpenABE_countMetric(OpenABE_METRIC_PAIRINGS);
   GT result(this->bpgroup);
 #if defined(BP_WITH_MCL)
   // FIX Bug #9: Pass pointers for MCL
@@ -295,16 +367,54 @@ OpenABEPairing::pairing(G1& g1, G2& g2)
 
 void
 OpenABEPairing::multi_pairing(GT& gt, std::vector<G1>& g1, std::vector<G2>& g2) {
-  fprintf(stderr, "[MULTI_PAIRING DEBUG] Called with %zu pairs\n", g1.size());
+  if (g1.size() != g2.size()) {
+    throw OpenABE_ERROR_INVALID_LENGTH;
+  }
+  this->multi_pairing(gt, g1.data(), g2.data(), g1.size());
+}
+
+void
+OpenABEPairing::multi_pairing(GT& gt, const G1 *g1, const G2 *g2, size_t n) {
+  OpenABE_TRACE_DEBUG("multi_pairing: %zu pairs", n);
+  OpenABE_countMetric(OpenABE_METRIC_MULTI_PAIRINGS);
+  OpenABE_countMetric(OpenABE_METRIC_PAIRINGS, n);
+  multi_bp_map_op(GET_BP_GROUP(this->bpgroup), gt, g1, g2, n);
+  if(gt.isInfinity()) {
+    OpenABE_TRACE_DEBUG("multi_pairing: result is infinity, setting to identity");
+    gt.setIdentity();
+  }
+}
+
+/*!
+ * Multi-pairing where the G2 side of the last m pairs is fixed and has
+ * precomputed Miller-loop lines: gt = prod_i e(g1[i], g2[i]) *
+ * prod_j e(fixedG1[j], fixedG2[j]), with a single final exponentiation.
+ */
+
+void
+OpenABEPairing::multi_pairing(GT& gt, const G1 *g1, const G2 *g2, size_t n,
+                              const G1 *fixedG1, const G2LineTable *const *fixedG2, size_t m) {
+  OpenABE_TRACE_DEBUG("multi_pairing: %zu pairs, %zu fixed", n, m);
+  OpenABE_countMetric(OpenABE_METRIC_MULTI_PAIRINGS);
+  OpenABE_countMetric(OpenABE_METRIC_PAIRINGS, n + m);
+  multi_bp_map_op(GET_BP_GROUP(this->bpgroup), gt, g1, g2, n, fixedG1, fixedG2, m);
+  if(gt.isInfinity()) {
+    gt.setIdentity();
+  }
+}
+
+#if defined(BP_WITH_MCL)
+void
+OpenABEPairing::multi_pairing(GT& gt, const G1Vector& g1, const G2Vector& g2) {
+  OpenABE_TRACE_DEBUG("multi_pairing: %zu contiguous pairs", g1.size());
+  OpenABE_countMetric(OpenABE_METRIC_MULTI_PAIRINGS);
+  OpenABE_countMetric(OpenABE_METRIC_PAIRINGS, g1.size());
   multi_bp_map_op(GET_BP_GROUP(this->bpgroup), gt, g1, g2);
-  fprintf(stderr, "[MULTI_PAIRING DEBUG] After multi_bp_map_op, checking isInfinity...\n");
-  bool is_inf = gt.isInfinity();
-  fprintf(stderr, "[MULTI_PAIRING DEBUG] isInfinity() returned: %d\n", is_inf);
-  if(is_inf) {
-    fprintf(stderr, "[MULTI_PAIRING DEBUG] Setting to identity!\n");
+  if(gt.isInfinity()) {
     gt.setIdentity();
   }
 }
+#endif
 
 /*!
  * Return the pairing parameters string.
@@ -376,31 +486,32 @@ OpenABEPairing::hashToBytes(uint8_t *buf, uint32_t buf_len)
 OpenABEByteString
 OpenABEPairing::hashFromBytes(OpenABEByteString &buf, uint32_t target_len, uint8_t hash_prefix)
 {
-  // compute number of hash blocks needed
-  int block_len = ceil(((double)target_len) / SHA256_LEN);
-  // set the hash_len
-  size_t hash_len = block_len * SHA256_LEN;
-  std::vector<uint8_t> hash(hash_len + 1, 0);
-
-  OpenABEByteString buf2 = buf;
-  uint8_t count = 0;
-
-  buf2.insertFirstByte(hash_prefix);
-  buf2.insertFirstByte(count);
-  uint8_t *ptr = buf2.getInternalPtr();
-  uint8_t *hash_ptr = &hash[0];
-
-  for(int i = 0; i < block_len; i++) {
-    // H(count || hash_prefix || buf)
-    sha256(hash_ptr, buf2.getInternalPtr(), buf2.size());
-    count++;
-    ptr[0] = count;      // change block number
-    hash_ptr += SHA256_LEN; // move ptr by SHA256_LEN size
+  OpenABEByteString result;
+  result.resize(target_len);
+  // block i is H(i || hash_prefix || buf): the two prefix bytes are fed to
+  // the digest ahead of buf instead of being inserted into a copy of it
+  uint8_t header[2] = { 0, hash_prefix };
+  uint8_t digest[SHA256_LEN];
+  unsigned int digest_len = 0;
+
+  EVP_MD_CTX *md_ctx = EVP_MD_CTX_new();
+  ASSERT(md_ctx != nullptr, OpenABE_ERROR_OUT_OF_MEMORY);
+  for (uint32_t offset = 0; offset < target_len; offset += SHA256_LEN) {
+    uint32_t n = min((uint32_t)SHA256_LEN, target_len - offset);
+    // full blocks are written straight into the output
+    uint8_t *out = (n == SHA256_LEN) ? &result[offset] : digest;
+    EVP_DigestInit_ex(md_ctx, EVP_sha256(), NULL);
+    EVP_DigestUpdate(md_ctx, header, sizeof(header));
+    EVP_DigestUpdate(md_ctx, buf.getInternalPtr(), buf.size());
+    EVP_DigestFinal_ex(md_ctx, out, &digest_len);
+    if (out == digest) {
+      memcpy(&result[offset], digest, n);
+      OpenABEZeroize(digest, SHA256_LEN);
+    }
+    header[0]++;      // change block number
   }
-
-  OpenABEByteString b;
-  b.appendArray(&hash[0], target_len);
-  return b;
+  EVP_MD_CTX_free(md_ctx);
+  return result;
 }
 
 }
@@ -33,6 +33,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <iostream>
 #include <fstream>
 #include <string>
@@ -64,6 +65,20 @@ ZObject::~ZObject()
 {
 }
 
+/*!
+ * Append the serialized form of this object to a sink.
+ *
+ * @param[in]   the sink to append to
+ */
+
+void
+ZObject::serializeTo(OpenABEByteSink &sink) const
+{
+    OpenABEByteString bytes;
+    this->serialize(bytes);
+    sink.append(bytes);
+}
+
 /*!
  * Increment the reference count.
  *
@@ -91,128 +106,18 @@ ZObject::deRef()
 void
 OpenABEZeroize(void *b, size_t b_len) {
   if (b == NULL) { fprintf(stderr, "%s:%s:%d: ASSERT_NOTNULL failed\n", __FILE__, __FUNCTION__, __LINE__); return; }
+#if defined(__GNUC__) || defined(__clang__)
+  // memset at full speed; the barrier keeps it from being elided as a dead store
+  memset(b, 0, b_len);
+  __asm__ __volatile__("" : : "r"(b) : "memory");
+#else
   volatile uint8_t *p = (uint8_t *)b;
   if (b_len > 0) {
     while( b_len-- ) {
         *p++ = 0;
     }
   }
-}
-
-/* helper methods to assist with serializing and base-64 encoding group elements */
-static const string base64_chars =
-             "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-             "abcdefghijklmnopqrstuvwxyz"
-             "0123456789+/";
-
-/* Note that the following was borrowed from Copyright (C) 2004-2008 Ren� Nyffenegger (*/
-
-bool is_base64(unsigned char c) {
-  return (isalnum(c) || (c == '+') || (c == '/'));
-}
-
-string Base64Encode(unsigned char const* bytes_to_encode, unsigned int in_len) {
-  string ret;
-  int i = 0;
-  int j = 0;
-  unsigned char char_array_3[3];
-  unsigned char char_array_4[4];
-
-  while (in_len--) {
-    char_array_3[i++] = *(bytes_to_encode++);
-    if (i == 3) {
-      char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-      char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-      char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-      char_array_4[3] = char_array_3[2] & 0x3f;
-
-      for(i = 0; (i <4) ; i++)
-        ret += base64_chars[char_array_4[i]];
-      i = 0;
-    }
-  }
-
-  if (i)
-  {
-    for(j = i; j < 3; j++)
-      char_array_3[j] = '\0';
-
-    char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-    char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-    char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-    char_array_4[3] = char_array_3[2] & 0x3f;
-
-    for (j = 0; (j < i + 1); j++)
-      ret += base64_chars[char_array_4[j]];
-
-    while((i++ < 3))
-      ret += '=';
-
-  }
-
-  return ret;
-
-}
-
-string Base64Decode(string const& encoded_string) {
-  int in_len = encoded_string.size();
-  int i = 0;
-  int j = 0;
-  size_t in_ = 0;
-  unsigned char char_array_4[4], char_array_3[3];
-  std::string ret;
-
-  while (in_len-- && ( encoded_string[in_] != '=') && is_base64(encoded_string[in_])) {
-    char_array_4[i++] = encoded_string[in_]; in_++;
-    if (i ==4) {
-      for (i = 0; i <4; i++)
-        char_array_4[i] = base64_chars.find(char_array_4[i]);
-
-      char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-      char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-      char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
-
-      for (i = 0; (i < 3); i++)
-        ret += char_array_3[i];
-      i = 0;
-    }
-  }
-
-  // The only case where we have a valid input and the following
-  // if happens is terminating '=' characters
-  if (in_ < encoded_string.size()) {
-    // Look for terminating '='s, maximum 2
-    if (encoded_string.size() - in_ > 2) {
-        fprintf(stderr, "Invalid Base64 input: too many terminating characters\n");
-        return "";
-    }
-    size_t tmp = in_;
-    for (; tmp < encoded_string.size(); tmp++) {
-        if (encoded_string[tmp] != '=') {
-            break;
-        }
-    }
-    if (tmp != encoded_string.size()) {
-        fprintf(stderr, "Invalid Base64 input: invalid terminating characters\n");
-        return "";
-    }
-  }
-
-  if (i) {
-    for (j = i; j <4; j++)
-      char_array_4[j] = 0;
-
-    for (j = 0; j <4; j++)
-      char_array_4[j] = base64_chars.find(char_array_4[j]);
-
-    char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-    char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-    char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
-
-    for (j = 0; (j < i - 1); j++) ret += char_array_3[j];
-  }
-
-  return ret;
+#endif
 }
 
 }
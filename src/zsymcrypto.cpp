@@ -31,10 +31,15 @@
 /// \author Alan Dunn and J. Ayo Akinyele
 ///
 
+#include <string.h>
+#include <algorithm>
+#include <atomic>
 #include <sstream>
 #include <stdexcept>
 #include <cassert>
+#include <vector>
 #include <openabe/zsymcrypto.h>
+#include <openabe/utils/zthreadpool.h>
 
 using namespace std;
 
@@ -128,6 +133,8 @@ OpenABESymKeyAuthEnc::OpenABESymKeyAuthEnc(int securitylevel, const string& zkey
     this->iv_len = AES_BLOCK_SIZE;
     this->aad_set = false;
     this->key = zkey;
+    this->enc_ctx = this->dec_ctx = nullptr;
+    this->enc_iv_len = this->dec_iv_len = 0;
 }
 
 OpenABESymKeyAuthEnc::OpenABESymKeyAuthEnc(int securitylevel, OpenABEByteString& zkey): ZObject()
@@ -139,6 +146,8 @@ OpenABESymKeyAuthEnc::OpenABESymKeyAuthEnc(int securitylevel, OpenABEByteString&
     this->iv_len = AES_BLOCK_SIZE;
     this->aad_set = false;
     this->key = zkey;
+    this->enc_ctx = this->dec_ctx = nullptr;
+    this->enc_iv_len = this->dec_iv_len = 0;
 }
 
 
@@ -147,6 +156,10 @@ OpenABESymKeyAuthEnc::~OpenABESymKeyAuthEnc()
     if (this->aad_set) {
         this->aad.zeroize();
     }
+    // freeing a context also clears its key schedule
+    EVP_CIPHER_CTX_free(this->enc_ctx);
+    EVP_CIPHER_CTX_free(this->dec_ctx);
+    this->key.zeroize();
 }
 
 void
@@ -182,86 +195,164 @@ OpenABESymKeyAuthEnc::setAddAuthData(uint8_t *aad, uint32_t aad_len)
     this->aad_set = true;
 }
 
+/*!
+ * Get the encryption (enc = 1) or decryption (enc = 0) context ready for a
+ * new message under the given IV. Each context is created and keyed on
+ * first use; after that only the IV is loaded (and the IV length changed
+ * if needed), so the AES key schedule is computed once per object.
+ *
+ * @return  the context, or nullptr on failure.
+ */
+EVP_CIPHER_CTX*
+OpenABESymKeyAuthEnc::startMessage(int enc, const uint8_t *iv, int ivLen)
+{
+    EVP_CIPHER_CTX *&ctx = enc ? this->enc_ctx : this->dec_ctx;
+    int &ctxIvLen = enc ? this->enc_iv_len : this->dec_iv_len;
+    const uint8_t *keyPtr = nullptr;
+
+    if (ctx == nullptr) {
+        ctx = EVP_CIPHER_CTX_new();
+        /* set cipher type and mode */
+        if (ctx == nullptr || EVP_CipherInit_ex(ctx, this->cipher, NULL, NULL, NULL, enc) != 1) {
+            return nullptr;
+        }
+        keyPtr = this->key.getInternalPtr();
+    }
+    if (ctxIvLen != ivLen) {
+        /* set the IV length (128-bits for our own IVs) */
+        if (EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, ivLen, NULL) != 1) {
+            return nullptr;
+        }
+        ctxIvLen = ivLen;
+    }
+    /* initialize key (first message only) and IV */
+    if (EVP_CipherInit_ex(ctx, NULL, NULL, keyPtr, iv, enc) != 1) {
+        return nullptr;
+    }
+    return ctx;
+}
+
+/*!
+ * Encrypt into caller-provided buffers, without any allocation.
+ *
+ * @param[in]   plaintext and its length.
+ * @param[out]  iv: AES_BLOCK_SIZE bytes, set to a fresh random IV.
+ * @param[out]  ciphertext: pt_len bytes.
+ * @param[out]  tag: AES_BLOCK_SIZE bytes.
+ * @return      OpenABE_NOERROR or an error.
+ */
+OpenABE_ERROR
+OpenABESymKeyAuthEnc::encrypt(const uint8_t *plaintext, size_t pt_len,
+                              uint8_t *iv, uint8_t *ciphertext, uint8_t *tag)
+{
+    int len = 0;
+    chooseRandomIV();
+    EVP_CIPHER_CTX *ctx = startMessage(1, this->iv, AES_BLOCK_SIZE);
+    if (ctx == nullptr) {
+        return OpenABE_ERROR_ENCRYPTION_ERROR;
+    }
+    memcpy(iv, this->iv, AES_BLOCK_SIZE);
+
+    /* specify the additional authentication data (aad) */
+    if (this->aad_set) {
+        EVP_EncryptUpdate(ctx, NULL, &len, this->aad.getInternalPtr(), this->aad.size());
+    }
+
+    /* encrypt plaintext */
+    if (pt_len > 0) {
+        if (EVP_EncryptUpdate(ctx, ciphertext, &len, plaintext, (int)pt_len) != 1 ||
+            (size_t)len != pt_len) {
+            return OpenABE_ERROR_ENCRYPTION_ERROR;
+        }
+    }
+
+    /* finalize: computes authentication tag*/
+    EVP_EncryptFinal_ex(ctx, ciphertext + pt_len, &len);
+    // For AES-GCM, the 'len' should be '0' because there is no extra bytes used for padding.
+    if (len != 0) {
+        return OpenABE_ERROR_UNEXPECTED_EXTRA_BYTES;
+    }
+
+    /* retrieve the tag */
+    EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, AES_BLOCK_SIZE, tag);
+    return OpenABE_NOERROR;
+}
 
 OpenABE_ERROR
 OpenABESymKeyAuthEnc::encrypt(const string& plaintext, OpenABEByteString *iv, OpenABEByteString *ciphertext, OpenABEByteString *tag)
 {
     OpenABE_ERROR result = OpenABE_NOERROR;
-    uint8_t *ct = nullptr;
 
     try {
         ASSERT_NOTNULL(iv);
         ASSERT_NOTNULL(ciphertext);
         ASSERT_NOTNULL(tag);
 
-        EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
-        OpenABEByteString ivObj, ctObj, tagObj;
-        uint8_t *pt_ptr = (uint8_t *) plaintext.c_str();
-        int len = 0, ctlen, pt_len = plaintext.size();
-        if(pt_len < AES_BLOCK_SIZE)
-            /* add block size to the len */
-            len += AES_BLOCK_SIZE;
-        else
-            /* add pt_len + block size to len */
-            len += pt_len;
-        // allocate the temp output ciphertext buffer
-        // uint8_t ct[len+1];
-        ct = (uint8_t*) malloc(len+1);
-        MALLOC_CHECK_OUT_OF_MEMORY(ct);
-        memset(ct, 0, len+1);
-
-        // cout << "Plaintext:\n";
-        // BIO_dump_fp(stdout, (const char *) &((*plaintext)[0]), plaintext->size());
-        // cout << "Enc Key:\n";
-        // BIO_dump_fp(stdout, (const char *) this->key.getInternalPtr(), this->key.size());
-
-        /* set cipher type and mode */
-        EVP_EncryptInit_ex(ctx, this->cipher, NULL, NULL, NULL);
-        /* set the IV length as 128-bits */
-        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, AES_BLOCK_SIZE, NULL);
-        /* initialize key and IV */
-
-        chooseRandomIV();
-        EVP_EncryptInit_ex(ctx, NULL, NULL, this->key.getInternalPtr(), this->iv);
-        iv->clear();
-        iv->appendArray(this->iv, this->iv_len);
-
-        /* specify the additional authentication data (aad) */
-        if (this->aad_set) {
-            EVP_EncryptUpdate(ctx, NULL, &ctlen, this->aad.getInternalPtr(), this->aad.size());
+        size_t pt_len = plaintext.size();
+        iv->resize(this->iv_len);
+        ciphertext->resize(pt_len);
+        tag->resize(AES_BLOCK_SIZE);
+        uint8_t ct_empty;
+        result = this->encrypt((const uint8_t *) plaintext.data(), pt_len, iv->getInternalPtr(),
+                               (pt_len > 0) ? ciphertext->getInternalPtr() : &ct_empty,
+                               tag->getInternalPtr());
+        if (result != OpenABE_NOERROR) {
+            iv->clear();
+            ciphertext->clear();
+            tag->clear();
         }
+    } catch(OpenABE_ERROR& e) {
+        result = e;
+    }
+    return result;
+}
 
-        /* encrypt plaintext */
-        EVP_EncryptUpdate(ctx, ct, &ctlen, pt_ptr, pt_len);
-
-        // cout << "Ciphertext:\n";
-        // BIO_dump_fp(stdout, (const char *) ct, ctlen);
-        ciphertext->clear();
-        ciphertext->appendArray(ct, ctlen);
+/*!
+ * Decrypt into a caller-provided buffer, without any allocation.
+ *
+ * @param[out]  plaintext: ct_len bytes (zeroized if the tag does not verify).
+ * @param[in]   ciphertext and its length.
+ * @param[in]   iv and its length.
+ * @param[in]   tag: AES_BLOCK_SIZE bytes.
+ * @return      true if the tag verified.
+ */
+bool
+OpenABESymKeyAuthEnc::decrypt(uint8_t *plaintext, const uint8_t *ciphertext, size_t ct_len,
+                              const uint8_t *iv, size_t iv_len, const uint8_t *tag)
+{
+    int pt_len = 0;
+    if (ct_len == 0) {
+        /* ciphertext has to be greater than 0 */
+        return false;
+    }
 
-        /* finalize: computes authentication tag*/
-        EVP_EncryptFinal_ex(ctx, ct, &len);
-        // For AES-GCM, the 'len' should be '0' because there is no extra bytes used for padding.
-        ASSERT(len == 0, OpenABE_ERROR_UNEXPECTED_EXTRA_BYTES);
+    EVP_CIPHER_CTX *ctx = startMessage(0, iv, (int)iv_len);
+    if (ctx == nullptr) {
+        return false;
+    }
 
-        /* retrieve the tag */
-        int tag_len = AES_BLOCK_SIZE;
-        uint8_t tag_buf[tag_len+1];
-        memset(tag_buf, 0, tag_len+1);
-        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, tag_len, tag_buf);
+    // OpenSSL says tag must be set *before* any EVP_DecryptUpdate call.
+    // This is a restriction for OpenSSL v1.0.1c and prior versions but also works
+    // thesame for later versions. To avoid OpenSSL version checks, we set the tag
+    // here which should work across all versions.
+    /* set the tag expected value */
+    EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, AES_BLOCK_SIZE, (void *) tag);
 
-        // cout << "Tag:\n";
-        // BIO_dump_fp(stdout, (const char *) tag_buf, tag_len);
-        tag->clear();
-        tag->appendArray(tag_buf, tag_len);
+    /* specify additional authentication data */
+    if(this->aad_set) {
+        EVP_DecryptUpdate(ctx, NULL, &pt_len, this->aad.getInternalPtr(), this->aad.size());
+    }
 
-        EVP_CIPHER_CTX_free(ctx);
-    } catch(OpenABE_ERROR& e) {
-        result = e;
+    /* decrypt and store plaintext in the output buffer */
+    if (EVP_DecryptUpdate(ctx, plaintext, &pt_len, ciphertext, (int)ct_len) == 1 &&
+        (size_t)pt_len == ct_len &&
+        EVP_DecryptFinal_ex(ctx, plaintext + ct_len, &pt_len) > 0) {
+        /* tag verification successful */
+        return true;
     }
-    if (ct)
-        free(ct);
-    return result;
+    /* authentication failure */
+    OpenABEZeroize(plaintext, ct_len);
+    return false;
 }
 
 bool
@@ -275,73 +366,543 @@ OpenABESymKeyAuthEnc::decrypt(string& plaintext, OpenABEByteString* iv, OpenABEB
         /* ciphertext has to be greater than 0 */
         return false;
     }
+    ASSERT(tag->size() == AES_BLOCK_SIZE, OpenABE_ERROR_INVALID_TAG_LENGTH);
 
-    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
-    uint8_t *pt = nullptr;
-    OpenABEByteString pt_buf;
+    string pt(ciphertext->size(), '\0');
+    if (!this->decrypt((uint8_t *) &pt[0], ciphertext->getInternalPtr(), ciphertext->size(),
+                       iv->getInternalPtr(), iv->size(), tag->getInternalPtr())) {
+        return false;
+    }
+    plaintext.swap(pt);
+    OpenABEZeroize(&pt[0], pt.size());
+    return true;
+}
 
-    int pt_len, retValue;
-    uint8_t *ct_ptr = ciphertext->getInternalPtr();
-    int ct_len = ciphertext->size();
-    // cout << "Dec Ciphertext:\n";
-    // BIO_dump_fp(stdout, (const char *) ct_ptr, ct_len);
+/********************************************************************************
+ * Implementation of the OpenABESymKeyChunkedAuthEnc class
+ ********************************************************************************/
 
-    uint8_t *tag_ptr =  tag->getInternalPtr();
-    int tag_len = tag->size();
-    ASSERT(tag_len == AES_BLOCK_SIZE, OpenABE_ERROR_INVALID_TAG_LENGTH);
-    // cout << "Dec Tag:\n";
-    // BIO_dump_fp(stdout, (const char *) tag_ptr, tag_len);
+namespace {
 
-    /* set cipher type and mode */
-    EVP_DecryptInit_ex(ctx, this->cipher, NULL, NULL, NULL);
-    /* set the IV length as 128-bits */
-    EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, iv->size(), NULL);
-    /* specify key and iv */
-    // cout << "Dec Key:\n";
-    // BIO_dump_fp(stdout, (const char *) this->key.getInternalPtr(), this->key.size());
-    EVP_DecryptInit_ex(ctx, NULL, NULL, this->key.getInternalPtr(), iv->getInternalPtr());
+// header: version || chunk size (32-bit big-endian) || nonce prefix
+const uint8_t CHUNKED_VERSION = 0x01;
+const size_t CHUNKED_PREFIX_LEN = 7;
+const size_t CHUNKED_HDR_LEN = 1 + sizeof(uint32_t) + CHUNKED_PREFIX_LEN;
+// nonce: prefix || chunk index (32-bit big-endian) || last-chunk flag
+const size_t CHUNKED_NONCE_LEN = CHUNKED_PREFIX_LEN + sizeof(uint32_t) + 1;
+const size_t CHUNKED_MAX_CHUNK_SIZE = (1 << 30);
+const size_t CHUNKED_MAX_CHUNKS = UINT32_MAX;
 
-    // OpenSSL says tag must be set *before* any EVP_DecryptUpdate call.
-    // This is a restriction for OpenSSL v1.0.1c and prior versions but also works
-    // thesame for later versions. To avoid OpenSSL version checks, we set the tag
-    // here which should work across all versions.
-    /* set the tag expected value */
-    EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, tag_len, tag_ptr);
+enum { STREAM_NONE = 0, STREAM_ENCRYPT, STREAM_DECRYPT };
 
-    /* specify additional authentication data */
-    if(this->aad_set) {
-        EVP_DecryptUpdate(ctx, NULL, &pt_len, this->aad.getInternalPtr(), this->aad.size());
+void write32(uint8_t *out, uint32_t n) {
+  out[0] = (n >> 24) & 0xFF;
+  out[1] = (n >> 16) & 0xFF;
+  out[2] = (n >> 8) & 0xFF;
+  out[3] = n & 0xFF;
+}
+
+// chunk size of a header, or 0 if the header is malformed
+size_t readChunkSize(const uint8_t *header) {
+  if (header[0] != CHUNKED_VERSION) {
+    return 0;
+  }
+  size_t chunk_size = ((size_t)header[1] << 24) | ((size_t)header[2] << 16) |
+                      ((size_t)header[3] << 8) | (size_t)header[4];
+  return (chunk_size <= CHUNKED_MAX_CHUNK_SIZE) ? chunk_size : 0;
+}
+
+// number of chunks in a ciphertext body, or 0 if it is malformed (every
+// chunk but the last is full, and the last carries at least one byte)
+size_t countChunks(size_t body_len, size_t chunk_size) {
+  size_t unit = chunk_size + AES_BLOCK_SIZE;
+  size_t num_chunks = body_len / unit + ((body_len % unit) != 0);
+  if (num_chunks == 0 || num_chunks > CHUNKED_MAX_CHUNKS ||
+      body_len - (num_chunks - 1) * unit <= AES_BLOCK_SIZE) {
+    return 0;
+  }
+  return num_chunks;
+}
+
+// a context keyed for the chunk nonces, or nullptr on failure
+EVP_CIPHER_CTX *newChunkContext(const EVP_CIPHER *cipher, OpenABEByteString &key, int enc) {
+  EVP_CIPHER_CTX *ctx = (cipher != nullptr) ? EVP_CIPHER_CTX_new() : nullptr;
+  if (ctx != nullptr &&
+      (EVP_CipherInit_ex(ctx, cipher, NULL, NULL, NULL, enc) != 1 ||
+       EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, CHUNKED_NONCE_LEN, NULL) != 1 ||
+       EVP_CipherInit_ex(ctx, NULL, NULL, key.getInternalPtr(), NULL, enc) != 1)) {
+    EVP_CIPHER_CTX_free(ctx);
+    ctx = nullptr;
+  }
+  return ctx;
+}
+
+// load the nonce of a chunk and authenticate the caller's AAD and the header
+bool startChunk(EVP_CIPHER_CTX *ctx, int enc, OpenABEByteString &aad,
+                const uint8_t *header, size_t index, bool last, const uint8_t *tag) {
+  uint8_t nonce[CHUNKED_NONCE_LEN];
+  int len = 0;
+  memcpy(nonce, header + CHUNKED_HDR_LEN - CHUNKED_PREFIX_LEN, CHUNKED_PREFIX_LEN);
+  write32(nonce + CHUNKED_PREFIX_LEN, (uint32_t)index);
+  nonce[CHUNKED_NONCE_LEN - 1] = last ? 1 : 0;
+  if (EVP_CipherInit_ex(ctx, NULL, NULL, NULL, nonce, enc) != 1) {
+    return false;
+  }
+  // the expected tag goes in before any update (see OpenABESymKeyAuthEnc)
+  if (!enc &&
+      EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, AES_BLOCK_SIZE, (void *)tag) != 1) {
+    return false;
+  }
+  if (aad.size() > 0 &&
+      EVP_CipherUpdate(ctx, NULL, &len, aad.getInternalPtr(), (int)aad.size()) != 1) {
+    return false;
+  }
+  return EVP_CipherUpdate(ctx, NULL, &len, header, (int)CHUNKED_HDR_LEN) == 1;
+}
+
+// encrypt n bytes into out, followed by the tag
+bool sealChunk(EVP_CIPHER_CTX *ctx, OpenABEByteString &aad, const uint8_t *header,
+               size_t index, bool last, const uint8_t *plaintext, size_t n, uint8_t *out) {
+  int len = 0;
+  return (startChunk(ctx, 1, aad, header, index, last, nullptr) &&
+          EVP_EncryptUpdate(ctx, out, &len, plaintext, (int)n) == 1 &&
+          (size_t)len == n &&
+          EVP_EncryptFinal_ex(ctx, out + n, &len) == 1 && len == 0 &&
+          EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, AES_BLOCK_SIZE, out + n) == 1);
+}
+
+// decrypt n bytes (followed by their tag) into out, zeroized on failure
+bool openChunk(EVP_CIPHER_CTX *ctx, OpenABEByteString &aad, const uint8_t *header,
+               size_t index, bool last, const uint8_t *in, size_t n, uint8_t *out) {
+  int len = 0;
+  if (startChunk(ctx, 0, aad, header, index, last, in + n) &&
+      EVP_DecryptUpdate(ctx, out, &len, in, (int)n) == 1 &&
+      (size_t)len == n &&
+      EVP_DecryptFinal_ex(ctx, out + n, &len) > 0) {
+    return true;
+  }
+  OpenABEZeroize(out, n);
+  return false;
+}
+
+}
+
+OpenABESymKeyChunkedAuthEnc::OpenABESymKeyChunkedAuthEnc(int securitylevel, OpenABEByteString& zkey): ZObject()
+{
+    this->cipher = nullptr;
+    if(securitylevel == DEFAULT_AES_SEC_LEVEL) {
+        this->cipher = (EVP_CIPHER *) EVP_aes_256_gcm();
     }
+    this->key = zkey;
+    this->stream_ctx = nullptr;
+    this->stream_mode = STREAM_NONE;
+    this->stream_chunk_size = this->stream_index = 0;
+}
 
-    // uint8_t pt[ct_len+1];
-    pt = (uint8_t*) malloc(ct_len+1);
-    MALLOC_CHECK_OUT_OF_MEMORY(pt);
-    memset(pt, 0, ct_len+1);
-    /* decrypt and store plaintext in pt buffer */
-    EVP_DecryptUpdate(ctx, pt, &pt_len, ct_ptr, ct_len);
-    pt_buf.appendArray(pt, (uint32_t) pt_len);
+OpenABESymKeyChunkedAuthEnc::~OpenABESymKeyChunkedAuthEnc()
+{
+    this->resetStream();
+    this->aad.zeroize();
+    this->key.zeroize();
+}
 
-    // cout << "Plaintext:\n";
-    // BIO_dump_fp(stdout, (const char *) pt, pt_len);
+void
+OpenABESymKeyChunkedAuthEnc::setAddAuthData(OpenABEByteString &aad)
+{
+    this->aad = aad;
+}
 
-    /* finalize decryption */
-    retValue = EVP_DecryptFinal_ex(ctx, pt, &pt_len);
-    if (pt) {
-        free(pt);
+size_t
+OpenABESymKeyChunkedAuthEnc::getCiphertextSize(size_t pt_len, size_t chunk_size)
+{
+    if (pt_len == 0 || chunk_size == 0) {
+        return 0;
     }
-    // printf("Tag Verify %s\n", retValue > 0 ? "Successful!" : "Failed!");
+    size_t num_chunks = pt_len / chunk_size + ((pt_len % chunk_size) != 0);
+    return CHUNKED_HDR_LEN + pt_len + num_chunks * AES_BLOCK_SIZE;
+}
 
-    EVP_CIPHER_CTX_free(ctx);
-    if(retValue > 0) {
-        /* tag verification successful */
-        plaintext = pt_buf.toString();
-        pt_buf.zeroize();
-        return true;
+size_t
+OpenABESymKeyChunkedAuthEnc::getPlaintextSize(const uint8_t *ciphertext, size_t ct_len)
+{
+    if (ciphertext == nullptr || ct_len <= CHUNKED_HDR_LEN) {
+        return 0;
     }
-    else {
-        /* authentication failure */
+    size_t chunk_size = readChunkSize(ciphertext);
+    if (chunk_size == 0) {
+        return 0;
+    }
+    size_t num_chunks = countChunks(ct_len - CHUNKED_HDR_LEN, chunk_size);
+    if (num_chunks == 0) {
+        return 0;
+    }
+    return ct_len - CHUNKED_HDR_LEN - num_chunks * AES_BLOCK_SIZE;
+}
+
+/*!
+ * Run fn over chunks first ... last on the library thread pool. Each thread
+ * takes runs of consecutive chunks with a context keyed once per run.
+ *
+ * @return  true if fn succeeded for every chunk.
+ */
+bool
+OpenABESymKeyChunkedAuthEnc::processChunks(int enc, size_t first, size_t last,
+                                           const function<bool(EVP_CIPHER_CTX*, size_t)> &fn)
+{
+    size_t count = last - first + 1;
+    shared_ptr<OpenABEThreadPool> pool = OpenABEThreadPool::getDefault();
+    // a few runs per thread so that uneven progress still balances out
+    size_t runs = min(count, 4 * (pool->size() + 1));
+    atomic<bool> ok(true);
+
+    pool->parallelFor(runs, [&](size_t r) {
+        size_t begin = first + r * count / runs, end = first + (r + 1) * count / runs;
+        EVP_CIPHER_CTX *ctx = newChunkContext(this->cipher, this->key, enc);
+        bool res = (ctx != nullptr);
+        for (size_t i = begin; res && ok && i < end; i++) {
+            res = fn(ctx, i);
+        }
+        // freeing a context also clears its key schedule
+        EVP_CIPHER_CTX_free(ctx);
+        if (!res) {
+            ok = false;
+        }
+    });
+    return ok;
+}
+
+/*!
+ * Encrypt a plaintext chunk by chunk into a caller-provided buffer.
+ *
+ * @param[in]   plaintext and its length (> 0).
+ * @param[out]  ciphertext: getCiphertextSize(pt_len, chunk_size) bytes.
+ * @param[in]   plaintext bytes per chunk.
+ * @return      OpenABE_NOERROR or an error.
+ */
+OpenABE_ERROR
+OpenABESymKeyChunkedAuthEnc::encrypt(const uint8_t *plaintext, size_t pt_len,
+                                     uint8_t *ciphertext, size_t chunk_size)
+{
+    if (plaintext == nullptr || ciphertext == nullptr) {
+        return OpenABE_ERROR_INVALID_INPUT;
+    }
+    if (pt_len == 0 || chunk_size == 0 || chunk_size > CHUNKED_MAX_CHUNK_SIZE) {
+        return OpenABE_ERROR_INVALID_LENGTH;
+    }
+    size_t num_chunks = pt_len / chunk_size + ((pt_len % chunk_size) != 0);
+    if (num_chunks > CHUNKED_MAX_CHUNKS) {
+        return OpenABE_ERROR_INVALID_LENGTH;
+    }
+
+    ciphertext[0] = CHUNKED_VERSION;
+    write32(ciphertext + 1, (uint32_t)chunk_size);
+    if (RAND_bytes(ciphertext + CHUNKED_HDR_LEN - CHUNKED_PREFIX_LEN, CHUNKED_PREFIX_LEN) != 1) {
+        return OpenABE_ERROR_ENCRYPTION_ERROR;
+    }
+    const uint8_t *header = ciphertext;
+    uint8_t *body = ciphertext + CHUNKED_HDR_LEN;
+
+    bool ok = processChunks(1, 0, num_chunks - 1, [&](EVP_CIPHER_CTX *ctx, size_t i) {
+        size_t start = i * chunk_size, n = min(chunk_size, pt_len - start);
+        // each chunk is followed by its tag
+        return sealChunk(ctx, this->aad, header, i, i == num_chunks - 1, plaintext + start, n,
+                         body + i * (chunk_size + AES_BLOCK_SIZE));
+    });
+    return ok ? OpenABE_NOERROR : OpenABE_ERROR_ENCRYPTION_ERROR;
+}
+
+/*!
+ * Decrypt a whole ciphertext.
+ *
+ * @param[out]  plaintext: getPlaintextSize(ciphertext, ct_len) bytes
+ *              (zeroized if a chunk does not verify).
+ * @param[in]   ciphertext and its length.
+ * @return      true if every chunk verified.
+ */
+bool
+OpenABESymKeyChunkedAuthEnc::decrypt(uint8_t *plaintext, const uint8_t *ciphertext, size_t ct_len)
+{
+    size_t pt_len = getPlaintextSize(ciphertext, ct_len);
+    return (pt_len > 0 && this->decryptRange(plaintext, ciphertext, ct_len, 0, pt_len));
+}
+
+/*!
+ * Decrypt a range of the plaintext. Only the chunks covering the range are
+ * authenticated, so truncation of the ciphertext is detected only by a
+ * range that reaches the last chunk.
+ *
+ * @param[out]  plaintext: len bytes (zeroized if a chunk does not verify).
+ * @param[in]   ciphertext and its length.
+ * @param[in]   offset and length of the range in the plaintext.
+ * @return      true if the chunks verified.
+ */
+bool
+OpenABESymKeyChunkedAuthEnc::decryptRange(uint8_t *plaintext, const uint8_t *ciphertext,
+                                          size_t ct_len, size_t offset, size_t len)
+{
+    size_t pt_len = getPlaintextSize(ciphertext, ct_len);
+    if (plaintext == nullptr || pt_len == 0 || len == 0 ||
+        offset >= pt_len || len > pt_len - offset) {
+        return false;
+    }
+    size_t chunk_size = readChunkSize(ciphertext);
+    size_t num_chunks = countChunks(ct_len - CHUNKED_HDR_LEN, chunk_size);
+    const uint8_t *header = ciphertext;
+    const uint8_t *body = ciphertext + CHUNKED_HDR_LEN;
+    size_t end = offset + len;
+
+    bool ok = processChunks(0, offset / chunk_size, (end - 1) / chunk_size,
+                            [&](EVP_CIPHER_CTX *ctx, size_t i) {
+        size_t start = i * chunk_size, n = min(chunk_size, pt_len - start);
+        const uint8_t *in = body + i * (chunk_size + AES_BLOCK_SIZE);
+        bool last = (i == num_chunks - 1);
+        if (start >= offset && start + n <= end) {
+            return openChunk(ctx, this->aad, header, i, last, in, n, plaintext + (start - offset));
+        }
+        // chunks only partly inside the range are opened into scratch space
+        vector<uint8_t> scratch(n);
+        bool verified = openChunk(ctx, this->aad, header, i, last, in, n, scratch.data());
+        if (verified) {
+            size_t from = max(start, offset), to = min(start + n, end);
+            memcpy(plaintext + (from - offset), scratch.data() + (from - start), to - from);
+        }
+        OpenABEZeroize(scratch.data(), n);
+        return verified;
+    });
+    if (!ok) {
+        OpenABEZeroize(plaintext, len);
+    }
+    return ok;
+}
+
+void
+OpenABESymKeyChunkedAuthEnc::resetStream()
+{
+    // freeing a context also clears its key schedule
+    EVP_CIPHER_CTX_free(this->stream_ctx);
+    this->stream_ctx = nullptr;
+    this->pending.zeroize();
+    this->stream_header.clear();
+    this->stream_mode = STREAM_NONE;
+    this->stream_chunk_size = this->stream_index = 0;
+}
+
+/*!
+ * Start encrypting a stream: the output is the format of encrypt(), built
+ * as the plaintext is fed in, with at most one chunk held back.
+ *
+ * @param[out]  ciphertext: the header is appended.
+ * @param[in]   plaintext bytes per chunk.
+ * @return      OpenABE_NOERROR or an error.
+ */
+OpenABE_ERROR
+OpenABESymKeyChunkedAuthEnc::encryptInit(OpenABEByteString *ciphertext, size_t chunk_size)
+{
+    uint8_t header[CHUNKED_HDR_LEN];
+    this->resetStream();
+    if (ciphertext == nullptr) {
+        return OpenABE_ERROR_INVALID_INPUT;
+    }
+    if (chunk_size == 0 || chunk_size > CHUNKED_MAX_CHUNK_SIZE) {
+        return OpenABE_ERROR_INVALID_LENGTH;
+    }
+    header[0] = CHUNKED_VERSION;
+    write32(header + 1, (uint32_t)chunk_size);
+    if (RAND_bytes(header + CHUNKED_HDR_LEN - CHUNKED_PREFIX_LEN, CHUNKED_PREFIX_LEN) != 1 ||
+        (this->stream_ctx = newChunkContext(this->cipher, this->key, 1)) == nullptr) {
+        return OpenABE_ERROR_ENCRYPTION_ERROR;
+    }
+    this->stream_header.appendArray(header, CHUNKED_HDR_LEN);
+    this->stream_chunk_size = chunk_size;
+    this->stream_mode = STREAM_ENCRYPT;
+    ciphertext->appendArray(header, CHUNKED_HDR_LEN);
+    return OpenABE_NOERROR;
+}
+
+/*!
+ * Seal the next chunk of the stream and append it to the ciphertext.
+ */
+OpenABE_ERROR
+OpenABESymKeyChunkedAuthEnc::sealNextChunk(const uint8_t *plaintext, size_t n, bool last,
+                                           OpenABEByteString *ciphertext)
+{
+    if (this->stream_index >= CHUNKED_MAX_CHUNKS) {
+        return OpenABE_ERROR_INVALID_LENGTH;
+    }
+    size_t offset = ciphertext->size();
+    ciphertext->resize(offset + n + AES_BLOCK_SIZE);
+    if (!sealChunk(this->stream_ctx, this->aad, this->stream_header.getInternalPtr(),
+                   this->stream_index, last, plaintext, n, ciphertext->getInternalPtr() + offset)) {
+        ciphertext->resize(offset);
+        return OpenABE_ERROR_ENCRYPTION_ERROR;
+    }
+    this->stream_index++;
+    return OpenABE_NOERROR;
+}
+
+/*!
+ * Feed plaintext to the stream. Full chunks are appended to the ciphertext
+ * as soon as it is known that more plaintext follows them.
+ *
+ * @param[in]   plaintext block and its length.
+ * @param[out]  ciphertext: sealed chunks are appended.
+ * @return      OpenABE_NOERROR or an error.
+ */
+OpenABE_ERROR
+OpenABESymKeyChunkedAuthEnc::encryptUpdate(const uint8_t *plaintext, size_t pt_len,
+                                           OpenABEByteString *ciphertext)
+{
+    OpenABE_ERROR result = OpenABE_NOERROR;
+    size_t chunk_size = this->stream_chunk_size;
+    if (this->stream_mode != STREAM_ENCRYPT || ciphertext == nullptr ||
+        (plaintext == nullptr && pt_len > 0)) {
+        return OpenABE_ERROR_INVALID_INPUT;
+    }
+
+    while (pt_len > 0 && result == OpenABE_NOERROR) {
+        if (this->pending.size() == chunk_size) {
+            result = this->sealNextChunk(this->pending.getInternalPtr(), chunk_size, false, ciphertext);
+            this->pending.zeroize();
+        } else if (this->pending.size() == 0 && pt_len > chunk_size) {
+            // whole chunks with more input behind them are sealed in place
+            result = this->sealNextChunk(plaintext, chunk_size, false, ciphertext);
+            plaintext += chunk_size;
+            pt_len -= chunk_size;
+        } else {
+            size_t n = min(pt_len, chunk_size - this->pending.size());
+            this->pending.appendArray((uint8_t *)plaintext, (uint32_t)n);
+            plaintext += n;
+            pt_len -= n;
+        }
+    }
+    if (result != OpenABE_NOERROR) {
+        this->resetStream();
+    }
+    return result;
+}
+
+/*!
+ * Seal the held-back chunk as the last one and end the stream.
+ *
+ * @param[out]  ciphertext: the last chunk is appended.
+ * @return      OpenABE_NOERROR or an error (the stream must not be empty).
+ */
+OpenABE_ERROR
+OpenABESymKeyChunkedAuthEnc::encryptFinalize(OpenABEByteString *ciphertext)
+{
+    OpenABE_ERROR result = OpenABE_ERROR_INVALID_INPUT;
+    if (this->stream_mode == STREAM_ENCRYPT && ciphertext != nullptr) {
+        result = OpenABE_ERROR_INVALID_LENGTH;
+        if (this->pending.size() > 0) {
+            result = this->sealNextChunk(this->pending.getInternalPtr(), this->pending.size(),
+                                         true, ciphertext);
+        }
+    }
+    this->resetStream();
+    return result;
+}
+
+/*!
+ * Start decrypting a stream in the format of encrypt().
+ */
+void
+OpenABESymKeyChunkedAuthEnc::decryptInit()
+{
+    this->resetStream();
+    this->stream_mode = STREAM_DECRYPT;
+}
+
+/*!
+ * Feed ciphertext to the stream. A chunk is only released once its tag has
+ * verified, and the last chunk is only known (and thus released) at
+ * decryptFinalize.
+ *
+ * @param[in]   ciphertext block and its length.
+ * @param[out]  plaintext: verified chunks are appended.
+ * @return      false if a chunk did not verify (which ends the stream).
+ */
+bool
+OpenABESymKeyChunkedAuthEnc::decryptUpdate(const uint8_t *ciphertext, size_t ct_len,
+                                           OpenABEByteString *plaintext)
+{
+    if (this->stream_mode != STREAM_DECRYPT || plaintext == nullptr ||
+        (ciphertext == nullptr && ct_len > 0)) {
+        this->resetStream();
+        return false;
+    }
+    if (ct_len > 0) {
+        this->pending.insert(this->pending.end(), ciphertext, ciphertext + ct_len);
+    }
+
+    size_t used = 0;
+    if (this->stream_chunk_size == 0) {
+        if (this->pending.size() < CHUNKED_HDR_LEN) {
+            return true;
+        }
+        size_t chunk_size = readChunkSize(this->pending.getInternalPtr());
+        if (chunk_size == 0 ||
+            (this->stream_ctx = newChunkContext(this->cipher, this->key, 0)) == nullptr) {
+            this->resetStream();
+            return false;
+        }
+        this->stream_header.appendArray(this->pending.getInternalPtr(), CHUNKED_HDR_LEN);
+        this->stream_chunk_size = chunk_size;
+        used = CHUNKED_HDR_LEN;
+    }
+
+    // a full chunk with more bytes behind it is not the last one
+    size_t unit = this->stream_chunk_size + AES_BLOCK_SIZE;
+    bool ok = true;
+    while (ok && this->pending.size() - used > unit) {
+        ok = (this->stream_index < CHUNKED_MAX_CHUNKS);
+        if (ok) {
+            size_t offset = plaintext->size();
+            plaintext->resize(offset + this->stream_chunk_size);
+            ok = openChunk(this->stream_ctx, this->aad, this->stream_header.getInternalPtr(),
+                           this->stream_index, false, this->pending.getInternalPtr() + used,
+                           this->stream_chunk_size, plaintext->getInternalPtr() + offset);
+            if (!ok) {
+                plaintext->resize(offset);
+            }
+        }
+        this->stream_index++;
+        used += unit;
+    }
+    if (!ok) {
+        this->resetStream();
         return false;
     }
+    if (used > 0) {
+        this->pending.erase(this->pending.begin(), this->pending.begin() + used);
+    }
+    return true;
+}
+
+/*!
+ * Verify and release the last chunk and end the stream.
+ *
+ * @param[out]  plaintext: the last chunk is appended.
+ * @return      false if the stream was truncated or the chunk did not verify.
+ */
+bool
+OpenABESymKeyChunkedAuthEnc::decryptFinalize(OpenABEByteString *plaintext)
+{
+    bool ok = (this->stream_mode == STREAM_DECRYPT && plaintext != nullptr &&
+               this->stream_chunk_size > 0 && this->pending.size() > AES_BLOCK_SIZE &&
+               this->stream_index < CHUNKED_MAX_CHUNKS);
+    if (ok) {
+        size_t n = this->pending.size() - AES_BLOCK_SIZE;
+        size_t offset = plaintext->size();
+        plaintext->resize(offset + n);
+        ok = openChunk(this->stream_ctx, this->aad, this->stream_header.getInternalPtr(),
+                       this->stream_index, true, this->pending.getInternalPtr(), n,
+                       plaintext->getInternalPtr() + offset);
+        if (!ok) {
+            plaintext->resize(offset);
+        }
+    }
+    this->resetStream();
+    return ok;
 }
 
 /********************************************************************************
@@ -361,6 +922,8 @@ OpenABESymKeyHandleImpl::OpenABESymKeyHandleImpl(const string& keyBytes, bool ap
     security_level_ = DEFAULT_AES_SEC_LEVEL;
     key_ = keyBytes;
     b64_encode_ = apply_b64_encode;
+    authEnc_.reset(new OpenABESymKeyAuthEnc(security_level_, key_));
+    authEnc_->setAddAuthData(NULL, 0);
 }
 
 OpenABESymKeyHandleImpl::OpenABESymKeyHandleImpl(OpenABEByteString& keyBytes,
@@ -378,6 +941,13 @@ OpenABESymKeyHandleImpl::OpenABESymKeyHandleImpl(OpenABEByteString& keyBytes,
     security_level_ = DEFAULT_AES_SEC_LEVEL;
     authData_ = authData;
     b64_encode_ = apply_b64_encode;
+    authEnc_.reset(new OpenABESymKeyAuthEnc(security_level_, key_));
+    // set the additional auth data (if set)
+    if (authData_.size() > 0) {
+        authEnc_->setAddAuthData(authData_);
+    } else {
+        authEnc_->setAddAuthData(NULL, 0);
+    }
 }
 
 
@@ -388,17 +958,17 @@ OpenABESymKeyHandleImpl::~OpenABESymKeyHandleImpl() {
 
 void OpenABESymKeyHandleImpl::encrypt(string& ciphertext, const string& plaintext)
 {
-    unique_ptr<OpenABESymKeyAuthEnc> symkeyContext_(new OpenABESymKeyAuthEnc(security_level_, key_));
+    if (authEnc_ == nullptr) {
+        fprintf(stderr, "OpenABESymKeyHandleImpl::encrypt: invalid key\n");
+        return; // Leave ciphertext empty to signal error
+    }
     try {
         OpenABEByteString zciphertext, ziv, zct, ztag;
-        // set the additional auth data (if set)
-        if (authData_.size() > 0) {
-        	symkeyContext_->setAddAuthData(authData_);
-        } else {
-        	symkeyContext_->setAddAuthData(NULL, 0);
-        }
         // now we can encrypt with sym key
-        if (symkeyContext_->encrypt(plaintext, &ziv, &zct, &ztag) != OpenABE_NOERROR) {
+        std::unique_lock<std::mutex> lock(authEncLock_);
+        OpenABE_ERROR result = authEnc_->encrypt(plaintext, &ziv, &zct, &ztag);
+        lock.unlock();
+        if (result != OpenABE_NOERROR) {
             fprintf(stderr, "OpenABESymKeyHandleImpl::encrypt: Encryption failed\n");
             return; // Leave ciphertext empty to signal error
         }
@@ -430,7 +1000,10 @@ void OpenABESymKeyHandleImpl::encrypt(string& ciphertext, const string& plaintex
 
 void OpenABESymKeyHandleImpl::decrypt(string& plaintext, const string& ciphertext)
 {
-    unique_ptr<OpenABESymKeyAuthEnc> symkeyContext_(new OpenABESymKeyAuthEnc(security_level_, key_));
+    if (authEnc_ == nullptr) {
+        fprintf(stderr, "OpenABESymKeyHandleImpl::decrypt: invalid key\n");
+        return; // Leave plaintext empty to signal error
+    }
     try {
         size_t index = 0;
         OpenABEByteString zciphertext;
@@ -444,13 +1017,9 @@ void OpenABESymKeyHandleImpl::decrypt(string& plaintext, const string& ciphertex
         zct = zciphertext.smartUnpack(&index);
         ztag = zciphertext.smartUnpack(&index);
 
-        // set the additional auth data (if set)
-        if (authData_.size() > 0) {
-           symkeyContext_->setAddAuthData(authData_);
-        } else {
-           symkeyContext_->setAddAuthData(NULL, 0);
-        }
-        bool dec_status = symkeyContext_->decrypt(plaintext, &ziv, &zct, &ztag);
+        std::unique_lock<std::mutex> lock(authEncLock_);
+        bool dec_status = authEnc_->decrypt(plaintext, &ziv, &zct, &ztag);
+        lock.unlock();
         if (!dec_status) {
             fprintf(stderr, "OpenABESymKeyHandleImpl::decrypt: Decryption failed\n");
             return; // Leave plaintext empty to signal error
@@ -0,0 +1,400 @@
+/**
+ * OpenABE WebAssembly benchmark scenarios
+ *
+ * Runs the scenarios of src/benchmark_comprehensive.cpp through
+ * openabe-wrapper.js and openabe-worker-pool.js. It also runs two groups
+ * the native suite has no equivalent for:
+ *   boundary  the cost of crossing into the module: an empty export call,
+ *             copying inputs into the heap and results out of it, and a
+ *             round trip to a worker (with and without a transfer list)
+ *   pool      encrypt and decrypt throughput of OpenABEWorkerPool for each
+ *             worker count, with the speedup over the smallest count
+ *
+ * Every result is an object with the fields of
+ * `benchmark_comprehensive --json` (name "<curve>/<operation>", times in
+ * ms), so a WASM run and a native run can be compared entry by entry with
+ * compareBenchmarkResults(). The boundary and pool groups are named
+ * "wasm/...". Pool entries also carry workers, tasks, ops_per_sec and
+ * speedup. The allocation fields are always 0, because the allocation
+ * hooks are native only.
+ *
+ * Used by openabe-benchmark.html in the browser and by
+ * run-openabe-benchmark.js in Node.
+ */
+
+const BENCHMARK_SCHEMES = ['cpabe', 'pke', 'boundary', 'pool'];
+
+const CPABE_CURVE = 'BLS12_381';
+const PKE_CURVE = 'NIST_P256';
+const CPABE_PLAINTEXT = 'This is a test message for benchmarking encryption performance in OpenABE CP-ABE';
+const PKE_PLAINTEXT = 'This is a test message for benchmarking PKE encryption performance in OpenABE';
+
+/**
+ * Statistics of one operation, computed like BenchmarkSummary::fromSamples
+ * (nearest-rank percentiles, population stddev, mean without the
+ * outliers above Q3 + 1.5 IQR)
+ */
+function summarizeSamples(name, samples) {
+  const sorted = samples.slice().sort((a, b) => a - b);
+  const n = sorted.length;
+  // ns resolution, for the per-call boundary costs
+  const round = x => Math.round(x * 1e6) / 1e6;
+  const percentile = p => sorted[Math.max(Math.ceil(p / 100 * n), 1) - 1];
+  const summary = {
+    name, count: n, mean: 0, trimmed_mean: 0, stddev: 0, min: 0, max: 0,
+    p50: 0, p95: 0, p99: 0, outliers: 0, allocs: 0, alloc_bytes: 0, peak_bytes: 0
+  };
+  if (n === 0) {
+    return summary;
+  }
+
+  const mean = sorted.reduce((s, t) => s + t, 0) / n;
+  const variance = sorted.reduce((s, t) => s + (t - mean) * (t - mean), 0) / n;
+  const fence = percentile(75) + 1.5 * (percentile(75) - percentile(25));
+  const kept = sorted.filter(t => t <= fence);
+
+  Object.assign(summary, {
+    mean: round(mean),
+    trimmed_mean: round(kept.reduce((s, t) => s + t, 0) / kept.length),
+    stddev: round(Math.sqrt(variance)),
+    min: round(sorted[0]),
+    max: round(sorted[n - 1]),
+    p50: round(percentile(50)),
+    p95: round(percentile(95)),
+    p99: round(percentile(99)),
+    outliers: n - kept.length
+  });
+  return summary;
+}
+
+/**
+ * Pair up the entries of a WASM run and a native run by name; ratio is
+ * the WASM p50 over the native p50
+ */
+function compareBenchmarkResults(wasm, native) {
+  const byName = new Map(native.map(r => [r.name, r]));
+  return wasm.filter(r => byName.has(r.name)).map(r => {
+    const base = byName.get(r.name);
+    return {
+      name: r.name,
+      native_p50: base.p50,
+      wasm_p50: r.p50,
+      ratio: base.p50 > 0 ? Math.round(r.p50 / base.p50 * 100) / 100 : null
+    };
+  });
+}
+
+class OpenABEBenchmark {
+  /**
+   * env.module          bound module from loadOpenABE()
+   * env.api             { OpenABEContext, OpenPKEContext } from openabe-wrapper.js
+   * env.createPool      workerCount => OpenABEWorkerPool, or null to skip
+   *                     the worker scenarios
+   * options.iterations  timed runs per operation (100, as natively)
+   * options.warmup      untimed runs before each operation (3)
+   * options.schemes     groups to run (BENCHMARK_SCHEMES)
+   * options.workerCounts  pool sizes to sweep ([1, 2, 4, ... cores])
+   * options.poolTasks   tasks per timed pool batch (64)
+   * options.poolRounds  timed batches per pool size (5)
+   * options.log         progress output (console.log)
+   */
+  constructor(env, options = {}) {
+    this.module = env.module;
+    this.api = env.api;
+    this.createPool = env.createPool || null;
+    this.iterations = options.iterations || 100;
+    this.warmup = options.warmup !== undefined ? options.warmup : 3;
+    this.schemes = options.schemes || BENCHMARK_SCHEMES;
+    this.workerCounts = options.workerCounts || OpenABEBenchmark.defaultWorkerCounts();
+    this.poolTasks = options.poolTasks || 64;
+    this.poolRounds = options.poolRounds || 5;
+    this.log = options.log || (line => console.log(line));
+    this.now = () => performance.now();
+  }
+
+  static defaultWorkerCounts() {
+    const cores = (typeof navigator !== 'undefined' && navigator.hardwareConcurrency) ||
+      (typeof require === 'function' ? require('os').cpus().length : 4);
+    const counts = [];
+    for (let n = 1; n < cores; n *= 2) counts.push(n);
+    counts.push(cores);
+    return counts;
+  }
+
+  /**
+   * Run the selected groups; returns every result in run order
+   */
+  async run() {
+    const results = [];
+    const groups = {
+      cpabe: () => this.runCPABE(),
+      pke: () => this.runPKE(),
+      boundary: () => this.runBoundary(),
+      pool: () => this.runPool()
+    };
+    for (const scheme of this.schemes) {
+      if (!groups[scheme]) {
+        throw new Error(`Unknown benchmark group: ${scheme}`);
+      }
+      results.push(...await groups[scheme]());
+    }
+    return results;
+  }
+
+  /**
+   * Time fn(i) over warmup + iterations runs; i < 0 for the warmup runs
+   * @private
+   */
+  async _measure(name, fn, iterations = this.iterations) {
+    const samples = [];
+    for (let i = -this.warmup; i < iterations; i++) {
+      const start = this.now();
+      await fn(i);
+      const elapsed = this.now() - start;
+      if (i >= 0) samples.push(elapsed);
+    }
+    const summary = summarizeSamples(name, samples);
+    this.log(`  ${name}: ${summary.p50} ms p50`);
+    return summary;
+  }
+
+  /**
+   * Time a synchronous call by running it `inner` times per sample, for
+   * operations too short for the timer; reports ms per call
+   * @private
+   */
+  _measureSync(name, fn, inner) {
+    const samples = [];
+    for (let i = -this.warmup; i < this.iterations; i++) {
+      const start = this.now();
+      for (let j = 0; j < inner; j++) fn();
+      const elapsed = (this.now() - start) / inner;
+      if (i >= 0) samples.push(elapsed);
+    }
+    const summary = summarizeSamples(name, samples);
+    this.log(`  ${name}: ${summary.p50} ms p50`);
+    return summary;
+  }
+
+  /**
+   * The CP-ABE operations of CPABEBenchmark, one fresh context per
+   * operation as natively
+   */
+  async runCPABE() {
+    const name = op => `${CPABE_CURVE}/${op}`;
+    const results = [];
+    this.log('=== CP-ABE Benchmark Suite ===');
+
+    results.push(this._measureSetup(name('Setup (generateParams)')));
+
+    let ctx = this._cpabe();
+    results.push(await this._measure(name('Key Generation (3 attrs)'),
+      i => ctx.keygen('attr1|attr2|attr3', `bench_key_${i}`)));
+    ctx.destroy();
+
+    ctx = this._cpabe();
+    results.push(await this._measure(name('Encryption (1 attr)'),
+      () => ctx.encrypt('attr1', CPABE_PLAINTEXT)));
+    ctx.destroy();
+
+    ctx = this._cpabe();
+    results.push(await this._measure(name('Encryption (complex policy)'),
+      () => ctx.encrypt('((attr1 and attr2) or (attr3 and attr4))', CPABE_PLAINTEXT)));
+    ctx.destroy();
+
+    ctx = this._cpabe();
+    ctx.keygen('attr1|attr2|attr3|attr4', 'bench_user');
+    let ct = ctx.encrypt('attr1 and attr2', CPABE_PLAINTEXT);
+    const expected = new TextEncoder().encode(CPABE_PLAINTEXT);
+    results.push(await this._measure(name('Decryption (matching)'), () => {
+      const pt = ctx.decrypt('bench_user', ct);
+      if (pt === null || pt.length !== expected.length || !pt.every((b, k) => b === expected[k])) {
+        throw new Error('Decryption failed');
+      }
+    }));
+    ctx.destroy();
+
+    ctx = this._cpabe();
+    ctx.keygen('attr5|attr6', 'bench_user_nomatch');
+    ct = ctx.encrypt('attr1 and attr2', CPABE_PLAINTEXT);
+    results.push(await this._measure(name('Decryption (non-matching)'), () => {
+      if (ctx.decrypt('bench_user_nomatch', ct) !== null) {
+        this.log('WARNING: Non-matching decryption unexpectedly succeeded!');
+      }
+    }));
+    ctx.destroy();
+    return results;
+  }
+
+  /**
+   * Setup times generateParams alone, without creating the context
+   * @private
+   */
+  _measureSetup(name) {
+    const samples = [];
+    for (let i = -this.warmup; i < this.iterations; i++) {
+      const ctx = new this.api.OpenABEContext(this.module, 'CP-ABE');
+      const start = this.now();
+      ctx.generateParams();
+      const elapsed = this.now() - start;
+      ctx.destroy();
+      if (i >= 0) samples.push(elapsed);
+    }
+    const summary = summarizeSamples(name, samples);
+    this.log(`  ${name}: ${summary.p50} ms p50`);
+    return summary;
+  }
+
+  /**
+   * @private
+   */
+  _cpabe() {
+    const ctx = new this.api.OpenABEContext(this.module, 'CP-ABE');
+    ctx.generateParams();
+    return ctx;
+  }
+
+  /**
+   * The PKE operations of PKEBenchmark. PKSIG is not exported by the
+   * WASM bindings, so PKSIGBenchmark has no counterpart here.
+   */
+  async runPKE() {
+    const { OpenPKEContext } = this.api;
+    const name = op => `${PKE_CURVE}/${op}`;
+    const results = [];
+    this.log('=== PKE (Public Key Encryption) Benchmark Suite ===');
+
+    let pke = new OpenPKEContext(this.module, PKE_CURVE);
+    results.push(await this._measure(name('PKE Key Generation'),
+      i => pke.keygen(`pke_user_${i}`)));
+    pke.destroy();
+
+    pke = new OpenPKEContext(this.module, PKE_CURVE);
+    pke.keygen('pke_test');
+    results.push(await this._measure(name('PKE Encryption'),
+      () => pke.encrypt('pke_test', PKE_PLAINTEXT)));
+    const ct = pke.encrypt('pke_test', PKE_PLAINTEXT);
+    results.push(await this._measure(name('PKE Decryption'), () => {
+      if (pke.decrypt('pke_test', ct) === null) {
+        throw new Error('PKE decryption failed');
+      }
+    }));
+    pke.destroy();
+    return results;
+  }
+
+  /**
+   * Costs of crossing the JS/WASM and thread boundaries
+   */
+  async runBoundary() {
+    const m = this.module;
+    const results = [];
+    this.log('=== JS/WASM Boundary ===');
+
+    results.push(this._measureSync('wasm/boundary/Export call (no-op)',
+      () => m._openabe_build_features(), 10000));
+
+    for (const [label, size] of [['1 KiB', 1024], ['64 KiB', 65536], ['1 MiB', 1 << 20]]) {
+      const data = new Uint8Array(size).fill(0x5a);
+      const inner = Math.max(1, Math.floor((1 << 22) / size));
+      results.push(this._measureSync(`wasm/boundary/Copy in ${label}`, () => {
+        const ptr = m._wasm_malloc(size);
+        m.HEAPU8.set(data, ptr);
+        m._wasm_free(ptr);
+      }, inner));
+      const ptr = m._wasm_malloc(size);
+      results.push(this._measureSync(`wasm/boundary/Copy out ${label}`,
+        () => m.HEAPU8.slice(ptr, ptr + size), inner));
+      m._wasm_free(ptr);
+    }
+
+    // the same encryption returning a copy and a view of the heap
+    const ctx = this._cpabe();
+    const payload = new Uint8Array(1 << 20).fill(0x5a);
+    results.push(await this._measure('wasm/boundary/Encrypt 1 MiB (copy out)',
+      () => ctx.encrypt('attr1', payload)));
+    results.push(await this._measure('wasm/boundary/Encrypt 1 MiB (view)',
+      () => ctx.encryptView('attr1', payload)));
+    ctx.destroy();
+
+    if (!this.createPool) {
+      this.log('  (no worker support: skipping worker round trips)');
+      return results;
+    }
+
+    const pool = this.createPool(1);
+    try {
+      const pctx = await pool.createContext('CP-ABE');
+      await pctx.generateParams();
+      results.push(await this._measure('wasm/boundary/Worker encrypt (1 attr)',
+        () => pctx.encrypt('attr1', CPABE_PLAINTEXT)));
+      results.push(await this._measure('wasm/boundary/Worker encrypt 1 MiB (clone)',
+        () => pctx.encrypt('attr1', payload)));
+      // a fresh buffer per run, since a transfer detaches it
+      const buffers = [];
+      for (let i = -this.warmup; i < this.iterations; i++) buffers.push(payload.slice());
+      results.push(await this._measure('wasm/boundary/Worker encrypt 1 MiB (transfer)',
+        i => pctx.encrypt('attr1', buffers[i + this.warmup], { transfer: true })));
+      await pctx.destroy();
+    } finally {
+      pool.terminate();
+    }
+    return results;
+  }
+
+  /**
+   * Throughput of the worker pool for each worker count. Each timed
+   * batch runs poolTasks encryptions (or decryptions) at once; untimed
+   * warmup batches let the pool replicate the context and key first.
+   */
+  async runPool() {
+    if (!this.createPool) {
+      this.log('=== Worker Pool === (no worker support: skipped)');
+      return [];
+    }
+    const results = [];
+    const baseline = {};
+    this.log('=== Worker Pool Scaling ===');
+
+    for (const workers of this.workerCounts) {
+      const pool = this.createPool(workers);
+      try {
+        const ctx = await pool.createContext('CP-ABE');
+        await ctx.generateParams();
+        await ctx.keygen('attr1|attr2|attr3|attr4', 'bench_user');
+        const encTasks = Array.from({ length: this.poolTasks },
+          () => ({ policy: 'attr1 and attr2', plaintext: CPABE_PLAINTEXT }));
+        const ciphertexts = await ctx.batchEncrypt(encTasks);
+        const decTasks = ciphertexts.map(ciphertext => ({ keyId: 'bench_user', ciphertext }));
+
+        for (const [op, batch] of [['encrypt', () => ctx.batchEncrypt(encTasks)],
+                                   ['decrypt', () => ctx.batchDecrypt(decTasks)]]) {
+          const name = `wasm/pool/CP-ABE ${op} x${workers} workers`;
+          const summary = await this._measure(name, batch, this.poolRounds);
+          const opsPerSec = summary.p50 > 0 ? this.poolTasks / (summary.p50 / 1000) : 0;
+          if (baseline[op] === undefined) baseline[op] = opsPerSec;
+          results.push(Object.assign(summary, {
+            workers,
+            tasks: this.poolTasks,
+            ops_per_sec: Math.round(opsPerSec * 100) / 100,
+            speedup: baseline[op] > 0 ? Math.round(opsPerSec / baseline[op] * 100) / 100 : 0
+          }));
+        }
+        await ctx.destroy();
+      } finally {
+        pool.terminate();
+      }
+    }
+    return results;
+  }
+}
+
+// Export for use in Node.js or browser
+if (typeof module !== 'undefined' && module.exports) {
+  module.exports = {
+    OpenABEBenchmark,
+    BENCHMARK_SCHEMES,
+    summarizeSamples,
+    compareBenchmarkResults
+  };
+}
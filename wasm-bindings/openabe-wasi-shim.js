@@ -0,0 +1,126 @@
+/**
+ * Minimal WASI (preview1) imports for running openabe.wasm outside a WASI
+ * runtime, in browsers, workers and Node alike
+ *
+ * Only what the library uses is implemented: clocks, randomness, stdout and
+ * stderr, and empty args/environment. There are no preopened directories,
+ * and every other call fails with ENOSYS. The instance's memory is only
+ * known after instantiation, so call attach(memory) before the first export.
+ */
+
+const WASI_ESUCCESS = 0;
+const WASI_EBADF = 8;
+const WASI_ENOSYS = 52;
+
+class WasiExit extends Error {
+  constructor(code) {
+    super(`WASI proc_exit(${code})`);
+    this.code = code;
+  }
+}
+
+function createWasiShim() {
+  let memory = null;
+  const decoder = new TextDecoder();
+  const pending = { 1: '', 2: '' };
+
+  const view = () => new DataView(memory.buffer);
+  const bytes = (ptr, len) => new Uint8Array(memory.buffer, ptr, len);
+
+  // line-buffered console output for stdout and stderr
+  const flush = (fd, text) => {
+    const lines = (pending[fd] + text).split('\n');
+    pending[fd] = lines.pop();
+    for (const line of lines) {
+      (fd === 2 ? console.error : console.log)(line);
+    }
+  };
+
+  const calls = {
+    args_sizes_get(argc, argvBufSize) {
+      view().setUint32(argc, 0, true);
+      view().setUint32(argvBufSize, 0, true);
+      return WASI_ESUCCESS;
+    },
+    args_get() {
+      return WASI_ESUCCESS;
+    },
+    environ_sizes_get(count, bufSize) {
+      view().setUint32(count, 0, true);
+      view().setUint32(bufSize, 0, true);
+      return WASI_ESUCCESS;
+    },
+    environ_get() {
+      return WASI_ESUCCESS;
+    },
+    clock_res_get(id, resolution) {
+      view().setBigUint64(resolution, 1000n, true);
+      return WASI_ESUCCESS;
+    },
+    clock_time_get(id, precision, time) {
+      // 0 is the realtime clock; the others count from an arbitrary origin
+      const ns = id === 0 ? BigInt(Date.now()) * 1000000n :
+        BigInt(Math.round(performance.now() * 1e6));
+      view().setBigUint64(time, ns, true);
+      return WASI_ESUCCESS;
+    },
+    random_get(buf, len) {
+      // getRandomValues refuses shared memory and more than 64 KiB at once
+      for (let done = 0; done < len; done += 65536) {
+        const chunk = new Uint8Array(Math.min(65536, len - done));
+        crypto.getRandomValues(chunk);
+        bytes(buf + done, chunk.length).set(chunk);
+      }
+      return WASI_ESUCCESS;
+    },
+    fd_write(fd, iovs, iovsLen, written) {
+      if (fd !== 1 && fd !== 2) {
+        return WASI_EBADF;
+      }
+      let total = 0, text = '';
+      for (let i = 0; i < iovsLen; i++) {
+        const ptr = view().getUint32(iovs + i * 8, true);
+        const len = view().getUint32(iovs + i * 8 + 4, true);
+        // TextDecoder does not read shared memory, so decode a copy
+        text += decoder.decode(bytes(ptr, len).slice(), { stream: true });
+        total += len;
+      }
+      flush(fd, text);
+      view().setUint32(written, total, true);
+      return WASI_ESUCCESS;
+    },
+    fd_fdstat_get(fd) {
+      return fd <= 2 ? WASI_ENOSYS : WASI_EBADF;
+    },
+    fd_prestat_get() {
+      // no preopened directories: ends libc's preopen scan
+      return WASI_EBADF;
+    },
+    fd_close() {
+      return WASI_EBADF;
+    },
+    sched_yield() {
+      return WASI_ESUCCESS;
+    },
+    proc_exit(code) {
+      throw new WasiExit(code);
+    }
+  };
+
+  // every import wasi-libc may pull in resolves, unimplemented ones to ENOSYS
+  const preview1 = new Proxy(calls, {
+    get: (target, name) => target[name] || (() => WASI_ENOSYS)
+  });
+
+  return {
+    imports: { wasi_snapshot_preview1: preview1 },
+    attach(instanceMemory) {
+      memory = instanceMemory;
+    }
+  };
+}
+
+// Export for use in Node.js or browser
+if (typeof module !== 'undefined' && module.exports) {
+  module.exports = { createWasiShim, WasiExit };
+}
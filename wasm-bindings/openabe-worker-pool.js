@@ -1,15 +1,54 @@
 /**
  * OpenABE Worker Pool
  * Manages a pool of Web Workers for parallel cryptographic operations
+ *
+ * Byte payloads travel as ArrayBuffers: results are transferred back from
+ * the workers, and inputs are structured-cloned (a single memcpy) unless
+ * the caller passes { transfer: true }, which moves the input's buffer to
+ * the worker and detaches it on the caller's side. Inputs backed by a
+ * SharedArrayBuffer are shared without a copy.
+ *
+ * Contexts are created on one worker and replicated lazily: the pool
+ * tracks which workers hold each context, its master secret and each key,
+ * routes every task to the least loaded worker that holds what the task
+ * needs, and only copies a context (or a key) to another worker once the
+ * warm workers have replicateThreshold tasks queued. Each worker has its
+ * own queue, bounded by maxQueuePerWorker; tasks that do not fit wait in
+ * the pool queue.
+ *
+ * Options:
+ *   workerCount          number of workers (hardwareConcurrency)
+ *   workerScript         worker script URL ('openabe-worker.js')
+ *   maxQueuePerWorker    tasks queued on one worker, not counting the
+ *                        running one (8)
+ *   replicateThreshold   load of the least loaded warm worker at which the
+ *                        pool replicates to a cold one (2)
+ *   replicateMasterKey   copy the master secret to other workers when
+ *                        keygen is the bottleneck; false keeps it on the
+ *                        workers it was generated or imported on (true)
  */
 
+/**
+ * Transfer list for a byte input, if the caller gave up its buffer
+ * @private
+ */
+function transferListFor(data, transfer) {
+    if (!transfer || data === null || typeof data !== 'object') return [];
+    const buffer = ArrayBuffer.isView(data) ? data.buffer : data;
+    return buffer instanceof ArrayBuffer ? [buffer] : [];
+}
+
 class OpenABEWorkerPool {
     constructor(options = {}) {
         this.workerCount = options.workerCount || navigator.hardwareConcurrency || 4;
         this.workerScript = options.workerScript || 'openabe-worker.js';
+        this.maxQueuePerWorker = options.maxQueuePerWorker || 8;
+        this.replicateThreshold = options.replicateThreshold || 2;
+        this.replicateMasterKey = options.replicateMasterKey !== false;
         this.workers = [];
         this.taskQueue = [];
         this.activeJobs = new Map();
+        this.contexts = new Map();
         this.nextContextId = 0;
 
         this._initializeWorkers();
@@ -21,92 +60,358 @@ class OpenABEWorkerPool {
      */
     _initializeWorkers() {
         for (let i = 0; i < this.workerCount; i++) {
-            const worker = new Worker(this.workerScript);
+            this.workers.push(this._spawnWorker(i));
+        }
+    }
 
-            worker.onmessage = (e) => this._handleResult(e);
-            worker.onerror = (e) => this._handleError(e);
+    /**
+     * @private
+     */
+    _spawnWorker(id) {
+        const worker = new Worker(this.workerScript);
 
-            this.workers.push({
-                id: i,
-                worker,
-                busy: false,
-                contextIds: new Set()
-            });
-        }
+        worker.onmessage = (e) => this._handleResult(e);
+        worker.onerror = (e) => this._handleError(e);
+
+        return {
+            id,
+            worker,
+            busy: false,
+            current: null,
+            queue: [],
+            contextIds: new Set()
+        };
     }
 
     /**
      * Create a new ABE context
+     *
+     * The context starts on options.replicas workers (1) and is copied to
+     * others on demand.
      */
     async createContext(scheme, options = {}) {
         const contextId = `ctx_${this.nextContextId++}`;
+        const state = {
+            scheme,
+            curve: options.curve,
+            holders: new Set(),         // workers holding the context
+            secretHolders: new Set(),   // ...and its master secret
+            keyHolders: new Map(),      // keyId -> workers holding the key
+            keyVersions: new Map(),     // keyId -> bumped on replace/delete
+            replicating: new Map(),     // workerId -> pending replication
+            mutation: Promise.resolve(),
+            generated: false,
+            imports: []                 // params given by the caller, replayed on replicas
+        };
+        this.contexts.set(contextId, state);
 
-        // Initialize context on all workers for load balancing
-        const promises = this.workers.map(w =>
+        const replicas = Math.min(Math.max(options.replicas || 1, 1), this.workers.length);
+        const targets = this._leastLoaded(this.workers, replicas);
+
+        await Promise.all(targets.map(w =>
             this._enqueue({
                 type: 'init-context',
                 contextId,
                 scheme,
                 curve: options.curve
-            }, w.id)
-        );
-
-        await Promise.all(promises);
+            }, { pin: w.id }).then(() => this._addHolder(state, contextId, w.id))
+        ));
 
         return new WorkerPoolContext(this, contextId, scheme);
     }
 
     /**
      * Enqueue a task
+     *
+     * route.pin sends it to that worker, bypassing the queue bound (used for
+     * context bookkeeping); otherwise route.needs ({ secret, keyId }) says
+     * what the worker must hold. route.onDone(result, workerId) runs before
+     * the promise resolves.
      * @private
      */
-    _enqueue(task, preferredWorkerId = null) {
+    _enqueue(message, route = {}) {
         return new Promise((resolve, reject) => {
             const jobId = crypto.randomUUID();
 
-            this.activeJobs.set(jobId, { resolve, reject });
+            this.activeJobs.set(jobId, { resolve, reject, onDone: route.onDone || null });
 
-            this.taskQueue.push({
-                ...task,
-                jobId,
-                preferredWorkerId
-            });
+            const task = {
+                message: { ...message, jobId },
+                transfer: route.transfer || [],
+                pin: route.pin !== undefined ? route.pin : null,
+                needs: route.needs || {}
+            };
 
-            this._scheduleNext();
+            if (task.pin !== null) {
+                const worker = this.workers.find(w => w.id === task.pin);
+                worker.queue.push(task);
+                this._pump(worker);
+            } else {
+                this.taskQueue.push(task);
+                this._scheduleNext();
+            }
         });
     }
 
     /**
-     * Schedule next task
+     * Tasks queued or running on a worker
      * @private
      */
-    _scheduleNext() {
-        if (this.taskQueue.length === 0) return;
+    _load(worker) {
+        return worker.queue.length + (worker.busy ? 1 : 0);
+    }
 
-        // Find free worker
-        let worker;
-        const task = this.taskQueue[0];
+    /**
+     * @private
+     */
+    _leastLoaded(workers, count) {
+        return workers.slice().sort((a, b) => this._load(a) - this._load(b)).slice(0, count);
+    }
 
-        if (task.preferredWorkerId !== null) {
-            worker = this.workers.find(
-                w => w.id === task.preferredWorkerId && !w.busy
-            );
+    /**
+     * Workers able to run a task: those holding the key it decrypts with,
+     * the master secret it derives keys from, or at least the context
+     * @private
+     */
+    _candidates(task) {
+        const state = this.contexts.get(task.message.contextId);
+        if (!state) return this.workers;
+
+        let ids = state.holders;
+        if (task.needs.keyId && state.keyHolders.has(task.needs.keyId)) {
+            ids = state.keyHolders.get(task.needs.keyId);
+        } else if (task.needs.secret && state.secretHolders.size > 0) {
+            ids = state.secretHolders;
         }
+        return this.workers.filter(w => ids.has(w.id));
+    }
 
-        if (!worker) {
-            worker = this.workers.find(w => !w.busy);
+    /**
+     * Move pool tasks onto the queues of warm workers
+     * @private
+     */
+    _scheduleNext() {
+        let i = 0;
+        while (i < this.taskQueue.length &&
+               this.workers.some(w => w.queue.length < this.maxQueuePerWorker)) {
+            const task = this.taskQueue[i];
+            const state = this.contexts.get(task.message.contextId);
+
+            if (state && state.holders.size === 0 && state.replicating.size === 0) {
+                this.taskQueue.splice(i, 1);
+                this._reject(task.message.jobId, 'Context is not loaded on any worker');
+                continue;
+            }
+
+            const candidates = this._candidates(task);
+            this._maybeReplicate(task, candidates);
+
+            const worker = this._leastLoaded(candidates, 1)[0];
+            if (worker && worker.queue.length < this.maxQueuePerWorker) {
+                this.taskQueue.splice(i, 1);
+                worker.queue.push(task);
+                this._pump(worker);
+            } else {
+                i++;
+            }
         }
+    }
 
-        if (!worker) return; // All workers busy
+    /**
+     * Send the next queued task to an idle worker
+     * @private
+     */
+    _pump(worker) {
+        if (worker.busy || worker.queue.length === 0) return;
 
-        // Remove task from queue
-        this.taskQueue.shift();
+        const task = worker.queue.shift();
 
         // Mark worker as busy
         worker.busy = true;
+        worker.current = task;
 
         // Send task to worker
-        worker.worker.postMessage(task);
+        worker.worker.postMessage(task.message, task.transfer);
+    }
+
+    /**
+     * Copy a context (or a key) to a cold worker when every warm worker
+     * is loaded past replicateThreshold
+     * @private
+     */
+    _maybeReplicate(task, candidates) {
+        const state = this.contexts.get(task.message.contextId);
+        if (!state || state.holders.size === 0) return;
+        if (task.needs.secret && !this.replicateMasterKey) return;
+
+        if (candidates.length > 0 &&
+            Math.min(...candidates.map(w => this._load(w))) < this.replicateThreshold) {
+            return;
+        }
+
+        const cold = this.workers.filter(w =>
+            !candidates.includes(w) && !state.replicating.has(w.id));
+        const target = this._leastLoaded(cold, 1)[0];
+        if (!target || this._load(target) >= this.replicateThreshold) return;
+
+        this._replicate(task.message.contextId, target, task.needs);
+    }
+
+    /**
+     * Export what a task needs from a worker holding it and import it on
+     * target. The master secret and keys are only copied when asked for.
+     * @private
+     */
+    _replicate(contextId, target, needs) {
+        const state = this.contexts.get(contextId);
+
+        const job = state.mutation.then(async () => {
+            const fresh = !state.holders.has(target.id);
+            const keyIds = needs.keyId && state.keyHolders.has(needs.keyId) ? [needs.keyId] : [];
+            const versions = keyIds.map(id => state.keyVersions.get(id));
+            const secret = !!needs.secret && this.replicateMasterKey &&
+                !state.secretHolders.has(target.id);
+
+            if (!fresh && !secret && keyIds.length === 0) return;
+
+            let sources = state.holders;
+            if (keyIds.length > 0) {
+                sources = state.keyHolders.get(keyIds[0]);
+            } else if (secret && state.secretHolders.size > 0) {
+                sources = state.secretHolders;
+            }
+            const source = this._leastLoaded(this.workers.filter(w => sources.has(w.id)), 1)[0];
+            if (!source) return;
+
+            const paramTypes = [];
+            if (state.generated && fresh) paramTypes.push('public');
+            if (state.generated && secret && state.secretHolders.has(source.id)) paramTypes.push('secret');
+
+            let exported = { params: [], keys: [] };
+            if (paramTypes.length > 0 || keyIds.length > 0) {
+                exported = await this._enqueue({
+                    type: 'export-state',
+                    contextId,
+                    paramTypes,
+                    keyIds
+                }, { pin: source.id });
+            }
+
+            const replay = state.imports.filter(entry =>
+                (fresh && entry.paramType !== 'secret') || (secret && entry.paramType === 'secret'));
+
+            await this._enqueue({
+                type: 'import-state',
+                contextId,
+                scheme: state.scheme,
+                curve: state.curve,
+                params: replay.concat(exported.params),
+                keys: exported.keys
+            }, {
+                pin: target.id,
+                transfer: exported.params.map(p => p.params).concat(exported.keys.map(k => k.blob))
+            });
+
+            if (this.contexts.get(contextId) !== state) return; // destroyed meanwhile
+
+            this._addHolder(state, contextId, target.id);
+            if (secret) state.secretHolders.add(target.id);
+            keyIds.forEach((keyId, i) => {
+                // a key replaced or deleted while it was being copied stays unregistered
+                if (state.keyVersions.get(keyId) === versions[i] && state.keyHolders.has(keyId)) {
+                    state.keyHolders.get(keyId).add(target.id);
+                }
+            });
+        }).catch(error => {
+            console.error(`Replicating ${contextId} to worker ${target.id} failed:`, error);
+        }).then(() => {
+            state.replicating.delete(target.id);
+            this._scheduleNext();
+        });
+
+        state.replicating.set(target.id, job);
+        return job;
+    }
+
+    /**
+     * Run a change to context state on every worker holding it, after
+     * replications already in flight and before any started later
+     * @private
+     */
+    _mutate(contextId, change) {
+        const state = this.contexts.get(contextId);
+        if (!state) return Promise.reject(new Error('Context not found'));
+
+        const pending = Array.from(state.replicating.values());
+        const run = state.mutation.then(() => Promise.all(pending)).then(() => change(state));
+
+        state.mutation = run.catch(() => {});
+        return run;
+    }
+
+    /**
+     * @private
+     */
+    _addHolder(state, contextId, workerId) {
+        state.holders.add(workerId);
+        const worker = this.workers.find(w => w.id === workerId);
+        if (worker) worker.contextIds.add(contextId);
+    }
+
+    /**
+     * Record that workerId now holds the only valid copy of keyId, and
+     * delete stale copies elsewhere
+     * @private
+     */
+    _registerKey(contextId, keyId, workerId) {
+        const state = this.contexts.get(contextId);
+        if (!state) return;
+
+        this._forgetKey(contextId, keyId, workerId);
+        state.keyHolders.set(keyId, new Set([workerId]));
+    }
+
+    /**
+     * @private
+     */
+    _forgetKey(contextId, keyId, keepWorkerId = null) {
+        const state = this.contexts.get(contextId);
+        if (!state) return;
+
+        state.keyVersions.set(keyId, (state.keyVersions.get(keyId) || 0) + 1);
+        for (const id of state.keyHolders.get(keyId) || []) {
+            if (id !== keepWorkerId) {
+                this._enqueue({ type: 'delete-key', contextId, keyId }, { pin: id })
+                    .catch(() => {});
+            }
+        }
+        state.keyHolders.delete(keyId);
+    }
+
+    /**
+     * Release a context on every worker holding it
+     * @private
+     */
+    _destroyContext(contextId) {
+        return this._mutate(contextId, state => {
+            this.contexts.delete(contextId);
+            return Promise.all(Array.from(state.holders).map(id => {
+                const worker = this.workers.find(w => w.id === id);
+                if (worker) worker.contextIds.delete(contextId);
+                return this._enqueue({ type: 'destroy-context', contextId }, { pin: id });
+            }));
+        });
+    }
+
+    /**
+     * @private
+     */
+    _reject(jobId, message) {
+        const job = this.activeJobs.get(jobId);
+        if (job) {
+            this.activeJobs.delete(jobId);
+            job.reject(new Error(message));
+        }
     }
 
     /**
@@ -117,23 +422,28 @@ class OpenABEWorkerPool {
         const { jobId, result, error } = event.data;
         const job = this.activeJobs.get(jobId);
 
+        // Mark worker as free
+        const worker = this.workers.find(w => w.worker === event.target);
+
         if (!job) {
             console.error('Unknown job ID:', jobId);
-            return;
-        }
-
-        if (error) {
-            job.reject(new Error(error));
         } else {
-            job.resolve(result);
+            this.activeJobs.delete(jobId);
+
+            if (error) {
+                job.reject(new Error(error));
+            } else {
+                if (job.onDone && worker) {
+                    job.onDone(result, worker.id);
+                }
+                job.resolve(result);
+            }
         }
 
-        this.activeJobs.delete(jobId);
-
-        // Mark worker as free
-        const worker = this.workers.find(w => w.worker === event.target);
         if (worker) {
             worker.busy = false;
+            worker.current = null;
+            this._pump(worker);
             this._scheduleNext();
         }
     }
@@ -151,17 +461,29 @@ class OpenABEWorkerPool {
             const oldWorker = this.workers[workerIndex];
             oldWorker.worker.terminate();
 
+            // Its contexts and keys are gone with it
+            for (const state of this.contexts.values()) {
+                state.holders.delete(oldWorker.id);
+                state.secretHolders.delete(oldWorker.id);
+                for (const holders of state.keyHolders.values()) {
+                    holders.delete(oldWorker.id);
+                }
+            }
+
+            if (oldWorker.current) {
+                this._reject(oldWorker.current.message.jobId, 'Worker failed');
+            }
+            for (const task of oldWorker.queue) {
+                if (task.pin !== null) {
+                    this._reject(task.message.jobId, 'Worker failed');
+                } else {
+                    this.taskQueue.unshift(task);
+                }
+            }
+
             // Create new worker
-            const newWorker = new Worker(this.workerScript);
-            newWorker.onmessage = (e) => this._handleResult(e);
-            newWorker.onerror = (e) => this._handleError(e);
-
-            this.workers[workerIndex] = {
-                id: oldWorker.id,
-                worker: newWorker,
-                busy: false,
-                contextIds: new Set()
-            };
+            this.workers[workerIndex] = this._spawnWorker(oldWorker.id);
+            this._scheduleNext();
         }
     }
 
@@ -174,6 +496,9 @@ class OpenABEWorkerPool {
                 type: 'keygen',
                 contextId,
                 ...task
+            }, {
+                needs: { secret: true },
+                onDone: (result, workerId) => this._registerKey(contextId, task.keyId, workerId)
             })
         );
 
@@ -183,13 +508,13 @@ class OpenABEWorkerPool {
     /**
      * Batch encryption
      */
-    async batchEncrypt(contextId, tasks) {
+    async batchEncrypt(contextId, tasks, options = {}) {
         const promises = tasks.map(task =>
             this._enqueue({
                 type: 'encrypt',
                 contextId,
                 ...task
-            })
+            }, { transfer: transferListFor(task.plaintext, options.transfer) })
         );
 
         return Promise.all(promises);
@@ -198,12 +523,15 @@ class OpenABEWorkerPool {
     /**
      * Batch decryption
      */
-    async batchDecrypt(contextId, tasks) {
+    async batchDecrypt(contextId, tasks, options = {}) {
         const promises = tasks.map(task =>
             this._enqueue({
                 type: 'decrypt',
                 contextId,
                 ...task
+            }, {
+                needs: { keyId: task.keyId },
+                transfer: transferListFor(task.ciphertext, options.transfer)
             })
         );
 
@@ -214,11 +542,19 @@ class OpenABEWorkerPool {
      * Get pool statistics
      */
     getStats() {
+        const replicas = {};
+        for (const [contextId, state] of this.contexts) {
+            replicas[contextId] = state.holders.size;
+        }
+
         return {
             totalWorkers: this.workers.length,
             busyWorkers: this.workers.filter(w => w.busy).length,
-            queueLength: this.taskQueue.length,
-            activeJobs: this.activeJobs.size
+            queueLength: this.taskQueue.length +
+                this.workers.reduce((n, w) => n + w.queue.length, 0),
+            workerQueues: this.workers.map(w => w.queue.length),
+            activeJobs: this.activeJobs.size,
+            replicas
         };
     }
 
@@ -233,6 +569,7 @@ class OpenABEWorkerPool {
         this.workers = [];
         this.taskQueue = [];
         this.activeJobs.clear();
+        this.contexts.clear();
     }
 }
 
@@ -246,10 +583,32 @@ class WorkerPoolContext {
         this.scheme = scheme;
     }
 
+    /**
+     * Generate params on one worker; the other replicas are dropped and
+     * recreated from it on demand, so every worker shares the same MPK
+     */
     async generateParams() {
-        return this.pool._enqueue({
-            type: 'generate-params',
-            contextId: this.contextId
+        return this.pool._mutate(this.contextId, async state => {
+            const [home, ...others] = this.pool._leastLoaded(
+                this.pool.workers.filter(w => state.holders.has(w.id)), this.pool.workers.length);
+
+            const result = await this.pool._enqueue({
+                type: 'generate-params',
+                contextId: this.contextId
+            }, { pin: home.id });
+
+            await Promise.all(others.map(w => {
+                state.holders.delete(w.id);
+                w.contextIds.delete(this.contextId);
+                return this.pool._enqueue({ type: 'destroy-context', contextId: this.contextId }, { pin: w.id });
+            }));
+
+            state.generated = true;
+            state.secretHolders = new Set([home.id]);
+            for (const keyId of Array.from(state.keyHolders.keys())) {
+                this.pool._forgetKey(this.contextId, keyId);
+            }
+            return result;
         });
     }
 
@@ -261,26 +620,36 @@ class WorkerPoolContext {
             keyId,
             authId,
             gid
+        }, {
+            needs: { secret: true },
+            onDone: (result, workerId) => this.pool._registerKey(this.contextId, keyId, workerId)
         });
     }
 
-    async encrypt(policy, plaintext) {
+    /**
+     * @param plaintext string, Uint8Array, ArrayBuffer or SharedArrayBuffer
+     * @param options { transfer: true } to move plaintext's buffer to the worker
+     */
+    async encrypt(policy, plaintext, options = {}) {
         const result = await this.pool._enqueue({
             type: 'encrypt',
             contextId: this.contextId,
             policy,
             plaintext
-        });
+        }, { transfer: transferListFor(plaintext, options.transfer) });
 
         return new Uint8Array(result.ciphertext);
     }
 
-    async decrypt(keyId, ciphertext) {
+    async decrypt(keyId, ciphertext, options = {}) {
         const result = await this.pool._enqueue({
             type: 'decrypt',
             contextId: this.contextId,
             keyId,
-            ciphertext: Array.from(ciphertext)
+            ciphertext
+        }, {
+            needs: { keyId },
+            transfer: transferListFor(ciphertext, options.transfer)
         });
 
         if (!result.success) {
@@ -294,42 +663,91 @@ class WorkerPoolContext {
         const result = await this.pool._enqueue({
             type: 'export-params',
             contextId: this.contextId,
-            type: 'public'
+            paramType: 'public'
         });
 
         return new Uint8Array(result.params);
     }
 
     async importPublicParams(params, authId = null) {
-        return this.pool._enqueue({
-            type: 'import-params',
-            contextId: this.contextId,
-            type: 'public',
-            params: Array.from(params),
-            authId
-        });
+        return this._importParams('public', params, authId);
     }
 
     async exportSecretParams() {
         const result = await this.pool._enqueue({
             type: 'export-params',
             contextId: this.contextId,
-            type: 'secret'
-        });
+            paramType: 'secret'
+        }, { needs: { secret: true } });
 
         return new Uint8Array(result.params);
     }
 
     async importSecretParams(params, authId = null) {
+        return this._importParams('secret', params, authId);
+    }
+
+    /**
+     * Import params on every replica and keep them for later replicas
+     * @private
+     */
+    async _importParams(paramType, params, authId) {
+        return this.pool._mutate(this.contextId, async state => {
+            const entry = { paramType, params, authId };
+            const results = await Promise.all(Array.from(state.holders).map(id =>
+                this.pool._enqueue({
+                    type: 'import-params',
+                    contextId: this.contextId,
+                    ...entry
+                }, { pin: id })
+            ));
+
+            state.imports.push(entry);
+            if (paramType === 'secret') {
+                state.secretHolders = new Set(state.holders);
+            }
+            return results[0];
+        });
+    }
+
+    /**
+     * Load a user key on one worker; it is copied to others as decryption
+     * load requires
+     */
+    async importKey(keyId, keyBlob) {
         return this.pool._enqueue({
-            type: 'import-params',
+            type: 'import-state',
             contextId: this.contextId,
-            type: 'secret',
-            params: Array.from(params),
-            authId
+            keys: [{ keyId, blob: keyBlob }]
+        }, {
+            onDone: (result, workerId) => this.pool._registerKey(this.contextId, keyId, workerId)
         });
     }
 
+    async exportKey(keyId) {
+        const result = await this.pool._enqueue({
+            type: 'export-state',
+            contextId: this.contextId,
+            keyIds: [keyId]
+        }, { needs: { keyId } });
+
+        return new Uint8Array(result.keys[0].blob);
+    }
+
+    /**
+     * Delete a key from every worker holding it
+     */
+    async deleteKey(keyId) {
+        this.pool._forgetKey(this.contextId, keyId);
+    }
+
+    /**
+     * Release the context on every worker
+     */
+    async destroy() {
+        return this.pool._destroyContext(this.contextId);
+    }
+
     /**
      * Batch key generation
      */
@@ -340,16 +758,16 @@ class WorkerPoolContext {
     /**
      * Batch encryption
      */
-    async batchEncrypt(tasks) {
-        const results = await this.pool.batchEncrypt(this.contextId, tasks);
+    async batchEncrypt(tasks, options = {}) {
+        const results = await this.pool.batchEncrypt(this.contextId, tasks, options);
         return results.map(r => new Uint8Array(r.ciphertext));
     }
 
     /**
      * Batch decryption
      */
-    async batchDecrypt(tasks) {
-        const results = await this.pool.batchDecrypt(this.contextId, tasks);
+    async batchDecrypt(tasks, options = {}) {
+        const results = await this.pool.batchDecrypt(this.contextId, tasks, options);
         return results.map(r =>
             r.success ? new Uint8Array(r.plaintext) : null
         );
@@ -3,8 +3,8 @@
  * Handles cryptographic operations in a separate thread
  */
 
-// Import the main OpenABE wrapper
-importScripts('openabe-wrapper.js');
+// Import the main OpenABE wrapper and the WASI imports it instantiates with
+importScripts('openabe-wasi-shim.js', 'openabe-wrapper.js');
 
 let wasmModule = null;
 let contexts = new Map(); // Store multiple contexts
@@ -54,11 +54,28 @@ self.onmessage = async function(e) {
                 result = await importParams(params);
                 break;
 
+            case 'export-state':
+                result = await exportState(params);
+                break;
+
+            case 'import-state':
+                result = await importState(params);
+                break;
+
+            case 'delete-key':
+                result = await deleteKey(params);
+                break;
+
+            case 'destroy-context':
+                result = await destroyContext(params);
+                break;
+
             default:
                 throw new Error(`Unknown task type: ${type}`);
         }
 
-        self.postMessage({ jobId, result });
+        // results carry ArrayBuffers, moved (not copied) to the caller
+        self.postMessage({ jobId, result }, transferables(result));
 
     } catch (error) {
         self.postMessage({
@@ -68,14 +85,38 @@ self.onmessage = async function(e) {
     }
 };
 
+// ArrayBuffers anywhere in a result, for the transfer list
+function transferables(value, list = []) {
+    if (value instanceof ArrayBuffer) {
+        list.push(value);
+    } else if (Array.isArray(value)) {
+        value.forEach(v => transferables(v, list));
+    } else if (value && typeof value === 'object' && !ArrayBuffer.isView(value)) {
+        Object.values(value).forEach(v => transferables(v, list));
+    }
+    return list;
+}
+
+// An ArrayBuffer holding exactly the bytes of a Uint8Array, without a copy
+// when the array already spans its whole buffer
+function toArrayBuffer(bytes) {
+    if (bytes.byteOffset === 0 && bytes.byteLength === bytes.buffer.byteLength &&
+        bytes.buffer instanceof ArrayBuffer) {
+        return bytes.buffer;
+    }
+    return bytes.slice().buffer;
+}
+
 // Initialize WASM module
 async function initializeWASM() {
-    // Fetch and instantiate WASM
-    const response = await fetch('openabe.wasm');
-    const wasmBytes = await response.arrayBuffer();
-    const wasmResult = await WebAssembly.instantiate(wasmBytes);
-
-    wasmModule = wasmResult.instance.exports;
+    // Fetch and instantiate the best build; the pool already runs one
+    // worker per core, so the library's own thread pool stays off here.
+    // The .wasm files sit next to this script unless the script URL names
+    // their directory, e.g. 'openabe-worker.js?base=../build-wasm-mcl/'.
+    const baseUrl = new URLSearchParams(self.location.search).get('base') || '';
+    const loaded = await loadOpenABE({ baseUrl, threads: 0 });
+
+    wasmModule = loaded.module;
     initOpenABE(wasmModule);
 }
 
@@ -119,17 +160,13 @@ async function encrypt({ contextId, policy, plaintext }) {
     const ctx = contexts.get(contextId);
     if (!ctx) throw new Error('Context not found');
 
-    // Convert plaintext string to Uint8Array if needed
-    let ptData = plaintext;
-    if (typeof plaintext === 'string') {
-        ptData = new TextEncoder().encode(plaintext);
-    }
-
-    const ciphertext = ctx.encrypt(policy, ptData);
+    // plaintext is a string, or bytes (Uint8Array, ArrayBuffer, or a view of
+    // a SharedArrayBuffer), copied once into the WASM heap
+    const view = ctx.encryptView(policy, plaintext);
 
-    // Convert to transferable array
+    // one copy out of the WASM heap, then transferred
     return {
-        ciphertext: Array.from(ciphertext),
+        ciphertext: view.slice().buffer,
         success: true
     };
 }
@@ -139,29 +176,28 @@ async function decrypt({ contextId, keyId, ciphertext }) {
     const ctx = contexts.get(contextId);
     if (!ctx) throw new Error('Context not found');
 
-    // Convert array back to Uint8Array
-    const ctData = new Uint8Array(ciphertext);
-
-    const plaintext = ctx.decrypt(keyId, ctData);
+    const view = ctx.decryptView(keyId, ciphertext);
 
-    if (plaintext === null) {
+    if (view === null) {
         return { success: false, error: 'Decryption failed' };
     }
 
+    const plaintext = view.slice().buffer;
+    view.fill(0);
     return {
-        plaintext: Array.from(plaintext),
+        plaintext,
         success: true
     };
 }
 
 // Export parameters
-async function exportParams({ contextId, type }) {
+async function exportParams({ contextId, paramType }) {
     const ctx = contexts.get(contextId);
     if (!ctx) throw new Error('Context not found');
 
     let params;
 
-    switch(type) {
+    switch(paramType) {
         case 'public':
             params = ctx.exportPublicParams();
             break;
@@ -172,23 +208,23 @@ async function exportParams({ contextId, type }) {
             params = ctx.exportGlobalParams();
             break;
         default:
-            throw new Error(`Unknown export type: ${type}`);
+            throw new Error(`Unknown export type: ${paramType}`);
     }
 
     return {
-        params: Array.from(params),
+        params: toArrayBuffer(params),
         success: true
     };
 }
 
 // Import parameters
-async function importParams({ contextId, type, params, authId }) {
+async function importParams({ contextId, paramType, params, authId }) {
     const ctx = contexts.get(contextId);
     if (!ctx) throw new Error('Context not found');
 
     const paramsData = new Uint8Array(params);
 
-    switch(type) {
+    switch(paramType) {
         case 'public':
             if (authId) {
                 ctx.importPublicParamsWithAuthority(authId, paramsData);
@@ -210,7 +246,62 @@ async function importParams({ contextId, type, params, authId }) {
             break;
 
         default:
-            throw new Error(`Unknown import type: ${type}`);
+            throw new Error(`Unknown import type: ${paramType}`);
+    }
+
+    return { success: true };
+}
+
+// Snapshot params and keys so the pool can copy them to another worker
+async function exportState({ contextId, paramTypes = [], keyIds = [] }) {
+    const params = [];
+    for (const paramType of paramTypes) {
+        const exported = await exportParams({ contextId, paramType });
+        params.push({ paramType, params: exported.params });
+    }
+
+    const ctx = contexts.get(contextId);
+    const keys = keyIds.map(keyId => ({
+        keyId,
+        blob: toArrayBuffer(ctx.exportUserKey(keyId))
+    }));
+
+    return { params, keys, success: true };
+}
+
+// Create the context if this worker does not hold it yet, then load the
+// params and keys exported from another worker (or given by the caller)
+async function importState({ contextId, scheme, curve, params = [], keys = [] }) {
+    if (!contexts.has(contextId)) {
+        await initContext({ contextId, scheme, curve });
+    }
+
+    for (const entry of params) {
+        await importParams({ contextId, ...entry });
+    }
+
+    const ctx = contexts.get(contextId);
+    for (const { keyId, blob } of keys) {
+        ctx.importUserKey(keyId, new Uint8Array(blob));
+    }
+
+    return { success: true };
+}
+
+// Delete a key (replaced or revoked elsewhere in the pool)
+async function deleteKey({ contextId, keyId }) {
+    const ctx = contexts.get(contextId);
+    if (!ctx) throw new Error('Context not found');
+
+    return { success: ctx.deleteKey(keyId) };
+}
+
+// Release a context and its keys
+async function destroyContext({ contextId }) {
+    const ctx = contexts.get(contextId);
+    if (ctx) {
+        ctx.destroy();
+        contexts.delete(contextId);
     }
 
     return { success: true };
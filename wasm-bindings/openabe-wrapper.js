@@ -74,119 +74,290 @@ class OpenABEContext {
     }
   }
 
-  encrypt(policy, plaintext) {
-    const policyStr = allocateString(this.module, policy);
+  /**
+   * Scratch output buffer in the WASM heap, grown as needed and reused
+   * across calls
+   * @private
+   */
+  _scratch(size) {
+    if (!this.scratch || this.scratch.cap < size) {
+      if (this.scratch) this.module._wasm_free(this.scratch.ptr);
+      const cap = Math.max(size, 4096);
+      this.scratch = { ptr: this.module._wasm_malloc(cap), cap };
+    }
+    return this.scratch;
+  }
 
-    let ptPtr, ptLen;
-    if (typeof plaintext === 'string') {
-      const ptStr = allocateString(this.module, plaintext);
-      ptPtr = ptStr.ptr;
-      ptLen = ptStr.len - 1; // exclude null terminator
-    } else {
-      ptLen = plaintext.length;
-      ptPtr = this.module._wasm_malloc(ptLen);
-      this.module.HEAPU8.set(plaintext, ptPtr);
+  /**
+   * Run one *_into call with the scratch buffer as output. The operation
+   * runs once: when the output does not fit, the held result is copied
+   * out with _openabe_take_result after growing the scratch buffer.
+   * @private
+   */
+  _runInto(call) {
+    const lenPtr = this.module._wasm_malloc(4);
+    try {
+      let out = this._scratch(0);
+      let size = call(out.ptr, out.cap, lenPtr);
+      if (size === -2) {
+        out = this._scratch(this.module.HEAPU32[lenPtr >> 2]);
+        size = this.module._openabe_take_result(out.ptr, out.cap, lenPtr);
+      }
+      return size < 0 ? null : readBuffer(this.module, out.ptr, size);
+    } finally {
+      this.module._wasm_free(lenPtr);
     }
+  }
 
-    // First call to get required size
-    const ctLenPtr = this.module._wasm_malloc(4);
-    this.module.HEAPU32[ctLenPtr >> 2] = 0;
-    let ctSize = this.module._openabe_encrypt(
-      this.ctx,
-      policyStr.ptr,
-      ptPtr,
-      ptLen,
-      0,
-      ctLenPtr
-    );
+  /**
+   * Copy input bytes into the WASM heap. plaintext may be a string, a
+   * Uint8Array, or a view of an ArrayBuffer or SharedArrayBuffer.
+   * @private
+   */
+  _copyIn(data) {
+    if (typeof data === 'string') {
+      const str = allocateString(this.module, data);
+      return { ptr: str.ptr, len: str.len - 1 }; // exclude null terminator
+    }
+    const bytes = data instanceof Uint8Array ? data : new Uint8Array(data);
+    const ptr = this.module._wasm_malloc(bytes.length);
+    this.module.HEAPU8.set(bytes, ptr);
+    return { ptr, len: bytes.length };
+  }
 
-    if (ctSize < 0) {
+  encrypt(policy, plaintext) {
+    const view = this.encryptView(policy, plaintext);
+    return view.slice();
+  }
+
+  /**
+   * Like encrypt(), but returns a view of the WASM heap that is only valid
+   * until the next call on this context (or any call that grows memory).
+   * Use it to copy the result once, directly where it is needed, e.g.
+   * view.slice().buffer for a postMessage transfer list.
+   */
+  encryptView(policy, plaintext) {
+    const policyStr = allocateString(this.module, policy);
+    const pt = this._copyIn(plaintext);
+    let ciphertext;
+    try {
+      ciphertext = this._runInto((out, cap, lenPtr) =>
+        this.module._openabe_encrypt_into(
+          this.ctx, policyStr.ptr, pt.ptr, pt.len, out, cap, lenPtr));
+    } finally {
+      this.module.HEAPU8.fill(0, pt.ptr, pt.ptr + pt.len);
       this.module._wasm_free(policyStr.ptr);
-      this.module._wasm_free(ptPtr);
-      this.module._wasm_free(ctLenPtr);
+      this.module._wasm_free(pt.ptr);
+    }
+    if (ciphertext === null) {
       throw new Error('Encryption failed');
     }
+    return ciphertext;
+  }
 
-    // Allocate buffer and encrypt
-    const ctPtr = this.module._wasm_malloc(ctSize);
-    this.module.HEAPU32[ctLenPtr >> 2] = ctSize;
-    const result = this.module._openabe_encrypt(
-      this.ctx,
-      policyStr.ptr,
-      ptPtr,
-      ptLen,
-      ctPtr,
-      ctLenPtr
-    );
+  decrypt(keyId, ciphertext) {
+    const view = this.decryptView(keyId, ciphertext);
+    if (view === null) {
+      return null;
+    }
+    const plaintext = view.slice();
+    view.fill(0);
+    return plaintext;
+  }
 
-    const actualCtLen = this.module.HEAPU32[ctLenPtr >> 2];
-    const ciphertext = new Uint8Array(actualCtLen);
-    ciphertext.set(readBuffer(this.module, ctPtr, actualCtLen));
+  /**
+   * Like decrypt(), but returns a view of the WASM heap with the same
+   * lifetime rules as encryptView().
+   */
+  decryptView(keyId, ciphertext) {
+    const keyIdStr = allocateString(this.module, keyId);
+    const ct = this._copyIn(ciphertext);
+    try {
+      return this._runInto((out, cap, lenPtr) =>
+        this.module._openabe_decrypt_into(
+          this.ctx, keyIdStr.ptr, ct.ptr, ct.len, out, cap, lenPtr));
+    } finally {
+      this.module._wasm_free(keyIdStr.ptr);
+      this.module._wasm_free(ct.ptr);
+    }
+  }
 
-    // Cleanup
-    this.module._wasm_free(policyStr.ptr);
-    this.module._wasm_free(ptPtr);
-    this.module._wasm_free(ctPtr);
-    this.module._wasm_free(ctLenPtr);
+  /**
+   * Pack inputs (strings or bytes) back to back in the WASM heap, with a
+   * uint32 length table, for the batch calls
+   * @private
+   */
+  _copyInBatch(items) {
+    const encoder = new TextEncoder();
+    const encoded = items.map(item =>
+      typeof item === 'string' ? encoder.encode(item) :
+        (item instanceof Uint8Array ? item : new Uint8Array(item)));
+    const total = encoded.reduce((n, bytes) => n + bytes.length, 0);
+    const ptr = this.module._wasm_malloc(Math.max(total, 1));
+    const lens = this.module._wasm_malloc(Math.max(items.length, 1) * 4);
+
+    let offset = ptr;
+    encoded.forEach((bytes, i) => {
+      this.module.HEAPU8.set(bytes, offset);
+      this.module.HEAPU32[(lens >> 2) + i] = bytes.length;
+      offset += bytes.length;
+    });
+    return { ptr, lens, len: total, count: items.length };
+  }
 
-    if (result < 0) {
-      throw new Error('Encryption failed');
+  /**
+   * @private
+   */
+  _freeBatch(batch) {
+    this.module.HEAPU8.fill(0, batch.ptr, batch.ptr + batch.len);
+    this.module._wasm_free(batch.ptr);
+    this.module._wasm_free(batch.lens);
+  }
+
+  /**
+   * Run a batch call and split its packed output; failed entries are null
+   * @private
+   */
+  _runBatch(count, call) {
+    const outLens = this.module._wasm_malloc(Math.max(count, 1) * 4);
+    try {
+      const packed = this._runInto((out, cap, lenPtr) => call(out, cap, outLens, lenPtr));
+      if (packed === null) {
+        return null;
+      }
+      const results = [];
+      let offset = 0;
+      for (let i = 0; i < count; i++) {
+        const len = this.module.HEAPU32[(outLens >> 2) + i];
+        if (len === 0xFFFFFFFF) {
+          results.push(null);
+          continue;
+        }
+        results.push(packed.slice(offset, offset + len));
+        offset += len;
+      }
+      packed.fill(0);
+      return results;
+    } finally {
+      this.module._wasm_free(outLens);
     }
+  }
 
-    return ciphertext;
+  /**
+   * Encrypt many plaintexts under one policy with a single call into the
+   * module
+   */
+  encryptBatch(policy, plaintexts) {
+    const policyStr = allocateString(this.module, policy);
+    const batch = this._copyInBatch(plaintexts);
+    let ciphertexts;
+    try {
+      ciphertexts = this._runBatch(batch.count, (out, cap, outLens, lenPtr) =>
+        this.module._openabe_encrypt_batch(this.ctx, policyStr.ptr, batch.ptr,
+          batch.lens, batch.count, out, cap, outLens, lenPtr));
+    } finally {
+      this._freeBatch(batch);
+      this.module._wasm_free(policyStr.ptr);
+    }
+    if (ciphertexts === null) {
+      throw new Error('Encryption failed');
+    }
+    return ciphertexts;
   }
 
-  decrypt(keyId, ciphertext) {
+  /**
+   * Decrypt many ciphertexts with one key with a single call into the
+   * module; entries that fail to decrypt are null
+   */
+  decryptBatch(keyId, ciphertexts) {
     const keyIdStr = allocateString(this.module, keyId);
-    const ctPtr = this.module._wasm_malloc(ciphertext.length);
-    this.module.HEAPU8.set(ciphertext, ctPtr);
-
-    // First call to get required size
-    const ptLenPtr = this.module._wasm_malloc(4);
-    this.module.HEAPU32[ptLenPtr >> 2] = 0;
-    let ptSize = this.module._openabe_decrypt(
-      this.ctx,
-      keyIdStr.ptr,
-      ctPtr,
-      ciphertext.length,
-      0,
-      ptLenPtr
-    );
-
-    if (ptSize < 0) {
+    const batch = this._copyInBatch(ciphertexts);
+    let plaintexts;
+    try {
+      plaintexts = this._runBatch(batch.count, (out, cap, outLens, lenPtr) =>
+        this.module._openabe_decrypt_batch(this.ctx, keyIdStr.ptr, batch.ptr,
+          batch.lens, batch.count, out, cap, outLens, lenPtr));
+    } finally {
+      this._freeBatch(batch);
       this.module._wasm_free(keyIdStr.ptr);
-      this.module._wasm_free(ctPtr);
-      this.module._wasm_free(ptLenPtr);
-      return null; // Decryption failed
     }
+    if (plaintexts === null) {
+      throw new Error('Decryption failed');
+    }
+    return plaintexts;
+  }
 
-    // Allocate buffer and decrypt
-    const ptPtr = this.module._wasm_malloc(ptSize);
-    this.module.HEAPU32[ptLenPtr >> 2] = ptSize;
-    const result = this.module._openabe_decrypt(
-      this.ctx,
-      keyIdStr.ptr,
-      ctPtr,
-      ciphertext.length,
-      ptPtr,
-      ptLenPtr
-    );
+  /**
+   * Feed one block to a stream call and copy out what it produced
+   * @private
+   */
+  _streamStep(data, call) {
+    const block = this._copyIn(data === undefined ? new Uint8Array(0) : data);
+    try {
+      const view = this._runInto((out, cap, lenPtr) => call(block.ptr, block.len, out, cap, lenPtr));
+      if (view === null) {
+        return null;
+      }
+      const result = view.slice();
+      view.fill(0);
+      return result;
+    } finally {
+      this.module.HEAPU8.fill(0, block.ptr, block.ptr + block.len);
+      this.module._wasm_free(block.ptr);
+    }
+  }
 
-    const actualPtLen = this.module.HEAPU32[ptLenPtr >> 2];
-    const plaintext = new Uint8Array(actualPtLen);
-    plaintext.set(readBuffer(this.module, ptPtr, actualPtLen));
+  /**
+   * Chunked encryption with bounded memory. Returns { header, update(data),
+   * final() }; the ciphertext is header followed by every update() and
+   * final() output, in order. One encryption stream at a time per context.
+   */
+  encryptStream(policy, chunkSize = 0) {
+    const policyStr = allocateString(this.module, policy);
+    let header;
+    try {
+      header = this._runInto((out, cap, lenPtr) =>
+        this.module._openabe_encrypt_init(this.ctx, policyStr.ptr, chunkSize, out, cap, lenPtr));
+      header = header && header.slice();
+    } finally {
+      this.module._wasm_free(policyStr.ptr);
+    }
+    if (header === null) {
+      throw new Error('Failed to start encryption stream');
+    }
 
-    // Cleanup
-    this.module._wasm_free(keyIdStr.ptr);
-    this.module._wasm_free(ctPtr);
-    this.module._wasm_free(ptPtr);
-    this.module._wasm_free(ptLenPtr);
+    const check = result => {
+      if (result === null) throw new Error('Encryption failed');
+      return result;
+    };
+    return {
+      header,
+      update: data => check(this._streamStep(data, (ptr, len, out, cap, lenPtr) =>
+        this.module._openabe_encrypt_update(this.ctx, ptr, len, out, cap, lenPtr))),
+      final: () => check(this._streamStep(undefined, (ptr, len, out, cap, lenPtr) =>
+        this.module._openabe_encrypt_final(this.ctx, out, cap, lenPtr)))
+    };
+  }
 
-    if (result < 0) {
-      return null;
+  /**
+   * Chunked decryption. Returns { update(data), final() }, each giving the
+   * plaintext of the chunks verified so far, or null once verification
+   * fails. One decryption stream at a time per context.
+   */
+  decryptStream(keyId) {
+    const keyIdStr = allocateString(this.module, keyId);
+    const result = this.module._openabe_decrypt_init(this.ctx, keyIdStr.ptr);
+    this.module._wasm_free(keyIdStr.ptr);
+    if (result !== 0) {
+      throw new Error('Failed to start decryption stream');
     }
 
-    return plaintext;
+    return {
+      update: data => this._streamStep(data, (ptr, len, out, cap, lenPtr) =>
+        this.module._openabe_decrypt_update(this.ctx, ptr, len, out, cap, lenPtr)),
+      final: () => this._streamStep(undefined, (ptr, len, out, cap, lenPtr) =>
+        this.module._openabe_decrypt_final(this.ctx, out, cap, lenPtr))
+    };
   }
 
   exportPublicParams() {
@@ -412,6 +583,11 @@ class OpenABEContext {
   }
 
   destroy() {
+    if (this.scratch) {
+      this.module.HEAPU8.fill(0, this.scratch.ptr, this.scratch.ptr + this.scratch.cap);
+      this.module._wasm_free(this.scratch.ptr);
+      this.scratch = null;
+    }
     if (this.ctx !== 0) {
       this.module._openabe_destroy_context(this.ctx);
       this.ctx = 0;
@@ -419,6 +595,138 @@ class OpenABEContext {
   }
 }
 
+/**
+ * WebAssembly features of the current engine that decide which build runs
+ */
+function detectWasmFeatures() {
+  // smallest modules using a v128 instruction and an atomic load from
+  // shared memory
+  const simd = new Uint8Array([0, 97, 115, 109, 1, 0, 0, 0, 1, 5, 1, 96, 0, 1, 123, 3,
+    2, 1, 0, 10, 10, 1, 8, 0, 65, 0, 253, 15, 253, 98, 11]);
+  const threads = new Uint8Array([0, 97, 115, 109, 1, 0, 0, 0, 1, 4, 1, 96, 0, 0, 3, 2,
+    1, 0, 5, 4, 1, 3, 1, 1, 10, 11, 1, 9, 0, 65, 0, 254, 16, 2, 0, 26, 11]);
+  const validate = bytes => {
+    try {
+      return WebAssembly.validate(bytes);
+    } catch (e) {
+      return false;
+    }
+  };
+
+  // browsers only hand out SharedArrayBuffer to cross-origin isolated pages
+  const sharedMemory = typeof SharedArrayBuffer !== 'undefined' &&
+    (typeof crossOriginIsolated === 'undefined' || crossOriginIsolated);
+
+  return {
+    simd: validate(simd),
+    threads: validate(threads) && sharedMemory
+  };
+}
+
+/**
+ * Pick the fastest build the engine can run: openabe-simd-threads.wasm
+ * (see build-openabe-wasm-mcl.sh --variant=simd-threads) or the generic
+ * openabe.wasm
+ */
+function selectOpenABEBuild(baseUrl = '') {
+  const features = detectWasmFeatures();
+  if (features.simd && features.threads) {
+    return { url: baseUrl + 'openabe-simd-threads.wasm', variant: 'simd-threads', threads: true };
+  }
+  return { url: baseUrl + 'openabe.wasm', variant: 'generic', threads: false };
+}
+
+/**
+ * The exports of an instance plus the heap views and string helpers the
+ * context classes use. The views are recreated whenever memory grows.
+ */
+function bindOpenABEModule(exports, memory) {
+  const module = Object.create(exports);
+  const encoder = new TextEncoder();
+  const decoder = new TextDecoder();
+  let buffer = null, heapU8 = null, heapU32 = null;
+  const views = () => {
+    if (memory.buffer !== buffer) {
+      buffer = memory.buffer;
+      heapU8 = new Uint8Array(buffer);
+      heapU32 = new Uint32Array(buffer);
+    }
+  };
+
+  Object.defineProperty(module, 'HEAPU8', { get: () => (views(), heapU8) });
+  Object.defineProperty(module, 'HEAPU32', { get: () => (views(), heapU32) });
+  module.lengthBytesUTF8 = str => encoder.encode(str).length;
+  module.stringToUTF8 = (str, ptr, maxBytes) => {
+    const written = encoder.encodeInto(str, module.HEAPU8.subarray(ptr, ptr + maxBytes - 1)).written;
+    module.HEAPU8[ptr + written] = 0;
+  };
+  module.UTF8ToString = ptr => {
+    const heap = module.HEAPU8;
+    let end = ptr;
+    while (heap[end] !== 0) end++;
+    // TextDecoder does not read shared memory, so decode a copy
+    return decoder.decode(heap.slice(ptr, end));
+  };
+  return module;
+}
+
+/**
+ * Fetch and instantiate the best OpenABE build.
+ *
+ * options.baseUrl  directory holding the .wasm files
+ * options.imports  host imports (default: the minimal WASI shim from
+ *                  openabe-wasi-shim.js, when it is loaded; for the threads
+ *                  build they must also provide wasi.thread-spawn)
+ * options.variant  'generic' to skip the threads build
+ * options.threads  library thread pool size for the threads build
+ *                  (hardwareConcurrency - 1; 0 keeps every loop on the caller)
+ *
+ * Falls back to the generic build if the threads build fails to
+ * instantiate. Returns { module, memory, variant }, where module is the
+ * export object the context classes take.
+ */
+async function loadOpenABE(options = {}) {
+  const baseUrl = options.baseUrl || '';
+  const build = options.variant === 'generic' ?
+    { url: baseUrl + 'openabe.wasm', variant: 'generic', threads: false } :
+    selectOpenABEBuild(baseUrl);
+
+  // the shim is a global in pages and workers, a module in Node
+  const wasiShim = typeof createWasiShim === 'function' ? createWasiShim :
+    (typeof require === 'function' ? require('./openabe-wasi-shim.js').createWasiShim : null);
+  const shim = !options.imports && wasiShim ? wasiShim() : null;
+  const imports = Object.assign({}, shim ? shim.imports : options.imports);
+  let memory = null;
+  if (build.threads) {
+    // the threads build imports its memory so every thread shares it
+    memory = new WebAssembly.Memory({ initial: 256, maximum: 65536, shared: true });
+    imports.env = Object.assign({}, imports.env, { memory });
+  }
+
+  let result;
+  try {
+    const response = await fetch(build.url);
+    result = await WebAssembly.instantiate(await response.arrayBuffer(), imports);
+  } catch (e) {
+    if (!build.threads) throw e;
+    return loadOpenABE(Object.assign({}, options, { variant: 'generic' }));
+  }
+
+  const exports = result.instance.exports;
+  memory = memory || exports.memory;
+  if (shim) shim.attach(memory);
+  // reactor modules run their static constructors here
+  if (exports._initialize) exports._initialize();
+
+  const module = bindOpenABEModule(exports, memory);
+  if (build.threads && module._openabe_set_thread_count) {
+    const cores = (typeof navigator !== 'undefined' && navigator.hardwareConcurrency) || 1;
+    module._openabe_set_thread_count(options.threads !== undefined ? options.threads : cores - 1);
+  }
+
+  return { module, memory, variant: build.variant };
+}
+
 /**
  * Initialize OpenABE library
  */
@@ -674,6 +982,10 @@ if (typeof module !== 'undefined' && module.exports) {
     OpenABEContext,
     OpenPKEContext,
     initOpenABE,
-    shutdownOpenABE
+    shutdownOpenABE,
+    detectWasmFeatures,
+    selectOpenABEBuild,
+    bindOpenABEModule,
+    loadOpenABE
   };
 }
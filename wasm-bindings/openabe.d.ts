@@ -19,6 +19,10 @@ export interface OpenABEModule {
   _openabe_generate_params(ctx: number): number;
   _openabe_keygen(ctx: number, attributes: number, key_id: number): number;
 
+  // Build variant (OPENABE_WASM_* bits) and library thread pool size
+  _openabe_build_features(): number;
+  _openabe_set_thread_count(num_threads: number): number;
+
   // Encryption/Decryption
   _openabe_encrypt(
     ctx: number,
@@ -38,6 +42,68 @@ export interface OpenABEModule {
     pt_len: number
   ): number;
 
+  // Single-pass variants: return the length written, -1 on error, or -2 if
+  // out_cap is too small (the length is stored at out_len and the result is
+  // held for _openabe_take_result)
+  _openabe_encrypt_into(
+    ctx: number,
+    policy: number,
+    plaintext: number,
+    pt_len: number,
+    out: number,
+    out_cap: number,
+    out_len: number
+  ): number;
+
+  _openabe_decrypt_into(
+    ctx: number,
+    key_id: number,
+    ciphertext: number,
+    ct_len: number,
+    out: number,
+    out_cap: number,
+    out_len: number
+  ): number;
+
+  _openabe_take_result(out: number, out_cap: number, out_len: number): number;
+
+  // Batches: inputs packed back to back with a uint32 length table; outputs
+  // packed the same way, OPENABE_BATCH_FAILED (0xFFFFFFFF) marking failures
+  _openabe_encrypt_batch(
+    ctx: number,
+    policy: number,
+    plaintexts: number,
+    in_lens: number,
+    count: number,
+    out: number,
+    out_cap: number,
+    out_lens: number,
+    out_len: number
+  ): number;
+
+  _openabe_decrypt_batch(
+    ctx: number,
+    key_id: number,
+    ciphertexts: number,
+    in_lens: number,
+    count: number,
+    out: number,
+    out_cap: number,
+    out_lens: number,
+    out_len: number
+  ): number;
+
+  // Streaming (chunked) encryption and decryption
+  _openabe_encrypt_init(ctx: number, policy: number, chunk_size: number,
+                        out: number, out_cap: number, out_len: number): number;
+  _openabe_encrypt_update(ctx: number, data: number, len: number,
+                          out: number, out_cap: number, out_len: number): number;
+  _openabe_encrypt_final(ctx: number, out: number, out_cap: number, out_len: number): number;
+  _openabe_decrypt_init(ctx: number, key_id: number): number;
+  _openabe_decrypt_update(ctx: number, data: number, len: number,
+                          out: number, out_cap: number, out_len: number): number;
+  _openabe_decrypt_final(ctx: number, out: number, out_cap: number, out_len: number): number;
+
   // Import/Export parameters
   _openabe_export_public_params(ctx: number, output: number, output_len: number): number;
   _openabe_import_public_params(ctx: number, params: number, params_len: number): number;
@@ -46,6 +112,7 @@ export interface OpenABEModule {
 
   // WASM memory access
   HEAPU8: Uint8Array;
+  HEAPU32: Uint32Array;
   UTF8ToString(ptr: number): string;
   stringToUTF8(str: string, outPtr: number, maxBytesToWrite: number): void;
   lengthBytesUTF8(str: string): number;
@@ -64,9 +131,34 @@ export class OpenABEContext {
 
   keygen(attributes: string, keyId: string): void;
 
-  encrypt(policy: string, plaintext: string | Uint8Array): Uint8Array;
+  encrypt(policy: string, plaintext: string | Uint8Array | ArrayBuffer): Uint8Array;
 
-  decrypt(keyId: string, ciphertext: Uint8Array): Uint8Array | null;
+  /** View into the WASM heap, valid until the next call on this context */
+  encryptView(policy: string, plaintext: string | Uint8Array | ArrayBuffer): Uint8Array;
+
+  decrypt(keyId: string, ciphertext: Uint8Array | ArrayBuffer): Uint8Array | null;
+
+  /** View into the WASM heap, valid until the next call on this context */
+  decryptView(keyId: string, ciphertext: Uint8Array | ArrayBuffer): Uint8Array | null;
+
+  /** Many plaintexts under one policy, in one call into the module */
+  encryptBatch(policy: string, plaintexts: Array<string | Uint8Array | ArrayBuffer>): Uint8Array[];
+
+  /** Many ciphertexts with one key; null where decryption failed */
+  decryptBatch(keyId: string, ciphertexts: Array<Uint8Array | ArrayBuffer>): Array<Uint8Array | null>;
+
+  /** Chunked encryption: header, then every update() and final() output */
+  encryptStream(policy: string, chunkSize?: number): {
+    header: Uint8Array;
+    update(data: string | Uint8Array | ArrayBuffer): Uint8Array;
+    final(): Uint8Array;
+  };
+
+  /** Chunked decryption; null once a chunk fails to verify */
+  decryptStream(keyId: string): {
+    update(data: Uint8Array | ArrayBuffer): Uint8Array | null;
+    final(): Uint8Array | null;
+  };
 
   exportPublicParams(): Uint8Array;
 
@@ -88,3 +180,41 @@ export function initOpenABE(module: OpenABEModule): void;
  * Shutdown the OpenABE library
  */
 export function shutdownOpenABE(module: OpenABEModule): void;
+
+export interface WasmFeatures {
+  simd: boolean;
+  /** shared memory and atomics, usable on this page */
+  threads: boolean;
+}
+
+export interface OpenABEBuild {
+  url: string;
+  variant: 'generic' | 'simd-threads';
+  threads: boolean;
+}
+
+/**
+ * WebAssembly features of the current engine
+ */
+export function detectWasmFeatures(): WasmFeatures;
+
+/**
+ * The fastest build the engine can run
+ */
+export function selectOpenABEBuild(baseUrl?: string): OpenABEBuild;
+
+/**
+ * Instance exports plus the heap views and string helpers of OpenABEModule
+ */
+export function bindOpenABEModule(exports: WebAssembly.Exports, memory: WebAssembly.Memory): OpenABEModule;
+
+/**
+ * Fetch and instantiate the best build, falling back to the generic one.
+ * Without imports, the minimal WASI shim (openabe-wasi-shim.js) is used.
+ */
+export function loadOpenABE(options?: {
+  baseUrl?: string;
+  imports?: WebAssembly.Imports;
+  variant?: 'generic';
+  threads?: number;
+}): Promise<{ module: OpenABEModule; memory: WebAssembly.Memory; variant: 'generic' | 'simd-threads' }>;
@@ -0,0 +1,188 @@
+#!/usr/bin/env node
+/**
+ * Node runner for the OpenABE WebAssembly benchmarks (openabe-benchmark.js)
+ *
+ * Loads openabe.wasm (or openabe-simd-threads.wasm) from --wasm-dir through
+ * openabe-wrapper.js. The worker pool scenarios run openabe-worker.js
+ * unchanged on worker_threads: this file doubles as the thread bootstrap,
+ * giving the worker script the parts of the Web Worker API it uses (self,
+ * postMessage, onmessage, importScripts, location, fetch).
+ *
+ * Usage:
+ *   node run-openabe-benchmark.js --wasm-dir ../build-wasm-mcl -n 50 \
+ *       --json wasm.json --native native.json
+ *
+ * where native.json comes from `benchmark_comprehensive --json native.json`.
+ */
+
+const fs = require('fs');
+const path = require('path');
+const vm = require('vm');
+const os = require('os');
+const { Worker: ThreadWorker, isMainThread, parentPort, workerData } = require('worker_threads');
+
+/**
+ * fetch() for file paths, relative to dir; URLs still go to the network
+ */
+function installFileFetch(dir) {
+  const networkFetch = globalThis.fetch;
+  globalThis.fetch = async url => {
+    if (/^https?:/.test(url)) {
+      return networkFetch(url);
+    }
+    const bytes = fs.readFileSync(path.resolve(dir, url));
+    return { ok: true, arrayBuffer: async () => bytes };
+  };
+}
+
+if (!isMainThread) {
+  // Web Worker environment for openabe-worker.js
+  const dir = path.dirname(workerData.script);
+  globalThis.self = globalThis;
+  self.location = { search: workerData.search };
+  self.postMessage = (message, transfer) => parentPort.postMessage(message, transfer);
+  self.importScripts = (...scripts) => {
+    for (const script of scripts) {
+      const file = path.resolve(dir, script);
+      vm.runInThisContext(fs.readFileSync(file, 'utf8'), { filename: file });
+    }
+  };
+  installFileFetch(dir);
+  parentPort.on('message', data => self.onmessage && self.onmessage({ data }));
+  self.importScripts(path.basename(workerData.script));
+  return;
+}
+
+/**
+ * Web Worker on top of a worker thread, as OpenABEWorkerPool expects
+ */
+class NodeWebWorker {
+  constructor(url) {
+    const [script, query] = String(url).split('?');
+    this.onmessage = null;
+    this.onerror = null;
+    this.thread = new ThreadWorker(__filename, {
+      workerData: {
+        script: path.resolve(__dirname, script),
+        search: query ? `?${query}` : ''
+      }
+    });
+    this.thread.on('message', data => this.onmessage && this.onmessage({ data, target: this }));
+    this.thread.on('error', error =>
+      this.onerror && this.onerror({ message: error.message, error, target: this }));
+  }
+
+  postMessage(message, transfer = []) {
+    this.thread.postMessage(message, transfer);
+  }
+
+  terminate() {
+    this.thread.terminate();
+  }
+}
+
+function usage() {
+  console.log(`Usage: node ${path.basename(__filename)} [options]
+
+Options:
+  --wasm-dir DIR        Directory holding openabe.wasm (default: this directory)
+  --variant generic     Skip the simd-threads build even if the engine runs it
+  -n, --iterations N    Timed runs per operation (default: 100)
+  -w, --warmup N        Untimed runs before each operation (default: 3)
+  -s, --scheme LIST     Comma-separated groups: ${BENCHMARK_SCHEMES.join(', ')} or all
+  -t, --workers LIST    Worker counts for the pool scaling (default: 1, 2, 4, ... cores)
+  --tasks N             Tasks per timed pool batch (default: 64)
+  --json FILE           Write the results as JSON (same fields as benchmark_comprehensive --json)
+  --native FILE         Compare p50s with a benchmark_comprehensive --json file
+  -h, --help            Show this help message`);
+}
+
+const { OpenABEContext, OpenPKEContext, initOpenABE, shutdownOpenABE,
+  detectWasmFeatures, loadOpenABE } = require('./openabe-wrapper.js');
+const { OpenABEWorkerPool } = require('./openabe-worker-pool.js');
+const { OpenABEBenchmark, BENCHMARK_SCHEMES, compareBenchmarkResults } =
+  require('./openabe-benchmark.js');
+
+async function main(argv) {
+  const options = {};
+  let wasmDir = __dirname, variant, jsonFile, nativeFile;
+  for (let i = 0; i < argv.length; i++) {
+    const arg = argv[i];
+    const next = () => {
+      if (i + 1 >= argv.length) throw new Error(`${arg} needs a value`);
+      return argv[++i];
+    };
+    if (arg === '--wasm-dir') {
+      wasmDir = path.resolve(next());
+    } else if (arg === '--variant') {
+      variant = next();
+    } else if (arg === '-n' || arg === '--iterations') {
+      options.iterations = parseInt(next(), 10);
+    } else if (arg === '-w' || arg === '--warmup') {
+      options.warmup = parseInt(next(), 10);
+    } else if (arg === '-s' || arg === '--scheme') {
+      const list = next();
+      if (list !== 'all') options.schemes = list.split(',');
+    } else if (arg === '-t' || arg === '--workers') {
+      options.workerCounts = next().split(',').map(n => parseInt(n, 10));
+    } else if (arg === '--tasks') {
+      options.poolTasks = parseInt(next(), 10);
+    } else if (arg === '--json') {
+      jsonFile = next();
+    } else if (arg === '--native') {
+      nativeFile = next();
+    } else if (arg === '-h' || arg === '--help') {
+      usage();
+      return 0;
+    } else {
+      console.error(`Unknown option: ${arg}`);
+      usage();
+      return 1;
+    }
+  }
+
+  installFileFetch(wasmDir);
+  const loaded = await loadOpenABE({ baseUrl: wasmDir + path.sep, variant });
+  initOpenABE(loaded.module);
+
+  const features = detectWasmFeatures();
+  console.log('========================================');
+  console.log('  OpenABE WebAssembly Benchmark');
+  console.log('========================================');
+  console.log(`  Runtime:   Node ${process.version} (${os.arch()})`);
+  console.log(`  Build:     ${loaded.variant} (simd: ${features.simd}, threads: ${features.threads})`);
+  console.log(`  Cores:     ${os.cpus().length}`);
+  console.log();
+
+  // workers load the build from wasmDir, like the page passes ?base=
+  const workerScript = `openabe-worker.js?base=${encodeURIComponent(wasmDir + path.sep)}`;
+  globalThis.Worker = NodeWebWorker;
+  const bench = new OpenABEBenchmark({
+    module: loaded.module,
+    api: { OpenABEContext, OpenPKEContext },
+    createPool: workerCount => new OpenABEWorkerPool({ workerCount, workerScript })
+  }, options);
+  const results = await bench.run();
+  shutdownOpenABE(loaded.module);
+
+  if (jsonFile) {
+    fs.writeFileSync(jsonFile, JSON.stringify(results, null, 2) + '\n');
+    console.log(`Wrote ${results.length} results to ${jsonFile}`);
+  }
+  if (nativeFile) {
+    const rows = compareBenchmarkResults(results, JSON.parse(fs.readFileSync(nativeFile, 'utf8')));
+    console.log();
+    console.log('=== WASM vs Native (p50, ms) ===');
+    console.log('Operation'.padEnd(45) + 'Native'.padStart(12) + 'WASM'.padStart(12) + 'Ratio'.padStart(10));
+    for (const row of rows) {
+      console.log(row.name.padEnd(45) + String(row.native_p50).padStart(12) +
+        String(row.wasm_p50).padStart(12) + (row.ratio === null ? 'N/A' : `${row.ratio}x`).padStart(10));
+    }
+  }
+  return 0;
+}
+
+main(process.argv.slice(2)).then(code => process.exit(code), error => {
+  console.error(error.stack || String(error));
+  process.exit(1);
+});
@@ -7,9 +7,11 @@
 
 #include <cstring>
 #include <string>
+#include <vector>
 #include <memory>
 #include "openabe/openabe.h"
 #include "openabe/zcrypto_box.h"
+#include "wasm-bindings.h"
 
 // Export functions with C linkage for WASM
 extern "C" {
@@ -43,6 +45,31 @@ int openabe_shutdown() {
     }
 }
 
+int openabe_build_features() {
+    int features = 0;
+#if defined(__wasm_simd128__)
+    features |= OPENABE_WASM_SIMD128;
+#endif
+#if defined(__wasm_atomics__)
+    features |= OPENABE_WASM_THREADS;
+#endif
+#if defined(MCL_SIZEOF_UNIT) && MCL_SIZEOF_UNIT == 8
+    features |= OPENABE_WASM_WIDE_LIMBS;
+#endif
+    return features;
+}
+
+int openabe_set_thread_count(int num_threads) {
+#if defined(__wasm_atomics__)
+    // the runtime cannot report the core count, so the host passes it in
+    oabe::OpenABEThreadPool::setDefaultSize(num_threads > 0 ? num_threads : 0);
+    return 0;
+#else
+    (void) num_threads;
+    return -1;
+#endif
+}
+
 // Create a new crypto context
 // scheme_id: "CP-ABE", "KP-ABE", or "PK"
 void* openabe_create_context(const char* scheme_id) {
@@ -186,6 +213,277 @@ int openabe_decrypt(void* ctx, const char* key_id,
     }
 }
 
+// Output of the last *_into call that did not fit the caller's buffer
+static thread_local std::string pending_result;
+
+static void clear_pending_result() {
+    // may hold a plaintext
+    if (!pending_result.empty()) {
+        memset(&pending_result[0], 0, pending_result.size());
+        pending_result.clear();
+    }
+}
+
+static int write_or_hold(std::string& result, char* out, size_t out_cap,
+                         size_t* out_len) {
+    clear_pending_result();
+    if (out_len != nullptr) {
+        *out_len = result.size();
+    }
+    if (out != nullptr && out_cap >= result.size()) {
+        memcpy(out, result.data(), result.size());
+        return result.size();
+    }
+    pending_result.swap(result);
+    return -2;
+}
+
+// Encrypt once into a caller-allocated buffer (see wasm-bindings.h)
+int openabe_encrypt_into(void* ctx, const char* policy,
+                         const char* plaintext, size_t pt_len,
+                         char* out, size_t out_cap, size_t* out_len) {
+    if (ctx == nullptr || policy == nullptr || plaintext == nullptr) return -1;
+
+    try {
+        oabe::OpenABECryptoContext* context = static_cast<oabe::OpenABECryptoContext*>(ctx);
+        std::string pt(plaintext, pt_len);
+        std::string ct;
+
+        context->encrypt(std::string(policy), pt, ct);
+        memset(&pt[0], 0, pt.size());
+        return write_or_hold(ct, out, out_cap, out_len);
+    } catch (...) {
+        return -1; // Error
+    }
+}
+
+// Decrypt once into a caller-allocated buffer (see wasm-bindings.h)
+int openabe_decrypt_into(void* ctx, const char* key_id,
+                         const char* ciphertext, size_t ct_len,
+                         char* out, size_t out_cap, size_t* out_len) {
+    if (ctx == nullptr || key_id == nullptr || ciphertext == nullptr) return -1;
+
+    try {
+        oabe::OpenABECryptoContext* context = static_cast<oabe::OpenABECryptoContext*>(ctx);
+        std::string ct(ciphertext, ct_len);
+        std::string pt;
+
+        if (!context->decrypt(std::string(key_id), ct, pt)) {
+            return -1; // Decryption failed
+        }
+        int rc = write_or_hold(pt, out, out_cap, out_len);
+        if (!pt.empty()) {
+            memset(&pt[0], 0, pt.size());
+        }
+        return rc;
+    } catch (...) {
+        return -1; // Error
+    }
+}
+
+// Copy out (and drop) the result held by the last *_into call
+int openabe_take_result(char* out, size_t out_cap, size_t* out_len) {
+    if (out == nullptr || out_cap < pending_result.size()) return -1;
+
+    size_t len = pending_result.size();
+    memcpy(out, pending_result.data(), len);
+    clear_pending_result();
+    if (out_len != nullptr) {
+        *out_len = len;
+    }
+    return len;
+}
+
+// Pack the results of a batch back to back (see wasm-bindings.h)
+static int write_batch(const std::vector<std::string>& results,
+                       const std::vector<bool>& ok, char* out, size_t out_cap,
+                       uint32_t* out_lens, size_t* out_len) {
+    size_t total = 0;
+    for (size_t i = 0; i < results.size(); i++) {
+        if (ok[i]) total += results[i].size();
+    }
+    std::string packed;
+    packed.reserve(total);
+    for (size_t i = 0; i < results.size(); i++) {
+        if (ok[i]) {
+            packed += results[i];
+        }
+        if (out_lens != nullptr) {
+            out_lens[i] = ok[i] ? (uint32_t) results[i].size() : OPENABE_BATCH_FAILED;
+        }
+    }
+    int rc = write_or_hold(packed, out, out_cap, out_len);
+    if (!packed.empty()) {
+        memset(&packed[0], 0, packed.size());
+    }
+    return rc;
+}
+
+static void split_batch(const char* data, const uint32_t* lens, size_t count,
+                        std::vector<std::string>& items) {
+    items.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        items.emplace_back(data, lens[i]);
+        data += lens[i];
+    }
+}
+
+// Encrypt count plaintexts under one policy in a single call
+int openabe_encrypt_batch(void* ctx, const char* policy,
+                          const char* plaintexts, const uint32_t* in_lens,
+                          size_t count, char* out, size_t out_cap,
+                          uint32_t* out_lens, size_t* out_len) {
+    if (ctx == nullptr || policy == nullptr) return -1;
+    if (count > 0 && (plaintexts == nullptr || in_lens == nullptr)) return -1;
+
+    std::vector<std::string> pts, cts;
+    try {
+        oabe::OpenABECryptoContext* context = static_cast<oabe::OpenABECryptoContext*>(ctx);
+        split_batch(plaintexts, in_lens, count, pts);
+        context->encryptBatch(std::string(policy), pts, cts);
+    } catch (...) {
+        cts.clear();
+    }
+    for (auto& pt : pts) {
+        if (!pt.empty()) memset(&pt[0], 0, pt.size());
+    }
+    if (cts.size() != count) {
+        return -1; // Error
+    }
+    return write_batch(cts, std::vector<bool>(count, true), out, out_cap,
+                       out_lens, out_len);
+}
+
+// Decrypt count ciphertexts with one key in a single call
+int openabe_decrypt_batch(void* ctx, const char* key_id,
+                          const char* ciphertexts, const uint32_t* in_lens,
+                          size_t count, char* out, size_t out_cap,
+                          uint32_t* out_lens, size_t* out_len) {
+    if (ctx == nullptr || key_id == nullptr) return -1;
+    if (count > 0 && (ciphertexts == nullptr || in_lens == nullptr)) return -1;
+
+    try {
+        oabe::OpenABECryptoContext* context = static_cast<oabe::OpenABECryptoContext*>(ctx);
+        std::vector<std::string> cts, pts;
+        std::vector<bool> decrypted;
+        split_batch(ciphertexts, in_lens, count, cts);
+        context->decryptBatch(std::string(key_id), cts, pts, decrypted);
+
+        int rc = write_batch(pts, decrypted, out, out_cap, out_lens, out_len);
+        for (auto& pt : pts) {
+            if (!pt.empty()) memset(&pt[0], 0, pt.size());
+        }
+        return rc;
+    } catch (...) {
+        return -1; // Error
+    }
+}
+
+// Start a chunked encryption; the output is the ABE header
+int openabe_encrypt_init(void* ctx, const char* policy, size_t chunk_size,
+                         char* out, size_t out_cap, size_t* out_len) {
+    if (ctx == nullptr || policy == nullptr) return -1;
+
+    try {
+        oabe::OpenABECryptoContext* context = static_cast<oabe::OpenABECryptoContext*>(ctx);
+        std::string ct;
+        if (chunk_size > 0) {
+            context->encryptInit(std::string(policy), ct, chunk_size);
+        } else {
+            context->encryptInit(std::string(policy), ct);
+        }
+        return write_or_hold(ct, out, out_cap, out_len);
+    } catch (...) {
+        return -1; // Error
+    }
+}
+
+// Feed plaintext; returns the chunks sealed so far
+int openabe_encrypt_update(void* ctx, const char* data, size_t len,
+                           char* out, size_t out_cap, size_t* out_len) {
+    if (ctx == nullptr || (data == nullptr && len > 0)) return -1;
+
+    try {
+        oabe::OpenABECryptoContext* context = static_cast<oabe::OpenABECryptoContext*>(ctx);
+        std::string block(data != nullptr ? data : "", len), ct;
+        context->encryptUpdate(block, ct);
+        if (!block.empty()) {
+            memset(&block[0], 0, block.size());
+        }
+        return write_or_hold(ct, out, out_cap, out_len);
+    } catch (...) {
+        return -1; // Error
+    }
+}
+
+// Seal the last chunk
+int openabe_encrypt_final(void* ctx, char* out, size_t out_cap, size_t* out_len) {
+    if (ctx == nullptr) return -1;
+
+    try {
+        oabe::OpenABECryptoContext* context = static_cast<oabe::OpenABECryptoContext*>(ctx);
+        std::string ct;
+        context->encryptFinalize(ct);
+        return write_or_hold(ct, out, out_cap, out_len);
+    } catch (...) {
+        return -1; // Error
+    }
+}
+
+// Start a chunked decryption with key_id
+int openabe_decrypt_init(void* ctx, const char* key_id) {
+    if (ctx == nullptr || key_id == nullptr) return -1;
+
+    try {
+        oabe::OpenABECryptoContext* context = static_cast<oabe::OpenABECryptoContext*>(ctx);
+        context->decryptInit(std::string(key_id));
+        return 0; // Success
+    } catch (...) {
+        return -1; // Error
+    }
+}
+
+// Feed ciphertext; returns the plaintext of the chunks verified so far
+int openabe_decrypt_update(void* ctx, const char* data, size_t len,
+                           char* out, size_t out_cap, size_t* out_len) {
+    if (ctx == nullptr || (data == nullptr && len > 0)) return -1;
+
+    try {
+        oabe::OpenABECryptoContext* context = static_cast<oabe::OpenABECryptoContext*>(ctx);
+        std::string block(data != nullptr ? data : "", len), pt;
+        if (!context->decryptUpdate(block, pt)) {
+            return -1; // Decryption failed
+        }
+        int rc = write_or_hold(pt, out, out_cap, out_len);
+        if (!pt.empty()) {
+            memset(&pt[0], 0, pt.size());
+        }
+        return rc;
+    } catch (...) {
+        return -1; // Error
+    }
+}
+
+// Verify the last chunk and return its plaintext
+int openabe_decrypt_final(void* ctx, char* out, size_t out_cap, size_t* out_len) {
+    if (ctx == nullptr) return -1;
+
+    try {
+        oabe::OpenABECryptoContext* context = static_cast<oabe::OpenABECryptoContext*>(ctx);
+        std::string pt;
+        if (!context->decryptFinalize(pt)) {
+            return -1; // Decryption failed
+        }
+        int rc = write_or_hold(pt, out, out_cap, out_len);
+        if (!pt.empty()) {
+            memset(&pt[0], 0, pt.size());
+        }
+        return rc;
+    } catch (...) {
+        return -1; // Error
+    }
+}
+
 // Export public parameters
 int openabe_export_public_params(void* ctx, char* output, size_t* output_len) {
     if (ctx == nullptr) return -1;
@@ -6,6 +6,7 @@
 #define WASM_BINDINGS_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -19,6 +20,16 @@ void wasm_free(void* ptr);
 int openabe_init(void);
 int openabe_shutdown(void);
 
+// Build variant: bit mask of the OPENABE_WASM_* features compiled in
+#define OPENABE_WASM_SIMD128     0x1
+#define OPENABE_WASM_THREADS     0x2
+#define OPENABE_WASM_WIDE_LIMBS  0x4   // MCL built with 64-bit limbs
+int openabe_build_features(void);
+
+// Size the library thread pool (threads build; 0 runs all loops on the
+// calling thread). Returns -1 when the module was built without threads.
+int openabe_set_thread_count(int num_threads);
+
 // Context management
 void* openabe_create_context(const char* scheme_id);
 void openabe_destroy_context(void* ctx);
@@ -39,6 +50,48 @@ int openabe_decrypt(void* ctx, const char* key_id,
                     const char* ciphertext, size_t ct_len,
                     char* plaintext_out, size_t* pt_len);
 
+// Single-pass variants writing into a caller-allocated (wasm_malloc) buffer
+// of out_cap bytes. Return the output length, -1 on error, or -2 with
+// *out_len set to the required size when out_cap is too small; the result
+// is then held until openabe_take_result() copies it out, so the operation
+// never runs twice.
+int openabe_encrypt_into(void* ctx, const char* policy,
+                         const char* plaintext, size_t pt_len,
+                         char* out, size_t out_cap, size_t* out_len);
+int openabe_decrypt_into(void* ctx, const char* key_id,
+                         const char* ciphertext, size_t ct_len,
+                         char* out, size_t out_cap, size_t* out_len);
+int openabe_take_result(char* out, size_t out_cap, size_t* out_len);
+
+// Batches in one call: the count inputs are packed back to back in the
+// input buffer with their lengths in in_lens, and the outputs come back
+// packed the same way with their lengths in out_lens. A ciphertext that
+// fails to decrypt gets OPENABE_BATCH_FAILED as its length and takes no
+// space. Return values and out/out_cap/out_len work as for the *_into
+// calls (out_lens is filled even when -2 is returned).
+#define OPENABE_BATCH_FAILED 0xFFFFFFFFu
+int openabe_encrypt_batch(void* ctx, const char* policy,
+                          const char* plaintexts, const uint32_t* in_lens,
+                          size_t count, char* out, size_t out_cap,
+                          uint32_t* out_lens, size_t* out_len);
+int openabe_decrypt_batch(void* ctx, const char* key_id,
+                          const char* ciphertexts, const uint32_t* in_lens,
+                          size_t count, char* out, size_t out_cap,
+                          uint32_t* out_lens, size_t* out_len);
+
+// Streaming (chunked) encryption and decryption with bounded memory; one
+// stream of each kind per context. Each call returns the output produced
+// so far, as the *_into calls do. chunk_size 0 uses the default.
+int openabe_encrypt_init(void* ctx, const char* policy, size_t chunk_size,
+                         char* out, size_t out_cap, size_t* out_len);
+int openabe_encrypt_update(void* ctx, const char* data, size_t len,
+                           char* out, size_t out_cap, size_t* out_len);
+int openabe_encrypt_final(void* ctx, char* out, size_t out_cap, size_t* out_len);
+int openabe_decrypt_init(void* ctx, const char* key_id);
+int openabe_decrypt_update(void* ctx, const char* data, size_t len,
+                           char* out, size_t out_cap, size_t* out_len);
+int openabe_decrypt_final(void* ctx, char* out, size_t out_cap, size_t* out_len);
+
 // Import/Export parameters
 int openabe_export_public_params(void* ctx, char* output, size_t* output_len);
 int openabe_import_public_params(void* ctx, const char* params, size_t params_len);